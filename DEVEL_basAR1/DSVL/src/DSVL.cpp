@@ -108,6 +108,16 @@ LONGLONG DSVL_VideoSource::GetCurrentTimestamp()
 	return((GM(p_graphManager))->GetCurrentTimestamp());
 }
 
+HRESULT DSVL_VideoSource::SetCameraParameterN(int interface_type, long Property, double dValue)
+{
+	return((GM(p_graphManager))->SetCameraParameterN((CP_INTERFACE)interface_type, Property, dValue));
+}
+
+HRESULT DSVL_VideoSource::SetCameraParameterToDefault(int interface_type, long Property, bool bAuto)
+{
+	return((GM(p_graphManager))->SetCameraParameterToDefault((CP_INTERFACE)interface_type, Property, bAuto));
+}
+
 
 HRESULT DSVL_VideoSource::Run()
 {
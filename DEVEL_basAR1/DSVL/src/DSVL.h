@@ -88,6 +88,11 @@ public:
 								  PIXELFORMAT* pixel_format);
 	LONGLONG GetCurrentTimestamp();
 
+	// camera parameters: interface_type 0 for IAMCameraControl, 1 for IAMVideoProcAmp
+	// (CP_INTERFACE of DSVL_GraphManager.h), dValue in [0..1] of the range, set manual
+	HRESULT SetCameraParameterN(int interface_type, long Property, double dValue);
+	HRESULT SetCameraParameterToDefault(int interface_type, long Property, bool bAuto = true);
+
 	// media flow control
 	HRESULT Run();
 	HRESULT Pause();
@@ -114,6 +114,30 @@ HRESULT MatchMediaTypes(IPin *pin, DS_MEDIA_FORMAT *mf, AM_MEDIA_TYPE *req_mt)
 	return(E_FAIL);
 }
 
+// -----------------------------------------------------------------------------------------------------------------
+HRESULT NegotiatePixelFormat(IPin *pin, DS_MEDIA_FORMAT *mf, AM_MEDIA_TYPE *req_mt)
+// resolves PIXELFORMAT_AUTO: the first of the pin's native YUY2, NV12 and MJPG types that matches
+// the requested size and frame rate, so that detection gets the luma without a colour conversion.
+// mf->pixel_format is what the sample grabber is to take; req_mt is the pin's type to set.
+{
+	const GUID native[3] = { MEDIASUBTYPE_YUY2, MEDIASUBTYPE_NV12_, MEDIASUBTYPE_MJPG_ };
+	GUID requested = mf->subtype;
+	for(int i=0; i<3; i++)
+	{
+		mf->subtype = native[i];
+		if(SUCCEEDED(MatchMediaTypes(pin, mf, req_mt)))
+		{
+			mf->subtype = requested;
+			// the MJPEG decompressor only delivers RGB
+			mf->pixel_format = (i == 2 ? PIXELFORMAT_RGB32 : MEDIASUBTYPEtoPX(native[i]));
+			return(S_OK);
+		}
+	}
+	mf->subtype = requested;
+	mf->pixel_format = PIXELFORMAT_RGB32;
+	return(E_FAIL);
+}
+
 // -----------------------------------------------------------------------------------------------------------------
 const char* VideoInputDeviceToString(VIDEO_INPUT_DEVICE device)
 {
@@ -262,13 +286,11 @@ HRESULT DSVL_GraphManager::DisableMemoryBuffer()
 		std::map<unsigned long, MemoryBufferEntry>::iterator iter;
 		for(iter = mb.begin();
 			iter != mb.end();
-			iter++)
+			)
 		{
 			// ignore use_count
 			(*iter).second.media_sample->Release();
-			std::map<unsigned long, MemoryBufferEntry>::iterator iter2 =
-				mb.erase(iter);
-			iter = iter2;
+			iter = mb.erase(iter);
 		}
 	}
 
@@ -563,18 +585,18 @@ HRESULT WINAPI DSVL_GraphManager::SampleCB(double SampleTime, IMediaSample *pSam
 	CAutoLock cObjectLock(&m_CSec);
 	if(mb.size() > 0) // constantly clean up (mb)
 	{
+		// samples still checked out by a client are kept
 		std::map<unsigned long, MemoryBufferEntry>::iterator iter;
 		for(iter = mb.begin();
 			iter != mb.end();
-			iter++)
+			)
 		{
 			if((*iter).second.use_count == 0)
 			{
 				(*iter).second.media_sample->Release();
-				std::map<unsigned long, MemoryBufferEntry>::iterator iter2 =
-					mb.erase(iter);
-				iter = iter2;
+				iter = mb.erase(iter);
 			}
+			else iter++;
 		}
 	}
 
@@ -594,7 +616,7 @@ HRESULT WINAPI DSVL_GraphManager::SampleCB(double SampleTime, IMediaSample *pSam
 		(unsigned long(sample_counter),mb_entry));
 
 	// flipping
-	if(media_format.flipH || media_format.flipV)
+	if((media_format.flipH || media_format.flipV) && media_format.pixel_format == PIXELFORMAT_RGB32)
 	{
 		BYTE *pBuffer;
 		if(SUCCEEDED(pSample->GetPointer(&pBuffer)))
@@ -871,7 +893,7 @@ HRESULT DSVL_GraphManager::BuildGraphFromXMLHandle(TiXmlHandle xml_h)
 		sprintf(px_temp,"PIXELFORMAT_%s",e_pixel_format->Value());
 		mf.pixel_format = StringToPX(px_temp);
 
-		if(mf.pixel_format == PIXELFORMAT_RGB32)
+		if(mf.pixel_format == PIXELFORMAT_RGB32 || mf.pixel_format == PIXELFORMAT_AUTO)
 		{
 			if((e_pixel_format->Attribute("flip_h") != NULL) &&
 				(_strnicmp("true",_bstr_t(e_pixel_format->Attribute("flip_h")),strlen("true")) == 0))
@@ -904,7 +926,7 @@ HRESULT DSVL_GraphManager::BuildGraphFromXMLHandle(TiXmlHandle xml_h)
 		sprintf(px_temp,"PIXELFORMAT_%s",e_pixel_format->Value());
 		mf.pixel_format = StringToPX(px_temp);
 
-		if(mf.pixel_format == PIXELFORMAT_RGB32)
+		if(mf.pixel_format == PIXELFORMAT_RGB32 || mf.pixel_format == PIXELFORMAT_AUTO)
 		{
 			if((e_pixel_format->Attribute("flip_h") != NULL) &&
 				(_strnicmp("true",_bstr_t(e_pixel_format->Attribute("flip_h")),strlen("true")) == 0))
@@ -969,15 +991,6 @@ HRESULT DSVL_GraphManager::BuildGraphFromXMLHandle(TiXmlHandle xml_h)
 		return hr;
 	if(FAILED(pSampleGrabber->QueryInterface(IID_ISampleGrabber,(void**)&sampleGrabber))) return(hr);
 
-	AM_MEDIA_TYPE _mt;
-	ZeroMemory(&_mt,sizeof(AM_MEDIA_TYPE));
-	_mt.majortype = MEDIATYPE_Video;
-	_mt.formattype = GUID_NULL;
-	_mt.subtype = PXtoMEDIASUBTYPE(mf.pixel_format);
-	hr = sampleGrabber->SetMediaType(&_mt);
-	if (FAILED(hr))
-		return hr;
-
 	// Obtain interfaces for media control
 	hr = graphBuilder->QueryInterface(IID_IMediaControl,(LPVOID *) &mediaControl);
 	if (FAILED(hr))
@@ -1034,6 +1047,9 @@ HRESULT DSVL_GraphManager::BuildGraphFromXMLHandle(TiXmlHandle xml_h)
 		// ---------------------------------------------------------------------------------
 		if(pinSupportsDV)
 		{
+			// the DV decoder delivers YUY2 natively
+			if(mf.pixel_format == PIXELFORMAT_AUTO) mf.pixel_format = PIXELFORMAT_YUY2;
+
 			CComPtr<IIPDVDec> pDVDec;
 			// insert a DV decoder (CLSID_DVVideoCodec) into our graph.
 			if(FAILED(hr = CoCreateInstance(CLSID_DVVideoCodec, NULL, CLSCTX_INPROC_SERVER, IID_IBaseFilter, (void**)&(pVideoDecoder)))) return(hr);
@@ -1079,6 +1095,17 @@ HRESULT DSVL_GraphManager::BuildGraphFromXMLHandle(TiXmlHandle xml_h)
 		// ---------------------------------------------------------------------------------
 		else // !pinSupportsDV
 		{
+			if(mf.pixel_format == PIXELFORMAT_AUTO)
+			{
+				AM_MEDIA_TYPE mt;
+				if(SUCCEEDED(NegotiatePixelFormat(capturePin, &mf, &mt)))
+				{
+					pStreamConfig->SetFormat(&mt);
+					FreeMediaType(mt);
+					mf.inputFlags &= ~WDM_MATCH_FORMAT; // already set, with the size and frame rate
+				}
+			}
+
 			if(mf.inputFlags & WDM_MATCH_FORMAT)
 			{
 				AM_MEDIA_TYPE mt;
@@ -1169,6 +1196,17 @@ HRESULT DSVL_GraphManager::BuildGraphFromXMLHandle(TiXmlHandle xml_h)
 	// ###########################################################################################
 
 
+	// the sample grabber's type is only known once PIXELFORMAT_AUTO has been resolved
+	if(mf.pixel_format == PIXELFORMAT_AUTO) mf.pixel_format = PIXELFORMAT_RGB32;
+	AM_MEDIA_TYPE _mt;
+	ZeroMemory(&_mt,sizeof(AM_MEDIA_TYPE));
+	_mt.majortype = MEDIATYPE_Video;
+	_mt.formattype = GUID_NULL;
+	_mt.subtype = PXtoMEDIASUBTYPE(mf.pixel_format);
+	hr = sampleGrabber->SetMediaType(&_mt);
+	if (FAILED(hr))
+		return hr;
+
 	// OT-FIX 11/22/04 [thp]
 	hr = graphBuilder->AddFilter(pSampleGrabber, L"Sample Grabber");
 
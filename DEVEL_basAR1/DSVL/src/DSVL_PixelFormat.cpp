@@ -41,12 +41,21 @@ const char PIXELFORMAT_names[PIXELFORMAT_ENUM_MAX][32] =
   "PIXELFORMAT_RGB24",
   "PIXELFORMAT_RGB32",
   "PIXELFORMAT_INVALID",
-  "PIXELFORMAT_QUERY" };
+  "PIXELFORMAT_QUERY",
+  "PIXELFORMAT_NV12",
+  "PIXELFORMAT_AUTO" };
+
+// Not in the DirectShow 9.0 headers; FOURCC subtypes as uuids.h builds them.
+const GUID MEDIASUBTYPE_NV12_ = {0x3231564E,0x0000,0x0010,{0x80,0x00,0x00,0xAA,0x00,0x38,0x9B,0x71}};
+const GUID MEDIASUBTYPE_MJPG_ = {0x47504A4D,0x0000,0x0010,{0x80,0x00,0x00,0xAA,0x00,0x38,0x9B,0x71}};
 
 int PXBitsPerPixel(PIXELFORMAT format)
 {
 	switch(format)
 	{
+	case PIXELFORMAT_UYVY:  return(16);
+	case PIXELFORMAT_YUY2:  return(16);
+	case PIXELFORMAT_NV12:  return(12);
 	case PIXELFORMAT_RGB565:return(16);
 	case PIXELFORMAT_RGB555:return(16);
 	case PIXELFORMAT_RGB24: return(24);
@@ -84,6 +93,7 @@ GUID PXtoMEDIASUBTYPE(PIXELFORMAT format)
 	case PIXELFORMAT_RGB555:return(MEDIASUBTYPE_RGB555);
 	case PIXELFORMAT_RGB24: return(MEDIASUBTYPE_RGB24);
 	case PIXELFORMAT_RGB32: return(MEDIASUBTYPE_RGB32);
+	case PIXELFORMAT_NV12:  return(MEDIASUBTYPE_NV12_);
 	};
 	return(CLSID_NULL);
 }
@@ -97,6 +107,7 @@ PIXELFORMAT MEDIASUBTYPEtoPX(GUID format)
 	if(format == MEDIASUBTYPE_RGB555) return(PIXELFORMAT_RGB555);
 	if(format == MEDIASUBTYPE_RGB24)  return(PIXELFORMAT_RGB24);
 	if(format == MEDIASUBTYPE_RGB32)  return(PIXELFORMAT_RGB32);
+	if(format == MEDIASUBTYPE_NV12_)  return(PIXELFORMAT_NV12);
 	return(PIXELFORMAT_UNKNOWN);	
 }
 
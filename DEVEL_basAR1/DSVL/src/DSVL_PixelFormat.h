@@ -36,6 +36,9 @@
 //-----------------------------------------------------------------------------------------------------------
 #include "DSVL_PixelFormatTypes.h"
 
+extern const GUID MEDIASUBTYPE_NV12_;
+extern const GUID MEDIASUBTYPE_MJPG_;
+
 // format conversion helpers
 int PXBitsPerPixel(PIXELFORMAT format);
 WORD PXtoOpenGL(PIXELFORMAT format, bool bWIN32format = true);
@@ -65,6 +68,12 @@ PIXELFORMAT StringToPX(char* formatName);
 [5] MEDIASUBTYPE_RGB24	 RGB, 24 bits per pixel. Uncompressed RGB samples.  
 [6] MEDIASUBTYPE_RGB32	 RGB, 32 bits per pixel. Uncompressed RGB samples. Do not use the alpha bits 
 						 with this media type. (Compare MEDIASUBTYPE_ARGB32.)  
+[9] MEDIASUBTYPE_NV12    NV12 format data. A planar YUV 4:2:0 format. A full-resolution plane of Y
+						 samples, one byte each, followed by a half-resolution plane of interleaved
+						 U and V samples. The Y plane alone is a greyscale image.
+[10] (none)              PIXELFORMAT_AUTO is resolved while the graph is built: the first of the
+						 source's native YUY2, NV12 and MJPG outputs at the requested size, else RGB32.
+						 MJPG is decoded by the system MJPEG decompressor, which delivers RGB32.
 */
 
 #endif
\ No newline at end of file
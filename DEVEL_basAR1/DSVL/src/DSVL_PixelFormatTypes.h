@@ -43,7 +43,9 @@ typedef enum _PIXELFORMAT
 	PIXELFORMAT_RGB32	 = 6,
 	PIXELFORMAT_INVALID  = 7, 
 	PIXELFORMAT_QUERY	 = 8,
-	PIXELFORMAT_ENUM_MAX = 9
+	PIXELFORMAT_NV12	 = 9,
+	PIXELFORMAT_AUTO	 = 10, // negotiated with the source, see NegotiatePixelFormat()
+	PIXELFORMAT_ENUM_MAX = 11
 } PIXELFORMAT;
 
 #endif
\ No newline at end of file
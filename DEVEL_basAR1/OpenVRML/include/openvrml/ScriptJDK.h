@@ -39,12 +39,18 @@ namespace openvrml {
     class ScriptJDK : public script {
         // Shared by all JDK script objects
         static JavaVM * d_jvm;
-        static JNIEnv * d_env;
+        static size_t d_instances;
 
         jclass d_class;
         jobject d_object;
         jmethodID d_processEventsID, d_processEventID, d_eventsProcessedID;
 
+        // Run on the script thread; the counts are under its lock.
+        bool d_deferred;
+        size_t d_jobs;
+        bool d_running;
+        bool d_reading;
+
     public:
         ScriptJDK(script_node & scriptNode,
                   const char * className, const char * classDir);
@@ -57,7 +63,16 @@ namespace openvrml {
         virtual void events_processed(double timestamp);
         virtual void shutdown(double timestamp);
 
+        virtual bool outputs_ready() throw ();
+        virtual void outputs_done() throw ();
+
+        static void run_deferred() throw ();
+
     private:
+        static JNIEnv * env() throw ();
+
+        void post(double timeStamp, const std::string & fname,
+                  size_t argc, const field_value * const argv[]);
         void activate(double timeStamp, const std::string & fname,
                       size_t argc, const field_value * const argv[]);
     };
@@ -640,6 +640,9 @@ namespace openvrml {
         const mat4f inverse() const throw ();
         const mat4f transpose() const throw ();
         float det() const throw ();
+
+        void transform_points(const vec3f * points, size_t n,
+                              vec3f * result) const throw ();
     };
 
     bool operator==(const mat4f & lhs, const mat4f & rhs)
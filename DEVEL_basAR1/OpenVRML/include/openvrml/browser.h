@@ -25,8 +25,11 @@
 #   include <cstddef>
 #   include <list>
 #   include <map>
+#   include <vector>
 #   include <openvrml/common.h>
+#   include <openvrml/doc.h>
 #   include <openvrml/node_class_ptr.h>
+#   include <openvrml/node_type_ptr.h>
 #   include <openvrml/script.h>
 
 namespace openvrml {
@@ -41,6 +44,7 @@ namespace openvrml {
     class ProtoNode;
     class scene;
     class Vrml97RootScope;
+    class compiled_scene;
     class null_node_class;
     class null_node_type;
 
@@ -48,6 +52,7 @@ namespace openvrml {
         friend class Vrml97Parser;
         friend class ProtoNodeClass;
         friend class Vrml97RootScope;
+        friend class compiled_scene;
 
     public:
         enum cb_reason {
@@ -62,6 +67,8 @@ namespace openvrml {
         std::auto_ptr<null_node_type> null_node_type_;
         typedef std::map<std::string, node_class_ptr> node_class_map_t;
         node_class_map_t node_class_map;
+        resource_loader::mutex node_class_map_mutex;
+        mutable std::vector<node_type_ptr> vrml97_types_;
         script_node_class script_node_class_;
         scene * scene_;
         node_ptr default_viewpoint;
@@ -71,11 +78,11 @@ namespace openvrml {
         bind_stack_t navigation_info_stack;
         std::list<node *> navigation_infos;
         std::list<node *> scoped_lights;
-        std::list<script_node *> scripts;
-        std::list<node *> timers;
-        std::list<node *> audio_clips;
-        std::list<node *> movies;
-        std::list<ProtoNode *> proto_node_list;
+        std::vector<script_node *> scripts;
+        std::vector<node *> timers;
+        std::vector<node *> audio_clips;
+        std::vector<node *> movies;
+        std::vector<ProtoNode *> proto_node_list;
         bool modified_;
         bool new_view;
         double delta_time;
@@ -86,6 +93,7 @@ namespace openvrml {
         struct event {
             double timestamp;
             field_value * value;
+            bool owns_value;
             node_ptr to_node;
             std::string to_eventin;
         };
@@ -99,6 +107,14 @@ namespace openvrml {
         size_t first_event;
         size_t last_event;
 
+        enum { max_free_values = 32 };
+        std::vector<field_value *> free_values[field_value::mfvec3f_id + 1];
+
+        const field_value * delivered_value;
+        bool delivered_value_orphaned;
+
+        void free_event_value(field_value * value) throw ();
+
     public:
         static double current_time() throw ();
 
@@ -131,15 +147,23 @@ namespace openvrml {
         void create_vrml_from_url(const std::vector<std::string> & url,
                                   const node_ptr & node,
                                   const std::string & event);
+        void compile_vrml(const std::string & url, std::ostream & out);
 
         void add_world_changed_callback(scene_cb);
 
         void sensitive_event(node * object, double timestamp,
                              bool is_over, bool is_active, double * point);
 
+        field_value * event_value(const field_value & value)
+            throw (std::bad_alloc);
         void queue_event(double timestamp, field_value * value,
                          const node_ptr & toNode,
-                         const std::string & to_eventin);
+                         const std::string & to_eventin,
+                         bool owns_value = true);
+        void queue_event(double timestamp, const field_value & value,
+                         const node_ptr & toNode,
+                         const std::string & to_eventin)
+            throw (std::bad_alloc);
 
         bool events_pending();
 
@@ -233,6 +257,7 @@ namespace openvrml {
               scene * parent = 0)
             throw (invalid_vrml, std::bad_alloc);
 
+        void load_inlines() throw (std::bad_alloc);
         void initialize(double timestamp) throw (std::bad_alloc);
         const std::vector<node_ptr> & nodes() const throw ();
         const std::string url() const throw (std::bad_alloc);
@@ -47,6 +47,10 @@ namespace openvrml {
         bool try_urls(const std::vector<std::string> & urls,
                       const doc2 * relative = 0);
 
+        static void prefetch(const std::vector<std::string> & urls,
+                             const doc2 * relative = 0)
+            throw ();
+
         const char * url() const;
 
         size_t w() const;
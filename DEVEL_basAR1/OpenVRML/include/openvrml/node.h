@@ -26,9 +26,11 @@
 #   include <deque>
 #   include <iostream>
 #   include <list>
+#   include <map>
 #   include <set>
 #   include <stdexcept>
 #   include <utility>
+#   include <vector>
 #   include <openvrml/field.h>
 #   include <openvrml/field_value_ptr.h>
 #   include <openvrml/node_type_ptr.h>
@@ -223,22 +225,24 @@ namespace openvrml {
     std::ostream & operator<<(std::ostream & out, const node & n);
 
     class node {
+        friend class node_ptr;
+        friend class script_node;
         friend std::ostream & operator<<(std::ostream & out,
                                          const node & n);
 
     public:
         class route {
         public:
-            const std::string from_eventout;
-            const node_ptr to_node;
-            const std::string to_eventin;
+            std::string from_eventout;
+            node_ptr to_node;
+            std::string to_eventin;
 
             route(const std::string & from_eventout, const node_ptr & to_node,
                   const std::string & to_eventin);
             route(const route & route);
         };
 
-        typedef std::list<route> routes_t;
+        typedef std::vector<route> routes_t;
 
         struct polled_eventout_value {
             const field_value_ptr value;
@@ -250,6 +254,7 @@ namespace openvrml {
         };
 
     private:
+        size_t ref_count_;
         scope_ptr scope_;
         openvrml::scene * scene_;
         bool modified_;
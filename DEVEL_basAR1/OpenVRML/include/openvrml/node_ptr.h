@@ -23,7 +23,6 @@
 #   define OPENVRML_NODE_PTR_H
 
 #   include <cassert>
-#   include <map>
 #   include <memory>
 #   include <openvrml/common.h>
 
@@ -40,7 +39,7 @@ namespace openvrml {
         friend bool operator==(const node_ptr & lhs, const node_ptr & rhs)
             throw ();
 
-        std::map<node *, size_t>::value_type * count_ptr;
+        node * node_;
 
     public:
         explicit node_ptr(node * node = 0) throw (std::bad_alloc);
@@ -60,7 +59,7 @@ namespace openvrml {
 
     private:
         void dispose() throw ();
-        void share(std::map<node *, size_t>::value_type * count_ptr) throw ();
+        void share(node * node) throw ();
     };
 
 
@@ -71,42 +70,40 @@ namespace openvrml {
 
     inline node_ptr::operator bool() const throw ()
     {
-        return this->count_ptr;
+        return this->node_ != 0;
     }
 
     inline node_ptr & node_ptr::operator=(const node_ptr & ptr) throw ()
     {
-        this->share(ptr.count_ptr);
+        this->share(ptr.node_);
         return *this;
     }
 
     inline node & node_ptr::operator*() const throw ()
     {
-        assert(this->count_ptr);
-        assert(this->count_ptr->first);
-        return *this->count_ptr->first;
+        assert(this->node_);
+        return *this->node_;
     }
 
     inline node * node_ptr::operator->() const throw ()
     {
-        assert(this->count_ptr);
-        assert(this->count_ptr->first);
-        return this->count_ptr->first;
+        assert(this->node_);
+        return this->node_;
     }
 
     inline node * node_ptr::get() const throw ()
     {
-        return this->count_ptr ? this->count_ptr->first : 0;
+        return this->node_;
     }
 
     inline void node_ptr::swap(node_ptr & ptr) throw ()
     {
-        std::swap(this->count_ptr, ptr.count_ptr);
+        std::swap(this->node_, ptr.node_);
     }
 
     inline bool operator==(const node_ptr & lhs, const node_ptr & rhs) throw ()
     {
-        return lhs.count_ptr == rhs.count_ptr;
+        return lhs.node_ == rhs.node_;
     }
 
     inline bool operator!=(const node_ptr & lhs, const node_ptr & rhs) throw ()
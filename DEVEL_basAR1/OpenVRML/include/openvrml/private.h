@@ -60,10 +60,42 @@
 #   include <cstddef>
 #   include <functional>
 #   include <limits>
+#   ifdef _MSC_VER
+#     include <intrin.h>
+#   endif
 
 namespace {
     namespace openvrml_ {
 
+        //
+        // Reference counts that the threads of scene::load_inlines share,
+        // as those of the VRML97 node types of a browser and of the default
+        // values of its PROTOs.
+        //
+        inline void atomic_increment(size_t & count) throw ()
+        {
+#   if defined(_MSC_VER) && defined(_WIN64)
+            _InterlockedIncrement64(reinterpret_cast<volatile __int64 *>(&count));
+#   elif defined(_MSC_VER)
+            _InterlockedIncrement(reinterpret_cast<volatile long *>(&count));
+#   else
+            __sync_add_and_fetch(&count, 1);
+#   endif
+        }
+
+        inline size_t atomic_decrement(size_t & count) throw ()
+        {
+#   if defined(_MSC_VER) && defined(_WIN64)
+            return size_t(_InterlockedDecrement64(
+                reinterpret_cast<volatile __int64 *>(&count)));
+#   elif defined(_MSC_VER)
+            return size_t(_InterlockedDecrement(
+                reinterpret_cast<volatile long *>(&count)));
+#   else
+            return __sync_sub_and_fetch(&count, 1);
+#   endif
+        }
+
         template <typename Float>
         inline Float fabs(const Float f)
         {
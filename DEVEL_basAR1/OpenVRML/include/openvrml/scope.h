@@ -35,6 +35,7 @@ namespace openvrml {
         friend class node;
 
         std::list<node_type_ptr> node_type_list;
+        std::map<std::string, node_type_ptr> node_type_map;
         std::map<std::string, node *> named_node_map;
 
     public:
@@ -39,6 +39,7 @@
 # endif
 
 # include <cmath>
+# include <cstring>
 # include <limits>
 
 # include <openvrml/browser.h>
@@ -53,6 +54,11 @@
 
 # define USE_TEXTURE_DISPLAY_LISTS 1
 
+// OpenGL 1.4 (SGIS_generate_mipmap); older headers do not have it.
+# ifndef GL_GENERATE_MIPMAP
+#   define GL_GENERATE_MIPMAP 0x8191
+# endif
+
 #   ifdef NDEBUG
 #     define OPENVRML_GL_PRINT_MESSAGE_(message_)
 #   else
@@ -96,6 +102,9 @@ namespace {
     class gl_capabilities {
     public:
         GLint max_modelview_stack_depth;
+        GLint max_texture_size;
+        bool texture_npot;
+        bool generate_mipmap;
 
         static const gl_capabilities * instance() throw (std::bad_alloc);
 
@@ -120,6 +129,31 @@ namespace {
     {
         glGetIntegerv(GL_MAX_MODELVIEW_STACK_DEPTH,
                       &this->max_modelview_stack_depth);
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &this->max_texture_size);
+
+        //
+        // Textures of any size come with OpenGL 2.0, mipmaps built by
+        // the driver with 1.4; either may also be an extension.
+        //
+        const char * const version =
+            reinterpret_cast<const char *>(glGetString(GL_VERSION));
+        const char * const ext =
+            reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+        const int major = version ? version[0] - '0' : 0;
+        const int minor = (version && version[1] == '.')
+                        ? version[2] - '0'
+                        : 0;
+        this->texture_npot = major >= 2
+            || (ext && strstr(ext, "GL_ARB_texture_non_power_of_two"));
+        this->generate_mipmap = major >= 2 || (major == 1 && minor >= 4)
+            || (ext && strstr(ext, "GL_SGIS_generate_mipmap"));
+    }
+
+    inline size_t pow2_below(size_t n, const size_t max_size)
+    {
+        size_t p = 1;
+        while (p * 2 <= n && p * 2 <= max_size) { p *= 2; }
+        return p;
     }
 }
 
@@ -281,29 +315,32 @@ namespace gl {
  * expected to vary between implementations, and we don't want nesting of
  * Transform nodes in VRML worlds to be constrained by this limit.
  *
- * modelview_matrix_stack uses the OpenGL modelview matrix stack until it fills
- * up, at which point any additional matrices that spill over are pushed onto
- * a conventional stack of mat4f.
+ * modelview_matrix_stack keeps the modelview matrix on the CPU as well, so
+ * that it is never read back from OpenGL: every change the viewer makes to
+ * the matrix goes through load() or multiply(). It uses the OpenGL modelview
+ * matrix stack until it fills up; the matrices pushed beyond that are only
+ * kept here, and loaded again when popped.
  */
 
 /**
- * @var size_t viewer::modelview_matrix_stack::size
+ * @var std::vector<mat4f> viewer::modelview_matrix_stack::saved
  *
- * @brief The current stack depth.
+ * @brief The matrices pushed.
  */
 
 /**
- * @var std::stack<mat4f> viewer::modelview_matrix_stack::spillover
+ * @var mat4f viewer::modelview_matrix_stack::current
  *
- * @brief Any matrices that won't fit on the OpenGL modelview matrix stack get
- *      pushed onto this stack.
+ * @brief The current modelview matrix, as OpenGL has it.
+ *
+ * Whoever sets the OpenGL modelview matrix other than through the stack
+ * sets this too.
  */
 
 /**
  * @brief Construct.
  */
-viewer::modelview_matrix_stack::modelview_matrix_stack():
-    size(0)
+viewer::modelview_matrix_stack::modelview_matrix_stack()
 {}
 
 /**
@@ -313,21 +350,11 @@ viewer::modelview_matrix_stack::modelview_matrix_stack():
  */
 void viewer::modelview_matrix_stack::push()
 {
-# ifndef NDEBUG
-    GLint matrixMode;
-    glGetIntegerv(GL_MATRIX_MODE, &matrixMode);
-# endif
-    assert(matrixMode == GL_MODELVIEW);
-    if (this->size
-        == size_t(gl_capabilities::instance()->max_modelview_stack_depth - 1))
-    {
-        mat4f mat;
-        glGetFloatv(GL_MODELVIEW_MATRIX, &mat[0][0]);
-        this->spillover.push(mat);
-        glPopMatrix();
+    this->saved.push_back(this->current);
+    if (this->saved.size()
+        < size_t(gl_capabilities::instance()->max_modelview_stack_depth)) {
+        glPushMatrix();
     }
-    glPushMatrix();
-    ++this->size;
 }
 
 /**
@@ -337,18 +364,41 @@ void viewer::modelview_matrix_stack::push()
  */
 void viewer::modelview_matrix_stack::pop()
 {
-# ifndef NDEBUG
-    GLint matrixMode;
-    glGetIntegerv(GL_MATRIX_MODE, &matrixMode);
-# endif
-    assert(matrixMode == GL_MODELVIEW);
-    glPopMatrix();
-    if (!this->spillover.empty()) {
-        glLoadMatrixf(&this->spillover.top()[0][0]);
-        this->spillover.pop();
-        glPushMatrix();
+    assert(!this->saved.empty());
+    this->current = this->saved.back();
+    if (this->saved.size()
+        < size_t(gl_capabilities::instance()->max_modelview_stack_depth)) {
+        glPopMatrix();
+    } else {
+        glLoadMatrixf(&this->current[0][0]);
     }
-    --this->size;
+    this->saved.pop_back();
+}
+
+/**
+ * @brief Replace the current matrix.
+ *
+ * @param mat   a matrix.
+ *
+ * @pre The current matrix is the modelview matrix.
+ */
+void viewer::modelview_matrix_stack::load(const mat4f & mat)
+{
+    this->current = mat;
+    glLoadMatrixf(&this->current[0][0]);
+}
+
+/**
+ * @brief Multiply the current matrix by @p mat.
+ *
+ * @param mat   a matrix.
+ *
+ * @pre The current matrix is the modelview matrix.
+ */
+void viewer::modelview_matrix_stack::multiply(const mat4f & mat)
+{
+    this->current = mat * this->current;
+    glMultMatrixf(&mat[0][0]);
 }
 
 /**
@@ -387,6 +437,12 @@ void viewer::modelview_matrix_stack::pop()
  * @brief Modelview matrix stack.
  */
 
+/**
+ * @var mat4f viewer::projection_matrix_
+ *
+ * @brief The projection matrix set by set_viewpoint(), as OpenGL has it.
+ */
+
 /**
  * @var bool viewer::gl_initialized
  *
@@ -1007,7 +1063,7 @@ viewer::insert_background(const std::vector<float> & groundAngle,
 
         this->modelview_matrix_stack_.push();
 
-        glScalef(1000.0, 1000.0, 1000.0);
+        this->modelview_matrix_stack_.multiply(mat4f::scale(1000.0));
 
         // Sphere constants
         const size_t nCirc = 8; // number of circumferential slices
@@ -1178,7 +1234,7 @@ viewer::insert_background(const std::vector<float> & groundAngle,
                 }
             }
 
-            glScalef(0.5, 0.5, 0.5);
+            this->modelview_matrix_stack_.multiply(mat4f::scale(0.5));
 
             glEnable(GL_TEXTURE_2D);
             glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
@@ -2194,6 +2250,32 @@ namespace {
     }
 }
 
+/**
+ * @brief The points of an extrusion.
+ *
+ * For viewers that build the extrusion themselves: the cross section placed
+ * at each spine point, and their texture coordinates.
+ *
+ * @param orientation   cross-section orientations.
+ * @param scale         cross-section scales.
+ * @param crossSection  cross-sections.
+ * @param spine         spine points.
+ * @retval c            <code>crossSection.size() * spine.size()</code>
+ *                      points, a cross section after the other.
+ * @retval tc           their texture coordinates.
+ */
+void viewer::extrusion_points(const std::vector<openvrml::rotation> & orientation,
+                              const std::vector<vec2f> & scale,
+                              const std::vector<vec2f> & crossSection,
+                              const std::vector<vec3f> & spine,
+                              std::vector<vec3f> & c,
+                              std::vector<vec2f> & tc)
+{
+    c.resize(crossSection.size() * spine.size());
+    tc.resize(crossSection.size() * spine.size());
+    computeExtrusion_(orientation, scale, crossSection, spine, c, tc);
+}
+
 /**
  * @brief Insert an extrusion into a display list.
  *
@@ -3385,6 +3467,37 @@ viewer::insert_texture(size_t w, size_t h, size_t nc,
     // Enable blending if needed
     if (this->blend && (nc == 2 || nc == 4)) { glEnable(GL_BLEND); }
 
+    //
+    // Images go up at their own size where the hardware takes any size,
+    // and are otherwise scaled down to powers of two here. Either way
+    // they must fit GL_MAX_TEXTURE_SIZE.
+    //
+    const gl_capabilities & caps = *gl_capabilities::instance();
+    const size_t max_size = caps.max_texture_size > 0
+                          ? size_t(caps.max_texture_size)
+                          : 256;
+    size_t tex_w = w, tex_h = h;
+    if (!caps.texture_npot || w > max_size || h > max_size) {
+        tex_w = pow2_below(w, max_size);
+        tex_h = pow2_below(h, max_size);
+    }
+    std::vector<unsigned char> scaled;
+    if (tex_w != w || tex_h != h) {
+        scaled.resize(nc * tex_w * tex_h);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (gluScaleImage(fmt[nc - 1],
+                          GLsizei(w), GLsizei(h), GL_UNSIGNED_BYTE, pixels,
+                          GLsizei(tex_w), GLsizei(tex_h), GL_UNSIGNED_BYTE,
+                          &scaled[0]) != 0) {
+            return 0;
+        }
+        pixels = &scaled[0];
+    }
+
+    // Only textures that are kept are worth their mipmaps.
+    const bool mipmap = retainHint && caps.generate_mipmap;
+
 #if USE_TEXTURE_DISPLAY_LISTS
     if (retainHint) { glGenTextures(1, &glid); }
     glBindTexture(GL_TEXTURE_2D, glid);
@@ -3393,11 +3506,15 @@ viewer::insert_texture(size_t w, size_t h, size_t nc,
     // Texturing is enabled in setMaterialMode
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
+    if (caps.generate_mipmap) {
+        glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP,
+                        mipmap ? GL_TRUE : GL_FALSE);
+    }
     glTexImage2D(GL_TEXTURE_2D,
                  0,
                  GLint(nc),
-                 GLsizei(w),
-                 GLsizei(h),
+                 GLsizei(tex_w),
+                 GLsizei(tex_h),
                  0,
                  fmt[nc - 1],
                  GL_UNSIGNED_BYTE,
@@ -3407,12 +3524,44 @@ viewer::insert_texture(size_t w, size_t h, size_t nc,
                     repeat_s ? GL_REPEAT : GL_CLAMP);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T,
                     repeat_t ? GL_REPEAT : GL_CLAMP);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER,
+                    mipmap ? GL_LINEAR : GL_NEAREST);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    mipmap ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
 
     return texture_object_t(glid);
 }
 
+/**
+ * @brief Replace the pixels of a texture object.
+ *
+ * The texture is filled in place, without being made again.
+ *
+ * @param ref       texture handle.
+ * @param w         width, as inserted.
+ * @param h         height, as inserted.
+ * @param nc        number of components.
+ * @param pixels    pixel data.
+ */
+void viewer::update_texture(const texture_object_t ref,
+                            const size_t w, const size_t h, const size_t nc,
+                            const unsigned char * const pixels)
+{
+    static const GLenum fmt[] = {
+        GL_LUMINANCE,       // single component
+        GL_LUMINANCE_ALPHA, // 2 components
+        GL_RGB,             // 3 components
+        GL_RGBA             // 4 components
+    };
+
+    if (this->select_mode || !ref) { return; }
+
+    glBindTexture(GL_TEXTURE_2D, GLuint(ref));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GLsizei(w), GLsizei(h),
+                    fmt[nc - 1], GL_UNSIGNED_BYTE, pixels);
+}
+
 
 /**
  * @brief Insert a subcomponent of a texture as an OpenGL texture.
@@ -3587,6 +3736,38 @@ namespace {
         up.z(float(t * orientation.y() * orientation.z()
                    + s * orientation.x()));
     }
+
+    /**
+     * The matrix of gluPerspective().
+     */
+    const mat4f perspective(const float fovy,
+                            const float aspect,
+                            const float znear,
+                            const float zfar)
+    {
+        const float f = float(1.0 / tan(fovy * pi / 360.0));
+        return mat4f(f / aspect, 0.0, 0.0, 0.0,
+                     0.0, f, 0.0, 0.0,
+                     0.0, 0.0, (zfar + znear) / (znear - zfar), -1.0,
+                     0.0, 0.0, 2.0f * zfar * znear / (znear - zfar), 0.0);
+    }
+
+    /**
+     * The matrix of gluLookAt().
+     */
+    const mat4f look_at(const vec3f & eye,
+                        const vec3f & target,
+                        const vec3f & up)
+    {
+        const vec3f f = (target - eye).normalize();
+        const vec3f s = (f * up).normalize();
+        const vec3f u = s * f;
+        return mat4f::translation(-eye)
+            * mat4f(s.x(), u.x(), -f.x(), 0.0,
+                    s.y(), u.y(), -f.y(), 0.0,
+                    s.z(), u.z(), -f.z(), 0.0,
+                    0.0, 0.0, 0.0, 1.0);
+    }
 }
 
 /**
@@ -3604,9 +3785,6 @@ void viewer::set_viewpoint(const vec3f & position,
                            const float avatarSize,
                            const float visibilityLimit)
 {
-    glMatrixMode( GL_PROJECTION );
-    if (!this->select_mode) { glLoadIdentity(); }
-
     float field_of_view = float(fieldOfView * 180.0 / pi);
     float aspect = float(this->win_width) / this->win_height;
     float znear = (avatarSize > 0.0)
@@ -3615,7 +3793,13 @@ void viewer::set_viewpoint(const vec3f & position,
     float zfar = (visibilityLimit > 0.0)
                ? visibilityLimit
                : 30000.0f;
-    gluPerspective(field_of_view, aspect, znear, zfar);
+    // In select mode, after the pick matrix of checkSensitive().
+    const mat4f p = perspective(field_of_view, aspect, znear, zfar);
+    this->projection_matrix_ = this->select_mode
+                             ? p * this->projection_matrix_
+                             : p;
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(&this->projection_matrix_[0][0]);
 
     this->frustum(openvrml::frustum(field_of_view, aspect, znear, zfar));
 
@@ -3628,9 +3812,7 @@ void viewer::set_viewpoint(const vec3f & position,
     vec3f target, up;
     computeView(position, orientation, d, target, up);
 
-    gluLookAt(position.x(), position.y(), position.z(),
-              target.x(), target.y(), target.z(),
-              up.x(), up.y(), up.z());
+    this->modelview_matrix_stack_.multiply(look_at(position, target, up));
 }
 
 /**
@@ -3641,8 +3823,7 @@ void viewer::set_viewpoint(const vec3f & position,
  */
 void viewer::transform_points(const size_t nPoints, vec3f * point) const
 {
-    mat4f m;
-    glGetFloatv(GL_MODELVIEW_MATRIX, &m[0][0]);
+    const mat4f & m = this->modelview_matrix_stack_.current;
     vec3f * const end = point + nPoints;
     for (; point != end; ++point) { *point = m * *point; }
 }
@@ -3654,7 +3835,7 @@ void viewer::transform_points(const size_t nPoints, vec3f * point) const
  */
 void viewer::transform(const mat4f & mat)
 {
-    glMultMatrixf(&mat[0][0]);
+    this->modelview_matrix_stack_.multiply(mat);
 }
 
 /**
@@ -3711,7 +3892,7 @@ void viewer::redraw()
     }
 
     glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    this->modelview_matrix_stack_.load(mat4f());
 
     this->browser.render(*this);
 
@@ -3794,8 +3975,7 @@ void viewer::rotate(const openvrml::rotation & rot) throw ()
 
     activeViewpoint.user_view_transform(newCameraTransform);
 
-    mat4f rotationMatrix;
-    glGetFloatv(GL_MODELVIEW_MATRIX, &rotationMatrix[0][0]);
+    mat4f rotationMatrix = this->modelview_matrix_stack_.current;
     rotationMatrix[3][0] = 0.0;
     rotationMatrix[3][1] = 0.0;
     rotationMatrix[3][2] = 0.0;
@@ -3831,11 +4011,14 @@ void viewer::step(const float x, const float y, const float z)
  */
 void viewer::zoom(const float z)
 {
-    GLint viewport[4];
+    const GLint viewport[4] = {
+        0, 0, GLint(this->win_width), GLint(this->win_height)
+    };
     GLdouble modelview[16], projection[16];
-    glGetIntegerv (GL_VIEWPORT, viewport);
-    glGetDoublev (GL_MODELVIEW_MATRIX, modelview);
-    glGetDoublev (GL_PROJECTION_MATRIX, projection);
+    for (size_t i = 0; i < 16; ++i) {
+        modelview[i] = this->modelview_matrix_stack_.current[i / 4][i % 4];
+        projection[i] = this->projection_matrix_[i / 4][i % 4];
+    }
     vrml97_node::navigation_info_node * const nav =
             this->browser.bindable_navigation_info_top();
     GLdouble x_c = this->win_width / 2;
@@ -4114,6 +4297,27 @@ void viewer::handleMouseDrag(int x, int y)
 }
 
 
+namespace {
+
+    /**
+     * The matrix of gluPickMatrix().
+     */
+    const mat4f pick_matrix(const float x,
+                            const float y,
+                            const float width,
+                            const float height,
+                            const GLint viewport[4])
+    {
+        return mat4f::scale(vec3f(viewport[2] / width,
+                                  viewport[3] / height,
+                                  1.0))
+            * mat4f::translation(
+                vec3f((viewport[2] - 2.0f * (x - viewport[0])) / width,
+                      (viewport[3] - 2.0f * (y - viewport[1])) / height,
+                      0.0));
+    }
+}
+
 /**
  * Check for pickable objects.
  */
@@ -4122,8 +4326,9 @@ bool viewer::checkSensitive(const int x,
                             const event_type mouseEvent)
 {
     double timeNow = browser::current_time();
-    GLint viewport[4];
-    glGetIntegerv(GL_VIEWPORT, viewport);
+    const GLint viewport[4] = {
+        0, 0, GLint(this->win_width), GLint(this->win_height)
+    };
 
     GLuint selectBuffer[4 * viewer::maxsensitive];
     glSelectBuffer(4 * viewer::maxsensitive, selectBuffer);
@@ -4134,11 +4339,12 @@ bool viewer::checkSensitive(const int x,
     glInitNames();
     glPushName(0);
 
+    const mat4f projectionMatrix = this->projection_matrix_;
     glMatrixMode(GL_PROJECTION);
     glPushMatrix();
-    glLoadIdentity();
-    gluPickMatrix(GLdouble(x), GLdouble(viewport[3] - y),
-                  2.0, 2.0, viewport);
+    this->projection_matrix_ =
+        pick_matrix(float(x), float(viewport[3] - y), 2.0, 2.0, viewport);
+    glLoadMatrixf(&this->projection_matrix_[0][0]);
 
     // Set up the global attributes
     glDisable(GL_FOG);
@@ -4166,7 +4372,7 @@ bool viewer::checkSensitive(const int x,
     }
 
     glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
+    this->modelview_matrix_stack_.load(mat4f());
 
     this->browser.render(*this);
 
@@ -4209,11 +4415,10 @@ bool viewer::checkSensitive(const int x,
             this->select_z = minz / double(0xffffffff);
         }
 
-        GLint viewport[4];
         GLdouble modelview[16], projection[16];
-        glGetIntegerv(GL_VIEWPORT, viewport);
-        glGetDoublev(GL_PROJECTION_MATRIX, projection);
-  //      glGetDoublev (GL_MODELVIEW_MATRIX, modelview);
+        for (size_t i = 0; i < 16; ++i) {
+            projection[i] = this->projection_matrix_[i / 4][i % 4];
+        }
 
         //
         // make modelview as a unit matrix as this is taken care in the core
@@ -4239,6 +4444,7 @@ bool viewer::checkSensitive(const int x,
   // To unset PickMatrix...
     glMatrixMode(GL_PROJECTION);
     glPopMatrix();
+    this->projection_matrix_ = projectionMatrix;
 
     // Sanity check. This can happen when the world gets replaced
     // by clicking on an anchor - the current sensitive object goes
@@ -4346,8 +4552,7 @@ viewer::draw_bounding_sphere(const bounding_sphere & bs,
     glShadeModel(GL_FLAT);
     glMatrixMode(GL_MODELVIEW);
     this->modelview_matrix_stack_.push();
-    const vec3f & c = bs.center();
-    glTranslatef(c.x(), c.y(), c.z());
+    this->modelview_matrix_stack_.multiply(mat4f::translation(bs.center()));
     GLUquadricObj * const sph = gluNewQuadric();
     switch (intersection) {
     case bounding_volume::outside:
@@ -22,7 +22,6 @@
 # ifndef OPENVRML_GL_VIEWER_H
 #   define OPENVRML_GL_VIEWER_H
 
-#   include <stack>
 #   include <openvrml/viewer.h>
 
 // Use the stencil buffer to set the SHAPE mask.
@@ -78,14 +77,17 @@ namespace openvrml {
             };
 
             class modelview_matrix_stack {
-                size_t size;
-                std::stack<mat4f> spillover;
+                std::vector<mat4f> saved;
 
             public:
+                mat4f current;
+
                 modelview_matrix_stack();
 
                 void push();
                 void pop();
+                void load(const mat4f & mat);
+                void multiply(const mat4f & mat);
             };
 
             struct light_info {
@@ -96,6 +98,7 @@ namespace openvrml {
             };
 
             modelview_matrix_stack modelview_matrix_stack_;
+            mat4f projection_matrix_;
 
             bool gl_initialized;
             bool blend;
@@ -164,6 +167,14 @@ namespace openvrml {
                               const unsigned char *pixels,
                               bool retainHint = false);
 
+            static void
+            extrusion_points(const std::vector<openvrml::rotation> & orientation,
+                             const std::vector<vec2f> & scale,
+                             const std::vector<vec2f> & crossSection,
+                             const std::vector<vec3f> & spine,
+                             std::vector<vec3f> & c,
+                             std::vector<vec2f> & tc);
+
             // Check for pickable entity selection
             bool checkSensitive(int x, int y, event_type event);
 
@@ -291,6 +302,9 @@ namespace openvrml {
                            bool repeat_s, bool repeat_t,
                            const unsigned char *pixels,
                            bool retainHint = false);
+            virtual void update_texture(texture_object_t ref,
+                                        size_t w, size_t h, size_t nc,
+                                        const unsigned char * pixels);
 
             // Reference/remove a texture object
             virtual void insert_texture_reference(texture_object_t ref,
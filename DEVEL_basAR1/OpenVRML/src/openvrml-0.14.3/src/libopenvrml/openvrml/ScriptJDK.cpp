@@ -38,6 +38,14 @@
 #   include <cstring>
 #   include <strstream>
 #   include <sstream>
+#   include <deque>
+#   ifdef _WIN32
+#     include <windows.h>
+#     include <process.h>
+#   else
+#     include <pthread.h>
+#     include <unistd.h>
+#   endif
 
 #   include <vrml_Browser.h>
 #   include <vrml_Event.h>
@@ -93,6 +101,7 @@
 #   include "script.h"
 #   include "browser.h"
 #   include "node.h"
+#   include "doc.h"
 
 #   ifdef _WIN32
 #     define PATH_SEPARATOR ";"
@@ -133,6 +142,64 @@ namespace {
         const std::string& name() const { return d_eventName; }
         const field_value * value() const { return d_value; }
     };
+
+    struct deferred_job {
+        ScriptJDK * script;
+        VrmlEvent * event;
+        size_t argc;
+    };
+
+    //
+    // The events of the deferred scripts are run in order by one thread,
+    // started as they come and ended when there are none left, like the
+    // fetch threads of resource_loader.
+    //
+    resource_loader::mutex & job_lock = *new resource_loader::mutex;
+    std::deque<deferred_job> job_queue;
+    bool job_thread = false;
+
+    void nap()
+    {
+#   ifdef _WIN32
+        Sleep(1);
+#   else
+        usleep(1000);
+#   endif
+    }
+
+#   ifdef _WIN32
+    unsigned __stdcall job_thread_main(void *)
+    {
+        ScriptJDK::run_deferred();
+        return 0;
+    }
+#   else
+    void * job_thread_main(void *)
+    {
+        ScriptJDK::run_deferred();
+        return 0;
+    }
+#   endif
+
+    //
+    // Called with job_lock held.
+    //
+    bool start_job_thread()
+    {
+#   ifdef _WIN32
+        const HANDLE tid =
+            HANDLE(_beginthreadex(0, 0, job_thread_main, 0, 0, 0));
+        if (tid == 0) { return false; }
+        CloseHandle(tid);
+#   else
+        pthread_t tid;
+        if (pthread_create(&tid, 0, job_thread_main, 0) != 0) {
+            return false;
+        }
+        pthread_detach(tid);
+#   endif
+        return true;
+    }
 }
 
 const char * ftn[] = {
@@ -161,7 +228,7 @@ const char * ftn[] = {
 
 // Static members
 JavaVM *ScriptJDK::d_jvm = 0;
-JNIEnv *ScriptJDK::d_env = 0;
+size_t ScriptJDK::d_instances = 0;
 
 /**
  * @class ScriptJDK
@@ -178,6 +245,10 @@ JNIEnv *ScriptJDK::d_env = 0;
  * @param scriptNode Reference to the ScriptNode that uses this Script.
  * @param className Name of the Java class.
  * @param classDir Location of Java class.
+ *
+ * If script::deferred, the events of a script without directOutput are run
+ * on the script thread; one with directOutput may change other nodes, and is
+ * still run in browser::update.
  */
 ScriptJDK::ScriptJDK(script_node & node,
                      const char * className,
@@ -187,11 +258,19 @@ ScriptJDK::ScriptJDK(script_node & node,
     d_object(0),
     d_processEventsID(0),
     d_processEventID(0),
-    d_eventsProcessedID(0)
-{
+    d_eventsProcessedID(0),
+    d_deferred(script::deferred()
+               && !static_cast<const sfbool &>(
+                      node.field("directOutput")).value),
+    d_jobs(0),
+    d_running(false),
+    d_reading(false)
+{
+  ++d_instances;
   if (! d_jvm)			// Initialize static members
   {
     JavaVMInitArgs vm_args;
+    JNIEnv * d_env;
     jint res;
     JavaVMOption options[3];
 
@@ -236,25 +315,33 @@ ScriptJDK::ScriptJDK(script_node & node,
     }
   }
 
-  if (d_jvm && d_env)		// Per-object initialization
+  JNIEnv * const d_env = env();
+  if (d_env)			// Per-object initialization
   {
     char fqClassName[1024];
     strcpy(fqClassName, "");
     strcat(fqClassName, className);
 
-    d_class = d_env->FindClass(fqClassName);
-    if (!d_class)
+    // Global references, as the script may be run on another thread.
+    jclass clazz = d_env->FindClass(fqClassName);
+    if (!clazz)
     {
       OPENVRML_PRINT_MESSAGE_("Can't find Java class "
                               + std::string(className) + ".");
       return;
     }
+    d_class = static_cast<jclass>(d_env->NewGlobalRef(clazz));
+    d_env->DeleteLocalRef(clazz);
 
     // Call constructor
     jmethodID ctorId = d_env->GetMethodID(d_class, "<init>", "()V");
 
     if (ctorId)
-      d_object = d_env->NewObject(d_class, ctorId);
+    {
+      jobject object = d_env->NewObject(d_class, ctorId);
+      d_object = d_env->NewGlobalRef(object);
+      d_env->DeleteLocalRef(object);
+    }
 
     jfieldID fid = d_env->GetFieldID(d_class, "NodePtr", "I");
     d_env->SetIntField(d_object, fid, reinterpret_cast<int>(&node));
@@ -274,16 +361,193 @@ ScriptJDK::ScriptJDK(script_node & node,
 
 /**
  * @brief Destructor. Delete JVM reference.
+ *
+ * A deferred script first waits for its events to be run. The JVM is
+ * destroyed with the last script.
  */
 ScriptJDK::~ScriptJDK()
 {
-  if (d_jvm)
+  if (d_deferred)
+  {
+    for (;;)
+    {
+      {
+        resource_loader::scoped_lock lock(job_lock);
+        if (d_jobs == 0) break;
+      }
+      nap();
+    }
+  }
+
+  JNIEnv * const d_env = env();
+  if (d_env)
   {
+    if (d_object) d_env->DeleteGlobalRef(d_object);
+    if (d_class) d_env->DeleteGlobalRef(d_class);
+  }
+
+  if (--d_instances == 0 && d_jvm)
+  {
+    for (;;)
+    {
+      {
+        resource_loader::scoped_lock lock(job_lock);
+        if (!job_thread) break;
+      }
+      nap();
+    }
     d_jvm->DestroyJavaVM();
     d_jvm = 0;
   }
 }
 
+/**
+ * @brief The JNI environment of the calling thread, which is attached to the
+ *        JVM if it is not yet.
+ *
+ * @return the JNI environment, or 0 if there is no JVM.
+ */
+JNIEnv * ScriptJDK::env() throw ()
+{
+  JNIEnv * e = 0;
+  if (!d_jvm) return 0;
+  if (d_jvm->GetEnv(reinterpret_cast<void **>(&e), JNI_VERSION_1_2) != JNI_OK)
+  {
+    if (d_jvm->AttachCurrentThread(reinterpret_cast<void **>(&e), 0) != 0)
+      return 0;
+  }
+  return e;
+}
+
+/**
+ * @brief Whether the script_node may read the eventOuts of the script.
+ *
+ * For a deferred script, @c false while the script thread runs it; else the
+ * script thread holds its next event until outputs_done.
+ *
+ * @return @c true if the eventOuts may be read until outputs_done.
+ */
+bool ScriptJDK::outputs_ready() throw ()
+{
+  if (!d_deferred) return true;
+
+  resource_loader::scoped_lock lock(job_lock);
+  if (d_running) return false;
+  d_reading = true;
+  return true;
+}
+
+/**
+ * @brief The script_node is done reading the eventOuts.
+ */
+void ScriptJDK::outputs_done() throw ()
+{
+  if (!d_deferred) return;
+
+  resource_loader::scoped_lock lock(job_lock);
+  d_reading = false;
+}
+
+/**
+ * @brief Run the events of the deferred scripts, on the script thread, until
+ *        there are none left.
+ *
+ * The next event of a script whose eventOuts the browser is reading waits
+ * for it to be done; the browser never waits for the script thread.
+ */
+void ScriptJDK::run_deferred() throw ()
+{
+  const bool attached = env() != 0;
+
+  for (;;)
+  {
+    deferred_job job;
+    {
+      resource_loader::scoped_lock lock(job_lock);
+      if (job_queue.empty())
+      {
+        job_thread = false;
+        break;
+      }
+      job = job_queue.front();
+      if (job.script->d_reading)
+        job.script = 0;
+      else
+      {
+        job_queue.pop_front();
+        job.script->d_running = true;
+      }
+    }
+    if (!job.script)
+    {
+      nap();
+      continue;
+    }
+
+    try
+    {
+      const sftime arg(job.event->timeStamp());
+      const field_value * argv[] = { job.event->value(), &arg };
+      if (attached)
+        job.script->activate(job.event->timeStamp(), job.event->name(),
+                             job.argc, argv);
+    }
+    catch (std::exception & ex)
+    {
+      OPENVRML_PRINT_EXCEPTION_(ex);
+    }
+    delete job.event;
+
+    resource_loader::scoped_lock lock(job_lock);
+    job.script->d_running = false;
+    --job.script->d_jobs;
+  }
+
+  if (attached) d_jvm->DetachCurrentThread();
+}
+
+/**
+ * @brief Run a specified script now, or on the script thread if it is
+ *        deferred.
+ *
+ * @param timeStamp Time at which script is being run.
+ * @param fname Script name
+ * @param argc Number of arguments to pass to script
+ * @param argv Array of arguments; the first is copied for the script thread
+ */
+void ScriptJDK::post(const double timeStamp,
+                     const std::string & fname,
+                     const size_t argc,
+                     const field_value * const argv[])
+{
+  if (!d_deferred)
+  {
+    this->activate(timeStamp, fname, argc, argv);
+    return;
+  }
+
+  deferred_job job;
+  job.script = this;
+  job.event = new VrmlEvent(timeStamp, fname, argv[0]);
+  job.argc = argc;
+
+  resource_loader::scoped_lock lock(job_lock);
+  job_queue.push_back(job);
+  ++d_jobs;
+  if (!job_thread)
+  {
+    job_thread = start_job_thread();
+    if (!job_thread)
+    {
+      // Run it here rather than lose it.
+      job_queue.pop_back();
+      --d_jobs;
+      delete job.event;
+      this->activate(timeStamp, fname, argc, argv);
+    }
+  }
+}
+
 namespace {
 
     /**
@@ -395,7 +659,7 @@ void ScriptJDK::initialize(const double timestamp)
 {
   const sftime arg(timestamp);
   const field_value * argv[] = { &arg };
-  this->activate(timestamp, "initialize", 1, argv);
+  this->post(timestamp, "initialize", 1, argv);
 }
 
 /**
@@ -411,7 +675,7 @@ void ScriptJDK::process_event(const std::string & id,
 {
   const sftime timestampArg(timestamp);
   const field_value * argv[] = { &value, &timestampArg };
-  this->activate(timestamp, id, 2, argv);
+  this->post(timestamp, id, 2, argv);
 }
 
 /**
@@ -423,7 +687,7 @@ void ScriptJDK::events_processed(const double timestamp)
 {
   const sftime arg(timestamp);
   const field_value * argv[] = { &arg };
-  this->activate(timestamp, "eventsProcessed", 1, argv);
+  this->post(timestamp, "eventsProcessed", 1, argv);
 }
 
 /**
@@ -436,7 +700,7 @@ void ScriptJDK::shutdown(const double timestamp)
 {
   const sftime arg(timestamp);
   const field_value * argv[] = { &arg };
-  this->activate(timestamp, "shutdown", 1, argv);
+  this->post(timestamp, "shutdown", 1, argv);
 }
 
 /**
@@ -452,6 +716,9 @@ void ScriptJDK::activate( double timeStamp,
 			  size_t argc,
 			  const field_value* const argv[] )
 {
+  JNIEnv * const d_env = env();
+  if (!d_env || !d_object) return;
+
   if (argc == 2 && d_processEventID)
   {
     jclass clazz = d_env->FindClass("vrml/Event");
@@ -325,7 +325,7 @@ antlr::RefToken Vrml97Scanner::nextToken()
 inline void Vrml97Scanner::getNextChar()
 {
     this->prev_char_ = this->c_;
-    this->c_ = this->in_.get();
+    this->c_ = this->in_.rdbuf()->sbumpc();
     ++this->col_; // Increment the column count;
 
     //
@@ -706,7 +706,7 @@ void Vrml97Parser::routeStatement(
 		match(PERIOD);
 		toInterfaceId = LT(1);
 		match(ID);
-#line 925 "Vrml97Parser.g"
+#line 937 "Vrml97Parser.g"
 		
 		using openvrml::field_value;
 		using openvrml::node;
@@ -757,12 +757,12 @@ openvrml::node_ptr  Vrml97Parser::node(
      const openvrml::scope_ptr & scope,
      const std::string & nodeId
 ) {
-#line 963 "Vrml97Parser.g"
+#line 975 "Vrml97Parser.g"
 	openvrml::node_ptr n;
 #line 763 "Vrml97Parser.cpp"
 	ANTLR_USE_NAMESPACE(antlr)RefToken  scriptId = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	ANTLR_USE_NAMESPACE(antlr)RefToken  nodeTypeId = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 963 "Vrml97Parser.g"
+#line 975 "Vrml97Parser.g"
 	
 	using openvrml::node_type_ptr;
 	using openvrml::node_ptr;
@@ -776,7 +776,7 @@ openvrml::node_ptr  Vrml97Parser::node(
 	if (((LA(1) == ID))&&( !LT(1)->getText().compare("Script") )) {
 		scriptId = LT(1);
 		match(ID);
-#line 976 "Vrml97Parser.g"
+#line 988 "Vrml97Parser.g"
 		
 		n.reset(new script_node(browser.script_node_class_, scope));
 		if (!nodeId.empty()) { n->id(nodeId); }
@@ -817,7 +817,7 @@ openvrml::node_ptr  Vrml97Parser::node(
 	else if ((LA(1) == ID)) {
 		nodeTypeId = LT(1);
 		match(ID);
-#line 987 "Vrml97Parser.g"
+#line 999 "Vrml97Parser.g"
 		
 		nodeType = scope->find_type(nodeTypeId->getText());
 		if (!nodeType) {
@@ -859,7 +859,7 @@ void Vrml97Parser::externproto(
 	openvrml::browser & browser, const openvrml::scope_ptr & scope
 ) {
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 844 "Vrml97Parser.g"
+#line 855 "Vrml97Parser.g"
 	
 	openvrml::node_interface_set interfaces;
 	openvrml::mfstring urlList;
@@ -886,8 +886,9 @@ void Vrml97Parser::externproto(
 		} // ( ... )*
 		match(RBRACKET);
 		urlList=externprotoUrlList();
-#line 852 "Vrml97Parser.g"
+#line 863 "Vrml97Parser.g"
 		
+		resource_loader::scoped_lock lock(browser.node_class_map_mutex);
 		for (size_t i = 0; i < urlList.value.size(); ++i) {
 			browser::node_class_map_t::const_iterator pos =
 		browser.node_class_map.find(urlList.value[i]);
@@ -917,7 +918,7 @@ void Vrml97Parser::externproto(
 		}
 		}
 		
-#line 921 "Vrml97Parser.cpp"
+#line 922 "Vrml97Parser.cpp"
 	}
 	catch (ANTLR_USE_NAMESPACE(antlr)RecognitionException& ex) {
 		reportError(ex);
@@ -936,7 +937,7 @@ void Vrml97Parser::proto(
 	node_class_ptr nodeClass;
 	scope_ptr protoScope;
 	
-#line 940 "Vrml97Parser.cpp"
+#line 941 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		match(KEYWORD_PROTO);
@@ -947,7 +948,7 @@ void Vrml97Parser::proto(
 		nodeClass.reset(new ProtoNodeClass(browser));
 		protoScope.reset(new openvrml::scope(id->getText(), scope));
 		
-#line 951 "Vrml97Parser.cpp"
+#line 952 "Vrml97Parser.cpp"
 		match(LBRACKET);
 		{ // ( ... )*
 		for (;;) {
@@ -961,7 +962,7 @@ void Vrml97Parser::proto(
 				scope_ptr interfaceDeclScope(new Vrml97RootScope(browser,
 				this->uri));
 				
-#line 965 "Vrml97Parser.cpp"
+#line 966 "Vrml97Parser.cpp"
 				protoInterfaceDeclaration(
                 interfaceDeclScope,
                 static_cast<ProtoNodeClass &>(*nodeClass));
@@ -980,6 +981,13 @@ void Vrml97Parser::proto(
 		match(RBRACE);
 #line 696 "Vrml97Parser.g"
 		
+		//
+		// Compile the implementation before the PROTO is added to the
+		// node_class_map: from there, EXTERNPROTO may instantiate it in
+		// the scenes that other threads are parsing.
+		//
+		static_cast<ProtoNodeClass &>(*nodeClass).compileImpl();
+		
 		//
 		// Add the new node_class (prototype definition) to the browser's
 		// node_class_map.
@@ -993,7 +1001,11 @@ void Vrml97Parser::proto(
 		}
 		const browser::node_class_map_t::value_type
 		value(implId, nodeClass);
+		{
+		resource_loader::scoped_lock
+		lock(browser.node_class_map_mutex);
 		browser.node_class_map.insert(value);
+		}
 		
 		//
 		// PROTOs implicitly introduce a new node type as well...
@@ -1015,7 +1027,7 @@ void Vrml97Parser::proto(
 		id->getColumn());
 		}
 		
-#line 1019 "Vrml97Parser.cpp"
+#line 1031 "Vrml97Parser.cpp"
 	}
 	catch (ANTLR_USE_NAMESPACE(antlr)RecognitionException& ex) {
 		reportError(ex);
@@ -1030,7 +1042,7 @@ void Vrml97Parser::protoInterfaceDeclaration(
 ) {
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id0 = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id1 = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 734 "Vrml97Parser.g"
+#line 745 "Vrml97Parser.g"
 	
 	using openvrml::node_interface;
 	using antlr::SemanticException;
@@ -1039,7 +1051,7 @@ void Vrml97Parser::protoInterfaceDeclaration(
 	openvrml::field_value::type_id ft(field_value::invalid_type_id);
 	openvrml::field_value_ptr fv;
 	
-#line 1043 "Vrml97Parser.cpp"
+#line 1055 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -1050,7 +1062,7 @@ void Vrml97Parser::protoInterfaceDeclaration(
 			ft=fieldType();
 			id0 = LT(1);
 			match(ID);
-#line 744 "Vrml97Parser.g"
+#line 755 "Vrml97Parser.g"
 			
 			try {
 			switch (it) {
@@ -1072,7 +1084,7 @@ void Vrml97Parser::protoInterfaceDeclaration(
 			id0->getColumn());
 			}
 			
-#line 1076 "Vrml97Parser.cpp"
+#line 1088 "Vrml97Parser.cpp"
 			break;
 		}
 		case KEYWORD_EXPOSEDFIELD:
@@ -1083,7 +1095,7 @@ void Vrml97Parser::protoInterfaceDeclaration(
 			id1 = LT(1);
 			match(ID);
 			fv=fieldValue(proto.browser, scope, ft);
-#line 766 "Vrml97Parser.g"
+#line 777 "Vrml97Parser.g"
 			
 			assert(fv);
 			try {
@@ -1106,7 +1118,7 @@ void Vrml97Parser::protoInterfaceDeclaration(
 			id1->getColumn());
 			}
 			
-#line 1110 "Vrml97Parser.cpp"
+#line 1122 "Vrml97Parser.cpp"
 			break;
 		}
 		default:
@@ -1126,11 +1138,11 @@ void Vrml97Parser::protoBody(
 	const openvrml::scope_ptr & scope,
           openvrml::ProtoNodeClass & proto
 ) {
-#line 802 "Vrml97Parser.g"
+#line 813 "Vrml97Parser.g"
 	
 	openvrml::node_ptr n;
 	
-#line 1134 "Vrml97Parser.cpp"
+#line 1146 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		{ // ( ... )*
@@ -1146,9 +1158,9 @@ void Vrml97Parser::protoBody(
 		_loop15:;
 		} // ( ... )*
 		n=protoNodeStatement(proto, scope);
-#line 808 "Vrml97Parser.g"
+#line 819 "Vrml97Parser.g"
 		assert(n); proto.addRootNode(n);
-#line 1152 "Vrml97Parser.cpp"
+#line 1164 "Vrml97Parser.cpp"
 		{ // ( ... )*
 		for (;;) {
 			if ((_tokenSet_0.member(LA(1)))) {
@@ -1170,26 +1182,26 @@ void Vrml97Parser::protoBody(
 }
 
 openvrml::node_interface::type_id  Vrml97Parser::eventInterfaceType() {
-#line 790 "Vrml97Parser.g"
+#line 801 "Vrml97Parser.g"
 	openvrml::node_interface::type_id it = openvrml::node_interface::invalid_type_id;
-#line 1176 "Vrml97Parser.cpp"
+#line 1188 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
 		case KEYWORD_EVENTIN:
 		{
 			match(KEYWORD_EVENTIN);
-#line 791 "Vrml97Parser.g"
+#line 802 "Vrml97Parser.g"
 			it = openvrml::node_interface::eventin_id;
-#line 1185 "Vrml97Parser.cpp"
+#line 1197 "Vrml97Parser.cpp"
 			break;
 		}
 		case KEYWORD_EVENTOUT:
 		{
 			match(KEYWORD_EVENTOUT);
-#line 792 "Vrml97Parser.g"
+#line 803 "Vrml97Parser.g"
 			it = openvrml::node_interface::eventout_id;
-#line 1193 "Vrml97Parser.cpp"
+#line 1205 "Vrml97Parser.cpp"
 			break;
 		}
 		default:
@@ -1207,176 +1219,176 @@ openvrml::node_interface::type_id  Vrml97Parser::eventInterfaceType() {
 }
 
 openvrml::field_value::type_id  Vrml97Parser::fieldType() {
-#line 1316 "Vrml97Parser.g"
+#line 1328 "Vrml97Parser.g"
 	openvrml::field_value::type_id ft =
          openvrml::field_value::invalid_type_id;
-#line 1214 "Vrml97Parser.cpp"
-#line 1316 "Vrml97Parser.g"
+#line 1226 "Vrml97Parser.cpp"
+#line 1328 "Vrml97Parser.g"
 	
 	using openvrml::field_value;
 	
-#line 1219 "Vrml97Parser.cpp"
+#line 1231 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
 		case FIELDTYPE_MFCOLOR:
 		{
 			match(FIELDTYPE_MFCOLOR);
-#line 1322 "Vrml97Parser.g"
+#line 1334 "Vrml97Parser.g"
 			ft = field_value::mfcolor_id;
-#line 1228 "Vrml97Parser.cpp"
+#line 1240 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_MFFLOAT:
 		{
 			match(FIELDTYPE_MFFLOAT);
-#line 1323 "Vrml97Parser.g"
+#line 1335 "Vrml97Parser.g"
 			ft = field_value::mffloat_id;
-#line 1236 "Vrml97Parser.cpp"
+#line 1248 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_MFINT32:
 		{
 			match(FIELDTYPE_MFINT32);
-#line 1324 "Vrml97Parser.g"
+#line 1336 "Vrml97Parser.g"
 			ft = field_value::mfint32_id;
-#line 1244 "Vrml97Parser.cpp"
+#line 1256 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_MFNODE:
 		{
 			match(FIELDTYPE_MFNODE);
-#line 1325 "Vrml97Parser.g"
+#line 1337 "Vrml97Parser.g"
 			ft = field_value::mfnode_id;
-#line 1252 "Vrml97Parser.cpp"
+#line 1264 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_MFROTATION:
 		{
 			match(FIELDTYPE_MFROTATION);
-#line 1326 "Vrml97Parser.g"
+#line 1338 "Vrml97Parser.g"
 			ft = field_value::mfrotation_id;
-#line 1260 "Vrml97Parser.cpp"
+#line 1272 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_MFSTRING:
 		{
 			match(FIELDTYPE_MFSTRING);
-#line 1327 "Vrml97Parser.g"
+#line 1339 "Vrml97Parser.g"
 			ft = field_value::mfstring_id;
-#line 1268 "Vrml97Parser.cpp"
+#line 1280 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_MFTIME:
 		{
 			match(FIELDTYPE_MFTIME);
-#line 1328 "Vrml97Parser.g"
+#line 1340 "Vrml97Parser.g"
 			ft = field_value::mftime_id;
-#line 1276 "Vrml97Parser.cpp"
+#line 1288 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_MFVEC2F:
 		{
 			match(FIELDTYPE_MFVEC2F);
-#line 1329 "Vrml97Parser.g"
+#line 1341 "Vrml97Parser.g"
 			ft = field_value::mfvec2f_id;
-#line 1284 "Vrml97Parser.cpp"
+#line 1296 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_MFVEC3F:
 		{
 			match(FIELDTYPE_MFVEC3F);
-#line 1330 "Vrml97Parser.g"
+#line 1342 "Vrml97Parser.g"
 			ft = field_value::mfvec3f_id;
-#line 1292 "Vrml97Parser.cpp"
+#line 1304 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_SFBOOL:
 		{
 			match(FIELDTYPE_SFBOOL);
-#line 1331 "Vrml97Parser.g"
+#line 1343 "Vrml97Parser.g"
 			ft = field_value::sfbool_id;
-#line 1300 "Vrml97Parser.cpp"
+#line 1312 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_SFCOLOR:
 		{
 			match(FIELDTYPE_SFCOLOR);
-#line 1332 "Vrml97Parser.g"
+#line 1344 "Vrml97Parser.g"
 			ft = field_value::sfcolor_id;
-#line 1308 "Vrml97Parser.cpp"
+#line 1320 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_SFFLOAT:
 		{
 			match(FIELDTYPE_SFFLOAT);
-#line 1333 "Vrml97Parser.g"
+#line 1345 "Vrml97Parser.g"
 			ft = field_value::sffloat_id;
-#line 1316 "Vrml97Parser.cpp"
+#line 1328 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_SFIMAGE:
 		{
 			match(FIELDTYPE_SFIMAGE);
-#line 1334 "Vrml97Parser.g"
+#line 1346 "Vrml97Parser.g"
 			ft = field_value::sfimage_id;
-#line 1324 "Vrml97Parser.cpp"
+#line 1336 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_SFINT32:
 		{
 			match(FIELDTYPE_SFINT32);
-#line 1335 "Vrml97Parser.g"
+#line 1347 "Vrml97Parser.g"
 			ft = field_value::sfint32_id;
-#line 1332 "Vrml97Parser.cpp"
+#line 1344 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_SFNODE:
 		{
 			match(FIELDTYPE_SFNODE);
-#line 1336 "Vrml97Parser.g"
+#line 1348 "Vrml97Parser.g"
 			ft = field_value::sfnode_id;
-#line 1340 "Vrml97Parser.cpp"
+#line 1352 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_SFROTATION:
 		{
 			match(FIELDTYPE_SFROTATION);
-#line 1337 "Vrml97Parser.g"
+#line 1349 "Vrml97Parser.g"
 			ft = field_value::sfrotation_id;
-#line 1348 "Vrml97Parser.cpp"
+#line 1360 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_SFSTRING:
 		{
 			match(FIELDTYPE_SFSTRING);
-#line 1338 "Vrml97Parser.g"
+#line 1350 "Vrml97Parser.g"
 			ft = field_value::sfstring_id;
-#line 1356 "Vrml97Parser.cpp"
+#line 1368 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_SFTIME:
 		{
 			match(FIELDTYPE_SFTIME);
-#line 1339 "Vrml97Parser.g"
+#line 1351 "Vrml97Parser.g"
 			ft = field_value::sftime_id;
-#line 1364 "Vrml97Parser.cpp"
+#line 1376 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_SFVEC2F:
 		{
 			match(FIELDTYPE_SFVEC2F);
-#line 1340 "Vrml97Parser.g"
+#line 1352 "Vrml97Parser.g"
 			ft = field_value::sfvec2f_id;
-#line 1372 "Vrml97Parser.cpp"
+#line 1384 "Vrml97Parser.cpp"
 			break;
 		}
 		case FIELDTYPE_SFVEC3F:
 		{
 			match(FIELDTYPE_SFVEC3F);
-#line 1341 "Vrml97Parser.g"
+#line 1353 "Vrml97Parser.g"
 			ft = field_value::sfvec3f_id;
-#line 1380 "Vrml97Parser.cpp"
+#line 1392 "Vrml97Parser.cpp"
 			break;
 		}
 		default:
@@ -1394,27 +1406,27 @@ openvrml::field_value::type_id  Vrml97Parser::fieldType() {
 }
 
 openvrml::node_interface::type_id  Vrml97Parser::fieldInterfaceType() {
-#line 795 "Vrml97Parser.g"
+#line 806 "Vrml97Parser.g"
 	openvrml::node_interface::type_id it =
             openvrml::node_interface::invalid_type_id;
-#line 1401 "Vrml97Parser.cpp"
+#line 1413 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
 		case KEYWORD_FIELD:
 		{
 			match(KEYWORD_FIELD);
-#line 798 "Vrml97Parser.g"
+#line 809 "Vrml97Parser.g"
 			it = openvrml::node_interface::field_id;
-#line 1410 "Vrml97Parser.cpp"
+#line 1422 "Vrml97Parser.cpp"
 			break;
 		}
 		case KEYWORD_EXPOSEDFIELD:
 		{
 			match(KEYWORD_EXPOSEDFIELD);
-#line 799 "Vrml97Parser.g"
+#line 810 "Vrml97Parser.g"
 			it = openvrml::node_interface::exposedfield_id;
-#line 1418 "Vrml97Parser.cpp"
+#line 1430 "Vrml97Parser.cpp"
 			break;
 		}
 		default:
@@ -1436,14 +1448,14 @@ openvrml::field_value_ptr  Vrml97Parser::fieldValue(
            const openvrml::scope_ptr & scope,
            openvrml::field_value::type_id ft
 ) {
-#line 1344 "Vrml97Parser.g"
+#line 1356 "Vrml97Parser.g"
 	openvrml::field_value_ptr fv;
-#line 1442 "Vrml97Parser.cpp"
-#line 1344 "Vrml97Parser.g"
+#line 1454 "Vrml97Parser.cpp"
+#line 1356 "Vrml97Parser.g"
 	
 	using openvrml::field_value;
 	
-#line 1447 "Vrml97Parser.cpp"
+#line 1459 "Vrml97Parser.cpp"
 	
 	if (((_tokenSet_10.member(LA(1))))&&( (ft == field_value::sfnode_id) || (ft == field_value::mfnode_id) )) {
 		fv=nodeFieldValue(browser, scope, ft);
@@ -1462,16 +1474,16 @@ openvrml::node_ptr  Vrml97Parser::protoNodeStatement(
 	openvrml::ProtoNodeClass & proto,
                    const openvrml::scope_ptr & scope
 ) {
-#line 822 "Vrml97Parser.g"
+#line 833 "Vrml97Parser.g"
 	openvrml::node_ptr n;
-#line 1468 "Vrml97Parser.cpp"
+#line 1480 "Vrml97Parser.cpp"
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id0 = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id1 = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 822 "Vrml97Parser.g"
+#line 833 "Vrml97Parser.g"
 	
 	using antlr::SemanticException;
 	
-#line 1475 "Vrml97Parser.cpp"
+#line 1487 "Vrml97Parser.cpp"
 	
 	switch ( LA(1)) {
 	case KEYWORD_DEF:
@@ -1487,7 +1499,7 @@ openvrml::node_ptr  Vrml97Parser::protoNodeStatement(
 		match(KEYWORD_USE);
 		id1 = LT(1);
 		match(ID);
-#line 830 "Vrml97Parser.g"
+#line 841 "Vrml97Parser.g"
 		
 		n.reset(scope->find_node(id1->getText()));
 		if (!n) {
@@ -1499,7 +1511,7 @@ openvrml::node_ptr  Vrml97Parser::protoNodeStatement(
 		id1->getColumn());
 		}
 		
-#line 1503 "Vrml97Parser.cpp"
+#line 1515 "Vrml97Parser.cpp"
 		break;
 	}
 	case ID:
@@ -1519,11 +1531,11 @@ void Vrml97Parser::protoBodyStatement(
 	openvrml::ProtoNodeClass & proto,
                    const openvrml::scope_ptr & scope
 ) {
-#line 812 "Vrml97Parser.g"
+#line 823 "Vrml97Parser.g"
 	
 	openvrml::node_ptr n;
 	
-#line 1527 "Vrml97Parser.cpp"
+#line 1539 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -1532,9 +1544,9 @@ void Vrml97Parser::protoBodyStatement(
 		case KEYWORD_USE:
 		{
 			n=protoNodeStatement(proto, scope);
-#line 817 "Vrml97Parser.g"
+#line 828 "Vrml97Parser.g"
 			assert(n); proto.addRootNode(n);
-#line 1538 "Vrml97Parser.cpp"
+#line 1550 "Vrml97Parser.cpp"
 			break;
 		}
 		case KEYWORD_EXTERNPROTO:
@@ -1566,12 +1578,12 @@ openvrml::node_ptr  Vrml97Parser::protoNode(
           const openvrml::scope_ptr & scope,
           const std::string & nodeId
 ) {
-#line 1096 "Vrml97Parser.g"
+#line 1108 "Vrml97Parser.g"
 	openvrml::node_ptr n;
-#line 1572 "Vrml97Parser.cpp"
+#line 1584 "Vrml97Parser.cpp"
 	ANTLR_USE_NAMESPACE(antlr)RefToken  scriptId = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	ANTLR_USE_NAMESPACE(antlr)RefToken  nodeTypeId = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 1096 "Vrml97Parser.g"
+#line 1108 "Vrml97Parser.g"
 	
 	using openvrml::node_type_ptr;
 	using openvrml::node_ptr;
@@ -1580,12 +1592,12 @@ openvrml::node_ptr  Vrml97Parser::protoNode(
 	
 	node_type_ptr nodeType;
 	
-#line 1584 "Vrml97Parser.cpp"
+#line 1596 "Vrml97Parser.cpp"
 	
 	if (((LA(1) == ID))&&( !LT(1)->getText().compare("Script") )) {
 		scriptId = LT(1);
 		match(ID);
-#line 1109 "Vrml97Parser.g"
+#line 1121 "Vrml97Parser.g"
 		
 		n.reset(new script_node(proto.browser.script_node_class_, scope));
 		if (!nodeId.empty()) { n->id(nodeId); }
@@ -1593,7 +1605,7 @@ openvrml::node_ptr  Vrml97Parser::protoNode(
 		script_node * const scriptNode = n->to_script();
 		assert(scriptNode);
 		
-#line 1597 "Vrml97Parser.cpp"
+#line 1609 "Vrml97Parser.cpp"
 		match(LBRACE);
 		{ // ( ... )*
 		for (;;) {
@@ -1626,7 +1638,7 @@ openvrml::node_ptr  Vrml97Parser::protoNode(
 	else if ((LA(1) == ID)) {
 		nodeTypeId = LT(1);
 		match(ID);
-#line 1121 "Vrml97Parser.g"
+#line 1133 "Vrml97Parser.g"
 		
 		nodeType = scope->find_type(nodeTypeId->getText());
 		if (!nodeType) {
@@ -1639,7 +1651,7 @@ openvrml::node_ptr  Vrml97Parser::protoNode(
 		n = nodeType->create_node(scope);
 		if (!nodeId.empty()) { n->id(nodeId); }
 		
-#line 1643 "Vrml97Parser.cpp"
+#line 1655 "Vrml97Parser.cpp"
 		match(LBRACE);
 		{ // ( ... )*
 		for (;;) {
@@ -1666,7 +1678,7 @@ void Vrml97Parser::externInterfaceDeclaration(
 	openvrml::node_interface_set & interfaces
 ) {
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 884 "Vrml97Parser.g"
+#line 896 "Vrml97Parser.g"
 	
 	using openvrml::node_interface;
 	using openvrml::field_value;
@@ -1674,14 +1686,14 @@ void Vrml97Parser::externInterfaceDeclaration(
 	node_interface::type_id it(node_interface::invalid_type_id);
 	field_value::type_id ft(field_value::invalid_type_id);
 	
-#line 1678 "Vrml97Parser.cpp"
+#line 1690 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		it=interfaceType();
 		ft=fieldType();
 		id = LT(1);
 		match(ID);
-#line 892 "Vrml97Parser.g"
+#line 904 "Vrml97Parser.g"
 		
 		const node_interface interface(it, ft, id->getText());
 		try {
@@ -1693,7 +1705,7 @@ void Vrml97Parser::externInterfaceDeclaration(
 		id->getColumn());
 		}
 		
-#line 1697 "Vrml97Parser.cpp"
+#line 1709 "Vrml97Parser.cpp"
 	}
 	catch (ANTLR_USE_NAMESPACE(antlr)RecognitionException& ex) {
 		reportError(ex);
@@ -1703,26 +1715,26 @@ void Vrml97Parser::externInterfaceDeclaration(
 }
 
 openvrml::mfstring  Vrml97Parser::externprotoUrlList() {
-#line 911 "Vrml97Parser.g"
+#line 923 "Vrml97Parser.g"
 	openvrml::mfstring urlList;
-#line 1709 "Vrml97Parser.cpp"
-#line 911 "Vrml97Parser.g"
+#line 1721 "Vrml97Parser.cpp"
+#line 923 "Vrml97Parser.g"
 	
 	using std::string;
 	using openvrml::mfstring;
 	
 	string s;
 	
-#line 1717 "Vrml97Parser.cpp"
+#line 1729 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
 		case STRING:
 		{
 			s=stringValue();
-#line 918 "Vrml97Parser.g"
+#line 930 "Vrml97Parser.g"
 			urlList.value.push_back(s);
-#line 1726 "Vrml97Parser.cpp"
+#line 1738 "Vrml97Parser.cpp"
 			break;
 		}
 		case LBRACKET:
@@ -1732,9 +1744,9 @@ openvrml::mfstring  Vrml97Parser::externprotoUrlList() {
 			for (;;) {
 				if ((LA(1) == STRING)) {
 					s=stringValue();
-#line 919 "Vrml97Parser.g"
+#line 931 "Vrml97Parser.g"
 					urlList.value.push_back(s);
-#line 1738 "Vrml97Parser.cpp"
+#line 1750 "Vrml97Parser.cpp"
 				}
 				else {
 					goto _loop27;
@@ -1761,9 +1773,9 @@ openvrml::mfstring  Vrml97Parser::externprotoUrlList() {
 }
 
 openvrml::node_interface::type_id  Vrml97Parser::interfaceType() {
-#line 905 "Vrml97Parser.g"
+#line 917 "Vrml97Parser.g"
 	openvrml::node_interface::type_id it = openvrml::node_interface::invalid_type_id;
-#line 1767 "Vrml97Parser.cpp"
+#line 1779 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -1794,19 +1806,19 @@ openvrml::node_interface::type_id  Vrml97Parser::interfaceType() {
 }
 
 std::string  Vrml97Parser::stringValue() {
-#line 1686 "Vrml97Parser.g"
+#line 1698 "Vrml97Parser.g"
 	std::string str;
-#line 1800 "Vrml97Parser.cpp"
+#line 1812 "Vrml97Parser.cpp"
 	ANTLR_USE_NAMESPACE(antlr)RefToken  s = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	
 	s = LT(1);
 	match(STRING);
-#line 1689 "Vrml97Parser.g"
+#line 1701 "Vrml97Parser.g"
 	
 	const std::string temp(s->getText());
 	str = std::string(temp.begin() + 1, temp.end() - 1);
 	
-#line 1810 "Vrml97Parser.cpp"
+#line 1822 "Vrml97Parser.cpp"
 	return str;
 }
 
@@ -1815,14 +1827,14 @@ void Vrml97Parser::nodeBodyElement(
                 openvrml::node & node
 ) {
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 1003 "Vrml97Parser.g"
+#line 1015 "Vrml97Parser.g"
 	
 	using openvrml::field_value;
 	using antlr::SemanticException;
 	field_value::type_id ft(field_value::invalid_type_id);
 	field_value_ptr fv;
 	
-#line 1826 "Vrml97Parser.cpp"
+#line 1838 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -1830,7 +1842,7 @@ void Vrml97Parser::nodeBodyElement(
 		{
 			id = LT(1);
 			match(ID);
-#line 1011 "Vrml97Parser.g"
+#line 1023 "Vrml97Parser.g"
 			
 			ft = node.type.has_field(id->getText());
 			if (ft == field_value::invalid_type_id) {
@@ -1845,14 +1857,14 @@ void Vrml97Parser::nodeBodyElement(
 			}
 			}
 			
-#line 1849 "Vrml97Parser.cpp"
+#line 1861 "Vrml97Parser.cpp"
 			fv=fieldValue(node.type.node_class.browser, scope, ft);
-#line 1025 "Vrml97Parser.g"
+#line 1037 "Vrml97Parser.g"
 			
 			assert(fv);
 			node.field(id->getText(), *fv);
 			
-#line 1856 "Vrml97Parser.cpp"
+#line 1868 "Vrml97Parser.cpp"
 			break;
 		}
 		case KEYWORD_ROUTE:
@@ -1884,7 +1896,7 @@ void Vrml97Parser::scriptInterfaceDeclaration(
                            openvrml::script_node & node
 ) {
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 1033 "Vrml97Parser.g"
+#line 1045 "Vrml97Parser.g"
 	
 	using openvrml::node_interface;
 	using openvrml::field_value;
@@ -1892,7 +1904,7 @@ void Vrml97Parser::scriptInterfaceDeclaration(
 	node_interface::type_id it(node_interface::invalid_type_id);
 	field_value::type_id ft(field_value::invalid_type_id);
 	
-#line 1896 "Vrml97Parser.cpp"
+#line 1908 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -1903,7 +1915,7 @@ void Vrml97Parser::scriptInterfaceDeclaration(
 			ft=fieldType();
 			id = LT(1);
 			match(ID);
-#line 1042 "Vrml97Parser.g"
+#line 1054 "Vrml97Parser.g"
 			
 			const node_interface_set::const_iterator pos =
 			node.node::type.interfaces().find(id->getText());
@@ -1926,7 +1938,7 @@ void Vrml97Parser::scriptInterfaceDeclaration(
 			assert(false);
 			}
 			
-#line 1930 "Vrml97Parser.cpp"
+#line 1942 "Vrml97Parser.cpp"
 			break;
 		}
 		case KEYWORD_FIELD:
@@ -1952,7 +1964,7 @@ void Vrml97Parser::scriptFieldInterfaceDeclaration(
                                 openvrml::script_node & node
 ) {
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 1067 "Vrml97Parser.g"
+#line 1079 "Vrml97Parser.g"
 	
 	using std::find_if;
 	using openvrml::field_value;
@@ -1961,7 +1973,7 @@ void Vrml97Parser::scriptFieldInterfaceDeclaration(
 	field_value::type_id ft = field_value::invalid_type_id;
 	field_value_ptr fv;
 	
-#line 1965 "Vrml97Parser.cpp"
+#line 1977 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		match(KEYWORD_FIELD);
@@ -1969,7 +1981,7 @@ void Vrml97Parser::scriptFieldInterfaceDeclaration(
 		id = LT(1);
 		match(ID);
 		fv=fieldValue(node.node::type.node_class.browser, scope, ft);
-#line 1078 "Vrml97Parser.g"
+#line 1090 "Vrml97Parser.g"
 		
 		assert(fv);
 		const node_interface_set & interfaces =
@@ -1986,7 +1998,7 @@ void Vrml97Parser::scriptFieldInterfaceDeclaration(
 		}
 		node.add_field(id->getText(), fv);
 		
-#line 1990 "Vrml97Parser.cpp"
+#line 2002 "Vrml97Parser.cpp"
 	}
 	catch (ANTLR_USE_NAMESPACE(antlr)RecognitionException& ex) {
 		reportError(ex);
@@ -2002,7 +2014,7 @@ void Vrml97Parser::protoNodeBodyElement(
 ) {
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	ANTLR_USE_NAMESPACE(antlr)RefToken  eventId = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 1136 "Vrml97Parser.g"
+#line 1148 "Vrml97Parser.g"
 	
 	using openvrml::field_value;
 	using antlr::SemanticException;
@@ -2010,7 +2022,7 @@ void Vrml97Parser::protoNodeBodyElement(
 	field_value::type_id ft(field_value::invalid_type_id);
 	field_value_ptr fv;
 	
-#line 2014 "Vrml97Parser.cpp"
+#line 2026 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -2030,7 +2042,7 @@ void Vrml97Parser::protoNodeBodyElement(
         || node.type.has_exposedfield(LT(1)->getText()) )) {
 				id = LT(1);
 				match(ID);
-#line 1147 "Vrml97Parser.g"
+#line 1159 "Vrml97Parser.g"
 				
 				ft = node.type.has_field(id->getText());
 				if (ft == field_value::invalid_type_id) {
@@ -2045,7 +2057,7 @@ void Vrml97Parser::protoNodeBodyElement(
 				}
 				}
 				
-#line 2049 "Vrml97Parser.cpp"
+#line 2061 "Vrml97Parser.cpp"
 				{
 				switch ( LA(1)) {
 				case LBRACKET:
@@ -2062,12 +2074,12 @@ void Vrml97Parser::protoNodeBodyElement(
 				{
 					{
 					fv=protoFieldValue(proto, scope, ft);
-#line 1162 "Vrml97Parser.g"
+#line 1174 "Vrml97Parser.g"
 					
 					assert(fv);
 					node.field(id->getText(), *fv);
 					
-#line 2071 "Vrml97Parser.cpp"
+#line 2083 "Vrml97Parser.cpp"
 					}
 					break;
 				}
@@ -2106,7 +2118,7 @@ void Vrml97Parser::protoScriptInterfaceDeclaration(
                                 openvrml::script_node & node
 ) {
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 1197 "Vrml97Parser.g"
+#line 1209 "Vrml97Parser.g"
 	
 	using openvrml::node_interface;
 	using openvrml::field_value;
@@ -2114,7 +2126,7 @@ void Vrml97Parser::protoScriptInterfaceDeclaration(
 	node_interface::type_id it(node_interface::invalid_type_id);
 	field_value::type_id ft(field_value::invalid_type_id);
 	
-#line 2118 "Vrml97Parser.cpp"
+#line 2130 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -2125,7 +2137,7 @@ void Vrml97Parser::protoScriptInterfaceDeclaration(
 			ft=fieldType();
 			id = LT(1);
 			match(ID);
-#line 1207 "Vrml97Parser.g"
+#line 1219 "Vrml97Parser.g"
 			
 			const node_interface_set::const_iterator pos =
 			node.node::type.interfaces().find(id->getText());
@@ -2148,7 +2160,7 @@ void Vrml97Parser::protoScriptInterfaceDeclaration(
 			assert(false);
 			}
 			
-#line 2152 "Vrml97Parser.cpp"
+#line 2164 "Vrml97Parser.cpp"
 			{
 			switch ( LA(1)) {
 			case KEYWORD_IS:
@@ -2198,27 +2210,27 @@ openvrml::field_value_ptr  Vrml97Parser::protoFieldValue(
                 const openvrml::scope_ptr & scope,
                 openvrml::field_value::type_id ft
 ) {
-#line 1357 "Vrml97Parser.g"
+#line 1369 "Vrml97Parser.g"
 	openvrml::field_value_ptr fv;
-#line 2204 "Vrml97Parser.cpp"
-#line 1357 "Vrml97Parser.g"
+#line 2216 "Vrml97Parser.cpp"
+#line 1369 "Vrml97Parser.g"
 	
 	using openvrml::field_value;
 	
-#line 2209 "Vrml97Parser.cpp"
+#line 2221 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		if (((_tokenSet_10.member(LA(1))))&&( (ft == field_value::sfnode_id) || (ft == field_value::mfnode_id) )) {
 			fv=protoNodeFieldValue(proto, scope, ft);
-#line 1365 "Vrml97Parser.g"
+#line 1377 "Vrml97Parser.g"
 			assert(fv);
-#line 2216 "Vrml97Parser.cpp"
+#line 2228 "Vrml97Parser.cpp"
 		}
 		else if ((_tokenSet_11.member(LA(1)))) {
 			fv=nonNodeFieldValue(ft);
-#line 1366 "Vrml97Parser.g"
+#line 1378 "Vrml97Parser.g"
 			assert(fv);
-#line 2222 "Vrml97Parser.cpp"
+#line 2234 "Vrml97Parser.cpp"
 		}
 		else {
 			throw ANTLR_USE_NAMESPACE(antlr)NoViableAltException(LT(1), getFilename());
@@ -2238,17 +2250,17 @@ void Vrml97Parser::isStatement(
             std::string const & nodeInterfaceId
 ) {
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 1174 "Vrml97Parser.g"
+#line 1186 "Vrml97Parser.g"
 	
 	using antlr::SemanticException;
 	
-#line 2246 "Vrml97Parser.cpp"
+#line 2258 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		match(KEYWORD_IS);
 		id = LT(1);
 		match(ID);
-#line 1179 "Vrml97Parser.g"
+#line 1191 "Vrml97Parser.g"
 		
 		try {
 		proto.addIS(node, nodeInterfaceId, id->getText());
@@ -2265,7 +2277,7 @@ void Vrml97Parser::isStatement(
 		id->getColumn());
 		}
 		
-#line 2269 "Vrml97Parser.cpp"
+#line 2281 "Vrml97Parser.cpp"
 	}
 	catch (ANTLR_USE_NAMESPACE(antlr)RecognitionException& ex) {
 		reportError(ex);
@@ -2281,7 +2293,7 @@ void Vrml97Parser::protoScriptFieldInterfaceDeclaration(
 ) {
 	ANTLR_USE_NAMESPACE(antlr)RefToken  id = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	ANTLR_USE_NAMESPACE(antlr)RefToken  protoFieldId = ANTLR_USE_NAMESPACE(antlr)nullToken;
-#line 1232 "Vrml97Parser.g"
+#line 1244 "Vrml97Parser.g"
 	
 	using std::find_if;
 	using openvrml::field_value;
@@ -2290,14 +2302,14 @@ void Vrml97Parser::protoScriptFieldInterfaceDeclaration(
 	field_value::type_id ft(field_value::invalid_type_id);
 	field_value_ptr fv;
 	
-#line 2294 "Vrml97Parser.cpp"
+#line 2306 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		match(KEYWORD_FIELD);
 		ft=fieldType();
 		id = LT(1);
 		match(ID);
-#line 1243 "Vrml97Parser.g"
+#line 1255 "Vrml97Parser.g"
 		
 		//
 		// We need to check if the fieldId is an exact match for any
@@ -2318,7 +2330,7 @@ void Vrml97Parser::protoScriptFieldInterfaceDeclaration(
 		id->getColumn());
 		}
 		
-#line 2322 "Vrml97Parser.cpp"
+#line 2334 "Vrml97Parser.cpp"
 		{
 		switch ( LA(1)) {
 		case LBRACKET:
@@ -2335,12 +2347,12 @@ void Vrml97Parser::protoScriptFieldInterfaceDeclaration(
 		{
 			{
 			fv=protoFieldValue(proto, scope, ft);
-#line 1264 "Vrml97Parser.g"
+#line 1276 "Vrml97Parser.g"
 			
 			assert(fv);
 			node.add_field(id->getText(), fv);
 			
-#line 2344 "Vrml97Parser.cpp"
+#line 2356 "Vrml97Parser.cpp"
 			}
 			break;
 		}
@@ -2350,7 +2362,7 @@ void Vrml97Parser::protoScriptFieldInterfaceDeclaration(
 			match(KEYWORD_IS);
 			protoFieldId = LT(1);
 			match(ID);
-#line 1270 "Vrml97Parser.g"
+#line 1282 "Vrml97Parser.g"
 			
 			//
 			// First, get the field value from the ProtoNodeClass'
@@ -2393,7 +2405,7 @@ void Vrml97Parser::protoScriptFieldInterfaceDeclaration(
 			protoFieldId->getColumn());
 			}
 			
-#line 2397 "Vrml97Parser.cpp"
+#line 2409 "Vrml97Parser.cpp"
 			}
 			break;
 		}
@@ -2416,14 +2428,14 @@ openvrml::field_value_ptr  Vrml97Parser::nodeFieldValue(
                const openvrml::scope_ptr & scope,
                openvrml::field_value::type_id ft
 ) {
-#line 1395 "Vrml97Parser.g"
+#line 1407 "Vrml97Parser.g"
 	openvrml::field_value_ptr fv;
-#line 2422 "Vrml97Parser.cpp"
-#line 1395 "Vrml97Parser.g"
+#line 2434 "Vrml97Parser.cpp"
+#line 1407 "Vrml97Parser.g"
 	
 	using openvrml::field_value;
 	
-#line 2427 "Vrml97Parser.cpp"
+#line 2439 "Vrml97Parser.cpp"
 	
 	if (((_tokenSet_14.member(LA(1))))&&( ft == field_value::sfnode_id )) {
 		fv=sfNodeValue(browser, scope);
@@ -2441,14 +2453,14 @@ openvrml::field_value_ptr  Vrml97Parser::nodeFieldValue(
 openvrml::field_value_ptr  Vrml97Parser::nonNodeFieldValue(
 	openvrml::field_value::type_id ft
 ) {
-#line 1369 "Vrml97Parser.g"
+#line 1381 "Vrml97Parser.g"
 	openvrml::field_value_ptr fv = openvrml::field_value_ptr(0);
-#line 2447 "Vrml97Parser.cpp"
-#line 1369 "Vrml97Parser.g"
+#line 2459 "Vrml97Parser.cpp"
+#line 1381 "Vrml97Parser.g"
 	
 	using openvrml::field_value;
 	
-#line 2452 "Vrml97Parser.cpp"
+#line 2464 "Vrml97Parser.cpp"
 	
 	if (((LA(1) == KEYWORD_FALSE || LA(1) == KEYWORD_TRUE))&&( ft == field_value::sfbool_id )) {
 		fv=sfBoolValue();
@@ -2516,9 +2528,9 @@ openvrml::field_value_ptr  Vrml97Parser::protoNodeFieldValue(
                     const openvrml::scope_ptr & scope,
                     openvrml::field_value::type_id ft
 ) {
-#line 1407 "Vrml97Parser.g"
+#line 1419 "Vrml97Parser.g"
 	openvrml::field_value_ptr fv;
-#line 2522 "Vrml97Parser.cpp"
+#line 2534 "Vrml97Parser.cpp"
 	
 	if (((_tokenSet_14.member(LA(1))))&&( ft == openvrml::field_value::sfnode_id )) {
 		fv=protoSfNodeValue(proto, scope);
@@ -2534,77 +2546,77 @@ openvrml::field_value_ptr  Vrml97Parser::protoNodeFieldValue(
 }
 
 openvrml::field_value_ptr  Vrml97Parser::sfBoolValue() {
-#line 1417 "Vrml97Parser.g"
+#line 1429 "Vrml97Parser.g"
 	openvrml::field_value_ptr sbv;
-#line 2540 "Vrml97Parser.cpp"
-#line 1417 "Vrml97Parser.g"
+#line 2552 "Vrml97Parser.cpp"
+#line 1429 "Vrml97Parser.g"
 	
 	bool val(false);
 	
-#line 2545 "Vrml97Parser.cpp"
+#line 2557 "Vrml97Parser.cpp"
 	
 	val=boolValue();
-#line 1422 "Vrml97Parser.g"
+#line 1434 "Vrml97Parser.g"
 	sbv.reset(new sfbool(val));
-#line 2550 "Vrml97Parser.cpp"
+#line 2562 "Vrml97Parser.cpp"
 	return sbv;
 }
 
 openvrml::field_value_ptr  Vrml97Parser::sfColorValue() {
-#line 1431 "Vrml97Parser.g"
+#line 1443 "Vrml97Parser.g"
 	openvrml::field_value_ptr scv;
-#line 2557 "Vrml97Parser.cpp"
-#line 1431 "Vrml97Parser.g"
+#line 2569 "Vrml97Parser.cpp"
+#line 1443 "Vrml97Parser.g"
 	
 	color c;
 	
-#line 2562 "Vrml97Parser.cpp"
+#line 2574 "Vrml97Parser.cpp"
 	
 	colorValue(c);
-#line 1436 "Vrml97Parser.g"
+#line 1448 "Vrml97Parser.g"
 	scv.reset(new sfcolor(c));
-#line 2567 "Vrml97Parser.cpp"
+#line 2579 "Vrml97Parser.cpp"
 	return scv;
 }
 
 openvrml::field_value_ptr  Vrml97Parser::sfFloatValue() {
-#line 1479 "Vrml97Parser.g"
+#line 1491 "Vrml97Parser.g"
 	openvrml::field_value_ptr sfv;
-#line 2574 "Vrml97Parser.cpp"
-#line 1479 "Vrml97Parser.g"
+#line 2586 "Vrml97Parser.cpp"
+#line 1491 "Vrml97Parser.g"
 	
 	float f;
 	
-#line 2579 "Vrml97Parser.cpp"
+#line 2591 "Vrml97Parser.cpp"
 	
 	f=floatValue();
-#line 1484 "Vrml97Parser.g"
+#line 1496 "Vrml97Parser.g"
 	sfv.reset(new sffloat(f));
-#line 2584 "Vrml97Parser.cpp"
+#line 2596 "Vrml97Parser.cpp"
 	return sfv;
 }
 
 openvrml::field_value_ptr  Vrml97Parser::sfImageValue() {
-#line 1505 "Vrml97Parser.g"
+#line 1517 "Vrml97Parser.g"
 	openvrml::field_value_ptr siv;
-#line 2591 "Vrml97Parser.cpp"
-#line 1505 "Vrml97Parser.g"
+#line 2603 "Vrml97Parser.cpp"
+#line 1517 "Vrml97Parser.g"
 	
 	unsigned long w(0L), h(0L), com(0L), pixel(0L);
 	
-#line 2596 "Vrml97Parser.cpp"
+#line 2608 "Vrml97Parser.cpp"
 	
 	w=intValue();
 	h=intValue();
 	com=intValue();
-#line 1511 "Vrml97Parser.g"
+#line 1523 "Vrml97Parser.g"
 	std::vector<unsigned char> pixelVector;
-#line 2603 "Vrml97Parser.cpp"
+#line 2615 "Vrml97Parser.cpp"
 	{ // ( ... )*
 	for (;;) {
 		if ((LA(1) == INTEGER || LA(1) == HEX_INTEGER)) {
 			pixel=intValue();
-#line 1514 "Vrml97Parser.g"
+#line 1526 "Vrml97Parser.g"
 			
 			// need to confirm the cross-platform-ness of this, it
 			// looks kind of ugly but might in fact be ok. basically,
@@ -2616,7 +2628,7 @@ openvrml::field_value_ptr  Vrml97Parser::sfImageValue() {
 			pixelVector.push_back(component);
 			}
 			
-#line 2620 "Vrml97Parser.cpp"
+#line 2632 "Vrml97Parser.cpp"
 		}
 		else {
 			goto _loop73;
@@ -2625,7 +2637,7 @@ openvrml::field_value_ptr  Vrml97Parser::sfImageValue() {
 	}
 	_loop73:;
 	} // ( ... )*
-#line 1526 "Vrml97Parser.g"
+#line 1538 "Vrml97Parser.g"
 	
 	// if somebody gives us a really, really, really big
 	// pixeltexture, then we will crash. in the age of dos
@@ -2644,40 +2656,40 @@ openvrml::field_value_ptr  Vrml97Parser::sfImageValue() {
 	}
 	siv.reset(new sfimage(w, h, com, &pixelVector[0]));
 	
-#line 2648 "Vrml97Parser.cpp"
+#line 2660 "Vrml97Parser.cpp"
 	return siv;
 }
 
 openvrml::field_value_ptr  Vrml97Parser::sfInt32Value() {
-#line 1546 "Vrml97Parser.g"
+#line 1558 "Vrml97Parser.g"
 	openvrml::field_value_ptr siv;
-#line 2655 "Vrml97Parser.cpp"
-#line 1546 "Vrml97Parser.g"
+#line 2667 "Vrml97Parser.cpp"
+#line 1558 "Vrml97Parser.g"
 	
 	long i;
 	
-#line 2660 "Vrml97Parser.cpp"
+#line 2672 "Vrml97Parser.cpp"
 	
 	i=intValue();
-#line 1551 "Vrml97Parser.g"
+#line 1563 "Vrml97Parser.g"
 	siv.reset(new sfint32(i));
-#line 2665 "Vrml97Parser.cpp"
+#line 2677 "Vrml97Parser.cpp"
 	return siv;
 }
 
 openvrml::field_value_ptr  Vrml97Parser::sfRotationValue() {
-#line 1624 "Vrml97Parser.g"
+#line 1636 "Vrml97Parser.g"
 	openvrml::field_value_ptr srv;
-#line 2672 "Vrml97Parser.cpp"
-#line 1624 "Vrml97Parser.g"
+#line 2684 "Vrml97Parser.cpp"
+#line 1636 "Vrml97Parser.g"
 	rotation r;
-#line 2675 "Vrml97Parser.cpp"
+#line 2687 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		rotationValue(r);
-#line 1626 "Vrml97Parser.g"
+#line 1638 "Vrml97Parser.g"
 		srv.reset(new sfrotation(r));
-#line 2681 "Vrml97Parser.cpp"
+#line 2693 "Vrml97Parser.cpp"
 	}
 	catch (ANTLR_USE_NAMESPACE(antlr)RecognitionException& ex) {
 		reportError(ex);
@@ -2688,87 +2700,87 @@ openvrml::field_value_ptr  Vrml97Parser::sfRotationValue() {
 }
 
 openvrml::field_value_ptr  Vrml97Parser::sfStringValue() {
-#line 1668 "Vrml97Parser.g"
+#line 1680 "Vrml97Parser.g"
 	openvrml::field_value_ptr ssv;
-#line 2694 "Vrml97Parser.cpp"
-#line 1668 "Vrml97Parser.g"
+#line 2706 "Vrml97Parser.cpp"
+#line 1680 "Vrml97Parser.g"
 	std::string s;
-#line 2697 "Vrml97Parser.cpp"
+#line 2709 "Vrml97Parser.cpp"
 	
 	s=stringValue();
-#line 1671 "Vrml97Parser.g"
+#line 1683 "Vrml97Parser.g"
 	ssv.reset(new sfstring(s));
-#line 2702 "Vrml97Parser.cpp"
+#line 2714 "Vrml97Parser.cpp"
 	return ssv;
 }
 
 openvrml::field_value_ptr  Vrml97Parser::sfTimeValue() {
-#line 1695 "Vrml97Parser.g"
+#line 1707 "Vrml97Parser.g"
 	openvrml::field_value_ptr stv;
-#line 2709 "Vrml97Parser.cpp"
-#line 1695 "Vrml97Parser.g"
+#line 2721 "Vrml97Parser.cpp"
+#line 1707 "Vrml97Parser.g"
 	double t(0.0);
-#line 2712 "Vrml97Parser.cpp"
+#line 2724 "Vrml97Parser.cpp"
 	
 	t=doubleValue();
-#line 1698 "Vrml97Parser.g"
+#line 1710 "Vrml97Parser.g"
 	stv.reset(new sftime(t));
-#line 2717 "Vrml97Parser.cpp"
+#line 2729 "Vrml97Parser.cpp"
 	return stv;
 }
 
 openvrml::field_value_ptr  Vrml97Parser::sfVec2fValue() {
-#line 1718 "Vrml97Parser.g"
+#line 1730 "Vrml97Parser.g"
 	openvrml::field_value_ptr svv;
-#line 2724 "Vrml97Parser.cpp"
-#line 1718 "Vrml97Parser.g"
+#line 2736 "Vrml97Parser.cpp"
+#line 1730 "Vrml97Parser.g"
 	vec2f v;
-#line 2727 "Vrml97Parser.cpp"
+#line 2739 "Vrml97Parser.cpp"
 	
 	vec2fValue(v);
-#line 1721 "Vrml97Parser.g"
+#line 1733 "Vrml97Parser.g"
 	svv.reset(new sfvec2f(v));
-#line 2732 "Vrml97Parser.cpp"
+#line 2744 "Vrml97Parser.cpp"
 	return svv;
 }
 
 openvrml::field_value_ptr  Vrml97Parser::sfVec3fValue() {
-#line 1745 "Vrml97Parser.g"
+#line 1757 "Vrml97Parser.g"
 	openvrml::field_value_ptr svv;
-#line 2739 "Vrml97Parser.cpp"
-#line 1745 "Vrml97Parser.g"
+#line 2751 "Vrml97Parser.cpp"
+#line 1757 "Vrml97Parser.g"
 	
 	vec3f v;
 	
-#line 2744 "Vrml97Parser.cpp"
+#line 2756 "Vrml97Parser.cpp"
 	
 	vec3fValue(v);
-#line 1750 "Vrml97Parser.g"
+#line 1762 "Vrml97Parser.g"
 	svv.reset(new sfvec3f(v));
-#line 2749 "Vrml97Parser.cpp"
+#line 2761 "Vrml97Parser.cpp"
 	return svv;
 }
 
 openvrml::field_value_ptr  Vrml97Parser::mfColorValue() {
-#line 1439 "Vrml97Parser.g"
+#line 1451 "Vrml97Parser.g"
 	openvrml::field_value_ptr mcv =
             openvrml::field_value_ptr(new mfcolor);
-#line 2757 "Vrml97Parser.cpp"
-#line 1439 "Vrml97Parser.g"
+#line 2769 "Vrml97Parser.cpp"
+#line 1451 "Vrml97Parser.g"
 	
 	color c;
 	mfcolor & colors = static_cast<mfcolor &>(*mcv);
 	
-#line 2763 "Vrml97Parser.cpp"
+#line 2775 "Vrml97Parser.cpp"
 	
 	switch ( LA(1)) {
 	case INTEGER:
 	case REAL:
 	{
 		colorValue(c);
-#line 1447 "Vrml97Parser.g"
+#line 1459 "Vrml97Parser.g"
 		colors.value.push_back(c);
-#line 2772 "Vrml97Parser.cpp"
+#line 2784 "Vrml97Parser.cpp"
 		break;
 	}
 	case LBRACKET:
@@ -2778,9 +2790,9 @@ openvrml::field_value_ptr  Vrml97Parser::mfColorValue() {
 		for (;;) {
 			if ((LA(1) == INTEGER || LA(1) == REAL)) {
 				colorValue(c);
-#line 1448 "Vrml97Parser.g"
+#line 1460 "Vrml97Parser.g"
 				colors.value.push_back(c);
-#line 2784 "Vrml97Parser.cpp"
+#line 2796 "Vrml97Parser.cpp"
 			}
 			else {
 				goto _loop63;
@@ -2801,25 +2813,25 @@ openvrml::field_value_ptr  Vrml97Parser::mfColorValue() {
 }
 
 openvrml::field_value_ptr  Vrml97Parser::mfFloatValue() {
-#line 1487 "Vrml97Parser.g"
+#line 1499 "Vrml97Parser.g"
 	openvrml::field_value_ptr mfv =
             openvrml::field_value_ptr(new mffloat);
-#line 2808 "Vrml97Parser.cpp"
-#line 1487 "Vrml97Parser.g"
+#line 2820 "Vrml97Parser.cpp"
+#line 1499 "Vrml97Parser.g"
 	
 	float f;
 	mffloat & floats = static_cast<mffloat &>(*mfv);
 	
-#line 2814 "Vrml97Parser.cpp"
+#line 2826 "Vrml97Parser.cpp"
 	
 	switch ( LA(1)) {
 	case INTEGER:
 	case REAL:
 	{
 		f=floatValue();
-#line 1495 "Vrml97Parser.g"
+#line 1507 "Vrml97Parser.g"
 		floats.value.push_back(f);
-#line 2823 "Vrml97Parser.cpp"
+#line 2835 "Vrml97Parser.cpp"
 		break;
 	}
 	case LBRACKET:
@@ -2829,9 +2841,9 @@ openvrml::field_value_ptr  Vrml97Parser::mfFloatValue() {
 		for (;;) {
 			if ((LA(1) == INTEGER || LA(1) == REAL)) {
 				f=floatValue();
-#line 1496 "Vrml97Parser.g"
+#line 1508 "Vrml97Parser.g"
 				floats.value.push_back(f);
-#line 2835 "Vrml97Parser.cpp"
+#line 2847 "Vrml97Parser.cpp"
 			}
 			else {
 				goto _loop69;
@@ -2852,25 +2864,25 @@ openvrml::field_value_ptr  Vrml97Parser::mfFloatValue() {
 }
 
 openvrml::field_value_ptr  Vrml97Parser::mfInt32Value() {
-#line 1554 "Vrml97Parser.g"
+#line 1566 "Vrml97Parser.g"
 	openvrml::field_value_ptr miv =
             openvrml::field_value_ptr(new mfint32);
-#line 2859 "Vrml97Parser.cpp"
-#line 1554 "Vrml97Parser.g"
+#line 2871 "Vrml97Parser.cpp"
+#line 1566 "Vrml97Parser.g"
 	
 	long i;
 	mfint32 & int32s = static_cast<mfint32 &>(*miv);
 	
-#line 2865 "Vrml97Parser.cpp"
+#line 2877 "Vrml97Parser.cpp"
 	
 	switch ( LA(1)) {
 	case INTEGER:
 	case HEX_INTEGER:
 	{
 		i=intValue();
-#line 1562 "Vrml97Parser.g"
+#line 1574 "Vrml97Parser.g"
 		int32s.value.push_back(i);
-#line 2874 "Vrml97Parser.cpp"
+#line 2886 "Vrml97Parser.cpp"
 		break;
 	}
 	case LBRACKET:
@@ -2880,9 +2892,9 @@ openvrml::field_value_ptr  Vrml97Parser::mfInt32Value() {
 		for (;;) {
 			if ((LA(1) == INTEGER || LA(1) == HEX_INTEGER)) {
 				i=intValue();
-#line 1563 "Vrml97Parser.g"
+#line 1575 "Vrml97Parser.g"
 				int32s.value.push_back(i);
-#line 2886 "Vrml97Parser.cpp"
+#line 2898 "Vrml97Parser.cpp"
 			}
 			else {
 				goto _loop77;
@@ -2903,16 +2915,16 @@ openvrml::field_value_ptr  Vrml97Parser::mfInt32Value() {
 }
 
 openvrml::field_value_ptr  Vrml97Parser::mfRotationValue() {
-#line 1629 "Vrml97Parser.g"
+#line 1641 "Vrml97Parser.g"
 	openvrml::field_value_ptr mrv =
          openvrml::field_value_ptr(new mfrotation);
-#line 2910 "Vrml97Parser.cpp"
-#line 1629 "Vrml97Parser.g"
+#line 2922 "Vrml97Parser.cpp"
+#line 1641 "Vrml97Parser.g"
 	
 	rotation r;
 	mfrotation & rotations = static_cast<mfrotation &>(*mrv);
 	
-#line 2916 "Vrml97Parser.cpp"
+#line 2928 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -2920,9 +2932,9 @@ openvrml::field_value_ptr  Vrml97Parser::mfRotationValue() {
 		case REAL:
 		{
 			rotationValue(r);
-#line 1636 "Vrml97Parser.g"
+#line 1648 "Vrml97Parser.g"
 			rotations.value.push_back(r);
-#line 2926 "Vrml97Parser.cpp"
+#line 2938 "Vrml97Parser.cpp"
 			break;
 		}
 		case LBRACKET:
@@ -2932,9 +2944,9 @@ openvrml::field_value_ptr  Vrml97Parser::mfRotationValue() {
 			for (;;) {
 				if ((LA(1) == INTEGER || LA(1) == REAL)) {
 					rotationValue(r);
-#line 1637 "Vrml97Parser.g"
+#line 1649 "Vrml97Parser.g"
 					rotations.value.push_back(r);
-#line 2938 "Vrml97Parser.cpp"
+#line 2950 "Vrml97Parser.cpp"
 				}
 				else {
 					goto _loop90;
@@ -2961,24 +2973,24 @@ openvrml::field_value_ptr  Vrml97Parser::mfRotationValue() {
 }
 
 openvrml::field_value_ptr  Vrml97Parser::mfStringValue() {
-#line 1674 "Vrml97Parser.g"
+#line 1686 "Vrml97Parser.g"
 	openvrml::field_value_ptr msv =
          openvrml::field_value_ptr(new mfstring);
-#line 2968 "Vrml97Parser.cpp"
-#line 1674 "Vrml97Parser.g"
+#line 2980 "Vrml97Parser.cpp"
+#line 1686 "Vrml97Parser.g"
 	
 	std::string s;
 	mfstring & strings = static_cast<mfstring &>(*msv);
 	
-#line 2974 "Vrml97Parser.cpp"
+#line 2986 "Vrml97Parser.cpp"
 	
 	switch ( LA(1)) {
 	case STRING:
 	{
 		s=stringValue();
-#line 1682 "Vrml97Parser.g"
+#line 1694 "Vrml97Parser.g"
 		strings.value.push_back(s);
-#line 2982 "Vrml97Parser.cpp"
+#line 2994 "Vrml97Parser.cpp"
 		break;
 	}
 	case LBRACKET:
@@ -2988,9 +3000,9 @@ openvrml::field_value_ptr  Vrml97Parser::mfStringValue() {
 		for (;;) {
 			if ((LA(1) == STRING)) {
 				s=stringValue();
-#line 1683 "Vrml97Parser.g"
+#line 1695 "Vrml97Parser.g"
 				strings.value.push_back(s);
-#line 2994 "Vrml97Parser.cpp"
+#line 3006 "Vrml97Parser.cpp"
 			}
 			else {
 				goto _loop95;
@@ -3011,24 +3023,24 @@ openvrml::field_value_ptr  Vrml97Parser::mfStringValue() {
 }
 
 openvrml::field_value_ptr  Vrml97Parser::mfTimeValue() {
-#line 1701 "Vrml97Parser.g"
+#line 1713 "Vrml97Parser.g"
 	openvrml::field_value_ptr mtv = openvrml::field_value_ptr(new mftime);
-#line 3017 "Vrml97Parser.cpp"
-#line 1701 "Vrml97Parser.g"
+#line 3029 "Vrml97Parser.cpp"
+#line 1713 "Vrml97Parser.g"
 	
 	double t;
 	mftime & times = static_cast<mftime &>(*mtv);
 	
-#line 3023 "Vrml97Parser.cpp"
+#line 3035 "Vrml97Parser.cpp"
 	
 	switch ( LA(1)) {
 	case INTEGER:
 	case REAL:
 	{
 		t=doubleValue();
-#line 1708 "Vrml97Parser.g"
+#line 1720 "Vrml97Parser.g"
 		times.value.push_back(t);
-#line 3032 "Vrml97Parser.cpp"
+#line 3044 "Vrml97Parser.cpp"
 		break;
 	}
 	case LBRACKET:
@@ -3038,9 +3050,9 @@ openvrml::field_value_ptr  Vrml97Parser::mfTimeValue() {
 		for (;;) {
 			if ((LA(1) == INTEGER || LA(1) == REAL)) {
 				t=doubleValue();
-#line 1709 "Vrml97Parser.g"
+#line 1721 "Vrml97Parser.g"
 				times.value.push_back(t);
-#line 3044 "Vrml97Parser.cpp"
+#line 3056 "Vrml97Parser.cpp"
 			}
 			else {
 				goto _loop100;
@@ -3061,25 +3073,25 @@ openvrml::field_value_ptr  Vrml97Parser::mfTimeValue() {
 }
 
 openvrml::field_value_ptr  Vrml97Parser::mfVec2fValue() {
-#line 1724 "Vrml97Parser.g"
+#line 1736 "Vrml97Parser.g"
 	openvrml::field_value_ptr mvv =
          openvrml::field_value_ptr(new mfvec2f);
-#line 3068 "Vrml97Parser.cpp"
-#line 1724 "Vrml97Parser.g"
+#line 3080 "Vrml97Parser.cpp"
+#line 1736 "Vrml97Parser.g"
 	
 	vec2f v;
 	mfvec2f & vec2fs = static_cast<mfvec2f &>(*mvv);
 	
-#line 3074 "Vrml97Parser.cpp"
+#line 3086 "Vrml97Parser.cpp"
 	
 	switch ( LA(1)) {
 	case INTEGER:
 	case REAL:
 	{
 		vec2fValue(v);
-#line 1732 "Vrml97Parser.g"
+#line 1744 "Vrml97Parser.g"
 		vec2fs.value.push_back(v);
-#line 3083 "Vrml97Parser.cpp"
+#line 3095 "Vrml97Parser.cpp"
 		break;
 	}
 	case LBRACKET:
@@ -3089,9 +3101,9 @@ openvrml::field_value_ptr  Vrml97Parser::mfVec2fValue() {
 		for (;;) {
 			if ((LA(1) == INTEGER || LA(1) == REAL)) {
 				vec2fValue(v);
-#line 1733 "Vrml97Parser.g"
+#line 1745 "Vrml97Parser.g"
 				vec2fs.value.push_back(v);
-#line 3095 "Vrml97Parser.cpp"
+#line 3107 "Vrml97Parser.cpp"
 			}
 			else {
 				goto _loop105;
@@ -3112,25 +3124,25 @@ openvrml::field_value_ptr  Vrml97Parser::mfVec2fValue() {
 }
 
 openvrml::field_value_ptr  Vrml97Parser::mfVec3fValue() {
-#line 1753 "Vrml97Parser.g"
+#line 1765 "Vrml97Parser.g"
 	openvrml::field_value_ptr mvv =
          openvrml::field_value_ptr(new mfvec3f);
-#line 3119 "Vrml97Parser.cpp"
-#line 1753 "Vrml97Parser.g"
+#line 3131 "Vrml97Parser.cpp"
+#line 1765 "Vrml97Parser.g"
 	
 	vec3f v;
 	mfvec3f & vec3fs = static_cast<mfvec3f &>(*mvv);
 	
-#line 3125 "Vrml97Parser.cpp"
+#line 3137 "Vrml97Parser.cpp"
 	
 	switch ( LA(1)) {
 	case INTEGER:
 	case REAL:
 	{
 		vec3fValue(v);
-#line 1761 "Vrml97Parser.g"
+#line 1773 "Vrml97Parser.g"
 		vec3fs.value.push_back(v);
-#line 3134 "Vrml97Parser.cpp"
+#line 3146 "Vrml97Parser.cpp"
 		break;
 	}
 	case LBRACKET:
@@ -3140,9 +3152,9 @@ openvrml::field_value_ptr  Vrml97Parser::mfVec3fValue() {
 		for (;;) {
 			if ((LA(1) == INTEGER || LA(1) == REAL)) {
 				vec3fValue(v);
-#line 1762 "Vrml97Parser.g"
+#line 1774 "Vrml97Parser.g"
 				vec3fs.value.push_back(v);
-#line 3146 "Vrml97Parser.cpp"
+#line 3158 "Vrml97Parser.cpp"
 			}
 			else {
 				goto _loop110;
@@ -3166,14 +3178,14 @@ openvrml::field_value_ptr  Vrml97Parser::sfNodeValue(
 	openvrml::browser & browser,
             const openvrml::scope_ptr & scope
 ) {
-#line 1572 "Vrml97Parser.g"
+#line 1584 "Vrml97Parser.g"
 	openvrml::field_value_ptr snv;
-#line 3172 "Vrml97Parser.cpp"
-#line 1572 "Vrml97Parser.g"
+#line 3184 "Vrml97Parser.cpp"
+#line 1584 "Vrml97Parser.g"
 	
 	openvrml::node_ptr n;
 	
-#line 3177 "Vrml97Parser.cpp"
+#line 3189 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -3182,17 +3194,17 @@ openvrml::field_value_ptr  Vrml97Parser::sfNodeValue(
 		case KEYWORD_USE:
 		{
 			n=nodeStatement(browser, scope);
-#line 1578 "Vrml97Parser.g"
+#line 1590 "Vrml97Parser.g"
 			snv.reset(new sfnode(n));
-#line 3188 "Vrml97Parser.cpp"
+#line 3200 "Vrml97Parser.cpp"
 			break;
 		}
 		case KEYWORD_NULL:
 		{
 			match(KEYWORD_NULL);
-#line 1579 "Vrml97Parser.g"
+#line 1591 "Vrml97Parser.g"
 			snv.reset(new sfnode);
-#line 3196 "Vrml97Parser.cpp"
+#line 3208 "Vrml97Parser.cpp"
 			break;
 		}
 		default:
@@ -3213,15 +3225,15 @@ openvrml::field_value_ptr  Vrml97Parser::mfNodeValue(
 	openvrml::browser & browser,
             const openvrml::scope_ptr & scope
 ) {
-#line 1592 "Vrml97Parser.g"
+#line 1604 "Vrml97Parser.g"
 	openvrml::field_value_ptr mnv = openvrml::field_value_ptr(new mfnode);
-#line 3219 "Vrml97Parser.cpp"
-#line 1592 "Vrml97Parser.g"
+#line 3231 "Vrml97Parser.cpp"
+#line 1604 "Vrml97Parser.g"
 	
 	openvrml::node_ptr n;
 	mfnode & nodes = static_cast<mfnode &>(*mnv);
 	
-#line 3225 "Vrml97Parser.cpp"
+#line 3237 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -3230,9 +3242,9 @@ openvrml::field_value_ptr  Vrml97Parser::mfNodeValue(
 		case KEYWORD_USE:
 		{
 			n=nodeStatement(browser, scope);
-#line 1599 "Vrml97Parser.g"
+#line 1611 "Vrml97Parser.g"
 			if (n) { nodes.value.push_back(n); }
-#line 3236 "Vrml97Parser.cpp"
+#line 3248 "Vrml97Parser.cpp"
 			break;
 		}
 		case LBRACKET:
@@ -3242,11 +3254,11 @@ openvrml::field_value_ptr  Vrml97Parser::mfNodeValue(
 			for (;;) {
 				if ((LA(1) == ID || LA(1) == KEYWORD_DEF || LA(1) == KEYWORD_USE)) {
 					n=nodeStatement(browser, scope);
-#line 1601 "Vrml97Parser.g"
+#line 1613 "Vrml97Parser.g"
 					
 					if (n) { nodes.value.push_back(n); }
 					
-#line 3250 "Vrml97Parser.cpp"
+#line 3262 "Vrml97Parser.cpp"
 				}
 				else {
 					goto _loop83;
@@ -3276,14 +3288,14 @@ openvrml::field_value_ptr  Vrml97Parser::protoSfNodeValue(
 	openvrml::ProtoNodeClass & proto,
                  const openvrml::scope_ptr & scope
 ) {
-#line 1582 "Vrml97Parser.g"
+#line 1594 "Vrml97Parser.g"
 	openvrml::field_value_ptr snv;
-#line 3282 "Vrml97Parser.cpp"
-#line 1582 "Vrml97Parser.g"
+#line 3294 "Vrml97Parser.cpp"
+#line 1594 "Vrml97Parser.g"
 	
 	openvrml::node_ptr n;
 	
-#line 3287 "Vrml97Parser.cpp"
+#line 3299 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -3292,17 +3304,17 @@ openvrml::field_value_ptr  Vrml97Parser::protoSfNodeValue(
 		case KEYWORD_USE:
 		{
 			n=protoNodeStatement(proto, scope);
-#line 1588 "Vrml97Parser.g"
+#line 1600 "Vrml97Parser.g"
 			snv.reset(new sfnode(n));
-#line 3298 "Vrml97Parser.cpp"
+#line 3310 "Vrml97Parser.cpp"
 			break;
 		}
 		case KEYWORD_NULL:
 		{
 			match(KEYWORD_NULL);
-#line 1589 "Vrml97Parser.g"
+#line 1601 "Vrml97Parser.g"
 			snv.reset(new sfnode);
-#line 3306 "Vrml97Parser.cpp"
+#line 3318 "Vrml97Parser.cpp"
 			break;
 		}
 		default:
@@ -3323,15 +3335,15 @@ openvrml::field_value_ptr  Vrml97Parser::protoMfNodeValue(
 	openvrml::ProtoNodeClass & proto,
                  const openvrml::scope_ptr & scope
 ) {
-#line 1607 "Vrml97Parser.g"
+#line 1619 "Vrml97Parser.g"
 	openvrml::field_value_ptr mnv = openvrml::field_value_ptr(new mfnode);
-#line 3329 "Vrml97Parser.cpp"
-#line 1607 "Vrml97Parser.g"
+#line 3341 "Vrml97Parser.cpp"
+#line 1619 "Vrml97Parser.g"
 	
 	openvrml::node_ptr n;
 	mfnode & nodes = static_cast<mfnode &>(*mnv);
 	
-#line 3335 "Vrml97Parser.cpp"
+#line 3347 "Vrml97Parser.cpp"
 	
 	try {      // for error handling
 		switch ( LA(1)) {
@@ -3340,11 +3352,11 @@ openvrml::field_value_ptr  Vrml97Parser::protoMfNodeValue(
 		case KEYWORD_USE:
 		{
 			n=protoNodeStatement(proto, scope);
-#line 1614 "Vrml97Parser.g"
+#line 1626 "Vrml97Parser.g"
 			
 			if (n) { nodes.value.push_back(n); }
 			
-#line 3348 "Vrml97Parser.cpp"
+#line 3360 "Vrml97Parser.cpp"
 			break;
 		}
 		case LBRACKET:
@@ -3354,11 +3366,11 @@ openvrml::field_value_ptr  Vrml97Parser::protoMfNodeValue(
 			for (;;) {
 				if ((LA(1) == ID || LA(1) == KEYWORD_DEF || LA(1) == KEYWORD_USE)) {
 					n=protoNodeStatement(proto, scope);
-#line 1618 "Vrml97Parser.g"
+#line 1630 "Vrml97Parser.g"
 					
 					if (n) { nodes.value.push_back(n); }
 					
-#line 3362 "Vrml97Parser.cpp"
+#line 3374 "Vrml97Parser.cpp"
 				}
 				else {
 					goto _loop86;
@@ -3385,25 +3397,25 @@ openvrml::field_value_ptr  Vrml97Parser::protoMfNodeValue(
 }
 
 bool  Vrml97Parser::boolValue() {
-#line 1425 "Vrml97Parser.g"
+#line 1437 "Vrml97Parser.g"
 	bool val = false;
-#line 3391 "Vrml97Parser.cpp"
+#line 3403 "Vrml97Parser.cpp"
 	
 	switch ( LA(1)) {
 	case KEYWORD_TRUE:
 	{
 		match(KEYWORD_TRUE);
-#line 1427 "Vrml97Parser.g"
+#line 1439 "Vrml97Parser.g"
 		val = true;
-#line 3399 "Vrml97Parser.cpp"
+#line 3411 "Vrml97Parser.cpp"
 		break;
 	}
 	case KEYWORD_FALSE:
 	{
 		match(KEYWORD_FALSE);
-#line 1428 "Vrml97Parser.g"
+#line 1440 "Vrml97Parser.g"
 		val = false;
-#line 3407 "Vrml97Parser.cpp"
+#line 3419 "Vrml97Parser.cpp"
 		break;
 	}
 	default:
@@ -3417,29 +3429,29 @@ bool  Vrml97Parser::boolValue() {
 void Vrml97Parser::colorValue(
 	color & c
 ) {
-#line 1451 "Vrml97Parser.g"
+#line 1463 "Vrml97Parser.g"
 	
 	float r, g, b;
 	
-#line 3425 "Vrml97Parser.cpp"
+#line 3437 "Vrml97Parser.cpp"
 	
 	r=colorComponent();
 	g=colorComponent();
 	b=colorComponent();
-#line 1456 "Vrml97Parser.g"
+#line 1468 "Vrml97Parser.g"
 	c.r(r);
 	c.g(g);
 	c.b(b);
-#line 3434 "Vrml97Parser.cpp"
+#line 3446 "Vrml97Parser.cpp"
 }
 
 float  Vrml97Parser::colorComponent() {
-#line 1464 "Vrml97Parser.g"
+#line 1476 "Vrml97Parser.g"
 	float val = 0.0f;
-#line 3440 "Vrml97Parser.cpp"
+#line 3452 "Vrml97Parser.cpp"
 	
 	val=floatValue();
-#line 1466 "Vrml97Parser.g"
+#line 1478 "Vrml97Parser.g"
 	
 	if (val < 0.0 || val > 1.0) {
 	this->reportWarning("Color component values must be from 0 to "
@@ -3451,14 +3463,14 @@ float  Vrml97Parser::colorComponent() {
 	}
 	}
 	
-#line 3455 "Vrml97Parser.cpp"
+#line 3467 "Vrml97Parser.cpp"
 	return val;
 }
 
 float  Vrml97Parser::floatValue() {
-#line 1499 "Vrml97Parser.g"
+#line 1511 "Vrml97Parser.g"
 	float val;
-#line 3462 "Vrml97Parser.cpp"
+#line 3474 "Vrml97Parser.cpp"
 	ANTLR_USE_NAMESPACE(antlr)RefToken  f0 = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	ANTLR_USE_NAMESPACE(antlr)RefToken  f1 = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	
@@ -3467,18 +3479,18 @@ float  Vrml97Parser::floatValue() {
 	{
 		f0 = LT(1);
 		match(REAL);
-#line 1501 "Vrml97Parser.g"
+#line 1513 "Vrml97Parser.g"
 		std::istringstream(f0->getText()) >> val;
-#line 3473 "Vrml97Parser.cpp"
+#line 3485 "Vrml97Parser.cpp"
 		break;
 	}
 	case INTEGER:
 	{
 		f1 = LT(1);
 		match(INTEGER);
-#line 1502 "Vrml97Parser.g"
+#line 1514 "Vrml97Parser.g"
 		std::istringstream(f1->getText()) >> val;
-#line 3482 "Vrml97Parser.cpp"
+#line 3494 "Vrml97Parser.cpp"
 		break;
 	}
 	default:
@@ -3490,9 +3502,9 @@ float  Vrml97Parser::floatValue() {
 }
 
 long  Vrml97Parser::intValue() {
-#line 1566 "Vrml97Parser.g"
+#line 1578 "Vrml97Parser.g"
 	long val;
-#line 3496 "Vrml97Parser.cpp"
+#line 3508 "Vrml97Parser.cpp"
 	ANTLR_USE_NAMESPACE(antlr)RefToken  i0 = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	ANTLR_USE_NAMESPACE(antlr)RefToken  i1 = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	
@@ -3501,18 +3513,18 @@ long  Vrml97Parser::intValue() {
 	{
 		i0 = LT(1);
 		match(INTEGER);
-#line 1568 "Vrml97Parser.g"
+#line 1580 "Vrml97Parser.g"
 		std::istringstream(i0->getText()) >> val;
-#line 3507 "Vrml97Parser.cpp"
+#line 3519 "Vrml97Parser.cpp"
 		break;
 	}
 	case HEX_INTEGER:
 	{
 		i1 = LT(1);
 		match(HEX_INTEGER);
-#line 1569 "Vrml97Parser.g"
+#line 1581 "Vrml97Parser.g"
 		std::istringstream(i1->getText()) >> val;
-#line 3516 "Vrml97Parser.cpp"
+#line 3528 "Vrml97Parser.cpp"
 		break;
 	}
 	default:
@@ -3526,18 +3538,18 @@ long  Vrml97Parser::intValue() {
 void Vrml97Parser::rotationValue(
 	rotation & r
 ) {
-#line 1643 "Vrml97Parser.g"
+#line 1655 "Vrml97Parser.g"
 	
 	using openvrml_::fequal;
 	float x, y, z, angle;
 	
-#line 3535 "Vrml97Parser.cpp"
+#line 3547 "Vrml97Parser.cpp"
 	
 	x=floatValue();
 	y=floatValue();
 	z=floatValue();
 	angle=floatValue();
-#line 1649 "Vrml97Parser.g"
+#line 1661 "Vrml97Parser.g"
 	
 	r.x(x);
 	r.y(y);
@@ -3555,13 +3567,13 @@ void Vrml97Parser::rotationValue(
 	}
 	}
 	
-#line 3559 "Vrml97Parser.cpp"
+#line 3571 "Vrml97Parser.cpp"
 }
 
 double  Vrml97Parser::doubleValue() {
-#line 1712 "Vrml97Parser.g"
+#line 1724 "Vrml97Parser.g"
 	double val = 0.0;
-#line 3565 "Vrml97Parser.cpp"
+#line 3577 "Vrml97Parser.cpp"
 	ANTLR_USE_NAMESPACE(antlr)RefToken  d0 = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	ANTLR_USE_NAMESPACE(antlr)RefToken  d1 = ANTLR_USE_NAMESPACE(antlr)nullToken;
 	
@@ -3570,18 +3582,18 @@ double  Vrml97Parser::doubleValue() {
 	{
 		d0 = LT(1);
 		match(REAL);
-#line 1714 "Vrml97Parser.g"
+#line 1726 "Vrml97Parser.g"
 		std::istringstream(d0->getText()) >> val;
-#line 3576 "Vrml97Parser.cpp"
+#line 3588 "Vrml97Parser.cpp"
 		break;
 	}
 	case INTEGER:
 	{
 		d1 = LT(1);
 		match(INTEGER);
-#line 1715 "Vrml97Parser.g"
+#line 1727 "Vrml97Parser.g"
 		std::istringstream(d1->getText()) >> val;
-#line 3585 "Vrml97Parser.cpp"
+#line 3597 "Vrml97Parser.cpp"
 		break;
 	}
 	default:
@@ -3595,37 +3607,37 @@ double  Vrml97Parser::doubleValue() {
 void Vrml97Parser::vec2fValue(
 	vec2f & v
 ) {
-#line 1736 "Vrml97Parser.g"
+#line 1748 "Vrml97Parser.g"
 	
 	float x, y;
 	
-#line 3603 "Vrml97Parser.cpp"
+#line 3615 "Vrml97Parser.cpp"
 	
 	x=floatValue();
 	y=floatValue();
-#line 1741 "Vrml97Parser.g"
+#line 1753 "Vrml97Parser.g"
 	v.x(x);
 	v.y(y);
-#line 3610 "Vrml97Parser.cpp"
+#line 3622 "Vrml97Parser.cpp"
 }
 
 void Vrml97Parser::vec3fValue(
 	vec3f & v
 ) {
-#line 1765 "Vrml97Parser.g"
+#line 1777 "Vrml97Parser.g"
 	
 	float x, y, z;
 	
-#line 3620 "Vrml97Parser.cpp"
+#line 3632 "Vrml97Parser.cpp"
 	
 	x=floatValue();
 	y=floatValue();
 	z=floatValue();
-#line 1770 "Vrml97Parser.g"
+#line 1782 "Vrml97Parser.g"
 	v.x(x);
 	v.y(y);
 	v.z(z);
-#line 3629 "Vrml97Parser.cpp"
+#line 3641 "Vrml97Parser.cpp"
 }
 
 void Vrml97Parser::initializeASTFactory( ANTLR_USE_NAMESPACE(antlr)ASTFactory& factory )
@@ -430,7 +430,7 @@ antlr::RefToken Vrml97Scanner::nextToken()
 inline void Vrml97Scanner::getNextChar()
 {
     this->prev_char_ = this->c_;
-    this->c_ = this->in_.get();
+    this->c_ = this->in_.rdbuf()->sbumpc();
     ++this->col_; // Increment the column count;
 
     //
@@ -694,6 +694,13 @@ proto[openvrml::browser & browser,
                                      static_cast<ProtoNodeClass &>(*nodeClass)]
         RBRACE
         {
+            //
+            // Compile the implementation before the PROTO is added to the
+            // node_class_map: from there, EXTERNPROTO may instantiate it in
+            // the scenes that other threads are parsing.
+            //
+            static_cast<ProtoNodeClass &>(*nodeClass).compileImpl();
+
             //
             // Add the new node_class (prototype definition) to the browser's
             // node_class_map.
@@ -707,7 +714,11 @@ proto[openvrml::browser & browser,
             }
             const browser::node_class_map_t::value_type
                 value(implId, nodeClass);
-            browser.node_class_map.insert(value);
+            {
+                resource_loader::scoped_lock
+                    lock(browser.node_class_map_mutex);
+                browser.node_class_map.insert(value);
+            }
 
             //
             // PROTOs implicitly introduce a new node type as well...
@@ -850,6 +861,7 @@ externproto[openvrml::browser & browser, const openvrml::scope_ptr & scope]
     : KEYWORD_EXTERNPROTO id:ID LBRACKET
         (externInterfaceDeclaration[interfaces])* RBRACKET
         urlList=externprotoUrlList {
+            resource_loader::scoped_lock lock(browser.node_class_map_mutex);
             for (size_t i = 0; i < urlList.value.size(); ++i) {
             	browser::node_class_map_t::const_iterator pos =
                         browser.node_class_map.find(urlList.value[i]);
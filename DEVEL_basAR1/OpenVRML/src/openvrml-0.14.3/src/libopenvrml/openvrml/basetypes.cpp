@@ -24,6 +24,85 @@
 # include "private.h"
 # include "basetypes.h"
 
+//
+// The products of mat4f in SSE or NEON when the compiler targets them. The
+// matrices keep their plain float storage: they are held in std containers
+// and on the heap, where 32-bit compilers do not align them to 16 bytes, so
+// the rows are loaded unaligned.
+//
+# if defined(__SSE__) || defined(_M_X64) \
+        || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#   define OPENVRML_MAT4F_SSE
+#   include <xmmintrin.h>
+# elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#   define OPENVRML_MAT4F_NEON
+#   include <arm_neon.h>
+# endif
+
+namespace {
+
+# if defined(OPENVRML_MAT4F_SSE)
+    typedef __m128 row4;
+
+    inline row4 load_row(const float * p) { return _mm_loadu_ps(p); }
+    inline void store_row(float * p, const row4 r) { _mm_storeu_ps(p, r); }
+
+    inline row4 combine(const row4 (&m)[4],
+                        const float x, const float y,
+                        const float z, const float w)
+    {
+        return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(x), m[0]),
+                                     _mm_mul_ps(_mm_set1_ps(y), m[1])),
+                          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(z), m[2]),
+                                     _mm_mul_ps(_mm_set1_ps(w), m[3])));
+    }
+
+    inline void load_columns(const float (&mat)[4][4], row4 (&c)[4])
+    {
+        c[0] = _mm_loadu_ps(mat[0]);
+        c[1] = _mm_loadu_ps(mat[1]);
+        c[2] = _mm_loadu_ps(mat[2]);
+        c[3] = _mm_loadu_ps(mat[3]);
+        _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+    }
+# elif defined(OPENVRML_MAT4F_NEON)
+    typedef float32x4_t row4;
+
+    inline row4 load_row(const float * p) { return vld1q_f32(p); }
+    inline void store_row(float * p, const row4 r) { vst1q_f32(p, r); }
+
+    inline row4 combine(const row4 (&m)[4],
+                        const float x, const float y,
+                        const float z, const float w)
+    {
+        return vmlaq_n_f32(vmlaq_n_f32(vmlaq_n_f32(vmulq_n_f32(m[0], x),
+                                                   m[1], y),
+                                       m[2], z),
+                           m[3], w);
+    }
+
+    inline void load_columns(const float (&mat)[4][4], row4 (&c)[4])
+    {
+        const float32x4x4_t t = vld4q_f32(&mat[0][0]);
+        c[0] = t.val[0];
+        c[1] = t.val[1];
+        c[2] = t.val[2];
+        c[3] = t.val[3];
+    }
+# endif
+
+# if defined(OPENVRML_MAT4F_SSE) || defined(OPENVRML_MAT4F_NEON)
+#   define OPENVRML_MAT4F_SIMD
+    inline void load_rows(const float (&mat)[4][4], row4 (&r)[4])
+    {
+        r[0] = load_row(mat[0]);
+        r[1] = load_row(mat[1]);
+        r[2] = load_row(mat[2]);
+        r[3] = load_row(mat[3]);
+    }
+# endif
+}
+
 namespace openvrml {
 
 /**
@@ -601,6 +680,16 @@ std::ostream & operator<<(std::ostream & out, const vec2f & v)
  */
 vec3f & vec3f::operator*=(const mat4f & mat) throw ()
 {
+# ifdef OPENVRML_MAT4F_SIMD
+    row4 m[4];
+    load_rows(reinterpret_cast<const float (&)[4][4]>(mat[0][0]), m);
+    float r[4];
+    store_row(r, combine(m, this->vec[0], this->vec[1], this->vec[2], 1.0f));
+    this->vec[0] = r[0] / r[3];
+    this->vec[1] = r[1] / r[3];
+    this->vec[2] = r[2] / r[3];
+    return *this;
+# else
     const float x = this->vec[0] * mat[0][0] + this->vec[1] * mat[1][0]
                     + this->vec[2] * mat[2][0] + mat[3][0];
     const float y = this->vec[0] * mat[0][1] + this->vec[1] * mat[1][1]
@@ -613,6 +702,7 @@ vec3f & vec3f::operator*=(const mat4f & mat) throw ()
     this->vec[1] = y / w;
     this->vec[2] = z / w;
     return *this;
+# endif
 }
 
 /**
@@ -640,6 +730,13 @@ vec3f & vec3f::operator*=(const mat4f & mat) throw ()
  */
 const vec3f operator*(const mat4f & mat, const vec3f & vec) throw ()
 {
+# ifdef OPENVRML_MAT4F_SIMD
+    row4 c[4];
+    load_columns(reinterpret_cast<const float (&)[4][4]>(mat[0][0]), c);
+    float r[4];
+    store_row(r, combine(c, vec[0], vec[1], vec[2], 1.0f));
+    return vec3f(r[0] / r[3], r[1] / r[3], r[2] / r[3]);
+# else
     const float x = mat[0][0] * vec[0] + mat[0][1] * vec[1]
                     + mat[0][2] * vec[2] + mat[0][3];
     const float y = mat[1][0] * vec[0] + mat[1][1] * vec[1]
@@ -649,6 +746,7 @@ const vec3f operator*(const mat4f & mat, const vec3f & vec) throw ()
     const float w = mat[3][0] * vec[0] + mat[3][1] * vec[1]
                     + mat[3][2] * vec[2] + mat[3][3];
     return vec3f(x / w, y / w, z / w);
+# endif
 }
 
 /**
@@ -1651,6 +1749,25 @@ mat4f & mat4f::operator*=(const float scalar) throw ()
  */
 mat4f & mat4f::operator*=(const mat4f & mat) throw ()
 {
+# ifdef OPENVRML_MAT4F_SIMD
+    // Every row of mat is loaded before any of this one is stored: mat may
+    // be this matrix.
+    row4 m[4];
+    load_rows(mat.mat, m);
+    const row4 r0 = combine(m, this->mat[0][0], this->mat[0][1],
+                               this->mat[0][2], this->mat[0][3]);
+    const row4 r1 = combine(m, this->mat[1][0], this->mat[1][1],
+                               this->mat[1][2], this->mat[1][3]);
+    const row4 r2 = combine(m, this->mat[2][0], this->mat[2][1],
+                               this->mat[2][2], this->mat[2][3]);
+    const row4 r3 = combine(m, this->mat[3][0], this->mat[3][1],
+                               this->mat[3][2], this->mat[3][3]);
+    store_row(this->mat[0], r0);
+    store_row(this->mat[1], r1);
+    store_row(this->mat[2], r2);
+    store_row(this->mat[3], r3);
+    return *this;
+# else
     mat4f temp;
 
 #define POSTMULT(i,j) (this->mat[i][0] * mat.mat[0][j] + \
@@ -1679,6 +1796,58 @@ mat4f & mat4f::operator*=(const mat4f & mat) throw ()
 
     *this = temp;
     return *this;
+# endif
+}
+
+/**
+ * @brief Transform an array of points.
+ *
+ * Sets @p result[i] to @p points[i] multiplied by the matrix, as
+ * vec3f::operator*=(const mat4f &) does, for @p n points. The rows of the
+ * matrix are loaded once for all of them, and when the matrix is affine the
+ * division by w is left out. @p result may be @p points.
+ *
+ * @param points    the points to transform.
+ * @param n         the number of points.
+ * @param result    the transformed points.
+ */
+void mat4f::transform_points(const vec3f * const points,
+                             const size_t n,
+                             vec3f * const result) const throw ()
+{
+    const bool affine = this->mat[0][3] == 0.0f && this->mat[1][3] == 0.0f
+                        && this->mat[2][3] == 0.0f && this->mat[3][3] == 1.0f;
+# ifdef OPENVRML_MAT4F_SIMD
+    row4 m[4];
+    load_rows(this->mat, m);
+    float r[4];
+    for (size_t i = 0; i < n; ++i) {
+        store_row(r, combine(m, points[i][0], points[i][1], points[i][2],
+                             1.0f));
+        if (affine) {
+            result[i] = vec3f(r[0], r[1], r[2]);
+        } else {
+            result[i] = vec3f(r[0] / r[3], r[1] / r[3], r[2] / r[3]);
+        }
+    }
+# else
+    for (size_t i = 0; i < n; ++i) {
+        const float x = points[i][0], y = points[i][1], z = points[i][2];
+        const vec3f p(x * this->mat[0][0] + y * this->mat[1][0]
+                      + z * this->mat[2][0] + this->mat[3][0],
+                      x * this->mat[0][1] + y * this->mat[1][1]
+                      + z * this->mat[2][1] + this->mat[3][1],
+                      x * this->mat[0][2] + y * this->mat[1][2]
+                      + z * this->mat[2][2] + this->mat[3][2]);
+        if (affine) {
+            result[i] = p;
+        } else {
+            const float w = x * this->mat[0][3] + y * this->mat[1][3]
+                            + z * this->mat[2][3] + this->mat[3][3];
+            result[i] = p / w;
+        }
+    }
+# endif
 }
 
 /**
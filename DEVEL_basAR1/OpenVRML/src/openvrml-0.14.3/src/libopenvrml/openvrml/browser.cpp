@@ -24,14 +24,24 @@
 # endif
 
 # include <algorithm>
+# include <cstring>
 # include <sstream>
 # include <stack>
 # include <regex.h>
+# include <sys/types.h>
+# include <sys/stat.h>
 # ifdef _WIN32
 #   include <sys/timeb.h>
 #   include <time.h>
+#   include <windows.h>
+#   ifdef interface
+#     undef interface
+#   endif
 # else
 #   include <sys/time.h>
+#   include <sys/mman.h>
+#   include <fcntl.h>
+#   include <unistd.h>
 # endif
 # include "private.h"
 # include "browser.h"
@@ -50,8 +60,11 @@ namespace openvrml {
         virtual ~NodeInterfaceTypeMismatch() throw ();
     };
 
+    class ProtoImplTemplate;
+
     class ProtoNode : public node {
         friend class ProtoNodeClass;
+        friend class ProtoImplTemplate;
         friend class Vrml97Parser;
 
     public:
@@ -145,6 +158,12 @@ namespace openvrml {
         ProtoNode(const ProtoNode &);
         ProtoNode & operator=(const ProtoNode &);
 
+        void insertIS(node & implNode,
+                      const std::string & implNodeInterfaceId,
+                      const std::string & protoInterfaceId,
+                      node_interface::type_id protoInterfaceType)
+            throw (std::bad_alloc);
+
         virtual void do_initialize(double timestamp) throw (std::bad_alloc);
         virtual void do_field(const std::string & id,
                                  const field_value & value)
@@ -191,6 +210,7 @@ namespace openvrml {
         ProtoNodeType protoNodeType;
         DefaultValueMap defaultValueMap;
         ProtoNode protoNode;
+        ProtoImplTemplate * implTemplate;
 
     public:
         explicit ProtoNodeClass(openvrml::browser & browser) throw ();
@@ -212,6 +232,7 @@ namespace openvrml {
                    const std::string & protoInterfaceId)
             throw (unsupported_interface, NodeInterfaceTypeMismatch,
                    field_value_type_mismatch, std::bad_alloc);
+        void compileImpl() throw (std::bad_alloc);
 
         virtual const node_type_ptr create_type(const std::string & id,
                                               const node_interface_set &)
@@ -224,6 +245,25 @@ namespace openvrml {
                         const std::string & uri = std::string())
             throw (std::bad_alloc);
         virtual ~Vrml97RootScope() throw ();
+
+    private:
+        static void create_types(const browser & browser,
+                                 std::vector<node_type_ptr> & types)
+            throw (std::bad_alloc);
+    };
+
+    class compiled_scene {
+    public:
+        static void write(std::ostream & out,
+                          const std::vector<node_ptr> & nodes,
+                          double source_size,
+                          double source_mtime)
+            throw (invalid_vrml, std::bad_alloc);
+        static bool read(openvrml::browser & browser,
+                         const std::string & source,
+                         const std::string & uri,
+                         std::vector<node_ptr> & nodes)
+            throw (std::bad_alloc);
     };
 }
 
@@ -416,6 +456,20 @@ invalid_vrml::~invalid_vrml() throw ()
  * @brief A map of URIs to node implementations.
  */
 
+/**
+ * @var resource_loader::mutex browser::node_class_map_mutex
+ *
+ * @brief Held by the parser while it reads or adds to node_class_map, as the
+ *        Inline scenes of scene::load_inlines are parsed at once.
+ */
+
+/**
+ * @var std::vector<node_type_ptr> browser::vrml97_types_
+ *
+ * @brief The VRML97 node types of node_class_map, made by the first
+ *        Vrml97RootScope and added to each one after it.
+ */
+
 /**
  * @var script_node_class browser::script_node_class_
  *
@@ -472,31 +526,31 @@ invalid_vrml::~invalid_vrml() throw ()
  */
 
 /**
- * @var std::list<script_node *> browser::scripts
+ * @var std::vector<script_node *> browser::scripts
  *
  * @brief A list of all the Script nodes in the browser.
  */
 
 /**
- * @var std::list<node *> browser::timers
+ * @var std::vector<node *> browser::timers
  *
  * @brief A list of all the TimeSensor nodes in the browser.
  */
 
 /**
- * @var std::list<node *> browser::audio_clips
+ * @var std::vector<node *> browser::audio_clips
  *
  * @brief A list of all the AudioClip nodes in the browser.
  */
 
 /**
- * @var std::list<node *> browser::movies
+ * @var std::vector<node *> browser::movies
  *
  * @brief A list of all the MovieTexture nodes in the browser.
  */
 
 /**
- * @var std::list<ProtoNode *> browser::proto_node_list
+ * @var std::vector<ProtoNode *> browser::proto_node_list
  *
  * @brief A list of all the prototype nodes in the browser.
  */
@@ -545,6 +599,15 @@ invalid_vrml::~invalid_vrml() throw ()
  * @brief The value associated with the event.
  */
 
+/**
+ * @var bool browser::event::owns_value
+ *
+ * @brief Whether the event frees @a value once delivered.
+ *
+ * The events of one value fanned out along several routes share it; only
+ * the last of them, queued after the others, owns it.
+ */
+
 /**
  * @var node_ptr browser::event::to_node
  *
@@ -601,6 +664,32 @@ invalid_vrml::~invalid_vrml() throw ()
  * @brief Index of the last pending event.
  */
 
+/**
+ * @var browser::max_free_values
+ *
+ * @brief The maximum number of values of each type kept for new events.
+ */
+
+/**
+ * @var std::vector<field_value *> browser::free_values
+ *
+ * @brief The values of delivered events, by type, reused for the next ones.
+ */
+
+/**
+ * @var const field_value * browser::delivered_value
+ *
+ * @brief The shared value being delivered by update(), if a later event
+ *        owns it.
+ */
+
+/**
+ * @var bool browser::delivered_value_orphaned
+ *
+ * @brief Whether the event owning @a delivered_value was discarded while it
+ *        was being delivered, leaving update() to free it.
+ */
+
 /**
  * @brief Get the current time.
  */
@@ -666,6 +755,8 @@ browser::browser(std::ostream & out, std::ostream & err)
     frame_rate_(0.0),
     first_event(0),
     last_event(0),
+    delivered_value(0),
+    delivered_value_orphaned(false),
     out(out),
     err(err),
     flags_need_updating(false)
@@ -705,7 +796,15 @@ browser::~browser() throw ()
     assert(this->audio_clips.empty());
     assert(this->movies.empty());
     assert(this->proto_node_list.empty());
+    this->vrml97_types_.clear();
     this->node_class_map.clear();
+
+    this->flush_events();
+    for (size_t i = 0; i <= field_value::mfvec3f_id; ++i) {
+        for (size_t j = 0; j < this->free_values[i].size(); ++j) {
+            delete this->free_values[i][j];
+        }
+    }
 }
 
 /**
@@ -1019,6 +1118,7 @@ void browser::load_url(const std::vector<std::string> & url,
     assert(this->audio_clips.empty());
     assert(this->movies.empty());
     assert(this->proto_node_list.empty());
+    this->vrml97_types_.clear();
     this->node_class_map.clear();
 
     //
@@ -1026,6 +1126,7 @@ void browser::load_url(const std::vector<std::string> & url,
     //
     this->init_node_class_map();
     this->scene_ = new scene(*this, url);
+    this->scene_->load_inlines();
     this->scene_->initialize(now);
 
     //
@@ -1114,118 +1215,145 @@ void browser::create_vrml_from_url(const std::vector<std::string> & url,
                                    const std::string & event)
 {}
 
+namespace {
+    template <typename NodeClass>
+    node_class * make_node_class(browser & b) throw (std::bad_alloc)
+    {
+        return new NodeClass(b);
+    }
+
+    /**
+     * @internal
+     *
+     * @brief The VRML97 node implementations, by URI.
+     *
+     * One table for the process: each browser makes its own node_class
+     * objects from it, as they refer to the browser their nodes belong to.
+     */
+    const struct {
+        const char * uri;
+        node_class * (*make)(browser &);
+    } vrml97_node_classes[] = {
+        { "urn:X-openvrml:node:Anchor",
+          &make_node_class<vrml97_node::anchor_class> },
+        { "urn:X-openvrml:node:Appearance",
+          &make_node_class<vrml97_node::appearance_class> },
+        { "urn:X-openvrml:node:AudioClip",
+          &make_node_class<vrml97_node::audio_clip_class> },
+        { "urn:X-openvrml:node:Background",
+          &make_node_class<vrml97_node::background_class> },
+        { "urn:X-openvrml:node:Billboard",
+          &make_node_class<vrml97_node::billboard_class> },
+        { "urn:X-openvrml:node:Box",
+          &make_node_class<vrml97_node::box_class> },
+        { "urn:X-openvrml:node:Collision",
+          &make_node_class<vrml97_node::collision_class> },
+        { "urn:X-openvrml:node:Color",
+          &make_node_class<vrml97_node::color_class> },
+        { "urn:X-openvrml:node:ColorInterpolator",
+          &make_node_class<vrml97_node::color_interpolator_class> },
+        { "urn:X-openvrml:node:Cone",
+          &make_node_class<vrml97_node::cone_class> },
+        { "urn:X-openvrml:node:Coordinate",
+          &make_node_class<vrml97_node::coordinate_class> },
+        { "urn:X-openvrml:node:CoordinateInterpolator",
+          &make_node_class<vrml97_node::coordinate_interpolator_class> },
+        { "urn:X-openvrml:node:Cylinder",
+          &make_node_class<vrml97_node::cylinder_class> },
+        { "urn:X-openvrml:node:CylinderSensor",
+          &make_node_class<vrml97_node::cylinder_sensor_class> },
+        { "urn:X-openvrml:node:DirectionalLight",
+          &make_node_class<vrml97_node::directional_light_class> },
+        { "urn:X-openvrml:node:ElevationGrid",
+          &make_node_class<vrml97_node::elevation_grid_class> },
+        { "urn:X-openvrml:node:Extrusion",
+          &make_node_class<vrml97_node::extrusion_class> },
+        { "urn:X-openvrml:node:Fog",
+          &make_node_class<vrml97_node::fog_class> },
+        { "urn:X-openvrml:node:FontStyle",
+          &make_node_class<vrml97_node::font_style_class> },
+        { "urn:X-openvrml:node:Group",
+          &make_node_class<vrml97_node::group_class> },
+        { "urn:X-openvrml:node:ImageTexture",
+          &make_node_class<vrml97_node::image_texture_class> },
+        { "urn:X-openvrml:node:IndexedFaceSet",
+          &make_node_class<vrml97_node::indexed_face_set_class> },
+        { "urn:X-openvrml:node:IndexedLineSet",
+          &make_node_class<vrml97_node::indexed_line_set_class> },
+        { "urn:X-openvrml:node:Inline",
+          &make_node_class<vrml97_node::inline_class> },
+        { "urn:X-openvrml:node:LOD",
+          &make_node_class<vrml97_node::lod_class> },
+        { "urn:X-openvrml:node:Material",
+          &make_node_class<vrml97_node::material_class> },
+        { "urn:X-openvrml:node:MovieTexture",
+          &make_node_class<vrml97_node::movie_texture_class> },
+        { "urn:X-openvrml:node:NavigationInfo",
+          &make_node_class<vrml97_node::navigation_info_class> },
+        { "urn:X-openvrml:node:Normal",
+          &make_node_class<vrml97_node::normal_class> },
+        { "urn:X-openvrml:node:NormalInterpolator",
+          &make_node_class<vrml97_node::normal_interpolator_class> },
+        { "urn:X-openvrml:node:OrientationInterpolator",
+          &make_node_class<vrml97_node::orientation_interpolator_class> },
+        { "urn:X-openvrml:node:PixelTexture",
+          &make_node_class<vrml97_node::pixel_texture_class> },
+        { "urn:X-openvrml:node:PlaneSensor",
+          &make_node_class<vrml97_node::plane_sensor_class> },
+        { "urn:X-openvrml:node:PointLight",
+          &make_node_class<vrml97_node::point_light_class> },
+        { "urn:X-openvrml:node:PointSet",
+          &make_node_class<vrml97_node::point_set_class> },
+        { "urn:X-openvrml:node:PositionInterpolator",
+          &make_node_class<vrml97_node::position_interpolator_class> },
+        { "urn:X-openvrml:node:ProximitySensor",
+          &make_node_class<vrml97_node::proximity_sensor_class> },
+        { "urn:X-openvrml:node:ScalarInterpolator",
+          &make_node_class<vrml97_node::scalar_interpolator_class> },
+        { "urn:X-openvrml:node:Shape",
+          &make_node_class<vrml97_node::shape_class> },
+        { "urn:X-openvrml:node:Sound",
+          &make_node_class<vrml97_node::sound_class> },
+        { "urn:X-openvrml:node:Sphere",
+          &make_node_class<vrml97_node::sphere_class> },
+        { "urn:X-openvrml:node:SphereSensor",
+          &make_node_class<vrml97_node::sphere_sensor_class> },
+        { "urn:X-openvrml:node:SpotLight",
+          &make_node_class<vrml97_node::spot_light_class> },
+        { "urn:X-openvrml:node:Switch",
+          &make_node_class<vrml97_node::switch_class> },
+        { "urn:X-openvrml:node:Text",
+          &make_node_class<vrml97_node::text_class> },
+        { "urn:X-openvrml:node:TextureCoordinate",
+          &make_node_class<vrml97_node::texture_coordinate_class> },
+        { "urn:X-openvrml:node:TextureTransform",
+          &make_node_class<vrml97_node::texture_transform_class> },
+        { "urn:X-openvrml:node:TimeSensor",
+          &make_node_class<vrml97_node::time_sensor_class> },
+        { "urn:X-openvrml:node:TouchSensor",
+          &make_node_class<vrml97_node::touch_sensor_class> },
+        { "urn:X-openvrml:node:Transform",
+          &make_node_class<vrml97_node::transform_class> },
+        { "urn:X-openvrml:node:Viewpoint",
+          &make_node_class<vrml97_node::viewpoint_class> },
+        { "urn:X-openvrml:node:VisibilitySensor",
+          &make_node_class<vrml97_node::visibility_sensor_class> },
+        { "urn:X-openvrml:node:WorldInfo",
+          &make_node_class<vrml97_node::world_info_class> }
+    };
+}
+
 /**
  * @brief Initialize the node_class map with the available node
  *        implementations.
  */
 void browser::init_node_class_map() {
-    using namespace vrml97_node;
-    this->node_class_map["urn:X-openvrml:node:Anchor"] =
-        node_class_ptr(new anchor_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Appearance"] =
-        node_class_ptr(new appearance_class(*this));
-    this->node_class_map["urn:X-openvrml:node:AudioClip"] =
-        node_class_ptr(new audio_clip_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Background"] =
-        node_class_ptr(new background_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Billboard"] =
-        node_class_ptr(new billboard_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Box"] =
-        node_class_ptr(new box_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Collision"] =
-        node_class_ptr(new collision_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Color"] =
-        node_class_ptr(new color_class(*this));
-    this->node_class_map["urn:X-openvrml:node:ColorInterpolator"] =
-        node_class_ptr(new color_interpolator_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Cone"] =
-        node_class_ptr(new cone_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Coordinate"] =
-        node_class_ptr(new coordinate_class(*this));
-    this->node_class_map["urn:X-openvrml:node:CoordinateInterpolator"] =
-        node_class_ptr(new coordinate_interpolator_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Cylinder"] =
-        node_class_ptr(new cylinder_class(*this));
-    this->node_class_map["urn:X-openvrml:node:CylinderSensor"] =
-        node_class_ptr(new cylinder_sensor_class(*this));
-    this->node_class_map["urn:X-openvrml:node:DirectionalLight"] =
-        node_class_ptr(new directional_light_class(*this));
-    this->node_class_map["urn:X-openvrml:node:ElevationGrid"] =
-        node_class_ptr(new elevation_grid_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Extrusion"] =
-        node_class_ptr(new extrusion_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Fog"] =
-        node_class_ptr(new fog_class(*this));
-    this->node_class_map["urn:X-openvrml:node:FontStyle"] =
-        node_class_ptr(new font_style_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Group"] =
-        node_class_ptr(new group_class(*this));
-    this->node_class_map["urn:X-openvrml:node:ImageTexture"] =
-        node_class_ptr(new image_texture_class(*this));
-    this->node_class_map["urn:X-openvrml:node:IndexedFaceSet"] =
-        node_class_ptr(new indexed_face_set_class(*this));
-    this->node_class_map["urn:X-openvrml:node:IndexedLineSet"] =
-        node_class_ptr(new indexed_line_set_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Inline"] =
-        node_class_ptr(new inline_class(*this));
-    this->node_class_map["urn:X-openvrml:node:LOD"] =
-        node_class_ptr(new lod_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Material"] =
-        node_class_ptr(new material_class(*this));
-    this->node_class_map["urn:X-openvrml:node:MovieTexture"] =
-        node_class_ptr(new movie_texture_class(*this));
-    this->node_class_map["urn:X-openvrml:node:NavigationInfo"] =
-        node_class_ptr(new navigation_info_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Normal"] =
-        node_class_ptr(new normal_class(*this));
-    this->node_class_map["urn:X-openvrml:node:NormalInterpolator"] =
-        node_class_ptr(new normal_interpolator_class(*this));
-    this->node_class_map["urn:X-openvrml:node:OrientationInterpolator"] =
-        node_class_ptr(new orientation_interpolator_class(*this));
-    this->node_class_map["urn:X-openvrml:node:PixelTexture"] =
-        node_class_ptr(new pixel_texture_class(*this));
-    this->node_class_map["urn:X-openvrml:node:PlaneSensor"] =
-        node_class_ptr(new plane_sensor_class(*this));
-    this->node_class_map["urn:X-openvrml:node:PointLight"] =
-        node_class_ptr(new point_light_class(*this));
-    this->node_class_map["urn:X-openvrml:node:PointSet"] =
-        node_class_ptr(new point_set_class(*this));
-    this->node_class_map["urn:X-openvrml:node:PositionInterpolator"] =
-        node_class_ptr(new position_interpolator_class(*this));
-    this->node_class_map["urn:X-openvrml:node:ProximitySensor"] =
-        node_class_ptr(new proximity_sensor_class(*this));
-    this->node_class_map["urn:X-openvrml:node:ScalarInterpolator"] =
-        node_class_ptr(new scalar_interpolator_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Shape"] =
-        node_class_ptr(new shape_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Sound"] =
-        node_class_ptr(new sound_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Sphere"] =
-        node_class_ptr(new sphere_class(*this));
-    this->node_class_map["urn:X-openvrml:node:SphereSensor"] =
-        node_class_ptr(new sphere_sensor_class(*this));
-    this->node_class_map["urn:X-openvrml:node:SpotLight"] =
-        node_class_ptr(new spot_light_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Switch"] =
-        node_class_ptr(new switch_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Text"] =
-        node_class_ptr(new text_class(*this));
-    this->node_class_map["urn:X-openvrml:node:TextureCoordinate"] =
-        node_class_ptr(new texture_coordinate_class(*this));
-    this->node_class_map["urn:X-openvrml:node:TextureTransform"] =
-        node_class_ptr(new texture_transform_class(*this));
-    this->node_class_map["urn:X-openvrml:node:TimeSensor"] =
-        node_class_ptr(new time_sensor_class(*this));
-    this->node_class_map["urn:X-openvrml:node:TouchSensor"] =
-        node_class_ptr(new touch_sensor_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Transform"] =
-        node_class_ptr(new transform_class(*this));
-    this->node_class_map["urn:X-openvrml:node:Viewpoint"] =
-        node_class_ptr(new viewpoint_class(*this));
-    this->node_class_map["urn:X-openvrml:node:VisibilitySensor"] =
-        node_class_ptr(new visibility_sensor_class(*this));
-    this->node_class_map["urn:X-openvrml:node:WorldInfo"] =
-        node_class_ptr(new world_info_class(*this));
+    for (size_t i = 0;
+         i < sizeof vrml97_node_classes / sizeof vrml97_node_classes[0];
+         ++i) {
+        this->node_class_map[vrml97_node_classes[i].uri] =
+            node_class_ptr(vrml97_node_classes[i].make(*this));
+    }
 }
 
 /**
@@ -1268,15 +1396,27 @@ double browser::frame_rate() const
  * @a first_event == @a last_event, the queue is empty. There is a fixed
  * maximum number of events. If we are so far behind that the queue is filled,
  * the oldest events get overwritten.
+ *
+ * A value sent to several nodes may be queued once for each of them without
+ * being copied: all but the last of those events are queued with
+ * @p owns_value @c false.
+ *
+ * @param timestamp     the time of the event.
+ * @param value         the value, from event_value() or a clone.
+ * @param to_node       the node the event is going to.
+ * @param to_eventin    the eventIn of @p to_node.
+ * @param owns_value    whether the event frees @p value once delivered.
  */
 void browser::queue_event(double timestamp,
                           field_value * value,
                           const node_ptr & to_node,
-                          const std::string & to_eventin)
+                          const std::string & to_eventin,
+                          const bool owns_value)
 {
     event * e = &this->event_mem[this->last_event];
     e->timestamp = timestamp;
     e->value = value;
+    e->owns_value = owns_value;
     e->to_node = to_node;
     e->to_eventin = to_eventin;
     this->last_event = (this->last_event + 1) % max_events;
@@ -1285,11 +1425,80 @@ void browser::queue_event(double timestamp,
     // was put on the queue, not necessarily in terms of earliest timestamp).
     if (this->last_event == this->first_event) {
         e = &this->event_mem[this->last_event];
-        delete e->value;
+        if (!e->owns_value) {
+            // The event owning the value is still queued.
+        } else if (e->value == this->delivered_value) {
+            this->delivered_value_orphaned = true;
+        } else {
+            this->free_event_value(e->value);
+        }
         this->first_event = (this->first_event + 1) % max_events;
     }
 }
 
+/**
+ * @brief Queue a copy of an event value for a node.
+ *
+ * The copy is taken from the values of the events already delivered, if
+ * one of the same type is free, so a steady cascade of events does not
+ * allocate.
+ */
+void browser::queue_event(const double timestamp,
+                          const field_value & value,
+                          const node_ptr & to_node,
+                          const std::string & to_eventin)
+    throw (std::bad_alloc)
+{
+    this->queue_event(timestamp, this->event_value(value), to_node,
+                      to_eventin);
+}
+
+/**
+ * @brief A copy of @p value for the event queue.
+ *
+ * @param value an event value.
+ *
+ * @return a recycled value of the type of @p value assigned from it, or a
+ *         new clone of it.
+ */
+field_value * browser::event_value(const field_value & value)
+    throw (std::bad_alloc)
+{
+    std::vector<field_value *> & pool = this->free_values[value.type()];
+    if (pool.empty()) { return value.clone().release(); }
+    field_value * const v = pool.back();
+    pool.pop_back();
+    try {
+        v->assign(value);
+    } catch (...) {
+        delete v;
+        throw;
+    }
+    return v;
+}
+
+/**
+ * @brief Give back the value of a delivered or discarded event.
+ *
+ * Up to @a max_free_values of each type but @c SFNode and @c MFNode are
+ * kept for event_value().
+ *
+ * @param value a value owned by the event queue.
+ */
+void browser::free_event_value(field_value * const value) throw ()
+{
+    // Node values are not kept, they would keep their nodes alive.
+    const field_value::type_id type = value->type();
+    if (type != field_value::sfnode_id && type != field_value::mfnode_id
+            && this->free_values[type].size() < max_free_values) {
+        try {
+            this->free_values[type].push_back(value);
+            return;
+        } catch (std::bad_alloc &) {}
+    }
+    delete value;
+}
+
 /**
  * @brief Check if any events are waiting to be distributed.
  *
@@ -1309,7 +1518,7 @@ void browser::flush_events()
     while (this->first_event != this->last_event) {
         event *e = &this->event_mem[this->first_event];
         this->first_event = (this->first_event + 1) % max_events;
-        delete e->value;
+        if (e->owns_value) { this->free_event_value(e->value); }
     }
 }
 
@@ -1346,18 +1555,6 @@ void browser::sensitive_event(node * const n,
     }
 }
 
-namespace {
-    template <typename T>
-    struct UpdatePolledNode_ : std::unary_function<T, void> {
-        explicit UpdatePolledNode_(double time): time(time) {}
-
-        void operator()(T node) const { node->update(time); }
-
-    private:
-        double time;
-    };
-}
-
 /**
  * @brief Process events (update the browser).
  *
@@ -1371,48 +1568,60 @@ bool browser::update(double current_time)
 
     this->delta_time = DEFAULT_DELTA;
 
+    //
+    // The polled nodes are walked by index: an update may add or remove
+    // nodes, which moves the arrays.
+    //
+    size_t i;
+
     // Update each of the timers.
-    std::list<node *>::iterator i, end = this->timers.end();
-    for (i = this->timers.begin(); i != end; ++i) {
-        vrml97_node::time_sensor_node * t = (*i)->to_time_sensor();
+    for (i = 0; i < this->timers.size(); ++i) {
+        vrml97_node::time_sensor_node * t = this->timers[i]->to_time_sensor();
         if (t) { t->update(current_time); }
     }
 
     // Update each of the clips.
-    end = this->audio_clips.end();
-    for (i = this->audio_clips.begin(); i != end; ++i) {
-        vrml97_node::audio_clip_node * c = (*i)->to_audio_clip();
+    for (i = 0; i < this->audio_clips.size(); ++i) {
+        vrml97_node::audio_clip_node * c =
+            this->audio_clips[i]->to_audio_clip();
         if (c) { c->update(current_time); }
     }
 
     // Update each of the movies.
-    end = this->movies.end();
-    for (i = this->movies.begin(); i != end; ++i) {
-        vrml97_node::movie_texture_node * m = (*i)->to_movie_texture();
+    for (i = 0; i < this->movies.size(); ++i) {
+        vrml97_node::movie_texture_node * m =
+            this->movies[i]->to_movie_texture();
         if (m) { m->update(current_time); }
     }
 
     //
     // Update each of the scripts.
     //
-    std::for_each(this->scripts.begin(), this->scripts.end(),
-                  UpdatePolledNode_<script_node *>(current_time));
+    for (i = 0; i < this->scripts.size(); ++i) {
+        this->scripts[i]->update(current_time);
+    }
 
     //
     // Update each of the prototype instances.
     //
-    std::for_each(this->proto_node_list.begin(), this->proto_node_list.end(),
-                  UpdatePolledNode_<ProtoNode *>(current_time));
+    for (i = 0; i < this->proto_node_list.size(); ++i) {
+        this->proto_node_list[i]->update(current_time);
+    }
 
     // Pass along events to their destinations
     while (this->first_event != this->last_event) {
         event * const e = &this->event_mem[this->first_event];
         this->first_event = (this->first_event + 1) % max_events;
 
-        e->to_node->process_event(e->to_eventin, *e->value, e->timestamp);
-
-        // this needs to change if event values are shared...
-        delete e->value;
+        field_value * const value = e->value;
+        const bool owns_value = e->owns_value;
+        this->delivered_value = owns_value ? 0 : value;
+        e->to_node->process_event(e->to_eventin, *value, e->timestamp);
+        this->delivered_value = 0;
+        if (owns_value || this->delivered_value_orphaned) {
+            this->delivered_value_orphaned = false;
+            this->free_event_value(value);
+        }
     }
 
     // Signal a redisplay if necessary
@@ -1726,8 +1935,8 @@ void browser::add_movie(vrml97_node::movie_texture_node & movie) {
 void browser::remove_movie(vrml97_node::movie_texture_node & movie)
 {
     assert(!this->movies.empty());
-    const std::list<node *>::iterator end = this->movies.end();
-    const std::list<node *>::iterator pos =
+    const std::vector<node *>::iterator end = this->movies.end();
+    const std::vector<node *>::iterator pos =
             std::find(this->movies.begin(), end, &movie);
     assert(pos != end);
     this->movies.erase(pos);
@@ -1755,7 +1964,7 @@ void browser::add_script(script_node & script) {
  */
 void browser::remove_script(script_node & script) {
     assert(!this->scripts.empty());
-    typedef std::list<script_node *> script_node_list_t;
+    typedef std::vector<script_node *> script_node_list_t;
     const script_node_list_t::iterator end = this->scripts.end();
     const script_node_list_t::iterator pos =
             std::find(this->scripts.begin(), end, &script);
@@ -1787,7 +1996,7 @@ void browser::add_proto(ProtoNode & node) {
  */
 void browser::remove_proto(ProtoNode & node) {
     assert(!this->proto_node_list.empty());
-    typedef std::list<ProtoNode *> proto_node_list_t;
+    typedef std::vector<ProtoNode *> proto_node_list_t;
     const proto_node_list_t::iterator end = this->proto_node_list.end();
     const proto_node_list_t::iterator pos =
             std::find(this->proto_node_list.begin(), end, &node);
@@ -1819,8 +2028,8 @@ void browser::add_time_sensor(vrml97_node::time_sensor_node & timer)
 void browser::remove_time_sensor(vrml97_node::time_sensor_node & timer)
 {
     assert(!this->timers.empty());
-    const std::list<node *>::iterator end = this->timers.end();
-    const std::list<node *>::iterator pos =
+    const std::vector<node *>::iterator end = this->timers.end();
+    const std::vector<node *>::iterator pos =
             std::find(this->timers.begin(), end, &timer);
     assert(pos != end);
     this->timers.erase(pos);
@@ -1851,8 +2060,8 @@ void browser::add_audio_clip(vrml97_node::audio_clip_node & audio_clip)
 void browser::remove_audio_clip(vrml97_node::audio_clip_node & audio_clip)
 {
     assert(!this->audio_clips.empty());
-    const std::list<node *>::iterator end = this->audio_clips.end();
-    const std::list<node *>::iterator pos =
+    const std::vector<node *>::iterator end = this->audio_clips.end();
+    const std::vector<node *>::iterator pos =
             std::find(this->audio_clips.begin(), end, &audio_clip);
     assert(pos != end);
     this->audio_clips.erase(pos);
@@ -2079,18 +2288,29 @@ scene::scene(openvrml::browser & browser,
             }
 
             doc2 doc(absoluteURI);
-            istream & in = doc.input_stream();
-            if (!in) { throw unreachable_url(); }
-            try {
-                Vrml97Scanner scanner(in);
-                Vrml97Parser parser(scanner, this->url());
-                parser.vrmlScene(browser, this->nodes_);
-            } catch (antlr::RecognitionException &) {
-                throw invalid_vrml();
-            } catch (std::bad_alloc &) {
-                throw;
-            } catch (...) {
-                throw unreachable_url();
+
+            //
+            // A local file may have been compiled; see browser::compile_vrml.
+            //
+            const char * const local =
+                (URI(absoluteURI).getScheme() == "file")
+                    ? doc.local_name()
+                    : 0;
+            if (!local || !compiled_scene::read(browser, local, this->url(),
+                                                this->nodes_)) {
+                istream & in = doc.input_stream();
+                if (!in) { throw unreachable_url(); }
+                try {
+                    Vrml97Scanner scanner(in);
+                    Vrml97Parser parser(scanner, this->url());
+                    parser.vrmlScene(browser, this->nodes_);
+                } catch (antlr::RecognitionException &) {
+                    throw invalid_vrml();
+                } catch (std::bad_alloc &) {
+                    throw;
+                } catch (...) {
+                    throw unreachable_url();
+                }
             }
         } catch (bad_url & ex) {
             browser.err << ex.what() << std::endl;
@@ -2123,6 +2343,143 @@ scene::scene(openvrml::browser & browser,
  * scene is not copyable.
  */
 
+namespace {
+
+    const size_t inline_threads_max = 4;
+
+    struct inline_load {
+        vrml97_node::inline_node * node;
+        scene * parent;
+        std::vector<std::string> url;
+        scene * inline_scene;
+    };
+
+    struct inline_job {
+        std::vector<inline_load> * loads;
+        size_t first;
+        size_t step;
+    };
+
+    //
+    // Each scene is made on one thread, and its nodes are only seen by
+    // another once the thread is joined; the node counts need no lock.
+    //
+    void parse_inlines(void * arg)
+    {
+        const inline_job & job = *static_cast<inline_job *>(arg);
+        std::vector<inline_load> & loads = *job.loads;
+        for (size_t i = job.first; i < loads.size(); i += job.step) {
+            try {
+                loads[i].inline_scene = new scene(loads[i].parent->browser,
+                                                  loads[i].url,
+                                                  loads[i].parent);
+            } catch (std::exception &) {
+                //
+                // Left to inline_node::load, which throws it again as the
+                // Inline is rendered.
+                //
+                loads[i].inline_scene = 0;
+            }
+        }
+    }
+
+    void find_inlines(const std::vector<node_ptr> & nodes,
+                      std::vector<vrml97_node::inline_node *> & found)
+        throw (std::bad_alloc)
+    {
+        for (std::vector<node_ptr>::const_iterator n = nodes.begin();
+             n != nodes.end();
+             ++n) {
+            if (!*n) { continue; }
+            vrml97_node::inline_node * const inline_node =
+                dynamic_cast<vrml97_node::inline_node *>(n->get());
+            if (inline_node) {
+                if (std::find(found.begin(), found.end(), inline_node)
+                        == found.end()) {
+                    found.push_back(inline_node);
+                }
+            } else if ((*n)->to_grouping()) {
+                find_inlines((*n)->to_grouping()->children(), found);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Load the Inline nodes of the scene before it is initialized.
+ *
+ * The Inlines found under the grouping nodes of the scene are parsed at once,
+ * on up to four threads that each make scenes of their own, and the scenes
+ * are attached to their nodes on the calling thread once every thread is
+ * done. The Inlines of those scenes are then loaded the same way, a level at
+ * a time. An Inline whose scene cannot be made, or that is not under a
+ * grouping node, as in a choice a Switch does not show, is still loaded by
+ * inline_node::load as it is first rendered.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void scene::load_inlines() throw (std::bad_alloc)
+{
+    using std::vector;
+    using vrml97_node::inline_node;
+
+    vector<scene *> scenes(1, this);
+    while (!scenes.empty()) {
+        vector<inline_load> loads;
+        for (vector<scene *>::const_iterator s = scenes.begin();
+             s != scenes.end();
+             ++s) {
+            vector<inline_node *> found;
+            find_inlines((*s)->nodes(), found);
+            for (vector<inline_node *>::const_iterator n = found.begin();
+                 n != found.end();
+                 ++n) {
+                if ((*n)->hasLoaded) { continue; }
+                const inline_load load = { *n, *s, (*n)->url.value, 0 };
+                loads.push_back(load);
+            }
+        }
+        if (loads.empty()) { break; }
+
+        const size_t threads = std::min(loads.size(), inline_threads_max);
+        inline_job jobs[inline_threads_max];
+        resource_loader::thread * thread[inline_threads_max] = { 0 };
+        for (size_t t = 0; t < threads; ++t) {
+            jobs[t].loads = &loads;
+            jobs[t].first = t;
+            jobs[t].step = threads;
+        }
+        for (size_t t = 1; t < threads; ++t) {
+            thread[t] = new (std::nothrow)
+                resource_loader::thread(parse_inlines, &jobs[t]);
+            if (thread[t] && !thread[t]->started()) {
+                delete thread[t];
+                thread[t] = 0;
+            }
+        }
+        parse_inlines(&jobs[0]);
+        for (size_t t = 1; t < threads; ++t) {
+            if (thread[t]) {
+                delete thread[t];
+            } else {
+                parse_inlines(&jobs[t]);
+            }
+        }
+
+        scenes.clear();
+        for (vector<inline_load>::const_iterator load = loads.begin();
+             load != loads.end();
+             ++load) {
+            if (!load->inline_scene) { continue; }
+            inline_node & n = *load->node;
+            n.inlineScene = load->inline_scene;
+            n.hasLoaded = true;
+            n.bounding_volume_dirty(true);
+            scenes.push_back(load->inline_scene);
+        }
+    }
+}
+
 /**
  * @brief Initialize the scene.
  *
@@ -2367,179 +2724,310 @@ namespace {
 }
 
 
-class ProtoImplCloner {
-        std::set<node *> traversedNodes;
-        const ProtoNode * protoDef;
-        ProtoNode * protoInstance;
+/**
+ * @internal
+ *
+ * @class ProtoImplTemplate
+ *
+ * @brief The implementation of a PROTO, flattened for instantiation.
+ *
+ * The archetypal ProtoNode is walked once, when the parser is done with the
+ * PROTO. Every node of the implementation gets a slot; node-valued
+ * fields, IS mappings and routes refer to slots rather than to nodes of the
+ * archetype, and the other field values are copied into the template. An
+ * instance is then built by creating the node of each slot and replaying the
+ * slots in order, without walking the archetype or looking nodes up by name.
+ *
+ * A node that is USEd more than once in the implementation has one slot, so
+ * the instance shares it the same way the archetype does.
+ */
 
-    public:
-        ProtoImplCloner():
-            protoDef(0),
-            protoInstance(0)
-        {}
+class ProtoImplTemplate {
+    static const size_t no_node = size_t(-1);
 
-        void clone(const ProtoNode & protoDef,
-                   ProtoNode & protoInstance)
-            throw (std::bad_alloc)
-        {
-            assert(this->traversedNodes.empty());
-            assert(!this->protoDef);
-            assert(!this->protoInstance);
-
-            this->protoDef = &protoDef;
-            this->protoInstance = &protoInstance;
-            const std::vector<node_ptr> & protoDefImplNodes =
-                    protoDef.getImplNodes();
-            for (std::vector<node_ptr>::const_iterator node =
-                    protoDefImplNodes.begin();
-                    node != protoDefImplNodes.end(); ++node) {
-                const node_ptr newNode =
-                        this->cloneNode(*node, protoInstance.scope());
-                assert(newNode);
-                protoInstance.addRootNode(newNode);
-            }
-            this->protoDef = 0;
-            this->protoInstance = 0;
-            this->traversedNodes.clear();
-        }
+    struct field_slot {
+        std::string id;
+        field_value::type_id type;
+        field_value_ptr value;
+        std::vector<size_t> nodes;
+    };
 
-    private:
-        const sfnode cloneFieldValue(const sfnode & node,
-                                     const scope_ptr & targetScope)
-            throw (std::bad_alloc)
-        {
-            return sfnode(this->cloneNode(node.value, targetScope));
-        }
+    struct is_slot {
+        std::string implInterfaceId;
+        std::string protoInterfaceId;
+        node_interface::type_id protoInterfaceType;
+    };
 
-        const mfnode cloneFieldValue(const mfnode & nodes,
-                                     const scope_ptr & targetScope)
-            throw (std::bad_alloc)
-        {
-            mfnode result(nodes.value.size());
-            for (size_t i = 0; i < nodes.value.size(); ++i) {
-                result.value[i] = this->cloneNode(nodes.value[i], targetScope);
-            }
-            return result;
-        }
+    struct node_slot {
+        const node_type * type;
+        std::string id;
+        std::vector<field_slot> fields;
+        std::vector<is_slot> isMappings;
+    };
 
-        const node_ptr cloneNode(const node_ptr & n,
-                                const scope_ptr & targetScope)
-            throw (std::bad_alloc)
-        {
-            assert(targetScope);
+    struct route_slot {
+        size_t from;
+        std::string fromEventOut;
+        size_t to;
+        std::string toEventIn;
+    };
 
-            node_ptr result(0);
+    typedef std::map<const node *, size_t> slot_map;
+    typedef std::multimap<const node *, const ProtoNode::ISMap::value_type *>
+        is_index;
 
-            if (!n) { return result; }
+    std::vector<node_slot> nodes;
+    std::vector<size_t> order;
+    std::vector<size_t> roots;
+    std::vector<route_slot> routes;
 
-            std::set<node *>::iterator pos =
-                this->traversedNodes.find(n.get());
-            const bool alreadyTraversed = (pos != this->traversedNodes.end());
+public:
+    explicit ProtoImplTemplate(const ProtoNode & protoDef)
+        throw (std::bad_alloc);
 
-            if (alreadyTraversed) {
-                result.reset(targetScope->find_node(n->id()));
-                assert(result);
-            } else {
-                result = n->type.create_node(targetScope);
-                if (!n->id().empty()) { result->id(n->id()); }
+    void instantiate(ProtoNode & protoInstance) const throw (std::bad_alloc);
 
-                //
-                // Any IS mappings for this node?
-                //
-                for (ProtoNode::ISMap::const_iterator isMapEntry =
-                        this->protoDef->isMap.begin();
-                        isMapEntry != this->protoDef->isMap.end();
-                        ++isMapEntry) {
-                    if (&isMapEntry->second.node == n.get()) {
-                        try {
-                            this->protoInstance
-                                    ->addIS(*result,
-                                            isMapEntry->second.interfaceId,
-                                            isMapEntry->first);
-                        } catch (std::bad_alloc &) {
-                            throw;
-                        } catch (std::runtime_error & ex) {
-                            OPENVRML_PRINT_EXCEPTION_(ex);
-                            assert(false);
-                        }
-                    }
-                }
+private:
+    size_t compileNode(const node_ptr & n,
+                       const ProtoNode & protoDef,
+                       const is_index & isIndex,
+                       slot_map & slots,
+                       std::vector<const node *> & sources)
+        throw (std::bad_alloc);
+};
 
-                const node_interface_set & interfaces = n->type.interfaces();
-                for (node_interface_set::const_iterator interface =
-                        interfaces.begin();
-                        interface != interfaces.end();
-                        ++interface) {
-                    try {
-                        if (interface->type == node_interface::exposedfield_id
-                                || interface->type
-                                    == node_interface::field_id) {
-                            if (interface->field_type
-                                    == field_value::sfnode_id) {
-                                const sfnode & value =
-                                        static_cast<const sfnode &>
-                                            (n->field(interface->id));
-                                result->field(interface->id,
-                                              this->cloneFieldValue(value,
-                                                                 targetScope));
-                            } else if (interface->field_type
-                                    == field_value::mfnode_id) {
-                                const mfnode & value =
-                                    static_cast<const mfnode &>
-                                        (n->field(interface->id));
-                                result->field(interface->id,
-                                              this->cloneFieldValue(value,
-                                                                 targetScope));
-                            } else {
-                                result->field(interface->id,
-                                              n->field(interface->id));
-                            }
-                        }
-                    } catch (std::bad_alloc) {
-                        throw;
-                    } catch (std::runtime_error & ex) {
-                        OPENVRML_PRINT_EXCEPTION_(ex);
-                    }
-                }
-            }
-            return result;
-        }
-    };
+/**
+ * @brief Compile the implementation of @p protoDef.
+ *
+ * @param protoDef  the archetypal ProtoNode.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+ProtoImplTemplate::ProtoImplTemplate(const ProtoNode & protoDef)
+    throw (std::bad_alloc)
+{
+    is_index isIndex;
+    for (ProtoNode::ISMap::const_iterator isMapEntry =
+            protoDef.isMap.begin();
+            isMapEntry != protoDef.isMap.end();
+            ++isMapEntry) {
+        isIndex.insert(is_index::value_type(&isMapEntry->second.node,
+                                            &*isMapEntry));
+    }
 
+    slot_map slots;
+    std::vector<const node *> sources;
+    const std::vector<node_ptr> & implNodes = protoDef.getImplNodes();
+    for (std::vector<node_ptr>::const_iterator n = implNodes.begin();
+            n != implNodes.end(); ++n) {
+        const size_t slot =
+            this->compileNode(*n, protoDef, isIndex, slots, sources);
+        assert(slot != no_node);
+        this->roots.push_back(slot);
+    }
 
-	class RouteCopyTraverser : public node_traverser {
-        const openvrml::scope & targetScope;
+    for (size_t i = 0; i < sources.size(); ++i) {
+        const node::routes_t & nodeRoutes = sources[i]->routes();
+        for (node::routes_t::const_iterator route = nodeRoutes.begin();
+                route != nodeRoutes.end(); ++route) {
+            const slot_map::const_iterator to =
+                slots.find(route->to_node.get());
+            assert(to != slots.end());
+            route_slot r;
+            r.from = i;
+            r.fromEventOut = route->from_eventout;
+            r.to = to->second;
+            r.toEventIn = route->to_eventin;
+            this->routes.push_back(r);
+        }
+    }
+}
 
-    public:
-        RouteCopyTraverser(const openvrml::scope & targetScope):
-            targetScope(targetScope)
-        {}
+/**
+ * @brief Give a node of the implementation, and the nodes below it, slots.
+ *
+ * @return the slot of @p n, or @c no_node if @p n is null.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+size_t ProtoImplTemplate::compileNode(const node_ptr & n,
+                                      const ProtoNode & protoDef,
+                                      const is_index & isIndex,
+                                      slot_map & slots,
+                                      std::vector<const node *> & sources)
+    throw (std::bad_alloc)
+{
+    if (!n) { return no_node; }
+
+    const slot_map::const_iterator pos = slots.find(n.get());
+    if (pos != slots.end()) { return pos->second; }
+
+    //
+    // The slot is allocated before the node's fields are visited, so slots
+    // are numbered in the order the nodes are created.
+    //
+    const size_t slot = this->nodes.size();
+    slots[n.get()] = slot;
+    sources.push_back(n.get());
+    this->nodes.push_back(node_slot());
+    this->nodes[slot].type = &n->type;
+    this->nodes[slot].id = n->id();
+
+    std::vector<is_slot> isMappings;
+    const std::pair<is_index::const_iterator, is_index::const_iterator>
+        isRange = isIndex.equal_range(n.get());
+    for (is_index::const_iterator i = isRange.first; i != isRange.second;
+            ++i) {
+        const node_interface_set & protoInterfaces =
+            protoDef.type.interfaces();
+        const node_interface_set::const_iterator protoInterface =
+            std::find_if(protoInterfaces.begin(), protoInterfaces.end(),
+                         interface_id_equals_(i->second->first));
+        assert(protoInterface != protoInterfaces.end());
+        is_slot isMapping;
+        isMapping.implInterfaceId = i->second->second.interfaceId;
+        isMapping.protoInterfaceId = i->second->first;
+        isMapping.protoInterfaceType = protoInterface->type;
+        isMappings.push_back(isMapping);
+    }
 
-        virtual ~RouteCopyTraverser() throw ()
-        {}
+    std::vector<field_slot> fields;
+    const node_interface_set & interfaces = n->type.interfaces();
+    for (node_interface_set::const_iterator interface = interfaces.begin();
+            interface != interfaces.end();
+            ++interface) {
+        if (interface->type != node_interface::exposedfield_id
+                && interface->type != node_interface::field_id) {
+            continue;
+        }
+        try {
+            field_slot field;
+            field.id = interface->id;
+            field.type = interface->field_type;
+            if (interface->field_type == field_value::sfnode_id) {
+                const sfnode & value =
+                    static_cast<const sfnode &>(n->field(interface->id));
+                field.nodes.push_back(this->compileNode(value.value,
+                                                        protoDef,
+                                                        isIndex,
+                                                        slots,
+                                                        sources));
+            } else if (interface->field_type == field_value::mfnode_id) {
+                const mfnode & value =
+                    static_cast<const mfnode &>(n->field(interface->id));
+                field.nodes.reserve(value.value.size());
+                for (size_t i = 0; i < value.value.size(); ++i) {
+                    field.nodes.push_back(this->compileNode(value.value[i],
+                                                            protoDef,
+                                                            isIndex,
+                                                            slots,
+                                                            sources));
+                }
+            } else {
+                field.value.reset(n->field(interface->id).clone().release());
+            }
+            fields.push_back(field);
+        } catch (std::bad_alloc &) {
+            throw;
+        } catch (std::runtime_error & ex) {
+            OPENVRML_PRINT_EXCEPTION_(ex);
+        }
+    }
 
-    private:
-        virtual void on_entering(node & n)
-        {
-            const std::string & fromNodeId = n.id();
-            if (!fromNodeId.empty()) {
-                node * const fromNode =
-                    this->targetScope.find_node(fromNodeId);
-                assert(fromNode);
-                const node::routes_t & routes = n.routes();
-                for (node::routes_t::const_iterator route = routes.begin();
-                        route != routes.end(); ++route) {
-                    const std::string & toNodeId = route->to_node->id();
-                    const node_ptr
-                        toNode(this->targetScope.find_node(toNodeId));
-                    assert(toNode);
-                    fromNode->add_route(route->from_eventout,
-                                        toNode,
-                                        route->to_eventin);
+    //
+    // this->nodes may have grown while the children were compiled; so, index
+    // it again rather than holding a reference across the loop above.
+    //
+    this->nodes[slot].fields.swap(fields);
+    this->nodes[slot].isMappings.swap(isMappings);
+    this->order.push_back(slot);
+    return slot;
+}
+
+/**
+ * @brief Build the implementation of a PROTO instance.
+ *
+ * @param protoInstance the new ProtoNode.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void ProtoImplTemplate::instantiate(ProtoNode & protoInstance) const
+    throw (std::bad_alloc)
+{
+    const scope_ptr & targetScope = protoInstance.scope();
+    assert(targetScope);
+
+    std::vector<node_ptr> instanceNodes(this->nodes.size());
+    for (size_t i = 0; i < this->nodes.size(); ++i) {
+        instanceNodes[i] = this->nodes[i].type->create_node(targetScope);
+        if (!this->nodes[i].id.empty()) {
+            instanceNodes[i]->id(this->nodes[i].id);
+        }
+    }
+
+    //
+    // Children come before their parents in this->order; so, a node's
+    // node-valued fields are set to nodes that are already complete.
+    //
+    for (std::vector<size_t>::const_iterator slot = this->order.begin();
+            slot != this->order.end(); ++slot) {
+        const node_slot & source = this->nodes[*slot];
+        node & result = *instanceNodes[*slot];
+
+        for (std::vector<is_slot>::const_iterator isMapping =
+                source.isMappings.begin();
+                isMapping != source.isMappings.end();
+                ++isMapping) {
+            protoInstance.insertIS(result,
+                                   isMapping->implInterfaceId,
+                                   isMapping->protoInterfaceId,
+                                   isMapping->protoInterfaceType);
+        }
+
+        for (std::vector<field_slot>::const_iterator field =
+                source.fields.begin();
+                field != source.fields.end();
+                ++field) {
+            try {
+                if (field->type == field_value::sfnode_id) {
+                    assert(field->nodes.size() == 1);
+                    const size_t child = field->nodes[0];
+                    result.field(field->id,
+                                 sfnode(child == no_node
+                                        ? node_ptr(0)
+                                        : instanceNodes[child]));
+                } else if (field->type == field_value::mfnode_id) {
+                    mfnode value(field->nodes.size());
+                    for (size_t i = 0; i < field->nodes.size(); ++i) {
+                        const size_t child = field->nodes[i];
+                        if (child != no_node) {
+                            value.value[i] = instanceNodes[child];
+                        }
+                    }
+                    result.field(field->id, value);
+                } else {
+                    result.field(field->id, *field->value);
                 }
+            } catch (std::bad_alloc &) {
+                throw;
+            } catch (std::runtime_error & ex) {
+                OPENVRML_PRINT_EXCEPTION_(ex);
             }
         }
-    };
+    }
+
+    for (std::vector<route_slot>::const_iterator route = this->routes.begin();
+            route != this->routes.end(); ++route) {
+        instanceNodes[route->from]->add_route(route->fromEventOut,
+                                              instanceNodes[route->to],
+                                              route->toEventIn);
+    }
+
+    for (std::vector<size_t>::const_iterator root = this->roots.begin();
+            root != this->roots.end(); ++root) {
+        protoInstance.addRootNode(instanceNodes[*root]);
+    }
+}
 
 	class NodeFieldCloner {
         std::set<node *> traversedNodes;
@@ -2688,17 +3176,15 @@ ProtoNode::ProtoNode(const node_type & nodeType,
                   add_eventout_value_(this->eventOutValueMap));
 
     //
-    // Cloning the nodes is a two-step process. First, we clone the actual
-    // node instances. Second, we traverse the node tree again cloning the
-    // routes.
+    // The implementation is built from the PROTO's template, which the
+    // parser compiled from the archetype before it let anything else see the
+    // PROTO. Instances, which EXTERNPROTO lets other scenes parsed at once
+    // make, only read it.
     //
-    ProtoImplCloner protoImplCloner;
-
-    protoImplCloner.clone(n, *this);
-
-    
-
-    RouteCopyTraverser(*scope).traverse(n.getImplNodes());
+    const ProtoNodeClass & protoClass =
+        static_cast<const ProtoNodeClass &>(nodeType.node_class);
+    assert(protoClass.implTemplate);
+    protoClass.implTemplate->instantiate(*this);
 
     //
     // Finally, we initialize the implementation using the PROTO's default
@@ -2707,8 +3193,7 @@ ProtoNode::ProtoNode(const node_type & nodeType,
     NodeFieldCloner nodeCloner;
 
     typedef ProtoNodeClass::DefaultValueMap DefaultValueMap;
-    DefaultValueMap & defaultValueMap =
-        static_cast<ProtoNodeClass &>(nodeType.node_class).defaultValueMap;
+    const DefaultValueMap & defaultValueMap = protoClass.defaultValueMap;
     const scope_ptr & protoScope = this->implNodes[0]->scope();
 
     for (DefaultValueMap::const_iterator i(defaultValueMap.begin());
@@ -3233,14 +3718,32 @@ void ProtoNode::addIS(node & implNode,
         throw field_value_type_mismatch();
     }
 
-    //
-    // Add the IS.
-    //
+    this->insertIS(implNode, implNodeInterfaceId, protoInterfaceId,
+                   protoInterface->type);
+}
+
+/**
+ * @brief Add an IS mapping that is known to be valid.
+ *
+ * @param implNode              a node in the prototype implementation.
+ * @param implNodeInterfaceId   an interface of @p implNode.
+ * @param protoInterfaceId      an interface of the prototype.
+ * @param protoInterfaceType    the type of the interface
+ *                              @p protoInterfaceId.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void ProtoNode::insertIS(node & implNode,
+                         const std::string & implNodeInterfaceId,
+                         const std::string & protoInterfaceId,
+                         const node_interface::type_id protoInterfaceType)
+    throw (std::bad_alloc)
+{
     const ImplNodeInterface implNodeInterfaceRef(implNode, implNodeInterfaceId);
     const ISMap::value_type value(protoInterfaceId, implNodeInterfaceRef);
     this->isMap.insert(value);
 
-    if (protoInterface->type == node_interface::eventout_id) {
+    if (protoInterfaceType == node_interface::eventout_id) {
         EventOutValueMap::iterator pos =
                 this->eventOutValueMap.find(protoInterfaceId);
         if (pos == this->eventOutValueMap.end()) {
@@ -3633,6 +4136,13 @@ ProtoNodeClass::ProtoNodeType::addInterface(const node_interface & interface)
  * @brief The prototype object. New nodes are created by copying this object.
  */
 
+/**
+ * @var ProtoImplTemplate * ProtoNodeClass::implTemplate
+ *
+ * @brief The implementation of @a protoNode, compiled for copying; null until
+ *      compileImpl is called.
+ */
+
 /**
  * @brief Constructor.
  *
@@ -3641,14 +4151,17 @@ ProtoNodeClass::ProtoNodeType::addInterface(const node_interface & interface)
 ProtoNodeClass::ProtoNodeClass(openvrml::browser & browser) throw ():
     node_class(browser),
     protoNodeType(*this, ""),
-    protoNode(protoNodeType)
+    protoNode(protoNodeType),
+    implTemplate(0)
 {}
 
 /**
  * @brief Destructor.
  */
 ProtoNodeClass::~ProtoNodeClass() throw ()
-{}
+{
+    delete this->implTemplate;
+}
 
 /**
  * @brief Add an eventIn.
@@ -3768,6 +4281,8 @@ void ProtoNodeClass::addField(const std::string & id,
 void ProtoNodeClass::addRootNode(const node_ptr & node) throw (std::bad_alloc)
 {
     this->protoNode.addRootNode(node);
+    delete this->implTemplate;
+    this->implTemplate = 0;
 }
 
 /**
@@ -3794,6 +4309,24 @@ void ProtoNodeClass::addIS(node & implNode,
            field_value_type_mismatch, std::bad_alloc)
 {
     this->protoNode.addIS(implNode, implNodeInterfaceId, protoInterfaceId);
+    delete this->implTemplate;
+    this->implTemplate = 0;
+}
+
+/**
+ * @brief Compile the implementation of the prototype for its instances.
+ *
+ * The parser calls this once the PROTO is complete, and before it adds the
+ * node_class to the browser's node_class_map.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void ProtoNodeClass::compileImpl() throw (std::bad_alloc)
+{
+    ProtoImplTemplate * const implTemplate =
+        new ProtoImplTemplate(this->protoNode);
+    delete this->implTemplate;
+    this->implTemplate = implTemplate;
 }
 
 namespace {
@@ -3869,6 +4402,9 @@ namespace {
 /**
  * @brief Constructor.
  *
+ * The node types are made once for a load of the browser, as every PROTO
+ * interface declaration and every Inline has a root scope of its own.
+ *
  * @param browser   the browser object.
  * @param uri       the URI associated with the stream being read.
  *
@@ -3878,6 +4414,29 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                                  const std::string & uri)
     throw (std::bad_alloc):
     scope(uri)
+{
+    if (browser.vrml97_types_.empty()) {
+        create_types(browser, browser.vrml97_types_);
+    }
+    for (std::vector<node_type_ptr>::const_iterator type =
+             browser.vrml97_types_.begin();
+         type != browser.vrml97_types_.end();
+         ++type) {
+        this->add_type(*type);
+    }
+}
+
+/**
+ * @brief Make the VRML97 node types of the node_classes of @p browser.
+ *
+ * @param browser   the browser object.
+ * @param types     the node types, in the order they are added to a scope.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void Vrml97RootScope::create_types(const browser & browser,
+                                   std::vector<node_type_ptr> & types)
+    throw (std::bad_alloc)
 {
     const browser::node_class_map_t & nodeClassMap = browser.node_class_map;
     browser::node_class_map_t::const_iterator pos;
@@ -3915,7 +4474,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             anchorInterfaceSet(anchorInterfaces, anchorInterfaces + 8);
     pos = nodeClassMap.find("urn:X-openvrml:node:Anchor");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("Anchor", anchorInterfaceSet));
+    types.push_back(pos->second->create_type("Anchor", anchorInterfaceSet));
 
     //
     // Appearance node
@@ -3936,7 +4495,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                                    appearanceInterfaces + 3);
     pos = nodeClassMap.find("urn:X-openvrml:node:Appearance");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("Appearance",
+    types.push_back(pos->second->create_type("Appearance",
                                             appearanceInterfaceSet));
 
     //
@@ -3973,7 +4532,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                                   audioClipInterfaces + 8);
     pos = nodeClassMap.find("urn:X-openvrml:node:AudioClip");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("AudioClip",
+    types.push_back(pos->second->create_type("AudioClip",
                                             audioClipInterfaceSet));
 
     //
@@ -3998,7 +4557,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                                   backgroundInterfaces + 12);
     pos = nodeClassMap.find("urn:X-openvrml:node:Background");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("Background",
+    types.push_back(pos->second->create_type("Background",
                                               backgroundInterfaceSet));
 
     //
@@ -4017,7 +4576,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                                   billboardInterfaces + 6);
     pos = nodeClassMap.find("urn:X-openvrml:node:Billboard");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("Billboard",
+    types.push_back(pos->second->create_type("Billboard",
                                               billboardInterfaceSet));
 
     //
@@ -4029,7 +4588,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             boxInterfaceSet(&boxInterface, &boxInterface + 1);
     pos = nodeClassMap.find("urn:X-openvrml:node:Box");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("Box", boxInterfaceSet));
+    types.push_back(pos->second->create_type("Box", boxInterfaceSet));
 
     //
     // Collision node
@@ -4048,7 +4607,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
         collisionInterfaceSet(collisionInterfaces, collisionInterfaces + 8);
     pos = nodeClassMap.find("urn:X-openvrml:node:Collision");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("Collision",
+    types.push_back(pos->second->create_type("Collision",
                                               collisionInterfaceSet));
 
     //
@@ -4062,7 +4621,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             colorInterfaceSet(&colorInterface, &colorInterface + 1);
     pos = nodeClassMap.find("urn:X-openvrml:node:Color");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("Color", colorInterfaceSet));
+    types.push_back(pos->second->create_type("Color", colorInterfaceSet));
 
     //
     // ColorInterpolator node
@@ -4086,7 +4645,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                                           colorInterpolatorInterfaces + 4);
     pos = nodeClassMap.find("urn:X-openvrml:node:ColorInterpolator");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("ColorInterpolator",
+    types.push_back(pos->second->create_type("ColorInterpolator",
                                               colorInterpolatorInterfaceSet));
 
     //
@@ -4102,7 +4661,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             coneInterfaceSet(coneInterfaces, coneInterfaces + 4);
     pos = nodeClassMap.find("urn:X-openvrml:node:Cone");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("Cone", coneInterfaceSet));
+    types.push_back(pos->second->create_type("Cone", coneInterfaceSet));
 
     //
     // Coordinate node
@@ -4114,7 +4673,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                                    &coordinateInterface + 1);
     pos = nodeClassMap.find("urn:X-openvrml:node:Coordinate");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("Coordinate",
+    types.push_back(pos->second->create_type("Coordinate",
                                               coordinateInterfaceSet));
 
     //
@@ -4131,7 +4690,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                                                coordinateInterpolatorInterfaces + 4);
     pos = nodeClassMap.find("urn:X-openvrml:node:CoordinateInterpolator");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("CoordinateInterpolator",
+    types.push_back(pos->second->create_type("CoordinateInterpolator",
                                               coordinateInterpolatorInterfaceSet));
 
     //
@@ -4148,7 +4707,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             cylinderInterfaceSet(cylinderInterfaces, cylinderInterfaces + 5);
     pos = nodeClassMap.find("urn:X-openvrml:node:Cylinder");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("Cylinder",
+    types.push_back(pos->second->create_type("Cylinder",
                                               cylinderInterfaceSet));
 
     //
@@ -4170,7 +4729,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                                        cylinderSensorInterfaces + 9);
     pos = nodeClassMap.find("urn:X-openvrml:node:CylinderSensor");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("CylinderSensor",
+    types.push_back(pos->second->create_type("CylinderSensor",
                                               cylinderSensorInterfaceSet));
 
     //
@@ -4188,7 +4747,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                                          directionalLightInterfaces + 5);
     pos = nodeClassMap.find("urn:X-openvrml:node:DirectionalLight");
     assert(pos != nodeClassMap.end());
-    this->add_type(pos->second->create_type("DirectionalLight",
+    types.push_back(pos->second->create_type("DirectionalLight",
                                               directionalLightInterfaceSet));
 
     //
@@ -4243,7 +4802,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             node_interface_set(node_interfaces, node_interfaces + 14);
         pos = nodeClassMap.find("urn:X-openvrml:node:ElevationGrid");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("ElevationGrid",
+        types.push_back(pos->second->create_type("ElevationGrid",
                                                 node_interface_set));
     }
 
@@ -4299,7 +4858,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 14);
         pos = nodeClassMap.find("urn:X-openvrml:node:Extrusion");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Extrusion",
+        types.push_back(pos->second->create_type("Extrusion",
                                                   nodeInterfaceSet));
     }
 
@@ -4328,7 +4887,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 5);
         pos = nodeClassMap.find("urn:X-openvrml:node:Fog");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Fog", nodeInterfaceSet));
+        types.push_back(pos->second->create_type("Fog", nodeInterfaceSet));
     }
 
     //
@@ -4368,7 +4927,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 9);
         pos = nodeClassMap.find("urn:X-openvrml:node:FontStyle");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("FontStyle",
+        types.push_back(pos->second->create_type("FontStyle",
                                                 nodeInterfaceSet));
     }
 
@@ -4397,7 +4956,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 5);
         pos = nodeClassMap.find("urn:X-openvrml:node:Group");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Group",
+        types.push_back(pos->second->create_type("Group",
                                                 nodeInterfaceSet));
     }
 
@@ -4420,7 +4979,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 3);
         pos = nodeClassMap.find("urn:X-openvrml:node:ImageTexture");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("ImageTexture",
+        types.push_back(pos->second->create_type("ImageTexture",
                                                 nodeInterfaceSet));
     }
 
@@ -4488,7 +5047,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 18);
         pos = nodeClassMap.find("urn:X-openvrml:node:IndexedFaceSet");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("IndexedFaceSet",
+        types.push_back(pos->second->create_type("IndexedFaceSet",
                                                 nodeInterfaceSet));
     }
 
@@ -4523,7 +5082,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 7);
         pos = nodeClassMap.find("urn:X-openvrml:node:IndexedLineSet");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("IndexedLineSet",
+        types.push_back(pos->second->create_type("IndexedLineSet",
                                                   nodeInterfaceSet));
     }
 
@@ -4540,7 +5099,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 3);
         pos = nodeClassMap.find("urn:X-openvrml:node:Inline");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Inline", nodeInterfaceSet));
+        types.push_back(pos->second->create_type("Inline", nodeInterfaceSet));
     }
 
     //
@@ -4556,7 +5115,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 3);
         pos = nodeClassMap.find("urn:X-openvrml:node:LOD");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("LOD", nodeInterfaceSet));
+        types.push_back(pos->second->create_type("LOD", nodeInterfaceSet));
     }
 
     //
@@ -4575,7 +5134,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 6);
         pos = nodeClassMap.find("urn:X-openvrml:node:Material");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Material",
+        types.push_back(pos->second->create_type("Material",
                                                   nodeInterfaceSet));
     }
 
@@ -4616,7 +5175,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 9);
         pos = nodeClassMap.find("urn:X-openvrml:node:MovieTexture");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("MovieTexture",
+        types.push_back(pos->second->create_type("MovieTexture",
                                                 nodeInterfaceSet));
     }
 
@@ -4651,7 +5210,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 7);
         pos = nodeClassMap.find("urn:X-openvrml:node:NavigationInfo");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("NavigationInfo",
+        types.push_back(pos->second->create_type("NavigationInfo",
                                                 nodeInterfaceSet));
     }
 
@@ -4667,7 +5226,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             nodeInterfaceSet(&nodeInterface, &nodeInterface + 1);
         pos = nodeClassMap.find("urn:X-openvrml:node:Normal");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Normal",
+        types.push_back(pos->second->create_type("Normal",
                                                 nodeInterfaceSet));
     }
 
@@ -4693,7 +5252,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 4);
         pos = nodeClassMap.find("urn:X-openvrml:node:NormalInterpolator");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("NormalInterpolator",
+        types.push_back(pos->second->create_type("NormalInterpolator",
                                                   nodeInterfaceSet));
     }
 
@@ -4719,7 +5278,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 4);
         pos = nodeClassMap.find("urn:X-openvrml:node:OrientationInterpolator");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("OrientationInterpolator",
+        types.push_back(pos->second->create_type("OrientationInterpolator",
                                                   nodeInterfaceSet));
     }
 
@@ -4742,7 +5301,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 3);
         pos = nodeClassMap.find("urn:X-openvrml:node:PixelTexture");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("PixelTexture",
+        types.push_back(pos->second->create_type("PixelTexture",
                                                   nodeInterfaceSet));
     }
 
@@ -4764,7 +5323,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 8);
         pos = nodeClassMap.find("urn:X-openvrml:node:PlaneSensor");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("PlaneSensor",
+        types.push_back(pos->second->create_type("PlaneSensor",
                                                   nodeInterfaceSet));
     }
 
@@ -4785,7 +5344,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 7);
         pos = nodeClassMap.find("urn:X-openvrml:node:PointLight");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("PointLight",
+        types.push_back(pos->second->create_type("PointLight",
                                                   nodeInterfaceSet));
     }
 
@@ -4805,7 +5364,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 2);
         pos = nodeClassMap.find("urn:X-openvrml:node:PointSet");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("PointSet",
+        types.push_back(pos->second->create_type("PointSet",
                                                 nodeInterfaceSet));
     }
 
@@ -4831,7 +5390,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 4);
         pos = nodeClassMap.find("urn:X-openvrml:node:PositionInterpolator");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("PositionInterpolator",
+        types.push_back(pos->second->create_type("PositionInterpolator",
                                                   nodeInterfaceSet));
     }
 
@@ -4869,7 +5428,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 8);
         pos = nodeClassMap.find("urn:X-openvrml:node:ProximitySensor");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("ProximitySensor",
+        types.push_back(pos->second->create_type("ProximitySensor",
                                                 nodeInterfaceSet));
     }
 
@@ -4895,7 +5454,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 4);
         pos = nodeClassMap.find("urn:X-openvrml:node:ScalarInterpolator");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("ScalarInterpolator",
+        types.push_back(pos->second->create_type("ScalarInterpolator",
                                                 nodeInterfaceSet));
     }
 
@@ -4915,7 +5474,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 2);
         pos = nodeClassMap.find("urn:X-openvrml:node:Shape");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Shape", nodeInterfaceSet));
+        types.push_back(pos->second->create_type("Shape", nodeInterfaceSet));
     }
 
     //
@@ -4958,7 +5517,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 10);
         pos = nodeClassMap.find("urn:X-openvrml:node:Sound");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Sound", nodeInterfaceSet));
+        types.push_back(pos->second->create_type("Sound", nodeInterfaceSet));
     }
 
     //
@@ -4973,7 +5532,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(&nodeInterface, &nodeInterface + 1);
         pos = nodeClassMap.find("urn:X-openvrml:node:Sphere");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Sphere", nodeInterfaceSet));
+        types.push_back(pos->second->create_type("Sphere", nodeInterfaceSet));
     }
 
     //
@@ -5004,7 +5563,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 6);
         pos = nodeClassMap.find("urn:X-openvrml:node:SphereSensor");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("SphereSensor",
+        types.push_back(pos->second->create_type("SphereSensor",
                                                 nodeInterfaceSet));
     }
 
@@ -5048,7 +5607,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 10);
         pos = nodeClassMap.find("urn:X-openvrml:node:SpotLight");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("SpotLight",
+        types.push_back(pos->second->create_type("SpotLight",
                                                 nodeInterfaceSet));
     }
 
@@ -5068,7 +5627,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 2);
         pos = nodeClassMap.find("urn:X-openvrml:node:Switch");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Switch", nodeInterfaceSet));
+        types.push_back(pos->second->create_type("Switch", nodeInterfaceSet));
     }
 
     //
@@ -5093,7 +5652,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 4);
         pos = nodeClassMap.find("urn:X-openvrml:node:Text");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Text", nodeInterfaceSet));
+        types.push_back(pos->second->create_type("Text", nodeInterfaceSet));
     }
 
     //
@@ -5108,7 +5667,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(&nodeInterface, &nodeInterface + 1);
         pos = nodeClassMap.find("urn:X-openvrml:node:TextureCoordinate");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("TextureCoordinate",
+        types.push_back(pos->second->create_type("TextureCoordinate",
                                                 nodeInterfaceSet));
     }
 
@@ -5134,7 +5693,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 4);
         pos = nodeClassMap.find("urn:X-openvrml:node:TextureTransform");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("TextureTransform",
+        types.push_back(pos->second->create_type("TextureTransform",
                                                 nodeInterfaceSet));
     }
 
@@ -5175,7 +5734,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
             nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 9);
         pos = nodeClassMap.find("urn:X-openvrml:node:TimeSensor");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("TimeSensor",
+        types.push_back(pos->second->create_type("TimeSensor",
                                                 nodeInterfaceSet));
     }
 
@@ -5210,7 +5769,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 7);
         pos = nodeClassMap.find("urn:X-openvrml:node:TouchSensor");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("TouchSensor",
+        types.push_back(pos->second->create_type("TouchSensor",
                                                   nodeInterfaceSet));
     }
 
@@ -5254,7 +5813,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 10);
         pos = nodeClassMap.find("urn:X-openvrml:node:Transform");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Transform",
+        types.push_back(pos->second->create_type("Transform",
                                                   nodeInterfaceSet));
     }
 
@@ -5291,7 +5850,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 8);
         pos = nodeClassMap.find("urn:X-openvrml:node:Viewpoint");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("Viewpoint",
+        types.push_back(pos->second->create_type("Viewpoint",
                                                   nodeInterfaceSet));
     }
 
@@ -5323,7 +5882,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 6);
         pos = nodeClassMap.find("urn:X-openvrml:node:VisibilitySensor");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("VisibilitySensor",
+        types.push_back(pos->second->create_type("VisibilitySensor",
                                                 nodeInterfaceSet));
     }
 
@@ -5343,7 +5902,7 @@ Vrml97RootScope::Vrml97RootScope(const browser & browser,
                 nodeInterfaceSet(nodeInterfaces, nodeInterfaces + 2);
         pos = nodeClassMap.find("urn:X-openvrml:node:WorldInfo");
         assert(pos != nodeClassMap.end());
-        this->add_type(pos->second->create_type("WorldInfo",
+        types.push_back(pos->second->create_type("WorldInfo",
                                                 nodeInterfaceSet));
     }
 }
@@ -5671,4 +6230,1006 @@ namespace {
 
 } // namespace
 
+
+/**
+ * @class compiled_scene
+ *
+ * @brief Binary form of a scene.
+ *
+ * A compiled scene (a <code>.wrlb</code> file next to the <code>.wrl</code>
+ * it was made from) is the node graph of the VRML97 file after PROTO
+ * expansion: the nodes the browser would create, the fields that differ
+ * from their defaults, and the ROUTEs. Multiple-valued fields are stored as
+ * flat arrays of their native types, so that reading one is a copy out of
+ * the mapped file.
+ *
+ * A compiled scene records the size and modification time of its source
+ * and is only used while they match. It is written in the byte order of
+ * the machine that compiles it and is ignored elsewhere.
+ *
+ * The file is a sequence of 32-bit words:
+ *  - the header: "WRLB", version, byte order mark, 0, source size and
+ *    modification time (two doubles each), and the number of strings,
+ *    nodes, field records, root nodes, hidden nodes and routes;
+ *  - the strings, as length and bytes padded to a word;
+ *  - for each node, the string of its type and of its DEF name;
+ *  - the field records, children before their parents: a node, the number
+ *    of its fields, and for each field its interface type, name, field type
+ *    and value;
+ *  - the root nodes;
+ *  - the hidden nodes: PROTO implementation nodes after the first, which
+ *    are kept in a Switch that shows none of them;
+ *  - the routes, as node, eventOut, node and eventIn.
+ */
+
+namespace {
+
+    typedef unsigned int word;
+
+    const char compiled_magic[4] = { 'W', 'R', 'L', 'B' };
+    const word compiled_version = 1;
+    const word compiled_byte_order = 0x01020304;
+    const word compiled_none = 0xffffffff;
+
+    //
+    // Set on the interface type of a field record entry that declares an
+    // interface of a Script node.
+    //
+    const word compiled_declaration = 0x100;
+
+    const std::string compiled_name(const std::string & source)
+    {
+        const std::string::size_type n = source.size();
+        return (n > 4 && source.compare(n - 4, 4, ".wrl") == 0)
+            ? source + "b"
+            : std::string();
+    }
+
+    bool is_script_builtin(const std::string & id)
+    {
+        return id == "url" || id == "directOutput" || id == "mustEvaluate";
+    }
+
+    class compiled_output {
+        std::string data_;
+
+    public:
+        const std::string & data() const throw ()
+        {
+            return this->data_;
+        }
+
+        void put_word(const word w)
+        {
+            this->data_.append(reinterpret_cast<const char *>(&w), sizeof w);
+        }
+
+        void put_double(const double d)
+        {
+            this->data_.append(reinterpret_cast<const char *>(&d), sizeof d);
+        }
+
+        void put_bytes(const void * const bytes, const size_t n)
+        {
+            this->data_.append(static_cast<const char *>(bytes), n);
+            this->data_.append((4 - n % 4) % 4, '\0');
+        }
+
+        template <typename T>
+        void put_array(const std::vector<T> & v)
+        {
+            this->put_word(word(v.size()));
+            if (!v.empty()) { this->put_bytes(&v[0], v.size() * sizeof(T)); }
+        }
+    };
+
+    class compiled_input {
+        const char * pos;
+        const char * const end;
+
+    public:
+        compiled_input(const char * const begin, const char * const end):
+            pos(begin),
+            end(end)
+        {}
+
+        const char * get_bytes(const size_t n) throw (invalid_vrml)
+        {
+            const size_t padded = n + (4 - n % 4) % 4;
+            if (padded > size_t(this->end - this->pos)) {
+                throw invalid_vrml();
+            }
+            const char * const bytes = this->pos;
+            this->pos += padded;
+            return bytes;
+        }
+
+        word get_word() throw (invalid_vrml)
+        {
+            word w;
+            memcpy(&w, this->get_bytes(sizeof w), sizeof w);
+            return w;
+        }
+
+        double get_double() throw (invalid_vrml)
+        {
+            double d;
+            memcpy(&d, this->get_bytes(sizeof d), sizeof d);
+            return d;
+        }
+
+        template <typename T>
+        void get_array(std::vector<T> & v) throw (invalid_vrml, std::bad_alloc)
+        {
+            const word n = this->get_word();
+            if (n > size_t(this->end - this->pos) / sizeof(T)) {
+                throw invalid_vrml();
+            }
+            v.resize(n);
+            if (n > 0) {
+                memcpy(&v[0], this->get_bytes(n * sizeof(T)), n * sizeof(T));
+            }
+        }
+    };
+
+    class mapped_file {
+        char * data_;
+        size_t size_;
+# ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+# endif
+
+    public:
+        explicit mapped_file(const std::string & path) throw ();
+        ~mapped_file() throw ();
+
+        const char * data() const throw ()
+        {
+            return this->data_;
+        }
+
+        size_t size() const throw ()
+        {
+            return this->size_;
+        }
+
+    private:
+        // Not copyable.
+        mapped_file(const mapped_file &);
+        mapped_file & operator=(const mapped_file &);
+    };
+
+    mapped_file::mapped_file(const std::string & path) throw ():
+        data_(0),
+        size_(0)
+    {
+# ifdef _WIN32
+        this->mapping = 0;
+        this->file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+        if (this->file == INVALID_HANDLE_VALUE) { return; }
+        const DWORD size = GetFileSize(this->file, 0);
+        if (size == INVALID_FILE_SIZE || size == 0) { return; }
+        this->mapping = CreateFileMapping(this->file, 0, PAGE_READONLY,
+                                          0, 0, 0);
+        if (!this->mapping) { return; }
+        this->data_ = static_cast<char *>(MapViewOfFile(this->mapping,
+                                                        FILE_MAP_READ,
+                                                        0, 0, 0));
+        if (this->data_) { this->size_ = size; }
+# else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) { return; }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void * const data = mmap(0, size_t(st.st_size), PROT_READ,
+                                     MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                this->data_ = static_cast<char *>(data);
+                this->size_ = size_t(st.st_size);
+            }
+        }
+        close(fd);
+# endif
+    }
+
+    mapped_file::~mapped_file() throw ()
+    {
+# ifdef _WIN32
+        if (this->data_) { UnmapViewOfFile(this->data_); }
+        if (this->mapping) { CloseHandle(this->mapping); }
+        if (this->file != INVALID_HANDLE_VALUE) { CloseHandle(this->file); }
+# else
+        if (this->data_) { munmap(this->data_, this->size_); }
+# endif
+    }
+
+    class compiled_scene_writer {
+        typedef std::vector<std::pair<node *, std::string> > endpoints_t;
+
+        scope * root_scope;
+        std::vector<node *> nodes;
+        std::map<const node *, word> index;
+        std::map<node *, node *> expansion;
+        std::map<const node *, std::string> names;
+        std::vector<ProtoNode *> protos;
+        std::vector<word> order;
+        std::vector<word> hidden;
+        std::map<const node_type *, node_ptr> defaults;
+        std::map<std::string, word> string_index;
+        std::vector<std::string> strings;
+
+    public:
+        explicit compiled_scene_writer(const std::vector<node_ptr> & roots);
+
+        void write(std::ostream & out,
+                   double source_size, double source_mtime)
+            throw (invalid_vrml, std::bad_alloc);
+
+    private:
+        std::vector<node_ptr> roots;
+
+        node * expand(node * n);
+        word visit(node * n);
+        word find(node * n);
+        word string(const std::string & s);
+        void resolve_eventout(node * n, const std::string & id,
+                              endpoints_t & result);
+        void resolve_eventin(node * n, const std::string & id,
+                             endpoints_t & result);
+        void put_value(compiled_output & out, const field_value & value);
+        void put_fields(compiled_output & out, node & n);
+    };
+
+    compiled_scene_writer::compiled_scene_writer(
+            const std::vector<node_ptr> & roots):
+        root_scope(roots.empty() ? 0 : roots[0]->scope().get()),
+        roots(roots)
+    {}
+
+    //
+    // The node a PROTO instance stands for: the first node of its
+    // implementation. The other implementation nodes are kept as hidden
+    // nodes, and a DEF name of the instance moves to the node.
+    //
+    node * compiled_scene_writer::expand(node * const n)
+    {
+        if (!n) { return 0; }
+        const std::map<node *, node *>::iterator pos = this->expansion.find(n);
+        if (pos != this->expansion.end()) { return pos->second; }
+
+        node * result = n;
+        std::string name;
+        if (n->scope().get() == this->root_scope) { name = n->id(); }
+        ProtoNode * proto;
+        while ((proto = dynamic_cast<ProtoNode *>(result))) {
+            this->protos.push_back(proto);
+            const std::vector<node_ptr> & impl = proto->getImplNodes();
+            result = impl[0].get();
+            this->expansion[n] = result;
+            for (size_t i = 1; i < impl.size(); ++i) {
+                this->hidden.push_back(this->visit(impl[i].get()));
+            }
+        }
+        this->expansion[n] = result;
+        if (!name.empty() && this->names.find(result) == this->names.end()) {
+            this->names[result] = name;
+        }
+        return result;
+    }
+
+    word compiled_scene_writer::visit(node * n)
+    {
+        n = this->expand(n);
+        if (!n) { return compiled_none; }
+        const std::map<const node *, word>::iterator pos = this->index.find(n);
+        if (pos != this->index.end()) { return pos->second; }
+
+        const word i = word(this->nodes.size());
+        this->index[n] = i;
+        this->nodes.push_back(n);
+        const node_interface_set & interfaces = n->type.interfaces();
+        for (node_interface_set::const_iterator interface(interfaces.begin());
+             interface != interfaces.end(); ++interface) {
+            if (interface->type != node_interface::exposedfield_id
+                    && interface->type != node_interface::field_id) {
+                continue;
+            }
+            if (interface->field_type == field_value::sfnode_id) {
+                const sfnode & value =
+                    static_cast<const sfnode &>(n->field(interface->id));
+                this->visit(value.value.get());
+            } else if (interface->field_type == field_value::mfnode_id) {
+                const mfnode & value =
+                    static_cast<const mfnode &>(n->field(interface->id));
+                for (size_t j = 0; j < value.value.size(); ++j) {
+                    this->visit(value.value[j].get());
+                }
+            }
+        }
+
+        this->order.push_back(i);
+        return i;
+    }
+
+    word compiled_scene_writer::find(node * const n)
+    {
+        const std::map<const node *, word>::iterator pos =
+            this->index.find(this->expand(n));
+        return (pos != this->index.end()) ? pos->second : compiled_none;
+    }
+
+    word compiled_scene_writer::string(const std::string & s)
+    {
+        const std::map<std::string, word>::iterator pos =
+            this->string_index.find(s);
+        if (pos != this->string_index.end()) { return pos->second; }
+        const word i = word(this->strings.size());
+        this->string_index[s] = i;
+        this->strings.push_back(s);
+        return i;
+    }
+
+    //
+    // Events to and from a PROTO instance belong to the interfaces of its
+    // implementation that are IS'd to the instance's interface.
+    //
+    void compiled_scene_writer::resolve_eventout(node * const n,
+                                                 const std::string & id,
+                                                 endpoints_t & result)
+    {
+        ProtoNode * const proto = dynamic_cast<ProtoNode *>(n);
+        if (!proto) {
+            result.push_back(std::make_pair(n, id));
+            return;
+        }
+        typedef ProtoNode::ISMap::iterator iterator;
+        std::pair<iterator, iterator> range = proto->isMap.equal_range(id);
+        const std::string::size_type suffix = id.size() - 8;
+        if (range.first == range.second && id.size() > 8
+                && id.compare(suffix, 8, "_changed") == 0) {
+            range = proto->isMap.equal_range(id.substr(0, suffix));
+        }
+        for (iterator itr(range.first); itr != range.second; ++itr) {
+            this->resolve_eventout(&itr->second.node, itr->second.interfaceId,
+                                   result);
+        }
+    }
+
+    void compiled_scene_writer::resolve_eventin(node * const n,
+                                                const std::string & id,
+                                                endpoints_t & result)
+    {
+        ProtoNode * const proto = dynamic_cast<ProtoNode *>(n);
+        if (!proto) {
+            result.push_back(std::make_pair(n, id));
+            return;
+        }
+        typedef ProtoNode::ISMap::iterator iterator;
+        std::pair<iterator, iterator> range = proto->isMap.equal_range(id);
+        if (range.first == range.second && id.size() > 4
+                && id.compare(0, 4, "set_") == 0) {
+            range = proto->isMap.equal_range(id.substr(4));
+        }
+        for (iterator itr(range.first); itr != range.second; ++itr) {
+            this->resolve_eventin(&itr->second.node, itr->second.interfaceId,
+                                  result);
+        }
+    }
+
+    void compiled_scene_writer::put_value(compiled_output & out,
+                                          const field_value & value)
+    {
+        switch (value.type()) {
+        case field_value::sfbool_id:
+            out.put_word(static_cast<const sfbool &>(value).value);
+            break;
+        case field_value::sfcolor_id:
+            out.put_bytes(&static_cast<const sfcolor &>(value).value,
+                          sizeof(color));
+            break;
+        case field_value::sffloat_id:
+            out.put_bytes(&static_cast<const sffloat &>(value).value,
+                          sizeof(float));
+            break;
+        case field_value::sfimage_id:
+            {
+                const sfimage & image = static_cast<const sfimage &>(value);
+                const bool empty = !image.array();
+                out.put_word(empty ? 0 : word(image.x()));
+                out.put_word(empty ? 0 : word(image.y()));
+                out.put_word(empty ? 0 : word(image.comp()));
+                if (!empty) {
+                    out.put_bytes(image.array(),
+                                  image.x() * image.y() * image.comp());
+                }
+            }
+            break;
+        case field_value::sfint32_id:
+            out.put_bytes(&static_cast<const sfint32 &>(value).value,
+                          sizeof(int32));
+            break;
+        case field_value::sfnode_id:
+            out.put_word(
+                this->find(static_cast<const sfnode &>(value).value.get()));
+            break;
+        case field_value::sfrotation_id:
+            out.put_bytes(&static_cast<const sfrotation &>(value).value,
+                          sizeof(rotation));
+            break;
+        case field_value::sfstring_id:
+            out.put_word(
+                this->string(static_cast<const sfstring &>(value).value));
+            break;
+        case field_value::sftime_id:
+            out.put_double(static_cast<const sftime &>(value).value);
+            break;
+        case field_value::sfvec2f_id:
+            out.put_bytes(&static_cast<const sfvec2f &>(value).value,
+                          sizeof(vec2f));
+            break;
+        case field_value::sfvec3f_id:
+            out.put_bytes(&static_cast<const sfvec3f &>(value).value,
+                          sizeof(vec3f));
+            break;
+        case field_value::mfcolor_id:
+            out.put_array(static_cast<const mfcolor &>(value).value);
+            break;
+        case field_value::mffloat_id:
+            out.put_array(static_cast<const mffloat &>(value).value);
+            break;
+        case field_value::mfint32_id:
+            out.put_array(static_cast<const mfint32 &>(value).value);
+            break;
+        case field_value::mfnode_id:
+            {
+                const std::vector<node_ptr> & nodes =
+                    static_cast<const mfnode &>(value).value;
+                out.put_word(word(nodes.size()));
+                for (size_t i = 0; i < nodes.size(); ++i) {
+                    out.put_word(this->find(nodes[i].get()));
+                }
+            }
+            break;
+        case field_value::mfrotation_id:
+            out.put_array(static_cast<const mfrotation &>(value).value);
+            break;
+        case field_value::mfstring_id:
+            {
+                const std::vector<std::string> & strings =
+                    static_cast<const mfstring &>(value).value;
+                out.put_word(word(strings.size()));
+                for (size_t i = 0; i < strings.size(); ++i) {
+                    out.put_word(this->string(strings[i]));
+                }
+            }
+            break;
+        case field_value::mftime_id:
+            out.put_array(static_cast<const mftime &>(value).value);
+            break;
+        case field_value::mfvec2f_id:
+            out.put_array(static_cast<const mfvec2f &>(value).value);
+            break;
+        case field_value::mfvec3f_id:
+            out.put_array(static_cast<const mfvec3f &>(value).value);
+            break;
+        default:
+            throw invalid_vrml();
+        }
+    }
+
+    //
+    // The fields of a node that differ from those of a new node of its
+    // type; for a Script, also the interfaces it declares.
+    //
+    void compiled_scene_writer::put_fields(compiled_output & out, node & n)
+    {
+        const bool script = n.to_script() != 0;
+        node_ptr & default_node = this->defaults[&n.type];
+        if (!script && !default_node) {
+            default_node = n.type.create_node(n.scope());
+        }
+
+        compiled_output fields;
+        word count = 0;
+        const node_interface_set & interfaces = n.type.interfaces();
+        for (node_interface_set::const_iterator interface(interfaces.begin());
+             interface != interfaces.end(); ++interface) {
+            word type = word(interface->type);
+            if (script && !is_script_builtin(interface->id)) {
+                type |= compiled_declaration;
+            } else if (interface->type != node_interface::exposedfield_id
+                       && interface->type != node_interface::field_id) {
+                continue;
+            }
+
+            compiled_output value;
+            if (interface->type == node_interface::exposedfield_id
+                    || interface->type == node_interface::field_id) {
+                this->put_value(value, n.field(interface->id));
+                if (!script) {
+                    compiled_output initial;
+                    this->put_value(initial,
+                                    default_node->field(interface->id));
+                    if (initial.data() == value.data()) { continue; }
+                }
+            }
+            fields.put_word(type);
+            fields.put_word(this->string(interface->id));
+            fields.put_word(word(interface->field_type));
+            fields.put_bytes(value.data().data(), value.data().size());
+            ++count;
+        }
+
+        out.put_word(this->index[&n]);
+        out.put_word(count);
+        out.put_bytes(fields.data().data(), fields.data().size());
+    }
+
+    void compiled_scene_writer::write(std::ostream & out,
+                                      const double source_size,
+                                      const double source_mtime)
+        throw (invalid_vrml, std::bad_alloc)
+    {
+        compiled_output root_list;
+        for (size_t i = 0; i < this->roots.size(); ++i) {
+            root_list.put_word(this->visit(this->roots[i].get()));
+        }
+
+        compiled_output node_table;
+        for (size_t i = 0; i < this->nodes.size(); ++i) {
+            const std::map<const node *, std::string>::const_iterator name =
+                this->names.find(this->nodes[i]);
+            node_table.put_word(this->string(this->nodes[i]->type.id));
+            node_table.put_word((name != this->names.end())
+                                ? this->string(name->second)
+                                : compiled_none);
+        }
+
+        compiled_output field_records;
+        for (size_t i = 0; i < this->order.size(); ++i) {
+            this->put_fields(field_records, *this->nodes[this->order[i]]);
+        }
+
+        compiled_output hidden_list;
+        for (size_t i = 0; i < this->hidden.size(); ++i) {
+            hidden_list.put_word(this->hidden[i]);
+        }
+
+        //
+        // ROUTEs are kept by the node they come from; those of PROTO
+        // instances are moved onto the implementation.
+        //
+        std::vector<node *> sources(this->nodes);
+        sources.insert(sources.end(), this->protos.begin(), this->protos.end());
+        compiled_output route_list;
+        word routes = 0;
+        for (size_t i = 0; i < sources.size(); ++i) {
+            const node::routes_t & node_routes = sources[i]->routes();
+            for (node::routes_t::const_iterator route(node_routes.begin());
+                 route != node_routes.end(); ++route) {
+                endpoints_t from, to;
+                this->resolve_eventout(sources[i], route->from_eventout, from);
+                this->resolve_eventin(route->to_node.get(), route->to_eventin,
+                                      to);
+                for (size_t j = 0; j < from.size(); ++j) {
+                    for (size_t k = 0; k < to.size(); ++k) {
+                        const word from_node = this->find(from[j].first);
+                        const word to_node = this->find(to[k].first);
+                        if (from_node == compiled_none
+                                || to_node == compiled_none) {
+                            continue;
+                        }
+                        route_list.put_word(from_node);
+                        route_list.put_word(this->string(from[j].second));
+                        route_list.put_word(to_node);
+                        route_list.put_word(this->string(to[k].second));
+                        ++routes;
+                    }
+                }
+            }
+        }
+
+        compiled_output header;
+        header.put_bytes(compiled_magic, sizeof compiled_magic);
+        header.put_word(compiled_version);
+        header.put_word(compiled_byte_order);
+        header.put_word(0);
+        header.put_double(source_size);
+        header.put_double(source_mtime);
+        header.put_word(word(this->strings.size()));
+        header.put_word(word(this->nodes.size()));
+        header.put_word(word(this->order.size()));
+        header.put_word(word(this->roots.size()));
+        header.put_word(word(this->hidden.size()));
+        header.put_word(routes);
+        for (size_t i = 0; i < this->strings.size(); ++i) {
+            header.put_word(word(this->strings[i].size()));
+            header.put_bytes(this->strings[i].data(), this->strings[i].size());
+        }
+
+        out.write(header.data().data(), header.data().size());
+        out.write(node_table.data().data(), node_table.data().size());
+        out.write(field_records.data().data(), field_records.data().size());
+        out.write(root_list.data().data(), root_list.data().size());
+        out.write(hidden_list.data().data(), hidden_list.data().size());
+        out.write(route_list.data().data(), route_list.data().size());
+        if (!out) { throw invalid_vrml(); }
+    }
+
+    class compiled_scene_reader {
+        const openvrml::browser & browser;
+        script_node_class & script_class;
+        compiled_input in;
+        std::vector<std::string> strings;
+        std::vector<node_ptr> nodes;
+
+    public:
+        compiled_scene_reader(const openvrml::browser & browser,
+                              script_node_class & script_class,
+                              const mapped_file & file);
+
+        bool read(double source_size, double source_mtime,
+                  const std::string & uri, std::vector<node_ptr> & roots)
+            throw (invalid_vrml, std::bad_alloc);
+
+    private:
+        const std::string & string(word i) throw (invalid_vrml);
+        const node_ptr & node(word i) throw (invalid_vrml);
+        const field_value_ptr value(field_value::type_id type)
+            throw (invalid_vrml, std::bad_alloc);
+        void fields() throw (invalid_vrml, std::bad_alloc);
+    };
+
+    compiled_scene_reader::compiled_scene_reader(
+            const openvrml::browser & browser,
+            script_node_class & script_class,
+            const mapped_file & file):
+        browser(browser),
+        script_class(script_class),
+        in(file.data(), file.data() + file.size())
+    {}
+
+    const std::string & compiled_scene_reader::string(const word i)
+        throw (invalid_vrml)
+    {
+        if (i >= this->strings.size()) { throw invalid_vrml(); }
+        return this->strings[i];
+    }
+
+    const node_ptr & compiled_scene_reader::node(const word i)
+        throw (invalid_vrml)
+    {
+        static const node_ptr null;
+        if (i == compiled_none) { return null; }
+        if (i >= this->nodes.size()) { throw invalid_vrml(); }
+        return this->nodes[i];
+    }
+
+    const field_value_ptr
+    compiled_scene_reader::value(const field_value::type_id type)
+        throw (invalid_vrml, std::bad_alloc)
+    {
+        std::auto_ptr<field_value> value(field_value::create(type));
+        switch (type) {
+        case field_value::sfbool_id:
+            static_cast<sfbool &>(*value).value = this->in.get_word() != 0;
+            break;
+        case field_value::sfcolor_id:
+            memcpy(&static_cast<sfcolor &>(*value).value,
+                   this->in.get_bytes(sizeof(color)), sizeof(color));
+            break;
+        case field_value::sffloat_id:
+            memcpy(&static_cast<sffloat &>(*value).value,
+                   this->in.get_bytes(sizeof(float)), sizeof(float));
+            break;
+        case field_value::sfimage_id:
+            {
+                const size_t x = this->in.get_word();
+                const size_t y = this->in.get_word();
+                const size_t comp = this->in.get_word();
+                if (comp > 4 || (x > 0 && y > (size_t(-1) / 4) / x)) {
+                    throw invalid_vrml();
+                }
+                static_cast<sfimage &>(*value)
+                    .set(x, y, comp, reinterpret_cast<const unsigned char *>(
+                                         this->in.get_bytes(x * y * comp)));
+            }
+            break;
+        case field_value::sfint32_id:
+            memcpy(&static_cast<sfint32 &>(*value).value,
+                   this->in.get_bytes(sizeof(int32)), sizeof(int32));
+            break;
+        case field_value::sfnode_id:
+            static_cast<sfnode &>(*value).value =
+                this->node(this->in.get_word());
+            break;
+        case field_value::sfrotation_id:
+            memcpy(&static_cast<sfrotation &>(*value).value,
+                   this->in.get_bytes(sizeof(rotation)), sizeof(rotation));
+            break;
+        case field_value::sfstring_id:
+            static_cast<sfstring &>(*value).value =
+                this->string(this->in.get_word());
+            break;
+        case field_value::sftime_id:
+            static_cast<sftime &>(*value).value = this->in.get_double();
+            break;
+        case field_value::sfvec2f_id:
+            memcpy(&static_cast<sfvec2f &>(*value).value,
+                   this->in.get_bytes(sizeof(vec2f)), sizeof(vec2f));
+            break;
+        case field_value::sfvec3f_id:
+            memcpy(&static_cast<sfvec3f &>(*value).value,
+                   this->in.get_bytes(sizeof(vec3f)), sizeof(vec3f));
+            break;
+        case field_value::mfcolor_id:
+            this->in.get_array(static_cast<mfcolor &>(*value).value);
+            break;
+        case field_value::mffloat_id:
+            this->in.get_array(static_cast<mffloat &>(*value).value);
+            break;
+        case field_value::mfint32_id:
+            this->in.get_array(static_cast<mfint32 &>(*value).value);
+            break;
+        case field_value::mfnode_id:
+            {
+                std::vector<node_ptr> & nodes =
+                    static_cast<mfnode &>(*value).value;
+                nodes.resize(this->in.get_word());
+                for (size_t i = 0; i < nodes.size(); ++i) {
+                    nodes[i] = this->node(this->in.get_word());
+                }
+            }
+            break;
+        case field_value::mfrotation_id:
+            this->in.get_array(static_cast<mfrotation &>(*value).value);
+            break;
+        case field_value::mfstring_id:
+            {
+                std::vector<std::string> & strings =
+                    static_cast<mfstring &>(*value).value;
+                strings.resize(this->in.get_word());
+                for (size_t i = 0; i < strings.size(); ++i) {
+                    strings[i] = this->string(this->in.get_word());
+                }
+            }
+            break;
+        case field_value::mftime_id:
+            this->in.get_array(static_cast<mftime &>(*value).value);
+            break;
+        case field_value::mfvec2f_id:
+            this->in.get_array(static_cast<mfvec2f &>(*value).value);
+            break;
+        case field_value::mfvec3f_id:
+            this->in.get_array(static_cast<mfvec3f &>(*value).value);
+            break;
+        default:
+            throw invalid_vrml();
+        }
+        return field_value_ptr(value);
+    }
+
+    void compiled_scene_reader::fields() throw (invalid_vrml, std::bad_alloc)
+    {
+        openvrml::node & n = *this->node(this->in.get_word());
+        for (word count = this->in.get_word(); count > 0; --count) {
+            const word interface_type = this->in.get_word();
+            const std::string & id = this->string(this->in.get_word());
+            const word type = this->in.get_word();
+            if (type == field_value::invalid_type_id
+                    || type > field_value::mfvec3f_id) {
+                throw invalid_vrml();
+            }
+            const field_value::type_id field_type = field_value::type_id(type);
+
+            if (interface_type & compiled_declaration) {
+                script_node * const script = n.to_script();
+                if (!script) { throw invalid_vrml(); }
+                switch (interface_type & ~compiled_declaration) {
+                case node_interface::eventin_id:
+                    script->add_eventin(field_type, id);
+                    break;
+                case node_interface::eventout_id:
+                    script->add_eventout(field_type, id);
+                    break;
+                case node_interface::field_id:
+                    script->add_field(id, this->value(field_type));
+                    break;
+                default:
+                    throw invalid_vrml();
+                }
+            } else {
+                if (n.type.has_field(id) != field_type
+                        && n.type.has_exposedfield(id) != field_type) {
+                    throw invalid_vrml();
+                }
+                n.field(id, *this->value(field_type));
+            }
+        }
+    }
+
+    bool compiled_scene_reader::read(const double source_size,
+                                     const double source_mtime,
+                                     const std::string & uri,
+                                     std::vector<node_ptr> & roots)
+        throw (invalid_vrml, std::bad_alloc)
+    {
+        if (memcmp(this->in.get_bytes(sizeof compiled_magic), compiled_magic,
+                   sizeof compiled_magic) != 0
+                || this->in.get_word() != compiled_version
+                || this->in.get_word() != compiled_byte_order) {
+            return false;
+        }
+        this->in.get_word();
+        if (this->in.get_double() != source_size
+                || this->in.get_double() != source_mtime) {
+            return false;
+        }
+        const word string_count = this->in.get_word();
+        const word node_count = this->in.get_word();
+        const word field_count = this->in.get_word();
+        const word root_count = this->in.get_word();
+        const word hidden_count = this->in.get_word();
+        const word route_count = this->in.get_word();
+
+        for (word i = 0; i < string_count; ++i) {
+            const word n = this->in.get_word();
+            this->strings.push_back(std::string(this->in.get_bytes(n), n));
+        }
+
+        //
+        // Make every node first, so that fields can refer to any of them,
+        // then fill them in children first, as the parser would.
+        //
+        const scope_ptr scope(new Vrml97RootScope(this->browser, uri));
+        for (word i = 0; i < node_count; ++i) {
+            const std::string & type = this->string(this->in.get_word());
+            const word name = this->in.get_word();
+            node_ptr n;
+            if (type == "Script") {
+                n.reset(new script_node(this->script_class, scope));
+            } else {
+                const node_type_ptr & node_type = scope->find_type(type);
+                if (!node_type) { throw invalid_vrml(); }
+                n = node_type->create_node(scope);
+            }
+            if (name != compiled_none) { n->id(this->string(name)); }
+            this->nodes.push_back(n);
+        }
+
+        for (word i = 0; i < field_count; ++i) { this->fields(); }
+
+        std::vector<node_ptr> result;
+        for (word i = 0; i < root_count; ++i) {
+            const node_ptr & n = this->node(this->in.get_word());
+            if (n) { result.push_back(n); }
+        }
+
+        if (hidden_count > 0) {
+            const node_type_ptr & switch_type = scope->find_type("Switch");
+            if (!switch_type) { throw invalid_vrml(); }
+            const node_ptr hidden = switch_type->create_node(scope);
+            mfnode choice(hidden_count);
+            for (word i = 0; i < hidden_count; ++i) {
+                choice.value[i] = this->node(this->in.get_word());
+            }
+            hidden->field("choice", choice);
+            result.push_back(hidden);
+        }
+
+        for (word i = 0; i < route_count; ++i) {
+            const node_ptr & from = this->node(this->in.get_word());
+            const std::string & eventout = this->string(this->in.get_word());
+            const node_ptr & to = this->node(this->in.get_word());
+            const std::string & eventin = this->string(this->in.get_word());
+            if (!from || !to) { throw invalid_vrml(); }
+            from->add_route(eventout, to, eventin);
+        }
+
+        roots.swap(result);
+        return true;
+    }
+}
+
+/**
+ * @brief Write the compiled form of a scene.
+ *
+ * @param out           an output stream, opened in binary mode.
+ * @param nodes         the root nodes of the scene, as parsed.
+ * @param source_size   the size of the source file.
+ * @param source_mtime  the modification time of the source file.
+ *
+ * @exception invalid_vrml      if @p out cannot be written.
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void compiled_scene::write(std::ostream & out,
+                           const std::vector<node_ptr> & nodes,
+                           const double source_size,
+                           const double source_mtime)
+    throw (invalid_vrml, std::bad_alloc)
+{
+    compiled_scene_writer(nodes).write(out, source_size, source_mtime);
+}
+
+/**
+ * @brief Read the compiled form of a scene, if there is an up to date one.
+ *
+ * @param browser   the browser the nodes belong to.
+ * @param source    the path of the <code>.wrl</code> file.
+ * @param uri       the URI of the scene.
+ * @param nodes     the root nodes of the scene.
+ *
+ * @return @c true if the scene was read from its compiled form; @c false if
+ *         there is none, it is out of date, or it cannot be read, and the
+ *         source must be parsed.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+bool compiled_scene::read(openvrml::browser & browser,
+                          const std::string & source,
+                          const std::string & uri,
+                          std::vector<node_ptr> & nodes)
+    throw (std::bad_alloc)
+{
+    const std::string compiled = compiled_name(source);
+    struct stat st;
+    if (compiled.empty() || stat(source.c_str(), &st) != 0) { return false; }
+    const mapped_file file(compiled);
+    if (!file.data()) { return false; }
+    try {
+        return compiled_scene_reader(browser, browser.script_node_class_, file)
+            .read(double(st.st_size), double(st.st_mtime), uri, nodes);
+    } catch (std::bad_alloc &) {
+        throw;
+    } catch (std::exception & ex) {
+        browser.err << compiled << ": " << ex.what() << std::endl;
+    }
+    return false;
+}
+
+/**
+ * @brief Compile a VRML97 file.
+ *
+ * The file is parsed, and its node graph written to @p out as a compiled
+ * scene. scene reads the compiled scene instead of the file when it is
+ * found next to the file, named after it with a trailing @c b
+ * (<code>.wrlb</code>), and the file has not changed since.
+ *
+ * @param url   the URI of a local <code>.wrl</code> file.
+ * @param out   an output stream, opened in binary mode.
+ *
+ * @exception invalid_vrml       if there is a syntax error in the VRML input,
+ *                              or @p out cannot be written.
+ * @exception unreachable_url    if @p url is not a local file that can be
+ *                              read.
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void browser::compile_vrml(const std::string & url, std::ostream & out)
+{
+    const URI uri(url);
+    const std::string absoluteURI = uri.getScheme().empty()
+                                  ? std::string(createFileURL(uri))
+                                  : url;
+    if (URI(absoluteURI).getScheme() != "file") { throw unreachable_url(); }
+
+    doc2 doc(absoluteURI);
+    const char * const local = doc.local_name();
+    struct stat st;
+    if (!local || stat(local, &st) != 0) { throw unreachable_url(); }
+    std::istream & in = doc.input_stream();
+    if (!in) { throw unreachable_url(); }
+
+    std::vector<node_ptr> nodes;
+    try {
+        Vrml97Scanner scanner(in);
+        Vrml97Parser parser(scanner, absoluteURI);
+        parser.vrmlScene(*this, nodes);
+    } catch (antlr::RecognitionException &) {
+        throw invalid_vrml();
+    }
+    compiled_scene::write(out, nodes, double(st.st_size), double(st.st_mtime));
+}
+
 } // namespace openvrml
@@ -22,8 +22,19 @@
 # include <cstdlib>
 # include <cctype>
 # include <cstring>
+# include <deque>
 # include <fstream>
+# include <map>
+# include <new>
+# include <vector>
 # include <regex.h>
+# ifdef _WIN32
+#   include <windows.h>
+#   include <process.h>
+# else
+#   include <pthread.h>
+#   include <unistd.h>
+# endif
 
 # include "private.h"
 # include "doc.h"
@@ -61,8 +72,10 @@ namespace openvrml {
 /**
  * @var char * doc::tmpfile_
  *
- * @brief Name of the temporary file created for the local copy of the
- *        resource.
+ * @brief Name of the temporary file holding the local copy of the resource.
+ *
+ * The file belongs to resource_loader::local_copy, which shares it with every
+ * doc and doc2 of the same URL.
  */
 
 /**
@@ -114,10 +127,7 @@ doc::~doc()
 {
     delete [] this->url_;
     delete this->out_;
-    if (this->tmpfile_) {
-        the_system->remove_file(this->tmpfile_);
-        delete [] this->tmpfile_;
-    }
+    delete [] this->tmpfile_;
 }
 
 /**
@@ -153,6 +163,33 @@ namespace {
       const char *s = stripProtocol(url);
       return ( *s == '/' || *(s+1) == ':' );
     }
+
+    //
+    // The scheme of url, lower case, in protocol; "file" if it has none.
+    // doc::url_protocol returns it from a static buffer, so it is kept out of
+    // doc::filename, which the resource_loader threads call.
+    //
+    void urlProtocol(const char * url, char (&protocol)[12])
+    {
+      const char *s = url;
+
+#ifdef _WIN32
+      if (strncmp(s+1,":/",2) == 0) { strcpy(protocol, "file"); return; }
+#endif
+
+      for (unsigned int i=0; i<sizeof(protocol); ++i, ++s)
+	{
+	  if (*s == 0 || ! isalpha(*s))
+	    {
+	      protocol[i] = '\0';
+	      break;
+	    }
+	  protocol[i] = tolower(*s);
+	}
+      protocol[sizeof(protocol)-1] = '\0';
+      if (*s != ':')
+        strcpy(protocol, "file");
+    }
 }
 
 /**
@@ -316,24 +353,8 @@ const char * doc::url_protocol() const
   if (url_)
     {
       static char protocol[12];
-      const char *s = url_;
-
-#ifdef _WIN32
-      if (strncmp(s+1,":/",2) == 0) return "file";
-#endif
-
-      for (unsigned int i=0; i<sizeof(protocol); ++i, ++s)
-	{
-	  if (*s == 0 || ! isalpha(*s))
-	    {
-	      protocol[i] = '\0';
-	      break;
-	    }
-	  protocol[i] = tolower(*s);
-	}
-      protocol[sizeof(protocol)-1] = '\0';
-      if (*s == ':')
-	return protocol;
+      urlProtocol(url_, protocol);
+      return protocol;
     }
 
   return "file";
@@ -400,20 +421,23 @@ bool doc::filename(char * fn, int nfn)
   if ((e = strrchr(s,'#')) != 0)
     *e = '\0';
 
-  const char *protocol = url_protocol();
+  char protocol[12] = "file";
+  if (url_) urlProtocol(url_, protocol);
 
   // Get a local copy of http files
   if (strcmp(protocol, "http") == 0)
     {
+      std::string name;
       if (tmpfile_)		// Already fetched it
 	s = tmpfile_;
-      else if ((s = const_cast<char *>(the_system->http_fetch(url_))))
+      else if (resource_loader::local_copy(url_, name))
 	{
-	  tmpfile_ = new char[strlen(s)+1];
-	  strcpy(tmpfile_, s);
-	  free(s);		// assumes tempnam or equiv...
+	  tmpfile_ = new char[name.length()+1];
+	  strcpy(tmpfile_, name.c_str());
 	  s = tmpfile_;
 	}
+      else
+	s = 0;
     }
 
   // Unrecognized protocol (need ftp here...)
@@ -696,6 +720,67 @@ namespace {
 }
 # endif // OPENVRML_ENABLE_GZIP
 
+namespace {
+
+    //
+    // The whole of a stream, read in large blocks and then served from
+    // memory: the get area is never refilled, so the scanner's sbumpc()
+    // stays inline for every character instead of calling into the file
+    // (and zlib) buffer.
+    //
+    class memory_streambuf : public std::streambuf {
+        std::vector<char> data;
+
+    public:
+        explicit memory_streambuf(std::istream & source);
+    };
+
+    class memory_istream : public std::istream {
+        memory_streambuf buf;
+
+    public:
+        explicit memory_istream(std::istream & source);
+    };
+
+    //
+    // memory_streambuf
+    //
+
+    memory_streambuf::memory_streambuf(std::istream & source) {
+        enum { block_size = 65536 };
+        if (!source) { return; }
+        std::streambuf * const in = source.rdbuf();
+        std::streamsize num;
+        do {
+            const size_t size = this->data.size();
+            this->data.resize(size + block_size);
+            num = in->sgetn(&this->data[size], block_size);
+            this->data.resize(size + (num > 0 ? size_t(num) : 0));
+        } while (num == block_size);
+
+        if (!this->data.empty()) {
+            char * const begin = &this->data[0];
+            this->setg(begin, begin, begin + this->data.size());
+        }
+    }
+
+    //
+    // memory_istream
+    //
+
+    memory_istream::memory_istream(std::istream & source):
+            std::basic_istream<char>(&buf),
+            buf(source) {
+        if (!source) {
+#   ifdef _WIN32
+            this->clear(failbit);
+#   else
+            this->setstate(failbit);
+#   endif
+        }
+    }
+}
+
 namespace openvrml {
 
 namespace {
@@ -747,8 +832,10 @@ namespace {
 /**
  * @var char * doc2::tmpfile_
  *
- * @brief Name of the temporary file created for the local copy of the
- *        resource.
+ * @brief Name of the temporary file holding the local copy of the resource.
+ *
+ * The file belongs to resource_loader::local_copy, which shares it with every
+ * doc and doc2 of the same URL.
  */
 
 /**
@@ -794,10 +881,7 @@ doc2::~doc2()
 {
     delete istm_;
     delete ostm_;
-    if (tmpfile_) {
-        the_system->remove_file(tmpfile_);
-        delete [] tmpfile_;
-    }
+    delete [] tmpfile_;
 }
 
 /**
@@ -1003,10 +1087,11 @@ std::istream & doc2::input_stream() {
             this->istm_ = &std::cin;
         } else {
 # ifdef OPENVRML_ENABLE_GZIP
-            this->istm_ = new z::ifstream(fn);
+            z::ifstream file(fn);
 # else
-            this->istm_ = new std::ifstream(fn);
+            std::ifstream file(fn, std::ios::in | std::ios::binary);
 # endif
+            this->istm_ = new memory_istream(file);
         }
     }
 
@@ -1057,12 +1142,12 @@ bool doc2::filename(char * fn, const size_t nfn) {
         //
         // Get a local copy of http files.
         //
+        std::string name;
         if (this->tmpfile_) {    // Already fetched it
             s = this->tmpfile_;
-        } else if ((s = the_system->http_fetch(this->url_.c_str()))) {
-            tmpfile_ = new char[strlen(s)+1];
-            strcpy(tmpfile_, s);
-            free(const_cast<char *>(s));        // assumes tempnam or equiv...
+        } else if (resource_loader::local_copy(this->url_, name)) {
+            tmpfile_ = new char[name.length() + 1];
+            strcpy(tmpfile_, name.c_str());
             s = tmpfile_;
         }
     }
@@ -1079,6 +1164,436 @@ bool doc2::filename(char * fn, const size_t nfn) {
     return s && *s;
 }
 
+/**
+ * @class resource_loader
+ *
+ * @brief Fetches the resources a scene refers to ahead of their use.
+ *
+ * Nodes that read a URL when they are first rendered hand it to prefetch as
+ * they are initialized, while the rest of the scene is still being set up.
+ * A few threads, started as jobs come and ended when there are none left,
+ * then make the local copy of each remote resource and run the handler of
+ * the job, which for an image decodes it into the cache of img. The copies
+ * are shared by every doc and doc2 of the same URL for the life of the
+ * process; when the renderer needs one not yet made, local_copy blocks until
+ * it is.
+ */
+
+/**
+ * @class resource_loader::mutex
+ *
+ * @brief A lock around the state resource_loader shares among its threads.
+ */
+
+/**
+ * @class resource_loader::scoped_lock
+ *
+ * @brief Holds a resource_loader::mutex for the life of the object.
+ */
+
+/**
+ * @class resource_loader::thread
+ *
+ * @brief A thread of its own, for work that outlasts a frame; it is joined
+ *        as the object is destroyed.
+ */
+
+/**
+ * @typedef resource_loader::thread::function
+ *
+ * @brief The work of a resource_loader::thread.
+ */
+
+/**
+ * @typedef resource_loader::handler
+ *
+ * @brief The work a job does with a URL, once it has a local copy; it returns
+ *        @c true if the resource is usable, so the later URLs of the job are
+ *        not tried.
+ */
+
+namespace {
+
+    const size_t fetch_threads_max = 4;
+
+    struct fetch_job {
+        std::vector<std::string> urls;
+        resource_loader::handler fetched;
+    };
+
+    struct local_copy_entry {
+        bool pending;
+        std::string name;
+    };
+
+    typedef std::map<std::string, local_copy_entry> local_copies_t;
+
+    //
+    // The local copies outlive the docs that use them; they are removed as
+    // the process ends.
+    //
+    struct local_copies_remover {
+        local_copies_t copies;
+
+        ~local_copies_remover() throw ()
+        {
+            for (local_copies_t::const_iterator copy = copies.begin();
+                 copy != copies.end(); ++copy) {
+                if (!copy->second.pending && !copy->second.name.empty()) {
+                    the_system->remove_file(copy->second.name.c_str());
+                }
+            }
+        }
+    };
+
+    //
+    // The locks are never destroyed, so a thread still ending as the
+    // process exits does not find them gone.
+    //
+    resource_loader::mutex & fetch_lock = *new resource_loader::mutex;
+    std::deque<fetch_job> fetch_queue;
+    size_t fetch_threads = 0;
+    local_copies_remover local_copies;
+
+    //
+    // system::http_host returns its host name in a static buffer; so,
+    // downloads are made one at a time.
+    //
+    resource_loader::mutex & http_lock = *new resource_loader::mutex;
+
+    bool is_http(const std::string & url)
+    {
+        char protocol[12];
+        urlProtocol(url.c_str(), protocol);
+        return strcmp(protocol, "http") == 0;
+    }
+
+    void run_fetch_jobs()
+    {
+        for (;;) {
+            fetch_job job;
+            {
+                resource_loader::scoped_lock lock(fetch_lock);
+                if (fetch_queue.empty()) {
+                    --fetch_threads;
+                    return;
+                }
+                job = fetch_queue.front();
+                fetch_queue.pop_front();
+            }
+            try {
+                for (size_t i = 0; i < job.urls.size(); ++i) {
+                    std::string name;
+                    if (job.fetched) {
+                        if (job.fetched(job.urls[i])) { break; }
+                    } else if (resource_loader::local_copy(job.urls[i],
+                                                           name)) {
+                        break;
+                    }
+                }
+            } catch (std::exception & ex) {
+                OPENVRML_PRINT_EXCEPTION_(ex);
+            }
+        }
+    }
+
+# ifdef _WIN32
+    unsigned __stdcall fetch_thread(void *)
+    {
+        run_fetch_jobs();
+        return 0;
+    }
+# else
+    void * fetch_thread(void *)
+    {
+        run_fetch_jobs();
+        return 0;
+    }
+# endif
+
+    //
+    // Called with fetch_lock held.
+    //
+    bool start_fetch_thread()
+    {
+# ifdef _WIN32
+        const HANDLE tid = HANDLE(_beginthreadex(0, 0, fetch_thread, 0, 0, 0));
+        if (tid == 0) { return false; }
+        CloseHandle(tid);
+# else
+        pthread_t tid;
+        if (pthread_create(&tid, 0, fetch_thread, 0) != 0) { return false; }
+        pthread_detach(tid);
+# endif
+        return true;
+    }
+}
+
+/**
+ * @brief Construct.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+resource_loader::mutex::mutex() throw (std::bad_alloc)
+{
+# ifdef _WIN32
+    CRITICAL_SECTION * const section = new CRITICAL_SECTION;
+    InitializeCriticalSection(section);
+    this->impl_ = section;
+# else
+    pthread_mutex_t * const m = new pthread_mutex_t;
+    pthread_mutex_init(m, 0);
+    this->impl_ = m;
+# endif
+}
+
+/**
+ * @brief Destroy.
+ */
+resource_loader::mutex::~mutex() throw ()
+{
+# ifdef _WIN32
+    CRITICAL_SECTION * const section =
+        static_cast<CRITICAL_SECTION *>(this->impl_);
+    DeleteCriticalSection(section);
+    delete section;
+# else
+    pthread_mutex_t * const m = static_cast<pthread_mutex_t *>(this->impl_);
+    pthread_mutex_destroy(m);
+    delete m;
+# endif
+}
+
+/**
+ * @brief Lock.
+ */
+void resource_loader::mutex::lock() throw ()
+{
+# ifdef _WIN32
+    EnterCriticalSection(static_cast<CRITICAL_SECTION *>(this->impl_));
+# else
+    pthread_mutex_lock(static_cast<pthread_mutex_t *>(this->impl_));
+# endif
+}
+
+/**
+ * @brief Unlock.
+ */
+void resource_loader::mutex::unlock() throw ()
+{
+# ifdef _WIN32
+    LeaveCriticalSection(static_cast<CRITICAL_SECTION *>(this->impl_));
+# else
+    pthread_mutex_unlock(static_cast<pthread_mutex_t *>(this->impl_));
+# endif
+}
+
+namespace {
+
+    struct thread_start {
+        resource_loader::thread::function run;
+        void * arg;
+    };
+
+# ifdef _WIN32
+    unsigned __stdcall thread_main(void * start)
+# else
+    void * thread_main(void * start)
+# endif
+    {
+        const thread_start s = *static_cast<thread_start *>(start);
+        delete static_cast<thread_start *>(start);
+        s.run(s.arg);
+        return 0;
+    }
+}
+
+/**
+ * @brief Start a thread.
+ *
+ * @param run   the work of the thread.
+ * @param arg   the argument of @p run.
+ *
+ * @see started
+ */
+resource_loader::thread::thread(const function run, void * const arg)
+    throw ():
+    impl_(0)
+{
+    thread_start * const start = new (std::nothrow) thread_start;
+    if (!start) { return; }
+    start->run = run;
+    start->arg = arg;
+# ifdef _WIN32
+    const HANDLE tid = HANDLE(_beginthreadex(0, 0, thread_main, start, 0, 0));
+    if (tid == 0) {
+        delete start;
+        return;
+    }
+    this->impl_ = tid;
+# else
+    pthread_t * const tid = new (std::nothrow) pthread_t;
+    if (!tid || pthread_create(tid, 0, thread_main, start) != 0) {
+        delete tid;
+        delete start;
+        return;
+    }
+    this->impl_ = tid;
+# endif
+}
+
+/**
+ * @brief Wait for the thread to end.
+ */
+resource_loader::thread::~thread() throw ()
+{
+    if (!this->impl_) { return; }
+# ifdef _WIN32
+    WaitForSingleObject(HANDLE(this->impl_), INFINITE);
+    CloseHandle(HANDLE(this->impl_));
+# else
+    pthread_t * const tid = static_cast<pthread_t *>(this->impl_);
+    pthread_join(*tid, 0);
+    delete tid;
+# endif
+}
+
+/**
+ * @brief Whether the thread could be started.
+ *
+ * @return @c true if the thread was started; @c false otherwise.
+ */
+bool resource_loader::thread::started() const throw ()
+{
+    return this->impl_ != 0;
+}
+
+/**
+ * @brief Start fetching a resource.
+ *
+ * The URLs are tried in order, as img::try_urls would, until one is fetched
+ * and, if there is a handler, the handler accepts it. A job without a handler
+ * only makes the local copy of a remote resource; so, one whose URLs are all
+ * local files is dropped.
+ *
+ * A prefetch is only a hint: if it cannot be queued, the resource is fetched
+ * when it is used, as it was before.
+ *
+ * @param urls      the alternative URLs of the resource.
+ * @param relative  the doc2 that @p urls are relative to, or 0 if they are
+ *                  absolute.
+ * @param fetched   the work to do with the local copy, or 0.
+ */
+void resource_loader::prefetch(const std::vector<std::string> & urls,
+                               const doc2 * const relative,
+                               const handler fetched)
+    throw ()
+{
+    try {
+        fetch_job job;
+        job.fetched = fetched;
+        bool remote = false;
+        for (size_t i = 0; i < urls.size(); ++i) {
+            if (urls[i].empty()) { continue; }
+            const doc resolved(urls[i], relative);
+            job.urls.push_back(resolved.url());
+            remote = remote || is_http(job.urls.back());
+        }
+        if (job.urls.empty() || (!fetched && !remote)) { return; }
+
+        scoped_lock lock(fetch_lock);
+        fetch_queue.push_back(job);
+        if (fetch_threads < fetch_threads_max
+                && fetch_threads < fetch_queue.size()) {
+            if (start_fetch_thread()) {
+                ++fetch_threads;
+            } else if (fetch_threads == 0) {
+                fetch_queue.clear();
+            }
+        }
+    } catch (std::exception & ex) {
+        OPENVRML_PRINT_EXCEPTION_(ex);
+    }
+}
+
+/**
+ * @brief The local copy of a remote resource.
+ *
+ * The first call for a URL downloads it; the others share the copy, waiting
+ * for it if the download is under way. A download that fails is not kept,
+ * so the next call tries again.
+ *
+ * @param url   an absolute http URL, without its fragment identifier.
+ * @retval name the name of the local file.
+ *
+ * @return @c true if there is a local copy; @c false otherwise.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+bool resource_loader::local_copy(const std::string & url, std::string & name)
+    throw (std::bad_alloc)
+{
+    fetch_lock.lock();
+    for (;;) {
+        const local_copies_t::const_iterator copy =
+            local_copies.copies.find(url);
+        if (copy == local_copies.copies.end()) { break; }
+        if (!copy->second.pending) {
+            name = copy->second.name;
+            fetch_lock.unlock();
+            return true;
+        }
+        fetch_lock.unlock();
+        nap();
+        fetch_lock.lock();
+    }
+    try {
+        local_copies.copies[url].pending = true;
+    } catch (std::bad_alloc &) {
+        fetch_lock.unlock();
+        throw;
+    }
+    fetch_lock.unlock();
+
+    const char * s;
+    {
+        scoped_lock lock(http_lock);
+        s = the_system->http_fetch(url.c_str());
+    }
+
+    scoped_lock lock(fetch_lock);
+    const local_copies_t::iterator copy = local_copies.copies.find(url);
+    assert(copy != local_copies.copies.end());
+    try {
+        if (s) { copy->second.name = s; } // Throws std::bad_alloc.
+    } catch (std::bad_alloc &) {
+        the_system->remove_file(s);
+        free(const_cast<char *>(s));
+        local_copies.copies.erase(copy);
+        throw;
+    }
+    if (!s) {
+        local_copies.copies.erase(copy);
+        return false;
+    }
+    free(const_cast<char *>(s)); // http_fetch mallocs the name.
+    copy->second.pending = false;
+    name = copy->second.name;
+    return true;
+}
+
+/**
+ * @brief Sleep a little, while waiting on another thread.
+ */
+void resource_loader::nap() throw ()
+{
+# ifdef _WIN32
+    Sleep(10);
+# else
+    usleep(10000);
+# endif
+}
+
 namespace {
 
     const char * const expression =
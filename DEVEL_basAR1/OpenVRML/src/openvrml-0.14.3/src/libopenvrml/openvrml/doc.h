@@ -24,7 +24,9 @@
 
 #   include <cstdio>
 #   include <iosfwd>
+#   include <new>
 #   include <string>
+#   include <vector>
 #   include <openvrml/common.h>
 
 namespace openvrml {
@@ -103,6 +105,76 @@ namespace openvrml {
 
         bool filename(char * fn, size_t nfn);
     };
+
+    class resource_loader {
+    public:
+        class mutex {
+            void * impl_;
+
+        public:
+            mutex() throw (std::bad_alloc);
+            ~mutex() throw ();
+
+            void lock() throw ();
+            void unlock() throw ();
+
+        private:
+            // Non-copyable.
+            mutex(const mutex &);
+            mutex & operator=(const mutex &);
+        };
+
+        class scoped_lock {
+            mutex & mutex_;
+
+        public:
+            explicit scoped_lock(mutex & m) throw ();
+            ~scoped_lock() throw ();
+
+        private:
+            // Non-copyable.
+            scoped_lock(const scoped_lock &);
+            scoped_lock & operator=(const scoped_lock &);
+        };
+
+        class thread {
+            void * impl_;
+
+        public:
+            typedef void (*function)(void * arg);
+
+            thread(function run, void * arg) throw ();
+            ~thread() throw ();
+
+            bool started() const throw ();
+
+        private:
+            // Non-copyable.
+            thread(const thread &);
+            thread & operator=(const thread &);
+        };
+
+        typedef bool (*handler)(const std::string & url);
+
+        static void prefetch(const std::vector<std::string> & urls,
+                             const doc2 * relative = 0,
+                             handler fetched = 0)
+            throw ();
+        static bool local_copy(const std::string & url, std::string & name)
+            throw (std::bad_alloc);
+        static void nap() throw ();
+    };
+
+    inline resource_loader::scoped_lock::scoped_lock(mutex & m) throw ():
+        mutex_(m)
+    {
+        this->mutex_.lock();
+    }
+
+    inline resource_loader::scoped_lock::~scoped_lock() throw ()
+    {
+        this->mutex_.unlock();
+    }
 }
 
 # endif
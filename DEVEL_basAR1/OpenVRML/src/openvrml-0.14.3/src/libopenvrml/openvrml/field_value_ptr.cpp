@@ -21,6 +21,7 @@
 
 # include "field_value_ptr.h"
 # include "field.h"
+# include "private.h"
 
 namespace openvrml {
 
@@ -62,6 +63,9 @@ namespace openvrml {
  * @var size_t * field_value_ptr::count
  *
  * @brief A pointer to the reference count.
+ *
+ * The count is atomic: the default values of a PROTO are shared by its
+ * instances in the scenes that scene::load_inlines parses at once.
  */
 
 /**
@@ -108,7 +112,7 @@ field_value_ptr::field_value_ptr(std::auto_ptr<field_value> & value)
 field_value_ptr::field_value_ptr(const field_value_ptr & ptr) throw ():
     value(ptr.value)
 {
-    ++*(this->count = ptr.count); // never throws
+    openvrml_::atomic_increment(*(this->count = ptr.count));
 }
 
 /**
@@ -137,7 +141,7 @@ field_value_ptr & field_value_ptr::operator=(const field_value_ptr & ptr)
     throw ()
 {
     if (this->count != ptr.count) {
-        ++*ptr.count;
+        openvrml_::atomic_increment(*ptr.count);
         this->dispose();
         this->value = ptr.value;
         this->count = ptr.count;
@@ -181,13 +185,13 @@ field_value_ptr & field_value_ptr::operator=(const field_value_ptr & ptr)
 void field_value_ptr::reset(field_value * const value) throw (std::bad_alloc)
 {
     if (this->value == value) { return; }
-    if (--*this->count == 0) {
+    if (openvrml_::atomic_decrement(*this->count) == 0) {
         delete this->value;
     } else {
         try {
             this->count = new size_t;
         } catch (std::bad_alloc &) {
-            ++*this->count;
+            openvrml_::atomic_increment(*this->count);
             delete value;
             throw;
         }
@@ -202,7 +206,7 @@ void field_value_ptr::reset(field_value * const value) throw (std::bad_alloc)
  */
 void field_value_ptr::dispose() throw ()
 {
-    if (--*this->count == 0) {
+    if (openvrml_::atomic_decrement(*this->count) == 0) {
         delete this->value;
         delete this->count;
     }
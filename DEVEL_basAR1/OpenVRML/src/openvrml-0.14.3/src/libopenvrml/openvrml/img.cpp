@@ -32,6 +32,10 @@
 # include <cstdlib>		// free()
 # include <cstring>
 # include <algorithm>
+# include <map>
+# include <set>
+# include <sys/types.h>
+# include <sys/stat.h>
 
 # include "private.h"
 # include "img.h"
@@ -6834,6 +6838,107 @@ typedef enum {
 
 static ImageFileType imageFileType(const char *, FILE *);
 
+namespace {
+
+    //
+    // Decoded still images, by resolved URI, shared by every img (and so
+    // by every browser) in the process. An entry is only used while the
+    // file keeps the modification time and size it was decoded from.
+    // The resource_loader threads decode into it too; decode_lock guards
+    // it, and decode_pending holds the URIs being decoded, so that a
+    // second reader waits for the first instead of decoding again.
+    //
+    struct decoded_image {
+        time_t mtime;
+        off_t size;
+        size_t w, h, nc;
+        std::vector<unsigned char> pixels;
+        unsigned long used;
+    };
+
+    typedef std::map<std::string, decoded_image> decode_cache_t;
+
+    const size_t decode_cache_limit = 32 * 1024 * 1024;
+
+    decode_cache_t decode_cache;
+    size_t decode_cache_bytes = 0;
+    unsigned long decode_cache_clock = 0;
+    std::set<std::string> decode_pending;
+    openvrml::resource_loader::mutex & decode_lock =
+        *new openvrml::resource_loader::mutex;
+
+    //
+    // The GIF and MPEG readers keep their state in statics; one image at a
+    // time goes through them.
+    //
+    openvrml::resource_loader::mutex & static_reader_lock =
+        *new openvrml::resource_loader::mutex;
+
+    bool decode_ahead(const std::string & url)
+    {
+        openvrml::img image;
+        return image.set_url(url.c_str());
+    }
+
+    unsigned char * decode_cache_get(const std::string & url,
+                                     const struct stat & st,
+                                     size_t * w, size_t * h, size_t * nc)
+    {
+        const decode_cache_t::iterator entry = decode_cache.find(url);
+        if (entry == decode_cache.end()) { return 0; }
+        decoded_image & image = entry->second;
+        if (image.mtime != st.st_mtime || image.size != st.st_size) {
+            decode_cache_bytes -= image.pixels.size();
+            decode_cache.erase(entry);
+            return 0;
+        }
+        unsigned char * const pixels =
+            static_cast<unsigned char *>(malloc(image.pixels.size()));
+        if (!pixels) { return 0; }
+        std::copy(image.pixels.begin(), image.pixels.end(), pixels);
+        *w = image.w;
+        *h = image.h;
+        *nc = image.nc;
+        image.used = ++decode_cache_clock;
+        return pixels;
+    }
+
+    void decode_cache_put(const std::string & url, const struct stat & st,
+                          size_t w, size_t h, size_t nc,
+                          const unsigned char * pixels)
+    {
+        const size_t bytes = w * h * nc;
+        if (bytes == 0 || bytes > decode_cache_limit) { return; }
+
+        //
+        // Drop the least recently used images until this one fits.
+        //
+        while (decode_cache_bytes + bytes > decode_cache_limit
+               && !decode_cache.empty()) {
+            decode_cache_t::iterator oldest = decode_cache.begin();
+            for (decode_cache_t::iterator entry = decode_cache.begin();
+                 entry != decode_cache.end(); ++entry) {
+                if (entry->second.used < oldest->second.used) {
+                    oldest = entry;
+                }
+            }
+            decode_cache_bytes -= oldest->second.pixels.size();
+            decode_cache.erase(oldest);
+        }
+
+        decoded_image & image = decode_cache[url];
+        decode_cache_bytes -= image.pixels.size();
+        image.mtime = st.st_mtime;
+        image.size = st.st_size;
+        image.w = w;
+        image.h = h;
+        image.nc = nc;
+        image.pixels.assign(pixels, pixels + bytes);
+        image.used = ++decode_cache_clock;
+        decode_cache_bytes += bytes;
+    }
+}
+
 namespace openvrml {
 
 /**
@@ -6946,10 +7051,46 @@ bool img::set_url(const char * const url, const doc2 * const relative)
     FILE * const fp = this->url_->fopen("rb");
 
     if (fp) {
+        //
+        // Still images that were decoded before are copied from the
+        // cache; GIF animations and movies are always read.
+        //
+        const std::string key(this->url_->url());
+        struct stat st;
+        const bool cacheable = (fstat(fileno(fp), &st) == 0
+                                && (st.st_mode & S_IFMT) == S_IFREG);
+        if (cacheable) {
+            decode_lock.lock();
+            while (decode_pending.find(key) != decode_pending.end()) {
+                decode_lock.unlock();
+                resource_loader::nap();
+                decode_lock.lock();
+            }
+            this->pixels_ = decode_cache_get(key, st,
+                                             &this->w_, &this->h_,
+                                             &this->nc_);
+            if (!this->pixels_) {
+                try {
+                    decode_pending.insert(key);
+                } catch (std::bad_alloc &) {
+                    decode_lock.unlock();
+                    throw;
+                }
+            }
+            decode_lock.unlock();
+            if (this->pixels_) {
+                this->url_->fclose();
+                return true;
+            }
+        }
+
         switch (imageFileType(url, fp)) {
         case ImageFile_GIF:
-            this->pixels_ = gifread(fp, &this->w_, &this->h_, &this->nc_,
-                                     &this->nframes_, &this->frame_);
+            {
+                resource_loader::scoped_lock lock(static_reader_lock);
+                this->pixels_ = gifread(fp, &this->w_, &this->h_, &this->nc_,
+                                        &this->nframes_, &this->frame_);
+            }
             break;
 # if OPENVRML_ENABLE_IMAGETEXTURE_NODE
         case ImageFile_JPG:
@@ -6957,8 +7098,11 @@ bool img::set_url(const char * const url, const doc2 * const relative)
             break;
 # endif
         case ImageFile_MPG:
-            this->pixels_ = mpgread(fp, &this->w_, &this->h_, &this->nc_,
-                                    &this->nframes_, &this->frame_);
+            {
+                resource_loader::scoped_lock lock(static_reader_lock);
+                this->pixels_ = mpgread(fp, &this->w_, &this->h_, &this->nc_,
+                                        &this->nframes_, &this->frame_);
+            }
             break;
 # if OPENVRML_ENABLE_IMAGETEXTURE_NODE
         case ImageFile_PNG:
@@ -6975,6 +7119,18 @@ bool img::set_url(const char * const url, const doc2 * const relative)
             OPENVRML_PRINT_MESSAGE_("Unable to read image file ("
                                     + std::string(url) + ").");
         }
+        if (cacheable) {
+            resource_loader::scoped_lock lock(decode_lock);
+            decode_pending.erase(key);
+            if (this->pixels_ && !this->frame_) {
+                try {
+                    decode_cache_put(key, st, this->w_, this->h_, this->nc_,
+                                     this->pixels_);
+                } catch (std::bad_alloc &) {
+                    // Not cached; the image itself is fine.
+                }
+            }
+        }
 
         this->url_->fclose();
     }
@@ -7005,6 +7161,23 @@ bool img::try_urls(const std::vector<std::string> & urls,
     return (i < urls.size());
 }
 
+/**
+ * @brief Start decoding an image ahead of its use.
+ *
+ * The image is decoded by a resource_loader thread into the cache that
+ * img::set_url reads, which waits for it if it is still being decoded.
+ *
+ * @param urls      URIs, tried in order as by img::try_urls.
+ * @param relative  URI to which the URIs in @p urls are relative; or 0 if
+ *                  all the URIs in @p urls are absolute.
+ */
+void img::prefetch(const std::vector<std::string> & urls,
+                   const doc2 * const relative)
+    throw ()
+{
+    resource_loader::prefetch(urls, relative, decode_ahead);
+}
+
 /**
  * @brief The URI of the currently loaded image.
  *
@@ -745,19 +745,19 @@ field_value_type_mismatch::~field_value_type_mismatch() throw ()
  */
 
 /**
- * @var const std::string node::route::from_eventout
+ * @var std::string node::route::from_eventout
  *
  * @brief The name of the eventOut the route is coming from.
  */
 
 /**
- * @var const node_ptr node::route::to_node
+ * @var node_ptr node::route::to_node
  *
  * @brief The node the route is going to.
  */
 
 /**
- * @var const std::string node::route::to_eventin
+ * @var std::string node::route::to_eventin
  *
  * @brief The name of the eventIn on @a to_node that the route is going to.
  */
@@ -819,7 +819,8 @@ node::route::route(const route & route):
 /**
  * @typedef node::routes_t
  *
- * @brief list of @link node::route routes@endlink.
+ * @brief Array of @link node::route routes@endlink, walked for each event
+ *      the node emits.
  */
 
 /**
@@ -897,6 +898,14 @@ node::polled_eventout_value::polled_eventout_value(
  * @see node::bounding_volume_dirty
  */
 
+/**
+ * @internal
+ *
+ * @var size_t node::ref_count_
+ *
+ * @brief The number of @link node_ptr node_ptrs@endlink to the node.
+ */
+
 /**
  * @internal
  *
@@ -942,6 +951,7 @@ node::polled_eventout_value::polled_eventout_value(
  * @param scope the Scope associated with the instance.
  */
 node::node(const node_type & type, const scope_ptr & scope) throw ():
+    ref_count_(0),
     scope_(scope),
     scene_(0),
     modified_(false),
@@ -2062,14 +2072,22 @@ void node::emit_event(const std::string & id,
         pos->second->modified = true;
     }
 
-    for (routes_t::const_iterator itr = this->routes_.begin();
-            itr != this->routes_.end(); ++itr) {
+    //
+    // One copy of the value is queued for all the routes of the eventOut,
+    // owned by the event of the last one.
+    //
+    routes_t::const_iterator last = this->routes_.end();
+    routes_t::const_iterator itr;
+    for (itr = this->routes_.begin(); itr != this->routes_.end(); ++itr) {
+        if (id == itr->from_eventout) { last = itr; }
+    }
+    if (last == this->routes_.end()) { return; }
+
+    field_value * const copy = this->scene()->browser.event_value(value);
+    for (itr = this->routes_.begin(); itr != last + 1; ++itr) {
         if (id == itr->from_eventout) {
-            field_value * const event_value = value.clone().release();
-            this->scene()->browser.queue_event(timestamp,
-                                               event_value,
-                                               itr->to_node,
-                                               itr->to_eventin);
+            this->scene()->browser.queue_event(timestamp, copy, itr->to_node,
+                                               itr->to_eventin, itr == last);
         }
     }
 }
@@ -22,6 +22,7 @@
 # include <cassert>
 # include "node_ptr.h"
 # include "browser.h"
+# include "node.h"
 
 namespace openvrml {
 
@@ -51,17 +52,15 @@ namespace openvrml {
  *         otherwise.
  */
 
-namespace {
-    typedef std::map<openvrml::node *, size_t> count_map_t;
-    count_map_t count_map;
-}
-
 /**
  * @internal
  *
- * @var std::map<node *, size_t>::value_type * node_ptr::count_ptr
+ * @var node * node_ptr::node_
+ *
+ * @brief The node, which holds the reference count in node::ref_count_.
  *
- * @brief Pointer to an entry in count_map.
+ * The count is not atomic: the nodes of a browser are only used on the
+ * thread that runs it.
  */
 
 /**
@@ -72,20 +71,9 @@ namespace {
  * @exception std::bad_alloc    if memory allocation fails.
  */
 node_ptr::node_ptr(node * const node) throw (std::bad_alloc):
-    count_ptr(0)
+    node_(node)
 {
-    if (node) {
-        count_map_t::iterator pos = count_map.find(node);
-        if (pos == count_map.end()) {
-            const std::pair<count_map_t::iterator, bool>
-                    result(count_map.insert(count_map_t::value_type(node, 0)));
-            assert(result.second);
-            assert(result.first->first == node);
-            pos = result.first;
-        }
-        ++pos->second;
-        this->count_ptr = &*pos;
-    }
+    if (this->node_) { ++this->node_->ref_count_; }
 }
 
 /**
@@ -94,11 +82,9 @@ node_ptr::node_ptr(node * const node) throw (std::bad_alloc):
  * @param ptr
  */
 node_ptr::node_ptr(const node_ptr & ptr) throw ():
-    count_ptr(ptr.count_ptr)
+    node_(ptr.node_)
 {
-    if (this->count_ptr) {
-        ++this->count_ptr->second;
-    }
+    if (this->node_) { ++this->node_->ref_count_; }
 }
 
 /**
@@ -158,18 +144,11 @@ node_ptr::node_ptr(const node_ptr & ptr) throw ():
  */
 void node_ptr::reset(node * const node) throw (std::bad_alloc)
 {
-    if (this->count_ptr && this->count_ptr->first == node) {
-        return;
-    }
+    if (this->node_ == node) { return; }
     this->dispose();
     if (node) {
-        std::pair<count_map_t::iterator, bool>
-                result(count_map.insert(count_map_t::value_type(node, 1)));
-        assert(result.first->first == node);
-        this->count_ptr = &*result.first;
-        if (!result.second) { // The node already exists in the table.
-            ++this->count_ptr->second;
-        }
+        ++node->ref_count_;
+        this->node_ = node;
     }
 }
 
@@ -177,32 +156,30 @@ void node_ptr::reset(node * const node) throw (std::bad_alloc)
  * @brief Relinquish ownership of the node.
  *
  * Decrement the reference count; if it drops to zero, call node::shutdown
- * on the node, delete the node, and remove its entry from the count map.
+ * on the node and delete the node.
  */
 void node_ptr::dispose() throw ()
 {
-    if (this->count_ptr) {
-        --this->count_ptr->second;
-        if (this->count_ptr->second == 0) {
-            this->count_ptr->first->shutdown(browser::current_time());
-            delete this->count_ptr->first;
-            count_map.erase(this->count_ptr->first);
+    if (this->node_) {
+        if (--this->node_->ref_count_ == 0) {
+            this->node_->shutdown(browser::current_time());
+            delete this->node_;
         }
-        this->count_ptr = 0;
+        this->node_ = 0;
     }
 }
 
 /**
  * @brief Share ownership of a node.
  *
- * @param count_ptr a pointer to an entry in the count map to share.
+ * @param node    the node to share, or 0.
  */
-void node_ptr::share(std::map<node *, size_t>::value_type * count_ptr) throw ()
+void node_ptr::share(node * const node) throw ()
 {
-    if (this->count_ptr != count_ptr) {
-        if (count_ptr) { ++count_ptr->second; }
+    if (this->node_ != node) {
+        if (node) { ++node->ref_count_; }
         this->dispose();
-        this->count_ptr = count_ptr;
+        this->node_ = node;
     }
 }
 
@@ -21,6 +21,7 @@
 
 # include "node_type_ptr.h"
 # include "node.h"
+# include "private.h"
 
 namespace openvrml {
 
@@ -60,6 +61,9 @@ namespace openvrml {
  * @var size_t * node_type_ptr::count
  *
  * @brief Reference count.
+ *
+ * The count is atomic: the standard node types of a browser are shared by the
+ * scenes that scene::load_inlines parses at once.
  */
 
 /**
@@ -88,7 +92,7 @@ node_type_ptr::node_type_ptr(node_type * const type) throw (std::bad_alloc):
 node_type_ptr::node_type_ptr(const node_type_ptr & ptr) throw ():
     type(ptr.type)
 {
-    ++*(this->count = ptr.count); // never throws
+    openvrml_::atomic_increment(*(this->count = ptr.count));
 }
 
 /**
@@ -105,7 +109,7 @@ node_type_ptr::node_type_ptr(const node_type_ptr & ptr) throw ():
 node_type_ptr & node_type_ptr::operator=(const node_type_ptr & ptr) throw ()
 {
     if (this->count != ptr.count) {
-        ++*ptr.count;
+        openvrml_::atomic_increment(*ptr.count);
         this->dispose();
         this->type = ptr.type;
         this->count = ptr.count;
@@ -153,13 +157,13 @@ node_type_ptr & node_type_ptr::operator=(const node_type_ptr & ptr) throw ()
 void node_type_ptr::reset(node_type * const type) throw (std::bad_alloc)
 {
     if (this->type == type) { return; }
-    if (--*this->count == 0) {
+    if (openvrml_::atomic_decrement(*this->count) == 0) {
         delete this->type;
     } else {
         try {
             this->count = new size_t;
         } catch (std::bad_alloc &) {
-            ++*this->count;
+            openvrml_::atomic_increment(*this->count);
             delete type;
             throw;
         }
@@ -174,7 +178,7 @@ void node_type_ptr::reset(node_type * const type) throw (std::bad_alloc)
  */
 void node_type_ptr::dispose() throw ()
 {
-    if (--*this->count == 0) {
+    if (openvrml_::atomic_decrement(*this->count) == 0) {
         delete this->type;
         delete this->count;
     }
@@ -56,6 +56,16 @@ namespace openvrml {
  * @brief List of @link openvrml::node_type node_types@endlink in the scope.
  */
 
+/**
+ * @var std::map<std::string, node_type_ptr> scope::node_type_map
+ *
+ * @brief The @link openvrml::node_type node_types@endlink of node_type_list,
+ *        keyed by type name.
+ *
+ * The parser looks up the type of every node it reads; the map saves it
+ * walking the list and comparing each name in turn.
+ */
+
 /**
  * @var std::map<std::string, node *> scope::named_node_map
  *
@@ -129,29 +139,16 @@ bool scope::add_type(const node_type_ptr & type) throw (std::bad_alloc)
 {
     assert(type);
     if (this->find_type(type->id)) { return false; }
-    this->node_type_list.push_front(type); // Throws std::bad_alloc.
+    this->node_type_map[type->id] = type; // Throws std::bad_alloc.
+    try {
+        this->node_type_list.push_front(type); // Throws std::bad_alloc.
+    } catch (std::bad_alloc &) {
+        this->node_type_map.erase(type->id);
+        throw;
+    }
     return true;
 }
 
-namespace {
-    struct has_id_ : std::unary_function<node_type_ptr, bool> {
-        explicit has_id_(const std::string & id):
-            id(&id)
-        {}
-
-        bool operator()(const node_type_ptr & type) const
-        {
-            assert(type);
-            return type->id == *this->id;
-        }
-
-    private:
-        const std::string * id;
-    };
-
-    typedef std::list<node_type_ptr> node_type_list_t;
-}
-
 /**
  * @brief Find a node type, given a type name. Returns 0 if type is
  *      not defined.
@@ -160,10 +157,9 @@ const node_type_ptr & scope::find_type(const std::string & id) const {
     //
     // Look through the types unique to this scope.
     //
-    const node_type_list_t::const_iterator end = this->node_type_list.end();
-    const node_type_list_t::const_iterator pos =
-            std::find_if(this->node_type_list.begin(), end, has_id_(id));
-    if (pos != end) { return *pos; }
+    typedef std::map<std::string, node_type_ptr> node_type_map_t;
+    const node_type_map_t::const_iterator pos = this->node_type_map.find(id);
+    if (pos != this->node_type_map.end()) { return pos->second; }
 
     //
     // Look in the parent scope for the type.
@@ -99,6 +99,70 @@ script::~script()
  * @brief Shut down the Script node.
  */
 
+/**
+ * @var bool script::deferred_
+ *
+ * @brief Whether scripts made from now are run outside browser::update,
+ *        where their binding can.
+ */
+bool script::deferred_ = false;
+
+/**
+ * @brief Whether the eventOuts of the script_node may be read.
+ *
+ * A binding running the script on another thread returns @c false while the
+ * script runs, and holds the script until outputs_done otherwise; the
+ * script_node then sends the eventOuts set at its next update.
+ *
+ * @return @c true if the script_node may read its eventOuts until
+ *         outputs_done is called.
+ */
+bool script::outputs_ready() throw ()
+{
+    return true;
+}
+
+/**
+ * @brief The script_node is done reading its eventOuts.
+ */
+void script::outputs_done() throw ()
+{}
+
+/**
+ * @brief Run the scripts made from now outside browser::update, where their
+ *        binding can.
+ *
+ * Their events are run on a thread of the binding, in order, and what they
+ * send is sent at the first update of the browser after they have run; so a
+ * slow script no longer holds the frame, but its eventOuts come a frame or
+ * more later. Off by default.
+ *
+ * @param value @c true to defer the scripts made from now.
+ */
+void script::defer(const bool value) throw ()
+{
+    script::deferred_ = value;
+}
+
+/**
+ * @brief Whether the scripts made from now are deferred.
+ *
+ * @return @c true if the scripts made from now are deferred.
+ */
+bool script::deferred() throw ()
+{
+    return script::deferred_;
+}
+
+/**
+ * @fn void script::collect_garbage(double budget)
+ *
+ * @brief Collect what the scripts of every browser no longer use, within
+ *        @p budget seconds where the binding can.
+ *
+ * Call it once a frame, after the browsers are updated.
+ */
+
 
 /**
  * @class script_node_class
@@ -504,8 +568,10 @@ void script_node::update(const double current_time)
     }
 
     //
-    // For each modified eventOut, send an event.
+    // For each modified eventOut, send an event; those of a script still
+    // running elsewhere are sent at a later update.
     //
+    if (this->script_ && !this->script_->outputs_ready()) { return; }
     for (eventout_value_map_t::iterator itr
              = this->eventout_value_map_.begin();
          itr != this->eventout_value_map_.end(); ++itr) {
@@ -514,6 +580,7 @@ void script_node::update(const double current_time)
             itr->second.modified = false;
         }
     }
+    if (this->script_) { this->script_->outputs_done(); }
 }
 
 /**
@@ -541,8 +608,8 @@ void script_node::assign_with_self_ref_check(const sfnode & inval,
     // refcounted objects.
     //
     if (oldNode
-        && (dynamic_cast<script_node *>(oldNode.count_ptr->first) == this)) {
-        ++oldNode.count_ptr->second;
+        && (dynamic_cast<script_node *>(oldNode.node_) == this)) {
+        ++oldNode.node_->ref_count_;
     }
 
     retval = inval;
@@ -557,8 +624,9 @@ void script_node::assign_with_self_ref_check(const sfnode & inval,
     // refcount from ever dropping to zero.
     //
     const node_ptr & newNode = retval.value;
-    if (dynamic_cast<script_node *>(newNode.count_ptr->first) == this) {
-        --(newNode.count_ptr->second);
+    if (newNode
+        && (dynamic_cast<script_node *>(newNode.node_) == this)) {
+        --(newNode.node_->ref_count_);
     }
 }
 
@@ -581,9 +649,8 @@ void script_node::assign_with_self_ref_check(const mfnode & inval,
     for (i = 0; i < retval.value.size(); ++i) {
         const node_ptr & oldNode = retval.value[i];
         if (oldNode
-            && (dynamic_cast<script_node *>(oldNode.count_ptr->first)
-                == this)) {
-            ++oldNode.count_ptr->second;
+            && (dynamic_cast<script_node *>(oldNode.node_) == this)) {
+            ++oldNode.node_->ref_count_;
         }
     }
 
@@ -592,9 +659,8 @@ void script_node::assign_with_self_ref_check(const mfnode & inval,
     for (i = 0; i < retval.value.size(); ++i) {
         const node_ptr & newNode = retval.value[i];
         if (newNode
-            && (dynamic_cast<script_node *>(newNode.count_ptr->first)
-                == this)) {
-            --(newNode.count_ptr->second);
+            && (dynamic_cast<script_node *>(newNode.node_) == this)) {
+            --(newNode.node_->ref_count_);
         }
     }
 }
@@ -618,6 +684,7 @@ void script_node::do_initialize(const double timestamp) throw (std::bad_alloc)
     //
     // For each modified eventOut, send an event.
     //
+    if (this->script_ && !this->script_->outputs_ready()) { return; }
     for (eventout_value_map_t::iterator itr(this->eventout_value_map_.begin());
             itr != this->eventout_value_map_.end(); ++itr) {
         if (itr->second.modified) {
@@ -625,6 +692,7 @@ void script_node::do_initialize(const double timestamp) throw (std::bad_alloc)
             itr->second.modified = false;
         }
     }
+    if (this->script_) { this->script_->outputs_done(); }
 }
 
 /**
@@ -729,14 +797,18 @@ void script_node::do_process_event(const std::string & id,
         //
         // For each modified eventOut, emit an event.
         //
-        for (eventout_value_map_t::iterator itr =
-                 this->eventout_value_map_.begin();
-             itr != this->eventout_value_map_.end();
-             ++itr) {
-            if (itr->second.modified) {
-                this->emit_event(itr->first, *itr->second.value, timestamp);
-                itr->second.modified = false;
+        if (this->script_->outputs_ready()) {
+            for (eventout_value_map_t::iterator itr =
+                     this->eventout_value_map_.begin();
+                 itr != this->eventout_value_map_.end();
+                 ++itr) {
+                if (itr->second.modified) {
+                    this->emit_event(itr->first, *itr->second.value,
+                                     timestamp);
+                    itr->second.modified = false;
+                }
             }
+            this->script_->outputs_done();
         }
         ++this->events_received;
     }
@@ -841,6 +913,11 @@ void script_node::do_shutdown(const double timestamp) throw ()
 #   include <memory>
 #   include <sstream>
 #   include <vector>
+#   ifdef _WIN32
+#     include <windows.h>
+#   else
+#     include <pthread.h>
+#   endif
 #   include <jsapi.h>
 # endif
 namespace openvrml {
@@ -854,15 +931,42 @@ class script : public openvrml::script {
     static JSRuntime * rt;
     static size_t nInstances;
 
+    //
+    // Contexts of scripts destroyed, kept for the next scripts made, of
+    // this browser or another, and the context the scheduled collections
+    // are run on.
+    //
+    static std::vector<JSContext *> contexts;
+    static JSContext * gc_cx;
+    static double gc_begin;
+    static double gc_duration;
+    static size_t gc_deferred;
+
+    struct runtime_remover {
+        ~runtime_remover() throw ();
+    };
+    static runtime_remover remover;
+
     double d_timeStamp;
 
     JSContext * cx;
 
+    //
+    // The arguments of activate, rooted once for the life of the script,
+    // and the timestamp last converted, which all the events of a cascade
+    // share.
+    //
+    jsval args[2];
+    double args_time;
+    jsval args_time_val;
+
 public:
     script(openvrml::script_node & node, const std::string & source)
         throw (std::bad_alloc);
     virtual ~script();
 
+    static void collect_garbage(double budget) throw ();
+
     virtual void initialize(double timeStamp);
     virtual void process_event(const std::string & id,
                               const openvrml::field_value & value,
@@ -875,6 +979,10 @@ public:
     jsval vrmlFieldToJSVal(const openvrml::field_value & value) throw ();
 
 private:
+    static JSContext * new_context() throw (std::bad_alloc);
+    static void release_context(JSContext * cx) throw ();
+    static JSBool gc_callback(JSContext * cx, JSGCStatus status);
+
     void initVrmlClasses(bool direct_output) throw (std::bad_alloc);
     void defineBrowserObject() throw (std::bad_alloc);
     void defineFields() throw (std::bad_alloc);
@@ -937,6 +1045,13 @@ script * script_node::create_script()
     return 0;
 }
 
+void script::collect_garbage(const double budget) throw ()
+{
+# if OPENVRML_ENABLE_SCRIPT_NODE_JAVASCRIPT
+    js_::script::collect_garbage(budget);
+# endif
+}
+
 # if OPENVRML_ENABLE_SCRIPT_NODE_JAVASCRIPT
 namespace {
 
@@ -944,6 +1059,64 @@ namespace js_ {
 
 const long MAX_HEAP_BYTES = 4L * 1024L * 1024L;
 const long STACK_CHUNK_BYTES = 4024L;
+const size_t MAX_POOLED_CONTEXTS = 16;
+const size_t MAX_GC_DEFERRED = 30;
+
+//
+// SpiderMonkey is built without JS_THREADSAFE, and the runtime is shared by
+// the scripts of every browser, some made on a loader thread while others
+// run; so, each use of it is made under this lock. It is recursive, as a
+// script may be reached again from an event it sends.
+//
+struct runtime_mutex {
+# ifdef _WIN32
+    CRITICAL_SECTION section;
+
+    runtime_mutex() throw () { InitializeCriticalSection(&this->section); }
+# else
+    pthread_mutex_t m;
+
+    runtime_mutex() throw ()
+    {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&this->m, &attr);
+        pthread_mutexattr_destroy(&attr);
+    }
+# endif
+};
+
+//
+// Never destroyed, so a script destroyed as the process exits still finds it.
+//
+runtime_mutex & js_mutex = *new runtime_mutex;
+
+class runtime_lock {
+public:
+    runtime_lock() throw ()
+    {
+# ifdef _WIN32
+        EnterCriticalSection(&js_mutex.section);
+# else
+        pthread_mutex_lock(&js_mutex.m);
+# endif
+    }
+
+    ~runtime_lock() throw ()
+    {
+# ifdef _WIN32
+        LeaveCriticalSection(&js_mutex.section);
+# else
+        pthread_mutex_unlock(&js_mutex.m);
+# endif
+    }
+
+private:
+    // Non-copyable.
+    runtime_lock(const runtime_lock &);
+    runtime_lock & operator=(const runtime_lock &);
+};
 
 # if 0
 enum err_num {
@@ -1592,6 +1765,12 @@ private:
 
 JSRuntime * script::rt = 0; // Javascript runtime singleton object
 size_t script::nInstances = 0; // Number of distinct script objects
+std::vector<JSContext *> script::contexts;
+JSContext * script::gc_cx = 0;
+double script::gc_begin = 0.0;
+double script::gc_duration = 0.0;
+size_t script::gc_deferred = 0;
+script::runtime_remover script::remover;
 
 JSBool eventOut_setProperty(JSContext * cx, JSObject * obj,
                             jsval id, jsval * val) throw ();
@@ -1608,22 +1787,16 @@ void errorReporter(JSContext * cx, const char * message,
 script::script(openvrml::script_node & node, const std::string & source)
     throw (std::bad_alloc):
     openvrml::script(node),
-    cx(0)
+    cx(0),
+    args_time(-1.0),
+    args_time_val(JSVAL_NULL)
 {
-
-    //
-    // Initialize the runtime.
-    //
-    if (!rt) {
-        if (!(rt = JS_NewRuntime(MAX_HEAP_BYTES))) { throw std::bad_alloc(); }
-    }
+    runtime_lock lock;
 
     //
     // Initialize the context for this script object.
     //
-    if (!(this->cx = JS_NewContext(rt, STACK_CHUNK_BYTES))) {
-        throw std::bad_alloc();
-    }
+    this->cx = new_context();
 
     //
     // Store a pointer to this script object in the context.
@@ -1639,6 +1812,7 @@ script::script(openvrml::script_node & node, const std::string & source)
     JSObject * const globalObj =
         JS_NewObject(this->cx, &Global::jsclass, 0, 0);
     if (!globalObj) { throw std::bad_alloc(); }
+    JS_SetGlobalObject(this->cx, globalObj);
 
     if (!JS_InitStandardClasses(this->cx, globalObj)) {
         throw std::bad_alloc();
@@ -1693,18 +1867,128 @@ script::script(openvrml::script_node & node, const std::string & source)
                            filename, lineno, &rval);
     OPENVRML_VERIFY_(ok);
 
+    this->args[0] = this->args[1] = JSVAL_NULL;
+    if (!JS_AddRoot(this->cx, &this->args[0])
+            || !JS_AddRoot(this->cx, &this->args[1])
+            || !JS_AddRoot(this->cx, &this->args_time_val)) {
+        throw std::bad_alloc();
+    }
+
     ++nInstances;
 }
 
 script::~script()
 {
-    JS_DestroyContext(this->cx);
-    if (--nInstances == 0) {
-        JS_DestroyRuntime(rt);
-        rt = 0;
+    runtime_lock lock;
+
+    JS_RemoveRoot(this->cx, &this->args[0]);
+    JS_RemoveRoot(this->cx, &this->args[1]);
+    JS_RemoveRoot(this->cx, &this->args_time_val);
+    release_context(this->cx);
+    --nInstances;
+}
+
+/**
+ * @brief Destroy the runtime as the process exits, if no script is left.
+ */
+script::runtime_remover::~runtime_remover() throw ()
+{
+    runtime_lock lock;
+
+    if (!rt || nInstances > 0) { return; }
+    for (size_t i = 0; i < contexts.size(); ++i) {
+        JS_DestroyContextNoGC(contexts[i]);
+    }
+    contexts.clear();
+    JS_DestroyContext(gc_cx);
+    gc_cx = 0;
+    JS_DestroyRuntime(rt);
+    rt = 0;
+}
+
+/**
+ * @brief A context for a new script: one of a script destroyed, or else a
+ *        new one.
+ *
+ * The runtime is made with the first script and kept after the last, so
+ * that a browser made again, as a scene is reloaded, finds its contexts.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+JSContext * script::new_context() throw (std::bad_alloc)
+{
+    if (!rt) {
+        if (!(rt = JS_NewRuntime(MAX_HEAP_BYTES))) { throw std::bad_alloc(); }
+        if (!(gc_cx = JS_NewContext(rt, STACK_CHUNK_BYTES))) {
+            throw std::bad_alloc();
+        }
+        JS_SetGCCallbackRT(rt, gc_callback);
+    }
+
+    if (!contexts.empty()) {
+        JSContext * const cx = contexts.back();
+        contexts.pop_back();
+        return cx;
+    }
+
+    JSContext * const cx = JS_NewContext(rt, STACK_CHUNK_BYTES);
+    if (!cx) { throw std::bad_alloc(); }
+    return cx;
+}
+
+/**
+ * @brief Keep the context of a script destroyed for the next one.
+ *
+ * Its global object is dropped, so that what the script made is collected.
+ * Destroying a context collects the runtime, which the pool avoids but past
+ * MAX_POOLED_CONTEXTS.
+ */
+void script::release_context(JSContext * const cx) throw ()
+{
+    JS_SetContextPrivate(cx, 0);
+    JS_SetGlobalObject(cx, 0);
+    JS_ClearPendingException(cx);
+    if (contexts.size() < MAX_POOLED_CONTEXTS) {
+        contexts.push_back(cx);
+    } else {
+        JS_DestroyContextNoGC(cx);
     }
 }
 
+/**
+ * @brief Time the collections, scheduled or not.
+ */
+JSBool script::gc_callback(JSContext *, const JSGCStatus status)
+{
+    if (status == JSGC_BEGIN) {
+        gc_begin = browser::current_time();
+    } else if (status == JSGC_END) {
+        gc_duration = browser::current_time() - gc_begin;
+    }
+    return JS_TRUE;
+}
+
+/**
+ * @brief Collect the runtime, if it has grown enough since the last
+ *        collection, when the last one took no more than @p budget.
+ *
+ * Called once a frame, so that the collections are made there rather than
+ * in the middle of an event, when an allocation reaches MAX_HEAP_BYTES. A
+ * collection that does not fit the budget is put off, for MAX_GC_DEFERRED
+ * calls at most.
+ *
+ * @param budget    the time, in seconds, the collection may take.
+ */
+void script::collect_garbage(const double budget) throw ()
+{
+    runtime_lock lock;
+
+    if (!gc_cx) { return; }
+    if (gc_duration > budget && ++gc_deferred < MAX_GC_DEFERRED) { return; }
+    gc_deferred = 0;
+    JS_MaybeGC(gc_cx);
+}
+
 void script::initialize(const double timestamp)
 {
     const sftime arg(timestamp);
@@ -1749,6 +2033,7 @@ void script::activate(const double timeStamp, const std::string & fname,
 {
     assert(this->cx);
 
+    runtime_lock lock;
     jsval fval, rval;
     JSObject * const globalObj = JS_GetGlobalObject(this->cx);
     assert(globalObj);
@@ -1768,19 +2053,28 @@ void script::activate(const double timeStamp, const std::string & fname,
         d_timeStamp = timeStamp;
         s_timeStamp = timeStamp; // XXX this won't work for long...
 
-        // convert FieldValue*'s to (gc-protected) jsvals
-        std::vector<jsval> jsargv(argc);
+        // convert FieldValue*'s to jsvals, in the rooted args; the
+        // timestamp is converted once for the events of a cascade
+        assert(argc <= 2);
         size_t i;
         for (i = 0; i < argc; ++i) {
             assert(argv[i]);
-            jsargv[i] = vrmlFieldToJSVal(*argv[i]);
-            if (!JS_AddRoot(this->cx, &jsargv[i])) {
-                throw std::bad_alloc();
+            if (argv[i]->type() == field_value::sftime_id) {
+                const double t =
+                    static_cast<const sftime *>(argv[i])->value;
+                if (t != this->args_time
+                        || this->args_time_val == JSVAL_NULL) {
+                    this->args_time_val = vrmlFieldToJSVal(*argv[i]);
+                    this->args_time = t;
+                }
+                this->args[i] = this->args_time_val;
+            } else {
+                this->args[i] = vrmlFieldToJSVal(*argv[i]);
             }
         }
 
         JSBool ok = JS_CallFunctionValue(this->cx, globalObj,
-                                         fval, argc, &jsargv[0], &rval);
+                                         fval, argc, this->args, &rval);
         // XXX
         // XXX What should we do at this point if a function call fails?
         // XXX For now, just print a message for a debug build.
@@ -1788,13 +2082,7 @@ void script::activate(const double timeStamp, const std::string & fname,
         OPENVRML_VERIFY_(ok);
 
         // Free up args
-        for (i = 0; i < argc; ++i) {
-            assert(jsargv[i] != JSVAL_NULL);
-            if (JSVAL_IS_GCTHING(jsargv[i])) {
-                ok = JS_RemoveRoot(cx, &jsargv[i]);
-                assert(ok);
-            }
-        }
+        this->args[0] = this->args[1] = JSVAL_NULL;
 
         //
         // Check to see if any eventOuts need to be sent.
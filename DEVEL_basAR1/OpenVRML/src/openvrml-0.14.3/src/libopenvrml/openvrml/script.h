@@ -40,12 +40,21 @@ namespace openvrml {
         virtual void events_processed(double timestamp) = 0;
         virtual void shutdown(double timestamp) = 0;
 
+        virtual bool outputs_ready() throw ();
+        virtual void outputs_done() throw ();
+
+        static void collect_garbage(double budget) throw ();
+        static void defer(bool value) throw ();
+        static bool deferred() throw ();
+
     protected:
         script_node & node;
 
         script(script_node & node);
 
     private:
+        static bool deferred_;
+
         // non-copyable
         script(const script &);
         script & operator=(const script &);
@@ -276,6 +276,14 @@ const char *system::http_fetch(const char * url)
         close(sockfd);
     }
 #endif
+    //
+    // result points to temp_name; the caller frees the copy.
+    //
+    if (result) {
+        char * const name = static_cast<char *>(malloc(strlen(result) + 1));
+        if (name) { strcpy(name, result); }
+        result = name;
+    }
     return result;
 }
 
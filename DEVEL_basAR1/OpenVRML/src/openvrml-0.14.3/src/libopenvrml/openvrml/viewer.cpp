@@ -470,6 +470,21 @@ viewer::~viewer() {}
  * @return a handle to the inserted texture.
  */
 
+/**
+ * @fn void viewer::update_texture(texture_object_t ref, size_t w, size_t h, size_t nc, const unsigned char * pixels)
+ *
+ * @brief Replace the pixels of a texture object.
+ *
+ * The texture keeps its size and settings; so, @p w, @p h and @p nc must be
+ * those it was inserted with, and the sizes already powers of two.
+ *
+ * @param ref       texture handle.
+ * @param w         width.
+ * @param h         height.
+ * @param nc        number of components.
+ * @param pixels    pixel data.
+ */
+
 /**
  * @fn void viewer::insert_texture_reference(texture_object_t ref, size_t components)
  *
@@ -571,6 +586,24 @@ viewer::intersect_view_volume(const bounding_volume & bvolume) const
  *                      to draw in unique way. (useful for debugging)
  */
 
+/**
+ * @brief Move the vertices of a shell to new coordinates.
+ *
+ * Called for an IndexedFaceSet of which only the points changed, in place of
+ * remove_object() and insert_shell(). The faces, colors, normals and texture
+ * coordinates given to insert_shell() are unchanged.
+ *
+ * @param ref   the object insert_shell() returned.
+ * @param coord the new coordinates.
+ *
+ * @return @c true if the object was updated; @c false if it has to be
+ *         removed and inserted again, which is all this implementation does.
+ */
+bool viewer::update_shell_coord(object_t, const std::vector<vec3f> &)
+{
+    return false;
+}
+
 /**
  * @todo We're forcing everybody to carry around a frustum
  *       whether they want it or not. It shouldn't be used except
@@ -139,6 +139,8 @@ namespace openvrml {
         virtual object_t insert_reference(object_t existing_object) = 0;
 
         virtual void remove_object(object_t ref) = 0;
+        virtual bool update_shell_coord(object_t ref,
+                                        const std::vector<vec3f> & coord);
 
         virtual void enable_lighting(bool val) = 0;
 
@@ -169,6 +171,9 @@ namespace openvrml {
                                                 bool repeat_t,
                                                 const unsigned char * pixels,
                                                 bool retainHint = false) = 0;
+        virtual void update_texture(texture_object_t ref,
+                                    size_t w, size_t h, size_t nc,
+                                    const unsigned char * pixels) = 0;
 
         virtual void insert_texture_reference(texture_object_t ref,
                                               size_t components) = 0;
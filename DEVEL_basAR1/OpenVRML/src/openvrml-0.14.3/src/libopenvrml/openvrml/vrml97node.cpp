@@ -2615,6 +2615,22 @@ void background_node::do_initialize(const double timestamp) throw ()
     background_class & nodeClass =
         static_cast<background_class &>(this->type.node_class);
     if (!nodeClass.has_first()) { nodeClass.set_first(*this); }
+
+    //
+    // The textures are decoded while the rest of the world is set up.
+    //
+    assert(this->scene());
+    try {
+        const doc2 baseDoc(this->scene()->url());
+        img::prefetch(this->backUrl.value, &baseDoc);
+        img::prefetch(this->bottomUrl.value, &baseDoc);
+        img::prefetch(this->frontUrl.value, &baseDoc);
+        img::prefetch(this->leftUrl.value, &baseDoc);
+        img::prefetch(this->rightUrl.value, &baseDoc);
+        img::prefetch(this->topUrl.value, &baseDoc);
+    } catch (std::bad_alloc & ex) {
+        OPENVRML_PRINT_EXCEPTION_(ex);
+    }
 }
 
 /**
@@ -4244,6 +4260,31 @@ coordinate_interpolator_class::create_type(
     return type;
 }
 
+namespace {
+
+    //
+    // vec3f is three packed floats, so an array of them is walked as one
+    // flat array of floats.
+    //
+    typedef char vec3f_is_packed_[(sizeof (vec3f) == 3 * sizeof (float))
+                                  ? 1 : -1];
+
+    /**
+     * @internal
+     *
+     * @brief Linear interpolation of @p n floats into @p out.
+     *
+     * A loop of independent multiply-adds, which the compiler turns into
+     * SIMD code.
+     */
+    void lerp_(const float * const a, const float * const b, const float f,
+               float * const out, const size_t n)
+        throw ()
+    {
+        for (size_t i = 0; i < n; ++i) { out[i] = a[i] + f * (b[i] - a[i]); }
+    }
+}
+
 /**
  * @class coordinate_interpolator_node
  *
@@ -4326,21 +4367,15 @@ coordinate_interpolator_node::process_set_fraction(const field_value & value,
         for (size_t i = 0; i < n; ++i) {
             if (this->key.value[i] <= f
                     && f <= this->key.value[i + 1]) {
-                std::vector<vec3f>::const_iterator v1 =
-                        this->keyValue.value.begin() + i * nCoords;
-                std::vector<vec3f>::const_iterator v2 =
-                        this->keyValue.value.begin() + (i + 1) * nCoords;
-
                 f = (f - this->key.value[i])
                     / (this->key.value[i + 1] - this->key.value[i]);
 
-                for (size_t j = 0; j < nCoords; ++j) {
-                    const vec3f vec(v1->x() + f * (v2->x() - v1->x()),
-                                    v1->y() + f * (v2->y() - v1->y()),
-                                    v1->z() + f * (v2->z() - v1->z()));
-                    this->value.value[j] = vec;
-                    ++v1;
-                    ++v2;
+                if (nCoords > 0) {
+                    lerp_(&this->keyValue.value[i * nCoords][0],
+                          &this->keyValue.value[(i + 1) * nCoords][0],
+                          f,
+                          &this->value.value[0][0],
+                          3 * nCoords);
                 }
                 break;
             }
@@ -7314,6 +7349,26 @@ image_texture_node::~image_texture_node() throw ()
     // delete texObject...
 }
 
+/**
+ * @brief Initialize.
+ *
+ * The image is decoded ahead of the first render, which reads it from the
+ * decode cache of img.
+ *
+ * @param timestamp the current time.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void image_texture_node::do_initialize(const double timestamp)
+    throw (std::bad_alloc)
+{
+    assert(this->scene());
+    if (!this->url.value.empty()) {
+        const doc2 baseDoc(this->scene()->url());
+        img::prefetch(this->url.value, &baseDoc);
+    }
+}
+
 /**
  * @brief Render the node.
  *
@@ -7353,33 +7408,19 @@ void image_texture_node::render(openvrml::viewer & viewer,
     } else {
         unsigned char *pix;
 
-        if (this->image && (pix = this->image->pixels())) {
-            // Ensure the image dimensions are powers of two
-            const size_t sizes[] = { 2, 4, 8, 16, 32, 64, 128, 256 };
-            const size_t nSizes = sizeof(sizes) / sizeof(int);
-            const size_t w = this->image->w();
-            const size_t h = this->image->h();
-            size_t i, j;
-            for (i = 0; i < nSizes; ++i) { if (w < sizes[i]) { break; } }
-            for (j = 0; j < nSizes; ++j) { if (h < sizes[j]) { break; } }
-
-            if (i > 0 && j > 0) {
-                // Always scale images down in size and reuse the same pixel
-                // memory. This can cause some ugliness...
-                if (w != sizes[i - 1] || h != sizes[j - 1]) {
-                    viewer.scale_texture(w, h, sizes[i - 1], sizes[j - 1],
-                                        this->image->nc(), pix);
-                    this->image->resize(sizes[i - 1], sizes[j - 1]);
-                }
-
-                this->texObject = viewer.insert_texture(this->image->w(),
-                                                        this->image->h(),
-                                                        this->image->nc(),
-                                                        this->repeatS.value,
-                                                        this->repeatT.value,
-                                                        pix,
-                                                        true);
-            }
+        if (this->image && (pix = this->image->pixels())
+            && this->image->w() > 0 && this->image->h() > 0) {
+            //
+            // The image goes to the viewer at its own size; the viewer
+            // scales it only if the hardware needs powers of two.
+            //
+            this->texObject = viewer.insert_texture(this->image->w(),
+                                                    this->image->h(),
+                                                    this->image->nc(),
+                                                    this->repeatS.value,
+                                                    this->repeatT.value,
+                                                    pix,
+                                                    true);
         }
     }
 
@@ -7742,6 +7783,38 @@ bool indexed_face_set_node::modified() const {
             || (this->texCoord.value && this->texCoord.value->modified()));
 }
 
+/**
+ * @brief Render this node.
+ *
+ * When only the points of the Coordinate node changed, the viewer is asked
+ * to move the vertices of the object it has; otherwise the object is built
+ * again.
+ *
+ * @param viewer    a renderer.
+ * @param context   the rendering context.
+ */
+void indexed_face_set_node::render(openvrml::viewer & viewer,
+                                   const rendering_context context)
+{
+    if (this->viewerObject && !context.draw_bounding_spheres
+            && !this->node::modified()
+            && this->coord.value && this->coord.value->modified()
+            && !(this->color_.value && this->color_.value->modified())
+            && !(this->normal.value && this->normal.value->modified())
+            && !(this->texCoord.value && this->texCoord.value->modified())) {
+        openvrml::coordinate_node * const coordinateNode =
+            this->coord.value->to_coordinate();
+        if (coordinateNode
+                && viewer.update_shell_coord(this->viewerObject,
+                                             coordinateNode->point())) {
+            this->coord.value->modified(false);
+            viewer.insert_reference(this->viewerObject);
+            return;
+        }
+    }
+    this->abstract_geometry_node::render(viewer, context);
+}
+
 /**
  * @brief Insert this geometry into @p viewer's display list.
  *
@@ -8324,6 +8397,28 @@ void inline_node::activate(double time, bool isOver, bool isActive, double *p)
     }
 }
 
+/**
+ * @brief Initialize.
+ *
+ * A scene attached by scene::load_inlines is initialized with the node;
+ * otherwise, a remote world is downloaded ahead of load().
+ *
+ * @param timestamp the current time.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+void inline_node::do_initialize(const double timestamp)
+    throw (std::bad_alloc)
+{
+    assert(this->scene());
+    if (this->inlineScene) {
+        this->inlineScene->initialize(timestamp);
+        return;
+    }
+    const doc2 baseDoc(this->scene()->url());
+    resource_loader::prefetch(this->url.value, &baseDoc);
+}
+
 /**
  * @brief Load the children from the URL.
  */
@@ -9002,6 +9097,397 @@ float material_node::transparency() const throw ()
 }
 
 
+    class movie_decoder {
+    public:
+        enum { ring_size = 4 };
+
+        struct slot {
+            int frame;
+            bool ready;
+            std::vector<unsigned char> pixels;
+        };
+
+        enum state_t { loading, loaded, failed };
+
+        const std::vector<std::string> urls;
+        const std::string base;
+        resource_loader::mutex lock;
+        state_t state;
+        bool started;
+        img image;
+        size_t tex_w, tex_h;
+        int wanted;
+        int step;
+        bool stopping;
+        slot ring[ring_size];
+
+        movie_decoder(const std::vector<std::string> & urls,
+                      const std::string & base)
+            throw (std::bad_alloc);
+        ~movie_decoder() throw ();
+
+        bool is_loaded() throw ();
+        void seek(int frame, int step) throw ();
+        const unsigned char * ready(int frame) throw ();
+
+    private:
+        resource_loader::thread * worker;
+
+        void load() throw ();
+        bool scale(int frame, std::vector<unsigned char> & pixels) throw ();
+        static void run(void * arg);
+
+        // Non-copyable.
+        movie_decoder(const movie_decoder &);
+        movie_decoder & operator=(const movie_decoder &);
+    };
+
+/**
+ * @class movie_decoder
+ *
+ * @brief The reading of a MovieTexture's movie and the making of its frames,
+ *        on a thread of its own.
+ *
+ * The movie is read whole by img, then the frames from the one
+ * movie_texture_node::update last asked for, onwards in the direction of
+ * play, are scaled to the power-of-two size of the texture into a ring of
+ * ring_size frames. The frame is only uploaded when the node renders; so,
+ * neither the reading nor the scaling takes from the time of a frame.
+ *
+ * If the thread cannot be started, the movie is read when the decoder is
+ * made and each frame scaled as it is asked for, as before.
+ */
+
+/**
+ * @var movie_decoder::ring_size
+ *
+ * @brief The number of frames made ahead.
+ */
+
+/**
+ * @class movie_decoder::slot
+ *
+ * @brief A frame of the ring.
+ */
+
+/**
+ * @var int movie_decoder::slot::frame
+ *
+ * @brief The frame in the slot, or -1.
+ */
+
+/**
+ * @var bool movie_decoder::slot::ready
+ *
+ * @brief Whether the pixels are those of the frame yet.
+ */
+
+/**
+ * @var std::vector<unsigned char> movie_decoder::slot::pixels
+ *
+ * @brief The frame, at the size of the texture.
+ */
+
+/**
+ * @var const std::vector<std::string> movie_decoder::urls
+ *
+ * @brief The urls of the MovieTexture when the decoder was made.
+ */
+
+/**
+ * @var const std::string movie_decoder::base
+ *
+ * @brief The URI the urls are relative to.
+ */
+
+/**
+ * @var resource_loader::mutex movie_decoder::lock
+ *
+ * @brief Guards the state, the frame asked for and the ring.
+ */
+
+/**
+ * @var movie_decoder::state_t movie_decoder::state
+ *
+ * @brief Whether the movie is read; image, tex_w and tex_h are only used
+ *        once it is not loading.
+ */
+
+/**
+ * @var bool movie_decoder::started
+ *
+ * @brief Whether movie_texture_node::update has seen the movie read; used
+ *        by the node's thread only.
+ */
+
+/**
+ * @var img movie_decoder::image
+ *
+ * @brief The frames of the movie.
+ */
+
+/**
+ * @var size_t movie_decoder::tex_w
+ *
+ * @brief The width of the texture.
+ */
+
+/**
+ * @var size_t movie_decoder::tex_h
+ *
+ * @brief The height of the texture.
+ */
+
+/**
+ * @var int movie_decoder::wanted
+ *
+ * @brief The frame last asked for.
+ */
+
+/**
+ * @var int movie_decoder::step
+ *
+ * @brief 1 while the movie plays forwards, -1 backwards.
+ */
+
+/**
+ * @var bool movie_decoder::stopping
+ *
+ * @brief Tells the thread to end.
+ */
+
+/**
+ * @var movie_decoder::slot movie_decoder::ring[ring_size]
+ *
+ * @brief The frames made ahead.
+ */
+
+/**
+ * @var resource_loader::thread * movie_decoder::worker
+ *
+ * @brief The thread.
+ */
+
+namespace {
+
+    //
+    // The largest power of two not above size, from 2 to 256; 0 if size is
+    // less than 2.
+    //
+    size_t texture_size(const size_t size)
+    {
+        size_t s = 0;
+        for (size_t p = 2; p <= 256 && p <= size; p *= 2) { s = p; }
+        return s;
+    }
+}
+
+/**
+ * @brief Construct, and start reading the movie.
+ *
+ * @param urls  the urls of the MovieTexture.
+ * @param base  the URI @p urls are relative to.
+ *
+ * @exception std::bad_alloc    if memory allocation fails.
+ */
+movie_decoder::movie_decoder(const std::vector<std::string> & urls,
+                             const std::string & base)
+    throw (std::bad_alloc):
+    urls(urls),
+    base(base),
+    state(loading),
+    started(false),
+    tex_w(0),
+    tex_h(0),
+    wanted(0),
+    step(1),
+    stopping(false),
+    worker(0)
+{
+    for (size_t i = 0; i < ring_size; ++i) { this->ring[i].frame = -1; }
+    this->worker = new resource_loader::thread(&movie_decoder::run, this);
+    if (!this->worker->started()) { this->load(); }
+}
+
+/**
+ * @brief Destroy, once the thread has ended.
+ *
+ * A movie still being read is read to the end first.
+ */
+movie_decoder::~movie_decoder() throw ()
+{
+    {
+        resource_loader::scoped_lock lock(this->lock);
+        this->stopping = true;
+    }
+    delete this->worker;
+}
+
+/**
+ * @brief Whether the movie is read.
+ *
+ * @return @c true if the movie is read; @c false if it is being read, or
+ *         could not be.
+ */
+bool movie_decoder::is_loaded() throw ()
+{
+    resource_loader::scoped_lock lock(this->lock);
+    return this->state == loaded;
+}
+
+/**
+ * @brief Tell the thread which frame is shown.
+ *
+ * @param frame the frame shown, or -1.
+ * @param step  1 if the movie plays forwards; -1 if it plays backwards.
+ */
+void movie_decoder::seek(const int frame, const int step) throw ()
+{
+    if (frame < 0) { return; }
+    resource_loader::scoped_lock lock(this->lock);
+    this->wanted = frame;
+    this->step = step;
+}
+
+/**
+ * @brief The pixels of a frame at the size of the texture.
+ *
+ * The lock must be held, and the movie read, as long as the pixels are used.
+ * Without the thread the frame is scaled now.
+ *
+ * @param frame a frame of the movie.
+ *
+ * @return the pixels of @p frame, or 0 if they are not ready yet.
+ */
+const unsigned char * movie_decoder::ready(const int frame) throw ()
+{
+    for (size_t i = 0; i < ring_size; ++i) {
+        if (this->ring[i].frame == frame && this->ring[i].ready) {
+            return &this->ring[i].pixels[0];
+        }
+    }
+    if (this->worker->started()) { return 0; }
+
+    slot & s = this->ring[0];
+    s.frame = frame;
+    s.ready = this->scale(frame, s.pixels);
+    return s.ready ? &s.pixels[0] : 0;
+}
+
+/**
+ * @brief Read the movie.
+ */
+void movie_decoder::load() throw ()
+{
+    state_t result = failed;
+    try {
+        const doc2 baseDoc(this->base);
+        if (this->image.try_urls(this->urls, &baseDoc)) {
+            this->tex_w = texture_size(this->image.w());
+            this->tex_h = texture_size(this->image.h());
+            if (this->tex_w > 0 && this->tex_h > 0) { result = loaded; }
+        }
+    } catch (std::exception & ex) {
+        OPENVRML_PRINT_EXCEPTION_(ex);
+    }
+    resource_loader::scoped_lock lock(this->lock);
+    this->state = result;
+}
+
+/**
+ * @brief Scale a frame to the size of the texture.
+ *
+ * @param frame     a frame of the movie.
+ * @retval pixels   the scaled frame.
+ *
+ * @return @c true if the frame is scaled; @c false if it is not in the movie
+ *         or memory allocation fails.
+ */
+bool movie_decoder::scale(const int frame, std::vector<unsigned char> & pixels)
+    throw ()
+{
+    const unsigned char * const src = this->image.pixels(size_t(frame));
+    if (!src) { return false; }
+    const size_t w = this->image.w(), h = this->image.h();
+    const size_t nc = this->image.nc();
+    try {
+        pixels.resize(this->tex_w * this->tex_h * nc);
+    } catch (std::bad_alloc &) {
+        return false;
+    }
+    unsigned char * dst = &pixels[0];
+    for (size_t y = 0; y < this->tex_h; ++y) {
+        const unsigned char * const row = src + (y * h / this->tex_h) * w * nc;
+        for (size_t x = 0; x < this->tex_w; ++x, dst += nc) {
+            std::copy(row + (x * w / this->tex_w) * nc,
+                      row + (x * w / this->tex_w) * nc + nc,
+                      dst);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief The work of the thread.
+ *
+ * @param arg   the movie_decoder.
+ */
+void movie_decoder::run(void * const arg)
+{
+    movie_decoder & d = *static_cast<movie_decoder *>(arg);
+    d.load();
+
+    for (;;) {
+        slot * target = 0;
+        int frame = -1;
+        {
+            resource_loader::scoped_lock lock(d.lock);
+            if (d.stopping || d.state != loaded) { return; }
+
+            //
+            // The first frame of the window from the one asked for that is
+            // not in the ring goes in place of one outside the window.
+            //
+            const int n = int(d.image.nframes());
+            int window[ring_size];
+            for (size_t k = 0; k < ring_size; ++k) {
+                window[k] = ((d.wanted + d.step * int(k)) % n + n) % n;
+            }
+            for (size_t k = 0; k < ring_size && frame < 0; ++k) {
+                size_t i = 0;
+                while (i < ring_size && d.ring[i].frame != window[k]) { ++i; }
+                if (i == ring_size) { frame = window[k]; }
+            }
+            for (size_t i = 0; i < ring_size && frame >= 0 && !target; ++i) {
+                if (std::find(window, window + ring_size, d.ring[i].frame)
+                        == window + ring_size) {
+                    target = &d.ring[i];
+                }
+            }
+            if (target) {
+                target->frame = frame;
+                target->ready = false;
+            }
+        }
+
+        if (!target) {
+            resource_loader::nap();
+            continue;
+        }
+        const bool scaled = d.scale(frame, target->pixels);
+
+        resource_loader::scoped_lock lock(d.lock);
+        if (target->frame == frame) {
+            if (scaled) {
+                target->ready = true;
+            } else {
+                target->frame = -1;
+            }
+        }
+    }
+}
+
+
 /**
  * @class movie_texture_class
  *
@@ -9198,9 +9684,9 @@ movie_texture_class::create_type(const std::string & id,
  */
 
 /**
- * @var img * movie_texture_node::image
+ * @var movie_decoder * movie_texture_node::decoder
  *
- * @brief Image data.
+ * @brief The reader of the movie and its frames.
  */
 
 /**
@@ -9227,6 +9713,13 @@ movie_texture_class::create_type(const std::string & id,
  * @brief Handle for the renderer.
  */
 
+/**
+ * @var viewer::texture_object_t movie_texture_node::oldTexObject
+ *
+ * @brief The texture object of a movie replaced by another, removed at the
+ *        next render.
+ */
+
 /**
  * @brief Construct.
  *
@@ -9239,11 +9732,12 @@ movie_texture_node::movie_texture_node(const node_type & type,
     abstract_texture_node(type, scope),
     loop(false),
     speed(1.0),
-    image(0),
+    decoder(0),
     frame(0),
     lastFrame(-1),
     lastFrameTime(-1.0),
-    texObject(0)
+    texObject(0),
+    oldTexObject(0)
 {}
 
 /**
@@ -9251,7 +9745,7 @@ movie_texture_node::movie_texture_node(const node_type & type,
  */
 movie_texture_node::~movie_texture_node() throw ()
 {
-    delete this->image;
+    delete this->decoder;
 }
 
 /**
@@ -9265,44 +9759,53 @@ movie_texture_node* movie_texture_node::to_movie_texture() const
 /**
  * @brief Update the node for the current timestamp.
  *
+ * The movie is read and its frames made ready by the node's movie_decoder;
+ * so, the frame is only advanced here, and the decoder told where it is.
+ *
  * @param time  the current time.
  */
 void movie_texture_node::update(const double time)
 {
-    if (modified()) {
-        if (this->image) {
-            const char * imageUrl = this->image->url();
-            size_t imageLen = strlen(imageUrl);
-            size_t i, nUrls = this->url.value.size();
-            for (i = 0; i < nUrls; ++i) {
-                size_t len = this->url.value[i].length();
-
-                if (this->url.value[i] == imageUrl
-                        || (imageLen > len
-                            && this->url.value[i]
-                                == (imageUrl + imageLen - len))) {
-                    break;
-                }
-            }
-
-            // if (d_image->url() not in d_url list) ...
-            if (i == nUrls) {
-                delete this->image;
-                this->image = 0;
+    if (modified() && this->decoder) {
+        const std::vector<std::string> & decoderUrls = this->decoder->urls;
+        if (decoderUrls != this->url.value) {
+            delete this->decoder;
+            this->decoder = 0;
+            if (!this->oldTexObject) {
+                this->oldTexObject = this->texObject;
             }
+            this->texObject = 0;
+            this->lastFrame = -1;
         }
     }
 
-    // Load the movie if needed (should check startTime...)
-    if (!this->image && this->url.value.size() > 0) {
-        doc2 baseDoc(this->scene()->url());
-        this->image = new img;
-        if (!this->image->try_urls(this->url.value, &baseDoc)) {
+    // Start reading the movie if needed (should check startTime...)
+    if (!this->decoder && this->url.value.size() > 0) {
+        this->decoder = new movie_decoder(this->url.value,
+                                          this->scene()->url());
+    }
+    if (!this->decoder) { return; }
+
+    movie_decoder::state_t state;
+    {
+        resource_loader::scoped_lock lock(this->decoder->lock);
+        state = this->decoder->state;
+    }
+    if (state == movie_decoder::loading) {
+        // Look again shortly.
+        this->type.node_class.browser.delta(0.1);
+        return;
+    }
+
+    const img & image = this->decoder->image;
+    if (!this->decoder->started) {
+        this->decoder->started = true;
+        if (state == movie_decoder::failed) {
             std::cerr << "Error: couldn't read MovieTexture from URL "
                       << this->url << std::endl;
         }
 
-        const size_t nFrames = this->image->nframes();
+        const size_t nFrames = image.nframes();
         this->duration.value = (nFrames >= 0)
                              ? double(nFrames)
                              : -1.0;
@@ -9318,7 +9821,7 @@ void movie_texture_node::update(const double time)
     }
 
     // No pictures to show
-    if (!this->image || this->image->nframes() == 0) { return; }
+    if (state == movie_decoder::failed || image.nframes() == 0) { return; }
 
     // See section 4.6.9 of the VRML97 spec for a detailed explanation
     // of the logic here.
@@ -9332,7 +9835,7 @@ void movie_texture_node::update(const double time)
                         this->lastFrameTime = time;
                         this->frame = (this->speed.value >= 0)
                                     ? 0
-                                    : this->image->nframes() - 1;
+                                    : image.nframes() - 1;
                         this->modified(true);
 	            } else if (this->startTime.value > this->lastFrameTime) {
                         this->active.value = true;
@@ -9340,7 +9843,7 @@ void movie_texture_node::update(const double time)
                         this->lastFrameTime = time;
                         this->frame = (this->speed.value >= 0)
                                     ? 0
-                                    : this->image->nframes() - 1;
+                                    : image.nframes() - 1;
                         this->modified(true);
 	            }
 	        }
@@ -9349,7 +9852,7 @@ void movie_texture_node::update(const double time)
                 this->emit_event("isActive", this->active, time);
                 this->lastFrameTime = time;
                 this->frame = (this->speed.value >= 0) ? 0 :
-                                 this->image->nframes() - 1;
+                                 image.nframes() - 1;
                 this->modified(true);
             }
         }
@@ -9381,6 +9884,8 @@ void movie_texture_node::update(const double time)
         this->modified(true);
     }
 
+    this->decoder->seek(this->frame, (this->speed.value < 0.0) ? -1 : 1);
+
     // Tell the scene when the next update is needed.
     if (this->active.value) {
         double d = this->lastFrameTime + fabs(1 / this->speed.value)
@@ -9392,7 +9897,10 @@ void movie_texture_node::update(const double time)
 /**
  * @brief Render the node.
  *
- * Render a frame if there is one available.
+ * Render a frame if there is one available. The texture object is made
+ * with the first frame and then only filled with the next ones; a frame
+ * the decoder has not made ready yet leaves the last one up until the next
+ * render.
  *
  * @param viewer    a Viewer.
  * @param context   a rendering context.
@@ -9400,49 +9908,45 @@ void movie_texture_node::update(const double time)
 void movie_texture_node::render(openvrml::viewer & viewer,
                                 const rendering_context context)
 {
-    if (!this->image || this->frame < 0) { return; }
-
-    unsigned char * pix = this->image->pixels(this->frame);
-
-    if (this->frame != this->lastFrame && this->texObject) {
-        viewer.remove_texture_object(this->texObject);
-        this->texObject = 0;
+    if (this->oldTexObject) {
+        viewer.remove_texture_object(this->oldTexObject);
+        this->oldTexObject = 0;
     }
+    if (!this->decoder || this->frame < 0) { return; }
 
-    if (!pix) {
+    resource_loader::scoped_lock lock(this->decoder->lock);
+    if (this->decoder->state != movie_decoder::loaded) { return; }
+
+    const size_t w = this->decoder->tex_w;
+    const size_t h = this->decoder->tex_h;
+    const size_t nc = this->decoder->image.nc();
+    if (size_t(this->frame) >= this->decoder->image.nframes()) {
         this->frame = -1;
-    } else if (this->texObject) {
-        viewer.insert_texture_reference(this->texObject, this->image->nc());
-    } else {
-        // Ensure image dimensions are powers of 2 (move to NodeTexture...)
-        const size_t sizes[] = { 2, 4, 8, 16, 32, 64, 128, 256 };
-        const size_t nSizes = sizeof(sizes) / sizeof(int);
-        const size_t w = this->image->w();
-        const size_t h = this->image->h();
-        size_t i, j;
-        for (i = 0; i < nSizes; ++i) { if (w < sizes[i]) { break; } }
-        for (j = 0; j < nSizes; ++j) { if (h < sizes[j]) { break; } }
-
-        if (i > 0 && j > 0) {
-            // Always scale images down in size and reuse the same pixel memory.
-            if (w != sizes[i - 1] || h != sizes[j - 1]) {
-                viewer.scale_texture(w, h, sizes[i - 1], sizes[j - 1],
-                                     this->image->nc(), pix);
-                this->image->resize(sizes[i - 1], sizes[j - 1]);
-            }
+        this->lastFrame = -1;
+        this->node::modified(false);
+        return;
+    }
 
-            this->texObject = viewer.insert_texture(this->image->w(),
-                                                    this->image->h(),
-                                                    this->image->nc(),
+    if (this->frame != this->lastFrame) {
+        const unsigned char * const pix = this->decoder->ready(this->frame);
+        if (pix && this->texObject) {
+            viewer.update_texture(this->texObject, w, h, nc, pix);
+            this->lastFrame = this->frame;
+        } else if (pix) {
+            this->texObject = viewer.insert_texture(w, h, nc,
                                                     this->repeatS.value,
                                                     this->repeatT.value,
                                                     pix,
-                                                    !this->active.value);
+                                                    true);
+            if (this->texObject) { this->lastFrame = this->frame; }
         }
     }
 
-    this->lastFrame = this->frame;
-    this->node::modified(false);
+    if (this->texObject) {
+        viewer.insert_texture_reference(this->texObject, nc);
+    }
+
+    if (this->lastFrame == this->frame) { this->node::modified(false); }
 }
 
 /**
@@ -9452,7 +9956,9 @@ void movie_texture_node::render(openvrml::viewer & viewer,
  */
 size_t movie_texture_node::components() const throw ()
 {
-    return this->image ? this->image->nc() : 0;
+    return this->decoder && this->decoder->is_loaded()
+        ? this->decoder->image.nc()
+        : 0;
 }
 
 /**
@@ -9462,7 +9968,9 @@ size_t movie_texture_node::components() const throw ()
  */
 size_t movie_texture_node::width() const throw ()
 {
-    return this->image ? this->image->w() : 0;
+    return this->decoder && this->decoder->is_loaded()
+        ? this->decoder->image.w()
+        : 0;
 }
 
 /**
@@ -9472,7 +9980,9 @@ size_t movie_texture_node::width() const throw ()
  */
 size_t movie_texture_node::height() const throw ()
 {
-    return this->image ? this->image->h() : 0;
+    return this->decoder && this->decoder->is_loaded()
+        ? this->decoder->image.h()
+        : 0;
 }
 
 /**
@@ -9482,7 +9992,9 @@ size_t movie_texture_node::height() const throw ()
  */
 size_t movie_texture_node::frames() const throw ()
 {
-    return this->image ? this->image->nframes() : 0;
+    return this->decoder && this->decoder->is_loaded()
+        ? this->decoder->image.nframes()
+        : 0;
 }
 
 /**
@@ -9492,7 +10004,9 @@ size_t movie_texture_node::frames() const throw ()
  */
 const unsigned char * movie_texture_node::pixels() const throw ()
 {
-    return this->image ? this->image->pixels() : 0;
+    return this->decoder && this->decoder->is_loaded()
+        ? this->decoder->image.pixels()
+        : 0;
 }
 
 /**
@@ -9507,6 +10021,12 @@ void movie_texture_node::do_initialize(const double timestamp)
 {
     assert(this->scene());
     this->scene()->browser.add_movie(*this);
+
+    //
+    // A remote movie is downloaded ahead of its first render.
+    //
+    const doc2 baseDoc(this->scene()->url());
+    resource_loader::prefetch(this->url.value, &baseDoc);
 }
 
 /**
@@ -1160,6 +1160,9 @@ namespace openvrml {
             virtual const unsigned char * pixels() const throw ();
 
         private:
+            virtual void do_initialize(double timestamp)
+                throw (std::bad_alloc);
+
             //
             // eventIn handlers
             //
@@ -1201,6 +1204,8 @@ namespace openvrml {
             virtual ~indexed_face_set_node() throw ();
 
             virtual bool modified() const;
+            virtual void render(openvrml::viewer & viewer,
+                                rendering_context context);
             virtual viewer::object_t
             insert_geometry(openvrml::viewer & viewer,
                             rendering_context context);
@@ -1265,6 +1270,7 @@ namespace openvrml {
         class inline_node : public abstract_base,
                                            public grouping_node {
             friend class inline_class;
+            friend class openvrml::scene;
 
             sfvec3f bboxCenter;
             sfvec3f bboxSize;
@@ -1287,6 +1293,9 @@ namespace openvrml {
                                   double * p);
 
         private:
+            virtual void do_initialize(double timestamp)
+                throw (std::bad_alloc);
+
             void load();
 
             //
@@ -1406,6 +1415,8 @@ namespace openvrml {
         };
 
 
+        class movie_decoder;
+
         class movie_texture_class : public node_class {
         public:
             explicit movie_texture_class(openvrml::browser & browser);
@@ -1428,11 +1439,12 @@ namespace openvrml {
             sftime duration;
             sfbool active;
 
-            img * image;
+            movie_decoder * decoder;
             int frame, lastFrame;
             double lastFrameTime;
 
             viewer::texture_object_t texObject;
+            viewer::texture_object_t oldTexObject;
 
         public:
             movie_texture_node(const node_type & type,
@@ -0,0 +1,78 @@
+// -*- Mode: C++; indent-tabs-mode: nil; c-basic-offset: 4; -*-
+//
+// OpenVRML
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+//
+
+//
+// vrmlc compiles VRML97 files: for each scene.wrl it writes scene.wrlb,
+// which the browser reads instead of parsing scene.wrl for as long as
+// scene.wrl is not changed. See browser::compile_vrml.
+//
+
+# ifdef HAVE_CONFIG_H
+#   include <config.h>
+# endif
+
+# include <cstdio>
+# include <fstream>
+# include <iostream>
+# include <openvrml/browser.h>
+
+int main(int argc, char * argv[]) {
+    using std::cerr;
+    using std::cout;
+    using std::endl;
+    using std::string;
+
+    if (argc < 2) {
+        cerr << "Usage: " << argv[0] << " file.wrl ..." << endl;
+        return 1;
+    }
+
+    openvrml::browser browser(cout, cerr);
+
+    int result = 0;
+    for (int i = 1; i < argc; ++i) {
+        const string source(argv[i]);
+        if (source.size() <= 4
+                || source.compare(source.size() - 4, 4, ".wrl") != 0) {
+            cerr << source << ": not a .wrl file" << endl;
+            result = 1;
+            continue;
+        }
+        const string compiled = source + "b";
+
+        std::ofstream out(compiled.c_str(),
+                          std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out) {
+            cerr << compiled << ": cannot be written" << endl;
+            result = 1;
+            continue;
+        }
+        try {
+            browser.compile_vrml(source, out);
+            out.close();
+            if (!out) { throw openvrml::invalid_vrml(); }
+        } catch (std::exception & ex) {
+            cerr << source << ": " << ex.what() << endl;
+            out.close();
+            std::remove(compiled.c_str());
+            result = 1;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,321 @@
+/*
+ *   Micro-benchmark of the stages of the marker detection.
+ *
+ *   Plays recordings of ar2VideoRecordOpen() with the file video
+ *   module (AR_INPUT_FILE) as fast as they are read, and times on
+ *   every frame, one after the other,
+ *
+ *     label     arLabelingCtx()
+ *     contour   arDetectMarker2Ctx()
+ *     info      arGetMarkerInfoCtx(), with the code cache off
+ *     code      arGetCodeCtx() on each square again
+ *     pose      arGetTransMat() of each marker identified
+ *
+ *   Each recording, with the resolution and the markers it was
+ *   made with, is run once for each size of the pattern library
+ *   given by -library, the patterns of -patt being loaded again
+ *   in turn to make up the larger ones. The results are written
+ *   as JSON, one object per run.
+ *
+ *   benchDetect [options] recording [recording ...]
+ *     -cparam=file    camera parameters (default Data/camera_para.dat)
+ *     -patt=file      a pattern of the library, repeatable
+ *     -library=N,...  sizes of the library (default the number of -patt)
+ *     -thresh=N       labeling threshold (default 100)
+ *     -width=W        marker width for the poses (default 80.0)
+ *     -repeat=N       passes over each recording (default 1)
+ *     -json=file      where the results go (default benchDetect.json)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <AR/config.h>
+#include <AR/param.h>
+#include <AR/ar.h>
+#include <AR/video.h>
+
+#define     BENCH_RECORDING_MAX   32
+#define     BENCH_LIBRARY_MAX     16
+
+enum { STAGE_LABEL, STAGE_CONTOUR, STAGE_INFO, STAGE_CODE, STAGE_POSE, STAGE_NUM };
+
+static const char *stage_name[STAGE_NUM] = { "label", "contour", "info", "code", "pose" };
+
+typedef struct {
+    double  sum;
+    double  min;
+    double  max;
+} BenchTime;
+
+typedef struct {
+    int        frames;
+    BenchTime  stage[STAGE_NUM];
+    double     labels;
+    double     squares;
+    double     markers;
+} BenchRun;
+
+static char        *cparam_name = "Data/camera_para.dat";
+static char        *patt_name[AR_PATT_NUM_MAX];
+static int          patt_num = 0;
+static int          library[BENCH_LIBRARY_MAX];
+static int          library_num = 0;
+static int          thresh = 100;
+static double       width = 80.0;
+static int          repeat = 1;
+
+static int   parse_library( char *s );
+static int   load_library( int size, int id[] );
+static void  free_library( int id[], int size );
+static int   bench_recording( char *file, BenchRun *run, int *xsize, int *ysize );
+static void  add_time( BenchTime *t, double msec );
+static void  write_run( FILE *fp, char *file, int xsize, int ysize, int size, BenchRun *run, int first );
+static void  usage( char *com );
+
+int main( int argc, char *argv[] )
+{
+    char       *recording[BENCH_RECORDING_MAX];
+    int         recording_num = 0;
+    char       *json_name = "benchDetect.json";
+    FILE       *fp;
+    BenchRun    run;
+    int         id[AR_PATT_NUM_MAX];
+    int         xsize, ysize;
+    int         first = 1;
+    int         i, j;
+
+    for( i = 1; i < argc; i++ ) {
+        if( strncmp( argv[i], "-cparam=", 8 ) == 0 ) cparam_name = &argv[i][8];
+        else if( strncmp( argv[i], "-patt=", 6 ) == 0 ) {
+            if( patt_num == AR_PATT_NUM_MAX ) { printf("Too many patterns.\n"); exit(0); }
+            patt_name[patt_num++] = &argv[i][6];
+        }
+        else if( strncmp( argv[i], "-library=", 9 ) == 0 ) {
+            if( parse_library( &argv[i][9] ) < 0 ) usage( argv[0] );
+        }
+        else if( strncmp( argv[i], "-thresh=", 8 ) == 0 ) thresh = atoi( &argv[i][8] );
+        else if( strncmp( argv[i], "-width=", 7 ) == 0 )  width  = atof( &argv[i][7] );
+        else if( strncmp( argv[i], "-repeat=", 8 ) == 0 ) repeat = atoi( &argv[i][8] );
+        else if( strncmp( argv[i], "-json=", 6 ) == 0 )   json_name = &argv[i][6];
+        else if( argv[i][0] == '-' ) usage( argv[0] );
+        else {
+            if( recording_num == BENCH_RECORDING_MAX ) { printf("Too many recordings.\n"); exit(0); }
+            recording[recording_num++] = argv[i];
+        }
+    }
+    if( recording_num == 0 || patt_num == 0 || repeat < 1 ) usage( argv[0] );
+    if( library_num == 0 ) library[library_num++] = patt_num;
+
+    // Not stdout, on which the video module writes as well.
+    if( (fp = fopen( json_name, "w" )) == NULL ) {
+        printf("Cannot write %s.\n", json_name);
+        exit(0);
+    }
+
+    // Every square is matched, so that the code stage is the same
+    // whatever was seen in the frames before.
+    arCodeCacheMode = AR_CODE_CACHE_OFF;
+    arTrackingMode  = AR_TRACKING_OFF;
+
+    fprintf( fp, "[\n" );
+    for( j = 0; j < library_num; j++ ) {
+        if( load_library( library[j], id ) < 0 ) exit(0);
+        for( i = 0; i < recording_num; i++ ) {
+            if( bench_recording( recording[i], &run, &xsize, &ysize ) < 0 ) continue;
+            write_run( fp, recording[i], xsize, ysize, library[j], &run, first );
+            first = 0;
+        }
+        free_library( id, library[j] );
+    }
+    fprintf( fp, "\n]\n" );
+    fclose( fp );
+
+    return 0;
+}
+
+static int parse_library( char *s )
+{
+    char   *e;
+    long    n;
+
+    for( ;; ) {
+        n = strtol( s, &e, 10 );
+        if( e == s || n < 1 || n > AR_PATT_NUM_MAX || library_num == BENCH_LIBRARY_MAX ) return -1;
+        library[library_num++] = (int)n;
+        if( *e == '\0' ) return 0;
+        if( *e != ',' ) return -1;
+        s = e + 1;
+    }
+}
+
+static int load_library( int size, int id[] )
+{
+    int     i;
+
+    for( i = 0; i < size; i++ ) {
+        if( (id[i] = arLoadPatt( patt_name[i % patt_num] )) < 0 ) {
+            printf("Pattern %s load error !!\n", patt_name[i % patt_num]);
+            free_library( id, i );
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void free_library( int id[], int size )
+{
+    int     i;
+
+    for( i = 0; i < size; i++ ) arFreePatt( id[i] );
+}
+
+static int bench_recording( char *file, BenchRun *run, int *xsize, int *ysize )
+{
+    char            vconf[512];
+    AR2VideoParamT *vid;
+    ARParam         wparam, cparam;
+    ARHandle       *handle;
+    ARUint8        *image;
+    ARInt16        *limage;
+    ARMarkerInfo2  *marker_info2;
+    ARMarkerInfo   *marker_info;
+    int             label_num, marker2_num, marker_num;
+    int            *area, *clip, *label_ref;
+    double         *pos;
+    double          center[2] = { 0.0, 0.0 };
+    double          conv[3][4];
+    int             code, dir;
+    double          cf;
+    int             format, stride;
+    double          t0, t1;
+    int             pass, k, s, found;
+
+    sprintf( vconf, "-file=%s -rate=0", file );
+    if( (vid = ar2VideoOpen( vconf )) == NULL ) return -1;
+    ar2VideoInqSize( vid, xsize, ysize );
+    if( ar2VideoInqPixelFormat( vid, &format, &stride ) < 0 ) format = AR_DEFAULT_PIXEL_FORMAT;
+
+    if( arParamLoad( cparam_name, 1, &wparam ) < 0 ) {
+        printf("Camera parameter load error !!\n");
+        ar2VideoClose( vid );
+        return -1;
+    }
+    arParamChangeSize( &wparam, *xsize, *ysize, &cparam );
+    arInitCparam( &cparam );
+    if( (handle = arCreateHandle( &cparam )) == NULL
+     || arSetPixelFormatCtx( handle, format ) < 0 ) {
+        printf("%s: the frames can't be detected.\n", file);
+        if( handle != NULL ) arDeleteHandle( handle );
+        ar2VideoClose( vid );
+        return -1;
+    }
+    if( format == AR_PIXEL_FORMAT_MONO ) handle->lumaStride = stride;
+
+    memset( run, 0, sizeof(BenchRun) );
+    for( s = 0; s < STAGE_NUM; s++ ) run->stage[s].min = DBL_MAX;
+
+    for( pass = 0; pass < repeat; pass++ ) {
+        if( ar2VideoCapStart( vid ) < 0 ) break;
+        while( (image = ar2VideoGetImage( vid )) != NULL ) {
+            t0 = arUtilClock();
+            limage = arLabelingCtx( handle, image, thresh,
+                                    &label_num, &area, &pos, &clip, &label_ref );
+            t1 = arUtilClock();
+            if( limage == NULL ) { ar2VideoCapNext( vid ); continue; }
+            add_time( &run->stage[STAGE_LABEL], (t1 - t0) * 1000.0 );
+
+            t0 = arUtilClock();
+            marker_info2 = arDetectMarker2Ctx( handle, limage, label_num, label_ref,
+                                               area, pos, clip, AR_AREA_MAX, AR_AREA_MIN,
+                                               1.0, &marker2_num );
+            t1 = arUtilClock();
+            add_time( &run->stage[STAGE_CONTOUR], (t1 - t0) * 1000.0 );
+            if( marker_info2 == NULL ) marker2_num = 0;
+
+            marker_num = marker2_num;
+            t0 = arUtilClock();
+            marker_info = arGetMarkerInfoCtx( handle, image, marker_info2, &marker_num );
+            t1 = arUtilClock();
+            add_time( &run->stage[STAGE_INFO], (t1 - t0) * 1000.0 );
+
+            t0 = arUtilClock();
+            for( k = 0; k < marker2_num; k++ ) {
+                arGetCodeCtx( handle, image, marker_info2[k].x_coord, marker_info2[k].y_coord,
+                              marker_info2[k].vertex, &code, &dir, &cf );
+            }
+            t1 = arUtilClock();
+            add_time( &run->stage[STAGE_CODE], (t1 - t0) * 1000.0 );
+
+            found = 0;
+            t0 = arUtilClock();
+            for( k = 0; k < marker_num; k++ ) {
+                if( marker_info[k].id < 0 || marker_info[k].cf < 0.5 ) continue;
+                arGetTransMat( &marker_info[k], center, width, conv );
+                found++;
+            }
+            t1 = arUtilClock();
+            add_time( &run->stage[STAGE_POSE], (t1 - t0) * 1000.0 );
+
+            run->frames++;
+            run->labels  += label_num;
+            run->squares += marker2_num;
+            run->markers += found;
+            ar2VideoCapNext( vid );
+        }
+        ar2VideoCapStop( vid );
+    }
+
+    arDeleteHandle( handle );
+    ar2VideoClose( vid );
+    if( run->frames == 0 ) {
+        printf("%s: no frame detected.\n", file);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void add_time( BenchTime *t, double msec )
+{
+    t->sum += msec;
+    if( msec < t->min ) t->min = msec;
+    if( msec > t->max ) t->max = msec;
+}
+
+static void write_run( FILE *fp, char *file, int xsize, int ysize, int size, BenchRun *run, int first )
+{
+    const char *c;
+    int         s;
+
+    fprintf( fp, "%s  {\"recording\": \"", first? "": ",\n" );
+    for( c = file; *c != '\0'; c++ ) {
+        if( *c == '"' || *c == '\\' ) fputc( '\\', fp );
+        fputc( *c, fp );
+    }
+    fprintf( fp, "\", \"xsize\": %d, \"ysize\": %d, \"library\": %d, \"frames\": %d,\n",
+             xsize, ysize, size, run->frames );
+    fprintf( fp, "   \"labels\": %.2f, \"squares\": %.2f, \"markers\": %.2f,\n",
+             run->labels / run->frames, run->squares / run->frames, run->markers / run->frames );
+    fprintf( fp, "   \"msec\": {" );
+    for( s = 0; s < STAGE_NUM; s++ ) {
+        fprintf( fp, "%s\"%s\": {\"mean\": %.4f, \"min\": %.4f, \"max\": %.4f}",
+                 s? ", ": "", stage_name[s],
+                 run->stage[s].sum / run->frames, run->stage[s].min, run->stage[s].max );
+    }
+    fprintf( fp, "}}" );
+}
+
+static void usage( char *com )
+{
+    printf("Usage: %s [options] recording [recording ...]\n", com);
+    printf("  -cparam=file    camera parameters (default Data/camera_para.dat)\n");
+    printf("  -patt=file      a pattern of the library, repeatable\n");
+    printf("  -library=N,...  sizes of the library (default the number of -patt)\n");
+    printf("  -thresh=N       labeling threshold (default 100)\n");
+    printf("  -width=W        marker width for the poses (default 80.0)\n");
+    printf("  -repeat=N       passes over each recording (default 1)\n");
+    printf("  -json=file      where the results go (default benchDetect.json)\n");
+    exit(0);
+}
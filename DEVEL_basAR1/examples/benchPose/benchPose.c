@@ -0,0 +1,531 @@
+/*
+ *   Accuracy and jitter of the poses under the detection modes.
+ *
+ *   Renders sequences of a marker under known poses through the camera
+ *   of -cparam, distortion included, with 2x2 supersampling and noise,
+ *   and runs each combination of modes of -modes over the same frames.
+ *   On every frame are measured, against the ground truth,
+ *
+ *     corner   distance of the vertices found, ideal screen pixels
+ *     trans    error of the translation of arGetTransMat(), mm
+ *     rot      error of its rotation, degrees
+ *     jitter   change of those errors from one frame to the next, the
+ *              noise of the poses without their bias
+ *     msec     arDetectMarker() and arGetTransMat() together
+ *
+ *   and printed side by side, and written as JSON with the build of the
+ *   library (ARDOUBLE_IS_FLOAT or not), one object per sequence and modes.
+ *
+ *   The modes are joined by '+': full (the defaults), half, refined
+ *   (AR_IMAGE_PROC_IN_HALF_REFINED), pyramid, subpixel, roi, motion
+ *   (AR_ROI_MOTION), tracking, lm (AR_POSE_REFINE_GAUSS_NEWTON), run and
+ *   cache.
+ *
+ *   benchPose [options] -patt=file
+ *     -cparam=file    camera parameters (default Data/camera_para.dat)
+ *     -patt=file      the pattern of the marker rendered
+ *     -modes=M,...    combinations of modes (default full,half,refined,
+ *                     pyramid,subpixel,roi,tracking,lm,refined+tracking+lm)
+ *     -sequence=S,... static, orbit and approach (default all)
+ *     -frames=N       of each sequence (default 120)
+ *     -width=W        marker width, mm (default 80.0)
+ *     -noise=S        standard deviation of the pixel noise (default 3.0)
+ *     -thresh=N       labeling threshold (default 100)
+ *     -json=file      where the results go (default benchPose.json)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <AR/config.h>
+#include <AR/param.h>
+#include <AR/ar.h>
+
+#define     BENCH_MODES_MAX       16
+#define     BENCH_BLACK           30        /* of the border, and the white around */
+#define     BENCH_WHITE           220
+#define     BENCH_FORGET          8         /* blank frames between the runs */
+
+enum { SEQ_STATIC, SEQ_ORBIT, SEQ_APPROACH, SEQ_NUM };
+static const char *seq_name[SEQ_NUM] = { "static", "orbit", "approach" };
+
+typedef struct {
+    double  sum;
+    double  max;
+} BenchError;
+
+typedef struct {
+    int         frames;
+    int         found;
+    BenchError  corner;
+    BenchError  trans;
+    BenchError  rot;
+    double      jitter_trans;       /* sum of squares */
+    double      jitter_rot;
+    int         jitter_num;
+    double      msec_sum, msec_min, msec_max;
+} BenchRun;
+
+static char        *cparam_name = "Data/camera_para.dat";
+static char        *patt_name = NULL;
+static char        *modes[BENCH_MODES_MAX] = { "full", "half", "refined", "pyramid", "subpixel",
+                                               "roi", "tracking", "lm", "refined+tracking+lm" };
+static int          modes_num = 9;
+static int          seq_on[SEQ_NUM] = { 1, 1, 1 };
+static int          frames = 120;
+static double       width = 80.0;
+static double       noise = 3.0;
+static int          thresh = 100;
+
+static ARParam      cparam;
+static int          patt_id;
+static double       texel[AR_PATT_SIZE_Y][AR_PATT_SIZE_X];
+static float       *ideal;              /* of the 2x2 samples of each pixel */
+static ARUint8     *image;
+static unsigned int seed;
+
+static int    parse_list( char *s, char *item[], int max );
+static int    set_modes( const char *combination );
+static int    load_texels( const char *name );
+static void   make_ideal( void );
+static void   truth( int seq, int f, double trans[3][4] );
+static void   render( double trans[3][4] );
+static void   bench( int seq, const char *combination, BenchRun *run );
+static double rot_angle( double a[3][4], double b[3][4] );
+static void   write_run( FILE *fp, int seq, const char *combination, BenchRun *run, int first );
+static void   usage( char *com );
+
+int main( int argc, char *argv[] )
+{
+    char       *json_name = "benchPose.json";
+    char       *seq[SEQ_NUM];
+    FILE       *fp;
+    BenchRun    run;
+    ARParam     wparam;
+    int         first = 1;
+    int         i, j, n;
+
+    for( i = 1; i < argc; i++ ) {
+        if( strncmp( argv[i], "-cparam=", 8 ) == 0 ) cparam_name = &argv[i][8];
+        else if( strncmp( argv[i], "-patt=", 6 ) == 0 ) patt_name = &argv[i][6];
+        else if( strncmp( argv[i], "-modes=", 7 ) == 0 ) {
+            if( (modes_num = parse_list( &argv[i][7], modes, BENCH_MODES_MAX )) < 1 ) usage( argv[0] );
+        }
+        else if( strncmp( argv[i], "-sequence=", 10 ) == 0 ) {
+            if( (n = parse_list( &argv[i][10], seq, SEQ_NUM )) < 1 ) usage( argv[0] );
+            for( j = 0; j < SEQ_NUM; j++ ) seq_on[j] = 0;
+            for( ; n > 0; n-- ) {
+                for( j = 0; j < SEQ_NUM; j++ ) if( strcmp( seq[n-1], seq_name[j] ) == 0 ) break;
+                if( j == SEQ_NUM ) usage( argv[0] );
+                seq_on[j] = 1;
+            }
+        }
+        else if( strncmp( argv[i], "-frames=", 8 ) == 0 ) frames = atoi( &argv[i][8] );
+        else if( strncmp( argv[i], "-width=", 7 ) == 0 ) width = atof( &argv[i][7] );
+        else if( strncmp( argv[i], "-noise=", 7 ) == 0 ) noise = atof( &argv[i][7] );
+        else if( strncmp( argv[i], "-thresh=", 8 ) == 0 ) thresh = atoi( &argv[i][8] );
+        else if( strncmp( argv[i], "-json=", 6 ) == 0 ) json_name = &argv[i][6];
+        else usage( argv[0] );
+    }
+    if( patt_name == NULL || frames < 2 || width <= 0.0 || noise < 0.0 ) usage( argv[0] );
+    for( i = 0; i < modes_num; i++ ) {
+        if( set_modes( modes[i] ) < 0 ) {
+            printf("Unknown modes %s.\n", modes[i]);
+            exit(0);
+        }
+    }
+
+    if( arParamLoad( cparam_name, 1, &wparam ) < 0 ) {
+        printf("Camera parameter load error !!\n");
+        exit(0);
+    }
+    cparam = wparam;
+    arInitCparam( &cparam );
+    if( (patt_id = arLoadPatt( patt_name )) < 0 || load_texels( patt_name ) < 0 ) {
+        printf("Pattern load error !!\n");
+        exit(0);
+    }
+    arMalloc( ideal, float, cparam.xsize * cparam.ysize * 8 );
+    arMalloc( image, ARUint8, cparam.xsize * cparam.ysize * AR_PIX_SIZE_DEFAULT );
+    make_ideal();
+
+    if( (fp = fopen( json_name, "w" )) == NULL ) {
+        printf("Cannot write %s.\n", json_name);
+        exit(0);
+    }
+    fprintf( fp, "[\n" );
+    printf("%-10s %-22s %6s %8s %8s %8s %8s %8s %8s %7s\n", "sequence", "modes", "found",
+           "corner", "trans", "rot", "jit mm", "jit deg", "max rot", "msec");
+    for( i = 0; i < SEQ_NUM; i++ ) {
+        if( !seq_on[i] ) continue;
+        for( j = 0; j < modes_num; j++ ) {
+            bench( i, modes[j], &run );
+            write_run( fp, i, modes[j], &run, first );
+            first = 0;
+            n = (run.found > 0)? run.found: 1;
+            printf("%-10s %-22s %3d/%-3d %8.3f %8.3f %8.3f %8.4f %8.4f %8.3f %7.3f\n",
+                   seq_name[i], modes[j], run.found, run.frames,
+                   run.corner.sum / n, run.trans.sum / n, run.rot.sum / n,
+                   (run.jitter_num > 0)? sqrt( run.jitter_trans / run.jitter_num ): 0.0,
+                   (run.jitter_num > 0)? sqrt( run.jitter_rot / run.jitter_num ): 0.0,
+                   run.rot.max, run.msec_sum / run.frames);
+        }
+    }
+    fprintf( fp, "\n]\n" );
+    fclose( fp );
+
+    free( ideal );
+    free( image );
+    return 0;
+}
+
+static int parse_list( char *s, char *item[], int max )
+{
+    int     n = 0;
+
+    for( ;; ) {
+        if( n == max || *s == '\0' ) return -1;
+        item[n++] = s;
+        if( (s = strchr( s, ',' )) == NULL ) return n;
+        *s++ = '\0';
+    }
+}
+
+// The defaults of config.h, then the modes of the combination.
+static int set_modes( const char *combination )
+{
+    char        name[256];
+    char       *p, *q;
+
+    arImageProcMode = DEFAULT_IMAGE_PROC_MODE;
+    arPyramidMode = DEFAULT_PYRAMID_MODE;
+    arEdgeRefineMode = DEFAULT_EDGE_REFINE_MODE;
+    arROIMode = DEFAULT_ROI_MODE;
+    arTrackingMode = DEFAULT_TRACKING_MODE;
+    arPoseRefineMode = DEFAULT_POSE_REFINE_MODE;
+    arLabelingMode = DEFAULT_LABELING_MODE;
+    arCodeCacheMode = DEFAULT_CODE_CACHE_MODE;
+
+    strncpy( name, combination, sizeof(name) - 1 );
+    name[sizeof(name) - 1] = '\0';
+    for( p = name; p != NULL; p = q ) {
+        if( (q = strchr( p, '+' )) != NULL ) *q++ = '\0';
+        if( strcmp( p, "full" ) == 0 ) ;
+        else if( strcmp( p, "half" ) == 0 ) arImageProcMode = AR_IMAGE_PROC_IN_HALF;
+        else if( strcmp( p, "refined" ) == 0 ) arImageProcMode = AR_IMAGE_PROC_IN_HALF_REFINED;
+        else if( strcmp( p, "pyramid" ) == 0 ) arPyramidMode = AR_PYRAMID_HALF;
+        else if( strcmp( p, "subpixel" ) == 0 ) arEdgeRefineMode = AR_EDGE_REFINE_SUBPIXEL;
+        else if( strcmp( p, "roi" ) == 0 ) arROIMode = AR_ROI_TRACKING;
+        else if( strcmp( p, "motion" ) == 0 ) arROIMode = AR_ROI_MOTION;
+        else if( strcmp( p, "tracking" ) == 0 ) arTrackingMode = AR_TRACKING_EDGE;
+        else if( strcmp( p, "lm" ) == 0 ) arPoseRefineMode = AR_POSE_REFINE_GAUSS_NEWTON;
+        else if( strcmp( p, "run" ) == 0 ) arLabelingMode = AR_LABELING_BY_RUN;
+        else if( strcmp( p, "cache" ) == 0 ) arCodeCacheMode = AR_CODE_CACHE_ON;
+        else return -1;
+    }
+    return 0;
+}
+
+// The grey of the first direction of the pattern file, row 0 at the top.
+static int load_texels( const char *name )
+{
+    FILE       *fp;
+    int         c, x, y, v;
+
+    if( (fp = fopen( name, "r" )) == NULL ) return -1;
+    memset( texel, 0, sizeof(texel) );
+    for( c = 0; c < 3; c++ ) {
+        for( y = 0; y < AR_PATT_SIZE_Y; y++ ) {
+            for( x = 0; x < AR_PATT_SIZE_X; x++ ) {
+                if( fscanf( fp, "%d", &v ) != 1 ) {fclose( fp ); return -1;}
+                texel[y][x] += v / 3.0;
+            }
+        }
+    }
+    fclose( fp );
+    return 0;
+}
+
+static void make_ideal( void )
+{
+    double      ix, iy;
+    float      *p = ideal;
+    int         x, y, s;
+
+    for( y = 0; y < cparam.ysize; y++ ) {
+        for( x = 0; x < cparam.xsize; x++ ) {
+            for( s = 0; s < 4; s++ ) {
+                arParamObserv2Ideal( cparam.dist_factor, x - 0.25 + (s & 1) * 0.5,
+                                     y - 0.25 + (s >> 1) * 0.5, &ix, &iy );
+                *p++ = (float)ix;
+                *p++ = (float)iy;
+            }
+        }
+    }
+}
+
+// The marker faces the camera, its y axis up, tilted by a about x and b
+// about y, turned by c about its normal, at t.
+static void pose( double a, double b, double c, double tx, double ty, double tz, double trans[3][4] )
+{
+    double      rx[3][3], ry[3][3], rz[3][3], m[3][3], r[3][3];
+    int         i, j, k;
+
+    memset( rx, 0, sizeof(rx) ); memset( ry, 0, sizeof(ry) ); memset( rz, 0, sizeof(rz) );
+    rx[0][0] = 1.0;      rx[1][1] = cos( a ); rx[1][2] = -sin( a ); rx[2][1] = sin( a ); rx[2][2] = cos( a );
+    ry[1][1] = 1.0;      ry[0][0] = cos( b ); ry[0][2] = sin( b );  ry[2][0] = -sin( b ); ry[2][2] = cos( b );
+    rz[2][2] = 1.0;      rz[0][0] = cos( c ); rz[0][1] = -sin( c ); rz[1][0] = sin( c ); rz[1][1] = cos( c );
+    for( i = 0; i < 3; i++ ) for( j = 0; j < 3; j++ ) {
+        m[i][j] = 0.0;
+        for( k = 0; k < 3; k++ ) m[i][j] += rx[i][k] * ry[k][j];
+    }
+    for( i = 0; i < 3; i++ ) for( j = 0; j < 3; j++ ) {
+        r[i][j] = 0.0;
+        for( k = 0; k < 3; k++ ) r[i][j] += m[i][k] * rz[k][j];
+    }
+    // Marker y up and z towards the camera, against the camera's y down and z ahead.
+    for( j = 0; j < 3; j++ ) {
+        trans[0][j] =  r[0][j];
+        trans[1][j] = -r[1][j];
+        trans[2][j] = -r[2][j];
+    }
+    trans[0][3] = tx;
+    trans[1][3] = ty;
+    trans[2][3] = tz;
+}
+
+static void truth( int seq, int f, double trans[3][4] )
+{
+    double      u = (double)f / (frames - 1);
+    double      d = M_PI / 180.0;
+
+    switch( seq ) {
+      case SEQ_STATIC:
+        pose( 20.0 * d, 10.0 * d, 5.0 * d, 10.0, -5.0, 500.0, trans );
+        break;
+      case SEQ_ORBIT:
+        pose( 35.0 * d * sin( 2.0 * M_PI * u ), 35.0 * d * cos( 2.0 * M_PI * u ), 90.0 * d * u,
+              40.0 * sin( 2.0 * M_PI * u ), 30.0 * cos( 2.0 * M_PI * u ), 550.0 + 100.0 * sin( 4.0 * M_PI * u ), trans );
+        break;
+      default:
+        pose( 30.0 * d, -15.0 * d, 20.0 * d, 0.0, 0.0, 300.0 + 1200.0 * u, trans );
+        break;
+    }
+}
+
+// The ideal screen point of the point (X, Y) of the marker.
+static void project( double trans[3][4], double X, double Y, double *u, double *v )
+{
+    double      c[3], s[3];
+    int         i;
+
+    for( i = 0; i < 3; i++ ) c[i] = trans[i][0] * X + trans[i][1] * Y + trans[i][3];
+    for( i = 0; i < 3; i++ ) s[i] = cparam.mat[i][0] * c[0] + cparam.mat[i][1] * c[1] + cparam.mat[i][2] * c[2] + cparam.mat[i][3];
+    *u = s[0] / s[2];
+    *v = s[1] / s[2];
+}
+
+static double gauss( void )
+{
+    double      u, v;
+
+    seed = seed * 1103515245u + 12345u;
+    u = ((seed >> 8) + 1.0) / 16777217.0;
+    seed = seed * 1103515245u + 12345u;
+    v = (seed >> 8) / 16777216.0;
+    return sqrt( -2.0 * log( u ) ) * cos( 2.0 * M_PI * v );
+}
+
+// Each sample of the image is taken back along the homography of the pose
+// to the marker plane.
+static void render( double trans[3][4] )
+{
+    double      h[3][3], g[3][3], det;
+    double      X, Y, W, sum, v;
+    float      *p = ideal;
+    ARUint8    *q = image;
+    int         x, y, s, i, j, k, col, row;
+
+    for( i = 0; i < 3; i++ ) {
+        for( j = 0; j < 3; j++ ) {
+            k = (j == 2)? 3: j;
+            h[i][j] = cparam.mat[i][0] * trans[0][k] + cparam.mat[i][1] * trans[1][k]
+                    + cparam.mat[i][2] * trans[2][k] + ((k == 3)? cparam.mat[i][3]: 0.0);
+        }
+    }
+    det = h[0][0] * (h[1][1] * h[2][2] - h[1][2] * h[2][1])
+        - h[0][1] * (h[1][0] * h[2][2] - h[1][2] * h[2][0])
+        + h[0][2] * (h[1][0] * h[2][1] - h[1][1] * h[2][0]);
+    g[0][0] =  (h[1][1] * h[2][2] - h[1][2] * h[2][1]) / det;
+    g[0][1] = -(h[0][1] * h[2][2] - h[0][2] * h[2][1]) / det;
+    g[0][2] =  (h[0][1] * h[1][2] - h[0][2] * h[1][1]) / det;
+    g[1][0] = -(h[1][0] * h[2][2] - h[1][2] * h[2][0]) / det;
+    g[1][1] =  (h[0][0] * h[2][2] - h[0][2] * h[2][0]) / det;
+    g[1][2] = -(h[0][0] * h[1][2] - h[0][2] * h[1][0]) / det;
+    g[2][0] =  (h[1][0] * h[2][1] - h[1][1] * h[2][0]) / det;
+    g[2][1] = -(h[0][0] * h[2][1] - h[0][1] * h[2][0]) / det;
+    g[2][2] =  (h[0][0] * h[1][1] - h[0][1] * h[1][0]) / det;
+
+    for( y = 0; y < cparam.ysize; y++ ) {
+        for( x = 0; x < cparam.xsize; x++ ) {
+            sum = 0.0;
+            for( s = 0; s < 4; s++, p += 2 ) {
+                W = g[2][0] * p[0] + g[2][1] * p[1] + g[2][2];
+                X = (g[0][0] * p[0] + g[0][1] * p[1] + g[0][2]) / W;
+                Y = (g[1][0] * p[0] + g[1][1] * p[1] + g[1][2]) / W;
+                if( W <= 0.0 || fabs( X ) > width / 2 || fabs( Y ) > width / 2 ) v = BENCH_WHITE;
+                else if( fabs( X ) > width / 4 || fabs( Y ) > width / 4 ) v = BENCH_BLACK;
+                else {
+                    col = (int)((X + width / 4) / (width / 2) * AR_PATT_SIZE_X);
+                    row = (int)((width / 4 - Y) / (width / 2) * AR_PATT_SIZE_Y);
+                    if( col >= AR_PATT_SIZE_X ) col = AR_PATT_SIZE_X - 1;
+                    if( row >= AR_PATT_SIZE_Y ) row = AR_PATT_SIZE_Y - 1;
+                    v = BENCH_BLACK + texel[row][col] * (BENCH_WHITE - BENCH_BLACK) / 255.0;
+                }
+                sum += v;
+            }
+            v = sum / 4.0 + noise * gauss();
+            v = (v < 0.0)? 0.0: (v > 255.0)? 255.0: v;
+            for( i = 0; i < AR_PIX_SIZE_DEFAULT; i++ ) *q++ = (ARUint8)(v + 0.5);
+        }
+    }
+}
+
+static void add_error( BenchError *e, double v )
+{
+    e->sum += v;
+    if( v > e->max ) e->max = v;
+}
+
+// The frames are rendered again for each combination, from the same seed,
+// so that all of them see the same images.
+static void bench( int seq, const char *combination, BenchRun *run )
+{
+    ARMarkerInfo   *marker_info;
+    int             marker_num;
+    double          trans[3][4], conv[3][4], err[3][4], prev_err[3][4];
+    double          center[2] = { 0.0, 0.0 };
+    double          corner[4][2] = { {-1.0, 1.0}, {1.0, 1.0}, {1.0, -1.0}, {-1.0, -1.0} };
+    double          t0, t, u, v, c, d, dt;
+    int             prev = 0;
+    int             f, i, j, k, best;
+
+    memset( run, 0, sizeof(BenchRun) );
+    run->msec_min = DBL_MAX;
+    set_modes( combination );
+    seed = 12345u + seq;
+
+    // Blank frames, for the markers of the last run to be forgotten: the
+    // history of arDetectMarker(), the boxes of AR_ROI_TRACKING and the
+    // markers of AR_TRACKING_EDGE.
+    memset( image, BENCH_WHITE, cparam.xsize * cparam.ysize * AR_PIX_SIZE_DEFAULT );
+    for( f = 0; f < BENCH_FORGET; f++ ) arDetectMarker( image, thresh, &marker_info, &marker_num );
+
+    for( f = 0; f < frames; f++ ) {
+        truth( seq, f, trans );
+        render( trans );
+
+        t0 = arUtilClock();
+        best = -1;
+        if( arDetectMarker( image, thresh, &marker_info, &marker_num ) == 0 ) {
+            for( i = 0; i < marker_num; i++ ) {
+                if( marker_info[i].id != patt_id ) continue;
+                if( best < 0 || marker_info[i].cf > marker_info[best].cf ) best = i;
+            }
+            if( best >= 0 ) arGetTransMat( &marker_info[best], center, width, conv );
+        }
+        t = (arUtilClock() - t0) * 1000.0;
+        run->frames++;
+        run->msec_sum += t;
+        if( t < run->msec_min ) run->msec_min = t;
+        if( t > run->msec_max ) run->msec_max = t;
+        if( best < 0 ) { prev = 0; continue; }
+        run->found++;
+
+        // The vertex of each corner, as arGetTransMat() pairs them.
+        c = 0.0;
+        for( k = 0; k < 4; k++ ) {
+            project( trans, corner[k][0] * width / 2, corner[k][1] * width / 2, &u, &v );
+            j = (4 - marker_info[best].dir + k) % 4;
+            u -= marker_info[best].vertex[j][0];
+            v -= marker_info[best].vertex[j][1];
+            c += sqrt( u * u + v * v ) / 4.0;
+        }
+        add_error( &run->corner, c );
+
+        for( i = 0, d = 0.0; i < 3; i++ ) {
+            err[i][3] = conv[i][3] - trans[i][3];
+            d += err[i][3] * err[i][3];
+        }
+        add_error( &run->trans, sqrt( d ) );
+        add_error( &run->rot, rot_angle( conv, trans ) );
+
+        // The error of the rotation as a rotation of its own, est * truth^T.
+        for( i = 0; i < 3; i++ ) for( j = 0; j < 3; j++ ) {
+            err[i][j] = 0.0;
+            for( k = 0; k < 3; k++ ) err[i][j] += conv[i][k] * trans[j][k];
+        }
+        if( prev ) {
+            for( i = 0, dt = 0.0; i < 3; i++ ) dt += (err[i][3] - prev_err[i][3]) * (err[i][3] - prev_err[i][3]);
+            run->jitter_trans += dt;
+            d = rot_angle( err, prev_err );
+            run->jitter_rot += d * d;
+            run->jitter_num++;
+        }
+        memcpy( prev_err, err, sizeof(err) );
+        prev = 1;
+    }
+}
+
+// Degrees of the rotation from the rotation part of b to that of a.
+static double rot_angle( double a[3][4], double b[3][4] )
+{
+    double      tr = 0.0;
+    int         i, k;
+
+    for( i = 0; i < 3; i++ ) for( k = 0; k < 3; k++ ) tr += a[i][k] * b[i][k];
+    tr = (tr - 1.0) / 2.0;
+    if( tr > 1.0 ) tr = 1.0;
+    if( tr < -1.0 ) tr = -1.0;
+    return acos( tr ) * 180.0 / M_PI;
+}
+
+static void write_run( FILE *fp, int seq, const char *combination, BenchRun *run, int first )
+{
+    int     n = (run->found > 0)? run->found: 1;
+
+    fprintf( fp, "%s  {\"sequence\": \"%s\", \"modes\": \"%s\", \"build\": \"%s\",\n",
+             first? "": ",\n", seq_name[seq], combination,
+#ifdef ARDOUBLE_IS_FLOAT
+             "float"
+#else
+             "double"
+#endif
+             );
+    fprintf( fp, "   \"frames\": %d, \"found\": %d, \"noise\": %.2f,\n", run->frames, run->found, noise );
+    fprintf( fp, "   \"corner_px\": {\"mean\": %.4f, \"max\": %.4f},\n", run->corner.sum / n, run->corner.max );
+    fprintf( fp, "   \"trans_mm\": {\"mean\": %.4f, \"max\": %.4f},\n", run->trans.sum / n, run->trans.max );
+    fprintf( fp, "   \"rot_deg\": {\"mean\": %.4f, \"max\": %.4f},\n", run->rot.sum / n, run->rot.max );
+    fprintf( fp, "   \"jitter\": {\"mm\": %.4f, \"deg\": %.4f},\n",
+             (run->jitter_num > 0)? sqrt( run->jitter_trans / run->jitter_num ): 0.0,
+             (run->jitter_num > 0)? sqrt( run->jitter_rot / run->jitter_num ): 0.0 );
+    fprintf( fp, "   \"msec\": {\"mean\": %.4f, \"min\": %.4f, \"max\": %.4f}}",
+             run->msec_sum / run->frames, run->msec_min, run->msec_max );
+}
+
+static void usage( char *com )
+{
+    printf("Usage: %s [options] -patt=file\n", com);
+    printf("  -cparam=file    camera parameters (default Data/camera_para.dat)\n");
+    printf("  -patt=file      the pattern of the marker rendered\n");
+    printf("  -modes=M,...    combinations of modes joined by '+', of full, half, refined,\n");
+    printf("                  pyramid, subpixel, roi, motion, tracking, lm, run and cache\n");
+    printf("  -sequence=S,... static, orbit and approach (default all)\n");
+    printf("  -frames=N       of each sequence (default 120)\n");
+    printf("  -width=W        marker width, mm (default 80.0)\n");
+    printf("  -noise=S        standard deviation of the pixel noise (default 3.0)\n");
+    printf("  -thresh=N       labeling threshold (default 100)\n");
+    printf("  -json=file      where the results go (default benchPose.json)\n");
+    exit(0);
+}
@@ -0,0 +1,388 @@
+/*
+ *   Benchmark of the drawing of ARvrml scenes.
+ *
+ *   Loads each model with arVrmlLoadFile(), from the .dat file that names
+ *   its .wrl and placement, and draws it N times a frame under synthetic
+ *   poses, turning on a grid in front of the camera, into an offscreen
+ *   framebuffer of a hidden window. Each count of instances is drawn with
+ *   one arVrmlDraw() per instance and with one arVrmlDrawInstanced() for
+ *   all. On every frame are measured
+ *
+ *     cpu        the time to submit the draws, arUtilClock()
+ *     gpu        the time the GL took for them, from a timer query
+ *     draws      draw calls made by the viewer, arVrmlGetStats()
+ *     triangles  of the meshes drawn
+ *     states     state changes made by the viewer
+ *
+ *   and written as JSON, one object per model, count and way of drawing.
+ *
+ *   benchVrml [options] model.dat [model.dat ...]
+ *     -instances=N,...  instances drawn together (default 1,16,64)
+ *     -frames=N         frames measured of each run (default 200)
+ *     -warmup=N         frames drawn before, not measured (default 20)
+ *     -size=WxH         of the framebuffer (default 640x480)
+ *     -json=file        where the results go (default benchVrml.json)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#ifdef _WIN32
+#  include <windows.h>
+#endif
+#ifdef __APPLE__
+#  include <GLUT/glut.h>
+#else
+#  include <GL/glut.h>
+#  ifndef _WIN32
+#    include <GL/glx.h>
+#  endif
+#endif
+#include <AR/config.h>
+#include <AR/ar.h>
+#include <AR/arvrml.h>
+
+#if defined(__CYGWIN__) || defined(__MINGW32__)
+#  define BENCH_GL_CALLBACK __attribute__ ((__stdcall__))
+#elif defined(_WIN32)
+#  define BENCH_GL_CALLBACK APIENTRY
+#else
+#  define BENCH_GL_CALLBACK
+#endif
+
+#define     BENCH_MODEL_MAX       32
+#define     BENCH_COUNT_MAX       16
+#define     BENCH_SPACING        120.0      /* between the instances of the grid */
+
+#define     GL_FRAMEBUFFER_EXT            0x8D40
+#define     GL_RENDERBUFFER_EXT           0x8D41
+#define     GL_COLOR_ATTACHMENT0_EXT      0x8CE0
+#define     GL_DEPTH_ATTACHMENT_EXT       0x8D00
+#define     GL_STENCIL_ATTACHMENT_EXT     0x8D20
+#define     GL_FRAMEBUFFER_COMPLETE_EXT   0x8CD5
+#define     GL_DEPTH24_STENCIL8_EXT       0x88F0
+#define     GL_TIME_ELAPSED_EXT           0x88BF
+#define     GL_QUERY_RESULT_ARB           0x8866
+
+typedef void   (BENCH_GL_CALLBACK *GenT)( GLsizei n, GLuint *ids );
+typedef void   (BENCH_GL_CALLBACK *BindT)( GLenum target, GLuint id );
+typedef void   (BENCH_GL_CALLBACK *StorageT)( GLenum target, GLenum format, GLsizei w, GLsizei h );
+typedef void   (BENCH_GL_CALLBACK *AttachT)( GLenum target, GLenum attachment, GLenum rbtarget, GLuint rb );
+typedef GLenum (BENCH_GL_CALLBACK *StatusT)( GLenum target );
+typedef void   (BENCH_GL_CALLBACK *BeginQueryT)( GLenum target, GLuint id );
+typedef void   (BENCH_GL_CALLBACK *EndQueryT)( GLenum target );
+typedef void   (BENCH_GL_CALLBACK *QueryResultT)( GLuint id, GLenum pname, unsigned long long *value );
+
+static GenT           genFramebuffers, genRenderbuffers, genQueries;
+static BindT          bindFramebuffer, bindRenderbuffer;
+static StorageT       renderbufferStorage;
+static AttachT        framebufferRenderbuffer;
+static StatusT        checkFramebufferStatus;
+static BeginQueryT    beginQuery;
+static EndQueryT      endQuery;
+static QueryResultT   getQueryObjectui64v;
+
+enum { MODE_DRAW, MODE_INSTANCED, MODE_NUM };
+static const char *mode_name[MODE_NUM] = { "draw", "instanced" };
+
+typedef struct {
+    double  sum;
+    double  min;
+    double  max;
+} BenchTime;
+
+typedef struct {
+    int        frames;
+    BenchTime  cpu;
+    BenchTime  gpu;
+    double     draws;
+    double     triangles;
+    double     states;
+} BenchRun;
+
+static int          count[BENCH_COUNT_MAX] = { 1, 16, 64 };
+static int          count_num = 3;
+static int          frames = 200;
+static int          warmup = 20;
+static int          xsize = 640, ysize = 480;
+static int          timer = 0;              /* the GL has timer queries */
+static GLuint       query;
+
+static int   parse_counts( char *s );
+static void *gl_proc( const char *name, const char *nameARB );
+static int   setup_gl( void );
+static void  make_poses( double (*pose)[16], int n, int frame );
+static void  bench_model( int id, int n, int mode, BenchRun *run );
+static void  add_time( BenchTime *t, double msec );
+static void  write_run( FILE *fp, char *model, int n, int mode, BenchRun *run, int first );
+static void  usage( char *com );
+
+int main( int argc, char *argv[] )
+{
+    char       *model[BENCH_MODEL_MAX];
+    int         model_num = 0;
+    char       *json_name = "benchVrml.json";
+    FILE       *fp;
+    BenchRun    run;
+    int         id, first = 1;
+    int         i, j, m;
+
+    glutInit( &argc, argv );
+    for( i = 1; i < argc; i++ ) {
+        if( strncmp( argv[i], "-instances=", 11 ) == 0 ) {
+            if( parse_counts( &argv[i][11] ) < 0 ) usage( argv[0] );
+        }
+        else if( strncmp( argv[i], "-frames=", 8 ) == 0 ) frames = atoi( &argv[i][8] );
+        else if( strncmp( argv[i], "-warmup=", 8 ) == 0 ) warmup = atoi( &argv[i][8] );
+        else if( strncmp( argv[i], "-size=", 6 ) == 0 ) {
+            if( sscanf( &argv[i][6], "%dx%d", &xsize, &ysize ) != 2 ) usage( argv[0] );
+        }
+        else if( strncmp( argv[i], "-json=", 6 ) == 0 ) json_name = &argv[i][6];
+        else if( argv[i][0] == '-' ) usage( argv[0] );
+        else {
+            if( model_num == BENCH_MODEL_MAX ) { printf("Too many models.\n"); exit(0); }
+            model[model_num++] = argv[i];
+        }
+    }
+    if( model_num == 0 || frames < 1 || warmup < 0 || xsize < 1 || ysize < 1 ) usage( argv[0] );
+
+    // Nothing is shown: the window only gives the GL context.
+    glutInitDisplayMode( GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH | GLUT_STENCIL );
+    glutInitWindowSize( 64, 64 );
+    glutCreateWindow( argv[0] );
+    glutHideWindow();
+    if( setup_gl() < 0 ) exit(0);
+
+    if( (fp = fopen( json_name, "w" )) == NULL ) {
+        printf("Cannot write %s.\n", json_name);
+        exit(0);
+    }
+    fprintf( fp, "[\n" );
+    for( i = 0; i < model_num; i++ ) {
+        if( (id = arVrmlLoadFile( model[i] )) < 0 ) {
+            printf("VRML %s load error !!\n", model[i]);
+            continue;
+        }
+        for( j = 0; j < count_num; j++ ) {
+            for( m = 0; m < MODE_NUM; m++ ) {
+                bench_model( id, count[j], m, &run );
+                write_run( fp, model[i], count[j], m, &run, first );
+                first = 0;
+            }
+        }
+        arVrmlFree( id );
+    }
+    fprintf( fp, "\n]\n" );
+    fclose( fp );
+
+    return 0;
+}
+
+static int parse_counts( char *s )
+{
+    char   *e;
+    long    n;
+
+    count_num = 0;
+    for( ;; ) {
+        n = strtol( s, &e, 10 );
+        if( e == s || n < 1 || count_num == BENCH_COUNT_MAX ) return -1;
+        count[count_num++] = (int)n;
+        if( *e == '\0' ) return 0;
+        if( *e != ',' ) return -1;
+        s = e + 1;
+    }
+}
+
+static void *gl_proc( const char *name, const char *nameARB )
+{
+    void *proc;
+
+#if defined(_WIN32)
+    if( !(proc = (void *)wglGetProcAddress( name )) ) proc = (void *)wglGetProcAddress( nameARB );
+#elif defined(__APPLE__)
+    proc = NULL;
+#else
+    if( !(proc = (void *)glXGetProcAddressARB( (const GLubyte *)name )) ) proc = (void *)glXGetProcAddressARB( (const GLubyte *)nameARB );
+#endif
+    return proc;
+}
+
+// The offscreen framebuffer, which is needed, and the timer query, which
+// only the gpu times are missing without.
+static int setup_gl( void )
+{
+    const char   *ext = (const char *)glGetString( GL_EXTENSIONS );
+    GLuint        fb, rb[2];
+
+    genFramebuffers         = (GenT)gl_proc( "glGenFramebuffers", "glGenFramebuffersEXT" );
+    bindFramebuffer         = (BindT)gl_proc( "glBindFramebuffer", "glBindFramebufferEXT" );
+    genRenderbuffers        = (GenT)gl_proc( "glGenRenderbuffers", "glGenRenderbuffersEXT" );
+    bindRenderbuffer        = (BindT)gl_proc( "glBindRenderbuffer", "glBindRenderbufferEXT" );
+    renderbufferStorage     = (StorageT)gl_proc( "glRenderbufferStorage", "glRenderbufferStorageEXT" );
+    framebufferRenderbuffer = (AttachT)gl_proc( "glFramebufferRenderbuffer", "glFramebufferRenderbufferEXT" );
+    checkFramebufferStatus  = (StatusT)gl_proc( "glCheckFramebufferStatus", "glCheckFramebufferStatusEXT" );
+    if( !genFramebuffers || !bindFramebuffer || !genRenderbuffers || !bindRenderbuffer
+     || !renderbufferStorage || !framebufferRenderbuffer || !checkFramebufferStatus ) {
+        printf("The GL has no framebuffer objects.\n");
+        return -1;
+    }
+
+    genFramebuffers( 1, &fb );
+    genRenderbuffers( 2, rb );
+    bindFramebuffer( GL_FRAMEBUFFER_EXT, fb );
+    bindRenderbuffer( GL_RENDERBUFFER_EXT, rb[0] );
+    renderbufferStorage( GL_RENDERBUFFER_EXT, GL_RGBA8, xsize, ysize );
+    framebufferRenderbuffer( GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, GL_RENDERBUFFER_EXT, rb[0] );
+    bindRenderbuffer( GL_RENDERBUFFER_EXT, rb[1] );
+    renderbufferStorage( GL_RENDERBUFFER_EXT, GL_DEPTH24_STENCIL8_EXT, xsize, ysize );
+    framebufferRenderbuffer( GL_FRAMEBUFFER_EXT, GL_DEPTH_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, rb[1] );
+    framebufferRenderbuffer( GL_FRAMEBUFFER_EXT, GL_STENCIL_ATTACHMENT_EXT, GL_RENDERBUFFER_EXT, rb[1] );
+    if( checkFramebufferStatus( GL_FRAMEBUFFER_EXT ) != GL_FRAMEBUFFER_COMPLETE_EXT ) {
+        printf("The offscreen framebuffer of %dx%d is not complete.\n", xsize, ysize);
+        return -1;
+    }
+    glViewport( 0, 0, xsize, ysize );
+
+    genQueries          = (GenT)gl_proc( "glGenQueries", "glGenQueriesARB" );
+    beginQuery          = (BeginQueryT)gl_proc( "glBeginQuery", "glBeginQueryARB" );
+    endQuery            = (EndQueryT)gl_proc( "glEndQuery", "glEndQueryARB" );
+    getQueryObjectui64v = (QueryResultT)gl_proc( "glGetQueryObjectui64v", "glGetQueryObjectui64vEXT" );
+    timer = ext != NULL && (strstr( ext, "GL_EXT_timer_query" ) || strstr( ext, "GL_ARB_timer_query" ))
+         && genQueries && beginQuery && endQuery && getQueryObjectui64v;
+    if( timer ) genQueries( 1, &query );
+    else        printf("The GL has no timer queries, the gpu times are left out.\n");
+
+    return 0;
+}
+
+// Column-major poses of n instances on a square grid facing the camera,
+// each turned about its vertical axis a little more every frame.
+static void make_poses( double (*pose)[16], int n, int frame )
+{
+    int     side = (int)ceil( sqrt( (double)n ) );
+    double  z = -(side * BENCH_SPACING * 1.3 + 200.0);
+    double  a;
+    int     k;
+
+    for( k = 0; k < n; k++ ) {
+        a = (frame * 2.0 + k * 10.0) * M_PI / 180.0;
+        memset( pose[k], 0, sizeof(pose[k]) );
+        pose[k][0]  =  cos( a );
+        pose[k][2]  = -sin( a );
+        pose[k][5]  =  1.0;
+        pose[k][8]  =  sin( a );
+        pose[k][10] =  cos( a );
+        pose[k][12] = ((k % side) - (side - 1) / 2.0) * BENCH_SPACING;
+        pose[k][13] = ((k / side) - (side - 1) / 2.0) * BENCH_SPACING;
+        pose[k][14] = z;
+        pose[k][15] = 1.0;
+    }
+}
+
+static void bench_model( int id, int n, int mode, BenchRun *run )
+{
+    double            (*pose)[16];
+    ARVrmlStats       stats;
+    unsigned long long gpu;
+    double            t0, t1;
+    double            h = 10.0 * tan( 22.5 * M_PI / 180.0 );
+    int               f, k;
+
+    if( (pose = (double (*)[16])malloc( sizeof(double[16]) * n )) == NULL ) {
+        printf("out of memory!!\n");
+        exit(1);
+    }
+    memset( run, 0, sizeof(BenchRun) );
+    run->cpu.min = run->gpu.min = DBL_MAX;
+
+    glMatrixMode( GL_PROJECTION );
+    glLoadIdentity();
+    glFrustum( -h * xsize / ysize, h * xsize / ysize, -h, h, 10.0, 10000.0 );
+    glMatrixMode( GL_MODELVIEW );
+
+    for( f = 0; f < warmup + frames; f++ ) {
+        make_poses( pose, n, f );
+        arVrmlTimerUpdate();
+        glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
+        glFinish();
+        arVrmlGetStats( &stats );
+
+        t0 = arUtilClock();
+        if( timer ) beginQuery( GL_TIME_ELAPSED_EXT, query );
+        glLoadIdentity();
+        if( mode == MODE_INSTANCED ) {
+            arVrmlDrawInstanced( id, (const double (*)[16])pose, n );
+        }
+        else {
+            for( k = 0; k < n; k++ ) {
+                glLoadMatrixd( pose[k] );
+                arVrmlDraw( id );
+            }
+        }
+        if( timer ) endQuery( GL_TIME_ELAPSED_EXT );
+        t1 = arUtilClock();
+        glFinish();
+        arVrmlGetStats( &stats );
+        if( f < warmup ) continue;
+
+        add_time( &run->cpu, (t1 - t0) * 1000.0 );
+        if( timer ) {
+            getQueryObjectui64v( query, GL_QUERY_RESULT_ARB, &gpu );
+            add_time( &run->gpu, gpu / 1000000.0 );
+        }
+        run->frames++;
+        run->draws     += stats.draws;
+        run->triangles += stats.triangles;
+        run->states    += stats.states;
+    }
+
+    free( pose );
+}
+
+static void add_time( BenchTime *t, double msec )
+{
+    t->sum += msec;
+    if( msec < t->min ) t->min = msec;
+    if( msec > t->max ) t->max = msec;
+}
+
+static void write_time( FILE *fp, const char *name, BenchTime *t, int frames )
+{
+    fprintf( fp, "\"%s\": {\"mean\": %.4f, \"min\": %.4f, \"max\": %.4f}",
+             name, t->sum / frames, t->min, t->max );
+}
+
+static void write_run( FILE *fp, char *model, int n, int mode, BenchRun *run, int first )
+{
+    const char *c;
+
+    fprintf( fp, "%s  {\"model\": \"", first? "": ",\n" );
+    for( c = model; *c != '\0'; c++ ) {
+        if( *c == '"' || *c == '\\' ) fputc( '\\', fp );
+        fputc( *c, fp );
+    }
+    fprintf( fp, "\", \"instances\": %d, \"mode\": \"%s\", \"frames\": %d,\n",
+             n, mode_name[mode], run->frames );
+    fprintf( fp, "   \"draws\": %.1f, \"triangles\": %.1f, \"states\": %.1f,\n",
+             run->draws / run->frames, run->triangles / run->frames, run->states / run->frames );
+    fprintf( fp, "   \"msec\": {" );
+    write_time( fp, "cpu", &run->cpu, run->frames );
+    if( timer ) {
+        fprintf( fp, ", " );
+        write_time( fp, "gpu", &run->gpu, run->frames );
+    }
+    fprintf( fp, "}}" );
+}
+
+static void usage( char *com )
+{
+    printf("Usage: %s [options] model.dat [model.dat ...]\n", com);
+    printf("  -instances=N,...  instances drawn together (default 1,16,64)\n");
+    printf("  -frames=N         frames measured of each run (default 200)\n");
+    printf("  -warmup=N         frames drawn before, not measured (default 20)\n");
+    printf("  -size=WxH         of the framebuffer (default 640x480)\n");
+    printf("  -json=file        where the results go (default benchVrml.json)\n");
+    exit(0);
+}
@@ -11,6 +11,11 @@ using namespace irrklang;
 
 Action::Action()
 {
+	this->point = 0;
+	this->base = 0;
+	this->model = 0;
+	this->handler = 0;
+	this->audio = 0;
 }
 
 Action::~Action()
@@ -1,9 +1,20 @@
 #ifndef Action_h
 #define Action_h
 
+#include "ArpeAlloc.h"
+
 class State;
+class iPoint;
+class Base;
+class ipObject;
+class Rules;
+namespace irrklang { class ISoundSource; }
+
+// Handler of an opcode, that applies the configuration or external action of
+// the point p, see Rules::compileRules().
+typedef int (*ActionHandler)(Rules *rules, iPoint *p);
 
-class Action {
+class Action : public ArpeAlloc {
 
  public:
 
@@ -33,6 +44,7 @@ class Action {
 	char		audioFilename[256];
     bool		audioOverplay;
 	int			audio3D; // 0 - 2D, 1 - 3D
+	irrklang::ISoundSource	*audio;	// audioFilename from the sound bank, by Rules::compileRules()
     
 	char		arduinoCommand[256];
 	char		eMsg[256];
@@ -51,6 +63,12 @@ class Action {
 
 	State*		myState;
 
+	//Resolved by Rules::compileRules()
+	iPoint*		point;		// Of ipointID
+	Base*		base;		// Of pointWaited, for GETBX, GETBY and GETBZ
+	ipObject*	model;		// Of modelToChange on point, for CHGM
+	ActionHandler handler;	// Of opcode and type, 0 when the type doesn't apply it
+
 	
 };
 
@@ -3,12 +3,12 @@
 #include <string.h>
 #include "Actuator.h"
 
-char Actuator::getBuff(char *buf, int n, FILE *fp)
+char Actuator::getBuff(char *buf, int n, CfgFile *fp)
 {
     char *ret;
 	
     for(;;) {
-        ret = fgets(buf, n, fp);
+        ret = cfgGets(buf, n, fp);
         if (ret == NULL) return(NULL);
         if (buf[0] != '\n' && buf[0] != '#') return(1); // Skip blank lines and comments.
     }
@@ -5,10 +5,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include "iPoint.h"
+#include "ConfigBundle.h"
+#include "ArpeAlloc.h"
 
 class Arpe;
 
-class Actuator {
+class Actuator : public ArpeAlloc {
 
  public:
 
@@ -16,7 +18,7 @@ class Actuator {
 
     void updateButton0( int value);
 
-	char getBuff(char *buf, int n, FILE *fp);
+	char getBuff(char *buf, int n, CfgFile *fp);
 	//virtual int actuatorReadFile() const = 0;
 
 	int grabPoint(iPoint *value);
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 //#include <GL/glut.h>
 #include <AR/ar.h>
@@ -21,6 +22,8 @@ ActuatorARTKSM::ActuatorARTKSM()
 	this->transporting = false;
 	this->transportingPoint = 0;
 	this->onUse = true;
+	this->pose = NULL;
+	arPoseFilterInit(&this->poseFilter);
 }
 
 ActuatorARTKSM::~ActuatorARTKSM()
@@ -28,14 +31,14 @@ ActuatorARTKSM::~ActuatorARTKSM()
 }
 
 int ActuatorARTKSM::actuatorReadFile(){
-	FILE          *fp;
+	CfgFile          *fp;
 	char		  buf[256],buf1[256],fileDAT[256];
 
 	//--------------------------------------------------------------------------
 	// Open the ActuatorARTKSM Configuration file
 	//--------------------------------------------------------------------------
 	printf("\n --------------------------------------------------------------------------");
-	if( (fp=fopen(this->configFilename,"r")) == NULL) {
+	if( (fp=cfgOpen(this->configFilename)) == NULL) {
 		printf("\n Error on opening %s !! ",this->configFilename);
 		return  -1;
 	}
@@ -46,7 +49,7 @@ int ActuatorARTKSM::actuatorReadFile(){
 	// READ THE Actuator Name
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s", &this->name) != 1) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1;	}
+	if (sscanf(buf, "%s", &this->name) != 1) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1;	}
 	printf("\n Actuator name: %s", this->name);
 
 	//--------------------------------------------------------------------------
@@ -54,20 +57,20 @@ int ActuatorARTKSM::actuatorReadFile(){
 	//--------------------------------------------------------------------------
 	// Marker that defines the actuator
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1;	}
-	if ((this->patternNumber = arLoadPatt(buf1)) < 0) { fclose(fp);  return(0);	}
+	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1;	}
+	if ((this->patternNumber = Arpe::loadMarker(buf1)) < 0) { cfgClose(fp);  return(0);	}
 	printf("\n Using marker: %s, id: %d", buf1, this->patternNumber); 
 	// Marker Width
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%lf", &this->markerWidth) != 1) { printf("\n Check %s file format", this->configFilename);fclose(fp); return -1;  }
+	if (sscanf(buf, "%lf", &this->markerWidth) != 1) { printf("\n Check %s file format", this->configFilename);cfgClose(fp); return -1;  }
 	// Marker Center
 	getBuff(buf, 256, fp);
 	if (sscanf(buf, "%lf %lf", &this->markerCenter[0], &this->markerCenter[1]) != 2) {
-			printf("\n Check %s file format", this->configFilename); fclose(fp); return(0);  }
+			printf("\n Check %s file format", this->configFilename); cfgClose(fp); return(0);  }
 	printf(" W: %3.2f, Center(%3.2f,%3.2f)", this->markerWidth , this->markerCenter[0], this->markerCenter[1]);
 	// Marker cover (USE_DEFAULT to get default marker cover / NO_COVER to don't use a marker cover)
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 	
 	if( strcmp(buf1, "NO_COVER") == 0){
 		this->cover = 0;
@@ -84,7 +87,7 @@ int ActuatorARTKSM::actuatorReadFile(){
 				//VRML Object
 				iVrml *c = new iVrml();
 				(*c).modelType = 1;
-				(*c).vrmlID = arVrmlLoadFile(fileDAT); 
+				(*c).vrmlID = iVrml::loadAsync(fileDAT); 
 				if ((*c).vrmlID < 0) {
 					printf("\n Error on Marker Base Cover %s file or on VRML file (%d)",fileDAT,(*c).vrmlID);
 					this->cover = 0;
@@ -101,12 +104,12 @@ int ActuatorARTKSM::actuatorReadFile(){
 	// READ THE Symbolic
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 	if (strcmp(buf1, "VRML") == 0) {
 		//VRML Object
 		iVrml *s = new iVrml();
 		(*s).modelType = 1;
-		(*s).vrmlID = arVrmlLoadFile(fileDAT); 
+		(*s).vrmlID = iVrml::loadAsync(fileDAT); 
 		if ((*s).vrmlID < 0) {
 			printf("\n Error on Symbolic object %s file or on VRML file (%d)",fileDAT,(*s).vrmlID);
 			this->symbol = 0;
@@ -122,7 +125,7 @@ int ActuatorARTKSM::actuatorReadFile(){
 	//--------------------------------------------------------------------------
 	// Point model
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 
 	if ( strcmp(buf1, "DEFAULT_IPOINT") == 0) { 
 		this->interactionPoint = (*myArpe).myGenericItens.holding;
@@ -134,7 +137,7 @@ int ActuatorARTKSM::actuatorReadFile(){
 			//VRML Object
 			iVrml *ip = new iVrml();
 			(*ip).modelType = 1;
-			(*ip).vrmlID = arVrmlLoadFile(fileDAT); 
+			(*ip).vrmlID = iVrml::loadAsync(fileDAT); 
 			printf("\n Point model object VRML id: %d ", (*ip).vrmlID);
 			if ((*ip).vrmlID < 0) {
 				printf("\n Error on Point model object %s file or on VRML file (%d)",fileDAT,(*ip).vrmlID);
@@ -142,7 +145,7 @@ int ActuatorARTKSM::actuatorReadFile(){
 			} else { 
 				printf("\n Point model object VRML id: %d ", (*ip).vrmlID); 
 				this->interactionPoint = ip;}
-			if ((*ip).vrmlID < 0) { fclose(fp); return(0); }
+			if ((*ip).vrmlID < 0) { cfgClose(fp); return(0); }
 			
 		} else {
 			printf("\n type not yet coded!!! Patience! ");
@@ -151,24 +154,38 @@ int ActuatorARTKSM::actuatorReadFile(){
 	// Translation (x,y,z) (mm)
 	getBuff(buf, 256, fp);
 	if( sscanf(buf, "%lf %lf %lf",	&this->ipTra[0], &this->ipTra[1], &this->ipTra[2]) != 3 ) {
-			printf("\n Check %s file format", this->configFilename);fclose(fp); return -1;  }
+			printf("\n Check %s file format", this->configFilename);cfgClose(fp); return -1;  }
 	// Action radius of the point
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%lf", &this->distCollision) != 1) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%lf", &this->distCollision) != 1) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 	printf("\n Point position from center (%3.2f,%3.2f,%3.2f), radius: %3.2f", 
 		this->ipTra[0], this->ipTra[1], this->ipTra[2], this->distCollision);
 
-	fclose(fp);
+	cfgClose(fp);
 	
 	return 0;
 }
 
 int ActuatorARTKSM::showActuatorItens(){
 	GLdouble m[16];
+	double trans[3][4];
+	double center[3];
+
+	// Where the marker is now rather than when its frame was captured.
+	if (arPoseFilterPredict(&this->poseFilter, arUtilTimer(), trans) < 0)
+		memcpy(trans, this->markerTrans, sizeof(trans));
+	arglCameraViewRH(trans,m,VIEW_SCALEFACTOR_1);
+
+	// Skip the models when the marker and the interaction point are out of view.
+	center[0] = this->ipTra[0] * 0.5;
+	center[1] = this->ipTra[1] * 0.5;
+	center[2] = this->ipTra[2] * 0.5;
+	if (!this->myArpe->sphereInView(m, center,
+		sqrt(center[0]*center[0] + center[1]*center[1] + center[2]*center[2]) + this->distCollision + BASE_BOUND_MARGIN,
+		NULL)) return 1;
 
 	glPushMatrix();
 		glLoadIdentity();
-		arglCameraViewRH(this->markerTrans,m,VIEW_SCALEFACTOR_1);
 		glLoadMatrixd(m);
 		
 		// DRAW MARKER COVER
@@ -215,67 +232,60 @@ int ActuatorARTKSM::showActuatorItens(){
 }
 
 
-int ActuatorARTKSM::searchActuatorOnFrame(ARMarkerInfo **marker_info, int marker_num){
+int ActuatorARTKSM::findActuatorOnFrame(ARMarkerInfo *marker_info, int marker_num){
 
-	bool	cdChanged = false;
-	int		cd=100;
-	int		toggleBase = 0;
 	int		j, k;
 
-		//SACRA ACOCHAMBRO
-//	double	m1Trans[3][4];
-//	double	m2Trans[3][4];
-//	double	mResult[3][4]; 
-//	double	matInv[3][4];
+	k = -1;
+	for (j = 0; j < marker_num; j++) {
+		if (marker_info[j].id == this->patternNumber) {
+			if( k == -1 ) k = j; // First marker detected.
+			else if (marker_info[k].cf < marker_info[j].cf) k = j; }
+	}
+	return k;
+}
+
+
+int ActuatorARTKSM::updateActuatorPose(bool found, double time){
+
+	if (found) {
+		this->visible = 1;
+		arPoseFilterUpdate(&this->poseFilter, this->markerTrans, time, this->filterTrans);
+		this->updateTrans( this->filterTrans );
+		this->updateButton0( this->visible );
+		if (this->pose != NULL) {
+			memcpy(this->pose->trans, this->interactionTrans, sizeof(this->pose->trans));
+			this->pose->visible = 1;
+		}
+		//printf("\n Found Actuator %d %s", (*a).id, (*a).name);
+		return TRUE;
+	} else { 
+		this->visible = 0; 
+		arPoseFilterReset(&this->poseFilter);
+		this->updateButton0( this->visible);
+		if (this->pose != NULL) this->pose->visible = 0;
+		return 2;
+	}
+}
 
-	static	double diff[3][4];
-	static	int matInit=1;
+
+int ActuatorARTKSM::searchActuatorOnFrame(ARMarkerInfo **marker_info, int marker_num){
+
+	int		k;
 
 	ARMarkerInfo           *auxMarker_info;
 
 	auxMarker_info = *marker_info;
 
 
-				k = -1;
-				for (j = 0; j < marker_num; j++) {
-					if (auxMarker_info[j].id == this->patternNumber) {
-						if( k == -1 ) k = j; // First marker detected.
-						else if (auxMarker_info[k].cf < auxMarker_info[j].cf) k = j; }
-				}
+				k = this->findActuatorOnFrame(auxMarker_info, marker_num);
 
 				if (k != -1) {
 					if (this->visible == 0) {
 						arGetTransMat(&auxMarker_info[k], this->markerCenter, this->markerWidth, this->markerTrans);
-
-						//if(matInit || cdChanged){
-						//	for (int u=0;u<3;u++)
-						//		for (int v=0;v<4;v++){ m1Trans[u][v]=0.0; m2Trans[u][v]=0.0; }
-
-						//		m1Trans[0][0] = m2Trans[0][0] = 1.0;
-						//		m1Trans[1][1] = m1Trans[2][2] = -1.0;
-						//		m2Trans[1][1] = m2Trans[2][2] = -1.0;
-						//		arUtilMatInv(m1Trans, matInv);
-						//		arUtilMatMul(matInv,m2Trans,diff);
-						//		matInit = 0;
-						//		cdChanged=false;
-						//}
-
 					} else { 
 						arGetTransMatCont(&auxMarker_info[k], this->markerTrans, this->markerCenter, this->markerWidth, this->markerTrans);
 					}
-					this->visible = 1;
-				/*	arUtilMatMul(this->markerTrans,diff,mResult);
-					for(int u=0;u<3;u++)
-						for(int v=0;v<4;v++)
-							this->markerTrans[u][v] = mResult[u][v];*/
-
-					this->updateTrans( this->markerTrans );
-					this->updateButton0( this->visible );
-					//printf("\n Found Actuator %d %s", (*a).id, (*a).name);
-					return TRUE;
-				} else { 
-					this->visible = 0; 
-					this->updateButton0( this->visible);
-					return 2;
 				}
+				return this->updateActuatorPose( k != -1, arUtilTimer() );
 }
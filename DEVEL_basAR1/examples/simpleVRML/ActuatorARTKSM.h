@@ -3,6 +3,7 @@
 
 #include "Actuator.h"
 #include "iObject3D.h"
+#include "TrackPose.h"
 #include <AR/ar.h>
 
 
@@ -14,6 +15,11 @@ class ActuatorARTKSM : public Actuator {
 	int showActuatorItens();
 
 	int searchActuatorOnFrame(ARMarkerInfo **marker_info, int marker_num);
+	// Index of the most confident marker of the actuator, -1 if not seen.
+	int findActuatorOnFrame(ARMarkerInfo *marker_info, int marker_num);
+	// Publish markerTrans, measured at time, or the loss of the actuator
+	// when not found.
+	int updateActuatorPose(bool found, double time);
 
     ActuatorARTKSM();
 
@@ -24,6 +30,8 @@ class ActuatorARTKSM : public Actuator {
     
     double markerCoord[4][2];
     double markerTrans[3][4];
+    ARPoseFilter poseFilter;		// Smooths markerTrans and predicts it at display time.
+    double filterTrans[3][4];		// markerTrans filtered.
     double markerWidth;
     double markerCenter[2];
 
@@ -31,6 +39,8 @@ class ActuatorARTKSM : public Actuator {
     iObject3D* symbol;
     iObject3D* interactionPoint;
     double ipTra[3];
+
+    TrackPose *pose;				// Its entry of Arpe::actuatorPose, NULL until indexed.
 };
 
 #endif // ActuatorARTKSM_h
@@ -0,0 +1,51 @@
+#include <windows.h>
+#include <crtdbg.h>
+#include <stdio.h>
+
+#include <AR/config.h>
+#include <AR/ar.h>
+
+#include "AllocCheck.h"
+
+static int						checking = FALSE;
+static __declspec(thread) long	allocs = 0;			// By the hook, of the thread.
+static __declspec(thread) long	seen = 0;			// allocs at the end of the last frame.
+static __declspec(thread) long	frames = 0;
+
+#ifdef _DEBUG
+// Called by the debug CRT for each allocation of the process, on the thread
+// that makes it; it must not allocate itself.
+static int allocHook(int type, void *data, size_t size, int block, long request,
+	const unsigned char *file, int line)
+{
+	if (type == _HOOK_ALLOC || type == _HOOK_REALLOC) allocs++;
+	return TRUE;
+}
+#endif
+
+void allocCheckStart(void)
+{
+#ifdef _DEBUG
+	_CrtSetAllocHook(allocHook);
+	checking = TRUE;
+	printf("\n Allocations checked after %d frames of each thread", ALLOC_CHECK_WARMUP);
+#else
+	printf("\n -alloccheck needs a Debug build");
+#endif
+}
+
+void allocCheckFrame(const char *thread)
+{
+	long n;
+
+	arFrameReset();
+	if (!checking) return;
+
+	n = allocs - seen;
+	if (++frames > ALLOC_CHECK_WARMUP && n > 0) {
+		printf("\n Alloc check: frame %ld of %s made %ld allocations", frames, thread, n);
+		_ASSERTE(n == 0);
+	}
+	// What the printf took is not the next frame's.
+	seen = allocs;
+}
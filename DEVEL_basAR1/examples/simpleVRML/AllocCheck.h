@@ -0,0 +1,22 @@
+#ifndef AllocCheck_h
+#define AllocCheck_h
+
+// Check that the frames of the steady state call no malloc(), with
+// -alloccheck on the command line.
+//
+// The temporaries of a frame come from the frame arena of its thread, see
+// arFrameAlloc(). allocCheckFrame() ends the frame of the calling thread:
+// it resets the arena and, with the check on, tells how many allocations
+// the thread made in the frame once ALLOC_CHECK_WARMUP frames have gone by,
+// counted by a hook of the debug CRT. A Release build has no hook and only
+// resets the arena.
+//
+// The scenes loaded or evicted for the memory budget are not steady: their
+// first draws decode textures and compile display lists.
+
+#define ALLOC_CHECK_WARMUP	300		// Frames of a thread before it is checked.
+
+void	allocCheckStart(void);
+void	allocCheckFrame(const char *thread);
+
+#endif // AllocCheck_h
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <ctype.h>
 
 #include <GL/glut.h>
 #include <AR/ar.h>
@@ -26,18 +28,86 @@
 #include "iObject3D.h"
 #include "ipDist.h"
 #include "iPoint.h"
+#include "Startup.h"
+#include "Log.h"
 
 
 #include <list>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <string>
 using namespace std;
 
+// The device every session plays its sounds on, made by the first one.
+ISoundEngine* Arpe::sharedAudioEngine()
+{
+	static ISoundEngine *engine = 0;
+
+	if (engine == 0) engine = createIrrKlangDevice();
+	return engine;
+}
+
+// The contents of a pattern file, as FNV-1a of its bytes and its length,
+// 0 and -1 when it can't be read.
+static pair<unsigned long, long> patternHash(const char *name)
+{
+	FILE *fp;
+	unsigned char buf[4096];
+	unsigned long hash = 2166136261UL;
+	long length = 0;
+	size_t i, n;
+
+	if ((fp = fopen(name, "rb")) == NULL) return make_pair(0UL, -1L);
+	while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+		for (i = 0; i < n; i++) hash = ((hash ^ buf[i]) * 16777619UL) & 0xffffffffUL;
+		length += (long)n;
+	}
+	fclose(fp);
+	return make_pair(hash, length);
+}
+
+// arLoadMarker(), once for each marker, so that the sessions of the process
+// and iPuzzle reading the same markers have the same patterns and ids. The
+// names are compared with the case and separators of Windows, and a file
+// of the same contents as one loaded, under another name, takes its id too,
+// so that no pattern sits twice in the table to be matched against twice.
+int Arpe::loadMarker(const char *name)
+{
+	static map<string, int> loaded;
+	static map<pair<unsigned long, long>, int> contents;
+	map<string, int>::iterator it;
+	map<pair<unsigned long, long>, int>::iterator ct;
+	pair<unsigned long, long> hash(0UL, -1L);
+	string key(name);
+	size_t i;
+	int id;
+
+	for (i = 0; i < key.size(); i++) key[i] = (key[i] == '\\')? '/': (char)tolower((unsigned char)key[i]);
+	if ((it = loaded.find(key)) != loaded.end()) return (*it).second;
+	if (strncmp(name, "matrix:", 7) != 0) {
+		hash = patternHash(name);
+		if (hash.second >= 0 && (ct = contents.find(hash)) != contents.end()) {
+			loaded[key] = (*ct).second;
+			return (*ct).second;
+		}
+	}
+	startupBegin(STARTUP_PATTERN);
+	id = arLoadMarker(name);
+	startupEnd();
+	if (id < 0) return id;
+	loaded[key] = id;
+	if (hash.second >= 0) contents[hash] = id;
+	return id;
+}
+
 
-char Arpe::getBuff(char *buf, int n, FILE *fp)
+char Arpe::getBuff(char *buf, int n, CfgFile *fp)
 {
     char *ret;
 	
     for(;;) {
-        ret = fgets(buf, n, fp);
+        ret = cfgGets(buf, n, fp);
         if (ret == NULL) return(NULL);
         if (buf[0] != '\n' && buf[0] != '#') return(1); // Skip blank lines and comments.
     }
@@ -46,13 +116,162 @@ char Arpe::getBuff(char *buf, int n, FILE *fp)
 Arpe::Arpe()
 {
 	this->myGame.myArpe = this;
-	this->audioEngine = createIrrKlangDevice();
+	this->audioEngine = sharedAudioEngine();
 	strcpy(configFilename,"Data/config_basar");
+	this->baseTransBuf = NULL;
+	this->baseInvBuf = NULL;
+	this->baseBufMax = 0;
+	this->actuatorPose = NULL;
+	this->poseActuator = NULL;
+	this->actuatorPoses = 0;
+	this->basePose = NULL;
+	this->poseBase = NULL;
+	this->basePoses = 0;
+	memset(this->viewPlane, 0, sizeof(this->viewPlane));
+	this->markerState = -1;
+	this->prefetchState = -1;
+	sessions().push_back(this);
 }
 
 Arpe::~Arpe()
 {
+	vector<Arpe*> &all = sessions();
+
+	all.erase(remove(all.begin(), all.end(), this), all.end());
+	delete[] this->baseTransBuf;
+	delete[] this->baseInvBuf;
+	arImageFree(this->actuatorPose);
+	delete[] this->poseActuator;
+	arImageFree(this->basePose);
+	delete[] this->poseBase;
+}
+
+vector<Arpe*> &Arpe::sessions()
+{
+	static vector<Arpe*> all;
+
+	return all;
+}
+
+// The markers the state of the rules needs: those of the actuators, of the
+// bases its actions name and of the bases that still show a point, set by
+// an earlier state. The others aren't matched until a state needs them.
+void Arpe::updateMarkers()
+{
+	list<Actuator*>::iterator a;
+	list<Base*>::iterator b;
+	State *st;
+
+	this->markerState = this->myRules->actualState;
+	this->markerWanted.clear();
+	for (a = this->listActuator.begin(); a != this->listActuator.end(); a++)
+		if ((*a)->type == 1) this->markerWanted.push_back(static_cast<ActuatorARTKSM*>(*a)->patternNumber);
+	if ((st = this->myRules->findState(this->myRules->actualState)) != 0)
+		this->markerWanted.insert(this->markerWanted.end(), st->patterns.begin(), st->patterns.end());
+	for (b = this->listBase.begin(); b != this->listBase.end(); b++)
+		if ((*b)->showsPoints()) (*b)->markerPatterns(this->markerWanted);
+	applyMarkers();
+}
+
+// Adds the VRML id of the model of obj, if it has one and it isn't there.
+static void prefetchModel(vector<int> &ids, ipObject *obj)
+{
+	iObject3D *i3D;
+
+	if (obj == 0 || obj->type != 1) return;
+	i3D = static_cast<iObject3D*>(obj);
+	if (i3D->modelType != 1) return;
+	if (find(ids.begin(), ids.end(), static_cast<iVrml*>(i3D)->vrmlID) == ids.end())
+		ids.push_back(static_cast<iVrml*>(i3D)->vrmlID);
+}
+
+// What the states within PREFETCH_DEPTH transitions of the actual one will
+// show and play, so that going to them loads nothing: the models their
+// actions change to, those their point modes show (the balls, the active
+// object, all the objects) and their sounds, which are put in the bank now.
+// The models are readied by prefetch() on the frames until the state changes.
+void Arpe::updatePrefetch()
+{
+	GenericItens *g = &this->myGenericItens;
+	vector<State*> states;
+	list<Action*>::iterator a;
+	list<ipObject*>::iterator o;
+	iPoint *p;
+	size_t i;
+
+	this->prefetchState = this->myRules->actualState;
+	this->prefetchWanted.clear();
+	this->myRules->upcomingStates(PREFETCH_DEPTH, states);
+	for (i = 0; i < states.size(); i++) {
+		for (a = states[i]->listAction.begin(); a != states[i]->listAction.end(); a++) {
+			if ((*a)->audio == 0 && strcmp((*a)->audioFilename, "") != 0)
+				(*a)->audio = audioBankSource(this->audioEngine, (*a)->audioFilename);
+			prefetchModel(this->prefetchWanted, (*a)->model);
+			if ((p = (*a)->point) == 0 || p->type != 1 || (*a)->type != 1) continue;
+			switch ((*a)->pointMode) {
+			case 1: case 3: case 4: case 6: case 7:		// The ball
+				prefetchModel(this->prefetchWanted, p->ball.holding != 0 ? p->ball.holding : g->holding);
+				if ((*a)->pointMode != 6) break;
+				prefetchModel(this->prefetchWanted, p->ball.canWork != 0 ? p->ball.canWork : g->canwork);
+				prefetchModel(this->prefetchWanted, p->ball.cannotWork != 0 ? p->ball.cannotWork : g->cannotWork);
+				break;
+			default: break;
+			}
+			switch ((*a)->pointMode) {
+			case 2: case 3:								// The active object
+				if (p->activeObjectID > 0) prefetchModel(this->prefetchWanted, p->findObject(p->activeObjectID));
+				break;
+			case 7:										// All the objects
+				for (o = p->listObject.begin(); o != p->listObject.end(); o++) prefetchModel(this->prefetchWanted, *o);
+				break;
+			default: break;
+			}
+		}
+	}
+	logDebug("
+ Prefetch: %d models for %d states after state %d", (int)this->prefetchWanted.size(), (int)states.size(), this->prefetchState);
+}
+
+// Keeps the models of updatePrefetch() from being evicted and has them
+// loaded back and drawn once, see arVrmlPrefetch().
+void Arpe::prefetch()
+{
+	size_t i;
 
+	for (i = 0; i < this->prefetchWanted.size(); i++) arVrmlPrefetch(this->prefetchWanted[i]);
+}
+
+// The pattern table is the process's, so a marker is matched while the
+// state of any session needs it. Patterns loaded other than for the
+// actuators and bases of the sessions are left as they are.
+void Arpe::applyMarkers()
+{
+	static map<int, int> applied;
+	map<int, int> active;
+	map<int, int>::iterator it;
+	vector<Arpe*> &all = sessions();
+	vector<int> patt, flag, own;
+	list<Actuator*>::iterator a;
+	list<Base*>::iterator b;
+	size_t i, k;
+
+	for (k = 0; k < all.size(); k++) {
+		own.clear();
+		for (a = all[k]->listActuator.begin(); a != all[k]->listActuator.end(); a++)
+			if ((*a)->type == 1) own.push_back(static_cast<ActuatorARTKSM*>(*a)->patternNumber);
+		for (b = all[k]->listBase.begin(); b != all[k]->listBase.end(); b++) (*b)->markerPatterns(own);
+		for (i = 0; i < own.size(); i++) active.insert(make_pair(own[i], 0));
+		// Sessions whose rules haven't run yet need all of theirs.
+		if (all[k]->markerState == -1) for (i = 0; i < own.size(); i++) active[own[i]] = 1;
+		else for (i = 0; i < all[k]->markerWanted.size(); i++) active[all[k]->markerWanted[i]] = 1;
+	}
+	if (active == applied) return;
+	for (it = active.begin(); it != active.end(); it++) {
+		patt.push_back((*it).first);
+		flag.push_back((*it).second);
+	}
+	if (!patt.empty()) arSetPattActive(&patt[0], &flag[0], (int)patt.size());
+	applied.swap(active);
 }
 
 int Arpe::arpeSetupEnvironment(){
@@ -64,7 +283,7 @@ int Arpe::arpeSetupEnvironment(){
 
 int Arpe::arpeReadFiles(){
 
-	FILE			*fp;
+	CfgFile			*fp;
 	char			buf[256],buf1[256],buf2[256],fileDAT[256];
 	double			auxVolume, scW, scH, scBD, scRR, retscan;
 	int				numBases, numActuators;
@@ -76,7 +295,7 @@ int Arpe::arpeReadFiles(){
 	// Open the ARPE Configuration file
 	//--------------------------------------------------------------------------
 	printf("\n --------------------------------------------------------------------------");
-	if( (fp=fopen(this->configFilename,"r")) == NULL) {
+	if( (fp=cfgOpen(this->configFilename)) == NULL) {
 		printf("\n Error on opening %s !! ",this->configFilename);
 		return -1;
 	}
@@ -86,7 +305,7 @@ int Arpe::arpeReadFiles(){
 	// Read Application name
 	//--------------------------------------------------------------------------
 	getBuff(this->appName, 256, fp);
-	//if( sscanf(buf, "%s", &this->appName) != 1) { printf("\n Check %s file format", this->configFilename); fclose(fp); return(0);}
+	//if( sscanf(buf, "%s", &this->appName) != 1) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return(0);}
 	printf("\n appName: %s ", this->appName);
 	//--------------------------------------------------------------------------
 	// Read Screen properties
@@ -147,13 +366,13 @@ int Arpe::arpeReadFiles(){
 	//--------------------------------------------------------------------------
 	// - HOLDING Default iPoint object
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 	// Load Object	
 	if (strcmp(buf1, "VRML") == 0) {
 		//VRML Object
 		iVrml* h = new iVrml();
 		(*h).modelType = 1;
-		(*h).vrmlID = arVrmlLoadFile(fileDAT); 
+		(*h).vrmlID = iVrml::loadAsync(fileDAT); 
 		if ((*h).vrmlID < 0) {
 			printf("\n Error on Default holding iPoint object %s file or on VRML file (%d)",fileDAT,(*h).vrmlID);
 			this->myGenericItens.holding = 0;
@@ -168,13 +387,13 @@ int Arpe::arpeReadFiles(){
 	}
 	// - CANWORK Default iPoint object
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 	// Load Object	
 	if (strcmp(buf1, "VRML") == 0) {
 		//VRML Object
 		iVrml* cw = new iVrml();
 		(*cw).modelType = 1;
-		(*cw).vrmlID = arVrmlLoadFile(fileDAT); 
+		(*cw).vrmlID = iVrml::loadAsync(fileDAT); 
 		if ((*cw).vrmlID < 0) {
 			printf("\n Error on Default canwork iPoint %s file or on VRML file (%d)",fileDAT,(*cw).vrmlID);
 			this->myGenericItens.canwork = 0;
@@ -189,14 +408,14 @@ int Arpe::arpeReadFiles(){
 	}
 	// - CANNOTWORK Default holding iPoint object
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 
 	// Load Object	
 	if (strcmp(buf1, "VRML") == 0) {
 		//VRML Object
 		iVrml* cnw = new iVrml();
 		(*cnw).modelType = 1;
-		(*cnw).vrmlID = arVrmlLoadFile(fileDAT);
+		(*cnw).vrmlID = iVrml::loadAsync(fileDAT);
 		if ((*cnw).vrmlID < 0) {
 			printf("\n Error on Default cannotwork iPoint %s file or on VRML file (%d)",fileDAT,(*cnw).vrmlID);
 			this->myGenericItens.cannotWork = 0;
@@ -212,14 +431,14 @@ int Arpe::arpeReadFiles(){
 	}
 	// - Default marker Cover
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 
 	// Load Object	
 	if (strcmp(buf1, "VRML") == 0) {
 		//VRML Object
 		iVrml* mc = new iVrml();
 		(*mc).modelType = 1;
-		(*mc).vrmlID = arVrmlLoadFile(fileDAT); 
+		(*mc).vrmlID = iVrml::loadAsync(fileDAT); 
 		if ((*mc).vrmlID < 0) {
 			printf("\n Error on Default marker Cover %s file or on VRML file (%d)",fileDAT,(*mc).vrmlID);
 			this->myGenericItens.markCover = 0;
@@ -236,13 +455,13 @@ int Arpe::arpeReadFiles(){
 	// Read Standard error sound
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s ", &buf1) != 1) { printf("\n error sound - Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s ", &buf1) != 1) { printf("\n error sound - Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 
 	if( strcmp(buf1,"NO_ERRORSOUND") == 0){ 
 		this->myGenericItens.errorSound = 0;
 		printf("\n No default error audio");
 	} else {
-			if (sscanf(buf, "%s %lf", &buf1,&auxVolume) != 2) { printf("\n error sound - Check %s file format", this->configFilename); fclose(fp); return -1; }
+			if (sscanf(buf, "%s %lf", &buf1,&auxVolume) != 2) { printf("\n error sound - Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 
 			AudioArpe *se = new AudioArpe();
 			strcpy((*se).filename,buf1);
@@ -262,13 +481,13 @@ int Arpe::arpeReadFiles(){
 	// Read Soundtrack Audio
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s ", &buf1) != 1) { printf("\n Soundtrack sound - Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s ", &buf1) != 1) { printf("\n Soundtrack sound - Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 
 	if( strcmp(buf1,"NO_BACKTRACK") == 0){ 
 		this->soundTrack = 0;
 		printf("\n No backtrack audio");
 	} else {
-		if (sscanf(buf, "%s %s %lf", &buf1, &buf2, &auxVolume) != 3) { printf("\n Soundtrack sound - Check %s file format", this->configFilename); fclose(fp); return -1; }
+		if (sscanf(buf, "%s %s %lf", &buf1, &buf2, &auxVolume) != 3) { printf("\n Soundtrack sound - Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 
 		AudioArpe *st = new AudioArpe();
 
@@ -290,13 +509,13 @@ int Arpe::arpeReadFiles(){
 	// Read Start Audio
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s ", &buf1) != 1) { printf("\n Start sound - Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s ", &buf1) != 1) { printf("\n Start sound - Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 
 	if( strcmp(buf1,"NO_STARTSOUND") == 0){ 
 		this->startAudio = 0;
 		printf("\n No start audio");
 	} else {
-		if (sscanf(buf, "%s %s %lf", &buf1, &buf2, &auxVolume) != 3) { printf("\n Start sound - Check %s file format", this->configFilename); fclose(fp); return -1; }
+		if (sscanf(buf, "%s %s %lf", &buf1, &buf2, &auxVolume) != 3) { printf("\n Start sound - Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 
 		AudioArpe *sa = new AudioArpe();
 
@@ -318,7 +537,7 @@ int Arpe::arpeReadFiles(){
 	// Read	Behavior configuration file
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 
 	Rules *mr = new Rules();
 	strcpy((*mr).configFilename,buf1);
@@ -329,7 +548,7 @@ int Arpe::arpeReadFiles(){
 	// Read	number of bases to create
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%d", &numBases) != 1) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%d", &numBases) != 1) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 	//--------------------------------------------------------------------------
 	// Read	the bases configuration files and save on base structures
 	//--------------------------------------------------------------------------
@@ -337,7 +556,7 @@ int Arpe::arpeReadFiles(){
 
 		Base *b = new Base();
 		getBuff(buf, 256, fp);
-		if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+		if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 		(*b).id = i+1;
 		strcpy((*b).configFilename,buf1);
 		printf("\n Base %d configuration file: %s",(*b).id, (*b).configFilename);
@@ -349,14 +568,14 @@ int Arpe::arpeReadFiles(){
 	// Read	number of actuators to create
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%d", &numActuators) != 1) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%d", &numActuators) != 1) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 	//--------------------------------------------------------------------------
 	// Read	the bases configuration files and save on base structures
 	//--------------------------------------------------------------------------
 	for(int j = 0; j < numActuators ; j++){
 
 		getBuff(buf, 256, fp);
-		if (sscanf(buf, "%s %s", &buf1, &buf2) != 2) { printf("\n Check %s file format", this->configFilename); fclose(fp); return -1; }
+		if (sscanf(buf, "%s %s", &buf1, &buf2) != 2) { printf("\n Check %s file format", this->configFilename); cfgClose(fp); return -1; }
 		
 		if(strcmp(buf1,"ARTKSM")==0){
 			ActuatorARTKSM *a = new ActuatorARTKSM();
@@ -400,7 +619,7 @@ int Arpe::arpeReadFiles(){
 
 
 	printf("\n %s correctly read!",this->configFilename);
-	fclose(fp);
+	cfgClose(fp);
 	return 1;
 }
 
@@ -413,195 +632,347 @@ void Arpe::addBase(Base* value)
 	list<Base*>::iterator it;
 	it = this->listBase.begin();
 	this->listBase.push_back(value);
+	this->baseIndex.add(value->id, value);
 
 }
 
+// Every actuator is tested against the points as the frame left them, then
+// the events are resolved in the order of the actuators: a point grabbed by
+// one of them can't be grabbed by a later one in the same frame, and the
+// first event that changes the state gives the next state of the frame.
+// Returns the events resolved, 1 when there were none.
 int Arpe::interactionControl()
 {
 	int toReturn = 0;
+	AR_TRACE_SCOPE("interactionControl");
+
+	// The rules and the actuator tests below use the base inverses, and the
+	// grids of the points, moved by the rules of the last frame.
+	this->updateBaseInverses();
+	for (list<Base*>::iterator b = this->listBase.begin(); b != this->listBase.end(); b++)
+		(*(*b)).refreshGrid();
+
 	//printf(
-	if(this->myRules->lockParser == 0 )
+	if ((*this->myRules).applyReload()) this->markerState = this->prefetchState = -1;
+	if((*this->myRules).updateParserLock() == 0 )
 		(*this->myRules).parseRule();
+	if (this->myRules->actualState != this->markerState) this->updateMarkers();
+	if (this->myRules->actualState != this->prefetchState) this->updatePrefetch();
 	//printf("\n interactionControl... OK, NS:%d, AS:%d",this->myRules->nextState,this->myRules->actualState);
 	//Test if actuator got a iPoint and the reactions
-	list<Actuator*>::iterator itActuator;
-	iPoint *movingPoint;
-	iPoint *collidePoint;
+	ActuatorEvent e;
+	TrackPose *pose;
 	double distance = 0;
-	int result = 0;
-
-	//SCAN THE ACTUATORS AND TEST WHAT IT IS DOIND AND CHECK THE POINT ACTIONS
-	for( itActuator = this->listActuator.begin() ; itActuator != this->listActuator.end() ; itActuator++){
-	//	printf("\n Testing Act %s.", (*itActuator)->name);
-
-		switch( (*(*itActuator)).transporting){
-
-		case 0:{ // ACTUATOR ISN'T TRANSPORTING ANYTHING
-			switch ( (*(*itActuator)).buttons[0]){
-				case 0:{ // CONTROL BUTTON ISN'T ACTIVE (MARKER NOT VISIBLE)
-					toReturn = 1;
-					break;}
-				case 1:{ // CONTROL BUTTON IS ACTIVE (MARKER IS VISIBLE)
-					// TRY TO DO AN ACTION WITH ANY POINT
-					// Search for the closest point to the actuator
-					collidePoint = this->findPointNearActuator((*itActuator),&distance);
-					if (collidePoint == 0) {toReturn = 1; // NO COLLISION BETWEEN ACTUATOR AND POINT
-					} else {
-						if(this->myRules->lockParser == 0 ){
-
-							// COLLISION HANDLING
-							switch(	(*(*collidePoint).actualAction).opcode){
-							case 1: { // STAT
-								return (*this->myRules).stat(collidePoint);
-								break;}
-							case 2: { // DRGF
-								return (*this->myRules).drgf(collidePoint,(*itActuator));
-								break;}
-							case 3: { // DRGRP
-								return (*this->myRules).drgrp_grab(collidePoint,(*itActuator));
-								break;}
-							case 11: { // CHGST
-								return (*this->myRules).chgst(collidePoint);
-								break;}
-							default: break;				
-							}
-						}
-					}
-				break;}
-			default:  break;};
-			break;}
-
-		case 1:{ // ACTUATOR IS TRANSPORTING A POINT
-	
-			// COLLISION HANDLING
-			switch ( (*(*itActuator)).buttons[0]){
-				case 0:{ // CONTROL BUTTON ISN'T ACTIVE (MARKER NOT VISIBLE)
-					// SEARCH THE CLOSEST POINT EXCEPT BY THE ONE THAT IS BEEN CARRIED
-					movingPoint = (*(*itActuator)).transportingPoint;
-					collidePoint = this->findPointNearActuator((*itActuator),&distance);
-					if (collidePoint == 0) {// NO COLLISION BETWEEN ACTUATOR AND POINT
-						(*(*itActuator)).releasePoint();
-						return this->releasePoint(movingPoint); 
-					}
-					// RELEASE OR DROP
-					switch((*(*collidePoint).actualAction).opcode){
-					case 7:{ // DRPO
-						return (*this->myRules).drpo(collidePoint,(*itActuator),movingPoint);
-						break;}
-					case 8:{ // DRPA
-						return (*this->myRules).drpa(collidePoint,(*itActuator),movingPoint);
-						break;}
-					default: 
-						(*(*itActuator)).releasePoint();
-						return this->releasePoint(movingPoint);
-						break;
-					};
-					break;}
-				case 1:{ // CONTROL BUTTON IS ACTIVE (MARKER IS VISIBLE)
-					// SEARCH THE CLOSEST POINT EXCEPT BY THE ONE THAT IS BEEN CARRIED
-					movingPoint = (*(*itActuator)).transportingPoint;
-					collidePoint = this->findPointNearActuator((*itActuator),&distance);
-					if (collidePoint == 0) return this->movePoint(movingPoint,(*itActuator)); // NO COLLISION BETWEEN ACTUATOR AND POINT
-					// KEEP MOVING OR COLLIDE AND TEST REACTION
-					switch((*(*collidePoint).actualAction).opcode){
-						case 3: { // DRGRP (IF collides repels moving point to origin)
-							return (*this->myRules).drgrp_collided(collidePoint,(*itActuator),movingPoint);
-							break;}
-						case 4: { // ATTO (If collides attract moving point to it) (Clone trans/rot/scale of the point)
-							return (*this->myRules).atto(collidePoint,(*itActuator),movingPoint);
-							break;}
-						case 5: { // ATTRP (If collides attracts point to it and repels any other point) (Clone trans/rot/scale of the point)
-							return (*this->myRules).attrp(collidePoint,(*itActuator),movingPoint);					
-							break;}
-						case 6: { // ATTA (If collides attracts any point)
-							return (*this->myRules).atta(collidePoint,(*itActuator),movingPoint);		
-							break;}
-						case 9: { // RPLO (If collided repels a point)
-							return (*this->myRules).rplo(collidePoint,(*itActuator),movingPoint);	
-							break;}
-						case 10: { // RPLA
-							return (*this->myRules).rpla(collidePoint,(*itActuator),movingPoint);	
-							break;}
-						default: { // KEEP MOVING
-							return this->movePoint(movingPoint,(*itActuator));
-							break;}
-					}
-					break;}
-			default:  break;};
-			break;}
-		default: 
-			break;};
+	unsigned int i;
+	int nextState;
+	bool getFromQueue, picked = false;
+
+	//SCAN THE ACTUATORS AND TEST WHAT EACH ONE IS DOING, NOTHING IS CHANGED YET
+	this->actuatorEvents.clear();
+	for (i = 0; i < (unsigned int)this->actuatorPoses; i++) {
+		pose = &this->actuatorPose[i];
+		e.actuator = this->poseActuator[i];
+		e.movingPoint = 0;
+		if ((*e.actuator).transporting == 1) {
+			// ACTUATOR IS TRANSPORTING A POINT, IT MOVES OR IT IS RELEASED
+			e.movingPoint = (*e.actuator).transportingPoint;
+			e.collidePoint = this->findPointNearActuator(e.actuator,pose,&distance);
+		} else if (pose->visible == 1) {
+			// MARKER IS VISIBLE, TRY TO DO AN ACTION WITH THE CLOSEST POINT
+			e.collidePoint = this->findPointNearActuator(e.actuator,pose,&distance);
+			if (e.collidePoint == 0) continue;
+		} else continue;
+		this->actuatorEvents.push_back(e);
+	}
 
-	//printf("\n END -- Testing Act %s.", (*itActuator)->name);
+	//RESOLVE THEM IN THE ORDER OF THE ACTUATORS
+	this->grabbedPoints.clear();
+	nextState = this->myRules->nextState;
+	getFromQueue = this->myRules->getFromQueue;
+	for (i = 0; i < this->actuatorEvents.size(); i++) {
+		this->resolveEvent(&this->actuatorEvents[i]);
+		if (this->myRules->nextState == nextState && this->myRules->getFromQueue == getFromQueue) continue;
+		if (picked) {
+			// An earlier actuator gave the next state already
+			this->myRules->nextState = nextState;
+			this->myRules->getFromQueue = getFromQueue;
+		} else {
+			picked = true;
+			nextState = this->myRules->nextState;
+			getFromQueue = this->myRules->getFromQueue;
+		}
 	}
 
+	toReturn = this->actuatorEvents.empty() ? 1 : (int)this->actuatorEvents.size();
 	return toReturn;
 }
 
+// The reaction of the rules to what the actuator met, as the loop of
+// interactionControl() did it.
+int Arpe::resolveEvent(ActuatorEvent *e)
+{
+	Actuator *actuator = e->actuator;
+	iPoint *collidePoint = e->collidePoint;
+	iPoint *movingPoint = e->movingPoint;
+	unsigned int i;
+
+	if (movingPoint == 0) { // ACTUATOR ISN'T TRANSPORTING ANYTHING
+		if (this->myRules->lockParser != 0) return 1;
+		for (i = 0; i < this->grabbedPoints.size(); i++)
+			if (this->grabbedPoints[i] == collidePoint) return 1;
+
+		// COLLISION HANDLING
+		switch(	(*(*collidePoint).actualAction).opcode){
+		case 1: { // STAT
+			return (*this->myRules).stat(collidePoint);}
+		case 2: { // DRGF
+			this->grabbedPoints.push_back(collidePoint);
+			return (*this->myRules).drgf(collidePoint,actuator);}
+		case 3: { // DRGRP
+			this->grabbedPoints.push_back(collidePoint);
+			return (*this->myRules).drgrp_grab(collidePoint,actuator);}
+		case 11: { // CHGST
+			return (*this->myRules).chgst(collidePoint);}
+		default: return 1;
+		}
+	}
+
+	if ((*actuator).buttons[0] == 0) { // CONTROL BUTTON ISN'T ACTIVE (MARKER NOT VISIBLE)
+		if (collidePoint != 0) {
+			// RELEASE OR DROP
+			switch((*(*collidePoint).actualAction).opcode){
+			case 7:{ // DRPO
+				return (*this->myRules).drpo(collidePoint,actuator,movingPoint);}
+			case 8:{ // DRPA
+				return (*this->myRules).drpa(collidePoint,actuator,movingPoint);}
+			default: break;
+			}
+		}
+		// NO COLLISION BETWEEN ACTUATOR AND POINT
+		(*actuator).releasePoint();
+		return this->releasePoint(movingPoint);
+	}
+
+	// CONTROL BUTTON IS ACTIVE (MARKER IS VISIBLE)
+	if (collidePoint == 0) return this->movePoint(movingPoint,actuator); // NO COLLISION BETWEEN ACTUATOR AND POINT
+	// KEEP MOVING OR COLLIDE AND TEST REACTION
+	switch((*(*collidePoint).actualAction).opcode){
+		case 3: { // DRGRP (IF collides repels moving point to origin)
+			return (*this->myRules).drgrp_collided(collidePoint,actuator,movingPoint);}
+		case 4: { // ATTO (If collides attract moving point to it) (Clone trans/rot/scale of the point)
+			return (*this->myRules).atto(collidePoint,actuator,movingPoint);}
+		case 5: { // ATTRP (If collides attracts point to it and repels any other point) (Clone trans/rot/scale of the point)
+			return (*this->myRules).attrp(collidePoint,actuator,movingPoint);}
+		case 6: { // ATTA (If collides attracts any point)
+			return (*this->myRules).atta(collidePoint,actuator,movingPoint);}
+		case 9: { // RPLO (If collided repels a point)
+			return (*this->myRules).rplo(collidePoint,actuator,movingPoint);}
+		case 10: { // RPLA
+			return (*this->myRules).rpla(collidePoint,actuator,movingPoint);}
+		default: { // KEEP MOVING
+			return this->movePoint(movingPoint,actuator);}
+	}
+}
+
+// Inverts at once the transforms of the bases that moved since the last
+// frame, and drops the actuator transforms of the last frame.
+// Extracts the six planes of the view frustum from the projection matrix p
+// (column major), so that the bases and actuators can skip their models when
+// they are out of view. The planes are normalized, their distance is in mm.
+void Arpe::setViewFrustum(const double p[16])
+{
+	double len;
+	int i, j;
+
+	for (i = 0; i < 6; i++) {
+		for (j = 0; j < 4; j++) {
+			if (i & 1) this->viewPlane[i][j] = p[j*4+3] - p[j*4+i/2];
+			else       this->viewPlane[i][j] = p[j*4+3] + p[j*4+i/2];
+		}
+		len = sqrt(this->viewPlane[i][0]*this->viewPlane[i][0]
+				 + this->viewPlane[i][1]*this->viewPlane[i][1]
+				 + this->viewPlane[i][2]*this->viewPlane[i][2]);
+		if (len > 0.0) for (j = 0; j < 4; j++) this->viewPlane[i][j] /= len;
+	}
+}
+
+// Returns 1 if the sphere of the given center and radius, in the coordinates
+// of the modelview (column major), is at least partly inside the view frustum
+// and 0 when it is wholly outside. The distance of the center along the view
+// axis is stored in depth, when not NULL, to draw the nearest things first.
+int Arpe::sphereInView(const double modelview[16], const double center[3], double radius, double *depth)
+{
+	double e[3];
+	int i;
+
+	for (i = 0; i < 3; i++)
+		e[i] = modelview[i]*center[0] + modelview[4+i]*center[1] + modelview[8+i]*center[2] + modelview[12+i];
+	if (depth) *depth = -e[2];
+
+	for (i = 0; i < 6; i++) {
+		if (this->viewPlane[i][0]*e[0] + this->viewPlane[i][1]*e[1] + this->viewPlane[i][2]*e[2]
+			+ this->viewPlane[i][3] < -radius) return 0;
+	}
+	return 1;
+}
+
+void Arpe::updateBaseInverses()
+{
+	list<Base*>::iterator b;
+	InfraStructure *infra;
+	int n = (int)this->listBase.size();
+	int i;
+
+	if (n == 0) return;
+	if (n > this->baseBufMax) {
+		delete[] this->baseTransBuf;
+		delete[] this->baseInvBuf;
+		this->baseTransBuf = new double[n][3][4];
+		this->baseInvBuf = new double[n][3][4];
+		this->baseBufMax = n;
+	}
+
+	for (i = 0, b = this->listBase.begin(); b != this->listBase.end(); b++) {
+		infra = (*(*b)).myInfraStructure;
+		infra->invalidateActuatorTrans();
+		if (infra->transDirty)
+			memcpy(this->baseTransBuf[i++], infra->baseTrans, sizeof(this->baseTransBuf[0]));
+	}
+	if (i == 0) return;
+	arUtilMatInvBatch(this->baseTransBuf, this->baseInvBuf, i);
+	for (i = 0, b = this->listBase.begin(); b != this->listBase.end(); b++) {
+		infra = (*(*b)).myInfraStructure;
+		if (!infra->transDirty) continue;
+		memcpy(infra->baseTransInv, this->baseInvBuf[i++], sizeof(this->baseInvBuf[0]));
+		infra->transDirty = 0;
+	}
+}
+
 Base* Arpe::findBase(int valueID)
 {
-	list<Base*>::iterator it;
+	Base *b = this->baseIndex.find(valueID);
 
-	for( it = this->listBase.begin(); it != this->listBase.end(); it++)
-		if((*(*it)).id == valueID)
-			return (*it);
-	
-	printf("\n *******Object not found");
-	return 0;
+	if (b == 0) printf("\n *******Object not found");
+	return b;
 }
 
 iPoint* Arpe::findIPoint(int valueID){
-	list<Base*>::iterator it;
-	list<iPoint*>::iterator itA;
+	return this->ipointIndex.find(valueID);
+}
 
-	for( it = this->listBase.begin(); it != this->listBase.end(); it++)
-		for( itA = (*(*it)).listPoint.begin(); itA != (*(*it)).listPoint.end(); itA++)
-			if( (*(*itA)).id == valueID)
-				return (*itA);
-	
-	//printf("\n *******Object not found");
-	return 0;
+void Arpe::indexIPoint(iPoint* value){
+	this->ipointIndex.add(value->id, value);
 }
 
-iPoint* Arpe::findPointNearActuator(Actuator* a, double *distance)
-{
+// Indexes the iPoints of all the bases again, once they are given the ids
+// the rules refer to them by. Those read by Base::addPoint() count from 1 in
+// each base.
+void Arpe::indexIPoints(){
 	list<Base*>::iterator b;
 	list<iPoint*>::iterator p;
-	iPoint *ip_actual,*ip_near;
-	ip_actual = 0;
+
+	this->ipointIndex.clear();
+	for( b = this->listBase.begin(); b != this->listBase.end(); b++)
+		for( p = (*b)->listPoint.begin(); p != (*b)->listPoint.end(); p++)
+			this->ipointIndex.add((*p)->id, (*p));
+}
+
+// Gives the marker actuators and the bases their entries of actuatorPose and
+// basePose, with the poses they have now. The arrays are taken as images are,
+// aligned to a cache line.
+void Arpe::indexTracks(){
+	list<Actuator*>::iterator a;
+	list<Base*>::iterator b;
+	ActuatorARTKSM *m;
+	InfraStructure *infra;
+	TrackPose *p;
+	int n;
+
+	arImageFree(this->actuatorPose);
+	delete[] this->poseActuator;
+	arImageFree(this->basePose);
+	delete[] this->poseBase;
+	this->actuatorPose = this->basePose = NULL;
+	this->poseActuator = NULL;
+	this->poseBase = NULL;
+
+	for (n = 0, a = this->listActuator.begin(); a != this->listActuator.end(); a++)
+		if ((*a)->type == 1) n++;
+	if (n > 0) {
+		arMallocImage(this->actuatorPose, TrackPose, n, AR_MEM_ARPE);
+		this->poseActuator = new ActuatorARTKSM*[n];
+	}
+	for (n = 0, a = this->listActuator.begin(); a != this->listActuator.end(); a++) {
+		if ((*a)->type != 1) continue;
+		m = static_cast<ActuatorARTKSM*>(*a);
+		p = &this->actuatorPose[n];
+		memcpy(p->trans, m->interactionTrans, sizeof(p->trans));
+		memcpy(p->point, m->ipTra, sizeof(p->point));
+		p->visible = m->visible;
+		p->id = m->id;
+		m->pose = p;
+		this->poseActuator[n++] = m;
+	}
+	this->actuatorPoses = n;
+
+	n = (int)this->listBase.size();
+	if (n > 0) {
+		arMallocImage(this->basePose, TrackPose, n, AR_MEM_ARPE);
+		this->poseBase = new Base*[n];
+	}
+	for (n = 0, b = this->listBase.begin(); b != this->listBase.end(); b++) {
+		infra = (*b)->myInfraStructure;
+		p = &this->basePose[n];
+		memcpy(p->trans, infra->baseTrans, sizeof(p->trans));
+		memset(p->point, 0, sizeof(p->point));
+		p->visible = infra->visible;
+		p->id = (*b)->id;
+		infra->pose = p;
+		this->poseBase[n++] = *b;
+	}
+	this->basePoses = n;
+}
+
+// Only the iPoints of the grid cells around the actuator are looked at, see
+// Base::sensePoints(), the others are too far to be sensing or to be returned.
+// Their distances are only computed again when the actuator or a point moved.
+iPoint* Arpe::findPointNearActuator(Actuator* a, TrackPose *pose, double *distance)
+{
+	list<Base*>::iterator b;
+	vector<iPoint*>::const_iterator p;
+	vector<iPoint*>::iterator s;
+	const Base::Sensed *sensed;
+	iPoint *ip_near;
+	double at[3], dist, nearDist;
+	ActuatorTrans *rel;
+	size_t k;
+
 	ip_near = 0;
-	
-	float xPto,yPto,zPto, dist;
-	double matInv[3][4], matResult[3][4];
+	nearDist = 0;
+	*distance = 0;
 
-	// ONLY ACTUATOR TYPE ARTKSM
-	ActuatorARTKSM* a2 = static_cast<ActuatorARTKSM*>(a);
-	//printf("\n A %3.2f ,  %3.2f , %3.2f", a2->ipTra[0], a2->ipTra[1], a2->ipTra[2]);
+	//printf("\n A %3.2f ,  %3.2f , %3.2f", pose->point[0], pose->point[1], pose->point[2]);
+
+	// SENSE TREATMENT, of the last query
+	for (s = this->sensedPoints.begin(); s != this->sensedPoints.end(); s++) (*s)->ball.senseStatus = 2;
+	this->sensedPoints.clear();
 
-	
 	for(b = this->listBase.begin() ; b != this->listBase.end() ; b++){
 
-		arUtilMatInv( (*(*(*b)).myInfraStructure).baseTrans, matInv);
-		arUtilMatMul(matInv,(*a).interactionTrans,matResult);
+		rel = (*(*(*b)).myInfraStructure).getActuatorTrans((*a).id,pose->trans);
 
-		for(p = (*(*b)).listPoint.begin() ; p != (*(*b)).listPoint.end() ; p++){ //Search near iPoints
+		// The actuator in base coordinates
+		at[0] = rel->trans[0][3] - pose->point[1]; //GAMBIARRA
+		at[1] = rel->trans[1][3] - pose->point[0]; //GAMBIARRA DEVIDO AO EIXO DE COORDENADA REAL COM 
+		at[2] = rel->trans[2][3] - pose->point[2]; //GAMBIARRA O DO OPENGL
 
-			xPto =  ((*(*p)).position.trans[0][3] + a2->ipTra[1]) - matResult[0][3]; //GAMBIARRA
-			yPto =  ((*(*p)).position.trans[1][3] + a2->ipTra[0]) - matResult[1][3];  //GAMBIARRA DEVIDO AO EIXO DE COORDENADA REAL COM 
-			zPto =  ((*(*p)).position.trans[2][3] + a2->ipTra[2]) - matResult[2][3];  //GAMBIARRA O DO OPENGL
-			dist = xPto*xPto + yPto*yPto + yPto*zPto;
-			//printf("\n IPOINT %d %3.2f ,  %3.2f , %3.2f : %3.2f", (*p)->id,  xPto , yPto, zPto, dist);
-			*distance = dist;
+		sensed = (*(*b)).sensePoints((*a).id, at);
+
+		for(p = sensed->point.begin(), k = 0 ; p != sensed->point.end() ; p++, k++){ //Search near iPoints
+
+			dist = sensed->dist[k];
+			//printf("\n IPOINT %d : %3.2f", (*p)->id, dist);
 
-			// Save distance on the points distance vector
-			ipDist *ipdist;
-			ipdist = (*p)->findActuator(a->id);
-			ipdist->distance = dist;
-			ip_actual = (*p);
-			
-			// SENSE TREATMENT
-			(*(*p)).ball.senseStatus = 2;
-			
 			if( (dist > 0) && (dist < (*(*p)).ball.distCollision*2)) // Try if on sensing distance
 				if( (*(*(*p)).actualAction).pointMode == 6) // IF SENSING
 					switch( (*(*(*p)).actualAction).opcode ){
@@ -645,41 +1016,22 @@ iPoint* Arpe::findPointNearActuator(Actuator* a, double *distance)
 					case 20: // Doen't need 
 					default: break;					}
 
-				//printf("\n Distance of point %d to actuator %d : %lf",ip_actual->id,a->id, dist);
-
-				// Calculate the nearest point
-				if( ip_actual != a->transportingPoint)
-					if( ip_near == 0){
-						
-						ip_near = ip_actual;
-					} else {
-						if ( ip_actual->getDistanceTo(a->id) < ip_near->getDistanceTo(a->id)){
-							
-							ip_near = ip_actual;
-						}
-					}
+			if ((*(*p)).ball.senseStatus != 2) this->sensedPoints.push_back(*p);
 
-				
+			// Calculate the nearest point
+			if( (*p) != a->transportingPoint)
+				if( ip_near == 0 || dist < nearDist){
+					ip_near = (*p);
+					nearDist = dist;
+				}
 		}
 	}
 	
 	if ( ip_near != 0 ){
-		if ( ip_near->getDistanceTo(a->id) > 0 && ( ip_near->getDistanceTo(a->id) < ip_near->ball.distCollision) )
+		*distance = nearDist;
+		if ( nearDist > 0 && ( nearDist < ip_near->ball.distCollision) )
 			return ip_near;	}
 
-	//if( (*a).transporting == 0){ // Not moving anything
-	//	if( (dist > 0 ) &&  (dist < (*(*p)).ball.distCollision)){
-	//		if( near != 0) return near;
-	//		return (*p);
-	//	}
-	//} else {	// Moving a iPoint
-	//	if( (*(*p)).id != (*(*a).transportingPoint).id){
-	//		if( (dist > 0 ) &&  (dist < (*(*p)).ball.distCollision)){
-	//			return (*p);
-	//		}
-	//	}
-	//}
-
 	return 0;
 }
 
@@ -687,12 +1039,11 @@ int Arpe::movePoint(iPoint* move, Actuator* actuator)
 {
 
 
-	double matInv [3][4], matResult[3][4],matTrans[3][4];
+	double matResult[3][4],matTrans[3][4];
 	static double matDiff[3][4];
 
 	arUtilMatMul((*actuator).interactionTrans,(*actuator).transDiff,matTrans);
-	arUtilMatInv((*(*(*move).myBase).myInfraStructure).baseTrans,matInv);
-	arUtilMatMul(matInv,matTrans,matResult);
+	arUtilMatMul((*(*(*move).myBase).myInfraStructure).baseTransInv,matTrans,matResult);
 
 	for(int i=0;i<3;i++)
 		for(int j=0;j<4;j++)
@@ -802,39 +1153,60 @@ void Arpe::addActuator(Actuator* value){
 	list<Actuator*>::iterator it;
 	it = listActuator.begin();
 	listActuator.push_back(value);
+	actuatorIndex.add(value->id, value);
 
 }
 
 Actuator* Arpe::findActuator(int valueID){
-	list<Actuator*>::iterator it;
+	Actuator *a = this->actuatorIndex.find(valueID);
 
-	for( it = this->listActuator.begin(); it != this->listActuator.end(); it++)
-		if((*(*it)).id == valueID)
-			return (*it);
-
-	printf("\n *******Actuator not found");
-	return 0;
+	if (a == 0) printf("\n *******Actuator not found");
+	return a;
 }
 
 int Arpe::playActionAudio(iPoint* value){
-
-	if( strcmp( (*(*value).actualAction).audioFilename,"") != 0) { 
-		if( (*(*value).actualAction).audioOverplay == false) 
-			this->audioEngine->stopAllSounds();
-		if( value->actualAction->audio3D ){
-			ISoundSource* as = this->audioEngine->addSoundSourceFromFile(value->actualAction->audioFilename);
-			vec3df pos(value->actualAction->x,value->actualAction->y,value->actualAction->z);
-			as->setDefaultVolume(value->actualAction->mathValue2);
-			this->audioEngine->play3D(as,pos);
+	Action *ac = value->actualAction;
+	double pos[3];
+
+	if( strcmp( ac->audioFilename,"") != 0) { 
+		// Actions made after Rules::compileRules() take theirs here.
+		if( ac->audio == 0) ac->audio = audioBankSource(this->audioEngine, ac->audioFilename);
+		if( ac->audioOverplay == false) 
+			audioStopAll();
+		if( ac->audio3D ){
+			this->audioPosition(value, pos);
+			audioPlay3D(ac->audio, pos, ac->mathValue2, value);
 		}
 		else{
-			this->audioEngine->play2D((*(*value).actualAction).audioFilename);	
+			audioPlay2D(ac->audio, false, -1);
 		}
 		return 1;
 	}
 	return 0;
 }
 
+// Where the point is in the camera frame, as its 3D sounds are placed.
+void Arpe::audioPosition(iPoint* value, double pos[3]){
+	double m[3][4];
+
+	arUtilMatMul((*(*(*value).myBase).myInfraStructure).baseTrans, (*value).position.trans, m);
+	pos[0] = m[0][3];
+	pos[1] = m[1][3];
+	pos[2] = m[2][3];
+}
+
+// The 3D sounds still playing follow their points.
+void Arpe::followAudio(){
+	const void *p;
+	double pos[3];
+
+	for (int v = 0; v < AUDIO_VOICES; v++)
+		if ((p = audioFollowed(v)) != 0) {
+			this->audioPosition((iPoint*)p, pos);
+			audioMove(v, pos);
+		}
+}
+
 int Arpe::verifyConsistency(){
 
 
@@ -4,6 +4,7 @@
 
 
 #include <list>
+#include <vector>
 
 
 #include "Actuator.h"
@@ -15,6 +16,9 @@
 #include "Game.h"
 #include "Serial.h"
 #include "User.h"
+#include "IdIndex.h"
+#include "TrackPose.h"
+#include "ConfigBundle.h"
 
 #include <irrKlang\irrKlang.h>
 using namespace irrklang;
@@ -24,6 +28,8 @@ class Actuator;
 class Game;
 class Rules;
 
+#define PREFETCH_DEPTH		2		// Transitions ahead of the actual state, see Arpe::updatePrefetch()
+
 
 class Arpe {
 
@@ -37,7 +43,6 @@ class Arpe {
 	int arpeSetupEnvironment();
     void arpeWriteFiles();
 	int verifyConsistency();
-	CRITICAL_SECTION	parserCS;
 	int s;
 	bool projection;			// Turn projection on/off
 	int prefWindowed;
@@ -48,16 +53,26 @@ class Arpe {
     char appName[256];
     char configFilename[256];
 
+	// Shared by the Arpe of all the sessions of the process
+    static ISoundEngine* sharedAudioEngine();
+	static int loadMarker(const char *name);
+
 	//Audio Interface
     ISoundEngine* audioEngine;
     AudioArpe* soundTrack;
     AudioArpe* startAudio;
 	int playAudio(iPoint* value);
 	int playActionAudio(iPoint* value);
+	void audioPosition(iPoint* value, double pos[3]);
+	void followAudio();
 
 	//Interaction 
 	int interactionControl();
-    iPoint* findPointNearActuator(Actuator* actuator, double *distance);
+	void updateMarkers();		// Only the markers of the state are matched
+	void updateBaseInverses();
+	void updatePrefetch();		// The models and sounds of the states to come
+	void prefetch();			// Each frame, on the thread of the GL context
+    iPoint* findPointNearActuator(Actuator* actuator, TrackPose *pose, double *distance);
 
 	//Moviment commands
     int movePoint(iPoint* value, Actuator* actuator);
@@ -78,6 +93,22 @@ class Arpe {
     void addBase(Base* value);
     Base* findBase(int valueID);
 	iPoint* findIPoint(int valueID);
+	void indexIPoint(iPoint* value);	// Called by Base::addPoint()
+	void indexIPoints();
+
+	//Tracked poses, see TrackPose.h
+	TrackPose *actuatorPose;			// Of the marker actuators, in the order of listActuator
+	ActuatorARTKSM **poseActuator;		// Their actuators
+	int actuatorPoses;
+	TrackPose *basePose;				// Of the bases, in the order of listBase
+	Base **poseBase;					// Their bases
+	int basePoses;
+	void indexTracks();					// Once the actuators and bases are read
+
+	//View culling
+	double viewPlane[6][4];		// Planes of the view frustum in eye coordinates, see setViewFrustum()
+	void setViewFrustum(const double p[16]);
+	int sphereInView(const double modelview[16], const double center[3], double radius, double *depth);
 
 	//Infrastructure
     Game myGame;
@@ -89,7 +120,40 @@ class Arpe {
 
 private:
 	
-	char getBuff(char *buf, int n, FILE *fp);
+	char getBuff(char *buf, int n, CfgFile *fp);
+
+	// Base transforms of the frame and their inverses, for updateBaseInverses()
+	double (*baseTransBuf)[3][4];
+	double (*baseInvBuf)[3][4];
+	int baseBufMax;
+
+	// The bases, iPoints and actuators by id, filled as the files are read
+	IdIndex<Base> baseIndex;
+	IdIndex<iPoint> ipointIndex;
+	IdIndex<Actuator> actuatorIndex;
+
+	// The patterns of the markers the state of the rules needs, see updateMarkers()
+	int markerState;			// actualState they are of, -1 to find them again
+	std::vector<int> markerWanted;
+
+	// The VRML ids of the models of the states the rules may go to next, see updatePrefetch()
+	int prefetchState;			// actualState they are of, -1 to find them again
+	std::vector<int> prefetchWanted;
+	static std::vector<Arpe*> &sessions();
+	static void applyMarkers();
+
+	// The iPoints the last findPointNearActuator() left sensing
+	std::vector<iPoint*> sensedPoints;
+
+	// What each actuator met in the frame, see interactionControl()
+	struct ActuatorEvent {
+		Actuator *actuator;
+		iPoint *collidePoint;		// 0 if none
+		iPoint *movingPoint;		// The one transported, 0 if none
+	};
+	std::vector<ActuatorEvent> actuatorEvents;
+	std::vector<iPoint*> grabbedPoints;		// By the events resolved so far
+	int resolveEvent(ActuatorEvent *e);
 };
 
 #endif // Arpe_h
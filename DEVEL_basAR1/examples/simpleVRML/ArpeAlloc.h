@@ -0,0 +1,23 @@
+#ifndef ArpeAlloc_h
+#define ArpeAlloc_h
+
+#include <stddef.h>
+#include <new>
+
+#include <AR/ar.h>
+
+// Base of the classes of the model of Arpe, the points, actions, states,
+// bases and actuators, so that what they take with new is accounted to
+// AR_MEM_ARPE by arMemAlloc(). Holds nothing; an empty base adds no bytes.
+class ArpeAlloc {
+
+ public:
+	static void *operator new(size_t size) {
+		void *p = arMemAlloc(AR_MEM_ARPE, size);
+		if (p == 0) throw std::bad_alloc();
+		return p;
+	}
+	static void operator delete(void *p) { arMemFree(p); }
+};
+
+#endif // ArpeAlloc_h
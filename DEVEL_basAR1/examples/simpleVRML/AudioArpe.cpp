@@ -1,15 +1,248 @@
 #include "AudioArpe.h"
 
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+using namespace std;
+
 #include <irrKlang\irrKlang.h>
 using namespace irrklang;
 
+#include <AR/ar.h>
+
 #include "Arpe.h"
+#include "Startup.h"
+
+enum { AUDIO_PLAY2D, AUDIO_PLAY3D, AUDIO_MOVE, AUDIO_STOPALL };
+
+struct AudioCommand {
+	int				op;
+	int				voice;
+	ISoundSource	*source;
+	bool			loop;
+	double			volume;
+	vec3df			pos;
+};
+
+static ISoundEngine			*engine = 0;
+static map<string, ISoundSource*> bank;		// 0 for the files that could not be read
+
+// The frame writes commandHead, the thread commandTail.
+static AudioCommand			command[AUDIO_QUEUE_SIZE];
+static volatile LONG		commandHead = 0;
+static volatile LONG		commandTail = 0;
+static HANDLE				commandEvent = NULL;
+static bool					running = false;
+
+// The voices as the frame gave them, voiceBusy cleared by the thread when
+// the sound is over.
+static volatile LONG		voiceBusy[AUDIO_VOICES];
+static ISoundSource			*voiceSource[AUDIO_VOICES];
+static const void			*voiceFollow[AUDIO_VOICES];
+static unsigned long		voiceAge[AUDIO_VOICES];
+static unsigned long		age = 0;
+
+// The thread's.
+static ISound				*voiceSound[AUDIO_VOICES];
+
+ISoundSource* audioBankSource(ISoundEngine *e, const char *filename)
+{
+	map<string, ISoundSource*>::iterator it;
+	ISoundSource *s;
+
+	if (filename == 0 || strcmp(filename, "") == 0) return 0;
+	if ((it = bank.find(filename)) != bank.end()) return (*it).second;
+
+	if ((s = e->getSoundSource(filename, false)) == 0)
+		s = e->addSoundSourceFromFile(filename, ESM_NO_STREAMING, true);
+	if (s == 0) printf("\n Error on loading %s sound!! ", filename);
+	bank[filename] = s;
+	return s;
+}
+
+static vec3df audioPos(const double pos[3])
+{
+	// From the camera, x right, y down, to irrKlang's, y up.
+	return vec3df((ik_f32)(pos[0] * AUDIO_UNIT), (ik_f32)(-pos[1] * AUDIO_UNIT), (ik_f32)(pos[2] * AUDIO_UNIT));
+}
+
+static void voiceStop(int v)
+{
+	if (voiceSound[v] == 0) return;
+	voiceSound[v]->stop();
+	voiceSound[v]->drop();
+	voiceSound[v] = 0;
+}
+
+static void audioDo(AudioCommand *c)
+{
+	int v;
+
+	switch (c->op) {
+	case AUDIO_PLAY2D:
+	case AUDIO_PLAY3D:
+		voiceStop(c->voice);
+		if (c->op == AUDIO_PLAY2D) voiceSound[c->voice] = engine->play2D(c->source, c->loop, true, true);
+		else voiceSound[c->voice] = engine->play3D(c->source, c->pos, c->loop, true, true);
+		if (voiceSound[c->voice] == 0) { InterlockedExchange(&voiceBusy[c->voice], 0); break; }
+		if (c->volume >= 0) voiceSound[c->voice]->setVolume((ik_f32)c->volume);
+		voiceSound[c->voice]->setIsPaused(false);
+		InterlockedExchange(&voiceBusy[c->voice], 1);
+		break;
+	case AUDIO_MOVE:
+		if (voiceSound[c->voice] != 0) voiceSound[c->voice]->setPosition(c->pos);
+		break;
+	case AUDIO_STOPALL:
+		for (v = 0; v < AUDIO_VOICES; v++) voiceStop(v);
+		engine->stopAllSounds();
+		break;
+	}
+}
+
+static void audioThread(void *data)
+{
+	AudioCommand c;
+	LONG tail;
+	int v;
+
+	arThreadRole(AR_THREAD_IO, "audio");
+	engine->setListenerPosition(vec3df(0, 0, 0), vec3df(0, 0, 1), vec3df(0, 0, 0), vec3df(0, 1, 0));
+	for (;;) {
+		WaitForSingleObject(commandEvent, 50);
+
+		while ((tail = commandTail) != commandHead) {
+			MemoryBarrier();
+			c = command[tail & (AUDIO_QUEUE_SIZE - 1)];
+			InterlockedExchange(&commandTail, tail + 1);
+			AR_TRACE_BEGIN("audioDo");
+			audioDo(&c);
+			AR_TRACE_END();
+		}
+
+		// The voices over are free again.
+		for (v = 0; v < AUDIO_VOICES; v++)
+			if (voiceSound[v] != 0 && voiceSound[v]->isFinished()) {
+				voiceSound[v]->drop();
+				voiceSound[v] = 0;
+				InterlockedExchange(&voiceBusy[v], 0);
+			}
+	}
+}
+
+int audioStart(ISoundEngine *e)
+{
+	engine = e;
+	if (running) return 0;
+	if (engine == 0) { printf("\n No audio device"); return -1; }
+	if ((commandEvent = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL
+		|| _beginthread(audioThread, 0, NULL) == -1L) { printf("\n Failure to start audio thread!!"); return -1; }
+	running = true;
+	return 0;
+}
+
+// Runs the command on the thread, or here when there is none.
+static void audioPost(AudioCommand *c)
+{
+	LONG head = commandHead;
+
+	if (!running) {
+		if (engine != 0) audioDo(c);
+		return;
+	}
+	if (head - commandTail == AUDIO_QUEUE_SIZE) { printf("\n Audio queue full"); return; }
+	command[head & (AUDIO_QUEUE_SIZE - 1)] = *c;
+	InterlockedExchange(&commandHead, head + 1);	// the command is written before it is seen
+	SetEvent(commandEvent);
+}
+
+// A free voice, or the oldest.
+static int voiceTake(ISoundSource *source, const void *follow)
+{
+	int v, best = 0;
+
+	for (v = 0; v < AUDIO_VOICES; v++) {
+		if (voiceBusy[v] == 0) { best = v; break; }
+		if (voiceAge[v] < voiceAge[best]) best = v;
+	}
+	InterlockedExchange(&voiceBusy[best], 1);
+	voiceSource[best] = source;
+	voiceFollow[best] = follow;
+	voiceAge[best] = ++age;
+	return best;
+}
+
+int audioPlay2D(ISoundSource *source, bool loop, double volume)
+{
+	AudioCommand c;
+
+	if (source == 0 || engine == 0) return -1;
+	c.op = AUDIO_PLAY2D;
+	c.voice = voiceTake(source, 0);
+	c.source = source;
+	c.loop = loop;
+	c.volume = volume;
+	audioPost(&c);
+	return c.voice;
+}
+
+int audioPlay3D(ISoundSource *source, const double pos[3], double volume, const void *follow)
+{
+	AudioCommand c;
+
+	if (source == 0 || engine == 0) return -1;
+	c.op = AUDIO_PLAY3D;
+	c.voice = voiceTake(source, follow);
+	c.source = source;
+	c.loop = false;
+	c.volume = volume;
+	c.pos = audioPos(pos);
+	audioPost(&c);
+	return c.voice;
+}
+
+void audioMove(int voice, const double pos[3])
+{
+	AudioCommand c;
+
+	if (voice < 0 || voice >= AUDIO_VOICES || voiceBusy[voice] == 0) return;
+	c.op = AUDIO_MOVE;
+	c.voice = voice;
+	c.pos = audioPos(pos);
+	audioPost(&c);
+}
+
+void audioStopAll(void)
+{
+	AudioCommand c;
+	int v;
+
+	for (v = 0; v < AUDIO_VOICES; v++) InterlockedExchange(&voiceBusy[v], 0);
+	c.op = AUDIO_STOPALL;
+	audioPost(&c);
+}
+
+const void* audioFollowed(int voice)
+{
+	if (voice < 0 || voice >= AUDIO_VOICES || voiceBusy[voice] == 0) return 0;
+	return voiceFollow[voice];
+}
+
+bool audioPlaying(int voice, ISoundSource *source)
+{
+	return voice >= 0 && voice < AUDIO_VOICES && voiceBusy[voice] != 0 && voiceSource[voice] == source;
+}
 
 AudioArpe::AudioArpe()
 {
 	this->position->X = 0;
 	this->position->Y = 0;
 	this->position->Z = 0;
+	this->audioSource = 0;
+	this->voice = -1;
 }
 
 AudioArpe::~AudioArpe()
@@ -22,29 +255,42 @@ int AudioArpe::play2D(){
 	if( (strcmp(this->filename,"") !=0) && (this->audioSource != 0)){
 
 		if( this->status == 2){ // LOOP
-			(*this->myArpe).audioEngine->play2D(this->audioSource,true);
+			this->voice = audioPlay2D(this->audioSource, true, this->volume);
 			return 2;
 		} else{
-			(*this->myArpe).audioEngine->play2D(this->audioSource);
+			this->voice = audioPlay2D(this->audioSource, false, this->volume);
 			return 1;
 		}
-		
+
 	}
 
 	return 0;
 }
 
 int AudioArpe::play3D(){
+	double pos[3];
+
+	if( (strcmp(this->filename,"") !=0) && (this->audioSource != 0)){
+		pos[0] = this->position->X;
+		pos[1] = this->position->Y;
+		pos[2] = this->position->Z;
+		this->voice = audioPlay3D(this->audioSource, pos, this->volume, 0);
+		return 1;
+	}
 
 	return 0;
 }
 
-int AudioArpe::loadSound(){
+bool AudioArpe::isPlaying(){
+	return audioPlaying(this->voice, this->audioSource);
+}
 
-	this->audioSource = (*this->myArpe).audioEngine->addSoundSourceFromFile(this->filename);
+// The volume is given to each play, the source is shared with the other
+// sounds of the same file.
+int AudioArpe::loadSound(){
 
-	if( (this->audioSource != 0)){ 
-		this->audioSource->setDefaultVolume(this->volume);
-	}
+	startupBegin(STARTUP_SOUND);
+	this->audioSource = audioBankSource((*this->myArpe).audioEngine, this->filename);
+	startupEnd();
 	return 1;
-}
\ No newline at end of file
+}
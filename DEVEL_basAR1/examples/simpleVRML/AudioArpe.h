@@ -2,11 +2,44 @@
 #define AudioArpe_h
 
 #include <irrKlang\irrKlang.h>
+#include "ArpeAlloc.h"
 using namespace irrklang;
 
 class Arpe;
 
-class AudioArpe {
+// Sounds of the application.
+//
+// audioBankSource() is the bank: each file is decoded into memory the first
+// time it is asked for, and the same source is given to every sound and
+// action that plays it, so that nothing is read when a sound is triggered.
+//
+// The sounds are played by a thread of their own, started by audioStart(),
+// from the commands the frame posts to it (audioPlay2D(), audioPlay3D(),
+// audioMove(), audioStopAll()) on a queue with one writer and one reader.
+// There are AUDIO_VOICES voices; the frame gives each new sound a free one,
+// or the oldest, which the thread then stops. A 3D sound is placed in the
+// camera frame, in which irrKlang's listener sits, and may be moved there
+// while it plays.
+
+#define AUDIO_VOICES		16
+#define AUDIO_QUEUE_SIZE	64		// Power of two.
+#define AUDIO_UNIT			0.001	// Metres of one ARToolKit unit.
+
+ISoundSource*	audioBankSource(ISoundEngine *engine, const char *filename);
+int				audioStart(ISoundEngine *engine);
+
+// Give the voice of the sound, -1 when it can't be played. A volume below 0
+// keeps the default of the source.
+int				audioPlay2D(ISoundSource *source, bool loop, double volume);
+int				audioPlay3D(ISoundSource *source, const double pos[3], double volume, const void *follow);
+void			audioMove(int voice, const double pos[3]);
+void			audioStopAll(void);
+
+// What the voice, while it is playing, was given to follow by audioPlay3D().
+const void*		audioFollowed(int voice);
+bool			audioPlaying(int voice, ISoundSource *source);
+
+class AudioArpe : public ArpeAlloc {
 
  public:
 
@@ -19,10 +52,12 @@ class AudioArpe {
     int status;
     ISoundSource* audioSource;
 	vec3df position[3];
+	int voice;					// Of the last play, -1 before.
 
 	int loadSound();
 	int play2D();
 	int play3D();
+	bool isPlaying();
 
 	Arpe *myArpe;
 };
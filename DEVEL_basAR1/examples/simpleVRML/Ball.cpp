@@ -25,11 +25,11 @@ Ball::Ball(){
 Ball::~Ball(){
 }
 
-char Ball::getBuff(char *buf, int n, FILE *fp){
+char Ball::getBuff(char *buf, int n, CfgFile *fp){
     char *ret;
 	
     for(;;) {
-        ret = fgets(buf, n, fp);
+        ret = cfgGets(buf, n, fp);
         if (ret == NULL) return(NULL);
         if (buf[0] != '\n' && buf[0] != '#') return(1); // Skip blank lines and comments.
     }
@@ -37,7 +37,7 @@ char Ball::getBuff(char *buf, int n, FILE *fp){
 
 int Ball::ballReadFile(){
 	
-	FILE          *fp;
+	CfgFile          *fp;
 	char           buf[256],buf1[256],buf2[256],fileDAT[256];
 	int			   numObjects;
 
@@ -53,14 +53,14 @@ int Ball::ballReadFile(){
 		return 0;
 	}
 
-	if( (fp=fopen(this->filename,"r")) == NULL) { printf("\n Error on opening %s action point balls file!! ",this->filename);	return 0;}
+	if( (fp=cfgOpen(this->filename)) == NULL) { printf("\n Error on opening %s action point balls file!! ",this->filename);	return 0;}
 
 	//--------------------------------------------------------------------------
 	// Read the amount of models
 	//--------------------------------------------------------------------------
 	getBuff(buf,256,fp);
     if (sscanf(buf, "%d", &numObjects) != 1) {
-		 printf("\n Check %s file format", this->filename);fclose(fp); return(0);
+		 printf("\n Check %s file format", this->filename);cfgClose(fp); return(0);
 	}
 	printf("\n About to load %d balls.", numObjects);
 
@@ -70,10 +70,10 @@ int Ball::ballReadFile(){
 		// Read the objects
 		//--------------------------------------------------------------------------
         getBuff(buf, 256, fp);
-		if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->filename); fclose(fp); return(0); }
+		if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->filename); cfgClose(fp); return(0); }
 		
 		if ( strcmp(buf1,"MODEL3D") == 0 ){
-			if (sscanf(buf, "%s %s %s", &buf1, &buf2, &fileDAT) != 3) { printf("\n Check %s file format", this->filename); fclose(fp); return(0); }
+			if (sscanf(buf, "%s %s %s", &buf1, &buf2, &fileDAT) != 3) { printf("\n Check %s file format", this->filename); cfgClose(fp); return(0); }
 			if(  strcmp(buf2,"VRML") == 0 ){
 				iVrml* obj = new iVrml();
 
@@ -82,7 +82,7 @@ int Ball::ballReadFile(){
 				(*obj).id = i +1;
 				(*obj).type = 1; // MODEL3D
 				(*obj).modelType = 1;  //VRML
-				(*obj).vrmlID = arVrmlLoadFile(fileDAT);
+				(*obj).vrmlID = iVrml::loadAsync(fileDAT);
 				if ((*obj).vrmlID < 0) {
 					printf("\n Error on %s file or on VRML file (%d)",fileDAT,(*obj).vrmlID);
 				} else {
@@ -116,7 +116,7 @@ int Ball::ballReadFile(){
 	}
 
 	printf("\n %d Balls correctly read!",numObjects);
-	fclose(fp);
+	cfgClose(fp);
 
 	return 1;
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define Ball_h
 
 #include "iObject3D.h"
+#include "ConfigBundle.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -26,7 +27,7 @@ class Ball {
 	char filename[256];
 
  private:
-	char getBuff(char *buf, int n, FILE *fp);
+	char getBuff(char *buf, int n, CfgFile *fp);
 	
 };
 
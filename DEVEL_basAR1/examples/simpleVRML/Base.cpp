@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include <GL/glut.h>
 #include <AR/ar.h>
@@ -17,19 +18,24 @@
 #include "iObject3D.h"
 #include "iPoint.h" 
 #include "Action.h"
+#include "ipDist.h"
+#include "BlendQueue.h"
 
 #include <list>
+#include <map>
+#include <vector>
+#include <algorithm>
 using namespace std;
 
 #define VIEW_SCALEFACTOR_1		1.0			// 1.0 ARToolKit unit becomes 1.0 of my OpenGL units.
 
 
-char Base::getBuff(char *buf, int n, FILE *fp)
+char Base::getBuff(char *buf, int n, CfgFile *fp)
 {
     char *ret;
 	
     for(;;) {
-        ret = fgets(buf, n, fp);
+        ret = cfgGets(buf, n, fp);
         if (ret == NULL) return(NULL);
         if (buf[0] != '\n' && buf[0] != '#') return(1); // Skip blank lines and comments.
     }
@@ -40,6 +46,7 @@ void Base::addPoint(iPoint* value)
 	list<iPoint*>::iterator it;
 	it = this->listPoint.begin();
 	this->listPoint.push_back(value);
+	if (this->myArpe) this->myArpe->indexIPoint(value);
 
 }
 
@@ -58,11 +65,17 @@ iPoint* Base::findPoint(int valueID)
 Base::Base()
 {
 	this->adaptType = 0;
+	this->boundCenter[0] = this->boundCenter[1] = this->boundCenter[2] = 0.0;
+	this->boundRadius = BASE_BOUND_MARGIN;
+	this->inView = 1;
+	this->viewDepth = 0.0;
+	this->gridCell = 1.0;
+	this->gridMoves = -1;
 }
 
 int Base::baseReadFile()
 {
-	FILE          *fp;
+	CfgFile          *fp;
 	char		  buf[256],buf1[256],buf2[256],fileDAT[256];
 	double		  auxVolume;
 	int			  nIPoints;
@@ -71,7 +84,7 @@ int Base::baseReadFile()
 	// Open the Base Configuration file
 	//--------------------------------------------------------------------------
 	printf("\n --------------------------------------------------------------------------");
-	if( (fp=fopen(this->configFilename,"r")) == NULL) {
+	if( (fp=cfgOpen(this->configFilename)) == NULL) {
 		printf("\n Error on opening %s !! ",this->configFilename);
 		return  -1;
 	}
@@ -82,7 +95,7 @@ int Base::baseReadFile()
 	// READ THE Base Name
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);  // -> Read base name
-	if (sscanf(buf, "%s", &this->name) != 1) { printf("\n Read base name - Check %s file format", this->configFilename); fclose(fp); return  -1;	}
+	if (sscanf(buf, "%s", &this->name) != 1) { printf("\n Read base name - Check %s file format", this->configFilename); cfgClose(fp); return  -1;	}
 	printf("\n Base name: %s", this->name);
 
 	//--------------------------------------------------------------------------
@@ -91,7 +104,7 @@ int Base::baseReadFile()
 	InfraStructure* iS = new InfraStructure();
 
 	getBuff(buf, 256, fp);	// -> Read source
-	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Read source - Check %s file format", this->configFilename); fclose(fp); return  -1;	}
+	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Read source - Check %s file format", this->configFilename); cfgClose(fp); return  -1;	}
 	if( strcmp(buf1,"ARTKSM") == 0){  
 		//--------------------------------------------------------------------------
 		// READ THE MARKER CONFIGURATION FOR A MARKER BASED BASE
@@ -103,20 +116,20 @@ int Base::baseReadFile()
 
 		// Marker that defines the base
 			getBuff(buf, 256, fp);	// -> Read patternSource
-			if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Read patternSource - Check %s file format", this->configFilename);fclose(fp); return  -1;	}
-			if (((*iA).patternNumber = arLoadPatt(buf1)) < 0) { fclose(fp);  return(0);	}
+			if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Read patternSource - Check %s file format", this->configFilename);cfgClose(fp); return  -1;	}
+			if (((*iA).patternNumber = Arpe::loadMarker(buf1)) < 0) { cfgClose(fp);  return(0);	}
 			printf("\n Using marker: %s, id: %d", buf1, (*iA).patternNumber); 
 		// Marker Width
 			getBuff(buf, 256, fp);	// -> read patternWidth
-			if (sscanf(buf, "%lf", &(*iA).markerWidth) != 1) {  printf("\n Read patternWidth - Check %s file format", this->configFilename); fclose(fp); return  -1;  }
+			if (sscanf(buf, "%lf", &(*iA).markerWidth) != 1) {  printf("\n Read patternWidth - Check %s file format", this->configFilename); cfgClose(fp); return  -1;  }
 		// Marker Center
 			getBuff(buf, 256, fp);	// -> read patternCenter
 			if (sscanf(buf, "%lf %lf", &(*iA).markerCenter[0], &(*iA).markerCenter[1]) != 2) {
-				fclose(fp); return(0);  }
+				cfgClose(fp); return(0);  }
 			printf(" W: %3.2f, Center(%3.2f,%3.2f)", (*iA).markerWidth , (*iA).markerCenter[0], (*iA).markerCenter[1]);
 		// Marker cover (USE_DEFAULT to get default marker cover / NO_COVER to don't use a marker cover)
 			getBuff(buf, 256, fp);	//	-> read patternCover
-			if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n read patternCover - Check %s file format", this->configFilename); fclose(fp); return  -1; }
+			if (sscanf(buf, "%s %s", &buf1, &fileDAT) != 2) { printf("\n read patternCover - Check %s file format", this->configFilename); cfgClose(fp); return  -1; }
 
 			if( strcmp(buf1, "NO_COVER") == 0){
 				(*iA).cover = 0;
@@ -131,7 +144,7 @@ int Base::baseReadFile()
 					if (strcmp(buf1, "VRML") == 0) {
 						//VRML Object
 						iVrml *c = new iVrml();
-						(*c).vrmlID = arVrmlLoadFile(fileDAT); 
+						(*c).vrmlID = iVrml::loadAsync(fileDAT); 
 						if ((*c).vrmlID < 0) {
 							printf("\n Error on Marker Base Cover %s file or on VRML file (%d)",fileDAT,(*c).vrmlID);
 						}
@@ -155,13 +168,13 @@ int Base::baseReadFile()
 	//--------------------------------------------------------------------------
 	
 	getBuff(buf, 256, fp);	// -> Read visibleSound
-	if (sscanf(buf, "%s ", &buf1) != 1) { printf("\n error Visible sound - Check %s file format", this->configFilename); fclose(fp); return  -1; }
+	if (sscanf(buf, "%s ", &buf1) != 1) { printf("\n error Visible sound - Check %s file format", this->configFilename); cfgClose(fp); return  -1; }
 
 	if( strcmp(buf1,"NO_VISIBLESOUND") == 0){ // NO_VISIBLESOUND
 		printf("\n No visible base audio");
 		this->visibleSound = 0;
 	} else {
-		if (sscanf(buf, "%s %s %lf", &buf1, &buf2, &auxVolume) != 2) { printf("\n error visible sound - Check %s file format", this->configFilename); fclose(fp); return  -1; }
+		if (sscanf(buf, "%s %s %lf", &buf1, &buf2, &auxVolume) != 2) { printf("\n error visible sound - Check %s file format", this->configFilename); cfgClose(fp); return  -1; }
 
 		AudioArpe *vs = new AudioArpe();
 		strcpy((*vs).filename,buf1);
@@ -184,7 +197,7 @@ int Base::baseReadFile()
 	//--------------------------------------------------------------------------
 
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s ", &buf1) != 1) { printf("\n error sound - Check %s file format", this->configFilename); fclose(fp); return  -1; }
+	if (sscanf(buf, "%s ", &buf1) != 1) { printf("\n error sound - Check %s file format", this->configFilename); cfgClose(fp); return  -1; }
 
 	if( strcmp(buf1,"NO_ERRORSOUND") == 0){ 
 		this->errorSound = 0;
@@ -194,7 +207,7 @@ int Base::baseReadFile()
 			this->errorSound = (*myArpe).myGenericItens.errorSound;
 			printf("\n Using Default error sound");
 		} else {
-			if (sscanf(buf, "%s %lf", &buf1,&auxVolume) != 2) { printf("\n error sound - Check %s file format", this->configFilename); fclose(fp); return  -1; }
+			if (sscanf(buf, "%s %lf", &buf1,&auxVolume) != 2) { printf("\n error sound - Check %s file format", this->configFilename); cfgClose(fp); return  -1; }
 
 			AudioArpe *es = new AudioArpe();
 			strcpy((*es).filename,buf1);
@@ -218,10 +231,10 @@ int Base::baseReadFile()
 	// Read Base Status
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s ", &fileDAT) != 1) { printf("\n Base Status - Check %s file format", this->configFilename); fclose(fp); return  -1; }
+	if (sscanf(buf, "%s ", &fileDAT) != 1) { printf("\n Base Status - Check %s file format", this->configFilename); cfgClose(fp); return  -1; }
 	iVrml* s = new iVrml();
 	(*s).modelType = 1;
-	(*s).vrmlID = arVrmlLoadFile(fileDAT); 
+	(*s).vrmlID = iVrml::loadAsync(fileDAT); 
 	if ((*s).vrmlID < 0) {
 		printf("\n Error on Status object %s file or on VRML file (%d)",fileDAT,(*s).vrmlID);
 		this->status = 0;
@@ -235,7 +248,7 @@ int Base::baseReadFile()
 	// READ number of ipoints
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%d ", &nIPoints) != 1) {printf("\n number of ipoints - Check %s file format", this->configFilename); fclose(fp); return  -1; }
+	if (sscanf(buf, "%d ", &nIPoints) != 1) {printf("\n number of ipoints - Check %s file format", this->configFilename); cfgClose(fp); return  -1; }
 	printf("\n Number of iPoints: %d",nIPoints);
 
 	//--------------------------------------------------------------------------
@@ -249,7 +262,7 @@ int Base::baseReadFile()
 		// READ iPoint Name
 		//--------------------------------------------------------------------------
 		getBuff(buf, 256, fp);
-		if (sscanf(buf, "%s", &(*auxIP).name) != 1) {printf("\n iPoint Name - Check %s file format", this->configFilename); fclose(fp); return  -1;}
+		if (sscanf(buf, "%s", &(*auxIP).name) != 1) {printf("\n iPoint Name - Check %s file format", this->configFilename); cfgClose(fp); return  -1;}
 		(*auxIP).id = i + 1;
 		printf("\n Ipoint Name: %s , id: %d", (*auxIP).name, (*auxIP).id);
 
@@ -257,7 +270,7 @@ int Base::baseReadFile()
 		// READ iPoint interactive model 
 		//--------------------------------------------------------------------------
 		getBuff(buf, 256, fp);
-		if (sscanf(buf, "%s", &buf1) != 1) {printf("\n iPoint interactive model - Check %s file format", this->configFilename); fclose(fp); return  -1;}
+		if (sscanf(buf, "%s", &buf1) != 1) {printf("\n iPoint interactive model - Check %s file format", this->configFilename); cfgClose(fp); return  -1;}
 
 		if( strcmp(buf1,"EXTERN_IPOINT") == 0) {
 			// EXTERN IPOINT 
@@ -300,7 +313,7 @@ int Base::baseReadFile()
 		// READ iPoint associated objects file
 		//--------------------------------------------------------------------------
 		getBuff(buf, 256, fp);
-		if (sscanf(buf, "%s", &(*auxIP).objFilename) != 1) {printf("\n objects file - Check %s file format", this->configFilename); fclose(fp); return  -1;}
+		if (sscanf(buf, "%s", &(*auxIP).objFilename) != 1) {printf("\n objects file - Check %s file format", this->configFilename); cfgClose(fp); return  -1;}
 	
 		if( strcmp((*auxIP).objFilename,"NO_OBJECT") == 0) {
 			strcpy((*auxIP).objFilename,"");
@@ -327,7 +340,7 @@ int Base::baseReadFile()
 		if( sscanf(buf, "%lf %lf %lf",	&(*auxIP).position.startTra[0], 
 										&(*auxIP).position.startTra[1], 
 										&(*auxIP).position.startTra[2]) != 3 ) {
-	        printf("\n Translations - Check %s file format", this->configFilename); fclose(fp); return -1;  }
+	        printf("\n Translations - Check %s file format", this->configFilename); cfgClose(fp); return -1;  }
 
 		(*auxIP).position.actualTra[0]=(*auxIP).position.startTra[0];
 		(*auxIP).position.actualTra[1]=(*auxIP).position.startTra[1];
@@ -338,7 +351,7 @@ int Base::baseReadFile()
 		if( sscanf(buf, "%lf %lf %lf",	&(*auxIP).position.startRot[0], 
 										&(*auxIP).position.startRot[1], 
 										&(*auxIP).position.startRot[2]) != 3 ) {
-	        printf("\n Rotations - Check %s file format", this->configFilename); fclose(fp); return -1;  }
+	        printf("\n Rotations - Check %s file format", this->configFilename); cfgClose(fp); return -1;  }
 		(*auxIP).position.actualRot[0]=(*auxIP).position.startRot[0];
 		(*auxIP).position.actualRot[1]=(*auxIP).position.startRot[1];
 		(*auxIP).position.actualRot[2]=(*auxIP).position.startRot[2];
@@ -349,7 +362,7 @@ int Base::baseReadFile()
 		if( sscanf(buf, "%lf %lf %lf",	&(*auxIP).position.startScl[0], 
 										&(*auxIP).position.startScl[1], 
 										&(*auxIP).position.startScl[2]) != 3 ) {
-	        printf("\n Scales - Check %s file format", this->configFilename); fclose(fp); return -1;  }	
+	        printf("\n Scales - Check %s file format", this->configFilename); cfgClose(fp); return -1;  }	
 		(*auxIP).position.actualScl[0]=(*auxIP).position.startScl[0];
 		(*auxIP).position.actualScl[1]=(*auxIP).position.startScl[1];
 		(*auxIP).position.actualScl[2]=(*auxIP).position.startScl[2];
@@ -367,7 +380,7 @@ int Base::baseReadFile()
 		// READ iPoint action radius
 		//--------------------------------------------------------------------------
 		getBuff(buf, 256, fp);
-		if( sscanf(buf, "%lf", &(*auxIP).ball.distCollision) != 1) { printf("\n action radius - Check %s file format", this->configFilename); fclose(fp); return -1;  }
+		if( sscanf(buf, "%lf", &(*auxIP).ball.distCollision) != 1) { printf("\n action radius - Check %s file format", this->configFilename); cfgClose(fp); return -1;  }
 
 		(*auxIP).myBase = this;
 		this->addPoint(auxIP);
@@ -375,7 +388,7 @@ int Base::baseReadFile()
 	}
 
 	printf("\n %s correctly read!",this->name);
-	fclose(fp);
+	cfgClose(fp);
     return 1;
 }
 
@@ -393,15 +406,225 @@ Base::~Base()
 {
 }
 
+void Base::markerPatterns(vector<int> &patterns) const
+{
+	list<InfraSource*>::const_iterator s;
+
+	if (this->myInfraStructure == 0) return;
+	for (s = this->myInfraStructure->listSource.begin(); s != this->myInfraStructure->listSource.end(); s++)
+		if ((*s)->type == 1) patterns.push_back(static_cast<InfraARTKSM*>(*s)->patternNumber);
+}
+
+int Base::showsPoints() const
+{
+	list<iPoint*>::const_iterator p;
+
+	for (p = this->listPoint.begin(); p != this->listPoint.end(); p++)
+		if ((*p)->viewMode != 0) return 1;
+	return 0;
+}
+
+// Copies the state of the iPoints the per-frame passes read into hot, where
+// they are now. The rules and their animation threads write the iPoints, this
+// is called at the start of each pass instead. Returns 1 when a point moved.
+int Base::gatherPoints()
+{
+	list<iPoint*>::iterator ip;
+	iPointHot &h = this->hot;
+	size_t n = this->listPoint.size(), i;
+	int moved = (h.point.size() != n);
+	int k;
+
+	if (moved) {
+		h.point.resize(n);
+		h.id.resize(n);
+		h.type.resize(n);
+		h.viewMode.resize(n);
+		h.opcode.resize(n);
+		h.tra.resize(3*n);
+		h.radius.resize(n);
+	}
+	for (i = 0, ip = this->listPoint.begin(); ip != this->listPoint.end(); ip++, i++) {
+		iPoint *p = *ip;
+		h.point[i] = p;
+		h.id[i] = p->id;
+		h.type[i] = p->type;
+		h.viewMode[i] = p->viewMode;
+		h.opcode[i] = p->actualAction ? p->actualAction->opcode : -1;
+		h.radius[i] = p->ball.distCollision;
+		for (k = 0; k < 3; k++)
+			if (h.tra[3*i + k] != p->position.trans[k][3]) {
+				h.tra[3*i + k] = p->position.trans[k][3];
+				moved = 1;
+			}
+	}
+	if (moved) h.moves++;
+
+	return moved;
+}
+
+// Bounds the marker and the virtual points of the base, where they are now,
+// with a sphere and tests it against the view frustum of the frame, see
+// Arpe::setViewFrustum(). Returns inView.
+int Base::updateView(){
+
+	const iPointHot &h = this->hot;
+	double min[3], max[3], d[3], r, r2;
+	size_t n, j;
+	int i;
+
+	this->gatherPoints();
+	n = h.point.size();
+
+	for (i = 0; i < 3; i++) min[i] = max[i] = 0.0;
+	for (j = 0; j < n; j++) {
+		if (h.type[j] != 1) continue;
+		for (i = 0; i < 3; i++) {
+			if (h.tra[3*j + i] < min[i]) min[i] = h.tra[3*j + i];
+			if (h.tra[3*j + i] > max[i]) max[i] = h.tra[3*j + i];
+		}
+	}
+	for (i = 0; i < 3; i++) this->boundCenter[i] = (min[i] + max[i]) * 0.5;
+
+	// The marker is at the origin.
+	r2 = this->boundCenter[0]*this->boundCenter[0] + this->boundCenter[1]*this->boundCenter[1]
+	   + this->boundCenter[2]*this->boundCenter[2];
+	for (j = 0; j < n; j++) {
+		if (h.type[j] != 1) continue;
+		for (i = 0; i < 3; i++) d[i] = h.tra[3*j + i] - this->boundCenter[i];
+		r = sqrt(d[0]*d[0] + d[1]*d[1] + d[2]*d[2]) + h.radius[j];
+		if (r*r > r2) r2 = r*r;
+	}
+	this->boundRadius = sqrt(r2) + BASE_BOUND_MARGIN;
+
+	this->inView = this->myArpe->sphereInView((*this->myInfraStructure).baseModelview,
+		this->boundCenter, this->boundRadius, &this->viewDepth);
+
+	return this->inView;
+}
+
+// Cell of a grid coordinate, 21 bits each. Far cells may share a key, the
+// points found are tested by their distance anyway.
+static long long gridKey(int cx, int cy, int cz)
+{
+	return ((long long)(cx & 0x1FFFFF) << 42) | ((long long)(cy & 0x1FFFFF) << 21) | (long long)(cz & 0x1FFFFF);
+}
+
+static bool gridLess(const pair<long long, iPoint*> &a, const pair<long long, iPoint*> &b)
+{
+	return a.first < b.first;
+}
+
+// Rebuilds the grid of the iPoints when gatherPoints() found them moved since
+// it was built. The
+// cells are as long as the longest sensing range of the points, the square
+// root of 2*distCollision as Arpe::findPointNearActuator() compares squared
+// distances, so that a query only looks at the 3x3x3 cells around it.
+// Returns 1 when the grid was rebuilt.
+int Base::refreshGrid()
+{
+	const iPointHot &h = this->hot;
+	size_t n, i;
+	double range = 0.0;
+
+	this->gatherPoints();
+	if (this->gridMoves == h.moves) return 0;
+	this->gridMoves = h.moves;
+
+	n = h.point.size();
+	for (i = 0; i < n; i++)
+		if (h.radius[i]*2 > range) range = h.radius[i]*2;
+	this->gridCell = sqrt(range);
+	if (this->gridCell < 1.0) this->gridCell = 1.0;
+
+	this->gridPoint.clear();
+	this->gridPoint.reserve(n);
+	for (i = 0; i < n; i++)
+		this->gridPoint.push_back(make_pair(gridKey((int)floor(h.tra[3*i] / this->gridCell),
+			(int)floor(h.tra[3*i + 1] / this->gridCell),
+			(int)floor(h.tra[3*i + 2] / this->gridCell)), h.point[i]));
+	sort(this->gridPoint.begin(), this->gridPoint.end(), gridLess);
+
+	return 1;
+}
+
+// The iPoints of the cells within gridCell of the actuator at, in base
+// coordinates, with their squared distances to it, kept for distanceTo().
+// They are only looked for again, and their ipDist set, when the actuator
+// moved or the grid was rebuilt since the last query of the actuator.
+const Base::Sensed *Base::sensePoints(int actuatorID, const double at[3])
+{
+	Sensed &s = this->sensed[actuatorID];
+	double d[3];
+	ipDist *ipdist;
+	size_t j;
+	int i;
+
+	if (s.moves == this->gridMoves && s.at[0] == at[0] && s.at[1] == at[1] && s.at[2] == at[2]) return &s;
+	for (i = 0; i < 3; i++) s.at[i] = at[i];
+	s.moves = this->gridMoves;
+
+	s.point.clear();
+	this->pointsNear(at, s.point);
+	s.dist.resize(s.point.size());
+	for (j = 0; j < s.point.size(); j++) {
+		for (i = 0; i < 3; i++) d[i] = s.point[j]->position.trans[i][3] - at[i];
+		s.dist[j] = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+		if ((ipdist = s.point[j]->findActuator(actuatorID)) != 0) ipdist->distance = s.dist[j];
+	}
+	return &s;
+}
+
+// Appends to inRange the iPoints of the cells within gridCell of at, in base
+// coordinates. Returns how many.
+int Base::pointsNear(const double at[3], vector<iPoint*> &inRange)
+{
+	vector< pair<long long, iPoint*> >::iterator lo, hi;
+	int c0[3], c1[3], cx, cy, cz, i, found = 0;
+
+	if (this->gridPoint.empty()) return 0;
+
+	for (i = 0; i < 3; i++) {
+		c0[i] = (int)floor((at[i] - this->gridCell) / this->gridCell);
+		c1[i] = (int)floor((at[i] + this->gridCell) / this->gridCell);
+	}
+	for (cx = c0[0]; cx <= c1[0]; cx++)
+		for (cy = c0[1]; cy <= c1[1]; cy++)
+			for (cz = c0[2]; cz <= c1[2]; cz++) {
+				pair<long long, iPoint*> key(gridKey(cx, cy, cz), (iPoint*)0);
+				lo = lower_bound(this->gridPoint.begin(), this->gridPoint.end(), key, gridLess);
+				hi = upper_bound(lo, this->gridPoint.end(), key, gridLess);
+				for (; lo != hi; lo++, found++) inRange.push_back((*lo).second);
+			}
+
+	return found;
+}
+
+// Squared distance of p to where the actuator was last queried with
+// sensePoints(). Returns 0 when it was not queried yet.
+int Base::distanceTo(iPoint *p, int actuatorID, double *dist)
+{
+	map<int, Sensed>::iterator a = this->sensed.find(actuatorID);
+	double d[3];
+	int i;
+
+	if (a == this->sensed.end() || (*a).second.moves < 0) return 0;
+	for (i = 0; i < 3; i++) d[i] = p->position.trans[i][3] - (*a).second.at[i];
+	*dist = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+	return 1;
+}
+
 int Base::showBaseItens(){
 
 	InfraStructure* infra = this->myInfraStructure;
 	list<InfraSource*>::iterator iSource;
-	double m[16];
 
-	if(!this->myArpe->audioEngine->isCurrentlyPlaying(this->visibleSound->audioSource))	
+	if(!this->visibleSound->isPlaying())	
 		visibleSound->play2D();
 
+	// Nothing of the base can be seen.
+	if (!this->inView) return 1;
+
 	glPushMatrix();
 
 	// DRAW MARKER COVER (if source is marker)
@@ -413,8 +636,7 @@ int Base::showBaseItens(){
 			case 1:{
 				InfraARTKSM* b = static_cast<InfraARTKSM*>(*iSource);
 					glPushMatrix();
-					arglCameraViewRH((*this->myInfraStructure).baseTrans,m,VIEW_SCALEFACTOR_1);
-					glLoadMatrixd(m);
+					glLoadMatrixd((*this->myInfraStructure).baseModelview);
 
 
 				// DRAW MARKER COVER
@@ -437,23 +659,51 @@ int Base::showBaseItens(){
 	}
 
 	
-	list<iPoint*>::iterator ip;
+	const iPointHot &h = this->hot;
+	iPoint *ip;
+	size_t j;
+	double m[16];
 
-	for( ip = this->listPoint.begin(); ip != this->listPoint.end(); ip++){ //Search for iPoints
-		if( (*ip)->type == 1){
-			glPushMatrix();
-				arglCameraViewRH((*this->myInfraStructure).baseTrans,m,VIEW_SCALEFACTOR_1);
-				// DRAW IPOINTS
-				glLoadMatrixd(m);	
-				(*(*ip)).showBall();	
+	// The points mostly share the same few ball models, the transforms of
+	// each model are gathered and drawn in a single call below.
+	map<iVrml*, vector<double> > balls;
+	map<iVrml*, vector<double> >::iterator ib;
+
+	// Gathered by updateView() of this frame.
+	for (j = 0; j < h.point.size(); j++) { //Search for iPoints
+		if (h.type[j] == 1) {
+			if (!this->myArpe->sphereInView((*this->myInfraStructure).baseModelview,
+				&h.tra[3*j], h.radius[j] + BASE_BOUND_MARGIN, NULL)) continue;
+			ip = h.point[j];
+
+			// DRAW IPOINTS
+			iVrml* model = (*ip).ballModel();
+			if( model != 0){
+				ip->position.bakeGL(ip->position.trans, m);
+				// Flashing, or seen through, it is drawn after the opaque ones.
+				if( (*ip).viewMode == 4 || arVrmlIsBlended((*model).vrmlID) == 1)
+					blendQueueAdd(model, (*this->myInfraStructure).baseModelview, m);
+				else
+					balls[model].insert(balls[model].end(), m, m + 16);
+			}
 
+			glPushMatrix();
 				// DRAW OBJECTS
-				(*(*ip)).showObjects();
+				glLoadMatrixd((*this->myInfraStructure).baseModelview);	
+				(*ip).showObjects();
 
 				glPopMatrix();
 		}
 	}
 
+	glPushMatrix();
+	glLoadMatrixd((*this->myInfraStructure).baseModelview);
+	for( ib = balls.begin(); ib != balls.end(); ib++)
+		(*(*ib).first).drawInstanced(
+			reinterpret_cast<const double (*)[16]>(&(*ib).second[0]),
+			(int)((*ib).second.size() / 16));
+	glPopMatrix();
+
 	glPopMatrix();
 
 	return 1;
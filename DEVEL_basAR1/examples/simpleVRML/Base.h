@@ -2,23 +2,45 @@
 #define Base_h
 
 #include <list>
+#include <map>
+#include <vector>
 using namespace std;
 
 #include "AudioArpe.h"
 #include "iPoint.h"
 #include "iVrml.h"
+#include "ConfigBundle.h"
+#include "ArpeAlloc.h"
+
+#define BASE_BOUND_MARGIN		50.0		// mm around the points and the marker for the models drawn there.
 
 class InfraStructure;
 class Arpe;
 
-class Base {
+// The state of the iPoints of a base that the per-frame passes read, as a
+// struct of arrays in listPoint order. The iPoints keep the rest, and their
+// position stays the one that is written, see Base::gatherPoints().
+struct iPointHot {
+	vector<iPoint*> point;
+	vector<int> id;
+	vector<int> type;
+	vector<int> viewMode;
+	vector<int> opcode;		// Of actualAction, -1 without one
+	vector<double> tra;		// Translation of position.trans, 3 per point
+	vector<double> radius;	// ball.distCollision
+	int moves;				// Times gatherPoints() found a point moved
+
+	iPointHot() : moves(0) {}
+};
+
+class Base : public ArpeAlloc {
 
  public:
     Base();
 	~Base();
 
 	//base configuration
-	char getBuff(char *buf, int n, FILE *fp);
+	char getBuff(char *buf, int n, CfgFile *fp);
     int baseReadFile();
     int baseWriteFile();
 	int id;
@@ -28,7 +50,12 @@ class Base {
 	int			adaptType; // Adaptation type depends on the User Profile.
 
 	// Show base Itens
+	int updateView();
 	int showBaseItens();
+	double boundCenter[3];	// Sphere around the marker and the points, in base coordinates
+	double boundRadius;
+	int inView;				// Of this frame, see updateView()
+	double viewDepth;
 
 	//Audio
 	AudioArpe* visibleSound;
@@ -36,15 +63,39 @@ class Base {
 
 	//Infrastructure
     InfraStructure* myInfraStructure;
+	void markerPatterns(vector<int> &patterns) const;	// Appends those of its marker sources
+	int showsPoints() const;							// A point isn't hidden
 
 	//iPoints
 	list< iPoint* > listPoint;
     void addPoint(iPoint* value);
     iPoint* findPoint(int valueID);
+	iPointHot hot;
+	int gatherPoints();
+
+	//Proximity of the iPoints to the actuators, see Arpe::findPointNearActuator()
+	struct Sensed {
+		double at[3];			// The actuator, in base coordinates
+		int moves;				// gridMoves the points were found at, -1 before
+		vector<iPoint*> point;	// In the cells around it
+		vector<double> dist;	// Their squared distances to it
+
+		Sensed() : moves(-1) {}
+	};
+	int refreshGrid();
+	const Sensed *sensePoints(int actuatorID, const double at[3]);
+	int distanceTo(iPoint *p, int actuatorID, double *dist);
+	double gridCell;		// Edge of the grid cells, the longest sensing range of the points
 
 	Arpe *myArpe;
 	iVrml *status;
 
+private:
+	vector< pair<long long, iPoint*> > gridPoint;	// The iPoints sorted by cell
+	int gridMoves;		// hot.moves the grid was built at
+	map<int, Sensed> sensed;	// Last query of each actuator
+	int pointsNear(const double at[3], vector<iPoint*> &inRange);
+
 };
 
 #endif // Base_h
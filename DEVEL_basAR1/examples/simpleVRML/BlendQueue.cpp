@@ -0,0 +1,72 @@
+#include <string.h>
+
+#include <GL/glut.h>
+#include <AR/arvrml.h>
+
+#include "BlendQueue.h"
+#include "iVrml.h"
+
+#include <vector>
+#include <algorithm>
+using namespace std;
+
+struct BlendItem {
+	double	depth;			// z of the origin of the model, in eye coordinates.
+	iVrml	*model;
+	double	modelview[16];
+};
+
+static vector<BlendItem>	items;
+static vector<double>		transforms;
+
+void blendQueueAdd(iVrml *model, const double base[16], const double local[16])
+{
+	BlendItem b;
+	int i, j;
+
+	b.model = model;
+	for (j = 0; j < 4; j++)
+		for (i = 0; i < 4; i++)
+			b.modelview[j*4 + i] = base[i]*local[j*4] + base[4 + i]*local[j*4 + 1]
+				+ base[8 + i]*local[j*4 + 2] + base[12 + i]*local[j*4 + 3];
+	b.depth = b.modelview[14];
+	items.push_back(b);
+}
+
+// The camera looks down -z: the most negative is the furthest.
+static bool further(const BlendItem &a, const BlendItem &b)
+{
+	return a.depth < b.depth;
+}
+
+void blendQueueDraw(void)
+{
+	size_t i, j, k;
+
+	if (items.empty()) return;
+
+	// Stable, the points at the same depth keep their order from frame to frame.
+	stable_sort(items.begin(), items.end(), further);
+
+	glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDepthMask(GL_FALSE);		// Tested against the opaque ones, hiding none of the others.
+	arVrmlSetBlendExternal(1);
+
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	for (i = 0; i < items.size(); i = j) {
+		for (j = i + 1; j < items.size() && items[j].model == items[i].model; j++);
+		transforms.clear();
+		for (k = i; k < j; k++)
+			transforms.insert(transforms.end(), items[k].modelview, items[k].modelview + 16);
+		(*items[i].model).drawInstanced(reinterpret_cast<const double (*)[16]>(&transforms[0]), (int)(j - i));
+	}
+	glPopMatrix();
+
+	arVrmlSetBlendExternal(0);
+	glPopAttrib();
+	items.clear();
+}
@@ -0,0 +1,23 @@
+#ifndef BlendQueue_h
+#define BlendQueue_h
+
+// The models drawn blended: the balls of FLASH_BALL, the objects of GHOST
+// and any model arVrmlIsBlended() says has transparent shapes.
+//
+// Blended where showBaseItens() reaches them, they would be drawn in the
+// order of the points, some over the opaque models behind them not drawn
+// yet, and each scene turns GL_BLEND on and off again. They are queued with
+// their modelview instead, and blendQueueDraw(), once the opaque models of
+// the bases and actuators are drawn, sorts them back to front by the depth
+// of their origin in eye coordinates and draws them with the blend state
+// and the depth writes set once for all of them. Models next to each other
+// in that order are drawn in a single arVrmlDrawInstanced().
+
+class iVrml;
+
+// The model under base times local, both column-major.
+void	blendQueueAdd(iVrml *model, const double base[16], const double local[16]);
+// Draws the queue and empties it, the projection of the frame set.
+void	blendQueueDraw(void);
+
+#endif // BlendQueue_h
@@ -0,0 +1,197 @@
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <AR/config.h>
+#include <AR/ar.h>
+
+#include "Broadcast.h"
+
+#define BROADCAST_TTL		4			// Router hops of a multicast group.
+
+struct BroadcastKeyPose {
+	int			found;
+	double		pos[3];
+	short		quat[4];
+};
+
+struct BroadcastSession {
+	int			session;
+	int			targets;
+	unsigned long seq;
+	unsigned long key;
+	int			sinceKey;				// Frames since the key.
+	int			rekey;					// A target went out of reach of the deltas.
+	BroadcastHeader head;				// Of the frame.
+	BroadcastKeyPose *keyPose;			// By target.
+	char		datagram[BROADCAST_DATAGRAM];
+	int			length;
+};
+
+static SOCKET			sock = INVALID_SOCKET;
+static sockaddr_in		target;
+
+int broadcastStart(const char *hostPort)
+{
+	WSADATA wsa;
+	addrinfo hints, *res;
+	char name[256], *port;
+	u_long nonBlocking = 1;
+	BOOL on = TRUE;
+	int ttl = BROADCAST_TTL;
+
+	if (sock != INVALID_SOCKET) return 0;
+	strncpy(name, hostPort, sizeof(name) - 1);
+	name[sizeof(name) - 1] = '\0';
+	if ((port = strrchr(name, ':')) == NULL) {
+		printf("\n Broadcast: %s is not host:port", hostPort);
+		return -1;
+	}
+	*port++ = '\0';
+
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return -1;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (getaddrinfo(name, port, &hints, &res) != 0) {
+		printf("\n Broadcast: unable to resolve %s", hostPort);
+		return -1;
+	}
+	memcpy(&target, res->ai_addr, sizeof(target));
+	freeaddrinfo(res);
+	if ((sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == INVALID_SOCKET) return -1;
+	ioctlsocket(sock, FIONBIO, &nonBlocking);		// A full network drops datagrams, never the frame.
+	setsockopt(sock, SOL_SOCKET, SO_BROADCAST, (const char *)&on, sizeof(on));
+	if (IN_MULTICAST(ntohl(target.sin_addr.s_addr)))
+		setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, (const char *)&ttl, sizeof(ttl));
+	printf("\n Poses broadcast to %s", hostPort);
+	return 0;
+}
+
+BroadcastSession *broadcastSessionCreate(int session, int targets)
+{
+	BroadcastSession *b;
+
+	if (sock == INVALID_SOCKET) return 0;
+	if (targets > BROADCAST_TARGETS) {
+		printf("\n Broadcast: only the first %d targets of session %d are sent", BROADCAST_TARGETS, session);
+		targets = BROADCAST_TARGETS;
+	}
+	b = new BroadcastSession;
+	b->session = session;
+	b->targets = targets;
+	b->seq = 0;
+	b->key = 0;
+	b->sinceKey = 0;
+	b->rekey = TRUE;
+	b->keyPose = new BroadcastKeyPose[targets > 0 ? targets : 1];
+	memset(b->keyPose, 0, sizeof(BroadcastKeyPose) * (targets > 0 ? targets : 1));
+	b->length = 0;
+	return b;
+}
+
+void broadcastSessionDelete(BroadcastSession *b)
+{
+	if (!b) return;
+	delete [] b->keyPose;
+	delete b;
+}
+
+// The datagram so far, with the header of the frame.
+static void flush(BroadcastSession *b, int last)
+{
+	BroadcastHeader *h = (BroadcastHeader *)b->datagram;
+
+	*h = b->head;
+	h->seq = b->seq++;
+	h->records = (unsigned char)((b->length - sizeof(BroadcastHeader)) /
+		((b->head.flags & BROADCAST_KEY)? sizeof(BroadcastKeyRecord): sizeof(BroadcastDeltaRecord)));
+	if (last) h->flags |= BROADCAST_LAST;
+	sendto(sock, b->datagram, b->length, 0, (const sockaddr *)&target, sizeof(target));
+	b->length = sizeof(BroadcastHeader);
+}
+
+// Room for a record of size bytes, sending the datagram if it is full.
+static void *record(BroadcastSession *b, int size)
+{
+	void *r;
+
+	if (b->length + size > BROADCAST_DATAGRAM) flush(b, FALSE);
+	r = b->datagram + b->length;
+	b->length += size;
+	return r;
+}
+
+void broadcastBegin(BroadcastSession *b, long frame, long long time)
+{
+	if (!b) return;
+	memset(&b->head, 0, sizeof(b->head));
+	b->head.magic = BROADCAST_MAGIC;
+	b->head.version = BROADCAST_VERSION;
+	b->head.session = (unsigned char)b->session;
+	b->head.frame = (unsigned long)frame;
+	b->head.time = time;
+	b->head.targets = (unsigned short)b->targets;
+	if (b->rekey || ++b->sinceKey >= BROADCAST_KEY_FRAMES) {
+		b->head.flags = BROADCAST_KEY;
+		b->key = b->seq;
+		b->sinceKey = 0;
+		b->rekey = FALSE;
+	}
+	b->head.key = b->key;
+	b->length = sizeof(BroadcastHeader);
+}
+
+void broadcastTarget(BroadcastSession *b, int target, int pattern, int found, const double trans[3][4])
+{
+	BroadcastKeyPose *k;
+	BroadcastKeyRecord *kr;
+	BroadcastDeltaRecord *dr;
+	double q[4], p[3], d[3];
+	short quat[4];
+	int i, still;
+
+	if (!b || target < 0 || target >= b->targets) return;
+	arUtilMat2QuatPos((double (*)[4])trans, q, p);
+	if (q[3] < 0.0) for (i = 0; i < 4; i++) q[i] = -q[i];
+	for (i = 0; i < 4; i++) quat[i] = (short)floor(q[i] * 32767.0 + 0.5);
+	k = &b->keyPose[target];
+
+	if (b->head.flags & BROADCAST_KEY) {
+		kr = (BroadcastKeyRecord *)record(b, sizeof(BroadcastKeyRecord));
+		kr->target = (unsigned char)target;
+		kr->flags = found ? BROADCAST_FOUND : 0;
+		kr->pattern = (short)pattern;
+		for (i = 0; i < 3; i++) kr->pos[i] = (float)p[i];
+		memcpy(kr->quat, quat, sizeof(quat));
+		k->found = found;
+		for (i = 0; i < 3; i++) k->pos[i] = kr->pos[i];	// As the receivers have it.
+		memcpy(k->quat, quat, sizeof(quat));
+		return;
+	}
+
+	still = (!found == !k->found);
+	for (i = 0; i < 3; i++) {
+		d[i] = floor((p[i] - k->pos[i]) / BROADCAST_UNIT + 0.5);
+		if (d[i] < -32767.0 || d[i] > 32767.0) { b->rekey = TRUE; return; }
+		if (d[i] != 0.0) still = FALSE;
+	}
+	for (i = 0; i < 4 && still; i++) if (abs(quat[i] - k->quat[i]) > BROADCAST_TURN) still = FALSE;
+	if (still) return;
+
+	dr = (BroadcastDeltaRecord *)record(b, sizeof(BroadcastDeltaRecord));
+	dr->target = (unsigned char)target;
+	dr->flags = found ? BROADCAST_FOUND : 0;
+	for (i = 0; i < 3; i++) dr->pos[i] = (short)d[i];
+	memcpy(dr->quat, quat, sizeof(quat));
+}
+
+void broadcastEnd(BroadcastSession *b)
+{
+	if (!b) return;
+	flush(b, TRUE);		// Even with no records, for the time and the losses.
+}
@@ -0,0 +1,90 @@
+#ifndef Broadcast_h
+#define Broadcast_h
+
+// The poses of every frame tracked, streamed with -broadcast host:port on
+// the command line to the other tables of an installation and to remote
+// dashboards, in UDP datagrams of a compact binary form. host may be a
+// multicast group, or a broadcast address.
+//
+// Each session sends on its own: every datagram begins with a
+// BroadcastHeader, of which seq counts the datagrams of the session so that
+// a gap is a loss. A frame goes in one datagram, or more if it does not fit,
+// the last flagged BROADCAST_LAST.
+//
+// One frame in BROADCAST_KEY_FRAMES is a key, flagged BROADCAST_KEY: a
+// BroadcastKeyRecord for every target of the session. The frames in between
+// carry a BroadcastDeltaRecord only for the targets that moved, were found
+// or were lost since the key, each against its pose in the key: the static
+// markers go only with the keys. As the deltas are against the key and not
+// the frame before, a datagram lost costs only its own frame; a key lost
+// leaves the deltas after it for the key of header.key until the next one.
+// Positions in the deltas are in BROADCAST_UNIT of the pose's units, and a
+// target too far from its key pose for them makes the next frame a key.
+//
+// The rotations are unit quaternions, w not negative, each component as a
+// signed 16 bit fraction of 32767. Everything is little endian.
+//
+// The tracking thread of the session serializes each frame into a buffer
+// of its own and sends it on a non-blocking socket: nothing is allocated
+// and a datagram the network has no room for is dropped, never the frame.
+
+#define BROADCAST_MAGIC			0x4142		// "BA"
+#define BROADCAST_VERSION		1
+#define BROADCAST_DATAGRAM		1400		// Bytes at most, within an Ethernet frame.
+#define BROADCAST_KEY_FRAMES	30
+#define BROADCAST_UNIT			0.5
+#define BROADCAST_TURN			16			// Of the quaternion, in 1/32767, that is still.
+#define BROADCAST_TARGETS		256
+
+// BroadcastHeader.flags
+#define BROADCAST_KEY			0x01
+#define BROADCAST_LAST			0x02
+
+// BroadcastKeyRecord.flags, BroadcastDeltaRecord.flags
+#define BROADCAST_FOUND			0x01
+
+#pragma pack(push, 1)
+struct BroadcastHeader {
+	unsigned short	magic;
+	unsigned char	version;
+	unsigned char	session;
+	unsigned long	seq;
+	unsigned long	key;			// seq of the first datagram of the key the deltas are against.
+	unsigned long	frame;			// Capture order.
+	long long		time;			// Capture time, microseconds on the clock of arVideoTime().
+	unsigned char	flags;
+	unsigned char	records;
+	unsigned short	targets;		// Of the session.
+};
+
+struct BroadcastKeyRecord {
+	unsigned char	target;			// In the order of the actuators then the bases of the session.
+	unsigned char	flags;
+	short			pattern;
+	float			pos[3];
+	short			quat[4];		// x, y, z, w.
+};
+
+struct BroadcastDeltaRecord {
+	unsigned char	target;
+	unsigned char	flags;
+	short			pos[3];			// From the key, in BROADCAST_UNIT.
+	short			quat[4];		// Not a delta.
+};
+#pragma pack(pop)
+
+struct BroadcastSession;
+
+// 0, or -1 when host:port is not valid or there is no socket.
+int		broadcastStart(const char *hostPort);
+// At start up, of a session of targets; 0 without broadcastStart().
+BroadcastSession *broadcastSessionCreate(int session, int targets);
+void	broadcastSessionDelete(BroadcastSession *b);
+
+// The tracking thread of the session, for each frame: begin, every target
+// in order, and end, which sends what is left.
+void	broadcastBegin(BroadcastSession *b, long frame, long long time);
+void	broadcastTarget(BroadcastSession *b, int target, int pattern, int found, const double trans[3][4]);
+void	broadcastEnd(BroadcastSession *b);
+
+#endif // Broadcast_h
@@ -0,0 +1,152 @@
+#include "ConfigBundle.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+using namespace std;
+
+struct CfgFile {
+	const char *data;
+	size_t size;
+	size_t pos;
+};
+
+// The files of the bundle and those read since, by the name they are opened by
+static map<string, string> cfgFiles;
+
+// Reads the file whole, with the line ends of a file opened as text.
+static int cfgReadAll(const char *filename, string &out)
+{
+	FILE *fp;
+	long size;
+	size_t i, j;
+
+	if ((fp = fopen(filename, "rb")) == NULL) return -1;
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	out.resize(size > 0 ? size : 0);
+	if (size > 0 && fread(&out[0], 1, size, fp) != (size_t)size) { fclose(fp); return -1; }
+	fclose(fp);
+
+	for (i = j = 0; i < out.size(); i++)
+		if (out[i] != '\r' || i + 1 == out.size() || out[i + 1] != '\n') out[j++] = out[i];
+	out.resize(j);
+	return 0;
+}
+
+// Returns how many files the bundle holds, -1 when it can't be read.
+int cfgBundleLoad(const char *filename)
+{
+	string all;
+	char magic[32], name[256];
+	int version, num, used, i;
+	unsigned long offset, size;
+	const char *p;
+	size_t start;
+
+	if (cfgReadAll(filename, all) < 0) return -1;
+	p = all.c_str();
+	if (sscanf(p, "%31s %d %d%n", magic, &version, &num, &used) != 3
+		|| strcmp(magic, CFG_BUNDLE_MAGIC) != 0 || version != CFG_BUNDLE_VERSION || num < 0) {
+		printf("\n %s is not a bundle", filename);
+		return -1;
+	}
+
+	// The index ends at the line after the last file.
+	start = used;
+	for (i = 0; i <= num && start < all.size(); i++) {
+		start = all.find('\n', start);
+		if (start == string::npos) break;
+		start++;
+	}
+	if (start == string::npos || i <= num) { printf("\n %s - Check bundle index", filename); return -1; }
+
+	p += used;
+	for (i = 0; i < num; i++) {
+		if (sscanf(p, "%lu %lu %255s%n", &offset, &size, name, &used) != 3
+			|| start + offset + size > all.size()) {
+			printf("\n %s - Check bundle index", filename);
+			return -1;
+		}
+		p += used;
+		cfgFiles[name] = all.substr(start + offset, size);
+	}
+
+	printf("\n %d configuration files read from %s", num, filename);
+	return num;
+}
+
+// Returns how many files the bundle was written with, -1 on error.
+int cfgBundleWrite(const char *filename)
+{
+	map<string, string>::iterator it;
+	unsigned long offset = 0;
+	FILE *fp;
+	int ok;
+
+	if ((fp = fopen(filename, "wb")) == NULL) { printf("\n Error on opening %s !! ", filename); return -1; }
+	fprintf(fp, "%s %d\n%d\n", CFG_BUNDLE_MAGIC, CFG_BUNDLE_VERSION, (int)cfgFiles.size());
+	for (it = cfgFiles.begin(); it != cfgFiles.end(); it++) {
+		fprintf(fp, "%lu %lu %s\n", offset, (unsigned long)(*it).second.size(), (*it).first.c_str());
+		offset += (unsigned long)(*it).second.size();
+	}
+	for (it = cfgFiles.begin(); it != cfgFiles.end(); it++)
+		fwrite((*it).second.data(), 1, (*it).second.size(), fp);
+	ok = !ferror(fp);
+	if (fclose(fp) != 0) ok = 0;
+	if (!ok) { printf("\n Error on writing %s !! ", filename); return -1; }
+
+	printf("\n %d configuration files written to %s", (int)cfgFiles.size(), filename);
+	return (int)cfgFiles.size();
+}
+
+// Returns -1 when the file can't be read, and the copy opened stays as it was.
+int cfgRefresh(const char *filename)
+{
+	string data;
+
+	if (cfgReadAll(filename, data) < 0) return -1;
+	cfgFiles[filename].swap(data);
+	return 0;
+}
+
+CfgFile *cfgOpen(const char *filename)
+{
+	map<string, string>::iterator it = cfgFiles.find(filename);
+	CfgFile *fp;
+
+	if (it == cfgFiles.end()) {
+		string data;
+		if (cfgReadAll(filename, data) < 0) return NULL;
+		it = cfgFiles.insert(make_pair(string(filename), data)).first;
+	}
+
+	fp = new CfgFile;
+	fp->data = (*it).second.data();
+	fp->size = (*it).second.size();
+	fp->pos = 0;
+	return fp;
+}
+
+// As fgets(), the line with its '\n' and as much as fits in n - 1 chars.
+char *cfgGets(char *buf, int n, CfgFile *fp)
+{
+	int i = 0;
+
+	if (fp->pos >= fp->size || n <= 0) return NULL;
+	while (i < n - 1 && fp->pos < fp->size) {
+		buf[i] = fp->data[fp->pos++];
+		if (buf[i++] == '\n') break;
+	}
+	buf[i] = '\0';
+	return buf;
+}
+
+void cfgClose(CfgFile *fp)
+{
+	delete fp;
+}
@@ -0,0 +1,30 @@
+#ifndef ConfigBundle_h
+#define ConfigBundle_h
+
+// The configuration files of a project, read in one go.
+//
+// cfgOpen() gives the file from the bundle loaded by cfgBundleLoad() or, when
+// it is not there, reads the text file whole; the loaders then take its lines
+// with cfgGets() as they did with fgets(). cfgBundleWrite() saves all the
+// files read so far as a bundle, so that the text files stay the way a
+// project is made and edited. cfgRefresh() reads a file from disk again,
+// for the next cfgOpen() of it, while none of it is open.
+//
+// A bundle starts with a line "BASAR_BUNDLE 1", the number of files and one
+// line "offset size name" for each, followed by the files one after the
+// other. The offsets count from the end of that index.
+
+#define CFG_BUNDLE_MAGIC	"BASAR_BUNDLE"
+#define CFG_BUNDLE_VERSION	1
+
+typedef struct CfgFile CfgFile;
+
+int		cfgBundleLoad(const char *filename);
+int		cfgBundleWrite(const char *filename);
+
+int		cfgRefresh(const char *filename);
+CfgFile	*cfgOpen(const char *filename);
+char	*cfgGets(char *buf, int n, CfgFile *fp);
+void	cfgClose(CfgFile *fp);
+
+#endif // ConfigBundle_h
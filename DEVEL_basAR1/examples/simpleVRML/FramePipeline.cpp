@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <process.h>
+
+#include <algorithm>
+
+#include <AR/config.h>
+#include <AR/video.h>
+#include <AR/ar.h>
+
+#include "FramePipeline.h"
+#include "AllocCheck.h"
+
+FramePipeline::FramePipeline()
+{
+	InitializeCriticalSection(&cs);
+	capturedEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	captureHandle = 0;
+	detectHandle = 0;
+	running = false;
+	threshold = 0;
+	video = 0;
+	handle = 0;
+	tracker = 0;
+	trackerData = 0;
+	seq = 0;
+	takenSeq = 0;
+	dropped = 0;
+	imageSize = 0;
+	imageProcMode = -1;
+	pyramidMode = -1;
+	detectEvery = 1;
+	exposureOn = false;
+	exposurePending = 0;
+	arExposureInit(&exposure);
+	for (int i = 0; i < FRAME_PIPELINE_SLOTS; i++) {
+		slot[i].image = 0;
+		slot[i].marker_num = 0;
+		slot[i].state = SLOT_FREE;
+		slot[i].seq = 0;
+		slot[i].time = 0.0;
+		memset(slot[i].stamp, 0, sizeof(slot[i].stamp));
+	}
+}
+
+FramePipeline::~FramePipeline()
+{
+	stop();
+	for (int i = 0; i < FRAME_PIPELINE_SLOTS; i++) arImageFree(slot[i].image);
+	CloseHandle(capturedEvent);
+	DeleteCriticalSection(&cs);
+}
+
+int FramePipeline::start(int xsize, int ysize, int stride, int *threshold)
+{
+	if (running) return 1;
+
+	this->threshold = threshold;
+	imageSize = (stride > 0 ? stride : xsize * AR_PIX_SIZE_DEFAULT) * ysize;
+	for (int i = 0; i < FRAME_PIPELINE_SLOTS; i++) {
+		arImageFree(slot[i].image);
+		slot[i].image = (ARUint8 *)arImageAlloc(AR_MEM_VIDEO, imageSize);
+		if (slot[i].image == 0) {
+			printf("\n FramePipeline: out of memory");
+			return 0;
+		}
+		slot[i].state = SLOT_FREE;
+	}
+
+	if (exposureOn) {
+		arExposureInit(&exposure);
+		exposureSet[0] = exposure.exposure;
+		exposureSet[1] = exposure.gain;
+		exposurePending = 1;
+	}
+
+	running = true;
+	captureHandle = (HANDLE)_beginthreadex(NULL, 0, captureThread, this, 0, NULL);
+	detectHandle  = (HANDLE)_beginthreadex(NULL, 0, detectThread, this, 0, NULL);
+	if (captureHandle == 0 || detectHandle == 0) {
+		printf("\n FramePipeline: unable to start threads");
+		stop();
+		return 0;
+	}
+	return 1;
+}
+
+void FramePipeline::stop()
+{
+	running = false;
+	SetEvent(capturedEvent);
+	if (captureHandle) {
+		WaitForSingleObject(captureHandle, INFINITE);
+		CloseHandle(captureHandle);
+		captureHandle = 0;
+	}
+	if (detectHandle) {
+		WaitForSingleObject(detectHandle, INFINITE);
+		CloseHandle(detectHandle);
+		detectHandle = 0;
+	}
+}
+
+void FramePipeline::setSource(AR2VideoParamT *video, ARHandle *handle)
+{
+	if (running) return;
+	this->video = video;
+	this->handle = handle;
+}
+
+void FramePipeline::setTracker(Tracker t, void *data)
+{
+	if (running) return;
+	tracker = t;
+	trackerData = data;
+}
+
+void FramePipeline::setModes(int imageProcMode, int pyramidMode, int detectEvery)
+{
+	this->imageProcMode = imageProcMode;
+	this->pyramidMode = pyramidMode;
+	if (detectEvery > 0) this->detectEvery = detectEvery;
+}
+
+void FramePipeline::setExposure(bool on)
+{
+	if (running) return;
+	exposureOn = on;
+}
+
+FramePipeline::Slot* FramePipeline::acquireReady()
+{
+	Slot *s;
+
+	EnterCriticalSection(&cs);
+	s = newest(SLOT_READY);
+	if (s) {
+		for (int i = 0; i < FRAME_PIPELINE_SLOTS; i++) {
+			if (slot[i].state == SLOT_DISPLAYED || (slot[i].state == SLOT_READY && &slot[i] != s))
+				slot[i].state = SLOT_FREE;
+		}
+		s->state = SLOT_DISPLAYED;
+		if (s->seq > takenSeq + 1) dropped += s->seq - takenSeq - 1;
+		takenSeq = s->seq;
+	}
+	LeaveCriticalSection(&cs);
+	return s;
+}
+
+// Must be called inside cs.
+FramePipeline::Slot* FramePipeline::newest(int state)
+{
+	Slot *s = 0;
+
+	for (int i = 0; i < FRAME_PIPELINE_SLOTS; i++) {
+		if (slot[i].state == state && (s == 0 || slot[i].seq > s->seq)) s = &slot[i];
+	}
+	return s;
+}
+
+unsigned __stdcall FramePipeline::captureThread(void *data)
+{
+	static_cast<FramePipeline *>(data)->captureLoop();
+	return 0;
+}
+
+unsigned __stdcall FramePipeline::detectThread(void *data)
+{
+	static_cast<FramePipeline *>(data)->detectLoop();
+	return 0;
+}
+
+void FramePipeline::captureLoop()
+{
+	ARUint8 *image;
+	Slot *s;
+	double time;
+	long long driverTime;
+	long captured = 0;
+	int i;
+
+	CoInitialize(NULL);
+	arThreadRole(AR_THREAD_CAPTURE, "pipeline capture");
+	while (running) {
+		if (exposurePending && InterlockedExchange(&exposurePending, 0) && setCamera(false) < 0) {
+			printf("\n FramePipeline: the camera has no exposure or gain control");
+			exposureOn = false;
+		}
+
+		// Blocks for up to the video library's frame timeout.
+		AR_TRACE_BEGIN("ar2VideoGetImage");
+		image = video ? ar2VideoGetImage(video) : arVideoGetImage();
+		AR_TRACE_END();
+		if (image == NULL) continue;
+		if (++captured % detectEvery != 0) {
+			if (video) ar2VideoCapNext(video);
+			else arVideoCapNext();
+			continue;
+		}
+		time = arUtilTimer();
+		if ((video ? ar2VideoInqFrameInfo(video, &driverTime, NULL) : arVideoInqFrameInfo(&driverTime, NULL)) < 0)
+			driverTime = arVideoTime();
+
+		// A free slot, or else the oldest frame still waiting for detection.
+		EnterCriticalSection(&cs);
+		s = 0;
+		for (i = 0; i < FRAME_PIPELINE_SLOTS && s == 0; i++) {
+			if (slot[i].state == SLOT_FREE) s = &slot[i];
+		}
+		for (i = 0; i < FRAME_PIPELINE_SLOTS && s == 0; i++) {
+			if (slot[i].state == SLOT_CAPTURED) s = &slot[i];
+		}
+		if (s) s->state = SLOT_CAPTURING;
+		LeaveCriticalSection(&cs);
+
+		AR_TRACE_BEGIN("copy");
+		if (s) memcpy(s->image, image, imageSize);
+		AR_TRACE_END();
+		if (video) ar2VideoCapNext(video);
+		else arVideoCapNext();
+		if (s == 0) continue;
+
+		EnterCriticalSection(&cs);
+		s->seq = ++seq;
+		s->time = time;
+		s->stamp[0] = driverTime;
+		s->stamp[LATENCY_CAPTURE + 1] = arVideoTime();
+		s->state = SLOT_CAPTURED;
+		LeaveCriticalSection(&cs);
+		SetEvent(capturedEvent);
+	}
+	if (exposureOn) setCamera(true);
+	arThreadRoleEnd();
+	CoUninitialize();
+}
+
+// Capture thread: the exposure and gain of the control, or the camera's own.
+// -1 if the camera has neither control.
+int FramePipeline::setCamera(bool automatic)
+{
+	double e, g;
+	int re, rg;
+
+	EnterCriticalSection(&cs);
+	e = automatic ? -1.0 : exposureSet[0];
+	g = automatic ? -1.0 : exposureSet[1];
+	LeaveCriticalSection(&cs);
+
+	if (video) {
+		re = ar2VideoSetControl(video, AR_VIDEO_CONTROL_EXPOSURE, e);
+		rg = ar2VideoSetControl(video, AR_VIDEO_CONTROL_GAIN, g);
+	} else {
+		re = arVideoSetControl(AR_VIDEO_CONTROL_EXPOSURE, e);
+		rg = arVideoSetControl(AR_VIDEO_CONTROL_GAIN, g);
+	}
+	return (re < 0 && rg < 0) ? -1 : 0;
+}
+
+// So that each actuator and base finds its marker in one step, rather than
+// each of them going through all the markers.
+void FramePipeline::indexMarkers(Slot *s)
+{
+	int i, id, k;
+
+	std::fill(s->best.begin(), s->best.end(), -1);
+	for (i = 0; i < s->marker_num; i++) {
+		if ((id = s->marker_info[i].id) < 0) continue;
+		if (id >= (int)s->best.size()) s->best.resize(id + 1, -1);
+		k = s->best[id];
+		if (k == -1 || s->marker_info[k].cf < s->marker_info[i].cf) s->best[id] = i;
+	}
+}
+
+void FramePipeline::detectLoop()
+{
+	Slot *s;
+	int mode;
+
+	arThreadRole(AR_THREAD_TRACK, "pipeline detect");
+	while (running) {
+		WaitForSingleObject(capturedEvent, 100);
+
+		// Newest captured frame; older ones are dropped.
+		EnterCriticalSection(&cs);
+		s = newest(SLOT_CAPTURED);
+		if (s) {
+			for (int i = 0; i < FRAME_PIPELINE_SLOTS; i++) {
+				if (slot[i].state == SLOT_CAPTURED && &slot[i] != s) slot[i].state = SLOT_FREE;
+			}
+			s->state = SLOT_DETECTING;
+		}
+		LeaveCriticalSection(&cs);
+		if (s == 0) continue;
+
+		if ((mode = InterlockedExchange(&imageProcMode, -1)) != -1) {
+			if (handle) handle->imageProcMode = mode;
+			else arImageProcMode = mode;
+		}
+		if ((mode = InterlockedExchange(&pyramidMode, -1)) != -1) {
+			if (handle) handle->pyramidMode = mode;
+			else arPyramidMode = mode;
+		}
+
+		// The markers go straight into the slot, which the display
+		// thread then owns along with the image.
+		AR_TRACE_BEGIN("detect");
+		if (handle) arDetectMarkerCopyCtx(handle, s->image, *threshold, s->marker_info, AR_SQUARE_MAX, &s->marker_num);
+		else arDetectMarkerCopy(s->image, *threshold, s->marker_info, AR_SQUARE_MAX, &s->marker_num);
+		indexMarkers(s);
+		AR_TRACE_END();
+		AR_TRACE_BEGIN("track");
+		if (tracker) tracker(s, trackerData);
+		AR_TRACE_END();
+		if (exposureOn && arExposureUpdate(&exposure, handle ? handle : arGetDefaultHandle())) {
+			EnterCriticalSection(&cs);
+			exposureSet[0] = exposure.exposure;
+			exposureSet[1] = exposure.gain;
+			LeaveCriticalSection(&cs);
+			InterlockedExchange(&exposurePending, 1);
+		}
+		s->stamp[LATENCY_DETECT + 1] = arVideoTime();
+
+		EnterCriticalSection(&cs);
+		s->state = SLOT_READY;
+		LeaveCriticalSection(&cs);
+		allocCheckFrame("pipeline detect");
+	}
+	arThreadRoleEnd();
+}
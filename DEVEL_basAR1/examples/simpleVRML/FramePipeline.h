@@ -0,0 +1,146 @@
+#ifndef FramePipeline_h
+#define FramePipeline_h
+
+#include <Windows.h>
+
+#include <AR/ar.h>
+#include <AR/video.h>
+
+#include <vector>
+
+#include "Latency.h"
+
+// Capture -> detect -> render pipeline.
+//
+// A capture thread copies each video frame into a free slot and hands the
+// driver buffer back at once, a detect thread runs arDetectMarker() on the
+// newest captured slot, and the GLUT thread renders the newest detected one.
+// So frame N+1 is captured and N detected while N-1 is drawn.
+//
+// Each slot is owned by exactly one stage at a time, as given by its state.
+// Stale frames are dropped rather than queued, to keep latency at one frame
+// per stage. With 4 slots every stage always finds one to work in.
+//
+// A tracker given by setTracker() is run by the detect thread on each slot
+// once its markers are found, and writes the poses of the frame into it, so
+// that the GLUT thread only takes them with the slot.
+//
+// The frames come from the default video of ARToolKit and are detected in its
+// default context, unless setSource() gives a video stream and a detection
+// context of their own, so that several pipelines may run side by side.
+//
+// With setExposure() the detect thread runs arExposureUpdate() on every
+// frame, and the capture thread sets the camera between two frames, as the
+// driver wants it from the thread that captures.
+//
+// Every slot is stamped, see Latency.h, with the capture time the driver
+// gave its frame and the times the capture and detect threads were done
+// with it.
+
+#define FRAME_PIPELINE_SLOTS 4
+
+class FramePipeline
+{
+public:
+	enum SlotState {
+		SLOT_FREE,			// Nobody's.
+		SLOT_CAPTURING,		// Capture thread is copying into it.
+		SLOT_CAPTURED,		// Waiting for detection.
+		SLOT_DETECTING,		// Detect thread is working on it.
+		SLOT_READY,			// Waiting to be shown.
+		SLOT_DISPLAYED		// GLUT thread is showing it.
+	};
+
+	struct Slot {
+		ARUint8			*image;
+		ARMarkerInfo	marker_info[AR_SQUARE_MAX];
+		int				marker_num;
+		int				state;
+		long			seq;			// Capture order.
+		double			time;			// arUtilTimer() when captured.
+		LatencyStamp	stamp;			// Up to LATENCY_DETECT.
+		std::vector<int> best;			// By marker id, the index of its most confident marker, or -1.
+
+		struct Pose {
+			int			found;
+			double		trans[3][4];	// The last one fitted when not found.
+		};
+		std::vector<Pose> pose;			// Written by the tracker, in its order.
+
+		// The index in marker_info of the marker of id seen with the
+		// highest confidence, -1 when it was not seen.
+		int markerOf(int id) const
+		{
+			return (id >= 0 && id < (int)best.size())? best[id]: -1;
+		}
+	};
+
+	FramePipeline();
+	~FramePipeline();
+
+	// Start the threads. Frames are xsize * ysize pixels in rows of stride
+	// bytes, detected with *threshold (read every frame, so it may be
+	// changed while running).
+	int start(int xsize, int ysize, int stride, int *threshold);
+	void stop();
+
+	// Before start(): the video and detection context, 0 for the defaults.
+	void setSource(AR2VideoParamT *video, ARHandle *handle);
+
+	// Before start(): detect thread, run on each slot after detection.
+	typedef void (*Tracker)(Slot *s, void *data);
+	void setTracker(Tracker t, void *data);
+
+	// GLUT thread: newest detected frame, or 0 if none arrived since the
+	// last call. The slot stays valid until the next call that returns one.
+	Slot* acquireReady();
+
+	// Any thread: how the detect thread detects from its next frame on.
+	// imageProcMode and pyramidMode as in arImageProcMode and arPyramidMode,
+	// -1 to leave them; one frame in detectEvery captured is detected, the
+	// others are handed straight back to the driver.
+	void setModes(int imageProcMode, int pyramidMode, int detectEvery);
+
+	// Before start(): the exposure and gain of the camera follow the
+	// detection, see arExposureUpdate(). The camera has its own control
+	// back when the pipeline stops.
+	void setExposure(bool on);
+
+	// GLUT thread: frames captured that acquireReady() never returned, as
+	// newer ones were ready first.
+	long droppedFrames() const { return dropped; }
+
+private:
+	CRITICAL_SECTION	cs;
+	HANDLE				capturedEvent;
+	HANDLE				captureHandle;
+	HANDLE				detectHandle;
+	volatile bool		running;
+	int					*threshold;
+	AR2VideoParamT		*video;
+	ARHandle			*handle;
+	Tracker				tracker;
+	void				*trackerData;
+	long				seq;
+	long				takenSeq;		// Of the last slot acquireReady() returned.
+	long				dropped;
+	Slot				slot[FRAME_PIPELINE_SLOTS];
+	int					imageSize;
+	volatile LONG		imageProcMode;	// -1 once applied, see setModes().
+	volatile LONG		pyramidMode;
+	volatile int		detectEvery;
+	bool				exposureOn;
+	ARExposure			exposure;		// Detect thread.
+	double				exposureSet[2];	// Exposure and gain to set, in cs.
+	volatile LONG		exposurePending;
+
+	static unsigned __stdcall captureThread(void *data);
+	static unsigned __stdcall detectThread(void *data);
+	void captureLoop();
+	void detectLoop();
+	Slot* newest(int state);
+	int setCamera(bool automatic);
+	static void indexMarkers(Slot *s);
+};
+
+#endif // FramePipeline_h
@@ -0,0 +1,114 @@
+#include <math.h>
+#include <string.h>
+
+#include <AR/config.h>
+#include <AR/ar.h>
+
+#include "Governor.h"
+
+struct GovernorTrack {
+	int			seen;
+	double		pos[2];					// Image widths.
+	double		time;
+};
+
+static GovernorTrack	track[GOVERNOR_SESSIONS][GOVERNOR_IDS];
+
+static int				level = GOVERNOR_FULL;
+static int				quiet;			// Periods the level could have stepped down.
+static int				backoff;		// Periods it may not step up, after late frames.
+static double			periodBegin = -1.0;
+
+// Of the period.
+static double			speed;			// Fastest marker, image widths per second.
+static long				markers;
+static long				frames;
+static long				shown;
+static long				late;
+
+static const char		*levelName[GOVERNOR_LEVELS] = { "FULL", "HALF", "PYRAMID", "SLOW" };
+
+void governorFrame(int session, const ARMarkerInfo *marker, int num, int xsize, double time)
+{
+	GovernorTrack *t;
+	double x, y, dt, v;
+	int i;
+
+	if (session < 0 || session >= GOVERNOR_SESSIONS || xsize <= 0) return;
+	frames++;
+	markers += num;
+	for (i = 0; i < num; i++) {
+		if (marker[i].id < 0 || marker[i].id >= GOVERNOR_IDS) continue;
+		t = &track[session][marker[i].id];
+		x = marker[i].pos[0] / xsize;
+		y = marker[i].pos[1] / xsize;
+		dt = time - t->time;
+		if (t->seen && dt > 0.0 && dt < GOVERNOR_PERIOD) {
+			v = sqrt((x - t->pos[0]) * (x - t->pos[0]) + (y - t->pos[1]) * (y - t->pos[1])) / dt;
+			if (v > speed) speed = v;
+		}
+		t->seen = 1;
+		t->pos[0] = x;
+		t->pos[1] = y;
+		t->time = time;
+	}
+}
+
+void governorShown(double begun, double presented, double budget)
+{
+	shown++;
+	if (presented - begun > budget) late++;
+}
+
+int governorTick(double now)
+{
+	int cap, next;
+
+	if (periodBegin < 0.0) periodBegin = now;
+	if (now - periodBegin < GOVERNOR_PERIOD) return -1;
+
+	// The most the level may be, for the markers of the period.
+	if (speed > GOVERNOR_FAST || (frames > 0 && markers > (long)GOVERNOR_MANY * frames)) cap = GOVERNOR_FULL;
+	else if (speed > GOVERNOR_STILL) cap = GOVERNOR_HALF;
+	else cap = GOVERNOR_SLOW;
+
+	next = level;
+	if (shown > 0 && late > shown * GOVERNOR_LATE) {
+		if (next < GOVERNOR_SLOW) next++;
+		backoff = GOVERNOR_HOLD;
+		quiet = 0;
+	} else if (next > cap) {
+		if (backoff > 0) backoff--;
+		else next = cap;
+		quiet = 0;
+	} else if (next < cap) {
+		if (backoff > 0) backoff--;
+		if (++quiet >= GOVERNOR_HOLD) {
+			next++;
+			quiet = 0;
+		}
+	} else {
+		if (backoff > 0) backoff--;
+		quiet = 0;
+	}
+
+	periodBegin = now;
+	speed = 0.0;
+	markers = frames = shown = late = 0;
+	if (next == level) return -1;
+	level = next;
+	return level;
+}
+
+void governorModes(int level, GovernorModes *modes)
+{
+	modes->imageProcMode = (level == GOVERNOR_FULL)? AR_IMAGE_PROC_IN_FULL: AR_IMAGE_PROC_IN_HALF_REFINED;
+	modes->pyramidMode   = (level >= GOVERNOR_PYRAMID)? AR_PYRAMID_QUARTER: AR_PYRAMID_OFF;
+	modes->detectEvery   = (level == GOVERNOR_SLOW)? 2: 1;
+	modes->swapInterval  = (level == GOVERNOR_SLOW)? 2: 1;
+}
+
+const char *governorLevelName(int level)
+{
+	return (level >= 0 && level < GOVERNOR_LEVELS)? levelName[level]: "?";
+}
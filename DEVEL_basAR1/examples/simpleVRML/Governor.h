@@ -0,0 +1,60 @@
+#ifndef Governor_h
+#define Governor_h
+
+#include <AR/ar.h>
+
+// Power governor, with -governor on the command line, for kiosks that would
+// otherwise detect every pixel of every frame all day.
+//
+// The GLUT thread reports each frame taken from a pipeline with
+// governorFrame() and each swap with governorShown(). Every GOVERNOR_PERIOD
+// seconds governorTick() looks at the period: how fast the markers moved
+// across the image, how many were seen, and how many frames were presented
+// later than the refresh they were begun for.
+//
+// Markers moving fast, or many of them, take the level straight back to
+// GOVERNOR_FULL; markers moving a little keep it at GOVERNOR_HALF at most.
+// Late frames step it down at once, and keep it from going back up for
+// GOVERNOR_HOLD periods. Still or absent markers step it down only after
+// GOVERNOR_HOLD periods, one level at a time.
+//
+// The levels, from the most work to the least:
+//   GOVERNOR_FULL      AR_IMAGE_PROC_IN_FULL, every frame.
+//   GOVERNOR_HALF      AR_IMAGE_PROC_IN_HALF_REFINED, corners still at full resolution.
+//   GOVERNOR_PYRAMID   AR_PYRAMID_QUARTER, contours traced again at full resolution.
+//   GOVERNOR_SLOW      As GOVERNOR_PYRAMID, every other frame detected and shown.
+
+enum {
+	GOVERNOR_FULL,
+	GOVERNOR_HALF,
+	GOVERNOR_PYRAMID,
+	GOVERNOR_SLOW,
+	GOVERNOR_LEVELS
+};
+
+#define GOVERNOR_PERIOD		1.0			// Seconds.
+#define GOVERNOR_HOLD		5			// Quiet periods before stepping down.
+#define GOVERNOR_FAST		0.5			// Image widths per second.
+#define GOVERNOR_STILL		0.05
+#define GOVERNOR_MANY		4			// Markers in a frame, on average.
+#define GOVERNOR_LATE		0.1			// Of the frames shown.
+#define GOVERNOR_SESSIONS	4
+#define GOVERNOR_IDS		64			// Marker ids followed for their motion.
+
+struct GovernorModes {
+	int			imageProcMode;
+	int			pyramidMode;
+	int			detectEvery;			// Frames captured per frame detected.
+	int			swapInterval;			// See arglSwapIntervalSet().
+};
+
+void	governorFrame(int session, const ARMarkerInfo *marker, int num, int xsize, double time);
+// A frame begun at begun was presented at presented, and should have been
+// within budget seconds.
+void	governorShown(double begun, double presented, double budget);
+// The new level, or -1 when it stays.
+int		governorTick(double now);
+void	governorModes(int level, GovernorModes *modes);
+const char *governorLevelName(int level);
+
+#endif // Governor_h
@@ -0,0 +1,53 @@
+#ifndef IdIndex_h
+#define IdIndex_h
+
+#include <vector>
+#include <map>
+#include <stddef.h>
+
+// Index of the objects read from the configuration files by their id.
+//
+// The ids the files give are small, so each one up to IDINDEX_DENSE has its
+// slot in a vector and is found in one step; larger ones are kept in a map.
+// The first object added with an id is the one found, as it was when the
+// lists were scanned. Negative ids are not indexed.
+
+#define IDINDEX_DENSE 4096
+
+template <class T>
+class IdIndex
+{
+public:
+	void add(int id, T *value)
+	{
+		if (id < 0 || value == 0) return;
+		if (id >= IDINDEX_DENSE) {
+			this->sparse.insert(std::make_pair(id, value));
+			return;
+		}
+		if ((size_t)id >= this->slot.size()) this->slot.resize(id + 1, (T *)0);
+		if (this->slot[id] == 0) this->slot[id] = value;
+	}
+
+	T *find(int id) const
+	{
+		if (id < 0) return 0;
+		if (id >= IDINDEX_DENSE) {
+			typename std::map<int, T *>::const_iterator it = this->sparse.find(id);
+			return it == this->sparse.end()? 0: it->second;
+		}
+		return (size_t)id < this->slot.size()? this->slot[id]: 0;
+	}
+
+	void clear()
+	{
+		this->slot.clear();
+		this->sparse.clear();
+	}
+
+private:
+	std::vector<T *>	slot;
+	std::map<int, T *>	sparse;
+};
+
+#endif // IdIndex_h
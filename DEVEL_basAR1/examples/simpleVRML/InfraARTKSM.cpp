@@ -12,6 +12,7 @@
 
 InfraARTKSM::InfraARTKSM()
 {
+	arPoseFilterInit(&this->poseFilter);
 }
 
 InfraARTKSM::~InfraARTKSM()
@@ -19,40 +20,56 @@ InfraARTKSM::~InfraARTKSM()
 }
 
 
-int InfraARTKSM::searchBaseOnFrame(ARMarkerInfo **marker_info, int marker_num){
+int InfraARTKSM::findBaseOnFrame(ARMarkerInfo *marker_info, int marker_num){
 	int             j, k;
-	ARMarkerInfo           *auxMarker_info;
-	auxMarker_info = *marker_info;
-
 
 	k = -1;
 	for (j = 0; j < marker_num; j++) {
-		if (auxMarker_info[j].id == this->patternNumber) {
+		if (marker_info[j].id == this->patternNumber) {
 			if( k == -1 ) k = j; // First marker detected.
-			else if (auxMarker_info[k].cf < auxMarker_info[j].cf) k = j; } 
+			else if (marker_info[k].cf < marker_info[j].cf) k = j; } 
 	}// Higher confidence marker detected.
+	return k;
+}
 
-	if (k != -1) {
-		// Get the transformation between the marker and the real camera.
-		//fprintf(stderr, "Saw object %d.\n", (*itObject).objectID);
-		if (this->visible == 0) {
-			arGetTransMat(&auxMarker_info[k], this->markerCenter, this->markerWidth, this->markerTrans );
-		} else {
-			arGetTransMatCont(&auxMarker_info[k], this->markerTrans , this->markerCenter, this->markerWidth, this->markerTrans);
-		}
 
+int InfraARTKSM::updateBasePose(bool found, double time){
+
+	if (found) {
 		this->visible = 1;
+		arPoseFilterUpdate(&this->poseFilter, this->markerTrans, time, this->filterTrans);
 		//Updatedata
-		(*this->myInfraStructure).updateInfraData(this->markerTrans,this->visible); //Acquire the latest infra data and update on basetrans
+		(*this->myInfraStructure).updateInfraData(this->filterTrans,this->visible); //Acquire the latest infra data and update on basetrans
 		//printf("\n Found Base ARTKSM");	
 		return TRUE;
 		
 	} else { 
 		this->visible = 0; 
+		arPoseFilterReset(&this->poseFilter);
 		(*this->myInfraStructure).visible = 0;
+		if ((*this->myInfraStructure).pose != NULL) (*this->myInfraStructure).pose->visible = 0;
 		return 2;
 
 	}
+}
 
 
+int InfraARTKSM::searchBaseOnFrame(ARMarkerInfo **marker_info, int marker_num){
+	int             k;
+	ARMarkerInfo           *auxMarker_info;
+	auxMarker_info = *marker_info;
+
+
+	k = this->findBaseOnFrame(auxMarker_info, marker_num);
+
+	if (k != -1) {
+		// Get the transformation between the marker and the real camera.
+		//fprintf(stderr, "Saw object %d.\n", (*itObject).objectID);
+		if (this->visible == 0) {
+			arGetTransMat(&auxMarker_info[k], this->markerCenter, this->markerWidth, this->markerTrans );
+		} else {
+			arGetTransMatCont(&auxMarker_info[k], this->markerTrans , this->markerCenter, this->markerWidth, this->markerTrans);
+		}
+	}
+	return this->updateBasePose( k != -1, arUtilTimer() );
 }
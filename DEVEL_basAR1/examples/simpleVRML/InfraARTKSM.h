@@ -14,6 +14,11 @@ class InfraARTKSM : public InfraSource {
     ~InfraARTKSM();
 
 	int searchBaseOnFrame(ARMarkerInfo **marker_info, int marker_num);
+	// Index of the most confident marker of the base, -1 if not seen.
+	int findBaseOnFrame(ARMarkerInfo *marker_info, int marker_num);
+	// Publish markerTrans, measured at time, or the loss of the base when
+	// not found.
+	int updateBasePose(bool found, double time);
 
  
     bool visible;
@@ -21,6 +26,8 @@ class InfraARTKSM : public InfraSource {
     iObject3D *cover;
     double markerCoord[4][2];
     double markerTrans[3][4];
+    ARPoseFilter poseFilter;		// Smooths markerTrans.
+    double filterTrans[3][4];		// markerTrans filtered.
     double markerWidth;
     double markerCenter[2];
 };
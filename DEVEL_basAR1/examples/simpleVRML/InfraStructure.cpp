@@ -1,10 +1,14 @@
 #include "InfraStructure.h"
 
 #include <list>
+#include <string.h>
 
 using namespace std;
 
 #include "InfraSource.h"
+#include <GL/glut.h>
+#include <AR/ar.h>
+#include <AR/gsub_lite.h>
 
 
 int InfraStructure::updateInfraData(double t[3][4], int v){
@@ -13,12 +17,21 @@ int InfraStructure::updateInfraData(double t[3][4], int v){
 			this->baseTrans[i][j] = t[i][j];
 
 	this->visible = v;
+	if (this->pose != NULL) {
+		memcpy(this->pose->trans, this->baseTrans, sizeof(this->pose->trans));
+		this->pose->visible = v;
+	}
+	arglCameraViewRH(this->baseTrans, this->baseModelview, 1.0);
+	this->transDirty = 1;
+	this->invalidateActuatorTrans();
 
     return 1;
 }
 
 InfraStructure::InfraStructure()
 {
+	this->transDirty = 1;
+	this->pose = NULL;
 }
 
 InfraStructure::~InfraStructure()
@@ -31,5 +44,32 @@ void InfraStructure::addInfraSource(InfraSource* value){
 	this->listSource.push_back(value);
 }
 
+// Transform of the actuator in the base, computed on the first request of
+// the frame and kept until the base or the actuators move.
+ActuatorTrans* InfraStructure::getActuatorTrans(int id, double interactionTrans[3][4]){
+	list<ActuatorTrans>::iterator it;
+
+	for( it = this->listActuatorTrans.begin(); it != this->listActuatorTrans.end(); it++)
+		if( (*it).actuatorId == id) break;
+	if( it == this->listActuatorTrans.end()){
+		ActuatorTrans t;
+		t.actuatorId = id;
+		t.valid = 0;
+		it = this->listActuatorTrans.insert(this->listActuatorTrans.end(), t);
+	}
+	if( !(*it).valid){
+		arUtilMatMul(this->baseTransInv, interactionTrans, (*it).trans);
+		(*it).valid = 1;
+	}
+	return &(*it);
+}
+
+void InfraStructure::invalidateActuatorTrans(){
+	list<ActuatorTrans>::iterator it;
+
+	for( it = this->listActuatorTrans.begin(); it != this->listActuatorTrans.end(); it++)
+		(*it).valid = 0;
+}
+
 
 
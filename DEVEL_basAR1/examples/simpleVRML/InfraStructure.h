@@ -3,25 +3,41 @@
 
 #include <list>
 
+#include "TrackPose.h"
+
 using namespace std;
 
 class InfraSource;
 class Base;
 
+// Transform from an actuator to the base, baseTransInv * interactionTrans.
+struct ActuatorTrans {
+    int actuatorId;
+    int valid;
+    double trans[3][4];
+};
+
 class InfraStructure {
 
  public:
 
     int updateInfraData(double t[3][4], int v);
 	void addInfraSource(InfraSource* value);
+	ActuatorTrans* getActuatorTrans(int id, double interactionTrans[3][4]);
+	void invalidateActuatorTrans();
 
     InfraStructure();
 
     ~InfraStructure();
 	
     double baseTrans[3][4];
+    double baseTransInv[3][4];	// Inverse of baseTrans, see Arpe::updateBaseInverses()
+    double baseModelview[16];	// GL modelview of baseTrans, shared by the points of the base
+    int transDirty;				// baseTrans changed since baseTransInv was computed
+    list< ActuatorTrans > listActuatorTrans;	// Of this frame, see getActuatorTrans()
 	
     int visible;
+    TrackPose *pose;			// Its entry of Arpe::basePose, NULL until indexed.
 	
     list< InfraSource* > listSource;
 
@@ -0,0 +1,151 @@
+#include "Latency.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char *stageName[LATENCY_STAGES + 1] = {
+	"capture", "detect", "wait", "interact", "draw", "swap", "total"
+};
+
+struct LatencyHistogram {
+	long		n;
+	long		bucket[LATENCY_BUCKETS];
+	double		sum;				// Milliseconds.
+	double		max;
+};
+
+// One per stage and the whole, only the GLUT thread's.
+static LatencyHistogram	histogram[LATENCY_STAGES + 1];
+static LatencyHistogram	period[LATENCY_STAGES + 1];		// Since latencyPeriod().
+
+static int		ledX = -1, ledY = -1;
+static int		ledMin = 256, ledMax = -1;
+
+static void add(LatencyHistogram *h, long long usec)
+{
+	double ms = usec * 0.001;
+	int b;
+
+	if (ms < 0.0) ms = 0.0;			// A driver stamp from another clock.
+	b = (int)ms;
+	if (b >= LATENCY_BUCKETS) b = LATENCY_BUCKETS - 1;
+	h->bucket[b]++;
+	h->n++;
+	h->sum += ms;
+	if (ms > h->max) h->max = ms;
+}
+
+void latencyFrame(const LatencyStamp time)
+{
+	int i;
+
+	for (i = 0; i < LATENCY_STAGES; i++) {
+		add(&histogram[i], time[i + 1] - time[i]);
+		add(&period[i], time[i + 1] - time[i]);
+	}
+	add(&histogram[LATENCY_STAGES], time[LATENCY_STAGES] - time[0]);
+	add(&period[LATENCY_STAGES], time[LATENCY_STAGES] - time[0]);
+}
+
+// The bucket below which fraction f of the frames were.
+static int percentile(const LatencyHistogram *h, double f)
+{
+	long c = 0;
+	int b;
+
+	for (b = 0; b < LATENCY_BUCKETS; b++) {
+		c += h->bucket[b];
+		if (c >= f * h->n) break;
+	}
+	return b;
+}
+
+void latencyReport(void)
+{
+	const LatencyHistogram *h;
+	int i, b;
+
+	fprintf(stderr, "Latency (ms)   frames    mean   p50   p95   p99     max\n");
+	for (i = 0; i <= LATENCY_STAGES; i++) {
+		h = &histogram[i];
+		if (h->n == 0) continue;
+		fprintf(stderr, "  %-10s %8ld %7.2f %5d %5d %5d %7.2f\n", stageName[i], h->n, h->sum / h->n,
+			percentile(h, 0.5) + 1, percentile(h, 0.95) + 1, percentile(h, 0.99) + 1, h->max);
+	}
+
+	// Frames below each millisecond, the last bucket being all beyond.
+	for (i = 0; i <= LATENCY_STAGES; i++) {
+		h = &histogram[i];
+		if (h->n == 0) continue;
+		fprintf(stderr, "  %-10s", stageName[i]);
+		for (b = 0; b < LATENCY_BUCKETS; b++)
+			if (h->bucket[b] != 0) fprintf(stderr, (b == LATENCY_BUCKETS - 1)? " %d+:%ld": " <%d:%ld", b + 1, h->bucket[b]);
+		fprintf(stderr, "\n");
+	}
+}
+
+void latencyReset(void)
+{
+	memset(histogram, 0, sizeof(histogram));
+}
+
+void latencyPeriod(LatencyPercentiles p[LATENCY_STAGES + 1])
+{
+	const LatencyHistogram *h;
+	int i;
+
+	for (i = 0; i <= LATENCY_STAGES; i++) {
+		h = &period[i];
+		p[i].n = h->n;
+		p[i].p50 = (h->n == 0)? 0: percentile(h, 0.5) + 1;
+		p[i].p95 = (h->n == 0)? 0: percentile(h, 0.95) + 1;
+		p[i].p99 = (h->n == 0)? 0: percentile(h, 0.99) + 1;
+		p[i].max = h->max;
+	}
+	memset(period, 0, sizeof(period));
+}
+
+const char *latencyStageName(int stage)
+{
+	return stageName[stage];
+}
+
+void latencyLedSet(int x, int y)
+{
+	ledX = x;
+	ledY = y;
+	ledMin = 256;
+	ledMax = -1;
+}
+
+int latencyLedActive(void)
+{
+	return ledX >= 0 && ledY >= 0;
+}
+
+// All the bytes of the pixels, whatever their order, so that only the change
+// between dark and lit counts.
+int latencyLed(const ARUint8 *image, int xsize, int ysize)
+{
+	const ARUint8 *p;
+	long sum = 0;
+	int x0, y0, x, y, v;
+
+	if (!latencyLedActive() || image == 0) return 0;
+	x0 = ledX - LATENCY_LED_PATCH / 2;
+	y0 = ledY - LATENCY_LED_PATCH / 2;
+	if (x0 < 0) x0 = 0;
+	if (y0 < 0) y0 = 0;
+	if (x0 + LATENCY_LED_PATCH > xsize) x0 = xsize - LATENCY_LED_PATCH;
+	if (y0 + LATENCY_LED_PATCH > ysize) y0 = ysize - LATENCY_LED_PATCH;
+	if (x0 < 0 || y0 < 0) return 0;
+
+	for (y = y0; y < y0 + LATENCY_LED_PATCH; y++) {
+		p = image + (y * xsize + x0) * AR_PIX_SIZE_DEFAULT;
+		for (x = 0; x < LATENCY_LED_PATCH * AR_PIX_SIZE_DEFAULT; x++) sum += p[x];
+	}
+	v = (int)(sum / (LATENCY_LED_PATCH * LATENCY_LED_PATCH * AR_PIX_SIZE_DEFAULT));
+	if (v < ledMin) ledMin = v;
+	if (v > ledMax) ledMax = v;
+	return ledMax - ledMin > 16 && v > (ledMin + ledMax) / 2;
+}
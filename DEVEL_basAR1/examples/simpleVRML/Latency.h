@@ -0,0 +1,59 @@
+#ifndef Latency_h
+#define Latency_h
+
+#include <AR/config.h>
+#include <AR/ar.h>
+
+// Motion to photon latency, measured with -latency on the command line.
+//
+// Each frame carries the time the driver captured it, from
+// arVideoInqFrameInfo(), and the time it left each stage below, all on the
+// clock of arVideoTime(). Once it is on the screen, after glutSwapBuffers(),
+// latencyFrame() adds how long every stage took, and the whole, to the
+// histograms that latencyReport() prints.
+//
+// latencyLed() is for checking the figures with a scope: the patch it gives
+// is drawn white in a corner of the window while the camera sees the LED at
+// the point set by latencyLedSet() lit, black otherwise. An LED blinking in
+// view and a photodiode on that corner then show, from outside, the time
+// between the light and the screen.
+
+#define LATENCY_BUCKETS		100		// Of one millisecond each, the last holding all beyond.
+#define LATENCY_LED_PATCH	8		// Pixels of the camera image averaged, on a side.
+#define LATENCY_LED_SIZE	32		// Pixels of the window drawn, on a side.
+
+enum {
+	LATENCY_CAPTURE,				// Driver to a slot of the pipeline.
+	LATENCY_DETECT,					// Markers and poses.
+	LATENCY_WAIT,					// Until Idle() takes the slot.
+	LATENCY_INTERACT,				// The rules and the serial devices.
+	LATENCY_DRAW,					// Display() up to the swap.
+	LATENCY_SWAP,					// glutSwapBuffers().
+	LATENCY_STAGES
+};
+
+// time[0] is the capture, time[i + 1] the end of stage i.
+typedef long long LatencyStamp[LATENCY_STAGES + 1];
+
+void	latencyFrame(const LatencyStamp time);
+void	latencyReport(void);
+void	latencyReset(void);
+
+// Of each stage and the whole, over the frames since the last call, apart
+// from the histograms of latencyReport(). For Metrics.h.
+struct LatencyPercentiles {
+	long		n;
+	int			p50, p95, p99;		// Milliseconds, the bucket they are below.
+	double		max;
+};
+void	latencyPeriod(LatencyPercentiles p[LATENCY_STAGES + 1]);
+const char *latencyStageName(int stage);
+
+// The camera image point of the LED, -1 when there is none.
+void	latencyLedSet(int x, int y);
+int		latencyLedActive(void);
+// Whether the LED is lit in the image, halfway between the darkest and the
+// brightest it was seen so far.
+int		latencyLed(const ARUint8 *image, int xsize, int ysize);
+
+#endif // Latency_h
@@ -0,0 +1,105 @@
+#include <windows.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <process.h>
+
+#include <AR/ar.h>
+
+#include "Log.h"
+
+struct LogEntry {
+	volatile LONG	seq;			// The head that may claim it, or that head + 1 once written.
+	char			text[LOG_MESSAGE + 1];
+};
+
+static LogEntry			ring[LOG_ENTRIES];
+static volatile LONG	head = 0;		// Next entry to claim.
+static LONG				tail = 0;		// Next entry to write out, the writer thread only.
+static volatile LONG	dropped = 0;
+static volatile LONG	running = FALSE;
+static HANDLE			wakeEvent = 0;
+static HANDLE			writerHandle = 0;
+
+static struct LogInit {
+	LogInit() { for (LONG i = 0; i < LOG_ENTRIES; i++) ring[i].seq = i; }
+} logInit;
+
+// Writes out the entries written so far, in order.
+static void drain(void)
+{
+	LogEntry *e;
+	LONG lost;
+
+	for (;;) {
+		e = &ring[tail & (LOG_ENTRIES - 1)];
+		if (e->seq != tail + 1) break;			// Not written yet.
+		fputs(e->text, stdout);
+		InterlockedExchange(&e->seq, tail + LOG_ENTRIES);	// Free for the next round.
+		tail++;
+	}
+	if ((lost = InterlockedExchange(&dropped, 0)) > 0) printf("\n Log: %ld messages dropped", lost);
+	fflush(stdout);
+}
+
+static unsigned __stdcall writerThread(void *arg)
+{
+	arThreadRole(AR_THREAD_BACKGROUND, "log");
+	while (running) {
+		WaitForSingleObject(wakeEvent, LOG_DRAIN);
+		drain();
+	}
+	arThreadRoleEnd();
+	return 0;
+}
+
+void logStart(void)
+{
+	if (writerHandle) return;
+	wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	running = TRUE;
+	writerHandle = (HANDLE)_beginthreadex(NULL, 0, writerThread, NULL, 0, NULL);
+	if (writerHandle == 0) {
+		running = FALSE;
+		printf("\n Log: unable to start thread");
+		return;
+	}
+	atexit(logStop);		// The rules exit() on a state that is not there.
+}
+
+void logStop(void)
+{
+	if (writerHandle == 0) return;
+	running = FALSE;
+	SetEvent(wakeEvent);
+	WaitForSingleObject(writerHandle, INFINITE);
+	CloseHandle(writerHandle);
+	CloseHandle(wakeEvent);
+	writerHandle = 0;
+	drain();
+}
+
+void logWrite(int level, const char *format, ...)
+{
+	LogEntry *e;
+	LONG h;
+	va_list ap;
+
+	for (;;) {
+		h = head;
+		e = &ring[h & (LOG_ENTRIES - 1)];
+		if (e->seq != h) {
+			if (e->seq - h < 0) { InterlockedIncrement(&dropped); return; }	// Full.
+			continue;							// Claimed by another thread, retry with its head.
+		}
+		if (InterlockedCompareExchange(&head, h + 1, h) == h) break;
+	}
+	va_start(ap, format);
+	_vsnprintf(e->text, LOG_MESSAGE, format, ap);
+	va_end(ap);
+	e->text[LOG_MESSAGE] = '\0';				// _vsnprintf() does not end a message it cuts.
+	InterlockedExchange(&e->seq, h + 1);		// Written, after the text.
+
+	// An error is often the last message before exit(): not left waiting.
+	if (level == LOG_ERROR && writerHandle) SetEvent(wakeEvent);
+}
@@ -0,0 +1,63 @@
+#ifndef Log_h
+#define Log_h
+
+// The console messages of the frame, detect and reload threads.
+//
+// Writing to a Windows console waits for the console host, for each printf;
+// the rules print a line for every transition and every action they parse.
+// logError() to logDebug() only format the message into the next free entry
+// of a ring and return; a thread of its own writes the ring to stdout every
+// LOG_DRAIN milliseconds. The ring is lock-free, for any number of threads
+// writing: a thread claims an entry with a compare and swap of the head and
+// marks it written with its seq. When the writer thread is behind by the
+// whole ring the message is dropped and counted, never waited for.
+//
+// A level above LOG_LEVEL, which may be set on the command line of the
+// compiler, compiles to nothing: the arguments are not even evaluated.
+
+#define LOG_ERROR		0
+#define LOG_WARN		1
+#define LOG_INFO		2
+#define LOG_DEBUG		3
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL		LOG_INFO
+#endif
+
+#define LOG_ENTRIES		1024		// In the ring, a power of 2.
+#define LOG_MESSAGE		120			// Characters of a message at most, the rest is cut.
+#define LOG_DRAIN		20			// Milliseconds between the writes to stdout.
+
+// At the start of main(), and at exit, which writes what is left. Messages
+// before logStart() wait in the ring.
+void	logStart(void);
+void	logStop(void);
+
+// Any thread.
+void	logWrite(int level, const char *format, ...);
+
+#if LOG_LEVEL >= LOG_ERROR
+#define logError(...)	logWrite(LOG_ERROR, __VA_ARGS__)
+#else
+#define logError(...)	((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_WARN
+#define logWarn(...)	logWrite(LOG_WARN, __VA_ARGS__)
+#else
+#define logWarn(...)	((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_INFO
+#define logInfo(...)	logWrite(LOG_INFO, __VA_ARGS__)
+#else
+#define logInfo(...)	((void)0)
+#endif
+
+#if LOG_LEVEL >= LOG_DEBUG
+#define logDebug(...)	logWrite(LOG_DEBUG, __VA_ARGS__)
+#else
+#define logDebug(...)	((void)0)
+#endif
+
+#endif // Log_h
@@ -0,0 +1,208 @@
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#include <process.h>
+#include <psapi.h>
+#include <tlhelp32.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <AR/config.h>
+#include <AR/ar.h>
+#include <AR/arvrml.h>
+
+#include "Metrics.h"
+
+#pragma comment(lib, "psapi.lib")
+
+struct MetricsPeriod {
+	double		seconds;
+	long		taken;					// Frames of all the sessions.
+	long		shown;
+	long		markers;
+	long		dropped;
+	int			scenes;
+	LatencyPercentiles latency[LATENCY_STAGES + 1];
+};
+
+static int				running = FALSE;
+static SOCKET			sock = INVALID_SOCKET;
+static sockaddr_in		target;
+static char				host[64];
+static double			started, periodBegin;
+static long				droppedBefore;
+
+static MetricsPeriod	counting;		// The GLUT thread's.
+static MetricsPeriod	handed;			// Under cs, until the metrics thread takes it.
+static MetricsPeriod	sending;		// The metrics thread's.
+static CRITICAL_SECTION	cs;
+static HANDLE			tickEvent;
+
+static char				datagram[METRICS_DATAGRAM];
+static int				length;
+
+static unsigned __stdcall metricsThread(void *data);
+
+int metricsStart(const char *hostPort)
+{
+	WSADATA wsa;
+	addrinfo hints, *res;
+	char name[256], *port;
+	u_long nonBlocking = 1;
+
+	if (running) return 0;
+	strncpy(name, hostPort, sizeof(name) - 1);
+	name[sizeof(name) - 1] = '\0';
+	if ((port = strrchr(name, ':')) == NULL) {
+		printf("\n Metrics: %s is not host:port", hostPort);
+		return -1;
+	}
+	*port++ = '\0';
+
+	if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) return -1;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	if (getaddrinfo(name, port, &hints, &res) != 0) {
+		printf("\n Metrics: unable to resolve %s", hostPort);
+		return -1;
+	}
+	memcpy(&target, res->ai_addr, sizeof(target));
+	freeaddrinfo(res);
+	if ((sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == INVALID_SOCKET) return -1;
+	ioctlsocket(sock, FIONBIO, &nonBlocking);		// A monitor away drops datagrams, never the frame.
+	if (gethostname(host, sizeof(host)) != 0) strcpy(host, "unknown");
+
+	InitializeCriticalSection(&cs);
+	tickEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	started = periodBegin = arUtilClock();
+	droppedBefore = 0;
+	memset(&counting, 0, sizeof(counting));
+	running = TRUE;
+	if (_beginthreadex(NULL, 0, metricsThread, NULL, 0, NULL) == 0) {
+		printf("\n Metrics: unable to start the thread");
+		running = FALSE;
+		return -1;
+	}
+	printf("\n Metrics sent to %s every %.0f s", hostPort, METRICS_PERIOD);
+	return 0;
+}
+
+void metricsTaken(int markers)
+{
+	counting.taken++;
+	counting.markers += markers;
+}
+
+void metricsShown(void)
+{
+	counting.shown++;
+}
+
+void metricsTick(long dropped)
+{
+	double now;
+
+	if (!running) return;
+	now = arUtilClock();
+	if (now - periodBegin < METRICS_PERIOD) return;
+
+	counting.seconds = now - periodBegin;
+	counting.dropped = dropped - droppedBefore;
+	counting.scenes = arVrmlLiveScenes();
+	EnterCriticalSection(&cs);
+	handed = counting;
+	latencyPeriod(handed.latency);
+	LeaveCriticalSection(&cs);
+	SetEvent(tickEvent);
+
+	memset(&counting, 0, sizeof(counting));
+	periodBegin = now;
+	droppedBefore = dropped;
+}
+
+static void append(const char *format, ...)
+{
+	va_list ap;
+	int n;
+
+	if (length >= METRICS_DATAGRAM - 1) return;
+	va_start(ap, format);
+	n = _vsnprintf(datagram + length, METRICS_DATAGRAM - 1 - length, format, ap);
+	va_end(ap);
+	length = (n < 0)? METRICS_DATAGRAM - 1: length + n;
+}
+
+// Of this process, in the snapshot of the threads of the system.
+static int threadCount(void)
+{
+	HANDLE snap;
+	THREADENTRY32 te;
+	DWORD pid = GetCurrentProcessId();
+	int n = 0;
+
+	if ((snap = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0)) == INVALID_HANDLE_VALUE) return -1;
+	te.dwSize = sizeof(te);
+	if (Thread32First(snap, &te)) {
+		do {
+			if (te.th32OwnerProcessID == pid) n++;
+		} while (Thread32Next(snap, &te));
+	}
+	CloseHandle(snap);
+	return n;
+}
+
+// Keys of the subsystems of arMemGet(), by AR_MEM_AR to AR_MEM_ARPE.
+static const char *memName[AR_MEM_TAGS] = { "ar", "video", "gsub", "vrml", "arpe" };
+
+static unsigned __stdcall metricsThread(void *data)
+{
+	PROCESS_MEMORY_COUNTERS_EX mem;
+	ARMemStats ms;
+	const LatencyPercentiles *p;
+	double s;
+	int i, first;
+
+	arThreadRole(AR_THREAD_BACKGROUND, "metrics");
+	for (;;) {
+		WaitForSingleObject(tickEvent, INFINITE);
+		EnterCriticalSection(&cs);
+		sending = handed;
+		LeaveCriticalSection(&cs);
+
+		memset(&mem, 0, sizeof(mem));
+		mem.cb = sizeof(mem);
+		GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&mem, sizeof(mem));
+
+		s = sending.seconds;
+		length = 0;
+		append("{\"host\": \"%s\", \"uptime\": %.1f, \"period\": %.1f", host, arUtilClock() - started, s);
+		append(", \"fps\": %.1f, \"detect_fps\": %.1f, \"dropped\": %ld, \"markers\": %.2f",
+			sending.shown / s, sending.taken / s, sending.dropped,
+			(sending.taken == 0)? 0.0: (double)sending.markers / sending.taken);
+		append(", \"memory_kb\": %lu, \"private_kb\": %lu, \"threads\": %d, \"vrml_scenes\": %d",
+			(unsigned long)(mem.WorkingSetSize / 1024), (unsigned long)(mem.PrivateUsage / 1024),
+			threadCount(), sending.scenes);
+		append(", \"subsystems_kb\": {");
+		for (i = 0; i < AR_MEM_TAGS; i++) {
+			arMemGet(i, &ms);
+			append("%s\"%s\": {\"now\": %ld, \"peak\": %ld}", (i == 0)? "": ", ",
+				memName[i], ms.bytes / 1024, ms.peak / 1024);
+		}
+		append("}");
+		append(", \"latency\": {");
+		first = TRUE;
+		for (i = 0; i <= LATENCY_STAGES; i++) {
+			p = &sending.latency[i];
+			if (p->n == 0) continue;
+			append("%s\"%s\": {\"n\": %ld, \"p50\": %d, \"p95\": %d, \"p99\": %d, \"max\": %.1f}",
+				first? "": ", ", latencyStageName(i), p->n, p->p50, p->p95, p->p99, p->max);
+			first = FALSE;
+		}
+		append("}}\n");
+
+		sendto(sock, datagram, length, 0, (const sockaddr *)&target, sizeof(target));
+	}
+	return 0;
+}
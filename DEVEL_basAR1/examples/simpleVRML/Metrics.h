@@ -0,0 +1,34 @@
+#ifndef Metrics_h
+#define Metrics_h
+
+#include "Latency.h"
+
+// Figures of a running installation, for watching a fleet of them from
+// outside, sent with -metrics host:port on the command line.
+//
+// The GLUT thread only counts, into fixed fields: metricsTaken() for each
+// frame a session takes from its pipeline, metricsShown() for each swap.
+// Every METRICS_PERIOD seconds metricsTick() hands the counts of the period,
+// the latency percentiles of latencyPeriod() and the live VRML scenes to the
+// metrics thread, which adds the memory and the threads of the process and
+// sends them to host:port in one UDP datagram, a line of JSON:
+//
+//   {"host": "kiosk3", "uptime": 86400.0, "period": 5.0,
+//    "fps": 59.8, "detect_fps": 29.9, "dropped": 2, "markers": 3.1,
+//    "memory_kb": 181234, "private_kb": 160012, "threads": 14, "vrml_scenes": 9,
+//    "latency": {"capture": {"n": 150, "p50": 4, "p95": 6, "p99": 9, "max": 11.2}, ...}}
+//
+// Nothing is allocated after metricsStart(), the datagram is written in a
+// buffer of its own.
+
+#define METRICS_PERIOD		5.0			// Seconds.
+#define METRICS_DATAGRAM	2048		// Bytes at most.
+
+// 0, or -1 when host:port is not valid or the thread could not start.
+int		metricsStart(const char *hostPort);
+void	metricsTaken(int markers);
+void	metricsShown(void);
+// dropped is the total of the pipelines, see FramePipeline::droppedFrames().
+void	metricsTick(long dropped);
+
+#endif // Metrics_h
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <AR/config.h>
+#include <AR/ar.h>
+
+#include "PoseShare.h"
+
+#define POSE_SHARE_ALIGN	64			// Entries start on cache lines of their own.
+
+static LONG align(size_t n)
+{
+	return (LONG)((n + POSE_SHARE_ALIGN - 1) / POSE_SHARE_ALIGN * POSE_SHARE_ALIGN);
+}
+
+PoseShareHeader *poseShareOpen(int session, int targets, int xsize, int ysize, int pixFormat, int stride, int frames)
+{
+	PoseShareHeader *h;
+	HANDLE mapping;
+	char name[64];
+	LONG headerSize, entrySize, imageBytes;
+	size_t size;
+	LONG i;
+
+	if (stride <= 0) stride = xsize * AR_PIX_SIZE_DEFAULT;
+	imageBytes = frames ? stride * ysize : 0;
+	headerSize = align(sizeof(PoseShareHeader));
+	entrySize = align(sizeof(PoseShareEntry) + targets * sizeof(PoseShareTarget) + imageBytes);
+	size = headerSize + (size_t)entrySize * POSE_SHARE_ENTRIES;
+
+	sprintf(name, POSE_SHARE_NAME "%d", session);
+	mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)size, name);
+	if (mapping == NULL) {
+		printf("\n PoseShare: unable to create %s", name);
+		return 0;
+	}
+	if (GetLastError() == ERROR_ALREADY_EXISTS) {
+		printf("\n PoseShare: %s is already published", name);
+		CloseHandle(mapping);
+		return 0;
+	}
+	// The view keeps the mapping for the readers once the handle is closed.
+	h = (PoseShareHeader *)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	CloseHandle(mapping);
+	if (h == NULL) {
+		printf("\n PoseShare: unable to map %s", name);
+		return 0;
+	}
+
+	memset(h, 0, headerSize);
+	h->version = POSE_SHARE_VERSION;
+	h->headerSize = headerSize;
+	h->entrySize = entrySize;
+	h->entries = POSE_SHARE_ENTRIES;
+	h->targets = targets;
+	h->xsize = xsize;
+	h->ysize = ysize;
+	h->pixFormat = pixFormat;
+	h->stride = stride;
+	h->imageBytes = imageBytes;
+	h->newest = -1;
+	for (i = 0; i < POSE_SHARE_ENTRIES; i++) ((PoseShareEntry *)poseShareEntry(h, i))->seq = 0;
+	// Last, so that a reader that sees the magic sees the rest.
+	InterlockedExchange(&h->magic, POSE_SHARE_MAGIC);
+	return h;
+}
+
+void poseShareClose(PoseShareHeader *h)
+{
+	if (h) UnmapViewOfFile(h);
+}
+
+PoseShareEntry *poseShareNext(PoseShareHeader *h)
+{
+	PoseShareEntry *e;
+
+	e = (PoseShareEntry *)poseShareEntry(h, (h->newest + 1) % h->entries);
+	InterlockedIncrement(&e->seq);		// Odd, and a full barrier before the entry is written.
+	return e;
+}
+
+void poseShareCommit(PoseShareHeader *h, PoseShareEntry *e)
+{
+	InterlockedIncrement(&e->seq);		// Even, once everything written before is visible.
+	InterlockedExchange(&h->newest, (LONG)(((char *)e - (char *)h - h->headerSize) / h->entrySize));
+}
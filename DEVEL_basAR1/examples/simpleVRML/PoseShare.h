@@ -0,0 +1,125 @@
+#ifndef PoseShare_h
+#define PoseShare_h
+
+#include <Windows.h>
+
+#include <AR/ar.h>
+
+// The markers and poses of every frame of a session, published with -share
+// on the command line in shared memory, for other processes on the kiosk
+// (projection mapping, analytics) that could not open the camera again.
+// With -shareframes the image of the frame goes with them.
+//
+// The mapping of session k is named POSE_SHARE_NAME "k". It begins with a
+// PoseShareHeader, followed by header.entries entries of header.entrySize
+// bytes each: a PoseShareEntry, header.targets PoseShareTargets in the order
+// of the actuators then the bases of the session, and header.imageBytes of
+// the image in the pixel format of the camera.
+//
+// The detect thread writes the entries round the ring, each behind a
+// sequence lock: seq is odd while the entry is written and even once it is
+// whole. It never waits for a reader. Readers take the entry in place,
+// without copying it out:
+//
+//   const PoseShareEntry *e;
+//   LONG seq;
+//   e = poseShareBegin(header, &seq);
+//   ... read e, poseShareTargets(header, e) and poseShareImage(header, e) ...
+//   if (!poseShareValid(e, seq)) ... it was overwritten meanwhile, begin again
+//
+// which leaves a reader header.entries - 1 frames to read an entry before
+// the writer comes round to it again.
+
+#define POSE_SHARE_NAME		"Local\\basAR.poses."
+#define POSE_SHARE_MAGIC	0x45534f50			// "POSE"
+#define POSE_SHARE_VERSION	1
+#define POSE_SHARE_ENTRIES	8
+
+struct PoseShareHeader {
+	LONG			magic;
+	LONG			version;
+	LONG			headerSize;
+	LONG			entrySize;
+	LONG			entries;
+	LONG			targets;
+	LONG			xsize;
+	LONG			ysize;
+	LONG			pixFormat;				// AR_PIXEL_FORMAT_*.
+	LONG			stride;
+	LONG			imageBytes;				// 0 without -shareframes.
+	volatile LONG	newest;					// Entry last written, -1 before the first.
+};
+
+struct PoseShareTarget {
+	int				pattern;
+	int				base;					// An InfraARTKSM, else an ActuatorARTKSM.
+	int				found;
+	double			trans[3][4];			// The last one fitted when not found.
+};
+
+struct PoseShareEntry {
+	volatile LONG	seq;
+	long			frame;					// Capture order.
+	double			time;					// arUtilTimer() when captured.
+	int				marker_num;
+	ARMarkerInfo	marker_info[AR_SQUARE_MAX];
+};
+
+inline const PoseShareEntry *poseShareEntry(const PoseShareHeader *h, LONG i)
+{
+	return (const PoseShareEntry *)((const char *)h + h->headerSize + (size_t)i * h->entrySize);
+}
+
+inline const PoseShareTarget *poseShareTargets(const PoseShareHeader *h, const PoseShareEntry *e)
+{
+	return (const PoseShareTarget *)(e + 1);
+}
+
+inline PoseShareTarget *poseShareTargets(const PoseShareHeader *h, PoseShareEntry *e)
+{
+	return (PoseShareTarget *)(e + 1);
+}
+
+inline const ARUint8 *poseShareImage(const PoseShareHeader *h, const PoseShareEntry *e)
+{
+	return (h->imageBytes > 0)? (const ARUint8 *)(poseShareTargets(h, e) + h->targets): 0;
+}
+
+inline ARUint8 *poseShareImage(const PoseShareHeader *h, PoseShareEntry *e)
+{
+	return (h->imageBytes > 0)? (ARUint8 *)(poseShareTargets(h, e) + h->targets): 0;
+}
+
+// The newest whole entry, or 0 when none has been written yet.
+inline const PoseShareEntry *poseShareBegin(const PoseShareHeader *h, LONG *seq)
+{
+	const PoseShareEntry *e;
+	LONG i;
+
+	for (;;) {
+		if ((i = h->newest) < 0) return 0;
+		e = poseShareEntry(h, i);
+		*seq = e->seq;
+		MemoryBarrier();
+		if ((*seq & 1) == 0) return e;
+	}
+}
+
+inline bool poseShareValid(const PoseShareEntry *e, LONG seq)
+{
+	MemoryBarrier();
+	return e->seq == seq;
+}
+
+// The mapping of a session, with room for the image when frames is set. 0
+// when it cannot be made.
+PoseShareHeader	*poseShareOpen(int session, int targets, int xsize, int ysize, int pixFormat, int stride, int frames);
+void		poseShareClose(PoseShareHeader *h);
+
+// Whichever thread tracks the session, the only writer: the entry for the
+// next frame, locked, to be filled in place and then handed to readers with
+// poseShareCommit().
+PoseShareEntry	*poseShareNext(PoseShareHeader *h);
+void		poseShareCommit(PoseShareHeader *h, PoseShareEntry *e);
+
+#endif // PoseShare_h
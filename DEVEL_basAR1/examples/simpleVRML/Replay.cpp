@@ -0,0 +1,76 @@
+#include <stdio.h>
+
+#include <AR/config.h>
+#include <AR/ar.h>
+
+#include "Replay.h"
+
+#define REPLAY_BUFFER		(1024 * 1024)	// Bytes written at once, not one frame at a time.
+
+static FILE		*record = NULL;
+
+int replayRecordStart(const char *file)
+{
+	int magic = REPLAY_MAGIC;
+
+	if ((record = fopen(file, "wb")) == NULL) {
+		printf("\n Replay: unable to write %s", file);
+		return -1;
+	}
+	setvbuf(record, NULL, _IOFBF, REPLAY_BUFFER);
+	fwrite(&magic, sizeof(magic), 1, record);
+	printf("\n Recording the tracking to %s", file);
+	return 0;
+}
+
+void replayRecordFrame(int session, double time, const std::vector<FramePipeline::Slot::Pose> &pose)
+{
+	int n = (int)pose.size(), i;
+
+	if (record == NULL) return;
+	fwrite(&session, sizeof(session), 1, record);
+	fwrite(&time, sizeof(time), 1, record);
+	fwrite(&n, sizeof(n), 1, record);
+	for (i = 0; i < n; i++) {
+		fwrite(&pose[i].found, sizeof(pose[i].found), 1, record);
+		fwrite(pose[i].trans, sizeof(pose[i].trans), 1, record);
+	}
+}
+
+void replayRecordStop(void)
+{
+	if (record == NULL) return;
+	fclose(record);
+	record = NULL;
+}
+
+int replayLoad(const char *file, std::vector<ReplayFrame> &frames)
+{
+	FILE *fp;
+	ReplayFrame f;
+	int magic, n, i;
+
+	frames.clear();
+	if ((fp = fopen(file, "rb")) == NULL) {
+		printf("\n Replay: unable to read %s", file);
+		return -1;
+	}
+	if (fread(&magic, sizeof(magic), 1, fp) != 1 || magic != REPLAY_MAGIC) {
+		printf("\n Replay: %s is not a recording", file);
+		fclose(fp);
+		return -1;
+	}
+	while (fread(&f.session, sizeof(f.session), 1, fp) == 1) {
+		if (fread(&f.time, sizeof(f.time), 1, fp) != 1 || fread(&n, sizeof(n), 1, fp) != 1 || n < 0) break;
+		f.pose.resize(n);
+		for (i = 0; i < n; i++) {
+			if (fread(&f.pose[i].found, sizeof(f.pose[i].found), 1, fp) != 1 ||
+				fread(f.pose[i].trans, sizeof(f.pose[i].trans), 1, fp) != 1) break;
+		}
+		if (i < n) break;			// Cut short, as by a crash while recording.
+		frames.push_back(f);
+	}
+	fclose(fp);
+	printf("\n Replay: %d frames in %s", (int)frames.size(), file);
+	return 0;
+}
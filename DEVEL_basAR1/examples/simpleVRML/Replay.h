@@ -0,0 +1,40 @@
+#ifndef Replay_h
+#define Replay_h
+
+#include <vector>
+
+#include "FramePipeline.h"
+
+// Recordings of the tracking, to test the rules without anyone moving
+// markers in front of a camera.
+//
+// With -record file on the command line, the GLUT thread writes the
+// visibility and pose of every actuator and base marker of each frame it
+// takes, as updateActuatorPose() and updateBasePose() are given them. With
+// -simulate file, no camera is opened and no window drawn: the frames of
+// the recording are read first, then fed to the actuators and bases and
+// through Arpe::interactionControl() as fast as it goes, and the rate of
+// the rules is reported.
+//
+// The file is binary, in the byte order of the machine: REPLAY_MAGIC, then
+// for each frame its session, its time, its number of targets and, for each
+// target in the order of the actuators then the bases of the session, found
+// and trans as in FramePipeline::Slot::Pose.
+
+#define REPLAY_MAGIC		0x50524142		// "BARP"
+
+struct ReplayFrame {
+	int			session;
+	double		time;					// arUtilTimer() when captured.
+	std::vector<FramePipeline::Slot::Pose> pose;
+};
+
+// 0, or -1 when file cannot be written.
+int		replayRecordStart(const char *file);
+void	replayRecordFrame(int session, double time, const std::vector<FramePipeline::Slot::Pose> &pose);
+void	replayRecordStop(void);
+
+// All the frames of file, or -1 when it is not a recording.
+int		replayLoad(const char *file, std::vector<ReplayFrame> &frames);
+
+#endif // Replay_h
@@ -4,6 +4,7 @@
 #include <windows.h>
 #include <process.h>
 #include <time.h>
+#include <math.h>
 
 #include <AR/gsub_lite.h>
 #include <AR/ar.h>
@@ -16,166 +17,87 @@
 #include "InfraStructure.h"
 #include "Serial.h"
 #include "SerialCommand.h"
+#include "Log.h"
 
 #include <GL/glut.h>
 
 #include <list>
+#include <vector>
+#include <algorithm>
 using namespace std;
 
-void callTraThread(void *data){ 
-	//	iPoint *p = static_cast<iPoint *>(data);
-	//	p->animTraThread(p->actualAction); 
+// reloadPhase, the thread sets it from PARSING, the frame back to IDLE.
+enum { RELOAD_IDLE, RELOAD_PARSING, RELOAD_READY, RELOAD_FAILED };
 
-	Action *a = static_cast<Action *>(data);
-	iPoint *p = a->myState->myRules->myArpe->findIPoint(a->ipointID);
-
-	printf("\n animTraThread: %s", p->name);
-
-	// Critical Section ->lock parser of this point
-	double tstep;
-	int nstep;
-	double x,y,z;
-
-	nstep = fabs(a->step);
-	tstep = (fabs(a->time))/nstep;
-
-	x = a->x/nstep;
-	y = a->y/nstep;
-	z = a->z/nstep;
-
-	for(int n = 0; n < nstep; n++){
-		//printf("t");
-		p->position.trans[0][3] += x;
-		p->position.trans[1][3] += y;
-		p->position.trans[2][3] += z;
-
-		p->wait(tstep);
-	}
+// The animation steps, applying the part f of the action a to the point p.
+// They are relative to where p is, so that the other actions and the
+// animations running at once on the same point add up.
+static void stepTra(iPoint *p, const Action *a, double f)
+{
+	p->position.trans[0][3] += a->x*f;
+	p->position.trans[1][3] += a->y*f;
+	p->position.trans[2][3] += a->z*f;
 }
 
-void callRotThread(void *data){ 
-	//	iPoint *p = static_cast<iPoint *>(data);
-	//	p->animRotThread(p->actualAction); 
-
-	Action *a = static_cast<Action *>(data);
-	iPoint *p = a->myState->myRules->myArpe->findIPoint(a->ipointID);
-
-	printf("\n animRotThread");
-
-	double tstep;
-	int nstep;
-	int     i, j;
+static void stepRot(iPoint *p, const Action *a, double f)
+{
+	int     i, j, k;
 	double temp[3][4];
-	double rotMatX[3][4];
-	double rotMatY[3][4];
-	double rotMatZ[3][4];
-	double x,y,z;
-
-	nstep = fabs(a->step);
-	tstep = (fabs(a->time))/nstep;
-
-	x = a->x/nstep;
-	y = a->y/nstep;
-	z = a->z/nstep;
-
-	p->createGLRotateMatrix(x,1.0,0.0,0.0,rotMatX);
-	p->createGLRotateMatrix(y,0.0,1.0,0.0,rotMatY);
-	p->createGLRotateMatrix(z,0.0,0.0,1.0,rotMatZ);
-
-	for(int n = 0; n < nstep; n++){
-		//printf("r");
-		if(x != 0.0){
-			for( j = 0; j < 3; j++ ) 
-				for( i = 0; i < 4; i++ ) 
-					temp[j][i] = p->position.trans[j][i];
-			arUtilMatMul(temp,rotMatX,p->position.trans);
-		}
-		if(y != 0.0){
-
-			for( j = 0; j < 3; j++ ) 
-				for( i = 0; i < 4; i++ ) 
-					temp[j][i] = p->position.trans[j][i];
-			arUtilMatMul(temp,rotMatY,p->position.trans);
-		}
-		if(z != 0.0){
-
-			for( j = 0; j < 3; j++ ) 
-				for( i = 0; i < 4; i++ ) 
-					temp[j][i] = p->position.trans[j][i];
-			arUtilMatMul(temp,rotMatZ,p->position.trans);
-		}
-
-		p->wait(tstep);
+	double rotMat[3][4];
+	const double angle[3] = { a->x, a->y, a->z };
 
+	for( k = 0; k < 3; k++ ){
+		if( angle[k] == 0.0) continue;
+		p->createGLRotateMatrix(angle[k]*f, k == 0, k == 1, k == 2, rotMat);
+		for( j = 0; j < 3; j++ ) 
+			for( i = 0; i < 4; i++ ) 
+				temp[j][i] = p->position.trans[j][i];
+		arUtilMatMul(temp,rotMat,p->position.trans);
 	}
-
 }
 
-void callSclThread(void *data){ 
-//	iPoint *p = static_cast<iPoint *>(data);
-//	p->animSclThread(p->actualAction);
-
-	Action *a = static_cast<Action *>(data);
-	iPoint *p = a->myState->myRules->myArpe->findIPoint(a->ipointID);
-
-	
+static void stepScl(iPoint *p, const Action *a, double f)
+{
 	int     i, j;
-	double tstep;
-	int nstep;
 	double temp[3][4],sclMat[3][4];
-	nstep = fabs(a->step);
-	tstep = fabs((a->time))/nstep;
 
 	for( j = 0; j < 3; j++ ) 
 		for( i = 0; i < 4; i++ ){ 
 			sclMat[j][i] = 0;
 			temp[j][i] = p->position.trans[j][i];
 		}
- 	sclMat[0][0] = pow(fabs(a->x),1./nstep);
-	sclMat[1][1] = pow(fabs(a->y),1./nstep);
-	sclMat[2][2] = pow(fabs(a->z),1./nstep);
-
-	for(int n = 0; n < nstep; n++){
-		for( j = 0; j < 3; j++ ) 
-			for( i = 0; i < 4; i++ ){ 
-				temp[j][i] =p->position.trans[j][i];
-			}
-		arUtilMatMul(temp,sclMat,p->position.trans);
-		p->wait(tstep);
-
-	}
-
+	sclMat[0][0] = pow(fabs(a->x),f);
+	sclMat[1][1] = pow(fabs(a->y),f);
+	sclMat[2][2] = pow(fabs(a->z),f);
+	arUtilMatMul(temp,sclMat,p->position.trans);
 }
 
 void Rules::addState(State* value){
 	list<State*>::iterator it;
 	it = listState.begin();
 	listState.push_back(value);
+
+	// The actions are all read by END_STATE
+	this->indexState(value);
 }
 
-State* Rules::findState(int valueID){
+void Rules::indexState(State* value){
+	list<Action*>::iterator itA;
 
-	list<State*>::iterator it;
-	//printf("\n Size of List State %d, asked state %d", this->listState.size(), valueID);
-	for( it = this->listState.begin(); it != this->listState.end(); it++)
-		if((*(*it)).id == valueID)
-			return (*it);
-	return 0;
+	stateIndex.add(value->id, value);
+	for( itA = value->listAction.begin(); itA != value->listAction.end(); itA++)
+		actionIndex.add((*itA)->id, (*itA));
+}
 
+State* Rules::findState(int valueID){
+	return this->stateIndex.find(valueID);
 }
 
 Action* Rules::findAction(int valueID){
-	list<State*>::iterator it;
-	list<Action*>::iterator itA;
-
-	for( it = this->listState.begin(); it != this->listState.end(); it++)
-		for( itA = (*(*it)).listAction.begin(); itA != (*(*it)).listAction.end(); itA++)
-			if( (*(*itA)).id == valueID)
-				return (*itA);
-	
-	printf("\n *******Object not found");
-	return 0;
+	Action *a = this->actionIndex.find(valueID);
 
+	if (a == 0) logWarn("\n *******Object not found");
+	return a;
 }
 
 Rules::Rules(){
@@ -188,11 +110,76 @@ Rules::Rules(){
 
 	getFromQueue = false;
 	queueIndex = 1;
+
+	this->animNow = 0;
+	this->lockUntil = -1;
+
+	this->staged = 0;
+	this->reloadPhase = RELOAD_IDLE;
+}
+
+// Starts an animation of the action a of p, stepped by tickAnimations() along
+// the time of the action from the last tick on.
+void Rules::startAnimation(iPoint *p, Action *a, void (*step)(iPoint *p, const Action *a, double f))
+{
+	Animation anim;
+
+	anim.point = p;
+	anim.action = a;
+	anim.step = step;
+	anim.start = this->animNow;
+	anim.done = 0;
+	this->animations.push_back(anim);
+}
+
+// Called by the frame loop with the time in seconds. Moves each animation by
+// the part of its action that the time passed since the last tick covers and
+// ends those that are done.
+void Rules::tickAnimations(double now)
+{
+	list<Animation>::iterator it;
+	double f;
+	AR_TRACE_SCOPE("tickAnimations");
+
+	this->animNow = now;
+
+	for( it = this->animations.begin(); it != this->animations.end(); ){
+		f = (now - (*it).start) / fabs((*it).action->time);
+		if (f > 1.0) f = 1.0;
+		if (f > (*it).done) {
+			(*it).step((*it).point, (*it).action, f - (*it).done);
+			(*it).done = f;
+		}
+		if ((*it).done >= 1.0) it = this->animations.erase(it);
+		else it++;
+	}
+}
+
+// Seconds of a monotonic clock, for the timed states.
+double Rules::now()
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+
+	if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (double)count.QuadPart / (double)freq.QuadPart;
+}
+
+// Called by Arpe::interactionControl() each frame before the parser, unlocks
+// it when the time of the state that locked it is over. Returns lockParser.
+int Rules::updateParserLock()
+{
+	if (this->lockParser && this->lockUntil >= 0 && now() >= this->lockUntil) {
+		this->lockParser = 0;
+		this->lockUntil = -1;
+	}
+	return this->lockParser;
 }
 
 int Rules::rulesReadFile()
 {
-	FILE			*fp;
+	CfgFile			*fp;
 	char			buf[256];
 	int				numPoints, numStates, pID;
 	double			nextState,time;
@@ -212,9 +199,9 @@ int Rules::rulesReadFile()
 	// Open the Behavior Configuration file
 	//--------------------------------------------------------------------------
 	printf("\n --------------------------------------------------------------------------");
-	if( (fp=fopen(this->configFilename,"r")) == NULL) {
+	if( (fp=cfgOpen(this->configFilename)) == NULL) {
 		printf("\n Error on opening %s !! ",this->configFilename);
-		exit(0);
+		return -1;
 	}
 	printf("\n Opening file %s ", this->configFilename);
 	printf("\n --------------------------------------------------------------------------");
@@ -350,7 +337,8 @@ int Rules::rulesReadFile()
 						if( auxS == 0 ){
 							// State isn't valid
 							printf("\n State %d doesn't exist, please check the queue line %d!!!", q[i], qLineCounter);
-							exit(0);
+							cfgClose(fp);
+							return -1;
 						} else {
 							// State is valid
 							queueState *qs = new queueState;
@@ -398,7 +386,7 @@ int Rules::rulesReadFile()
 
 
 	//printf("\n Queue itens: %d",this->qS.size());
-	fclose(fp);
+	cfgClose(fp);
 	return 1;
 }
 
@@ -461,21 +449,205 @@ int Rules::verifyConsistency(){
 	return 0;
 }
 
+// The actions each opcode applies right when its state is parsed, by type.
+// The others work when an actuator collides with the point.
+#define RULES_HANDLER(name) static int name##Handler(Rules *r, iPoint *p) { return r->name(p); }
+RULES_HANDLER(chgvm) RULES_HANDLER(tra) RULES_HANDLER(rot) RULES_HANDLER(scl)
+RULES_HANDLER(chgm) RULES_HANDLER(sets) RULES_HANDLER(setl) RULES_HANDLER(gets)
+RULES_HANDLER(getl) RULES_HANDLER(chgnm) RULES_HANDLER(esnd) RULES_HANDLER(ercv)
+RULES_HANDLER(esndb) RULES_HANDLER(n255b)
+RULES_HANDLER(adda) RULES_HANDLER(addb) RULES_HANDLER(amb) RULES_HANDLER(bma)
+RULES_HANDLER(nega) RULES_HANDLER(negb) RULES_HANDLER(mula) RULES_HANDLER(mulb)
+RULES_HANDLER(swab) RULES_HANDLER(cmp) RULES_HANDLER(cmpv) RULES_HANDLER(loada)
+RULES_HANDLER(loadb) RULES_HANDLER(dist) RULES_HANDLER(loadq) RULES_HANDLER(getq)
+RULES_HANDLER(setq) RULES_HANDLER(randi) RULES_HANDLER(getbx) RULES_HANDLER(getby)
+RULES_HANDLER(getbz)
+#undef RULES_HANDLER
+
+static const struct {
+	int type;		// 0 - Config, 2 - extern
+	int opcode;
+	ActionHandler handler;
+} actionHandlers[] = {
+	{ 0, 12, chgvmHandler }, { 0, 13, traHandler }, { 0, 14, rotHandler }, { 0, 15, sclHandler },
+	{ 0, 16, chgmHandler }, { 0, 17, setsHandler }, { 0, 18, setlHandler }, { 0, 19, getsHandler },
+	{ 0, 20, getlHandler }, { 0, 23, chgnmHandler },
+	{ 0, 24, addaHandler }, { 0, 25, addbHandler }, { 0, 26, ambHandler }, { 0, 27, bmaHandler },
+	{ 0, 28, negaHandler }, { 0, 29, negbHandler }, { 0, 30, mulaHandler }, { 0, 31, mulbHandler },
+	{ 0, 32, swabHandler }, { 0, 33, cmpHandler }, { 0, 34, cmpvHandler }, { 0, 35, loadaHandler },
+	{ 0, 36, loadbHandler }, { 0, 37, distHandler }, { 0, 38, loadqHandler }, { 0, 39, getqHandler },
+	{ 0, 40, setqHandler }, { 0, 41, randiHandler }, { 0, 42, getbxHandler }, { 0, 43, getbyHandler },
+	{ 0, 44, getbzHandler }, { 0, 46, n255bHandler },
+	{ 2, 21, esndHandler }, { 2, 22, ercvHandler }, { 2, 45, esndbHandler }
+};
+
+// Resolves the iPoint, base, model and sound each action read by
+// rulesReadFile() refers to, and the handler of its opcode, so that parsing a
+// state looks nothing up. Returns how many actions refer to an iPoint that
+// doesn't exist.
+int Rules::compileRules()
+{
+	int missing = this->resolveActions();
+
+	this->compileAudio();
+	return missing;
+}
+
+// All that compileRules() resolves but the sounds, which the reload thread
+// leaves to the frame.
+int Rules::resolveActions()
+{
+	list<State*>::iterator s;
+	list<Action*>::iterator a;
+	Action *ac;
+	int i, missing = 0;
+
+	for( s = this->listState.begin(); s != this->listState.end(); s++){
+		(*s)->patterns.clear();
+		for( a = (*s)->listAction.begin(); a != (*s)->listAction.end(); a++){
+			ac = (*a);
+			ac->point = this->myArpe->findIPoint(ac->ipointID);
+			if (ac->point == 0) {
+				printf("\n *******iPoint %d of action %d not found", ac->ipointID, ac->id);
+				missing++;
+			}
+			ac->base = 0;
+			if (ac->opcode >= 42 && ac->opcode <= 44) ac->base = this->myArpe->findBase(ac->pointWaited);
+			ac->model = 0;
+			if (ac->opcode == 16 && ac->point != 0) ac->model = ac->point->findObject(ac->modelToChange);
+			if (ac->point != 0 && ac->point->myBase != 0) ac->point->myBase->markerPatterns((*s)->patterns);
+			if (ac->base != 0) ac->base->markerPatterns((*s)->patterns);
+
+			ac->handler = 0;
+			for (i = 0; i < (int)(sizeof(actionHandlers) / sizeof(actionHandlers[0])); i++)
+				if (actionHandlers[i].type == ac->type && actionHandlers[i].opcode == ac->opcode)
+					ac->handler = actionHandlers[i].handler;
+		}
+	}
+	return missing;
+}
+
+int Rules::compileAudio()
+{
+	list<State*>::iterator s;
+	list<Action*>::iterator a;
+
+	for( s = this->listState.begin(); s != this->listState.end(); s++)
+		for( a = (*s)->listAction.begin(); a != (*s)->listAction.end(); a++)
+			(*a)->audio = audioBankSource(this->myArpe->audioEngine, (*a)->audioFilename);
+	return 0;
+}
+
+// The reload thread, reading the file into r->staged while the frame runs
+// on the rules it has.
+void Rules::reloadThread(void *data)
+{
+	Rules *r = (Rules *)data;
+	Rules *s = r->staged;
+	int ok;
+
+	arThreadRole(AR_THREAD_BACKGROUND, NULL);
+	ok = cfgRefresh(s->configFilename) == 0 && s->rulesReadFile() >= 0;
+	if (ok) {
+		s->resolveActions();
+		s->verifyConsistency();
+	}
+	InterlockedExchange(&r->reloadPhase, ok ? RELOAD_READY : RELOAD_FAILED);
+}
+
+// Starts reading the rules file again on a thread of its own. The states
+// it reads are swapped in by applyReload(), between two frames.
 int Rules::reloadRules()
 {
+	if (this->reloadPhase != RELOAD_IDLE) { printf("\n The rules are being reloaded already"); return -1; }
+
+	this->staged = new Rules();
+	strcpy(this->staged->configFilename, this->configFilename);
+	this->staged->myArpe = this->myArpe;
+	this->reloadPhase = RELOAD_PARSING;
+	if (_beginthread(reloadThread, 0, this) == -1L) {
+		printf("\n Failure to start reload thread!!");
+		delete this->staged;
+		this->staged = 0;
+		this->reloadPhase = RELOAD_IDLE;
+		return -1;
+	}
+	printf("\n Reloading %s", this->configFilename);
 	return 0;
 }
 
+// Called by Arpe::interactionControl() each frame before the parser. Once
+// the reload thread is done, takes the states, queue and indexes it read;
+// the points get the action of the same id in the new states, and the rules
+// go on from the state they were in, or from the first one when it is gone.
+// The old states are kept, as the animations may still run their actions.
+// Returns 1 when the rules were swapped.
+int Rules::applyReload()
+{
+	list<State*>::iterator s;
+	list<Base*>::iterator b;
+	list<iPoint*>::iterator p;
+	Rules *n = this->staged;
+	Action *a;
+
+	if (this->reloadPhase == RELOAD_IDLE || this->reloadPhase == RELOAD_PARSING) return 0;
+	MemoryBarrier();
+	this->staged = 0;
+	if (this->reloadPhase == RELOAD_FAILED) {
+		printf("\n Reload of %s failed, the rules are kept", this->configFilename);
+		delete n;
+		InterlockedExchange(&this->reloadPhase, RELOAD_IDLE);
+		return 0;
+	}
+
+	// The sounds are in a bank only the frame fills.
+	n->compileAudio();
+
+	this->retiredStates.splice(this->retiredStates.end(), this->listState);
+	this->listState.swap(n->listState);
+	this->qS.swap(n->qS);
+	this->stateIndex.clear();
+	this->actionIndex.clear();
+	for( s = this->listState.begin(); s != this->listState.end(); s++){
+		(*s)->myRules = this;
+		(*s)->onUse = 0;
+		this->indexState(*s);
+	}
+
+	for( b = this->myArpe->listBase.begin(); b != this->myArpe->listBase.end(); b++)
+		for( p = (*b)->listPoint.begin(); p != (*b)->listPoint.end(); p++){
+			if ((*p)->actualAction != 0 && (a = this->actionIndex.find((*p)->actualAction->id)) != 0) (*p)->actualAction = a;
+			if ((*p)->configAction != 0 && (a = this->actionIndex.find((*p)->configAction->id)) != 0) (*p)->configAction = a;
+		}
+
+	if (this->findState(this->actualState) == 0) {
+		this->actualState = this->lastState = 0;
+		this->nextState = 1;
+	} else {
+		this->findState(this->actualState)->onUse = 1;
+		if (this->findState(this->nextState) == 0) this->nextState = this->actualState;
+	}
+	if (this->findQS(this->queueIndex) == 0) this->queueIndex = 1;
+	this->nextStateMath = -1;
+	this->lockParser = 0;
+	this->lockUntil = -1;
+
+	printf("\n %d States reloaded from %s", (int)this->listState.size(), this->configFilename);
+	delete n;
+	InterlockedExchange(&this->reloadPhase, RELOAD_IDLE);
+	return 1;
+}
+
 Rules::~Rules()
 {
 }
 
-char Rules::getBuff(char *buf, int n, FILE *fp)
+char Rules::getBuff(char *buf, int n, CfgFile *fp)
 {
     char *ret;
 	
     for(;;) {
-        ret = fgets(buf, n, fp);
+        ret = cfgGets(buf, n, fp);
         if (ret == NULL) return (NULL);
 		if(feof(fp)) {printf("\n -------------------------------- EOF"); return (EOF);}
         if (buf[0] != '\n' && buf[0] != '#') return(1); // Skip blank lines and comments.
@@ -509,26 +681,22 @@ int Rules::drgrp_grab(iPoint *collidePoint, Actuator *a){		// 3 = CAN_MOVE and r
 int Rules::drgrp_collided(iPoint *collidePoint, Actuator *a,iPoint *movingPoint) {
 
 	if( (*(*movingPoint).myBase).errorSound != 0) { (*(*(*movingPoint).myBase).errorSound).play2D();}
-	EnterCriticalSection(&this->myArpe->parserCS);
 	if( (*(*collidePoint).actualAction).nextState == 0){
 		this->getFromQueue = true;
 	} else {
 		this->nextState  = (*(*collidePoint).actualAction).nextState;
 		this->getFromQueue = false;	}
-	LeaveCriticalSection(&this->myArpe->parserCS);
 	(*a).releasePoint();
 	return (*this->myArpe).repelPoint(movingPoint);
 }
 int Rules::chgst(iPoint *collidePoint){		// 11 = GOTO_STATE, move to other state
 
 	(*this->myArpe).playActionAudio(collidePoint);
-	EnterCriticalSection(&this->myArpe->parserCS);
 	if( (*(*collidePoint).actualAction).nextState == 0){
 		this->getFromQueue = true;
 	} else {
 		this->nextState  = (*(*collidePoint).actualAction).nextState;
 		this->getFromQueue = false;	}
-	LeaveCriticalSection(&this->myArpe->parserCS);
 	return 1;
 }
 int Rules::atto(iPoint *collidePoint, Actuator *a,iPoint *movingPoint){		// 4 = ATTRACT A SPECIFIC POINT
@@ -536,13 +704,11 @@ int Rules::atto(iPoint *collidePoint, Actuator *a,iPoint *movingPoint){		// 4 =
 	if( (*movingPoint).id == (*(*collidePoint).actualAction).pointWaited){
 		// COLLIDED WITH A WAITED POINT, TREAT THE REACTION
 		(*this->myArpe).playActionAudio(collidePoint);
-		EnterCriticalSection(&this->myArpe->parserCS);
 		if( (*(*collidePoint).actualAction).nextState == 0){
 			this->getFromQueue = true;
 		} else {
 			this->nextState  = (*(*collidePoint).actualAction).nextState;
 			this->getFromQueue = false;	}
-		LeaveCriticalSection(&this->myArpe->parserCS);
 		(*a).releasePoint();
 		return (*this->myArpe).attractPoint(movingPoint,collidePoint);
 	} else { 
@@ -556,13 +722,11 @@ int Rules::attrp(iPoint *collidePoint, Actuator *a,iPoint *movingPoint){		// 5 =
 
 	if( (*movingPoint).id == (*(*collidePoint).actualAction).pointWaited){
 		(*this->myArpe).playActionAudio(collidePoint);
-		EnterCriticalSection(&this->myArpe->parserCS);
 		if( (*(*collidePoint).actualAction).nextState == 0){
 			this->getFromQueue = true;
 		} else {
 			this->nextState  = (*(*collidePoint).actualAction).nextState;
 			this->getFromQueue = false;	}
-		LeaveCriticalSection(&this->myArpe->parserCS);
 		(*a).releasePoint();
 		return (*this->myArpe).attractPoint(movingPoint,collidePoint);
 	} else { 
@@ -576,13 +740,11 @@ int Rules::attrp(iPoint *collidePoint, Actuator *a,iPoint *movingPoint){		// 5 =
 int Rules::atta(iPoint *collidePoint, Actuator *a, iPoint *movingPoint){		// 6 = ATTRACT everything
 
 	(*this->myArpe).playActionAudio(collidePoint);
-	EnterCriticalSection(&this->myArpe->parserCS);
 	if( (*(*collidePoint).actualAction).nextState == 0){
 		this->getFromQueue = true;
 	} else {
 		this->nextState  = (*(*collidePoint).actualAction).nextState;
 		this->getFromQueue = false;	}
-	LeaveCriticalSection(&this->myArpe->parserCS);
 	(*a).releasePoint();
 	return (*this->myArpe).attractPoint(movingPoint,collidePoint);
 
@@ -591,13 +753,11 @@ int Rules::drpo(iPoint *collidePoint, Actuator *a, iPoint *movingPoint){		// 7 =
 
 	if( (*movingPoint).id == (*(*collidePoint).actualAction).pointWaited){
 		(*this->myArpe).playActionAudio(collidePoint);
-		EnterCriticalSection(&this->myArpe->parserCS);
 		if( (*(*collidePoint).actualAction).nextState == 0){
 			this->getFromQueue = true;
 		} else {
 			this->nextState  = (*(*collidePoint).actualAction).nextState;
 			this->getFromQueue = false;	}
-		LeaveCriticalSection(&this->myArpe->parserCS);
 		(*a).releasePoint();
 		return (*this->myArpe).dropPoint(movingPoint,collidePoint);
 	} else { 
@@ -611,13 +771,11 @@ int Rules::drpo(iPoint *collidePoint, Actuator *a, iPoint *movingPoint){		// 7 =
 int Rules::drpa(iPoint *collidePoint, Actuator *a, iPoint *movingPoint){		// 8 = DROP with check everything
 
 	(*this->myArpe).playActionAudio(collidePoint);
-	EnterCriticalSection(&this->myArpe->parserCS);
 	if( (*(*collidePoint).actualAction).nextState == 0){
 		this->getFromQueue = true;
 	} else {
 		this->nextState  = (*(*collidePoint).actualAction).nextState;
 		this->getFromQueue = false;	}
-	LeaveCriticalSection(&this->myArpe->parserCS);
 	(*a).releasePoint();
 	return (*this->myArpe).dropPoint(movingPoint,collidePoint);
 }
@@ -625,13 +783,11 @@ int Rules::rplo(iPoint *collidePoint, Actuator *a, iPoint *movingPoint){		// 9 =
 
 	if( (*movingPoint).id == (*(*collidePoint).actualAction).pointWaited){
 		(*this->myArpe).playActionAudio(collidePoint);
-		EnterCriticalSection(&this->myArpe->parserCS);
 		if( (*(*collidePoint).actualAction).nextState == 0){
 			this->getFromQueue = true;
 		} else {
 			this->nextState  = (*(*collidePoint).actualAction).nextState;
 			this->getFromQueue = false;	}
-		LeaveCriticalSection(&this->myArpe->parserCS);
 		(*a).releasePoint();
 		return (*this->myArpe).repelPoint(movingPoint);
 	} else { 
@@ -643,13 +799,11 @@ int Rules::rplo(iPoint *collidePoint, Actuator *a, iPoint *movingPoint){		// 9 =
 int Rules::rpla(iPoint *collidePoint, Actuator *a, iPoint *movingPoint){		// 10 = REPELS everything.
 
 	(*this->myArpe).playActionAudio(collidePoint);
-	EnterCriticalSection(&this->myArpe->parserCS);
 	if( (*(*collidePoint).actualAction).nextState == 0){
 		this->getFromQueue = true;
 	} else {
 		this->nextState  = (*(*collidePoint).actualAction).nextState;
 		this->getFromQueue = false;	}
-	LeaveCriticalSection(&this->myArpe->parserCS);
 	(*a).releasePoint();
 	return (*this->myArpe).repelPoint(movingPoint);
 	
@@ -666,8 +820,8 @@ int Rules::tra(iPoint *p){
 	double m[16];
 
 	if( p->configAction->time > 0) {
-		// Start animation thread
-		_beginthread(callTraThread,0, p->configAction);
+		// Start animation
+		this->startAnimation(p, p->configAction, stepTra);
 	} else {
 		// apply here
 
@@ -710,8 +864,8 @@ int Rules::tra(iPoint *p){
 int Rules::rot(iPoint *p){
 
 	if( p->configAction->time > 0) {
-		// Start animation thread
-		_beginthread(callRotThread,0, p->configAction);
+		// Start animation
+		this->startAnimation(p, p->configAction, stepRot);
 	} else {
 		// apply here
 		int     i, j;
@@ -762,8 +916,8 @@ int Rules::rot(iPoint *p){
 int Rules::scl(iPoint *p){
 
 	if( p->configAction->time > 0) {
-		// Start animation thread
-		_beginthread(callSclThread,0, p->configAction);
+		// Start animation
+		this->startAnimation(p, p->configAction, stepScl);
 	} else {
 		// apply here
 
@@ -805,10 +959,10 @@ int Rules::scl(iPoint *p){
 }
 int Rules::chgm(iPoint *p){
 
-	if ( (*p).findObject( (*(*p).configAction).modelToChange ) != 0 ){
+	if ( (*(*p).configAction).model != 0 ){
 
 		(*p).activeObjectID = (*(*p).configAction).modelToChange;
-		printf("Model to change: %d , PID: %d", (*p).activeObjectID , (*p).id );
+		logInfo("Model to change: %d , PID: %d", (*p).activeObjectID , (*p).id );
 		return 1;
 	}
 	return 0;
@@ -846,8 +1000,7 @@ int Rules::esnd(iPoint *p){
 	if( p->arduino != 0 ){
 		if ( p->arduino->sendFromLookupTable(p->actualAction->eMsg) ){ 
 			(*this->myArpe).playActionAudio(p);
-			printf("\n Dentro de ESND Name: %s", p->name);
-			printf("\n Returning");
+			logDebug("\n Dentro de ESND Name: %s\n Returning", p->name);
 			return 1;
 		} else {
 			if( (*(*p).myBase).errorSound != 0) { (*(*(*p).myBase).errorSound).play2D();}
@@ -856,14 +1009,14 @@ int Rules::esnd(iPoint *p){
 		}
 	} else {
 		// Couldn't connect to it.
-		printf("\n Could not connect to hardware, !");
+		logWarn("\n Could not connect to hardware, !");
 		if( (*(*p).myBase).errorSound != 0) { (*(*(*p).myBase).errorSound).play2D();}
 		//p->actualAction = 0;
 		return -1;}
 	//printf("\n Sent: %s (%d).",p->actualAction->eMsg,p->arduino->findCommand(p->actualAction->eMsg)->requestNumber);
 	//p->actualAction = 0;
 
-	printf("\n Shouldn't be passing by here!!!! basAR is crazy!!!");
+	logError("\n Shouldn't be passing by here!!!! basAR is crazy!!!");
 	return 1;
 	
 }
@@ -873,8 +1026,7 @@ int Rules::esndb(iPoint *p){
 	if( p->arduino != 0 ){
 		if ( p->arduino->sendNormInt(p->B) ){  // SENTENCE TO SEND TO ARDUINO A NORMALIZED VALUE
 			(*this->myArpe).playActionAudio(p);
-			printf("\n Dentro de ESND Name: %s", p->name);
-			printf("\n Returning");
+			logDebug("\n Dentro de ESND Name: %s\n Returning", p->name);
 			return 1;
 		} else {
 			if( (*(*p).myBase).errorSound != 0) { (*(*(*p).myBase).errorSound).play2D();}
@@ -883,14 +1035,14 @@ int Rules::esndb(iPoint *p){
 		}
 	} else {
 		// Couldn't connect to it.
-		printf("\n Could not connect to hardware, !");
+		logWarn("\n Could not connect to hardware, !");
 		if( (*(*p).myBase).errorSound != 0) { (*(*(*p).myBase).errorSound).play2D();}
 		//p->actualAction = 0;
 		return -1;}
 	//printf("\n Sent: %s (%d).",p->actualAction->eMsg,p->arduino->findCommand(p->actualAction->eMsg)->requestNumber);
 	//p->actualAction = 0;
 
-	printf("\n Shouldn't be passing by here!!!! basAR is crazy!!!");
+	logError("\n Shouldn't be passing by here!!!! basAR is crazy!!!");
 
 	return 1;
 }
@@ -901,15 +1053,11 @@ int Rules::ercv(iPoint *p){
 		// Prepare what need to be scanned to 
 		if( (strcmp(p->actualAction->eMsg,"0") == 0 ) || (strcmp(p->actualAction->eMsg,"") == 0 ) ){
 			// Disabel reading thread to get data.
-			EnterCriticalSection(&p->commCS);
 			p->arduino->enableReceive = 0 ;
-			LeaveCriticalSection(&p->commCS);
 
 		} else {
 			// Enable reading thread to get data.
-			EnterCriticalSection(&p->commCS);
 			p->arduino->enableReceive = 1;
-			LeaveCriticalSection(&p->commCS);
 		}
 	}
 	return 1;
@@ -1087,7 +1235,7 @@ int Rules::randi(iPoint *p){
 
 int Rules::getbx(iPoint *p){
 	Base *b = 0;
-	b = this->myArpe->findBase(p->configAction->pointWaited);
+	b = p->configAction->base;
 	if(b!=0){
 		if (b->myInfraStructure->visible){
 			p->B = b->myInfraStructure->baseTrans[0][3];
@@ -1098,7 +1246,7 @@ int Rules::getbx(iPoint *p){
 }
 int Rules::getby(iPoint *p){
 	Base *b = 0;
-	b = this->myArpe->findBase(p->configAction->pointWaited);
+	b = p->configAction->base;
 	if(b!=0){
 		if (b->myInfraStructure->visible){
 			p->B = b->myInfraStructure->baseTrans[1][3];
@@ -1109,7 +1257,7 @@ int Rules::getby(iPoint *p){
 }
 int Rules::getbz(iPoint *p){
 	Base *b = 0;
-	b = this->myArpe->findBase(p->configAction->pointWaited);
+	b = p->configAction->base;
 	if(b!=0){
 		if (b->myInfraStructure->visible){
 			p->B = b->myInfraStructure->baseTrans[2][3];
@@ -1134,12 +1282,10 @@ void Rules::copyMatrix(double source[3][4],double destiny[3][4]){
 
 }
 
-void parserLock( void *data){
-
-	State *st = static_cast<State *>(data);
-	st->myRules->lockParser = 1;
-	st->myRules->wait(st->time);
-	st->myRules->lockParser = 0;
+// Locks the parser for the time of the state st, updateParserLock() unlocks it.
+void Rules::parserLock(State *st){
+	this->lockParser = 1;
+	this->lockUntil = now() + (st->time > 0 ? st->time : 0);
 }
 
 int Rules::parseRule(){
@@ -1156,14 +1302,13 @@ int Rules::parseRule(){
 			
 			// find which state from the queue to parse
 			s = this->findQS(this->queueIndex);
-			printf("\n Requesting queue state %d", s->id);
-			if( s == 0 ) { printf("\n App went crazy, you asked State %d and we couldn't find. Please review app!!", this->nextState); exit(0);}  
+			if( s == 0 ) { logError("\n App went crazy, you asked State %d and we couldn't find. Please review app!!", this->nextState); exit(0);}  
+			logInfo("\n Requesting queue state %d", s->id);
 			(*s).parseState();
 			// AFTER THE QUEUED STATE is parsed SET THE NEXT TO QUEUE STATE TO PARSE
 			this->queueIndex = this->setNextQueueItem(this->queueIndex );
 			this->getFromQueue = false;
 
-			EnterCriticalSection(&this->myArpe->parserCS);
 			this->lastState = this->actualState;
 			this->actualState = (*s).id;
 			this->nextState = this->actualState;
@@ -1178,20 +1323,20 @@ int Rules::parseRule(){
 
 			if( this->nextStateMath > 0 ) { // If a math next state is set, applies, has priority over configuration state and working state
 				this->nextState = this->nextStateMath;
-				printf(" *Q_NSM* ");
+				logDebug(" *Q_NSM* ");
 			} else {
 				if( this->nextStateMath == 0) {
 					this->getFromQueue = true;
-					printf(" *Q_NSM-GFQ* ");
+					logDebug(" *Q_NSM-GFQ* ");
 				} else {
 					if( (*s).nextState > 0) { // This test if it is a configuration state.
 						this->nextState = (*s).nextState;
 						this->getFromQueue = false;
-						printf(" *Q_NS* ");
+						logDebug(" *Q_NS* ");
 					} else {
 						if( (*s).nextState == 0){
 							this->getFromQueue = true;
-							printf(" *Q_NS-GFQ* ");
+							logDebug(" *Q_NS-GFQ* ");
 						}
 					}
 				}
@@ -1199,16 +1344,15 @@ int Rules::parseRule(){
 			this->nextStateMath = -1;
 
 			//printf(" NS: %d", this->nextState);
-			LeaveCriticalSection(&this->myArpe->parserCS);
 
-			if( (*s).time != 0 ) _beginthread( parserLock, 0, s);
-			printf(" ... OK, NS:%d, AS:%d",this->nextState,this->actualState);
+			if( (*s).time != 0 ) this->parserLock(s);
+			logInfo(" ... OK, NS:%d, AS:%d",this->nextState,this->actualState);
 
 			return 1;
 
 			// point to the next state of the queue
 		} else {
-			printf("\n Queue must be a value above 0, app will be terminated, verify state %d.", this->actualState);
+			logError("\n Queue must be a value above 0, app will be terminated, verify state %d.", this->actualState);
 		}
 
 	}
@@ -1222,16 +1366,13 @@ int Rules::parseRule(){
 			//if( (*s).onUse == 0)
 
 			//do{
-			printf("\n asking for state: %d", this->nextState);
-			EnterCriticalSection(&this->myArpe->parserCS);
-			LeaveCriticalSection(&this->myArpe->parserCS);
+			logInfo("\n asking for state: %d", this->nextState);
 			s = this->findState(this->nextState);
-			if( s == 0 ) { printf("\n App went crazy, you asked State %d and we couldn't find. Please review app!!", this->nextState); exit(0);}  
+			if( s == 0 ) { logError("\n App went crazy, you asked State %d and we couldn't find. Please review app!!", this->nextState); exit(0);}  
 
 			(*s).parseState();
 			//(*s).parsedTime = time(NULL); printf (" %ld", (*s).parsedTime );
 
-			EnterCriticalSection(&this->myArpe->parserCS);
 			this->lastState = this->actualState;
 			this->actualState = (*s).id;
 			// Put the actual state onUse
@@ -1245,21 +1386,21 @@ int Rules::parseRule(){
 			// SOLVE NEXT STATE
 			if( this->nextStateMath > 0 ) { // If a math next state is set, applies, has priority over configuration state and working state
 				this->nextState = this->nextStateMath;
-				printf(" *S_NSM* ");
+				logDebug(" *S_NSM* ");
 			} else {
 				if( this->nextStateMath == 0) {
 					this->getFromQueue = true;
-					printf(" *S_NSM-GFQ* ");
+					logDebug(" *S_NSM-GFQ* ");
 				} else {
 					if( (*s).nextState > 0) { // This test if it is a configuration state.
 						this->nextState = (*s).nextState;
 						//printf("\n ********************* %d",this->nextState);
 						this->getFromQueue = false;
-						printf(" *S_NS* ");
+						logDebug(" *S_NS* ");
 					} else {
 						if( (*s).nextState == 0){
 							this->getFromQueue = true;
-							printf(" *S_NS-GFQ* ");
+							logDebug(" *S_NS-GFQ* ");
 						} 
 					}
 
@@ -1267,13 +1408,12 @@ int Rules::parseRule(){
 			}
 			this->nextStateMath = -1;
 			//printf(" NS: %d", this->nextState);
-			LeaveCriticalSection(&this->myArpe->parserCS);
 
 			//printf(" --- time: %lf",s->time);
-			if( (*s).time != 0 ) _beginthread( parserLock, 0, s);
+			if( (*s).time != 0 ) this->parserLock(s);
 
 			//} while ( (*s).nextState != 0 );
-			printf(" ... OK, NS:%d, AS:%d",this->nextState,this->actualState);
+			logInfo(" ... OK, NS:%d, AS:%d",this->nextState,this->actualState);
 
 			return 1;
 		}
@@ -1320,6 +1460,48 @@ State* Rules::findQS(int valueID){
 }
 
 
+// The state a nextState of s goes to: the state of that id, or for 0 the
+// state of the queue that is next, or 0 when it stays.
+static State* transitionTo(Rules *r, int nextState){
+
+	if( nextState > 0) return r->findState(nextState);
+	if( nextState == 0) return r->findQS(r->queueIndex);
+	return 0;
+}
+
+// Breadth first from the actual state, through the nextState of each state
+// and of each of its actions, CMP and CMPV included. The actual state is
+// left out, as are the states already found.
+void Rules::upcomingStates(int depth, vector<State*> &states){
+
+	vector<State*> level, next;
+	list<Action*>::iterator a;
+	State *s, *to;
+	size_t i;
+	int d;
+
+	states.clear();
+	if( (s = this->findState(this->actualState)) == 0) return;
+	level.push_back(s);
+	for( d = 0; d < depth && !level.empty(); d++){
+		next.clear();
+		for( i = 0; i < level.size(); i++){
+			to = transitionTo(this, level[i]->nextState);
+			if( to != 0 && to != s && find(states.begin(), states.end(), to) == states.end()){
+				states.push_back(to);
+				next.push_back(to);
+			}
+			for( a = level[i]->listAction.begin(); a != level[i]->listAction.end(); a++){
+				to = transitionTo(this, (*a)->nextState);
+				if( to == 0 || to == s || find(states.begin(), states.end(), to) != states.end()) continue;
+				states.push_back(to);
+				next.push_back(to);
+			}
+		}
+		level.swap(next);
+	}
+}
+
 int Rules::setNextQueueItem(int valueID){
 
 	list<queueState*>::iterator it;
@@ -2,22 +2,26 @@
 #define Rules_h
 
 #include <list>
+#include <vector>
 
 #include "Action.h"
 #include "State.h"
 #include "iPoint.h"
 #include "Actuator.h"
 #include "queueState.h"
+#include "IdIndex.h"
+#include "ConfigBundle.h"
+#include "ArpeAlloc.h"
 
 class Arpe;
 
-class Rules {
+class Rules : public ArpeAlloc {
 
  public:
 
 	//Rules
 	//int  interpretPointMode(char *value);
-	char getBuff(char *buf, int n, FILE *fp);
+	char getBuff(char *buf, int n, CfgFile *fp);
 	int parseRule();
 	char configFilename[256];
     Rules();
@@ -25,7 +29,12 @@ class Rules {
 	int rulesReadFile();
     int rulesWriteFile();
     int verifyConsistency();
+    int compileRules();
+	int compileAudio();
+
+	// Hot reload of the rules file, see reloadRules()
     int reloadRules();
+	int applyReload();
 
 	//States
 	int nextState;
@@ -45,6 +54,9 @@ class Rules {
 	bool getFromQueue;
 	int queueIndex;
 	State* findQS(int valueID);
+
+	// The states the rules may go to within depth transitions, see Arpe::updatePrefetch()
+	void upcomingStates(int depth, std::vector<State*> &states);
 	int setNextQueueItem(int valueID);
 	void addQS(queueState* value);
 
@@ -103,13 +115,43 @@ class Rules {
 	int getbx(iPoint *p);
 	int getby(iPoint *p);
 	int getbz(iPoint *p);
-	//void callTraThread();
-	
+
+	// Animations of tra(), rot() and scl() with a time
+	void tickAnimations(double now);
+
+	// Timed states, see parserLock()
+	static double now();
+	int updateParserLock();
  
     Arpe *myArpe;
 	void wait( double seconds);
 
 private:
+	struct Animation {
+		iPoint *point;
+		Action *action;
+		void (*step)(iPoint *p, const Action *a, double f);
+		double start;	// Time of the tick before it started
+		double done;	// Part of the action applied
+	};
+	std::list<Animation> animations;
+	double animNow;		// Time of the last tickAnimations()
+	double lockUntil;	// now() lockParser ends at, -1 when not timed
+	void startAnimation(iPoint *p, Action *a, void (*step)(iPoint *p, const Action *a, double f));
+	void parserLock(State *st);
+
+	// The states and their actions by id, filled by addState()
+	IdIndex<State> stateIndex;
+	IdIndex<Action> actionIndex;
+	void indexState(State *s);
+	int resolveActions();
+
+	// The rules read by the reload thread, handed over by reloadPhase
+	Rules *staged;
+	volatile long reloadPhase;
+	std::list<State*> retiredStates;	// Replaced, the points may still hold their actions
+	static void reloadThread(void *data);
+
 	void convParaToGl(const double para[3][4], double m_modelview[16], const double scale);
 	void loadIdentity(double value[3][4]);
 	void copyMatrix(double source[3][4],double destiny[3][4]);
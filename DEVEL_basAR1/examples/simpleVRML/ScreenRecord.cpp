@@ -0,0 +1,338 @@
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include <process.h>
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mfreadwrite.h>
+
+#include <GL/glut.h>
+
+#include <AR/config.h>
+#include <AR/ar.h>
+#include <AR/video.h>
+
+#include "ScreenRecord.h"
+
+#pragma comment(lib, "mfplat.lib")
+#pragma comment(lib, "mfreadwrite.lib")
+#pragma comment(lib, "mfuuid.lib")
+
+#ifndef GL_BGRA
+#  define GL_BGRA				0x80E1
+#endif
+#ifndef GL_PIXEL_PACK_BUFFER
+#  define GL_PIXEL_PACK_BUFFER	0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#  define GL_STREAM_READ		0x88E1
+#endif
+#ifndef GL_READ_ONLY
+#  define GL_READ_ONLY			0x88B8
+#endif
+
+typedef void (APIENTRY *GenBuffers)(GLsizei n, GLuint *buffers);
+typedef void (APIENTRY *DeleteBuffers)(GLsizei n, const GLuint *buffers);
+typedef void (APIENTRY *BindBuffer)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *BufferData)(GLenum target, ptrdiff_t size, const GLvoid *data, GLenum usage);
+typedef GLvoid *(APIENTRY *MapBuffer)(GLenum target, GLenum access);
+typedef GLboolean (APIENTRY *UnmapBuffer)(GLenum target);
+
+static GenBuffers		genBuffers;
+static DeleteBuffers	deleteBuffers;
+static BindBuffer		bindBuffer;
+static BufferData		bufferData;
+static MapBuffer		mapBuffer;
+static UnmapBuffer		unmapBuffer;
+
+// The GLUT thread.
+static char				fileName[MAX_PATH];
+static int				mp4;
+static int				width, height;
+static GLuint			pbo[SCREEN_RECORD_PBOS];
+static long long		pboTime[SCREEN_RECORD_PBOS];
+static int				pboNext = 0;		// To read into.
+static int				pboPending = 0;		// Read and not collected.
+static int				pboRead = FALSE;	// By screenRecordRead() of this frame.
+
+// The queue, written by the GLUT thread at head and by the encoder at tail.
+static ARUint8			*queue[SCREEN_RECORD_QUEUE];
+static long long		queueTime[SCREEN_RECORD_QUEUE];
+static volatile LONG	head = 0;
+static volatile LONG	tail = 0;
+static volatile LONG	dropped = 0;
+static LONG				written = 0;
+static volatile LONG	running = FALSE;
+static HANDLE			wakeEvent = 0;
+static HANDLE			encoderHandle = 0;
+
+// The encoder thread.
+static AR2VideoRecordT	*arv = NULL;
+static IMFSinkWriter	*writer = NULL;
+static DWORD			stream;
+static long long		firstTime;
+
+static void *bufferProc(const char *name, const char *nameARB)
+{
+	void *proc;
+
+	if (!(proc = (void *)wglGetProcAddress(name))) proc = (void *)wglGetProcAddress(nameARB);
+	return proc;
+}
+
+static int mp4Open(void)
+{
+	IMFAttributes *attr = NULL;
+	IMFMediaType *out = NULL, *in = NULL;
+	WCHAR wide[MAX_PATH];
+	HRESULT hr;
+	// H.264 wants an even size; the last column or row is left out.
+	int w = width & ~1, h = height & ~1;
+
+	if (FAILED(MFStartup(MF_VERSION))) return -1;
+	MultiByteToWideChar(CP_ACP, 0, fileName, -1, wide, MAX_PATH);
+	hr = MFCreateAttributes(&attr, 1);
+	if (SUCCEEDED(hr)) hr = attr->SetUINT32(MF_READWRITE_ENABLE_HARDWARE_TRANSFORMS, TRUE);
+	if (SUCCEEDED(hr)) hr = MFCreateSinkWriterFromURL(wide, NULL, attr, &writer);
+
+	if (SUCCEEDED(hr)) hr = MFCreateMediaType(&out);
+	if (SUCCEEDED(hr)) hr = out->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+	if (SUCCEEDED(hr)) hr = out->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_H264);
+	if (SUCCEEDED(hr)) hr = out->SetUINT32(MF_MT_AVG_BITRATE, SCREEN_RECORD_BITRATE);
+	if (SUCCEEDED(hr)) hr = out->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+	if (SUCCEEDED(hr)) hr = MFSetAttributeSize(out, MF_MT_FRAME_SIZE, w, h);
+	if (SUCCEEDED(hr)) hr = MFSetAttributeRatio(out, MF_MT_FRAME_RATE, SCREEN_RECORD_FPS, 1);
+	if (SUCCEEDED(hr)) hr = MFSetAttributeRatio(out, MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+	if (SUCCEEDED(hr)) hr = writer->AddStream(out, &stream);
+
+	// The sink writer puts a converter of its own from RGB32 to what the encoder takes.
+	if (SUCCEEDED(hr)) hr = MFCreateMediaType(&in);
+	if (SUCCEEDED(hr)) hr = in->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video);
+	if (SUCCEEDED(hr)) hr = in->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_RGB32);
+	if (SUCCEEDED(hr)) hr = in->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+	if (SUCCEEDED(hr)) hr = in->SetUINT32(MF_MT_DEFAULT_STRIDE, (UINT32)(w * 4));	// Top down.
+	if (SUCCEEDED(hr)) hr = MFSetAttributeSize(in, MF_MT_FRAME_SIZE, w, h);
+	if (SUCCEEDED(hr)) hr = MFSetAttributeRatio(in, MF_MT_FRAME_RATE, SCREEN_RECORD_FPS, 1);
+	if (SUCCEEDED(hr)) hr = MFSetAttributeRatio(in, MF_MT_PIXEL_ASPECT_RATIO, 1, 1);
+	if (SUCCEEDED(hr)) hr = writer->SetInputMediaType(stream, in, NULL);
+	if (SUCCEEDED(hr)) hr = writer->BeginWriting();
+
+	if (in) in->Release();
+	if (out) out->Release();
+	if (attr) attr->Release();
+	if (FAILED(hr)) {
+		if (writer) writer->Release();
+		writer = NULL;
+		MFShutdown();
+		return -1;
+	}
+	return 0;
+}
+
+static void mp4Frame(ARUint8 *image, long long time)
+{
+	IMFMediaBuffer *buffer = NULL;
+	IMFSample *sample = NULL;
+	BYTE *data;
+	int w = width & ~1, h = height & ~1;
+	HRESULT hr;
+
+	hr = MFCreateMemoryBuffer(w * h * 4, &buffer);
+	if (SUCCEEDED(hr)) hr = buffer->Lock(&data, NULL, NULL);
+	if (SUCCEEDED(hr)) {
+		MFCopyImage(data, w * 4, image, width * 4, w * 4, h);
+		buffer->Unlock();
+		hr = buffer->SetCurrentLength(w * h * 4);
+	}
+	if (SUCCEEDED(hr)) hr = MFCreateSample(&sample);
+	if (SUCCEEDED(hr)) hr = sample->AddBuffer(buffer);
+	// In 100 ns, from the microseconds of arVideoTime().
+	if (SUCCEEDED(hr)) hr = sample->SetSampleTime((time - firstTime) * 10);
+	if (SUCCEEDED(hr)) hr = sample->SetSampleDuration(10000000 / SCREEN_RECORD_FPS);
+	if (SUCCEEDED(hr)) writer->WriteSample(stream, sample);
+	if (sample) sample->Release();
+	if (buffer) buffer->Release();
+}
+
+static void mp4Close(void)
+{
+	writer->Finalize();
+	writer->Release();
+	writer = NULL;
+	MFShutdown();
+}
+
+// Encodes the frames queued so far, in order.
+static void drain(void)
+{
+	LONG t = tail;
+
+	while (t != head) {
+		ARUint8 *image = queue[t & (SCREEN_RECORD_QUEUE - 1)];
+		long long time = queueTime[t & (SCREEN_RECORD_QUEUE - 1)];
+
+		if (written == 0) firstTime = time;
+		if (mp4) mp4Frame(image, time);
+		else ar2VideoRecordFrame(arv, image, time);
+		written++;
+		InterlockedExchange(&tail, ++t);			// Free for the GLUT thread, after the encoding.
+	}
+}
+
+static unsigned __stdcall encoderThread(void *arg)
+{
+	int ok;
+
+	arThreadRole(AR_THREAD_BACKGROUND, "screen record");
+	if (mp4) {
+		CoInitializeEx(NULL, COINIT_MULTITHREADED);
+		ok = (mp4Open() == 0);
+	} else {
+		ok = ((arv = ar2VideoRecordOpen(fileName, width, height, AR_PIXEL_FORMAT_BGRA, width * 4, 1)) != NULL);
+	}
+	if (!ok) {
+		printf("\n ScreenRecord: unable to write %s", fileName);
+		running = FALSE;
+	}
+	while (running) {
+		WaitForSingleObject(wakeEvent, INFINITE);
+		drain();
+	}
+	if (ok) {
+		drain();
+		if (mp4) mp4Close();
+		else ar2VideoRecordClose(arv);
+		arv = NULL;
+	}
+	if (mp4) CoUninitialize();
+	arThreadRoleEnd();
+	return 0;
+}
+
+int screenRecordStart(const char *file)
+{
+	const char *ext;
+	int i;
+
+	if (encoderHandle) return 0;
+	genBuffers = (GenBuffers)bufferProc("glGenBuffers", "glGenBuffersARB");
+	deleteBuffers = (DeleteBuffers)bufferProc("glDeleteBuffers", "glDeleteBuffersARB");
+	bindBuffer = (BindBuffer)bufferProc("glBindBuffer", "glBindBufferARB");
+	bufferData = (BufferData)bufferProc("glBufferData", "glBufferDataARB");
+	mapBuffer = (MapBuffer)bufferProc("glMapBuffer", "glMapBufferARB");
+	unmapBuffer = (UnmapBuffer)bufferProc("glUnmapBuffer", "glUnmapBufferARB");
+	if (!genBuffers || !deleteBuffers || !bindBuffer || !bufferData || !mapBuffer || !unmapBuffer) {
+		printf("\n ScreenRecord: no pixel buffer objects in this OpenGL");
+		return -1;
+	}
+
+	strncpy(fileName, file, sizeof(fileName) - 1);
+	ext = strrchr(file, '.');
+	mp4 = (ext != NULL && _stricmp(ext, ".mp4") == 0);
+	width = glutGet(GLUT_WINDOW_WIDTH);
+	height = glutGet(GLUT_WINDOW_HEIGHT);
+
+	for (i = 0; i < SCREEN_RECORD_QUEUE; i++) {
+		if ((queue[i] = (ARUint8 *)arImageAlloc(AR_MEM_ARPE, width * height * 4)) == NULL) {
+			while (--i >= 0) arImageFree(queue[i]);
+			printf("\n ScreenRecord: out of memory");
+			return -1;
+		}
+	}
+	genBuffers(SCREEN_RECORD_PBOS, pbo);
+	for (i = 0; i < SCREEN_RECORD_PBOS; i++) {
+		bindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+		bufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, NULL, GL_STREAM_READ);
+	}
+	bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	pboNext = pboPending = 0;
+	pboRead = FALSE;
+	head = tail = dropped = written = 0;
+
+	wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	running = TRUE;
+	encoderHandle = (HANDLE)_beginthreadex(NULL, 0, encoderThread, NULL, 0, NULL);
+	if (encoderHandle == 0) {
+		running = FALSE;
+		CloseHandle(wakeEvent);
+		deleteBuffers(SCREEN_RECORD_PBOS, pbo);
+		for (i = 0; i < SCREEN_RECORD_QUEUE; i++) arImageFree(queue[i]);
+		printf("\n ScreenRecord: unable to start thread");
+		return -1;
+	}
+	printf("\n Recording the window, %dx%d, to %s", width, height, fileName);
+	return 0;
+}
+
+void screenRecordRead(void)
+{
+	if (encoderHandle == 0) return;
+	if (!running) { screenRecordStop(); return; }		// The encoder could not open the file.
+	if (glutGet(GLUT_WINDOW_WIDTH) != width || glutGet(GLUT_WINDOW_HEIGHT) != height) {
+		printf("\n ScreenRecord: the window changed size, recording stopped");
+		screenRecordStop();
+		return;
+	}
+
+	// Queued on the GPU; glReadPixels() returns before the pixels are read.
+	glReadBuffer(GL_BACK);
+	bindBuffer(GL_PIXEL_PACK_BUFFER, pbo[pboNext]);
+	glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+	bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	pboNext = (pboNext + 1) % SCREEN_RECORD_PBOS;
+	pboPending++;
+	pboRead = TRUE;
+}
+
+// Copies the oldest buffer read into the queue, top row first.
+static void collect(void)
+{
+	int oldest = (pboNext + SCREEN_RECORD_PBOS - pboPending) % SCREEN_RECORD_PBOS;
+	ARUint8 *src, *dst;
+	LONG h = head;
+	int y;
+
+	pboPending--;
+	if (h - tail == SCREEN_RECORD_QUEUE) { InterlockedIncrement(&dropped); return; }	// Full.
+	bindBuffer(GL_PIXEL_PACK_BUFFER, pbo[oldest]);
+	if ((src = (ARUint8 *)mapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY)) != NULL) {
+		dst = queue[h & (SCREEN_RECORD_QUEUE - 1)];
+		for (y = 0; y < height; y++) memcpy(dst + y * width * 4, src + (height - 1 - y) * width * 4, width * 4);
+		unmapBuffer(GL_PIXEL_PACK_BUFFER);
+		queueTime[h & (SCREEN_RECORD_QUEUE - 1)] = pboTime[oldest];
+		InterlockedExchange(&head, h + 1);			// Queued, after the pixels.
+		SetEvent(wakeEvent);
+	}
+	bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+void screenRecordCollect(long long time)
+{
+	if (encoderHandle == 0 || !pboRead) return;
+	pboTime[(pboNext + SCREEN_RECORD_PBOS - 1) % SCREEN_RECORD_PBOS] = time;
+	pboRead = FALSE;
+	// The buffer read SCREEN_RECORD_PBOS - 1 frames ago; its copy is done by now.
+	if (pboPending == SCREEN_RECORD_PBOS) collect();
+}
+
+void screenRecordStop(void)
+{
+	int i;
+
+	if (encoderHandle == 0) return;
+	// The last frames, waited for.
+	while (running && pboPending > 0) {
+		while (running && head - tail == SCREEN_RECORD_QUEUE) Sleep(1);
+		collect();
+	}
+	pboPending = 0;
+	running = FALSE;
+	SetEvent(wakeEvent);
+	WaitForSingleObject(encoderHandle, INFINITE);
+	CloseHandle(encoderHandle);
+	CloseHandle(wakeEvent);
+	encoderHandle = 0;
+	deleteBuffers(SCREEN_RECORD_PBOS, pbo);
+	for (i = 0; i < SCREEN_RECORD_QUEUE; i++) arImageFree(queue[i]);
+	printf("\n ScreenRecord: %ld frames written to %s, %ld dropped", written, fileName, dropped);
+}
@@ -0,0 +1,32 @@
+#ifndef ScreenRecord_h
+#define ScreenRecord_h
+
+// Recordings of the window, as it is shown: the video, the models and the
+// overlays composited.
+//
+// With -screenrecord file on the command line, Display() reads the back
+// buffer into one of SCREEN_RECORD_PBOS pixel buffer objects before the
+// swap, which only queues the copy on the GPU. After the swap, the buffer
+// read SCREEN_RECORD_PBOS - 1 frames ago, whose copy is done by then, is
+// mapped and copied into a free entry of a queue, and a thread of its own
+// encodes the queue. When the encoder is behind by the whole queue the frame
+// is dropped and counted: the drawing never waits for it.
+//
+// A file ending in .mp4 is encoded in H.264 by Media Foundation, on the
+// encoder of the graphics card when there is one; any other is an .arv of
+// ar2VideoRecordOpen(), lossless, that the file video module plays back.
+// The size is that of the window when recording starts; the recording ends
+// when the window changes size.
+
+#define SCREEN_RECORD_PBOS		3			// Frames read back at once.
+#define SCREEN_RECORD_QUEUE		8			// Frames waiting for the encoder, a power of 2.
+#define SCREEN_RECORD_FPS		30			// Frame rate of the .mp4, the frames themselves are timed.
+#define SCREEN_RECORD_BITRATE	8000000		// Bits per second of the .mp4.
+
+// The GLUT thread, with the window current.
+int		screenRecordStart(const char *file);
+void	screenRecordRead(void);					// Before glutSwapBuffers().
+void	screenRecordCollect(long long time);	// After, with arVideoTime() of the frame.
+void	screenRecordStop(void);
+
+#endif // ScreenRecord_h
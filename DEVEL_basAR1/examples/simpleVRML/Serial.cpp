@@ -1,15 +1,25 @@
 #include "serial.h"
 
 #include <Windows.h>
+#include <process.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <AR/ar.h>
+
 #include "Serial.h"
+#include "Startup.h"
+#include "Log.h"
 
 Serial::Serial(){
 
 	strcpy(this->buffer,"");
+	this->nameSeed = 0;
+	this->writeBehind = 0;
+	this->outLen = 0;
+	this->openedAt = 0;
+	this->handshook = 0;
 }
 
 Serial::Serial(char *portName)
@@ -18,6 +28,13 @@ Serial::Serial(char *portName)
     this->connected = false;
 	strcpy(this->buffer,"");
 	strcpy(this->portName,portName);
+	this->nameSeed = 0;
+	this->writeBehind = 0;
+	this->outLen = 0;
+	this->openedAt = 0;
+	this->handshook = 0;
+
+    startupBegin(STARTUP_SERIAL);
 
     //Try to connect to the given port throuh CreateFile
     this->hSerial = CreateFile(portName,
@@ -25,7 +42,7 @@ Serial::Serial(char *portName)
             0,
             NULL,
             OPEN_EXISTING,
-            FILE_ATTRIBUTE_NORMAL,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
             NULL);
 
     //Check if the connection was successfull
@@ -70,13 +87,14 @@ Serial::Serial(char *portName)
              else
              {
                  //If everything went fine we're connected
-                 this->connected = true;
-                 //We wait 2s as the arduino board will be reseting
-                 Sleep(ARDUINO_WAIT_TIME);
+                 this->connected = this->setupEvents();
+                 //The arduino board is reseting, handshake() waits for it
+                 this->openedAt = GetTickCount();
              }
         }
     }
 
+    startupEnd();
 }
 
 Serial::~Serial()
@@ -91,10 +109,39 @@ Serial::~Serial()
     }
 }
 
+// The reads return at once with what the port has, and it signals each byte
+// received to the WaitCommEvent() of the serial thread.
+bool Serial::setupEvents()
+{
+    COMMTIMEOUTS timeouts = {0};
+
+    timeouts.ReadIntervalTimeout = MAXDWORD;
+    if (!SetCommTimeouts(this->hSerial, &timeouts) || !SetCommMask(this->hSerial, EV_RXCHAR))
+    {
+        printf("ALERT: Could not set Serial Port events");
+        return false;
+    }
+    return true;
+}
+
+HANDLE Serial::getHandle()
+{
+    return this->hSerial;
+}
+
+// The port is opened for overlapped I/O, the calls here wait for their own.
+static BOOL serialIO(HANDLE h, BOOL ok, DWORD *done, OVERLAPPED *ov)
+{
+    if (!ok && GetLastError() == ERROR_IO_PENDING) ok = GetOverlappedResult(h, ov, done, TRUE);
+    CloseHandle(ov->hEvent);
+    return ok;
+}
+
 int Serial::readData(char *buffer, unsigned int nbChar)
 {
     //Number of bytes we'll have read
     DWORD bytesRead;
+    OVERLAPPED ov = {0};
     //Number of bytes we'll really ask to read
     unsigned int toRead;
 
@@ -117,7 +164,8 @@ int Serial::readData(char *buffer, unsigned int nbChar)
         }
 
         //Try to read the require number of chars, and return the number of read bytes on success
-        if(ReadFile(this->hSerial, buffer, toRead, &bytesRead, NULL) && bytesRead != 0)
+        ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if(serialIO(this->hSerial, ReadFile(this->hSerial, buffer, toRead, &bytesRead, &ov), &bytesRead, &ov) && bytesRead != 0)
         {
             return bytesRead;
         }
@@ -132,9 +180,11 @@ int Serial::readData(char *buffer, unsigned int nbChar)
 bool Serial::writeData(char *buffer, unsigned int nbChar)
 {
     DWORD bytesSend;
+    OVERLAPPED ov = {0};
 
     //Try to write the buffer on the Serial port
-    if(!WriteFile(this->hSerial, (void *)buffer, nbChar, &bytesSend, 0))
+    ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if(!serialIO(this->hSerial, WriteFile(this->hSerial, (void *)buffer, nbChar, &bytesSend, &ov), &bytesSend, &ov))
     {
         //In case it don't work get comm error and return false
         ClearCommError(this->hSerial, &this->errors, &this->status);
@@ -228,6 +278,9 @@ int Serial::serialSetup(){
 	//We're not yet connected
     this->connected = false;
 	strcpy(this->buffer,"");
+	this->handshook = 0;
+
+    startupBegin(STARTUP_SERIAL);
 
     //Try to connect to the given port throuh CreateFile
     this->hSerial = CreateFile(this->portName,
@@ -235,7 +288,7 @@ int Serial::serialSetup(){
             0,
             NULL,
             OPEN_EXISTING,
-            FILE_ATTRIBUTE_NORMAL,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED,
             NULL);
 
     //Check if the connection was successfull
@@ -280,76 +333,163 @@ int Serial::serialSetup(){
              else
              {
                  //If everything went fine we're connected
-                 this->connected = true;
-                 //We wait 2s as the arduino board will be reseting
-                 Sleep(ARDUINO_WAIT_TIME);
+                 this->connected = this->setupEvents();
+                 //The arduino board is reseting, handshake() waits for it
+                 this->openedAt = GetTickCount();
              }
         }
     }
 
+	startupEnd();
+	return 1;
+}
+
+// Once the board is done resetting, checks that it answers: aliveTest, then
+// aliveAnswer, to which it sends 2. The bytes are written to the port
+// directly, as the frame may have set writeBehind meanwhile, and the names
+// looked up in the table handshakeAsync() compiled. Returns 1 when the board
+// answered.
+int Serial::handshake(){
+	SerialCommand *test, *answer;
+	DWORD elapsed = GetTickCount() - this->openedAt;
+	char frame[4];
+	int br = -1, tries = 0;
+
+	if( elapsed < ARDUINO_WAIT_TIME) Sleep(ARDUINO_WAIT_TIME - elapsed);
+
+	if( (test = this->findCommand("aliveTest")) == 0 || !this->writeData(&test->requestCode, 1)){
+		logWarn("\n Failure to send hardware aliveTest!! (%s)", this->portName);
+		return 0;
+	}
+	logInfo("\n ... Test byte correctly sent (%s)", this->portName);
+	if( (answer = this->findCommand("aliveAnswer")) == 0 || !this->writeData(&answer->requestCode, 1)){
+		logWarn("\n Failure to send hardware aliveAnswer!! (%s)", this->portName);
+		return 0;
+	}
+	Sleep(ARDUINO_ANSWER_TIME);
+	while( br != 3 && tries++ <= 10) br = this->readData(frame, 3);
+	if( br != 3){
+		logWarn("\n Alive read %d bytes (%s)", br, this->portName);
+		return 0;
+	}
+	frame[3] = '\0';
+	if( atoi(frame) != 2){
+		logWarn("\n Alive read failed (%s)", this->portName);
+		return 0;
+	}
+	logInfo("\n Alive read success (%s)", this->portName);
 	return 1;
 }
 
+void Serial::handshakeThread(void *data){
+	Serial *s = (Serial *)data;
+
+	arThreadRole(AR_THREAD_IO, NULL);
+	s->handshake();
+	InterlockedExchange(&s->handshook, 1);
+}
+
+// Starts handshake() on a thread of its own, the port being connected.
+int Serial::handshakeAsync(){
+
+	if( !this->isConnected()) return -1;
+	this->compileCommands();
+	if( _beginthread(handshakeThread, 0, this) == -1L){
+		printf("\n Failure to start handshake thread!! (%s)", this->portName);
+		InterlockedExchange(&this->handshook, 1);
+		return -1;
+	}
+	return 0;
+}
+
 void Serial::addCommand(SerialCommand* value){
-	list<SerialCommand*>::iterator it;
-	it = listCommand.begin();
 	listCommand.push_back(value);
+	numberIndex.add(value->requestNumber, value);
+	nameTable.clear();		// compiled again on the next findCommand()
 }
 
-SerialCommand* Serial::findCommand(char *valueMSG){
-	//printf("\n Searching for: %s", valueMSG);
+// FNV-1a, seeded.
+unsigned int Serial::nameHash(const char *name, unsigned int seed){
+	unsigned int h = 2166136261u ^ seed;
+
+	while( *name != '\0'){ h ^= (unsigned char)*name++; h *= 16777619u; }
+	return h;
+}
+
+// Looks for the seed, and the table twice the commands or larger, that puts
+// each name in a slot of its own, so that a name is found with one strcmp().
+// A name repeated is found as its first command, as it was when the list was
+// scanned.
+void Serial::compileCommands(){
 	list<SerialCommand*>::iterator it;
-	
+	unsigned int size, seed, h;
+	bool placed = false;
+
 	for( it = this->listCommand.begin(); it != this->listCommand.end(); it++)
-		if( strcmp((*(*it)).requestName,valueMSG) == 0){
-	//		printf("\n found: %s", (*(*it)).requestName );
-			return (*it);
+		(*it)->requestCode = (char)(*it)->requestNumber;	// Transform int to char
+
+	for( size = 2; size < 2 * this->listCommand.size(); size *= 2);
+	while( !placed ){
+		for( seed = 0; seed < 64 && !placed; seed++){
+			this->nameTable.assign(size, (SerialCommand*)0);
+			placed = true;
+			for( it = this->listCommand.begin(); it != this->listCommand.end() && placed; it++){
+				h = nameHash((*it)->requestName, seed) & (size - 1);
+				if( this->nameTable[h] == 0) this->nameTable[h] = (*it);
+				else if( strcmp(this->nameTable[h]->requestName, (*it)->requestName) != 0) placed = false;
+			}
+			this->nameSeed = seed;
 		}
-	
-	printf("\n *******Command not found");
+		if( !placed) size *= 2;
+	}
+}
+
+SerialCommand* Serial::findCommand(char *valueMSG){
+	SerialCommand *s;
+
+	if( this->nameTable.empty()) this->compileCommands();
+	s = this->nameTable[nameHash(valueMSG, this->nameSeed) & (this->nameTable.size() - 1)];
+	if( s != 0 && strcmp(s->requestName, valueMSG) == 0) return s;
+
+	logWarn("\n *******Command not found");
 	return 0;
 }
 
 SerialCommand* Serial::findCommand(int valueMSG){
-	//printf("\n Searching for: %s", valueMSG);
-	list<SerialCommand*>::iterator it;
-	
-	for( it = this->listCommand.begin(); it != this->listCommand.end(); it++)
-		if( (*it)->requestNumber == valueMSG){
-	//		printf("\n found: %s", (*(*it)).requestName );
-			return (*it);
-		}
-	
-	printf("\n *******Command not found");
-	return 0;
+	SerialCommand *s = this->numberIndex.find(valueMSG);
+
+	if( s == 0) logWarn("\n *******Command not found");
+	return s;
+}
+
+bool Serial::sendByte(char value){
+	if( this->writeBehind == 0) return this->writeData(&value, 1);
+	if( this->outLen == SERIAL_OUT_MAX) return false;
+	this->outBuf[this->outLen++] = value;
+	return true;
 }
 
 bool Serial::sendFromLookupTable(char *valueMSG){
 	
 	if ( this->isConnected()){
-		char toSend[1];
 		SerialCommand *s;
-		s = 0;
 		s = this->findCommand(valueMSG);
 		
 		if ( s != 0) {
 			// Command exists
-			sprintf(toSend,"%c",s->requestNumber);	// Transform int to char
-			
-			if(!this->writeData(toSend,1)){ 
-				printf("\n Failure to send!!"); 
+			if(!this->sendByte(s->requestCode)){ 
+				logWarn("\n Failure to send!!"); 
 			} else {
 				//Sent to hardware
-				printf("\n -----------> %s", valueMSG);
-				//printf("\n HEEEEEEEEEREEEEEEEEEEEEEEEEEE");
+				logInfo("\n -----------> %s", valueMSG);
 				return true;}
 		} else {
 			// Command doesn't exist
-			printf("\n This command doesn't exist");
+			logWarn("\n This command doesn't exist");
 			return false;} 
 	} else {
 		// Couldn't connect to it.
-		printf("\n Hardware isn't connected!");
+		logWarn("\n Hardware isn't connected!");
 		return false;}
 
 	return false;
@@ -360,32 +500,19 @@ bool Serial::sendNormInt(int value){
 	if ( value > 0 && value < 256 ) {
 
 		if ( this->isConnected()){
-			char toSend[1];
-			SerialCommand *s;
-			s = 0;
-
-			if ( s != 0) {
-				// Command exists
-				sprintf(toSend,"%c",value);	// Transform int to char
-
-				if(!this->writeData(toSend,1)){ 
-					printf("\n Failure to send!!"); 
-				} else {
-					//Sent to hardware
-					printf("\n -----------> %d", value);
-					//printf("\n HEEEEEEEEEREEEEEEEEEEEEEEEEEE");
-					return true;}
+			if(!this->sendByte((char)value)){	// Transform int to char
+				logWarn("\n Failure to send!!"); 
 			} else {
-				// Command doesn't exist
-				printf("\n This command doesn't exist");
-				return false;} 
+				//Sent to hardware
+				logInfo("\n -----------> %d", value);
+				return true;}
 		} else {
 			// Couldn't connect to it.
-			printf("\n Hardware isn't connected!");
+			logWarn("\n Hardware isn't connected!");
 			return false;}
 
 	} else {
-		printf("\n Value is out of range 0-255! ( value = %d )",value);
+		logWarn("\n Value is out of range 0-255! ( value = %d )",value);
 		return false;
 	}
 
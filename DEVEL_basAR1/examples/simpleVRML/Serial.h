@@ -2,13 +2,17 @@
 #define Serial_h
 
 #define ARDUINO_WAIT_TIME 2000
+#define ARDUINO_ANSWER_TIME 1000	// Milliseconds the board is given to answer aliveAnswer.
+#define SERIAL_OUT_MAX 64	// Bytes a port is sent in one write.
 
 #include <list>
+#include <vector>
 #include <Windows.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "SerialCommand.h"
+#include "IdIndex.h"
 
 // http://arduino.cc/playground/Interfacing/CPPWindows
 
@@ -23,6 +27,16 @@ private:
 	DWORD errors;		// Last Error
 
 	char getBuff(char *buf, int n, FILE *fp);
+	bool setupEvents();
+
+	// The commands by name, placed where nameHash() with nameSeed puts them
+	// with no two in a slot, and by number.
+	std::vector< SerialCommand* > nameTable;
+	unsigned int nameSeed;
+	IdIndex< SerialCommand > numberIndex;
+	static unsigned int nameHash(const char *name, unsigned int seed);
+	bool sendByte(char value);
+	static void handshakeThread(void *data);
 public:
 	int serialReadFile();
 	char configFilename[256];
@@ -32,15 +46,32 @@ public:
 	char portName[256];
 
 	void addCommand(SerialCommand* value);
+	void compileCommands();
 	std::list< SerialCommand* > listCommand;
 	SerialCommand* findCommand(char *valueMSG);
 	SerialCommand* findCommand(int valueMSG);
 	bool sendFromLookupTable(char *valueMSG); 
 	bool sendNormInt(int value);
 
+	// When writeBehind is set the bytes sent wait in outBuf until the serial
+	// thread takes them, so those of a frame go in one write.
+	int writeBehind;
+	char outBuf[SERIAL_OUT_MAX];
+	int outLen;
+
 	Serial();
 	Serial(char *portName); // Initialize serial with given COMM port
 	int serialSetup();
+
+	// The port is opened at once, the board is given ARDUINO_WAIT_TIME from
+	// openedAt to reset by handshake(), which handshakeAsync() runs on a
+	// thread of its own so that the boards come up together. handshook is
+	// set once it is done, answered or not; until then only that thread
+	// uses the port.
+	DWORD openedAt;
+	volatile LONG handshook;
+	int handshake();
+	int handshakeAsync();
 	~Serial(); // close the connection
 	//Read data in a buffer, if nbChar is greater than the
     //maximum number of bytes available, it will return only the
@@ -52,6 +83,8 @@ public:
 	bool writeData(char *buffer, unsigned int nbChar); 
     //Check if we are actually connected
     bool isConnected();
+	//The port, opened for overlapped I/O, for the serial thread
+	HANDLE getHandle();
 };
 
 
@@ -12,6 +12,7 @@ public:
 	int id;
 
 	int requestNumber;
+	char requestCode;		// requestNumber as the byte sent, see Serial::compileCommands()
 	char requestName[256];
 	int nextState;
 
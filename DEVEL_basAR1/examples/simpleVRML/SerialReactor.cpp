@@ -0,0 +1,370 @@
+#include "SerialReactor.h"
+
+#include <windows.h>
+#include <process.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <AR/ar.h>
+
+#include "iPoint.h"
+#include "Base.h"
+#include "Arpe.h"
+#include "Rules.h"
+#include "Serial.h"
+#include "SerialCommand.h"
+#include "Startup.h"
+
+#define SERIAL_LINK_MAX		MAXIMUM_WAIT_OBJECTS
+#define SERIAL_QUEUE_SIZE	256		// Power of two.
+
+// What each port waits the Arduino to answer to.
+enum { LINK_IDLE, LINK_INT, LINK_READ, LINK_CMD };
+
+struct SerialLink {
+	iPoint		*point;
+	HANDLE		hSerial;
+	OVERLAPPED	waitOv;			// WaitCommEvent(), only the thread uses these
+	OVERLAPPED	readOv;
+	OVERLAPPED	writeOv;
+	DWORD		mask;
+	char		frame[3];
+	int			have;
+	double		lastByte;
+	int			phase;			// the protocol, only serialReactorRun() uses these
+	double		sent;
+	double		nextPoll;
+	volatile LONG live;			// set by the thread once it waits on the port
+};
+
+struct SerialMessage {
+	int			link;
+	char		data[4];		// the 3 bytes and a '\0' for atoi()
+};
+
+struct SerialOutput {
+	int			link;
+	int			len;
+	char		data[SERIAL_OUT_MAX];
+};
+
+static SerialLink		links[SERIAL_LINK_MAX];
+static int				linkNum = 0;
+
+// The thread writes queueHead, serialReactorRun() queueTail, each reads the other's.
+static SerialMessage	queue[SERIAL_QUEUE_SIZE];
+static volatile LONG	queueHead = 0;
+static volatile LONG	queueTail = 0;
+static volatile LONG	queueDropped = 0;
+
+// The other way, serialReactorFlush() writes outHead and the thread outTail.
+static SerialOutput		out[SERIAL_QUEUE_SIZE];
+static volatile LONG	outHead = 0;
+static volatile LONG	outTail = 0;
+static HANDLE			outEvent = NULL;	// set when outHead is
+
+static void queuePost(int link, const char *frame)
+{
+	LONG head = queueHead;
+
+	if (head - queueTail == SERIAL_QUEUE_SIZE) { InterlockedIncrement(&queueDropped); return; }
+	queue[head & (SERIAL_QUEUE_SIZE - 1)].link = link;
+	memcpy(queue[head & (SERIAL_QUEUE_SIZE - 1)].data, frame, 3);
+	queue[head & (SERIAL_QUEUE_SIZE - 1)].data[3] = '\0';
+	InterlockedExchange(&queueHead, head + 1);		// the message is written before it is seen
+}
+
+static int queueTake(SerialMessage *m)
+{
+	LONG tail = queueTail;
+
+	if (tail == queueHead) return 0;
+	MemoryBarrier();
+	*m = queue[tail & (SERIAL_QUEUE_SIZE - 1)];
+	InterlockedExchange(&queueTail, tail + 1);
+	return 1;
+}
+
+// Writes what the frame loop has posted, each in one write.
+static void linkWrite(void)
+{
+	SerialOutput *o;
+	SerialLink *l;
+	DWORD n;
+	BOOL ok;
+
+	while (outTail != outHead) {
+		MemoryBarrier();
+		o = &out[outTail & (SERIAL_QUEUE_SIZE - 1)];
+		l = &links[o->link];
+		ok = WriteFile(l->hSerial, o->data, o->len, &n, &l->writeOv);
+		if (!ok && GetLastError() == ERROR_IO_PENDING) ok = GetOverlappedResult(l->hSerial, &l->writeOv, &n, TRUE);
+		if (!ok || n != (DWORD)o->len) printf("\n Failure to send!! (%s)", l->point->arduino->portName);
+		InterlockedExchange(&outTail, outTail + 1);
+	}
+}
+
+// Arms the wait for the next byte, 0 when it could not be.
+static int linkArm(SerialLink *l)
+{
+	if (WaitCommEvent(l->hSerial, &l->mask, &l->waitOv)) { SetEvent(l->waitOv.hEvent); return 1; }
+	return GetLastError() == ERROR_IO_PENDING;
+}
+
+// Frames what the port has received. The reads return at once with what there
+// is, as Serial sets the port up.
+static void linkRead(int i)
+{
+	SerialLink *l = &links[i];
+	char buf[64];
+	DWORD n, k;
+	double now;
+
+	for (;;) {
+		if (!ReadFile(l->hSerial, buf, sizeof(buf), &n, &l->readOv)) {
+			if (GetLastError() != ERROR_IO_PENDING || !GetOverlappedResult(l->hSerial, &l->readOv, &n, TRUE)) return;
+		}
+		if (n == 0) return;
+
+		now = Rules::now();
+		if (l->have > 0 && now - l->lastByte > SERIAL_FRAME_GAP) l->have = 0;
+		l->lastByte = now;
+		for (k = 0; k < n; k++) {
+			l->frame[l->have++] = buf[k];
+			if (l->have == 3) { queuePost(i, l->frame); l->have = 0; }
+		}
+	}
+}
+
+// Waits on the ports whose handshake is done and that aren't waited on yet.
+// Returns how many are still in their handshake.
+static int linkJoin(HANDLE events[], int which[], int *waitNum, int *joined)
+{
+	int i, pending = 0;
+
+	for (i = 0; i < linkNum; i++) {
+		if (joined[i]) continue;
+		if (!links[i].point->arduino->handshook) { pending++; continue; }
+		joined[i] = 1;
+		if (!linkArm(&links[i])) { printf("\n Failure to wait on serial %s", links[i].point->arduino->portName); continue; }
+		events[*waitNum] = links[i].waitOv.hEvent;
+		which[(*waitNum)++] = i;
+		InterlockedExchange(&links[i].live, 1);
+	}
+	return pending;
+}
+
+static void reactorThread(void *data)
+{
+	HANDLE events[SERIAL_LINK_MAX + 1];
+	int which[SERIAL_LINK_MAX + 1];		// the link of each event
+	int joined[SERIAL_LINK_MAX];
+	int waitNum = 1, pending;
+	DWORD ret, n;
+	int i, w;
+
+	arThreadRole(AR_THREAD_IO, "serial reactor");
+	events[0] = outEvent;
+	which[0] = -1;
+	memset(joined, 0, sizeof(joined));
+	pending = linkJoin(events, which, &waitNum, joined);
+
+	while (waitNum > 0) {
+		ret = WaitForMultipleObjects(waitNum, events, FALSE, pending > 0 ? SERIAL_LATE_POLL : INFINITE);
+		if (ret == WAIT_TIMEOUT) { pending = linkJoin(events, which, &waitNum, joined); continue; }
+		if (ret < WAIT_OBJECT_0 || ret >= WAIT_OBJECT_0 + waitNum) break;
+		w = ret - WAIT_OBJECT_0;
+		if (w == 0) { AR_TRACE_BEGIN("linkWrite"); linkWrite(); AR_TRACE_END(); continue; }
+		i = which[w];
+
+		AR_TRACE_BEGIN("linkRead");
+		if (GetOverlappedResult(links[i].hSerial, &links[i].waitOv, &n, FALSE)) linkRead(i);
+		AR_TRACE_END();
+		ResetEvent(events[w]);
+		if (!linkArm(&links[i])) {
+			// The port is left out from now on.
+			printf("\n Failure to wait on serial %s", links[i].point->arduino->portName);
+			waitNum--;
+			events[w] = events[waitNum];
+			which[w] = which[waitNum];
+		}
+	}
+	printf("\n Serial thread stopped!!");
+}
+
+int serialReactorAdd(iPoint *p)
+{
+	SerialLink *l;
+
+	if (p->arduino == 0 || !p->arduino->isConnected()) return -1;
+	if (linkNum == SERIAL_LINK_MAX) { printf("\n Max supported %d serial ports", SERIAL_LINK_MAX); return -1; }
+
+	l = &links[linkNum];
+	memset(l, 0, sizeof(*l));
+	l->point = p;
+	l->hSerial = p->arduino->getHandle();
+	l->waitOv.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	l->readOv.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	l->writeOv.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if (l->waitOv.hEvent == NULL || l->readOv.hEvent == NULL || l->writeOv.hEvent == NULL) { printf("\n Failure to create serial events"); return -1; }
+	l->phase = LINK_IDLE;
+	l->nextPoll = Rules::now() + SERIAL_POLL_TIME;
+	printf("\n Starting serial on COM %s", p->arduino->portName);
+	linkNum++;
+	return 0;
+}
+
+int serialReactorStart(void)
+{
+	DWORD start = GetTickCount();
+	int i, late = 0;
+
+	if (linkNum == 0) return 0;
+
+	startupBegin(STARTUP_SERIAL_WAIT);
+	for (i = 0; i < linkNum; i++) {
+		while (!links[i].point->arduino->handshook && GetTickCount() - start < SERIAL_SETUP_TIMEOUT) Sleep(10);
+		if (!links[i].point->arduino->handshook) late++;
+	}
+	startupEnd();
+	if (late > 0) printf("\n %d serial boards still coming up, they join when they answer", late);
+
+	if ((outEvent = CreateEvent(NULL, FALSE, FALSE, NULL)) == NULL
+		|| _beginthread(reactorThread, 0, NULL) == -1L) { printf("\n Failure to start serial thread!!"); return -1; }
+	for (i = 0; i < linkNum; i++) links[i].point->arduino->writeBehind = 1;
+	return 0;
+}
+
+static void errorSound(iPoint *p)
+{
+	if (p->myBase->errorSound != 0) p->myBase->errorSound->play2D();
+}
+
+static void setNextState(iPoint *p, int state)
+{
+	p->myBase->myArpe->myRules->nextState = state;
+}
+
+// The request of the port is answered, by data, or not in time when data is 0.
+static void linkAnswer(SerialLink *l, const char *data, double now)
+{
+	iPoint *p = l->point;
+	Serial *s = p->arduino;
+	SerialCommand *sc, *scTest;
+	int value = data != 0 ? atoi(data) : 0;
+
+	switch (l->phase) {
+	case LINK_INT:
+		// Interruption returns the number of the next state to be called
+		if (value > 0 && value < (int)p->myBase->myArpe->myRules->listState.size()) {
+			printf("NS: %d", value);
+			setNextState(p, value);
+		} else {
+			if (value != 0) printf("\n Asking by %d, it's a not valid state. Sorry!", value);
+		}
+
+		// Test if ERCV POOLING - readRequest
+		if (s->enableReceive == 1 && p->actualAction != 0) {
+			if (s->sendFromLookupTable("readRequest")) {
+				printf("\n ... Check Read");
+				l->phase = LINK_READ;
+				l->sent = now;
+				return;
+			}
+			printf("\n Failure to send read request!!");
+			errorSound(p);
+		}
+		break;
+
+	case LINK_READ:
+		// Interruption returns the lookup code to match with code asked
+		sc = data != 0 ? s->findCommand(value) : 0;
+		scTest = s->findCommand("readRequestAnswer");
+		if (sc != 0 && scTest != 0 && sc->requestNumber == scTest->requestNumber && p->actualAction != 0) {
+			//HARDWARE IS WAITING COMMAND TO BE READ
+			if (s->sendFromLookupTable(p->actualAction->eMsg)) {
+				printf("\n ... Requested command has been sent!");
+				l->phase = LINK_CMD;
+				l->sent = now;
+				return;
+			}
+		}
+		errorSound(p);
+		break;
+
+	case LINK_CMD:
+		//VERIFIES IF command exists
+		sc = data != 0 ? s->findCommand(value) : 0;
+		scTest = p->actualAction != 0 ? s->findCommand(p->actualAction->eMsg) : 0;
+		if (sc != 0 && scTest != 0 && sc->requestNumber == scTest->requestNumber) {
+			//HARDWARE SENT THE ASKED COMMAND
+			setNextState(p, sc->nextState);
+			p->myBase->myArpe->playActionAudio(p);
+		} else {
+			errorSound(p);
+		}
+		break;
+
+	default:
+		return;		// Nothing was asked, what came is stale.
+	}
+
+	l->phase = LINK_IDLE;
+	l->nextPoll = now + SERIAL_POLL_TIME;
+}
+
+void serialReactorRun(void)
+{
+	SerialMessage m;
+	double now = Rules::now();
+	LONG dropped;
+	int i;
+	AR_TRACE_SCOPE("serialReactorRun");
+
+	while (queueTake(&m)) linkAnswer(&links[m.link], m.data, now);
+	if ((dropped = InterlockedExchange(&queueDropped, 0)) != 0) printf("\n %ld serial messages dropped", dropped);
+
+	for (i = 0; i < linkNum; i++) {
+		SerialLink *l = &links[i];
+
+		if (!l->live) continue;
+		if (l->phase != LINK_IDLE) {
+			if (now - l->sent > SERIAL_ANSWER_TIME) linkAnswer(l, 0, now);
+		} else if (now >= l->nextPoll) {
+			// interrupt testing - intRequest
+			if (l->point->arduino->sendFromLookupTable("intRequest")) {
+				l->phase = LINK_INT;
+				l->sent = now;
+			} else {
+				printf("\n Failure to send hardware int request!!");
+				l->nextPoll = now + SERIAL_POLL_TIME;
+			}
+		}
+	}
+}
+
+void serialReactorFlush(void)
+{
+	Serial *s;
+	SerialOutput *o;
+	LONG head = outHead;
+	int i;
+
+	for (i = 0; i < linkNum; i++) {
+		s = links[i].point->arduino;
+		if (s->outLen == 0) continue;
+		if (!links[i].live) { s->outLen = 0; continue; }	// in its handshake, a board resetting takes nothing
+		if (head - outTail == SERIAL_QUEUE_SIZE) break;		// sent on a later frame
+		o = &out[head & (SERIAL_QUEUE_SIZE - 1)];
+		o->link = i;
+		o->len = s->outLen;
+		memcpy(o->data, s->outBuf, s->outLen);
+		s->outLen = 0;
+		head++;
+	}
+	if (head != outHead) {
+		InterlockedExchange(&outHead, head);
+		SetEvent(outEvent);
+	}
+}
@@ -0,0 +1,37 @@
+#ifndef SerialReactor_h
+#define SerialReactor_h
+
+// The serial ports of the external iPoints, served by one thread.
+//
+// serialReactorAdd() takes each iPoint whose Arduino is connected, once it is
+// read, and serialReactorStart() starts the thread. The boards reset and
+// answer the handshake of their Serial meanwhile, all at once; the start
+// waits SERIAL_SETUP_TIMEOUT at most for them, and a board still not done
+// then is joined by the thread when it is, the frame sending it nothing
+// until then. It waits for the bytes of
+// all ports at once (overlapped WaitCommEvent), puts them together in the
+// 3 byte messages the Arduinos answer with and posts these to a queue with no
+// lock, having one writer and one reader. serialReactorRun(), called from the
+// frame loop before the parser, takes them and does what the polling thread
+// of each iPoint did: asks for the interruption and, when ercv enabled it,
+// for the command the rule waits for, once every SERIAL_POLL_TIME.
+//
+// Once the thread runs, what the frame sends to a port waits in its Serial
+// and serialReactorFlush(), called when the rules of the frame are done,
+// posts it to the thread in a second queue, so that each port has one write
+// a frame and WriteFile() is not called by the frame loop.
+
+#define SERIAL_POLL_TIME	1.0		// Seconds between the requests to each Arduino.
+#define SERIAL_ANSWER_TIME	1.0		// Seconds an answer is waited for.
+#define SERIAL_FRAME_GAP	0.1		// Seconds after which a message left incomplete is dropped.
+#define SERIAL_SETUP_TIMEOUT	4000	// Milliseconds serialReactorStart() waits for the handshakes.
+#define SERIAL_LATE_POLL	100		// Milliseconds between the looks of the thread for late boards.
+
+class iPoint;
+
+int		serialReactorAdd(iPoint *p);
+int		serialReactorStart(void);
+void	serialReactorRun(void);
+void	serialReactorFlush(void);
+
+#endif // SerialReactor_h
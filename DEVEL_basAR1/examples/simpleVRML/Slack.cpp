@@ -0,0 +1,74 @@
+#include <AR/ar.h>
+
+#include "Slack.h"
+
+struct SlackEntry {
+	SlackTask	task;
+	void		*arg;
+	double		posted;
+};
+
+struct SlackKind {
+	SlackTask	task;
+	double		cost;			// Smoothed seconds, 0 until run once.
+};
+
+static SlackEntry	queue[SLACK_TASKS];
+static unsigned int	head = 0;		// Next entry to run.
+static unsigned int	tail = 0;		// Next entry to fill.
+static SlackKind	kinds[SLACK_KINDS];
+static int			kindCount = 0;
+
+static SlackKind *kindOf(SlackTask task)
+{
+	int i;
+
+	for (i = 0; i < kindCount; i++) if (kinds[i].task == task) return &kinds[i];
+	if (kindCount == SLACK_KINDS) return 0;
+	kinds[kindCount].task = task;
+	kinds[kindCount].cost = 0.0;
+	return &kinds[kindCount++];
+}
+
+int slackPost(SlackTask task, void *arg)
+{
+	unsigned int i;
+
+	for (i = head; i != tail; i++)
+		if (queue[i & (SLACK_TASKS - 1)].task == task && queue[i & (SLACK_TASKS - 1)].arg == arg) return 0;
+	if (tail - head == SLACK_TASKS) return -1;
+	queue[tail & (SLACK_TASKS - 1)].task = task;
+	queue[tail & (SLACK_TASKS - 1)].arg = arg;
+	queue[tail & (SLACK_TASKS - 1)].posted = arUtilClock();
+	tail++;
+	return 0;
+}
+
+double slackRun(double budget)
+{
+	double start, now, t;
+	SlackEntry e;
+	SlackKind *k;
+
+	if (head == tail) return 0.0;
+	start = now = arUtilClock();
+	while (head != tail) {
+		e = queue[head & (SLACK_TASKS - 1)];
+		k = kindOf(e.task);
+		// Run in order: a task that does not fit holds those after it.
+		if (now - e.posted < SLACK_STARVE
+			&& (budget - (now - start) < SLACK_MARGIN
+				|| (k != 0 && now + k->cost > start + budget - SLACK_MARGIN))) break;
+		head++;
+		e.task(e.arg);
+		t = arUtilClock();
+		if (k != 0) k->cost = (k->cost == 0.0) ? t - now : k->cost + (t - now - k->cost) * 0.1;
+		now = t;
+	}
+	return now - start;
+}
+
+void slackClear(void)
+{
+	head = tail;
+}
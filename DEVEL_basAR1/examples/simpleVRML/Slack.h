@@ -0,0 +1,31 @@
+#ifndef Slack_h
+#define Slack_h
+
+// Work that need not be done in the frame that asks for it, done in the
+// time the frame pacer leaves before the next frame begins.
+//
+// Idle() returns at once while arglFramePacerWait() says it is too early to
+// begin the frame, so that the frame takes the newest detection. The GLUT
+// thread posts such work with slackPost() and slackRun() gives it that wait:
+// the tasks are run in the order they were posted, each only while the time
+// it took the last times, smoothed, still fits before the frame; one that
+// does not fit waits for the next gap. A task waiting SLACK_STARVE seconds
+// runs at the next call whatever the time left, so that a machine too slow
+// to leave any still gets it done.
+
+#define SLACK_TASKS		64			// Queued at most, a power of 2.
+#define SLACK_MARGIN	0.001		// Seconds kept free before the frame.
+#define SLACK_STARVE	0.25		// Seconds a task waits at most.
+#define SLACK_KINDS		16			// Tasks whose cost is followed.
+
+typedef void (*SlackTask)(void *arg);
+
+// The GLUT thread only. A task already queued with the same arg is not
+// queued again. 0, or -1 when the queue is full and the task is dropped.
+int		slackPost(SlackTask task, void *arg);
+// Runs the tasks that fit in budget seconds from now; the seconds it took.
+double	slackRun(double budget);
+// Drops what is queued, at exit.
+void	slackClear(void);
+
+#endif // Slack_h
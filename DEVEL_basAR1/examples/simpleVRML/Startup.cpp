@@ -0,0 +1,78 @@
+#include "Startup.h"
+
+#include <AR/config.h>
+#include <AR/ar.h>
+#include <AR/arvrml.h>
+#include <stdio.h>
+
+static const char *phaseName[STARTUP_PHASES] = {
+	"config", "camera", "pattern", "vrml", "vrml wait", "vrml draw", "sound", "serial", "serial wait"
+};
+
+static double	phaseTime[STARTUP_PHASES];		// Seconds, without the phases within.
+static long		phaseCount[STARTUP_PHASES];
+
+static int		openPhase[STARTUP_DEPTH];
+static double	openBegin[STARTUP_DEPTH];
+static double	openInner[STARTUP_DEPTH];		// Seconds of the phases within.
+static int		depth = 0;
+static double	origin = -1.0;
+static int		done = 0;
+
+void startupBegin(int phase)
+{
+	AR_TRACE_BEGIN(phaseName[phase]);
+	if (done || depth == STARTUP_DEPTH) { depth++; return; }
+
+	openPhase[depth] = phase;
+	openBegin[depth] = arUtilClock();
+	openInner[depth] = 0.0;
+	if (origin < 0.0) origin = openBegin[depth];
+	depth++;
+}
+
+void startupEnd(void)
+{
+	double t;
+
+	AR_TRACE_END();
+	if (depth == 0) return;
+	depth--;
+	if (done || depth >= STARTUP_DEPTH) return;
+
+	t = arUtilClock() - openBegin[depth];
+	phaseTime[openPhase[depth]] += t - openInner[depth];
+	phaseCount[openPhase[depth]]++;
+	if (depth > 0) openInner[depth - 1] += t;
+}
+
+void startupReport(void)
+{
+	ARVrmlLoadStats vrml;
+	double total, sum = 0.0;
+	int i;
+
+	if (done || origin < 0.0) return;
+	done = 1;
+	total = arUtilClock() - origin;
+
+	printf("\n --------------------------------------------------------------------------");
+	printf("\n Startup (ms)     count      time      %%");
+	for (i = 0; i < STARTUP_PHASES; i++) {
+		sum += phaseTime[i];
+		if (phaseCount[i] == 0) continue;
+		printf("\n   %-12s %8ld %9.1f %6.1f", phaseName[i], phaseCount[i], phaseTime[i] * 1000.0, phaseTime[i] * 100.0 / total);
+	}
+	printf("\n   %-12s %8s %9.1f %6.1f", "other", "", (total - sum) * 1000.0, (total - sum) * 100.0 / total);
+	printf("\n   %-12s %8s %9.1f", "total", "", total * 1000.0);
+
+	// Parsed on the loader thread, alongside the phases above.
+	if (arVrmlGetLoadStats(&vrml) == 0 && vrml.scenes > 0) {
+		printf("\n VRML scenes %ld: parse %.1f ms, viewers %.1f ms, first draw %.1f ms",
+			vrml.scenes, vrml.parse, vrml.build, vrml.draw);
+	}
+	printf("\n --------------------------------------------------------------------------");
+
+	if (arTraceMode == AR_TRACE_ON && arTraceDump(STARTUP_TRACE_FILE) == 0)
+		printf("\n Trace of the startup written to %s", STARTUP_TRACE_FILE);
+}
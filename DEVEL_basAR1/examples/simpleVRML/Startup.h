@@ -0,0 +1,34 @@
+#ifndef Startup_h
+#define Startup_h
+
+// Time the startup of the projects took, by phase, printed by startupReport()
+// once they are all set up.
+//
+// startupBegin() and startupEnd() pair around a phase, on the GLUT thread
+// only, and nest: a phase is given the time outside the phases within it, so
+// that the lines of the report add up to the whole. Each phase is a span of
+// the trace of -trace too, which startupReport() dumps to STARTUP_TRACE_FILE.
+// The VRML scenes are parsed on the loader thread meanwhile, their figures
+// come from arVrmlGetLoadStats().
+
+#define STARTUP_DEPTH		16
+#define STARTUP_TRACE_FILE	"startup.json"
+
+enum {
+	STARTUP_CONFIG,					// The configuration files and the bundle.
+	STARTUP_CAMERA,					// Video, camera parameters and the window.
+	STARTUP_PATTERN,				// arLoadMarker().
+	STARTUP_VRML,					// Queueing the scenes, parsing those loaded at once.
+	STARTUP_VRML_WAIT,				// Until the loader thread has parsed them all.
+	STARTUP_VRML_DRAW,				// The first draw of the objects.
+	STARTUP_SOUND,					// The engine and the sources of the sounds.
+	STARTUP_SERIAL,					// Opening the serial ports.
+	STARTUP_SERIAL_WAIT,			// The handshakes of the boards, all at once, SERIAL_SETUP_TIMEOUT at most.
+	STARTUP_PHASES
+};
+
+void	startupBegin(int phase);
+void	startupEnd(void);
+void	startupReport(void);
+
+#endif // Startup_h
@@ -3,12 +3,14 @@
 
 #include <time.h>
 #include <list>
+#include <vector>
 
 #include "Action.h"
+#include "ArpeAlloc.h"
 
 class Rules;
 
-class State {
+class State : public ArpeAlloc {
 
  public:
 
@@ -29,6 +31,9 @@ class State {
 
 	std::list< Action* > listAction;
 	Rules *myRules;
+
+	// Of the markers of the bases its actions name, by Rules::compileRules().
+	std::vector<int> patterns;
 };
 
 #endif // State_h
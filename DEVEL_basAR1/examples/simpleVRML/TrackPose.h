@@ -0,0 +1,26 @@
+#ifndef TrackPose_h
+#define TrackPose_h
+
+// The pose and visibility of an actuator or a base, as the last frame left
+// them.
+//
+// Arpe keeps those of its marker actuators and of its bases in two arrays,
+// in the order of listActuator and listBase, see Arpe::indexTracks(). The
+// passes that look at all of them every frame, the proximity of
+// Arpe::interactionControl() and the drawing of Display(), walk the arrays
+// rather than the lists and the objects they point to. ActuatorARTKSM and
+// InfraStructure write their entry as they are given a pose. The marker
+// search of the frame has its own array, the TrackTarget of simpleVRML.cpp.
+//
+// An entry is two cache lines, and the arrays start on one: what the passes
+// read of an actuator is in those two lines, not spread among its names,
+// file names and models.
+
+struct TrackPose {
+	double	trans[3][4];	// interactionTrans of an actuator, baseTrans of a base.
+	double	point[3];		// Interaction point of an actuator from its marker, 0 for a base.
+	int		visible;
+	int		id;				// Of the actuator or the base.
+};
+
+#endif // TrackPose_h
@@ -2,6 +2,8 @@
 #include "Arpe.h"
 #include "uIdent.h"
 
+#include <stdlib.h>
+
 
 #include <list>
 using namespace std;
@@ -13,11 +15,16 @@ User::User(void)
 
 User::~User(void)
 {
+	this->eventLog.close();
+}
+
+void User::logEvent(int operationID, int baseID, int iPointID){
+	this->eventLog.append(operationID, baseID, iPointID);
 }
 
 int User::userReadFile(){
 		
-	FILE          *fp;
+	CfgFile          *fp;
 	char           buf[256],buf1[256],buf2[256];
 	int			   aux, retScan;
 
@@ -33,13 +40,13 @@ int User::userReadFile(){
 		return  0;
 	}
 
-	if( (fp=fopen(this->filename,"r")) == NULL) { printf("\n Error on opening %s user file!! ",this->filename);	return -1;}
+	if( (fp=cfgOpen(this->filename)) == NULL) { printf("\n Error on opening %s user file!! ",this->filename);	return -1;}
 
 	//--------------------------------------------------------------------------
 	// Read the user identification
 	//--------------------------------------------------------------------------
 	getBuff(buf,256,fp);
-	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->filename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->filename); cfgClose(fp); return -1; }
 	this->ident = new uIdent();
 	if ( strcmp(buf1,"ANONYMOUS") == 0) {
 		printf("\n No ID is used to this user, assuming generic user Anonymous");
@@ -53,9 +60,9 @@ int User::userReadFile(){
 	// Read the Log File
 	//--------------------------------------------------------------------------
 	getBuff(buf,256,fp);
-	if (sscanf(buf, "%s", &this->uLogFilename) != 1) { printf("\n Check %s file format", this->filename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s", &this->uLogFilename) != 1) { printf("\n Check %s file format", this->filename); cfgClose(fp); return -1; }
 
-	if( strcmp(this->uLogFilename,"NO_LOG")) {
+	if( strcmp(this->uLogFilename,"NO_LOG") == 0) {
 		// NO LOG IS DEFINED
 		this->uLogList.clear();
 		strcpy(this->uLogFilename,"");
@@ -83,13 +90,14 @@ int User::userReadFile(){
 				break;}
 		default: break;
 		}
+		this->eventLog.open(this->uLogFilename, this->uLogIncremental, this->uLogRefreshSize, atof(this->ident->basARID));
 	}
 
 	//--------------------------------------------------------------------------
 	// Read the Static parameters
 	//--------------------------------------------------------------------------
 	getBuff(buf,256,fp);
-	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->filename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->filename); cfgClose(fp); return -1; }
 
 	if (strcmp(buf1,"NO_STATIC") == 0) {
 		strcpy(this->uStaticFilename,"");
@@ -105,7 +113,7 @@ int User::userReadFile(){
 	// Read the Profile parameters
 	//--------------------------------------------------------------------------
 	getBuff(buf,256,fp);
-	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->filename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->filename); cfgClose(fp); return -1; }
 
 	if (strcmp(buf1,"NO_PROFILE") == 0) {
 		strcpy(this->uProfileFilename,"");
@@ -122,7 +130,7 @@ int User::userReadFile(){
 	// Read Adaptation
 	//--------------------------------------------------------------------------
 	getBuff(buf,256,fp);
-	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->filename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->filename); cfgClose(fp); return -1; }
 
 	if( strcmp(buf1,"NO_ADAPTATION") == 0) {
 		this->myAdapt = 0;
@@ -131,7 +139,7 @@ int User::userReadFile(){
 
 		// READ SAD - Structure Adaptation Definitions
 
-		if (sscanf(buf, "&s &s", &buf1, &this->adaptFilename) != 2) { printf("\n Check %s file format", this->filename); fclose(fp); return -1; }
+		if (sscanf(buf, "%s %s", &buf1, &this->adaptFilename) != 2) { printf("\n Check %s file format", this->filename); cfgClose(fp); return -1; }
 		
 		if ( strcmp(buf1,"ONLY_LOAD") == 0 ) {
 			printf(" Will only load the file: %s",this->adaptFilename);
@@ -148,7 +156,7 @@ int User::userReadFile(){
 		// READ number of ATs
 
 		getBuff(buf,256,fp);
-		if (sscanf(buf, "%d", &aux) != 1) { printf("\n Check %s file format", this->filename); fclose(fp); return -1; }
+		if (sscanf(buf, "%d", &aux) != 1) { printf("\n Check %s file format", this->filename); cfgClose(fp); return -1; }
 
 
 
@@ -166,18 +174,18 @@ int User::userReadFile(){
 
 
 
-	fclose(fp);
+	cfgClose(fp);
 	return 1;
 }
 
 
 
-char User::getBuff(char *buf, int n, FILE *fp)
+char User::getBuff(char *buf, int n, CfgFile *fp)
 {
     char *ret;
 	
     for(;;) {
-        ret = fgets(buf, n, fp);
+        ret = cfgGets(buf, n, fp);
         if (ret == NULL) return(NULL);
         if (buf[0] != '\n' && buf[0] != '#') return(1); // Skip blank lines and comments.
     }
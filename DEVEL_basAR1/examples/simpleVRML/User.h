@@ -3,6 +3,9 @@
 
 #include <list>
 
+#include "ConfigBundle.h"
+#include "UserLog.h"
+
 class Arpe;
 class uLog;
 class uProfileParam;
@@ -19,7 +22,7 @@ public:
 	char filename[256];
 	
 	//Setup functions
-	char		getBuff(char *buf, int n, FILE *fp);
+	char		getBuff(char *buf, int n, CfgFile *fp);
 	int			userReadFile();
 
 	
@@ -41,6 +44,8 @@ public:
 	std::list< uLog* > uLogList;  //ADJUSTABLE SAVING DELTA
 	void		addLog( uLog* value);
 	uLog*		findULog(int valueID);
+	UserLog		eventLog;		// written as uLogFilename says, see UserLog.h
+	void		logEvent(int operationID, int baseID, int iPointID);
 
 	// STATIC PARAMETERS
 	std::list< uStaticParam* > uStaticList;
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <io.h>
+#include <process.h>
+
+#include <AR/ar.h>
+
+#include "UserLog.h"
+
+UserLog::UserLog()
+{
+	fp = 0;
+	wakeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	writerHandle = 0;
+	running = false;
+	refreshSize = 1;
+	start = 0;
+	lastHandoff = 0;
+	seq = 0;
+	dropped = 0;
+	front = 0;
+	fill = 0;
+	back = 1;
+	backLen = 0;
+}
+
+UserLog::~UserLog()
+{
+	close();
+	CloseHandle(wakeEvent);
+}
+
+int UserLog::open(const char *filename, bool incremental, int refreshSize, double userID)
+{
+	UserLogHeader h;
+
+	close();
+	if ((fp = fopen(filename, incremental ? "ab" : "wb")) == NULL) {
+		printf("\n Error on opening %s log file!! ", filename);
+		return -1;
+	}
+
+	// An incremental log only has its header once.
+	fseek(fp, 0, SEEK_END);
+	if (ftell(fp) == 0) {
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, USER_LOG_MAGIC, sizeof(h.magic));
+		h.version = USER_LOG_VERSION;
+		h.recordSize = sizeof(UserLogRecord);
+		h.userID = userID;
+		h.start = (__int64)time(NULL);
+		fwrite(&h, sizeof(h), 1, fp);
+	}
+
+	this->refreshSize = refreshSize < 1 ? 1 : (refreshSize > USER_LOG_RECORDS ? USER_LOG_RECORDS : refreshSize);
+	start = lastHandoff = GetTickCount();
+	seq = 0;
+	dropped = 0;
+	front = 0;
+	fill = 0;
+	back = 1;
+	backLen = 0;
+
+	running = true;
+	writerHandle = (HANDLE)_beginthreadex(NULL, 0, writerThread, this, 0, NULL);
+	if (writerHandle == 0) {
+		printf("\n UserLog: unable to start thread");
+		running = false;
+		fclose(fp);
+		fp = 0;
+		return -1;
+	}
+	printf("\n Logging to %s", filename);
+	return 0;
+}
+
+// Stops the writer, then writes what it was not given.
+void UserLog::close()
+{
+	if (fp == 0) return;
+
+	running = false;
+	SetEvent(wakeEvent);
+	if (writerHandle) {
+		WaitForSingleObject(writerHandle, INFINITE);
+		CloseHandle(writerHandle);
+		writerHandle = 0;
+	}
+	if (fill > 0) fwrite(buffer[front], sizeof(UserLogRecord), fill, fp);
+	fill = 0;
+	if (dropped > 0) printf("\n UserLog: %ld events dropped", dropped);
+	fclose(fp);
+	fp = 0;
+}
+
+// Gives the front buffer to the writer, 0 when it still has the other one.
+int UserLog::handoff()
+{
+	if (backLen != 0) return 0;
+
+	back = front;
+	front = 1 - front;
+	InterlockedExchange(&backLen, fill);	// back is set before the writer sees it
+	fill = 0;
+	lastHandoff = GetTickCount();
+	SetEvent(wakeEvent);
+	return 1;
+}
+
+void UserLog::append(int operationID, int baseID, int iPointID)
+{
+	UserLogRecord *r;
+	DWORD now;
+
+	if (fp == 0) return;
+	if (fill == USER_LOG_RECORDS && !handoff()) { dropped++; seq++; return; }
+
+	now = GetTickCount();
+	r = &buffer[front][fill++];
+	r->seq = seq++;
+	r->time = now - start;
+	r->operationID = (unsigned short)operationID;
+	r->baseID = (unsigned short)baseID;
+	r->iPointID = (unsigned short)iPointID;
+	r->reserved = 0;
+
+	if (fill >= refreshSize || now - lastHandoff >= USER_LOG_SYNC) handoff();
+}
+
+unsigned __stdcall UserLog::writerThread(void *data)
+{
+	static_cast<UserLog *>(data)->writerLoop();
+	return 0;
+}
+
+void UserLog::writerLoop()
+{
+	DWORD lastSync = GetTickCount();
+	LONG n;
+
+	arThreadRole(AR_THREAD_BACKGROUND, "user log");
+	while (running) {
+		WaitForSingleObject(wakeEvent, USER_LOG_SYNC);
+
+		if ((n = backLen) != 0) {
+			MemoryBarrier();
+			if (fwrite(buffer[back], sizeof(UserLogRecord), n, fp) != (size_t)n) printf("\n UserLog: write failed");
+			InterlockedExchange(&backLen, 0);
+		}
+		if (GetTickCount() - lastSync >= USER_LOG_SYNC) {
+			fflush(fp);
+			_commit(_fileno(fp));
+			lastSync = GetTickCount();
+		}
+	}
+
+	// A buffer handed over just before close().
+	if ((n = backLen) != 0) {
+		MemoryBarrier();
+		fwrite(buffer[back], sizeof(UserLogRecord), n, fp);
+		InterlockedExchange(&backLen, 0);
+	}
+	fflush(fp);
+	_commit(_fileno(fp));
+	arThreadRoleEnd();
+}
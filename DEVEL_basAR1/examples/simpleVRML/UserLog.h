@@ -0,0 +1,76 @@
+#ifndef UserLog_h
+#define UserLog_h
+
+#include <Windows.h>
+#include <stdio.h>
+
+// The event log of a user session, written by a thread of its own.
+//
+// append() only fills the front buffer; when it holds the refresh size of
+// the user file, or USER_LOG_SYNC has gone by, it is handed to the writer
+// thread and the other one is filled. A frame never waits on the file: if
+// the writer still has the other buffer when the front one is full, the
+// events are dropped and counted. The writer flushes the file to disk every
+// USER_LOG_SYNC.
+//
+// The file is a UserLogHeader followed by one UserLogRecord per event, in
+// the byte order of the machine. An incremental log is appended to, with the
+// header only written when the file is new.
+
+#define USER_LOG_MAGIC		"BASARLOG"
+#define USER_LOG_VERSION	1
+#define USER_LOG_RECORDS	4096	// Records in each buffer.
+#define USER_LOG_SYNC		2000	// Milliseconds between the flushes to disk.
+
+struct UserLogHeader {
+	char			magic[8];
+	int				version;
+	int				recordSize;		// sizeof(UserLogRecord)
+	double			userID;
+	__int64			start;			// time() when the log was opened
+};
+
+struct UserLogRecord {
+	unsigned int	seq;
+	unsigned int	time;			// Milliseconds since the log was opened.
+	unsigned short	operationID;
+	unsigned short	baseID;
+	unsigned short	iPointID;
+	unsigned short	reserved;
+};
+
+class UserLog
+{
+public:
+	UserLog();
+	~UserLog();
+
+	int open(const char *filename, bool incremental, int refreshSize, double userID);
+	void close();
+
+	// GLUT thread: records an event, never waits.
+	void append(int operationID, int baseID, int iPointID);
+
+private:
+	FILE				*fp;
+	HANDLE				wakeEvent;
+	HANDLE				writerHandle;
+	volatile bool		running;
+	int					refreshSize;
+	DWORD				start;			// GetTickCount() when opened
+	DWORD				lastHandoff;
+	unsigned int		seq;
+	long				dropped;
+
+	UserLogRecord		buffer[2][USER_LOG_RECORDS];
+	int					front;			// The buffer append() fills,
+	int					fill;			// with so many records.
+	int					back;			// The buffer the writer has,
+	volatile LONG		backLen;		// with so many records; 0 when it is done.
+
+	static unsigned __stdcall writerThread(void *data);
+	void writerLoop();
+	int handoff();
+};
+
+#endif // UserLog_h
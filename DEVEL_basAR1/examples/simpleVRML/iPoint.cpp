@@ -24,14 +24,11 @@
 #include "Serial.h"
 #include "SerialCommand.h"
 #include "ipDist.h"
+#include "BlendQueue.h"
 
 #include <list>
 using namespace std;
 
-void callReadThread(void *data){ 
-	iPoint *p = static_cast<iPoint *>(data);
-	p->poolingThread(); }
-
 void iPoint::addObject(ipObject* value){
 	list<ipObject*>::iterator it;
 	it = this->listObject.begin();
@@ -51,222 +48,88 @@ ipObject*  iPoint::findObject(int valueID){
 
 }
 
-void iPoint::showBall(){
-	if( this->type == 1){
-		double mat[3][4], m[16];
+// The VRML model of an item, or 0 when it has another kind of model.
+static iVrml* vrmlModel(iObject3D* item){
+	if( item == 0 || item->modelType != 1) return 0;
+	return static_cast<iVrml*>(item);
+}
 
-		glMatrixMode(GL_MODELVIEW);
-		glPushMatrix();
-		glMatrixMode(GL_MODELVIEW);
-		glLoadIdentity();
-		arUtilMatMul((*(*this->myBase).myInfraStructure).baseTrans, this->position.trans, mat);
-		arglCameraViewRH(mat,m,1);
-		glLoadMatrixd(m);
-		//glTranslated(this->position.actualTra[0],this->position.actualTra[1],this->position.actualTra[2]);
-		//printf("\n TRANS: (%3.2f,%3.2f,%3.2f)",this->position.actualTra[0],this->position.actualTra[1],this->position.actualTra[2]);
-		
-		switch( this->viewMode ){
-		case 0:{	// 0 = HIDE			- hide point and object
-			break;}
-		case 1:{	// 1 = ONLY_BALL	- shows only point
-			if( this->ball.holding != 0) {
-				switch((*this->ball.holding).modelType){
-				case 1: { // VRML
-					iVrml* model = static_cast<iVrml*>(this->ball.holding);
-					//	printf("\n Base name: %s Ipoint %d VRML TO PRINT: %d", (*this->myBase).name, this->id, (*model).vrmlID);
-					(*model).draw();
-					break;}
-				case 2: { // Assimp
-					break;}
-				default: break; }
-			} else {
-				switch( this->myBase->myArpe->myGenericItens.holding->modelType){
-				case 1: { // VRML
-					iVrml* model = static_cast<iVrml*>(this->myBase->myArpe->myGenericItens.holding);
-					(*model).draw();
-					break;}
-				case 2: { // Assimp
-					break;}
-				default: break;}
+// A model with blended shapes is left to blendQueueDraw(), under base times m.
+static int drawModel(iVrml* model, const double base[16], const double m[16]){
+	if( arVrmlIsBlended((*model).vrmlID) == 1){
+		blendQueueAdd(model, base, m);
+		return AR_VRML_LOADED;
+	}
+	return (*model).draw();
+}
 
+iVrml* iPoint::ballModel(){
+	GenericItens* generic = &this->myBase->myArpe->myGenericItens;
+
+	if( this->type != 1) return 0;
+
+	switch( this->viewMode ){
+	case 0:		// 0 = HIDE			- hide point and object
+	case 2:		// 2 = ONLY_OBJECT		- shows only enabled objects
+	case 5:		// 5 = GHOST		- show a ghost object 
+		return 0;
+	case 1:		// 1 = ONLY_BALL	- shows only point
+	case 3:		// 3 = BOTH			- shows enabled objects and point
+	case 7:		// 7 = ALL_OBJECTS  - shows all objects at once	
+		return vrmlModel( this->ball.holding != 0 ? this->ball.holding : generic->holding);
+	case 4:{	// 4 = FLASHING		- shows a flashing poing
+		iVrml* model = 0;
+		if( this->ball.flashingTime < 5){
+			model = vrmlModel( this->ball.holding != 0 ? this->ball.holding : generic->holding);
+		} else {
+			if( this->ball.flashingTime > 10 ){ 
+				this->ball.flashingTime = 0;
 			}
-			break;}
-		case 2:{	// 2 = ONLY_OBJECT		- shows only enabled objects
-			break;}
-		case 3:{	// 3 = BOTH			- shows enabled objects and point
-			if( this->ball.holding != 0) {
-				switch((*this->ball.holding).modelType){
-				case 1: { // VRML
-					iVrml* model = static_cast<iVrml*>(this->ball.holding);
-					//	printf("\n Base name: %s Ipoint %d VRML TO PRINT: %d", (*this->myBase).name, this->id, (*model).vrmlID);
-					(*model).draw();
-					break;}
-				case 2: { // Assimp
-					break;}
-				default: break; }
-			} else {
-				switch( this->myBase->myArpe->myGenericItens.holding->modelType){
-				case 1: { // VRML
-					iVrml* model = static_cast<iVrml*>(this->myBase->myArpe->myGenericItens.holding);
-					(*model).draw();
-					break;}
-				case 2: { // Assimp
-					break;}
-				default: break;}
-			}
-			break;}
-		case 4:{	// 4 = FLASHING		- shows a flashing poing
-			if( this->ball.flashingTime < 5){
-				if( this->ball.holding != 0) {
-					switch((*this->ball.holding).modelType){
-					case 1: { // VRML
-						iVrml* model = static_cast<iVrml*>(this->ball.holding);
-						//	printf("\n Base name: %s Ipoint %d VRML TO PRINT: %d", (*this->myBase).name, this->id, (*model).vrmlID);
-						(*model).draw();
-						break;}
-					case 2: { // Assimp
-						break;}
-					default: break; }
-				} else {
-					switch( this->myBase->myArpe->myGenericItens.holding->modelType){
-					case 1: { // VRML
-						iVrml* model = static_cast<iVrml*>(this->myBase->myArpe->myGenericItens.holding);
-						(*model).draw();
-						break;}
-					case 2: { // Assimp
-						break;}
-					default: break;}
-				}
-			} else {
-				if( this->ball.flashingTime > 10 ){ 
-					this->ball.flashingTime = 0;
-				}
-			}
-			this->ball.flashingTime++;
-
-
-
-
-			break;}
-		case 5:{	// 5 = GHOST		- show a ghost object 
-			break;}
-		case 6:{	// 6 = SENSE_PROX   - shows only point with sensing properties. (Only works if has the sensing points correcty)
-			//printf("\n SENSE %d %d", this->ball.senseStatus, this->ball.activeBall);
-			switch( this->ball.senseStatus){
-			case 0:
-			case 1:
-				break;
-			case 2:{	// HOLDING MODEL
-
-				if( this->ball.holding != 0) {
-					switch((*this->ball.holding).modelType){
-					case 1: { // VRML
-						iVrml* model = static_cast<iVrml*>(this->ball.holding);
-						//	printf("\n Base name: %s Ipoint %d VRML TO PRINT: %d", (*this->myBase).name, this->id, (*model).vrmlID);
-						(*model).draw();
-						break;}
-					case 2: { // Assimp
-						break;}
-					default: break; }
-				} else {
-					switch( this->myBase->myArpe->myGenericItens.holding->modelType){
-					case 1: { // VRML
-						iVrml* model = static_cast<iVrml*>(this->myBase->myArpe->myGenericItens.holding);
-						(*model).draw();
-						break;}
-					case 2: { // Assimp
-						break;}
-					default: break;}
-				}
-				break;}
-			case 3:{	// CAN WORK MODEL
-				if( this->ball.canWork != 0) {
-					switch((*this->ball.canWork).modelType){
-					case 1: { // VRML
-						iVrml* model = static_cast<iVrml*>(this->ball.canWork);
-						//	printf("\n Base name: %s Ipoint %d VRML TO PRINT: %d", (*this->myBase).name, this->id, (*model).vrmlID);
-						(*model).draw();
-						break;}
-					case 2: { // Assimp
-						break;}
-					default: break; }
-				} else {
-					switch( this->myBase->myArpe->myGenericItens.canwork->modelType){
-					case 1: { // VRML
-						iVrml* model = static_cast<iVrml*>(this->myBase->myArpe->myGenericItens.canwork);
-						(*model).draw();
-						break;}
-					case 2: { // Assimp
-						break;}
-					default: break;}
-				}
-				break;}
-			case 4:{	// CANNOT WORK MODEL
-				if( this->ball.cannotWork != 0) {
-					switch((*this->ball.cannotWork).modelType){
-					case 1: { // VRML
-						iVrml* model = static_cast<iVrml*>(this->ball.cannotWork);
-						//	printf("\n Base name: %s Ipoint %d VRML TO PRINT: %d", (*this->myBase).name, this->id, (*model).vrmlID);
-						(*model).draw();
-						break;}
-					case 2: { // Assimp
-						break;}
-					default: break; }
-				} else {
-					switch( this->myBase->myArpe->myGenericItens.cannotWork->modelType){
-					case 1: { // VRML
-						iVrml* model = static_cast<iVrml*>(this->myBase->myArpe->myGenericItens.cannotWork);
-						(*model).draw();
-						break;}
-					case 2: { // Assimp
-						break;}
-					default: break;}
-				}
-				break;}
-			default: break;}
+		}
+		this->ball.flashingTime++;
+		return model;}
+	case 6:		// 6 = SENSE_PROX   - shows only point with sensing properties. (Only works if has the sensing points correcty)
+		switch( this->ball.senseStatus){
+		case 2:		// HOLDING MODEL
+			return vrmlModel( this->ball.holding != 0 ? this->ball.holding : generic->holding);
+		case 3:		// CAN WORK MODEL
+			return vrmlModel( this->ball.canWork != 0 ? this->ball.canWork : generic->canwork);
+		case 4:		// CANNOT WORK MODEL
+			return vrmlModel( this->ball.cannotWork != 0 ? this->ball.cannotWork : generic->cannotWork);
+		default: return 0;}
+	default: return 0;
+	};
+}
 
-			break;}
-		case 7:{	// 7 = ALL_OBJECTS  - shows all objects at once	
-			if( this->ball.holding != 0) {
-				switch((*this->ball.holding).modelType){
-				case 1: { // VRML
-					iVrml* model = static_cast<iVrml*>(this->ball.holding);
-					//	printf("\n Base name: %s Ipoint %d VRML TO PRINT: %d", (*this->myBase).name, this->id, (*model).vrmlID);
-					(*model).draw();
-					break;}
-				case 2: { // Assimp
-					break;}
-				default: break; }
-			} else {
-				switch( this->myBase->myArpe->myGenericItens.holding->modelType){
-				case 1: { // VRML
-					iVrml* model = static_cast<iVrml*>(this->myBase->myArpe->myGenericItens.holding);
-					(*model).draw();
-					break;}
-				case 2: { // Assimp
-					break;}
-				default: break;}
-			}
-			break;}
+void iPoint::showBall(){
+	iVrml* model = this->ballModel();
 
-		default: break;
-		};
+	if( model != 0){
+		double m[16];
 
+		// The base modelview is computed once per frame, the point only
+		// adds its own transform.
+		this->position.bakeGL(this->position.trans, m);
+		glMatrixMode(GL_MODELVIEW);
+		glPushMatrix();
+		glLoadMatrixd((*(*this->myBase).myInfraStructure).baseModelview);
+		glMultMatrixd(m);
+		(*model).draw();
 		glPopMatrix();
 	}
 }
 
 void iPoint::showObjects(){
 	if( this->type){
-		double mat[3][4], m[16];
+		const double *base = (*(*this->myBase).myInfraStructure).baseModelview;
+		double m[16];
 
+		this->position.bakeGL(this->position.trans, m);
 		glMatrixMode(GL_MODELVIEW);
 		glPushMatrix();
 		glMatrixMode(GL_MODELVIEW);
-		glLoadIdentity();
-		arUtilMatMul((*(*this->myBase).myInfraStructure).baseTrans, this->position.trans, mat);
-		arglCameraViewRH(mat,m,1);
-		glLoadMatrixd(m);
+		glLoadMatrixd(base);
+		glMultMatrixd(m);
 
 		switch(this->viewMode ){
 		case 0:{	// 0 = HIDE			- hide point and object
@@ -283,7 +146,7 @@ void iPoint::showObjects(){
 					switch((*i3D).modelType){
 					case 1: { // VRML
 						iVrml* model = static_cast<iVrml*>(i3D);
-						(*model).draw();
+						if (drawModel(model, base, m) == AR_VRML_LOADING) this->showPlaceholder();
 						break;}
 					case 2: { // Assimp
 						break;}
@@ -310,7 +173,7 @@ void iPoint::showObjects(){
 					switch((*i3D).modelType){
 					case 1: { // VRML
 						iVrml* model = static_cast<iVrml*>(i3D);
-						(*model).draw();
+						if (drawModel(model, base, m) == AR_VRML_LOADING) this->showPlaceholder();
 						break;}
 					case 2: { // Assimp
 						break;}
@@ -328,6 +191,12 @@ void iPoint::showObjects(){
 		case 4:{	// 4 = FLASHING		- shows a flashing point
 			break;}
 		case 5:{	// 5 = GHOST		- show a ghost object 
+			// Always blended, drawn see-through after the opaque ones.
+			if((this->activeObjectID > 0) && (this->listObject.size() > 0)){
+				ipObject* obj = this->findObject(this->activeObjectID);
+				iVrml* model = (obj != 0 && (*obj).type == 1)? vrmlModel(static_cast<iObject3D*>(obj)): 0;
+				if( model != 0) blendQueueAdd(model, base, m);
+			}
 			break;}
 		case 6:{	// 6 = SENSE_PROX   - shows only point with sensing properties. (Only works if has the sensing points correcty)
 			break;}
@@ -342,7 +211,7 @@ void iPoint::showObjects(){
 					switch((*i3D).modelType){
 					case 1: { // VRML
 						iVrml* model = static_cast<iVrml*>(i3D);
-						(*model).draw();
+						if (drawModel(model, base, m) == AR_VRML_LOADING) this->showPlaceholder();
 						break;}
 					case 2: { // Assimp
 						break;}
@@ -365,12 +234,34 @@ void iPoint::showObjects(){
 	}
 }
 
+// Stands in for an object whose model is still being loaded, see
+// arVrmlLoadFileAsync(), with the holding ball of the point.
+void iPoint::showPlaceholder(){
+	iObject3D* holding = this->ball.holding;
+
+	if( holding == 0) holding = this->myBase->myArpe->myGenericItens.holding;
+	if( holding == 0) return;
+
+	switch((*holding).modelType){
+	case 1: { // VRML
+		iVrml* model = static_cast<iVrml*>(holding);
+		(*model).draw();
+		break;}
+	case 2: { // Assimp
+		break;}
+	default: break;
+	};
+}
+
 iPoint::iPoint(){
 //	position = new ipPosition();
 	this->activeObjectID	= 0;
 	this->viewMode			= 0;
 //	int			viewMode = 0;
 	this->adaptType			= 0;
+	this->myBase			= 0;
+	this->actualAction		= 0;
+	this->configAction		= 0;
 }
 
 iPoint::~iPoint(){
@@ -381,7 +272,7 @@ iPoint::~iPoint(){
 
 int iPoint::iPointReadFile(){
 	
-	FILE          *fp;
+	CfgFile          *fp;
 	char           buf[256],buf1[256],buf2[256],fileDAT[256];
 	int			   numObjects;
 
@@ -400,14 +291,14 @@ int iPoint::iPointReadFile(){
 		return  0;
 	}
 
-	if( (fp=fopen(this->objFilename,"r")) == NULL) { printf("\n Error on opening %s action point object file!! ",this->objFilename);	return -1;}
+	if( (fp=cfgOpen(this->objFilename)) == NULL) { printf("\n Error on opening %s action point object file!! ",this->objFilename);	return -1;}
 
 	//--------------------------------------------------------------------------
 	// Read the amount of models
 	//--------------------------------------------------------------------------
 	getBuff(buf,256,fp);
     if (sscanf(buf, "%d", &numObjects) != 1) {
-		 printf("\n Check %s file format", this->objFilename);fclose(fp); return -1;
+		 printf("\n Check %s file format", this->objFilename);cfgClose(fp); return -1;
 	}
 	printf("\n About to load %d objects.", numObjects);
 
@@ -417,10 +308,10 @@ int iPoint::iPointReadFile(){
 		// Read the objects
 		//--------------------------------------------------------------------------
         getBuff(buf, 256, fp);
-		if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->objFilename); fclose(fp); return -1; }
+		if (sscanf(buf, "%s", &buf1) != 1) { printf("\n Check %s file format", this->objFilename); cfgClose(fp); return -1; }
 		
 		if ( strcmp(buf1,"MODEL3D") == 0 ){
-			if (sscanf(buf, "%s %s %s", &buf1, &buf2, &fileDAT) != 3) { printf("\n Check %s file format", this->objFilename); fclose(fp); return -1; }
+			if (sscanf(buf, "%s %s %s", &buf1, &buf2, &fileDAT) != 3) { printf("\n Check %s file format", this->objFilename); cfgClose(fp); return -1; }
 			if(  strcmp(buf2,"VRML") == 0 ){
 				iVrml* obj = new iVrml();
 
@@ -429,7 +320,8 @@ int iPoint::iPointReadFile(){
 				(*obj).id = i +1;
 				(*obj).type = 1; // MODEL3D
 				(*obj).modelType = 1;  //VRML
-				(*obj).vrmlID = arVrmlLoadFile(fileDAT);
+				// Parsed in the background, the ball shows until it is ready.
+				(*obj).vrmlID = arVrmlLoadFileAsync(fileDAT);
 				if ((*obj).vrmlID < 0) {
 					printf("\n Error on %s file or on VRML file (%d)",fileDAT,(*obj).vrmlID);
 				} else {
@@ -451,20 +343,17 @@ int iPoint::iPointReadFile(){
 	printf("\n First Active Object ID: %d, of %d", (*this->findObject(1)).id, this->listObject.size());
 
 	printf("\n %s correctly read!",this->name);
-	fclose(fp);
+	cfgClose(fp);
 
 	return 1;
 }
 
 int iPoint::externiPointReadFile(){
 	
-	FILE			*fp;
+	CfgFile			*fp;
 	char			buf[256],buf1[256],buf2[256];
 	int				retScan;
 	int				commandCounter = 1;
-	int				readCmd = 0;
-	int				br = 0;
-	int				countReadInt = 0;
 
 	//--------------------------------------------------------------------------
 	// Open the Object Configuration file
@@ -479,7 +368,7 @@ int iPoint::externiPointReadFile(){
 		return  0;
 	}
 
-	if( (fp=fopen(this->objFilename,"r")) == NULL) { printf("\n Error on opening %s action point object file!! ",this->objFilename); return -1;}
+	if( (fp=cfgOpen(this->objFilename)) == NULL) { printf("\n Error on opening %s action point object file!! ",this->objFilename); return -1;}
 
 	this->arduino = 0;
 
@@ -489,7 +378,7 @@ int iPoint::externiPointReadFile(){
 	// Read the COM
 	//--------------------------------------------------------------------------
 	getBuff(buf, 256, fp);
-	if (sscanf(buf, "%s %s", &buf1, &buf2) != 2) { printf("\n Check %s file format", this->objFilename); fclose(fp); return -1; }
+	if (sscanf(buf, "%s %s", &buf1, &buf2) != 2) { printf("\n Check %s file format", this->objFilename); cfgClose(fp); return -1; }
 
 	if( strcmp(buf1,"COM1") == 0) this->arduino = new Serial("\\\\.\\COM1");
 	if( strcmp(buf1,"COM2") == 0) this->arduino = new Serial("\\\\.\\COM2");
@@ -533,7 +422,7 @@ int iPoint::externiPointReadFile(){
 			break;
 			   }
 		default:{
-			fclose(fp);
+			cfgClose(fp);
 			printf("\n Error on command %d", commandCounter);
 			exit(0);
 			break;}
@@ -545,56 +434,20 @@ int iPoint::externiPointReadFile(){
 
 	}
 
+	// The board is given the time to reset and answer on a thread of its
+	// own, while the other files are read, see Serial::handshakeAsync().
 	printf("\n Trying to connect to hardware");
-	if( this->arduino == 0 || this->arduino->isConnected()){
+	if( this->arduino != 0 && this->arduino->isConnected()){
 		strcpy(this->arduino->configFilename,buf2);
-		//	this->arduino = ard;
-
-		if(this->arduino->sendFromLookupTable("aliveTest")){ // SEND aliveTest to check connection
-			printf("\n ... Test byte correctly sent ");
-
-			// test reading
-			if ( this->arduino->sendFromLookupTable("aliveAnswer") ){ 
-				////printf("\n ... Check Int");
-				br = -1;
-				Sleep(1000);
-				while(br != 3){ br = this->arduino->readData(arduino->buffer,3); 
-				if( countReadInt > 10 ) break;
-				countReadInt++;
-				}
-				if( br == 3) {
-					readCmd = atoi ( this->arduino->buffer);
-					if ( readCmd == 2 ){
-						printf("\n Alive read success");
-					} else { 
-						printf("\n Alive read failed");
-					}
-				} else {
-					printf("\n Alive read %d bytes", br);
-				}
-				printf("....Received aliveAnswer");
-			}
-			else { printf("\n Failure to send hardware aliveAnswer!!"); }
-
-
-			EnterCriticalSection(&this->commCS);
-			this->arduino->enableReceive = 0;
-			LeaveCriticalSection(&this->commCS);
-			// START READING THREAD
-			//_beginthread(callReadThread,0, this);
-
-
-
-		}
-
-
+		this->arduino->enableReceive = 0;
+		this->arduino->handshakeAsync();
 	} else {
 		this->arduino = 0;
 		printf("\n Verify COM on configuration file");
 	}
 
 	printf("\n %s correctly read!",this->name);
-	fclose(fp);
+	cfgClose(fp);
 
 	return 1;
 }
@@ -603,110 +456,17 @@ int iPoint::iPointWriteFile(){
 	return 0;
 }
 
-char iPoint::getBuff(char *buf, int n, FILE *fp)
+char iPoint::getBuff(char *buf, int n, CfgFile *fp)
 {
     char *ret;
 	
     for(;;) {
-        ret = fgets(buf, n, fp);
+        ret = cfgGets(buf, n, fp);
         if (ret == NULL) return(NULL);
         if (buf[0] != '\n' && buf[0] != '#') return(1); // Skip blank lines and comments.
     }
 }
 
-void iPoint::poolingThread(){
-	Sleep(1000);
-	
-	// Split Int pooling and Rcv pooling
-	int enableReceive;
-	int br = -1;
-	int counter = 0;
-	int countReadInt = 0;
-	int countReadRq = 0;
-	int intNewState = 0;
-	int readCmd = 0;
-	SerialCommand *sc = 0;
-	SerialCommand *scTest = 0;
-	printf("\n Starting serial on COM %s",this->arduino->portName);
-	while( TRUE ){
-		Sleep(1000);
-		//this->wait(1);
-		countReadInt = 0;
-		countReadRq = 0;
-		strcpy(this->arduino->buffer,"0");
-
-		printf(".x.");
-		EnterCriticalSection(&this->commCS);
-		if( this->arduino!=0 && this->arduino->isConnected()) enableReceive = this->arduino->enableReceive;
-		LeaveCriticalSection(&this->commCS);
-		
-		// interrupt testing - intRequest
-		// Interruption returns the number of the next state to be called
-		if ( this->arduino->sendFromLookupTable("intRequest") ){ 
-			//printf("\n ... Check Int");
-			br = -1;
-			while(br != 3){ br = this->arduino->readData(arduino->buffer,3); 
-				if( countReadInt > 10 ) break;
-				countReadInt++;
-				}
-			intNewState = atoi ( this->arduino->buffer);
-			if ( intNewState > 0 && intNewState < this->myBase->myArpe->myRules->listState.size() ){
-				printf ("NS: %d",intNewState);
-				EnterCriticalSection(&this->myBase->myArpe->parserCS);
-				this->myBase->myArpe->myRules->nextState = intNewState;
-				LeaveCriticalSection(&this->myBase->myArpe->parserCS);
-			} else { 
-				if( intNewState != 0) printf("\n Asking by %d, its a not valid state. Sorry!", intNewState);
-			}
-		}
-		else { printf("\n Failure to send hardware int request!!"); }
-
-
-		// Test if ERCV POOLING - readRequest
-		// Interruption returns the lookup code to match with code asked
-		if(enableReceive == 1){
-			if ( this->arduino->sendFromLookupTable("readRequest") ){ 
-				printf("\n ... Check Read");
-				br = -1;
-				while(br != 3){ br = this->arduino->readData(arduino->buffer,3); 
-				if( countReadRq > 10 ) break;
-				countReadRq++;
-				}
-				// VERIFIES IF readRequestAnswer is correct
-				readCmd = atoi ( this->arduino->buffer);
-				sc = this->arduino->findCommand(readCmd);
-				scTest = this->arduino->findCommand("readRequestAnswer");
-				if (sc != 0 && sc->requestNumber == scTest->requestNumber){
-					//HARDWARE IS WAITING COMMAND TO BE READ
-
-					if ( this->arduino->sendFromLookupTable(this->actualAction->eMsg)){
-						printf("\n ... Requested command has been sent!");
-						br = -1;
-						countReadRq = 0;
-						while(br != 3){ br = this->arduino->readData(arduino->buffer,3); 
-							if( countReadRq > 10 ) break;
-							countReadRq++;
-							}
-						//VERIFIES IF command exists
-						sc = 0;
-						readCmd = atoi ( this->arduino->buffer);
-						sc = this->arduino->findCommand(readCmd);	
-						scTest = this->arduino->findCommand(this->actualAction->eMsg);
-						if( sc != 0 && sc->requestNumber == scTest->requestNumber){
-							//HARDWARE SENT THE ASKED COMMAND
-							EnterCriticalSection(&this->myBase->myArpe->parserCS);
-							this->myBase->myArpe->myRules->nextState = sc->nextState;
-							LeaveCriticalSection(&this->myBase->myArpe->parserCS);				
-							enableReceive = 0;
-							this->myBase->myArpe->playActionAudio(this);
-						} else { if( this->myBase->errorSound != 0) { this->myBase->errorSound->play2D();} }
-					} else { if( this->myBase->errorSound != 0) { this->myBase->errorSound->play2D();} }
-				} else { if( this->myBase->errorSound != 0) { this->myBase->errorSound->play2D();} }
-			} else { printf("\n Failure to send read request!!"); if( this->myBase->errorSound != 0) { this->myBase->errorSound->play2D();} }
-		}
-	}
-}
-
 void iPoint::wait( double seconds){
 	clock_t endwait;
 	endwait = clock () + seconds*CLOCKS_PER_SEC;
@@ -739,26 +499,24 @@ void iPoint::addActuator(ipDist* value){
 	list<ipDist*>::iterator it;
 	it = this->listDistances.begin();
 	this->listDistances.push_back(value);	
+	this->distanceIndex.add(value->actuator->id, value);
 }
 
 ipDist* iPoint::findActuator(int valueID){
-	list<ipDist*>::iterator it;
+	ipDist *d = this->distanceIndex.find(valueID);
 
-	for( it = this->listDistances.begin(); it != this->listDistances.end(); it++)
-		if( (*it)->actuator->id == valueID)
-			return (*it);
-	
-	printf("\n *******Actuator not found");
-	return 0;
+	if (d == 0) printf("\n *******Actuator not found");
+	return d;
 }
 
+// Squared distance to where the actuator was last queried by the base, even
+// when the point was too far from it for Arpe::findPointNearActuator() to
+// update its ipDist.
 double	iPoint::getDistanceTo(int valueID){
-	list<ipDist*>::iterator it;
+	ipDist *d = this->distanceIndex.find(valueID);
+	double dist;
 
-	for( it = this->listDistances.begin(); it != this->listDistances.end(); it++)
-		if( (*it)->actuator->id == valueID)
-			return (*it)->distance;
-	
-	printf("\n *******Actuator not found");
-	return 0;
+	if (d == 0) { printf("\n *******Actuator not found"); return 0; }
+	if (this->myBase && this->myBase->distanceTo(this, valueID, &dist)) return dist;
+	return d->distance;
 }
\ No newline at end of file
@@ -11,19 +11,23 @@
 #include "ipPosition.h"
 #include "Action.h"
 #include "Serial.h"
+#include "IdIndex.h"
+#include "ConfigBundle.h"
+#include "ArpeAlloc.h"
 
 class ipAction;
 class Base;
 class ipDist;
+class iVrml;
 
-class iPoint {
+class iPoint : public ArpeAlloc {
 
  public:
     iPoint();
     ~iPoint();
 	
 	//Setup functions
-	char		getBuff(char *buf, int n, FILE *fp);
+	char		getBuff(char *buf, int n, CfgFile *fp);
 	int			iPointReadFile();
 	int			externiPointReadFile();
 	int			iPointWriteFile();
@@ -53,17 +57,16 @@ class iPoint {
 	int			activeObjectID;
 	void		addObject(ipObject* value);
 	ipObject*	findObject(int valueID);
+	iVrml*		ballModel();
 	void		showBall();
     void		showObjects();
+	void		showPlaceholder();
 
-	//External hardware configuration
-	CRITICAL_SECTION	commCS;
+	//External hardware configuration, its input comes in through SerialReactor
 	Serial		*arduino;
 	int			enableReceiveOnThread;
-	void		poolingThread();
 
 	//Animation control
-	CRITICAL_SECTION	animCS;
 	void		wait(double seconds);
 	void		createGLRotateMatrix(double angle, double x, double y, double z, double matrix[3][4]);
 
@@ -76,6 +79,7 @@ class iPoint {
 	void					addActuator(ipDist* value);
 	ipDist*					findActuator(int valueID);
 	double					getDistanceTo(int valueID);
+	IdIndex<ipDist>			distanceIndex;		// By actuator id
     Base					*myBase;
 };
 
@@ -14,6 +14,8 @@
 #include "iPuzzle.h"
 
 #include "iARTKMarker.h"
+#include "Arpe.h"
+#include "Startup.h"
 
 
 using namespace std;
@@ -170,7 +172,7 @@ int iPuzzle::puzzleFill(){
 			//************************************************************
 			getBuff(buf, 256, fp2);
 			if(sscanf(buf, "%s", &buf1) != 1){ fclose(fp); return 0;} 
-			if ((newAct.m_patternID = arLoadPatt(buf1)) < 0) { fclose(fp2);  return(0);	}
+			if ((newAct.m_patternID = Arpe::loadMarker(buf1)) < 0) { fclose(fp2);  return(0);	}
 			//************************************************************
 			//	Read marker size
 			//************************************************************
@@ -189,7 +191,9 @@ int iPuzzle::puzzleFill(){
 			if (sscanf(buf, "%s %s", &buf1, &fileModel) != 2) {fclose(fp2); return(0); }
 			//CALL VRML LOADER TO VRML MARKER COVER
 			if (strcmp(buf1, "VRML") == 0) {
+				startupBegin(STARTUP_VRML);
 				newAct.m_cover_VRML_ID = arVrmlLoadFile(fileModel);
+				startupEnd();
 				printf("\n Marker Cover VRML id: %d ", newAct.m_cover_VRML_ID);
 				if (newAct.m_cover_VRML_ID < 0) {fclose(fp2); return(0);	}
 			} else {
@@ -204,7 +208,9 @@ int iPuzzle::puzzleFill(){
 
 			//CALL VRML LOADER TO VRML MARKER COVER
 			if (strcmp(buf1, "VRML") == 0) {
+				startupBegin(STARTUP_VRML);
 				newAct.m_rep_VRML_ID = arVrmlLoadFile(fileModel);
+				startupEnd();
 				printf("\n Abstract Representation VRML id: %d ", newAct.m_rep_VRML_ID);
 				if (newAct.m_rep_VRML_ID < 0) {fclose(fp2); return(0);	}
 			} else {
@@ -218,7 +224,9 @@ int iPuzzle::puzzleFill(){
 			if (sscanf(buf, "%s %s", &buf1, &fileModel) != 2) {fclose(fp2); return(0); }
 			//CALL VRML LOADER TO VRML MARKER COVER
 			if (strcmp(buf1, "VRML") == 0) {
+				startupBegin(STARTUP_VRML);
 				newAct.m_action_VRMLID = arVrmlLoadFile(fileModel);
+				startupEnd();
 				printf("\n ActionPoint Representation VRML id: %d ", newAct.m_action_VRMLID);
 				if (newAct.m_action_VRMLID < 0) {fclose(fp2); return(0);	}
 			} else {
@@ -1,8 +1,13 @@
 #include "iVrml.h"
+#include "Startup.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <windows.h>
+
+#include <vector>
+using namespace std;
 
 #include <AR/ar.h>
 #include <AR/config.h>
@@ -18,6 +23,11 @@ int iVrml::draw(){
 	return arVrmlDraw(this->vrmlID);
 }
 
+int iVrml::drawInstanced(const double transforms[][16], int n){
+
+	return arVrmlDrawInstanced(this->vrmlID, transforms, n);
+}
+
 iVrml::iVrml(){
 }
 
@@ -27,4 +37,33 @@ iVrml::~iVrml(){
 iVrml* iVrml::allocate(char *filename){
 
 	return 0;
+}
+
+// The models of loadAsync() not waited for yet
+static vector<int> pendingID;
+
+int iVrml::loadAsync(const char *filename){
+	int id;
+
+	startupBegin(STARTUP_VRML);
+	id = arVrmlLoadFileAsync(filename);
+	startupEnd();
+	if (id >= 0) pendingID.push_back(id);
+	return id;
+}
+
+int iVrml::waitLoaded(){
+	size_t i;
+	int status, failed = 0;
+
+	for (i = 0; i < pendingID.size(); i++) {
+		while ((status = arVrmlLoadStatus(pendingID[i])) == AR_VRML_LOADING) Sleep(1);
+		if (status < 0) {
+			printf("\n Error on VRML file of VRML id %d", pendingID[i]);
+			failed++;
+		}
+	}
+	pendingID.clear();
+
+	return failed;
 }
\ No newline at end of file
@@ -13,8 +13,18 @@ class iVrml : public iObject3D {
 
     int draw();
 
+    // Draws the model once under each of the n transforms.
+    int drawInstanced(const double transforms[][16], int n);
+
 	iVrml* allocate(char *filename);
 
+	// Queues the model to be parsed on the loader thread of ARvrml while the
+	// configuration goes on being read. Returns the id of arVrmlLoadFileAsync().
+	static int loadAsync(const char *filename);
+	// Waits for the models queued by loadAsync(), their viewers made here on
+	// the thread of the GL context. Returns how many failed.
+	static int waitLoaded();
+
     iVrml();
 
     ~iVrml();
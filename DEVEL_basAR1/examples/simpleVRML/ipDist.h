@@ -1,9 +1,11 @@
 #ifndef ipDist_h
 #define ipDist_h
 
+#include "ArpeAlloc.h"
+
 class Actuator;
 
-class ipDist
+class ipDist : public ArpeAlloc
 {
 public:
 	Actuator *actuator;
@@ -1,9 +1,11 @@
 #ifndef ipObject_h
 #define ipObject_h
 
+#include "ArpeAlloc.h"
+
 class iPoint;
 
-class ipObject {
+class ipObject : public ArpeAlloc {
 
  public:
 
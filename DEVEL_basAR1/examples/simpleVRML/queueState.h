@@ -2,9 +2,10 @@
 #define queueState_h
 
 #include "State.h"
+#include "ArpeAlloc.h"
 
 
-class queueState
+class queueState : public ArpeAlloc
 {
 public:
 
@@ -19,6 +19,8 @@
 #include <AR/arvrml.h>
 
 #include <list>
+#include <vector>
+#include <algorithm>
 
 
 
@@ -32,6 +34,21 @@
 #include "ipObject.h"
 #include "Serial.h"
 #include "ipDist.h"
+#include "FramePipeline.h"
+#include "ConfigBundle.h"
+#include "SerialReactor.h"
+#include "Latency.h"
+#include "Startup.h"
+#include "Metrics.h"
+#include "AllocCheck.h"
+#include "Governor.h"
+#include "PoseShare.h"
+#include "Broadcast.h"
+#include "Replay.h"
+#include "Log.h"
+#include "ScreenRecord.h"
+#include "BlendQueue.h"
+#include "Slack.h"
 
 using namespace std;
 
@@ -44,6 +61,11 @@ using namespace std;
 #define VIEW_SCALEFACTOR_4		4.0			// 1.0 ARToolKit unit becomes 4.0 of my OpenGL units.
 #define VIEW_DISTANCE_MIN		4.0			// Objects closer to the camera than this will not be displayed.
 #define VIEW_DISTANCE_MAX		4000.0		// Objects further away from the camera than this will not be displayed.
+#define POSE_MAX				64			// Actuator and base markers whose poses are computed together.
+#define VRML_BUDGET_GPU_KB		(256 * 1024)	// Models least recently drawn are dropped, and reloaded when drawn again,
+#define VRML_BUDGET_CPU_KB		(512 * 1024)	// beyond these, so that a long running installation stays bounded.
+#define CONFIG_BUNDLE			"Data/basAR.bundle"	// The configuration files in one, see ConfigBundle.h
+#define TRACE_FILE				"trace.json"		// For chrome://tracing or Perfetto, with -trace.
 
 // ============================================================================
 //	Global variables
@@ -56,22 +78,80 @@ using namespace std;
 //static int prefDepth = 32;					// Fullscreen mode bit depth.
 //static int prefRefresh = 0;					// Fullscreen mode refresh rate. Set to 0 to use default rate.
 
-// Image acquisition.
-static ARUint8		*gARTImage = NULL;
-
 // Marker detection.
 static int			gARTThreshhold = 100;
 static long			gCallCountMarkerDetect = 0;
 
-// Transformation matrix retrieval.
-static int			gPatt_found = FALSE;	// At least one marker.
+// The actuator and base markers tracked, in the order the actuators and bases
+// are looked at, see trackSlot(). Their poses go into the slots in this order.
+struct TrackTarget {
+	ActuatorARTKSM	*actuator;		// Or
+	InfraARTKSM		*base;
+	int				pattern;
+	double			width;
+	double			center[2];
+
+	// Of the tracker, as the last frame it tracked left them.
+	int				visible;
+	double			vertex[4][2];	// Of the marker trans was fitted to.
+	double			trans[3][4];
+};
+static int			gTrackThread = TRUE;	// FALSE with -onethread, the poses are then fitted by Idle().
+
+// One camera and the installation it looks at, each with its Arpe, given by
+// -session on the command line. The first one opens ARToolKit's default video
+// and detects in its default context, the others open their own. They are
+// drawn side by side in the one window, the models of the scenes being
+// shared in its GL context, as are the sounds and the patterns. The poses
+// are fitted with the calibration of the first camera, which the others
+// must have the size of.
+struct Session {
+	Arpe			arpe;
+	char			vconf[256];
+	AR2VideoParamT	*video;			// 0 and
+	ARHandle		*handle;		// 0 for the first.
+	ARParam			cparam;
+	ARParamSizes	sizes;			// cparam at each capture resolution, see setCameraSize().
+	int				pixFormat;		// Of the camera, and
+	int				stride;			// the bytes of a row of its images.
+	FramePipeline	pipeline;
+	vector<TrackTarget> target;
+	ARUint8			*image;			// Of the displayed pipeline slot.
+	int				pattFound;		// At least one marker.
+	int				fresh;			// A slot was taken this frame.
+	int				view[4];		// Its part of the window.
+	LatencyStamp	stamp;			// Of the slot taken, with -latency.
+	int				stamped;		// Until the swap of its frame.
+	PoseShareHeader	*share;			// With -share, see PoseShare.h
+	BroadcastSession *broadcast;	// With -broadcast, see Broadcast.h
+	ARGL_CONTEXT_SETTINGS_REF arglSettings;
+};
+static vector<Session*> gSession;
 
 // Drawing.
-static ARParam		gARTCparam;
-static ARGL_CONTEXT_SETTINGS_REF gArglSettings = NULL;
+static ARGL_FRAME_PACER_REF gPacer = NULL;
+static int			gLatency = FALSE;		// -latency on the command line, see Latency.h
+static int			gLatencyLed = FALSE;	// The LED of -latencyled is lit in the first camera.
+static const char	*gMetricsTarget = NULL;	// host:port of -metrics, see Metrics.h
+static int			gMetrics = FALSE;
+static int			gAllocCheck = FALSE;	// -alloccheck on the command line, see AllocCheck.h
+static int			gGovernor = FALSE;		// -governor on the command line, see Governor.h
+static int			gExposure = FALSE;		// -exposure, the camera set by arExposureUpdate().
+static int			gShare = FALSE;			// -share on the command line, see PoseShare.h
+static int			gShareFrames = FALSE;	// -shareframes, the images too.
+static const char	*gBroadcastTarget = NULL;	// host:port of -broadcast, see Broadcast.h
+static const char	*gRecordFile = NULL;	// Of -record, see Replay.h
+static const char	*gScreenRecordFile = NULL;	// Of -screenrecord, see ScreenRecord.h
+static const char	*gSimulateFile = NULL;	// Of -simulate, no camera and no window.
+static int			gSwapInterval = 1;		// Refreshes per swap, as the governor set it.
+static int			gMainWindow = 0;		// Of the first session, the projector when -monitor is given.
+static int			gMonitor = FALSE;		// -monitor, a second window for the operator.
+static int			gMonitorWindow = 0;		// Shares the video textures and the models of gMainWindow.
+static int			gDrawingMonitor = FALSE;	// The monitor shows the video even when projecting.
+static double		gFrameBegun;			// When Idle() began the frame being drawn.
 
 // Object Data.
-Arpe arpe;
+static int			gWriteBundle = FALSE;	// -bundle on the command line, save the files read as CONFIG_BUNDLE.
 
 
 bool				cdChanged = false;
@@ -83,24 +163,46 @@ int					tr = 0;
 //	Functions
 // ============================================================================
 
-static int setupCamera(const char *cparam_name, char *vconf, ARParam *cparam);
+static int setupCamera(Session *s, const char *cparam_name);
 static void debugReportMode(void);
 static void Quit(void);
 static void Keyboard(unsigned char key, int x, int y);
+static void initTracking(Session *s);
+static void trackSlot(FramePipeline::Slot *slot, void *data);
 static void Idle(void);
 static void Visibility(int visible);
 static void Reshape(int w, int h);
 static void Display(void);
+static void MonitorDisplay(void);
 void poolingThread(void * pParams);
 int main(int argc, char** argv);
 
-static int setupCamera(const char *cparam_name, char *vconf, ARParam *cparam)
+// Switches the camera parameters and the detection context of s to a capture
+// resolution; those of a resolution already seen are only looked up, and the
+// distortion mesh of gsub_lite is kept for each as well.
+static int setCameraSize(Session *s, int xsize, int ysize)
+{
+	int i;
+
+	if ((i = arParamSizesAdd(&s->sizes, xsize, ysize, arDistortionLUTSize)) < 0) return (FALSE);
+	if (s->handle) arSetParamSizeCtx(s->handle, &s->sizes, xsize, ysize);
+	else if (s == gSession[0]) arInitCparamSize(&s->sizes, xsize, ysize);
+	s->cparam = s->sizes.param[i];
+	return (TRUE);
+}
+
+static int setupCamera(Session *s, const char *cparam_name)
 {	
     ARParam			wparam;
 	int				xsize, ysize;
     // Open the video path.
-	printf("\n arVideoOpen()");
-	arVideoOpen(vconf);
+	if (s == gSession[0]) {
+		printf("\n arVideoOpen()");
+		arVideoOpen(s->vconf);
+	} else if ((s->video = ar2VideoOpen(s->vconf)) == NULL) {
+		printf("\n setupCamera(): Unable to open connection to camera %s.\n", s->vconf);
+		return (FALSE);
+	}
 
  //   if (arVideoOpen(vconf) < 0) {
  //   	fprintf(stderr, "setupCamera(): Unable to open connection to camera.\n");
@@ -109,7 +211,14 @@ static int setupCamera(const char *cparam_name, char *vconf, ARParam *cparam)
  //}
 	
 	printf("\n arVideoInqSize()");
-	arVideoInqSize(&xsize, &ysize);
+	if (s->video) ar2VideoInqSize(s->video, &xsize, &ysize);
+	else arVideoInqSize(&xsize, &ysize);
+
+	// Whatever DSVL negotiated; YUY2 and NV12 are detected on their luma.
+	if ((s->video ? ar2VideoInqPixelFormat(s->video, &s->pixFormat, &s->stride) : arVideoInqPixelFormat(&s->pixFormat, &s->stride)) < 0) {
+		s->pixFormat = AR_DEFAULT_PIXEL_FORMAT;
+		s->stride = xsize * AR_PIX_SIZE_DEFAULT;
+	}
 
     //// Find the size of the window.
     //if (arVideoInqSize(&xsize, &ysize) < 0) return (FALSE);
@@ -124,11 +233,40 @@ static int setupCamera(const char *cparam_name, char *vconf, ARParam *cparam)
 	//	printf("\n setupCamera(): Error loading parameter file %s for camera.\n", cparam_name);
  //       return (FALSE);
  //   }
-    arParamChangeSize(&wparam, xsize, ysize, cparam);
+    arParamSizesInit(&s->sizes, &wparam);
+    s->cparam = s->sizes.param[arParamSizesAdd(&s->sizes, xsize, ysize, arDistortionLUTSize)];
     fprintf(stdout, "*** Camera Parameter ***\n");
-    arParamDisp(cparam);
+    arParamDisp(&s->cparam);
+
+	if (s != gSession[0]) {
+		// The poses are fitted with the first camera's arParam.
+		if (xsize != gSession[0]->cparam.xsize || ysize != gSession[0]->cparam.ysize) {
+			printf("\n setupCamera(): Camera %s is not %dx%d like the first one.\n", s->vconf, gSession[0]->cparam.xsize, gSession[0]->cparam.ysize);
+			return (FALSE);
+		}
+		if ((s->handle = arCreateHandle(&s->cparam)) == NULL) {
+			printf("\n setupCamera(): Unable to create the detection context of camera %s.\n", s->vconf);
+			return (FALSE);
+		}
+		arSetPixelFormatCtx(s->handle, s->pixFormat);
+		setCameraSize(s, xsize, ysize);
+		if (ar2VideoCapStart(s->video) != 0) {
+			printf("\n setupCamera(): Unable to begin camera data capture.\n");
+			return (FALSE);
+		}
+		return (TRUE);
+	}
 	
-    arInitCparam(cparam);
+    arPixelFormat = s->pixFormat;
+    setCameraSize(s, xsize, ysize);
+
+#ifdef _WIN32
+	// Label each frame on all cores, one band per core.
+	SYSTEM_INFO sysInfo;
+	GetSystemInfo(&sysInfo);
+	arLabelingThreads = sysInfo.dwNumberOfProcessors;
+	if (arLabelingThreads > AR_LABELING_THREADS_MAX) arLabelingThreads = AR_LABELING_THREADS_MAX;
+#endif
 
 	if (arVideoCapStart() != 0) {
     	fprintf(stderr, "setupCamera(): Unable to begin camera data capture.\n");
@@ -139,57 +277,61 @@ static int setupCamera(const char *cparam_name, char *vconf, ARParam *cparam)
 	return (TRUE);
 }
 
-static int initAppHWandGL(){
+// The window is made for the first session, as wide as all of them.
+static int initAppHWandGL(Session *s){
 
 	char glutGamemode[32];
 	char           *cparam_name    = "Data/camera_para.dat";
 
-#ifdef _WIN32
-	char			*vconf = "Data\\WDM_camera_flipV.xml";
-#else
-	char			*vconf = "";
-#endif
 	printf("\n calling setupCamera()");
-	if (!setupCamera(cparam_name, vconf, &gARTCparam)) {
+	if (!setupCamera(s, cparam_name)) {
 		fprintf(stderr, "main(): Unable to set up AR camera.\n");
 		printf("\n main(): Unable to set up AR camera.\n");
 		exit(-1);
 	}
 	printf("\n setupCamera() ... Ok");
+
+	if (s == gSession[0]) {
 #ifdef _WIN32
-	CoInitialize(NULL);
+		CoInitialize(NULL);
 #endif
 
-	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
-	if (!arpe.prefWindowed) {
-		if (arpe.prefRefresh) sprintf(glutGamemode, "%ix%i:%i@%i", arpe.prefWidth, arpe.prefHeight, arpe.prefDepth, arpe.prefRefresh);
-		else sprintf(glutGamemode, "%ix%i:%i", arpe.prefWidth, arpe.prefHeight, arpe.prefDepth);
-		glutGameModeString(glutGamemode);
-		glutEnterGameMode();
-	} else {
-		glutInitWindowSize(gARTCparam.xsize, gARTCparam.ysize);
-		glutCreateWindow(arpe.appName);
+		glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
+		if (!s->arpe.prefWindowed) {
+			if (s->arpe.prefRefresh) sprintf(glutGamemode, "%ix%i:%i@%i", s->arpe.prefWidth, s->arpe.prefHeight, s->arpe.prefDepth, s->arpe.prefRefresh);
+			else sprintf(glutGamemode, "%ix%i:%i", s->arpe.prefWidth, s->arpe.prefHeight, s->arpe.prefDepth);
+			glutGameModeString(glutGamemode);
+			glutEnterGameMode();
+		} else {
+			glutInitWindowSize(s->cparam.xsize * (int)gSession.size(), s->cparam.ysize);
+			glutCreateWindow(s->arpe.appName);
+		}
+		gMainWindow = glutGetWindow();
+		printf("\n openGl ok");
 	}
-	printf("\n openGl ok");
 
 
 	// Setup argl library for current context.
-	if ((gArglSettings = arglSetupForCurrentContext()) == NULL) {
+	if ((s->arglSettings = arglSetupForCurrentContext()) == NULL) {
 		fprintf(stderr, "main(): arglSetupForCurrentContext() returned error.\n");
 		exit(-1);
 	}
-	debugReportMode();
-	arUtilTimerReset();
+	arglPixelFormatSet(s->arglSettings, s->pixFormat);	// YUY2 is converted by a shader.
+	arglPixelBufferObjectsSet(s->arglSettings, 2);	// Upload the video frames asynchronously.
+	for (int i = 0; i < s->sizes.num; i++) {
+		arglDistortionMeshPrepare(s->arglSettings, &s->sizes.param[i]);	// Not during the first frame.
+	}
+	if (s == gSession[0]) {
+		arglSwapIntervalSet(1);		// Swap on the display refresh, the pacer times the frames.
+		gPacer = arglFramePacerCreate();
+		debugReportMode();
+		arUtilTimerReset();
+	}
 	return 1;
 }
 
 
-void callArduinoThread(void *data){ 
-	iPoint *p = static_cast<iPoint *>(data);
-	p->poolingThread(); }
-
-
-static int initAppData(){
+static int initAppData(Session *s){
 	int counterActuator, counterBase, counterPoint;
 
 //	InitializeCriticalSection(&arpe.cs);
@@ -197,22 +339,31 @@ static int initAppData(){
 	counterBase = 1;
 	counterPoint = 1;
 
+	startupBegin(STARTUP_CONFIG);
+	// The sounds are played on their own thread from here on.
+	startupBegin(STARTUP_SOUND);
+	audioStart(s->arpe.audioEngine);
+	startupEnd();
+
 	printf("\n 1.");
 	// Start setting up the Kernel
-	if( arpe.arpeReadFiles() == -1) {printf("\n ****** ERROR ON basAR"); exit(0);} 
-	InitializeCriticalSection(&arpe.parserCS);
-	printf("\n parserCS set.");
+	if( s->arpe.arpeReadFiles() == -1) {printf("\n ****** ERROR ON basAR"); exit(0);} 
+	if( s->arpe.myUser != 0 && (*s->arpe.myUser).userReadFile() == -1) {printf("\n ****** ERROR ON USER"); exit(0);}
 
-	initAppHWandGL();
+	if (!gSimulateFile) {
+		startupBegin(STARTUP_CAMERA);
+		initAppHWandGL(s);
+		startupEnd();
+	}
 
 
 	printf("\n 2.");
 	// Setup actuator
 	list<Actuator*>::iterator itA;
-	for(itA = arpe.listActuator.begin(); itA != arpe.listActuator.end(); itA++){
+	for(itA = s->arpe.listActuator.begin(); itA != s->arpe.listActuator.end(); itA++){
 		switch((*(*itA)).type){
 		case 1:{ // Single ARToolKit Marker actuator
-			(*(*itA)).myArpe = &arpe;
+			(*(*itA)).myArpe = &s->arpe;
 			ActuatorARTKSM* a = static_cast<ActuatorARTKSM*>(*itA);
 			if( (*a).actuatorReadFile() == -1) {printf("\n ****** ERROR ON ACTUATOR"); exit(0);}  // Mandar id do ultimo atuador
 			(*a).id = counterActuator;
@@ -227,8 +378,8 @@ static int initAppData(){
 	printf("\n 3.");
 	// Setup bases 
 	list<Base*>::iterator itB;
-	for(itB = arpe.listBase.begin(); itB != arpe.listBase.end(); itB++){
-		(*(*itB)).myArpe = &arpe;
+	for(itB = s->arpe.listBase.begin(); itB != s->arpe.listBase.end(); itB++){
+		(*(*itB)).myArpe = &s->arpe;
 		if( (*(*itB)).baseReadFile() == -1) {printf("\n ****** ERROR ON BASE"); exit(0);} // Mandar id da ultima base
 		(*(*itB)).id = counterBase;
 		counterBase++;
@@ -240,19 +391,16 @@ static int initAppData(){
 			ip->id = counterPoint;
 			switch( (*ip).type){
 				case 1:{	// INTERN IPOINT
-					InitializeCriticalSection(&ip->animCS);
 					if( (*ip).iPointReadFile() == -1) {printf("\n ****** ERROR ON IPOINT"); exit(0);}
 					else { 
 					}
 					break;}
 
 				case 2:{	// EXTERN IPOINT
-					InitializeCriticalSection(&ip->commCS);
 					if( (*ip).externiPointReadFile() == -1) {printf("\n ****** ERROR ON IPOINT"); exit(0);} 
 					else { 
 						//Initialize hardware
-						Sleep(1000);
-						_beginthread(callArduinoThread,0,ip);
+						serialReactorAdd(ip);
 					} 
 					break;}
 				default: { 
@@ -262,7 +410,7 @@ static int initAppData(){
 
 			//Copy actuator list to the iPoints
 			list<Actuator*>::iterator itA;
-			for(itA = arpe.listActuator.begin(); itA != arpe.listActuator.end(); itA++){
+			for(itA = s->arpe.listActuator.begin(); itA != s->arpe.listActuator.end(); itA++){
 				ipDist *ipdist = new ipDist();
 				ipdist->actuator = (*itA);
 				ipdist->distance = 0;
@@ -273,17 +421,28 @@ static int initAppData(){
 		}
 	}
 
+	s->arpe.indexIPoints();
+	s->arpe.indexTracks();
+
 	printf("\n 4.");
 	// Setup Rules
-	Rules* r = arpe.myRules;
-	(*r).myArpe = &arpe;
-	(*r).rulesReadFile();
+	Rules* r = s->arpe.myRules;
+	(*r).myArpe = &s->arpe;
+	if ((*r).rulesReadFile() < 0) exit(0);
+	(*r).compileRules();
 
 	//printf("\n 5.");
 	//if( arpe.arduino !=0){ // If it specifies an Arduino
 	//	arpe.arduino->serialReadFile();
 	//}
 
+	// The models were parsed on the loader thread while the files were read,
+	// the objects of the iPoints show their placeholder until they are.
+	printf("\n 5.");
+	startupBegin(STARTUP_VRML_WAIT);
+	iVrml::waitLoaded();
+	startupEnd();
+
 	printf("\n 6.");
 	printf("\n --------------------------------------------------------------------------");
 	printf("\n Verify objects...");
@@ -291,11 +450,15 @@ static int initAppData(){
 
 	// Test render all the VRML objects.
     printf(" \n 6.1. Pre-rendering the VRML objects... ");
-	arpe.verifyConsistency();
+	if (!gSimulateFile) {
+		startupBegin(STARTUP_VRML_DRAW);
+		s->arpe.verifyConsistency();
+		startupEnd();
+	}
 
 	//Verify data consistency.
     printf(" \n 6.2. Verify action consistency... ");
-	arpe.myRules->verifyConsistency();
+	s->arpe.myRules->verifyConsistency();
 
 	//if Serial is applyable
 	printf(" \n 6.2. Verify ARDUINO... ");
@@ -327,6 +490,7 @@ static int initAppData(){
 //}
 
 	printf("\n 7.");
+	startupEnd();
 	// Execute app
 	return 1;
 }
@@ -345,9 +509,9 @@ static void debugReportMode(void)
 		fprintf(stderr, "ProcMode (X)   : HALF IMAGE\n");
 	}
 	
-	if (arglDrawModeGet(gArglSettings) == AR_DRAW_BY_GL_DRAW_PIXELS) {
+	if (arglDrawModeGet(gSession[0]->arglSettings) == AR_DRAW_BY_GL_DRAW_PIXELS) {
 		fprintf(stderr, "DrawMode (C)   : GL_DRAW_PIXELS\n");
-	} else if (arglTexmapModeGet(gArglSettings) == AR_DRAW_TEXTURE_FULL_IMAGE) {
+	} else if (arglTexmapModeGet(gSession[0]->arglSettings) == AR_DRAW_TEXTURE_FULL_IMAGE) {
 		fprintf(stderr, "DrawMode (C)   : TEXTURE MAPPING (FULL RESOLUTION)\n");
 	} else {
 		fprintf(stderr, "DrawMode (C)   : TEXTURE MAPPING (HALF RESOLUTION)\n");
@@ -364,13 +528,48 @@ static void debugReportMode(void)
 	} else {
 		fprintf(stderr, "MatchingPCAMode (P)   : With PCA\n");
 	}
+
+	if( arThresholdMode == AR_THRESHOLD_ADAPTIVE ) {
+		fprintf(stderr, "ThresholdMode (T)   : ADAPTIVE\n");
+	} else if( arThresholdMode == AR_THRESHOLD_AUTO ) {
+		fprintf(stderr, "ThresholdMode (T)   : AUTO\n");
+	} else {
+		fprintf(stderr, "ThresholdMode (T)   : MANUAL (%d)\n", gARTThreshhold);
+	}
+
+	fprintf(stderr, "LabelingThreads     : %d\n", arLabelingThreads);
 }
 
 static void Quit(void)
 {
-	arglCleanup(gArglSettings);
+	size_t i;
+
+	slackClear();
+	if (gMonitorWindow) {
+		glutSetWindow(gMonitorWindow);
+		for (i = 0; i < gSession.size(); i++) arglCleanup(gSession[i]->arglSettings);
+		glutSetWindow(gMainWindow);
+	}
+	for (i = 0; i < gSession.size(); i++) {
+		Session *s = gSession[i];
+		s->pipeline.stop();
+		poseShareClose(s->share);
+		broadcastSessionDelete(s->broadcast);
+		if (s->arpe.myUser != 0) (*s->arpe.myUser).eventLog.close();
+		arglCleanup(s->arglSettings);
+		if (s->video) {
+			ar2VideoCapStop(s->video);
+			ar2VideoClose(s->video);
+			arDeleteHandle(s->handle);
+		}
+	}
+	replayRecordStop();
+	screenRecordStop();
+	if (gLatency) latencyReport();
+	arglFramePacerDelete(gPacer);
 	arVideoCapStop();
 	arVideoClose();
+	arLabelingCleanup();
 	//puzzle.audioEngine->drop();
 #ifdef _WIN32
 	CoUninitialize();
@@ -381,6 +580,7 @@ static void Quit(void)
 static void Keyboard(unsigned char key, int x, int y)
 {
 	int mode;
+	size_t i;
 	switch (key) {
 		case 0x1B:						// Quit.
 		case 'Q':
@@ -396,11 +596,11 @@ static void Keyboard(unsigned char key, int x, int y)
 		case 'P':
 			printf("\n Projection");
 			// TURN PROJECTION ON/OFF --- TURN THE VIDEO OFF.
-			if( arpe.projection) {
+			if( gSession[0]->arpe.projection) {
 				printf(" mode OFF");
-				arpe.projection = false; } else {
+				for (i = 0; i < gSession.size(); i++) gSession[i]->arpe.projection = false; } else {
 					printf(" mode ON");
-					arpe.projection = true;
+					for (i = 0; i < gSession.size(); i++) gSession[i]->arpe.projection = true;
 				}
 
 			break;
@@ -414,6 +614,12 @@ static void Keyboard(unsigned char key, int x, int y)
 			gARTThreshhold++;
 			printf("\n gARTThreshhold: %d",gARTThreshhold); 
 			break;
+		case 't':
+		case 'T':
+			arThresholdMode = (arThresholdMode + 1) % 3;
+			for (i = 0; i < gSession.size(); i++) if (gSession[i]->handle) gSession[i]->handle->threshMode = arThresholdMode;
+			debugReportMode();
+			break;
 		//case 'P':
 		//case 'p':
 		//	if(arpe.arduino->writeData("p",1) == false){ printf("\n falhou");} // a
@@ -439,16 +645,24 @@ static void Keyboard(unsigned char key, int x, int y)
 		//		printf("\n Desabilita leitura");
 		//		arpe.tr = 0;
 		//		break;}
+		case 'R':
+		case 'r':
+			// The frame goes on with the rules it has while they are read.
+			for (i = 0; i < gSession.size(); i++) gSession[i]->arpe.myRules->reloadRules();
+			break;
 		case 'C':
 		case 'c':
-			mode = arglDrawModeGet(gArglSettings);
-			if (mode == AR_DRAW_BY_GL_DRAW_PIXELS) {
-				arglDrawModeSet(gArglSettings, AR_DRAW_BY_TEXTURE_MAPPING);
-				arglTexmapModeSet(gArglSettings, AR_DRAW_TEXTURE_FULL_IMAGE);
-			} else {
-				mode = arglTexmapModeGet(gArglSettings);
-				if (mode == AR_DRAW_TEXTURE_FULL_IMAGE)	arglTexmapModeSet(gArglSettings, AR_DRAW_TEXTURE_HALF_IMAGE);
-				else arglDrawModeSet(gArglSettings, AR_DRAW_BY_GL_DRAW_PIXELS);
+			for (i = 0; i < gSession.size(); i++) {
+				ARGL_CONTEXT_SETTINGS_REF argl = gSession[i]->arglSettings;
+				mode = arglDrawModeGet(argl);
+				if (mode == AR_DRAW_BY_GL_DRAW_PIXELS) {
+					arglDrawModeSet(argl, AR_DRAW_BY_TEXTURE_MAPPING);
+					arglTexmapModeSet(argl, AR_DRAW_TEXTURE_FULL_IMAGE);
+				} else {
+					mode = arglTexmapModeGet(argl);
+					if (mode == AR_DRAW_TEXTURE_FULL_IMAGE)	arglTexmapModeSet(argl, AR_DRAW_TEXTURE_HALF_IMAGE);
+					else arglDrawModeSet(argl, AR_DRAW_BY_GL_DRAW_PIXELS);
+				}
 			}
 			fprintf(stderr, "*** Camera - %f (frame/sec)\n", (double)gCallCountMarkerDetect/arUtilTimer());
 			gCallCountMarkerDetect = 0;
@@ -461,99 +675,317 @@ static void Keyboard(unsigned char key, int x, int y)
 			printf("Keys:\n");
 			printf(" q or [esc]    Quit demo.\n");
 			printf(" c             Change arglDrawMode and arglTexmapMode.\n");
+			printf(" t             Change threshold mode (manual, adaptive, auto).\n");
+			printf(" - and +       Change the manual threshold.\n");
+			printf(" r             Reload the rules file.\n");
+			printf(" l             With -latency, print the latencies and start again.\n");
+			printf(" d             With -trace, write the trace of the threads to %s.\n", TRACE_FILE);
+			printf(" m             Print the memory of each subsystem and its peak.\n");
 			printf(" ? or /        Show this help.\n");
 			printf("\nAdditionally, the ARVideo library supplied the following help text:\n");
 			arVideoDispOption();
 			break;
+		case 'L':
+		case 'l':
+			if (!gLatency) break;
+			latencyReport();
+			latencyReset();
+			break;
+		case 'D':
+		case 'd':
+			if (arTraceMode != AR_TRACE_ON) break;
+			if (arTraceDump(TRACE_FILE) == 0) printf("\n Trace written to %s", TRACE_FILE);
+			break;
+		case 'M':
+		case 'm':
+			arMemDump(stdout);
+			break;
 		default:
 			break;
 	}
 }
 
-static void Idle(void)
+// The marker actuators, then the marker sources of the bases of the
+// session, in the order Idle() looks at them.
+static void initTracking(Session *s)
+{
+	list<Actuator*>::iterator itAct;
+	list<Base*>::iterator b;
+	list<InfraSource*>::iterator iSource;
+	TrackTarget t;
+
+	memset(&t, 0, sizeof(t));
+	for( itAct = s->arpe.listActuator.begin(); itAct != s->arpe.listActuator.end(); itAct++){
+		if ((*(*itAct)).type != 1) continue;
+		t.actuator = static_cast<ActuatorARTKSM*>(*itAct);
+		t.base = NULL;
+		t.pattern = (*t.actuator).patternNumber;
+		t.width = (*t.actuator).markerWidth;
+		t.center[0] = (*t.actuator).markerCenter[0];
+		t.center[1] = (*t.actuator).markerCenter[1];
+		s->target.push_back(t);
+	}
+	for( b = s->arpe.listBase.begin() ; b != s->arpe.listBase.end() ; b++)
+		for( iSource = (*(*(*b)).myInfraStructure).listSource.begin(); iSource != (*(*(*b)).myInfraStructure).listSource.end(); iSource++){
+			if ((*(*iSource)).type != 1) continue;
+			t.actuator = NULL;
+			t.base = static_cast<InfraARTKSM*>(*iSource);
+			t.pattern = (*t.base).patternNumber;
+			t.width = (*t.base).markerWidth;
+			t.center[0] = (*t.base).markerCenter[0];
+			t.center[1] = (*t.base).markerCenter[1];
+			s->target.push_back(t);
+		}
+
+	s->pipeline.setSource(s->video, s->handle);
+	s->pipeline.setExposure(gExposure != FALSE);
+	if (gTrackThread) s->pipeline.setTracker(trackSlot, s);
+}
+
+// Fits at once the poses of the n markers of the targets which, from their
+// previous poses, and gives them to the targets and the slot.
+static void fitPoses(Session *s, FramePipeline::Slot *slot, ARMarkerInfo *marker[], int which[], int n)
+{
+	double	width[POSE_MAX], center[POSE_MAX][2], trans[POSE_MAX][3][4], err[POSE_MAX];
+	int		cont[POSE_MAX], j;
+
+	for (j = 0; j < n; j++) {
+		TrackTarget &t = s->target[which[j]];
+		width[j] = t.width;
+		center[j][0] = t.center[0];
+		center[j][1] = t.center[1];
+		cont[j] = t.visible;
+		memcpy(trans[j], t.trans, sizeof(trans[j]));	// Previous pose, and the result if the fit fails.
+	}
+	arGetTransMatBatch(marker, n, width, center, cont, trans, err, arLabelingThreads);
+	for (j = 0; j < n; j++) {
+		memcpy(s->target[which[j]].trans, trans[j], sizeof(trans[j]));
+		memcpy(slot->pose[which[j]].trans, trans[j], sizeof(trans[j]));
+		s->target[which[j]].visible = TRUE;
+	}
+}
+
+// Publishes the markers and poses of the slot, and its image with
+// -shareframes, to the other processes of the kiosk.
+static void shareSlot(Session *s, FramePipeline::Slot *slot)
+{
+	PoseShareEntry	*e = poseShareNext(s->share);
+	PoseShareTarget	*t = poseShareTargets(s->share, e);
+	ARUint8			*image;
+	size_t			i;
+
+	e->frame = slot->seq;
+	e->time = slot->time;
+	e->marker_num = slot->marker_num;
+	memcpy(e->marker_info, slot->marker_info, slot->marker_num * sizeof(ARMarkerInfo));
+	for (i = 0; i < s->target.size(); i++) {
+		t[i].pattern = s->target[i].pattern;
+		t[i].base = (s->target[i].base != NULL);
+		t[i].found = slot->pose[i].found;
+		memcpy(t[i].trans, slot->pose[i].trans, sizeof(t[i].trans));
+	}
+	if ((image = poseShareImage(s->share, e)) != NULL) memcpy(image, slot->image, s->share->imageBytes);
+	poseShareCommit(s->share, e);
+}
+
+// Sends the poses of the slot to the other tables and the dashboards.
+static void broadcastSlot(Session *s, FramePipeline::Slot *slot)
+{
+	size_t i;
+
+	broadcastBegin(s->broadcast, slot->seq, slot->stamp[0]);
+	for (i = 0; i < s->target.size(); i++)
+		broadcastTarget(s->broadcast, (int)i, s->target[i].pattern, slot->pose[i].found, slot->pose[i].trans);
+	broadcastEnd(s->broadcast);
+}
+
+// Writes the pose of each target into the slot, fitting those seen POSE_MAX
+// at a time. A marker seen with the corners its pose was last fitted to keeps
+// that pose. Run by the detect thread, or by Idle() with -onethread; what
+// the targets keep from the last frame is only the tracker's.
+static void trackSlot(FramePipeline::Slot *slot, void *data)
 {
-	static int ms_prev;
-	int ms;
-	float s_elapsed;
-	ARUint8 *image;
+	Session			*s = (Session *)data;
+	ARMarkerInfo	*marker[POSE_MAX];
+	int				which[POSE_MAX];
+	size_t			i;
+	int				k, n = 0;
+
+	slot->pose.resize(s->target.size());
+	for (i = 0; i < s->target.size(); i++) {
+		TrackTarget &t = s->target[i];
+		FramePipeline::Slot::Pose &pose = slot->pose[i];
+
+		k = slot->markerOf(t.pattern);
+		pose.found = (k != -1);
+		memcpy(pose.trans, t.trans, sizeof(pose.trans));
+		if (k == -1) { t.visible = FALSE; continue; }
+		if (t.visible && memcmp(t.vertex, slot->marker_info[k].vertex, sizeof(t.vertex)) == 0) continue;
+		memcpy(t.vertex, slot->marker_info[k].vertex, sizeof(t.vertex));
+
+		marker[n] = &slot->marker_info[k];
+		which[n++] = (int)i;
+		if (n == POSE_MAX) { fitPoses(s, slot, marker, which, n); n = 0; }
+	}
+	if (n > 0) fitPoses(s, slot, marker, which, n);
+	if (s->share) shareSlot(s, slot);
+	if (s->broadcast) broadcastSlot(s, slot);
+}
 
-	ARMarkerInfo    *marker_info;					// Pointer to array holding the details of detected markers.
-    int             marker_num;						// Count of number of markers detected.
+// Gives the actuators and bases of the session their poses of a frame.
+static void applyPoses(Session *s, const vector<FramePipeline::Slot::Pose> &pose, double time)
+{
+	size_t i;
+
+	for (i = 0; i < s->target.size() && i < pose.size(); i++) {
+		TrackTarget &t = s->target[i];
+		if (t.actuator != NULL) {
+			memcpy((*t.actuator).markerTrans, pose[i].trans, sizeof(pose[i].trans));
+			s->pattFound = (*t.actuator).updateActuatorPose(pose[i].found != 0, time);
+		} else {
+			memcpy((*t.base).markerTrans, pose[i].trans, sizeof(pose[i].trans));
+			s->pattFound = (*t.base).updateBasePose(pose[i].found != 0, time);
+		}
+	}
+}
+
+// Runs the frames of a recording through the rules of the sessions as fast
+// as they go, and reports how fast that is. The recording is read whole
+// first, so that only the rules are timed.
+static void simulate(const char *file)
+{
+	vector<ReplayFrame> frames;
+	double begin, seconds;
+	size_t f, k;
+	long n = 0;
+
+	if (replayLoad(file, frames) < 0) exit(-1);
+	for (k = 0; k < gSession.size(); k++) initTracking(gSession[k]);
+
+	begin = arUtilClock();
+	for (f = 0; f < frames.size(); f++) {
+		ReplayFrame &frame = frames[f];
+		if (frame.session < 0 || frame.session >= (int)gSession.size()) continue;
+		Session *s = gSession[frame.session];
+
+		applyPoses(s, frame.pose, frame.time);
+		(*s->arpe.myRules).tickAnimations(frame.time);
+		s->arpe.interactionControl();
+		n++;
+	}
+	seconds = arUtilClock() - begin;
+
+	printf("\n Simulated %ld frames in %.3f s: %.0f frames/s, %.1f us a frame", n, seconds,
+		(seconds > 0.0)? n / seconds: 0.0, (n > 0)? seconds * 1e6 / n: 0.0);
+	for (k = 0; k < gSession.size(); k++)
+		printf("\n Session %d ends in state %d", (int)k, gSession[k]->arpe.myRules->actualState);
+	printf("\n");
+}
+
+// A new level from the governor, for every pipeline and the swaps.
+static void governorApply(int level)
+{
+	GovernorModes modes;
+	size_t k;
+
+	if (level < 0) return;
+	governorModes(level, &modes);
+	for (k = 0; k < gSession.size(); k++) {
+		gSession[k]->pipeline.setModes(modes.imageProcMode, modes.pyramidMode, modes.detectEvery);
+	}
+	if (modes.swapInterval != gSwapInterval && arglSwapIntervalSet(modes.swapInterval)) gSwapInterval = modes.swapInterval;
+	printf("\n Governor: %s", governorLevelName(level));
+}
+
+static void Idle(void)
+{
+	double now, wait, spent;
+	FramePipeline::Slot *slot;
+	size_t k;
+	int fresh = FALSE;
 	
 
-	// Find out how long since Idle() last ran.
-	ms = glutGet(GLUT_ELAPSED_TIME);
-	s_elapsed = (float)(ms - ms_prev) * 0.001;
-	if (s_elapsed < 0.01f) return; // Don't update more often than 100 Hz.
-	ms_prev = ms;
+	// Begin the frame only when, drawn at once, it would be done just
+	// before the next display refresh, so it takes the newest detection.
+	now = glutGet(GLUT_ELAPSED_TIME) * 0.001;
+	wait = arglFramePacerWait(gPacer, now);
+	// The time until then goes to the work that can wait, see Slack.h.
+	spent = slackRun(wait);
+	if (wait > 0.0) {
+		if (wait - spent > 0.002) Sleep(1);
+		return;
+	}
+	AR_TRACE_SCOPE("Idle");
 	
 	// Update drawing.
 	arVrmlTimerUpdate();
 
-	gPatt_found = FALSE;	// Invalidate any previous detected markers.
-	
-	// Grab a video frame.
-	if ((image = arVideoGetImage()) != NULL) {
-		gARTImage = image;	// Save the fetched image.
-		
+	// Take the newest frame each pipeline has captured, detected and tracked.
+	// It stays ours, and the image of the session valid, until the next one
+	// is taken.
+	for (k = 0; k < gSession.size(); k++) {
+		Session *s = gSession[k];
+
+		s->fresh = FALSE;
+		if ((slot = s->pipeline.acquireReady()) == NULL) continue;
+		s->fresh = TRUE;
+		fresh = TRUE;
+		s->pattFound = FALSE;	// Invalidate any previous detected markers.
+		s->image = slot->image;
+		if (gLatency) {
+			memcpy(s->stamp, slot->stamp, sizeof(s->stamp));
+			s->stamp[LATENCY_WAIT + 1] = arVideoTime();
+			s->stamped = TRUE;
+		}
+		if (k == 0 && latencyLedActive()) gLatencyLed = latencyLed(s->image, s->cparam.xsize, s->cparam.ysize);
 		
 		gCallCountMarkerDetect++; // Increment ARToolKit FPS counter.
-		
-		// Detect the markers in the video frame.
-		if (arDetectMarker(gARTImage, gARTThreshhold, &marker_info, &marker_num) < 0) {
-			exit(-1);
-		}
+		if (gMetrics) metricsTaken(slot->marker_num);
+		if (gGovernor) governorFrame((int)k, slot->marker_info, slot->marker_num, s->cparam.xsize, slot->time);
 	
 		//--------------------------------------------------------------------------
-		// CHECK FOR ACTUATOR VISIBILITY
+		// ACTUATOR AND BASE VISIBILITY, FROM THE POSES OF THE SLOT
 		//--------------------------------------------------------------------------
-		
-		list<Actuator*>::iterator itAct;
-
-		for( itAct = arpe.listActuator.begin(); itAct != arpe.listActuator.end(); itAct++){
-
-			switch( (*(*itAct)).type){
-			case 1:{	// ---------------------------------------------------------TREAT ARToolKit Marker
-				ActuatorARTKSM* a = static_cast<ActuatorARTKSM*>(*itAct);
-				gPatt_found = (*a).searchActuatorOnFrame(&marker_info, marker_num);
-				break;}
-			default: break;
-			};
-		}
-
-
 
-		//--------------------------------------------------------------------------
-		// CHECK FOR BASE VISIBILITY
-		//--------------------------------------------------------------------------		
-
-		list<Base*>::iterator b;
-		list<InfraSource*>::iterator iSource;
-
-		for( b = arpe.listBase.begin() ; b != arpe.listBase.end() ; b++){
-			
-			for( iSource = (*(*(*b)).myInfraStructure).listSource.begin(); iSource != (*(*(*b)).myInfraStructure).listSource.end(); iSource++){
-				//printf("here");
-				//if( (*(*iSource)).onUse)
-					switch( (*(*iSource)).type ){
-					case 1: { // Source of tracking is ARTKSM
-						
-						InfraARTKSM* iS = static_cast<InfraARTKSM*>(*iSource);
-						gPatt_found = (*iS).searchBaseOnFrame(&marker_info, marker_num);
-						break;}
-					default: break;
-					};
-			}
-		}
+		if (!gTrackThread) trackSlot(slot, s);
+		if (gRecordFile) replayRecordFrame((int)k, slot->time, slot->pose);
+		applyPoses(s, slot->pose, slot->time);
+	}
+	if (gMetrics) {
+		long dropped = 0;
+		for (k = 0; k < gSession.size(); k++) dropped += gSession[k]->pipeline.droppedFrames();
+		metricsTick(dropped);
+	}
+	if (gGovernor) governorApply(governorTick(now));
+	if (!fresh) return;
 
-		//--------------------------------------------------------------------------
-		// CHECK FOR INTERATIONS
-		//--------------------------------------------------------------------------	
-		
-		arpe.interactionControl();
+	//--------------------------------------------------------------------------
+	// CHECK FOR INTERATIONS
+	//--------------------------------------------------------------------------	
+	
+	// The serial devices are polled and written once for all the sessions.
+	serialReactorRun();
+	for (k = 0; k < gSession.size(); k++) {
+		if (!gSession[k]->fresh) continue;
+		(*gSession[k]->arpe.myRules).tickAnimations(now);
+		gSession[k]->arpe.interactionControl();
+	}
+	serialReactorFlush();
+	for (k = 0; k < gSession.size(); k++) if (gSession[k]->fresh) gSession[k]->arpe.followAudio();
+	if (gLatency) {
+		long long t = arVideoTime();
+		for (k = 0; k < gSession.size(); k++) if (gSession[k]->fresh) gSession[k]->stamp[LATENCY_INTERACT + 1] = t;
+	}
 
-		// Tell GLUT to update the display.
+	// Tell GLUT to update the display.
+	arglFramePacerBegin(gPacer, now);
+	gFrameBegun = now;
+	glutSetWindow(gMainWindow);
+	glutPostRedisplay();
+	if (gMonitorWindow) {
+		glutSetWindow(gMonitorWindow);
 		glutPostRedisplay();
+		glutSetWindow(gMainWindow);
 	}
 }
 
@@ -566,8 +998,19 @@ static void Visibility(int visible)
 	}
 }
 
+// The sessions share the width of the window, side by side.
 static void Reshape(int w, int h)
 {
+	size_t i;
+	int n = (int)gSession.size();
+
+	for (i = 0; i < gSession.size(); i++) {
+		gSession[i]->view[0] = (int)i * w / n;
+		gSession[i]->view[1] = 0;
+		gSession[i]->view[2] = ((int)i + 1) * w / n - gSession[i]->view[0];
+		gSession[i]->view[3] = h;
+	}
+
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	glViewport(0, 0, (GLsizei) w, (GLsizei) h);
 	
@@ -579,27 +1022,22 @@ static void Reshape(int w, int h)
 	// Call through to anyone else who needs to know about window sizing here.
 }
 
-static void Display(void)
+// The video of the session and what it sees, in its viewport.
+static void drawSession(Session *s)
 {
-
     GLdouble p[16];
 //	GLdouble m[16];
-	
-	// Select correct buffer for this context.
-	glDrawBuffer(GL_BACK);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear the buffers for new frame.
-	
-	if (arpe.projection == false ) arglDispImage(gARTImage, &gARTCparam, 1.0, gArglSettings);	// zoom = 1.0.
-	arVideoCapNext();
-	gARTImage = NULL; // Image data is no longer valid after calling arVideoCapNext().
+
+	if ((s->arpe.projection == false || gDrawingMonitor) && s->image != NULL) arglDispImage(s->image, &s->cparam, 1.0, s->arglSettings);	// zoom = 1.0.
 				
-	if (gPatt_found) {
+	if (s->pattFound) {
 		
 		// Projection transformation.
-		arglCameraFrustumRH(&gARTCparam, VIEW_DISTANCE_MIN, VIEW_DISTANCE_MAX, p);
+		arglCameraFrustumRH(&s->cparam, VIEW_DISTANCE_MIN, VIEW_DISTANCE_MAX, p);
 		glMatrixMode(GL_PROJECTION);
 		glLoadMatrixd(p);
 		glMatrixMode(GL_MODELVIEW);
+		s->arpe.setViewFrustum(p);
 		
 		// Viewing transformation.
 		glLoadIdentity();
@@ -614,74 +1052,266 @@ static void Display(void)
 		//--------------------------------------------------------------------------
 		// Show BASE Objects
 		//--------------------------------------------------------------------------
-		list<Base*>::iterator b;
-
-		for( b = arpe.listBase.begin(); b != arpe.listBase.end(); b++){
-			if( (*(*(*b)).myInfraStructure).visible == 1){
-				//printf("\n Base %s is visible", (*(*b)).name);
-
-				(*(*b)).showBaseItens();
+		// Nearest first, so that the depth test rejects what they hide.
+		vector< pair<double, Base*> > drawBase;
+		size_t i;
+		int k;
+
+		for (k = 0; k < s->arpe.basePoses; k++) {
+			if (s->arpe.basePose[k].visible == 1) {
+				Base *b = s->arpe.poseBase[k];
+				//printf("\n Base %s is visible", (*b).name);
+				(*b).updateView();
+				drawBase.push_back(make_pair((*b).viewDepth, b));
 			}
 		}
+		sort(drawBase.begin(), drawBase.end());
+		for (i = 0; i < drawBase.size(); i++) (*drawBase[i].second).showBaseItens();
 
 		//--------------------------------------------------------------------------
 		// Show ACTUATOR Objects
 		//--------------------------------------------------------------------------
-		list<Actuator*>::iterator a;
-
-		for( a = arpe.listActuator.begin(); a != arpe.listActuator.end(); a++){
+		for (k = 0; k < s->arpe.actuatorPoses; k++) {
+			if (s->arpe.actuatorPose[k].visible != 1) continue;
+			ActuatorARTKSM* aASM = s->arpe.poseActuator[k];
+			if (!(*aASM).onUse) continue;
 			glPushMatrix();
-			
-			if( (*(*a)).onUse)
-				switch( (*(*a)).type){
-					case 1: {
-							ActuatorARTKSM* aASM = static_cast<ActuatorARTKSM*>(*a);
-							if( (*aASM).visible == 1) {
-								//printf("\n Actuator %s is visible", (*aASM).name);
-								(*aASM).showActuatorItens();
-							}
-							break;}
-					default: break;
-				};
+			//printf("\n Actuator %s is visible", (*aASM).name);
+			(*aASM).showActuatorItens();
 			glPopMatrix();
 		}
 
+		//--------------------------------------------------------------------------
+		// Show the blended Objects, back to front over all the others
+		//--------------------------------------------------------------------------
+		blendQueueDraw();
+
+	} // pattFound
+}
 
+static void prefetchTask(void *arg)
+{
+	size_t i;
 
+	glutSetWindow(gMainWindow);
+	for (i = 0; i < gSession.size(); i++) gSession[i]->arpe.prefetch();
+}
 
-	} // gPatt_found
+static void Display(void)
+{
+
+	double now, presented;
+	long long t;
+	size_t i;
+	AR_TRACE_SCOPE("Display");
+	
+	// Select correct buffer for this context.
+	glDrawBuffer(GL_BACK);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear the buffers for new frame.
+	
+	for (i = 0; i < gSession.size(); i++) {
+		glViewport(gSession[i]->view[0], gSession[i]->view[1], gSession[i]->view[2], gSession[i]->view[3]);
+		drawSession(gSession[i]);
+	}
+
+	// What the states to come show is loaded and drawn once, unseen, ahead,
+	// when there is time before the next frame.
+	slackPost(prefetchTask, NULL);
 	
 	// Any 2D overlays go here.
-	//none
+	// The corner the photodiode of -latencyled looks at.
+	if (latencyLedActive()) {
+		glPushAttrib(GL_COLOR_BUFFER_BIT | GL_SCISSOR_BIT);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(0, glutGet(GLUT_WINDOW_HEIGHT) - LATENCY_LED_SIZE, LATENCY_LED_SIZE, LATENCY_LED_SIZE);
+		glClearColor(gLatencyLed? 1.0f: 0.0f, gLatencyLed? 1.0f: 0.0f, gLatencyLed? 1.0f: 0.0f, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+		glPopAttrib();
+	}
 	
+	now = glutGet(GLUT_ELAPSED_TIME) * 0.001;
+	t = arVideoTime();
+	screenRecordRead();
+	AR_TRACE_BEGIN("glutSwapBuffers");
+	glutSwapBuffers();
+	AR_TRACE_END();
+	screenRecordCollect(t);
+	presented = glutGet(GLUT_ELAPSED_TIME) * 0.001;
+	arglFramePacerPresented(gPacer, now, presented);
+	if (gMetrics) metricsShown();
+	// Late when it missed the refresh it was begun for.
+	if (gGovernor) governorShown(gFrameBegun, presented, arglFramePacerPeriod(gPacer) * (gSwapInterval + 0.5));
+
+	// The frames taken are on the screen.
+	if (gLatency) {
+		for (i = 0; i < gSession.size(); i++) {
+			Session *s = gSession[i];
+			if (!s->stamped) continue;
+			s->stamp[LATENCY_DRAW + 1] = t;
+			s->stamp[LATENCY_SWAP + 1] = arVideoTime();
+			latencyFrame(s->stamp);
+			s->stamped = FALSE;
+		}
+	}
+	allocCheckFrame("GLUT");
+}
+
+// The see-through view of every session, for the operator, whatever the
+// projector shows. Drawn with the textures and models of the first window,
+// the video uploaded by whichever of the two draws the frame first.
+static void MonitorDisplay(void)
+{
+	int w = glutGet(GLUT_WINDOW_WIDTH), h = glutGet(GLUT_WINDOW_HEIGHT);
+	int n = (int)gSession.size();
+	size_t i;
+	AR_TRACE_SCOPE("MonitorDisplay");
+
+	glDrawBuffer(GL_BACK);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	gDrawingMonitor = TRUE;
+	for (i = 0; i < gSession.size(); i++) {
+		glViewport((int)i * w / n, 0, ((int)i + 1) * w / n - (int)i * w / n, h);
+		drawSession(gSession[i]);
+	}
+	gDrawingMonitor = FALSE;
 	glutSwapBuffers();
 }
 
+// Opens the window of -monitor, sharing the objects of the first.
+static void monitorOpen(void)
+{
+	size_t i;
+
+	glutInitWindowSize(gSession[0]->cparam.xsize * (int)gSession.size(), gSession[0]->cparam.ysize);
+	gMonitorWindow = glutCreateWindow("monitor");
+	for (i = 0; i < gSession.size(); i++) {
+		if (arglSetupForCurrentContextShared(gSession[i]->arglSettings) == NULL) break;
+	}
+	if (i < gSession.size()) {
+		printf("\n main(): unable to share the window objects, no monitor");
+		while (i-- > 0) arglCleanup(gSession[i]->arglSettings);
+		glutDestroyWindow(gMonitorWindow);
+		gMonitorWindow = 0;
+	} else {
+		arglSwapIntervalSet(0);		// The projector window waits for the refresh, not both.
+		glutDisplayFunc(MonitorDisplay);
+		glutKeyboardFunc(Keyboard);
+	}
+	glutSetWindow(gMainWindow);
+}
+
+// Adds the session of the configuration file and the video configuration.
+static void addSession(const char *config, const char *vconf)
+{
+	Session *s = new Session();
+
+	strncpy(s->arpe.configFilename, config, sizeof(s->arpe.configFilename) - 1);
+	strncpy(s->vconf, vconf, sizeof(s->vconf) - 1);
+	s->video = NULL;
+	s->handle = NULL;
+	s->pixFormat = AR_DEFAULT_PIXEL_FORMAT;
+	s->stride = 0;
+	s->image = NULL;
+	s->pattFound = FALSE;
+	s->fresh = FALSE;
+	s->stamped = FALSE;
+	s->share = NULL;
+	s->broadcast = NULL;
+	s->arglSettings = NULL;
+	gSession.push_back(s);
+}
+
 int main(int argc, char** argv)
 {
+	size_t k;
+
 	// Iniciar
+	logStart();
 	printf("\n glutInit()");
 	glutInit(&argc, argv);
+	arThreadRole(AR_THREAD_RENDER, "GLUT");
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "-bundle") == 0) gWriteBundle = TRUE;
+		else if (strcmp(argv[i], "-onethread") == 0) gTrackThread = FALSE;
+		else if (strcmp(argv[i], "-session") == 0 && i + 2 < argc) { addSession(argv[i + 1], argv[i + 2]); i += 2; }
+		else if (strcmp(argv[i], "-latency") == 0) gLatency = TRUE;
+		else if (strcmp(argv[i], "-trace") == 0) arTraceMode = AR_TRACE_ON;
+		else if (strcmp(argv[i], "-hugepages") == 0) arImagePageMode = AR_IMAGE_PAGE_HUGE;
+		else if (strcmp(argv[i], "-simd") == 0 && i + 1 < argc) { arCpuSetFeatures((int)strtol(argv[i + 1], NULL, 0)); arCpuDump(stdout); i++; }
+		else if (strcmp(argv[i], "-latencyled") == 0 && i + 2 < argc) { latencyLedSet(atoi(argv[i + 1]), atoi(argv[i + 2])); i += 2; }
+		else if (strcmp(argv[i], "-metrics") == 0 && i + 1 < argc) { gMetricsTarget = argv[i + 1]; gLatency = TRUE; i++; }
+		else if (strcmp(argv[i], "-alloccheck") == 0) gAllocCheck = TRUE;
+		else if (strcmp(argv[i], "-governor") == 0) gGovernor = TRUE;
+		else if (strcmp(argv[i], "-exposure") == 0) gExposure = TRUE;
+		else if (strcmp(argv[i], "-share") == 0) gShare = TRUE;
+		else if (strcmp(argv[i], "-shareframes") == 0) gShare = gShareFrames = TRUE;
+		else if (strcmp(argv[i], "-broadcast") == 0 && i + 1 < argc) { gBroadcastTarget = argv[i + 1]; i++; }
+		else if (strcmp(argv[i], "-record") == 0 && i + 1 < argc) { gRecordFile = argv[i + 1]; i++; }
+		else if (strcmp(argv[i], "-screenrecord") == 0 && i + 1 < argc) { gScreenRecordFile = argv[i + 1]; i++; }
+		else if (strcmp(argv[i], "-monitor") == 0) gMonitor = TRUE;
+		else if (strcmp(argv[i], "-simulate") == 0 && i + 1 < argc) { gSimulateFile = argv[i + 1]; i++; }
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) { if (arThreadRoleLoad(argv[i + 1]) > 0) arThreadRoleDump(stdout); i++; }
+#ifdef _WIN32
+	if (gSession.empty()) addSession("Data/config_basar", "Data\\WDM_camera_flipV.xml");
+#else
+	if (gSession.empty()) addSession("Data/config_basar", "");
+#endif
 
-	initAppData();
+	arVrmlSetMemoryBudget(VRML_BUDGET_GPU_KB, VRML_BUDGET_CPU_KB);
 
-	// START SOUNDTRACK AUDIO
-	if( arpe.soundTrack != 0){
-		arpe.soundTrack->play2D();
+	// The text files are read for what the bundle doesn't have.
+	startupBegin(STARTUP_CONFIG);
+	if (!gWriteBundle) cfgBundleLoad(CONFIG_BUNDLE);
+	startupEnd();
+	for (k = 0; k < gSession.size(); k++) initAppData(gSession[k]);
+	if (gSimulateFile) {
+		simulate(gSimulateFile);
+		return (0);
 	}
+	startupBegin(STARTUP_SERIAL);
+	serialReactorStart();
+	startupEnd();
+	if (gWriteBundle) cfgBundleWrite(CONFIG_BUNDLE);
+	startupReport();
+
+	for (k = 0; k < gSession.size(); k++) {
+		Arpe &arpe = gSession[k]->arpe;
+
+		// START SOUNDTRACK AUDIO
+		if( arpe.soundTrack != 0){
+			arpe.soundTrack->play2D();
+		}
 
-	// START INTRODUCTION AUDIO
-	if( arpe.startAudio != 0){
-		arpe.startAudio->play2D();
+		// START INTRODUCTION AUDIO
+		if( arpe.startAudio != 0){
+			arpe.startAudio->play2D();
+		}
 	}
 		
+	if (gMonitor) monitorOpen();
 	glutDisplayFunc(Display);
 	glutReshapeFunc(Reshape);
 	glutVisibilityFunc(Visibility);
 	glutKeyboardFunc(Keyboard);
+
+	// Capture, detection and tracking run on their own threads from here on.
+	if (gBroadcastTarget != NULL) broadcastStart(gBroadcastTarget);
+	if (gRecordFile != NULL && replayRecordStart(gRecordFile) < 0) gRecordFile = NULL;
+	if (gScreenRecordFile != NULL) screenRecordStart(gScreenRecordFile);
+	for (k = 0; k < gSession.size(); k++) {
+		Session *s = gSession[k];
+		initTracking(s);
+		s->broadcast = broadcastSessionCreate((int)k, (int)s->target.size());
+		if (gShare) s->share = poseShareOpen((int)k, (int)s->target.size(), s->cparam.xsize, s->cparam.ysize, s->pixFormat, s->stride, gShareFrames);
+		if (!s->pipeline.start(s->cparam.xsize, s->cparam.ysize, s->stride, &gARTThreshhold)) {
+			fprintf(stderr, "main(): Unable to start the frame pipeline.\n");
+			exit(-1);
+		}
+	}
+	if (gMetricsTarget != NULL && metricsStart(gMetricsTarget) == 0) gMetrics = TRUE;
+	if (gAllocCheck) allocCheckStart();
 	
 	glutMainLoop();
 
 	return (0);
 }
-
@@ -1,8 +1,12 @@
 #include "uIdent.h"
 
+#include <string.h>
+
 
 uIdent::uIdent(void)
 {
+	strcpy(this->name,"");
+	strcpy(this->basARID,"");
 }
 
 
@@ -0,0 +1,442 @@
+/*
+ *   Trains a pattern from recordings of its marker.
+ *
+ *   Plays recordings of ar2VideoRecordOpen() with the file video
+ *   module (AR_INPUT_FILE) and takes, on every frame, the square of
+ *   the marker: the one arGetCodeCtx() matches best to the pattern
+ *   of -seed, or the largest without one. Its samples in the four
+ *   directions, as arSavePatt() would save them, are turned to agree
+ *   best with the ones taken before, or with the seed, and summed;
+ *   a square that agrees less than -cf is left out as not the marker.
+ *   The mean of the samples is loaded with arLoadPattData() and added
+ *   to the pattern bundle of -bundle, and written as a pattern file
+ *   with -patt.
+ *
+ *   The frames are read a batch at a time and shared out among the
+ *   worker threads, each with its own ARHandle, thread t taking
+ *   frames t, t+threads, ... The samples are summed in the order of
+ *   the frames, so the pattern does not depend on the threads.
+ *
+ *   trainPatt [options] recording [recording ...]
+ *     -cparam=file    camera parameters (default Data/camera_para.dat)
+ *     -seed=file      a pattern of the marker, to find it among others
+ *     -cf=C           least agreement of a square (default 0.7)
+ *     -thresh=N       labeling threshold (default 100)
+ *     -step=N         every Nth frame (default 1)
+ *     -threads=N      worker threads (default 4)
+ *     -bundle=file    the bundle the pattern is added to (default Data/patterns.bun)
+ *     -patt=file      also write the pattern as a file
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <AR/config.h>
+#include <AR/param.h>
+#include <AR/ar.h>
+#include <AR/video.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <process.h>
+#else
+#  include <pthread.h>
+#endif
+
+#define     TRAIN_RECORDING_MAX   32
+#define     TRAIN_BATCH           4       /* frames of a batch for each thread */
+#define     TRAIN_PARAM_MAX       8
+#define     TRAIN_LEN             (AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3)
+
+typedef struct {
+    ARUint8   *image;
+    int        squares;
+    int        found;
+    ARUint8    pat[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3];
+} TrainFrame;
+
+typedef struct {
+    ARHandle   *handle;
+    TrainFrame *frame;
+    int         frame_num;
+    int         first;
+    int         interval;
+} TrainJob;
+
+static char        *cparam_name = "Data/camera_para.dat";
+static char        *seed_name = NULL;
+static char        *bundle_name = "Data/patterns.bun";
+static char        *patt_name = NULL;
+static double       cf_min = 0.7;
+static int          thresh = 100;
+static int          step = 1;
+static int          thread_num = 4;
+
+static int          seed = -1;
+static double       seed_ref[TRAIN_LEN];
+static double       sum[4][TRAIN_LEN];
+static int          sample_num = 0;
+static int          frame_total = 0;
+static int          square_total = 0;
+static int          rejected = 0;
+
+static int     train_recording( char *file );
+static void    run_batch( ARHandle *handle[], TrainFrame frame[], int frame_num );
+static void    do_job( TrainJob *job );
+static void    sample_frame( ARHandle *handle, TrainFrame *f );
+static void    add_sample( ARUint8 pat[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3] );
+static double  correlate( const ARUint8 *p, const double *ref );
+static int     save_pattern( char *cparam_file );
+static void    usage( char *com );
+
+#ifdef _WIN32
+static unsigned __stdcall train_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_job( (TrainJob *)arg );
+    return 0;
+}
+#else
+static void *train_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_job( (TrainJob *)arg );
+    return NULL;
+}
+#endif
+
+int main( int argc, char *argv[] )
+{
+    char       *recording[TRAIN_RECORDING_MAX];
+    int         recording_num = 0;
+    ARInt16     samples[4][TRAIN_LEN];
+    double      pow[4];
+    int         i;
+
+    for( i = 1; i < argc; i++ ) {
+        if( strncmp( argv[i], "-cparam=", 8 ) == 0 )       cparam_name = &argv[i][8];
+        else if( strncmp( argv[i], "-seed=", 6 ) == 0 )    seed_name   = &argv[i][6];
+        else if( strncmp( argv[i], "-cf=", 4 ) == 0 )      cf_min      = atof( &argv[i][4] );
+        else if( strncmp( argv[i], "-thresh=", 8 ) == 0 )  thresh      = atoi( &argv[i][8] );
+        else if( strncmp( argv[i], "-step=", 6 ) == 0 )    step        = atoi( &argv[i][6] );
+        else if( strncmp( argv[i], "-threads=", 9 ) == 0 ) thread_num  = atoi( &argv[i][9] );
+        else if( strncmp( argv[i], "-bundle=", 8 ) == 0 )  bundle_name = &argv[i][8];
+        else if( strncmp( argv[i], "-patt=", 6 ) == 0 )    patt_name   = &argv[i][6];
+        else if( argv[i][0] == '-' ) usage( argv[0] );
+        else {
+            if( recording_num == TRAIN_RECORDING_MAX ) { printf("Too many recordings.\n"); exit(0); }
+            recording[recording_num++] = argv[i];
+        }
+    }
+    if( recording_num == 0 || step < 1 || thread_num < 1 ) usage( argv[0] );
+    if( thread_num > AR_BATCH_THREADS_MAX ) thread_num = AR_BATCH_THREADS_MAX;
+
+    if( seed_name != NULL ) {
+        if( (seed = arLoadPatt( seed_name )) < 0 ) {
+            printf("Pattern %s load error !!\n", seed_name);
+            exit(0);
+        }
+        // The samples of the library are 255 less the image, less their
+        // mean: turned back to the sign of the image.
+        arGetPattSamples( seed, samples, pow );
+        for( i = 0; i < TRAIN_LEN; i++ ) seed_ref[i] = -samples[0][i];
+    }
+    arTrackingMode = AR_TRACKING_OFF;
+
+    for( i = 0; i < recording_num; i++ ) train_recording( recording[i] );
+
+    printf("%d frames, %d squares, %d samples, %d left out.\n",
+           frame_total, square_total, sample_num, rejected);
+    if( sample_num == 0 ) {
+        printf("No sample of the marker.\n");
+        exit(0);
+    }
+    if( seed >= 0 ) arFreePatt( seed );
+    if( save_pattern( cparam_name ) < 0 ) exit(0);
+
+    return 0;
+}
+
+static int train_recording( char *file )
+{
+    char            vconf[512];
+    AR2VideoParamT *vid;
+    ARParam         wparam, cparam;
+    ARHandle       *handle[AR_BATCH_THREADS_MAX];
+    TrainFrame     *frame;
+    ARUint8        *image;
+    int             xsize, ysize;
+    int             format, stride, size;
+    int             batch, frame_num, n, count;
+    int             i, t;
+
+    sprintf( vconf, "-file=%s -rate=0", file );
+    if( (vid = ar2VideoOpen( vconf )) == NULL ) return -1;
+    ar2VideoInqSize( vid, &xsize, &ysize );
+    if( ar2VideoInqPixelFormat( vid, &format, &stride ) < 0 ) {
+        format = AR_DEFAULT_PIXEL_FORMAT;
+        stride = xsize * AR_PIX_SIZE_DEFAULT;
+    }
+    size = stride * ysize;
+
+    if( arParamLoad( cparam_name, 1, &wparam ) < 0 ) {
+        printf("Camera parameter load error !!\n");
+        ar2VideoClose( vid );
+        return -1;
+    }
+    arParamChangeSize( &wparam, xsize, ysize, &cparam );
+    arInitCparam( &cparam );
+    for( t = 0; t < thread_num; t++ ) {
+        if( (handle[t] = arCreateHandle( &cparam )) == NULL
+         || arSetPixelFormatCtx( handle[t], format ) < 0 ) {
+            printf("%s: the frames can't be detected.\n", file);
+            if( handle[t] != NULL ) t++;
+            while( t-- > 0 ) arDeleteHandle( handle[t] );
+            ar2VideoClose( vid );
+            return -1;
+        }
+        // The frames are already spread over the threads.
+        handle[t]->threads = 1;
+        handle[t]->roiMode = AR_ROI_FULL_FRAME;
+        handle[t]->codeCacheMode = AR_CODE_CACHE_OFF;
+        if( format == AR_PIXEL_FORMAT_MONO ) handle[t]->lumaStride = stride;
+    }
+
+    batch = thread_num * TRAIN_BATCH;
+    arMalloc( frame, TrainFrame, batch );
+    for( i = 0; i < batch; i++ ) arMalloc( frame[i].image, ARUint8, size );
+
+    count = 0;
+    if( ar2VideoCapStart( vid ) == 0 ) {
+        do {
+            // The video module keeps one frame: copied out for the threads.
+            frame_num = 0;
+            while( frame_num < batch && (image = ar2VideoGetImage( vid )) != NULL ) {
+                if( count++ % step == 0 ) memcpy( frame[frame_num++].image, image, size );
+                ar2VideoCapNext( vid );
+            }
+            run_batch( handle, frame, frame_num );
+            for( n = 0; n < frame_num; n++ ) {
+                square_total += frame[n].squares;
+                if( frame[n].found ) add_sample( frame[n].pat );
+            }
+            frame_total += frame_num;
+        } while( frame_num == batch );
+        ar2VideoCapStop( vid );
+    }
+
+    for( i = 0; i < batch; i++ ) free( frame[i].image );
+    free( frame );
+    for( t = 0; t < thread_num; t++ ) arDeleteHandle( handle[t] );
+    ar2VideoClose( vid );
+
+    return 0;
+}
+
+static void run_batch( ARHandle *handle[], TrainFrame frame[], int frame_num )
+{
+    TrainJob  job[AR_BATCH_THREADS_MAX];
+#ifdef _WIN32
+    HANDLE    tid[AR_BATCH_THREADS_MAX];
+#else
+    pthread_t tid[AR_BATCH_THREADS_MAX];
+#endif
+    int       started[AR_BATCH_THREADS_MAX];
+    int       n, t;
+
+    n = (thread_num < frame_num)? thread_num: frame_num;
+    for( t = 0; t < n; t++ ) {
+        job[t].handle    = handle[t];
+        job[t].frame     = frame;
+        job[t].frame_num = frame_num;
+        job[t].first     = t;
+        job[t].interval  = n;
+    }
+
+    for( t = 1; t < n; t++ ) {
+#ifdef _WIN32
+        tid[t] = (HANDLE)_beginthreadex( NULL, 0, train_thread, &job[t], 0, NULL );
+        started[t] = (tid[t] != 0);
+#else
+        started[t] = (pthread_create( &tid[t], NULL, train_thread, &job[t] ) == 0);
+#endif
+    }
+    if( n > 0 ) do_job( &job[0] );
+    for( t = 1; t < n; t++ ) {
+        if( !started[t] ) {
+            do_job( &job[t] );
+            continue;
+        }
+#ifdef _WIN32
+        WaitForSingleObject( tid[t], INFINITE );
+        CloseHandle( tid[t] );
+#else
+        pthread_join( tid[t], NULL );
+#endif
+    }
+}
+
+static void do_job( TrainJob *job )
+{
+    int     i;
+
+    for( i = job->first; i < job->frame_num; i += job->interval ) {
+        sample_frame( job->handle, &job->frame[i] );
+    }
+}
+
+static void sample_frame( ARHandle *handle, TrainFrame *f )
+{
+    ARInt16        *limage;
+    ARMarkerInfo2  *marker_info2;
+    int             label_num, marker2_num;
+    int            *area, *clip, *label_ref;
+    double         *pos;
+    int             code, dir;
+    double          cf, best_v;
+    int             best, k;
+
+    f->squares = 0;
+    f->found   = 0;
+    handle->auto_thresh = 0;
+    handle->auto_lost   = 0;
+    limage = arLabelingCtx( handle, f->image, thresh,
+                            &label_num, &area, &pos, &clip, &label_ref );
+    if( limage == NULL ) return;
+    marker_info2 = arDetectMarker2Ctx( handle, limage, label_num, label_ref,
+                                       area, pos, clip, AR_AREA_MAX, AR_AREA_MIN,
+                                       1.0, &marker2_num );
+    if( marker_info2 == NULL || marker2_num <= 0 ) return;
+    f->squares = marker2_num;
+
+    best   = -1;
+    best_v = 0.0;
+    for( k = 0; k < marker2_num; k++ ) {
+        if( seed >= 0 ) {
+            if( arGetCodeCtx( handle, f->image, marker_info2[k].x_coord, marker_info2[k].y_coord,
+                              marker_info2[k].vertex, &code, &dir, &cf ) < 0 ) continue;
+            if( code != seed || cf < cf_min || cf <= best_v ) continue;
+            best_v = cf;
+        }
+        else {
+            if( marker_info2[k].area <= best_v ) continue;
+            best_v = marker_info2[k].area;
+        }
+        best = k;
+    }
+    if( best < 0 ) return;
+
+    if( arGetPattSquareCtx( handle, f->image, &marker_info2[best], f->pat ) == 0 ) f->found = 1;
+}
+
+static void add_sample( ARUint8 pat[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3] )
+{
+    const double   *ref;
+    double          v, best_v;
+    int             best, h, i;
+
+    // Without a seed the first sample sets the direction of the others.
+    ref  = (seed >= 0)? seed_ref: (sample_num > 0)? sum[0]: NULL;
+    best = 0;
+    if( ref != NULL ) {
+        best_v = -2.0;
+        for( h = 0; h < 4; h++ ) {
+            v = correlate( &pat[h][0][0][0], ref );
+            if( v > best_v ) { best_v = v; best = h; }
+        }
+        if( best_v < cf_min ) {
+            rejected++;
+            return;
+        }
+    }
+
+    for( h = 0; h < 4; h++ ) {
+        for( i = 0; i < TRAIN_LEN; i++ ) sum[h][i] += (&pat[(best+h)%4][0][0][0])[i];
+    }
+    sample_num++;
+}
+
+/* Normalized correlation, of the samples and ref each less its mean. */
+static double correlate( const ARUint8 *p, const double *ref )
+{
+    double  pm, rm, a, b, pp, rr, pr;
+    int     i;
+
+    pm = rm = 0.0;
+    for( i = 0; i < TRAIN_LEN; i++ ) { pm += p[i]; rm += ref[i]; }
+    pm /= TRAIN_LEN;
+    rm /= TRAIN_LEN;
+
+    pp = rr = pr = 0.0;
+    for( i = 0; i < TRAIN_LEN; i++ ) {
+        a = p[i] - pm;
+        b = ref[i] - rm;
+        pp += a * a;
+        rr += b * b;
+        pr += a * b;
+    }
+    if( pp == 0.0 || rr == 0.0 ) return 0.0;
+
+    return pr / sqrt( pp * rr );
+}
+
+static int save_pattern( char *cparam_file )
+{
+    ARUint8     mean[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3];
+    ARParam     param[TRAIN_PARAM_MAX];
+    int         id[AR_PATT_NUM_MAX];
+    int         param_num, id_num;
+    FILE       *fp;
+    int         h, i;
+
+    for( h = 0; h < 4; h++ ) {
+        for( i = 0; i < TRAIN_LEN; i++ ) {
+            (&mean[h][0][0][0])[i] = (ARUint8)(sum[h][i] / sample_num + 0.5);
+        }
+    }
+    if( patt_name != NULL && arWritePatt( patt_name, mean ) < 0 ) {
+        printf("Cannot write %s.\n", patt_name);
+        return -1;
+    }
+
+    // Added to the bundle when there is one, made with the camera otherwise.
+    param_num = id_num = 0;
+    if( (fp = fopen( bundle_name, "rb" )) != NULL ) {
+        fclose( fp );
+        if( arLoadBundle( bundle_name, param, TRAIN_PARAM_MAX, &param_num,
+                          id, AR_PATT_NUM_MAX - 1, &id_num ) < 0 ) return -1;
+    }
+    else {
+        if( arParamLoad( cparam_file, 1, &param[0] ) < 0 ) {
+            printf("Camera parameter load error !!\n");
+            return -1;
+        }
+        param_num = 1;
+    }
+    if( (id[id_num] = arLoadPattData( mean )) < 0 ) {
+        printf("The pattern can't be loaded.\n");
+        return -1;
+    }
+    id_num++;
+    if( arSaveBundle( bundle_name, param, param_num, id, id_num ) < 0 ) {
+        printf("Cannot write %s.\n", bundle_name);
+        return -1;
+    }
+    printf("Pattern %d of %s.\n", id_num - 1, bundle_name);
+
+    return 0;
+}
+
+static void usage( char *com )
+{
+    printf("Usage: %s [options] recording [recording ...]\n", com);
+    printf("  -cparam=file    camera parameters (default Data/camera_para.dat)\n");
+    printf("  -seed=file      a pattern of the marker, to find it among others\n");
+    printf("  -cf=C           least agreement of a square (default 0.7)\n");
+    printf("  -thresh=N       labeling threshold (default 100)\n");
+    printf("  -step=N         every Nth frame (default 1)\n");
+    printf("  -threads=N      worker threads (default 4)\n");
+    printf("  -bundle=file    the bundle the pattern is added to (default Data/patterns.bun)\n");
+    printf("  -patt=file      also write the pattern as a file\n");
+    exit(0);
+}
@@ -63,6 +63,34 @@ extern "C" {
 { if( ((V) = (T *)malloc( sizeof(T) * (S) )) == 0 ) \
 {printf("malloc error!!\n"); exit(1);} }
 
+/** \def arMallocTag(V,T,S,G)
+* \brief allocation macro function, accounted to a subsystem
+*
+* allocate S elements of type T with arMemAlloc(), to be freed with
+* arMemFree().
+* \param V returned allocated area pointer
+* \param T type of element
+* \param S number of elements
+* \param G subsystem, AR_MEM_AR to AR_MEM_ARPE
+*/
+#define arMallocTag(V,T,S,G)  \
+{ if( ((V) = (T *)arMemAlloc( (G), sizeof(T) * (S) )) == 0 ) \
+{printf("malloc error!!\n"); exit(1);} }
+
+/** \def arMallocImage(V,T,S,G)
+* \brief allocation macro function, for an image
+*
+* allocate S elements of type T with arImageAlloc(), to be freed with
+* arImageFree().
+* \param V returned allocated area pointer
+* \param T type of element
+* \param S number of elements
+* \param G subsystem, AR_MEM_AR to AR_MEM_ARPE
+*/
+#define arMallocImage(V,T,S,G)  \
+{ if( ((V) = (T *)arImageAlloc( (G), sizeof(T) * (S) )) == 0 ) \
+{printf("malloc error!!\n"); exit(1);} }
+
 /* overhead ARToolkit type*/
 typedef char              ARInt8;
 typedef short             ARInt16;
@@ -161,8 +189,10 @@ typedef struct {
 * \param area number of pixels in the labeled region
 * \param pos position of the center of the marker (in observed screen coordinates)
 * \param coord_num numer of pixels in the contour.
-* \param x_coord x coordinate of the pixels of contours (size limited by AR_CHAIN_MAX).
-* \param y_coord y coordinate of the pixels of contours (size limited by AR_CHAIN_MAX).
+* \param x_coord x coordinate of the pixels of contours. Points into the contour
+*                pool of the ARHandle that traced it, valid until its next
+*                arDetectMarker2Ctx().
+* \param y_coord y coordinate of the pixels of contours (same storage as x_coord).
 * \param vertex position of the vertices of the marker. (in observed screen coordinates)
 		 rem:the first vertex is stored again as the 5th entry in the array  for convenience of drawing a line-strip easier.
 * 
@@ -171,11 +201,48 @@ typedef struct {
     int     area;
     double  pos[2];
     int     coord_num;
-    int     x_coord[AR_CHAIN_MAX];
-    int     y_coord[AR_CHAIN_MAX];
+    int    *x_coord;
+    int    *y_coord;
     int     vertex[5];
 } ARMarkerInfo2;
 
+/** \struct ARMarkerList
+* \brief markers detected in one image by arDetectMarkerBatch().
+*
+* \param marker_info detected markers, allocated with malloc(), NULL if none
+* \param marker_num number of detected markers, -1 if the detection failed
+*/
+typedef struct {
+    ARMarkerInfo  *marker_info;
+    int            marker_num;
+} ARMarkerList;
+
+/** \struct ARPoseFilter
+* \brief state of the pose filter of one marker or multi-marker.
+*
+* Set up with arPoseFilterInit(). The cutoffs may be changed afterwards.
+* \param min_cutoff cutoff frequency (Hz) of a still pose; lower is smoother
+* \param beta_pos increase of the cutoff per mm/s of the position
+* \param beta_rot increase of the cutoff per rad/s of the rotation
+* \param init 1 once a pose has been given
+* \param time time of the last pose (in seconds)
+* \param pos filtered position
+* \param vel velocity of the position (per second)
+* \param quat filtered rotation (x, y, z, w)
+* \param omega angular velocity (rotation vector per second)
+*/
+typedef struct {
+    double  min_cutoff;
+    double  beta_pos;
+    double  beta_rot;
+    int     init;
+    double  time;
+    double  pos[3];
+    double  vel[3];
+    double  quat[4];
+    double  omega[3];
+} ARPoseFilter;
+
 // ============================================================================
 //	Public globals.
 // ============================================================================
@@ -219,10 +286,91 @@ extern int      arFittingMode;
 * the possible values are :
 * - AR_IMAGE_PROC_IN_FULL: full image uses.
 * - AR_IMAGE_PROC_IN_HALF: half image uses.
+* - AR_IMAGE_PROC_IN_HALF_REFINED: the squares are found in the half
+*   image, then their edges are fitted again on the full image as with
+*   AR_EDGE_REFINE_SUBPIXEL and their patterns are read from it, for the
+*   corner accuracy of AR_IMAGE_PROC_IN_FULL.
 * by default: DEFAULT_IMAGE_PROC_MODE in config.h
 */
 extern int      arImageProcMode;
 
+/** \var int arLabelingMode
+* \brief define the connected component labeling algorithm.
+*
+* the possible values are :
+* - AR_LABELING_BY_PIXEL: two-pass labeling of single pixels.
+* - AR_LABELING_BY_RUN: labeling of horizontal runs of dark pixels,
+*   merged across rows. Faster on busy backgrounds. Not used in debug mode.
+* by default: DEFAULT_LABELING_MODE in config.h
+*/
+extern int      arLabelingMode;
+
+/** \var int arThresholdMode
+* \brief define how dark pixels are told from bright ones.
+*
+* the possible values are :
+* - AR_THRESHOLD_MANUAL: the thresh argument of the detection functions is used.
+* - AR_THRESHOLD_ADAPTIVE: each pixel is compared with the mean brightness
+*   of its neighbourhood (blocks of AR_ADAPTIVE_THRESH_BLOCK pixels), so
+*   uneven lighting does not hide markers. The thresh argument is ignored.
+* - AR_THRESHOLD_AUTO: the threshold is set from the brightness inside and
+*   around the squares found in the previous frame. The thresh argument is
+*   used until squares are found, and again once none were seen for
+*   AR_AUTO_THRESH_LOST_MAX frames.
+* by default: DEFAULT_THRESHOLD_MODE in config.h
+*/
+extern int      arThresholdMode;
+
+/** \var int arROIMode
+* \brief define which part of the image is searched for markers.
+*
+* the possible values are :
+* - AR_ROI_FULL_FRAME: the whole image is labeled every frame.
+* - AR_ROI_TRACKING: once markers are found, only boxes around them
+*   (grown by AR_ROI_MARGIN of their size) are labeled in the next frames.
+*   The whole image is labeled again every AR_ROI_FULL_SCAN_INTERVAL
+*   frames, and as soon as one of the tracked markers is lost.
+* - AR_ROI_MOTION: only the blocks of AR_MOTION_BLOCK pixels that changed
+*   since they were last labeled, and the blocks around them, are labeled;
+*   the markers of the previous frame that lie wholly in the other blocks
+*   are kept as they were, and when no block changed the markers of the
+*   previous frame are given again without any labeling. A block changed
+*   when its pixels, taken every AR_MOTION_STEP pixels across and down,
+*   differ by more than AR_MOTION_DIFF grey levels on average. The whole
+*   image is labeled again every AR_MOTION_FULL_SCAN_INTERVAL frames, and
+*   when more than AR_SQUARE_MAX boxes would be needed. Only
+*   arDetectMarkerCtx() and the functions calling it gate by motion.
+* by default: DEFAULT_ROI_MODE in config.h
+*/
+extern int      arROIMode;
+
+/** \var int arPyramidMode
+* \brief define the resolution at which square candidates are searched.
+*
+* the possible values are :
+* - AR_PYRAMID_OFF: candidates are searched as set by arImageProcMode.
+* - AR_PYRAMID_HALF: candidates are searched in the half size image.
+* - AR_PYRAMID_QUARTER: candidates are searched in the quarter size image.
+* In both pyramid modes the contour of each candidate is traced again in
+* the full size image, so line fitting and pattern matching keep full
+* resolution accuracy. arImageProcMode is then ignored.
+* by default: DEFAULT_PYRAMID_MODE in config.h
+*/
+extern int      arPyramidMode;
+
+/** \var int arLabelingThreads
+* \brief number of threads labeling each image.
+*
+* When greater than 1, the image is cut into that many horizontal bands
+* (at most AR_LABELING_THREADS_MAX, of at least AR_LABELING_BAND_MIN rows)
+* that are binarized and labeled in parallel, then merged along their
+* seams. Labeling is then done by runs whatever arLabelingMode is, and
+* the labels are the same as with one thread. Frames labeled in
+* AR_ROI_TRACKING boxes and debug mode use one thread.
+* by default: DEFAULT_LABELING_THREADS in config.h
+*/
+extern int      arLabelingThreads;
+
 /** \var ARParam arParam
 * \brief internal intrinsic camera parameter
 *
@@ -254,9 +402,12 @@ extern int      arImXsize, arImYsize;
 extern int      arTemplateMatchingMode;
 
 /** \var int arMatchingPCAMode
-* \brief XXXBK
+* \brief template matching on principal components
 *
-* XXXBK
+* With PCA, samples are compared with the patterns on the leading
+* eigenvectors of the loaded patterns, and full correlation is only
+* computed for the closest one. The eigenbasis is updated as patterns
+* are loaded, and needs at least 4 patterns.
 * the possible values are :
 * -AR_MATCHING_WITHOUT_PCA: without PCA
 * -AR_MATCHING_WITH_PCA: with PCA
@@ -264,6 +415,143 @@ extern int      arTemplateMatchingMode;
 */
 extern int      arMatchingPCAMode;
 
+/** \var int arPattDetectionMode
+* \brief kind of markers identified by arGetCode().
+*
+* the possible values are :
+* - AR_PATT_DETECTION_TEMPLATE: patterns loaded with arLoadPatt()
+* - AR_PATT_DETECTION_MATRIX: matrix codes, see arMatrixCodeDecode()
+* - AR_PATT_DETECTION_TEMPLATE_AND_MATRIX: matrix codes, then patterns
+*   for the squares that are not one
+* Matrix codes are reported with ids from AR_MATRIX_CODE_ID_BASE on.
+* by default: DEFAULT_PATT_DETECTION_MODE in config.h
+*/
+extern int      arPattDetectionMode;
+
+/** \var int arPattSamplingMode
+* \brief how arGetPatt() samples the inside of a marker.
+*
+* the possible values are :
+* - AR_PATT_SAMPLING_FULL: each pattern pixel is the mean of up to
+*   AR_PATT_SAMPLE_NUM/AR_PATT_SIZE_X squared samples, more for bigger markers
+* - AR_PATT_SAMPLING_FAST: one sample per pattern pixel, whatever the
+*   marker size
+* by default: DEFAULT_PATT_SAMPLING_MODE in config.h
+*/
+extern int      arPattSamplingMode;
+
+/** \var int arDistortionLUTSize
+* \brief memory budget of the distortion lookup table, in bytes.
+*
+* When positive, arInitCparam() and arCreateHandle() build a table of
+* observed to ideal coordinates with arParamLUTCreate(), that
+* arGetLineCtx() uses for contour points instead of the iterative
+* arParamObserv2Ideal(). The table is as dense as the budget allows:
+* 8 bytes per pixel for an exact table, a quarter of that per halving
+* of its resolution.
+* by default: DEFAULT_DISTORTION_LUT_SIZE in config.h (no table)
+*/
+extern int      arDistortionLUTSize;
+
+/** \var int arEdgeRefineMode
+* \brief refinement of the marker edges on the image.
+*
+* the possible values are :
+* - AR_EDGE_REFINE_OFF: the edges are the lines fitted to the contour
+*   pixels by arGetLine()
+* - AR_EDGE_REFINE_SUBPIXEL: each edge is fitted again to the points of
+*   strongest gradient across it, see arRefineLineCtx()
+* by default: DEFAULT_EDGE_REFINE_MODE in config.h
+*/
+extern int      arEdgeRefineMode;
+
+/** \var int arTrackingMode
+* \brief following of the markers from frame to frame.
+*
+* the possible values are :
+* - AR_TRACKING_OFF: every frame is labeled and its squares matched
+* - AR_TRACKING_EDGE: the markers identified by arDetectMarker() or
+*   arsDetectMarker() are then followed along their edges, see
+*   arTrackLineCtx(). The whole detection only runs again when one of
+*   them is lost and every AR_TRACKING_REDETECT_INTERVAL frames, which
+*   is also when new markers are found. On the frames in between the
+*   threshold is not used and no debug image is made.
+* by default: DEFAULT_TRACKING_MODE in config.h
+*/
+extern int      arTrackingMode;
+
+/** \var int arCodeCacheMode
+* \brief reuse of the pattern matching results of the last frame.
+*
+* the possible values are :
+* - AR_CODE_CACHE_OFF: arGetMarkerInfo() matches every square
+* - AR_CODE_CACHE_ON: a square at about the place and size of one
+*   identified with a confidence of at least AR_CODE_CACHE_CF in the
+*   last frame takes its id and confidence without being matched. The
+*   squares are matched again after AR_CODE_CACHE_VERIFY_INTERVAL frames.
+* by default: DEFAULT_CODE_CACHE_MODE in config.h
+*/
+extern int      arCodeCacheMode;
+
+/** \var int arStatsMode
+* \brief measurement of the stages of the detection.
+*
+* the possible values are :
+* - AR_STATS_OFF: nothing is measured
+* - AR_STATS_ON: each detection times its stages and counts what they
+*   find, see arGetStats(). The clock is read a few times per square.
+* by default: DEFAULT_STATS_MODE in config.h
+*/
+extern int      arStatsMode;
+
+/** \var int arTraceMode
+* \brief trace of the spans of the threads.
+*
+* the possible values are :
+* - AR_TRACE_OFF: AR_TRACE_BEGIN() only tests the mode
+* - AR_TRACE_ON: the spans are kept, the last AR_TRACE_EVENTS of each
+*   thread, for arTraceDump().
+* by default: DEFAULT_TRACE_MODE in config.h
+*/
+extern int      arTraceMode;
+
+/** \var int arImagePageMode
+* \brief pages of the images of arImageAlloc().
+*
+* the possible values are :
+* - AR_IMAGE_PAGE_NORMAL the pages of malloc().
+* - AR_IMAGE_PAGE_HUGE huge pages for the images of AR_IMAGE_HUGE_PAGE
+*   bytes or more, where the system gives them; fewer misses of the TLB
+*   as the labeling goes down the image.
+* by default: DEFAULT_IMAGE_PAGE_MODE in config.h
+*/
+extern int      arImagePageMode;
+
+/** \var int arPoseRefineMode
+* \brief refinement of the pose in arGetTransMat() and its variants.
+*
+* the possible values are :
+* - AR_POSE_REFINE_GRID: arModifyMatrix() searches the rotation angles
+*   on a shrinking grid, alternating with the translation
+* - AR_POSE_REFINE_GAUSS_NEWTON: rotation and translation are refined
+*   together by Levenberg-Marquardt steps on the reprojection error, for
+*   at most AR_POSE_REFINE_MAX_LOOP_COUNT steps
+* by default: DEFAULT_POSE_REFINE_MODE in config.h
+*/
+extern int      arPoseRefineMode;
+
+/** \var int arPixelFormat
+* \brief pixel format of the images given to the detection functions.
+*
+* One of the AR_PIXEL_FORMAT_* formats, so that one library can take
+* the images of cameras in different formats. The labeling and the
+* pattern sampling have code specialized for each format, picked when
+* the image is processed; AR_DEFAULT_PIXEL_FORMAT also has the vector
+* code paths.
+* by default: AR_DEFAULT_PIXEL_FORMAT in config.h
+*/
+extern int      arPixelFormat;
+
 // ============================================================================
 //	Public functions.
 // ============================================================================
@@ -328,11 +616,26 @@ ARUint32 arGetVersion(char **versionStringRef);
 */
 int arInitCparam( ARParam *param );
 
+/**
+* \brief initialize camera parameters at one of a set of sizes.
+*
+* arInitCparam() with the parameters and lookup table of sizes for
+* xsize x ysize, added to the set if it does not have them yet. Switching
+* back and forth between sizes already in the set computes nothing.
+* \param sizes camera parameters at each size, see arParamSizesInit()
+* \param xsize width of the images
+* \param ysize height of the images
+* \return 0 if success, -1 if the set is full.
+*/
+int arInitCparamSize( ARParamSizes *sizes, int xsize, int ysize );
+
 /**
 * \brief load markers description from a file
 *
 * load the bitmap pattern specified in the file filename into the pattern
 * matching array for later use by the marker detection routines.
+* The array grows as needed, so the number of patterns is not limited
+* by AR_PATT_NUM_MAX.
 * \param filename name of the file containing the pattern bitmap to be loaded
 * \return the identity number of the pattern loaded or 1 if the pattern load failed.
 */
@@ -362,6 +665,22 @@ int arLoadPatt( const char *filename );
 int arDetectMarker( ARUint8 *dataPtr, int thresh,
                     ARMarkerInfo **marker_info, int *marker_num );
 
+/**
+* \brief arDetectMarker() into an array owned by the caller.
+*
+* The markers found are copied to marker_info, which stays valid across
+* later detections. Markers beyond marker_max are dropped; AR_SQUARE_MAX
+* entries are always enough.
+* \param dataPtr a pointer to the color image which is to be searched for square markers.
+* \param thresh specifies the threshold value (between 0-255)
+* \param marker_info array receiving the markers found
+* \param marker_max number of entries of marker_info
+* \param marker_num the number of markers copied to marker_info.
+* \return 0 when the function completes normally, -1 otherwise
+*/
+int arDetectMarkerCopy( ARUint8 *dataPtr, int thresh,
+                        ARMarkerInfo marker_info[], int marker_max, int *marker_num );
+
 /**
 * \brief main function to detect rapidly the square markers in the video input frame.
 *
@@ -382,6 +701,22 @@ int arDetectMarker( ARUint8 *dataPtr, int thresh,
 int arDetectMarkerLite( ARUint8 *dataPtr, int thresh,
                         ARMarkerInfo **marker_info, int *marker_num );
 
+/**
+* \brief arDetectMarker() on the luma plane of a video frame.
+*
+* For planar YUV sources, where the Y plane can be used as it is, with
+* no conversion to the default pixel format. The patterns are sampled
+* in grey, so AR_TEMPLATE_MATCHING_BW suits them best.
+* \param luma the luma plane, one byte per pixel, of arImXsize x arImYsize pixels.
+* \param stride number of bytes from one line of the plane to the next, at least arImXsize
+* \param thresh specifies the threshold value (between 0-255)
+* \param marker_info a pointer to an array of ARMarkerInfo structures returned
+* \param marker_num the number of detected markers in the image.
+* \return 0 when the function completes normally, -1 otherwise
+*/
+int arDetectMarkerLuma( ARUint8 *luma, int stride, int thresh,
+                        ARMarkerInfo **marker_info, int *marker_num );
+
 /**
 * \brief compute camera position in function of detected markers.
 *
@@ -425,6 +760,71 @@ double arGetTransMat( ARMarkerInfo *marker_info,
 double arGetTransMatCont( ARMarkerInfo *marker_info, double prev_conv[3][4],
                           double center[2], double width, double conv[3][4] );
 
+/**
+* \brief compute the transformation matrices of many markers.
+*
+* Marker i gets the result of arGetTransMat(), or of arGetTransMatCont()
+* with conv[i] as previous matrix when cont[i] is set. The markers are
+* shared out among thread_num threads.
+* \param marker_info the markers, one pointer per marker
+* \param num number of markers
+* \param width sizes of the markers (in mm)
+* \param center physical centers of the markers
+* \param cont NULL, or num flags telling to use the history of conv[i]
+* \param conv num transformation matrices, read for the history and written
+* \param err num fitting errors, -1 for a marker with no pose
+* \param thread_num number of threads, at most AR_BATCH_THREADS_MAX
+* \return 0 if every marker got a pose, -1 otherwise.
+*/
+int arGetTransMatBatch( ARMarkerInfo *marker_info[], int num,
+                        double width[], double center[][2], int cont[],
+                        double conv[][3][4], double err[], int thread_num );
+
+/**
+* \brief set up a pose filter.
+*
+* Cutoffs from config.h, and no pose yet.
+* \param filter the filter
+* \return 0, -1 if filter is NULL.
+*/
+int arPoseFilterInit( ARPoseFilter *filter );
+
+/**
+* \brief forget the poses given to a filter.
+*
+* To be called when the marker is lost, so that the next pose starts afresh.
+* \param filter the filter
+*/
+void arPoseFilterReset( ARPoseFilter *filter );
+
+/**
+* \brief give a filter the pose measured at a time.
+*
+* A pose more than AR_POSE_FILTER_RESET_TIME after the previous one, or
+* before it, starts afresh.
+* \param filter the filter
+* \param conv the pose found by arGetTransMat() or arGetTransMatCont()
+* \param time time the image was captured (in seconds, e.g. arUtilTimer())
+* \param filtered receives the filtered pose at that time, may be NULL
+* \return 0, -1 on bad arguments.
+*/
+int arPoseFilterUpdate( ARPoseFilter *filter, double conv[3][4], double time,
+                        double filtered[3][4] );
+
+/**
+* \brief predict the pose at a time.
+*
+* The filtered pose moved on by its velocities, at most
+* AR_POSE_FILTER_PREDICT_MAX seconds past the last measure. Given the
+* time the frame will be displayed, this hides the latency of capture,
+* detection and rendering.
+* \param filter the filter
+* \param time time to predict the pose for (in seconds)
+* \param conv receives the predicted pose
+* \return 0, -1 if the filter has no pose.
+*/
+int arPoseFilterPredict( ARPoseFilter *filter, double time, double conv[3][4] );
+
 double arGetTransMat2( double rot[3][3], double pos2d[][2],
                        double pos3d[][2], int num, double conv[3][4] );
 double arGetTransMat3( double rot[3][3], double ppos2d[][2],
@@ -466,6 +866,91 @@ int arActivatePatt( int pat_no );
 */
 int arDeactivatePatt( int pat_no );
 
+/**
+* \brief activate and desactivate patterns at once.
+*
+* Sets each of the patterns patt_no to active or not, and rebuilds the
+* list the template matching goes through once. The new list is built
+* aside and then swapped in, so this may be called while another thread
+* detects markers, at most once per frame of that thread. Ids that are not
+* of a loaded pattern, matrix codes among them, are skipped.
+* \param patt_no numbers of the patterns
+* \param active for each of them, non-zero to activate it
+* \param num number of patterns
+* \return number of patterns set
+*/
+int arSetPattActive( const int *patt_no, const int *active, int num );
+
+/**
+* \brief list the active patterns.
+*
+* For a matcher of arSetPattMatcherCtx() to hold the library itself, e.g.
+* on the GPU. The list is that the template matching goes through.
+* \param patt_no where the numbers of the patterns go
+* \param max room in patt_no
+* \return number of active patterns, which may be more than max.
+*/
+int arGetPattActive( int *patt_no, int max );
+
+/**
+* \brief samples of a loaded pattern, as the template matching correlates them.
+*
+* For each of the four directions, the AR_PATT_SIZE_Y x AR_PATT_SIZE_X x 3
+* samples of the pattern less their mean, in -255..255, and the length of
+* that vector.
+* \param patt_no number of the pattern
+* \param samples where the samples go
+* \param pow where the lengths go
+* \return 0 if success, -1 if no pattern is loaded as patt_no.
+*/
+int arGetPattSamples( int patt_no, ARInt16 samples[4][AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3], double pow[4] );
+
+/**
+* \brief count of the changes to the pattern library.
+*
+* Goes up whenever a pattern is loaded, freed, activated or deactivated,
+* so that a copy of the library, e.g. on the GPU, knows to be made again.
+* \return the count.
+*/
+int arGetPattSerial( void );
+
+/**
+* \brief save camera parameters and patterns in a bundle.
+*
+* Writes a binary bundle of the given camera parameters and loaded
+* patterns, with their precomputed norms and PCA projections, in the
+* memory layout of the matcher: arLoadBundle() maps it instead of
+* parsing. The bundle is tied to the byte order and the pattern
+* layout of this build; load the text files with arParamLoad()
+* and arLoadPatt(), then save them here, to convert them.
+* \param filename name of the bundle file
+* \param param camera parameters to save
+* \param param_num number of camera parameters
+* \param patt_id ids of the patterns to save, as returned by arLoadPatt()
+* \param patt_num number of patterns
+* \return 0 if success, -1 if error
+*/
+int arSaveBundle( const char *filename, ARParam *param, int param_num,
+                  int patt_id[], int patt_num );
+
+/**
+* \brief load a bundle written by arSaveBundle().
+*
+* When no pattern is loaded yet, the mapped file becomes the pattern
+* table and nothing is recomputed. Otherwise the patterns are added
+* to the loaded ones as arLoadPatt() does.
+* \param filename name of the bundle file
+* \param param the camera parameters of the bundle
+* \param param_max size of param
+* \param param_num number of camera parameters loaded, or NULL
+* \param patt_id ids of the patterns, in the order they were saved
+* \param id_max size of patt_id
+* \param patt_num number of patterns loaded, or NULL
+* \return 0 if success, -1 if error (no bundle, other byte order or layout, too many entries)
+*/
+int arLoadBundle( const char *filename, ARParam *param, int param_max, int *param_num,
+                  int patt_id[], int id_max, int *patt_num );
+
 /**
 * \brief save a marker.
 *
@@ -479,6 +964,65 @@ int arDeactivatePatt( int pat_no );
 int arSavePatt( ARUint8 *image,
                 ARMarkerInfo *marker_info, char *filename );
 
+/**
+* \brief write the samples of a marker as arSavePatt() does.
+*
+* \param filename The name of the file where the bitmap image is to be saved.
+* \param ext_pat the samples of the four directions, as arGetPattSquareCtx() extracts them.
+* \return 0 if the file is written, -1 otherwise.
+*/
+int arWritePatt( const char *filename, ARUint8 ext_pat[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3] );
+
+/**
+* \brief load a marker from its samples.
+*
+* As arLoadPatt() of the file arWritePatt() would write, e.g. for a
+* pattern averaged from many captures.
+* \param data the samples of the four directions, as arGetPattSquareCtx() extracts them.
+* \return the identity of the loaded pattern.
+*/
+int arLoadPattData( ARUint8 data[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3] );
+
+/**
+* \brief load a marker by name.
+*
+* A name of the form "matrix:<code>" stands for the matrix code marker
+* of that code (0 to AR_MATRIX_CODE_NUM-1), and turns matrix code
+* detection on if arPattDetectionMode was AR_PATT_DETECTION_TEMPLATE.
+* Any other name is loaded with arLoadPatt().
+* \param name pattern file name or matrix code
+* \return the id the marker is reported with, or -1 on error.
+*/
+int arLoadMarker( const char *name );
+
+/**
+* \brief draw a matrix code marker.
+*
+* Give the cells of the inside of a matrix code marker, upper row first,
+* 1 for a dark cell and 0 for a light one. The printed marker is these
+* cells surrounded by the usual black border.
+* \param code code of the marker, 0 to AR_MATRIX_CODE_NUM-1
+* \param cell the cells
+* \return 0 if success, -1 if code is out of range.
+*/
+int arMatrixCodeEncode( int code, ARUint8 cell[AR_MATRIX_CODE_SIZE][AR_MATRIX_CODE_SIZE] );
+
+/**
+* \brief read a matrix code from a marker sample.
+*
+* The sample, as extracted by arGetPatt(), is cut into
+* AR_MATRIX_CODE_SIZE x AR_MATRIX_CODE_SIZE cells that are thresholded,
+* oriented by their corners and decoded, up to AR_MATRIX_CODE_ERROR_MAX
+* wrong cells.
+* \param ext_pat marker sample
+* \param code id of the marker, AR_MATRIX_CODE_ID_BASE plus its code, or -1
+* \param dir orientation of the marker, as for a pattern
+* \param cf confidence, 1.0 less 0.1 per wrong cell
+* \return 0 if a code was read, -1 otherwise.
+*/
+int arMatrixCodeDecode( ARUint8 ext_pat[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3],
+                        int *code, int *dir, double *cf );
+
 
 /*
     Utility
@@ -532,6 +1076,29 @@ int    arUtilMat2QuatPos( double m[3][4], double q[4], double p[3] );
 */
 int    arUtilQuatPos2Mat( double q[4], double p[3], double m[3][4] );
 
+/**
+* \brief arUtilMatMul() on arrays of matrices: d[n] = s1[n]*s2[n].
+*
+* Two products at a time on SSE2 or AArch64. d may be s1 or s2.
+* \param s1 first matrices
+* \param s2 second matrices
+* \param d resulted matrices
+* \param num number of products
+* \return always 0
+*/
+int    arUtilMatMulBatch( double s1[][3][4], double s2[][3][4], double d[][3][4], int num );
+
+/**
+* \brief arUtilMatInv() on an array of matrices.
+*
+* Two inverses at a time on SSE2 or AArch64. d may be s.
+* \param s matrices to invert
+* \param d resulted inverse matrices
+* \param num number of matrices
+* \return 0 if all the inversions succeed, -1 otherwise (the singular ones are left unchanged)
+*/
+int    arUtilMatInvBatch( double s[][3][4], double d[][3][4], int num );
+
 /**
 * \brief get the time with the ARToolkit timer.
 * 
@@ -548,6 +1115,285 @@ double arUtilTimer(void);
 */
 void   arUtilTimerReset(void);
 
+/**
+* \brief get the time of a fine clock.
+*
+* For measuring short intervals, such as the stages of the detection:
+* unlike arUtilTimer() it is not reset and has a resolution of a
+* microsecond or better.
+* \return time (in seconds) since an arbitrary origin
+*/
+double arUtilClock(void);
+
+/**
+* \brief open a span of the trace of the calling thread.
+*
+* The spans of a thread nest; each is closed by arTraceEnd().
+* Called by AR_TRACE_BEGIN() when arTraceMode is AR_TRACE_ON.
+* \param name what is done, a string that is never freed
+*/
+void   arTraceBegin( const char *name );
+
+/**
+* \brief close the last span opened by the calling thread.
+*
+* Does nothing when the thread has no span open, so that it may be
+* called whatever arTraceMode was when the span would have begun.
+*/
+void   arTraceEnd( void );
+
+/**
+* \brief name the calling thread in the trace.
+* \param name of the thread, copied
+*/
+void   arTraceThreadName( const char *name );
+
+/**
+* \brief write the trace.
+*
+* Writes the spans kept of every thread in the JSON format of Chrome's
+* trace viewer, which chrome://tracing and Perfetto read. The threads
+* go on tracing meanwhile.
+* \param filename the .json file
+* \return 0 if success, -1 if the file cannot be written.
+*/
+int    arTraceDump( const char *filename );
+
+/**
+* \brief memory of a subsystem, see arMemGet().
+*
+* bytes is what the subsystem holds now, peak the most it has held
+* since the start or arMemResetPeak(); allocs and frees count the
+* calls of arMemAlloc() and arMemFree(), and arMemRealloc() to a new
+* size as one of each.
+*/
+typedef struct {
+    long    bytes;
+    long    peak;
+    long    allocs;
+    long    frees;
+} ARMemStats;
+
+/**
+* \brief allocate memory accounted to a subsystem.
+*
+* The block carries its size and subsystem in a header, so that
+* arMemFree() can take them off. It is aligned as malloc() aligns.
+* \param tag subsystem, AR_MEM_AR to AR_MEM_ARPE
+* \param size in bytes
+* \return the block, NULL if there is no memory.
+*/
+void  *arMemAlloc( int tag, size_t size );
+
+/**
+* \brief resize memory of arMemAlloc(), or allocate it when ptr is NULL.
+* \param tag subsystem, for a new block
+* \param ptr the block, or NULL
+* \param size in bytes
+* \return the block, NULL if there is no memory, ptr being left as it was.
+*/
+void  *arMemRealloc( int tag, void *ptr, size_t size );
+
+/**
+* \brief free memory of arMemAlloc() or arMemRealloc(); NULL is ignored.
+*/
+void   arMemFree( void *ptr );
+
+/**
+* \brief account memory a subsystem holds outside arMemAlloc().
+*
+* For the memory of other libraries, such as the nodes of OpenVRML, and
+* for the textures and buffer objects given to GL.
+* \param tag subsystem
+* \param bytes added, negative for those released
+*/
+void   arMemAdd( int tag, long bytes );
+
+/**
+* \brief read the memory of a subsystem.
+* \param tag subsystem
+* \param stats filled in
+* \return 0 if success, -1 for an unknown subsystem.
+*/
+int    arMemGet( int tag, ARMemStats *stats );
+
+/**
+* \brief start the peaks of all the subsystems again from what they hold.
+*/
+void   arMemResetPeak( void );
+
+/**
+* \brief print the memory of each subsystem, and their total.
+* \param fp where to print, stdout for the console
+*/
+void   arMemDump( FILE *fp );
+
+/**
+* \brief allocate an image, or a buffer of the size of one.
+*
+* The memory is aligned to AR_IMAGE_ALIGN bytes and padded to a multiple
+* of them, so that a vector loop may load whole vectors to the end. An
+* image given back to arImageFree() is kept in a pool, and handed out
+* again for an image of about its size: a video module or a detection
+* that allocates one each frame does not go to the system. It is
+* accounted to the subsystem while pooled.
+* \param tag subsystem, AR_MEM_AR to AR_MEM_ARPE
+* \param size in bytes
+* \return the image, NULL if there is no memory.
+*/
+void  *arImageAlloc( int tag, size_t size );
+
+/**
+* \brief give back an image of arImageAlloc() to the pool; NULL is ignored.
+*/
+void   arImageFree( void *buff );
+
+/**
+* \brief free the images kept in the pool.
+*/
+void   arImagePoolTrim( void );
+
+/**
+* \brief bytes of a row of an image, aligned to AR_IMAGE_ALIGN.
+* \param xsize pixels of a row
+* \param pixSize bytes of a pixel
+* \return the stride, for a frame whose rows the consumer may pad.
+*/
+int    arImageStride( int xsize, int pixSize );
+
+/**
+* \brief mark of the frame arena of a thread, see arFrameMark().
+*/
+typedef struct {
+    void    *block;
+    size_t   used;
+} ARFrameMark;
+
+/**
+* \brief take temporary memory from the frame arena of the calling thread.
+*
+* The memory lasts until the arena is released to a mark taken before,
+* or reset. Each thread has an arena of its own, taken without a lock;
+* its blocks are kept when released, so a thread whose frames need no
+* more than they did before makes no call to malloc().
+* \param size in bytes
+* \return the memory, aligned as malloc() aligns. Exits if there is no
+* memory, as arMalloc() does.
+*/
+void  *arFrameAlloc( size_t size );
+
+/**
+* \brief mark the frame arena of the calling thread.
+*
+* A function that takes from the arena marks it first, and releases to
+* the mark before it returns.
+*/
+ARFrameMark arFrameMark( void );
+
+/**
+* \brief release what the calling thread took from its arena since mark.
+*/
+void   arFrameRelease( ARFrameMark mark );
+
+/**
+* \brief release the whole frame arena of the calling thread.
+*
+* Called at the end of each frame of the thread, after glutSwapBuffers()
+* for the display thread, for what was taken without a mark.
+*/
+void   arFrameReset( void );
+
+/**
+* \brief free the blocks of the frame arena of the calling thread.
+*/
+void   arFrameCleanup( void );
+
+/**
+* \brief give the calling thread the priority and the cores of its role.
+*
+* A named thread is also registered, so that arThreadRoleSet() applies to
+* it, and named in the trace as by arTraceThreadName(). The workers of a
+* pool, that live for one call, pass NULL and are not registered.
+* \param role AR_THREAD_CAPTURE, AR_THREAD_TRACK, AR_THREAD_RENDER,
+* AR_THREAD_IO or AR_THREAD_BACKGROUND
+* \param name name of the thread, or NULL
+* \return 0, or -1 if role is not one or the registry is full
+*/
+int    arThreadRole( int role, const char *name );
+
+/**
+* \brief take the calling thread out of the registry, before it ends.
+*/
+void   arThreadRoleEnd( void );
+
+/**
+* \brief set the priority and the cores of a role.
+*
+* The registered threads of every role take the change, since the cores
+* a role isolates are taken off the others.
+* \param role as in arThreadRole()
+* \param priority -2 lowest to 2 highest, 0 being that of the process
+* \param cores mask of the cores, 0 for those of the process
+* \param isolate 1 to keep the other roles off cores, if there are any
+* \return 0, or -1 if role or priority is out of range
+*/
+int    arThreadRoleSet( int role, int priority, unsigned long cores, int isolate );
+
+/**
+* \brief set the roles from a file.
+*
+* Each line is a role, capture, track, render, io or background, then its
+* priority, its cores, as 0x0c, and optionally 1 to isolate them. A line
+* beginning with # is a comment.
+* \param filename name of the file
+* \return the number of roles set, or -1 if the file cannot be read
+*/
+int    arThreadRoleLoad( const char *filename );
+
+/**
+* \brief write the roles and the registered threads.
+* \param fp where to, as stdout
+*/
+void   arThreadRoleDump( FILE *fp );
+
+/**
+* \brief read the features of the CPU and choose the kernels for them.
+*
+* Called by arInitCparam(), arsInitCparam() and arCreateHandle(); the
+* features are read once. Until then the kernels are those the compiler
+* was told the CPU has.
+*/
+void   arCpuInit( void );
+
+/**
+* \brief the features of the CPU the kernels are chosen for.
+* \return AR_CPU_SSE2, AR_CPU_SSSE3, AR_CPU_AVX2 and AR_CPU_NEON, those
+* the CPU has less those arCpuSetFeatures() took away.
+*/
+int    arCpuFeatures( void );
+
+/**
+* \brief choose the kernels again for some of the features only.
+*
+* To measure a kernel against another. Not while a thread detects.
+* \param features those the kernels may use, ~0 for all the CPU has
+* \return the features the kernels are chosen for.
+*/
+int    arCpuSetFeatures( int features );
+
+/**
+* \brief the variant chosen for a kernel.
+* \param kernel AR_KERNEL_BINARIZE or AR_KERNEL_CORRELATE
+* \return its name, as "avx2", "sse2" or "c", NULL for no such kernel.
+*/
+const char *arCpuKernelName( int kernel );
+
+/**
+* \brief print the features of the CPU and the variant of each kernel.
+* \param fp where to print, stdout for the console
+*/
+void   arCpuDump( FILE *fp );
+
 /**
 * \brief sleep the actual thread.
 *
@@ -560,6 +1406,35 @@ void   arUtilSleep( int msec );
   Internal processing
 */
 
+/**
+* \brief measurement macro functions of the detection stages.
+*
+* When the context runs with AR_STATS_ON, AR_STATS_START() reads
+* arUtilClock() into T, and AR_STATS_STAGE() adds the time since, in
+* milliseconds, to the member S of the statistics of the context and
+* reads the clock again. With AR_STATS_OFF they only test the mode.
+* \param H detection context
+* \param S stage of ARDetectStats
+* \param T double holding the time
+*/
+#define AR_STATS_START(H,T)  \
+do { if( (H)->statsMode == AR_STATS_ON ) (T) = arUtilClock(); } while( 0 )
+#define AR_STATS_STAGE(H,S,T)  \
+do { if( (H)->statsMode == AR_STATS_ON ) { double t_ = arUtilClock(); \
+(H)->stats.S += (t_ - (T)) * 1000.0; (T) = t_; } } while( 0 )
+
+/**
+* \brief trace macro functions.
+*
+* AR_TRACE_BEGIN() opens a span of the trace when arTraceMode is
+* AR_TRACE_ON, AR_TRACE_END() closes it. AR_TRACE_SCOPE() opens one
+* that the end of the C++ block closes.
+* \param N name of the span, a string that is never freed
+*/
+#define AR_TRACE_BEGIN(N)  \
+do { if( arTraceMode == AR_TRACE_ON ) arTraceBegin( N ); } while( 0 )
+#define AR_TRACE_END()  arTraceEnd()
+
 /**
 * \brief extract connected components from image.
 *
@@ -579,10 +1454,11 @@ ARInt16 *arLabeling( ARUint8 *image, int thresh,
                      int **label_ref );
 
 /**
- * \brief clean up static data allocated by arLabeling.
+ * \brief clean up data allocated by arLabeling.
  *
- * In debug mode, arLabeling may allocate and use static storage.
- * This function deallocates this storage.
+ * Frees the label buffers of the default detection contexts, and the
+ * debug image used in debug mode. They are allocated again by the next
+ * call to arInitCparam() or arLabeling(). Call this at shutdown.
  */
  void arLabelingCleanup(void);
 
@@ -768,6 +1644,739 @@ typedef struct {
     int     count;
 } arPrevInfo;
 
+/** \struct ARLabelBand
+* \brief run labeling tables of one horizontal band of the label image.
+*
+* \param j0 first row labeled
+* \param j1 row after the last row labeled
+* \param run_buf runs of the band (x start, x end, y, label)
+* \param run_max capacity of run_buf, in runs
+* \param run_num number of runs in run_buf
+* \param run_label per-label parent and bounding box
+* \param run_sum per-label pixel coordinate sums
+* \param run_label_max capacity of run_label and run_sum, in labels
+* \param label_num number of labels opened in the band
+*/
+typedef struct {
+    int            j0, j1;
+    int           *run_buf;
+    int            run_max;
+    int            run_num;
+    int           *run_label;
+    double        *run_sum;
+    int            run_label_max;
+    int            label_num;
+} ARLabelBand;
+
+/** \struct ARContourBlock
+* \brief block of the contour pool of an ARHandle.
+*
+* Contours are stored whole in one block, x coordinates then y coordinates,
+* so that blocks never move once contours point into them.
+* \param data coordinates
+* \param size capacity of data, in ints
+* \param used number of ints handed out since the pool was last emptied
+* \param next next block, or NULL
+*/
+typedef struct ARContourBlock {
+    int                    *data;
+    int                     size;
+    int                     used;
+    struct ARContourBlock  *next;
+} ARContourBlock;
+
+/** \struct ARDetectStats
+* \brief measurements of the last frame detected by a context.
+*
+* Filled when the context runs with AR_STATS_ON, see arStatsMode. The
+* times are in milliseconds.
+* \param frame number of frames detected with the statistics on
+* \param tracked 1 when the frame was followed by AR_TRACKING_EDGE, the
+*                stages of the whole detection then being 0
+* \param label binarizing, labeling and threshold update
+* \param contour contour tracing of the regions and square fitting
+* \param line line fitting of the edges of the squares, and their refinement
+* \param pattern extraction of the patterns of the squares
+* \param match template or matrix code matching of the patterns
+* \param track following of the markers, AR_TRACKING_EDGE
+* \param pose arGetTransMatBatch(), since the statistics were last read
+* \param label_num number of labeled regions
+* \param square_num number of squares found in them
+* \param line_num number of squares whose edges were fitted
+* \param pattern_num number of patterns extracted and matched, the others
+*                    coming from the code cache
+* \param marker_num number of markers given by the detection
+* \param pose_num number of poses computed, since the statistics were last read
+* \param simd the features of the CPU the kernels were chosen for, see
+*             arCpuFeatures() and arCpuKernelName()
+*/
+typedef struct {
+    int            frame;
+    int            tracked;
+    double         label;
+    double         contour;
+    double         line;
+    double         pattern;
+    double         match;
+    double         track;
+    double         pose;
+    int            label_num;
+    int            square_num;
+    int            line_num;
+    int            pattern_num;
+    int            marker_num;
+    int            pose_num;
+    int            simd;
+} ARDetectStats;
+
+/**
+* \brief a template matcher of a whole frame, see arSetPattMatcherCtx().
+*
+* Matches the num patterns ext_pat, extracted from the squares of one
+* frame, against the active patterns of arGetPattActive(), as the
+* template matching does with AR_TEMPLATE_MATCHING_COLOR and no PCA,
+* and writes the best pattern, its direction and its confidence for each.
+* \param data user data of arSetPattMatcherCtx()
+* \param ext_pat the patterns
+* \param num number of patterns
+* \param code best pattern of each, -1 if none
+* \param dir direction of each
+* \param cf confidence of each
+* \return 0 if all were matched, -1 for the library to match them.
+*/
+typedef int (*ARPattMatcher)( void *data, ARUint8 (*ext_pat)[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3], int num,
+                              int *code, int *dir, double *cf );
+
+/** \struct ARHandle
+* \brief marker detection context.
+*
+* Owns all the working state of the detection pipeline (label image,
+* equivalence tables, contours, marker list and tracking history), so
+* that several detectors can run at the same time, e.g. one per camera
+* or one per thread. The pattern table loaded with arLoadPatt() is
+* shared by all handles and must not be modified while a detection runs.
+* \param xsize width of the input image
+* \param ysize height of the input image
+* \param imageProcMode AR_IMAGE_PROC_IN_FULL, AR_IMAGE_PROC_IN_HALF or AR_IMAGE_PROC_IN_HALF_REFINED
+* \param labelingMode AR_LABELING_BY_PIXEL or AR_LABELING_BY_RUN
+* \param threshMode AR_THRESHOLD_MANUAL, AR_THRESHOLD_ADAPTIVE or AR_THRESHOLD_AUTO
+* \param roiMode AR_ROI_FULL_FRAME, AR_ROI_TRACKING or AR_ROI_MOTION
+* \param pyramidMode AR_PYRAMID_OFF, AR_PYRAMID_HALF or AR_PYRAMID_QUARTER
+* \param threads number of threads labeling each image, see arLabelingThreads
+* \param samplingMode AR_PATT_SAMPLING_FULL or AR_PATT_SAMPLING_FAST
+* \param edgeRefineMode AR_EDGE_REFINE_OFF or AR_EDGE_REFINE_SUBPIXEL
+* \param trackingMode AR_TRACKING_OFF or AR_TRACKING_EDGE
+* \param codeCacheMode AR_CODE_CACHE_OFF or AR_CODE_CACHE_ON
+* \param statsMode AR_STATS_OFF or AR_STATS_ON
+* \param pixFormat pixel format of the images, see arSetPixelFormatCtx()
+* \param pixSize bytes per pixel of pixFormat
+* \param pixOffset offsets of the blue, green and red bytes in a pixel of
+*                  pixFormat, all that of the luma byte for grey formats
+* \param lumaStride line length of the luma plane being detected by
+*                   arDetectMarkerLumaCtx(), 0 for images in the default format
+* \param debug when non-zero, a binarized debug image is produced in debug_image
+* \param dist_factor lens distortion parameters used by arGetLineCtx()
+* \param undist lookup table for dist_factor, see arDistortionLUTSize
+* \param undistShared non-zero when undist is the table of an ARParamSizes,
+*                     see arSetParamSizeCtx(), and not freed with the context
+* \param l_image label image
+* \param l_image_size number of pixels allocated for l_image and bin_image
+* \param bin_image thresholded image (0 or 0xFF per pixel) read by the labeling pass
+* \param bin_given binary image of arSetBinaryImageCtx() for the next labeling pass, or NULL
+* \param work label equivalence table
+* \param work_size maximum number of labels held by work, work2 and the per-label tables
+* \param work2 per-label statistics (area, sum x, sum y, clip)
+* \param wlabel_num number of labels after the last arLabelingCtx()
+* \param warea area of each label
+* \param wclip bounding box of each label
+* \param wpos center of each label
+* \param debug_image binarized image written in debug mode
+* \param thresh_block per-block means and thresholds, for AR_THRESHOLD_ADAPTIVE
+* \param thresh_block_size number of ints allocated for thresh_block
+* \param auto_thresh threshold found by arUpdateThresholdCtx(), 0 if none yet
+* \param auto_lost number of frames since arUpdateThresholdCtx() last saw a square
+* \param border_dark median grey level just inside the squares, as last measured by arUpdateThresholdCtx()
+* \param border_bright median grey level just outside them
+* \param border_serial number of frames border_dark and border_bright were measured on
+* \param band run labeling tables, one per band, for AR_LABELING_BY_RUN
+* \param band_merge parent and final label of each band label, for AR_LABELING_BY_RUN
+* \param band_merge_max capacity of band_merge, in labels
+* \param chain_x x coordinates of the contour being traced
+* \param chain_y y coordinates of the contour being traced
+* \param chain_max capacity of chain_x and chain_y
+* \param contour_pool blocks holding the contours of marker_info2, emptied by arDetectMarker2Ctx()
+* \param contour_cur block contours are being added to
+* \param marker_info2 contour candidates found by arDetectMarker2Ctx()
+* \param marker2_num number of entries in marker_info2
+* \param marker_info markers found by arGetMarkerInfoCtx()
+* \param marker_num number of entries in marker_info
+* \param code_cache markers identified by arGetMarkerInfoCtx() in the last
+*                   frame, for AR_CODE_CACHE_ON
+* \param code_cache_age number of frames each entry of code_cache was
+*                   reused since it was matched
+* \param code_cache_num number of entries in code_cache
+* \param prev_info markers of the previous frames, used by arDetectMarkerCtx()
+* \param prev_num number of entries in prev_info
+* \param roi boxes (x min, x max, y min, y max, in image pixels) labeled in the next frame
+* \param roi_num number of entries in roi, 0 to label the whole image
+* \param roi_y0 first image row spanned by roi
+* \param roi_y1 last image row spanned by roi
+* \param roi_count number of frames since the whole image was labeled
+* \param roi_tracked number of markers the boxes were made for
+* \param track markers followed by AR_TRACKING_EDGE, as in the last frame
+* \param track_vertex vertices of the markers of track one frame earlier
+* \param track_num number of entries in track, 0 for a whole detection next
+* \param track_count number of frames followed since the last whole detection
+* \param motion_thumb grey levels of the image, every AR_MOTION_STEP pixels, as last labeled
+* \param motion_block per block of AR_MOTION_BLOCK pixels, the change and whether it is labeled
+* \param motion_size number of bytes of motion_thumb, 0 until AR_ROI_MOTION is used
+* \param motion_marker markers of the last frame detected in AR_ROI_MOTION mode
+* \param motion_num number of motion_marker, -1 for the whole image to be labeled next
+* \param motion_count number of frames since the whole image was labeled
+* \param refine_mask full resolution binary window used by arRefineMarker2Ctx()
+* \param refine_mask_size number of bytes allocated for refine_mask
+* \param stats measurements of the frame being, or last, detected
+* \param patt_matcher matcher of arSetPattMatcherCtx(), or NULL
+* \param patt_matcher_data its user data
+* \param patt_batch patterns of the squares of the frame, matched at once
+*/
+typedef struct {
+    int            xsize, ysize;
+    int            imageProcMode;
+    int            labelingMode;
+    int            threshMode;
+    int            roiMode;
+    int            pyramidMode;
+    int            threads;
+    int            samplingMode;
+    int            edgeRefineMode;
+    int            trackingMode;
+    int            codeCacheMode;
+    int            statsMode;
+    int            pixFormat;
+    int            pixSize;
+    int            pixOffset[3];
+    int            lumaStride;
+    int            debug;
+    double         dist_factor[4];
+    ARParamLUT     undist;
+    int            undistShared;
+
+    ARInt16       *l_image;
+    int            l_image_size;
+    ARUint8       *bin_image;
+    ARUint8       *bin_given;
+    int           *work;
+    int           *work2;
+    int            work_size;
+    int            wlabel_num;
+    int           *warea;
+    int           *wclip;
+    double        *wpos;
+
+    ARUint8       *debug_image;
+    int            debug_xsize, debug_ysize, debug_mode;
+
+    int           *thresh_block;
+    int            thresh_block_size;
+    int            auto_thresh;
+    int            auto_lost;
+    int            border_dark, border_bright;
+    int            border_serial;
+
+    ARLabelBand    band[AR_LABELING_THREADS_MAX];
+    int           *band_merge;
+    int            band_merge_max;
+
+    int           *chain_x;
+    int           *chain_y;
+    int            chain_max;
+    ARContourBlock *contour_pool;
+    ARContourBlock *contour_cur;
+    ARMarkerInfo2 *marker_info2;
+    int            marker2_num;
+    ARMarkerInfo   marker_info[AR_SQUARE_MAX];
+    int            marker_num;
+    ARMarkerInfo   code_cache[AR_SQUARE_MAX];
+    int            code_cache_age[AR_SQUARE_MAX];
+    int            code_cache_num;
+
+    arPrevInfo     prev_info[AR_SQUARE_MAX];
+    int            prev_num;
+
+    int            roi[AR_SQUARE_MAX][4];
+    int            roi_num;
+    int            roi_y0, roi_y1;
+    int            roi_count;
+    int            roi_tracked;
+
+    ARMarkerInfo   track[AR_SQUARE_MAX];
+    double         track_vertex[AR_SQUARE_MAX][4][2];
+    int            track_num;
+    int            track_count;
+
+    ARUint8       *motion_thumb;
+    int           *motion_block;
+    int            motion_size;
+    ARMarkerInfo   motion_marker[AR_SQUARE_MAX];
+    int            motion_num;
+    int            motion_count;
+
+    ARUint8       *refine_mask;
+    int            refine_mask_size;
+
+    ARDetectStats  stats;
+
+    ARPattMatcher  patt_matcher;
+    void          *patt_matcher_data;
+    ARUint8        patt_batch[AR_SQUARE_MAX][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3];
+} ARHandle;
+
+/**
+* \brief create a marker detection context.
+*
+* Allocate a new detection context for images of the size and
+* distortion described by param. The image processing mode, labeling
+* mode, threshold mode, ROI mode, pyramid mode, thread count, sampling
+* mode, edge refinement mode, tracking mode, code cache mode, pixel
+* format and debug flag are copied from arImageProcMode, arLabelingMode,
+* arThresholdMode, arROIMode, arPyramidMode, arLabelingThreads,
+* arPattSamplingMode, arEdgeRefineMode, arTrackingMode, arCodeCacheMode,
+* arStatsMode, arPixelFormat and arDebug.
+* \param param camera parameters of the video source
+* \return the new context, or NULL on error.
+*/
+ARHandle *arCreateHandle( ARParam *param );
+
+/**
+* \brief change the image size of a marker detection context.
+*
+* The label image and work tables are grown when the new size needs
+* more room than is currently allocated; they are never shrunk.
+* \param handle detection context
+* \param xsize new image width
+* \param ysize new image height
+* \return 0 if success, -1 otherwise.
+*/
+int arResizeHandle( ARHandle *handle, int xsize, int ysize );
+
+/**
+* \brief set the pixel format of the images of a detection context.
+*
+* \param handle detection context
+* \param format one of the AR_PIXEL_FORMAT_* formats
+* \return 0 if success, -1 for an unknown format, the context being unchanged.
+*/
+int arSetPixelFormatCtx( ARHandle *handle, int format );
+
+/**
+* \brief switch a detection context to one of a set of sizes.
+*
+* The context is resized as by arResizeHandle() and takes the distortion
+* and the lookup table of the size from the set, adding the size with a
+* table of arDistortionLUTSize bytes if the set does not have it yet.
+* The table is shared, not copied; the set must outlive the context.
+* \param handle detection context
+* \param sizes camera parameters at each size, see arParamSizesInit()
+* \param xsize new image width
+* \param ysize new image height
+* \return 0 if success, -1 if the set is full, the context being unchanged.
+*/
+int arSetParamSizeCtx( ARHandle *handle, ARParamSizes *sizes, int xsize, int ysize );
+
+/**
+* \brief free a marker detection context.
+*
+* \param handle context created with arCreateHandle()
+* \return 0 if success, -1 otherwise.
+*/
+int arDeleteHandle( ARHandle *handle );
+
+/**
+* \brief get the context used by the global API.
+*
+* arDetectMarker(), arLabeling() and the other non-Ctx functions run
+* on this default context. It is first updated from arImXsize,
+* arImYsize, arImageProcMode, arLabelingMode, arThresholdMode, arROIMode,
+* arPyramidMode, arLabelingThreads, arPattSamplingMode, arEdgeRefineMode,
+* arTrackingMode, arCodeCacheMode, arStatsMode, arPixelFormat, arDebug
+* and arParam.
+* \return the default context.
+*/
+ARHandle *arGetDefaultHandle( void );
+
+/**
+* \brief get the measurements of the last detection of the default context.
+*
+* \param stats filled with the stages of the last frame given by
+*              arDetectMarker() and the other non-Ctx functions, and the
+*              poses computed since the last call of arGetStats() or
+*              arGetStatsCtx(), which are of the whole process and are
+*              cleared.
+* \return 0 if success, -1 when arStatsMode is AR_STATS_OFF.
+*/
+int arGetStats( ARDetectStats *stats );
+
+/**
+* \brief get the measurements of the last detection of a context.
+*
+* To be called from the thread that detects with the context.
+* \param handle detection context
+* \param stats filled as by arGetStats()
+* \return 0 if success, -1 when the context runs with AR_STATS_OFF.
+*/
+int arGetStatsCtx( ARHandle *handle, ARDetectStats *stats );
+
+/**
+* \brief begin the measurements of a frame.
+*
+* Called by the detection functions before each frame; clears the
+* stages of the statistics of the context when it runs with AR_STATS_ON.
+* \param handle detection context
+*/
+void arResetStatsCtx( ARHandle *handle );
+
+/**
+* \brief add poses to the statistics.
+*
+* Called by arGetTransMatBatch() when arStatsMode is AR_STATS_ON.
+* \param msec time taken
+* \param num number of poses
+*/
+void arStatsAddPose( double msec, int num );
+
+/**
+* \brief get the size reduction of the label image of a context.
+*
+* \param handle detection context
+* \return 1, 2 or 4: the label image is that many times smaller than
+* the input image in each direction.
+*/
+int arGetLabelingScale( ARHandle *handle );
+
+/**
+* \brief main function to detect the square markers in a context.
+*
+* Same as arDetectMarker(), but all working state is kept in handle.
+* \param handle detection context
+* \param dataPtr a pointer to the color image which is to be searched for square markers.
+* \param thresh specifies the threshold value (between 0-255)
+* \param marker_info a pointer to an array of ARMarkerInfo, owned by handle.
+* \param marker_num the number of detected markers in the image.
+* \return 0 when the function completes normally, -1 otherwise
+*/
+int arDetectMarkerCtx( ARHandle *handle, ARUint8 *dataPtr, int thresh,
+                       ARMarkerInfo **marker_info, int *marker_num );
+
+/**
+* \brief arDetectMarkerCopy() in a context.
+*
+* \param handle detection context
+* \param dataPtr a pointer to the color image which is to be searched for square markers.
+* \param thresh specifies the threshold value (between 0-255)
+* \param marker_info array receiving the markers found
+* \param marker_max number of entries of marker_info
+* \param marker_num the number of markers copied to marker_info.
+* \return 0 when the function completes normally, -1 otherwise
+*/
+int arDetectMarkerCopyCtx( ARHandle *handle, ARUint8 *dataPtr, int thresh,
+                           ARMarkerInfo marker_info[], int marker_max, int *marker_num );
+
+/**
+* \brief detection without tracking history, in a context.
+*
+* Same as arDetectMarkerLite(), but all working state is kept in handle.
+* \param handle detection context
+* \param dataPtr a pointer to the color image which is to be searched for square markers.
+* \param thresh specifies the threshold value (between 0-255)
+* \param marker_info a pointer to an array of ARMarkerInfo, owned by handle.
+* \param marker_num the number of detected markers in the image.
+* \return 0 when the function completes normally, -1 otherwise
+*/
+int arDetectMarkerLiteCtx( ARHandle *handle, ARUint8 *dataPtr, int thresh,
+                           ARMarkerInfo **marker_info, int *marker_num );
+
+/**
+* \brief arDetectMarkerLuma() in a context.
+*
+* handle->lumaStride is set for the duration of the call.
+* \param handle detection context
+* \param luma the luma plane, one byte per pixel, of handle->xsize x handle->ysize pixels.
+* \param stride number of bytes from one line of the plane to the next, at least handle->xsize
+* \param thresh specifies the threshold value (between 0-255)
+* \param marker_info a pointer to an array of ARMarkerInfo, owned by handle.
+* \param marker_num the number of detected markers in the image.
+* \return 0 when the function completes normally, -1 otherwise
+*/
+int arDetectMarkerLumaCtx( ARHandle *handle, ARUint8 *luma, int stride, int thresh,
+                           ARMarkerInfo **marker_info, int *marker_num );
+
+/**
+* \brief detect the square markers in many images.
+*
+* The images are shared out among thread_num threads, each with its own
+* context created from arParam and the mode globals. Each image gets the
+* result arDetectMarkerLite() would give for it alone: ROI tracking is
+* off and the automatic threshold starts afresh on every image.
+* Safe while no other thread loads or frees patterns.
+* \param images the images, of arParam size and in the pixel format of arDetectMarker()
+* \param image_num number of images
+* \param thresh threshold value (between 0-255)
+* \param result image_num entries that receive the markers of each
+*               image, to be freed with arFreeMarkerBatch()
+* \param thread_num number of threads, at most AR_BATCH_THREADS_MAX
+* \return 0 if every image was processed, -1 otherwise.
+*/
+int arDetectMarkerBatch( ARUint8 *images[], int image_num, int thresh,
+                         ARMarkerList result[], int thread_num );
+
+/**
+* \brief free the results of arDetectMarkerBatch().
+*
+* \param result results of arDetectMarkerBatch()
+* \param image_num number of images
+*/
+void arFreeMarkerBatch( ARMarkerList result[], int image_num );
+
+/**
+* \brief extract connected components from image, in a context.
+*
+* Same as arLabeling(), but the output buffers are owned by handle.
+*/
+ARInt16 *arLabelingCtx( ARHandle *handle, ARUint8 *image, int thresh,
+                        int *label_num, int **area, double **pos, int **clip,
+                        int **label_ref );
+
+void arGetImgFeatureCtx( ARHandle *handle, int *num, int **area, int **clip, double **pos );
+
+/**
+* \brief update the automatic threshold of a context.
+*
+* In AR_THRESHOLD_AUTO mode, sample the image just inside and just
+* outside the contour of each square and set handle->auto_thresh
+* halfway between the median dark and bright levels. It is called by
+* the detection functions. In every mode the two levels are kept in
+* handle->border_dark and handle->border_bright, for arExposureUpdate().
+* \param handle detection context
+* \param image the image the squares were found in
+* \param marker_info2 squares found by arDetectMarker2Ctx()
+* \param marker_num number of squares
+* \return the threshold for the next frame, or -1 if none is known.
+*/
+int arUpdateThresholdCtx( ARHandle *handle, ARUint8 *image,
+                          ARMarkerInfo2 *marker_info2, int marker_num );
+
+/** \struct ARExposure
+* \brief exposure and gain of a camera, set for the detection.
+*
+* The settings are in 0.0 <-> 1.0 of the range of the camera, as
+* ar2VideoSetControl() takes them.
+* \param exposure the exposure to set
+* \param gain the gain to set
+* \param exposure_min shortest exposure set, 0.0 by default
+* \param gain_max highest gain set, AR_EXPOSURE_GAIN_MAX by default
+* \param target contrast of the marker borders aimed at, in grey levels
+* \param contrast contrast of the borders last measured, -1 before
+* \param serial border_serial of the context when last updated
+* \param lost frames labeled whole without a square since the last one
+* \param settle frames left before the last change shows in the images
+* \param cheap 1 when the context left the next frame to tracking or ROI
+*/
+typedef struct {
+    double         exposure;
+    double         gain;
+    double         exposure_min;
+    double         gain_max;
+    int            target;
+    int            contrast;
+    int            serial;
+    int            lost;
+    int            settle;
+    int            cheap;
+} ARExposure;
+
+/**
+* \brief start an exposure and gain control.
+*
+* At AR_EXPOSURE_START and AR_EXPOSURE_GAIN_START, which the camera
+* should be set to before the first frame.
+* \param exposure the control
+*/
+void arExposureInit( ARExposure *exposure );
+
+/**
+* \brief update the exposure and gain of a camera from its last detection.
+*
+* Long exposures blur the markers as they move, and each marker lost
+* costs a labeling of the whole frame. The exposure is kept as short as
+* the contrast of the marker borders allows: a low contrast raises the
+* gain, up to gain_max, before the exposure, and a high one or bright
+* borders lower the exposure before the gain. A frame that had to be
+* labeled whole, its squares contrasted enough, trades some exposure
+* for gain. Nothing changes while the markers are tracked, nor for
+* AR_EXPOSURE_SETTLE frames after a change; with no square in sight
+* for AR_EXPOSURE_LOST_MAX frames the gain goes up.
+* \param exposure the control
+* \param handle the context, after the detection of the frame
+* \return 1 when exposure->exposure or exposure->gain changed and is
+* to be set, 0 otherwise.
+*/
+int arExposureUpdate( ARExposure *exposure, ARHandle *handle );
+
+/**
+* \brief threshold a window of the image in full resolution.
+*
+* Uses the same threshold mode as arLabelingCtx(). The window is stored
+* with a one pixel blank frame in handle->refine_mask, so the mask is
+* (x1-x0+3) pixels wide and (y1-y0+3) pixels high.
+* \param handle detection context
+* \param image input image
+* \param thresh threshold value (between 0-255)
+* \param x0 left column of the window
+* \param y0 top row of the window
+* \param x1 right column of the window
+* \param y1 bottom row of the window
+* \return the mask, 1 for dark pixels and 0 otherwise.
+*/
+ARUint8 *arBinarizeRegionCtx( ARHandle *handle, ARUint8 *image, int thresh,
+                              int x0, int y0, int x1, int y1 );
+
+/**
+* \brief give the binary image of the next labeling pass.
+*
+* The next arLabelingCtx() of the context, and so the next detection,
+* labels bin_image instead of thresholding the image itself, e.g. when
+* arglBinarize() has done it on the GPU. bin_image is at the resolution
+* of the label image, arGetLabelingScale() pixels of the image per pixel
+* across and down, 0xFF for dark pixels and 0 otherwise, the top row
+* first; it is copied, and must stay valid until then. It is only taken
+* with AR_THRESHOLD_MANUAL and no region of interest, the threshold
+* having been made for one value over the whole image; otherwise it is
+* dropped and the image thresholded as usual. The other passes that read
+* the image, the pattern and the refinement of the edges, still do.
+* \param handle detection context
+* \param bin_image binary image, or NULL to threshold the image again
+* \return 0 if success, -1 otherwise.
+*/
+int arSetBinaryImageCtx( ARHandle *handle, ARUint8 *bin_image );
+
+/**
+* \brief fit the edges of a marker to the image gradient.
+*
+* Along each edge, the grey levels are sampled across it, up to
+* AR_EDGE_REFINE_RANGE pixels on each side, at up to AR_EDGE_REFINE_SAMPLES
+* points. The edge is fitted again to the subpixel positions of the
+* strongest gradient, weighted by the gradient. Edges with too few such
+* points keep their line. The vertices are recomputed from the lines.
+* \param handle detection context
+* \param image the image the marker was found in
+* \param line lines of the marker edges found by arGetLineCtx() (ideal screen coordinates)
+* \param vertex vertices of the marker (ideal screen coordinates)
+* \return the number of edges refined.
+*/
+int arRefineLineCtx( ARHandle *handle, ARUint8 *image, double line[4][3], double vertex[4][2] );
+
+/**
+* \brief find the edges of a marker near where they are expected.
+*
+* As arRefineLineCtx(), with profiles of AR_TRACKING_RANGE pixels on
+* each side and only edges that get brighter away from the centre of the
+* marker. Fails unless all four edges are found.
+* \param handle detection context
+* \param image the image to search
+* \param line expected lines of the marker edges (ideal screen coordinates)
+* \param vertex expected vertices of the marker (ideal screen coordinates)
+* \return 4 when the lines and vertices were updated, 0 otherwise.
+*/
+int arTrackLineCtx( ARHandle *handle, ARUint8 *image, double line[4][3], double vertex[4][2] );
+
+/**
+* \brief trace the square candidates again in full resolution.
+*
+* In AR_PYRAMID_HALF and AR_PYRAMID_QUARTER modes, replace the contour and
+* vertices of each candidate found by arDetectMarker2Ctx() with those of
+* the full resolution image. A candidate keeps its coarse contour when the
+* full resolution one is not a square. It does nothing in AR_PYRAMID_OFF.
+* \param handle detection context
+* \param image input image
+* \param thresh threshold value (between 0-255)
+* \param marker_info2 candidates found by arDetectMarker2Ctx()
+* \param marker_num number of candidates
+* \return the number of refined candidates.
+*/
+int arRefineMarker2Ctx( ARHandle *handle, ARUint8 *image, int thresh,
+                        ARMarkerInfo2 *marker_info2, int marker_num );
+
+ARMarkerInfo2 *arDetectMarker2Ctx( ARHandle *handle, ARInt16 *limage,
+                                   int label_num, int *label_ref,
+                                   int *warea, double *wpos, int *wclip,
+                                   int area_max, int area_min, double factor, int *marker_num );
+
+ARMarkerInfo *arGetMarkerInfoCtx( ARHandle *handle, ARUint8 *image,
+                                  ARMarkerInfo2 *marker_info2, int *marker_num );
+
+int arGetCodeCtx( ARHandle *handle, ARUint8 *image, int *x_coord, int *y_coord, int *vertex,
+                  int *code, int *dir, double *cf );
+
+/**
+* \brief match the patterns of a frame at once.
+*
+* Matches the num patterns of ext_pat as arGetCodeCtx() does each, by the
+* matcher of arSetPattMatcherCtx() when there is one and
+* arPattDetectionMode, arTemplateMatchingMode and arMatchingPCAMode are
+* AR_PATT_DETECTION_TEMPLATE, AR_TEMPLATE_MATCHING_COLOR and
+* AR_MATCHING_WITHOUT_PCA, one after the other otherwise.
+* arGetMarkerInfoCtx() extracts the patterns of all its squares into
+* handle->patt_batch and matches them with this.
+* \param handle detection context
+* \param ext_pat the patterns
+* \param num number of patterns
+* \param code best pattern of each
+* \param dir direction of each
+* \param cf confidence of each
+* \return 0.
+*/
+int arGetCodeBatchCtx( ARHandle *handle, ARUint8 (*ext_pat)[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3], int num,
+                       int *code, int *dir, double *cf );
+
+/**
+* \brief match the patterns of each frame elsewhere, e.g. on the GPU.
+*
+* With a matcher set, the patterns of all the squares of a frame are
+* matched by one call of it, see arGetCodeBatchCtx(). It is called in
+* the thread detecting with the context.
+* \param handle detection context
+* \param matcher the matcher, NULL for the library's own
+* \param data passed to it
+* \return 0 if success, -1 otherwise.
+*/
+int arSetPattMatcherCtx( ARHandle *handle, ARPattMatcher matcher, void *data );
+
+int arGetPattCtx( ARHandle *handle, ARUint8 *image, int *x_coord, int *y_coord, int *vertex,
+                  ARUint8 ext_pat[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3] );
+
+int arGetLineCtx( ARHandle *handle, int x_coord[], int y_coord[], int coord_num,
+                  int vertex[], double line[4][3], double v[4][2] );
+
+int arGetContourCtx( ARHandle *handle, ARInt16 *limage, int *label_ref,
+                     int label, int clip[4], ARMarkerInfo2 *marker_info2 );
+
+int arSavePattCtx( ARHandle *handle, ARUint8 *image, ARMarkerInfo *marker_info, char *filename );
+
+/**
+* \brief extract the samples of a square in its four directions.
+*
+* What arSavePattCtx() saves of a square of arDetectMarker2Ctx(),
+* without it having to be the square of the last detection.
+* \param handle detection context
+* \param image the image the square was found in
+* \param marker_info2 the square
+* \param ext_pat where the samples go
+* \return 0 if success, -1 if the square cannot be sampled.
+*/
+int arGetPattSquareCtx( ARHandle *handle, ARUint8 *image, ARMarkerInfo2 *marker_info2,
+                        ARUint8 ext_pat[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3] );
+
 
 /*------------------------------------*/
 
@@ -777,6 +2386,7 @@ extern ARSParam arsParam;
 extern double   arsMatR2L[3][4];
 
 int           arsInitCparam      ( ARSParam *sparam );
+ARHandle     *arsGetDefaultHandle( int LorR );
 void          arsGetImgFeature   ( int *num, int **area, int **clip, double **pos, int LorR );
 ARInt16      *arsLabeling        ( ARUint8 *image, int thresh,
                                    int *label_num, int **area, double **pos, int **clip,
@@ -789,6 +2399,24 @@ int           arsDetectMarker    ( ARUint8 *dataPtr, int thresh,
                                    ARMarkerInfo **marker_info, int *marker_num, int LorR );
 int           arsDetectMarkerLite( ARUint8 *dataPtr, int thresh,
                                    ARMarkerInfo **marker_info, int *marker_num, int LorR );
+/**
+* \brief arsDetectMarker() on both images of a stereo pair at once.
+*
+* The left image is detected on a worker thread while the calling thread
+* does the right one; the function returns when both are done, so
+* arsGetTransMat() can be called on either result straight away.
+* \param dataL left image
+* \param dataR right image
+* \param thresh specifies the threshold value (between 0-255)
+* \param marker_infoL markers found in the left image
+* \param marker_numL number of markers found in the left image
+* \param marker_infoR markers found in the right image
+* \param marker_numR number of markers found in the right image
+* \return 0 when both detections complete normally, -1 otherwise
+*/
+int           arsDetectMarkerStereo( ARUint8 *dataL, ARUint8 *dataR, int thresh,
+                                     ARMarkerInfo **marker_infoL, int *marker_numL,
+                                     ARMarkerInfo **marker_infoR, int *marker_numR );
 double        arsGetTransMat     ( ARMarkerInfo *marker_infoL, ARMarkerInfo *marker_infoR,
                                    double center[2], double width,
                                    double transL[3][4], double transR[3][4] );
@@ -809,7 +2437,69 @@ double arsModifyMatrix( double rot[3][3], double trans[3], ARSParam *arsParam,
                         double pos3dL[][3], double pos2dL[][2], int numL,
                         double pos3dR[][3], double pos2dR[][2], int numR );
 
+/**
+* \brief the two cameras of a stereo calibration as an ARViewParam.
+*
+* \param sparam stereo parameters
+* \param vparam the left camera as view 0, the right one as view 1
+* \return 0 if success, -1 if error
+*/
+int    arViewParamFromStereo( ARSParam *sparam, ARViewParam *vparam );
+
+/**
+* \brief detect the markers of all the cameras at once.
+*
+* Each view is detected by arDetectMarkerCtx() on its own handle, one
+* thread per view. The handles are created with arCreateHandle() on the
+* parameters of their camera, so the vertices use its distortion.
+* \param handle detection context of each view
+* \param data image of each view
+* \param view_num number of views, at most AR_VIEW_MAX
+* \param thresh specifies the threshold value (between 0-255)
+* \param marker_info markers found in each view, owned by its handle
+* \param marker_num number of markers found in each view
+* \return 0 when all the detections complete normally, -1 otherwise
+*/
+int    arViewDetectMarker( ARHandle *handle[], ARUint8 *data[], int view_num, int thresh,
+                           ARMarkerInfo *marker_info[], int marker_num[] );
+
+/**
+* \brief pose of a marker from all the views that see it.
+*
+* Starts from the pose of the view with the best confidence, then fits
+* the pose to the corners of every view together.
+* \param vparam calibration of the cameras
+* \param marker_info the marker in each view, NULL in the views that miss it
+* \param center the center of the marker
+* \param width the size of the marker
+* \param conv pose of the marker in the coordinates of camera 0
+* \return mean squared reprojection error of the corners, -1 if error
+*/
+double arViewGetTransMat( ARViewParam *vparam, ARMarkerInfo *marker_info[],
+                          double center[2], double width, double conv[3][4] );
+
+/**
+* \brief arViewGetTransMat() starting from the previous pose.
+*
+* \param vparam calibration of the cameras
+* \param marker_info the marker in each view, NULL in the views that miss it
+* \param prev_conv pose of the previous frame, in the coordinates of camera 0
+* \param center the center of the marker
+* \param width the size of the marker
+* \param conv pose of the marker in the coordinates of camera 0
+* \return mean squared reprojection error of the corners, -1 if error
+*/
+double arViewGetTransMatCont( ARViewParam *vparam, ARMarkerInfo *marker_info[],
+                              double prev_conv[3][4], double center[2], double width,
+                              double conv[3][4] );
+
 #ifdef __cplusplus
 }
+
+struct ARTraceScope {
+    ARTraceScope( const char *name ) { AR_TRACE_BEGIN( name ); }
+    ~ARTraceScope() { arTraceEnd(); }
+};
+#define AR_TRACE_SCOPE(N)  ARTraceScope arTraceScope_( N )
 #endif
 #endif
@@ -81,6 +81,12 @@ typedef struct {
 * \param trans position of the multi-marker pattern (more precisely, the camera position in the multi-marker CS)
 * \param prevF boolean flag for visibility
 * \param transR last position
+* \param pos3d corners of all the markers, 4 x 3 doubles each in the order
+*              of marker, so that those of the visible ones are gathered
+*              by index
+* \param wpos2d corners of each marker in its own plane, 4 x 2 doubles each
+* \param vlist indices in marker of the markers visible in the last frame
+* \param vnum number of them
 */
 typedef struct {
     ARMultiEachMarkerInfoT  *marker;
@@ -89,6 +95,11 @@ typedef struct {
     int                     prevF;
 /*---*/
     double                  transR[3][4];
+/*---*/
+    double                  *pos3d;
+    double                  *wpos2d;
+    int                     *vlist;
+    int                     vnum;
 } ARMultiMarkerInfoT;
 
 // ============================================================================
@@ -116,6 +127,10 @@ ARMultiMarkerInfoT *arMultiReadConfigFile( const char *filename );
 * calculate the transformation between the multi-marker patterns and the real camera. Based on 
 * confident values of detected markers in the multi-markers patterns, a global position is return.
 *
+* Corners that disagree with the fit (partly hidden or mismatched markers)
+* are left out of it. When config->prevF is set, the fit starts from
+* config->trans.
+*
 * \param marker_info list of detected markers (from arDetectMarker)
 * \param marker_num number of detected markers
 * \param config 
@@ -124,6 +139,28 @@ ARMultiMarkerInfoT *arMultiReadConfigFile( const char *filename );
 double  arMultiGetTransMat(ARMarkerInfo *marker_info, int marker_num,
                            ARMultiMarkerInfoT *config);
 
+/**
+* \brief compute the positions of several multi-marker patterns at once.
+*
+* The same as arMultiGetTransMat() for config[0], config[1], ... in turn,
+* but the detected markers are bucketed by id once, so that each pattern
+* looks only at those of its markers and at the unidentified ones. The
+* markers are matched to the patterns in turn; then each pattern is fitted,
+* from its config->trans when config->prevF is set, on one of thread_num
+* threads.
+*
+* \param marker_info list of detected markers (from arDetectMarker)
+* \param marker_num number of detected markers
+* \param config the patterns, NULL for none
+* \param config_num number of patterns
+* \param err the result of arMultiGetTransMat() for each pattern
+* \param thread_num number of threads, at most AR_BATCH_THREADS_MAX
+* \return 0 if every pattern got a position, -1 otherwise.
+*/
+int     arMultiGetTransMatBatch(ARMarkerInfo *marker_info, int marker_num,
+                                ARMultiMarkerInfoT *config[], int config_num,
+                                double err[], int thread_num);
+
 /**
 * \brief activate a multi-marker pattern on the recognition procedure.
 *
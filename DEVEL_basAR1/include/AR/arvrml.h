@@ -25,11 +25,120 @@
 extern "C" {
 #endif
 
+#define AR_VRML_LOADED     0
+#define AR_VRML_LOADING    1
+
 int arVrmlLoadFile(const char *file);
+/* Queues the scene to be parsed on a loader thread and returns its id at
+ * once. Until arVrmlLoadStatus() gives AR_VRML_LOADED, arVrmlDraw() draws
+ * nothing and returns AR_VRML_LOADING. Both must be called from the thread
+ * that owns the GL context. */
+int arVrmlLoadFileAsync(const char *file);
+int arVrmlLoadStatus( int id );
 int arVrmlFree( int id );
 int arVrmlDraw( int id );
+/* Draws the scene of id n times, each under the current modelview times one
+ * of the column-major transforms, setting up the GL state and lights once. */
+int arVrmlDrawInstanced( int id, const double transforms[][16], int n );
+/* Ticks only the scenes drawn since the last call, still animating, or held
+ * active by arVrmlSetActive(). */
 int arVrmlTimerUpdate( void );
+/* Between two draws of the same frame only the GL state the scenes change is
+ * set again. Call it after drawing with other code in between that changes
+ * the depth or blend function, the light model or the lights; the next
+ * arVrmlTimerUpdate() does it too, and so does a draw in another context than
+ * the last, which must share the objects of the first, as with
+ * arglSetupForCurrentContextShared(). */
+int arVrmlInvalidateState( void );
+/* Scenes held active by it are never evicted for the memory budget. */
+int arVrmlSetActive( int id, int flag );
+/* Bounds the memory of the scenes: the bytes they hold in GL, as buffer
+ * objects and textures, and in memory. When a tick leaves more, the scenes
+ * drawn least recently are dropped, their animation and script state lost,
+ * and parsed again on the loader thread when next drawn; arVrmlDraw() returns
+ * AR_VRML_LOADING meanwhile. 0 for no limit, the default. */
+int arVrmlSetMemoryBudget( int gpuKB, int cpuKB );
+/* The time, in milliseconds, arVrmlTimerUpdate() may spend collecting the
+ * garbage of the scripts of all the scenes, which share one runtime. A
+ * collection that took longer is put off for up to 30 ticks. 2 by default. */
+int arVrmlSetScriptBudget( double msec );
+/* Runs the events of the Java scripts of the scenes loaded from now on a
+ * thread of their own, unless they have directOutput, so that a slow script
+ * does not hold arVrmlTimerUpdate(); what they send is applied at a later
+ * tick. Off by default. */
+int arVrmlSetScriptDeferred( int flag );
+/* Draws the meshes of the scenes with fewer triangles as they are further
+ * from the camera: past nearDist, in the units of the transforms of
+ * arVrmlDraw() (millimetres from arGetTransMat()), a first simpler level made
+ * when they load, past farDist a second. 0 for never; 600 and 1200 by default. */
+int arVrmlSetLOD( double nearDist, double farDist );
 int arVrmlSetInternalLight( int flag );
+/* Culls the nodes of the scene of id, and of every instance sharing it,
+ * against the GL projection and modelview of arVrmlDraw(). On by default. */
+int arVrmlSetCulling( int id, int flag );
+/* 1 once a draw of the scene of id has met a transparent material or a
+ * texture with alpha, which it blends; 0 before, or for an opaque scene. */
+int arVrmlIsBlended( int id );
+/* While set, the draws leave GL_BLEND on or off as they find it, instead of
+ * turning it off before and after each scene, so that an application drawing
+ * the blended scenes last, back to front, sets the blend state once for all
+ * of them. Off by default. */
+int arVrmlSetBlendExternal( int flag );
+/* Packs the textures of the scenes loaded from now that do not repeat and
+ * are no more than 128 texels a side, as the icons and colours of small
+ * models, into one texture shared by all the scenes, their coordinates
+ * mapped onto their tile: the models drawn one after the other do not bind
+ * a texture of their own each. A tile shows from the second draw of the
+ * scene. On by default. */
+int arVrmlSetTextureAtlas( int flag );
+/* Drives the TouchSensors, PlaneSensors, CylinderSensors, SphereSensors and
+ * Anchors of the instance id from an actuator, tested on the CPU against the
+ * geometry under them as its last arVrmlDraw() put it: a ray from origin
+ * along direction, or a point touching what is within radius of it, in the
+ * eye coordinates of that draw. A sensor pressed over follows the actuator
+ * until released. Returns 1 while the actuator is over a sensor or drags
+ * one, 0 when not, -1 on error. */
+int arVrmlPointerRay( int id, const double origin[3], const double direction[3], int press );
+int arVrmlPointerTouch( int id, const double point[3], double radius, int press );
+
+/* The GL work of all the draws since the last call: the draw calls of the
+ * meshes and display lists, the triangles of the meshes, and the state the
+ * viewer changed for them outside the display lists, appearances, lights,
+ * textures and buffer bindings. */
+typedef struct {
+    long    draws;
+    long    triangles;
+    long    states;
+} ARVrmlStats;
+
+int arVrmlGetStats( ARVrmlStats *stats );
+
+/* The time, in milliseconds, the scenes loaded since the last call took:
+ * parsing them, on the loader thread for arVrmlLoadFileAsync(), making their
+ * viewers, and their first draw, which decodes the textures and compiles the
+ * display lists. A scene shared by several .dat files counts once, one
+ * evicted for the memory budget again each time it is loaded back. */
+typedef struct {
+    long    scenes;
+    double  parse;
+    double  build;
+    double  draw;
+} ARVrmlLoadStats;
+
+int arVrmlGetLoadStats( ARVrmlLoadStats *stats );
+
+/* The scenes whose browser is in memory, parsed and not evicted. */
+int arVrmlLiveScenes( void );
+
+/* Readies the scene of the instance id for a draw to come, as for a state
+ * the application may go to next: an evicted scene is queued to be parsed
+ * again, a parsed one gets its viewer, and its first draw, which decodes
+ * the textures and compiles the display lists, is made with the color,
+ * depth and stencil writes off, one scene per arVrmlTimerUpdate() at most.
+ * A scene prefetched is not evicted at the next tick, as if it was drawn.
+ * To be called each frame from the thread of arVrmlDraw(); returns
+ * AR_VRML_LOADED once the scene has been drawn, AR_VRML_LOADING before. */
+int arVrmlPrefetch( int id );
 
 #ifdef __cplusplus
 }
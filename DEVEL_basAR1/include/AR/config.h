@@ -61,18 +61,22 @@
 
 /*--------------------------------------------------------------*/
 /*                                                              */
-/*  For Linux, you should define one of below 4 input method    */
+/*  For Linux, you should define one of below 6 input method    */
 /*    AR_INPUT_V4L:       use of standard Video4Linux Library   */
+/*    AR_INPUT_V4L2:      use of Video4Linux2 streaming I/O     */
 /*    AR_INPUT_GSTREAMER: use of GStreamer Media Framework      */
 /*    AR_INPUT_DV:        use of DV Camera                      */
 /*    AR_INPUT_1394CAM:   use of 1394 Digital Camera            */
+/*    AR_INPUT_FILE:      use of a recording of ar2VideoRecord  */
 /*                                                              */
 /*--------------------------------------------------------------*/
 #ifdef __linux
 #undef  AR_INPUT_V4L
+#undef  AR_INPUT_V4L2
 #undef  AR_INPUT_DV
 #undef  AR_INPUT_1394CAM
 #undef  AR_INPUT_GSTREAMER
+#undef  AR_INPUT_FILE
 
 #  ifdef AR_INPUT_V4L
 #    ifdef USE_EYETOY
@@ -82,6 +86,10 @@
 #    endif
 #  endif
 
+#  ifdef AR_INPUT_V4L2
+#    define  AR_DEFAULT_PIXEL_FORMAT AR_PIXEL_FORMAT_yuvs
+#  endif
+
 #  ifdef AR_INPUT_DV
 #    define  AR_DEFAULT_PIXEL_FORMAT AR_PIXEL_FORMAT_RGB
 #  endif
@@ -94,6 +102,10 @@
 #    define  AR_DEFAULT_PIXEL_FORMAT AR_PIXEL_FORMAT_RGB
 #  endif
 
+#  ifdef AR_INPUT_FILE
+#    define  AR_DEFAULT_PIXEL_FORMAT AR_PIXEL_FORMAT_RGB
+#  endif
+
 #  undef   AR_BIG_ENDIAN
 #  define  AR_LITTLE_ENDIAN
 #endif
@@ -129,10 +141,25 @@
 #    undef   AR_BIG_ENDIAN   // Least significant Byte has greatest address in memory (i386).
 #    define  AR_LITTLE_ENDIAN
 #  endif
-#  define  AR_DEFAULT_PIXEL_FORMAT AR_PIXEL_FORMAT_ARGB
+/*
+ *  Define for the AVFoundation capture of Mac OS X 10.7 and later
+ *  (lib/SRC/VideoAVFoundation), else QuickTime is used.
+ */
+#  undef   AR_INPUT_AVFOUNDATION
+#  ifdef AR_INPUT_AVFOUNDATION
+#    define  AR_DEFAULT_PIXEL_FORMAT AR_PIXEL_FORMAT_MONO
+#  else
+#    define  AR_DEFAULT_PIXEL_FORMAT AR_PIXEL_FORMAT_ARGB
+#  endif
 #endif
 
 
+/*------------------------------------------------------------*/
+/*  Define ARDOUBLE_IS_FLOAT to fit the marker edges and undo  */
+/*  the lens distortion in single precision (see ARdouble).    */
+/*------------------------------------------------------------*/
+#undef   ARDOUBLE_IS_FLOAT
+
 /*------------------------------------------------------------*/
 
 #define  AR_DRAW_BY_GL_DRAW_PIXELS    0
@@ -141,6 +168,7 @@
 #define  AR_DRAW_TEXTURE_HALF_IMAGE   1
 #define  AR_IMAGE_PROC_IN_FULL        0
 #define  AR_IMAGE_PROC_IN_HALF        1
+#define  AR_IMAGE_PROC_IN_HALF_REFINED 2
 #define  AR_FITTING_TO_IDEAL          0
 #define  AR_FITTING_TO_INPUT          1
 
@@ -150,6 +178,70 @@
 #define  AR_MATCHING_WITH_PCA         1
 #define  DEFAULT_TEMPLATE_MATCHING_MODE     AR_TEMPLATE_MATCHING_COLOR
 #define  DEFAULT_MATCHING_PCA_MODE          AR_MATCHING_WITHOUT_PCA
+#define  AR_PATT_DETECTION_TEMPLATE            0
+#define  AR_PATT_DETECTION_MATRIX              1
+#define  AR_PATT_DETECTION_TEMPLATE_AND_MATRIX 2
+#define  DEFAULT_PATT_DETECTION_MODE        AR_PATT_DETECTION_TEMPLATE
+#define  AR_PATT_SAMPLING_FULL        0
+#define  AR_PATT_SAMPLING_FAST        1
+#define  DEFAULT_PATT_SAMPLING_MODE         AR_PATT_SAMPLING_FULL
+#define  DEFAULT_DISTORTION_LUT_SIZE        0
+#define  AR_EDGE_REFINE_OFF           0
+#define  AR_EDGE_REFINE_SUBPIXEL      1
+#define  DEFAULT_EDGE_REFINE_MODE           AR_EDGE_REFINE_OFF
+#define  AR_TRACKING_OFF              0
+#define  AR_TRACKING_EDGE             1
+#define  DEFAULT_TRACKING_MODE              AR_TRACKING_OFF
+#define  AR_CODE_CACHE_OFF            0
+#define  AR_CODE_CACHE_ON             1
+#define  DEFAULT_CODE_CACHE_MODE            AR_CODE_CACHE_OFF
+#define  AR_POSE_REFINE_GRID          0
+#define  AR_POSE_REFINE_GAUSS_NEWTON  1
+#define  DEFAULT_POSE_REFINE_MODE           AR_POSE_REFINE_GRID
+#define  AR_STATS_OFF                 0
+#define  AR_STATS_ON                  1
+#define  DEFAULT_STATS_MODE                 AR_STATS_OFF
+#define  AR_TRACE_OFF                 0
+#define  AR_TRACE_ON                  1
+#define  DEFAULT_TRACE_MODE                 AR_TRACE_OFF
+#define  AR_MEM_AR                    0    /* subsystems of arMemAlloc() */
+#define  AR_MEM_VIDEO                 1
+#define  AR_MEM_GSUB                  2
+#define  AR_MEM_VRML                  3
+#define  AR_MEM_ARPE                  4
+#define  AR_MEM_TAGS                  5
+#define  AR_IMAGE_PAGE_NORMAL         0    /* pages of arImageAlloc() */
+#define  AR_IMAGE_PAGE_HUGE           1
+#define  DEFAULT_IMAGE_PAGE_MODE            AR_IMAGE_PAGE_NORMAL
+#define  AR_CPU_SSE2                  0x01 /* features of arCpuFeatures() */
+#define  AR_CPU_SSSE3                 0x02
+#define  AR_CPU_AVX2                  0x04
+#define  AR_CPU_NEON                  0x08
+#define  AR_KERNEL_BINARIZE           0    /* kernels of arCpuKernelName() */
+#define  AR_KERNEL_CORRELATE          1
+#define  AR_KERNELS                   2
+#define  AR_THREAD_CAPTURE            0    /* roles of arThreadRole() */
+#define  AR_THREAD_TRACK              1
+#define  AR_THREAD_RENDER             2
+#define  AR_THREAD_IO                 3
+#define  AR_THREAD_BACKGROUND         4
+#define  AR_THREAD_ROLES              5
+#define  AR_LABELING_BY_PIXEL         0
+#define  AR_LABELING_BY_RUN           1
+#define  DEFAULT_LABELING_MODE              AR_LABELING_BY_PIXEL
+#define  AR_THRESHOLD_MANUAL          0
+#define  AR_THRESHOLD_ADAPTIVE        1
+#define  AR_THRESHOLD_AUTO            2
+#define  DEFAULT_THRESHOLD_MODE             AR_THRESHOLD_MANUAL
+#define  AR_ROI_FULL_FRAME            0
+#define  AR_ROI_TRACKING              1
+#define  AR_ROI_MOTION                2
+#define  DEFAULT_ROI_MODE                   AR_ROI_FULL_FRAME
+#define  AR_PYRAMID_OFF               0
+#define  AR_PYRAMID_HALF              1
+#define  AR_PYRAMID_QUARTER           2
+#define  DEFAULT_PYRAMID_MODE               AR_PYRAMID_OFF
+#define  DEFAULT_LABELING_THREADS           1
 
 
 #ifdef __linux
@@ -164,6 +256,22 @@
 #    define   DEFAULT_VIDEO_MODE          VIDEO_MODE_NTSC
 #  endif
 
+#  ifdef AR_INPUT_V4L2
+#    define   DEFAULT_VIDEO_DEVICE        "/dev/video0"
+#    define   DEFAULT_VIDEO_WIDTH         640
+#    define   DEFAULT_VIDEO_HEIGHT        480
+#    define   DEFAULT_VIDEO_BUFFERS       4
+#    define   AR_VIDEO_V4L2_BUFFERS_MAX   32
+#  endif
+
+#  ifdef AR_INPUT_GSTREAMER
+#    define   AR_VIDEO_GST_FRAMES         4
+#  endif
+
+#  ifdef AR_INPUT_FILE
+#    define   DEFAULT_VIDEO_FILE          "video.arv"
+#  endif
+
 #  ifdef AR_INPUT_DV
 /* Defines all moved into video.c now - they are not used anywhere else */
 #  endif
@@ -189,6 +297,7 @@
 #endif
 
 #ifdef _WIN32
+#  define   AR_VIDEO_DSVL_CLIENTS       4
 #  define   DEFAULT_IMAGE_PROC_MODE     AR_IMAGE_PROC_IN_FULL
 #  define   DEFAULT_FITTING_MODE        AR_FITTING_TO_INPUT
 #  define   DEFAULT_DRAW_MODE           AR_DRAW_BY_TEXTURE_MAPPING
@@ -202,6 +311,9 @@
 #  define   DEFAULT_FITTING_MODE        AR_FITTING_TO_IDEAL
 #  define   DEFAULT_DRAW_MODE           AR_DRAW_BY_TEXTURE_MAPPING
 #  define   DEFAULT_DRAW_TEXTURE_IMAGE  AR_DRAW_TEXTURE_FULL_IMAGE
+#  ifdef AR_INPUT_AVFOUNDATION
+#    define   AR_VIDEO_AVF_FRAMES       4
+#  endif
 #undef    APPLE_TEXTURE_FAST_TRANSFER
 #endif
 
@@ -209,6 +321,9 @@
 /*  For NVIDIA OpenGL Driver  */
 #undef    AR_OPENGL_TEXTURE_RECTANGLE
 
+/*  For the EGL offscreen context of gsub_lite, without a window (link -lEGL)  */
+#undef    AR_OPENGL_EGL
+
 
 
 #if (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_ABGR) || (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_BGRA) || (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_RGBA) || (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_ARGB)
@@ -224,20 +339,95 @@
 #endif
 
 
+/* The kernels for a vector unit the compiler was not told of are built
+   for it alone, and taken when arCpuFeatures() has it. */
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#  if defined(_MSC_VER)
+#    define AR_CPU_TARGET(T)
+#    if _MSC_VER >= 1800
+#      define AR_CPU_X86_AVX2
+#    endif
+#  else
+#    define AR_CPU_TARGET(T)  __attribute__((target(T)))
+#    define AR_CPU_X86_AVX2
+#  endif
+#endif
+
+
 #define   AR_GET_TRANS_MAT_MAX_LOOP_COUNT         5
 #define   AR_GET_TRANS_MAT_MAX_FIT_ERROR          1.0
 #define   AR_GET_TRANS_CONT_MAT_MAX_FIT_ERROR     1.0
+#define   AR_POSE_REFINE_MAX_LOOP_COUNT          10
+#define   AR_POSE_REFINE_CONVERGE                 1.0e-6
+#define   AR_POSE_FILTER_MIN_CUTOFF               1.0
+#define   AR_POSE_FILTER_BETA_POS                 0.01
+#define   AR_POSE_FILTER_BETA_ROT                 0.5
+#define   AR_POSE_FILTER_PREDICT_MAX              0.1
+#define   AR_POSE_FILTER_RESET_TIME               0.5
 
 #define   AR_AREA_MAX      100000
 #define   AR_AREA_MIN          70
+#define   AR_CANDIDATE_ASPECT_MAX   8
+#define   AR_CANDIDATE_FILL_MIN  0.08
+#define   AR_CANDIDATE_EDGE_MIN     8
 
 
 #define   AR_SQUARE_MAX        30
 #define   AR_CHAIN_MAX      10000
+#define   AR_CONTOUR_BLOCK  65536
+#define   AR_LABEL_WORK_MAX 32768
+#define   AR_ADAPTIVE_THRESH_BLOCK 32
+#define   AR_ADAPTIVE_THRESH_BIAS  10
+#define   AR_AUTO_THRESH_LOST_MAX  30
+#define   AR_EXPOSURE_START      0.25
+#define   AR_EXPOSURE_GAIN_START 0.25
+#define   AR_EXPOSURE_GAIN_MAX   0.75
+#define   AR_EXPOSURE_STEP       0.02
+#define   AR_EXPOSURE_CONTRAST     80
+#define   AR_EXPOSURE_BRIGHT_MAX  240
+#define   AR_EXPOSURE_SETTLE        3
+#define   AR_EXPOSURE_LOST_MAX     15
+#define   AR_ROI_FULL_SCAN_INTERVAL 10
+#define   AR_ROI_MARGIN            0.5
+#define   AR_MOTION_BLOCK          32
+#define   AR_MOTION_STEP            4
+#define   AR_MOTION_DIFF            8
+#define   AR_MOTION_FULL_SCAN_INTERVAL 300
+#define   AR_LABELING_THREADS_MAX   8
+#define   AR_BATCH_THREADS_MAX     16
+#define   AR_VIEW_MAX               8
+#define   AR_VIDEO_LEASE_MAX        8
+#define   AR_VIDEO_GROUP_MAX        4
+#define   AR_VIDEO_GROUP_HISTORY    2
+#define   AR_LABELING_BAND_MIN     16
+#define   AR_PARAM_LUT_STEP_MAX    16
+#define   AR_EDGE_REFINE_RANGE      4
+#define   AR_EDGE_REFINE_SAMPLES   32
+#define   AR_EDGE_REFINE_CONTRAST   8
+#define   AR_TRACKING_RANGE        10
+#define   AR_TRACKING_REDETECT_INTERVAL 30
+#define   AR_CODE_CACHE_CF         0.7
+#define   AR_CODE_CACHE_DIST       0.05
+#define   AR_CODE_CACHE_VERIFY_INTERVAL 10
+#define   AR_TRACE_EVENTS       16384
+#define   AR_TRACE_THREADS_MAX     32
+#define   AR_THREAD_MAX            64    /* threads in the registry of arThreadRole() */
+#define   AR_TRACE_DEPTH           32
+#define   AR_FRAME_BLOCK        65536    /* bytes of a block of arFrameAlloc() at least */
+#define   AR_IMAGE_ALIGN           64    /* bytes an image of arImageAlloc() is aligned to, and its rows by arImageStride() */
+#define   AR_IMAGE_POOL_MAX        16    /* images freed that arImageFree() keeps for the next arImageAlloc() */
+#define   AR_IMAGE_HUGE_PAGE  (2*1024*1024)  /* bytes an image must have for AR_IMAGE_PAGE_HUGE */
 #define   AR_PATT_NUM_MAX      50 
+#define   AR_PATT_PREFILTER_MIN 16
+#define   AR_PATT_CANDIDATE_NUM 8
 #define   AR_PATT_SIZE_X       16 
 #define   AR_PATT_SIZE_Y       16 
 #define   AR_PATT_SAMPLE_NUM   64
+#define   AR_MATRIX_CODE_SIZE   6
+#define   AR_MATRIX_CODE_NUM    4096
+#define   AR_MATRIX_CODE_ID_BASE 10000
+#define   AR_MATRIX_CODE_ERROR_MAX 3
+#define   AR_MATRIX_CODE_CONTRAST  40
 
 #define   AR_GL_CLIP_NEAR      50.0
 #define   AR_GL_CLIP_FAR     5000.0
@@ -248,5 +438,9 @@
 #define   AR_PARAM_NMIN         6
 #define   AR_PARAM_NMAX      1000
 #define   AR_PARAM_C34        100.0
+#define   AR_PARAM_CALIB_FRAMES_MIN     3
+#define   AR_PARAM_CALIB_DOT_AREA_MIN   6
+#define   AR_PARAM_CALIB_MAX_LOOP_COUNT 50
+#define   AR_PARAM_CALIB_CONVERGE    1.0e-8
 
 #endif
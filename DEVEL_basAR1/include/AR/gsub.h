@@ -128,6 +128,9 @@ void argSwapBuffers( void );
 * This function is called in the entry block of a program. User
 * specify the main callback of his program. Users should not
 * put routines calls after this function, generally never accessible.
+* \remark buffer swaps wait for the display refresh, and mainFunc is
+* called when a frame drawn at once would be done just before the next
+* refresh, as measured by the swaps of argSwapBuffers.
 * \param mouseFunc the user mouse function can be NULL.
 * \param keyFunc the user keyboard function can be NULL.
 * \param mainFunc the user main update function can be NULL.
@@ -187,6 +190,19 @@ void argDraw3dLeft( void );
 */
 void argDraw3dRight( void );
 
+/** \fn void argDraw3dStereo( void (*drawFunc)(void) )
+* \brief render the 3D scene for both eyes from one traversal.
+*
+* In HMD mode, with the parameters of argLoadHMDparam, drawFunc is
+* called once, compiled into a display list, and the list is drawn
+* for the left then the right eye. Otherwise drawFunc is called once
+* in the view of argDraw3dCamera(0, 0).
+* \remark drawFunc must not read back GL state, nor change the
+* projection matrix.
+* \param drawFunc function rendering the scene, e.g. by arVrmlDraw
+*/
+void argDraw3dStereo( void (*drawFunc)(void) );
+
 /** \fn void argDraw3dCamera( int xwin, int ywin )
 * \brief switch the rendering view for 3D rendering mode.
 *
@@ -233,10 +249,10 @@ void argConvGLcpara( ARParam *param, double gnear, double gfar, double m[16] );
 * \remark According to your argDrawMode, argTexmapMode and the internal
 * image format the openGL function called is different and less
 * or more efficient.
-* \remark with AR_DRAW_BY_GL_DRAW_PIXELS, unaffected by current camera
-* parameters matrix but affected by glRasterPos3f.
-* \remark with AR_DRAW_BY_TEXTURE_MAPPING, affected by current current camera
-* parameters matrix. You need generally call argDrawMode2D before this function.
+* \remark the image is textured by gsub_lite in the viewport of the
+* window, and streamed through pixel buffer objects where the driver
+* has them. AR_DRAW_BY_GL_DRAW_PIXELS draws it without the compensation
+* of the lens distortion. The current matrices and viewport are kept.
 * \param image image to display
 * \param xwin XXXBK
 * \param ywin XXXBK
@@ -55,6 +55,9 @@ extern "C" {
 * camera position. You will find more informations on the calibration routine
 * on opticalcalibration.html .This function modify gsub state of left and right camera
 * intrinsic parameters. 
+* From the sixth sample of an eye on, the samples so far are solved in a
+* thread of their own after each new one, and a cross shows where that
+* solution puts the target; the last solve is the result.
 * \param targetId the target used for the calibration step.
 * \param thresh2 lighting threshold value to use
 * \param postFunc a callback function used to analysis computed internal camera
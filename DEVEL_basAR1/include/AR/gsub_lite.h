@@ -135,6 +135,9 @@ extern "C" {
 #include <AR/config.h>
 #include <AR/ar.h>		// ARUint8, AR_PIXEL_FORMAT, arDebug, arImage.
 #include <AR/param.h>	// ARParam, arParamDecompMat(), arParamObserv2Ideal()
+#ifdef AR_INPUT_AVFOUNDATION
+#  include <IOSurface/IOSurface.h>
+#endif
 
 // ============================================================================
 //	Public types and definitions.
@@ -148,6 +151,9 @@ extern "C" {
 #  define FALSE 0
 #endif
 
+// Most pixel buffer objects arglPixelBufferObjectsSet() rotates.
+#define ARGL_PIXEL_BUFFER_OBJECTS_MAX 3
+
 /*!
     @typedef ARGL_CONTEXT_SETTINGS_REF
     @abstract Opaque type to hold ARGL settings for a given OpenGL context.
@@ -173,6 +179,24 @@ extern "C" {
  */
 typedef struct _ARGL_CONTEXT_SETTINGS *ARGL_CONTEXT_SETTINGS_REF;
 
+/*!
+    @typedef ARGL_FRAME_PACER_REF
+    @abstract Opaque type of the frame pacer of arglFramePacerCreate().
+ */
+typedef struct _ARGL_FRAME_PACER *ARGL_FRAME_PACER_REF;
+
+/*!
+    @typedef ARGL_OFFSCREEN_REF
+    @abstract Opaque type of the offscreen framebuffer of arglOffscreenCreate().
+ */
+typedef struct _ARGL_OFFSCREEN *ARGL_OFFSCREEN_REF;
+
+/*!
+    @typedef ARGL_MATCHER_REF
+    @abstract Opaque type of the template matcher of arglMatcherCreate().
+ */
+typedef struct _ARGL_MATCHER *ARGL_MATCHER_REF;
+
 // ============================================================================
 //	Public globals.
 // ============================================================================
@@ -210,6 +234,27 @@ extern GLuint arglAppleTextureRangeStorageHint;
 */
 ARGL_CONTEXT_SETTINGS_REF arglSetupForCurrentContext(void);
 
+/*!
+    @function
+    @abstract Draw in the current context from the objects of another.
+    @discussion
+		For a second window showing the same video, as a projector beside the
+		monitor of an operator. The current context is made to share the
+		textures, buffer objects, display lists and programs of the context
+		share was set up for; on Windows by wglShareLists(), which must be
+		called before the current context has any objects of its own, elsewhere
+		the context must have been created sharing them. The settings are then
+		those of share: the video is uploaded by the first context to draw a
+		frame and only drawn by the others, and a VRML scene made in one is
+		drawn in all.
+
+		arglCleanup() in each context ends its sharing; the objects are
+		deleted by the last.
+	@param share The settings of arglSetupForCurrentContext() in the first context.
+    @result share, or NULL if the objects could not be shared.
+*/
+ARGL_CONTEXT_SETTINGS_REF arglSetupForCurrentContextShared(ARGL_CONTEXT_SETTINGS_REF share);
+
 /*!
     @function
     @abstract Free memory used by gsub_lite associated with the specified context.
@@ -372,6 +417,59 @@ void arglDispImage(ARUint8 *image, const ARParam *cparam, const double zoom, ARG
  */
 void arglDispImageStateful(ARUint8 *image, const ARParam *cparam, const double zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings);
 
+/*!
+	@function
+    @abstract Display an NV12 image, as from V4L2 or GStreamer, with the fragment program.
+    @discussion
+		Like arglDispImage, with the fragment program of arglShaderSet(), whatever its
+		setting: the luma and CbCr planes are uploaded as they are and converted to RGB
+		on the GPU. Needs OpenGL 2.0; nothing is drawn without it.
+	@param luma The tightly-packed luma plane, cparam->xsize by cparam->ysize bytes.
+	@param chroma The interleaved CbCr plane of half the width and height, or NULL
+		if it follows the luma plane.
+	@param cparam See arglDispImage().
+	@param zoom See arglDispImage().
+	@param contextSettings See arglDispImage().
+ */
+void arglDispImageNV12(ARUint8 *luma, ARUint8 *chroma, const ARParam *cparam, const double zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings);
+
+/*!
+	@function
+    @abstract Display a raw Bayer frame, as from ar2VideoInqBayer(), with the fragment program.
+    @discussion
+		Like arglDispImageNV12: the frame is uploaded as it is and demosaiced on the GPU,
+		each 2x2 tile taking its own R and B and the G of its column, as the video modules
+		do on the CPU. This leaves the CPU only the binning of the luma for the detection.
+	@param raw The tightly-packed frame, cparam->xsize by cparam->ysize bytes.
+	@param red The position of R in each 2x2 tile: 0 top left, 1 top right, 2 bottom left,
+		3 bottom right, top being the first row in memory.
+	@param cparam See arglDispImage().
+	@param zoom See arglDispImage().
+	@param contextSettings See arglDispImage().
+ */
+void arglDispImageBayer(ARUint8 *raw, const int red, const ARParam *cparam, const double zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings);
+
+#ifdef AR_INPUT_AVFOUNDATION
+/*!
+	@function
+    @abstract Display the IOSurface of a video frame, by binding it as an OpenGL texture.
+    @discussion
+		Like arglDispImage, but the pixels are not uploaded: the surface of
+		the CVPixelBuffer of ar2VideoInqPixelBuffer() (CVPixelBufferGetIOSurface())
+		is bound as a rectangle texture with CGLTexImageIOSurface2D. The draw
+		mode, texmap mode and pixel format settings are not used. 420f frames
+		are drawn as their luma plane, BGRA and 2vuy frames in colour.
+		The frame must stay held (by ar2VideoLeaseFrame(), or until
+		ar2VideoCapNext()) while it is drawn.
+	@param surface The IOSurface of the frame.
+	@param cparam See arglDispImage().
+	@param zoom See arglDispImage().
+	@param contextSettings See arglDispImage().
+	@availability Mac OS X 10.7 and later, with AR_INPUT_AVFOUNDATION.
+ */
+void arglDispImageIOSurface(IOSurfaceRef surface, const ARParam *cparam, const double zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings);
+#endif // AR_INPUT_AVFOUNDATION
+
 /*!
     @function
     @abstract Set compensation for camera lens distortion in arglDispImage to off or on.
@@ -409,6 +507,26 @@ int arglDistortionCompensationSet(ARGL_CONTEXT_SETTINGS_REF contextSettings, int
  */
 int arglDistortionCompensationGet(ARGL_CONTEXT_SETTINGS_REF contextSettings, int *enable);
 
+/*!
+    @function
+	@abstract Build the distortion compensation mesh of a camera ahead of the first draw.
+	@discussion
+		arglDispImage() draws the image on a 20 x 20 grid of the ideal positions
+		of the camera's pixels, computed from cparam->dist_factor[]. The grid is
+		built once per camera parameter and kept in the context, in a vertex buffer
+		object where the driver has them, so changes of zoom or texmap mode reuse it.
+		Calling this function right after arglSetupForCurrentContext() builds it
+		there, rather than during the first frame drawn. The grids of the last
+		four camera parameters drawn are kept, so calling it once for each
+		capture resolution (see arParamSizesAdd()) makes switching between them
+		build nothing, the fragment program's distortion table included.
+	@param contextSettings A reference to ARGL's settings for the current OpenGL
+		context, as returned by arglSetupForCurrentContext() for this context. 
+	@param cparam Pointer to the camera parameters that will be passed to arglDispImage().
+	@result TRUE if the mesh was built, FALSE if an error occurred.
+ */
+int arglDistortionMeshPrepare(ARGL_CONTEXT_SETTINGS_REF contextSettings, const ARParam *cparam);
+
 /*!
     @function
     @abstract Set the format of pixel data which will be passed to arglDispImage*()
@@ -535,6 +653,257 @@ void arglTexRectangleSet(ARGL_CONTEXT_SETTINGS_REF contextSettings, const int st
  */
 int arglTexRectangleGet(ARGL_CONTEXT_SETTINGS_REF contextSettings);
 
+/*!
+    @function
+	@abstract Determines use of pixel buffer objects for the texture uploads of arglDispImage().
+	@discussion
+		When arglDrawModeSet(AR_DRAW_BY_TEXTURE_MAPPING) has been called, a count
+		of 2 or 3 makes arglDispImage() copy each frame into the next of that many
+		rotating pixel buffer objects and fill the texture from there. The transfer
+		to the texture then runs asynchronously, by DMA, and the image may be given
+		back to the video library (e.g. by arVideoCapNext()) as soon as
+		arglDispImage() returns. A count of 0 uploads straight from the image, and
+		waits for the transfer.
+ 
+		If the OpenGL driver available at runtime supports neither OpenGL 2.1 nor
+		GL_ARB_pixel_buffer_object, the setting reverts to 0 on the first draw.
+ 
+		The initial value is 0.
+	@param count 0, or the number of pixel buffer objects, at most ARGL_PIXEL_BUFFER_OBJECTS_MAX.
+ */
+void arglPixelBufferObjectsSet(ARGL_CONTEXT_SETTINGS_REF contextSettings, const int count);
+
+/*!
+    @function
+	@abstract Enquire as to the number of pixel buffer objects used by arglDispImage().
+	@discussion
+		See arglPixelBufferObjectsSet() for more info.
+ */
+int arglPixelBufferObjectsGet(ARGL_CONTEXT_SETTINGS_REF contextSettings);
+
+/*!
+    @function
+	@abstract Determines use of an OpenGL 2.0 fragment program in arglDispImage().
+	@discussion
+		When arglDrawModeSet(AR_DRAW_BY_TEXTURE_MAPPING) has been called, a value of TRUE
+		makes arglDispImage() upload the image as it is, into a non power-of-two texture,
+		and leave the rest to a fragment program: 2vuy and yuvs images are converted to
+		RGB, and the camera lens distortion is compensated for by a table of the observed
+		position of every pixel, built once per camera parameters. No display list is
+		built on the CPU. The texmap mode is not used.
+ 
+		Setting the pixel format to 2vuy or yuvs on an implementation without
+		GL_APPLE_ycbcr_422 or GL_MESA_ycbcr_texture sets this to TRUE. If the
+		OpenGL driver available at runtime does not support OpenGL 2.0, the value
+		reverts to FALSE on the first draw.
+ 
+		The initial value is FALSE.
+ */
+void arglShaderSet(ARGL_CONTEXT_SETTINGS_REF contextSettings, const int state);
+
+/*!
+    @function
+	@abstract Enquire as to use of the fragment program in arglDispImage().
+	@discussion
+		See arglShaderSet() for more info.
+ */
+int arglShaderGet(ARGL_CONTEXT_SETTINGS_REF contextSettings);
+
+/*!
+    @function
+	@abstract Set the number of display refreshes per buffer swap of the current context.
+	@discussion
+		A value of 1 synchronises buffer swaps with the display refresh (vsync),
+		0 swaps at once. Uses CGL on Mac OS X, WGL_EXT_swap_control on Windows
+		and GLX_SGI_swap_control elsewhere, which cannot set 0.
+	@param interval Refreshes per swap.
+	@result TRUE if the interval was set, FALSE if the driver does not support it.
+ */
+int arglSwapIntervalSet(const int interval);
+
+/*!
+    @function
+	@abstract Create a frame pacer, to time the frames of a vsynced render loop.
+	@discussion
+		The pacer measures the time between buffer swaps, to estimate the
+		display refresh period, and the time taken to draw a frame. From
+		these, arglFramePacerWait() tells how long to wait before beginning
+		the next frame, so that it is done just before a refresh. The video
+		and the markers are then taken as late as possible, instead of a
+		frame alternately making and missing the refresh.
+ 
+		All times are in seconds, of any one clock that does not jump.
+	@result A new pacer, to be freed with arglFramePacerDelete().
+ */
+ARGL_FRAME_PACER_REF arglFramePacerCreate(void);
+
+/*!
+    @function
+	@abstract Free a frame pacer.
+ */
+void arglFramePacerDelete(ARGL_FRAME_PACER_REF pacer);
+
+/*!
+    @function
+	@abstract Time to wait before beginning the next frame.
+	@param now Current time.
+	@result Seconds before the frame should begin, 0 to begin now.
+ */
+double arglFramePacerWait(ARGL_FRAME_PACER_REF pacer, const double now);
+
+/*!
+    @function
+	@abstract Record the beginning of a frame, once arglFramePacerWait() returned 0.
+	@param now Current time.
+ */
+void arglFramePacerBegin(ARGL_FRAME_PACER_REF pacer, const double now);
+
+/*!
+    @function
+	@abstract Record a buffer swap.
+	@param drawn Time the drawing was done, just before the swap.
+	@param presented Time the swap returned.
+ */
+void arglFramePacerPresented(ARGL_FRAME_PACER_REF pacer, const double drawn, const double presented);
+
+/*!
+    @function
+	@abstract Enquire as to the refresh period the pacer has measured.
+	@result The period in seconds, 1/60 until measured.
+ */
+double arglFramePacerPeriod(ARGL_FRAME_PACER_REF pacer);
+
+/*!
+    @function
+	@abstract Create a framebuffer to draw into without a window.
+	@discussion
+		The framebuffer has a colour and a depth buffer of width x height. Between
+		arglOffscreenBind() and arglOffscreenUnbind(), everything is drawn into
+		it, including by arglDispImage(), and arglOffscreenRead() reads the frames
+		back for e.g. encoding.
+ 
+		With ownContext FALSE, the framebuffer is made in the current OpenGL context.
+		With ownContext TRUE, it first creates and makes current an OpenGL context of
+		its own, with EGL and no window or display server, so that on a server
+		arglSetupForCurrentContext() can follow without GLUT. This needs
+		AR_OPENGL_EGL in config.h, and libEGL.
+ 
+		Needs OpenGL 3.0 or GL_EXT_framebuffer_object.
+	@param width Width in pixels.
+	@param height Height in pixels.
+	@param ownContext TRUE to create an EGL context for the framebuffer.
+	@result The framebuffer, to be freed with arglOffscreenDelete(), or NULL if an error occurred.
+ */
+ARGL_OFFSCREEN_REF arglOffscreenCreate(const int width, const int height, const int ownContext);
+
+/*!
+    @function
+	@abstract Free an offscreen framebuffer, and its context if it has one of its own.
+ */
+void arglOffscreenDelete(ARGL_OFFSCREEN_REF offscreen);
+
+/*!
+    @function
+	@abstract Draw into the offscreen framebuffer, over all of it.
+	@discussion
+		Binds the framebuffer and sets the viewport to its size.
+ */
+void arglOffscreenBind(ARGL_OFFSCREEN_REF offscreen);
+
+/*!
+    @function
+	@abstract Draw into the window again.
+ */
+void arglOffscreenUnbind(ARGL_OFFSCREEN_REF offscreen);
+
+/*!
+    @function
+	@abstract Read back a frame drawn into the offscreen framebuffer.
+	@discussion
+		Call once per frame, when the drawing is done. With pixel buffer objects
+		(OpenGL 2.1 or GL_ARB_pixel_buffer_object) the read of this frame is only
+		started, into one of two buffers, and the frame of the previous call is
+		returned from the other, whose transfer has had since then to complete.
+		So nothing waits for the GPU, at the cost of one frame of latency, and
+		the first call returns NULL. Without them the frame is read at once.
+ 
+		The pixels are AR_PIXEL_FORMAT_BGRA, width * 4 bytes per row, the bottom
+		row first as in OpenGL. They stay valid until the next call.
+	@result The pixels, or NULL if none are available yet.
+ */
+ARUint8 *arglOffscreenRead(ARGL_OFFSCREEN_REF offscreen);
+
+/*!
+    @function
+	@abstract Binarize an image for libAR's labeling on the GPU.
+	@discussion
+		Draws the image, through the fragment program of arglShaderSet(), into
+		offscreen, with every pixel darker than thresh white and the rest black,
+		and reads it back into mask: 0xFF for dark pixels and 0 otherwise,
+		cparam->xsize / scale bytes per row, the top row first. That is the binary
+		image libAR labels, to be given to it with arSetBinaryImageCtx(), scale
+		being arGetLabelingScale() of the detection context. A pixel is dark as
+		libAR binarizes it: the mean of its red, green and blue, or its luma for
+		2vuy and yuvs images, is below thresh. The distortion is not compensated.
+ 
+		Only the threshold is done by the GPU: the labeling, the contours and the
+		rest of the detection stay with libAR, which traces the contours in the
+		label image and so needs all of it, not only a table of the labels.
+ 
+		The read waits for the GPU, so that the mask is of this image. This is worth
+		it when the CPU is short rather than the bus: the whole image is uploaded,
+		and a byte per pixel of the label image read back.
+		Needs OpenGL 2.0 and the framebuffer objects of arglOffscreenCreate().
+	@param image The image, in the format of arglPixelFormatSet().
+	@param cparam Camera parameters of the image; only its size is used.
+	@param scale Pixels of the image per pixel of the mask, across and down.
+	@param thresh Threshold, 0 to 255.
+	@param mask Where the binary image goes, (cparam->xsize / scale) * (cparam->ysize / scale) bytes.
+	@param offscreen A framebuffer of cparam->xsize / scale by cparam->ysize / scale, in the current context.
+	@result TRUE if the mask was written, FALSE if the OpenGL implementation cannot do it or the sizes do not match.
+ */
+int arglBinarize(ARUint8 *image, const ARParam *cparam, const int scale, const int thresh, ARUint8 *mask, ARGL_OFFSCREEN_REF offscreen, ARGL_CONTEXT_SETTINGS_REF contextSettings);
+
+/*!
+    @function
+	@abstract Create a template matcher that runs on the GPU, in the current context.
+	@discussion
+		The matcher holds the active patterns of libAR in a texture, a row per
+		pattern and direction, made again whenever arGetPattSerial() changes. Given
+		to arSetPattMatcherCtx() with arglMatch(), it matches all the squares of a
+		frame in one upload, one draw and one read back of a pixel per pair of
+		patterns, so that a library of hundreds of patterns costs the CPU no more
+		than one of a few. The GPU only picks the best pattern and direction of
+		each square; its confidence is then worked out from the samples as libAR
+		does, on the CPU.
+ 
+		The matching is done in the thread detecting with the detection context,
+		in which the context the matcher was created in must be current: usually
+		one of its own, from arglOffscreenCreate() with ownContext TRUE.
+ 
+		Needs OpenGL 2.0 and the framebuffer objects of arglOffscreenCreate(). The
+		library may be up to a quarter of GL_MAX_TEXTURE_SIZE patterns.
+	@result The matcher, to be freed with arglMatcherDelete(), or NULL if out of memory.
+		A matcher the OpenGL implementation cannot run lets libAR match.
+ */
+ARGL_MATCHER_REF arglMatcherCreate(void);
+
+/*!
+    @function
+	@abstract Free a template matcher, in the context it was created in.
+ */
+void arglMatcherDelete(ARGL_MATCHER_REF matcher);
+
+/*!
+    @function
+	@abstract The ARPattMatcher of a matcher of arglMatcherCreate().
+	@discussion
+		E.g. arSetPattMatcherCtx(handle, arglMatch, arglMatcherCreate()).
+	@param data The matcher.
+	@result 0 if the patterns were matched, -1 for libAR to match them.
+ */
+int arglMatch(void *data, ARUint8 (*ext_pat)[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3], int num, int *code, int *dir, double *cf);
+
 #ifdef __cplusplus
 }
 #endif
@@ -357,6 +357,94 @@ double arVecInnerproduct( ARVec *x, ARVec *y );
 */
 int    arVecTridiagonalize( ARMat *a, ARVec *d, ARVec *e );
 
+// ============================================================================
+//	Fixed-size routines.
+// ============================================================================
+
+/* The 3x3 and 3x4 matrices of the pose code, on the stack and inlined,
+   without the allocations of ARMat. */
+#if defined(_MSC_VER)
+#  define AR_INLINE static __inline
+#elif defined(__GNUC__)
+#  define AR_INLINE static __inline__
+#else
+#  define AR_INLINE static
+#endif
+
+/** \fn int arMat3Inv( double s[3][3], double d[3][3] )
+* \brief inverts a 3x3 matrix.
+*
+* d may be s.
+* \param s matrix to invert
+* \param d inverse of s
+* \return 0 on success, -1 if s is singular (d is left unchanged)
+*/
+AR_INLINE int arMat3Inv( double s[3][3], double d[3][3] )
+{
+    double  a[3][3];
+    double  det;
+    int     i, j;
+
+    a[0][0] = s[1][1]*s[2][2] - s[1][2]*s[2][1];
+    a[0][1] = s[0][2]*s[2][1] - s[0][1]*s[2][2];
+    a[0][2] = s[0][1]*s[1][2] - s[0][2]*s[1][1];
+    a[1][0] = s[1][2]*s[2][0] - s[1][0]*s[2][2];
+    a[1][1] = s[0][0]*s[2][2] - s[0][2]*s[2][0];
+    a[1][2] = s[0][2]*s[1][0] - s[0][0]*s[1][2];
+    a[2][0] = s[1][0]*s[2][1] - s[1][1]*s[2][0];
+    a[2][1] = s[0][1]*s[2][0] - s[0][0]*s[2][1];
+    a[2][2] = s[0][0]*s[1][1] - s[0][1]*s[1][0];
+    det = s[0][0]*a[0][0] + s[0][1]*a[1][0] + s[0][2]*a[2][0];
+    if( det == 0.0 ) return -1;
+
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 3; i++ ) d[j][i] = a[j][i] / det;
+    }
+    return 0;
+}
+
+/** \fn void arMat3MulVec( double m[3][3], double v[3], double r[3] )
+* \brief multiplies a vector by a 3x3 matrix: r = m.v
+*
+* \param m matrix
+* \param v vector
+* \param r result, distinct from v
+*/
+AR_INLINE void arMat3MulVec( double m[3][3], double v[3], double r[3] )
+{
+    r[0] = m[0][0]*v[0] + m[0][1]*v[1] + m[0][2]*v[2];
+    r[1] = m[1][0]*v[0] + m[1][1]*v[1] + m[1][2]*v[2];
+    r[2] = m[2][0]*v[0] + m[2][1]*v[1] + m[2][2]*v[2];
+}
+
+/** \fn int arMat34Inv( double s[3][4], double d[3][4] )
+* \brief inverts a 3x4 transformation.
+*
+* The inverse of s seen as a 4x4 matrix with a last row of 0 0 0 1.
+* d may be s.
+* \param s transformation to invert
+* \param d inverse of s
+* \return 0 on success, -1 if s is singular (d is left unchanged)
+*/
+AR_INLINE int arMat34Inv( double s[3][4], double d[3][4] )
+{
+    double  r[3][3], t[3], it[3];
+    int     i, j;
+
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 3; i++ ) r[j][i] = s[j][i];
+        t[j] = s[j][3];
+    }
+    if( arMat3Inv( r, r ) < 0 ) return -1;
+    arMat3MulVec( r, t, it );
+
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 3; i++ ) d[j][i] = r[j][i];
+        d[j][3] = -it[j];
+    }
+    return 0;
+}
+
 
 #ifdef __cplusplus
 }
@@ -44,6 +44,18 @@ extern "C" {
 //	Public types and defines.
 // ============================================================================
 
+/** \typedef ARdouble
+* \brief working precision of the edge fitting and undistortion.
+*
+* float when ARDOUBLE_IS_FLOAT is defined in config.h, double otherwise.
+* The parameters and results of the library functions stay double.
+*/
+#ifdef ARDOUBLE_IS_FLOAT
+typedef float             ARdouble;
+#else
+typedef double            ARdouble;
+#endif
+
 /** \struct ARParam
 * \brief camera intrinsic parameters.
 * 
@@ -78,6 +90,64 @@ typedef struct {
     double   dist_factorR[4];
 } ARSParam;
 
+/** \struct ARViewParam
+* \brief calibration of several cameras viewing one scene.
+*
+* \param view_num number of cameras, at most AR_VIEW_MAX
+* \param param intrinsic parameters of each camera
+* \param trans transformation from the coordinates of camera 0 to those
+*        of each camera (the identity for camera 0)
+*/
+typedef struct {
+    int      view_num;
+    ARParam  param[AR_VIEW_MAX];
+    double   trans[AR_VIEW_MAX][3][4];
+} ARViewParam;
+
+/** \struct ARParamLUT
+* \brief precomputed observed to ideal coordinates conversion.
+*
+* Offsets from observed to ideal coordinates at every step-th pixel of
+* an xsize x ysize image, interpolated bilinearly in between.
+* \param table x and y offsets of the nodes, row by row
+* \param xsize width of the image covered
+* \param ysize height of the image covered
+* \param step spacing of the nodes in pixels, a power of 2
+* \param xnum number of nodes per row
+* \param ynum number of rows of nodes
+* \param max_bytes memory budget the table was built for
+* \param dist_factor distortion factors the table was built for
+*/
+typedef struct {
+    float   *table;
+    int      xsize, ysize;
+    int      step;
+    int      xnum, ynum;
+    int      max_bytes;
+    double   dist_factor[4];
+} ARParamLUT;
+
+#define   AR_PARAM_SIZES_MAX     4
+
+/** \struct ARParamSizes
+* \brief camera parameters and lookup tables for each capture resolution.
+*
+* Built once per resolution by arParamSizesAdd(), so that switching the
+* capture resolution at run time, see arSetParamSizeCtx(), computes
+* nothing. The tables are shared with the detection contexts switched to
+* them, so the sizes are never replaced, only freed all at once.
+* \param source parameters all sizes are scaled from
+* \param num number of sizes
+* \param param source scaled to each size by arParamChangeSize()
+* \param lut table of each size, built for the max_bytes given to arParamSizesAdd()
+*/
+typedef struct {
+    ARParam     source;
+    int         num;
+    ARParam     param[AR_PARAM_SIZES_MAX];
+    ARParamLUT  lut[AR_PARAM_SIZES_MAX];
+} ARParamSizes;
+
 // ============================================================================
 //	Public globals.
 // ============================================================================
@@ -156,6 +226,41 @@ int arParamIdeal2Observ( const double dist_factor[4], const double ix, const dou
 int arParamObserv2Ideal( const double dist_factor[4], const double ox, const double oy,
                          double *ix, double *iy );
 
+/** \fn int arParamLUTCreate( ARParamLUT *lut, const double dist_factor[4], int xsize, int ysize, int max_bytes )
+* \brief build a lookup table for arParamObserv2IdealLUT().
+*
+* The nodes are as close as max_bytes allows, from every pixel to every
+* AR_PARAM_LUT_STEP_MAX-th one. A previous table held by lut is freed.
+* \param lut table to fill, zeroed before first use
+* \param dist_factor distorsion factors of used camera
+* \param xsize width of the image
+* \param ysize height of the image
+* \param max_bytes most memory the table may take
+* \return 0 if success, -1 if the budget is too small (lut then has no table)
+*/
+int arParamLUTCreate( ARParamLUT *lut, const double dist_factor[4], int xsize, int ysize, int max_bytes );
+
+/** \fn void arParamLUTFree( ARParamLUT *lut )
+* \brief free the table built by arParamLUTCreate().
+* \param lut table to free
+*/
+void arParamLUTFree( ARParamLUT *lut );
+
+/** \fn int arParamObserv2IdealLUT( const ARParamLUT *lut, const double ox, const double oy, double *ix, double *iy )
+* \brief arParamObserv2Ideal() through a lookup table.
+*
+* Points outside the image, or all points if the table could not be
+* built, are converted with arParamObserv2Ideal().
+* \param lut table built by arParamLUTCreate()
+* \param ox x in observed screen coordinates
+* \param oy y in observed screen coordinates
+* \param ix resulted x in ideal screen coordinates
+* \param iy resulted y in ideal screen coordinates
+* \return 0 if success, -1 otherwise
+*/
+int arParamObserv2IdealLUT( const ARParamLUT *lut, const double ox, const double oy,
+                            double *ix, double *iy );
+
 /** \fn int arParamChangeSize( ARParam *source, int xsize, int ysize, ARParam *newparam )
 * \brief change the camera size parameters.
 *
@@ -168,6 +273,39 @@ int arParamObserv2Ideal( const double dist_factor[4], const double ox, const dou
 */
 int arParamChangeSize( ARParam *source, int xsize, int ysize, ARParam *newparam );
 
+/** \fn int arParamSizesInit( ARParamSizes *sizes, ARParam *source )
+* \brief start a set of sizes, with none yet.
+* \param sizes the set
+* \param source parameters of the calibrated size
+* \return 0
+*/
+int arParamSizesInit( ARParamSizes *sizes, ARParam *source );
+
+/** \fn int arParamSizesAdd( ARParamSizes *sizes, int xsize, int ysize, int max_bytes )
+* \brief scale the parameters to a size, unless the set already has it.
+* \param sizes the set
+* \param xsize width of the images
+* \param ysize height of the images
+* \param max_bytes budget of its lookup table, see arParamLUTCreate(); 0 for none
+* \return the index of the size in sizes->param, -1 if the set is full.
+*/
+int arParamSizesAdd( ARParamSizes *sizes, int xsize, int ysize, int max_bytes );
+
+/** \fn int arParamSizesFind( const ARParamSizes *sizes, int xsize, int ysize )
+* \brief find a size of the set.
+* \return its index in sizes->param, -1 if the set does not have it.
+*/
+int arParamSizesFind( const ARParamSizes *sizes, int xsize, int ysize );
+
+/** \fn void arParamSizesFree( ARParamSizes *sizes )
+* \brief free the tables of the set.
+*
+* Contexts switched to one of its sizes must have been deleted, or switched
+* with arInitCparam() or arResizeHandle() to a table of their own.
+* \param sizes the set
+*/
+void arParamSizesFree( ARParamSizes *sizes );
+
 /** \fn int arParamSave( char *filename, int num, ARParam *param, ...)
 * \brief save a camera intrinsic parameters.
 *
@@ -200,6 +338,64 @@ int    arParamLoad( const char *filename, int num, ARParam *param, ...);
 */
 int    arParamDisp( ARParam *param );
 
+/** \fn int arParamCalib( unsigned char *images[], int image_num, int xsize, int ysize, int thresh, int dot_num_x, int dot_num_y, double dot_dist, int thread_num, char *filename, ARParam *param, double *err )
+* \brief calibrate a camera from images of a grid of dots.
+*
+* The dots are found in worker threads, then arParamCalibSolve()
+* solves the camera on all the images where the whole grid was found.
+* \param images grey images (one byte per pixel) of the dark dots on a light background
+* \param image_num number of images
+* \param xsize width of the images
+* \param ysize height of the images
+* \param thresh pixels darker than this belong to the dots
+* \param dot_num_x number of dots in a row of the grid
+* \param dot_num_y number of rows of the grid
+* \param dot_dist distance between two neighbour dots
+* \param thread_num number of threads finding the dots
+* \param filename file the parameters are saved to with arParamSave(), or NULL
+* \param param the calibrated parameters
+* \param err RMS reprojection error in pixels, or NULL
+* \return the number of images used, -1 if Error
+*/
+int    arParamCalib( unsigned char *images[], int image_num, int xsize, int ysize,
+                     int thresh, int dot_num_x, int dot_num_y, double dot_dist,
+                     int thread_num, char *filename, ARParam *param, double *err );
+
+/** \fn int arParamCalibFindDots( unsigned char *image, int xsize, int ysize, int thresh, int dot_num_x, int dot_num_y, double screen[][2] )
+* \brief find the dots of a calibration grid.
+*
+* \param image grey image, one byte per pixel
+* \param xsize width of the image
+* \param ysize height of the image
+* \param thresh pixels darker than this belong to the dots
+* \param dot_num_x number of dots in a row of the grid
+* \param dot_num_y number of rows of the grid
+* \param screen observed dot centres, row after row (dot_num_x*dot_num_y)
+* \return 0 if the whole grid was found, -1 otherwise
+*/
+int    arParamCalibFindDots( unsigned char *image, int xsize, int ysize, int thresh,
+                             int dot_num_x, int dot_num_y, double screen[][2] );
+
+/** \fn int arParamCalibSolve( double screen[][2], int image_num, int dot_num_x, int dot_num_y, double dot_dist, int xsize, int ysize, ARParam *param, double *err )
+* \brief solve the camera from the dots of many images.
+*
+* The intrinsics, the distortion and the pose of each image are
+* fitted together (Levenberg-Marquardt, the poses eliminated from
+* the normal equations), from a closed-form first guess.
+* \param screen dots of each image as given by arParamCalibFindDots(), image after image
+* \param image_num number of images, at least AR_PARAM_CALIB_FRAMES_MIN
+* \param dot_num_x number of dots in a row of the grid
+* \param dot_num_y number of rows of the grid
+* \param dot_dist distance between two neighbour dots
+* \param xsize width of the images
+* \param ysize height of the images
+* \param param the calibrated parameters
+* \param err RMS reprojection error in pixels, or NULL
+* \return 0 if success, -1 if Error
+*/
+int    arParamCalibSolve( double screen[][2], int image_num, int dot_num_x, int dot_num_y,
+                          double dot_dist, int xsize, int ysize, ARParam *param, double *err );
+
 /*-------------------*/
 
 int    arsParamChangeSize( ARSParam *source, int xsize, int ysize, ARSParam *newparam );
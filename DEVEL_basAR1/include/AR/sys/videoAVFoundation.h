@@ -0,0 +1,28 @@
+/*******************************************************
+ *
+ * Video capture for Mac OS X 10.7 and later with AVFoundation.
+ *
+ * The frames are the CVPixelBuffers of the capture session,
+ * locked read-only and never copied. ar2VideoGetImage()
+ * returns the luma plane of a 420f frame, or the pixels of
+ * a BGRA frame, in place; ar2VideoInqPixelBuffer() gives the
+ * buffer itself, to bind its IOSurface as a texture with
+ * arglDispImageIOSurface().
+ *
+*******************************************************/
+#ifndef AR_VIDEO_AVFOUNDATION_H
+#define AR_VIDEO_AVFOUNDATION_H
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <CoreVideo/CoreVideo.h>
+#include <AR/config.h>
+#include <AR/ar.h>
+
+typedef struct _AR2VideoParamT AR2VideoParamT;
+
+#ifdef  __cplusplus
+}
+#endif
+#endif // AR_VIDEO_AVFOUNDATION_H
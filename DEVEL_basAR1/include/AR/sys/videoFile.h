@@ -0,0 +1,54 @@
+/*******************************************************
+ *
+ * Video playback of the recordings of ar2VideoRecordOpen().
+ *
+ * The recording is memory mapped. ar2VideoGetImage() returns
+ * every frame once, in order, at the recorded times, at a
+ * fixed rate or as fast as they are asked for. Uncompressed
+ * frames are handed out in place from the mapping.
+ *
+*******************************************************/
+#ifndef AR_VIDEO_FILE_H
+#define AR_VIDEO_FILE_H
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include <AR/config.h>
+#include <AR/ar.h>
+
+#define   AR_VIDEO_FILE_RATE_RECORDED   -1.0
+#define   AR_VIDEO_FILE_RATE_FASTEST     0.0
+
+typedef struct {
+    char                   file[256];
+    double                 rate;            /* frames per second, or AR_VIDEO_FILE_RATE_* */
+    int                    loop;
+    int                    debug;
+
+    int                    fd;
+    ARUint8               *map;
+    size_t                 length;
+    int                    xsize;
+    int                    ysize;
+    int                    format;          /* AR_PIXEL_FORMAT_* */
+    int                    stride;
+    int                    compress;
+    int                    frames;
+    void                  *index;           /* VideoRecordIndexT of every frame */
+    ARUint8               *image;           /* decompressed frame */
+
+    int                    capturing;
+    int                    next;            /* frame of the next ar2VideoGetImage() */
+    int                    pending;         /* ar2VideoCapNext() has not been called */
+    unsigned long          n;               /* frames handed out */
+    long long              start;           /* playback time of frame 0 */
+    long long              time;            /* playback time of the last frame */
+    struct VideoLeasePool *lease;
+} AR2VideoParamT;
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
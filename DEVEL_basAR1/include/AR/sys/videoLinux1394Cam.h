@@ -24,11 +24,16 @@ extern "C" {
 #include <libdc1394/dc1394_control.h>
 
 
+#define   AR_VIDEO_1394_DECODE_RGB    0
+#define   AR_VIDEO_1394_DECODE_LUMA   1
+
 typedef struct {
     int      node;
     int      mode;
     int      rate;
     int      debug;  
+    int      thread;
+    int      trigger;
     int      card;
     int      channel;
     int      speed;
@@ -37,11 +42,16 @@ typedef struct {
     int      int_mode;
     int      int_rate;
     int      status;
+    int      decode;        /* AR_VIDEO_1394_DECODE_*, of Bayer frames */
 
     int                    internal_id;
     dc1394_feature_set     features;
     dc1394_cameracapture   camera;
     ARUint8                *image;
+    ARUint8                *raw;        /* Bayer frame of the last image, or NULL */
+    int                    bayer_red;   /* position of R in its tiles, see ar2VideoInqBayer() */
+    struct VideoLeasePool *lease;
+    struct VideoCaptureThread *capture;
 } AR2VideoParamT;
 
 #ifdef  __cplusplus
@@ -23,16 +23,21 @@ extern "C" {
 #include <libraw1394/raw1394.h>
 #include <libdv/dv.h>
 
+#define   AR_VIDEO_DV_FRESH   4
+
+/* Frames are decoded by the capture thread into one of three images and
+   swapped with the consumer through 'ready' by an atomic exchange, the
+   AR_VIDEO_DV_FRESH bit marking a frame not handed out yet. */
 typedef struct {
     int              size;
-    ARUint8         *buff_in;
-    ARUint8         *buff_wait;
-    ARUint8         *buff_out;
-    int              fill_size_in;
-    int              fill_size_wait;
-    int              fill_size_out;
-    int              read_size;
-    pthread_mutex_t  mutex;
+    ARUint8         *dv;            /* DV frame being received */
+    int              fill_size;
+    ARUint8         *image[3];
+    long long        time[3];
+    int              write;         /* image of the capture thread */
+    int              ready;         /* newest decoded image | AR_VIDEO_DV_FRESH */
+    int              read;          /* image of the last ar2VideoGetImage() */
+    int              parsed;        /* the DV header has been checked */
     int              init;
 } AR2VideoBufferT;
 
@@ -45,7 +50,7 @@ typedef struct {
     AR2VideoBufferT *buffer;
     int              packet_num;
     dv_decoder_t    *dv_decoder;
-    ARUint8         *image;
+    struct VideoLeasePool *lease;
 } AR2VideoParamT;
 
 #ifdef  __cplusplus
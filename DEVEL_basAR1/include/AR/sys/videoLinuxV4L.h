@@ -44,6 +44,7 @@ typedef struct {
     int                 mode;
 
     int                 debug;
+    int                 thread;
 
     int                 fd;
     int                 video_cont_num;
@@ -51,6 +52,8 @@ typedef struct {
     ARUint8             *videoBuffer;
     struct video_mbuf   vm;
     struct video_mmap   vmm;
+    struct VideoLeasePool *lease;
+    struct VideoCaptureThread *capture;
 } AR2VideoParamT;
 
 #ifdef  __cplusplus
@@ -0,0 +1,73 @@
+/*******************************************************
+ *
+ * Video capture for Linux Video4Linux2 devices.
+ *
+ * The frames are captured into a ring of driver buffers,
+ * memory mapped and optionally exported as DMABUF file
+ * descriptors. ar2VideoGetImage() returns a pointer into
+ * the dequeued buffer itself, and ar2VideoLeaseFrame() keeps
+ * the buffer out of the ring.
+ *
+*******************************************************/
+#ifndef AR_VIDEO_LINUX_V4L2_H
+#define AR_VIDEO_LINUX_V4L2_H
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+#include <AR/config.h>
+#include <AR/ar.h>
+
+#define   AR_VIDEO_V4L2_IO_MMAP       0
+#define   AR_VIDEO_V4L2_IO_DMABUF     1
+
+#define   AR_VIDEO_V4L2_DECODE_RGB    0
+#define   AR_VIDEO_V4L2_DECODE_LUMA   1
+
+typedef struct {
+    ARUint8             *start;
+    size_t               length;
+    int                  dmabuf_fd;     /* -1 unless exported, buffer[frame.id] of a lease */
+    int                  refs;          /* leases of ar2VideoLeaseFrame() */
+    unsigned long        n;
+    long long            time;
+    ARUint8             *decoded;       /* MJPEG frame of the buffer, or NULL */
+} AR2VideoBufferV4L2T;
+
+typedef struct {
+  //device controls
+    char                dev[256];
+    int                 channel;
+    int                 width;
+    int                 height;
+    unsigned int        format;         /* V4L2_PIX_FMT_* */
+    int                 io;             /* AR_VIDEO_V4L2_IO_* */
+    int                 decode;         /* AR_VIDEO_V4L2_DECODE_*, of MJPEG */
+    int                 buffer_num;
+  //image controls
+    double              brightness;
+    double              contrast;
+    double              saturation;
+    double              hue;
+
+    int                 debug;
+
+    int                 fd;
+    int                 stride;
+    int                 capturing;
+    int                 current;        /* dequeued buffer of the last image, or -1 */
+    unsigned long       n;              /* sequence of the last image */
+    long long           time;           /* capture time of the last image, 0 before the first */
+    pthread_mutex_t     mutex;          /* of the buffer references */
+    AR2VideoBufferV4L2T buffer[AR_VIDEO_V4L2_BUFFERS_MAX];
+} AR2VideoParamT;
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
@@ -101,6 +101,9 @@ extern "C" {
 #  ifdef AR_INPUT_V4L
 #    include <AR/sys/videoLinuxV4L.h>
 #  endif
+#  ifdef AR_INPUT_V4L2
+#    include <AR/sys/videoLinuxV4L2.h>
+#  endif
 #  ifdef  AR_INPUT_DV
 #    include <AR/sys/videoLinuxDV.h>
 #  endif
@@ -110,6 +113,9 @@ extern "C" {
 #  ifdef  AR_INPUT_GSTREAMER
 #    include <AR/sys/videoGStreamer.h>
 #  endif
+#  ifdef  AR_INPUT_FILE
+#    include <AR/sys/videoFile.h>
+#  endif
 #endif
 
 #ifdef __sgi
@@ -117,9 +123,50 @@ extern "C" {
 #endif
 
 #ifdef __APPLE__
-#  include <AR/sys/videoMacOSX.h>
+#  ifdef AR_INPUT_AVFOUNDATION
+#    include <AR/sys/videoAVFoundation.h>
+#  else
+#    include <AR/sys/videoMacOSX.h>
+#  endif
 #endif
 
+// ============================================================================
+//	Public types.
+// ============================================================================
+
+/**
+ * \brief a video frame leased from the video driver.
+ *
+ * A leased frame stays valid, whatever the capture does, until every
+ * reference taken with arVideoLeaseFrame() or arVideoRetainFrame()
+ * has been given back with arVideoReleaseFrame(). Drivers that can
+ * hold their own buffers (V4L2, GStreamer, DirectShow) lease them in
+ * place; the others lease a copy, taken once per frame.
+ * \param buff the pixels of the frame
+ * \param time the capture time in microseconds, on the clock of
+ * arVideoTime()
+ * \param format the AR_PIXEL_FORMAT_* of the pixels
+ * \param stride the length in bytes of a row
+ * \param xsize the width of the frame
+ * \param ysize the height of the frame
+ * \param n the sequence number of the frame, see arVideoInqFrameInfo()
+ * \param id the lease slot of the driver
+ */
+typedef struct {
+    ARUint8         *buff;
+    long long        time;
+    int              format;
+    int              stride;
+    int              xsize;
+    int              ysize;
+    unsigned long    n;
+    int              id;
+} ARVideoFrame;
+
+// The controls of ar2VideoSetControl().
+#define AR_VIDEO_CONTROL_EXPOSURE   0       // the exposure time
+#define AR_VIDEO_CONTROL_GAIN       1
+
 // ============================================================================
 //	Public globals.
 // ============================================================================
@@ -253,6 +300,59 @@ AR_DLL_API  ARUint8*		arVideoGetImage(void);
  */
 AR_DLL_API  int				arVideoInqSize(int *x, int *y);
 
+/**
+ * \brief lease the video image.
+ *
+ * Takes a reference to the frame returned by the last arVideoGetImage(),
+ * which then stays valid after arVideoCapNext() and the next
+ * arVideoGetImage(). It must be called before arVideoCapNext().
+ * \param frame the leased frame
+ * \return 0 if successful, -1 if there is no image or every lease slot
+ * is in use.
+ */
+AR_DLL_API  int				arVideoLeaseFrame(ARVideoFrame *frame);
+
+/**
+ * \brief take one more reference to a leased frame.
+ *
+ * For handing a frame to another consumer, which releases it on its own.
+ * \param frame a frame from arVideoLeaseFrame()
+ * \return 0 if successful, -1 if the frame is not leased.
+ */
+AR_DLL_API  int				arVideoRetainFrame(ARVideoFrame *frame);
+
+/**
+ * \brief give back a reference to a leased frame.
+ *
+ * The frame is given back to the driver with its last reference.
+ * Leases may be released from any thread.
+ * \param frame a frame from arVideoLeaseFrame()
+ * \return 0 if successful, -1 if the frame is not leased.
+ */
+AR_DLL_API  int				arVideoReleaseFrame(ARVideoFrame *frame);
+
+/**
+ * \brief get the capture time and the sequence number of the video image.
+ *
+ * Describes the frame returned by the last arVideoGetImage(). The sequence
+ * number comes from the driver where it has one (V4L2, GStreamer,
+ * DirectShow), so that a gap of more than one is a dropped frame; the
+ * other drivers count the images returned.
+ * \param time the capture time in microseconds, on the clock of
+ * arVideoTime(), or NULL
+ * \param n the sequence number of the frame, or NULL
+ * \return 0 if successful, -1 if no image has been returned yet.
+ */
+AR_DLL_API  int				arVideoInqFrameInfo(long long *time, unsigned long *n);
+
+/**
+ * \brief get the current time of the clock of the video timestamps.
+ *
+ * A monotonic clock, not affected by changes of the system time.
+ * \return the time in microseconds
+ */
+AR_DLL_API  long long		arVideoTime(void);
+
 /*
 	multiple cameras
  */
@@ -332,6 +432,129 @@ AR_DLL_API  ARUint8			*ar2VideoGetImage(AR2VideoParamT *vid);
  */
 AR_DLL_API  int				ar2VideoInqSize(AR2VideoParamT *vid, int *x, int *y);
 
+/**
+ * \brief lease the video image of a video source (multiple video inputs)
+ *
+ * Companion function to arVideoLeaseFrame for multiple video sources.
+ * \param vid a video handle structure for multi-camera grabbing
+ */
+AR_DLL_API  int				ar2VideoLeaseFrame(AR2VideoParamT *vid, ARVideoFrame *frame);
+
+/**
+ * \brief take one more reference to a leased frame (multiple video inputs)
+ *
+ * Companion function to arVideoRetainFrame for multiple video sources.
+ * \param vid a video handle structure for multi-camera grabbing
+ */
+AR_DLL_API  int				ar2VideoRetainFrame(AR2VideoParamT *vid, ARVideoFrame *frame);
+
+/**
+ * \brief give back a reference to a leased frame (multiple video inputs)
+ *
+ * Companion function to arVideoReleaseFrame for multiple video sources.
+ * \param vid a video handle structure for multi-camera grabbing
+ */
+AR_DLL_API  int				ar2VideoReleaseFrame(AR2VideoParamT *vid, ARVideoFrame *frame);
+
+/**
+ * \brief get the capture time and the sequence number of the video image (multiple video inputs)
+ *
+ * Companion function to arVideoInqFrameInfo for multiple video sources.
+ * \param vid a video handle structure for multi-camera grabbing
+ */
+AR_DLL_API  int				ar2VideoInqFrameInfo(AR2VideoParamT *vid, long long *time, unsigned long *n);
+
+/**
+ * \brief a recording of video frames.
+ *
+ * The recordings are played back by the file video module
+ * (AR_INPUT_FILE), for benchmarks on the same frames every run.
+ */
+typedef struct _AR2VideoRecordT AR2VideoRecordT;
+
+/**
+ * \brief start a recording of video frames.
+ * \param filename the file to write
+ * \param xsize the width of the frames
+ * \param ysize the height of the frames
+ * \param format the AR_PIXEL_FORMAT_* of the frames, see ar2VideoInqPixelFormat()
+ * \param stride the length in bytes of a row of the frames
+ * \param compress 1 to compress the frames without loss, 0 to store them as they are
+ * \return the recording, or NULL if the file cannot be written
+ */
+AR_DLL_API  AR2VideoRecordT	*ar2VideoRecordOpen(char *filename, int xsize, int ysize, int format, int stride, int compress);
+
+/**
+ * \brief add a frame to a recording.
+ * \param rec the recording of ar2VideoRecordOpen()
+ * \param image the frame, e.g. of arVideoGetImage()
+ * \param time the capture time of arVideoInqFrameInfo(), or 0 for now
+ * \return 0 if successful, -1 if the frame cannot be written
+ */
+AR_DLL_API  int				ar2VideoRecordFrame(AR2VideoRecordT *rec, ARUint8 *image, long long time);
+
+/**
+ * \brief finish a recording and write its index.
+ * \param rec the recording of ar2VideoRecordOpen()
+ */
+AR_DLL_API  int				ar2VideoRecordClose(AR2VideoRecordT *rec);
+
+#ifndef _WIN32
+/**
+ * \brief a group of video devices captured together.
+ *
+ * Every device of the group is grabbed by its own thread, frame sets
+ * pair the frames of the devices by their capture time.
+ */
+typedef struct _AR2VideoGroupT AR2VideoGroupT;
+
+/**
+ * \brief open and start a group of video devices.
+ *
+ * The devices must support frame leases.
+ * \param config the configuration strings of the devices
+ * \param num the number of devices (1 <-> AR_VIDEO_GROUP_MAX)
+ * \return the group, or NULL if a device cannot be opened
+ */
+AR_DLL_API  AR2VideoGroupT	*ar2VideoOpenGroup(char *config[], int num);
+
+/**
+ * \brief stop and close a group of video devices.
+ * \param group the group of ar2VideoOpenGroup()
+ */
+AR_DLL_API  int				ar2VideoCloseGroup(AR2VideoGroupT *group);
+
+/**
+ * \brief get a video device of a group, e.g. for ar2VideoInqSize().
+ *
+ * The device is captured by the group, do not grab it.
+ * \param group the group of ar2VideoOpenGroup()
+ * \param i the index of the device
+ */
+AR_DLL_API  AR2VideoParamT	*ar2VideoGroupDevice(AR2VideoGroupT *group, int i);
+
+/**
+ * \brief get a time-aligned set of frames of a group.
+ *
+ * Takes the newest frame of the slowest device and, of every other
+ * device, its frame nearest in time. The frames are leased until
+ * ar2VideoReleaseGroupFrames().
+ * \param group the group of ar2VideoOpenGroup()
+ * \param frame one frame per device
+ * \param skew the time between the earliest and the latest frame of the set,
+ * or NULL
+ * \return 0 if a frame set newer than the last one is ready, -1 if not
+ */
+AR_DLL_API  int				ar2VideoGetGroupFrames(AR2VideoGroupT *group, ARVideoFrame frame[], long long *skew);
+
+/**
+ * \brief give back a set of frames of ar2VideoGetGroupFrames().
+ * \param group the group of ar2VideoOpenGroup()
+ * \param frame one frame per device
+ */
+AR_DLL_API  int				ar2VideoReleaseGroupFrames(AR2VideoGroupT *group, ARVideoFrame frame[]);
+#endif
+
 // Functions added for Studierstube/OpenTracker.
 #ifdef _WIN32
 #  ifndef __MEMORY_BUFFER_HANDLE__
@@ -345,10 +568,82 @@ typedef struct _MemoryBufferHandle
 #  endif // __MEMORY_BUFFER_HANDLE__
 AR_DLL_API  int				ar2VideoInqFreq(AR2VideoParamT *vid, float *fps);
 AR_DLL_API  int				ar2VideoInqFlipping(AR2VideoParamT *vid, int *flipH, int *flipV);
+// The ar2VideoInqPixelFormat() of the default video source.
+AR_DLL_API  int				arVideoInqPixelFormat(int *format, int *stride);
+// The ar2VideoSetControl() of the default video source.
+AR_DLL_API  int				arVideoSetControl(int control, double value);
+// Every lock is a checkout of its own, held by its thread across arVideoCapNext(),
+// up to AR_VIDEO_DSVL_CLIENTS consumers in all.
 AR_DLL_API  unsigned char	*ar2VideoLockBuffer(AR2VideoParamT *vid, MemoryBufferHandle *pHandle);
 AR_DLL_API  int				ar2VideoUnlockBuffer(AR2VideoParamT *vid, MemoryBufferHandle Handle);
 #endif // _WIN32
 
+#if defined(AR_INPUT_V4L2) || defined(AR_INPUT_GSTREAMER) || defined(AR_INPUT_FILE) || defined(AR_INPUT_AVFOUNDATION) || defined(AR_INPUT_1394CAM) || defined(_WIN32)
+/**
+ * \brief get the pixel format of the video images.
+ *
+ * The images are handed out in place, in the format of the camera or
+ * of the pipeline, or as recorded. NV12, I420 and 420f images, MJPEG
+ * decoded with -decode=luma, and the Bayer frames of 1394 cameras with
+ * -decode=luma, are given as their luma plane. On Windows
+ * the format is the one DSVL negotiated, see <AUTO/> in the XML config.
+ * \param vid a video source
+ * \param format the AR_PIXEL_FORMAT_* of the images, see arSetPixelFormatCtx()
+ * \param stride the length in bytes of a row of the images
+ * \return 0 if successful, -1 if the format has no AR_PIXEL_FORMAT_*.
+ */
+AR_DLL_API  int				ar2VideoInqPixelFormat(AR2VideoParamT *vid, int *format, int *stride);
+#endif // AR_INPUT_V4L2 || AR_INPUT_GSTREAMER || AR_INPUT_FILE || AR_INPUT_AVFOUNDATION || AR_INPUT_1394CAM || _WIN32
+
+#if defined(AR_INPUT_V4L2) || defined(AR_INPUT_1394CAM) || defined(_WIN32)
+/**
+ * \brief set a control of the camera.
+ *
+ * The value is in 0.0 <-> 1.0 of the range of the camera, as for the
+ * -brightness option of V4L2, and turns the automatic control of the
+ * camera off; a negative value turns it back on. The exposure is the
+ * absolute exposure of V4L2, the shutter of 1394 cameras and the
+ * CameraControl_Exposure of DirectShow, whose range is in powers of 2.
+ * May be called while another thread captures.
+ * \param vid a video source
+ * \param control AR_VIDEO_CONTROL_EXPOSURE or AR_VIDEO_CONTROL_GAIN
+ * \param value the setting, or negative for automatic
+ * \return 0 if successful, -1 if the camera has no such control.
+ */
+AR_DLL_API  int				ar2VideoSetControl(AR2VideoParamT *vid, int control, double value);
+#endif // AR_INPUT_V4L2 || AR_INPUT_1394CAM || _WIN32
+
+#ifdef AR_INPUT_1394CAM
+/**
+ * \brief get the raw Bayer frame of the last image.
+ *
+ * With -decode=luma the image is binned from the Bayer frame for the
+ * detection, and the frame itself can be shown with arglDispImageBayer(),
+ * which demosaics it on the GPU. The frame is the DMA buffer of the camera,
+ * valid until ar2VideoCapNext(). Not available with -thread.
+ * \param vid a video source
+ * \param raw the frame, one byte per pixel
+ * \param red position of R in each 2x2 tile: 0 top left, 1 top right,
+ * 2 bottom left, 3 bottom right.
+ * \return 0 if successful, -1 if the last image was not made from a Bayer frame.
+ */
+AR_DLL_API  int				ar2VideoInqBayer(AR2VideoParamT *vid, ARUint8 **raw, int *red);
+#endif // AR_INPUT_1394CAM
+
+#ifdef AR_INPUT_AVFOUNDATION
+/**
+ * \brief get the CVPixelBuffer of a video frame.
+ *
+ * The buffer is IOSurface backed, see arglDispImageIOSurface(). It is
+ * not retained, and stays valid as long as the frame does.
+ * \param vid a video source
+ * \param frame a frame from ar2VideoLeaseFrame(), or NULL for the image
+ * of the last ar2VideoGetImage()
+ * \return the buffer, or NULL if the frame is no longer held.
+ */
+AR_DLL_API  CVPixelBufferRef	ar2VideoInqPixelBuffer(AR2VideoParamT *vid, ARVideoFrame *frame);
+#endif // AR_INPUT_AVFOUNDATION
+
 #ifdef  __cplusplus
 }
 #endif
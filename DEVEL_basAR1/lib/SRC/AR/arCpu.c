@@ -0,0 +1,141 @@
+/*
+ *   The vector units of the CPU, and the kernels chosen for them.
+ *
+ *   The binary is built for the least CPU it may run on. The kernels that
+ *   need more, as SSSE3 and AVX2, are compiled beside the others and one
+ *   variant of each is chosen once, when arCpuInit() has read the
+ *   features of the CPU. arCpuSetFeatures() takes some away, to measure
+ *   a kernel against the next one down.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_MSC_VER)
+#  include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#  include <cpuid.h>
+#endif
+#include <AR/ar.h>
+
+/* In the modules of the kernels; each takes its variant for features and
+   returns its name. */
+const char *arLabelingKernel( int features );
+const char *arGetCodeKernel( int features );
+
+static int           cpu_detected = -1;
+static int           cpu_allowed  = ~0;
+static const char   *kernel_name[AR_KERNELS];
+
+static const char   *kernel_title[AR_KERNELS] = { "binarize", "correlate" };
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+static void cpu_id( int leaf, int r[4] )
+{
+#  if defined(_MSC_VER)
+    __cpuidex( r, leaf, 0 );
+#  else
+    unsigned int    a, b, c, d;
+
+    a = b = c = d = 0;
+    __cpuid_count( leaf, 0, a, b, c, d );
+    r[0] = (int)a; r[1] = (int)b; r[2] = (int)c; r[3] = (int)d;
+#  endif
+}
+
+/* The registers whose state the system saves on a switch of threads. */
+static unsigned long long cpu_xcr0( void )
+{
+#  if defined(_MSC_VER) && _MSC_VER >= 1600
+    return _xgetbv( 0 );
+#  elif defined(_MSC_VER)
+    return 0;
+#  else
+    unsigned int    lo, hi;
+
+    __asm__ __volatile__( "xgetbv" : "=a"(lo), "=d"(hi) : "c"(0) );
+    return ((unsigned long long)hi << 32) | lo;
+#  endif
+}
+#endif
+
+static int cpu_detect( void )
+{
+    int     features = 0;
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+    int     r[4];
+    int     max;
+
+    cpu_id( 0, r );
+    max = r[0];
+    if( max < 1 ) return 0;
+    cpu_id( 1, r );
+    if( r[3] & (1 << 26) ) features |= AR_CPU_SSE2;
+    if( r[2] & (1 <<  9) ) features |= AR_CPU_SSSE3;
+    /* AVX2 wants the CPU to have it, and the system to save the YMM
+       registers, which OSXSAVE and XCR0 tell. */
+    if( max >= 7 && (r[2] & (1 << 27)) && (cpu_xcr0() & 0x6) == 0x6 ) {
+        cpu_id( 7, r );
+        if( r[1] & (1 << 5) ) features |= AR_CPU_AVX2;
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    features |= AR_CPU_NEON;
+#endif
+
+    return features;
+}
+
+static void cpu_select( void )
+{
+    int     features = cpu_detected & cpu_allowed;
+
+    kernel_name[AR_KERNEL_BINARIZE]  = arLabelingKernel( features );
+    kernel_name[AR_KERNEL_CORRELATE] = arGetCodeKernel( features );
+}
+
+void arCpuInit( void )
+{
+    if( cpu_detected >= 0 ) return;
+
+    cpu_detected = cpu_detect();
+    cpu_select();
+}
+
+int arCpuFeatures( void )
+{
+    arCpuInit();
+
+    return cpu_detected & cpu_allowed;
+}
+
+int arCpuSetFeatures( int features )
+{
+    arCpuInit();
+    cpu_allowed = features;
+    cpu_select();
+
+    return cpu_detected & cpu_allowed;
+}
+
+const char *arCpuKernelName( int kernel )
+{
+    if( kernel < 0 || kernel >= AR_KERNELS ) return NULL;
+    arCpuInit();
+
+    return kernel_name[kernel];
+}
+
+void arCpuDump( FILE *fp )
+{
+    int     features = arCpuFeatures();
+    int     i;
+
+    fprintf( fp, "\n cpu     %s%s%s%s%s\n",
+             (features & AR_CPU_SSE2)?  " sse2":  "",
+             (features & AR_CPU_SSSE3)? " ssse3": "",
+             (features & AR_CPU_AVX2)?  " avx2":  "",
+             (features & AR_CPU_NEON)?  " neon":  "",
+             (features == 0)?           " none":  "" );
+    for( i = 0; i < AR_KERNELS; i++ ) {
+        fprintf( fp, " %-10s %s\n", kernel_title[i], kernel_name[i] );
+    }
+}
@@ -1,56 +1,90 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include <AR/ar.h>
 
-static ARMarkerInfo2          *marker_info2;
-static ARMarkerInfo           *wmarker_info;
-static int                    wmarker_num = 0;
-
-static arPrevInfo             prev_info[AR_SQUARE_MAX];
-static int                    prev_num = 0;
-
-static arPrevInfo             sprev_info[2][AR_SQUARE_MAX];
-static int                    sprev_num[2] = {0,0};
+static void sync_debug_image( ARHandle *handle, int LorR );
+static void sort_by_x( ARMarkerInfo *marker_info, int marker_num, int order[] );
+static double match_prev( ARMarkerInfo *marker_info, arPrevInfo *prev );
+static int  find_prev( ARMarkerInfo *marker_info, int order[], int marker_num, arPrevInfo *prev );
+static void update_roi( ARHandle *handle, ARMarkerInfo *marker_info, int marker_num );
+static void marker_box( ARHandle *handle, ARMarkerInfo *marker_info, int box[4] );
+static int  motion_roi( ARHandle *handle, ARUint8 *image );
+static int  keep_still( ARHandle *handle, ARMarkerInfo *marker_info, int marker_num );
+static int  track_markers( ARHandle *handle, ARUint8 *image );
+static void start_tracking( ARHandle *handle, ARMarkerInfo *marker_info, int marker_num );
+static double polygon_area( double vertex[4][2] );
+static ARMarkerInfo *find_markers( ARHandle *handle, ARUint8 *dataPtr, int thresh,
+                                   int LorR, int *marker_num );
 
 int arSavePatt( ARUint8 *image, ARMarkerInfo *marker_info, char *filename )
 {
-    FILE      *fp;
+    return arSavePattCtx( arGetDefaultHandle(), image, marker_info, filename );
+}
+
+int arSavePattCtx( ARHandle *handle, ARUint8 *image, ARMarkerInfo *marker_info, char *filename )
+{
+    ARMarkerInfo2 *marker_info2 = handle->marker_info2;
     ARUint8   ext_pat[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3];
-    int       vertex[4];
-    int       i, j, k, x, y;
+    int       i;
 
 	// Match supplied info against previously recognised marker.
-    for( i = 0; i < wmarker_num; i++ ) {
+    for( i = 0; i < handle->marker2_num; i++ ) {
         if( marker_info->area   == marker_info2[i].area
          && marker_info->pos[0] == marker_info2[i].pos[0]
          && marker_info->pos[1] == marker_info2[i].pos[1] ) break;
     }
-    if( i == wmarker_num ) return -1;
+    if( i == handle->marker2_num ) return -1;
+
+    arGetPattSquareCtx( handle, image, &marker_info2[i], ext_pat );
+
+    return arWritePatt( filename, ext_pat );
+}
+
+int arGetPattSquareCtx( ARHandle *handle, ARUint8 *image, ARMarkerInfo2 *marker_info2,
+                        ARUint8 ext_pat[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3] )
+{
+    int       vertex[4];
+    int       j, k;
 
     for( j = 0; j < 4; j++ ) {
         for( k = 0; k < 4; k++ ) {
-            vertex[k] = marker_info2[i].vertex[(k+j+2)%4];
+            vertex[k] = marker_info2->vertex[(k+j+2)%4];
         }
-        arGetPatt( image, marker_info2[i].x_coord,
-                   marker_info2[i].y_coord, vertex, ext_pat[j] );
+        if( arGetPattCtx( handle, image, marker_info2->x_coord,
+                          marker_info2->y_coord, vertex, ext_pat[j] ) < 0 ) return -1;
     }
 
+    return 0;
+}
+
+int arWritePatt( const char *filename, ARUint8 ext_pat[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3] )
+{
+    FILE      *fp;
+    char      line[AR_PATT_SIZE_X*4 + 2];
+    int       i, j, x, y;
+
     fp = fopen( filename, "w" );
     if( fp == NULL ) return -1;
 
-	// Write out in order AR_PATT_SIZE_X columns x AR_PATT_SIZE_Y rows x 3 colours x 4 orientations.
+	// Write out in order AR_PATT_SIZE_X columns x AR_PATT_SIZE_Y rows x 3 colours x 4 orientations,
+	// a row at a time.
     for( i = 0; i < 4; i++ ) {
         for( j = 0; j < 3; j++ ) {
             for( y = 0; y < AR_PATT_SIZE_Y; y++ ) {
                 for( x = 0; x < AR_PATT_SIZE_X; x++ ) {
-                    fprintf( fp, "%4d", ext_pat[i][y][x][j] );
+                    sprintf( &line[x*4], "%4d", ext_pat[i][y][x][j] );
                 }
-                fprintf(fp, "\n");
+                line[AR_PATT_SIZE_X*4] = '\n';
+                line[AR_PATT_SIZE_X*4 + 1] = '\0';
+                fputs( line, fp );
             }
         }
-        fprintf(fp, "\n");
+        fputc( '\n', fp );
     }
 
-    fclose( fp );
+    if( fclose( fp ) != 0 ) return -1;
 
     return 0;
 }
@@ -58,44 +92,66 @@ int arSavePatt( ARUint8 *image, ARMarkerInfo *marker_info, char *filename )
 int arDetectMarker( ARUint8 *dataPtr, int thresh,
                     ARMarkerInfo **marker_info, int *marker_num )
 {
-    ARInt16                *limage;
-    int                    label_num;
-    int                    *area, *clip, *label_ref;
-    double                 *pos;
-    double                 rarea, rlen, rlenmin;
+    ARHandle   *handle;
+    int        ret;
+
+    handle = arGetDefaultHandle();
+    ret = arDetectMarkerCtx( handle, dataPtr, thresh, marker_info, marker_num );
+    sync_debug_image( handle, 1 );
+
+    return ret;
+}
+
+int arDetectMarkerCtx( ARHandle *handle, ARUint8 *dataPtr, int thresh,
+                       ARMarkerInfo **marker_info, int *marker_num )
+{
+    ARMarkerInfo           *wmarker_info;
+    int                    wmarker_num;
+    arPrevInfo             *prev_info = handle->prev_info;
     double                 diff, diffmin;
+    int                    order[AR_SQUARE_MAX];
+    int                    sorted_num;
     int                    cid, cdir;
+    int                    motion = 0;
     int                    i, j, k;
+    double                 t = 0.0;
 
     *marker_num = 0;
+    arResetStatsCtx( handle );
+
+    AR_STATS_START( handle, t );
+    if( track_markers( handle, dataPtr ) == 0 ) {
+        AR_STATS_STAGE( handle, track, t );
+        if( handle->statsMode == AR_STATS_ON ) {
+            handle->stats.tracked    = 1;
+            handle->stats.marker_num = handle->marker_num;
+        }
+        *marker_num  = handle->marker_num;
+        *marker_info = handle->marker_info;
+        return 0;
+    }
+    AR_STATS_STAGE( handle, track, t );
+
+    if( handle->roiMode == AR_ROI_MOTION ) {
+        motion = motion_roi( handle, dataPtr );
+        if( motion == 0 ) {
+            // Nothing moved: the markers of the last frame stand.
+            memcpy( handle->marker_info, handle->motion_marker, handle->motion_num * sizeof(ARMarkerInfo) );
+            if( handle->statsMode == AR_STATS_ON ) handle->stats.marker_num = handle->motion_num;
+            *marker_num  = handle->marker_num = handle->motion_num;
+            *marker_info = handle->marker_info;
+            return 0;
+        }
+    }
+    else handle->motion_num = -1;
 
-    limage = arLabeling( dataPtr, thresh,
-                         &label_num, &area, &pos, &clip, &label_ref );
-    if( limage == 0 )    return -1;
-
-    marker_info2 = arDetectMarker2( limage, label_num, label_ref,
-                                    area, pos, clip, AR_AREA_MAX, AR_AREA_MIN,
-                                    1.0, &wmarker_num);
-    if( marker_info2 == 0 ) return -1;
-
-    wmarker_info = arGetMarkerInfo( dataPtr, marker_info2, &wmarker_num );
+    wmarker_info = find_markers( handle, dataPtr, thresh, -1, &wmarker_num );
     if( wmarker_info == 0 ) return -1;
+    if( motion == 1 ) wmarker_num = keep_still( handle, wmarker_info, wmarker_num );
 
-    for( i = 0; i < prev_num; i++ ) {
-        rlenmin = 10.0;
-        cid = -1;
-        for( j = 0; j < wmarker_num; j++ ) {
-            rarea = (double)prev_info[i].marker.area / (double)wmarker_info[j].area;
-            if( rarea < 0.7 || rarea > 1.43 ) continue;
-            rlen = ( (wmarker_info[j].pos[0] - prev_info[i].marker.pos[0])
-                   * (wmarker_info[j].pos[0] - prev_info[i].marker.pos[0])
-                   + (wmarker_info[j].pos[1] - prev_info[i].marker.pos[1])
-                   * (wmarker_info[j].pos[1] - prev_info[i].marker.pos[1]) ) / wmarker_info[j].area;
-            if( rlen < 0.5 && rlen < rlenmin ) {
-                rlenmin = rlen;
-                cid = j;
-            }
-        }
+    sort_by_x( wmarker_info, wmarker_num, order );
+    for( i = 0; i < handle->prev_num; i++ ) {
+        cid = find_prev( wmarker_info, order, wmarker_num, &prev_info[i] );
         if( cid >= 0 && wmarker_info[cid].cf < prev_info[i].marker.cf ) {
             wmarker_info[cid].cf = prev_info[i].marker.cf;
             wmarker_info[cid].id = prev_info[i].marker.id;
@@ -124,83 +180,149 @@ int arDetectMarker( ARUint8 *dataPtr, int thresh,
 */
         if( wmarker_info[i].cf < 0.5 ) wmarker_info[i].id = -1;
    }
+    update_roi( handle, wmarker_info, wmarker_num );
 
 
 /*------------------------------------------------------------*/
 
-    for( i = j = 0; i < prev_num; i++ ) {
+    for( i = j = 0; i < handle->prev_num; i++ ) {
         prev_info[i].count++;
         if( prev_info[i].count < 4 ) {
             prev_info[j] = prev_info[i];
             j++;
         }
     }
-    prev_num = j;
+    handle->prev_num = j;
 
     for( i = 0; i < wmarker_num; i++ ) {
         if( wmarker_info[i].id < 0 ) continue;
 
-        for( j = 0; j < prev_num; j++ ) {
+        for( j = 0; j < handle->prev_num; j++ ) {
             if( prev_info[j].marker.id == wmarker_info[i].id ) break;
         }
         prev_info[j].marker = wmarker_info[i];
         prev_info[j].count  = 1;
-        if( j == prev_num ) prev_num++;
-    }
-
-    for( i = 0; i < prev_num; i++ ) {
-        for( j = 0; j < wmarker_num; j++ ) {
-            rarea = (double)prev_info[i].marker.area / (double)wmarker_info[j].area;
-            if( rarea < 0.7 || rarea > 1.43 ) continue;
-            rlen = ( (wmarker_info[j].pos[0] - prev_info[i].marker.pos[0])
-                   * (wmarker_info[j].pos[0] - prev_info[i].marker.pos[0])
-                   + (wmarker_info[j].pos[1] - prev_info[i].marker.pos[1])
-                   * (wmarker_info[j].pos[1] - prev_info[i].marker.pos[1]) ) / wmarker_info[j].area;
-            if( rlen < 0.5 ) break;
+        if( j == handle->prev_num ) handle->prev_num++;
+    }
+
+    // Markers of the previous frames that matched nothing are carried over.
+    // The ones carried over count as detected for the following ones.
+    sorted_num = wmarker_num;
+    for( i = 0; i < handle->prev_num; i++ ) {
+        if( find_prev( wmarker_info, order, sorted_num, &prev_info[i] ) >= 0 ) continue;
+        for( j = sorted_num; j < wmarker_num; j++ ) {
+            if( match_prev( &wmarker_info[j], &prev_info[i] ) >= 0.0 ) break;
         }
         if( j == wmarker_num ) {
+            if( wmarker_num == AR_SQUARE_MAX ) break;
             wmarker_info[wmarker_num] = prev_info[i].marker;
             wmarker_num++;
         }
     }
+    start_tracking( handle, wmarker_info, sorted_num );
+    if( handle->roiMode == AR_ROI_MOTION ) {
+        memcpy( handle->motion_marker, wmarker_info, sorted_num * sizeof(ARMarkerInfo) );
+        handle->motion_num = sorted_num;
+    }
 
-
-    *marker_num  = wmarker_num;
+    if( handle->statsMode == AR_STATS_ON ) handle->stats.marker_num = wmarker_num;
+    *marker_num  = handle->marker_num = wmarker_num;
     *marker_info = wmarker_info;
 
     return 0;
 }
 
 
-int arDetectMarkerLite( ARUint8 *dataPtr, int thresh,
+int arDetectMarkerLuma( ARUint8 *luma, int stride, int thresh,
                         ARMarkerInfo **marker_info, int *marker_num )
 {
-    ARInt16                *limage;
-    int                    label_num;
-    int                    *area, *clip, *label_ref;
-    double                 *pos;
-    int                    i;
+    ARHandle   *handle;
+    int        ret;
+
+    handle = arGetDefaultHandle();
+    ret = arDetectMarkerLumaCtx( handle, luma, stride, thresh, marker_info, marker_num );
+    sync_debug_image( handle, 1 );
+
+    return ret;
+}
+
+int arDetectMarkerLumaCtx( ARHandle *handle, ARUint8 *luma, int stride, int thresh,
+                           ARMarkerInfo **marker_info, int *marker_num )
+{
+    int        ret;
 
     *marker_num = 0;
+    if( stride < handle->xsize ) return -1;
+
+    handle->lumaStride = stride;
+    ret = arDetectMarkerCtx( handle, luma, thresh, marker_info, marker_num );
+    handle->lumaStride = 0;
+
+    return ret;
+}
+
+int arDetectMarkerCopy( ARUint8 *dataPtr, int thresh,
+                        ARMarkerInfo marker_info[], int marker_max, int *marker_num )
+{
+    ARHandle   *handle;
+    int        ret;
+
+    handle = arGetDefaultHandle();
+    ret = arDetectMarkerCopyCtx( handle, dataPtr, thresh, marker_info, marker_max, marker_num );
+    sync_debug_image( handle, 1 );
+
+    return ret;
+}
+
+int arDetectMarkerCopyCtx( ARHandle *handle, ARUint8 *dataPtr, int thresh,
+                           ARMarkerInfo marker_info[], int marker_max, int *marker_num )
+{
+    ARMarkerInfo   *wmarker_info;
+    int            wmarker_num;
+
+    *marker_num = 0;
+    if( arDetectMarkerCtx( handle, dataPtr, thresh, &wmarker_info, &wmarker_num ) < 0 ) return -1;
+
+    if( wmarker_num > marker_max ) wmarker_num = marker_max;
+    if( wmarker_num > 0 ) memcpy( marker_info, wmarker_info, wmarker_num * sizeof(ARMarkerInfo) );
+    *marker_num = wmarker_num;
+
+    return 0;
+}
+
+int arDetectMarkerLite( ARUint8 *dataPtr, int thresh,
+                        ARMarkerInfo **marker_info, int *marker_num )
+{
+    ARHandle   *handle;
+    int        ret;
+
+    handle = arGetDefaultHandle();
+    ret = arDetectMarkerLiteCtx( handle, dataPtr, thresh, marker_info, marker_num );
+    sync_debug_image( handle, 1 );
+
+    return ret;
+}
 
-    limage = arLabeling( dataPtr, thresh,
-                         &label_num, &area, &pos, &clip, &label_ref );
-    if( limage == 0 )    return -1;
+int arDetectMarkerLiteCtx( ARHandle *handle, ARUint8 *dataPtr, int thresh,
+                           ARMarkerInfo **marker_info, int *marker_num )
+{
+    ARMarkerInfo           *wmarker_info;
+    int                    wmarker_num;
+    int                    i;
 
-    marker_info2 = arDetectMarker2( limage, label_num, label_ref,
-                                    area, pos, clip, AR_AREA_MAX, AR_AREA_MIN,
-                                    1.0, &wmarker_num);
-    if( marker_info2 == 0 ) return -1;
+    *marker_num = 0;
+    arResetStatsCtx( handle );
 
-    wmarker_info = arGetMarkerInfo( dataPtr, marker_info2, &wmarker_num );
+    wmarker_info = find_markers( handle, dataPtr, thresh, -1, &wmarker_num );
     if( wmarker_info == 0 ) return -1;
 
     for( i = 0; i < wmarker_num; i++ ) {
         if( wmarker_info[i].cf < 0.5 ) wmarker_info[i].id = -1;
     }
+    update_roi( handle, wmarker_info, wmarker_num );
 
-
-    *marker_num  = wmarker_num;
+    if( handle->statsMode == AR_STATS_ON ) handle->stats.marker_num = wmarker_num;
+    *marker_num  = handle->marker_num = wmarker_num;
     *marker_info = wmarker_info;
 
     return 0;
@@ -209,60 +331,56 @@ int arDetectMarkerLite( ARUint8 *dataPtr, int thresh,
 int arsDetectMarker( ARUint8 *dataPtr, int thresh,
                      ARMarkerInfo **marker_info, int *marker_num, int LorR )
 {
-    ARInt16                *limage;
-    int                    label_num;
-    int                    *area, *clip, *label_ref;
-    double                 *pos;
-    double                 rarea, rlen, rlenmin;
+    ARHandle               *handle;
+    ARMarkerInfo           *wmarker_info;
+    int                    wmarker_num;
+    arPrevInfo             *sprev_info;
     double                 diff, diffmin;
+    int                    order[AR_SQUARE_MAX];
     int                    cid, cdir;
     int                    i, j, k;
+    double                 t = 0.0;
 
     *marker_num = 0;
+    handle = arsGetDefaultHandle( LorR );
+    sprev_info = handle->prev_info;
+    arResetStatsCtx( handle );
+
+    AR_STATS_START( handle, t );
+    if( track_markers( handle, dataPtr ) == 0 ) {
+        AR_STATS_STAGE( handle, track, t );
+        if( handle->statsMode == AR_STATS_ON ) {
+            handle->stats.tracked    = 1;
+            handle->stats.marker_num = handle->marker_num;
+        }
+        *marker_num  = handle->marker_num;
+        *marker_info = handle->marker_info;
+        return 0;
+    }
+    AR_STATS_STAGE( handle, track, t );
 
-    limage = arsLabeling( dataPtr, thresh,
-                          &label_num, &area, &pos, &clip, &label_ref, LorR );
-    if( limage == 0 )    return -1;
-
-    marker_info2 = arDetectMarker2( limage, label_num, label_ref,
-                                    area, pos, clip, AR_AREA_MAX, AR_AREA_MIN,
-                                    1.0, &wmarker_num);
-    if( marker_info2 == 0 ) return -1;
-
-    wmarker_info = arsGetMarkerInfo( dataPtr, marker_info2, &wmarker_num, LorR );
+    wmarker_info = find_markers( handle, dataPtr, thresh, LorR, &wmarker_num );
     if( wmarker_info == 0 ) return -1;
 
-    for( i = 0; i < sprev_num[LorR]; i++ ) {
-        rlenmin = 10.0;
-        cid = -1;
-        for( j = 0; j < wmarker_num; j++ ) {
-            rarea = (double)sprev_info[LorR][i].marker.area / (double)wmarker_info[j].area;
-            if( rarea < 0.7 || rarea > 1.43 ) continue;
-            rlen = ( (wmarker_info[j].pos[0] - sprev_info[LorR][i].marker.pos[0])
-                   * (wmarker_info[j].pos[0] - sprev_info[LorR][i].marker.pos[0])
-                   + (wmarker_info[j].pos[1] - sprev_info[LorR][i].marker.pos[1])
-                   * (wmarker_info[j].pos[1] - sprev_info[LorR][i].marker.pos[1]) ) / wmarker_info[j].area;
-            if( rlen < 0.5 && rlen < rlenmin ) {
-                rlenmin = rlen;
-                cid = j;
-            }
-        }
-        if( cid >= 0 && wmarker_info[cid].cf < sprev_info[LorR][i].marker.cf ) {
-            wmarker_info[cid].cf = sprev_info[LorR][i].marker.cf;
-            wmarker_info[cid].id = sprev_info[LorR][i].marker.id;
+    sort_by_x( wmarker_info, wmarker_num, order );
+    for( i = 0; i < handle->prev_num; i++ ) {
+        cid = find_prev( wmarker_info, order, wmarker_num, &sprev_info[i] );
+        if( cid >= 0 && wmarker_info[cid].cf < sprev_info[i].marker.cf ) {
+            wmarker_info[cid].cf = sprev_info[i].marker.cf;
+            wmarker_info[cid].id = sprev_info[i].marker.id;
             diffmin = 10000.0 * 10000.0;
             cdir = -1;
             for( j = 0; j < 4; j++ ) {
                 diff = 0;
                 for( k = 0; k < 4; k++ ) {
-                    diff += (sprev_info[LorR][i].marker.vertex[k][0] - wmarker_info[cid].vertex[(j+k)%4][0])
-                          * (sprev_info[LorR][i].marker.vertex[k][0] - wmarker_info[cid].vertex[(j+k)%4][0])
-                          + (sprev_info[LorR][i].marker.vertex[k][1] - wmarker_info[cid].vertex[(j+k)%4][1])
-                          * (sprev_info[LorR][i].marker.vertex[k][1] - wmarker_info[cid].vertex[(j+k)%4][1]);
+                    diff += (sprev_info[i].marker.vertex[k][0] - wmarker_info[cid].vertex[(j+k)%4][0])
+                          * (sprev_info[i].marker.vertex[k][0] - wmarker_info[cid].vertex[(j+k)%4][0])
+                          + (sprev_info[i].marker.vertex[k][1] - wmarker_info[cid].vertex[(j+k)%4][1])
+                          * (sprev_info[i].marker.vertex[k][1] - wmarker_info[cid].vertex[(j+k)%4][1]);
                 }
                 if( diff < diffmin ) {
                     diffmin = diff;
-                    cdir = (sprev_info[LorR][i].marker.dir - j + 4) % 4;
+                    cdir = (sprev_info[i].marker.dir - j + 4) % 4;
                 }
             }
             wmarker_info[cid].dir = cdir;
@@ -272,16 +390,19 @@ int arsDetectMarker( ARUint8 *dataPtr, int thresh,
     for( i = 0; i < wmarker_num; i++ ) {
         if( wmarker_info[i].cf < 0.5 ) wmarker_info[i].id = -1;
     }
+    update_roi( handle, wmarker_info, wmarker_num );
 
     j = 0;
     for( i = 0; i < wmarker_num; i++ ) {
         if( wmarker_info[i].id < 0 ) continue;
-        sprev_info[LorR][j].marker = wmarker_info[i];
-        sprev_info[LorR][j].count  = 1;
+        sprev_info[j].marker = wmarker_info[i];
+        sprev_info[j].count  = 1;
         j++;
     }
-    sprev_num[LorR] = j;
+    handle->prev_num = j;
+    start_tracking( handle, wmarker_info, wmarker_num );
 
+    if( handle->statsMode == AR_STATS_ON ) handle->stats.marker_num = wmarker_num;
     *marker_num  = wmarker_num;
     *marker_info = wmarker_info;
 
@@ -291,33 +412,455 @@ int arsDetectMarker( ARUint8 *dataPtr, int thresh,
 int arsDetectMarkerLite( ARUint8 *dataPtr, int thresh,
                          ARMarkerInfo **marker_info, int *marker_num, int LorR )
 {
-    ARInt16                *limage;
-    int                    label_num;
-    int                    *area, *clip, *label_ref;
-    double                 *pos;
+    ARHandle               *handle;
+    ARMarkerInfo           *wmarker_info;
+    int                    wmarker_num;
     int                    i;
 
     *marker_num = 0;
+    handle = arsGetDefaultHandle( LorR );
+    arResetStatsCtx( handle );
 
-    limage = arsLabeling( dataPtr, thresh,
-                          &label_num, &area, &pos, &clip, &label_ref, LorR );
-    if( limage == 0 )    return -1;
-
-    marker_info2 = arDetectMarker2( limage, label_num, label_ref,
-                                    area, pos, clip, AR_AREA_MAX, AR_AREA_MIN,
-                                    1.0, &wmarker_num);
-    if( marker_info2 == 0 ) return -1;
-
-    wmarker_info = arsGetMarkerInfo( dataPtr, marker_info2, &wmarker_num, LorR );
+    wmarker_info = find_markers( handle, dataPtr, thresh, LorR, &wmarker_num );
     if( wmarker_info == 0 ) return -1;
 
     for( i = 0; i < wmarker_num; i++ ) {
         if( wmarker_info[i].cf < 0.5 ) wmarker_info[i].id = -1;
     }
+    update_roi( handle, wmarker_info, wmarker_num );
 
-
+    if( handle->statsMode == AR_STATS_ON ) handle->stats.marker_num = wmarker_num;
     *marker_num  = wmarker_num;
     *marker_info = wmarker_info;
 
     return 0;
 }
+
+// Labels the image and finds the squares in it and their codes, timing the
+// stages into the statistics of the context. The debug image is synced for
+// the stereo handle LorR when it is not -1.
+static ARMarkerInfo *find_markers( ARHandle *handle, ARUint8 *dataPtr, int thresh,
+                                   int LorR, int *marker_num )
+{
+    ARMarkerInfo2          *marker_info2;
+    ARMarkerInfo           *marker_info;
+    ARInt16                *limage;
+    int                    label_num;
+    int                    *area, *clip, *label_ref;
+    double                 *pos;
+    double                 t = 0.0;
+
+    AR_STATS_START( handle, t );
+    AR_TRACE_BEGIN( "arLabeling" );
+    limage = arLabelingCtx( handle, dataPtr, thresh,
+                            &label_num, &area, &pos, &clip, &label_ref );
+    AR_TRACE_END();
+    if( LorR != -1 ) sync_debug_image( handle, LorR );
+    if( limage == 0 )    return NULL;
+    AR_STATS_STAGE( handle, label, t );
+
+    AR_TRACE_BEGIN( "arDetectMarker2" );
+    marker_info2 = arDetectMarker2Ctx( handle, limage, label_num, label_ref,
+                                       area, pos, clip, AR_AREA_MAX, AR_AREA_MIN,
+                                       1.0, marker_num);
+    if( marker_info2 != 0 ) arRefineMarker2Ctx( handle, dataPtr, thresh, marker_info2, *marker_num );
+    AR_TRACE_END();
+    if( marker_info2 == 0 ) return NULL;
+    AR_STATS_STAGE( handle, contour, t );
+    arUpdateThresholdCtx( handle, dataPtr, marker_info2, *marker_num );
+    AR_STATS_STAGE( handle, label, t );
+
+    if( handle->statsMode == AR_STATS_ON ) {
+        handle->stats.label_num  = label_num;
+        handle->stats.square_num = *marker_num;
+    }
+
+    AR_TRACE_BEGIN( "arGetMarkerInfo" );
+    marker_info = arGetMarkerInfoCtx( handle, dataPtr, marker_info2, marker_num );
+    AR_TRACE_END();
+
+    return marker_info;
+}
+
+static void sync_debug_image( ARHandle *handle, int LorR )
+{
+    if( !handle->debug ) return;
+
+    if( LorR ) arImage = arImageL = handle->debug_image;
+    else       arImageR = handle->debug_image;
+}
+
+// Indices of the markers in increasing x of their centres.
+static void sort_by_x( ARMarkerInfo *marker_info, int marker_num, int order[] )
+{
+    int     i, k;
+
+    for( i = 0; i < marker_num; i++ ) {
+        for( k = i; k > 0 && marker_info[order[k-1]].pos[0] > marker_info[i].pos[0]; k-- ) {
+            order[k] = order[k-1];
+        }
+        order[k] = i;
+    }
+}
+
+// How far a marker is from one of the previous frames, relative to its
+// size, or -1 if they are too different to be the same marker.
+static double match_prev( ARMarkerInfo *marker_info, arPrevInfo *prev )
+{
+    double  rarea, rlen;
+
+    rarea = (double)prev->marker.area / (double)marker_info->area;
+    if( rarea < 0.7 || rarea > 1.43 ) return -1.0;
+    rlen = ( (marker_info->pos[0] - prev->marker.pos[0])
+           * (marker_info->pos[0] - prev->marker.pos[0])
+           + (marker_info->pos[1] - prev->marker.pos[1])
+           * (marker_info->pos[1] - prev->marker.pos[1]) ) / marker_info->area;
+    if( rlen >= 0.5 ) return -1.0;
+
+    return rlen;
+}
+
+// The closest match of prev among the markers sorted by sort_by_x(), the
+// first one on ties, or -1. A match has less than prev->marker.area/0.7
+// pixels and a squared distance under half its area, so only the markers
+// within sqrt(prev->marker.area) in x are tried.
+static int find_prev( ARMarkerInfo *marker_info, int order[], int marker_num, arPrevInfo *prev )
+{
+    double  r, rlen, rlenmin;
+    int     lo, hi, mid;
+    int     cid, j;
+
+    r = sqrt( (double)prev->marker.area );
+    lo = 0;
+    hi = marker_num;
+    while( lo < hi ) {
+        mid = (lo + hi) / 2;
+        if( marker_info[order[mid]].pos[0] < prev->marker.pos[0] - r ) lo = mid + 1;
+        else                                                           hi = mid;
+    }
+
+    rlenmin = 10.0;
+    cid = -1;
+    for( ; lo < marker_num; lo++ ) {
+        j = order[lo];
+        if( marker_info[j].pos[0] > prev->marker.pos[0] + r ) break;
+        if( (rlen = match_prev( &marker_info[j], prev )) < 0.0 ) continue;
+        if( rlen < rlenmin || (rlen == rlenmin && j < cid) ) {
+            rlenmin = rlen;
+            cid = j;
+        }
+    }
+
+    return cid;
+}
+
+// Choose the boxes to label in the next frame. In AR_ROI_TRACKING mode they
+// surround the markers identified in this frame, except every
+// AR_ROI_FULL_SCAN_INTERVAL frames and when a tracked marker was lost,
+// when the whole image is labeled again.
+static void update_roi( ARHandle *handle, ARMarkerInfo *marker_info, int marker_num )
+{
+    double    m;
+    int       box[4];
+    int       *roi;
+    int       i, n;
+
+    for( i = n = 0; i < marker_num; i++ ) {
+        if( marker_info[i].id >= 0 ) n++;
+    }
+
+    if( handle->roiMode != AR_ROI_TRACKING || n == 0
+     || (handle->roi_num > 0 && (n < handle->roi_tracked
+                                 || ++handle->roi_count >= AR_ROI_FULL_SCAN_INTERVAL)) ) {
+        handle->roi_num   = 0;
+        handle->roi_count = 0;
+        return;
+    }
+
+    handle->roi_num = 0;
+    handle->roi_y0  = handle->ysize;
+    handle->roi_y1  = 0;
+    for( i = 0; i < marker_num; i++ ) {
+        if( marker_info[i].id < 0 ) continue;
+
+        marker_box( handle, &marker_info[i], box );
+        m = ((box[1] - box[0] > box[3] - box[2])? box[1] - box[0]: box[3] - box[2]) * AR_ROI_MARGIN;
+
+        roi = handle->roi[handle->roi_num++];
+        roi[0] = (box[0] - m < 0)? 0: (int)(box[0] - m);
+        roi[1] = (box[1] + m > handle->xsize-1)? handle->xsize-1: (int)(box[1] + m);
+        roi[2] = (box[2] - m < 0)? 0: (int)(box[2] - m);
+        roi[3] = (box[3] + m > handle->ysize-1)? handle->ysize-1: (int)(box[3] + m);
+        if( roi[2] < handle->roi_y0 ) handle->roi_y0 = roi[2];
+        if( roi[3] > handle->roi_y1 ) handle->roi_y1 = roi[3];
+    }
+    handle->roi_tracked = n;
+}
+
+// Bounding box of a marker in the observed image: x0, x1, y0, y1.
+static void marker_box( ARHandle *handle, ARMarkerInfo *marker_info, int box[4] )
+{
+    double    ox, oy;
+    double    x0, x1, y0, y1;
+    int       k;
+
+    x0 = y0 = 1.0e9;
+    x1 = y1 = -1.0e9;
+    for( k = 0; k < 4; k++ ) {
+        arParamIdeal2Observ( handle->dist_factor, marker_info->vertex[k][0],
+                             marker_info->vertex[k][1], &ox, &oy );
+        if( ox < x0 ) x0 = ox;
+        if( ox > x1 ) x1 = ox;
+        if( oy < y0 ) y0 = oy;
+        if( oy > y1 ) y1 = oy;
+    }
+    box[0] = (int)floor(x0);
+    box[1] = (int)ceil(x1);
+    box[2] = (int)floor(y0);
+    box[3] = (int)ceil(y1);
+}
+
+// In AR_ROI_MOTION mode, compare the image with motion_thumb block by block
+// and choose the boxes to label: the blocks that changed, grown by a block
+// all round, as runs along each row of blocks. The thumbnail is brought up
+// to date in the blocks labeled. Returns 0 when no block changed, 1 when
+// the boxes are set, 2 when the whole image is to be labeled.
+static int motion_roi( ARHandle *handle, ARUint8 *image )
+{
+    ARUint8   *p, *q;
+    int       *block;
+    int       tw, th, bw, bh, spb, size;
+    int       bx, by, x, y, x0, n, d;
+
+    tw   = handle->xsize / AR_MOTION_STEP;
+    th   = handle->ysize / AR_MOTION_STEP;
+    spb  = AR_MOTION_BLOCK / AR_MOTION_STEP;
+    bw   = (tw + spb - 1) / spb;
+    bh   = (th + spb - 1) / spb;
+    size = tw * th;
+    if( size != handle->motion_size ) {
+        arMemFree( handle->motion_thumb );
+        arMemFree( handle->motion_block );
+        arMallocTag( handle->motion_thumb, ARUint8, size, AR_MEM_AR );
+        arMallocTag( handle->motion_block, int, bw*bh, AR_MEM_AR );
+        handle->motion_size = size;
+        handle->motion_num  = -1;
+    }
+    block = handle->motion_block;
+    handle->roi_num = 0;
+
+    // The whole image, and a new thumbnail.
+    if( handle->motion_num < 0 || ++handle->motion_count >= AR_MOTION_FULL_SCAN_INTERVAL ) {
+        for( y = 0; y < th; y++ ) {
+            q = &(handle->motion_thumb[y*tw]);
+            for( x = 0; x < tw; x++ ) {
+                p = handle->lumaStride? &image[y*AR_MOTION_STEP*handle->lumaStride + x*AR_MOTION_STEP]
+                                      : &image[(y*AR_MOTION_STEP*handle->xsize + x*AR_MOTION_STEP)*handle->pixSize + handle->pixOffset[1]];
+                *q++ = *p;
+            }
+        }
+        handle->motion_count = 0;
+        return 2;
+    }
+
+    // Sum of the differences in each block.
+    for( n = 0; n < bw*bh; n++ ) block[n] = 0;
+    for( y = 0; y < th; y++ ) {
+        q = &(handle->motion_thumb[y*tw]);
+        for( x = 0; x < tw; x++, q++ ) {
+            p = handle->lumaStride? &image[y*AR_MOTION_STEP*handle->lumaStride + x*AR_MOTION_STEP]
+                                  : &image[(y*AR_MOTION_STEP*handle->xsize + x*AR_MOTION_STEP)*handle->pixSize + handle->pixOffset[1]];
+            d = *p - *q;
+            block[(y/spb)*bw + x/spb] += (d < 0)? -d: d;
+        }
+    }
+    n = 0;
+    for( by = 0; by < bh; by++ ) {
+        for( bx = 0; bx < bw; bx++ ) {
+            d = block[by*bw + bx];
+            block[by*bw + bx] = (d > AR_MOTION_DIFF * spb * spb)? 1: 0;
+            n += block[by*bw + bx];
+        }
+    }
+    if( n == 0 ) return 0;
+
+    // Grown by a block: bit 1 marks the blocks to label.
+    for( by = 0; by < bh; by++ ) {
+        for( bx = 0; bx < bw; bx++ ) {
+            for( y = by-1; y <= by+1; y++ ) {
+                for( x = bx-1; x <= bx+1; x++ ) {
+                    if( y < 0 || y >= bh || x < 0 || x >= bw ) continue;
+                    if( block[y*bw + x] & 1 ) block[by*bw + bx] |= 2;
+                }
+            }
+        }
+    }
+
+    // Runs of blocks to label along each row, and their part of the thumbnail.
+    handle->roi_y0 = handle->ysize;
+    handle->roi_y1 = 0;
+    for( by = 0; by < bh; by++ ) {
+        for( bx = 0; bx < bw; ) {
+            if( !(block[by*bw + bx] & 2) ) { bx++; continue; }
+            for( x0 = bx; bx < bw && (block[by*bw + bx] & 2); bx++ );
+            if( handle->roi_num == AR_SQUARE_MAX ) {
+                handle->roi_num = 0;
+                handle->motion_num = -1;
+                return motion_roi( handle, image );
+            }
+            handle->roi[handle->roi_num][0] = x0 * AR_MOTION_BLOCK;
+            handle->roi[handle->roi_num][1] = (bx * AR_MOTION_BLOCK < handle->xsize)? bx * AR_MOTION_BLOCK - 1: handle->xsize - 1;
+            handle->roi[handle->roi_num][2] = by * AR_MOTION_BLOCK;
+            handle->roi[handle->roi_num][3] = ((by+1) * AR_MOTION_BLOCK < handle->ysize)? (by+1) * AR_MOTION_BLOCK - 1: handle->ysize - 1;
+            if( handle->roi[handle->roi_num][2] < handle->roi_y0 ) handle->roi_y0 = handle->roi[handle->roi_num][2];
+            if( handle->roi[handle->roi_num][3] > handle->roi_y1 ) handle->roi_y1 = handle->roi[handle->roi_num][3];
+            handle->roi_num++;
+
+            for( y = by*spb; y < (by+1)*spb && y < th; y++ ) {
+                q = &(handle->motion_thumb[y*tw + x0*spb]);
+                for( x = x0*spb; x < bx*spb && x < tw; x++ ) {
+                    p = handle->lumaStride? &image[y*AR_MOTION_STEP*handle->lumaStride + x*AR_MOTION_STEP]
+                                          : &image[(y*AR_MOTION_STEP*handle->xsize + x*AR_MOTION_STEP)*handle->pixSize + handle->pixOffset[1]];
+                    *q++ = *p;
+                }
+            }
+        }
+    }
+    return 1;
+}
+
+// Append to the markers found in the boxes of motion_roi() those of the
+// last frame that lie wholly outside them. Returns the number of markers.
+static int keep_still( ARHandle *handle, ARMarkerInfo *marker_info, int marker_num )
+{
+    int       box[4];
+    int       *roi;
+    int       i, k;
+
+    for( i = 0; i < handle->motion_num && marker_num < AR_SQUARE_MAX; i++ ) {
+        marker_box( handle, &handle->motion_marker[i], box );
+        for( k = 0; k < handle->roi_num; k++ ) {
+            roi = handle->roi[k];
+            if( box[1] >= roi[0] && box[0] <= roi[1] && box[3] >= roi[2] && box[2] <= roi[3] ) break;
+        }
+        if( k < handle->roi_num ) continue;
+        marker_info[marker_num++] = handle->motion_marker[i];
+    }
+    return marker_num;
+}
+
+// Follow the markers of the last frame in AR_TRACKING_EDGE mode. Their
+// vertices are predicted from their motion over the last two frames and
+// the edges searched for around them. The markers found are left in
+// handle->marker_info and handle->prev_info. Returns -1, for a whole
+// detection, when a marker is lost or changes size too much, and every
+// AR_TRACKING_REDETECT_INTERVAL frames.
+static int track_markers( ARHandle *handle, ARUint8 *image )
+{
+    ARMarkerInfo  *t, *m;
+    double        line[4][3], vertex[4][2];
+    double        ex, ey, len, a, b, r, cx, cy;
+    int           i, j, k;
+
+    if( handle->trackingMode != AR_TRACKING_EDGE || handle->track_num == 0 ) return -1;
+    if( ++handle->track_count >= AR_TRACKING_REDETECT_INTERVAL ) {
+        handle->track_num = 0;
+        return -1;
+    }
+
+    for( i = 0; i < handle->track_num; i++ ) {
+        t = &handle->track[i];
+        for( k = 0; k < 4; k++ ) {
+            vertex[k][0] = 2.0 * t->vertex[k][0] - handle->track_vertex[i][k][0];
+            vertex[k][1] = 2.0 * t->vertex[k][1] - handle->track_vertex[i][k][1];
+        }
+        // Line k through vertices k and k+1, its normal on the same side
+        // as in the last frame.
+        for( k = 0; k < 4; k++ ) {
+            ex  = vertex[(k+1)%4][0] - vertex[k][0];
+            ey  = vertex[(k+1)%4][1] - vertex[k][1];
+            len = sqrt( ex*ex + ey*ey );
+            if( len == 0.0 ) break;
+            a =  ey / len;
+            b = -ex / len;
+            if( a*t->line[k][0] + b*t->line[k][1] < 0.0 ) {
+                a = -a;
+                b = -b;
+            }
+            line[k][0] = a;
+            line[k][1] = b;
+            line[k][2] = -(a*vertex[k][0] + b*vertex[k][1]);
+        }
+        if( k < 4 || arTrackLineCtx( handle, image, line, vertex ) == 0 ) break;
+
+        if( (r = polygon_area( t->vertex )) <= 0.0 ) break;
+        r = polygon_area( vertex ) / r;
+        if( r < 0.7 || r > 1.43 ) break;
+
+        m = &handle->marker_info[i];
+        *m = *t;
+        m->area = (int)(t->area * r + 0.5);
+        cx = (vertex[0][0] + vertex[1][0] + vertex[2][0] + vertex[3][0]) / 4.0;
+        cy = (vertex[0][1] + vertex[1][1] + vertex[2][1] + vertex[3][1]) / 4.0;
+        arParamIdeal2Observ( handle->dist_factor, cx, cy, &m->pos[0], &m->pos[1] );
+        for( k = 0; k < 4; k++ ) {
+            m->line[k][0]   = line[k][0];
+            m->line[k][1]   = line[k][1];
+            m->line[k][2]   = line[k][2];
+            m->vertex[k][0] = vertex[k][0];
+            m->vertex[k][1] = vertex[k][1];
+        }
+    }
+    if( i < handle->track_num ) {
+        handle->track_num = 0;
+        return -1;
+    }
+
+    for( i = 0; i < handle->track_num; i++ ) {
+        memcpy( handle->track_vertex[i], handle->track[i].vertex, sizeof(handle->track_vertex[i]) );
+        handle->track[i] = handle->marker_info[i];
+
+        for( j = 0; j < handle->prev_num; j++ ) {
+            if( handle->prev_info[j].marker.id == handle->marker_info[i].id ) break;
+        }
+        if( j == AR_SQUARE_MAX ) continue;
+        handle->prev_info[j].marker = handle->marker_info[i];
+        handle->prev_info[j].count  = 1;
+        if( j == handle->prev_num ) handle->prev_num++;
+    }
+    handle->marker_num = handle->track_num;
+    update_roi( handle, handle->marker_info, handle->marker_num );
+
+    return 0;
+}
+
+// The identified markers of a whole detection, followed from the next
+// frame on, first as if they were not moving.
+static void start_tracking( ARHandle *handle, ARMarkerInfo *marker_info, int marker_num )
+{
+    int     i, n;
+
+    handle->track_num   = 0;
+    handle->track_count = 0;
+    if( handle->trackingMode != AR_TRACKING_EDGE ) return;
+
+    for( i = n = 0; i < marker_num; i++ ) {
+        if( marker_info[i].id < 0 ) continue;
+        handle->track[n] = marker_info[i];
+        memcpy( handle->track_vertex[n], marker_info[i].vertex, sizeof(handle->track_vertex[n]) );
+        n++;
+    }
+    handle->track_num = n;
+}
+
+static double polygon_area( double vertex[4][2] )
+{
+    double  s;
+    int     k;
+
+    s = 0.0;
+    for( k = 0; k < 4; k++ ) {
+        s += vertex[k][0] * vertex[(k+1)%4][1] - vertex[(k+1)%4][0] * vertex[k][1];
+    }
+    return fabs( s ) / 2.0;
+}
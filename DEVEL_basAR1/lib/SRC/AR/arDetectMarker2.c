@@ -9,42 +9,82 @@
  *
 *******************************************************/
 
+#include <stdlib.h>
+#include <string.h>
 #include <AR/ar.h>
 
+static int check_bbox( int area, int clip[4], int edge_min );
+
 static int check_square( int area, ARMarkerInfo2 *marker_info2, double factor );
 
+static void grow_chain( ARHandle *handle, int need );
+
+static int *pool_alloc( ARHandle *handle, int n );
+
+static void store_contour( ARHandle *handle, int n, ARMarkerInfo2 *marker_info2 );
+
+static int trace_mask( ARHandle *handle, ARUint8 *mask, int mw, int mh, int *n );
+
 static int get_vertex( int x_coord[], int y_coord[], int st, int ed,
                        double thresh, int vertex[], int *vnum );
 
-static ARMarkerInfo2    marker_info2[AR_SQUARE_MAX];
+static int prune_overlaps( ARMarkerInfo2 *marker_info2, int marker_num );
+
+static int compare_int( const void *a, const void *b );
+
+// Directions of the eight neighbours, clockwise from straight up. Having
+// stepped in direction d, the next step of a trace is the first of
+// trace_search[d] that is dark: from three steps back round the turn.
+static const int xdir[8] = { 0, 1, 1, 1, 0,-1,-1,-1};
+static const int ydir[8] = {-1,-1, 0, 1, 1, 1, 0,-1};
+static const unsigned char trace_search[8][8] = {
+    { 5, 6, 7, 0, 1, 2, 3, 4 }, { 6, 7, 0, 1, 2, 3, 4, 5 },
+    { 7, 0, 1, 2, 3, 4, 5, 6 }, { 0, 1, 2, 3, 4, 5, 6, 7 },
+    { 1, 2, 3, 4, 5, 6, 7, 0 }, { 2, 3, 4, 5, 6, 7, 0, 1 },
+    { 3, 4, 5, 6, 7, 0, 1, 2 }, { 4, 5, 6, 7, 0, 1, 2, 3 }
+};
 
 ARMarkerInfo2 *arDetectMarker2( ARInt16 *limage, int label_num, int *label_ref,
                                 int *warea, double *wpos, int *wclip,
                                 int area_max, int area_min, double factor, int *marker_num )
 {
+    return arDetectMarker2Ctx( arGetDefaultHandle(), limage, label_num, label_ref,
+                               warea, wpos, wclip, area_max, area_min, factor, marker_num );
+}
+
+ARMarkerInfo2 *arDetectMarker2Ctx( ARHandle *handle, ARInt16 *limage,
+                                   int label_num, int *label_ref,
+                                   int *warea, double *wpos, int *wclip,
+                                   int area_max, int area_min, double factor, int *marker_num )
+{
+    ARMarkerInfo2     *marker_info2;
     ARMarkerInfo2     *pm;
+    ARContourBlock    *pb;
     int               xsize, ysize;
     int               marker_num2;
+    int               scale, edge_min;
     int               i, j, ret;
-    double            d;
 
-    if( arImageProcMode == AR_IMAGE_PROC_IN_HALF ) {
-        area_min /= 4;
-        area_max /= 4;
-        xsize = arImXsize / 2;
-        ysize = arImYsize / 2;
-    }
-    else {
-        xsize = arImXsize;
-        ysize = arImYsize;
-    }
+    marker_info2 = handle->marker_info2;
+    scale = arGetLabelingScale( handle );
+    area_min /= scale*scale;
+    area_max /= scale*scale;
+    xsize = handle->xsize / scale;
+    ysize = handle->ysize / scale;
+    edge_min = AR_CANDIDATE_EDGE_MIN / scale;
+
+    // Contours of the previous frame are no longer referenced.
+    handle->contour_cur = handle->contour_pool;
+    for( pb = handle->contour_pool; pb != NULL; pb = pb->next ) pb->used = 0;
+
     marker_num2 = 0;
     for(i=0; i<label_num; i++ ) {
         if( warea[i] < area_min || warea[i] > area_max ) continue;
         if( wclip[i*4+0] == 1 || wclip[i*4+1] == xsize-2 ) continue;
         if( wclip[i*4+2] == 1 || wclip[i*4+3] == ysize-2 ) continue;
+        if( check_bbox( warea[i], &(wclip[i*4]), edge_min ) < 0 ) continue;
 
-        ret = arGetContour( limage, label_ref, i+1,
+        ret = arGetContourCtx( handle, limage, label_ref, i+1,
                             &(wclip[i*4]), &(marker_info2[marker_num2]));
         if( ret < 0 ) continue;
 
@@ -58,72 +98,115 @@ ARMarkerInfo2 *arDetectMarker2( ARInt16 *limage, int label_num, int *label_ref,
         if( marker_num2 == AR_SQUARE_MAX ) break;
     }
 
-    for( i=0; i < marker_num2; i++ ) {
-        for( j=i+1; j < marker_num2; j++ ) {
-            d = (marker_info2[i].pos[0] - marker_info2[j].pos[0])
-              * (marker_info2[i].pos[0] - marker_info2[j].pos[0])
-              + (marker_info2[i].pos[1] - marker_info2[j].pos[1])
-              * (marker_info2[i].pos[1] - marker_info2[j].pos[1]);
-            if( marker_info2[i].area > marker_info2[j].area ) {
-                if( d < marker_info2[i].area / 4 ) {
-                    marker_info2[j].area = 0;
-                }
-            }
-            else {
-                if( d < marker_info2[j].area / 4 ) {
-                    marker_info2[i].area = 0;
-                }
-            }
-        }
-    }
-    for( i=0; i < marker_num2; i++ ) {
-        if( marker_info2[i].area == 0.0 ) {
-            for( j=i+1; j < marker_num2; j++ ) {
-                marker_info2[j-1] = marker_info2[j];
-            }
-            marker_num2--;
-        }
-    }
+    marker_num2 = prune_overlaps( marker_info2, marker_num2 );
 
-    if( arImageProcMode == AR_IMAGE_PROC_IN_HALF ) {
+    if( scale > 1 ) {
         pm = &(marker_info2[0]);
         for( i = 0; i < marker_num2; i++ ) {
-            pm->area *= 4;
-            pm->pos[0] *= 2.0;
-            pm->pos[1] *= 2.0;
+            pm->area *= scale*scale;
+            pm->pos[0] *= scale;
+            pm->pos[1] *= scale;
             for( j = 0; j< pm->coord_num; j++ ) {
-                pm->x_coord[j] *= 2;
-                pm->y_coord[j] *= 2;
+                pm->x_coord[j] *= scale;
+                pm->y_coord[j] *= scale;
             }
             pm++;
         }
     }
 
-    *marker_num = marker_num2;
+    *marker_num = handle->marker2_num = marker_num2;
     return( &(marker_info2[0]) );
 }
 
+// Drop the smaller of two candidates whose centres are closer than half
+// the side of the larger one. The close pairs are found by a sweep along
+// x, then handled in the order of the former all-pairs loop, so that the
+// same candidates survive.
+static int prune_overlaps( ARMarkerInfo2 *marker_info2, int marker_num )
+{
+    int       order[AR_SQUARE_MAX];
+    int       pair[AR_SQUARE_MAX*(AR_SQUARE_MAX-1)/2];
+    int       pair_num;
+    int       amax, o;
+    int       i, j, k, l;
+    double    dx, d;
+
+    amax = 0;
+    for( i = 0; i < marker_num; i++ ) {
+        if( marker_info2[i].area > amax ) amax = marker_info2[i].area;
+        for( k = i; k > 0 && marker_info2[order[k-1]].pos[0] > marker_info2[i].pos[0]; k-- ) {
+            order[k] = order[k-1];
+        }
+        order[k] = i;
+    }
+
+    pair_num = 0;
+    for( k = 0; k < marker_num; k++ ) {
+        i = order[k];
+        for( l = k+1; l < marker_num; l++ ) {
+            j = order[l];
+            dx = marker_info2[j].pos[0] - marker_info2[i].pos[0];
+            if( dx*dx >= amax / 4 ) break;
+            pair[pair_num++] = (i < j)? i*AR_SQUARE_MAX + j: j*AR_SQUARE_MAX + i;
+        }
+    }
+    qsort( pair, pair_num, sizeof(int), compare_int );
+
+    for( k = 0; k < pair_num; k++ ) {
+        i = pair[k] / AR_SQUARE_MAX;
+        j = pair[k] % AR_SQUARE_MAX;
+        d = (marker_info2[i].pos[0] - marker_info2[j].pos[0])
+          * (marker_info2[i].pos[0] - marker_info2[j].pos[0])
+          + (marker_info2[i].pos[1] - marker_info2[j].pos[1])
+          * (marker_info2[i].pos[1] - marker_info2[j].pos[1]);
+        if( marker_info2[i].area > marker_info2[j].area ) {
+            if( d < marker_info2[i].area / 4 ) {
+                marker_info2[j].area = 0;
+            }
+        }
+        else {
+            if( d < marker_info2[j].area / 4 ) {
+                marker_info2[i].area = 0;
+            }
+        }
+    }
+
+    for( i = o = 0; i < marker_num; i++ ) {
+        if( marker_info2[i].area == 0 ) continue;
+        if( o != i ) marker_info2[o] = marker_info2[i];
+        o++;
+    }
+
+    return o;
+}
+
+static int compare_int( const void *a, const void *b )
+{
+    return *(const int *)a - *(const int *)b;
+}
+
 int arGetContour( ARInt16 *limage, int *label_ref,
                   int label, int clip[4], ARMarkerInfo2 *marker_info2 )
 {
-    static int      xdir[8] = { 0, 1, 1, 1, 0,-1,-1,-1};
-    static int      ydir[8] = {-1,-1, 0, 1, 1, 1, 0,-1};
-    static int      wx[AR_CHAIN_MAX];
-    static int      wy[AR_CHAIN_MAX];
+    return arGetContourCtx( arGetDefaultHandle(), limage, label_ref, label, clip, marker_info2 );
+}
+
+// The trace steps a pointer through the label image, by offsets worked
+// out once, and searches the neighbours in the order of trace_search
+// rather than turning the direction round one at a time.
+int arGetContourCtx( ARHandle *handle, ARInt16 *limage, int *label_ref,
+                     int label, int clip[4], ARMarkerInfo2 *marker_info2 )
+{
+    const unsigned char *search;
     ARInt16         *p1;
+    int             *cx, *cy;
+    int             off[8];
     int             xsize, ysize;
-    int             sx, sy, dir;
-    int             dmax, d, v1;
+    int             sx, sy, x, y, dir, n;
     int             i, j;
 
-    if( arImageProcMode == AR_IMAGE_PROC_IN_HALF ) {
-        xsize = arImXsize / 2;
-        ysize = arImYsize / 2;
-    }
-    else {
-        xsize = arImXsize;
-        ysize = arImYsize;
-    }
+    xsize = handle->xsize / arGetLabelingScale( handle );
+    ysize = handle->ysize / arGetLabelingScale( handle );
     j = clip[2];
     p1 = &(limage[j*xsize+clip[0]]);
     for( i = clip[0]; i <= clip[1]; i++, p1++ ) {
@@ -135,60 +218,251 @@ int arGetContour( ARInt16 *limage, int *label_ref,
         printf("??? 1\n"); return(-1);
     }
 
-    marker_info2->coord_num = 1;
-    marker_info2->x_coord[0] = sx;
-    marker_info2->y_coord[0] = sy;
+    for( i = 0; i < 8; i++ ) off[i] = ydir[i]*xsize + xdir[i];
+
+    grow_chain( handle, 2 );
+    cx = handle->chain_x;
+    cy = handle->chain_y;
+    n = 1;
+    cx[0] = x = sx;
+    cy[0] = y = sy;
+    p1 = &(limage[sy*xsize + sx]);
     dir = 5;
     for(;;) {
-        p1 = &(limage[marker_info2->y_coord[marker_info2->coord_num-1] * xsize
-                    + marker_info2->x_coord[marker_info2->coord_num-1]]);
-        dir = (dir+5)%8;
+        search = trace_search[dir];
         for(i=0;i<8;i++) {
-            if( p1[ydir[dir]*xsize+xdir[dir]] > 0 ) break;
-            dir = (dir+1)%8;
+            if( p1[off[search[i]]] > 0 ) break;
         }
         if( i == 8 ) {
             printf("??? 2\n"); return(-1);
         }
-        marker_info2->x_coord[marker_info2->coord_num]
-            = marker_info2->x_coord[marker_info2->coord_num-1] + xdir[dir];
-        marker_info2->y_coord[marker_info2->coord_num]
-            = marker_info2->y_coord[marker_info2->coord_num-1] + ydir[dir];
-        if( marker_info2->x_coord[marker_info2->coord_num] == sx
-         && marker_info2->y_coord[marker_info2->coord_num] == sy ) break;
-        marker_info2->coord_num++;
-        if( marker_info2->coord_num == AR_CHAIN_MAX-1 ) {
+        dir = search[i];
+        p1 += off[dir];
+        x += xdir[dir];
+        y += ydir[dir];
+        cx[n] = x;
+        cy[n] = y;
+        if( x == sx && y == sy ) break;
+        n++;
+        if( n == xsize*ysize ) {
             printf("??? 3\n"); return(-1);
         }
+        if( n+1 > handle->chain_max ) {
+            grow_chain( handle, n+1 );
+            cx = handle->chain_x;
+            cy = handle->chain_y;
+        }
     }
 
+    store_contour( handle, n, marker_info2 );
+
+    return 0;
+}
+
+int arRefineMarker2Ctx( ARHandle *handle, ARUint8 *image, int thresh,
+                        ARMarkerInfo2 *marker_info2, int marker_num )
+{
+    ARMarkerInfo2   *pm, rm;
+    ARUint8         *mask;
+    int             scale, mw, mh;
+    int             x0, y0, x1, y1;
+    int             i, j, k, n;
+
+    if( handle->pyramidMode == AR_PYRAMID_OFF ) return 0;
+
+    scale = arGetLabelingScale( handle );
+
+    n = 0;
+    for( i = 0; i < marker_num; i++ ) {
+        pm = &(marker_info2[i]);
+
+        // Each coarse contour pixel stands for a scale x scale block.
+        x0 = x1 = pm->x_coord[0];
+        y0 = y1 = pm->y_coord[0];
+        for( j = 1; j < pm->coord_num; j++ ) {
+            if( pm->x_coord[j] < x0 ) x0 = pm->x_coord[j];
+            if( pm->x_coord[j] > x1 ) x1 = pm->x_coord[j];
+            if( pm->y_coord[j] < y0 ) y0 = pm->y_coord[j];
+            if( pm->y_coord[j] > y1 ) y1 = pm->y_coord[j];
+        }
+        x0 -= scale;
+        y0 -= scale;
+        x1 += scale*2;
+        y1 += scale*2;
+        if( x0 < 0 ) x0 = 0;
+        if( y0 < 0 ) y0 = 0;
+        if( x1 > handle->xsize-1 ) x1 = handle->xsize-1;
+        if( y1 > handle->ysize-1 ) y1 = handle->ysize-1;
+
+        mask = arBinarizeRegionCtx( handle, image, thresh, x0, y0, x1, y1 );
+        mw = x1 - x0 + 3;
+        mh = y1 - y0 + 3;
+        if( trace_mask( handle, mask, mw, mh, &k ) < 0 ) continue;
+        for( j = 0; j < k; j++ ) {
+            handle->chain_x[j] += x0 - 1;
+            handle->chain_y[j] += y0 - 1;
+        }
+        store_contour( handle, k, &rm );
+        if( check_square( pm->area, &rm, 1.0 ) < 0 ) continue;
+
+        pm->coord_num = rm.coord_num;
+        pm->x_coord   = rm.x_coord;
+        pm->y_coord   = rm.y_coord;
+        memcpy( pm->vertex, rm.vertex, sizeof(pm->vertex) );
+        n++;
+    }
+
+    return n;
+}
+
+// Trace the outer contour of the first dark blob of a mask with a blank
+// frame into the chain, as arGetContourCtx() does on the label image. Fails
+// quietly when the blob reaches the edge of the window, since it then goes
+// on outside it.
+static int trace_mask( ARHandle *handle, ARUint8 *mask, int mw, int mh, int *n )
+{
+    const unsigned char *search;
+    ARUint8         *p1;
+    int             off[8];
+    int             sx, sy, x, y, dir, k;
+    int             i;
+
+    for( i = mw + 1; i < mw*(mh-1); i++ ) {
+        if( mask[i] ) break;
+    }
+    if( i == mw*(mh-1) ) return(-1);
+    sx = i % mw;
+    sy = i / mw;
+    for( i = 0; i < 8; i++ ) off[i] = ydir[i]*mw + xdir[i];
+
+    grow_chain( handle, 2 );
+    k = 1;
+    handle->chain_x[0] = x = sx;
+    handle->chain_y[0] = y = sy;
+    p1 = &(mask[sy*mw + sx]);
+    dir = 5;
+    for(;;) {
+        if( x == 1 || x == mw-2 || y == 1 || y == mh-2 ) return(-1);
+        search = trace_search[dir];
+        for(i=0;i<8;i++) {
+            if( p1[off[search[i]]] ) break;
+        }
+        if( i == 8 ) return(-1);
+        dir = search[i];
+        p1 += off[dir];
+        x += xdir[dir];
+        y += ydir[dir];
+        handle->chain_x[k] = x;
+        handle->chain_y[k] = y;
+        if( x == sx && y == sy ) break;
+        k++;
+        if( k == mw*mh ) return(-1);
+        if( k+1 > handle->chain_max ) grow_chain( handle, k+1 );
+    }
+
+    *n = k;
+    return 0;
+}
+
+// Make room for need points in the trace chain.
+static void grow_chain( ARHandle *handle, int need )
+{
+    int     n;
+
+    if( need <= handle->chain_max ) return;
+    n = (handle->chain_max > 0)? handle->chain_max*2: 1024;
+    while( n < need ) n *= 2;
+    handle->chain_x = (int *)arMemRealloc( AR_MEM_AR, handle->chain_x, n*sizeof(int) );
+    handle->chain_y = (int *)arMemRealloc( AR_MEM_AR, handle->chain_y, n*sizeof(int) );
+    if( handle->chain_x == NULL || handle->chain_y == NULL ) {printf("malloc error!!\n"); exit(1);}
+    handle->chain_max = n;
+}
+
+// n ints from the contour pool, in one block. A new block is added when
+// none of the remaining ones has room.
+static int *pool_alloc( ARHandle *handle, int n )
+{
+    ARContourBlock  *pb;
+    int             *p;
+
+    pb = handle->contour_cur;
+    while( pb != NULL && pb->used + n > pb->size ) {
+        if( pb->next == NULL ) { pb = NULL; break; }
+        pb = pb->next;
+    }
+    if( pb == NULL ) {
+        arMallocTag( pb, ARContourBlock, 1, AR_MEM_AR );
+        pb->size = (n > AR_CONTOUR_BLOCK)? n: AR_CONTOUR_BLOCK;
+        pb->used = 0;
+        pb->next = NULL;
+        arMallocTag( pb->data, int, pb->size, AR_MEM_AR );
+        if( handle->contour_cur == NULL ) {
+            handle->contour_pool = pb;
+        }
+        else {
+            while( handle->contour_cur->next != NULL ) handle->contour_cur = handle->contour_cur->next;
+            handle->contour_cur->next = pb;
+        }
+    }
+    handle->contour_cur = pb;
+
+    p = &(pb->data[pb->used]);
+    pb->used += n;
+    return p;
+}
+
+// Copy the n traced points to the pool, starting at the point farthest
+// from where the trace began, which is a corner of a square, and close
+// the contour.
+static void store_contour( ARHandle *handle, int n, ARMarkerInfo2 *marker_info2 )
+{
+    int             *cx = handle->chain_x;
+    int             *cy = handle->chain_y;
+    int             *px, *py;
+    int             sx, sy;
+    int             dmax, d, v1;
+    int             i;
+
+    sx = cx[0];
+    sy = cy[0];
     dmax = 0;
-    for(i=1;i<marker_info2->coord_num;i++) {
-        d = (marker_info2->x_coord[i]-sx)*(marker_info2->x_coord[i]-sx)
-          + (marker_info2->y_coord[i]-sy)*(marker_info2->y_coord[i]-sy);
+    v1 = 0;
+    for(i=1;i<n;i++) {
+        d = (cx[i]-sx)*(cx[i]-sx) + (cy[i]-sy)*(cy[i]-sy);
         if( d > dmax ) {
             dmax = d;
             v1 = i;
         }
     }
 
-    for(i=0;i<v1;i++) {
-        wx[i] = marker_info2->x_coord[i];
-        wy[i] = marker_info2->y_coord[i];
-    }
-    for(i=v1;i<marker_info2->coord_num;i++) {
-        marker_info2->x_coord[i-v1] = marker_info2->x_coord[i];
-        marker_info2->y_coord[i-v1] = marker_info2->y_coord[i];
-    }
-    for(i=0;i<v1;i++) {
-        marker_info2->x_coord[i-v1+marker_info2->coord_num] = wx[i];
-        marker_info2->y_coord[i-v1+marker_info2->coord_num] = wy[i];
-    }
-    marker_info2->x_coord[marker_info2->coord_num] = marker_info2->x_coord[0];
-    marker_info2->y_coord[marker_info2->coord_num] = marker_info2->y_coord[0];
-    marker_info2->coord_num++;
+    px = pool_alloc( handle, (n+1)*2 );
+    py = px + n + 1;
+    memcpy( px,      &cx[v1], (n-v1)*sizeof(int) );
+    memcpy( py,      &cy[v1], (n-v1)*sizeof(int) );
+    memcpy( px+n-v1, cx,      v1*sizeof(int) );
+    memcpy( py+n-v1, cy,      v1*sizeof(int) );
+    px[n] = px[0];
+    py[n] = py[0];
 
-    return 0;
+    marker_info2->coord_num = n + 1;
+    marker_info2->x_coord   = px;
+    marker_info2->y_coord   = py;
+}
+
+// Rejects, before its contour is traced, a label whose bounding box is
+// too small, too elongated or too sparsely covered to hold the border of
+// a square seen from any usable angle.
+static int check_bbox( int area, int clip[4], int edge_min )
+{
+    int             w, h;
+
+    w = clip[1] - clip[0] + 1;
+    h = clip[3] - clip[2] + 1;
+    if( w < edge_min || h < edge_min ) return(-1);
+    if( w > h * AR_CANDIDATE_ASPECT_MAX || h > w * AR_CANDIDATE_ASPECT_MAX ) return(-1);
+    if( area < AR_CANDIDATE_FILL_MIN * w * h ) return(-1);
+
+    return(0);
 }
 
 static int check_square( int area, ARMarkerInfo2 *marker_info2, double factor )
@@ -286,34 +560,50 @@ static int check_square( int area, ARMarkerInfo2 *marker_info2, double factor )
     return(0);
 }
 
+// The corners of the chain between st and ed: it is split at the point
+// farthest from the chord, while that is more than sqrt(thresh) away, and
+// the pieces split again in turn. The pieces left are kept on a stack
+// rather than by recursion, and the search gives up as soon as a seventh
+// corner turns up. The corners are not in order along the chain, which
+// check_square() only needs of a single one.
 static int get_vertex( int x_coord[], int y_coord[], int st,  int ed,
                        double thresh, int vertex[], int *vnum)
 {
+    int      stack[8][2], top;
     double   d, dmax;
     double   a, b, c;
-    int      i, v1;
+    int      i, v1 = 0;
 
-    a = y_coord[ed] - y_coord[st];
-    b = x_coord[st] - x_coord[ed];
-    c = x_coord[ed]*y_coord[st] - y_coord[ed]*x_coord[st];
-    dmax = 0;
-    for(i=st+1;i<ed;i++) {
-        d = a*x_coord[i] + b*y_coord[i] + c;
-        if( d*d > dmax ) {
-            dmax = d*d;
-            v1 = i;
+    top = 0;
+    stack[0][0] = st;
+    stack[0][1] = ed;
+    while( top >= 0 ) {
+        st = stack[top][0];
+        ed = stack[top][1];
+        top--;
+
+        a = y_coord[ed] - y_coord[st];
+        b = x_coord[st] - x_coord[ed];
+        c = x_coord[ed]*y_coord[st] - y_coord[ed]*x_coord[st];
+        dmax = 0;
+        for(i=st+1;i<ed;i++) {
+            d = a*x_coord[i] + b*y_coord[i] + c;
+            if( d*d > dmax ) {
+                dmax = d*d;
+                v1 = i;
+            }
         }
-    }
-    if( dmax/(a*a+b*b) > thresh ) {
-        if( get_vertex(x_coord, y_coord, st,  v1, thresh, vertex, vnum) < 0 )
-            return(-1);
+        if( dmax/(a*a+b*b) <= thresh ) continue;
 
         if( (*vnum) > 5 ) return(-1);
         vertex[(*vnum)] = v1;
         (*vnum)++;
 
-        if( get_vertex(x_coord, y_coord, v1,  ed, thresh, vertex, vnum) < 0 )
-            return(-1);
+        // The far piece first, so that the near one is split next.
+        stack[++top][0] = v1;
+        stack[top][1]   = ed;
+        stack[++top][0] = st;
+        stack[top][1]   = v1;
     }
 
     return(0);
@@ -0,0 +1,233 @@
+/*******************************************************
+ *
+ * Marker detection over many images.
+ *
+ * The images are shared out among worker threads, each with its
+ * own ARHandle, thread t taking images t, t+thread_num, ...
+ * Every image is detected as arDetectMarkerLite() does, with no
+ * state carried over from the images before it, so the results
+ * do not depend on how the images were shared out.
+ *
+ * The two images of a stereo pair are detected at the same time,
+ * on the left and right default handles.
+ *
+*******************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <AR/ar.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <process.h>
+#else
+#  include <pthread.h>
+#endif
+
+typedef struct {
+    ARHandle        *handle;
+    ARUint8        **images;
+    int              image_num;
+    int              first;
+    int              interval;
+    int              thresh;
+    ARMarkerList    *result;
+} BatchJob;
+
+typedef struct {
+    ARUint8         *image;
+    int              thresh;
+    ARMarkerInfo    *marker_info;
+    int              marker_num;
+    int              ret;
+} StereoJob;
+
+static void do_batch( BatchJob *job );
+static void do_stereo_left( StereoJob *job );
+
+#ifdef _WIN32
+static unsigned __stdcall batch_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_batch( (BatchJob *)arg );
+    return 0;
+}
+#else
+static void *batch_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_batch( (BatchJob *)arg );
+    return NULL;
+}
+#endif
+
+#ifdef _WIN32
+static unsigned __stdcall stereo_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_stereo_left( (StereoJob *)arg );
+    return 0;
+}
+#else
+static void *stereo_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_stereo_left( (StereoJob *)arg );
+    return NULL;
+}
+#endif
+
+int arDetectMarkerBatch( ARUint8 *images[], int image_num, int thresh,
+                         ARMarkerList result[], int thread_num )
+{
+    BatchJob  job[AR_BATCH_THREADS_MAX];
+#ifdef _WIN32
+    HANDLE    tid[AR_BATCH_THREADS_MAX];
+#else
+    pthread_t tid[AR_BATCH_THREADS_MAX];
+#endif
+    int       started[AR_BATCH_THREADS_MAX];
+    int       ret;
+    int       i, t;
+
+    if( images == NULL || result == NULL || image_num < 0 ) return -1;
+    if( thread_num > AR_BATCH_THREADS_MAX ) thread_num = AR_BATCH_THREADS_MAX;
+    if( thread_num > image_num )            thread_num = image_num;
+    if( thread_num < 1 )                    thread_num = 1;
+
+    for( i = 0; i < image_num; i++ ) {
+        result[i].marker_info = NULL;
+        result[i].marker_num  = -1;
+    }
+
+    for( t = 0; t < thread_num; t++ ) {
+        if( (job[t].handle = arCreateHandle( &arParam )) == NULL ) break;
+        /* The images are already spread over the threads. */
+        job[t].handle->threads = 1;
+        job[t].handle->roiMode = AR_ROI_FULL_FRAME;
+        job[t].handle->codeCacheMode = AR_CODE_CACHE_OFF;
+        job[t].images    = images;
+        job[t].image_num = image_num;
+        job[t].first     = t;
+        job[t].thresh    = thresh;
+        job[t].result    = result;
+    }
+    if( t == 0 ) return -1;
+    thread_num = t;
+    for( t = 0; t < thread_num; t++ ) job[t].interval = thread_num;
+
+    for( t = 1; t < thread_num; t++ ) {
+#ifdef _WIN32
+        tid[t] = (HANDLE)_beginthreadex( NULL, 0, batch_thread, &job[t], 0, NULL );
+        started[t] = (tid[t] != 0);
+#else
+        started[t] = (pthread_create( &tid[t], NULL, batch_thread, &job[t] ) == 0);
+#endif
+    }
+    do_batch( &job[0] );
+    for( t = 1; t < thread_num; t++ ) {
+        if( !started[t] ) {
+            do_batch( &job[t] );
+            continue;
+        }
+#ifdef _WIN32
+        WaitForSingleObject( tid[t], INFINITE );
+        CloseHandle( tid[t] );
+#else
+        pthread_join( tid[t], NULL );
+#endif
+    }
+
+    for( t = 0; t < thread_num; t++ ) arDeleteHandle( job[t].handle );
+
+    ret = 0;
+    for( i = 0; i < image_num; i++ ) {
+        if( result[i].marker_num < 0 ) ret = -1;
+    }
+    return ret;
+}
+
+int arsDetectMarkerStereo( ARUint8 *dataL, ARUint8 *dataR, int thresh,
+                           ARMarkerInfo **marker_infoL, int *marker_numL,
+                           ARMarkerInfo **marker_infoR, int *marker_numR )
+{
+    StereoJob job;
+#ifdef _WIN32
+    HANDLE    tid;
+#else
+    pthread_t tid;
+#endif
+    int       started, ret;
+
+    /* Both default handles are brought up to date before the worker
+       starts, so that they are not refreshed from the globals while
+       the two detections run. */
+    arsGetDefaultHandle( 1 );
+    arsGetDefaultHandle( 0 );
+
+    job.image  = dataL;
+    job.thresh = thresh;
+#ifdef _WIN32
+    tid = (HANDLE)_beginthreadex( NULL, 0, stereo_thread, &job, 0, NULL );
+    started = (tid != 0);
+#else
+    started = (pthread_create( &tid, NULL, stereo_thread, &job ) == 0);
+#endif
+
+    ret = arsDetectMarker( dataR, thresh, marker_infoR, marker_numR, 0 );
+
+    if( started ) {
+#ifdef _WIN32
+        WaitForSingleObject( tid, INFINITE );
+        CloseHandle( tid );
+#else
+        pthread_join( tid, NULL );
+#endif
+    }
+    else {
+        do_stereo_left( &job );
+    }
+    *marker_infoL = job.marker_info;
+    *marker_numL  = job.marker_num;
+
+    return (ret < 0 || job.ret < 0)? -1: 0;
+}
+
+void arFreeMarkerBatch( ARMarkerList result[], int image_num )
+{
+    int     i;
+
+    for( i = 0; i < image_num; i++ ) {
+        free( result[i].marker_info );
+        result[i].marker_info = NULL;
+        result[i].marker_num  = 0;
+    }
+}
+
+static void do_stereo_left( StereoJob *job )
+{
+    job->ret = arsDetectMarker( job->image, job->thresh, &job->marker_info, &job->marker_num, 1 );
+}
+
+static void do_batch( BatchJob *job )
+{
+    ARHandle      *handle = job->handle;
+    ARMarkerInfo  *marker_info;
+    int           marker_num;
+    int           i;
+
+    for( i = job->first; i < job->image_num; i += job->interval ) {
+        handle->auto_thresh = 0;
+        handle->auto_lost   = 0;
+        if( job->images[i] == NULL
+         || arDetectMarkerLiteCtx( handle, job->images[i], job->thresh,
+                                   &marker_info, &marker_num ) < 0 ) {
+            continue;
+        }
+        if( marker_num > 0 ) {
+            arMalloc( job->result[i].marker_info, ARMarkerInfo, marker_num );
+            memcpy( job->result[i].marker_info, marker_info, marker_num*sizeof(ARMarkerInfo) );
+        }
+        job->result[i].marker_num = marker_num;
+    }
+}
@@ -0,0 +1,106 @@
+/*
+ *   Exposure and gain of the camera, set for the detection.
+ *
+ *   The contrast of the marker borders is the one arUpdateThresholdCtx()
+ *   measures on every frame it labels. Whether a frame was labeled whole
+ *   is read from the state the context left after the frame before: its
+ *   tracked markers, its ROI, or its motion blocks.
+ */
+#include <string.h>
+#include <AR/ar.h>
+
+static int brighter( ARExposure *e );
+static int darker( ARExposure *e );
+
+void arExposureInit( ARExposure *e )
+{
+    memset( e, 0, sizeof(ARExposure) );
+    e->exposure     = AR_EXPOSURE_START;
+    e->gain         = AR_EXPOSURE_GAIN_START;
+    e->exposure_min = 0.0;
+    e->gain_max     = AR_EXPOSURE_GAIN_MAX;
+    e->target       = AR_EXPOSURE_CONTRAST;
+    e->contrast     = -1;
+}
+
+int arExposureUpdate( ARExposure *e, ARHandle *handle )
+{
+    int     whole, measured, changed;
+
+    whole    = !e->cheap;
+    e->cheap = (handle->track_num > 0 || handle->roi_num > 0 || handle->motion_num >= 0);
+    measured = (handle->border_serial != e->serial);
+    e->serial = handle->border_serial;
+
+    if( e->settle > 0 ) {
+        e->settle--;
+        return 0;
+    }
+
+    changed = 0;
+    if( measured ) {
+        e->lost     = 0;
+        e->contrast = handle->border_bright - handle->border_dark;
+        if( handle->border_bright >= AR_EXPOSURE_BRIGHT_MAX || e->contrast > e->target + e->target/4 ) {
+            changed = darker( e );
+        }
+        else if( e->contrast < e->target ) {
+            changed = brighter( e );
+        }
+        else if( whole && e->exposure > e->exposure_min && e->gain < e->gain_max ) {
+            // The marker was lost, perhaps blurred: shorter, with more gain.
+            e->exposure -= AR_EXPOSURE_STEP;
+            if( e->exposure < e->exposure_min ) e->exposure = e->exposure_min;
+            e->gain += AR_EXPOSURE_STEP;
+            if( e->gain > e->gain_max ) e->gain = e->gain_max;
+            changed = 1;
+        }
+    }
+    else if( whole && ++e->lost >= AR_EXPOSURE_LOST_MAX ) {
+        // Too dark or too blurred to tell: only the gain goes up, the
+        // exposure waits for a square to measure.
+        e->lost = 0;
+        if( e->gain < e->gain_max ) {
+            e->gain += AR_EXPOSURE_STEP;
+            if( e->gain > e->gain_max ) e->gain = e->gain_max;
+            changed = 1;
+        }
+    }
+
+    if( changed ) e->settle = AR_EXPOSURE_SETTLE;
+    return changed;
+}
+
+/* The gain first, then the exposure. */
+static int brighter( ARExposure *e )
+{
+    if( e->gain < e->gain_max ) {
+        e->gain += AR_EXPOSURE_STEP;
+        if( e->gain > e->gain_max ) e->gain = e->gain_max;
+        return 1;
+    }
+    if( e->exposure < 1.0 ) {
+        e->exposure += AR_EXPOSURE_STEP;
+        if( e->exposure > 1.0 ) e->exposure = 1.0;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* The exposure first, then the gain. */
+static int darker( ARExposure *e )
+{
+    if( e->exposure > e->exposure_min ) {
+        e->exposure -= AR_EXPOSURE_STEP;
+        if( e->exposure < e->exposure_min ) e->exposure = e->exposure_min;
+        return 1;
+    }
+    if( e->gain > 0.0 ) {
+        e->gain -= AR_EXPOSURE_STEP;
+        if( e->gain < 0.0 ) e->gain = 0.0;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ *   Per-thread arena for the temporaries of a frame.
+ *
+ *   Each thread takes from blocks of its own, with a bump of their used
+ *   bytes and no lock. A function marks the arena, takes what it needs
+ *   and releases to its mark before returning, so the arena is a stack;
+ *   arFrameReset() at the end of the frame releases whatever is left.
+ *   Blocks are kept when released, so once a thread has been through its
+ *   largest frame it no longer calls malloc().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <AR/ar.h>
+
+#ifdef _MSC_VER
+#  define FRAME_TLS         __declspec(thread)
+#else
+#  define FRAME_TLS         __thread
+#endif
+
+#define FRAME_ALIGN(n)   (((n) + 15) & ~(size_t)15)
+
+typedef struct FrameBlock {
+    struct FrameBlock  *next;                   /* later, or spare */
+    size_t              size;
+    size_t              used;
+} FrameBlock;
+
+/* The data follows the block, aligned as malloc() aligns. */
+#define FRAME_DATA(b)    ((char *)(b) + FRAME_ALIGN(sizeof(FrameBlock)))
+
+static FRAME_TLS FrameBlock  *first = NULL;
+static FRAME_TLS FrameBlock  *cur = NULL;
+
+static FrameBlock *frame_block( size_t size )
+{
+    FrameBlock  *b;
+
+    if( size < AR_FRAME_BLOCK ) size = AR_FRAME_BLOCK;
+    if( (b = (FrameBlock *)arMemAlloc( AR_MEM_AR, FRAME_ALIGN(sizeof(FrameBlock)) + size )) == NULL ) {
+        printf("malloc error!!\n");
+        exit(1);
+    }
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+
+    return b;
+}
+
+void *arFrameAlloc( size_t size )
+{
+    FrameBlock  *b;
+
+    size = FRAME_ALIGN( size );
+    if( cur == NULL ) first = cur = frame_block( size );
+
+    if( cur->used + size > cur->size ) {
+        /* The spare after cur, when it is large enough, else a new block
+           put before it. */
+        if( cur->next == NULL || cur->next->size < size ) {
+            b = frame_block( size );
+            b->next = cur->next;
+            cur->next = b;
+        }
+        cur = cur->next;
+        cur->used = 0;
+    }
+    cur->used += size;
+
+    return FRAME_DATA( cur ) + cur->used - size;
+}
+
+ARFrameMark arFrameMark( void )
+{
+    ARFrameMark  mark;
+
+    mark.block = cur;
+    mark.used  = (cur != NULL)? cur->used: 0;
+
+    return mark;
+}
+
+void arFrameRelease( ARFrameMark mark )
+{
+    if( mark.block == NULL ) {
+        arFrameReset();
+        return;
+    }
+    cur = (FrameBlock *)mark.block;
+    cur->used = mark.used;
+}
+
+void arFrameReset( void )
+{
+    cur = first;
+    if( cur != NULL ) cur->used = 0;
+}
+
+void arFrameCleanup( void )
+{
+    FrameBlock  *b;
+
+    while( first != NULL ) {
+        b = first;
+        first = b->next;
+        arMemFree( b );
+    }
+    cur = NULL;
+}
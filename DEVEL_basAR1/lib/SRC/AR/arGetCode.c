@@ -10,73 +10,234 @@
 *******************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <unistd.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#endif
 #include <AR/ar.h>
 #include <AR/matrix.h>
 
 #define   DEBUG        0
 #define   EVEC_MAX     10
+#define   EVEC_KEEP    32
+#define   EVEC_RESIDUAL 1.0e-3
+
+// Vectorized correlation, see correlate4(). AVX2 is compiled for every
+// x86 and taken when arCpuFeatures() has it.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define AR_MATCH_SSE2
+#  include <emmintrin.h>
+#  if defined(AR_CPU_X86_AVX2)
+#    define AR_MATCH_AVX2
+#    include <immintrin.h>
+#  endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define AR_MATCH_NEON
+#  include <arm_neon.h>
+#endif
 
-static int    pattern_num = -1;
-static int    patf[AR_PATT_NUM_MAX] = { 0 };
-static int    pat[AR_PATT_NUM_MAX][4][AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3];
-static double patpow[AR_PATT_NUM_MAX][4];
-static int    patBW[AR_PATT_NUM_MAX][4][AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3];
-static double patpowBW[AR_PATT_NUM_MAX][4];
-
-static double evec[EVEC_MAX][AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3];
-static double epat[AR_PATT_NUM_MAX][4][EVEC_MAX];
+#define   PATT_LEN     (AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3)
+#define   PATT_LEN_BW  (AR_PATT_SIZE_Y*AR_PATT_SIZE_X)
+#define   KEY_BLOCK    4
+#define   KEY_DIM      ((AR_PATT_SIZE_Y/KEY_BLOCK)*(AR_PATT_SIZE_X/KEY_BLOCK))
+
+// One loaded pattern. Samples are stored as ARInt16 (they lie in -255..255),
+// the four rotations one after the other, so that correlate4() reads them in
+// one pass. key is a unit length copy at KEY_BLOCK times lower resolution,
+// used by select_candidates().
+typedef struct {
+    int     flag;                   /* 0: free, 1: active, 2: deactivated */
+    ARInt16 pat[4][PATT_LEN];
+    double  patpow[4];
+    ARInt16 patBW[4][PATT_LEN_BW];
+    double  patpowBW[4];
+    float   epat[4][EVEC_MAX];
+    double  key[4][KEY_DIM];
+} PattEntry;
+
+// The active patterns, listed so the matcher need not skip holes.
+typedef struct {
+    int     *id;
+    int      num;
+} PattActive;
+
+// The pattern table grows by doubling from AR_PATT_NUM_MAX entries, and
+// patt_active lists the active ones. A new list is built in the other of
+// patt_active_buf and then published, so that a matcher running in another
+// thread, which takes patt_active once per marker, sees either list whole.
+// After arLoadBundle() into an empty table, patt points into the mapped
+// bundle (patt_map) until the table has to grow.
+static PattEntry *patt = NULL;
+static int       patt_max = 0;
+static int       pattern_num = 0;
+static PattActive patt_active_buf[2] = { { NULL, 0 }, { NULL, 0 } };
+static PattActive * volatile patt_active = &patt_active_buf[0];
+static volatile int patt_serial = 0;
+static void     *patt_map = NULL;
+static size_t    patt_map_size = 0;
+
+// Pattern bundle, see arSaveBundle(). Each section starts on a BUNDLE_ALIGN
+// boundary. The records are PattEntry as laid out by this build, so the
+// header carries the byte order and the sizes to check the layout against.
+#define   BUNDLE_MAGIC    "ARPB"
+#define   BUNDLE_VERSION  1
+#define   BUNDLE_ENDIAN   0x01020304
+#define   BUNDLE_ALIGN    64
+#define   ALIGN_UP(x)     ((((x) + BUNDLE_ALIGN - 1) / BUNDLE_ALIGN) * BUNDLE_ALIGN)
+
+typedef struct {
+    char      magic[4];
+    ARUint32  endian;
+    ARInt32   version;
+    ARInt32   param_num;
+    ARInt32   param_size;
+    ARInt32   patt_num;
+    ARInt32   patt_size;
+    ARInt32   patt_size_x;
+    ARInt32   patt_size_y;
+    ARInt32   evec_max;
+    ARInt32   key_dim;
+    ARInt32   evec_num;
+    ARInt32   evec_dim;
+    ARInt32   param_offset;             /* ARParam[param_num]        */
+    ARInt32   patt_offset;              /* PattEntry[patt_num]       */
+    ARInt32   evec_offset;              /* float[evec_num][PATT_LEN] */
+    ARInt32   ev_offset;                /* double[evec_num]          */
+    ARInt32   size;
+    double    evec_total;
+} BundleHeader;
+
+// Eigenbasis of the loaded patterns for AR_MATCHING_WITH_PCA, updated by
+// update_evec() as patterns are loaded. evec_ev are the eigenvalues of the
+// second moment matrix and evec_total its trace; the first evec_dim vectors
+// are used for matching.
+static float  evec[EVEC_KEEP][PATT_LEN];
+static double evec_ev[EVEC_KEEP];
+static double evec_total = 0.0;
+static int    evec_num = 0;
 static int    evec_dim;
 static int    evecf = 0;
 //static double evecBW[EVEC_MAX][AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3];
-//static double epatBW[AR_PATT_NUM_MAX][4][EVEC_MAX];
+//static double epatBW[][4][EVEC_MAX];
 //static int    evec_dimBW;
 static int    evecBWf = 0;
 
 static void   get_cpara( double world[4][2], double vertex[4][2],
                          double para[3][3] );
+static int    get_hpara( double vertex[4][2], double para[3][3] );
 static int    pattern_match( ARUint8 *data, int *code, int *dir, double *cf );
+static void   match_one( ARUint8 *data, int *code, int *dir, double *cf );
+static int    sum_bytes( ARUint8 *data, int n );
+static void   correlate4_c( ARInt16 *input, ARInt16 *p, int n, int stride, int sum[4] );
+#if defined(AR_MATCH_SSE2)
+static void   correlate4_sse2( ARInt16 *input, ARInt16 *p, int n, int stride, int sum[4] );
+#endif
+#if defined(AR_MATCH_AVX2)
+static void   correlate4_avx2( ARInt16 *input, ARInt16 *p, int n, int stride, int sum[4] );
+#endif
+#if defined(AR_MATCH_NEON)
+static void   correlate4_neon( ARInt16 *input, ARInt16 *p, int n, int stride, int sum[4] );
+#endif
 static void   put_zero( ARUint8 *p, int size );
 static void   gen_evec(void);
+static void   update_evec( PattEntry *pe );
+static void   update_epat(void);
+static void   project_evec( ARInt16 *sample, float vec[EVEC_MAX] );
+static void   update_active(void);
+static void   grow_active( int n );
+
+// The variants of correlate4(), the first that the CPU has being taken.
+static const struct {
+    int          features;
+    const char  *name;
+    void       (*func)( ARInt16 *input, ARInt16 *p, int n, int stride, int sum[4] );
+} correlate4_kernel[] = {
+#if defined(AR_MATCH_AVX2)
+    { AR_CPU_AVX2, "avx2", correlate4_avx2 },
+#endif
+#if defined(AR_MATCH_SSE2)
+    { AR_CPU_SSE2, "sse2", correlate4_sse2 },
+#endif
+#if defined(AR_MATCH_NEON)
+    { AR_CPU_NEON, "neon", correlate4_neon },
+#endif
+    { 0,           "c",    correlate4_c }
+};
+
+// Until arCpuInit(), what the compiler was told the CPU has.
+#if defined(AR_MATCH_SSE2)
+static void (*correlate4)( ARInt16 *, ARInt16 *, int, int, int [4] ) = correlate4_sse2;
+#elif defined(AR_MATCH_NEON)
+static void (*correlate4)( ARInt16 *, ARInt16 *, int, int, int [4] ) = correlate4_neon;
+#else
+static void (*correlate4)( ARInt16 *, ARInt16 *, int, int, int [4] ) = correlate4_c;
+#endif
+static void   make_key( ARInt16 *sample, int chans, double key[KEY_DIM] );
+static int    select_candidates( PattActive *active, ARInt16 *input, int chans, int cand[AR_PATT_CANDIDATE_NUM] );
+static int    alloc_entry(void);
+static int    check_bundle( BundleHeader *head, size_t size );
+static int    write_pad( FILE *fp, int *pos, int offset );
+static void  *map_file( const char *filename, size_t *size );
+static void   unmap_file( void *base, size_t size );
 
 
 int arLoadPatt( const char *filename )
 {
-    FILE    *fp;
-    int     patno;
-    int     h, i, j, l, m;
-    int     i1, i2, i3;
-
-    if(pattern_num == -1 ) {
-        for( i = 0; i < AR_PATT_NUM_MAX; i++ ) patf[i] = 0;
-        pattern_num = 0;
-    }
-
-    for( i = 0; i < AR_PATT_NUM_MAX; i++ ) {
-        if(patf[i] == 0) break;
-    }
-    if( i == AR_PATT_NUM_MAX ) return -1;
-    patno = i;
+    FILE      *fp;
+    ARUint8   data[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3];
+    int       h, j;
+    int       i1, i2, i3;
 
     if( (fp=fopen(filename, "r")) == NULL ) {
         printf("\"%s\" not found!!\n", filename);
         return(-1);
     }
-
     for( h=0; h<4; h++ ) {
-        l = 0;
         for( i3 = 0; i3 < 3; i3++ ) {
             for( i2 = 0; i2 < AR_PATT_SIZE_Y; i2++ ) {
                 for( i1 = 0; i1 < AR_PATT_SIZE_X; i1++ ) {
                     if( fscanf(fp, "%d", &j) != 1 ) {
                         printf("Pattern Data read error!!\n");
+                        fclose(fp);
                         return -1;
                     }
-                    j = 255-j;
-                    pat[patno][h][(i2*AR_PATT_SIZE_X+i1)*3+i3] = j;
-                    if( i3 == 0 ) patBW[patno][h][i2*AR_PATT_SIZE_X+i1]  = j;
-                    else          patBW[patno][h][i2*AR_PATT_SIZE_X+i1] += j;
-                    if( i3 == 2 ) patBW[patno][h][i2*AR_PATT_SIZE_X+i1] /= 3;
+                    data[h][i2][i1][i3] = (ARUint8)j;
+                }
+            }
+        }
+    }
+    fclose(fp);
+
+    return( arLoadPattData( data ) );
+}
+
+int arLoadPattData( ARUint8 data[4][AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3] )
+{
+    PattEntry *pe;
+    int       patno;
+    int       h, i, j, l, m;
+    int       i1, i2, i3;
+
+    patno = alloc_entry();
+    pe = &(patt[patno]);
+
+    for( h=0; h<4; h++ ) {
+        l = 0;
+        for( i3 = 0; i3 < 3; i3++ ) {
+            for( i2 = 0; i2 < AR_PATT_SIZE_Y; i2++ ) {
+                for( i1 = 0; i1 < AR_PATT_SIZE_X; i1++ ) {
+                    j = 255-data[h][i2][i1][i3];
+                    pe->pat[h][(i2*AR_PATT_SIZE_X+i1)*3+i3] = j;
+                    if( i3 == 0 ) pe->patBW[h][i2*AR_PATT_SIZE_X+i1]  = j;
+                    else          pe->patBW[h][i2*AR_PATT_SIZE_X+i1] += j;
+                    if( i3 == 2 ) pe->patBW[h][i2*AR_PATT_SIZE_X+i1] /= 3;
                     l += j;
                 }
             }
@@ -84,39 +245,178 @@ int arLoadPatt( const char *filename )
         l /= (AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3);
 
         m = 0;
-        for( i = 0; i < AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3; i++ ) {
-            pat[patno][h][i] -= l;
-            m += (pat[patno][h][i]*pat[patno][h][i]);
+        for( i = 0; i < PATT_LEN; i++ ) {
+            pe->pat[h][i] -= l;
+            m += (pe->pat[h][i]*pe->pat[h][i]);
         }
-        patpow[patno][h] = sqrt((double)m);
-        if( patpow[patno][h] == 0.0 ) patpow[patno][h] = 0.0000001;
+        pe->patpow[h] = sqrt((double)m);
+        if( pe->patpow[h] == 0.0 ) pe->patpow[h] = 0.0000001;
 
         m = 0;
-        for( i = 0; i < AR_PATT_SIZE_Y*AR_PATT_SIZE_X; i++ ) {
-            patBW[patno][h][i] -= l;
-            m += (patBW[patno][h][i]*patBW[patno][h][i]);
+        for( i = 0; i < PATT_LEN_BW; i++ ) {
+            pe->patBW[h][i] -= l;
+            m += (pe->patBW[h][i]*pe->patBW[h][i]);
         }
-        patpowBW[patno][h] = sqrt((double)m);
-        if( patpowBW[patno][h] == 0.0 ) patpowBW[patno][h] = 0.0000001;
+        pe->patpowBW[h] = sqrt((double)m);
+        if( pe->patpowBW[h] == 0.0 ) pe->patpowBW[h] = 0.0000001;
+
+        make_key( pe->pat[h], 3, pe->key[h] );
     }
-    fclose(fp);
 
-    patf[patno] = 1;
+    pe->flag = 1;
     pattern_num++;
-
-/*
-    gen_evec();
-*/
+    update_active();
+    update_evec( pe );
+    update_epat();
 
     return( patno );
 }
 
+int arSaveBundle( const char *filename, ARParam *param, int param_num,
+                  int patt_id[], int patt_num )
+{
+    BundleHeader  head;
+    FILE          *fp;
+    int           pos, i;
+
+    if( param_num < 0 || (param_num > 0 && param == NULL) ) return -1;
+    if( patt_num < 0 || (patt_num > 0 && patt_id == NULL) ) return -1;
+    for( i = 0; i < patt_num; i++ ) {
+        if( patt_id[i] < 0 || patt_id[i] >= patt_max || patt[patt_id[i]].flag == 0 ) return -1;
+    }
+
+    memset( &head, 0, sizeof(head) );
+    memcpy( head.magic, BUNDLE_MAGIC, 4 );
+    head.endian       = BUNDLE_ENDIAN;
+    head.version      = BUNDLE_VERSION;
+    head.param_num    = param_num;
+    head.param_size   = sizeof(ARParam);
+    head.patt_num     = patt_num;
+    head.patt_size    = sizeof(PattEntry);
+    head.patt_size_x  = AR_PATT_SIZE_X;
+    head.patt_size_y  = AR_PATT_SIZE_Y;
+    head.evec_max     = EVEC_MAX;
+    head.key_dim      = KEY_DIM;
+    head.evec_num     = evec_num;
+    head.evec_dim     = evec_dim;
+    head.evec_total   = evec_total;
+    head.param_offset = ALIGN_UP( (int)sizeof(head) );
+    head.patt_offset  = ALIGN_UP( head.param_offset + param_num*(int)sizeof(ARParam) );
+    head.evec_offset  = ALIGN_UP( head.patt_offset + patt_num*(int)sizeof(PattEntry) );
+    head.ev_offset    = ALIGN_UP( head.evec_offset + evec_num*PATT_LEN*(int)sizeof(float) );
+    head.size         = head.ev_offset + evec_num*(int)sizeof(double);
+
+    if( (fp = fopen(filename, "wb")) == NULL ) {
+        printf("Error: cannot create \"%s\".\n", filename);
+        return -1;
+    }
+    pos = 0;
+    if( fwrite(&head, sizeof(head), 1, fp) != 1 ) goto error;
+    pos += sizeof(head);
+    if( write_pad(fp, &pos, head.param_offset) < 0 ) goto error;
+    if( param_num > 0 && fwrite(param, sizeof(ARParam), param_num, fp) != (size_t)param_num ) goto error;
+    pos += param_num * sizeof(ARParam);
+    if( write_pad(fp, &pos, head.patt_offset) < 0 ) goto error;
+    for( i = 0; i < patt_num; i++ ) {
+        if( fwrite(&patt[patt_id[i]], sizeof(PattEntry), 1, fp) != 1 ) goto error;
+    }
+    pos += patt_num * sizeof(PattEntry);
+    if( write_pad(fp, &pos, head.evec_offset) < 0 ) goto error;
+    for( i = 0; i < evec_num; i++ ) {
+        if( fwrite(evec[i], sizeof(float), PATT_LEN, fp) != PATT_LEN ) goto error;
+    }
+    pos += evec_num * PATT_LEN * sizeof(float);
+    if( write_pad(fp, &pos, head.ev_offset) < 0 ) goto error;
+    if( evec_num > 0 && fwrite(evec_ev, sizeof(double), evec_num, fp) != (size_t)evec_num ) goto error;
+    fclose( fp );
+
+    return 0;
+
+error:
+    printf("Error: cannot write \"%s\".\n", filename);
+    fclose( fp );
+    return -1;
+}
+
+int arLoadBundle( const char *filename, ARParam *param, int param_max, int *param_num,
+                  int patt_id[], int id_max, int *patt_num )
+{
+    BundleHeader  *head;
+    PattEntry     *rec;
+    unsigned char *base;
+    size_t        size;
+    int           i, k;
+
+    if( (base = (unsigned char *)map_file(filename, &size)) == NULL ) {
+        printf("\"%s\" not found!!\n", filename);
+        return -1;
+    }
+    head = (BundleHeader *)base;
+    if( check_bundle(head, size) < 0 ) {
+        printf("\"%s\" is not a pattern bundle of this build.\n", filename);
+        unmap_file( base, size );
+        return -1;
+    }
+    if( head->param_num > param_max || head->patt_num > id_max ) {
+        printf("\"%s\" holds more entries than requested.\n", filename);
+        unmap_file( base, size );
+        return -1;
+    }
+
+    if( head->param_num > 0 ) {
+        memcpy( param, base + head->param_offset, head->param_num*sizeof(ARParam) );
+    }
+    if( param_num != NULL ) *param_num = head->param_num;
+    if( patt_num != NULL )  *patt_num  = head->patt_num;
+    rec = (PattEntry *)(base + head->patt_offset);
+
+    if( pattern_num == 0 && patt_map == NULL && head->patt_num > 0 ) {
+        // Nothing loaded yet: the table is the bundle itself, and the
+        // stored eigenbasis and projections are used as they are.
+        arMemFree( patt );
+        patt        = rec;
+        patt_max    = head->patt_num;
+        grow_active( patt_max );
+        patt_map      = base;
+        patt_map_size = size;
+        arMemAdd( AR_MEM_AR, (long)size );
+        for( i = 0; i < patt_max; i++ ) patt_id[i] = i;
+        pattern_num = patt_max;
+        update_active();
+
+        evec_num   = head->evec_num;
+        evec_dim   = head->evec_dim;
+        evec_total = head->evec_total;
+        memcpy( evec, base + head->evec_offset, evec_num*PATT_LEN*sizeof(float) );
+        memcpy( evec_ev, base + head->ev_offset, evec_num*sizeof(double) );
+        evecf   = (pattern_num >= 4 && evec_num > 0);
+        evecBWf = 0;
+
+        return 0;
+    }
+
+    // Added to loaded patterns, which extend the eigenbasis as arLoadPatt() does.
+    for( i = 0; i < head->patt_num; i++ ) {
+        k = alloc_entry();
+        memcpy( &patt[k], &rec[i], sizeof(PattEntry) );
+        pattern_num++;
+        update_evec( &patt[k] );
+        patt_id[i] = k;
+    }
+    update_active();
+    update_epat();
+    unmap_file( base, size );
+
+    return 0;
+}
+
 int arFreePatt( int patno )
 {
-    if( patf[patno] == 0 ) return -1;
+    if( patno < 0 || patno >= patt_max || patt[patno].flag == 0 ) return -1;
 
-    patf[patno] = 0;
+    patt[patno].flag = 0;
     pattern_num--;
+    update_active();
 
     gen_evec();
 
@@ -125,69 +425,143 @@ int arFreePatt( int patno )
 
 int arActivatePatt( int patno )
 {
-    if( patf[patno] == 0 ) return -1;
+    if( patno < 0 || patno >= patt_max || patt[patno].flag == 0 ) return -1;
 
-    patf[patno] = 1;
+    patt[patno].flag = 1;
+    update_active();
 
     return 1;
 }
 
 int arDeactivatePatt( int patno )
 {
-    if( patf[patno] == 0 ) return -1;
+    if( patno < 0 || patno >= patt_max || patt[patno].flag == 0 ) return -1;
 
-    patf[patno] = 2;
+    patt[patno].flag = 2;
+    update_active();
 
     return 1;
 }
 
+int arSetPattActive( const int *patt_no, const int *active, int num )
+{
+    int     i, n;
+
+    n = 0;
+    for( i = 0; i < num; i++ ) {
+        if( patt_no[i] < 0 || patt_no[i] >= patt_max || patt[patt_no[i]].flag == 0 ) continue;
+        patt[patt_no[i]].flag = active[i]? 1: 2;
+        n++;
+    }
+    if( n > 0 ) update_active();
+
+    return n;
+}
+
 int arGetCode( ARUint8 *image, int *x_coord, int *y_coord, int *vertex,
                int *code, int *dir, double *cf )
 {
-#if DEBUG
-static int count = 0;
-static double a1 = 0.0;
-static double a2 = 0.0;
-double b1, b2, b3;
-#endif
+    return arGetCodeCtx( arGetDefaultHandle(), image, x_coord, y_coord, vertex, code, dir, cf );
+}
+
+int arGetCodeCtx( ARHandle *handle, ARUint8 *image, int *x_coord, int *y_coord, int *vertex,
+                  int *code, int *dir, double *cf )
+{
     ARUint8 ext_pat[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3];
+    double  t = 0.0;
 
-#if DEBUG
-b1 = arUtilTimer();
-#endif
-    arGetPatt(image, x_coord, y_coord, vertex, ext_pat);
-#if DEBUG
-b2 = arUtilTimer();
-#endif
+    AR_STATS_START( handle, t );
+    arGetPattCtx(handle, image, x_coord, y_coord, vertex, ext_pat);
+    AR_STATS_STAGE( handle, pattern, t );
 
-    pattern_match((ARUint8 *)ext_pat, code, dir, cf);
-#if DEBUG
-b3 = arUtilTimer();
-#endif
+    match_one((ARUint8 *)ext_pat, code, dir, cf);
+    AR_STATS_STAGE( handle, match, t );
+    if( handle->statsMode == AR_STATS_ON ) handle->stats.pattern_num++;
 
-#if DEBUG
-a1 += (b2 - b1);
-a2 += (b3 - b2);
-count++;
-if( count == 60 ) {
-    printf("%10.5f[msec], %10.5f[msec]\n", a1*1000.0/60.0, a2*1000.0/60.0);
-    count = 0;
-    a1 = a2 = 0.0;
+    return(0);
 }
-#endif
+
+int arGetCodeBatchCtx( ARHandle *handle, ARUint8 (*ext_pat)[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3], int num,
+                       int *code, int *dir, double *cf )
+{
+    double  t = 0.0;
+    int     i;
+
+    if( num <= 0 ) return(0);
+
+    AR_STATS_START( handle, t );
+    if( handle->patt_matcher == NULL
+     || arPattDetectionMode != AR_PATT_DETECTION_TEMPLATE
+     || arTemplateMatchingMode != AR_TEMPLATE_MATCHING_COLOR
+     || arMatchingPCAMode != AR_MATCHING_WITHOUT_PCA
+     || (*handle->patt_matcher)( handle->patt_matcher_data, ext_pat, num, code, dir, cf ) < 0 ) {
+        for( i = 0; i < num; i++ ) {
+            match_one( (ARUint8 *)ext_pat[i], &code[i], &dir[i], &cf[i] );
+        }
+    }
+    AR_STATS_STAGE( handle, match, t );
+    if( handle->statsMode == AR_STATS_ON ) handle->stats.pattern_num += num;
 
     return(0);
 }
 
+int arSetPattMatcherCtx( ARHandle *handle, ARPattMatcher matcher, void *data )
+{
+    if( handle == NULL ) return -1;
+    handle->patt_matcher      = matcher;
+    handle->patt_matcher_data = data;
+    return 0;
+}
+
+int arGetPattActive( int *patt_no, int max )
+{
+    PattActive *active = patt_active;
+    int         i;
+
+    for( i = 0; i < active->num && i < max; i++ ) patt_no[i] = active->id[i];
+    return active->num;
+}
+
+int arGetPattSamples( int patt_no, ARInt16 samples[4][PATT_LEN], double pow[4] )
+{
+    if( patt_no < 0 || patt_no >= patt_max || patt[patt_no].flag == 0 ) return -1;
+
+    memcpy( samples, patt[patt_no].pat, sizeof(patt[patt_no].pat) );
+    memcpy( pow, patt[patt_no].patpow, sizeof(patt[patt_no].patpow) );
+    return 0;
+}
+
+int arGetPattSerial( void )
+{
+    return patt_serial;
+}
+
+// Template matching, or matrix code decoding, of one pattern.
+static void match_one( ARUint8 *data, int *code, int *dir, double *cf )
+{
+    if( arPattDetectionMode == AR_PATT_DETECTION_TEMPLATE
+     || (arMatrixCodeDecode((ARUint8 (*)[AR_PATT_SIZE_X][3])data, code, dir, cf) < 0
+      && arPattDetectionMode == AR_PATT_DETECTION_TEMPLATE_AND_MATRIX) ) {
+        pattern_match(data, code, dir, cf);
+    }
+}
+
 #if 1
 int arGetPatt( ARUint8 *image, int *x_coord, int *y_coord, int *vertex,
                ARUint8 ext_pat[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3] )
+{
+    return arGetPattCtx( arGetDefaultHandle(), image, x_coord, y_coord, vertex, ext_pat );
+}
+
+int arGetPattCtx( ARHandle *handle, ARUint8 *image, int *x_coord, int *y_coord, int *vertex,
+                  ARUint8 ext_pat[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3] )
 {
     ARUint32  ext_pat2[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3];
     double    world[4][2];
     double    local[4][2];
     double    para[3][3];
-    double    d, xw, yw;
+    double    xw, yw;
+    double    nx, ny, nd, dnx, dny, dnd;
     int       xc, yc;
     int       xdiv, ydiv;
     int       xdiv2, ydiv2;
@@ -199,6 +573,12 @@ int arGetPatt( ARUint8 *image, int *x_coord, int *y_coord, int *vertex,
 	int       ext_pat2_x_index;
 	int       ext_pat2_y_index;
 	int       image_index;
+    int       xsize = handle->xsize;
+    int       ysize = handle->ysize;
+    // Contours refined by arRefineMarker2Ctx() are in full resolution.
+    int       half  = (handle->imageProcMode == AR_IMAGE_PROC_IN_HALF
+                    && handle->pyramidMode == AR_PYRAMID_OFF);
+    int       fast  = (handle->samplingMode == AR_PATT_SAMPLING_FAST);
 
     world[0][0] = 100.0;
     world[0][1] = 100.0;
@@ -212,30 +592,37 @@ int arGetPatt( ARUint8 *image, int *x_coord, int *y_coord, int *vertex,
         local[i][0] = x_coord[vertex[i]];
         local[i][1] = y_coord[vertex[i]];
     }
-    get_cpara( world, local, para );
 
-    lx1 = (int)((local[0][0] - local[1][0])*(local[0][0] - local[1][0])
-        + (local[0][1] - local[1][1])*(local[0][1] - local[1][1]));
-    lx2 = (int)((local[2][0] - local[3][0])*(local[2][0] - local[3][0])
-        + (local[2][1] - local[3][1])*(local[2][1] - local[3][1]));
-    ly1 = (int)((local[1][0] - local[2][0])*(local[1][0] - local[2][0])
-        + (local[1][1] - local[2][1])*(local[1][1] - local[2][1]));
-    ly2 = (int)((local[3][0] - local[0][0])*(local[3][0] - local[0][0])
-        + (local[3][1] - local[0][1])*(local[3][1] - local[0][1]));
-    if( lx2 > lx1 ) lx1 = lx2;
-    if( ly2 > ly1 ) ly1 = ly2;
     xdiv2 = AR_PATT_SIZE_X;
     ydiv2 = AR_PATT_SIZE_Y;
-    if( arImageProcMode == AR_IMAGE_PROC_IN_FULL ) {
-        while( xdiv2*xdiv2 < lx1/4 ) xdiv2*=2;
-        while( ydiv2*ydiv2 < ly1/4 ) ydiv2*=2;
+    if( fast ) {
+        // One sample per pattern pixel, on a closed form homography.
+        if( get_hpara( local, para ) < 0 ) return(-1);
     }
     else {
-        while( xdiv2*xdiv2*4 < lx1/4 ) xdiv2*=2;
-        while( ydiv2*ydiv2*4 < ly1/4 ) ydiv2*=2;
+        get_cpara( world, local, para );
+
+        lx1 = (int)((local[0][0] - local[1][0])*(local[0][0] - local[1][0])
+            + (local[0][1] - local[1][1])*(local[0][1] - local[1][1]));
+        lx2 = (int)((local[2][0] - local[3][0])*(local[2][0] - local[3][0])
+            + (local[2][1] - local[3][1])*(local[2][1] - local[3][1]));
+        ly1 = (int)((local[1][0] - local[2][0])*(local[1][0] - local[2][0])
+            + (local[1][1] - local[2][1])*(local[1][1] - local[2][1]));
+        ly2 = (int)((local[3][0] - local[0][0])*(local[3][0] - local[0][0])
+            + (local[3][1] - local[0][1])*(local[3][1] - local[0][1]));
+        if( lx2 > lx1 ) lx1 = lx2;
+        if( ly2 > ly1 ) ly1 = ly2;
+        if( !half ) {
+            while( xdiv2*xdiv2 < lx1/4 ) xdiv2*=2;
+            while( ydiv2*ydiv2 < ly1/4 ) ydiv2*=2;
+        }
+        else {
+            while( xdiv2*xdiv2*4 < lx1/4 ) xdiv2*=2;
+            while( ydiv2*ydiv2*4 < ly1/4 ) ydiv2*=2;
+        }
+        if( xdiv2 > AR_PATT_SAMPLE_NUM ) xdiv2 = AR_PATT_SAMPLE_NUM;
+        if( ydiv2 > AR_PATT_SAMPLE_NUM ) ydiv2 = AR_PATT_SAMPLE_NUM;
     }
-    if( xdiv2 > AR_PATT_SAMPLE_NUM ) xdiv2 = AR_PATT_SAMPLE_NUM;
-    if( ydiv2 > AR_PATT_SAMPLE_NUM ) ydiv2 = AR_PATT_SAMPLE_NUM;
 
     xdiv = xdiv2/AR_PATT_SIZE_X;
     ydiv = ydiv2/AR_PATT_SIZE_Y;
@@ -246,23 +633,45 @@ printf("%3d(%f), %3d(%f)\n", xdiv2, sqrt(lx1), ydiv2, sqrt(ly1));
 	xdiv2_reciprocal = 1.0 / xdiv2;
 	ydiv2_reciprocal = 1.0 / ydiv2;
 
+    // The homogeneous coordinates of the samples are stepped along each row.
+    dnx = para[0][0] * 5.0 * xdiv2_reciprocal;
+    dny = para[1][0] * 5.0 * xdiv2_reciprocal;
+    dnd = para[2][0] * 5.0 * xdiv2_reciprocal;
+    xw  = 102.5 + 2.5 * xdiv2_reciprocal;
+
     put_zero( (ARUint8 *)ext_pat2, AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3*sizeof(ARUint32) );
     for( j = 0; j < ydiv2; j++ ) {
         yw = 102.5 + 5.0 * (j+0.5) * ydiv2_reciprocal;
-        for( i = 0; i < xdiv2; i++ ) {
-            xw = 102.5 + 5.0 * (i+0.5) * xdiv2_reciprocal;
-            d = para[2][0]*xw + para[2][1]*yw + para[2][2];
-            if( d == 0 ) return(-1);
-            xc = (int)((para[0][0]*xw + para[0][1]*yw + para[0][2])/d);
-            yc = (int)((para[1][0]*xw + para[1][1]*yw + para[1][2])/d);
-            if( arImageProcMode == AR_IMAGE_PROC_IN_HALF ) {
+        nx = para[0][0]*xw + para[0][1]*yw + para[0][2];
+        ny = para[1][0]*xw + para[1][1]*yw + para[1][2];
+        nd = para[2][0]*xw + para[2][1]*yw + para[2][2];
+        for( i = 0; i < xdiv2; i++, nx += dnx, ny += dny, nd += dnd ) {
+            if( nd == 0 ) return(-1);
+            xc = (int)(nx/nd);
+            yc = (int)(ny/nd);
+            if( half ) {
                 xc = ((xc+1)/2)*2;
                 yc = ((yc+1)/2)*2;
             }
-            if( xc >= 0 && xc < arImXsize && yc >= 0 && yc < arImYsize ) {
+            if( xc >= 0 && xc < xsize && yc >= 0 && yc < ysize ) {
 				ext_pat2_y_index = j/ydiv;
 				ext_pat2_x_index = i/xdiv;
-				image_index = (yc*arImXsize+xc)*AR_PIX_SIZE_DEFAULT;
+                if( handle->lumaStride ) {
+                    // Luma plane from arDetectMarkerLumaCtx(): a grey pattern.
+                    image_index = image[yc*handle->lumaStride + xc];
+                    ext_pat2[ext_pat2_y_index][ext_pat2_x_index][0] += image_index;
+                    ext_pat2[ext_pat2_y_index][ext_pat2_x_index][1] += image_index;
+                    ext_pat2[ext_pat2_y_index][ext_pat2_x_index][2] += image_index;
+                    continue;
+                }
+                if( handle->pixFormat != AR_DEFAULT_PIXEL_FORMAT ) {
+                    image_index = (yc*xsize+xc)*handle->pixSize;
+                    ext_pat2[ext_pat2_y_index][ext_pat2_x_index][0] += image[image_index+handle->pixOffset[0]];
+                    ext_pat2[ext_pat2_y_index][ext_pat2_x_index][1] += image[image_index+handle->pixOffset[1]];
+                    ext_pat2[ext_pat2_y_index][ext_pat2_x_index][2] += image[image_index+handle->pixOffset[2]];
+                    continue;
+                }
+				image_index = (yc*xsize+xc)*AR_PIX_SIZE_DEFAULT;
 #if (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_ARGB)
                 ext_pat2[ext_pat2_y_index][ext_pat2_x_index][0] += image[image_index+3];
                 ext_pat2[ext_pat2_y_index][ext_pat2_x_index][1] += image[image_index+2];
@@ -484,15 +893,58 @@ int arGetPatt( ARUint8 *image, int *x_coord, int *y_coord, int *vertex,
 }
 #endif
 
+// The mapping of get_cpara() for the world square of arGetPattCtx(),
+// 100 to 110 on both axes, solved directly rather than as an 8x8 system.
+static int get_hpara( double vertex[4][2], double para[3][3] )
+{
+    double  dx1, dx2, dx3, dy1, dy2, dy3, den;
+    double  a, b, c, d, e, f, g, h;
+
+    dx1 = vertex[1][0] - vertex[2][0];
+    dx2 = vertex[3][0] - vertex[2][0];
+    dx3 = vertex[0][0] - vertex[1][0] + vertex[2][0] - vertex[3][0];
+    dy1 = vertex[1][1] - vertex[2][1];
+    dy2 = vertex[3][1] - vertex[2][1];
+    dy3 = vertex[0][1] - vertex[1][1] + vertex[2][1] - vertex[3][1];
+    if( dx3 == 0.0 && dy3 == 0.0 ) {
+        g = h = 0.0;
+    }
+    else {
+        den = dx1*dy2 - dx2*dy1;
+        if( den == 0.0 ) return -1;
+        g = (dx3*dy2 - dx2*dy3) / den;
+        h = (dx1*dy3 - dx3*dy1) / den;
+    }
+    // Unit square to vertex, then world to unit square.
+    a = vertex[1][0] - vertex[0][0] + g*vertex[1][0];
+    b = vertex[3][0] - vertex[0][0] + h*vertex[3][0];
+    c = vertex[0][0];
+    d = vertex[1][1] - vertex[0][1] + g*vertex[1][1];
+    e = vertex[3][1] - vertex[0][1] + h*vertex[3][1];
+    f = vertex[0][1];
+    para[0][0] = a / 10.0;
+    para[0][1] = b / 10.0;
+    para[0][2] = c - 10.0*(a + b);
+    para[1][0] = d / 10.0;
+    para[1][1] = e / 10.0;
+    para[1][2] = f - 10.0*(d + e);
+    para[2][0] = g / 10.0;
+    para[2][1] = h / 10.0;
+    para[2][2] = 1.0 - 10.0*(g + h);
+
+    return 0;
+}
+
 static void get_cpara( double world[4][2], double vertex[4][2],
                        double para[3][3] )
 {
-    ARMat   *a, *b, *c;
+    double  am[8*8], bm[8], cm[8];
+    ARMat   ma = { am, 8, 8 }, mb = { bm, 8, 1 }, mc = { cm, 8, 1 };
+    ARMat   *a = &ma, *b = &mb, *c = &mc;
     int     i;
 
-    a = arMatrixAlloc( 8, 8 );
-    b = arMatrixAlloc( 8, 1 );
-    c = arMatrixAlloc( 8, 1 );
+    /* Solved for each square decoded, on the stack so as not to call
+       malloc() in the frame. */
     for( i = 0; i < 4; i++ ) {
         a->m[i*16+0]  = world[i][0];
         a->m[i*16+1]  = world[i][1];
@@ -523,39 +975,38 @@ static void get_cpara( double world[4][2], double vertex[4][2],
     para[2][0] = c->m[2*3+0];
     para[2][1] = c->m[2*3+1];
     para[2][2] = 1.0;
-    arMatrixFree( a );
-    arMatrixFree( b );
-    arMatrixFree( c );
 }
 
 static int pattern_match( ARUint8 *data, int *code, int *dir, double *cf )
 {
-    double invec[EVEC_MAX];
-    int    input[AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3];
+    float  invec[EVEC_MAX];
+    float  dist, d;
+    ARInt16 input[AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3];
     int    i, j, l;
     int    k = 0; // fix VC7 compiler warning: uninitialized variable
     int    ave, sum, res, res2;
+    int    sum4[4];
+    int    cand[AR_PATT_CANDIDATE_NUM], *list, list_num;
+    PattActive *active = patt_active;
     double datapow, sum2, min;
     double max = 0.0; // fix VC7 compiler warning: uninitialized variable
 
-    sum = ave = 0;
-    for(i=0;i<AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3;i++) {
-        ave += (255-data[i]);
-    }
+    ave = 255*AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3 - sum_bytes( data, AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3 );
     ave /= (AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3);
 
     if( arTemplateMatchingMode == AR_TEMPLATE_MATCHING_COLOR ) {
         for(i=0;i<AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3;i++) {
-            input[i] = (255-data[i]) - ave;
-            sum += input[i]*input[i];
+            input[i] = (ARInt16)((255-ave) - data[i]);
         }
+        correlate4( input, input, AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3, 0, sum4 );
     }
     else {
         for(i=0;i<AR_PATT_SIZE_Y*AR_PATT_SIZE_X;i++) {
-            input[i] = ((255-data[i*3+0]) + (255-data[i*3+1]) + (255-data[i*3+02]))/3 - ave;
-            sum += input[i]*input[i];
+            input[i] = (ARInt16)(((255-data[i*3+0]) + (255-data[i*3+1]) + (255-data[i*3+02]))/3 - ave);
         }
+        correlate4( input, input, AR_PATT_SIZE_Y*AR_PATT_SIZE_X, 0, sum4 );
     }
+    sum = sum4[0];
 
     datapow = sqrt( (double)sum );
     if( datapow == 0.0 ) {
@@ -569,66 +1020,69 @@ static int pattern_match( ARUint8 *data, int *code, int *dir, double *cf )
     if( arTemplateMatchingMode == AR_TEMPLATE_MATCHING_COLOR ) {
         if( arMatchingPCAMode == AR_MATCHING_WITH_PCA && evecf ) {
 
-            for( i = 0; i < evec_dim; i++ ) {
-                invec[i] = 0.0;
-                for( j = 0; j < AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3; j++ ) {
-                    invec[i] += evec[i][j] * input[j];
-                }
-                invec[i] /= datapow;
-            }
+            project_evec( input, invec );
+            for( i = 0; i < evec_dim; i++ ) invec[i] /= (float)datapow;
 
             min = 10000.0;
-            k = -1;
-            for( l = 0; l < pattern_num; l++ ) {
-                k++;
-                while( patf[k] == 0 ) k++;
-                if( patf[k] == 2 ) continue;
+            for( l = 0; l < active->num; l++ ) {
+                k = active->id[l];
 #if DEBUG
                 printf("%3d: ", k);
 #endif
                 for( j = 0; j < 4; j++ ) {
-                    sum2 = 0;
+                    dist = 0.0f;
                     for(i = 0; i < evec_dim; i++ ) {
-                        sum2 += (invec[i] - epat[k][j][i]) * (invec[i] - epat[k][j][i]);
+                        d = invec[i] - patt[k].epat[j][i];
+                        dist += d * d;
                     }
 #if DEBUG
-                    printf("%10.7f ", sum2);
+                    printf("%10.7f ", dist);
 #endif
-                    if( sum2 < min ) { min = sum2; res = j; res2 = k; }
+                    if( dist < min ) { min = dist; res = j; res2 = k; }
                 }
 #if DEBUG
                 printf("\n");
 #endif
             }
-            sum = 0;
-            for(i=0;i<AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3;i++) sum += input[i]*pat[res2][res][i];
-            max = sum / patpow[res2][res] / datapow;
+            if( res2 < 0 ) {
+                max = 0.0;
+            }
+            else {
+                correlate4( input, patt[res2].pat[res], PATT_LEN, 0, sum4 );
+                max = sum4[0] / patt[res2].patpow[res] / datapow;
+            }
         }
         else {
-            k = -1;
+            list     = active->id;
+            list_num = active->num;
+            if( list_num > AR_PATT_PREFILTER_MIN ) {
+                list     = cand;
+                list_num = select_candidates( active, input, 3, cand );
+            }
             max = 0.0;
-            for( l = 0; l < pattern_num; l++ ) {
-                k++;
-                while( patf[k] == 0 ) k++;
-                if( patf[k] == 2 ) continue;
+            for( l = 0; l < list_num; l++ ) {
+                k = list[l];
+                correlate4( input, patt[k].pat[0], PATT_LEN, PATT_LEN, sum4 );
                 for( j = 0; j < 4; j++ ) {
-                    sum = 0;
-                    for(i=0;i<AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3;i++) sum += input[i]*pat[k][j][i];
-                    sum2 = sum / patpow[k][j] / datapow;
+                    sum2 = sum4[j] / patt[k].patpow[j] / datapow;
                     if( sum2 > max ) { max = sum2; res = j; res2 = k; }
                 }
             }
         }
     }
     else {
-        for( l = 0; l < pattern_num; l++ ) {
-            k++;
-            while( patf[k] == 0 ) k++;
-            if( patf[k] == 2 ) continue;
+        list     = active->id;
+        list_num = active->num;
+        if( list_num > AR_PATT_PREFILTER_MIN ) {
+            list     = cand;
+            list_num = select_candidates( active, input, 1, cand );
+        }
+        max = 0.0;
+        for( l = 0; l < list_num; l++ ) {
+            k = list[l];
+            correlate4( input, patt[k].patBW[0], PATT_LEN_BW, PATT_LEN_BW, sum4 );
             for( j = 0; j < 4; j++ ) {
-                sum = 0;
-                for(i=0;i<AR_PATT_SIZE_Y*AR_PATT_SIZE_X;i++) sum += input[i]*patBW[k][j][i];
-                sum2 = sum / patpowBW[k][j] / datapow;
+                sum2 = sum4[j] / patt[k].patpowBW[j] / datapow;
                 if( sum2 > max ) { max = sum2; res = j; res2 = k; }
             }
         }
@@ -645,101 +1099,556 @@ static int pattern_match( ARUint8 *data, int *code, int *dir, double *cf )
     return 0;
 }
 
-static void   put_zero( ARUint8 *p, int size )
+// Sum of n bytes.
+static int sum_bytes( ARUint8 *data, int n )
 {
-    while( (size--) > 0 ) *(p++) = 0;
+    int       sum = 0;
+    int       i = 0;
+
+#if defined(AR_MATCH_SSE2)
+    __m128i   zero = _mm_setzero_si128();
+    __m128i   acc  = _mm_setzero_si128();
+
+    for( ; i + 16 <= n; i += 16 ) {
+        acc = _mm_add_epi32( acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)&data[i]), zero) );
+    }
+    sum = _mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#elif defined(AR_MATCH_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+
+    for( ; i + 16 <= n; i += 16 ) {
+        acc = vpadalq_u16( acc, vpaddlq_u8(vld1q_u8(&data[i])) );
+    }
+    sum = vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1)
+        + vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+#endif
+    for( ; i < n; i++ ) sum += data[i];
+
+    return sum;
 }
 
-static void gen_evec(void)
+// Dot products of the n samples of input with four rows of samples,
+// p, p+stride, p+2*stride and p+3*stride, in one pass over input. With
+// stride 0 only sum[0] is meaningful. n must be a multiple of 8.
+// Products of two samples fit in 17 bits, so the sums cannot overflow.
+static void correlate4_c( ARInt16 *input, ARInt16 *p, int n, int stride, int sum[4] )
 {
-    int    i, j, k, ii, jj;
-    ARMat  *input, *wevec;
-    ARVec  *wev;
-    double sum, sum2;
-    int    dim;
+    int       i, x;
+
+    sum[0] = sum[1] = sum[2] = sum[3] = 0;
+    for( i = 0; i < n; i++ ) {
+        x = input[i];
+        sum[0] += x * p[i];
+        if( stride == 0 ) continue;
+        sum[1] += x * p[i+stride];
+        sum[2] += x * p[i+stride*2];
+        sum[3] += x * p[i+stride*3];
+    }
+}
 
-    if( pattern_num < 4 ) {
-        evecf   = 0;
-        evecBWf = 0;
-        return;
+#if defined(AR_MATCH_SSE2)
+// Transpose-add four accumulators into one vector of sums.
+static void correlate4_sum( __m128i a0, __m128i a1, __m128i a2, __m128i a3, int sum[4] )
+{
+    a0 = _mm_add_epi32( _mm_unpacklo_epi32(a0, a1), _mm_unpackhi_epi32(a0, a1) );
+    a2 = _mm_add_epi32( _mm_unpacklo_epi32(a2, a3), _mm_unpackhi_epi32(a2, a3) );
+    a0 = _mm_add_epi32( _mm_unpacklo_epi64(a0, a2), _mm_unpackhi_epi64(a0, a2) );
+    _mm_storeu_si128( (__m128i *)sum, a0 );
+}
+
+static void correlate4_sse2( ARInt16 *input, ARInt16 *p, int n, int stride, int sum[4] )
+{
+    __m128i   x, a0, a1, a2, a3;
+    int       i;
+
+    a0 = a1 = a2 = a3 = _mm_setzero_si128();
+    for( i = 0; i < n; i += 8 ) {
+        x  = _mm_loadu_si128( (const __m128i *)&input[i] );
+        a0 = _mm_add_epi32( a0, _mm_madd_epi16(x, _mm_loadu_si128((const __m128i *)&p[i])) );
+        if( stride == 0 ) continue;
+        a1 = _mm_add_epi32( a1, _mm_madd_epi16(x, _mm_loadu_si128((const __m128i *)&p[i+stride])) );
+        a2 = _mm_add_epi32( a2, _mm_madd_epi16(x, _mm_loadu_si128((const __m128i *)&p[i+stride*2])) );
+        a3 = _mm_add_epi32( a3, _mm_madd_epi16(x, _mm_loadu_si128((const __m128i *)&p[i+stride*3])) );
     }
+    correlate4_sum( a0, a1, a2, a3, sum );
+}
+#endif
 
-#if DEBUG
-    printf("------------------------------------------\n");
+#if defined(AR_MATCH_AVX2)
+// 16 samples at a time, then the 8 left if n is not a multiple of 16.
+AR_CPU_TARGET("avx2")
+static void correlate4_avx2( ARInt16 *input, ARInt16 *p, int n, int stride, int sum[4] )
+{
+    __m256i   x, a0, a1, a2, a3;
+    __m128i   y, b0, b1, b2, b3;
+    int       i;
+
+    a0 = a1 = a2 = a3 = _mm256_setzero_si256();
+    for( i = 0; i + 16 <= n; i += 16 ) {
+        x  = _mm256_loadu_si256( (const __m256i *)&input[i] );
+        a0 = _mm256_add_epi32( a0, _mm256_madd_epi16(x, _mm256_loadu_si256((const __m256i *)&p[i])) );
+        if( stride == 0 ) continue;
+        a1 = _mm256_add_epi32( a1, _mm256_madd_epi16(x, _mm256_loadu_si256((const __m256i *)&p[i+stride])) );
+        a2 = _mm256_add_epi32( a2, _mm256_madd_epi16(x, _mm256_loadu_si256((const __m256i *)&p[i+stride*2])) );
+        a3 = _mm256_add_epi32( a3, _mm256_madd_epi16(x, _mm256_loadu_si256((const __m256i *)&p[i+stride*3])) );
+    }
+    b0 = _mm_add_epi32( _mm256_castsi256_si128(a0), _mm256_extracti128_si256(a0, 1) );
+    b1 = _mm_add_epi32( _mm256_castsi256_si128(a1), _mm256_extracti128_si256(a1, 1) );
+    b2 = _mm_add_epi32( _mm256_castsi256_si128(a2), _mm256_extracti128_si256(a2, 1) );
+    b3 = _mm_add_epi32( _mm256_castsi256_si128(a3), _mm256_extracti128_si256(a3, 1) );
+    if( i < n ) {
+        y  = _mm_loadu_si128( (const __m128i *)&input[i] );
+        b0 = _mm_add_epi32( b0, _mm_madd_epi16(y, _mm_loadu_si128((const __m128i *)&p[i])) );
+        if( stride != 0 ) {
+            b1 = _mm_add_epi32( b1, _mm_madd_epi16(y, _mm_loadu_si128((const __m128i *)&p[i+stride])) );
+            b2 = _mm_add_epi32( b2, _mm_madd_epi16(y, _mm_loadu_si128((const __m128i *)&p[i+stride*2])) );
+            b3 = _mm_add_epi32( b3, _mm_madd_epi16(y, _mm_loadu_si128((const __m128i *)&p[i+stride*3])) );
+        }
+    }
+    correlate4_sum( b0, b1, b2, b3, sum );
+}
+#endif
+
+#if defined(AR_MATCH_NEON)
+static void correlate4_neon( ARInt16 *input, ARInt16 *p, int n, int stride, int sum[4] )
+{
+    int16x8_t x, y;
+    int32x4_t a0, a1, a2, a3;
+    int       i;
+
+    a0 = a1 = a2 = a3 = vdupq_n_s32(0);
+    for( i = 0; i < n; i += 8 ) {
+        x  = vld1q_s16( &input[i] );
+        y  = vld1q_s16( &p[i] );
+        a0 = vmlal_s16( vmlal_s16(a0, vget_low_s16(x), vget_low_s16(y)), vget_high_s16(x), vget_high_s16(y) );
+        if( stride == 0 ) continue;
+        y  = vld1q_s16( &p[i+stride] );
+        a1 = vmlal_s16( vmlal_s16(a1, vget_low_s16(x), vget_low_s16(y)), vget_high_s16(x), vget_high_s16(y) );
+        y  = vld1q_s16( &p[i+stride*2] );
+        a2 = vmlal_s16( vmlal_s16(a2, vget_low_s16(x), vget_low_s16(y)), vget_high_s16(x), vget_high_s16(y) );
+        y  = vld1q_s16( &p[i+stride*3] );
+        a3 = vmlal_s16( vmlal_s16(a3, vget_low_s16(x), vget_low_s16(y)), vget_high_s16(x), vget_high_s16(y) );
+    }
+    sum[0] = vgetq_lane_s32(a0,0) + vgetq_lane_s32(a0,1) + vgetq_lane_s32(a0,2) + vgetq_lane_s32(a0,3);
+    sum[1] = vgetq_lane_s32(a1,0) + vgetq_lane_s32(a1,1) + vgetq_lane_s32(a1,2) + vgetq_lane_s32(a1,3);
+    sum[2] = vgetq_lane_s32(a2,0) + vgetq_lane_s32(a2,1) + vgetq_lane_s32(a2,2) + vgetq_lane_s32(a2,3);
+    sum[3] = vgetq_lane_s32(a3,0) + vgetq_lane_s32(a3,1) + vgetq_lane_s32(a3,2) + vgetq_lane_s32(a3,3);
+}
 #endif
 
-    dim = (pattern_num*4 < AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3)? pattern_num*4: AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3;
-    input  = arMatrixAlloc( pattern_num*4, AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3 );
-    wevec   = arMatrixAlloc( dim, AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3 );
-    wev     = arVecAlloc( dim );
+// Takes the variant of correlate4() for the features, called by arCpuInit()
+// and arCpuSetFeatures(). Returns its name.
+const char *arGetCodeKernel( int features )
+{
+    int       i;
+
+    for( i = 0; correlate4_kernel[i].features & ~features; i++ );
+    correlate4 = correlate4_kernel[i].func;
+
+    return correlate4_kernel[i].name;
+}
+
+static void   put_zero( ARUint8 *p, int size )
+{
+    while( (size--) > 0 ) *(p++) = 0;
+}
+
+// Rebuilds the eigenbasis from all loaded patterns, e.g. after one was freed.
+static void gen_evec(void)
+{
+    int    i;
+
+    evec_num   = 0;
+    evec_total = 0.0;
+    for( i = 0; i < patt_max; i++ ) {
+        if( patt[i].flag != 0 ) update_evec( &patt[i] );
+    }
+    update_epat();
+}
 
-    for( j = jj = 0; jj < AR_PATT_NUM_MAX; jj++ ) {
-        if( patf[jj] == 0 ) continue;
-        for( k = 0; k < 4; k++ ) {
-            for( i = 0; i < AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3; i++ ) {
-                input->m[(j*4+k)*AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3+i] = pat[j][k][i] / patpow[j][k];
+// Adds the four rotations of pe to the eigenbasis: their components outside
+// the current basis are orthonormalised onto it, and the second moment matrix
+// restricted to the extended basis is diagonalised again. Only the
+// EVEC_KEEP strongest eigenvectors are kept, so the cost of an update does
+// not grow with the number of patterns.
+static void update_evec( PattEntry *pe )
+{
+    static double x[4][PATT_LEN];
+    static double q[4][PATT_LEN];
+    static float  wevec[EVEC_KEEP][PATT_LEN];
+    ARMat  *y, *v;
+    ARVec  *ev;
+    double c[4][EVEC_KEEP+4];
+    double sum, trace;
+    int    h, i, k, m, n, qn;
+
+    for( h = 0; h < 4; h++ ) {
+        for( i = 0; i < PATT_LEN; i++ ) x[h][i] = pe->pat[h][i] / pe->patpow[h];
+    }
+    evec_total += 4.0;
+
+    // Coordinates on the current basis and Gram-Schmidt of the residuals.
+    qn = 0;
+    for( h = 0; h < 4; h++ ) {
+        for( k = 0; k < evec_num; k++ ) {
+            sum = 0.0;
+            for( i = 0; i < PATT_LEN; i++ ) sum += evec[k][i] * x[h][i];
+            c[h][k] = sum;
+        }
+        for( i = 0; i < PATT_LEN; i++ ) q[qn][i] = x[h][i];
+        for( k = 0; k < evec_num; k++ ) {
+            for( i = 0; i < PATT_LEN; i++ ) q[qn][i] -= c[h][k] * evec[k][i];
+        }
+        for( m = 0; m < qn; m++ ) {
+            sum = 0.0;
+            for( i = 0; i < PATT_LEN; i++ ) sum += q[m][i] * q[qn][i];
+            for( i = 0; i < PATT_LEN; i++ ) q[qn][i] -= sum * q[m][i];
+        }
+        sum = 0.0;
+        for( i = 0; i < PATT_LEN; i++ ) sum += q[qn][i] * q[qn][i];
+        if( sum < EVEC_RESIDUAL*EVEC_RESIDUAL ) continue;
+        sum = 1.0 / sqrt(sum);
+        for( i = 0; i < PATT_LEN; i++ ) q[qn][i] *= sum;
+        qn++;
+    }
+    for( h = 0; h < 4; h++ ) {
+        for( m = 0; m < qn; m++ ) {
+            sum = 0.0;
+            for( i = 0; i < PATT_LEN; i++ ) sum += q[m][i] * x[h][i];
+            c[h][evec_num+m] = sum;
+        }
+    }
+    n = evec_num + qn;
+
+    // Y^T Y is diag(ev) plus the moments of the new samples, on the
+    // extended basis, so the PCA of Y gives the updated eigenvectors.
+    if( n >= 2 ) {
+        y  = arMatrixAlloc( evec_num+4, n );
+        v  = arMatrixAlloc( n, n );
+        ev = arVecAlloc( n );
+        for( i = 0; i < (evec_num+4)*n; i++ ) y->m[i] = 0.0;
+        trace = 0.0;
+        for( k = 0; k < evec_num; k++ ) {
+            y->m[k*n+k] = sqrt(evec_ev[k]);
+            trace += evec_ev[k];
+        }
+        for( h = 0; h < 4; h++ ) {
+            for( k = 0; k < n; k++ ) {
+                y->m[(evec_num+h)*n+k] = c[h][k];
+                trace += c[h][k] * c[h][k];
             }
         }
-        j++;
+        if( arMatrixPCA2( y, v, ev ) < 0 ) {
+            arMatrixFree( y );
+            arMatrixFree( v );
+            arVecFree( ev );
+            return;
+        }
+        if( n > EVEC_KEEP ) n = EVEC_KEEP;
+        for( m = 0; m < n; m++ ) {
+            if( ev->v[m] <= 0.0 ) break;
+            for( i = 0; i < PATT_LEN; i++ ) {
+                sum = 0.0;
+                for( k = 0; k < evec_num; k++ ) sum += v->m[m*v->clm+k] * evec[k][i];
+                for( k = 0; k < qn; k++ )       sum += v->m[m*v->clm+evec_num+k] * q[k][i];
+                wevec[m][i] = (float)sum;
+            }
+            evec_ev[m] = ev->v[m] * trace;
+        }
+        n = m;
+        for( m = 0; m < n; m++ ) {
+            for( i = 0; i < PATT_LEN; i++ ) evec[m][i] = wevec[m][i];
+        }
+        evec_num = n;
+        arMatrixFree( y );
+        arMatrixFree( v );
+        arVecFree( ev );
     }
-
-    if( arMatrixPCA2(input, wevec, wev) < 0 ) {
-        arMatrixFree( input );
-        arMatrixFree( wevec );
-        arVecFree( wev );
-        evecf   = 0;
-        evecBWf = 0;
-        return;
+    else if( n == 1 ) {
+        // The only sample direction so far.
+        if( evec_num == 0 ) {
+            for( i = 0; i < PATT_LEN; i++ ) evec[0][i] = (float)q[0][i];
+        }
+        sum = 0.0;
+        for( h = 0; h < 4; h++ ) sum += c[h][0] * c[h][0];
+        evec_ev[0] = (evec_num == 0)? sum: evec_ev[0] + sum;
+        evec_num = 1;
     }
+}
 
+// Chooses evec_dim and recomputes the projections of all patterns.
+static void update_epat(void)
+{
+    double sum;
+    int    i, j, h, k;
+
+    // As many eigenvectors as hold 90% of the energy, at most EVEC_MAX.
     sum = 0.0;
-    for( i = 0; i < dim; i++ ) {
-        sum += wev->v[i];
+    for( i = 0; i < evec_num; i++ ) {
+        sum += evec_ev[i];
 #if DEBUG
-        printf("%2d(%10.7f): \n", i+1, sum);
+        printf("%2d(%10.7f): \n", i+1, sum/evec_total);
 #endif
-        if( sum > 0.90 ) break;
+        if( sum > 0.90*evec_total ) break;
         if( i == EVEC_MAX-1 ) break;
     }
-    evec_dim = i+1;
+    evec_dim = (i < evec_num)? i+1: evec_num;
 
-    for( j = 0; j < evec_dim; j++ ) {
-        for( i = 0; i < AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3; i++ ) {
-            evec[j][i] = wevec->m[j*AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3+i];
+    for( j = 0; j < patt_max; j++ ) {
+        if( patt[j].flag == 0 ) continue;
+        for( h = 0; h < 4; h++ ) {
+            project_evec( patt[j].pat[h], patt[j].epat[h] );
+            for( k = 0; k < evec_dim; k++ ) patt[j].epat[h][k] /= (float)patt[j].patpow[h];
         }
     }
-    
-    for( i = 0; i < AR_PATT_NUM_MAX; i++ ) {
-        if(patf[i] == 0) continue;
-        for( j = 0; j < 4; j++ ) {
-#if DEBUG
-            printf("%2d[%d]: ", i+1, j+1);
+
+    evecf   = (pattern_num >= 4 && evec_num > 0);
+    evecBWf = 0;
+}
+
+// Projections of a sample on the leading evec_dim eigenvectors.
+static void project_evec( ARInt16 *sample, float vec[EVEC_MAX] )
+{
+    int       i, k;
+
+#if defined(AR_MATCH_SSE2)
+    __m128i   s, sign;
+    __m128    a0, a1;
+    float     t[4];
+
+    for( k = 0; k < evec_dim; k++ ) {
+        a0 = a1 = _mm_setzero_ps();
+        for( i = 0; i < PATT_LEN; i += 8 ) {
+            s    = _mm_loadu_si128( (const __m128i *)&sample[i] );
+            sign = _mm_srai_epi16( s, 15 );
+            a0 = _mm_add_ps( a0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(s, sign)), _mm_loadu_ps(&evec[k][i])) );
+            a1 = _mm_add_ps( a1, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(s, sign)), _mm_loadu_ps(&evec[k][i+4])) );
+        }
+        _mm_storeu_ps( t, _mm_add_ps(a0, a1) );
+        vec[k] = (t[0] + t[1]) + (t[2] + t[3]);
+    }
+#elif defined(AR_MATCH_NEON)
+    int16x8_t   s;
+    float32x4_t a0, a1;
+
+    for( k = 0; k < evec_dim; k++ ) {
+        a0 = a1 = vdupq_n_f32(0.0f);
+        for( i = 0; i < PATT_LEN; i += 8 ) {
+            s  = vld1q_s16( &sample[i] );
+            a0 = vmlaq_f32( a0, vcvtq_f32_s32(vmovl_s16(vget_low_s16(s))),  vld1q_f32(&evec[k][i]) );
+            a1 = vmlaq_f32( a1, vcvtq_f32_s32(vmovl_s16(vget_high_s16(s))), vld1q_f32(&evec[k][i+4]) );
+        }
+        a0 = vaddq_f32( a0, a1 );
+        vec[k] = (vgetq_lane_f32(a0,0) + vgetq_lane_f32(a0,1)) + (vgetq_lane_f32(a0,2) + vgetq_lane_f32(a0,3));
+    }
+#else
+    float     sum;
+
+    for( k = 0; k < evec_dim; k++ ) {
+        sum = 0.0f;
+        for( i = 0; i < PATT_LEN; i++ ) sum += evec[k][i] * sample[i];
+        vec[k] = sum;
+    }
 #endif
-            sum2 = 0.0;
-            for( k = 0; k < evec_dim; k++ ) {
-                sum = 0.0;
-                for(ii=0;ii<AR_PATT_SIZE_Y*AR_PATT_SIZE_X*3;ii++) {
-                    sum += evec[k][ii] * pat[i][j][ii] / patpow[i][j];
-                }
-#if DEBUG
-                printf("%10.7f ", sum);
+}
+
+// A free entry of the table, grown if there is none.
+static int alloc_entry(void)
+{
+    PattEntry  *p;
+    int        i, n;
+
+    for( i = 0; i < patt_max; i++ ) {
+        if(patt[i].flag == 0) return i;
+    }
+
+    n = (patt_max > 0)? patt_max*2: AR_PATT_NUM_MAX;
+    if( patt_map != NULL ) {
+        // Still the mapped bundle: move the table to the heap.
+        p = (PattEntry *)arMemAlloc( AR_MEM_AR, n*sizeof(PattEntry) );
+        if( p == NULL ) {printf("malloc error!!\n"); exit(1);}
+        memcpy( p, patt, patt_max*sizeof(PattEntry) );
+        unmap_file( patt_map, patt_map_size );
+        arMemAdd( AR_MEM_AR, -(long)patt_map_size );
+        patt_map = NULL;
+        patt = p;
+    }
+    else {
+        patt = (PattEntry *)arMemRealloc( AR_MEM_AR, patt, n*sizeof(PattEntry) );
+    }
+    if( patt == NULL ) {printf("malloc error!!\n"); exit(1);}
+    grow_active( n );
+    for( i = patt_max; i < n; i++ ) patt[i].flag = 0;
+    i = patt_max;
+    patt_max = n;
+
+    return i;
+}
+
+static int check_bundle( BundleHeader *head, size_t size )
+{
+    if( size < sizeof(BundleHeader) )                        return -1;
+    if( memcmp(head->magic, BUNDLE_MAGIC, 4) != 0 )          return -1;
+    if( head->endian != BUNDLE_ENDIAN ) {
+        printf("The bundle was written with the other byte order, run the converter on this machine.\n");
+        return -1;
+    }
+    if( head->version != BUNDLE_VERSION )                    return -1;
+    if( head->param_size != (int)sizeof(ARParam)
+     || head->patt_size  != (int)sizeof(PattEntry)
+     || head->patt_size_x != AR_PATT_SIZE_X || head->patt_size_y != AR_PATT_SIZE_Y
+     || head->evec_max != EVEC_MAX || head->key_dim != KEY_DIM ) return -1;
+    if( head->param_num < 0 || head->patt_num < 0
+     || head->evec_num < 0 || head->evec_num > EVEC_KEEP
+     || head->evec_dim < 0 || head->evec_dim > head->evec_num ) return -1;
+    if( head->param_offset % BUNDLE_ALIGN || head->patt_offset % BUNDLE_ALIGN
+     || head->evec_offset % BUNDLE_ALIGN || head->ev_offset % BUNDLE_ALIGN ) return -1;
+    if( (size_t)head->size > size
+     || head->param_offset + head->param_num*(int)sizeof(ARParam) > head->patt_offset
+     || head->patt_offset + head->patt_num*(int)sizeof(PattEntry) > head->evec_offset
+     || head->evec_offset + head->evec_num*PATT_LEN*(int)sizeof(float) > head->ev_offset
+     || head->ev_offset + head->evec_num*(int)sizeof(double) > head->size ) return -1;
+
+    return 0;
+}
+
+static int write_pad( FILE *fp, int *pos, int offset )
+{
+    for( ; *pos < offset; (*pos)++ ) {
+        if( fputc(0, fp) == EOF ) return -1;
+    }
+
+    return 0;
+}
+
+// The whole file, mapped copy-on-write: the records can be updated
+// (flag, epat) without touching the file.
+static void *map_file( const char *filename, size_t *size )
+{
+#ifdef _WIN32
+    HANDLE   file, map;
+    void     *base;
+
+    file = CreateFileA( filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                        FILE_ATTRIBUTE_NORMAL, NULL );
+    if( file == INVALID_HANDLE_VALUE ) return NULL;
+    *size = GetFileSize( file, NULL );
+    map = CreateFileMappingA( file, NULL, PAGE_WRITECOPY, 0, 0, NULL );
+    CloseHandle( file );
+    if( map == NULL ) return NULL;
+    base = MapViewOfFile( map, FILE_MAP_COPY, 0, 0, 0 );
+    CloseHandle( map );
+
+    return base;
+#else
+    struct stat  st;
+    void         *base;
+    int          fd;
+
+    if( (fd = open(filename, O_RDONLY)) < 0 ) return NULL;
+    if( fstat(fd, &st) < 0 || st.st_size == 0 ) {
+        close( fd );
+        return NULL;
+    }
+    *size = st.st_size;
+    base = mmap( NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0 );
+    close( fd );
+
+    return (base == MAP_FAILED)? NULL: base;
 #endif
-                epat[i][j][k] = sum;
-                sum2 += sum*sum;
-            }
-#if DEBUG
-            printf(":: %10.7f\n", sqrt(sum2));
+}
+
+static void unmap_file( void *base, size_t size )
+{
+#ifdef _WIN32
+    UnmapViewOfFile( base );
+#else
+    munmap( base, size );
 #endif
-        }
+}
+
+static void update_active(void)
+{
+    PattActive  *next;
+    int         i;
+
+    next = (patt_active == &patt_active_buf[0])? &patt_active_buf[1]: &patt_active_buf[0];
+    next->num = 0;
+    for( i = 0; i < patt_max; i++ ) {
+        if( patt[i].flag == 1 ) next->id[next->num++] = i;
     }
+    patt_active = next;
+    patt_serial++;
+}
 
-    arMatrixFree( input );
-    arMatrixFree( wevec );
-    arVecFree( wev );
+// Room in both lists for n patterns.
+static void grow_active( int n )
+{
+    int     i;
 
-    evecf   = 1;
-    evecBWf = 0;
+    for( i = 0; i < 2; i++ ) {
+        patt_active_buf[i].id = (int *)arMemRealloc( AR_MEM_AR, patt_active_buf[i].id, n*sizeof(int) );
+        if( patt_active_buf[i].id == NULL ) {printf("malloc error!!\n"); exit(1);}
+    }
+}
 
-    return;
+// Sums of a sample over KEY_BLOCK x KEY_BLOCK pixels, scaled to unit length.
+// chans is 3 for a colour sample, 1 for a black and white one.
+static void make_key( ARInt16 *sample, int chans, double key[KEY_DIM] )
+{
+    double  len;
+    int     i, j, k;
+
+    for( k = 0; k < KEY_DIM; k++ ) key[k] = 0.0;
+    for( j = 0; j < AR_PATT_SIZE_Y; j++ ) {
+        for( i = 0; i < AR_PATT_SIZE_X*chans; i++ ) {
+            key[(j/KEY_BLOCK)*(AR_PATT_SIZE_X/KEY_BLOCK) + i/(KEY_BLOCK*chans)]
+                += sample[j*AR_PATT_SIZE_X*chans + i];
+        }
+    }
+    len = 0.0;
+    for( k = 0; k < KEY_DIM; k++ ) len += key[k]*key[k];
+    if( len == 0.0 ) return;
+    len = 1.0 / sqrt(len);
+    for( k = 0; k < KEY_DIM; k++ ) key[k] *= len;
 }
 
+// The active patterns whose keys correlate best with the key of input, in
+// any rotation: at most AR_PATT_CANDIDATE_NUM of them, in table order so
+// that ties resolve as in a full scan. Returns their number.
+static int select_candidates( PattActive *active, ARInt16 *input, int chans, int cand[AR_PATT_CANDIDATE_NUM] )
+{
+    double  key[KEY_DIM];
+    double  score[AR_PATT_CANDIDATE_NUM];
+    double  d, best;
+    int     num, i, j, k, l;
+
+    make_key( input, chans, key );
+
+    num = 0;
+    for( l = 0; l < active->num; l++ ) {
+        k = active->id[l];
+        best = -2.0;
+        for( j = 0; j < 4; j++ ) {
+            d = 0.0;
+            for( i = 0; i < KEY_DIM; i++ ) d += key[i] * patt[k].key[j][i];
+            if( d > best ) best = d;
+        }
+        if( num == AR_PATT_CANDIDATE_NUM && best <= score[num-1] ) continue;
+        if( num < AR_PATT_CANDIDATE_NUM ) num++;
+        for( i = num-1; i > 0 && score[i-1] < best; i-- ) {
+            score[i] = score[i-1];
+            cand[i]  = cand[i-1];
+        }
+        score[i] = best;
+        cand[i]  = k;
+    }
+
+    for( i = 1; i < num; i++ ) {
+        k = cand[i];
+        for( j = i; j > 0 && cand[j-1] > k; j-- ) cand[j] = cand[j-1];
+        cand[j] = k;
+    }
+
+    return num;
+}
@@ -11,72 +11,157 @@
 
 #include <AR/ar.h>
 
-static ARMarkerInfo    marker_infoL[AR_SQUARE_MAX];
-static ARMarkerInfo    marker_infoR[AR_SQUARE_MAX];
+static int  find_cached( ARHandle *handle, ARMarkerInfo *info, int used[] );
+static int  cached_dir( ARMarkerInfo *cached, ARMarkerInfo *info );
+static void update_cache( ARHandle *handle, ARMarkerInfo *info, int age[], int marker_num );
 
 ARMarkerInfo *arGetMarkerInfo( ARUint8 *image,
                                ARMarkerInfo2 *marker_info2, int *marker_num )
 {
-    int            id, dir;
-    double         cf;
-    int            i, j;
-
-    for (i = j = 0; i < *marker_num; i++) {
-        marker_infoL[j].area   = marker_info2[i].area;
-        marker_infoL[j].pos[0] = marker_info2[i].pos[0];
-        marker_infoL[j].pos[1] = marker_info2[i].pos[1];
-
-        if (arGetLine(marker_info2[i].x_coord, marker_info2[i].y_coord,
-                      marker_info2[i].coord_num, marker_info2[i].vertex,
-                      marker_infoL[j].line, marker_infoL[j].vertex) < 0 ) continue;
-
-        arGetCode(image,
-                  marker_info2[i].x_coord, marker_info2[i].y_coord,
-                  marker_info2[i].vertex, &id, &dir, &cf );
-
-        marker_infoL[j].id  = id;
-        marker_infoL[j].dir = dir;
-        marker_infoL[j].cf  = cf;
-
-        j++;
-    }
-    *marker_num = j;
-
-    return (marker_infoL);
+    return arGetMarkerInfoCtx( arGetDefaultHandle(), image, marker_info2, marker_num );
 }
 
 ARMarkerInfo *arsGetMarkerInfo( ARUint8 *image,
                                 ARMarkerInfo2 *marker_info2, int *marker_num, int LorR )
 {
-    ARMarkerInfo   *info;
-    int            id, dir;
-    double         cf;
-    int            i, j;
-
-    if (LorR) info = &marker_infoL[0];
-	else      info = &marker_infoR[0];
+    return arGetMarkerInfoCtx( arsGetDefaultHandle(LorR), image, marker_info2, marker_num );
+}
 
+ARMarkerInfo *arGetMarkerInfoCtx( ARHandle *handle, ARUint8 *image,
+                                  ARMarkerInfo2 *marker_info2, int *marker_num )
+{
+    ARMarkerInfo   *info;
+    int            id[AR_SQUARE_MAX], dir[AR_SQUARE_MAX];
+    double         cf[AR_SQUARE_MAX];
+    int            used[AR_SQUARE_MAX], age[AR_SQUARE_MAX];
+    int            batch[AR_SQUARE_MAX], batch_num;
+    int            i, j, k;
+    double         t = 0.0;
+
+    info = handle->marker_info;
+    for( k = 0; k < handle->code_cache_num; k++ ) used[k] = 0;
+
+    // The patterns are extracted square by square, then matched at once.
+    batch_num = 0;
     for (i = j = 0; i < *marker_num; i++) {
         info[j].area   = marker_info2[i].area;
         info[j].pos[0] = marker_info2[i].pos[0];
         info[j].pos[1] = marker_info2[i].pos[1];
 
-        if (arsGetLine(marker_info2[i].x_coord, marker_info2[i].y_coord,
-                       marker_info2[i].coord_num, marker_info2[i].vertex,
-                       info[j].line, info[j].vertex, LorR) < 0 ) continue;
-
-        arGetCode(image,
-                  marker_info2[i].x_coord, marker_info2[i].y_coord,
-                  marker_info2[i].vertex, &id, &dir, &cf );
-
-        info[j].id  = id;
-        info[j].dir = dir;
-        info[j].cf  = cf;
+        AR_STATS_START( handle, t );
+        if (arGetLineCtx(handle, marker_info2[i].x_coord, marker_info2[i].y_coord,
+                         marker_info2[i].coord_num, marker_info2[i].vertex,
+                         info[j].line, info[j].vertex) < 0 ) {
+            AR_STATS_STAGE( handle, line, t );
+            continue;
+        }
+        if( handle->edgeRefineMode == AR_EDGE_REFINE_SUBPIXEL
+         || (handle->imageProcMode == AR_IMAGE_PROC_IN_HALF_REFINED
+          && handle->pyramidMode == AR_PYRAMID_OFF) ) {
+            arRefineLineCtx( handle, image, info[j].line, info[j].vertex );
+        }
+        AR_STATS_STAGE( handle, line, t );
+        if( handle->statsMode == AR_STATS_ON ) handle->stats.line_num++;
+
+        if( handle->codeCacheMode == AR_CODE_CACHE_ON
+         && (k = find_cached( handle, &info[j], used )) >= 0 ) {
+            info[j].id  = handle->code_cache[k].id;
+            info[j].dir = cached_dir( &handle->code_cache[k], &info[j] );
+            info[j].cf  = handle->code_cache[k].cf;
+            age[j] = handle->code_cache_age[k] + 1;
+            j++;
+            continue;
+        }
+
+        AR_STATS_START( handle, t );
+        arGetPattCtx(handle, image,
+                     marker_info2[i].x_coord, marker_info2[i].y_coord,
+                     marker_info2[i].vertex, handle->patt_batch[batch_num] );
+        AR_STATS_STAGE( handle, pattern, t );
+        batch[batch_num++] = j;
+        age[j] = 0;
 
         j++;
     }
-    *marker_num = j;
+    arGetCodeBatchCtx( handle, handle->patt_batch, batch_num, id, dir, cf );
+    for( k = 0; k < batch_num; k++ ) {
+        info[batch[k]].id  = id[k];
+        info[batch[k]].dir = dir[k];
+        info[batch[k]].cf  = cf[k];
+    }
+    *marker_num = handle->marker_num = j;
+    update_cache( handle, info, age, j );
 
     return (info);
 }
 
+// The unused entry of the cache closest to the square, within
+// AR_CODE_CACHE_DIST of its area in squared distance and with about the
+// same area, or -1. Entries reused AR_CODE_CACHE_VERIFY_INTERVAL times
+// are not taken, so that the square is matched again.
+static int find_cached( ARHandle *handle, ARMarkerInfo *info, int used[] )
+{
+    ARMarkerInfo  *c;
+    double        rarea, rlen, rlenmin;
+    int           k, kmin;
+
+    rlenmin = AR_CODE_CACHE_DIST;
+    kmin = -1;
+    for( k = 0; k < handle->code_cache_num; k++ ) {
+        if( used[k] || handle->code_cache_age[k] >= AR_CODE_CACHE_VERIFY_INTERVAL ) continue;
+        c = &handle->code_cache[k];
+        rarea = (double)c->area / (double)info->area;
+        if( rarea < 0.7 || rarea > 1.43 ) continue;
+        rlen = ( (info->pos[0] - c->pos[0]) * (info->pos[0] - c->pos[0])
+               + (info->pos[1] - c->pos[1]) * (info->pos[1] - c->pos[1]) ) / info->area;
+        if( rlen < rlenmin ) {
+            rlenmin = rlen;
+            kmin = k;
+        }
+    }
+    if( kmin >= 0 ) used[kmin] = 1;
+
+    return kmin;
+}
+
+// Direction of the square, from the rotation of its vertices that best
+// matches those of the cached marker.
+static int cached_dir( ARMarkerInfo *cached, ARMarkerInfo *info )
+{
+    double    diff, diffmin;
+    int       cdir, j, k;
+
+    diffmin = 10000.0 * 10000.0;
+    cdir = cached->dir;
+    for( j = 0; j < 4; j++ ) {
+        diff = 0;
+        for( k = 0; k < 4; k++ ) {
+            diff += (cached->vertex[k][0] - info->vertex[(j+k)%4][0])
+                  * (cached->vertex[k][0] - info->vertex[(j+k)%4][0])
+                  + (cached->vertex[k][1] - info->vertex[(j+k)%4][1])
+                  * (cached->vertex[k][1] - info->vertex[(j+k)%4][1]);
+        }
+        if( diff < diffmin ) {
+            diffmin = diff;
+            cdir = (cached->dir - j + 4) % 4;
+        }
+    }
+
+    return cdir;
+}
+
+static void update_cache( ARHandle *handle, ARMarkerInfo *info, int age[], int marker_num )
+{
+    int     i, n;
+
+    n = 0;
+    if( handle->codeCacheMode == AR_CODE_CACHE_ON ) {
+        for( i = 0; i < marker_num; i++ ) {
+            if( info[i].id < 0 || info[i].cf < AR_CODE_CACHE_CF ) continue;
+            handle->code_cache[n]     = info[i];
+            handle->code_cache_age[n] = age[i];
+            n++;
+        }
+    }
+    handle->code_cache_num = n;
+}
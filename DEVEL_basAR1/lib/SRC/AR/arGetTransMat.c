@@ -16,13 +16,22 @@
 
 #define P_MAX       500
 
-static double  pos2d[P_MAX][2];
-static double  pos3d[P_MAX][3];
-
 static double arGetTransMatSub( double rot[3][3], double ppos2d[][2],
                                 double pos3d[][3], int num, double conv[3][4],
                                 double *dist_factor, double cpara[3][4] );
 
+static void get_trans( double rot[3][3], double pos2d[][2], double pos3d[][3],
+                       int num, double cpara[3][4], double trans[3] );
+
+static double refine_pose( double rot[3][3], double trans[3], double cpara[3][4],
+                           double pos3d[][3], double pos2d[][2], int num );
+
+static double pose_error( double rot[3][3], double trans[3], double cpara[3][4],
+                          double pos3d[][3], double pos2d[][2], int num,
+                          double jtj[6][6], double jtr[6] );
+
+static int solve6( double a[6][6], double b[6], double x[6] );
+
 double arGetTransMat( ARMarkerInfo *marker_info,
                       double center[2], double width, double conv[3][4] )
 {
@@ -72,10 +81,12 @@ double arGetTransMat3( double rot[3][3], double ppos2d[][2],
                        double ppos3d[][2], int num, double conv[3][4],
                        double *dist_factor, double cpara[3][4] )
 {
+    double  pos3d[P_MAX][3];
     double  off[3], pmax[3], pmin[3];
     double  ret;
     int     i;
 
+    if( num > P_MAX ) return -1;
     pmax[0]=pmax[1]=pmax[2] = -10000000000.0;
     pmin[0]=pmin[1]=pmin[2] =  10000000000.0;
     for( i = 0; i < num; i++ ) {
@@ -121,10 +132,12 @@ double arGetTransMat5( double rot[3][3], double ppos2d[][2],
                        double ppos3d[][3], int num, double conv[3][4],
                        double *dist_factor, double cpara[3][4] )
 {
+    double  pos3d[P_MAX][3];
     double  off[3], pmax[3], pmin[3];
     double  ret;
     int     i;
 
+    if( num > P_MAX ) return -1;
     pmax[0]=pmax[1]=pmax[2] = -10000000000.0;
     pmin[0]=pmin[1]=pmin[2] =  10000000000.0;
     for( i = 0; i < num; i++ ) {
@@ -158,19 +171,12 @@ static double arGetTransMatSub( double rot[3][3], double ppos2d[][2],
                                 double pos3d[][3], int num, double conv[3][4],
                                 double *dist_factor, double cpara[3][4] )
 {
-    ARMat   *mat_a, *mat_b, *mat_c, *mat_d, *mat_e, *mat_f;
+    double  pos2d[P_MAX][2];
     double  trans[3];
-    double  wx, wy, wz;
+    double  wa, wb, wc;
     double  ret;
     int     i, j;
 
-    mat_a = arMatrixAlloc( num*2, 3 );
-    mat_b = arMatrixAlloc( 3, num*2 );
-    mat_c = arMatrixAlloc( num*2, 1 );
-    mat_d = arMatrixAlloc( 3, 3 );
-    mat_e = arMatrixAlloc( 3, 1 );
-    mat_f = arMatrixAlloc( 3, 1 );
-
     if( arFittingMode == AR_FITTING_TO_INPUT ) {
         for( i = 0; i < num; i++ ) {
             arParamIdeal2Observ(dist_factor, ppos2d[i][0], ppos2d[i][1],
@@ -184,74 +190,19 @@ static double arGetTransMatSub( double rot[3][3], double ppos2d[][2],
         }
     }
 
-    for( j = 0; j < num; j++ ) {
-        wx = rot[0][0] * pos3d[j][0]
-           + rot[0][1] * pos3d[j][1]
-           + rot[0][2] * pos3d[j][2];
-        wy = rot[1][0] * pos3d[j][0]
-           + rot[1][1] * pos3d[j][1]
-           + rot[1][2] * pos3d[j][2];
-        wz = rot[2][0] * pos3d[j][0]
-           + rot[2][1] * pos3d[j][1]
-           + rot[2][2] * pos3d[j][2];
-        mat_a->m[j*6+0] = mat_b->m[num*0+j*2] = cpara[0][0];
-        mat_a->m[j*6+1] = mat_b->m[num*2+j*2] = cpara[0][1];
-        mat_a->m[j*6+2] = mat_b->m[num*4+j*2] = cpara[0][2] - pos2d[j][0];
-        mat_c->m[j*2+0] = wz * pos2d[j][0]
-               - cpara[0][0]*wx - cpara[0][1]*wy - cpara[0][2]*wz;
-        mat_a->m[j*6+3] = mat_b->m[num*0+j*2+1] = 0.0;
-        mat_a->m[j*6+4] = mat_b->m[num*2+j*2+1] = cpara[1][1];
-        mat_a->m[j*6+5] = mat_b->m[num*4+j*2+1] = cpara[1][2] - pos2d[j][1];
-        mat_c->m[j*2+1] = wz * pos2d[j][1]
-               - cpara[1][1]*wy - cpara[1][2]*wz;
+    if( arPoseRefineMode == AR_POSE_REFINE_GAUSS_NEWTON ) {
+        arGetAngle( rot, &wa, &wb, &wc );
+        arGetRot( wa, wb, wc, rot );
+        get_trans( rot, pos2d, pos3d, num, cpara, trans );
+        ret = refine_pose( rot, trans, cpara, pos3d, pos2d, num );
     }
-    arMatrixMul( mat_d, mat_b, mat_a );
-    arMatrixMul( mat_e, mat_b, mat_c );
-    arMatrixSelfInv( mat_d );
-    arMatrixMul( mat_f, mat_d, mat_e );
-    trans[0] = mat_f->m[0];
-    trans[1] = mat_f->m[1];
-    trans[2] = mat_f->m[2];
-
-    ret = arModifyMatrix( rot, trans, cpara, pos3d, pos2d, num );
-
-    for( j = 0; j < num; j++ ) {
-        wx = rot[0][0] * pos3d[j][0]
-           + rot[0][1] * pos3d[j][1]
-           + rot[0][2] * pos3d[j][2];
-        wy = rot[1][0] * pos3d[j][0]
-           + rot[1][1] * pos3d[j][1]
-           + rot[1][2] * pos3d[j][2];
-        wz = rot[2][0] * pos3d[j][0]
-           + rot[2][1] * pos3d[j][1]
-           + rot[2][2] * pos3d[j][2];
-        mat_a->m[j*6+0] = mat_b->m[num*0+j*2] = cpara[0][0];
-        mat_a->m[j*6+1] = mat_b->m[num*2+j*2] = cpara[0][1];
-        mat_a->m[j*6+2] = mat_b->m[num*4+j*2] = cpara[0][2] - pos2d[j][0];
-        mat_c->m[j*2+0] = wz * pos2d[j][0]
-               - cpara[0][0]*wx - cpara[0][1]*wy - cpara[0][2]*wz;
-        mat_a->m[j*6+3] = mat_b->m[num*0+j*2+1] = 0.0;
-        mat_a->m[j*6+4] = mat_b->m[num*2+j*2+1] = cpara[1][1];
-        mat_a->m[j*6+5] = mat_b->m[num*4+j*2+1] = cpara[1][2] - pos2d[j][1];
-        mat_c->m[j*2+1] = wz * pos2d[j][1]
-               - cpara[1][1]*wy - cpara[1][2]*wz;
+    else {
+        get_trans( rot, pos2d, pos3d, num, cpara, trans );
+        ret = arModifyMatrix( rot, trans, cpara, pos3d, pos2d, num );
+
+        get_trans( rot, pos2d, pos3d, num, cpara, trans );
+        ret = arModifyMatrix( rot, trans, cpara, pos3d, pos2d, num );
     }
-    arMatrixMul( mat_d, mat_b, mat_a );
-    arMatrixMul( mat_e, mat_b, mat_c );
-    arMatrixSelfInv( mat_d );
-    arMatrixMul( mat_f, mat_d, mat_e );
-    trans[0] = mat_f->m[0];
-    trans[1] = mat_f->m[1];
-    trans[2] = mat_f->m[2];
-
-    ret = arModifyMatrix( rot, trans, cpara, pos3d, pos2d, num );
-
-    arMatrixFree( mat_a );
-    arMatrixFree( mat_b );
-    arMatrixFree( mat_c );
-    arMatrixFree( mat_d );
-    arMatrixFree( mat_e );
-    arMatrixFree( mat_f );
 
     for( j = 0; j < 3; j++ ) {
         for( i = 0; i < 3; i++ ) conv[j][i] = rot[j][i];
@@ -260,3 +211,207 @@ static double arGetTransMatSub( double rot[3][3], double ppos2d[][2],
 
     return ret;
 }
+
+/* Least squares translation for rot: the 3x3 normal equations of the
+   2*num projection equations are summed directly. */
+static void get_trans( double rot[3][3], double pos2d[][2], double pos3d[][3],
+                       int num, double cpara[3][4], double trans[3] )
+{
+    double  d[3][3], e[3];
+    double  a0[3], a1[3], c0, c1;
+    double  wx, wy, wz;
+    int     i, j, k;
+
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 3; i++ ) d[j][i] = 0.0;
+        e[j] = 0.0;
+    }
+    for( k = 0; k < num; k++ ) {
+        wx = rot[0][0] * pos3d[k][0]
+           + rot[0][1] * pos3d[k][1]
+           + rot[0][2] * pos3d[k][2];
+        wy = rot[1][0] * pos3d[k][0]
+           + rot[1][1] * pos3d[k][1]
+           + rot[1][2] * pos3d[k][2];
+        wz = rot[2][0] * pos3d[k][0]
+           + rot[2][1] * pos3d[k][1]
+           + rot[2][2] * pos3d[k][2];
+        a0[0] = cpara[0][0];
+        a0[1] = cpara[0][1];
+        a0[2] = cpara[0][2] - pos2d[k][0];
+        c0 = wz * pos2d[k][0]
+           - cpara[0][0]*wx - cpara[0][1]*wy - cpara[0][2]*wz;
+        a1[0] = 0.0;
+        a1[1] = cpara[1][1];
+        a1[2] = cpara[1][2] - pos2d[k][1];
+        c1 = wz * pos2d[k][1]
+           - cpara[1][1]*wy - cpara[1][2]*wz;
+        for( j = 0; j < 3; j++ ) {
+            for( i = 0; i < 3; i++ ) d[j][i] += a0[j]*a0[i] + a1[j]*a1[i];
+            e[j] += a0[j]*c0 + a1[j]*c1;
+        }
+    }
+    arMat3Inv( d, d );
+    arMat3MulVec( d, e, trans );
+}
+
+/* Levenberg-Marquardt on the reprojection error, over a rotation
+   increment w (rot <- exp([w]x) rot) and the translation together, with
+   the analytic Jacobian. Returns the mean squared error, as
+   arModifyMatrix() does. */
+static double refine_pose( double rot[3][3], double trans[3], double cpara[3][4],
+                           double pos3d[][3], double pos2d[][2], int num )
+{
+    double  jtj[6][6], jtr[6], a[6][6], d[6];
+    double  nrot[3][3], ntrans[3], dr[3][3];
+    double  err, nerr, lambda, th, s, c, k[3];
+    int     loop, i, j;
+
+    err = pose_error( rot, trans, cpara, pos3d, pos2d, num, jtj, jtr );
+    lambda = 0.001;
+    for( loop = 0; loop < AR_POSE_REFINE_MAX_LOOP_COUNT; loop++ ) {
+        for( ;; ) {
+            for( j = 0; j < 6; j++ ) {
+                for( i = 0; i < 6; i++ ) a[j][i] = jtj[j][i];
+                a[j][j] += lambda * jtj[j][j];
+            }
+            if( solve6( a, jtr, d ) < 0 ) return err/num;
+
+            th = sqrt( d[0]*d[0] + d[1]*d[1] + d[2]*d[2] );
+            if( th > 0.0 ) {
+                k[0] = d[0]/th; k[1] = d[1]/th; k[2] = d[2]/th;
+            }
+            else {
+                k[0] = 1.0; k[1] = k[2] = 0.0;
+            }
+            s = sin( th );
+            c = 1.0 - cos( th );
+            dr[0][0] = 1.0 - c*(k[1]*k[1] + k[2]*k[2]);
+            dr[0][1] = -s*k[2] + c*k[0]*k[1];
+            dr[0][2] =  s*k[1] + c*k[0]*k[2];
+            dr[1][0] =  s*k[2] + c*k[0]*k[1];
+            dr[1][1] = 1.0 - c*(k[0]*k[0] + k[2]*k[2]);
+            dr[1][2] = -s*k[0] + c*k[1]*k[2];
+            dr[2][0] = -s*k[1] + c*k[0]*k[2];
+            dr[2][1] =  s*k[0] + c*k[1]*k[2];
+            dr[2][2] = 1.0 - c*(k[0]*k[0] + k[1]*k[1]);
+            for( j = 0; j < 3; j++ ) {
+                for( i = 0; i < 3; i++ ) {
+                    nrot[j][i] = dr[j][0]*rot[0][i] + dr[j][1]*rot[1][i] + dr[j][2]*rot[2][i];
+                }
+                ntrans[j] = trans[j] + d[3+j];
+            }
+
+            nerr = pose_error( nrot, ntrans, cpara, pos3d, pos2d, num, NULL, NULL );
+            if( nerr < err ) break;
+            lambda *= 10.0;
+            if( lambda > 1.0e6 ) return err/num;
+        }
+        lambda *= 0.1;
+
+        for( j = 0; j < 3; j++ ) {
+            for( i = 0; i < 3; i++ ) rot[j][i] = nrot[j][i];
+            trans[j] = ntrans[j];
+        }
+        if( err - nerr < err * AR_POSE_REFINE_CONVERGE ) {
+            err = nerr;
+            break;
+        }
+        err = pose_error( rot, trans, cpara, pos3d, pos2d, num, jtj, jtr );
+    }
+
+    return err/num;
+}
+
+/* Sum of the squared reprojection errors and, if jtj is given, the
+   normal equations of the Gauss-Newton step (jtr is -J^t r). */
+static double pose_error( double rot[3][3], double trans[3], double cpara[3][4],
+                          double pos3d[][3], double pos2d[][2], int num,
+                          double jtj[6][6], double jtr[6] )
+{
+    double  p[3], hx, hy, h, x, y, rx, ry;
+    double  ju[6], jv[6], gu[3], gv[3];
+    double  err;
+    int     n, i, j;
+
+    if( jtj != NULL ) {
+        for( j = 0; j < 6; j++ ) {
+            for( i = 0; i < 6; i++ ) jtj[j][i] = 0.0;
+            jtr[j] = 0.0;
+        }
+    }
+    err = 0.0;
+    for( n = 0; n < num; n++ ) {
+        for( j = 0; j < 3; j++ ) {
+            p[j] = rot[j][0]*pos3d[n][0] + rot[j][1]*pos3d[n][1] + rot[j][2]*pos3d[n][2];
+        }
+        hx = cpara[0][0]*(p[0]+trans[0]) + cpara[0][1]*(p[1]+trans[1])
+           + cpara[0][2]*(p[2]+trans[2]) + cpara[0][3];
+        hy = cpara[1][0]*(p[0]+trans[0]) + cpara[1][1]*(p[1]+trans[1])
+           + cpara[1][2]*(p[2]+trans[2]) + cpara[1][3];
+        h  = cpara[2][0]*(p[0]+trans[0]) + cpara[2][1]*(p[1]+trans[1])
+           + cpara[2][2]*(p[2]+trans[2]) + cpara[2][3];
+        x = hx / h;
+        y = hy / h;
+        rx = x - pos2d[n][0];
+        ry = y - pos2d[n][1];
+        err += rx*rx + ry*ry;
+        if( jtj == NULL ) continue;
+
+        /* d(x,y)/d(camera point), then through -[p]x for the rotation
+           and the identity for the translation. */
+        for( j = 0; j < 3; j++ ) {
+            gu[j] = (cpara[0][j] - x*cpara[2][j]) / h;
+            gv[j] = (cpara[1][j] - y*cpara[2][j]) / h;
+        }
+        ju[0] = gu[2]*p[1] - gu[1]*p[2];
+        ju[1] = gu[0]*p[2] - gu[2]*p[0];
+        ju[2] = gu[1]*p[0] - gu[0]*p[1];
+        jv[0] = gv[2]*p[1] - gv[1]*p[2];
+        jv[1] = gv[0]*p[2] - gv[2]*p[0];
+        jv[2] = gv[1]*p[0] - gv[0]*p[1];
+        for( j = 0; j < 3; j++ ) {
+            ju[3+j] = gu[j];
+            jv[3+j] = gv[j];
+        }
+        for( j = 0; j < 6; j++ ) {
+            for( i = 0; i < 6; i++ ) jtj[j][i] += ju[j]*ju[i] + jv[j]*jv[i];
+            jtr[j] -= ju[j]*rx + jv[j]*ry;
+        }
+    }
+
+    return err;
+}
+
+/* Cholesky solution of a x = b for the symmetric positive definite a. */
+static int solve6( double a[6][6], double b[6], double x[6] )
+{
+    double  l[6][6], w;
+    int     i, j, k;
+
+    for( j = 0; j < 6; j++ ) {
+        for( i = 0; i <= j; i++ ) {
+            w = a[j][i];
+            for( k = 0; k < i; k++ ) w -= l[j][k]*l[i][k];
+            if( i == j ) {
+                if( w <= 0.0 ) return -1;
+                l[j][j] = sqrt( w );
+            }
+            else {
+                l[j][i] = w / l[i][i];
+            }
+        }
+    }
+    for( j = 0; j < 6; j++ ) {
+        w = b[j];
+        for( k = 0; k < j; k++ ) w -= l[j][k]*x[k];
+        x[j] = w / l[j][j];
+    }
+    for( j = 5; j >= 0; j-- ) {
+        w = x[j];
+        for( k = j+1; k < 6; k++ ) w -= l[k][j]*x[k];
+        x[j] = w / l[j][j];
+    }
+
+    return 0;
+}
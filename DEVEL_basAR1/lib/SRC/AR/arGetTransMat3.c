@@ -284,26 +284,24 @@ int arGetInitRot( ARMarkerInfo *marker_info, double cpara[3][4], double rot[3][3
 static int check_dir( double dir[3], double st[2], double ed[2],
                       double cpara[3][4] )
 {
-    ARMat     *mat_a;
+    double    inv[3][3];
     double    world[2][3];
     double    camera[2][2];
     double    v[2][2];
     double    h;
     int       i, j;
 
-    mat_a = arMatrixAlloc( 3, 3 );
-    for(j=0;j<3;j++) for(i=0;i<3;i++) mat_a->m[j*3+i] = cpara[j][i];
-    arMatrixSelfInv( mat_a );
-    world[0][0] = mat_a->m[0]*st[0]*10.0
-                + mat_a->m[1]*st[1]*10.0
-                + mat_a->m[2]*10.0;
-    world[0][1] = mat_a->m[3]*st[0]*10.0
-                + mat_a->m[4]*st[1]*10.0
-                + mat_a->m[5]*10.0;
-    world[0][2] = mat_a->m[6]*st[0]*10.0
-                + mat_a->m[7]*st[1]*10.0
-                + mat_a->m[8]*10.0;
-    arMatrixFree( mat_a );
+    for(j=0;j<3;j++) for(i=0;i<3;i++) inv[j][i] = cpara[j][i];
+    arMat3Inv( inv, inv );
+    world[0][0] = inv[0][0]*st[0]*10.0
+                + inv[0][1]*st[1]*10.0
+                + inv[0][2]*10.0;
+    world[0][1] = inv[1][0]*st[0]*10.0
+                + inv[1][1]*st[1]*10.0
+                + inv[1][2]*10.0;
+    world[0][2] = inv[2][0]*st[0]*10.0
+                + inv[2][1]*st[1]*10.0
+                + inv[2][2]*10.0;
     world[1][0] = world[0][0] + dir[0];
     world[1][1] = world[0][1] + dir[1];
     world[1][2] = world[0][2] + dir[2];
@@ -392,8 +390,10 @@ static int check_rotation( double rot[2][3] )
     b = k1*k2 + k3*k4;
     c = k2*k2 + k4*k4 - 1;
 
+    /* Already orthogonal directions give d = 0, or just below by rounding. */
     d = b*b - a*c;
-    if( d < 0 ) return -1;
+    if( d < -1.0e-10 * (b*b + fabs(a*c)) ) return -1;
+    if( d < 0 ) d = 0;
     r1 = (-b + sqrt(d))/a;
     p1 = k1*r1 + k2;
     q1 = k3*r1 + k4;
@@ -441,7 +441,8 @@ static int check_rotation( double rot[2][3] )
     c = k2*k2 + k4*k4 - 1;
 
     d = b*b - a*c;
-    if( d < 0 ) return -1;
+    if( d < -1.0e-10 * (b*b + fabs(a*c)) ) return -1;
+    if( d < 0 ) d = 0;
     r3 = (-b + sqrt(d))/a;
     p3 = k1*r3 + k2;
     q3 = k3*r3 + k4;
@@ -0,0 +1,136 @@
+/*******************************************************
+ *
+ * Pose estimation of many markers.
+ *
+ * The markers are shared out among worker threads, thread t
+ * taking markers t, t+thread_num, ... arGetTransMat() and
+ * arGetTransMatCont() keep no state from one call to the next,
+ * so the poses are those of calling them marker after marker.
+ *
+*******************************************************/
+
+#include <stdlib.h>
+#include <AR/ar.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <process.h>
+#else
+#  include <pthread.h>
+#endif
+
+typedef struct {
+    ARMarkerInfo   **marker_info;
+    int              num;
+    double          *width;
+    double         (*center)[2];
+    int             *cont;
+    double         (*conv)[3][4];
+    double          *err;
+    int              first;
+    int              interval;
+} PoseJob;
+
+static void do_poses( PoseJob *job );
+
+#ifdef _WIN32
+static unsigned __stdcall pose_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_poses( (PoseJob *)arg );
+    return 0;
+}
+#else
+static void *pose_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_poses( (PoseJob *)arg );
+    return NULL;
+}
+#endif
+
+int arGetTransMatBatch( ARMarkerInfo *marker_info[], int num,
+                        double width[], double center[][2], int cont[],
+                        double conv[][3][4], double err[], int thread_num )
+{
+    PoseJob   job[AR_BATCH_THREADS_MAX];
+#ifdef _WIN32
+    HANDLE    tid[AR_BATCH_THREADS_MAX];
+#else
+    pthread_t tid[AR_BATCH_THREADS_MAX];
+#endif
+    int       started[AR_BATCH_THREADS_MAX];
+    int       ret;
+    int       i, t;
+    double    t0 = 0.0;
+
+    if( marker_info == NULL || width == NULL || center == NULL
+     || conv == NULL || err == NULL || num < 0 ) return -1;
+    if( thread_num > AR_BATCH_THREADS_MAX ) thread_num = AR_BATCH_THREADS_MAX;
+    if( thread_num > num )                  thread_num = num;
+    if( thread_num < 1 )                    thread_num = 1;
+    if( arStatsMode == AR_STATS_ON ) t0 = arUtilClock();
+    AR_TRACE_BEGIN( "arGetTransMatBatch" );
+
+    for( t = 0; t < thread_num; t++ ) {
+        job[t].marker_info = marker_info;
+        job[t].num         = num;
+        job[t].width       = width;
+        job[t].center      = center;
+        job[t].cont        = cont;
+        job[t].conv        = conv;
+        job[t].err         = err;
+        job[t].first       = t;
+        job[t].interval    = thread_num;
+    }
+
+    for( t = 1; t < thread_num; t++ ) {
+#ifdef _WIN32
+        tid[t] = (HANDLE)_beginthreadex( NULL, 0, pose_thread, &job[t], 0, NULL );
+        started[t] = (tid[t] != 0);
+#else
+        started[t] = (pthread_create( &tid[t], NULL, pose_thread, &job[t] ) == 0);
+#endif
+    }
+    do_poses( &job[0] );
+    for( t = 1; t < thread_num; t++ ) {
+        if( !started[t] ) {
+            do_poses( &job[t] );
+            continue;
+        }
+#ifdef _WIN32
+        WaitForSingleObject( tid[t], INFINITE );
+        CloseHandle( tid[t] );
+#else
+        pthread_join( tid[t], NULL );
+#endif
+    }
+
+    AR_TRACE_END();
+    if( arStatsMode == AR_STATS_ON ) arStatsAddPose( (arUtilClock() - t0) * 1000.0, num );
+
+    ret = 0;
+    for( i = 0; i < num; i++ ) {
+        if( err[i] < 0.0 ) ret = -1;
+    }
+    return ret;
+}
+
+static void do_poses( PoseJob *job )
+{
+    int     i;
+
+    for( i = job->first; i < job->num; i += job->interval ) {
+        if( job->marker_info[i] == NULL ) {
+            job->err[i] = -1.0;
+        }
+        else if( job->cont != NULL && job->cont[i] ) {
+            job->err[i] = arGetTransMatCont( job->marker_info[i], job->conv[i],
+                                             job->center[i], job->width[i], job->conv[i] );
+        }
+        else {
+            job->err[i] = arGetTransMat( job->marker_info[i],
+                                         job->center[i], job->width[i], job->conv[i] );
+        }
+    }
+}
@@ -0,0 +1,382 @@
+/*******************************************************
+ *
+ * Marker detection contexts.
+ *
+ * Each ARHandle owns the working buffers of the detection
+ * pipeline, so that detections on different handles can run
+ * concurrently. The global API (arDetectMarker(), arLabeling(),
+ * arsDetectMarker(), ...) runs on the default handles below.
+ *
+*******************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <AR/ar.h>
+
+static ARHandle         handleL;
+static ARHandle         handleR;
+
+// Poses computed since the statistics were last read, of all the contexts.
+static double           pose_time = 0.0;
+static int              pose_num  = 0;
+
+// Size and offsets of the blue, green and red bytes of each pixel format;
+// the three offsets are that of the luma byte for the grey formats.
+static const struct {
+    int     format;
+    int     size;
+    int     offset[3];
+} pixel_layout[] = {
+    { AR_PIXEL_FORMAT_RGB,  3, {2, 1, 0} },
+    { AR_PIXEL_FORMAT_BGR,  3, {0, 1, 2} },
+    { AR_PIXEL_FORMAT_RGBA, 4, {2, 1, 0} },
+    { AR_PIXEL_FORMAT_BGRA, 4, {0, 1, 2} },
+    { AR_PIXEL_FORMAT_ABGR, 4, {1, 2, 3} },
+    { AR_PIXEL_FORMAT_ARGB, 4, {3, 2, 1} },
+    { AR_PIXEL_FORMAT_MONO, 1, {0, 0, 0} },
+    { AR_PIXEL_FORMAT_2vuy, 2, {1, 1, 1} },
+    { AR_PIXEL_FORMAT_yuvs, 2, {0, 0, 0} }
+};
+
+static void update_default_handle( ARHandle *handle, double *dist_factor );
+static void free_buffers( ARHandle *handle );
+static void update_lut( ARHandle *handle );
+
+ARHandle *arCreateHandle( ARParam *param )
+{
+    ARHandle    *handle;
+
+    if( param == NULL ) return NULL;
+
+    arCpuInit();
+    arMallocTag( handle, ARHandle, 1, AR_MEM_AR );
+    memset( handle, 0, sizeof(ARHandle) );
+
+    handle->imageProcMode = arImageProcMode;
+    handle->labelingMode  = arLabelingMode;
+    handle->threshMode    = arThresholdMode;
+    handle->roiMode       = arROIMode;
+    handle->pyramidMode   = arPyramidMode;
+    handle->threads       = arLabelingThreads;
+    handle->samplingMode  = arPattSamplingMode;
+    handle->edgeRefineMode = arEdgeRefineMode;
+    handle->trackingMode  = arTrackingMode;
+    handle->codeCacheMode = arCodeCacheMode;
+    handle->statsMode     = arStatsMode;
+    handle->debug         = arDebug;
+    handle->motion_num    = -1;
+    memcpy( handle->dist_factor, param->dist_factor, sizeof(handle->dist_factor) );
+    if( arSetPixelFormatCtx( handle, arPixelFormat ) < 0 ) {
+        arSetPixelFormatCtx( handle, AR_DEFAULT_PIXEL_FORMAT );
+    }
+
+    if( arResizeHandle( handle, param->xsize, param->ysize ) < 0 ) {
+        arMemFree( handle );
+        return NULL;
+    }
+    update_lut( handle );
+
+    return handle;
+}
+
+int arResizeHandle( ARHandle *handle, int xsize, int ysize )
+{
+    int         image_size, work_size;
+
+    if( handle == NULL || xsize <= 0 || ysize <= 0 ) return -1;
+
+    /* A new label is only opened on a pixel whose left, upper-left,
+       upper and upper-right neighbours are all background, so there
+       can be at most one per 4 pixels. Labels are stored as ARInt16. */
+    image_size = xsize * ysize;
+    work_size  = image_size / 4;
+    if( work_size > AR_LABEL_WORK_MAX ) work_size = AR_LABEL_WORK_MAX;
+
+    if( image_size > handle->l_image_size ) {
+        arImageFree( handle->l_image );
+        arImageFree( handle->bin_image );
+        arMallocImage( handle->l_image,   ARInt16, image_size, AR_MEM_AR );
+        arMallocImage( handle->bin_image, ARUint8, image_size, AR_MEM_AR );
+        handle->l_image_size = image_size;
+    }
+    if( work_size > handle->work_size ) {
+        arMemFree( handle->work );
+        arMemFree( handle->work2 );
+        arMemFree( handle->warea );
+        arMemFree( handle->wclip );
+        arMemFree( handle->wpos );
+        arMallocTag( handle->work,  int,    work_size, AR_MEM_AR );
+        arMallocTag( handle->work2, int,    work_size*7, AR_MEM_AR );
+        arMallocTag( handle->warea, int,    work_size, AR_MEM_AR );
+        arMallocTag( handle->wclip, int,    work_size*4, AR_MEM_AR );
+        arMallocTag( handle->wpos,  double, work_size*2, AR_MEM_AR );
+        handle->work_size = work_size;
+    }
+    if( handle->marker_info2 == NULL ) {
+        arMallocTag( handle->marker_info2, ARMarkerInfo2, AR_SQUARE_MAX, AR_MEM_AR );
+    }
+
+    if( xsize != handle->xsize || ysize != handle->ysize ) {
+        handle->roi_num   = 0;
+        handle->track_num = 0;
+        handle->code_cache_num = 0;
+        handle->motion_num = -1;
+    }
+    handle->xsize = xsize;
+    handle->ysize = ysize;
+
+    return 0;
+}
+
+int arSetPixelFormatCtx( ARHandle *handle, int format )
+{
+    int         i;
+
+    for( i = 0; i < (int)(sizeof(pixel_layout)/sizeof(pixel_layout[0])); i++ ) {
+        if( pixel_layout[i].format == format ) break;
+    }
+    if( i == (int)(sizeof(pixel_layout)/sizeof(pixel_layout[0])) ) return -1;
+
+    handle->pixFormat = format;
+    handle->pixSize   = pixel_layout[i].size;
+    memcpy( handle->pixOffset, pixel_layout[i].offset, sizeof(handle->pixOffset) );
+
+    return 0;
+}
+
+int arSetParamSizeCtx( ARHandle *handle, ARParamSizes *sizes, int xsize, int ysize )
+{
+    int         i;
+
+    if( handle == NULL || sizes == NULL ) return -1;
+    if( (i = arParamSizesAdd( sizes, xsize, ysize, arDistortionLUTSize )) < 0 ) return -1;
+    if( arResizeHandle( handle, xsize, ysize ) < 0 ) return -1;
+
+    memcpy( handle->dist_factor, sizes->param[i].dist_factor, sizeof(handle->dist_factor) );
+    if( !handle->undistShared ) arParamLUTFree( &handle->undist );
+    handle->undist = sizes->lut[i];
+    handle->undistShared = 1;
+
+    return 0;
+}
+
+int arInitCparamSize( ARParamSizes *sizes, int xsize, int ysize )
+{
+    int         i;
+
+    if( (i = arParamSizesAdd( sizes, xsize, ysize, arDistortionLUTSize )) < 0 ) return -1;
+
+    /* The table is taken first, so that arGetDefaultHandle() finds it up to date. */
+    arSetParamSizeCtx( &handleL, sizes, xsize, ysize );
+    arImXsize = xsize;
+    arImYsize = ysize;
+    arParam = sizes->param[i];
+    arGetDefaultHandle();
+
+    return 0;
+}
+
+int arDeleteHandle( ARHandle *handle )
+{
+    if( handle == NULL ) return -1;
+    if( handle == &handleL || handle == &handleR ) return -1;
+
+    free_buffers( handle );
+    arMemFree( handle );
+
+    return 0;
+}
+
+ARHandle *arGetDefaultHandle( void )
+{
+    update_default_handle( &handleL, arParam.dist_factor );
+
+    return &handleL;
+}
+
+ARHandle *arsGetDefaultHandle( int LorR )
+{
+    if( LorR ) {
+        update_default_handle( &handleL, arsParam.dist_factorL );
+        return &handleL;
+    }
+    else {
+        update_default_handle( &handleR, arsParam.dist_factorR );
+        return &handleR;
+    }
+}
+
+int arGetStats( ARDetectStats *stats )
+{
+    return arGetStatsCtx( &handleL, stats );
+}
+
+int arGetStatsCtx( ARHandle *handle, ARDetectStats *stats )
+{
+    if( handle == NULL || stats == NULL ) return -1;
+    if( handle->statsMode != AR_STATS_ON ) return -1;
+
+    *stats = handle->stats;
+    stats->pose     = pose_time;
+    stats->pose_num = pose_num;
+    stats->simd     = arCpuFeatures();
+    pose_time = 0.0;
+    pose_num  = 0;
+
+    return 0;
+}
+
+void arResetStatsCtx( ARHandle *handle )
+{
+    int     frame;
+
+    if( handle->statsMode != AR_STATS_ON ) return;
+
+    frame = handle->stats.frame;
+    memset( &handle->stats, 0, sizeof(handle->stats) );
+    handle->stats.frame = frame + 1;
+}
+
+void arStatsAddPose( double msec, int num )
+{
+    pose_time += msec;
+    pose_num  += num;
+}
+
+int arGetLabelingScale( ARHandle *handle )
+{
+    if( handle->pyramidMode == AR_PYRAMID_QUARTER )      return 4;
+    if( handle->pyramidMode == AR_PYRAMID_HALF )         return 2;
+    if( handle->imageProcMode == AR_IMAGE_PROC_IN_HALF
+     || handle->imageProcMode == AR_IMAGE_PROC_IN_HALF_REFINED ) return 2;
+    return 1;
+}
+
+void arLabelingCleanup( void )
+{
+    free_buffers( &handleL );
+    free_buffers( &handleR );
+    arImageL = NULL;
+    arImageR = NULL;
+    arImage  = NULL;
+}
+
+static void update_default_handle( ARHandle *handle, double *dist_factor )
+{
+    arResizeHandle( handle, arImXsize, arImYsize );
+    handle->imageProcMode = arImageProcMode;
+    handle->labelingMode  = arLabelingMode;
+    handle->threshMode    = arThresholdMode;
+    handle->roiMode       = arROIMode;
+    handle->pyramidMode   = arPyramidMode;
+    handle->threads       = arLabelingThreads;
+    handle->samplingMode  = arPattSamplingMode;
+    handle->edgeRefineMode = arEdgeRefineMode;
+    handle->trackingMode  = arTrackingMode;
+    handle->codeCacheMode = arCodeCacheMode;
+    handle->statsMode     = arStatsMode;
+    handle->debug         = arDebug;
+    handle->motion_num    = -1;
+    memcpy( handle->dist_factor, dist_factor, sizeof(handle->dist_factor) );
+    if( handle->pixFormat != arPixelFormat && arSetPixelFormatCtx( handle, arPixelFormat ) < 0 ) {
+        arSetPixelFormatCtx( handle, AR_DEFAULT_PIXEL_FORMAT );
+    }
+    update_lut( handle );
+}
+
+/* The table for arDistortionLUTSize bytes, rebuilt only when the image
+   size, the distortion or the budget has changed. */
+static void update_lut( ARHandle *handle )
+{
+    ARParamLUT  *lut = &handle->undist;
+
+    /* A table of an ARParamSizes is used as long as it fits, and never
+       rebuilt or freed here. */
+    if( handle->undistShared ) {
+        if( lut->max_bytes == arDistortionLUTSize
+         && lut->xsize == handle->xsize && lut->ysize == handle->ysize
+         && memcmp(lut->dist_factor, handle->dist_factor, sizeof(lut->dist_factor)) == 0 ) return;
+        memset( lut, 0, sizeof(ARParamLUT) );
+        handle->undistShared = 0;
+    }
+    if( arDistortionLUTSize <= 0 ) {
+        if( lut->table != NULL ) arParamLUTFree( lut );
+        lut->max_bytes = 0;
+        return;
+    }
+    if( lut->max_bytes == arDistortionLUTSize
+     && lut->xsize == handle->xsize && lut->ysize == handle->ysize
+     && memcmp(lut->dist_factor, handle->dist_factor, sizeof(lut->dist_factor)) == 0 ) return;
+
+    arParamLUTCreate( lut, handle->dist_factor, handle->xsize, handle->ysize, arDistortionLUTSize );
+}
+
+static void free_buffers( ARHandle *handle )
+{
+    ARContourBlock  *pb;
+    int             b;
+
+    arImageFree( handle->l_image );
+    arImageFree( handle->bin_image );
+    arMemFree( handle->work );
+    arMemFree( handle->work2 );
+    arMemFree( handle->warea );
+    arMemFree( handle->wclip );
+    arMemFree( handle->wpos );
+    arMemFree( handle->marker_info2 );
+    arMemFree( handle->debug_image );
+    if( !handle->undistShared ) arParamLUTFree( &handle->undist );
+    memset( &handle->undist, 0, sizeof(handle->undist) );
+    handle->undistShared = 0;
+    for( b = 0; b < AR_LABELING_THREADS_MAX; b++ ) {
+        arMemFree( handle->band[b].run_buf );
+        arMemFree( handle->band[b].run_label );
+        arMemFree( handle->band[b].run_sum );
+    }
+    arMemFree( handle->band_merge );
+    memset( handle->band, 0, sizeof(handle->band) );
+    arMemFree( handle->thresh_block );
+    arMemFree( handle->refine_mask );
+    arMemFree( handle->motion_thumb );
+    arMemFree( handle->motion_block );
+    arMemFree( handle->chain_x );
+    arMemFree( handle->chain_y );
+    while( handle->contour_pool != NULL ) {
+        pb = handle->contour_pool;
+        handle->contour_pool = pb->next;
+        arMemFree( pb->data );
+        arMemFree( pb );
+    }
+    handle->l_image      = NULL;
+    handle->bin_image    = NULL;
+    handle->work         = NULL;
+    handle->work2        = NULL;
+    handle->warea        = NULL;
+    handle->wclip        = NULL;
+    handle->wpos         = NULL;
+    handle->marker_info2 = NULL;
+    handle->debug_image  = NULL;
+    handle->band_merge   = NULL;
+    handle->band_merge_max = 0;
+    handle->thresh_block = NULL;
+    handle->thresh_block_size = 0;
+    handle->refine_mask  = NULL;
+    handle->refine_mask_size = 0;
+    handle->motion_thumb = NULL;
+    handle->motion_block = NULL;
+    handle->motion_size  = 0;
+    handle->motion_num   = -1;
+    handle->chain_x      = NULL;
+    handle->chain_y      = NULL;
+    handle->chain_max    = 0;
+    handle->contour_cur  = NULL;
+    handle->l_image_size = 0;
+    handle->work_size    = 0;
+    handle->wlabel_num   = 0;
+    handle->marker2_num  = 0;
+    handle->marker_num   = 0;
+    handle->roi_num      = 0;
+    handle->track_num    = 0;
+    handle->code_cache_num = 0;
+    handle->debug_xsize  = 0;
+}
@@ -13,158 +13,641 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 #include <AR/ar.h>
 
 #ifdef _WIN32
 #  include <windows.h>
+#  include <process.h>
 #  define put_zero(p,s) ZeroMemory(p, s)
 #else
 #  include <string.h>
+#  include <pthread.h>
 #  define put_zero(p,s) memset((void *)p, 0, s)
 #endif
 
 #define USE_OPTIMIZATIONS
-#define WORK_SIZE   1024*32
-
-/*****************************************************************************/
-// BUG in ARToolkit 2.65
-// Hardcoded buffer (600*500) is too small for full-size DV-PAL/NTSC resolutions of
-// 720x576 and 720x480, respectively. Results in segment faults.
-/*
-static ARInt16      l_imageL[640*500];
-static ARInt16      l_imageR[640*500];
-*/
-
-#define HARDCODED_BUFFER_WIDTH  1024
-#define HARDCODED_BUFFER_HEIGHT 1024
-
-static ARInt16      l_imageL[HARDCODED_BUFFER_WIDTH*HARDCODED_BUFFER_HEIGHT];
-static ARInt16      l_imageR[HARDCODED_BUFFER_WIDTH*HARDCODED_BUFFER_HEIGHT];
-/*****************************************************************************/
-
-
-static int          workL[WORK_SIZE];
-static int          workR[WORK_SIZE];
-static int          work2L[WORK_SIZE*7];
-static int          work2R[WORK_SIZE*7];
-
-static int          wlabel_numL;
-static int          wlabel_numR;
-static int          wareaL[WORK_SIZE];
-static int          wareaR[WORK_SIZE];
-static int          wclipL[WORK_SIZE*4];
-static int          wclipR[WORK_SIZE*4];
-static double       wposL[WORK_SIZE*2];
-static double       wposR[WORK_SIZE*2];
-
-static ARInt16 *labeling2( ARUint8 *image, int thresh,
+
+// Vectorized binarization. SSE2 is in every x86-64 compiler; the 24 bit
+// formats need SSSE3 byte shuffles. NEON deinterleaves all formats itself.
+// SSSE3 and AVX2 are compiled for every x86 and taken when arCpuFeatures()
+// has them.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define AR_BINARIZE_SSE2
+#  include <emmintrin.h>
+#  if defined(AR_CPU_TARGET) || defined(__SSSE3__)
+#    define AR_BINARIZE_SSSE3
+#    include <tmmintrin.h>
+#  endif
+#  if defined(AR_CPU_X86_AVX2)
+#    define AR_BINARIZE_AVX2
+#    include <immintrin.h>
+#  endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define AR_BINARIZE_NEON
+#  include <arm_neon.h>
+#endif
+
+// Offset of the first colour (or luma) byte of a pixel.
+#if (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_BGRA) || (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_RGBA)
+#  define BIN_RGB32   0
+#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_ARGB) || (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_ABGR)
+#  define BIN_RGB32   1
+#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_BGR) || (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_RGB)
+#  define BIN_RGB24   0
+#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_MONO)
+#  define BIN_MONO    0
+#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_2vuy)
+#  define BIN_YUV422  1
+#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_yuvs)
+#  define BIN_YUV422  0
+#else
+#  error Unknown default pixel format defined in config.h
+#endif
+
+// Brightness of a pixel, in units of BIN_LUM_SCALE per grey level.
+#if defined(BIN_RGB32)
+#  define BIN_LUM(p)      ((p)[BIN_RGB32] + (p)[BIN_RGB32+1] + (p)[BIN_RGB32+2])
+#  define BIN_LUM_SCALE   3
+#elif defined(BIN_RGB24)
+#  define BIN_LUM(p)      ((p)[0] + (p)[1] + (p)[2])
+#  define BIN_LUM_SCALE   3
+#elif defined(BIN_MONO)
+#  define BIN_LUM(p)      ((p)[0])
+#  define BIN_LUM_SCALE   1
+#else
+#  define BIN_LUM(p)      ((p)[BIN_YUV422])
+#  define BIN_LUM_SCALE   1
+#endif
+
+// Pixels of the input image, which is either in handle->pixFormat or,
+// for arDetectMarkerLumaCtx(), a plane of luma bytes handle->lumaStride
+// bytes per line. IMG_LUM() is in BIN_LUM() units in all cases.
+#define IMG_DEFAULT(h)       ((h)->lumaStride == 0 && (h)->pixFormat == AR_DEFAULT_PIXEL_FORMAT)
+#define IMG_PIX_SIZE(h)      ((h)->lumaStride? 1: (h)->pixSize)
+#define IMG_PIX(h,img,x,y)   ((h)->lumaStride? &((img)[(y)*(h)->lumaStride + (x)]) \
+                                             : &((img)[((y)*(h)->xsize + (x))*(h)->pixSize]))
+#define IMG_LUM(h,p)         (IMG_DEFAULT(h)? BIN_LUM(p): pixel_lum(h, p))
+
+// Kernels for the formats other than the default one, each specialized
+// for a pixel size and the place of its colour or luma bytes. bin sets
+// mask to 0xFF for the pixels up to t and sum adds them up, for n pixels
+// taking every step-th, both in BIN_LUM() units.
+typedef struct {
+    void    (*bin)( ARUint8 *p, int n, int step, int t, ARUint8 *mask );
+    int     (*sum)( ARUint8 *p, int n, int step );
+} PixelKernel;
+
+#define PIXEL_KERNEL(name, size, lum)                                   \
+static void name##_bin( ARUint8 *p, int n, int step, int t, ARUint8 *mask ) \
+{                                                                       \
+    int     i;                                                          \
+    for( i = 0; i < n; i++, p += (size)*step ) mask[i] = ((lum) <= t)? 0xFF: 0; \
+}                                                                       \
+static int name##_sum( ARUint8 *p, int n, int step )                    \
+{                                                                       \
+    int     i, sum;                                                     \
+    for( i = sum = 0; i < n; i++, p += (size)*step ) sum += (lum);      \
+    return sum;                                                         \
+}
+
+#define LUM_RGB(o)    (((p)[o] + (p)[(o)+1] + (p)[(o)+2]) * BIN_LUM_SCALE / 3)
+#define LUM_Y(o)      ((p)[o] * BIN_LUM_SCALE)
+
+PIXEL_KERNEL( pix_rgb24,  3, LUM_RGB(0) )
+PIXEL_KERNEL( pix_rgbx32, 4, LUM_RGB(0) )
+PIXEL_KERNEL( pix_xrgb32, 4, LUM_RGB(1) )
+PIXEL_KERNEL( pix_mono,   1, LUM_Y(0) )
+PIXEL_KERNEL( pix_uyvy,   2, LUM_Y(1) )
+PIXEL_KERNEL( pix_yuyv,   2, LUM_Y(0) )
+
+// Indexed by AR_PIXEL_FORMAT_*.
+static const PixelKernel pixel_kernels[] = {
+    { NULL,           NULL           },
+    { pix_rgb24_bin,  pix_rgb24_sum  },     /* AR_PIXEL_FORMAT_RGB  */
+    { pix_rgb24_bin,  pix_rgb24_sum  },     /* AR_PIXEL_FORMAT_BGR  */
+    { pix_rgbx32_bin, pix_rgbx32_sum },     /* AR_PIXEL_FORMAT_RGBA */
+    { pix_rgbx32_bin, pix_rgbx32_sum },     /* AR_PIXEL_FORMAT_BGRA */
+    { pix_xrgb32_bin, pix_xrgb32_sum },     /* AR_PIXEL_FORMAT_ABGR */
+    { pix_mono_bin,   pix_mono_sum   },     /* AR_PIXEL_FORMAT_MONO */
+    { pix_xrgb32_bin, pix_xrgb32_sum },     /* AR_PIXEL_FORMAT_ARGB */
+    { pix_uyvy_bin,   pix_uyvy_sum   },     /* AR_PIXEL_FORMAT_2vuy */
+    { pix_yuyv_bin,   pix_yuyv_sum   }      /* AR_PIXEL_FORMAT_yuvs */
+};
+
+#if defined(BIN_RGB32) || defined(BIN_RGB24)
+#  define BIN_IS_DARK(p)  (BIN_LUM(p) <= thresht3)
+#else
+#  define BIN_IS_DARK(p)  (BIN_LUM(p) <= thresh)
+#endif
+
+static ARInt16 *labeling2( ARHandle *handle, ARUint8 *image, int thresh,
                            int *label_num, int **area, double **pos, int **clip,
-                           int **label_ref, int LorR );
-static ARInt16 *labeling3( ARUint8 *image, int thresh,
+                           int **label_ref );
+static ARInt16 *labeling_run( ARHandle *handle, ARUint8 *image, int thresh,
+                              int *label_num, int **area, double **pos, int **clip,
+                              int **label_ref );
+static int      effective_thresh( ARHandle *handle, int thresh );
+static int      refine_lines( ARHandle *handle, ARUint8 *image, double line[4][3], double vertex[4][2],
+                              int R, int outward, int need );
+static double   sample_lum( ARHandle *handle, ARUint8 *image, double x, double y );
+static int      pixel_lum( ARHandle *handle, ARUint8 *p );
+static void     observ2ideal( ARHandle *handle, double ox, double oy, double *ix, double *iy );
+static void     row_range( ARHandle *handle, int lysize, int *j0, int *j1 );
+static void     binarize( ARHandle *handle, ARUint8 *image, int thresh );
+static void     binarize_rows( ARHandle *handle, ARUint8 *image, int thresh,
+                               int *bthresh, int bx, int j0, int j1 );
+static void     binarize_row( ARHandle *handle, ARUint8 *image, int thresh,
+                              int *bthresh, int bx, int j, int x0, int x1 );
+static void     binarize_tail( ARUint8 *image, int i, int n, int thresh, ARUint8 *mask );
+static void     binarize_luma( ARUint8 *luma, int n, int step, int thresh, ARUint8 *mask );
+static int     *adaptive_thresholds( ARHandle *handle, ARUint8 *image, int *bx_out );
+static int      binarize_c( ARUint8 *image, int pixnum, int thresh, ARUint8 *mask );
+#if defined(AR_BINARIZE_SSE2) && !defined(BIN_RGB24)
+static int      binarize_sse2( ARUint8 *image, int pixnum, int thresh, ARUint8 *mask );
+#endif
+#if defined(AR_BINARIZE_SSSE3) && defined(BIN_RGB24)
+static int      binarize_ssse3( ARUint8 *image, int pixnum, int thresh, ARUint8 *mask );
+#endif
+#if defined(AR_BINARIZE_AVX2) && (defined(BIN_RGB32) || defined(BIN_MONO))
+static int      binarize_avx2( ARUint8 *image, int pixnum, int thresh, ARUint8 *mask );
+#endif
+#if defined(AR_BINARIZE_NEON)
+static int      binarize_neon( ARUint8 *image, int pixnum, int thresh, ARUint8 *mask );
+#endif
+static ARInt16 *labeling3( ARHandle *handle, ARUint8 *image, int thresh,
                            int *label_num, int **area, double **pos, int **clip,
-                           int **label_ref, int LorR );
+                           int **label_ref );
 
 void arGetImgFeature( int *num, int **area, int **clip, double **pos )
 {
-    *num  = wlabel_numL;
-    *area = wareaL;
-    *clip = wclipL;
-    *pos  = wposL;
+    arGetImgFeatureCtx( arGetDefaultHandle(), num, area, clip, pos );
+}
+
+// The variants of binarize_simd() for the pixel format, the first that
+// the CPU has being taken.
+static const struct {
+    int          features;
+    const char  *name;
+    int        (*func)( ARUint8 *image, int pixnum, int thresh, ARUint8 *mask );
+} binarize_kernel[] = {
+#if defined(AR_BINARIZE_AVX2) && (defined(BIN_RGB32) || defined(BIN_MONO))
+    { AR_CPU_AVX2,  "avx2",  binarize_avx2 },
+#endif
+#if defined(AR_BINARIZE_SSSE3) && defined(BIN_RGB24)
+    { AR_CPU_SSSE3, "ssse3", binarize_ssse3 },
+#endif
+#if defined(AR_BINARIZE_SSE2) && !defined(BIN_RGB24)
+    { AR_CPU_SSE2,  "sse2",  binarize_sse2 },
+#endif
+#if defined(AR_BINARIZE_NEON)
+    { AR_CPU_NEON,  "neon",  binarize_neon },
+#endif
+    { 0,            "c",     binarize_c }
+};
+
+// Until arCpuInit(), what the compiler was told the CPU has.
+#if defined(AR_BINARIZE_SSE2) && !defined(BIN_RGB24)
+static int (*binarize_simd)( ARUint8 *, int, int, ARUint8 * ) = binarize_sse2;
+#elif defined(AR_BINARIZE_SSSE3) && defined(BIN_RGB24) && defined(__SSSE3__)
+static int (*binarize_simd)( ARUint8 *, int, int, ARUint8 * ) = binarize_ssse3;
+#elif defined(AR_BINARIZE_NEON)
+static int (*binarize_simd)( ARUint8 *, int, int, ARUint8 * ) = binarize_neon;
+#else
+static int (*binarize_simd)( ARUint8 *, int, int, ARUint8 * ) = binarize_c;
+#endif
+
+// Takes the variant of binarize_simd() for the features, called by
+// arCpuInit() and arCpuSetFeatures(). Returns its name.
+const char *arLabelingKernel( int features )
+{
+    int       i;
 
-    return;
+    for( i = 0; binarize_kernel[i].features & ~features; i++ );
+    binarize_simd = binarize_kernel[i].func;
+
+    return binarize_kernel[i].name;
 }
 
 ARInt16 *arLabeling( ARUint8 *image, int thresh,
                      int *label_num, int **area, double **pos, int **clip,
                      int **label_ref )
 {
-    if( arDebug ) {
-        return( labeling3(image, thresh, label_num,
-                          area, pos, clip, label_ref, 1) );
-    } else {
-        return( labeling2(image, thresh, label_num,
-                          area, pos, clip, label_ref, 1) );
-    }
+    ARHandle   *handle;
+    ARInt16    *ret;
+
+    handle = arGetDefaultHandle();
+    ret = arLabelingCtx( handle, image, thresh, label_num, area, pos, clip, label_ref );
+    if( handle->debug ) arImage = arImageL = handle->debug_image;
+
+    return( ret );
 }
 
 void arsGetImgFeature( int *num, int **area, int **clip, double **pos, int LorR )
 {
-    if (LorR) {
-        *num  = wlabel_numL;
-        *area = wareaL;
-        *clip = wclipL;
-        *pos  = wposL;
-    } else {
-        *num  = wlabel_numR;
-        *area = wareaR;
-        *clip = wclipR;
-        *pos  = wposR;
-    }
-
-    return;
+    arGetImgFeatureCtx( arsGetDefaultHandle(LorR), num, area, clip, pos );
 }
 
 ARInt16 *arsLabeling( ARUint8 *image, int thresh,
                       int *label_num, int **area, double **pos, int **clip,
                       int **label_ref, int LorR )
 {
-    if( arDebug ) {
-        return( labeling3(image, thresh, label_num,
-                          area, pos, clip, label_ref, LorR) );
+    ARHandle   *handle;
+    ARInt16    *ret;
+
+    handle = arsGetDefaultHandle( LorR );
+    ret = arLabelingCtx( handle, image, thresh, label_num, area, pos, clip, label_ref );
+    if( handle->debug ) {
+        if( LorR ) arImage = arImageL = handle->debug_image;
+        else       arImageR = handle->debug_image;
+    }
+
+    return( ret );
+}
+
+void arGetImgFeatureCtx( ARHandle *handle, int *num, int **area, int **clip, double **pos )
+{
+    *num  = handle->wlabel_num;
+    *area = handle->warea;
+    *clip = handle->wclip;
+    *pos  = handle->wpos;
+
+    return;
+}
+
+ARInt16 *arLabelingCtx( ARHandle *handle, ARUint8 *image, int thresh,
+                        int *label_num, int **area, double **pos, int **clip,
+                        int **label_ref )
+{
+    thresh = effective_thresh( handle, thresh );
+
+    if( handle->debug ) {
+        return( labeling3(handle, image, thresh, label_num,
+                          area, pos, clip, label_ref) );
+    } else if( handle->labelingMode == AR_LABELING_BY_RUN || handle->threads > 1 ) {
+        return( labeling_run(handle, image, thresh, label_num,
+                             area, pos, clip, label_ref) );
     } else {
-        return( labeling2(image, thresh, label_num,
-                          area, pos, clip, label_ref, LorR) );
+        return( labeling2(handle, image, thresh, label_num,
+                          area, pos, clip, label_ref) );
+    }
+}
+
+int arUpdateThresholdCtx( ARHandle *handle, ARUint8 *image,
+                          ARMarkerInfo2 *marker_info2, int marker_num )
+{
+    int       hist_in[256], hist_out[256];
+    int       med_in, med_out;
+    int       n, step;
+    int       x1, y1, x2, y2;
+    double    dx, dy;
+    int       i, j;
+
+    put_zero( hist_in,  sizeof(hist_in)  );
+    put_zero( hist_out, sizeof(hist_out) );
+    n = 0;
+    for( i = 0; i < marker_num; i++ ) {
+        // About 64 samples per square, on the black border just inside the
+        // contour and on the white surround just outside it.
+        step = marker_info2[i].coord_num / 64 + 1;
+        for( j = 0; j < marker_info2[i].coord_num; j += step ) {
+            dx = marker_info2[i].x_coord[j] - marker_info2[i].pos[0];
+            dy = marker_info2[i].y_coord[j] - marker_info2[i].pos[1];
+            x1 = (int)(marker_info2[i].pos[0] + dx * 0.9);
+            y1 = (int)(marker_info2[i].pos[1] + dy * 0.9);
+            x2 = (int)(marker_info2[i].pos[0] + dx * 1.15);
+            y2 = (int)(marker_info2[i].pos[1] + dy * 1.15);
+            if( x1 < 0 || x1 >= handle->xsize || y1 < 0 || y1 >= handle->ysize ) continue;
+            if( x2 < 0 || x2 >= handle->xsize || y2 < 0 || y2 >= handle->ysize ) continue;
+            hist_in[IMG_LUM(handle, IMG_PIX(handle, image, x1, y1)) / BIN_LUM_SCALE]++;
+            hist_out[IMG_LUM(handle, IMG_PIX(handle, image, x2, y2)) / BIN_LUM_SCALE]++;
+            n++;
+        }
+    }
+
+    if( n == 0 ) {
+        if( handle->threshMode != AR_THRESHOLD_AUTO ) return -1;
+        if( ++handle->auto_lost >= AR_AUTO_THRESH_LOST_MAX ) handle->auto_thresh = 0;
+        return( handle->auto_thresh > 0 ? handle->auto_thresh : -1 );
+    }
+
+    for( i = j = 0; i < 256; i++ ) {
+        j += hist_in[i];
+        if( j*2 >= n ) break;
+    }
+    med_in = i;
+    for( i = j = 0; i < 256; i++ ) {
+        j += hist_out[i];
+        if( j*2 >= n ) break;
+    }
+    med_out = i;
+
+    // In every mode, for arExposureUpdate().
+    if( med_out > med_in ) {
+        handle->border_dark   = med_in;
+        handle->border_bright = med_out;
+        handle->border_serial++;
+    }
+    if( handle->threshMode != AR_THRESHOLD_AUTO ) return -1;
+    handle->auto_lost = 0;
+
+    if( med_out <= med_in ) return( handle->auto_thresh > 0 ? handle->auto_thresh : -1 );
+    i = (med_in + med_out) / 2;
+    if( handle->auto_thresh > 0 ) i = (handle->auto_thresh + i) / 2;
+    if( i < 1 ) i = 1;
+    handle->auto_thresh = i;
+
+    return( i );
+}
+
+ARUint8 *arBinarizeRegionCtx( ARHandle *handle, ARUint8 *image, int thresh,
+                              int x0, int y0, int x1, int y1 )
+{
+    ARUint8   *pnt, *mpnt;
+    int       *bthresh = NULL;
+    int       w, h, scale, bs, bx = 0, by = 0, bi, by_cur;
+    int       i, j;
+#if defined(BIN_RGB32) || defined(BIN_RGB24)
+	int		  thresht3;
+#endif
+
+    thresh = effective_thresh( handle, thresh );
+#if defined(BIN_RGB32) || defined(BIN_RGB24)
+    thresht3 = thresh * 3;
+#endif
+
+    w = x1 - x0 + 3;
+    h = y1 - y0 + 3;
+    if( w*h > handle->refine_mask_size ) {
+        arMemFree( handle->refine_mask );
+        arMallocTag( handle->refine_mask, ARUint8, w*h, AR_MEM_AR );
+        handle->refine_mask_size = w*h;
+    }
+    put_zero( handle->refine_mask, w*h );
+
+    // Reuse the block thresholds of the labeling pass of this frame.
+    scale = arGetLabelingScale( handle );
+    bs = AR_ADAPTIVE_THRESH_BLOCK;
+    if( handle->threshMode == AR_THRESHOLD_ADAPTIVE && handle->thresh_block != NULL ) {
+        bx = (handle->xsize/scale + bs - 1) / bs;
+        by = (handle->ysize/scale + bs - 1) / bs;
+        bthresh = &(handle->thresh_block[bx*by]);
+    }
+
+    for( j = y0; j <= y1; j++ ) {
+        pnt  = IMG_PIX( handle, image, x0, j );
+        mpnt = &(handle->refine_mask[(j-y0+1)*w + 1]);
+        if( bthresh != NULL ) {
+            by_cur = (j/scale)/bs;
+            if( by_cur > by-1 ) by_cur = by-1;
+            for( i = x0; i <= x1; i++, pnt += IMG_PIX_SIZE(handle) ) {
+                bi = (i/scale)/bs;
+                if( bi > bx-1 ) bi = bx-1;
+                *(mpnt++) = (IMG_LUM(handle, pnt) <= bthresh[by_cur*bx+bi])? 1: 0;
+            }
+        }
+        else if( handle->lumaStride ) {
+            for( i = x0; i <= x1; i++, pnt++ ) {
+                *(mpnt++) = (*pnt <= thresh)? 1: 0;
+            }
+        }
+        else if( !IMG_DEFAULT(handle) ) {
+            for( i = x0; i <= x1; i++, pnt += handle->pixSize ) {
+                *(mpnt++) = (pixel_lum(handle, pnt) <= thresh*BIN_LUM_SCALE)? 1: 0;
+            }
+        }
+        else {
+            for( i = x0; i <= x1; i++, pnt += AR_PIX_SIZE_DEFAULT ) {
+                *(mpnt++) = BIN_IS_DARK(pnt)? 1: 0;
+            }
+        }
+    }
+
+    return( handle->refine_mask );
+}
+
+int arSetBinaryImageCtx( ARHandle *handle, ARUint8 *bin_image )
+{
+    if( handle == NULL ) return -1;
+    handle->bin_given = bin_image;
+    return 0;
+}
+
+int arRefineLineCtx( ARHandle *handle, ARUint8 *image, double line[4][3], double vertex[4][2] )
+{
+    return refine_lines( handle, image, line, vertex, AR_EDGE_REFINE_RANGE, 0, 1 );
+}
+
+int arTrackLineCtx( ARHandle *handle, ARUint8 *image, double line[4][3], double vertex[4][2] )
+{
+    return refine_lines( handle, image, line, vertex, AR_TRACKING_RANGE, 1, 4 );
+}
+
+#define   REFINE_RANGE_MAX  ((AR_TRACKING_RANGE > AR_EDGE_REFINE_RANGE)? AR_TRACKING_RANGE: AR_EDGE_REFINE_RANGE)
+
+// Profiles of R pixels on each side of the edges. With outward set, only
+// edges getting brighter away from the centre of the marker are taken.
+// Unless at least need edges are fitted, nothing is changed.
+static int refine_lines( ARHandle *handle, ARUint8 *image, double line[4][3], double vertex[4][2],
+                         int R, int outward, int need )
+{
+    double    px[AR_EDGE_REFINE_SAMPLES], py[AR_EDGE_REFINE_SAMPLES], pw[AR_EDGE_REFINE_SAMPLES];
+    double    prof[2*REFINE_RANGE_MAX+1], g[2*REFINE_RANGE_MAX+1];
+    double    nline[4][3], nvertex[4][2];
+    double    ex, ey, len, t, ix, iy, ox, oy, nx, ny, d, s, gmax;
+    double    sw, mx, my, sxx, sxy, syy, a, b, w1;
+    double    xmax, ymax, cx, cy, sgn;
+    int       n, num, refined;
+    int       i, j, k, kmax;
+
+    xmax = handle->xsize - 1.001;
+    ymax = handle->ysize - 1.001;
+    cx = (vertex[0][0] + vertex[1][0] + vertex[2][0] + vertex[3][0]) / 4.0;
+    cy = (vertex[0][1] + vertex[1][1] + vertex[2][1] + vertex[3][1]) / 4.0;
+    refined = 0;
+    for( i = 0; i < 4; i++ ) {
+        for( k = 0; k < 3; k++ ) nline[i][k] = line[i][k];
+        sgn = (line[i][0]*cx + line[i][1]*cy + line[i][2] < 0.0)? 1.0: -1.0;
+
+        // Line i runs from vertex i to vertex i+1; the ends, where the
+        // neighbouring edges would be in the profiles, are left out.
+        ex  = vertex[(i+1)%4][0] - vertex[i][0];
+        ey  = vertex[(i+1)%4][1] - vertex[i][1];
+        len = sqrt( ex*ex + ey*ey );
+        n   = (int)(len / 2);
+        if( n > AR_EDGE_REFINE_SAMPLES ) n = AR_EDGE_REFINE_SAMPLES;
+        if( n < 4 ) continue;
+
+        num = 0;
+        for( j = 0; j < n; j++ ) {
+            t  = 0.1 + 0.8 * (j + 0.5) / n;
+            ix = vertex[i][0] + t * ex;
+            iy = vertex[i][1] + t * ey;
+            arParamIdeal2Observ( handle->dist_factor, ix, iy, &ox, &oy );
+            arParamIdeal2Observ( handle->dist_factor, ix + line[i][0], iy + line[i][1], &nx, &ny );
+            nx -= ox;
+            ny -= oy;
+            d = sqrt( nx*nx + ny*ny );
+            if( d == 0.0 ) continue;
+            nx /= d;
+            ny /= d;
+            if( ox - R*fabs(nx) < 0.0 || ox + R*fabs(nx) > xmax
+             || oy - R*fabs(ny) < 0.0 || oy + R*fabs(ny) > ymax ) continue;
+
+            for( k = -R; k <= R; k++ ) {
+                prof[k+R] = sample_lum( handle, image, ox + k*nx, oy + k*ny );
+            }
+            gmax = AR_EDGE_REFINE_CONTRAST * BIN_LUM_SCALE;
+            kmax = -1;
+            for( k = 1; k < 2*R; k++ ) {
+                g[k] = (outward)? sgn * (prof[k+1] - prof[k-1]): fabs( prof[k+1] - prof[k-1] );
+                if( g[k] > gmax ) {
+                    gmax = g[k];
+                    kmax = k;
+                }
+            }
+            // The peak needs a neighbour on each side for the parabola.
+            if( kmax < 2 || kmax > 2*R-2 ) continue;
+
+            d = g[kmax-1] - 2.0*g[kmax] + g[kmax+1];
+            s = kmax - R;
+            if( d < 0.0 ) s += 0.5 * (g[kmax-1] - g[kmax+1]) / d;
+            observ2ideal( handle, ox + s*nx, oy + s*ny, &px[num], &py[num] );
+            pw[num] = gmax;
+            num++;
+        }
+        if( num < 3 || num < n/2 ) continue;
+
+        sw = mx = my = 0.0;
+        for( j = 0; j < num; j++ ) {
+            sw += pw[j];
+            mx += pw[j] * px[j];
+            my += pw[j] * py[j];
+        }
+        mx /= sw;
+        my /= sw;
+        sxx = sxy = syy = 0.0;
+        for( j = 0; j < num; j++ ) {
+            sxx += pw[j] * (px[j] - mx) * (px[j] - mx);
+            sxy += pw[j] * (px[j] - mx) * (py[j] - my);
+            syy += pw[j] * (py[j] - my) * (py[j] - my);
+        }
+        // Normal of the principal axis, oriented like the line of arGetLine().
+        t = 0.5 * atan2( 2.0*sxy, sxx - syy );
+        a =  sin( t );
+        b = -cos( t );
+        if( a*line[i][0] + b*line[i][1] < 0.0 ) {
+            a = -a;
+            b = -b;
+        }
+        if( a*line[i][0] + b*line[i][1] < 0.99 ) continue;
+
+        nline[i][0] = a;
+        nline[i][1] = b;
+        nline[i][2] = -(a*mx + b*my);
+        refined++;
+    }
+    if( refined == 0 || refined < need ) return 0;
+
+    for( i = 0; i < 4; i++ ) {
+        w1 = nline[(i+3)%4][0] * nline[i][1] - nline[i][0] * nline[(i+3)%4][1];
+        if( w1 == 0.0 ) return 0;
+        nvertex[i][0] = (  nline[(i+3)%4][1] * nline[i][2]
+                         - nline[i][1] * nline[(i+3)%4][2] ) / w1;
+        nvertex[i][1] = (  nline[i][0] * nline[(i+3)%4][2]
+                         - nline[(i+3)%4][0] * nline[i][2] ) / w1;
+    }
+    for( i = 0; i < 4; i++ ) {
+        for( k = 0; k < 3; k++ ) line[i][k] = nline[i][k];
+        vertex[i][0] = nvertex[i][0];
+        vertex[i][1] = nvertex[i][1];
+    }
+
+    return refined;
+}
+
+// Brightness at a point inside the image, interpolated between the four
+// pixels around it, in BIN_LUM() units.
+static double sample_lum( ARHandle *handle, ARUint8 *image, double x, double y )
+{
+    ARUint8   *p;
+    double    ax, ay;
+    int       x0, y0, pix, row;
+
+    x0  = (int)x;
+    y0  = (int)y;
+    ax  = x - x0;
+    ay  = y - y0;
+    p   = IMG_PIX( handle, image, x0, y0 );
+    pix = IMG_PIX_SIZE( handle );
+    row = (handle->lumaStride)? handle->lumaStride: handle->xsize * handle->pixSize;
+
+    return (1.0-ay) * ((1.0-ax)*IMG_LUM(handle, p)     + ax*IMG_LUM(handle, p+pix))
+         +      ay  * ((1.0-ax)*IMG_LUM(handle, p+row) + ax*IMG_LUM(handle, p+row+pix));
+}
+
+// Brightness of a pixel of a luma plane or of an image in a format other
+// than the default one, in BIN_LUM() units.
+static int pixel_lum( ARHandle *handle, ARUint8 *p )
+{
+    int     *o = handle->pixOffset;
+
+    if( handle->lumaStride ) return p[0] * BIN_LUM_SCALE;
+    if( o[0] == o[2] )       return p[o[0]] * BIN_LUM_SCALE;
+    return (p[o[0]] + p[o[1]] + p[o[2]]) * BIN_LUM_SCALE / 3;
+}
+
+// Observed to ideal coordinates, through the lookup table if there is one.
+static void observ2ideal( ARHandle *handle, double ox, double oy, double *ix, double *iy )
+{
+    if( handle->undist.table != NULL ) arParamObserv2IdealLUT( &handle->undist, ox, oy, ix, iy );
+    else                               arParamObserv2Ideal( handle->dist_factor, ox, oy, ix, iy );
+}
+
+// The threshold actually used: in AR_THRESHOLD_AUTO mode, the one found
+// by arUpdateThresholdCtx() once there is one.
+static int effective_thresh( ARHandle *handle, int thresh )
+{
+    if( handle->threshMode == AR_THRESHOLD_AUTO && handle->auto_thresh > 0 ) {
+        return( handle->auto_thresh );
     }
+    return( thresh );
 }
 
-static ARInt16 *labeling2( ARUint8 *image, int thresh,
+static ARInt16 *labeling2( ARHandle *handle, ARUint8 *image, int thresh,
                            int *label_num, int **area, double **pos, int **clip,
-                           int **label_ref, int LorR )
+                           int **label_ref )
 {
-    ARUint8   *pnt;                     /*  image pointer       */
+    ARUint8   *bpnt;                    /*  binary image pointer */
     ARInt16   *pnt1, *pnt2;             /*  image pointer       */
     int       *wk;                      /*  pointer for work    */
     int       wk_max;                   /*  work                */
     int       m,n;                      /*  work                */
     int       i,j,k;                    /*  for loop            */
     int       lxsize, lysize;
-    int       poff;
     ARInt16   *l_image;
     int       *work, *work2;
     int       *wlabel_num;
     int       *warea;
     int       *wclip;
     double    *wpos;
+    int       xsize, scale;
+    int       j0, j1;
 #ifdef USE_OPTIMIZATIONS
 	int		  pnt2_index;   // [tp]
 #endif
-	int		  thresht3 = thresh * 3;
 
-	if (LorR) {
-        l_image = &l_imageL[0];
-        work    = &workL[0];
-        work2   = &work2L[0];
-        wlabel_num = &wlabel_numL;
-        warea   = &wareaL[0];
-        wclip   = &wclipL[0];
-        wpos    = &wposL[0];
-    } else {
-        l_image = &l_imageR[0];
-        work    = &workR[0];
-        work2   = &work2R[0];
-        wlabel_num = &wlabel_numR;
-        warea   = &wareaR[0];
-        wclip   = &wclipR[0];
-        wpos    = &wposR[0];
-    }
-
-    if (arImageProcMode == AR_IMAGE_PROC_IN_HALF) {
-        lxsize = arImXsize / 2;
-        lysize = arImYsize / 2;
-    } else {
-        lxsize = arImXsize;
-        lysize = arImYsize;
-    }
+    l_image    = handle->l_image;
+    work       = handle->work;
+    work2      = handle->work2;
+    wlabel_num = &(handle->wlabel_num);
+    warea      = handle->warea;
+    wclip      = handle->wclip;
+    wpos       = handle->wpos;
+    xsize      = handle->xsize;
+    scale      = arGetLabelingScale( handle );
+    lxsize     = xsize / scale;
+    lysize     = handle->ysize / scale;
 
     pnt1 = &l_image[0]; // Leftmost pixel of top row of image.
     pnt2 = &l_image[(lysize - 1)*lxsize]; // Leftmost pixel of bottom row of image.
@@ -212,39 +695,19 @@ static ARInt16 *labeling2( ARUint8 *image, int thresh,
     }
 #endif
 
+    binarize( handle, image, thresh );
+
+    // Rows outside the region of interest hold no dark pixels.
+    row_range( handle, lysize, &j0, &j1 );
+    for( j = 1; j < j0; j++ )        put_zero( &(l_image[j*lxsize]), lxsize*sizeof(ARInt16) );
+    for( j = j1; j < lysize-1; j++ ) put_zero( &(l_image[j*lxsize]), lxsize*sizeof(ARInt16) );
+
     wk_max = 0;
-    pnt2 = &(l_image[lxsize+1]);
-    if (arImageProcMode == AR_IMAGE_PROC_IN_HALF) {
-        pnt = &(image[(arImXsize*2+2)*AR_PIX_SIZE_DEFAULT]);
-        poff = AR_PIX_SIZE_DEFAULT*2;
-    } else {
-        pnt = &(image[(arImXsize+1)*AR_PIX_SIZE_DEFAULT]);
-        poff = AR_PIX_SIZE_DEFAULT;
-    }
-    for (j = 1; j < lysize - 1; j++, pnt += poff*2, pnt2 += 2) {
-        for(i = 1; i < lxsize-1; i++, pnt+=poff, pnt2++) {
-#if (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_ARGB)
-            if( *(pnt+1) + *(pnt+2) + *(pnt+3) <= thresht3 )
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_ABGR)
-            if( *(pnt+1) + *(pnt+2) + *(pnt+3) <= thresht3 )
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_BGRA)
-            if( *(pnt+0) + *(pnt+1) + *(pnt+2) <= thresht3 )
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_BGR)
-            if( *(pnt+0) + *(pnt+1) + *(pnt+2) <= thresht3 )
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_RGBA)
-            if( *(pnt+0) + *(pnt+1) + *(pnt+2) <= thresht3 )
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_RGB)
-            if( *(pnt+0) + *(pnt+1) + *(pnt+2) <= thresht3 )
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_MONO)
-			if( *(pnt) <= thresh )
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_2vuy)
-			if( *(pnt+1) <= thresh )
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_yuvs)
-			if( *(pnt+0) <= thresh )
-#else
-#  error Unknown default pixel format defined in config.h
-#endif
-			{
+    pnt2 = &(l_image[j0*lxsize+1]);
+    bpnt = &(handle->bin_image[j0*lxsize+1]);
+    for (j = j0; j < j1; j++, bpnt += 2, pnt2 += 2) {
+        for(i = 1; i < lxsize-1; i++, bpnt++, pnt2++) {
+            if( *bpnt ) {
                 pnt1 = &(pnt2[-lxsize]);
                 if( *pnt1 > 0 ) {
                     *pnt2 = *pnt1;
@@ -401,7 +864,7 @@ static ARInt16 *labeling2( ARUint8 *image, int thresh,
 				}
                 else {
                     wk_max++;
-                    if( wk_max > WORK_SIZE ) {
+                    if( wk_max > handle->work_size ) {
                         return(0);
                     }
                     work[wk_max-1] = *pnt2 = wk_max;
@@ -418,7 +881,6 @@ static ARInt16 *labeling2( ARUint8 *image, int thresh,
                 *pnt2 = 0;
             }
         }
-        if (arImageProcMode == AR_IMAGE_PROC_IN_HALF) pnt += arImXsize*AR_PIX_SIZE_DEFAULT;
     }
 
     j = 1;
@@ -462,18 +924,877 @@ static ARInt16 *labeling2( ARUint8 *image, int thresh,
     return (l_image);
 }
 
-static ARInt16 *labeling3( ARUint8 *image, int thresh,
+// Run based labeling.
+//
+// Each row of the binary image is split into runs of dark pixels. A run
+// takes the label of the 8-connected runs of the row above, merging their
+// labels in a union-find table (the smaller label stays the root), or opens
+// a new label. The run and label tables grow as needed. Since roots are the
+// first label opened for a component, final labels come out in the same
+// order as labeling2(), and so do area, pos and clip.
+//
+// With handle->threads > 1 the rows are cut into that many horizontal
+// bands, each binarized and labeled by its own thread into its own tables.
+// The bands are then merged: band labels get consecutive global numbers,
+// and runs touching across a seam are joined in a second union-find table
+// with the same smaller-is-root rule, so the final order does not change.
+//
+// run_buf  : x0, x1, y, label per run
+// run_label: parent, final label, area, min x, max x, min y, max y per label
+// run_sum  : sum x, sum y per label
+// band_merge: parent, final label per global label
+#define RUN_INTS    4
+#define LABEL_INTS  7
+
+typedef struct {
+    ARHandle    *handle;
+    ARLabelBand *band;
+    ARUint8     *image;
+    int          thresh;
+    int         *bthresh;
+    int          bx;
+    int          b0, b1;                /* rows to binarize */
+} BandJob;
+
+static void grow_runs( ARLabelBand *band, int need )
+{
+    int     n;
+
+    if( need <= band->run_max ) return;
+    n = (band->run_max > 0)? band->run_max*2: 1024;
+    while( n < need ) n *= 2;
+    band->run_buf = (int *)arMemRealloc( AR_MEM_AR, band->run_buf, n*RUN_INTS*sizeof(int) );
+    if( band->run_buf == NULL ) {printf("malloc error!!\n"); exit(1);}
+    band->run_max = n;
+}
+
+static void grow_labels( ARLabelBand *band, int need )
+{
+    int     n;
+
+    if( need <= band->run_label_max ) return;
+    n = (band->run_label_max > 0)? band->run_label_max*2: 1024;
+    while( n < need ) n *= 2;
+    band->run_label = (int *)arMemRealloc( AR_MEM_AR, band->run_label, n*LABEL_INTS*sizeof(int) );
+    band->run_sum   = (double *)arMemRealloc( AR_MEM_AR, band->run_sum, n*2*sizeof(double) );
+    if( band->run_label == NULL || band->run_sum == NULL ) {printf("malloc error!!\n"); exit(1);}
+    band->run_label_max = n;
+}
+
+static int run_find( int *lab, int l )
+{
+    while( lab[l*LABEL_INTS] != l ) {
+        lab[l*LABEL_INTS] = lab[lab[l*LABEL_INTS]*LABEL_INTS];
+        l = lab[l*LABEL_INTS];
+    }
+    return l;
+}
+
+static int merge_find( int *g, int l )
+{
+    while( g[l*2] != l ) {
+        g[l*2] = g[g[l*2]*2];
+        l = g[l*2];
+    }
+    return l;
+}
+
+// Label rows band->j0 to band->j1-1 of the binary image into the band's
+// own tables.
+static void label_band( ARHandle *handle, ARLabelBand *band )
+{
+    ARUint8   *bpnt;
+    int       *run, *lab;
+    int       lxsize;
+    int       run_num, lab_num;
+    int       prev_st, prev_ed, cur_st, scan;
+    int       x0, x1, len, l, r;
+    int       i, j, k;
+
+    lxsize = handle->xsize / arGetLabelingScale( handle );
+
+    run_num = lab_num = 0;
+    prev_st = prev_ed = 0;
+    for( j = band->j0; j < band->j1; j++ ) {
+        bpnt   = &(handle->bin_image[j*lxsize]);
+        cur_st = run_num;
+        scan   = prev_st;
+        i = 1;
+        while( i < lxsize-1 ) {
+            if( bpnt[i] == 0 ) { i++; continue; }
+            x0 = i;
+            while( i < lxsize-1 && bpnt[i] ) i++;
+            x1 = i - 1;
+            len = x1 - x0 + 1;
+
+            grow_runs( band, run_num+1 );
+            run = band->run_buf;
+            lab = band->run_label;
+
+            l = 0;
+            for( k = scan; k < prev_ed; k++ ) {
+                if( run[k*RUN_INTS+1] < x0-1 ) { scan = k+1; continue; }
+                if( run[k*RUN_INTS+0] > x1+1 ) break;
+                r = run_find( lab, run[k*RUN_INTS+3] );
+                if( l == 0 ) l = r;
+                else if( r < l ) { lab[l*LABEL_INTS] = r; l = r; }
+                else if( r > l ) { lab[r*LABEL_INTS] = l; }
+            }
+            if( l == 0 ) {
+                lab_num++;
+                grow_labels( band, lab_num+1 );
+                lab = band->run_label;
+                l = lab_num;
+                lab[l*LABEL_INTS+0] = l;
+                lab[l*LABEL_INTS+2] = 0;
+                lab[l*LABEL_INTS+3] = x0;
+                lab[l*LABEL_INTS+4] = x1;
+                lab[l*LABEL_INTS+5] = j;
+                band->run_sum[l*2+0] = 0.0;
+                band->run_sum[l*2+1] = 0.0;
+            }
+            else {
+                if( lab[l*LABEL_INTS+3] > x0 ) lab[l*LABEL_INTS+3] = x0;
+                if( lab[l*LABEL_INTS+4] < x1 ) lab[l*LABEL_INTS+4] = x1;
+            }
+            lab[l*LABEL_INTS+2] += len;
+            lab[l*LABEL_INTS+6]  = j;
+            band->run_sum[l*2+0] += (double)(x0 + x1) * len / 2.0;
+            band->run_sum[l*2+1] += (double)j * len;
+
+            run[run_num*RUN_INTS+0] = x0;
+            run[run_num*RUN_INTS+1] = x1;
+            run[run_num*RUN_INTS+2] = j;
+            run[run_num*RUN_INTS+3] = l;
+            run_num++;
+        }
+        prev_st = cur_st;
+        prev_ed = run_num;
+    }
+
+    band->run_num   = run_num;
+    band->label_num = lab_num;
+}
+
+// Worker body: binarize and clear the band's rows, then label them.
+static void do_band( BandJob *job )
+{
+    ARHandle  *handle = job->handle;
+    int       lxsize;
+
+    lxsize = handle->xsize / arGetLabelingScale( handle );
+    binarize_rows( handle, job->image, job->thresh, job->bthresh, job->bx, job->b0, job->b1 );
+    put_zero( (ARUint8 *)&(handle->l_image[job->b0*lxsize]),
+              (job->b1 - job->b0)*lxsize*sizeof(ARInt16) );
+    label_band( handle, job->band );
+}
+
+#ifdef _WIN32
+static unsigned __stdcall band_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_band( (BandJob *)arg );
+    return 0;
+}
+#else
+static void *band_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_band( (BandJob *)arg );
+    return NULL;
+}
+#endif
+
+// Binarize and label the bands on handle->threads threads, the calling
+// thread doing the first band. Falls back to the calling thread alone for
+// bands whose thread cannot be started.
+static void label_bands( ARHandle *handle, ARUint8 *image, int thresh, int band_num )
+{
+    BandJob   job[AR_LABELING_THREADS_MAX];
+#ifdef _WIN32
+    HANDLE    tid[AR_LABELING_THREADS_MAX];
+#else
+    pthread_t tid[AR_LABELING_THREADS_MAX];
+#endif
+    int       started[AR_LABELING_THREADS_MAX];
+    int       *bthresh = NULL;
+    int       lysize, bx = 0;
+    int       b;
+
+    lysize = handle->ysize / arGetLabelingScale( handle );
+
+    if( handle->threshMode == AR_THRESHOLD_ADAPTIVE ) {
+        bthresh = adaptive_thresholds( handle, image, &bx );
+    }
+
+    for( b = 0; b < band_num; b++ ) {
+        handle->band[b].j0 = 1 + (lysize-2) *  b    / band_num;
+        handle->band[b].j1 = 1 + (lysize-2) * (b+1) / band_num;
+        job[b].handle  = handle;
+        job[b].band    = &(handle->band[b]);
+        job[b].image   = image;
+        job[b].thresh  = thresh;
+        job[b].bthresh = bthresh;
+        job[b].bx      = bx;
+        job[b].b0      = (b == 0)?          0:      handle->band[b].j0;
+        job[b].b1      = (b == band_num-1)? lysize: handle->band[b].j1;
+    }
+
+    for( b = 1; b < band_num; b++ ) {
+#ifdef _WIN32
+        tid[b] = (HANDLE)_beginthreadex( NULL, 0, band_thread, &job[b], 0, NULL );
+        started[b] = (tid[b] != 0);
+#else
+        started[b] = (pthread_create( &tid[b], NULL, band_thread, &job[b] ) == 0);
+#endif
+    }
+    do_band( &job[0] );
+    for( b = 1; b < band_num; b++ ) {
+        if( !started[b] ) {
+            do_band( &job[b] );
+            continue;
+        }
+#ifdef _WIN32
+        WaitForSingleObject( tid[b], INFINITE );
+        CloseHandle( tid[b] );
+#else
+        pthread_join( tid[b], NULL );
+#endif
+    }
+}
+
+static ARInt16 *labeling_run( ARHandle *handle, ARUint8 *image, int thresh,
+                              int *label_num, int **area, double **pos, int **clip,
+                              int **label_ref )
+{
+    ARLabelBand *band;
+    ARInt16   *lpnt;                    /*  label image pointer  */
+    int       offset[AR_LABELING_THREADS_MAX];
+    int       *run, *lab, *g;
+    double    *sum;
+    int       lxsize, lysize;
+    int       band_num, total;
+    int       up, up_ed, k0, k1;
+    int       l, r, f, n;
+    int       i, j, k, b;
+
+    lxsize = handle->xsize / arGetLabelingScale( handle );
+    lysize = handle->ysize / arGetLabelingScale( handle );
+
+    band_num = handle->threads;
+    if( band_num > AR_LABELING_THREADS_MAX ) band_num = AR_LABELING_THREADS_MAX;
+    if( band_num > (lysize-2) / AR_LABELING_BAND_MIN ) band_num = (lysize-2) / AR_LABELING_BAND_MIN;
+    if( band_num < 1 || handle->roi_num > 0 || handle->bin_given != NULL ) band_num = 1;
+
+    if( band_num == 1 ) {
+        binarize( handle, image, thresh );
+        put_zero( (ARUint8 *)handle->l_image, lxsize*lysize*sizeof(ARInt16) );
+        row_range( handle, lysize, &(handle->band[0].j0), &(handle->band[0].j1) );
+        label_band( handle, &(handle->band[0]) );
+    }
+    else {
+        label_bands( handle, image, thresh, band_num );
+        put_zero( (ARUint8 *)handle->l_image, lxsize*sizeof(ARInt16) );
+        put_zero( (ARUint8 *)&(handle->l_image[(lysize-1)*lxsize]), lxsize*sizeof(ARInt16) );
+    }
+
+    // Global numbering: label l of band b is offset[b] + l.
+    total = 0;
+    for( b = 0; b < band_num; b++ ) {
+        offset[b] = total;
+        total += handle->band[b].label_num;
+    }
+    if( total+1 > handle->band_merge_max ) {
+        arMemFree( handle->band_merge );
+        arMallocTag( handle->band_merge, int, (total+1)*2, AR_MEM_AR );
+        handle->band_merge_max = total+1;
+    }
+    g = handle->band_merge;
+    for( b = 0; b < band_num; b++ ) {
+        band = &(handle->band[b]);
+        for( l = 1; l <= band->label_num; l++ ) {
+            g[(offset[b]+l)*2] = offset[b] + run_find( band->run_label, l );
+        }
+    }
+
+    // Join the runs of the last row of each band with the 8-connected runs
+    // of the first row of the next one.
+    for( b = 1; b < band_num; b++ ) {
+        band  = &(handle->band[b-1]);
+        up_ed = band->run_num;
+        for( up = up_ed; up > 0 && band->run_buf[(up-1)*RUN_INTS+2] == handle->band[b].j0-1; up-- );
+        run = handle->band[b].run_buf;
+        for( k0 = 0; k0 < handle->band[b].run_num && run[k0*RUN_INTS+2] == handle->band[b].j0; k0++ ) {
+            for( k1 = up; k1 < up_ed; k1++ ) {
+                if( band->run_buf[k1*RUN_INTS+1] < run[k0*RUN_INTS+0]-1 ) { up = k1+1; continue; }
+                if( band->run_buf[k1*RUN_INTS+0] > run[k0*RUN_INTS+1]+1 ) break;
+                l = merge_find( g, offset[b-1] + band->run_buf[k1*RUN_INTS+3] );
+                r = merge_find( g, offset[b]   + run[k0*RUN_INTS+3] );
+                if( r < l )      g[l*2] = r;
+                else if( l < r ) g[r*2] = l;
+            }
+        }
+    }
+
+    // Parents are always smaller than their children, so one ascending
+    // pass flattens the table and numbers the roots.
+    *label_num = handle->wlabel_num = 0;
+    for( l = 1; l <= total; l++ ) {
+        r = g[l*2];
+        if( r == l ) {
+            if( handle->wlabel_num == handle->work_size ) return(0);
+            g[l*2+1] = ++handle->wlabel_num;
+        }
+        else {
+            r = g[r*2];
+            g[l*2+0] = r;
+            g[l*2+1] = g[r*2+1];
+        }
+    }
+    *label_num = handle->wlabel_num;
+
+    if( *label_num == 0 ) {
+        return( handle->l_image );
+    }
+
+    put_zero( (ARUint8 *)handle->warea, *label_num *     sizeof(int) );
+    put_zero( (ARUint8 *)handle->wpos,  *label_num * 2 * sizeof(double) );
+    for( i = 0; i < *label_num; i++ ) {
+        handle->work[i]        = i + 1;
+        handle->wclip[i*4+0]   = lxsize;
+        handle->wclip[i*4+1]   = 0;
+        handle->wclip[i*4+2]   = lysize;
+        handle->wclip[i*4+3]   = 0;
+    }
+    for( b = 0; b < band_num; b++ ) {
+        band = &(handle->band[b]);
+        lab  = band->run_label;
+        sum  = band->run_sum;
+        for( l = 1; l <= band->label_num; l++ ) {
+            j = g[(offset[b]+l)*2+1] - 1;
+            handle->warea[j]    += lab[l*LABEL_INTS+2];
+            handle->wpos[j*2+0] += sum[l*2+0];
+            handle->wpos[j*2+1] += sum[l*2+1];
+            if( handle->wclip[j*4+0] > lab[l*LABEL_INTS+3] ) handle->wclip[j*4+0] = lab[l*LABEL_INTS+3];
+            if( handle->wclip[j*4+1] < lab[l*LABEL_INTS+4] ) handle->wclip[j*4+1] = lab[l*LABEL_INTS+4];
+            if( handle->wclip[j*4+2] > lab[l*LABEL_INTS+5] ) handle->wclip[j*4+2] = lab[l*LABEL_INTS+5];
+            if( handle->wclip[j*4+3] < lab[l*LABEL_INTS+6] ) handle->wclip[j*4+3] = lab[l*LABEL_INTS+6];
+        }
+    }
+    for( i = 0; i < *label_num; i++ ) {
+        handle->wpos[i*2+0] /= handle->warea[i];
+        handle->wpos[i*2+1] /= handle->warea[i];
+    }
+
+    for( b = 0; b < band_num; b++ ) {
+        band = &(handle->band[b]);
+        run  = band->run_buf;
+        n    = band->run_num;
+        for( k = 0; k < n; k++ ) {
+            f    = g[(offset[b]+run[k*RUN_INTS+3])*2+1];
+            lpnt = &(handle->l_image[run[k*RUN_INTS+2]*lxsize + run[k*RUN_INTS+0]]);
+            for( i = run[k*RUN_INTS+0]; i <= run[k*RUN_INTS+1]; i++ ) *(lpnt++) = (ARInt16)f;
+        }
+    }
+
+    *label_ref = handle->work;
+    *area      = handle->warea;
+    *pos       = handle->wpos;
+    *clip      = handle->wclip;
+    return( handle->l_image );
+}
+
+// Label image rows j0 to j1-1 may hold dark pixels: the rows spanned by
+// the region of interest, or the whole image less its border.
+static void row_range( ARHandle *handle, int lysize, int *j0, int *j1 )
+{
+    int       step;
+
+    step = arGetLabelingScale( handle );
+    *j0 = 1;
+    *j1 = lysize - 1;
+    if( handle->roi_num > 0 ) {
+        if( handle->roi_y0/step > *j0 )   *j0 = handle->roi_y0/step;
+        if( handle->roi_y1/step+1 < *j1 ) *j1 = handle->roi_y1/step + 1;
+        if( *j1 < *j0 )                   *j1 = *j0;
+    }
+}
+
+// Fill handle->bin_image with 0xFF for dark pixels and 0 otherwise, at
+// label image resolution. In full resolution mode with a global threshold
+// the rows are processed as one run of pixels; otherwise it is done row by
+// row. When a region of interest is set, only its rectangles are binarized
+// and the rest of the binary image is left clear. A binary image given with
+// arSetBinaryImageCtx() is taken instead, with a manual threshold and no
+// region of interest, and dropped otherwise.
+static void binarize( ARHandle *handle, ARUint8 *image, int thresh )
+{
+    ARUint8   *bin;
+    int       *bthresh = NULL;
+    int       lxsize, lysize, step, bx = 0;
+    int       x0, x1, y0, y1;
+    int       i, j;
+
+    step   = arGetLabelingScale( handle );
+    lxsize = handle->xsize / step;
+    lysize = handle->ysize / step;
+
+    // Binarized already, e.g. by arglBinarize().
+    if( handle->bin_given != NULL ) {
+        bin = handle->bin_given;
+        handle->bin_given = NULL;
+        if( handle->threshMode == AR_THRESHOLD_MANUAL && handle->roi_num == 0 ) {
+            memcpy( handle->bin_image, bin, lxsize*lysize );
+            return;
+        }
+    }
+
+    if( handle->threshMode == AR_THRESHOLD_ADAPTIVE ) {
+        bthresh = adaptive_thresholds( handle, image, &bx );
+    }
+
+    if( handle->roi_num > 0 ) {
+        put_zero( handle->bin_image, lxsize*lysize );
+        for( i = 0; i < handle->roi_num; i++ ) {
+            x0 = handle->roi[i][0] / step;
+            x1 = handle->roi[i][1] / step;
+            y0 = handle->roi[i][2] / step;
+            y1 = handle->roi[i][3] / step;
+            if( x1 >= lxsize ) x1 = lxsize - 1;
+            if( y1 >= lysize ) y1 = lysize - 1;
+            for( j = y0; j <= y1; j++ ) {
+                binarize_row( handle, image, thresh, bthresh, bx, j, x0, x1 );
+            }
+        }
+    }
+    else {
+        binarize_rows( handle, image, thresh, bthresh, bx, 0, lysize );
+    }
+}
+
+// Binarize rows j0 to j1-1 of the label image in full.
+static void binarize_rows( ARHandle *handle, ARUint8 *image, int thresh,
+                           int *bthresh, int bx, int j0, int j1 )
+{
+    ARUint8   *pnt;
+    int       lxsize, step;
+    int       i, j, n;
+
+    step   = arGetLabelingScale( handle );
+    lxsize = handle->xsize / step;
+
+    if( bthresh == NULL && step == 1 && IMG_DEFAULT(handle) ) {
+        n   = lxsize * (j1 - j0);
+        pnt = &(image[j0*lxsize*AR_PIX_SIZE_DEFAULT]);
+        i = binarize_simd( pnt, n, thresh, &(handle->bin_image[j0*lxsize]) );
+        binarize_tail( pnt, i, n, thresh, &(handle->bin_image[j0*lxsize]) );
+    }
+    else {
+        for( j = j0; j < j1; j++ ) {
+            binarize_row( handle, image, thresh, bthresh, bx, j, 0, lxsize-1 );
+        }
+    }
+}
+
+// Binarize pixels x0 to x1 (inclusive) of row j of the label image.
+static void binarize_row( ARHandle *handle, ARUint8 *image, int thresh,
+                          int *bthresh, int bx, int j, int x0, int x1 )
+{
+    ARUint8   *pnt, *bpnt;
+    const PixelKernel *k;
+    int       lxsize, step, bs;
+    int       i, e, t;
+#if defined(BIN_RGB32) || defined(BIN_RGB24)
+	int		  thresht3 = thresh * 3;
+#endif
+
+    step   = arGetLabelingScale( handle );
+    lxsize = handle->xsize / step;
+    bpnt = &(handle->bin_image[j*lxsize]);
+    pnt  = IMG_PIX( handle, image, x0*step, j*step );
+
+    if( handle->lumaStride ) {
+        if( bthresh != NULL ) {
+            bs = AR_ADAPTIVE_THRESH_BLOCK;
+            for( i = x0; i <= x1; ) {
+                t = bthresh[(j/bs)*bx + i/bs];
+                e = (i/bs + 1)*bs - 1;
+                if( e > x1 ) e = x1;
+                for( ; i <= e; i++, pnt += step ) {
+                    bpnt[i] = (*pnt * BIN_LUM_SCALE <= t)? 0xFF: 0;
+                }
+            }
+        }
+        else {
+            binarize_luma( pnt, x1-x0+1, step, thresh, &bpnt[x0] );
+        }
+    }
+    else if( !IMG_DEFAULT(handle) ) {
+        k = &pixel_kernels[handle->pixFormat];
+        if( bthresh != NULL ) {
+            bs = AR_ADAPTIVE_THRESH_BLOCK;
+            for( i = x0; i <= x1; i = e+1 ) {
+                e = (i/bs + 1)*bs - 1;
+                if( e > x1 ) e = x1;
+                k->bin( pnt, e-i+1, step, bthresh[(j/bs)*bx + i/bs], &bpnt[i] );
+                pnt += (e-i+1) * handle->pixSize * step;
+            }
+        }
+        else {
+            k->bin( pnt, x1-x0+1, step, thresh*BIN_LUM_SCALE, &bpnt[x0] );
+        }
+    }
+    else if( bthresh != NULL ) {
+        bs = AR_ADAPTIVE_THRESH_BLOCK;
+        for( i = x0; i <= x1; ) {
+            t = bthresh[(j/bs)*bx + i/bs];
+            e = (i/bs + 1)*bs - 1;
+            if( e > x1 ) e = x1;
+            for( ; i <= e; i++, pnt += AR_PIX_SIZE_DEFAULT*step ) {
+                bpnt[i] = (BIN_LUM(pnt) <= t)? 0xFF: 0;
+            }
+        }
+    }
+    else if( step == 1 ) {
+        i = binarize_simd( pnt, x1-x0+1, thresh, &bpnt[x0] );
+        binarize_tail( pnt, i, x1-x0+1, thresh, &bpnt[x0] );
+    }
+    else {
+        for( i = x0; i <= x1; i++, pnt += AR_PIX_SIZE_DEFAULT*step ) {
+            bpnt[i] = BIN_IS_DARK(pnt)? 0xFF: 0;
+        }
+    }
+}
+
+// Scalar binarization of pixels i to n-1 of a run of pixels.
+static void binarize_tail( ARUint8 *image, int i, int n, int thresh, ARUint8 *mask )
+{
+    ARUint8   *pnt;
+#if defined(BIN_RGB32) || defined(BIN_RGB24)
+	int		  thresht3 = thresh * 3;
+#endif
+
+    for( pnt = &(image[i*AR_PIX_SIZE_DEFAULT]); i < n; i++, pnt += AR_PIX_SIZE_DEFAULT ) {
+        mask[i] = BIN_IS_DARK(pnt) ? 0xFF : 0;
+    }
+}
+
+// Binarize n pixels of a line of a luma plane, taking every step-th byte.
+static void binarize_luma( ARUint8 *luma, int n, int step, int thresh, ARUint8 *mask )
+{
+    int       i = 0;
+
+    if( thresh < 0 ) {
+        put_zero( mask, n );
+        return;
+    }
+    if( thresh > 255 ) thresh = 255;
+#if defined(AR_BINARIZE_SSE2)
+    if( step == 1 ) {
+        const __m128i  t = _mm_set1_epi8( (char)thresh );
+        __m128i        v;
+
+        for( ; i + 16 <= n; i += 16 ) {
+            v = _mm_loadu_si128( (const __m128i *)(luma + i) );
+            _mm_storeu_si128( (__m128i *)(mask + i), _mm_cmpeq_epi8( _mm_min_epu8(v, t), v ) );
+        }
+    }
+#elif defined(AR_BINARIZE_NEON)
+    if( step == 1 ) {
+        const uint8x16_t  t = vdupq_n_u8( (uint8_t)thresh );
+
+        for( ; i + 16 <= n; i += 16 ) {
+            vst1q_u8( mask + i, vcleq_u8( vld1q_u8(luma + i), t ) );
+        }
+    }
+#endif
+    for( ; i < n; i++ ) {
+        mask[i] = (luma[i*step] <= thresh)? 0xFF: 0;
+    }
+}
+
+// Thresholds for local thresholding. The label image is cut into square
+// blocks of AR_ADAPTIVE_THRESH_BLOCK pixels and a pixel is dark when it is
+// more than AR_ADAPTIVE_THRESH_BIAS grey levels below the mean of the 3x3
+// blocks centred on its own. Returns one threshold per block, bx per row.
+static int *adaptive_thresholds( ARHandle *handle, ARUint8 *image, int *bx_out )
+{
+    ARUint8   *pnt;
+    int       *bmean, *bthresh;
+    int       lxsize, lysize, step, bs, bx, by;
+    int       i, j, k, l, m, n, w, h, sum;
+
+    step   = arGetLabelingScale( handle );
+    lxsize = handle->xsize / step;
+    lysize = handle->ysize / step;
+
+    bs = AR_ADAPTIVE_THRESH_BLOCK;
+    bx = (lxsize + bs - 1) / bs;
+    by = (lysize + bs - 1) / bs;
+    if( bx*by*2 > handle->thresh_block_size ) {
+        arMemFree( handle->thresh_block );
+        arMallocTag( handle->thresh_block, int, bx*by*2, AR_MEM_AR );
+        handle->thresh_block_size = bx*by*2;
+    }
+    bmean   = handle->thresh_block;
+    bthresh = &(handle->thresh_block[bx*by]);
+    put_zero( bmean, bx*by*sizeof(int) );
+
+    for( j = 0; j < lysize; j++ ) {
+        pnt = IMG_PIX( handle, image, 0, j*step );
+        for( k = 0; k < bx; k++ ) {
+            w = (k == bx-1)? lxsize - k*bs: bs;
+            if( handle->lumaStride ) {
+                for( i = sum = 0; i < w; i++, pnt += step ) {
+                    sum += *pnt;
+                }
+                sum *= BIN_LUM_SCALE;
+            }
+            else if( !IMG_DEFAULT(handle) ) {
+                sum = pixel_kernels[handle->pixFormat].sum( pnt, w, step );
+                pnt += w * handle->pixSize * step;
+            }
+            else {
+                for( i = sum = 0; i < w; i++, pnt += AR_PIX_SIZE_DEFAULT*step ) {
+                    sum += BIN_LUM(pnt);
+                }
+            }
+            bmean[(j/bs)*bx+k] += sum;
+        }
+    }
+    for( l = 0; l < by; l++ ) {
+        h = (l == by-1)? lysize - l*bs: bs;
+        for( k = 0; k < bx; k++ ) {
+            w = (k == bx-1)? lxsize - k*bs: bs;
+            bmean[l*bx+k] /= w*h;
+        }
+    }
+    for( l = 0; l < by; l++ ) {
+        for( k = 0; k < bx; k++ ) {
+            sum = n = 0;
+            for( m = l-1; m <= l+1; m++ ) {
+                if( m < 0 || m >= by ) continue;
+                for( i = k-1; i <= k+1; i++ ) {
+                    if( i < 0 || i >= bx ) continue;
+                    sum += bmean[m*bx+i];
+                    n++;
+                }
+            }
+            bthresh[l*bx+k] = sum / n - AR_ADAPTIVE_THRESH_BIAS*BIN_LUM_SCALE;
+        }
+    }
+
+    *bx_out = bx;
+    return bthresh;
+}
+
+// Binarize as many leading pixels as the vector unit can handle, 16 at
+// a time, 32 with AVX2. Returns the number of pixels done; the caller
+// finishes the rest. Through binarize_simd, for the CPU.
+static int binarize_c( ARUint8 *image, int pixnum, int thresh, ARUint8 *mask )
+{
+    return 0;
+}
+
+#if defined(AR_BINARIZE_SSE2) && !defined(BIN_RGB24)
+static int binarize_sse2( ARUint8 *image, int pixnum, int thresh, ARUint8 *mask )
+{
+    int       n = 0;
+
+#  if defined(BIN_RGB32)
+    const __m128i  lo8 = _mm_set1_epi32( 0xFF );
+    const __m128i  t3  = _mm_set1_epi32( thresh*3 + 1 );
+    __m128i        v, s, r0, r1, r2, r3;
+
+#    define BIN_SUM32(V) _mm_add_epi32( _mm_add_epi32( \
+        _mm_and_si128( _mm_srli_epi32( (V), BIN_RGB32*8    ), lo8 ), \
+        _mm_and_si128( _mm_srli_epi32( (V), BIN_RGB32*8+8  ), lo8 ) ), \
+        _mm_and_si128( _mm_srli_epi32( (V), BIN_RGB32*8+16 ), lo8 ) )
+    for( ; n + 16 <= pixnum; n += 16, image += 64, mask += 16 ) {
+        v = _mm_loadu_si128( (const __m128i *)(image +  0) ); s = BIN_SUM32(v); r0 = _mm_cmplt_epi32( s, t3 );
+        v = _mm_loadu_si128( (const __m128i *)(image + 16) ); s = BIN_SUM32(v); r1 = _mm_cmplt_epi32( s, t3 );
+        v = _mm_loadu_si128( (const __m128i *)(image + 32) ); s = BIN_SUM32(v); r2 = _mm_cmplt_epi32( s, t3 );
+        v = _mm_loadu_si128( (const __m128i *)(image + 48) ); s = BIN_SUM32(v); r3 = _mm_cmplt_epi32( s, t3 );
+        _mm_storeu_si128( (__m128i *)mask,
+                          _mm_packs_epi16( _mm_packs_epi32(r0, r1), _mm_packs_epi32(r2, r3) ) );
+    }
+#    undef BIN_SUM32
+
+#  else
+    __m128i        t, v;
+#    if defined(BIN_YUV422)
+    __m128i        v1;
+#      if (BIN_YUV422 != 1)
+    const __m128i  lo8 = _mm_set1_epi16( 0xFF );
+#      endif
+#    endif
+
+    if( thresh < 0 || thresh > 255 ) return 0;
+    t = _mm_set1_epi8( (char)thresh );
+#    if defined(BIN_MONO)
+    for( ; n + 16 <= pixnum; n += 16, image += 16, mask += 16 ) {
+        v = _mm_loadu_si128( (const __m128i *)image );
+#    else
+    for( ; n + 16 <= pixnum; n += 16, image += 32, mask += 16 ) {
+        v  = _mm_loadu_si128( (const __m128i *)(image +  0) );
+        v1 = _mm_loadu_si128( (const __m128i *)(image + 16) );
+#      if (BIN_YUV422 == 1)
+        v  = _mm_packus_epi16( _mm_srli_epi16(v, 8), _mm_srli_epi16(v1, 8) );
+#      else
+        v  = _mm_packus_epi16( _mm_and_si128(v, lo8), _mm_and_si128(v1, lo8) );
+#      endif
+#    endif
+        // v <= t  <=>  min(v, t) == v, for unsigned bytes.
+        _mm_storeu_si128( (__m128i *)mask, _mm_cmpeq_epi8( _mm_min_epu8(v, t), v ) );
+    }
+#  endif
+
+    return n;
+}
+#endif
+
+#if defined(AR_BINARIZE_SSSE3) && defined(BIN_RGB24)
+AR_CPU_TARGET("ssse3")
+static int binarize_ssse3( ARUint8 *image, int pixnum, int thresh, ARUint8 *mask )
+{
+    const __m128i  zero = _mm_setzero_si128();
+    const __m128i  t3   = _mm_set1_epi16( (short)(thresh*3 + 1) );
+    ARUint8        ctl[3][3][16];
+    __m128i        shuf[3][3];
+    __m128i        v0, v1, v2, ch[3], lo, hi;
+    int            n = 0;
+    int            c, r, i, k;
+
+    // shuf[c][r] gathers byte c of each pixel held in input register r.
+    for( c = 0; c < 3; c++ ) {
+        for( r = 0; r < 3; r++ ) {
+            for( i = 0; i < 16; i++ ) {
+                k = 3*i + c - 16*r;
+                ctl[c][r][i] = (k >= 0 && k < 16) ? (ARUint8)k : 0x80;
+            }
+            shuf[c][r] = _mm_loadu_si128( (const __m128i *)ctl[c][r] );
+        }
+    }
+    for( ; n + 16 <= pixnum; n += 16, image += 48, mask += 16 ) {
+        v0 = _mm_loadu_si128( (const __m128i *)(image +  0) );
+        v1 = _mm_loadu_si128( (const __m128i *)(image + 16) );
+        v2 = _mm_loadu_si128( (const __m128i *)(image + 32) );
+        for( c = 0; c < 3; c++ ) {
+            ch[c] = _mm_or_si128( _mm_or_si128( _mm_shuffle_epi8(v0, shuf[c][0]),
+                                                _mm_shuffle_epi8(v1, shuf[c][1]) ),
+                                                _mm_shuffle_epi8(v2, shuf[c][2]) );
+        }
+        lo = _mm_add_epi16( _mm_add_epi16( _mm_unpacklo_epi8(ch[0], zero),
+                                           _mm_unpacklo_epi8(ch[1], zero) ),
+                                           _mm_unpacklo_epi8(ch[2], zero) );
+        hi = _mm_add_epi16( _mm_add_epi16( _mm_unpackhi_epi8(ch[0], zero),
+                                           _mm_unpackhi_epi8(ch[1], zero) ),
+                                           _mm_unpackhi_epi8(ch[2], zero) );
+        _mm_storeu_si128( (__m128i *)mask,
+                          _mm_packs_epi16( _mm_cmplt_epi16(lo, t3), _mm_cmplt_epi16(hi, t3) ) );
+    }
+
+    return n;
+}
+#endif
+
+#if defined(AR_BINARIZE_AVX2) && (defined(BIN_RGB32) || defined(BIN_MONO))
+AR_CPU_TARGET("avx2")
+static int binarize_avx2( ARUint8 *image, int pixnum, int thresh, ARUint8 *mask )
+{
+    int       n = 0;
+
+#  if defined(BIN_RGB32)
+    const __m256i  lo8 = _mm256_set1_epi32( 0xFF );
+    const __m256i  t3  = _mm256_set1_epi32( thresh*3 + 1 );
+    // The packs go within each 128 bit lane; this puts the groups of four
+    // pixels back in order.
+    const __m256i  order = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+    __m256i        v, s, r0, r1, r2, r3;
+
+#    define BIN_SUM32(V) _mm256_add_epi32( _mm256_add_epi32( \
+        _mm256_and_si256( _mm256_srli_epi32( (V), BIN_RGB32*8    ), lo8 ), \
+        _mm256_and_si256( _mm256_srli_epi32( (V), BIN_RGB32*8+8  ), lo8 ) ), \
+        _mm256_and_si256( _mm256_srli_epi32( (V), BIN_RGB32*8+16 ), lo8 ) )
+    for( ; n + 32 <= pixnum; n += 32, image += 128, mask += 32 ) {
+        v = _mm256_loadu_si256( (const __m256i *)(image +  0) ); s = BIN_SUM32(v); r0 = _mm256_cmpgt_epi32( t3, s );
+        v = _mm256_loadu_si256( (const __m256i *)(image + 32) ); s = BIN_SUM32(v); r1 = _mm256_cmpgt_epi32( t3, s );
+        v = _mm256_loadu_si256( (const __m256i *)(image + 64) ); s = BIN_SUM32(v); r2 = _mm256_cmpgt_epi32( t3, s );
+        v = _mm256_loadu_si256( (const __m256i *)(image + 96) ); s = BIN_SUM32(v); r3 = _mm256_cmpgt_epi32( t3, s );
+        v = _mm256_packs_epi16( _mm256_packs_epi32(r0, r1), _mm256_packs_epi32(r2, r3) );
+        _mm256_storeu_si256( (__m256i *)mask, _mm256_permutevar8x32_epi32(v, order) );
+    }
+#    undef BIN_SUM32
+
+#  else
+    __m256i        t, v;
+
+    if( thresh < 0 || thresh > 255 ) return 0;
+    t = _mm256_set1_epi8( (char)thresh );
+    for( ; n + 32 <= pixnum; n += 32, image += 32, mask += 32 ) {
+        v = _mm256_loadu_si256( (const __m256i *)image );
+        _mm256_storeu_si256( (__m256i *)mask, _mm256_cmpeq_epi8( _mm256_min_epu8(v, t), v ) );
+    }
+#  endif
+
+    return n;
+}
+#endif
+
+#if defined(AR_BINARIZE_NEON)
+static int binarize_neon( ARUint8 *image, int pixnum, int thresh, ARUint8 *mask )
+{
+    int       n = 0;
+
+#  if defined(BIN_RGB32) || defined(BIN_RGB24)
+    const uint16x8_t  t3 = vdupq_n_u16( (uint16_t)(thresh*3) );
+    uint8x16_t        a, b, c;
+    uint16x8_t        lo, hi;
+
+    if( thresh < 0 ) return 0;
+    for( ; n + 16 <= pixnum; n += 16, image += 16*AR_PIX_SIZE_DEFAULT, mask += 16 ) {
+#    if defined(BIN_RGB32)
+        uint8x16x4_t  v = vld4q_u8( image );
+        a = v.val[BIN_RGB32]; b = v.val[BIN_RGB32+1]; c = v.val[BIN_RGB32+2];
+#    else
+        uint8x16x3_t  v = vld3q_u8( image );
+        a = v.val[0]; b = v.val[1]; c = v.val[2];
+#    endif
+        lo = vaddw_u8( vaddl_u8( vget_low_u8(a),  vget_low_u8(b)  ), vget_low_u8(c)  );
+        hi = vaddw_u8( vaddl_u8( vget_high_u8(a), vget_high_u8(b) ), vget_high_u8(c) );
+        vst1q_u8( mask, vcombine_u8( vmovn_u16( vcleq_u16(lo, t3) ), vmovn_u16( vcleq_u16(hi, t3) ) ) );
+    }
+
+#  else
+    uint8x16_t        t, v;
+
+    if( thresh < 0 || thresh > 255 ) return 0;
+    t = vdupq_n_u8( (uint8_t)thresh );
+    for( ; n + 16 <= pixnum; n += 16, image += 16*AR_PIX_SIZE_DEFAULT, mask += 16 ) {
+#    if defined(BIN_MONO)
+        v = vld1q_u8( image );
+#    else
+        v = vld2q_u8( image ).val[BIN_YUV422];
+#    endif
+        vst1q_u8( mask, vcleq_u8(v, t) );
+    }
+#  endif
+
+    return n;
+}
+#endif
+
+static ARInt16 *labeling3( ARHandle *handle, ARUint8 *image, int thresh,
                            int *label_num, int **area, double **pos, int **clip,
-                           int **label_ref, int LorR )
+                           int **label_ref )
 {
-    ARUint8   *pnt;                     /*  image pointer       */
+    ARUint8   *bpnt;                    /*  binary image pointer */
     ARInt16   *pnt1, *pnt2;             /*  image pointer       */
     int       *wk;                      /*  pointer for work    */
     int       wk_max;                   /*  work                */
     int       m,n;                      /*  work                */
     int       i,j,k;                    /*  for loop            */
     int       lxsize, lysize;
-    int       poff;
     ARUint8   *dpnt;
     ARInt16   *l_image;
     int       *work, *work2;
@@ -481,73 +1802,36 @@ static ARInt16 *labeling3( ARUint8 *image, int thresh,
     int       *warea;
     int       *wclip;
     double    *wpos;
-	int		  thresht3 = thresh * 3;
-	static int imageProcModePrev = -1;
-	static int imXsizePrev = -1;
-	static int imYsizePrev = -1;
+    int       xsize, scale;
+
+    l_image    = handle->l_image;
+    work       = handle->work;
+    work2      = handle->work2;
+    wlabel_num = &(handle->wlabel_num);
+    warea      = handle->warea;
+    wclip      = handle->wclip;
+    wpos       = handle->wpos;
+    xsize      = handle->xsize;
+    scale      = arGetLabelingScale( handle );
 
 	// Ensure that the debug image is correct size.
 	// If size has changed, debug image will need to be re-allocated.
-	if (imageProcModePrev != arImageProcMode || imXsizePrev != arImXsize || imYsizePrev != arImYsize) {
-		arLabelingCleanup();
-		imageProcModePrev = arImageProcMode;
-		imXsizePrev = arImXsize;
-		imYsizePrev = arImYsize;
+	if (handle->debug_mode != scale || handle->debug_xsize != xsize || handle->debug_ysize != handle->ysize) {
+		if (handle->debug_image) {
+			arMemFree( handle->debug_image );
+			handle->debug_image = NULL;
+		}
+		handle->debug_mode = scale;
+		handle->debug_xsize = xsize;
+		handle->debug_ysize = handle->ysize;
 	}
 
-    if( arImageProcMode == AR_IMAGE_PROC_IN_HALF ) {
-        lxsize = arImXsize / 2;
-        lysize = arImYsize / 2;
-    }
-    else {
-        lxsize = arImXsize;
-        lysize = arImYsize;
-    }
-
-    if( LorR ) {
-        l_image = &l_imageL[0];
-        work    = &workL[0];
-        work2   = &work2L[0];
-        wlabel_num = &wlabel_numL;
-        warea   = &wareaL[0];
-        wclip   = &wclipL[0];
-        wpos    = &wposL[0];
-        if( arImageL == NULL ) {
-#if 0
-            int texXsize = 1;
-            int texYsize = 1;
-            while( texXsize < arImXsize ) texXsize *= 2;
-            if( texXsize > 512 ) texXsize = 512;
-            while( texYsize < arImYsize ) texYsize *= 2;
-            arMalloc( arImageL, ARUint8, texXsize*texYsize*AR_PIX_SIZE_DEFAULT );
-#else
-            arMalloc( arImageL, ARUint8, arImXsize*arImYsize*AR_PIX_SIZE_DEFAULT );
-#endif
-            put_zero( arImageL, lxsize*lysize*AR_PIX_SIZE_DEFAULT );
-            arImage = arImageL;
-        }
-    }
-    else {
-        l_image = &l_imageR[0];
-        work    = &workR[0];
-        work2   = &work2R[0];
-        wlabel_num = &wlabel_numR;
-        warea   = &wareaR[0];
-        wclip   = &wclipR[0];
-        wpos    = &wposR[0];
-        if( arImageR == NULL ) {
-#if 0
-            int texXsize = 1;
-            int texYsize = 1;
-            while( texXsize < arImXsize ) texXsize *= 2;
-            if( texXsize > 512 ) texXsize = 512;
-            while( texYsize < arImYsize ) texYsize *= 2;
-            arMalloc( arImageR, ARUint8, texXsize*texYsize*AR_PIX_SIZE_DEFAULT );
-#else
-            arMalloc( arImageR, ARUint8, arImXsize*arImYsize*AR_PIX_SIZE_DEFAULT );
-#endif
-            put_zero( arImageR, lxsize*lysize*AR_PIX_SIZE_DEFAULT );
-        }
+    lxsize = xsize / scale;
+    lysize = handle->ysize / scale;
+
+    if( handle->debug_image == NULL ) {
+        arMallocTag( handle->debug_image, ARUint8, xsize*handle->ysize*AR_PIX_SIZE_DEFAULT, AR_MEM_AR );
+        put_zero( handle->debug_image, lxsize*lysize*AR_PIX_SIZE_DEFAULT );
     }
 
     pnt1 = &l_image[0];
@@ -564,49 +1848,25 @@ static ARInt16 *labeling3( ARUint8 *image, int thresh,
         pnt2 += lxsize;
     }
 
+    binarize( handle, image, thresh );
+
     wk_max = 0;
     pnt2 = &(l_image[lxsize+1]);
-    if( LorR ) dpnt = &(arImageL[(lxsize+1)*AR_PIX_SIZE_DEFAULT]);
-    else       dpnt = &(arImageR[(lxsize+1)*AR_PIX_SIZE_DEFAULT]);
-    if( arImageProcMode == AR_IMAGE_PROC_IN_HALF ) {
-        pnt = &(image[(arImXsize*2+2)*AR_PIX_SIZE_DEFAULT]);
-        poff = AR_PIX_SIZE_DEFAULT*2;
-    }
-    else {
-        pnt = &(image[(arImXsize+1)*AR_PIX_SIZE_DEFAULT]);
-        poff = AR_PIX_SIZE_DEFAULT;
-    }
-    for(j = 1; j < lysize-1; j++, pnt+=poff*2, pnt2+=2, dpnt+=AR_PIX_SIZE_DEFAULT*2) {
-        for(i = 1; i < lxsize-1; i++, pnt+=poff, pnt2++, dpnt+=AR_PIX_SIZE_DEFAULT) {
-#if (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_ARGB)
-            if( *(pnt+1) + *(pnt+2) + *(pnt+3) <= thresht3 ) {
+    bpnt = &(handle->bin_image[lxsize+1]);
+    dpnt = &(handle->debug_image[(lxsize+1)*AR_PIX_SIZE_DEFAULT]);
+    for(j = 1; j < lysize-1; j++, bpnt+=2, pnt2+=2, dpnt+=AR_PIX_SIZE_DEFAULT*2) {
+        for(i = 1; i < lxsize-1; i++, bpnt++, pnt2++, dpnt+=AR_PIX_SIZE_DEFAULT) {
+            if( *bpnt ) {
+#if (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_ARGB) || (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_ABGR)
                 *(dpnt+1) = *(dpnt+2) = *(dpnt+3) = 255;
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_ABGR)
-            if( *(pnt+1) + *(pnt+2) + *(pnt+3) <= thresht3 ) {
-                *(dpnt+1) = *(dpnt+2) = *(dpnt+3) = 255;
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_BGRA)
-            if( *(pnt+0) + *(pnt+1) + *(pnt+2) <= thresht3 ) {
-                *(dpnt+0) = *(dpnt+1) = *(dpnt+2) = 255;
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_BGR)
-            if( *(pnt+0) + *(pnt+1) + *(pnt+2) <= thresht3 ) {
-                *(dpnt+0) = *(dpnt+1) = *(dpnt+2) = 255;
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_RGBA)
-            if( *(pnt+0) + *(pnt+1) + *(pnt+2) <= thresht3 ) {
-                *(dpnt+0) = *(dpnt+1) = *(dpnt+2) = 255;
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_RGB)
-            if( *(pnt+0) + *(pnt+1) + *(pnt+2) <= thresht3 ) {
-                *(dpnt+0) = *(dpnt+1) = *(dpnt+2) = 255;
 #elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_MONO)
-			if( *(pnt) <= thresh ) {
 				*(dpnt) = 255;
 #elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_2vuy)
-			if( *(pnt+1) <= thresh ) {
 				*(dpnt+0) = 128; *(dpnt+1) = 235; // *(dpnt+0) is chroma, set to 128 to maintain black & white debug image.
 #elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_yuvs)
-			if( *(pnt+0) <= thresh ) {
 				*(dpnt+0) = 235; *(dpnt+1) = 128; // *(dpnt+1) is chroma, set to 128 to maintain black & white debug image.
 #else
-#  error Unknown default pixel format defined in config.h
+                *(dpnt+0) = *(dpnt+1) = *(dpnt+2) = 255;
 #endif
 						pnt1 = &(pnt2[-lxsize]);
                 if( *pnt1 > 0 ) {
@@ -692,7 +1952,7 @@ static ARInt16 *labeling3( ARUint8 *image, int thresh,
                 }
                 else {
                     wk_max++;
-                    if( wk_max > WORK_SIZE ) {
+                    if( wk_max > handle->work_size ) {
                         return(0);
                     }
                     work[wk_max-1] = *pnt2 = wk_max;
@@ -729,7 +1989,6 @@ static ARInt16 *labeling3( ARUint8 *image, int thresh,
 #  error Unknown default pixel format defined in config.h
 #endif
         }
-        if (arImageProcMode == AR_IMAGE_PROC_IN_HALF) pnt += arImXsize*AR_PIX_SIZE_DEFAULT;
     }
 
     j = 1;
@@ -772,16 +2031,3 @@ static ARInt16 *labeling3( ARUint8 *image, int thresh,
     *clip      = wclip;
     return( l_image );
 }
-
-void arLabelingCleanup(void)
-{
-	if (arImageL) {
-		free (arImageL);
-		arImageL = NULL;
-		arImage = NULL;
-	}
-	if (arImageR) {
-		free (arImageR);
-		arImageR = NULL;
-	}
-}
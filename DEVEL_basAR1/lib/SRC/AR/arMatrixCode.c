@@ -0,0 +1,253 @@
+/*******************************************************
+ *
+ * Matrix code markers.
+ *
+ * The inside of the marker is a grid of AR_MATRIX_CODE_SIZE x
+ * AR_MATRIX_CODE_SIZE dark and light cells, read from the pattern
+ * sample arGetPattCtx() extracts:
+ *
+ *  - the four corner cells give the orientation: the upper left
+ *    one is light, the three others are dark;
+ *  - the next 24 cells, in raster order, hold the code as an
+ *    extended Golay (24,12) codeword, which corrects up to three
+ *    wrong cells;
+ *  - the remaining cells alternate dark, light, dark, ... and
+ *    are checked to reject blobs that are not matrix markers.
+ *
+ * Decoding costs the same whatever the number of markers in use.
+ *
+*******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <AR/ar.h>
+
+#define   GOLAY_POLY       0xC75            /* x^11+x^10+x^6+x^5+x^4+x^2+1 */
+#define   CELL_NUM         (AR_MATRIX_CODE_SIZE*AR_MATRIX_CODE_SIZE)
+
+static int  golay_rem( int word );
+static int  golay_encode( int code );
+static int  golay_decode( int word, int *code );
+static int  bit_count( int word );
+static void rotate_cells( int cell[CELL_NUM] );
+static void init_syndromes( void );
+
+/* Error pattern of each syndrome of the (23,12) code. */
+static int  syndrome_err[1<<11];
+static int  syndrome_init = 0;
+
+int arLoadMarker( const char *name )
+{
+    int     code;
+    char    c;
+
+    if( strncmp(name, "matrix:", 7) != 0 ) return arLoadPatt( name );
+
+    if( sscanf(name+7, "%d%c", &code, &c) != 1
+     || code < 0 || code >= AR_MATRIX_CODE_NUM ) {
+        printf("\"%s\": bad matrix code!!\n", name);
+        return -1;
+    }
+    if( !syndrome_init ) init_syndromes();
+    if( arPattDetectionMode == AR_PATT_DETECTION_TEMPLATE ) {
+        arPattDetectionMode = AR_PATT_DETECTION_TEMPLATE_AND_MATRIX;
+    }
+
+    return AR_MATRIX_CODE_ID_BASE + code;
+}
+
+int arMatrixCodeEncode( int code, ARUint8 cell[AR_MATRIX_CODE_SIZE][AR_MATRIX_CODE_SIZE] )
+{
+    ARUint8   *c = &cell[0][0];
+    int       word, i, k;
+
+    if( code < 0 || code >= AR_MATRIX_CODE_NUM ) return -1;
+
+    word = golay_encode( code );
+    for( i = k = 0; i < CELL_NUM; i++ ) {
+        if( i == 0 ) {
+            c[i] = 0;
+        }
+        else if( i == AR_MATRIX_CODE_SIZE-1 || i == CELL_NUM-AR_MATRIX_CODE_SIZE || i == CELL_NUM-1 ) {
+            c[i] = 1;
+        }
+        else if( k < 24 ) {
+            c[i] = (word >> (23-k)) & 1;
+            k++;
+        }
+        else {
+            c[i] = ((k++ - 24) & 1) == 0;
+        }
+    }
+
+    return 0;
+}
+
+int arMatrixCodeDecode( ARUint8 ext_pat[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3],
+                        int *code, int *dir, double *cf )
+{
+    int     sum[CELL_NUM], num[CELL_NUM], cell[CELL_NUM];
+    int     corner[4];
+    int     cx[AR_PATT_SIZE_X], cy[AR_PATT_SIZE_Y];
+    int     vmin, vmax, thresh;
+    int     word, data, err, e, d, emin;
+    int     i, j, k, n;
+
+    *code = -1;
+    *dir  = 0;
+    *cf   = 0.0;
+
+    /* Cell of each sample column and row, -1 for samples too close to
+       a cell border to be trusted. */
+    for( i = 0; i < AR_PATT_SIZE_X; i++ ) {
+        n = (2*i+1) * AR_MATRIX_CODE_SIZE;
+        k = n % (2*AR_PATT_SIZE_X);
+        cx[i] = (5*k >= 2*AR_PATT_SIZE_X && 5*k <= 8*AR_PATT_SIZE_X)? n / (2*AR_PATT_SIZE_X): -1;
+    }
+    for( j = 0; j < AR_PATT_SIZE_Y; j++ ) {
+        n = (2*j+1) * AR_MATRIX_CODE_SIZE;
+        k = n % (2*AR_PATT_SIZE_Y);
+        cy[j] = (5*k >= 2*AR_PATT_SIZE_Y && 5*k <= 8*AR_PATT_SIZE_Y)? n / (2*AR_PATT_SIZE_Y): -1;
+    }
+
+    for( i = 0; i < CELL_NUM; i++ ) sum[i] = num[i] = 0;
+    for( j = 0; j < AR_PATT_SIZE_Y; j++ ) {
+        if( cy[j] < 0 ) continue;
+        for( i = 0; i < AR_PATT_SIZE_X; i++ ) {
+            if( cx[i] < 0 ) continue;
+            k = cy[j]*AR_MATRIX_CODE_SIZE + cx[i];
+            sum[k] += ext_pat[j][i][0] + ext_pat[j][i][1] + ext_pat[j][i][2];
+            num[k] += 3;
+        }
+    }
+
+    vmin = 255;
+    vmax = 0;
+    for( i = 0; i < CELL_NUM; i++ ) {
+        if( num[i] == 0 ) return -1;
+        sum[i] /= num[i];
+        if( sum[i] < vmin ) vmin = sum[i];
+        if( sum[i] > vmax ) vmax = sum[i];
+    }
+    if( vmax - vmin < AR_MATRIX_CODE_CONTRAST ) return -1;
+    thresh = (vmin + vmax) / 2;
+    for( i = 0; i < CELL_NUM; i++ ) cell[i] = (sum[i] < thresh);
+
+    /* Orientation: the rotation, in the sense of the pattern rotations
+       of arLoadPatt(), that brings the light corner to the upper left. */
+    corner[0] = cell[0];
+    corner[1] = cell[AR_MATRIX_CODE_SIZE-1];
+    corner[2] = cell[CELL_NUM-1];
+    corner[3] = cell[CELL_NUM-AR_MATRIX_CODE_SIZE];
+    emin = 5;
+    d = 0;
+    for( k = 0; k < 4; k++ ) {
+        e = 0;
+        for( i = 0; i < 4; i++ ) e += (corner[(k+i)%4] != (i != 0));
+        if( e < emin ) { emin = e; d = (4-k)%4; }
+    }
+    if( emin > 1 ) return -1;
+    for( k = 0; k < d; k++ ) rotate_cells( cell );
+
+    word = 0;
+    err  = emin;
+    for( i = k = 0; i < CELL_NUM; i++ ) {
+        if( i == 0 || i == AR_MATRIX_CODE_SIZE-1
+         || i == CELL_NUM-AR_MATRIX_CODE_SIZE || i == CELL_NUM-1 ) continue;
+        if( k < 24 ) word = (word << 1) | cell[i];
+        else         err += (cell[i] != (((k - 24) & 1) == 0));
+        k++;
+    }
+    if( (e = golay_decode( word, &data )) < 0 ) return -1;
+    err += e;
+    if( err > AR_MATRIX_CODE_ERROR_MAX ) return -1;
+
+    *code = AR_MATRIX_CODE_ID_BASE + data;
+    *dir  = d;
+    *cf   = 1.0 - 0.1 * err;
+
+    return 0;
+}
+
+/* Remainder of word, a polynomial of degree < 23, modulo GOLAY_POLY. */
+static int golay_rem( int word )
+{
+    int     i;
+
+    for( i = 22; i >= 11; i-- ) {
+        if( word & (1 << i) ) word ^= GOLAY_POLY << (i-11);
+    }
+    return word;
+}
+
+/* 12 data bits, 11 check bits and an overall parity bit. */
+static int golay_encode( int code )
+{
+    int     word;
+
+    word = (code << 11) | golay_rem( code << 11 );
+    return (word << 1) | (bit_count(word) & 1);
+}
+
+/* Number of bits corrected, -1 if there were more than 3 errors. */
+static int golay_decode( int word, int *code )
+{
+    int     w, e, n;
+
+    if( !syndrome_init ) init_syndromes();
+
+    w = word >> 1;
+    e = syndrome_err[golay_rem( w )];
+    w ^= e;
+    n = bit_count( e );
+    if( (bit_count(w) & 1) != (word & 1) ) {
+        if( n == 3 ) return -1;
+        n++;
+    }
+    *code = w >> 11;
+
+    return n;
+}
+
+static int bit_count( int word )
+{
+    int     n;
+
+    for( n = 0; word; word &= word-1 ) n++;
+    return n;
+}
+
+/* Undoes the quarter turn of the sample of arGetPattCtx() that comes
+   from shifting its vertices by one. */
+static void rotate_cells( int cell[CELL_NUM] )
+{
+    int     w[CELL_NUM];
+    int     u, v;
+
+    for( v = 0; v < AR_MATRIX_CODE_SIZE; v++ ) {
+        for( u = 0; u < AR_MATRIX_CODE_SIZE; u++ ) {
+            w[v*AR_MATRIX_CODE_SIZE+u] = cell[(AR_MATRIX_CODE_SIZE-1-u)*AR_MATRIX_CODE_SIZE + v];
+        }
+    }
+    memcpy( cell, w, sizeof(w) );
+}
+
+/* The (23,12) code is perfect: the 2048 error patterns of at most 3 bits
+   have distinct syndromes, covering all of them. */
+static void init_syndromes( void )
+{
+    int     i, j, k;
+
+    syndrome_err[0] = 0;
+    for( i = 0; i < 23; i++ ) {
+        syndrome_err[golay_rem(1<<i)] = 1<<i;
+        for( j = i+1; j < 23; j++ ) {
+            syndrome_err[golay_rem((1<<i)|(1<<j))] = (1<<i)|(1<<j);
+            for( k = j+1; k < 23; k++ ) {
+                syndrome_err[golay_rem((1<<i)|(1<<j)|(1<<k))] = (1<<i)|(1<<j)|(1<<k);
+            }
+        }
+    }
+    syndrome_init = 1;
+}
@@ -0,0 +1,302 @@
+/*
+ *   Accounting of the memory of the subsystems: AR core, video, gsub,
+ *   ARvrml with OpenVRML, and the Arpe model.
+ *
+ *   arMemAlloc() puts the size and subsystem of each block in a header
+ *   before it, so that arMemFree() takes them off without being told.
+ *   The counters are kept with atomic adds and the peak raised with a
+ *   compare-and-swap, so that any thread may allocate without a lock.
+ *
+ *   arImageAlloc() aligns the images for the vector loops, and keeps
+ *   those freed in a pool under a spin lock, which is held for a search
+ *   of AR_IMAGE_POOL_MAX entries at most.
+ */
+#ifdef __linux__
+#  define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sched.h>
+#  ifdef __linux__
+#    include <sys/mman.h>
+#  endif
+#endif
+#include <AR/ar.h>
+
+#ifdef _MSC_VER
+#  define MEM_ADD(p,n)      InterlockedExchangeAdd( (p), (n) )
+#  define MEM_CAS(p,o,n)    InterlockedCompareExchange( (p), (n), (o) )
+#else
+#  define MEM_ADD(p,n)      __sync_fetch_and_add( (p), (n) )
+#  define MEM_CAS(p,o,n)    __sync_val_compare_and_swap( (p), (o), (n) )
+#endif
+#ifdef _WIN32
+#  define MEM_YIELD()       Sleep( 0 )
+#else
+#  define MEM_YIELD()       sched_yield()
+#endif
+
+typedef union {
+    struct {
+        size_t  size;
+        int     tag;
+    } h;
+    double      align[2];                       /* keeps the block aligned */
+} MemHeader;
+
+typedef struct {
+    volatile long bytes;
+    volatile long peak;
+    volatile long allocs;
+    volatile long frees;
+} MemCount;
+
+typedef union {
+    struct {
+        void   *base;                           /* of malloc(), or of the huge pages */
+        size_t  size;                           /* that the image may take */
+        int     tag;
+        int     huge;
+    } h;
+    char        align[AR_IMAGE_ALIGN];
+} ImageHeader;
+
+int                  arImagePageMode = DEFAULT_IMAGE_PAGE_MODE;
+
+static MemCount      mem[AR_MEM_TAGS];
+static ImageHeader  *image_pool[AR_IMAGE_POOL_MAX];
+static int           image_pool_num = 0;
+static volatile long image_lock = 0;
+
+static const char   *mem_name[AR_MEM_TAGS] = {
+    "AR core", "video", "gsub", "ARvrml", "Arpe"
+};
+
+static void mem_count( int tag, long bytes )
+{
+    long    now, peak;
+
+    now = MEM_ADD( &mem[tag].bytes, bytes ) + bytes;
+    if( bytes <= 0 ) return;
+    while( (peak = mem[tag].peak) < now ) {
+        if( MEM_CAS( &mem[tag].peak, peak, now ) == peak ) break;
+    }
+}
+
+void *arMemAlloc( int tag, size_t size )
+{
+    MemHeader   *p;
+
+    if( tag < 0 || tag >= AR_MEM_TAGS ) return NULL;
+    if( (p = (MemHeader *)malloc( sizeof(MemHeader) + size )) == NULL ) return NULL;
+    p->h.size = size;
+    p->h.tag  = tag;
+    MEM_ADD( &mem[tag].allocs, 1 );
+    mem_count( tag, (long)size );
+
+    return p + 1;
+}
+
+void *arMemRealloc( int tag, void *ptr, size_t size )
+{
+    MemHeader   *p, *q;
+    size_t       old;
+
+    if( ptr == NULL ) return arMemAlloc( tag, size );
+
+    p   = (MemHeader *)ptr - 1;
+    old = p->h.size;
+    tag = p->h.tag;
+    if( (q = (MemHeader *)realloc( p, sizeof(MemHeader) + size )) == NULL ) return NULL;
+    q->h.size = size;
+    if( size != old ) {
+        MEM_ADD( &mem[tag].allocs, 1 );
+        MEM_ADD( &mem[tag].frees, 1 );
+        mem_count( tag, (long)size - (long)old );
+    }
+
+    return q + 1;
+}
+
+void arMemFree( void *ptr )
+{
+    MemHeader   *p;
+
+    if( ptr == NULL ) return;
+
+    p = (MemHeader *)ptr - 1;
+    MEM_ADD( &mem[p->h.tag].frees, 1 );
+    mem_count( p->h.tag, -(long)p->h.size );
+    free( p );
+}
+
+void arMemAdd( int tag, long bytes )
+{
+    if( tag < 0 || tag >= AR_MEM_TAGS || bytes == 0 ) return;
+    mem_count( tag, bytes );
+}
+
+int arMemGet( int tag, ARMemStats *stats )
+{
+    if( tag < 0 || tag >= AR_MEM_TAGS || stats == NULL ) return -1;
+
+    stats->bytes  = mem[tag].bytes;
+    stats->peak   = mem[tag].peak;
+    stats->allocs = mem[tag].allocs;
+    stats->frees  = mem[tag].frees;
+    if( stats->peak < stats->bytes ) stats->peak = stats->bytes;
+
+    return 0;
+}
+
+void arMemResetPeak( void )
+{
+    int     i;
+
+    for( i = 0; i < AR_MEM_TAGS; i++ ) mem[i].peak = mem[i].bytes;
+}
+
+void arMemDump( FILE *fp )
+{
+    ARMemStats  s;
+    long        bytes = 0, peak = 0;
+    int         i;
+
+    fprintf( fp, "\n %-8s %12s %12s %10s %10s\n", "memory", "KB", "peak KB", "allocs", "frees" );
+    for( i = 0; i < AR_MEM_TAGS; i++ ) {
+        arMemGet( i, &s );
+        fprintf( fp, " %-8s %12.1f %12.1f %10ld %10ld\n", mem_name[i],
+                 s.bytes / 1024.0, s.peak / 1024.0, s.allocs, s.frees );
+        bytes += s.bytes;
+        peak  += s.peak;
+    }
+    /* The peaks of the subsystems need not come at once; their sum bounds
+       the peak of the whole. */
+    fprintf( fp, " %-8s %12.1f %12.1f\n", "total", bytes / 1024.0, peak / 1024.0 );
+}
+
+/* The pages of an image, huge when the mode asks and the system gives
+   them, NULL if there is no memory. */
+static void *image_pages( size_t bytes, int *huge )
+{
+    void        *base = NULL;
+
+    *huge = 0;
+    if( arImagePageMode == AR_IMAGE_PAGE_HUGE && bytes >= AR_IMAGE_HUGE_PAGE ) {
+#if defined(_WIN32)
+        SIZE_T   page = GetLargePageMinimum();
+
+        /* Only for a user with the right to lock pages in memory. */
+        if( page != 0 ) {
+            base = VirtualAlloc( NULL, (bytes + page - 1) / page * page,
+                                 MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE );
+        }
+#elif defined(__linux__)
+        bytes = (bytes + AR_IMAGE_HUGE_PAGE - 1) / AR_IMAGE_HUGE_PAGE * AR_IMAGE_HUGE_PAGE;
+        if( posix_memalign( &base, AR_IMAGE_HUGE_PAGE, bytes ) != 0 ) base = NULL;
+        else madvise( base, bytes, MADV_HUGEPAGE );
+#endif
+        if( base != NULL ) {
+            *huge = 1;
+            return base;
+        }
+    }
+    return malloc( bytes + AR_IMAGE_ALIGN );
+}
+
+static void image_release( ImageHeader *p )
+{
+    MEM_ADD( &mem[p->h.tag].frees, 1 );
+    mem_count( p->h.tag, -(long)p->h.size );
+#ifdef _WIN32
+    if( p->h.huge ) {
+        VirtualFree( p->h.base, 0, MEM_RELEASE );
+        return;
+    }
+#endif
+    free( p->h.base );
+}
+
+void *arImageAlloc( int tag, size_t size )
+{
+    ImageHeader *p = NULL;
+    void        *base;
+    size_t       bytes;
+    int          huge, i, best = -1;
+
+    if( tag < 0 || tag >= AR_MEM_TAGS ) return NULL;
+    size = (size + AR_IMAGE_ALIGN - 1) / AR_IMAGE_ALIGN * AR_IMAGE_ALIGN;
+
+    /* The smallest in the pool that the image fits, and not twice its
+       size, so that a thumbnail does not hold on to a frame. */
+    while( MEM_CAS( &image_lock, 0, 1 ) != 0 ) MEM_YIELD();
+    for( i = 0; i < image_pool_num; i++ ) {
+        if( image_pool[i]->h.size < size || image_pool[i]->h.size / 2 > size ) continue;
+        if( best < 0 || image_pool[i]->h.size < image_pool[best]->h.size ) best = i;
+    }
+    if( best >= 0 ) {
+        p = image_pool[best];
+        image_pool[best] = image_pool[--image_pool_num];
+    }
+    MEM_CAS( &image_lock, 1, 0 );
+
+    if( p != NULL ) {
+        if( p->h.tag != tag ) {
+            mem_count( p->h.tag, -(long)p->h.size );
+            mem_count( tag, (long)p->h.size );
+            p->h.tag = tag;
+        }
+        return p + 1;
+    }
+
+    bytes = sizeof(ImageHeader) + size;
+    if( (base = image_pages( bytes, &huge )) == NULL ) return NULL;
+    /* The header goes just before the aligned image. */
+    p = (ImageHeader *)(((size_t)base + AR_IMAGE_ALIGN - 1) / AR_IMAGE_ALIGN * AR_IMAGE_ALIGN);
+    p->h.base = base;
+    p->h.size = size;
+    p->h.tag  = tag;
+    p->h.huge = huge;
+    MEM_ADD( &mem[tag].allocs, 1 );
+    mem_count( tag, (long)size );
+
+    return p + 1;
+}
+
+void arImageFree( void *buff )
+{
+    ImageHeader *p;
+
+    if( buff == NULL ) return;
+
+    p = (ImageHeader *)buff - 1;
+    while( MEM_CAS( &image_lock, 0, 1 ) != 0 ) MEM_YIELD();
+    if( image_pool_num < AR_IMAGE_POOL_MAX ) {
+        image_pool[image_pool_num++] = p;
+        p = NULL;
+    }
+    MEM_CAS( &image_lock, 1, 0 );
+    if( p != NULL ) image_release( p );
+}
+
+void arImagePoolTrim( void )
+{
+    ImageHeader *pool[AR_IMAGE_POOL_MAX];
+    int          i, n;
+
+    while( MEM_CAS( &image_lock, 0, 1 ) != 0 ) MEM_YIELD();
+    n = image_pool_num;
+    memcpy( pool, image_pool, n * sizeof(ImageHeader *) );
+    image_pool_num = 0;
+    MEM_CAS( &image_lock, 1, 0 );
+    for( i = 0; i < n; i++ ) image_release( pool[i] );
+}
+
+int arImageStride( int xsize, int pixSize )
+{
+    return (xsize * pixSize + AR_IMAGE_ALIGN - 1) / AR_IMAGE_ALIGN * AR_IMAGE_ALIGN;
+}
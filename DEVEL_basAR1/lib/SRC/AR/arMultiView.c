@@ -0,0 +1,432 @@
+/*******************************************************
+ *
+ * Marker tracking with several calibrated cameras.
+ *
+ * Each camera detects on its own ARHandle, one thread per
+ * camera. The pose is then solved once for all the cameras:
+ * the corners seen in every view are reprojected through that
+ * camera and its placement in the reference camera (camera 0),
+ * and a Gauss-Newton fit on the six pose parameters minimises
+ * all the reprojection errors together. The stereo pose
+ * functions are the case of two cameras.
+ *
+*******************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <AR/ar.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <process.h>
+#else
+#  include <pthread.h>
+#endif
+
+typedef struct {
+    ARHandle        *handle;
+    ARUint8         *image;
+    int              thresh;
+    ARMarkerInfo    *marker_info;
+    int              marker_num;
+    int              ret;
+} ViewJob;
+
+static void   do_view( ViewJob *job );
+static double view_pose( ARViewParam *vparam, ARMarkerInfo *marker_info[],
+                         double prev_conv[3][4], double center[2], double width,
+                         double conv[3][4] );
+static double view_error( double cam[][3][4], double pos2d[][4][2], int num,
+                          double pos3d[4][3], double rot[3][3], double trans[3],
+                          double jtj[6][6], double jtr[6] );
+static void   get_corners( ARMarkerInfo *marker_info, double pos2d[4][2] );
+static void   inv_trans( double t[3][4], double inv[3][4] );
+static void   mul_trans( double a[3][4], double b[3][4], double c[3][4] );
+static void   rot_update( double w[3], double rot[3][3] );
+static int    solve6( double a[6][6], double b[6], double x[6] );
+
+#ifdef _WIN32
+static unsigned __stdcall view_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_view( (ViewJob *)arg );
+    return 0;
+}
+#else
+static void *view_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_view( (ViewJob *)arg );
+    return NULL;
+}
+#endif
+
+int arViewParamFromStereo( ARSParam *sparam, ARViewParam *vparam )
+{
+    int     i, j;
+
+    if( sparam == NULL || vparam == NULL ) return -1;
+
+    vparam->view_num = 2;
+    vparam->param[0].xsize = vparam->param[1].xsize = sparam->xsize;
+    vparam->param[0].ysize = vparam->param[1].ysize = sparam->ysize;
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 4; i++ ) {
+            vparam->param[0].mat[j][i] = sparam->matL[j][i];
+            vparam->param[1].mat[j][i] = sparam->matR[j][i];
+            vparam->trans[0][j][i]     = (i == j)? 1.0: 0.0;
+            vparam->trans[1][j][i]     = sparam->matL2R[j][i];
+        }
+    }
+    for( i = 0; i < 4; i++ ) {
+        vparam->param[0].dist_factor[i] = sparam->dist_factorL[i];
+        vparam->param[1].dist_factor[i] = sparam->dist_factorR[i];
+    }
+
+    return 0;
+}
+
+int arViewDetectMarker( ARHandle *handle[], ARUint8 *data[], int view_num, int thresh,
+                        ARMarkerInfo *marker_info[], int marker_num[] )
+{
+    ViewJob   job[AR_VIEW_MAX];
+#ifdef _WIN32
+    HANDLE    tid[AR_VIEW_MAX];
+#else
+    pthread_t tid[AR_VIEW_MAX];
+#endif
+    int       started[AR_VIEW_MAX];
+    int       ret;
+    int       v;
+
+    if( handle == NULL || data == NULL || view_num < 1 || view_num > AR_VIEW_MAX ) return -1;
+
+    for( v = 0; v < view_num; v++ ) {
+        job[v].handle = handle[v];
+        job[v].image  = data[v];
+        job[v].thresh = thresh;
+    }
+    for( v = 1; v < view_num; v++ ) {
+#ifdef _WIN32
+        tid[v] = (HANDLE)_beginthreadex( NULL, 0, view_thread, &job[v], 0, NULL );
+        started[v] = (tid[v] != 0);
+#else
+        started[v] = (pthread_create( &tid[v], NULL, view_thread, &job[v] ) == 0);
+#endif
+    }
+    do_view( &job[0] );
+    for( v = 1; v < view_num; v++ ) {
+        if( !started[v] ) {
+            do_view( &job[v] );
+            continue;
+        }
+#ifdef _WIN32
+        WaitForSingleObject( tid[v], INFINITE );
+        CloseHandle( tid[v] );
+#else
+        pthread_join( tid[v], NULL );
+#endif
+    }
+
+    ret = 0;
+    for( v = 0; v < view_num; v++ ) {
+        marker_info[v] = job[v].marker_info;
+        marker_num[v]  = job[v].marker_num;
+        if( job[v].ret < 0 ) ret = -1;
+    }
+    return ret;
+}
+
+double arViewGetTransMat( ARViewParam *vparam, ARMarkerInfo *marker_info[],
+                          double center[2], double width, double conv[3][4] )
+{
+    return view_pose( vparam, marker_info, NULL, center, width, conv );
+}
+
+double arViewGetTransMatCont( ARViewParam *vparam, ARMarkerInfo *marker_info[],
+                              double prev_conv[3][4], double center[2], double width,
+                              double conv[3][4] )
+{
+    return view_pose( vparam, marker_info, prev_conv, center, width, conv );
+}
+
+double arsGetTransMat( ARMarkerInfo *marker_infoL, ARMarkerInfo *marker_infoR,
+                       double center[2], double width,
+                       double transL[3][4], double transR[3][4] )
+{
+    return arsGetTransMatCont( marker_infoL, marker_infoR, NULL, center, width, transL, transR );
+}
+
+double arsGetTransMatCont( ARMarkerInfo *marker_infoL, ARMarkerInfo *marker_infoR,
+                           double prev_conv[3][4],
+                           double center[2], double width,
+                           double transL[3][4], double transR[3][4] )
+{
+    ARViewParam    vparam;
+    ARMarkerInfo  *marker_info[2];
+    double         err;
+
+    arViewParamFromStereo( &arsParam, &vparam );
+    marker_info[0] = marker_infoL;
+    marker_info[1] = marker_infoR;
+    err = view_pose( &vparam, marker_info, prev_conv, center, width, transL );
+    if( err < 0.0 ) return err;
+    mul_trans( arsParam.matL2R, transL, transR );
+
+    return err;
+}
+
+static void do_view( ViewJob *job )
+{
+    job->marker_info = NULL;
+    job->marker_num  = 0;
+    if( job->handle == NULL || job->image == NULL ) {
+        job->ret = -1;
+        return;
+    }
+    job->ret = arDetectMarkerCtx( job->handle, job->image, job->thresh,
+                                  &job->marker_info, &job->marker_num );
+}
+
+/* The pose in the reference camera: from prev_conv, or else from the single
+   view pose of the most confident view; then refined on all the views. */
+static double view_pose( ARViewParam *vparam, ARMarkerInfo *marker_info[],
+                         double prev_conv[3][4], double center[2], double width,
+                         double conv[3][4] )
+{
+    double   cam[AR_VIEW_MAX][3][4];
+    double   pos2d[AR_VIEW_MAX][4][2];
+    double   pos3d[4][3], ppos3d[4][2];
+    double   rot[3][3], trans[3], inv[3][4], conv1[3][4];
+    double   jtj[6][6], jtr[6], d[6], w[3];
+    double   err, err0, rot0[3][3], trans0[3];
+    int      view[AR_VIEW_MAX];
+    int      num, best, v, i, j, loop;
+
+    if( vparam == NULL || marker_info == NULL ) return -1;
+    if( vparam->view_num < 1 || vparam->view_num > AR_VIEW_MAX ) return -1;
+
+    num = 0;
+    best = -1;
+    for( v = 0; v < vparam->view_num; v++ ) {
+        if( marker_info[v] == NULL ) continue;
+        /* Projection from the reference camera into view v. */
+        for( j = 0; j < 3; j++ ) {
+            for( i = 0; i < 4; i++ ) {
+                cam[num][j][i] = vparam->param[v].mat[j][0] * vparam->trans[v][0][i]
+                               + vparam->param[v].mat[j][1] * vparam->trans[v][1][i]
+                               + vparam->param[v].mat[j][2] * vparam->trans[v][2][i]
+                               + ((i == 3)? vparam->param[v].mat[j][3]: 0.0);
+            }
+        }
+        get_corners( marker_info[v], pos2d[num] );
+        view[num] = v;
+        if( best < 0 || marker_info[v]->cf > marker_info[view[best]]->cf ) best = num;
+        num++;
+    }
+    if( num == 0 ) return -1;
+
+    ppos3d[0][0] = center[0] - width/2.0;
+    ppos3d[0][1] = center[1] + width/2.0;
+    ppos3d[1][0] = center[0] + width/2.0;
+    ppos3d[1][1] = center[1] + width/2.0;
+    ppos3d[2][0] = center[0] + width/2.0;
+    ppos3d[2][1] = center[1] - width/2.0;
+    ppos3d[3][0] = center[0] - width/2.0;
+    ppos3d[3][1] = center[1] - width/2.0;
+    for( i = 0; i < 4; i++ ) {
+        pos3d[i][0] = ppos3d[i][0];
+        pos3d[i][1] = ppos3d[i][1];
+        pos3d[i][2] = 0.0;
+    }
+
+    if( prev_conv != NULL ) {
+        for( j = 0; j < 3; j++ ) {
+            for( i = 0; i < 3; i++ ) rot[j][i] = prev_conv[j][i];
+            trans[j] = prev_conv[j][3];
+        }
+    }
+    else {
+        v = view[best];
+        if( arGetInitRot( marker_info[v], vparam->param[v].mat, rot ) < 0 ) return -1;
+        for( i = 0; i < AR_GET_TRANS_MAT_MAX_LOOP_COUNT; i++ ) {
+            err = arGetTransMat3( rot, pos2d[best], ppos3d, 4, conv1,
+                                  vparam->param[v].dist_factor, vparam->param[v].mat );
+            if( err < AR_GET_TRANS_MAT_MAX_FIT_ERROR ) break;
+        }
+        if( err < 0.0 ) return -1;
+        inv_trans( vparam->trans[v], inv );
+        mul_trans( inv, conv1, conv );
+        for( j = 0; j < 3; j++ ) {
+            for( i = 0; i < 3; i++ ) rot[j][i] = conv[j][i];
+            trans[j] = conv[j][3];
+        }
+    }
+
+    err = view_error( cam, pos2d, num, pos3d, rot, trans, jtj, jtr );
+    for( loop = 0; loop < AR_POSE_REFINE_MAX_LOOP_COUNT && err >= 0.0; loop++ ) {
+        if( solve6( jtj, jtr, d ) < 0 ) break;
+        memcpy( rot0, rot, sizeof(rot) );
+        memcpy( trans0, trans, sizeof(trans) );
+        for( i = 0; i < 3; i++ ) w[i] = d[i];
+        rot_update( w, rot );
+        for( i = 0; i < 3; i++ ) trans[i] += d[3+i];
+        err0 = err;
+        err = view_error( cam, pos2d, num, pos3d, rot, trans, jtj, jtr );
+        if( err < 0.0 || err > err0 ) {
+            memcpy( rot, rot0, sizeof(rot) );
+            memcpy( trans, trans0, sizeof(trans) );
+            err = err0;
+            break;
+        }
+        if( err0 - err < AR_POSE_REFINE_CONVERGE * err0 ) break;
+    }
+    if( err < 0.0 ) return -1;
+
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 3; i++ ) conv[j][i] = rot[j][i];
+        conv[j][3] = trans[j];
+    }
+
+    return err / (num*4);
+}
+
+/* Sum of the squared reprojection errors of all the views, and the normal
+   equations of the update: rot <- exp([w]) rot, trans <- trans + t.
+   Returns -1 if a corner falls behind a camera. */
+static double view_error( double cam[][3][4], double pos2d[][4][2], int num,
+                          double pos3d[4][3], double rot[3][3], double trans[3],
+                          double jtj[6][6], double jtr[6] )
+{
+    double   p[3], q[3], h[3], dp[3][6], dh[3][6], ju[6], jv[6];
+    double   ru, rv, err;
+    int      k, n, i, j, a;
+
+    for( j = 0; j < 6; j++ ) {
+        for( i = 0; i < 6; i++ ) jtj[j][i] = 0.0;
+        jtr[j] = 0.0;
+    }
+    err = 0.0;
+    for( k = 0; k < num; k++ ) {
+        for( n = 0; n < 4; n++ ) {
+            for( j = 0; j < 3; j++ ) {
+                q[j] = rot[j][0]*pos3d[n][0] + rot[j][1]*pos3d[n][1] + rot[j][2]*pos3d[n][2];
+                p[j] = q[j] + trans[j];
+            }
+            for( j = 0; j < 3; j++ ) {
+                h[j] = cam[k][j][0]*p[0] + cam[k][j][1]*p[1] + cam[k][j][2]*p[2] + cam[k][j][3];
+            }
+            if( h[2] <= 0.0 ) return -1;
+            ru = pos2d[k][n][0] - h[0]/h[2];
+            rv = pos2d[k][n][1] - h[1]/h[2];
+            err += ru*ru + rv*rv;
+
+            /* dp/dw = -[q]x, dp/dt = I. */
+            dp[0][0] =   0.0; dp[0][1] =  q[2]; dp[0][2] = -q[1];
+            dp[1][0] = -q[2]; dp[1][1] =   0.0; dp[1][2] =  q[0];
+            dp[2][0] =  q[1]; dp[2][1] = -q[0]; dp[2][2] =   0.0;
+            for( j = 0; j < 3; j++ ) {
+                for( i = 0; i < 3; i++ ) dp[j][3+i] = (i == j)? 1.0: 0.0;
+            }
+            for( j = 0; j < 3; j++ ) {
+                for( a = 0; a < 6; a++ ) {
+                    dh[j][a] = cam[k][j][0]*dp[0][a] + cam[k][j][1]*dp[1][a] + cam[k][j][2]*dp[2][a];
+                }
+            }
+            for( a = 0; a < 6; a++ ) {
+                ju[a] = (dh[0][a] - h[0]/h[2]*dh[2][a]) / h[2];
+                jv[a] = (dh[1][a] - h[1]/h[2]*dh[2][a]) / h[2];
+            }
+            for( j = 0; j < 6; j++ ) {
+                for( i = 0; i < 6; i++ ) jtj[j][i] += ju[j]*ju[i] + jv[j]*jv[i];
+                jtr[j] += ju[j]*ru + jv[j]*rv;
+            }
+        }
+    }
+    return err;
+}
+
+/* The corners in the order of the square corners of arGetTransMat(). */
+static void get_corners( ARMarkerInfo *marker_info, double pos2d[4][2] )
+{
+    int     dir, i;
+
+    dir = marker_info->dir;
+    for( i = 0; i < 4; i++ ) {
+        pos2d[i][0] = marker_info->vertex[(4+i-dir)%4][0];
+        pos2d[i][1] = marker_info->vertex[(4+i-dir)%4][1];
+    }
+}
+
+static void inv_trans( double t[3][4], double inv[3][4] )
+{
+    int     i, j;
+
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 3; i++ ) inv[j][i] = t[i][j];
+        inv[j][3] = -(t[0][j]*t[0][3] + t[1][j]*t[1][3] + t[2][j]*t[2][3]);
+    }
+}
+
+static void mul_trans( double a[3][4], double b[3][4], double c[3][4] )
+{
+    int     i, j;
+
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 4; i++ ) {
+            c[j][i] = a[j][0]*b[0][i] + a[j][1]*b[1][i] + a[j][2]*b[2][i]
+                    + ((i == 3)? a[j][3]: 0.0);
+        }
+    }
+}
+
+/* rot <- exp([w]x) rot, by Rodrigues' formula. */
+static void rot_update( double w[3], double rot[3][3] )
+{
+    double   r[3][3], m[3][3], a, c, s, t, x, y, z;
+    int      i, j;
+
+    a = sqrt( w[0]*w[0] + w[1]*w[1] + w[2]*w[2] );
+    if( a < 1.0e-12 ) return;
+    x = w[0] / a; y = w[1] / a; z = w[2] / a;
+    c = cos( a ); s = sin( a ); t = 1.0 - c;
+    r[0][0] = t*x*x + c;   r[0][1] = t*x*y - s*z; r[0][2] = t*x*z + s*y;
+    r[1][0] = t*x*y + s*z; r[1][1] = t*y*y + c;   r[1][2] = t*y*z - s*x;
+    r[2][0] = t*x*z - s*y; r[2][1] = t*y*z + s*x; r[2][2] = t*z*z + c;
+    for( j = 0; j < 3; j++ ) {
+        for( i = 0; i < 3; i++ ) m[j][i] = r[j][0]*rot[0][i] + r[j][1]*rot[1][i] + r[j][2]*rot[2][i];
+    }
+    memcpy( rot, m, sizeof(m) );
+}
+
+/* Gaussian elimination with partial pivoting. */
+static int solve6( double a[6][6], double b[6], double x[6] )
+{
+    double   m[6][7], t;
+    int      i, j, k, p;
+
+    for( j = 0; j < 6; j++ ) {
+        for( i = 0; i < 6; i++ ) m[j][i] = a[j][i];
+        m[j][6] = b[j];
+    }
+    for( k = 0; k < 6; k++ ) {
+        p = k;
+        for( j = k+1; j < 6; j++ ) if( fabs(m[j][k]) > fabs(m[p][k]) ) p = j;
+        if( fabs(m[p][k]) < 1.0e-12 ) return -1;
+        if( p != k ) {
+            for( i = k; i < 7; i++ ) { t = m[k][i]; m[k][i] = m[p][i]; m[p][i] = t; }
+        }
+        for( j = k+1; j < 6; j++ ) {
+            t = m[j][k] / m[k][k];
+            for( i = k; i < 7; i++ ) m[j][i] -= t * m[k][i];
+        }
+    }
+    for( k = 5; k >= 0; k-- ) {
+        t = m[k][6];
+        for( i = k+1; i < 6; i++ ) t -= m[k][i] * x[i];
+        x[k] = t / m[k][k];
+    }
+
+    return 0;
+}
@@ -0,0 +1,254 @@
+/*******************************************************
+ *
+ * Pose filtering and prediction.
+ *
+ * The position and the rotation are tracked with their
+ * velocities (an alpha-beta filter, the steady state of a
+ * constant velocity Kalman filter), so a steady motion is
+ * followed without lag. As in the one-euro filter the gain
+ * follows a cutoff frequency that grows with the speed: a
+ * still marker stops jittering and a moving one is followed
+ * quickly. The velocities extrapolate the pose to the time
+ * it will be displayed.
+ *
+*******************************************************/
+
+#include <math.h>
+#include <AR/ar.h>
+
+#ifndef M_PI
+#  define M_PI 3.14159265358979323846
+#endif
+
+static double smoothing( double cutoff, double dt );
+static void   mat_to_quat( double m[3][4], double q[4] );
+static void   quat_to_mat( double q[4], double p[3], double m[3][4] );
+static void   quat_mul( double a[4], double b[4], double q[4] );
+static void   quat_normalize( double q[4] );
+static void   quat_to_vec( double q[4], double v[3] );
+static void   vec_to_quat( double v[3], double q[4] );
+
+int arPoseFilterInit( ARPoseFilter *filter )
+{
+    if( filter == NULL ) return -1;
+
+    filter->min_cutoff = AR_POSE_FILTER_MIN_CUTOFF;
+    filter->beta_pos   = AR_POSE_FILTER_BETA_POS;
+    filter->beta_rot   = AR_POSE_FILTER_BETA_ROT;
+    arPoseFilterReset( filter );
+
+    return 0;
+}
+
+void arPoseFilterReset( ARPoseFilter *filter )
+{
+    filter->init = 0;
+}
+
+int arPoseFilterUpdate( ARPoseFilter *filter, double conv[3][4], double time,
+                        double filtered[3][4] )
+{
+    double   q[4], qp[4], dq[4], inv[4], w[3], r[3];
+    double   dt, a, b, speed;
+    int      i;
+
+    if( filter == NULL || conv == NULL ) return -1;
+
+    mat_to_quat( conv, q );
+    dt = time - filter->time;
+    if( !filter->init || dt > AR_POSE_FILTER_RESET_TIME || dt < 0.0 ) {
+        for( i = 0; i < 3; i++ ) {
+            filter->pos[i]   = conv[i][3];
+            filter->vel[i]   = 0.0;
+            filter->omega[i] = 0.0;
+        }
+        for( i = 0; i < 4; i++ ) filter->quat[i] = q[i];
+        filter->time = time;
+        filter->init = 1;
+        if( filtered != NULL ) arPoseFilterPredict( filter, time, filtered );
+        return 0;
+    }
+    if( dt == 0.0 ) {
+        if( filtered != NULL ) arPoseFilterPredict( filter, time, filtered );
+        return 0;
+    }
+
+    /* Position: the prediction at this time is corrected by a share of the
+       residual, the velocity by that share squared over (2 - share). */
+    speed = sqrt( filter->vel[0]*filter->vel[0] + filter->vel[1]*filter->vel[1]
+                + filter->vel[2]*filter->vel[2] );
+    a = smoothing( filter->min_cutoff + filter->beta_pos * speed, dt );
+    b = a * a / (2.0 - a);
+    for( i = 0; i < 3; i++ ) {
+        r[i] = conv[i][3] - (filter->pos[i] + filter->vel[i] * dt);
+        filter->pos[i] += filter->vel[i] * dt + a * r[i];
+        filter->vel[i] += b * r[i] / dt;
+    }
+
+    /* Rotation, the same with the rotation vector from the predicted
+       rotation to the measured one as residual. */
+    for( i = 0; i < 3; i++ ) w[i] = filter->omega[i] * dt;
+    vec_to_quat( w, dq );
+    quat_mul( dq, filter->quat, qp );
+    quat_normalize( qp );
+    if( q[0]*qp[0] + q[1]*qp[1] + q[2]*qp[2] + q[3]*qp[3] < 0.0 ) {
+        for( i = 0; i < 4; i++ ) q[i] = -q[i];
+    }
+    inv[0] = -qp[0];
+    inv[1] = -qp[1];
+    inv[2] = -qp[2];
+    inv[3] =  qp[3];
+    quat_mul( q, inv, dq );
+    quat_to_vec( dq, r );
+    speed = sqrt( filter->omega[0]*filter->omega[0] + filter->omega[1]*filter->omega[1]
+                + filter->omega[2]*filter->omega[2] );
+    a = smoothing( filter->min_cutoff + filter->beta_rot * speed, dt );
+    b = a * a / (2.0 - a);
+    for( i = 0; i < 3; i++ ) {
+        w[i] = a * r[i];
+        filter->omega[i] += b * r[i] / dt;
+    }
+    vec_to_quat( w, dq );
+    quat_mul( dq, qp, filter->quat );
+    quat_normalize( filter->quat );
+
+    filter->time = time;
+    if( filtered != NULL ) arPoseFilterPredict( filter, time, filtered );
+
+    return 0;
+}
+
+int arPoseFilterPredict( ARPoseFilter *filter, double time, double conv[3][4] )
+{
+    double   p[3], w[3], dq[4], q[4];
+    double   dt;
+    int      i;
+
+    if( filter == NULL || !filter->init ) return -1;
+
+    dt = time - filter->time;
+    if( dt < 0.0 )                       dt = 0.0;
+    if( dt > AR_POSE_FILTER_PREDICT_MAX ) dt = AR_POSE_FILTER_PREDICT_MAX;
+
+    for( i = 0; i < 3; i++ ) {
+        p[i] = filter->pos[i] + filter->vel[i] * dt;
+        w[i] = filter->omega[i] * dt;
+    }
+    vec_to_quat( w, dq );
+    quat_mul( dq, filter->quat, q );
+    quat_normalize( q );
+    quat_to_mat( q, p, conv );
+
+    return 0;
+}
+
+/* Weight of the new sample in a first-order low-pass of the given cutoff (Hz). */
+static double smoothing( double cutoff, double dt )
+{
+    double   tau;
+
+    tau = 1.0 / (2.0 * M_PI * cutoff);
+    return 1.0 / (1.0 + tau / dt);
+}
+
+/* Quaternions are stored (x, y, z, w). Built from the largest of the four
+   components, so that marker poses, often near a half turn about an axis
+   of the camera, keep their accuracy. */
+static void mat_to_quat( double m[3][4], double q[4] )
+{
+    double   t, s;
+
+    t = m[0][0] + m[1][1] + m[2][2];
+    if( t > m[0][0] && t > m[1][1] && t > m[2][2] ) {
+        s = sqrt( t + 1.0 ) * 2.0;
+        q[3] = s / 4.0;
+        q[0] = (m[2][1] - m[1][2]) / s;
+        q[1] = (m[0][2] - m[2][0]) / s;
+        q[2] = (m[1][0] - m[0][1]) / s;
+    }
+    else if( m[0][0] > m[1][1] && m[0][0] > m[2][2] ) {
+        s = sqrt( 1.0 + m[0][0] - m[1][1] - m[2][2] ) * 2.0;
+        q[3] = (m[2][1] - m[1][2]) / s;
+        q[0] = s / 4.0;
+        q[1] = (m[0][1] + m[1][0]) / s;
+        q[2] = (m[0][2] + m[2][0]) / s;
+    }
+    else if( m[1][1] > m[2][2] ) {
+        s = sqrt( 1.0 + m[1][1] - m[0][0] - m[2][2] ) * 2.0;
+        q[3] = (m[0][2] - m[2][0]) / s;
+        q[0] = (m[0][1] + m[1][0]) / s;
+        q[1] = s / 4.0;
+        q[2] = (m[1][2] + m[2][1]) / s;
+    }
+    else {
+        s = sqrt( 1.0 + m[2][2] - m[0][0] - m[1][1] ) * 2.0;
+        q[3] = (m[1][0] - m[0][1]) / s;
+        q[0] = (m[0][2] + m[2][0]) / s;
+        q[1] = (m[1][2] + m[2][1]) / s;
+        q[2] = s / 4.0;
+    }
+    quat_normalize( q );
+}
+
+static void quat_to_mat( double q[4], double p[3], double m[3][4] )
+{
+    double   x = q[0], y = q[1], z = q[2], w = q[3];
+
+    m[0][0] = 1.0 - 2.0*(y*y + z*z);
+    m[0][1] = 2.0*(x*y - w*z);
+    m[0][2] = 2.0*(x*z + w*y);
+    m[1][0] = 2.0*(x*y + w*z);
+    m[1][1] = 1.0 - 2.0*(x*x + z*z);
+    m[1][2] = 2.0*(y*z - w*x);
+    m[2][0] = 2.0*(x*z - w*y);
+    m[2][1] = 2.0*(y*z + w*x);
+    m[2][2] = 1.0 - 2.0*(x*x + y*y);
+    m[0][3] = p[0];
+    m[1][3] = p[1];
+    m[2][3] = p[2];
+}
+
+static void quat_mul( double a[4], double b[4], double q[4] )
+{
+    q[0] = a[3]*b[0] + a[0]*b[3] + a[1]*b[2] - a[2]*b[1];
+    q[1] = a[3]*b[1] - a[0]*b[2] + a[1]*b[3] + a[2]*b[0];
+    q[2] = a[3]*b[2] + a[0]*b[1] - a[1]*b[0] + a[2]*b[3];
+    q[3] = a[3]*b[3] - a[0]*b[0] - a[1]*b[1] - a[2]*b[2];
+}
+
+static void quat_normalize( double q[4] )
+{
+    double   n;
+
+    n = sqrt( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] + q[3]*q[3] );
+    q[0] /= n;
+    q[1] /= n;
+    q[2] /= n;
+    q[3] /= n;
+}
+
+/* Rotation vector (axis times angle) of a unit quaternion with w >= 0. */
+static void quat_to_vec( double q[4], double v[3] )
+{
+    double   s, k;
+
+    s = sqrt( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] );
+    if( s < 1.0e-12 ) k = 2.0;
+    else              k = 2.0 * atan2( s, q[3] ) / s;
+    v[0] = q[0] * k;
+    v[1] = q[1] * k;
+    v[2] = q[2] * k;
+}
+
+static void vec_to_quat( double v[3], double q[4] )
+{
+    double   a, k;
+
+    a = sqrt( v[0]*v[0] + v[1]*v[1] + v[2]*v[2] );
+    if( a < 1.0e-12 ) k = 0.5;
+    else              k = sin( a / 2.0 ) / a;
+    q[0] = v[0] * k;
+    q[1] = v[1] * k;
+    q[2] = v[2] * k;
+    q[3] = cos( a / 2.0 );
+}
@@ -0,0 +1,275 @@
+/*
+ *   Roles of the threads: the priority and the cores of each.
+ *
+ *   A thread takes its role with arThreadRole() when it starts. Those
+ *   given a name stay in the registry until arThreadRoleEnd(), so that
+ *   arThreadRoleSet() and arThreadRoleLoad() apply to them too; the short
+ *   lived workers of the detection pools only take the priority and the
+ *   cores. A role that isolates its cores has them taken off the others,
+ *   so that what tracks and renders is not preempted by what loads.
+ */
+#ifdef __linux__
+#  define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <pthread.h>
+#  include <sched.h>
+#  include <unistd.h>
+#  ifdef __linux__
+#    include <sys/resource.h>
+#    include <sys/syscall.h>
+#  endif
+#endif
+#include <AR/ar.h>
+
+#ifdef _MSC_VER
+#  define THREAD_TLS        __declspec(thread)
+#else
+#  define THREAD_TLS        __thread
+#endif
+#ifdef _WIN32
+#  define THREAD_LOCK()     while( InterlockedCompareExchange( &lock, 1, 0 ) != 0 ) Sleep( 0 )
+#  define THREAD_UNLOCK()   InterlockedExchange( &lock, 0 )
+#else
+#  define THREAD_LOCK()     while( __sync_lock_test_and_set( &lock, 1 ) != 0 ) sched_yield()
+#  define THREAD_UNLOCK()   __sync_lock_release( &lock )
+#endif
+
+typedef struct {
+    int             priority;       /* -2 lowest to 2 highest */
+    unsigned long   cores;          /* mask, 0 for any */
+    int             isolate;
+} ThreadRole;
+
+typedef struct {
+    int             used;
+    int             role;
+    char            name[32];
+#ifdef _WIN32
+    HANDLE          handle;
+#else
+    pthread_t       thread;
+#  ifdef __linux__
+    pid_t           tid;
+#  endif
+#endif
+} ThreadEntry;
+
+static const char  *role_name[AR_THREAD_ROLES] = { "capture", "track", "render", "io", "background" };
+
+static ThreadRole   role[AR_THREAD_ROLES] = {
+    {  1, 0, 0 },                   /* capture */
+    {  1, 0, 0 },                   /* track */
+    {  1, 0, 0 },                   /* render */
+    {  0, 0, 0 },                   /* io */
+    { -1, 0, 0 }                    /* background */
+};
+static ThreadEntry  entry[AR_THREAD_MAX];
+#ifdef _WIN32
+static volatile LONG lock = 0;
+#else
+static volatile int lock = 0;
+#endif
+static THREAD_TLS int self = -1;
+
+/* The cores the process may run on, 0 when they are not known. */
+static unsigned long process_cores( void )
+{
+#ifdef _WIN32
+    DWORD_PTR       process, system;
+
+    if( !GetProcessAffinityMask( GetCurrentProcess(), &process, &system ) ) return 0;
+    return (unsigned long)process;
+#elif defined(__linux__)
+    cpu_set_t       set;
+    unsigned long   mask = 0;
+    int             i;
+
+    if( sched_getaffinity( 0, sizeof(set), &set ) != 0 ) return 0;
+    for( i = 0; i < (int)(sizeof(mask) * 8); i++ ) {
+        if( CPU_ISSET( i, &set ) ) mask |= 1UL << i;
+    }
+    return mask;
+#else
+    return 0;
+#endif
+}
+
+/* The cores of r: its own, or those of the process, less the cores the
+ * other roles isolate, unless that leaves none. */
+static unsigned long role_cores( int r )
+{
+    unsigned long   cores, isolated = 0;
+    int             i;
+
+    cores = (role[r].cores != 0)? role[r].cores: process_cores();
+    for( i = 0; i < AR_THREAD_ROLES; i++ ) {
+        if( i != r && role[i].isolate ) isolated |= role[i].cores;
+    }
+    if( (cores & ~isolated) != 0 ) cores &= ~isolated;
+    return cores;
+}
+
+/* Gives the thread of e, or the calling one when e is NULL, the priority
+ * and the cores of r. What the system refuses, as a raised priority to a
+ * user without the right, is left as it was. */
+static void thread_apply( ThreadEntry *e, int r )
+{
+    unsigned long   cores = role_cores( r );
+#ifdef _WIN32
+    HANDLE          h = (e != NULL)? e->handle: GetCurrentThread();
+
+    SetThreadPriority( h, role[r].priority );
+    if( cores != 0 ) SetThreadAffinityMask( h, (DWORD_PTR)cores );
+#elif defined(__linux__)
+    pthread_t       thread = (e != NULL)? e->thread: pthread_self();
+    pid_t           tid = (e != NULL)? e->tid: (pid_t)syscall( SYS_gettid );
+    cpu_set_t       set;
+    int             i;
+
+    setpriority( PRIO_PROCESS, tid, -5 * role[r].priority );
+    if( cores != 0 ) {
+        CPU_ZERO( &set );
+        for( i = 0; i < (int)(sizeof(cores) * 8); i++ ) {
+            if( cores & (1UL << i) ) CPU_SET( i, &set );
+        }
+        pthread_setaffinity_np( thread, sizeof(set), &set );
+    }
+#else
+    (void)e;
+    (void)cores;
+#endif
+}
+
+int arThreadRole( int r, const char *name )
+{
+    ThreadEntry    *e = NULL;
+    int             i;
+
+    if( r < 0 || r >= AR_THREAD_ROLES ) return -1;
+    if( name == NULL ) {
+        thread_apply( NULL, r );
+        return 0;
+    }
+    arTraceThreadName( name );
+
+    THREAD_LOCK();
+    if( self >= 0 ) e = &entry[self];
+    for( i = 0; e == NULL && i < AR_THREAD_MAX; i++ ) {
+        if( !entry[i].used ) {
+            e = &entry[i];
+            self = i;
+        }
+    }
+    if( e == NULL ) {
+        THREAD_UNLOCK();
+        thread_apply( NULL, r );
+        return -1;
+    }
+    if( !e->used ) {
+#ifdef _WIN32
+        DuplicateHandle( GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(),
+                         &e->handle, 0, FALSE, DUPLICATE_SAME_ACCESS );
+#else
+        e->thread = pthread_self();
+#  ifdef __linux__
+        e->tid = (pid_t)syscall( SYS_gettid );
+#  endif
+#endif
+        e->used = 1;
+    }
+    e->role = r;
+    strncpy( e->name, name, sizeof(e->name) - 1 );
+    e->name[sizeof(e->name) - 1] = '\0';
+    thread_apply( e, r );
+    THREAD_UNLOCK();
+
+    return 0;
+}
+
+void arThreadRoleEnd( void )
+{
+    if( self < 0 ) return;
+
+    THREAD_LOCK();
+#ifdef _WIN32
+    CloseHandle( entry[self].handle );
+#endif
+    entry[self].used = 0;
+    self = -1;
+    THREAD_UNLOCK();
+}
+
+int arThreadRoleSet( int r, int priority, unsigned long cores, int isolate )
+{
+    int             i;
+
+    if( r < 0 || r >= AR_THREAD_ROLES || priority < -2 || priority > 2 ) return -1;
+
+    THREAD_LOCK();
+    role[r].priority = priority;
+    role[r].cores    = cores;
+    role[r].isolate  = (isolate && cores != 0)? 1: 0;
+    /* The isolation of one role changes the cores of the others. */
+    for( i = 0; i < AR_THREAD_MAX; i++ ) {
+        if( entry[i].used ) thread_apply( &entry[i], entry[i].role );
+    }
+    THREAD_UNLOCK();
+
+    return 0;
+}
+
+int arThreadRoleLoad( const char *filename )
+{
+    FILE           *fp;
+    char            buf[256], name[64], cores[64];
+    int             priority, isolate, i, n = 0;
+
+    if( (fp = fopen( filename, "r" )) == NULL ) {
+        printf("unable to read the thread roles of %s.\n", filename);
+        return -1;
+    }
+    while( fgets( buf, sizeof(buf), fp ) != NULL ) {
+        if( buf[0] == '#' || buf[0] == '\n' || buf[0] == '\r' ) continue;
+        isolate = 0;
+        if( sscanf( buf, "%63s %d %63s %d", name, &priority, cores, &isolate ) < 3 ) {
+            printf("%s: a role is name, priority, cores and isolate: %s", filename, buf);
+            continue;
+        }
+        for( i = 0; i < AR_THREAD_ROLES; i++ ) {
+            if( strcmp( name, role_name[i] ) == 0 ) break;
+        }
+        if( i == AR_THREAD_ROLES ) {
+            printf("%s: no thread role %s.\n", filename, name);
+            continue;
+        }
+        if( arThreadRoleSet( i, priority, strtoul( cores, NULL, 0 ), isolate ) < 0 ) {
+            printf("%s: priority %d of %s out of -2 to 2.\n", filename, priority, name);
+            continue;
+        }
+        n++;
+    }
+    fclose( fp );
+
+    return n;
+}
+
+void arThreadRoleDump( FILE *fp )
+{
+    int             i;
+
+    THREAD_LOCK();
+    for( i = 0; i < AR_THREAD_ROLES; i++ ) {
+        fprintf( fp, "%-10s priority %2d  cores 0x%lx%s\n", role_name[i], role[i].priority,
+                 role_cores( i ), role[i].isolate? " isolated": "" );
+    }
+    for( i = 0; i < AR_THREAD_MAX; i++ ) {
+        if( entry[i].used ) fprintf( fp, "  %-24s %s\n", entry[i].name, role_name[entry[i].role] );
+    }
+    THREAD_UNLOCK();
+}
@@ -0,0 +1,177 @@
+/*
+ *   Trace of the spans of the threads, for chrome://tracing or Perfetto.
+ *
+ *   Each thread writes the spans it closes into a ring of its own, taken
+ *   the first time it traces, without any lock: the events are written
+ *   before the count of the ring is raised, and arTraceDump() only reads
+ *   up to that count, leaving the oldest AR_TRACE_MARGIN of a full ring,
+ *   which a thread may be writing over meanwhile.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#  include <windows.h>
+#endif
+#include <AR/ar.h>
+
+#ifdef _MSC_VER
+#  define TRACE_TLS         __declspec(thread)
+#  define TRACE_BARRIER()   MemoryBarrier()
+#  define TRACE_TAKE(n)     (InterlockedIncrement( (n) ) - 1)
+#else
+#  define TRACE_TLS         __thread
+#  define TRACE_BARRIER()   __sync_synchronize()
+#  define TRACE_TAKE(n)     __sync_fetch_and_add( (n), 1 )
+#endif
+
+#define AR_TRACE_MARGIN  64
+
+typedef struct {
+    const char   *name;
+    double        begin;
+    double        end;
+} TraceEvent;
+
+typedef struct {
+    char          thread_name[32];
+    volatile long head;                         /* events written */
+    TraceEvent    event[AR_TRACE_EVENTS];
+    /* the thread's own */
+    const char   *open_name[AR_TRACE_DEPTH];
+    double        open_begin[AR_TRACE_DEPTH];
+    int           depth;
+} TraceThread;
+
+int                       arTraceMode = DEFAULT_TRACE_MODE;
+
+static TraceThread       *trace_thread[AR_TRACE_THREADS_MAX];
+static volatile long      trace_thread_num = 0;
+static TRACE_TLS TraceThread *self = NULL;
+static TRACE_TLS int      self_full = 0;
+
+static TraceThread *trace_self( void )
+{
+    TraceThread  *t;
+    long          n;
+
+    if( self != NULL || self_full ) return self;
+
+    n = TRACE_TAKE( &trace_thread_num );
+    if( n >= AR_TRACE_THREADS_MAX ) {
+        self_full = 1;
+        return NULL;
+    }
+    if( (t = (TraceThread *)calloc( 1, sizeof(TraceThread) )) == NULL ) {
+        self_full = 1;
+        return NULL;
+    }
+    sprintf( t->thread_name, "thread %ld", n );
+    TRACE_BARRIER();
+    trace_thread[n] = t;
+    self = t;
+
+    return self;
+}
+
+void arTraceBegin( const char *name )
+{
+    TraceThread  *t;
+
+    if( (t = trace_self()) == NULL ) return;
+    if( t->depth < AR_TRACE_DEPTH ) {
+        t->open_name[t->depth]  = name;
+        t->open_begin[t->depth] = arUtilClock();
+    }
+    t->depth++;
+}
+
+void arTraceEnd( void )
+{
+    TraceThread  *t = self;
+    TraceEvent   *e;
+
+    if( t == NULL || t->depth == 0 ) return;
+    t->depth--;
+    if( t->depth >= AR_TRACE_DEPTH ) return;
+
+    e = &(t->event[t->head % AR_TRACE_EVENTS]);
+    e->name  = t->open_name[t->depth];
+    e->begin = t->open_begin[t->depth];
+    e->end   = arUtilClock();
+    TRACE_BARRIER();
+    t->head++;
+}
+
+void arTraceThreadName( const char *name )
+{
+    TraceThread  *t;
+
+    if( (t = trace_self()) == NULL ) return;
+    strncpy( t->thread_name, name, sizeof(t->thread_name) - 1 );
+}
+
+static long trace_first( TraceThread *t, long head )
+{
+    if( head <= AR_TRACE_EVENTS - AR_TRACE_MARGIN ) return 0;
+    return head - (AR_TRACE_EVENTS - AR_TRACE_MARGIN);
+}
+
+static void trace_string( FILE *fp, const char *s )
+{
+    fputc( '"', fp );
+    for( ; *s != '\0'; s++ ) {
+        if( *s == '"' || *s == '\\' ) fputc( '\\', fp );
+        if( (unsigned char)*s >= 0x20 ) fputc( *s, fp );
+    }
+    fputc( '"', fp );
+}
+
+int arTraceDump( const char *filename )
+{
+    FILE         *fp;
+    TraceThread  *t;
+    TraceEvent    e;
+    double        origin = -1.0;
+    long          num, head[AR_TRACE_THREADS_MAX];
+    long          i, j;
+    int           first = 1;
+
+    if( (fp = fopen( filename, "w" )) == NULL ) {
+        printf("Cannot write %s.\n", filename);
+        return -1;
+    }
+
+    num = trace_thread_num;
+    if( num > AR_TRACE_THREADS_MAX ) num = AR_TRACE_THREADS_MAX;
+    for( i = 0; i < num; i++ ) {
+        head[i] = 0;
+        if( (t = trace_thread[i]) == NULL ) continue;
+        head[i] = t->head;
+        TRACE_BARRIER();
+        for( j = trace_first( t, head[i] ); j < head[i]; j++ ) {
+            if( origin < 0.0 || t->event[j % AR_TRACE_EVENTS].begin < origin ) origin = t->event[j % AR_TRACE_EVENTS].begin;
+        }
+    }
+
+    fprintf( fp, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n" );
+    for( i = 0; i < num; i++ ) {
+        if( (t = trace_thread[i]) == NULL ) continue;
+        fprintf( fp, "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %ld, \"args\": {\"name\": ",
+                 first? "": ",\n", i );
+        trace_string( fp, t->thread_name );
+        fprintf( fp, "}}" );
+        first = 0;
+        for( j = trace_first( t, head[i] ); j < head[i]; j++ ) {
+            e = t->event[j % AR_TRACE_EVENTS];
+            fprintf( fp, ",\n{\"ph\": \"X\", \"name\": " );
+            trace_string( fp, e.name );
+            fprintf( fp, ", \"pid\": 1, \"tid\": %ld, \"ts\": %.1f, \"dur\": %.1f}",
+                     i, (e.begin - origin) * 1000000.0, (e.end - e.begin) * 1000000.0 );
+        }
+    }
+    fprintf( fp, "\n]}\n" );
+    fclose( fp );
+
+    return 0;
+}
@@ -17,20 +17,62 @@
 #include <windows.h>
 #else
 #include <sys/time.h>
+#include <time.h>
 #endif
 #include <AR/param.h>
 #include <AR/matrix.h>
 #include <AR/ar.h>
 
+// Two transformations per vector register in the batch routines.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  include <emmintrin.h>
+#  define AR_UTIL_SIMD
+typedef __m128d V2;
+#  define V2_LOAD(a, b)   _mm_loadh_pd( _mm_load_sd(&(a)), &(b) )
+#  define V2_STORE(a, b, v) ( _mm_storel_pd(&(a), v), _mm_storeh_pd(&(b), v) )
+#  define V2_ADD(x, y)    _mm_add_pd( x, y )
+#  define V2_SUB(x, y)    _mm_sub_pd( x, y )
+#  define V2_MUL(x, y)    _mm_mul_pd( x, y )
+#  define V2_DIV(x, y)    _mm_div_pd( x, y )
+#  define V2_SET(x)       _mm_set1_pd( x )
+#  define V2_ANY_ZERO(v)  ( _mm_movemask_pd(_mm_cmpeq_pd(v, _mm_setzero_pd())) != 0 )
+#elif defined(__aarch64__)
+#  include <arm_neon.h>
+#  define AR_UTIL_SIMD
+typedef float64x2_t V2;
+#  define V2_LOAD(a, b)   vcombine_f64( vld1_f64(&(a)), vld1_f64(&(b)) )
+#  define V2_STORE(a, b, v) ( vst1_f64(&(a), vget_low_f64(v)), vst1_f64(&(b), vget_high_f64(v)) )
+#  define V2_ADD(x, y)    vaddq_f64( x, y )
+#  define V2_SUB(x, y)    vsubq_f64( x, y )
+#  define V2_MUL(x, y)    vmulq_f64( x, y )
+#  define V2_DIV(x, y)    vdivq_f64( x, y )
+#  define V2_SET(x)       vdupq_n_f64( x )
+#  define V2_ANY_ZERO(v)  ( vgetq_lane_f64(v, 0) == 0.0 || vgetq_lane_f64(v, 1) == 0.0 )
+#endif
+
 
 int        arDebug                 = 0;
 ARUint8*   arImage                 = NULL;
 int        arFittingMode           = DEFAULT_FITTING_MODE;
 int        arImageProcMode         = DEFAULT_IMAGE_PROC_MODE;
+int        arLabelingMode          = DEFAULT_LABELING_MODE;
+int        arThresholdMode         = DEFAULT_THRESHOLD_MODE;
+int        arROIMode               = DEFAULT_ROI_MODE;
+int        arPyramidMode           = DEFAULT_PYRAMID_MODE;
+int        arLabelingThreads       = DEFAULT_LABELING_THREADS;
 ARParam    arParam;
 int        arImXsize, arImYsize;
 int        arTemplateMatchingMode  = DEFAULT_TEMPLATE_MATCHING_MODE;
 int        arMatchingPCAMode       = DEFAULT_MATCHING_PCA_MODE;
+int        arPattDetectionMode     = DEFAULT_PATT_DETECTION_MODE;
+int        arPattSamplingMode      = DEFAULT_PATT_SAMPLING_MODE;
+int        arDistortionLUTSize     = DEFAULT_DISTORTION_LUT_SIZE;
+int        arEdgeRefineMode        = DEFAULT_EDGE_REFINE_MODE;
+int        arTrackingMode          = DEFAULT_TRACKING_MODE;
+int        arCodeCacheMode         = DEFAULT_CODE_CACHE_MODE;
+int        arPoseRefineMode        = DEFAULT_POSE_REFINE_MODE;
+int        arStatsMode             = DEFAULT_STATS_MODE;
+int        arPixelFormat           = AR_DEFAULT_PIXEL_FORMAT;
 
 ARUint8*   arImageL                = NULL;
 ARUint8*   arImageR                = NULL;
@@ -61,24 +103,32 @@ ARUint32 arGetVersion(char **versionStringRef)
 }
 
 static int arGetLine2(int x_coord[], int y_coord[], int coord_num,
-                      int vertex[], double line[4][3], double v[4][2], double *dist_factor);
+                      int vertex[], double line[4][3], double v[4][2], double *dist_factor,
+                      const ARParamLUT *lut);
+static int fit_line( int x_coord[], int y_coord[], int n, double *dist_factor,
+                     const ARParamLUT *lut, double line[3] );
 
 int arInitCparam( ARParam *param )
 {
+    arCpuInit();
     arImXsize = param->xsize;
     arImYsize = param->ysize;
     arParam = *param;
+    arGetDefaultHandle();
 
     return(0);
 }
 
 int arsInitCparam( ARSParam *sparam )
 {   
+    arCpuInit();
     arImXsize = sparam->xsize;
     arImYsize = sparam->ysize;
     arsParam = *sparam;
 
     arUtilMatInv( arsParam.matL2R, arsMatR2L );
+    arsGetDefaultHandle( 1 );
+    arsGetDefaultHandle( 0 );
 
     return(0);
 }
@@ -86,55 +136,40 @@ int arsInitCparam( ARSParam *sparam )
 int arGetLine(int x_coord[], int y_coord[], int coord_num,
               int vertex[], double line[4][3], double v[4][2])
 {
-    return arGetLine2( x_coord, y_coord, coord_num, vertex, line, v, arParam.dist_factor );
+    return arGetLine2( x_coord, y_coord, coord_num, vertex, line, v, arParam.dist_factor, NULL );
 }
 
 int arsGetLine(int x_coord[], int y_coord[], int coord_num,
                int vertex[], double line[4][3], double v[4][2], int LorR)
 {   
     if( LorR ) 
-        return arGetLine2( x_coord, y_coord, coord_num, vertex, line, v, arsParam.dist_factorL );
+        return arGetLine2( x_coord, y_coord, coord_num, vertex, line, v, arsParam.dist_factorL, NULL );
     else
-        return arGetLine2( x_coord, y_coord, coord_num, vertex, line, v, arsParam.dist_factorR );
+        return arGetLine2( x_coord, y_coord, coord_num, vertex, line, v, arsParam.dist_factorR, NULL );
+}
+
+int arGetLineCtx(ARHandle *handle, int x_coord[], int y_coord[], int coord_num,
+                 int vertex[], double line[4][3], double v[4][2])
+{
+    return arGetLine2( x_coord, y_coord, coord_num, vertex, line, v, handle->dist_factor,
+                       (handle->undist.table != NULL)? &handle->undist: NULL );
 }
 
 static int arGetLine2(int x_coord[], int y_coord[], int coord_num,
-                      int vertex[], double line[4][3], double v[4][2], double *dist_factor)
+                      int vertex[], double line[4][3], double v[4][2], double *dist_factor,
+                      const ARParamLUT *lut)
 {
-    ARMat    *input, *evec;
-    ARVec    *ev, *mean;
     double   w1;
     int      st, ed, n;
-    int      i, j;
+    int      i;
 
-    ev     = arVecAlloc( 2 );
-    mean   = arVecAlloc( 2 );
-    evec   = arMatrixAlloc( 2, 2 );
     for( i = 0; i < 4; i++ ) {
         w1 = (double)(vertex[i+1]-vertex[i]+1) * 0.05 + 0.5;
         st = (int)(vertex[i]   + w1);
         ed = (int)(vertex[i+1] - w1);
         n = ed - st + 1;
-        input  = arMatrixAlloc( n, 2 );
-        for( j = 0; j < n; j++ ) {
-            arParamObserv2Ideal( dist_factor, x_coord[st+j], y_coord[st+j],
-                                 &(input->m[j*2+0]), &(input->m[j*2+1]) );
-        }
-        if( arMatrixPCA(input, evec, ev, mean) < 0 ) {
-            arMatrixFree( input );
-            arMatrixFree( evec );
-            arVecFree( mean );
-            arVecFree( ev );
-            return(-1);
-        }
-        line[i][0] =  evec->m[1];
-        line[i][1] = -evec->m[0];
-        line[i][2] = -(line[i][0]*mean->v[0] + line[i][1]*mean->v[1]);
-        arMatrixFree( input );
+        if( fit_line( &x_coord[st], &y_coord[st], n, dist_factor, lut, line[i] ) < 0 ) return(-1);
     }
-    arMatrixFree( evec );
-    arVecFree( mean );
-    arVecFree( ev );
 
     for( i = 0; i < 4; i++ ) {
         w1 = line[(i+3)%4][0] * line[i][1] - line[i][0] * line[(i+3)%4][1];
@@ -148,6 +183,61 @@ static int arGetLine2(int x_coord[], int y_coord[], int coord_num,
     return(0);
 }
 
+/* Principal axis of the n ideal points, in one pass and without the
+   allocations of arMatrixPCA(): the eigenvector of the largest eigenvalue
+   of their 2x2 covariance. The moments are taken about the first point,
+   which keeps them accurate in single precision. */
+static int fit_line( int x_coord[], int y_coord[], int n, double *dist_factor,
+                     const ARParamLUT *lut, double line[3] )
+{
+    double   ix, iy;
+    ARdouble x0, y0, dx, dy;
+    ARdouble sx, sy, sxx, sxy, syy;
+    ARdouble mx, my, cxx, cxy, cyy;
+    ARdouble l, ex, ey, fx, fy, e;
+    int      j;
+
+    if( n < 2 ) return(-1);
+
+    x0 = y0 = 0;
+    sx = sy = sxx = sxy = syy = 0;
+    for( j = 0; j < n; j++ ) {
+        if( lut != NULL ) arParamObserv2IdealLUT( lut, x_coord[j], y_coord[j], &ix, &iy );
+        else              arParamObserv2Ideal( dist_factor, x_coord[j], y_coord[j], &ix, &iy );
+        if( j == 0 ) { x0 = (ARdouble)ix; y0 = (ARdouble)iy; }
+        dx = (ARdouble)ix - x0;
+        dy = (ARdouble)iy - y0;
+        sx  += dx;
+        sy  += dy;
+        sxx += dx*dx;
+        sxy += dx*dy;
+        syy += dy*dy;
+    }
+    mx  = sx / n;
+    my  = sy / n;
+    cxx = sxx / n - mx*mx;
+    cxy = sxy / n - mx*my;
+    cyy = syy / n - my*my;
+    if( cxx + cyy <= 0 ) return(-1);
+
+    /* Both vectors are normal to a row of C - l*I; take the longer one. */
+    l  = (cxx + cyy)/2 + (ARdouble)sqrt( (cxx - cyy)*(cxx - cyy)/4 + cxy*cxy );
+    ex = l - cyy;
+    ey = cxy;
+    fx = cxy;
+    fy = l - cxx;
+    if( fx*fx + fy*fy > ex*ex + ey*ey ) { ex = fx; ey = fy; }
+    e = (ARdouble)sqrt( ex*ex + ey*ey );
+    ex /= e;
+    ey /= e;
+
+    line[0] =  ey;
+    line[1] = -ex;
+    line[2] = -(line[0]*(x0 + mx) + line[1]*(y0 + my));
+
+    return(0);
+}
+
 int arUtilMatMul( double s1[3][4], double s2[3][4], double d[3][4] )
 {
     int     i, j;
@@ -166,24 +256,7 @@ int arUtilMatMul( double s1[3][4], double s2[3][4], double d[3][4] )
 
 int arUtilMatInv( double s[3][4], double d[3][4] )
 {
-    ARMat       *mat;
-    int         i, j;
-
-    mat = arMatrixAlloc( 4, 4 );
-    for( j = 0; j < 3; j++ ) {
-        for( i = 0; i < 4; i++ ) {
-            mat->m[j*4+i] = s[j][i];
-        }
-    }
-    mat->m[3*4+0] = 0; mat->m[3*4+1] = 0;
-    mat->m[3*4+2] = 0; mat->m[3*4+3] = 1;
-    arMatrixSelfInv( mat );
-    for( j = 0; j < 3; j++ ) {
-        for( i = 0; i < 4; i++ ) {
-            d[j][i] = mat->m[j*4+i];
-        }
-    }
-    arMatrixFree( mat );
+    arMat34Inv( s, d );
 
     return 0;
 }
@@ -245,6 +318,91 @@ int arUtilQuatPos2Mat( double q[4], double p[3], double m[3][4] )
     return 0;
 }
 
+int arUtilMatMulBatch( double s1[][3][4], double s2[][3][4], double d[][3][4], int num )
+{
+    int     n;
+#ifdef AR_UTIL_SIMD
+    V2      a[3][4], b[3][4], r;
+    int     i, j;
+
+    for( n = 0; n+1 < num; n += 2 ) {
+        for( j = 0; j < 3; j++ ) {
+            for( i = 0; i < 4; i++ ) {
+                a[j][i] = V2_LOAD( s1[n][j][i], s1[n+1][j][i] );
+                b[j][i] = V2_LOAD( s2[n][j][i], s2[n+1][j][i] );
+            }
+        }
+        for( j = 0; j < 3; j++ ) {
+            for( i = 0; i < 4; i++ ) {
+                r = V2_ADD( V2_ADD( V2_MUL(a[j][0], b[0][i]), V2_MUL(a[j][1], b[1][i]) ),
+                                    V2_MUL(a[j][2], b[2][i]) );
+                if( i == 3 ) r = V2_ADD( r, a[j][3] );
+                V2_STORE( d[n][j][i], d[n+1][j][i], r );
+            }
+        }
+    }
+#else
+    n = 0;
+#endif
+    for( ; n < num; n++ ) {
+        double  t[3][4];
+        arUtilMatMul( s1[n], s2[n], t );
+        memcpy( d[n], t, sizeof(t) );
+    }
+
+    return 0;
+}
+
+int arUtilMatInvBatch( double s[][3][4], double d[][3][4], int num )
+{
+    int     ret = 0;
+    int     n;
+#ifdef AR_UTIL_SIMD
+    V2      m[3][4], c[3][3], det, r;
+    int     i, j;
+
+    for( n = 0; n+1 < num; n += 2 ) {
+        for( j = 0; j < 3; j++ ) {
+            for( i = 0; i < 4; i++ ) m[j][i] = V2_LOAD( s[n][j][i], s[n+1][j][i] );
+        }
+        /* Cofactors and determinant of the rotation part, as arMat3Inv(). */
+        c[0][0] = V2_SUB( V2_MUL(m[1][1], m[2][2]), V2_MUL(m[1][2], m[2][1]) );
+        c[0][1] = V2_SUB( V2_MUL(m[0][2], m[2][1]), V2_MUL(m[0][1], m[2][2]) );
+        c[0][2] = V2_SUB( V2_MUL(m[0][1], m[1][2]), V2_MUL(m[0][2], m[1][1]) );
+        c[1][0] = V2_SUB( V2_MUL(m[1][2], m[2][0]), V2_MUL(m[1][0], m[2][2]) );
+        c[1][1] = V2_SUB( V2_MUL(m[0][0], m[2][2]), V2_MUL(m[0][2], m[2][0]) );
+        c[1][2] = V2_SUB( V2_MUL(m[0][2], m[1][0]), V2_MUL(m[0][0], m[1][2]) );
+        c[2][0] = V2_SUB( V2_MUL(m[1][0], m[2][1]), V2_MUL(m[1][1], m[2][0]) );
+        c[2][1] = V2_SUB( V2_MUL(m[0][1], m[2][0]), V2_MUL(m[0][0], m[2][1]) );
+        c[2][2] = V2_SUB( V2_MUL(m[0][0], m[1][1]), V2_MUL(m[0][1], m[1][0]) );
+        det = V2_ADD( V2_ADD( V2_MUL(m[0][0], c[0][0]), V2_MUL(m[0][1], c[1][0]) ),
+                              V2_MUL(m[0][2], c[2][0]) );
+        if( V2_ANY_ZERO(det) ) {
+            if( arMat34Inv( s[n],   d[n]   ) < 0 ) ret = -1;
+            if( arMat34Inv( s[n+1], d[n+1] ) < 0 ) ret = -1;
+            continue;
+        }
+        for( j = 0; j < 3; j++ ) {
+            for( i = 0; i < 3; i++ ) c[j][i] = V2_DIV( c[j][i], det );
+        }
+        for( j = 0; j < 3; j++ ) {
+            for( i = 0; i < 3; i++ ) V2_STORE( d[n][j][i], d[n+1][j][i], c[j][i] );
+            r = V2_ADD( V2_ADD( V2_MUL(c[j][0], m[0][3]), V2_MUL(c[j][1], m[1][3]) ),
+                                V2_MUL(c[j][2], m[2][3]) );
+            r = V2_SUB( V2_SET(0.0), r );
+            V2_STORE( d[n][j][3], d[n+1][j][3], r );
+        }
+    }
+#else
+    n = 0;
+#endif
+    for( ; n < num; n++ ) {
+        if( arMat34Inv( s[n], d[n] ) < 0 ) ret = -1;
+    }
+
+    return ret;
+}
+
 
 static int      ss, sms;
 
@@ -298,6 +456,38 @@ void arUtilTimerReset(void)
 #endif
 }
 
+double arUtilClock(void)
+{
+#ifdef _WIN32
+    static double   period = 0.0;
+    LARGE_INTEGER   count;
+
+    if( period == 0.0 ) {
+        QueryPerformanceFrequency( &count );
+        period = 1.0 / (double)count.QuadPart;
+    }
+    QueryPerformanceCounter( &count );
+
+    return( (double)count.QuadPart * period );
+#elif defined(__linux)
+    struct timespec    ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return( (double)ts.tv_sec + (double)ts.tv_nsec * 1.0e-9 );
+#else
+    struct timeval     time;
+
+#if defined(__APPLE__)
+    gettimeofday( &time, NULL );
+#else
+    gettimeofday( &time );
+#endif
+
+    return( (double)time.tv_sec + (double)time.tv_usec * 1.0e-6 );
+#endif
+}
+
 void arUtilSleep( int msec )
 {
 #ifndef _WIN32
@@ -87,6 +87,10 @@ LIB32=link.exe -lib
 # PROP Default_Filter "cpp;c;cxx;rc;def;r;odl;idl;hpj;bat"
 # Begin Source File
 
+SOURCE=.\arCpu.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\arDetectMarker.c
 # End Source File
 # Begin Source File
@@ -95,6 +99,18 @@ SOURCE=.\arDetectMarker2.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\arDetectMarkerBatch.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\arExposure.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\arFrame.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\arGetCode.c
 # End Source File
 # Begin Source File
@@ -115,14 +131,46 @@ SOURCE=.\arGetTransMat3.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\arGetTransMatBatch.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\arGetTransMatCont.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\arHandle.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\arLabeling.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\arMatrixCode.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\arMem.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\arMultiView.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\arPoseFilter.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\arThread.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\arTrace.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\arUtil.c
 # End Source File
 # Begin Source File
@@ -191,6 +239,10 @@ SOURCE=.\mUnit.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\paramCalib.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\paramChangeSize.c
 # End Source File
 # Begin Source File
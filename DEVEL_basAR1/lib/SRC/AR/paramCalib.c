@@ -0,0 +1,994 @@
+/*******************************************************
+ *
+ * Camera calibration from images of a grid of dots.
+ *
+ * The dots of the images are found in worker threads, thread t
+ * taking images t, t+thread_num, ... The camera is then solved
+ * for all the images together: a homography per image gives a
+ * closed-form first guess of the intrinsics (Zhang's method)
+ * and of the pose of each image, and a Levenberg-Marquardt fit
+ * refines the intrinsics, the distortion and every pose on the
+ * observed dots. The camera parameters are shared while each
+ * pose belongs to one image, so the normal equations are block
+ * sparse: the pose blocks are eliminated (Schur complement) and
+ * an iteration costs time linear in the number of images.
+ *
+*******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <AR/ar.h>
+#include <AR/param.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <process.h>
+#else
+#  include <pthread.h>
+#endif
+
+/* fx, fy, cx, cy, then the distortion center and factor. The scale
+   factor of the distortion is left at 1, K taking it up. */
+#define  CAM_NUM   7
+#define  POSE_NUM  6
+
+typedef struct {
+    unsigned char  **images;
+    int              image_num;
+    int              xsize, ysize;
+    int              thresh;
+    int              dot_num_x, dot_num_y;
+    double         (*screen)[2];
+    int             *found;
+    int              first;
+    int              interval;
+} CalibJob;
+
+typedef struct {
+    double   sx, sy;
+    int      area;
+    int      border;
+} Blob;
+
+static void   do_find( CalibJob *job );
+static int    find_blobs( unsigned char *image, int xsize, int ysize, int thresh,
+                          int area_max, Blob **blob, int *blob_num );
+static int    compare_area( const void *a, const void *b );
+static int    order_dots( double (*dot)[2], int n, int dot_num_x, int dot_num_y,
+                          double screen[][2] );
+static int    assign_dots( double (*dot)[2], int n, int dot_num_x, int dot_num_y,
+                           double h[3][3], double screen[][2] );
+static int    count_near( double (*dot)[2], int n, double a[2], double b[2], double tol );
+static int    get_homography( double (*src)[2], double (*dst)[2], int n, double h[3][3] );
+static void   apply_homography( double h[3][3], double x, double y, double p[2] );
+static int    init_camera( double (*hom)[3][3], int image_num, int xsize, int ysize,
+                           double cam[CAM_NUM] );
+static void   init_pose( double h[3][3], double cam[CAM_NUM], double pose[POSE_NUM] );
+static double calib_error( double screen[][2], int image_num, int dot_num_x, int dot_num_y,
+                           double dot_dist, double cam[CAM_NUM], double *pose );
+static int    calib_step( double screen[][2], int image_num, int dot_num_x, int dot_num_y,
+                          double dot_dist, double cam[CAM_NUM], double *pose,
+                          double *work, double lambda, double new_cam[CAM_NUM],
+                          double *new_pose );
+static void   project( double cam[CAM_NUM], double pose[POSE_NUM], double x, double y,
+                       double o[2] );
+static void   rot_from_vec( double v[3], double r[3][3] );
+static void   vec_from_rot( double r[3][3], double v[3] );
+static int    chol_decomp( double *a, int n );
+static void   chol_solve( double *a, int n, double *b );
+
+#ifdef _WIN32
+static unsigned __stdcall find_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_BACKGROUND, NULL );
+    do_find( (CalibJob *)arg );
+    return 0;
+}
+#else
+static void *find_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_BACKGROUND, NULL );
+    do_find( (CalibJob *)arg );
+    return NULL;
+}
+#endif
+
+int arParamCalib( unsigned char *images[], int image_num, int xsize, int ysize,
+                  int thresh, int dot_num_x, int dot_num_y, double dot_dist,
+                  int thread_num, char *filename, ARParam *param, double *err )
+{
+    CalibJob     job[AR_BATCH_THREADS_MAX];
+#ifdef _WIN32
+    HANDLE       tid[AR_BATCH_THREADS_MAX];
+#else
+    pthread_t    tid[AR_BATCH_THREADS_MAX];
+#endif
+    int          started[AR_BATCH_THREADS_MAX];
+    double     (*screen)[2];
+    int         *found;
+    int          dot_num, used;
+    int          i, t;
+
+    if( images == NULL || image_num <= 0 || param == NULL ) return -1;
+    if( dot_num_x < 2 || dot_num_y < 2 ) return -1;
+    dot_num = dot_num_x * dot_num_y;
+    if( thread_num > AR_BATCH_THREADS_MAX ) thread_num = AR_BATCH_THREADS_MAX;
+    if( thread_num > image_num )            thread_num = image_num;
+    if( thread_num < 1 )                    thread_num = 1;
+
+    screen = (double (*)[2])malloc( sizeof(double)*2*dot_num*image_num );
+    found  = (int *)malloc( sizeof(int)*image_num );
+    if( screen == NULL || found == NULL ) {
+        free( screen );
+        free( found );
+        return -1;
+    }
+
+    for( t = 0; t < thread_num; t++ ) {
+        job[t].images    = images;
+        job[t].image_num = image_num;
+        job[t].xsize     = xsize;
+        job[t].ysize     = ysize;
+        job[t].thresh    = thresh;
+        job[t].dot_num_x = dot_num_x;
+        job[t].dot_num_y = dot_num_y;
+        job[t].screen    = screen;
+        job[t].found     = found;
+        job[t].first     = t;
+        job[t].interval  = thread_num;
+    }
+    for( t = 1; t < thread_num; t++ ) {
+#ifdef _WIN32
+        tid[t] = (HANDLE)_beginthreadex( NULL, 0, find_thread, &job[t], 0, NULL );
+        started[t] = (tid[t] != 0);
+#else
+        started[t] = (pthread_create( &tid[t], NULL, find_thread, &job[t] ) == 0);
+#endif
+    }
+    do_find( &job[0] );
+    for( t = 1; t < thread_num; t++ ) {
+        if( !started[t] ) {
+            do_find( &job[t] );
+            continue;
+        }
+#ifdef _WIN32
+        WaitForSingleObject( tid[t], INFINITE );
+        CloseHandle( tid[t] );
+#else
+        pthread_join( tid[t], NULL );
+#endif
+    }
+
+    /* Keep the images whose dots were all found, in order. */
+    used = 0;
+    for( i = 0; i < image_num; i++ ) {
+        if( !found[i] ) continue;
+        if( used != i ) {
+            memcpy( screen[used*dot_num], screen[i*dot_num], sizeof(double)*2*dot_num );
+        }
+        used++;
+    }
+    free( found );
+
+    if( arParamCalibSolve( screen, used, dot_num_x, dot_num_y, dot_dist,
+                           xsize, ysize, param, err ) < 0 ) {
+        free( screen );
+        return -1;
+    }
+    free( screen );
+
+    if( filename != NULL && arParamSave( filename, 1, param ) < 0 ) {
+        printf("Could not save the camera parameters to %s.\n", filename);
+        return -1;
+    }
+
+    return used;
+}
+
+static void do_find( CalibJob *job )
+{
+    int     dot_num;
+    int     i;
+
+    dot_num = job->dot_num_x * job->dot_num_y;
+    for( i = job->first; i < job->image_num; i += job->interval ) {
+        job->found[i] = (arParamCalibFindDots( job->images[i], job->xsize, job->ysize,
+                                               job->thresh, job->dot_num_x, job->dot_num_y,
+                                               &(job->screen[i*dot_num]) ) == 0);
+    }
+}
+
+int arParamCalibFindDots( unsigned char *image, int xsize, int ysize, int thresh,
+                          int dot_num_x, int dot_num_y, double screen[][2] )
+{
+    Blob     *blob;
+    double  (*dot)[2];
+    int       blob_num, dot_num, n;
+    int       best, i, k;
+
+    if( image == NULL || xsize <= 0 || ysize <= 0 ) return -1;
+    if( dot_num_x < 2 || dot_num_y < 2 ) return -1;
+    dot_num = dot_num_x * dot_num_y;
+
+    if( find_blobs( image, xsize, ysize, thresh, xsize*ysize/dot_num,
+                    &blob, &blob_num ) < 0 ) return -1;
+
+    /* The dots are the dot_num blobs closest in size. */
+    n = 0;
+    for( i = 0; i < blob_num; i++ ) {
+        if( blob[i].area < AR_PARAM_CALIB_DOT_AREA_MIN || blob[i].border ) continue;
+        blob[n++] = blob[i];
+    }
+    if( n < dot_num ) {
+        free( blob );
+        return -1;
+    }
+    qsort( blob, n, sizeof(Blob), compare_area );
+    best = 0;
+    for( k = 1; k + dot_num <= n; k++ ) {
+        if( (double)blob[k+dot_num-1].area*blob[best].area
+          < (double)blob[best+dot_num-1].area*blob[k].area ) best = k;
+    }
+
+    dot = (double (*)[2])malloc( sizeof(double)*2*dot_num );
+    if( dot == NULL ) {
+        free( blob );
+        return -1;
+    }
+    for( i = 0; i < dot_num; i++ ) {
+        dot[i][0] = blob[best+i].sx / blob[best+i].area;
+        dot[i][1] = blob[best+i].sy / blob[best+i].area;
+    }
+    free( blob );
+
+    k = order_dots( dot, dot_num, dot_num_x, dot_num_y, screen );
+    free( dot );
+
+    return k;
+}
+
+/* The 4-connected regions darker than thresh and at most area_max pixels
+   large, with their pixel sums. */
+static int find_blobs( unsigned char *image, int xsize, int ysize, int thresh,
+                       int area_max, Blob **blob, int *blob_num )
+{
+    unsigned char   *mark;
+    int             *stack;
+    Blob            *b, *nb;
+    int              b_max, sp, p, x, y, q;
+
+    mark  = (unsigned char *)calloc( xsize*ysize, 1 );
+    stack = (int *)malloc( sizeof(int)*xsize*ysize );
+    b_max = 256;
+    b     = (Blob *)malloc( sizeof(Blob)*b_max );
+    if( mark == NULL || stack == NULL || b == NULL ) {
+        free( mark );
+        free( stack );
+        free( b );
+        return -1;
+    }
+
+    *blob_num = 0;
+    for( p = 0; p < xsize*ysize; p++ ) {
+        if( mark[p] || image[p] >= thresh ) continue;
+
+        if( *blob_num == b_max ) {
+            nb = (Blob *)realloc( b, sizeof(Blob)*b_max*2 );
+            if( nb == NULL ) {
+                free( mark );
+                free( stack );
+                free( b );
+                return -1;
+            }
+            b = nb;
+            b_max *= 2;
+        }
+        nb = &b[*blob_num];
+        nb->sx = nb->sy = 0.0;
+        nb->area = 0;
+        nb->border = 0;
+
+        sp = 0;
+        stack[sp++] = p;
+        mark[p] = 1;
+        while( sp > 0 ) {
+            q = stack[--sp];
+            x = q % xsize;
+            y = q / xsize;
+            nb->sx += x;
+            nb->sy += y;
+            nb->area++;
+            if( x == 0 || y == 0 || x == xsize-1 || y == ysize-1 ) nb->border = 1;
+            if( x > 0       && !mark[q-1]     && image[q-1]     < thresh ) { mark[q-1] = 1;     stack[sp++] = q-1; }
+            if( x < xsize-1 && !mark[q+1]     && image[q+1]     < thresh ) { mark[q+1] = 1;     stack[sp++] = q+1; }
+            if( y > 0       && !mark[q-xsize] && image[q-xsize] < thresh ) { mark[q-xsize] = 1; stack[sp++] = q-xsize; }
+            if( y < ysize-1 && !mark[q+xsize] && image[q+xsize] < thresh ) { mark[q+xsize] = 1; stack[sp++] = q+xsize; }
+        }
+        if( nb->area <= area_max ) (*blob_num)++;
+    }
+
+    free( mark );
+    free( stack );
+    *blob = b;
+
+    return 0;
+}
+
+static int compare_area( const void *a, const void *b )
+{
+    return ((const Blob *)a)->area - ((const Blob *)b)->area;
+}
+
+/* The corners of the grid are the 4 sharpest vertices of the convex hull
+   of the dots. The side with dot_num_x dots on it is the first row. */
+static int order_dots( double (*dot)[2], int n, int dot_num_x, int dot_num_y,
+                       double screen[][2] )
+{
+    double   corner[4][2], grid[4][2], h[3][3];
+    double   ang[4], a, ux, uy, vx, vy, len, tol;
+    int      hull[2*AR_PARAM_NMAX+2], order[AR_PARAM_NMAX];
+    int      hull_num, lower, crn[4], c0;
+    int      i, j, k, cx, cy;
+
+    if( n > AR_PARAM_NMAX ) return -1;
+
+    /* Monotone chain hull, counter-clockwise. */
+    for( i = 0; i < n; i++ ) order[i] = i;
+    for( i = 1; i < n; i++ ) {
+        k = order[i];
+        for( j = i; j > 0 && (dot[order[j-1]][0] > dot[k][0]
+                           || (dot[order[j-1]][0] == dot[k][0] && dot[order[j-1]][1] > dot[k][1])); j-- ) {
+            order[j] = order[j-1];
+        }
+        order[j] = k;
+    }
+    hull_num = 0;
+    for( i = 0; i < n; i++ ) {
+        while( hull_num >= 2
+            && (dot[hull[hull_num-1]][0]-dot[hull[hull_num-2]][0])*(dot[order[i]][1]-dot[hull[hull_num-2]][1])
+             - (dot[hull[hull_num-1]][1]-dot[hull[hull_num-2]][1])*(dot[order[i]][0]-dot[hull[hull_num-2]][0]) <= 0 ) hull_num--;
+        hull[hull_num++] = order[i];
+    }
+    lower = hull_num + 1;
+    for( i = n-2; i >= 0; i-- ) {
+        while( hull_num >= lower
+            && (dot[hull[hull_num-1]][0]-dot[hull[hull_num-2]][0])*(dot[order[i]][1]-dot[hull[hull_num-2]][1])
+             - (dot[hull[hull_num-1]][1]-dot[hull[hull_num-2]][1])*(dot[order[i]][0]-dot[hull[hull_num-2]][0]) <= 0 ) hull_num--;
+        hull[hull_num++] = order[i];
+    }
+    hull_num--;
+    if( hull_num < 4 ) return -1;
+
+    /* The 4 smallest interior angles, kept in hull order. */
+    for( k = 0; k < 4; k++ ) { crn[k] = -1; ang[k] = 10.0; }
+    for( i = 0; i < hull_num; i++ ) {
+        ux = dot[hull[(i+hull_num-1)%hull_num]][0] - dot[hull[i]][0];
+        uy = dot[hull[(i+hull_num-1)%hull_num]][1] - dot[hull[i]][1];
+        vx = dot[hull[(i+1)%hull_num]][0] - dot[hull[i]][0];
+        vy = dot[hull[(i+1)%hull_num]][1] - dot[hull[i]][1];
+        a = acos( (ux*vx + uy*vy) / sqrt((ux*ux + uy*uy)*(vx*vx + vy*vy)) );
+        for( k = 3; k >= 0 && a < ang[k]; k-- ) {
+            if( k < 3 ) { ang[k+1] = ang[k]; crn[k+1] = crn[k]; }
+            ang[k] = a;
+            crn[k] = i;
+        }
+    }
+    for( i = 1; i < 4; i++ ) {
+        k = crn[i];
+        for( j = i; j > 0 && crn[j-1] > k; j-- ) crn[j] = crn[j-1];
+        crn[j] = k;
+    }
+    for( k = 0; k < 4; k++ ) {
+        corner[k][0] = dot[hull[crn[k]]][0];
+        corner[k][1] = dot[hull[crn[k]]][1];
+    }
+
+    /* Which side is a row: count the dots along the first two sides. */
+    c0 = -1;
+    for( k = 0; k < 2 && c0 < 0; k++ ) {
+        ux = corner[k+1][0] - corner[k][0];
+        uy = corner[k+1][1] - corner[k][1];
+        len = sqrt( ux*ux + uy*uy );
+        tol = 0.3 * len / ((dot_num_x > dot_num_y)? dot_num_x-1: dot_num_y-1);
+        i = count_near( dot, n, corner[k], corner[k+1], tol );
+        if( i == dot_num_x ) c0 = k;
+        else if( i == dot_num_y ) c0 = k + 1;
+    }
+    if( c0 < 0 ) return -1;
+
+    cx = dot_num_x - 1;
+    cy = dot_num_y - 1;
+    grid[0][0] = 0;  grid[0][1] = 0;
+    grid[1][0] = cx; grid[1][1] = 0;
+    grid[2][0] = cx; grid[2][1] = cy;
+    grid[3][0] = 0;  grid[3][1] = cy;
+    {
+        double  c[4][2];
+        for( k = 0; k < 4; k++ ) {
+            c[k][0] = corner[(c0+k)%4][0];
+            c[k][1] = corner[(c0+k)%4][1];
+        }
+        if( get_homography( grid, c, 4, h ) < 0 ) return -1;
+    }
+
+    /* Predict the dots from the corners, then again from all the dots. */
+    if( assign_dots( dot, n, dot_num_x, dot_num_y, h, screen ) < 0 ) return -1;
+    {
+        double  (*g)[2];
+        g = (double (*)[2])malloc( sizeof(double)*2*n );
+        if( g == NULL ) return -1;
+        for( j = 0; j < dot_num_y; j++ ) {
+            for( i = 0; i < dot_num_x; i++ ) {
+                g[j*dot_num_x+i][0] = i;
+                g[j*dot_num_x+i][1] = j;
+            }
+        }
+        k = get_homography( g, screen, n, h );
+        free( g );
+        if( k < 0 ) return -1;
+    }
+    return assign_dots( dot, n, dot_num_x, dot_num_y, h, screen );
+}
+
+/* Each grid position takes the nearest dot, which must be nobody else's. */
+static int assign_dots( double (*dot)[2], int n, int dot_num_x, int dot_num_y,
+                        double h[3][3], double screen[][2] )
+{
+    unsigned char   used[AR_PARAM_NMAX];
+    double          p[2], d, dmin;
+    int             i, j, k, kmin;
+
+    memset( used, 0, n );
+    for( j = 0; j < dot_num_y; j++ ) {
+        for( i = 0; i < dot_num_x; i++ ) {
+            apply_homography( h, i, j, p );
+            kmin = -1;
+            dmin = 0.0;
+            for( k = 0; k < n; k++ ) {
+                d = (dot[k][0]-p[0])*(dot[k][0]-p[0]) + (dot[k][1]-p[1])*(dot[k][1]-p[1]);
+                if( kmin < 0 || d < dmin ) { kmin = k; dmin = d; }
+            }
+            if( used[kmin] ) return -1;
+            used[kmin] = 1;
+            screen[j*dot_num_x+i][0] = dot[kmin][0];
+            screen[j*dot_num_x+i][1] = dot[kmin][1];
+        }
+    }
+
+    return 0;
+}
+
+static int count_near( double (*dot)[2], int n, double a[2], double b[2], double tol )
+{
+    double   ux, uy, len, d, s;
+    int      i, c;
+
+    ux = b[0] - a[0];
+    uy = b[1] - a[1];
+    len = sqrt( ux*ux + uy*uy );
+    if( len == 0.0 ) return 0;
+    ux /= len;
+    uy /= len;
+
+    c = 0;
+    for( i = 0; i < n; i++ ) {
+        s = (dot[i][0]-a[0])*ux + (dot[i][1]-a[1])*uy;
+        d = (dot[i][1]-a[1])*ux - (dot[i][0]-a[0])*uy;
+        if( s > -tol && s < len + tol && fabs(d) < tol ) c++;
+    }
+
+    return c;
+}
+
+/* h maps src onto dst, h[2][2] = 1. Both point sets are centred and
+   scaled first, which keeps the normal equations well conditioned. */
+static int get_homography( double (*src)[2], double (*dst)[2], int n, double h[3][3] )
+{
+    double   a[64], b[8], r[8], hn[3][3];
+    double   sm[2], dm[2], ss, ds;
+    double   x, y, u, v;
+    int      i, j, k;
+
+    if( n < 4 ) return -1;
+
+    sm[0] = sm[1] = dm[0] = dm[1] = 0.0;
+    for( i = 0; i < n; i++ ) {
+        sm[0] += src[i][0]; sm[1] += src[i][1];
+        dm[0] += dst[i][0]; dm[1] += dst[i][1];
+    }
+    sm[0] /= n; sm[1] /= n; dm[0] /= n; dm[1] /= n;
+    ss = ds = 0.0;
+    for( i = 0; i < n; i++ ) {
+        ss += sqrt( (src[i][0]-sm[0])*(src[i][0]-sm[0]) + (src[i][1]-sm[1])*(src[i][1]-sm[1]) );
+        ds += sqrt( (dst[i][0]-dm[0])*(dst[i][0]-dm[0]) + (dst[i][1]-dm[1])*(dst[i][1]-dm[1]) );
+    }
+    if( ss == 0.0 || ds == 0.0 ) return -1;
+    ss = n / ss;
+    ds = n / ds;
+
+    for( i = 0; i < 64; i++ ) a[i] = 0.0;
+    for( i = 0; i < 8; i++ )  b[i] = 0.0;
+    for( k = 0; k < n; k++ ) {
+        x = (src[k][0] - sm[0]) * ss;
+        y = (src[k][1] - sm[1]) * ss;
+        u = (dst[k][0] - dm[0]) * ds;
+        v = (dst[k][1] - dm[1]) * ds;
+        r[0] = x; r[1] = y; r[2] = 1; r[3] = r[4] = r[5] = 0; r[6] = -x*u; r[7] = -y*u;
+        for( i = 0; i < 8; i++ ) {
+            for( j = 0; j < 8; j++ ) a[i*8+j] += r[i] * r[j];
+            b[i] += r[i] * u;
+        }
+        r[0] = r[1] = r[2] = 0; r[3] = x; r[4] = y; r[5] = 1; r[6] = -x*v; r[7] = -y*v;
+        for( i = 0; i < 8; i++ ) {
+            for( j = 0; j < 8; j++ ) a[i*8+j] += r[i] * r[j];
+            b[i] += r[i] * v;
+        }
+    }
+    if( chol_decomp( a, 8 ) < 0 ) return -1;
+    chol_solve( a, 8, b );
+
+    hn[0][0] = b[0]; hn[0][1] = b[1]; hn[0][2] = b[2];
+    hn[1][0] = b[3]; hn[1][1] = b[4]; hn[1][2] = b[5];
+    hn[2][0] = b[6]; hn[2][1] = b[7]; hn[2][2] = 1.0;
+
+    /* Undo the normalisations: h = Td^-1 hn Ts. */
+    for( i = 0; i < 3; i++ ) {
+        for( j = 0; j < 3; j++ ) {
+            x = (j < 2)? hn[i][j]*ss: hn[i][2] - (hn[i][0]*sm[0] + hn[i][1]*sm[1])*ss;
+            h[i][j] = x;
+        }
+    }
+    for( j = 0; j < 3; j++ ) {
+        h[0][j] = h[0][j] / ds + dm[0] * h[2][j];
+        h[1][j] = h[1][j] / ds + dm[1] * h[2][j];
+    }
+    for( i = 0; i < 3; i++ ) {
+        for( j = 0; j < 3; j++ ) if( i != 2 || j != 2 ) h[i][j] /= h[2][2];
+    }
+    h[2][2] = 1.0;
+
+    return 0;
+}
+
+static void apply_homography( double h[3][3], double x, double y, double p[2] )
+{
+    double   w;
+
+    w    =  h[2][0]*x + h[2][1]*y + h[2][2];
+    p[0] = (h[0][0]*x + h[0][1]*y + h[0][2]) / w;
+    p[1] = (h[1][0]*x + h[1][1]*y + h[1][2]) / w;
+}
+
+int arParamCalibSolve( double screen[][2], int image_num, int dot_num_x, int dot_num_y,
+                       double dot_dist, int xsize, int ysize, ARParam *param, double *err )
+{
+    double    (*hom)[3][3];
+    double    (*grid)[2];
+    double     *pose, *new_pose, *work;
+    double      cam[CAM_NUM], new_cam[CAM_NUM];
+    double      e, new_e, lambda;
+    int         dot_num;
+    int         i, j, loop;
+
+    if( screen == NULL || param == NULL ) return -1;
+    if( image_num < AR_PARAM_CALIB_FRAMES_MIN ) return -1;
+    if( dot_num_x < 2 || dot_num_y < 2 || dot_dist <= 0.0 ) return -1;
+    dot_num = dot_num_x * dot_num_y;
+
+    hom      = (double (*)[3][3])malloc( sizeof(double)*9*image_num );
+    grid     = (double (*)[2])malloc( sizeof(double)*2*dot_num );
+    pose     = (double *)malloc( sizeof(double)*POSE_NUM*image_num );
+    new_pose = (double *)malloc( sizeof(double)*POSE_NUM*image_num );
+    work     = (double *)malloc( sizeof(double)*(POSE_NUM*POSE_NUM + CAM_NUM*POSE_NUM + POSE_NUM)*image_num );
+    if( hom == NULL || grid == NULL || pose == NULL || new_pose == NULL || work == NULL ) {
+        free( hom ); free( grid ); free( pose ); free( new_pose ); free( work );
+        return -1;
+    }
+
+    for( j = 0; j < dot_num_y; j++ ) {
+        for( i = 0; i < dot_num_x; i++ ) {
+            grid[j*dot_num_x+i][0] = i * dot_dist;
+            grid[j*dot_num_x+i][1] = j * dot_dist;
+        }
+    }
+    for( i = 0; i < image_num; i++ ) {
+        if( get_homography( grid, &screen[i*dot_num], dot_num, hom[i] ) < 0 ) {
+            free( hom ); free( grid ); free( pose ); free( new_pose ); free( work );
+            return -1;
+        }
+    }
+    free( grid );
+
+    init_camera( hom, image_num, xsize, ysize, cam );
+    for( i = 0; i < image_num; i++ ) init_pose( hom[i], cam, &pose[i*POSE_NUM] );
+    free( hom );
+
+    e = calib_error( screen, image_num, dot_num_x, dot_num_y, dot_dist, cam, pose );
+    lambda = 0.001;
+    for( loop = 0; loop < AR_PARAM_CALIB_MAX_LOOP_COUNT; loop++ ) {
+        if( calib_step( screen, image_num, dot_num_x, dot_num_y, dot_dist, cam, pose,
+                        work, lambda, new_cam, new_pose ) < 0 ) {
+            new_e = e;
+        }
+        else {
+            new_e = calib_error( screen, image_num, dot_num_x, dot_num_y, dot_dist,
+                                 new_cam, new_pose );
+        }
+        if( new_e < e ) {
+            memcpy( cam, new_cam, sizeof(cam) );
+            memcpy( pose, new_pose, sizeof(double)*POSE_NUM*image_num );
+            if( e - new_e < AR_PARAM_CALIB_CONVERGE * e ) { e = new_e; break; }
+            e = new_e;
+            lambda *= 0.1;
+        }
+        else {
+            lambda *= 10.0;
+            if( lambda > 1.0e10 ) break;
+        }
+    }
+    free( pose );
+    free( new_pose );
+    free( work );
+
+    param->xsize = xsize;
+    param->ysize = ysize;
+    for( j = 0; j < 3; j++ ) for( i = 0; i < 4; i++ ) param->mat[j][i] = 0.0;
+    param->mat[0][0] = cam[0];
+    param->mat[1][1] = cam[1];
+    param->mat[0][2] = cam[2];
+    param->mat[1][2] = cam[3];
+    param->mat[2][2] = 1.0;
+    param->dist_factor[0] = cam[4];
+    param->dist_factor[1] = cam[5];
+    param->dist_factor[2] = cam[6];
+    param->dist_factor[3] = 1.0;
+    if( err != NULL ) *err = sqrt( e / (image_num*dot_num) );
+
+    return 0;
+}
+
+/* Zhang's closed form, with no skew, in coordinates scaled by the image
+   size. An implausible result falls back to a centred principal point
+   and a 53 degree field of view. */
+static int init_camera( double (*hom)[3][3], int image_num, int xsize, int ysize,
+                        double cam[CAM_NUM] )
+{
+    double   a[16], b[4], r[4], rhs;
+    double   h[3][3], v[2][6];
+    double   s, ox, oy, l, fx, fy;
+    int      i, j, k, m;
+
+    s  = (xsize > ysize)? xsize: ysize;
+    ox = xsize / 2.0;
+    oy = ysize / 2.0;
+
+    for( i = 0; i < 16; i++ ) a[i] = 0.0;
+    for( i = 0; i < 4; i++ )  b[i] = 0.0;
+    for( k = 0; k < image_num; k++ ) {
+        for( j = 0; j < 3; j++ ) {
+            h[0][j] = (hom[k][0][j] - ox*hom[k][2][j]) / s;
+            h[1][j] = (hom[k][1][j] - oy*hom[k][2][j]) / s;
+            h[2][j] =  hom[k][2][j];
+        }
+        /* v_ij . (B11, B22, B13, B23, B33) for columns i, j of h. */
+        for( m = 0; m < 2; m++ ) {
+            int c1 = 0, c2 = 1 - m;
+            v[m][0] = h[0][c1]*h[0][c2];
+            v[m][1] = h[1][c1]*h[1][c2];
+            v[m][2] = h[2][c1]*h[0][c2] + h[0][c1]*h[2][c2];
+            v[m][3] = h[2][c1]*h[1][c2] + h[1][c1]*h[2][c2];
+            v[m][4] = h[2][c1]*h[2][c2];
+        }
+        v[1][0] -= h[0][1]*h[0][1];
+        v[1][1] -= h[1][1]*h[1][1];
+        v[1][2] -= 2.0*h[2][1]*h[0][1];
+        v[1][3] -= 2.0*h[2][1]*h[1][1];
+        v[1][4] -= h[2][1]*h[2][1];
+        for( m = 0; m < 2; m++ ) {
+            /* B11 = 1. */
+            for( i = 0; i < 4; i++ ) r[i] = v[m][i+1];
+            rhs = -v[m][0];
+            for( i = 0; i < 4; i++ ) {
+                for( j = 0; j < 4; j++ ) a[i*4+j] += r[i] * r[j];
+                b[i] += r[i] * rhs;
+            }
+        }
+    }
+
+    cam[4] = ox;
+    cam[5] = oy;
+    cam[6] = 0.0;
+    if( chol_decomp( a, 4 ) == 0 ) {
+        chol_solve( a, 4, b );
+        if( b[0] > 0.0 ) {
+            l  = b[3] - b[1]*b[1] - b[2]*b[2]/b[0];
+            fx = l;
+            fy = l / b[0];
+            if( fx > 0.0 && fy > 0.0 ) {
+                cam[0] = sqrt( fx ) * s;
+                cam[1] = sqrt( fy ) * s;
+                cam[2] = -b[1] * s + ox;
+                cam[3] = -b[2] / b[0] * s + oy;
+                if( cam[2] > 0 && cam[2] < xsize && cam[3] > 0 && cam[3] < ysize ) return 0;
+            }
+        }
+    }
+    cam[0] = cam[1] = xsize;
+    cam[2] = ox;
+    cam[3] = oy;
+
+    return -1;
+}
+
+/* Pose of the grid from its homography: K^-1 h = [r1 r2 t] up to scale. */
+static void init_pose( double h[3][3], double cam[CAM_NUM], double pose[POSE_NUM] )
+{
+    double   a[3][3], r[3][3], l, d;
+    int      i, j;
+
+    for( j = 0; j < 3; j++ ) {
+        a[0][j] = (h[0][j] - cam[2]*h[2][j]) / cam[0];
+        a[1][j] = (h[1][j] - cam[3]*h[2][j]) / cam[1];
+        a[2][j] =  h[2][j];
+    }
+    l = 1.0 / sqrt( a[0][0]*a[0][0] + a[1][0]*a[1][0] + a[2][0]*a[2][0] );
+    if( a[2][2] < 0.0 ) l = -l;
+    for( i = 0; i < 3; i++ ) {
+        r[i][0]   = a[i][0] * l;
+        r[i][1]   = a[i][1] * l;
+        pose[3+i] = a[i][2] * l;
+    }
+    d = r[0][0]*r[0][1] + r[1][0]*r[1][1] + r[2][0]*r[2][1];
+    for( i = 0; i < 3; i++ ) r[i][1] -= d * r[i][0];
+    d = sqrt( r[0][1]*r[0][1] + r[1][1]*r[1][1] + r[2][1]*r[2][1] );
+    for( i = 0; i < 3; i++ ) r[i][1] /= d;
+    r[0][2] = r[1][0]*r[2][1] - r[2][0]*r[1][1];
+    r[1][2] = r[2][0]*r[0][1] - r[0][0]*r[2][1];
+    r[2][2] = r[0][0]*r[1][1] - r[1][0]*r[0][1];
+    vec_from_rot( r, pose );
+}
+
+static double calib_error( double screen[][2], int image_num, int dot_num_x, int dot_num_y,
+                           double dot_dist, double cam[CAM_NUM], double *pose )
+{
+    double   o[2], e;
+    int      dot_num, k, i, j;
+
+    dot_num = dot_num_x * dot_num_y;
+    e = 0.0;
+    for( k = 0; k < image_num; k++ ) {
+        for( j = 0; j < dot_num_y; j++ ) {
+            for( i = 0; i < dot_num_x; i++ ) {
+                project( cam, &pose[k*POSE_NUM], i*dot_dist, j*dot_dist, o );
+                o[0] -= screen[k*dot_num + j*dot_num_x + i][0];
+                o[1] -= screen[k*dot_num + j*dot_num_x + i][1];
+                e += o[0]*o[0] + o[1]*o[1];
+            }
+        }
+    }
+
+    return e;
+}
+
+/* One damped Gauss-Newton step. U, V_k and W_k are the camera, pose and
+   mixed blocks of J^T J, with numerical derivatives. The pose blocks are
+   eliminated: (U - sum W_k V_k^-1 W_k^T) dc = gc - sum W_k V_k^-1 g_k,
+   then dp_k = V_k^-1 (g_k - W_k^T dc). */
+static int calib_step( double screen[][2], int image_num, int dot_num_x, int dot_num_y,
+                       double dot_dist, double cam[CAM_NUM], double *pose,
+                       double *work, double lambda, double new_cam[CAM_NUM],
+                       double *new_pose )
+{
+    double   u[CAM_NUM*CAM_NUM], gc[CAM_NUM], s[CAM_NUM*CAM_NUM], sb[CAM_NUM];
+    double   jc[2][CAM_NUM], jp[2][POSE_NUM], vw[CAM_NUM+1][POSE_NUM];
+    double   c[CAM_NUM], p[POSE_NUM], o[2], o1[2], o2[2], res[2], dh;
+    double  *v, *w, *g;
+    int      dot_num, k, i, j, a, b, m;
+
+    dot_num = dot_num_x * dot_num_y;
+    for( a = 0; a < CAM_NUM*CAM_NUM; a++ ) u[a] = 0.0;
+    for( a = 0; a < CAM_NUM; a++ ) gc[a] = 0.0;
+
+    for( k = 0; k < image_num; k++ ) {
+        v = &work[k*(POSE_NUM*POSE_NUM + CAM_NUM*POSE_NUM + POSE_NUM)];
+        w = v + POSE_NUM*POSE_NUM;
+        g = w + CAM_NUM*POSE_NUM;
+        for( a = 0; a < POSE_NUM*POSE_NUM; a++ ) v[a] = 0.0;
+        for( a = 0; a < CAM_NUM*POSE_NUM; a++ ) w[a] = 0.0;
+        for( a = 0; a < POSE_NUM; a++ ) g[a] = 0.0;
+
+        for( j = 0; j < dot_num_y; j++ ) {
+            for( i = 0; i < dot_num_x; i++ ) {
+                project( cam, &pose[k*POSE_NUM], i*dot_dist, j*dot_dist, o );
+                res[0] = screen[k*dot_num + j*dot_num_x + i][0] - o[0];
+                res[1] = screen[k*dot_num + j*dot_num_x + i][1] - o[1];
+
+                for( a = 0; a < CAM_NUM; a++ ) {
+                    memcpy( c, cam, sizeof(c) );
+                    dh = 1.0e-6 * (fabs(cam[a]) + 1.0);
+                    c[a] = cam[a] + dh;
+                    project( c, &pose[k*POSE_NUM], i*dot_dist, j*dot_dist, o1 );
+                    c[a] = cam[a] - dh;
+                    project( c, &pose[k*POSE_NUM], i*dot_dist, j*dot_dist, o2 );
+                    jc[0][a] = (o1[0] - o2[0]) / (2.0*dh);
+                    jc[1][a] = (o1[1] - o2[1]) / (2.0*dh);
+                }
+                for( a = 0; a < POSE_NUM; a++ ) {
+                    memcpy( p, &pose[k*POSE_NUM], sizeof(p) );
+                    dh = (a < 3)? 1.0e-7: 1.0e-6 * (fabs(p[a]) + 1.0);
+                    p[a] = pose[k*POSE_NUM+a] + dh;
+                    project( cam, p, i*dot_dist, j*dot_dist, o1 );
+                    p[a] = pose[k*POSE_NUM+a] - dh;
+                    project( cam, p, i*dot_dist, j*dot_dist, o2 );
+                    jp[0][a] = (o1[0] - o2[0]) / (2.0*dh);
+                    jp[1][a] = (o1[1] - o2[1]) / (2.0*dh);
+                }
+
+                for( m = 0; m < 2; m++ ) {
+                    for( a = 0; a < CAM_NUM; a++ ) {
+                        for( b = 0; b < CAM_NUM; b++ ) u[a*CAM_NUM+b] += jc[m][a] * jc[m][b];
+                        for( b = 0; b < POSE_NUM; b++ ) w[a*POSE_NUM+b] += jc[m][a] * jp[m][b];
+                        gc[a] += jc[m][a] * res[m];
+                    }
+                    for( a = 0; a < POSE_NUM; a++ ) {
+                        for( b = 0; b < POSE_NUM; b++ ) v[a*POSE_NUM+b] += jp[m][a] * jp[m][b];
+                        g[a] += jp[m][a] * res[m];
+                    }
+                }
+            }
+        }
+    }
+
+    /* Schur complement of the damped pose blocks. The damping has a floor:
+       without distortion the distortion center does not move the dots. */
+    dh = 0.0;
+    for( a = 0; a < CAM_NUM; a++ ) if( u[a*CAM_NUM+a] > dh ) dh = u[a*CAM_NUM+a];
+    for( a = 0; a < CAM_NUM*CAM_NUM; a++ ) s[a] = u[a];
+    for( a = 0; a < CAM_NUM; a++ ) {
+        s[a*CAM_NUM+a] += lambda * ((u[a*CAM_NUM+a] > 1.0e-6*dh)? u[a*CAM_NUM+a]: 1.0e-6*dh);
+        sb[a] = gc[a];
+    }
+    for( k = 0; k < image_num; k++ ) {
+        v = &work[k*(POSE_NUM*POSE_NUM + CAM_NUM*POSE_NUM + POSE_NUM)];
+        w = v + POSE_NUM*POSE_NUM;
+        g = w + CAM_NUM*POSE_NUM;
+        for( a = 0; a < POSE_NUM; a++ ) v[a*POSE_NUM+a] *= 1.0 + lambda;
+        if( chol_decomp( v, POSE_NUM ) < 0 ) return -1;
+        /* vw[a] = V^-1 W^T row a, vw[CAM_NUM] = V^-1 g. */
+        for( a = 0; a < CAM_NUM; a++ ) {
+            for( b = 0; b < POSE_NUM; b++ ) vw[a][b] = w[a*POSE_NUM+b];
+            chol_solve( v, POSE_NUM, vw[a] );
+        }
+        for( b = 0; b < POSE_NUM; b++ ) vw[CAM_NUM][b] = g[b];
+        chol_solve( v, POSE_NUM, vw[CAM_NUM] );
+        for( a = 0; a < CAM_NUM; a++ ) {
+            for( b = 0; b < CAM_NUM; b++ ) {
+                for( m = 0; m < POSE_NUM; m++ ) s[a*CAM_NUM+b] -= w[a*POSE_NUM+m] * vw[b][m];
+            }
+            for( m = 0; m < POSE_NUM; m++ ) sb[a] -= w[a*POSE_NUM+m] * vw[CAM_NUM][m];
+        }
+    }
+    if( chol_decomp( s, CAM_NUM ) < 0 ) return -1;
+    chol_solve( s, CAM_NUM, sb );
+    for( a = 0; a < CAM_NUM; a++ ) new_cam[a] = cam[a] + sb[a];
+
+    /* Back-substitute the poses (v holds the factor of V_k). */
+    for( k = 0; k < image_num; k++ ) {
+        v = &work[k*(POSE_NUM*POSE_NUM + CAM_NUM*POSE_NUM + POSE_NUM)];
+        w = v + POSE_NUM*POSE_NUM;
+        g = w + CAM_NUM*POSE_NUM;
+        for( b = 0; b < POSE_NUM; b++ ) {
+            p[b] = g[b];
+            for( a = 0; a < CAM_NUM; a++ ) p[b] -= w[a*POSE_NUM+b] * sb[a];
+        }
+        chol_solve( v, POSE_NUM, p );
+        for( b = 0; b < POSE_NUM; b++ ) new_pose[k*POSE_NUM+b] = pose[k*POSE_NUM+b] + p[b];
+    }
+
+    return 0;
+}
+
+/* Observed position of grid point (x, y, 0): pinhole through K, then the
+   distortion of arParamIdeal2Observ() with a scale factor of 1. */
+static void project( double cam[CAM_NUM], double pose[POSE_NUM], double x, double y,
+                     double o[2] )
+{
+    double   r[3][3], px, py, pz, ix, iy, d;
+
+    rot_from_vec( pose, r );
+    px = r[0][0]*x + r[0][1]*y + pose[3];
+    py = r[1][0]*x + r[1][1]*y + pose[4];
+    pz = r[2][0]*x + r[2][1]*y + pose[5];
+    ix = cam[0] * px / pz + cam[2] - cam[4];
+    iy = cam[1] * py / pz + cam[3] - cam[5];
+    d  = 1.0 - cam[6]/100000000.0 * (ix*ix + iy*iy);
+    o[0] = ix * d + cam[4];
+    o[1] = iy * d + cam[5];
+}
+
+static void rot_from_vec( double v[3], double r[3][3] )
+{
+    double   a, c, s, t, x, y, z;
+
+    a = sqrt( v[0]*v[0] + v[1]*v[1] + v[2]*v[2] );
+    if( a < 1.0e-12 ) {
+        r[0][0] = 1.0;   r[0][1] = -v[2]; r[0][2] =  v[1];
+        r[1][0] =  v[2]; r[1][1] = 1.0;   r[1][2] = -v[0];
+        r[2][0] = -v[1]; r[2][1] =  v[0]; r[2][2] = 1.0;
+        return;
+    }
+    x = v[0] / a; y = v[1] / a; z = v[2] / a;
+    c = cos( a ); s = sin( a ); t = 1.0 - c;
+    r[0][0] = t*x*x + c;   r[0][1] = t*x*y - s*z; r[0][2] = t*x*z + s*y;
+    r[1][0] = t*x*y + s*z; r[1][1] = t*y*y + c;   r[1][2] = t*y*z - s*x;
+    r[2][0] = t*x*z - s*y; r[2][1] = t*y*z + s*x; r[2][2] = t*z*z + c;
+}
+
+static void vec_from_rot( double r[3][3], double v[3] )
+{
+    double   c, a, s, x, y, z, n;
+
+    c = (r[0][0] + r[1][1] + r[2][2] - 1.0) / 2.0;
+    if( c >  1.0 ) c =  1.0;
+    if( c < -1.0 ) c = -1.0;
+    a = acos( c );
+    s = sin( a );
+    if( s > 1.0e-6 ) {
+        v[0] = (r[2][1] - r[1][2]) / (2.0*s) * a;
+        v[1] = (r[0][2] - r[2][0]) / (2.0*s) * a;
+        v[2] = (r[1][0] - r[0][1]) / (2.0*s) * a;
+    }
+    else if( c > 0.0 ) {
+        v[0] = v[1] = v[2] = 0.0;
+    }
+    else {
+        /* Half turn: the axis from the diagonal of r = 2 n n^T - I. */
+        x = sqrt( (r[0][0] + 1.0) / 2.0 );
+        y = sqrt( (r[1][1] + 1.0) / 2.0 );
+        z = sqrt( (r[2][2] + 1.0) / 2.0 );
+        if( x >= y && x >= z ) { y = (r[0][1] > 0)? y: -y; z = (r[0][2] > 0)? z: -z; }
+        else if( y >= z )      { x = (r[0][1] > 0)? x: -x; z = (r[1][2] > 0)? z: -z; }
+        else                   { x = (r[0][2] > 0)? x: -x; y = (r[1][2] > 0)? y: -y; }
+        n = sqrt( x*x + y*y + z*z );
+        v[0] = x / n * a;
+        v[1] = y / n * a;
+        v[2] = z / n * a;
+    }
+}
+
+/* Cholesky factor of the symmetric n x n matrix a, in its lower triangle. */
+static int chol_decomp( double *a, int n )
+{
+    double   s;
+    int      i, j, k;
+
+    for( j = 0; j < n; j++ ) {
+        s = a[j*n+j];
+        for( k = 0; k < j; k++ ) s -= a[j*n+k] * a[j*n+k];
+        if( s <= 0.0 ) return -1;
+        a[j*n+j] = sqrt( s );
+        for( i = j+1; i < n; i++ ) {
+            s = a[i*n+j];
+            for( k = 0; k < j; k++ ) s -= a[i*n+k] * a[j*n+k];
+            a[i*n+j] = s / a[j*n+j];
+        }
+    }
+
+    return 0;
+}
+
+static void chol_solve( double *a, int n, double *b )
+{
+    int      i, k;
+
+    for( i = 0; i < n; i++ ) {
+        for( k = 0; k < i; k++ ) b[i] -= a[i*n+k] * b[k];
+        b[i] /= a[i*n+i];
+    }
+    for( i = n-1; i >= 0; i-- ) {
+        for( k = i+1; k < n; k++ ) b[i] -= a[k*n+i] * b[k];
+        b[i] /= a[i*n+i];
+    }
+}
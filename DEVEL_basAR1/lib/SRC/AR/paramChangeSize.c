@@ -12,6 +12,7 @@
 *******************************************************/
 
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
 #include <AR/param.h>
 
@@ -39,6 +40,49 @@ int arParamChangeSize( ARParam *source, int xsize, int ysize, ARParam *newparam
     return 0;
 }
 
+int arParamSizesInit( ARParamSizes *sizes, ARParam *source )
+{
+    memset( sizes, 0, sizeof(ARParamSizes) );
+    sizes->source = *source;
+
+    return 0;
+}
+
+int arParamSizesAdd( ARParamSizes *sizes, int xsize, int ysize, int max_bytes )
+{
+    int     i;
+
+    if( (i = arParamSizesFind( sizes, xsize, ysize )) >= 0 ) return i;
+    if( sizes->num == AR_PARAM_SIZES_MAX ) return -1;
+
+    i = sizes->num++;
+    arParamChangeSize( &sizes->source, xsize, ysize, &sizes->param[i] );
+    if( max_bytes > 0 ) {
+        arParamLUTCreate( &sizes->lut[i], sizes->param[i].dist_factor, xsize, ysize, max_bytes );
+    }
+
+    return i;
+}
+
+int arParamSizesFind( const ARParamSizes *sizes, int xsize, int ysize )
+{
+    int     i;
+
+    for( i = 0; i < sizes->num; i++ ) {
+        if( sizes->param[i].xsize == xsize && sizes->param[i].ysize == ysize ) return i;
+    }
+
+    return -1;
+}
+
+void arParamSizesFree( ARParamSizes *sizes )
+{
+    int     i;
+
+    for( i = 0; i < sizes->num; i++ ) arParamLUTFree( &sizes->lut[i] );
+    sizes->num = 0;
+}
+
 int arsParamChangeSize( ARSParam *source, int xsize, int ysize, ARSParam *newparam )
 {
     double  scale;
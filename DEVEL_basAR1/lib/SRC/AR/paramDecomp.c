@@ -102,47 +102,21 @@ int  arParamDecompMat( double source[3][4], double cpara[3][4], double trans[3][
 int arsParamGetMat( double matL[3][4], double matR[3][4],
                     double cparaL[3][4], double cparaR[3][4], double matL2R[3][4] )
 {
-    ARMat    *t1, *t2, *t3;
-    double   transL[3][4], transR[3][4];
+    double   transL[3][4], transR[3][4], itransL[3][4];
     int      i, j;
 
     arParamDecompMat( matL, cparaL, transL );
     arParamDecompMat( matR, cparaR, transR );
 
-    t1 = arMatrixAlloc( 4, 4 );
-    t2 = arMatrixAlloc( 4, 4 );
+    if( arMat34Inv( transL, itransL ) < 0 ) return -1;
     for( j = 0; j < 3; j++ ) {
-       for( i = 0; i < 4; i++ ) {
-            t1->m[j*4+i] = transL[j][i];
-            t2->m[j*4+i] = transR[j][i];
+        for( i = 0; i < 4; i++ ) {
+            matL2R[j][i] = transR[j][0] * itransL[0][i]
+                         + transR[j][1] * itransL[1][i]
+                         + transR[j][2] * itransL[2][i];
         }
+        matL2R[j][3] += transR[j][3];
     }
-    t1->m[12] = t1->m[13] = t1->m[14] = 0.0;
-    t1->m[15] = 1.0;
-    t2->m[12] = t2->m[13] = t2->m[14] = 0.0;
-    t2->m[15] = 1.0;
-
-    if( arMatrixSelfInv(t1) != 0 ) {
-        arMatrixFree( t1 );
-        arMatrixFree( t2 );
-        return -1;
-    }
-    t3 = arMatrixAllocMul(t2, t1);
-    if( t3 == NULL ) {
-        arMatrixFree( t1 );
-        arMatrixFree( t2 );
-        return -1;
-    }
-
-    for( j = 0; j < 3; j++ ) {
-       for( i = 0; i < 4; i++ ) {
-            matL2R[j][i] = t3->m[j*4+i];
-        }
-    }
-
-    arMatrixFree( t1 );
-    arMatrixFree( t2 );
-    arMatrixFree( t3 );
 
     return 0;
 }
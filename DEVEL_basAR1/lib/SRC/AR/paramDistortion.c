@@ -10,15 +10,18 @@
 *******************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <AR/param.h>
+#include <AR/ar.h>
 
 #define  PD_LOOP   3
 
 int arParamObserv2Ideal( const double dist_factor[4], const double ox, const double oy,
                          double *ix, double *iy )
 {
-    double  z02, z0, p, q, z, px, py;
+    ARdouble z02, z0, p, q, z, px, py;
     int     i;
 
     px = ox - dist_factor[0];
@@ -29,7 +32,7 @@ int arParamObserv2Ideal( const double dist_factor[4], const double ox, const dou
 
     for( i = 1; ; i++ ) {
         if( z0 != 0.0 ) {
-            z = z0 - ((1.0 - p*z02)*z0 - q) / (1.0 - 3.0*p*z02);
+            z = z0 - ((1 - p*z02)*z0 - q) / (1 - 3*p*z02);
             px = px * z / z0;
             py = py * z / z0;
         }
@@ -50,10 +53,91 @@ int arParamObserv2Ideal( const double dist_factor[4], const double ox, const dou
     return(0);
 }
 
+int arParamLUTCreate( ARParamLUT *lut, const double dist_factor[4], int xsize, int ysize, int max_bytes )
+{
+    double  ix, iy;
+    float   *t;
+    int     step, xnum, ynum;
+    int     i, j;
+
+    arParamLUTFree( lut );
+    lut->xsize = xsize;
+    lut->ysize = ysize;
+    lut->max_bytes = max_bytes;
+    memcpy( lut->dist_factor, dist_factor, sizeof(lut->dist_factor) );
+    if( xsize <= 0 || ysize <= 0 ) return(-1);
+
+    /* One more node than needed on each axis, so that interpolation
+       never reads past the table. */
+    for( step = 1; step <= AR_PARAM_LUT_STEP_MAX; step *= 2 ) {
+        xnum = (xsize-1)/step + 2;
+        ynum = (ysize-1)/step + 2;
+        if( (double)xnum*ynum*2*sizeof(float) <= max_bytes ) break;
+    }
+    if( step > AR_PARAM_LUT_STEP_MAX ) return(-1);
+
+    if( (lut->table = (float *)arMemAlloc(AR_MEM_AR, xnum*ynum*2*sizeof(float))) == NULL ) return(-1);
+    lut->step = step;
+    lut->xnum = xnum;
+    lut->ynum = ynum;
+
+    t = lut->table;
+    for( j = 0; j < ynum; j++ ) {
+        for( i = 0; i < xnum; i++ ) {
+            arParamObserv2Ideal( dist_factor, i*step, j*step, &ix, &iy );
+            *(t++) = (float)(ix - i*step);
+            *(t++) = (float)(iy - j*step);
+        }
+    }
+
+    return(0);
+}
+
+void arParamLUTFree( ARParamLUT *lut )
+{
+    arMemFree( lut->table );
+    lut->table = NULL;
+    lut->step  = 0;
+    lut->xnum  = lut->ynum = 0;
+}
+
+int arParamObserv2IdealLUT( const ARParamLUT *lut, const double ox, const double oy,
+                            double *ix, double *iy )
+{
+    const float *t;
+    double  fx, fy, ax, ay;
+    int     x, y;
+
+    if( lut->table == NULL || ox < 0.0 || oy < 0.0
+     || ox > lut->xsize-1 || oy > lut->ysize-1 ) {
+        return arParamObserv2Ideal( lut->dist_factor, ox, oy, ix, iy );
+    }
+
+    fx = ox / lut->step;
+    fy = oy / lut->step;
+    x  = (int)fx;
+    y  = (int)fy;
+    ax = fx - x;
+    ay = fy - y;
+    t  = &(lut->table[(y*lut->xnum + x)*2]);
+    if( ax == 0.0 && ay == 0.0 ) {
+        *ix = ox + t[0];
+        *iy = oy + t[1];
+    }
+    else {
+        *ix = ox + (1.0-ay) * ((1.0-ax)*t[0] + ax*t[2])
+                 +      ay  * ((1.0-ax)*t[lut->xnum*2] + ax*t[lut->xnum*2+2]);
+        *iy = oy + (1.0-ay) * ((1.0-ax)*t[1] + ax*t[3])
+                 +      ay  * ((1.0-ax)*t[lut->xnum*2+1] + ax*t[lut->xnum*2+3]);
+    }
+
+    return(0);
+}
+
 int arParamIdeal2Observ( const double dist_factor[4], const double ix, const double iy,
                          double *ox, double *oy )
 {
-    double    x, y, d;
+    ARdouble  x, y, d;
 
     x = (ix - dist_factor[0]) * dist_factor[3];
     y = (iy - dist_factor[1]) * dist_factor[3];
@@ -62,7 +146,7 @@ int arParamIdeal2Observ( const double dist_factor[4], const double ix, const dou
         *oy = dist_factor[1];
     }
     else {
-        d = 1.0 - dist_factor[2]/100000000.0 * (x*x+y*y);
+        d = 1 - (ARdouble)(dist_factor[2]/100000000.0) * (x*x+y*y);
         *ox = x * d + dist_factor[0];
         *oy = y * d + dist_factor[1];
     }
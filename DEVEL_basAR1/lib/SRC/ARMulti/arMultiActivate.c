@@ -49,6 +49,7 @@ int arMultiFreeConfig(ARMultiMarkerInfoT *config)
         if (arFreePatt(config->marker[i].patt_id) != 1) return (-1);
     }
     free(config->marker);
+    free(config->pos3d);
     free(config);
     config = NULL;
 
@@ -10,11 +10,19 @@
 *******************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <AR/ar.h>
 #include <AR/matrix.h>
 #include <AR/arMulti.h>
 
+#ifdef _WIN32
+#  include <windows.h>
+#  include <process.h>
+#else
+#  include <pthread.h>
+#endif
+
 #define  debug  0
 
 #define  THRESH_1            2.0
@@ -22,6 +30,10 @@
 #define  THRESH_3           10.0
 #define  AR_MULTI_GET_TRANS_MAT_MAX_LOOP_COUNT   2
 #define  AR_MULTI_GET_TRANS_MAT_MAX_FIT_ERROR    10.0
+#define  AR_MULTI_GET_TRANS_MAT_CONVERGE         0.99
+#define  AR_MULTI_ROBUST_LOOP_COUNT  2
+#define  AR_MULTI_ROBUST_K2          9.0
+#define  AR_MULTI_ROBUST_MIN_ERROR   4.0
 
 typedef struct {
     double   pos[4][2];
@@ -31,117 +43,281 @@ typedef struct {
     int      dir;
 } arMultiEachMarkerInternalInfoT;
 
+/* The detected markers bucketed by id, for arMultiGetTransMatBatch(): each
+   board looks only at those of its patterns, and at the weak ones any board
+   may take, instead of at every marker for each of its own. */
+typedef struct {
+    int      id;
+    int      index;
+} MarkerBucket;
+
+typedef struct {
+    MarkerBucket  *bucket;          /* every marker, by id then index */
+    int           *weak;            /* id -1 or cf <= 0.7, by index */
+    int            weak_num;
+    int            num;
+} MarkerIndex;
+
+typedef struct {
+    ARMarkerInfo         *marker_info;
+    MarkerIndex          *index;
+    ARMultiMarkerInfoT  **config;
+    int                   config_num;
+    double               *err;
+    int                   first;
+    int                   interval;
+} BoardJob;
+
 static int verify_markers(ARMarkerInfo *marker_info, int marker_num,
-                          ARMultiMarkerInfoT *config);
+                          MarkerIndex *index, ARMultiMarkerInfoT *config);
+
+static void select_markers( ARMarkerInfo *marker_info, int marker_num,
+                            MarkerIndex *index, ARMultiMarkerInfoT *config );
+
+static double get_trans( ARMarkerInfo *marker_info, ARMultiMarkerInfoT *config );
+
+static void index_markers( ARMarkerInfo *marker_info, int marker_num, MarkerIndex *index );
+
+static int bucket_range( MarkerIndex *index, int id, int *lo );
+
+static int compare_bucket( const void *a, const void *b );
+
+static void do_boards( BoardJob *job );
+
+static int get_points( ARMarkerInfo *marker_info, ARMultiMarkerInfoT *config,
+                       double *pos2d, double *pos3d );
+
+static double fit_robust( double rot[3][3], double *pos2d, double *pos3d, int num,
+                          double *work, double conv[3][4] );
+
+static double fit_points( double rot[3][3], double *pos2d, double *pos3d, int num,
+                          double conv[3][4] );
+
+static int compare_double( const void *a, const void *b );
 
 
 double arMultiGetTransMat(ARMarkerInfo *marker_info, int marker_num,
                           ARMultiMarkerInfoT *config)
 {
-    double                *pos2d, *pos3d;
-    double                rot[3][3], trans1[3][4], trans2[3][4];
-    double                err, err2;
-    int                   max, max_area, max_marker, vnum;
-    int                   dir;
-    int                   i, j, k;
-
     if( config->prevF ) {
-        verify_markers( marker_info, marker_num, config );
+        verify_markers( marker_info, marker_num, NULL, config );
     }
+    select_markers( marker_info, marker_num, NULL, config );
+
+    return get_trans( marker_info, config );
+}
+
+#ifdef _WIN32
+static unsigned __stdcall board_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_boards( (BoardJob *)arg );
+    return 0;
+}
+#else
+static void *board_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_TRACK, NULL );
+    do_boards( (BoardJob *)arg );
+    return NULL;
+}
+#endif
+
+int arMultiGetTransMatBatch(ARMarkerInfo *marker_info, int marker_num,
+                            ARMultiMarkerInfoT *config[], int config_num,
+                            double err[], int thread_num)
+{
+    BoardJob              job[AR_BATCH_THREADS_MAX];
+#ifdef _WIN32
+    HANDLE                tid[AR_BATCH_THREADS_MAX];
+#else
+    pthread_t             tid[AR_BATCH_THREADS_MAX];
+#endif
+    int                   started[AR_BATCH_THREADS_MAX];
+    MarkerIndex           index;
+    ARFrameMark           mark;
+    double                t0 = 0.0;
+    int                   ret;
+    int                   i, t;
+
+    if( marker_info == NULL || config == NULL || err == NULL
+     || marker_num < 0 || config_num < 0 ) return -1;
+    if( thread_num > AR_BATCH_THREADS_MAX ) thread_num = AR_BATCH_THREADS_MAX;
+    if( thread_num > config_num )           thread_num = config_num;
+    if( thread_num < 1 )                    thread_num = 1;
+    if( arStatsMode == AR_STATS_ON ) t0 = arUtilClock();
+    AR_TRACE_BEGIN( "arMultiGetTransMatBatch" );
+
+    mark = arFrameMark();
+    index.bucket = (MarkerBucket *)arFrameAlloc( (marker_num+1)*sizeof(MarkerBucket) );
+    index.weak   = (int *)arFrameAlloc( (marker_num+1)*sizeof(int) );
+    index_markers( marker_info, marker_num, &index );
+
+    /* The boards take the markers their patterns are found at in turn, as
+       one call after another would; the bucketing follows what each took. */
+    for( i = 0; i < config_num; i++ ) {
+        if( config[i] == NULL || !config[i]->prevF ) continue;
+        if( verify_markers( marker_info, marker_num, &index, config[i] ) == 0 ) {
+            index_markers( marker_info, marker_num, &index );
+        }
+    }
+
+    /* Then the markers are only read, and each board fitted on its own. */
+    for( t = 0; t < thread_num; t++ ) {
+        job[t].marker_info = marker_info;
+        job[t].index       = &index;
+        job[t].config      = config;
+        job[t].config_num  = config_num;
+        job[t].err         = err;
+        job[t].first       = t;
+        job[t].interval    = thread_num;
+    }
+    for( t = 1; t < thread_num; t++ ) {
+#ifdef _WIN32
+        tid[t] = (HANDLE)_beginthreadex( NULL, 0, board_thread, &job[t], 0, NULL );
+        started[t] = (tid[t] != 0);
+#else
+        started[t] = (pthread_create( &tid[t], NULL, board_thread, &job[t] ) == 0);
+#endif
+    }
+    do_boards( &job[0] );
+    for( t = 1; t < thread_num; t++ ) {
+        if( !started[t] ) {
+            do_boards( &job[t] );
+            continue;
+        }
+#ifdef _WIN32
+        WaitForSingleObject( tid[t], INFINITE );
+        CloseHandle( tid[t] );
+#else
+        pthread_join( tid[t], NULL );
+#endif
+    }
+    arFrameRelease( mark );
+
+    AR_TRACE_END();
+    if( arStatsMode == AR_STATS_ON ) arStatsAddPose( (arUtilClock() - t0) * 1000.0, config_num );
+
+    ret = 0;
+    for( i = 0; i < config_num; i++ ) {
+        if( err[i] < 0.0 ) ret = -1;
+    }
+    return ret;
+}
+
+static void do_boards( BoardJob *job )
+{
+    int     i;
+
+    for( i = job->first; i < job->config_num; i += job->interval ) {
+        if( job->config[i] == NULL ) {
+            job->err[i] = -1.0;
+            continue;
+        }
+        select_markers( job->marker_info, job->index->num, job->index, job->config[i] );
+        job->err[i] = get_trans( job->marker_info, job->config[i] );
+    }
+}
+
+/* The markers of config seen, the most confident for each of its patterns. */
+static void select_markers( ARMarkerInfo *marker_info, int marker_num,
+                            MarkerIndex *index, ARMultiMarkerInfoT *config )
+{
+    int     vnum, lo, hi;
+    int     i, j, k;
 
-    max = -1;
     vnum = 0;
     for( i = 0; i < config->marker_num; i++ ) {
         k = -1;
-        for( j = 0; j < marker_num; j++ ) {
+        if( index != NULL ) {
+            hi = bucket_range( index, config->marker[i].patt_id, &lo );
+        }
+        else {
+            lo = 0;
+            hi = marker_num;
+        }
+        for( ; lo < hi; lo++ ) {
+            j = (index != NULL)? index->bucket[lo].index: lo;
             if( marker_info[j].id != config->marker[i].patt_id ) continue;
             if( marker_info[j].cf < 0.70 ) continue;
 
             if( k == -1 ) k = j;
             else if( marker_info[k].cf < marker_info[j].cf ) k = j;
         }
-        if( (config->marker[i].visible=k) == -1) continue;
+        if( (config->marker[i].visible=k) != -1 ) config->vlist[vnum++] = i;
+    }
+    config->vnum = vnum;
+}
 
-        err = arGetTransMat(&marker_info[k], config->marker[i].center,
-                            config->marker[i].width, trans1);
-#if debug
-printf("##err = %10.5f %d %10.5f %10.5f\n", err, marker_info[k].dir, marker_info[k].pos[0], marker_info[k].pos[1]);
-#endif
-        if( err > THRESH_1 ) {
-            config->marker[i].visible = -1;
-            continue;
-        }
+static double get_trans( ARMarkerInfo *marker_info, ARMultiMarkerInfoT *config )
+{
+    double                *pos2d, *pos3d, *work;
+    ARFrameMark           mark;
+    double                rot[3][3], trans1[3][4], trans2[3][4];
+    double                err, err2;
+    int                   max, max_area, vnum, num;
+    int                   i, j, k;
 
-        vnum++;
-        if( max == -1 
-         || marker_info[k].area > max_area ) {
-            max = i;
-            max_marker = k;
-            max_area   = marker_info[k].area;
-            for( j = 0; j < 3; j++ ) {
-                for( k = 0; k < 4; k++ ) {
-                    trans2[j][k] = trans1[j][k];
-                }
-            }
-        }
-    }
-    if( max == -1 ) {
+    vnum = config->vnum;
+    if( vnum == 0 ) {
         config->prevF = 0;
         return -1;
     }
 
-    arMalloc(pos2d, double, vnum*4*2);
-    arMalloc(pos3d, double, vnum*4*3);
-
-    j = 0;
-    for( i = 0; i < config->marker_num; i++ ) {
-        if( (k=config->marker[i].visible) < 0 ) continue;
-
-        dir = marker_info[k].dir;
-        pos2d[j*8+0] = marker_info[k].vertex[(4-dir)%4][0];
-        pos2d[j*8+1] = marker_info[k].vertex[(4-dir)%4][1];
-        pos2d[j*8+2] = marker_info[k].vertex[(5-dir)%4][0];
-        pos2d[j*8+3] = marker_info[k].vertex[(5-dir)%4][1];
-        pos2d[j*8+4] = marker_info[k].vertex[(6-dir)%4][0];
-        pos2d[j*8+5] = marker_info[k].vertex[(6-dir)%4][1];
-        pos2d[j*8+6] = marker_info[k].vertex[(7-dir)%4][0];
-        pos2d[j*8+7] = marker_info[k].vertex[(7-dir)%4][1];
-        pos3d[j*12+0] = config->marker[i].pos3d[0][0];
-        pos3d[j*12+1] = config->marker[i].pos3d[0][1];
-        pos3d[j*12+2] = config->marker[i].pos3d[0][2];
-        pos3d[j*12+3] = config->marker[i].pos3d[1][0];
-        pos3d[j*12+4] = config->marker[i].pos3d[1][1];
-        pos3d[j*12+5] = config->marker[i].pos3d[1][2];
-        pos3d[j*12+6] = config->marker[i].pos3d[2][0];
-        pos3d[j*12+7] = config->marker[i].pos3d[2][1];
-        pos3d[j*12+8] = config->marker[i].pos3d[2][2];
-        pos3d[j*12+9] = config->marker[i].pos3d[3][0];
-        pos3d[j*12+10] = config->marker[i].pos3d[3][1];
-        pos3d[j*12+11] = config->marker[i].pos3d[3][2];
-        j++;
-    }
+    mark  = arFrameMark();
+    pos2d = (double *)arFrameAlloc( vnum*4*2*sizeof(double) );
+    pos3d = (double *)arFrameAlloc( vnum*4*3*sizeof(double) );
+    work  = (double *)arFrameAlloc( vnum*4*6*sizeof(double) );
 
+    /* From the previous pose, the robust fit copes with the markers that
+       are off by itself: the single marker fits below are only needed
+       when it fails. */
+    err = 0.0;
     if( config->prevF ) {
+        num = get_points( marker_info, config, pos2d, pos3d );
         for( j = 0; j < 3; j++ ) {
             for( i = 0; i < 3; i++ ) {
                 rot[j][i] = config->trans[j][i];
             }
         }
-        for( i = 0; i < AR_MULTI_GET_TRANS_MAT_MAX_LOOP_COUNT; i++ ) {
-            err = arGetTransMat4( rot, (double (*)[2])pos2d,
-                                       (double (*)[3])pos3d,
-                                        vnum*4, config->trans );
-            if( err < AR_MULTI_GET_TRANS_MAT_MAX_FIT_ERROR ) break;
-        }
+        err = fit_robust( rot, pos2d, pos3d, num, work, config->trans );
 
         if( err < THRESH_2 ) {
             config->prevF = 1;
-            free(pos3d);
-            free(pos2d);
+            arFrameRelease( mark );
             return err;
         }
     }
 
+    max = -1;
+    for( j = 0; j < vnum; j++ ) {
+        i = config->vlist[j];
+        if( (k=config->marker[i].visible) == -1 ) continue;
+
+        err2 = arGetTransMat(&marker_info[k], config->marker[i].center,
+                             config->marker[i].width, trans1);
+#if debug
+printf("##err = %10.5f %d %10.5f %10.5f\n", err2, marker_info[k].dir, marker_info[k].pos[0], marker_info[k].pos[1]);
+#endif
+        if( err2 > THRESH_1 ) {
+            config->marker[i].visible = -1;
+            continue;
+        }
+
+        if( max == -1 
+         || marker_info[k].area > max_area ) {
+            max = i;
+            max_area   = marker_info[k].area;
+            memcpy( trans2, trans1, sizeof(trans2) );
+        }
+    }
+    if( max == -1 ) {
+        config->prevF = 0;
+        arFrameRelease( mark );
+        return -1;
+    }
+
+    num = get_points( marker_info, config, pos2d, pos3d );
     arUtilMatMul( trans2, config->marker[max].itrans, trans1 );
     for( j = 0; j < 3; j++ ) {
         for( i = 0; i < 3; i++ ) {
@@ -149,11 +325,7 @@ printf("##err = %10.5f %d %10.5f %10.5f\n", err, marker_info[k].dir, marker_info
         }
     }
 
-    for( i = 0; i < AR_MULTI_GET_TRANS_MAT_MAX_LOOP_COUNT; i++ ) {
-        err2 = arGetTransMat4( rot, (double (*)[2])pos2d, (double (*)[3])pos3d,
-                              vnum*4, trans2 );
-        if( err2 < AR_MULTI_GET_TRANS_MAT_MAX_FIT_ERROR ) break;
-    }
+    err2 = fit_robust( rot, pos2d, pos3d, num, work, trans2 );
 
     if( config->prevF == 0 || err2 < err ) {
         for( j = 0; j < 3; j++ ) {
@@ -171,45 +343,208 @@ printf("##err = %10.5f %d %10.5f %10.5f\n", err, marker_info[k].dir, marker_info
         config->prevF = 0;
     }
 
-    free(pos3d);
-    free(pos2d);
+    arFrameRelease( mark );
     return err;
 }
 
+static void index_markers( ARMarkerInfo *marker_info, int marker_num, MarkerIndex *index )
+{
+    int     i;
+
+    index->num = marker_num;
+    index->weak_num = 0;
+    for( i = 0; i < marker_num; i++ ) {
+        index->bucket[i].id    = marker_info[i].id;
+        index->bucket[i].index = i;
+        if( marker_info[i].id == -1 || marker_info[i].cf <= 0.7 ) index->weak[index->weak_num++] = i;
+    }
+    qsort( index->bucket, marker_num, sizeof(MarkerBucket), compare_bucket );
+}
+
+/* The markers of id are index->bucket[*lo] up to the one returned. */
+static int bucket_range( MarkerIndex *index, int id, int *lo )
+{
+    int     a, b, m;
+
+    a = 0;
+    b = index->num;
+    while( a < b ) {
+        m = (a + b) / 2;
+        if( index->bucket[m].id < id ) a = m + 1;
+        else                           b = m;
+    }
+    *lo = a;
+    while( b < index->num && index->bucket[b].id == id ) b++;
+
+    return b;
+}
+
+static int compare_bucket( const void *a, const void *b )
+{
+    const MarkerBucket *p = (const MarkerBucket *)a;
+    const MarkerBucket *q = (const MarkerBucket *)b;
+
+    if( p->id != q->id ) return (p->id < q->id)? -1: 1;
+    return p->index - q->index;
+}
+
+/* Corners of the visible markers, those in space gathered from
+   config->pos3d by the indices of config->vlist. */
+static int get_points( ARMarkerInfo *marker_info, ARMultiMarkerInfoT *config,
+                       double *pos2d, double *pos3d )
+{
+    int        dir;
+    int        i, j, k, v;
+
+    j = 0;
+    for( v = 0; v < config->vnum; v++ ) {
+        i = config->vlist[v];
+        if( (k=config->marker[i].visible) < 0 ) continue;
+
+        dir = marker_info[k].dir;
+        pos2d[j*8+0] = marker_info[k].vertex[(4-dir)%4][0];
+        pos2d[j*8+1] = marker_info[k].vertex[(4-dir)%4][1];
+        pos2d[j*8+2] = marker_info[k].vertex[(5-dir)%4][0];
+        pos2d[j*8+3] = marker_info[k].vertex[(5-dir)%4][1];
+        pos2d[j*8+4] = marker_info[k].vertex[(6-dir)%4][0];
+        pos2d[j*8+5] = marker_info[k].vertex[(6-dir)%4][1];
+        pos2d[j*8+6] = marker_info[k].vertex[(7-dir)%4][0];
+        pos2d[j*8+7] = marker_info[k].vertex[(7-dir)%4][1];
+        memcpy( &pos3d[j*12], &config->pos3d[i*12], 12*sizeof(double) );
+        j++;
+    }
+
+    return j*4;
+}
+
+/* Fits the num corners, then refits on the corners whose squared
+   reprojection error is below AR_MULTI_ROBUST_K2 times the median one
+   (and at least AR_MULTI_ROBUST_MIN_ERROR), so that markers that are
+   partly hidden or were mismatched do not pull the pose. Every corner is
+   tested again after each fit. work holds num*6 doubles. */
+static double fit_robust( double rot[3][3], double *pos2d, double *pos3d, int num,
+                          double *work, double conv[3][4] )
+{
+    double     *res, *w2d, *w3d, *p2d, *p3d;
+    double     err, thresh, hx, hy, h, wx, wy, wz;
+    int        n, m, loop;
+    int        i, j;
+
+    res = work;
+    w2d = work + num;
+    w3d = work + num*3;
+    p2d = pos2d;
+    p3d = pos3d;
+    n   = num;
+
+    for( loop = 0; ; loop++ ) {
+        err = fit_points( rot, p2d, p3d, n, conv );
+        if( loop == AR_MULTI_ROBUST_LOOP_COUNT || num <= 4 ) break;
+
+        for( i = 0; i < num; i++ ) {
+            wx = conv[0][0]*pos3d[i*3+0] + conv[0][1]*pos3d[i*3+1] + conv[0][2]*pos3d[i*3+2] + conv[0][3];
+            wy = conv[1][0]*pos3d[i*3+0] + conv[1][1]*pos3d[i*3+1] + conv[1][2]*pos3d[i*3+2] + conv[1][3];
+            wz = conv[2][0]*pos3d[i*3+0] + conv[2][1]*pos3d[i*3+1] + conv[2][2]*pos3d[i*3+2] + conv[2][3];
+            hx = arParam.mat[0][0]*wx + arParam.mat[0][1]*wy + arParam.mat[0][2]*wz + arParam.mat[0][3];
+            hy = arParam.mat[1][0]*wx + arParam.mat[1][1]*wy + arParam.mat[1][2]*wz + arParam.mat[1][3];
+            h  = arParam.mat[2][0]*wx + arParam.mat[2][1]*wy + arParam.mat[2][2]*wz + arParam.mat[2][3];
+            if( h == 0.0 ) return err;
+            res[i] = (hx/h - pos2d[i*2+0]) * (hx/h - pos2d[i*2+0])
+                   + (hy/h - pos2d[i*2+1]) * (hy/h - pos2d[i*2+1]);
+            w2d[i] = res[i];
+        }
+        qsort( w2d, num, sizeof(double), compare_double );
+        thresh = w2d[num/2] * AR_MULTI_ROBUST_K2;
+        if( thresh < AR_MULTI_ROBUST_MIN_ERROR ) thresh = AR_MULTI_ROBUST_MIN_ERROR;
+
+        for( i = m = 0; i < num; i++ ) {
+            if( res[i] < thresh ) m++;
+        }
+        if( m == n || m < 4 || m < num/2 ) break;
+
+        for( i = j = 0; i < num; i++ ) {
+            if( res[i] >= thresh ) continue;
+            w2d[j*2+0] = pos2d[i*2+0];
+            w2d[j*2+1] = pos2d[i*2+1];
+            w3d[j*3+0] = pos3d[i*3+0];
+            w3d[j*3+1] = pos3d[i*3+1];
+            w3d[j*3+2] = pos3d[i*3+2];
+            j++;
+        }
+        p2d = w2d;
+        p3d = w3d;
+        n   = m;
+#if debug
+printf("##robust: %d/%d corners, thresh = %10.5f\n", m, num, thresh);
+#endif
+    }
+
+    return err;
+}
+
+/* Iterates arGetTransMat4() from rot until the error is small enough or
+   stops improving. */
+static double fit_points( double rot[3][3], double *pos2d, double *pos3d, int num,
+                          double conv[3][4] )
+{
+    double     err, err0;
+    int        i;
+
+    err0 = 0.0;
+    for( i = 0; i < AR_MULTI_GET_TRANS_MAT_MAX_LOOP_COUNT; i++ ) {
+        err = arGetTransMat4( rot, (double (*)[2])pos2d, (double (*)[3])pos3d,
+                              num, conv );
+        if( err < AR_MULTI_GET_TRANS_MAT_MAX_FIT_ERROR ) break;
+        if( i > 0 && err > err0 * AR_MULTI_GET_TRANS_MAT_CONVERGE ) break;
+        err0 = err;
+    }
+
+    return err;
+}
+
+static int compare_double( const void *a, const void *b )
+{
+    if( *(const double *)a < *(const double *)b ) return -1;
+    if( *(const double *)a > *(const double *)b ) return  1;
+    return 0;
+}
+
+/* Matches the markers of config, where its last pose puts them, to the
+   markers detected there. Any marker is looked at, unless it was found
+   confidently with another pattern; with index, only those of the pattern
+   and the weak ones, in the same order. */
 static int verify_markers(ARMarkerInfo *marker_info, int marker_num,
-                          ARMultiMarkerInfoT *config)
+                          MarkerIndex *index, ARMultiMarkerInfoT *config)
 {
     arMultiEachMarkerInternalInfoT *winfo;
+    ARFrameMark                    mark;
     double                         wtrans[3][4];
-    double                         pos3d[4][2];
+    double                         *pos3d;
     double                         wx, wy, wz, hx, hy, h;
     int                            dir1, dir2, marker2;
     double                         err, err1, err2;
     double                         x1, x2, y1, y2;
     int                            w1, w2;
+    int                            *cand, cand_num, lo, hi, c, w;
     int                            i, j, k;
 
-    arMalloc(winfo,arMultiEachMarkerInternalInfoT,config->marker_num);
+    mark  = arFrameMark();
+    winfo = (arMultiEachMarkerInternalInfoT *)arFrameAlloc( config->marker_num*sizeof(arMultiEachMarkerInternalInfoT) );
+    cand  = (int *)arFrameAlloc( (marker_num+1)*sizeof(int) );
 
     for( i = 0; i < config->marker_num; i++ ) {
         arUtilMatMul(config->trans, config->marker[i].trans, wtrans);
-        pos3d[0][0] = config->marker[i].center[0] - config->marker[i].width/2.0;
-        pos3d[0][1] = config->marker[i].center[1] + config->marker[i].width/2.0;
-        pos3d[1][0] = config->marker[i].center[0] + config->marker[i].width/2.0;
-        pos3d[1][1] = config->marker[i].center[1] + config->marker[i].width/2.0;
-        pos3d[2][0] = config->marker[i].center[0] + config->marker[i].width/2.0;
-        pos3d[2][1] = config->marker[i].center[1] - config->marker[i].width/2.0;
-        pos3d[3][0] = config->marker[i].center[0] - config->marker[i].width/2.0;
-        pos3d[3][1] = config->marker[i].center[1] - config->marker[i].width/2.0;
+        pos3d = &config->wpos2d[i*8];
+        x1 = x2 = y1 = y2 = 0.0;
         for( j = 0; j < 4; j++ ) {
-            wx = wtrans[0][0] * pos3d[j][0]
-               + wtrans[0][1] * pos3d[j][1]
+            wx = wtrans[0][0] * pos3d[j*2+0]
+               + wtrans[0][1] * pos3d[j*2+1]
                + wtrans[0][3];
-            wy = wtrans[1][0] * pos3d[j][0]
-               + wtrans[1][1] * pos3d[j][1]
+            wy = wtrans[1][0] * pos3d[j*2+0]
+               + wtrans[1][1] * pos3d[j*2+1]
                + wtrans[1][3];
-            wz = wtrans[2][0] * pos3d[j][0]
-               + wtrans[2][1] * pos3d[j][1]
+            wz = wtrans[2][0] * pos3d[j*2+0]
+               + wtrans[2][1] * pos3d[j*2+1]
                + wtrans[2][3];
             hx = arParam.mat[0][0] * wx
                + arParam.mat[0][1] * wy
@@ -259,9 +594,30 @@ printf("\n");
 
     w1 = w2 = 0;
     for( i = 0; i < config->marker_num; i++ ) {
+        if( index != NULL ) {
+            /* Those of the pattern merged with the weak ones, by index. */
+            hi = bucket_range( index, config->marker[i].patt_id, &lo );
+            cand_num = w = 0;
+            while( lo < hi || w < index->weak_num ) {
+                if( w == index->weak_num
+                 || (lo < hi && index->bucket[lo].index < index->weak[w]) ) {
+                    cand[cand_num++] = index->bucket[lo++].index;
+                }
+                else {
+                    if( lo < hi && index->bucket[lo].index == index->weak[w] ) lo++;
+                    cand[cand_num++] = index->weak[w++];
+                }
+            }
+        }
+        else {
+            for( j = 0; j < marker_num; j++ ) cand[j] = j;
+            cand_num = marker_num;
+        }
+
         marker2 = -1;
         err2 = winfo[i].thresh;
-        for( j = 0; j < marker_num; j++ ) {
+        for( c = 0; c < cand_num; c++ ) {
+            j = cand[c];
             if( marker_info[j].id != -1
              && marker_info[j].id != config->marker[i].patt_id
              && marker_info[j].cf > 0.7 ) continue;
@@ -318,13 +674,29 @@ printf("%3d<=>%3d, err = %f(%f)\n", i+1, marker2+1, err2, winfo[i].thresh);
 printf("w1,w2 = %d,%d\n", w1, w2);
 #endif
     if( w2 >= w1 ) {
-        free(winfo);
+        arFrameRelease( mark );
         return -1;
     }
 
     for( i = 0; i < config->marker_num; i++ ) {
-        for( j = 0; j < marker_num; j++ ) {
+        if( index != NULL ) {
+            hi = bucket_range( index, config->marker[i].patt_id, &lo );
+            for( ; lo < hi; lo++ ) {
+                j = index->bucket[lo].index;
                 if( marker_info[j].id == config->marker[i].patt_id ) marker_info[j].id = -1;
+            }
+            /* And those given the pattern just before, by a marker of config
+               of the same pattern. */
+            for( k = 0; k < i; k++ ) {
+                if( winfo[k].marker != -1 && marker_info[winfo[k].marker].id == config->marker[i].patt_id ) {
+                    marker_info[winfo[k].marker].id = -1;
+                }
+            }
+        }
+        else {
+            for( j = 0; j < marker_num; j++ ) {
+                if( marker_info[j].id == config->marker[i].patt_id ) marker_info[j].id = -1;
+            }
         }
         if( winfo[i].marker != -1 ) {
             marker_info[winfo[i].marker].id  = config->marker[i].patt_id;
@@ -333,7 +705,7 @@ printf("w1,w2 = %d,%d\n", w1, w2);
         }
     }
 
-    free(winfo);
+    arFrameRelease( mark );
 
     return 0;
 }
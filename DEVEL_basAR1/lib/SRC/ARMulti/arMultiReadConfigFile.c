@@ -10,6 +10,7 @@
 *******************************************************/
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <AR/ar.h>
 #include <AR/matrix.h>
@@ -92,6 +93,25 @@ ARMultiMarkerInfoT *arMultiReadConfigFile( const char *filename )
     marker_info->marker_num = num;
     marker_info->prevF      = 0;
 
+    /* The corners once for all frames, in one block with the list of the
+       visible markers, which arMultiGetTransMat() fills. */
+    marker_info->pos3d = (double *)malloc( num*(12+8)*sizeof(double) + num*sizeof(int) );
+    if( marker_info->pos3d == NULL ) {free(marker); free(marker_info); return NULL;}
+    marker_info->wpos2d = marker_info->pos3d + num*12;
+    marker_info->vlist  = (int *)(marker_info->wpos2d + num*8);
+    marker_info->vnum   = 0;
+    for( i = 0; i < num; i++ ) {
+        memcpy( &marker_info->pos3d[i*12], marker[i].pos3d, 12*sizeof(double) );
+        marker_info->wpos2d[i*8+0] = marker[i].center[0] - marker[i].width/2.0;
+        marker_info->wpos2d[i*8+1] = marker[i].center[1] + marker[i].width/2.0;
+        marker_info->wpos2d[i*8+2] = marker[i].center[0] + marker[i].width/2.0;
+        marker_info->wpos2d[i*8+3] = marker[i].center[1] + marker[i].width/2.0;
+        marker_info->wpos2d[i*8+4] = marker[i].center[0] + marker[i].width/2.0;
+        marker_info->wpos2d[i*8+5] = marker[i].center[1] - marker[i].width/2.0;
+        marker_info->wpos2d[i*8+6] = marker[i].center[0] - marker[i].width/2.0;
+        marker_info->wpos2d[i*8+7] = marker[i].center[1] - marker[i].width/2.0;
+    }
+
     return marker_info;
 }
 
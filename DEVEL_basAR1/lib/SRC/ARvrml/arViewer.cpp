@@ -7,19 +7,109 @@ remove culling pb
 */
 
 #include <iostream>
+#include <algorithm>
 #include <math.h>
+#include <float.h>
+#include <string.h>
 #ifdef __APPLE__
 #  include <GLUT/glut.h>
 #else
 #  include <GL/glut.h>
 #endif
 #include "arViewer.h"
+#ifdef _WIN32
+#  include <windows.h>
+#elif defined(__APPLE__)
+#  include <OpenGL/OpenGL.h>
+#else
+#  include <GL/glx.h>
+#endif
 
 using namespace openvrml;
 
+#ifndef GL_ARRAY_BUFFER
+#  define GL_ARRAY_BUFFER              0x8892
+#  define GL_ELEMENT_ARRAY_BUFFER      0x8893
+#  define GL_STATIC_DRAW               0x88E4
+#  define GL_DYNAMIC_DRAW              0x88E8
+#endif
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#  define GL_PIXEL_UNPACK_BUFFER       0x88EC
+#endif
+#ifndef GL_STREAM_DRAW
+#  define GL_STREAM_DRAW               0x88E0
+#endif
+
+#if defined(__CYGWIN__) || defined(__MINGW32__)
+#  define AR_VRML_GL_CALLBACK __attribute__ ((__stdcall__))
+#elif defined(_WIN32)
+#  define AR_VRML_GL_CALLBACK APIENTRY
+#else
+#  define AR_VRML_GL_CALLBACK
+#endif
+
+#define  AR_VRML_MESH_STRIDE   11
+
+extern "C" {
+    typedef GLvoid (AR_VRML_GL_CALLBACK *arVrmlTessCB)();
+    typedef void (AR_VRML_GL_CALLBACK *arVrmlGenBuffers)(GLsizei, GLuint *);
+    typedef void (AR_VRML_GL_CALLBACK *arVrmlDeleteBuffers)(GLsizei, const GLuint *);
+    typedef void (AR_VRML_GL_CALLBACK *arVrmlBindBuffer)(GLenum, GLuint);
+    typedef void (AR_VRML_GL_CALLBACK *arVrmlBufferData)(GLenum, ptrdiff_t, const GLvoid *, GLenum);
+    typedef void (AR_VRML_GL_CALLBACK *arVrmlBufferSubData)(GLenum, ptrdiff_t, ptrdiff_t, const GLvoid *);
+}
+
+// Buffer objects of GL 1.5 or ARB_vertex_buffer_object, fetched with the
+// first mesh; without them the meshes are drawn from their arrays.
+static int                  bufferObjects = -1;
+static arVrmlGenBuffers     genBuffers;
+static arVrmlDeleteBuffers  deleteBuffers;
+static arVrmlBindBuffer     bindBuffer;
+static arVrmlBufferData     bufferData;
+static arVrmlBufferSubData  bufferSubData;
+
+// Pixel buffer objects of GL 2.1 or ARB_pixel_buffer_object, for the frames
+// of movies; without them the frames are uploaded from memory.
+static int                  pixelBuffers = -1;
+
+// The GL state arVrmlViewer leaves behind from one draw to the next: the
+// settings no node changes while rendering, and the lights still on. It is
+// shared by all the viewers as they draw in the same context, and forgotten
+// by invalidateState() when something else may have drawn in between. The
+// viewers draw in every context sharing the objects of the first, as the
+// windows of arglSetupForCurrentContextShared(): the display lists, buffer
+// objects and textures are made once, but the state is that of one context.
+static bool                 stateValid = false;
+static unsigned int         stateLights;
+static void                *stateContext = NULL;
+
+static void atlasRelease(viewer::texture_object_t ref);
+
+static void *currentContext()
+{
+#if defined(_WIN32)
+    return (void *)wglGetCurrentContext();
+#elif defined(__APPLE__)
+    return (void *)CGLGetCurrentContext();
+#else
+    return (void *)glXGetCurrentContext();
+#endif
+}
+
+arVrmlCounts arVrmlViewer::counts = { 0, 0, 0 };
+double arVrmlViewer::lodDistance[AR_VRML_LOD_LEVELS - 1] = { 600.0, 1200.0 };
+bool arVrmlViewer::blendExternal = false;
+
+void arVrmlViewer::invalidateState()
+{
+    stateValid = false;
+}
+
 arVrmlViewer::arVrmlViewer(openvrml::browser& browser) : gl::viewer(browser)
 {
     internal_light = true;
+    cull = true;
+    blended = false;
 
     translation[0] = 0.0;
     translation[1] = 0.0;
@@ -32,16 +122,60 @@ arVrmlViewer::arVrmlViewer(openvrml::browser& browser) : gl::viewer(browser)
     scale[0] = 1.0;
     scale[1] = 1.0;
     scale[2] = 1.0;
+
+    retired.buffer[0] = retired.buffer[1] = 0;
+    unpackBuffer[0] = unpackBuffer[1] = 0;
+    unpackNext = 0;
+    filename[0] = '\0';
+
+    cacheLoaded = false;
+    cacheValid = false;
+    cacheWriting = true;
+    cacheIn = NULL;
+    cacheOut = NULL;
+
+    recording = false;
+    look.material = false;
+    look.lighting = true;
+    look.ambient = look.shininess = look.transparency = 0.0f;
+    look.diffuse = color(1.0f, 1.0f, 1.0f);
+    look.alpha = 1.0f;
+    look.texComponents = 0;
+    look.geometryColor = false;
+
+    pickTag = 0;
+    pickList = NULL;
+    lod = 0;
+
+    texRotation = 0.0f;
+    texScale = vec2f(1.0f, 1.0f);
 }
 
 arVrmlViewer::~arVrmlViewer()
 {
-  
+    std::map<object_t, arVrmlMesh>::iterator it;
+
+    for (it = meshes.begin(); it != meshes.end(); ++it) {
+        if (it->second.buffer[0]) deleteBuffers(2, it->second.buffer);
+        glDeleteLists(GLuint(it->first), 1);
+    }
+    if (retired.buffer[0]) deleteBuffers(2, retired.buffer);
+    if (unpackBuffer[0]) deleteBuffers(2, unpackBuffer);
+    // Its tiles are free for the scenes to come.
+    std::map<texture_object_t, size_t>::const_iterator tex;
+    for (tex = textureBytes.begin(); tex != textureBytes.end(); ++tex) atlasRelease(tex->first);
+    cacheClose();
 }
 
-void arVrmlViewer::timerUpdate()
-{ 
-  this->update(0.0);
+// Ticks the time-dependent nodes; true while anything of the scene changes,
+// as it does for every tick of a running TimeSensor and its interpolators.
+bool arVrmlViewer::timerUpdate()
+{
+    bool changed = this->browser.update(0.0);
+
+    // Cleared here as render() would, a scene that is not drawn included.
+    this->browser.modified(false);
+    return changed || this->browser.events_pending();
 }
 
 
@@ -51,61 +185,184 @@ void arVrmlViewer::setInternalLight(bool flag)
     internal_light = flag;
 }
 
+void arVrmlViewer::setCulling(bool flag)
+{
+    cull = flag;
+}
+
+// The view volume of the ARToolKit projection, arglCameraFrustumRH() is not
+// symmetric so the planes are taken from the matrix rather than from a field
+// of view. bounding_sphere::intersect_frustum() wants inward normals and the
+// distance of the plane from the origin.
+void arVrmlViewer::cullUpdate(const float p[16])
+{
+    float   *plane[4];
+    double   len;
+    int      i, j;
+
+    cull_modelview = modelview_matrix_stack_.current;
+
+    plane[0] = cull_frustum.left_plane;
+    plane[1] = cull_frustum.right_plane;
+    plane[2] = cull_frustum.bot_plane;
+    plane[3] = cull_frustum.top_plane;
+    for (i = 0; i < 4; i++) {
+        double v[4];
+        for (j = 0; j < 4; j++) {
+            if (i & 1) v[j] = p[j*4+3] - p[j*4+i/2];
+            else       v[j] = p[j*4+3] + p[j*4+i/2];
+        }
+        len = sqrt(v[0]*v[0] + v[1]*v[1] + v[2]*v[2]);
+        if (len == 0.0) len = 1.0;
+        for (j = 0; j < 3; j++) plane[i][j] = float(v[j] / len);
+        plane[i][3] = float(-v[3] / len);
+    }
+    cull_frustum.z_near = p[14] / (p[10] - 1.0);
+    cull_frustum.z_far  = p[14] / (p[10] + 1.0);
+}
+
 void arVrmlViewer::redraw()
+{
+    static const double identity[1][16] = {{ 1.0, 0.0, 0.0, 0.0,
+                                             0.0, 1.0, 0.0, 0.0,
+                                             0.0, 0.0, 1.0, 0.0,
+                                             0.0, 0.0, 0.0, 1.0 }};
+
+    redrawInstanced(identity, 1);
+}
+
+// The GL state of the scene is set up once for all the instances, each one
+// only adds its transform and renders the display lists already compiled.
+void arVrmlViewer::redrawInstanced(const double (*transforms)[16], int n)
 {
 	double start = browser::current_time();
-    glMatrixMode(GL_MODELVIEW);
-    glPushMatrix();
-    glTranslated( translation[0], translation[1], translation[2] );
-    if (rotation[0] != 0.0) { glRotated(rotation[0], 1.0, 0.0, 0.0); }
-	if (rotation[1] != 0.0) { glRotated(rotation[1], 0.0, 1.0, 0.0); }
-	if (rotation[2] != 0.0) { glRotated(rotation[2], 0.0, 0.0, 1.0); }
-    glScaled(scale[0], scale[1], scale[2]);
+	void *context = currentContext();
 	
+    if (context != stateContext) {
+        stateContext = context;
+        stateValid = false;
+    }
+    if (!stateValid) {
+#if USE_STENCIL_SHAPE
+        glStencilFunc(GL_ALWAYS, 1, 1);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+#endif
+        glDepthFunc(GL_LEQUAL);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glCullFace(GL_BACK);
+        glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
+        glEnable(GL_NORMALIZE);
+        stateLights = (1u << max_lights) - 1;
+        stateValid = true;
+        counts.states += 6;
+    }
+
+    // What the nodes may have changed in the last draw.
 #if USE_STENCIL_SHAPE
     glEnable(GL_STENCIL_TEST);
-    glStencilFunc(GL_ALWAYS, 1, 1);
-    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
 #endif
     glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glDisable(GL_FOG);          // this is a global attribute
     glDisable(GL_TEXTURE_2D);
     glEnable(GL_CULL_FACE);
     glFrontFace(GL_CCW);
-    glCullFace(GL_BACK);
+    counts.states += 5;
 	
 	if (internal_light) {
 		if (lit) glEnable(GL_LIGHTING);
-		glLightModeli(GL_LIGHT_MODEL_TWO_SIDE, GL_TRUE);
-		glEnable(GL_NORMALIZE);
 		glDisable(GL_COLOR_MATERIAL);
-		glDisable(GL_BLEND);
+		if (!blendExternal) glDisable(GL_BLEND);
 		glShadeModel(GL_SMOOTH);
-		
-		for (int i = 0; i < max_lights; ++i) {
-			light_info_[i].type = light_unused;
-			GLenum light = (GLenum) (GL_LIGHT0 + i);
-			glDisable(light);
-		}
+		counts.states += 4;
 	}
+
+    // The pick list of the instance is made again by each of its draws.
+    std::map<int, arVrmlPickList>::iterator pl = picks.find(pickTag);
+    if (pl == picks.end()) {
+        arVrmlPickList l;
+        l.activeView = 0;
+        l.pressed = false;
+        l.grabDistance = 0.0f;
+        l.refits = 0;
+        pl = picks.insert(std::make_pair(pickTag, l)).first;
+    }
+    pickList = &pl->second;
+    pickList->items.clear();
+    pickList->views.clear();
+    pickList->topStale = true;
 	
-    objects = 0;
-    nested_objects = 0;
-    sensitive = 0;
-	
-    this->browser.render(*this);
+    // The matrices of the application are read from GL once for all the
+    // instances; from there modelview_matrix_stack_ keeps the modelview.
+    GLfloat m[16], p[16];
+    glGetFloatv(GL_MODELVIEW_MATRIX, m);
+    if (cull) glGetFloatv(GL_PROJECTION_MATRIX, p);
+    const mat4f base(m);
+
+    mat4f place = mat4f::scale(vec3f(float(scale[0]), float(scale[1]), float(scale[2])));
+    if (rotation[2] != 0.0) place = place * mat4f::rotation(openvrml::rotation(0.0, 0.0, 1.0, float(rotation[2] * pi / 180.0)));
+    if (rotation[1] != 0.0) place = place * mat4f::rotation(openvrml::rotation(0.0, 1.0, 0.0, float(rotation[1] * pi / 180.0)));
+    if (rotation[0] != 0.0) place = place * mat4f::rotation(openvrml::rotation(1.0, 0.0, 0.0, float(rotation[0] * pi / 180.0)));
+    place = place * mat4f::translation(vec3f(float(translation[0]), float(translation[1]), float(translation[2])));
+
+    glMatrixMode(GL_MODELVIEW);
+    for (int k = 0; k < n; ++k) {
+        float t[16];
+        for (int i = 0; i < 16; ++i) t[i] = float(transforms[k][i]);
+        glPushMatrix();
+        modelview_matrix_stack_.load(place * mat4f(t) * base);
+        if (cull) cullUpdate(p);
+
+        // The level of detail from how far the origin of the scene is from
+        // the camera, as the pose of the marker puts it.
+        const mat4f & mv = modelview_matrix_stack_.current;
+        const double distance = sqrt(double(mv[3][0]) * mv[3][0] + double(mv[3][1]) * mv[3][1]
+                                     + double(mv[3][2]) * mv[3][2]);
+        for (lod = 0; lod < AR_VRML_LOD_LEVELS - 1; ++lod) {
+            if (lodDistance[lod] <= 0.0 || distance <= lodDistance[lod]) break;
+        }
+
+        // The lights of the scene are placed again under each transform,
+        // only those left on by the last draw need to be turned off.
+        if (internal_light) {
+            for (int i = 0; i < max_lights; ++i) {
+                light_info_[i].type = light_unused;
+                if (stateLights & (1u << i)) { glDisable((GLenum) (GL_LIGHT0 + i)); counts.states++; }
+            }
+            stateLights = 0;
+        }
+
+        objects = 0;
+        nested_objects = 0;
+        sensitive = 0;
+        pickStack.clear();
+
+        recording = true;
+        this->browser.render(*this);
+        flushDraws();
+        recording = false;
+        flushAtlas();
+
+        for (int i = 0; i < max_lights; ++i) {
+            if (light_info_[i].type != light_unused) stateLights |= 1u << i;
+        }
+
+        glMatrixMode(GL_MODELVIEW);
+        glPopMatrix();
+    }
+    pickList = NULL;
 	
 	if (internal_light) {
 		if (lit) glDisable(GL_LIGHTING);
 	}
-    glDisable(GL_BLEND);
+    if (!blendExternal) glDisable(GL_BLEND);
     glDisable(GL_CULL_FACE);
     glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-	
-    glMatrixMode(GL_MODELVIEW);
-    glPopMatrix();
+
+    // The meshes made after the first draw are those of animated geometry.
+    if (cacheWriting) {
+        cacheWriting = false;
+        cacheClose();
+    }
 }
 
 void  arVrmlViewer::post_redraw()
@@ -134,7 +391,16 @@ void arVrmlViewer::set_viewpoint(const openvrml::vec3f & position,
 				 float avatarSize,
 				 float visibilityLimit)
 {
+    // The viewpoint is not applied to GL, the scene is placed by the
+    // modelview of redraw(); browser::render() hands the nodes their
+    // transforms relative to it.
+    cull_matrix = mat4f::rotation(orientation) * mat4f::translation(position) * cull_modelview;
 
+    // The sensors take their points in the coordinates of the viewpoint.
+    if (pickList) {
+        pickList->views.push_back((mat4f::rotation(orientation) * mat4f::translation(position)
+                                   * modelview_matrix_stack_.current).inverse());
+    }
 }
 
 viewer::object_t arVrmlViewer::insert_background(const std::vector<float> & groundAngle,
@@ -152,6 +418,8 @@ viewer::object_t arVrmlViewer::insert_dir_light(float ambientIntensity,
 				  const openvrml::color & color,
 				  const openvrml::vec3f & direction)
 {
+    // The light may take the place of one a recorded draw still needs.
+    flushDraws();
     if (internal_light) return gl::viewer::insert_dir_light(ambientIntensity, intensity, color, direction);
     return 0;
 }
@@ -163,6 +431,7 @@ viewer::object_t arVrmlViewer::insert_point_light(float ambientIntensity,
 				    const openvrml::vec3f & location,
 				    float radius)
 {
+    flushDraws();
 	if (internal_light) return gl::viewer::insert_point_light(ambientIntensity, attenuation, color, intensity, location, radius);
 
     return 0;
@@ -179,6 +448,7 @@ viewer::object_t arVrmlViewer::insert_spot_light(float ambientIntensity,
 				   const openvrml::vec3f & location,
 				   float radius)
 {
+    flushDraws();
     if (internal_light) return gl::viewer::insert_spot_light(ambientIntensity, attenuation, beamWidth, color,cutOffAngle, direction, intensity, location, radius);
     return 0;
 }
@@ -186,10 +456,2206 @@ viewer::object_t arVrmlViewer::insert_spot_light(float ambientIntensity,
  bounding_volume::intersection
 arVrmlViewer::intersect_view_volume(const bounding_volume & bvolume) const
 {
-  // if( d_cull ) {
-  //return  openvrml::viewer::intersect_view_volume(bvolume);
-	// }
-	// else {
-         return bounding_volume::inside;
-	//}
+    const bounding_sphere * bs = dynamic_cast<const bounding_sphere *>(&bvolume);
+
+    if (!cull) return bounding_volume::inside;
+    if (!bs) return bounding_volume::partial;
+
+    bounding_sphere eye(*bs);
+    eye.transform(cull_matrix);
+    return eye.intersect_frustum(cull_frustum);
+}
+
+static void *bufferProc(const char *name, const char *nameARB)
+{
+    void *proc;
+
+#if defined(_WIN32)
+    if (!(proc = (void *)wglGetProcAddress(name))) proc = (void *)wglGetProcAddress(nameARB);
+#elif defined(__APPLE__)
+    proc = NULL;
+#else
+    if (!(proc = (void *)glXGetProcAddressARB((const GLubyte *)name))) proc = (void *)glXGetProcAddressARB((const GLubyte *)nameARB);
+#endif
+    return proc;
+}
+
+static int bufferObjectsCheck()
+{
+    const char *version;
+    const char *ext;
+
+    if (bufferObjects >= 0) return bufferObjects;
+
+    bufferObjects = 0;
+    version = (const char *)glGetString(GL_VERSION);
+    ext = (const char *)glGetString(GL_EXTENSIONS);
+    if (!version || !((version[0] > '1') || (version[0] == '1' && version[2] >= '5'))) {
+        if (!ext || !strstr(ext, "GL_ARB_vertex_buffer_object")) return bufferObjects;
+    }
+#ifdef __APPLE__
+    genBuffers = glGenBuffers;
+    deleteBuffers = glDeleteBuffers;
+    bindBuffer = glBindBuffer;
+    bufferData = (arVrmlBufferData)glBufferData;
+    bufferSubData = (arVrmlBufferSubData)glBufferSubData;
+#else
+    genBuffers = (arVrmlGenBuffers)bufferProc("glGenBuffers", "glGenBuffersARB");
+    deleteBuffers = (arVrmlDeleteBuffers)bufferProc("glDeleteBuffers", "glDeleteBuffersARB");
+    bindBuffer = (arVrmlBindBuffer)bufferProc("glBindBuffer", "glBindBufferARB");
+    bufferData = (arVrmlBufferData)bufferProc("glBufferData", "glBufferDataARB");
+    bufferSubData = (arVrmlBufferSubData)bufferProc("glBufferSubData", "glBufferSubDataARB");
+#endif
+    bufferObjects = (genBuffers && deleteBuffers && bindBuffer && bufferData && bufferSubData)? 1: 0;
+    return bufferObjects;
+}
+
+static int pixelBuffersCheck()
+{
+    const char *version;
+    const char *ext;
+
+    if (pixelBuffers >= 0) return pixelBuffers;
+
+    pixelBuffers = 0;
+    if (!bufferObjectsCheck()) return pixelBuffers;
+    version = (const char *)glGetString(GL_VERSION);
+    ext = (const char *)glGetString(GL_EXTENSIONS);
+    if (!version || !((version[0] > '2') || (version[0] == '2' && version[2] >= '1'))) {
+        if (!ext || !(strstr(ext, "GL_ARB_pixel_buffer_object") || strstr(ext, "GL_EXT_pixel_buffer_object")))
+            return pixelBuffers;
+    }
+    pixelBuffers = 1;
+    return pixelBuffers;
+}
+
+namespace {
+
+    // The faces of an IndexedFaceSet as insert_shell() is given them, turned
+    // into the vertices and triangles of a mesh. A vertex is made for each
+    // corner of a face, or for each coordinate when every attribute follows
+    // the coordinates, so that shared corners are stored once.
+    struct arVrmlShell {
+        unsigned int                         mask;
+        const std::vector<vec3f> &           coord;
+        const std::vector<int32> &           coordIndex;
+        const std::vector<openvrml::color> & color;
+        const std::vector<int32> &           colorIndex;
+        const std::vector<vec3f> &           normal;
+        const std::vector<int32> &           normalIndex;
+        const std::vector<vec2f> &           texCoord;
+        const std::vector<int32> &           texCoordIndex;
+        int                                  texAxes[2];
+        float                                texParams[4];
+        bool                                 share;
+        bool                                 record;
+        std::map<int32, GLuint>              shared;
+        size_t                               face;
+        vec3f                                faceNormal;
+        GLenum                               type;
+        std::vector<GLuint>                  prim;
+        arVrmlMesh &                         m;
+
+        arVrmlShell(unsigned int mask,
+                    const std::vector<vec3f> & coord,
+                    const std::vector<int32> & coordIndex,
+                    const std::vector<openvrml::color> & color,
+                    const std::vector<int32> & colorIndex,
+                    const std::vector<vec3f> & normal,
+                    const std::vector<int32> & normalIndex,
+                    const std::vector<vec2f> & texCoord,
+                    const std::vector<int32> & texCoordIndex,
+                    arVrmlMesh & m):
+            mask(mask), coord(coord), coordIndex(coordIndex),
+            color(color), colorIndex(colorIndex),
+            normal(normal), normalIndex(normalIndex),
+            texCoord(texCoord), texCoordIndex(texCoordIndex),
+            share(false), record(false), face(0), type(GL_TRIANGLES), m(m)
+        {}
+
+        GLuint corner(size_t i);
+        void triangles();
+    };
+
+    GLuint arVrmlShell::corner(size_t i)
+    {
+        const vec3f & v = coord[coordIndex[i]];
+        float *p;
+        size_t index;
+
+        if (share) {
+            std::map<int32, GLuint>::iterator it = shared.find(coordIndex[i]);
+            if (it != shared.end()) return it->second;
+        }
+
+        m.vertex.resize(m.vertex.size() + AR_VRML_MESH_STRIDE);
+        p = &m.vertex[m.vertex.size() - AR_VRML_MESH_STRIDE];
+
+        if (!texCoord.empty()) {
+            index = !texCoordIndex.empty()? texCoordIndex[i]: coordIndex[i];
+            p[0] = texCoord[index][0];
+            p[1] = texCoord[index][1];
+        } else {
+            p[0] = (v[texAxes[0]] - texParams[0]) * texParams[1];
+            p[1] = (v[texAxes[1]] - texParams[2]) * texParams[3];
+        }
+
+        if (!color.empty()) {
+            if (mask & openvrml::viewer::mask_color_per_vertex) {
+                index = !colorIndex.empty()? colorIndex[i]: coordIndex[i];
+            } else {
+                index = !colorIndex.empty()? colorIndex[face]: face;
+            }
+            p[2] = color[index].r();
+            p[3] = color[index].g();
+            p[4] = color[index].b();
+        } else {
+            p[2] = p[3] = p[4] = 1.0f;
+        }
+
+        if (mask & openvrml::viewer::mask_normal_per_vertex) {
+            index = !normalIndex.empty()? normalIndex[i]: coordIndex[i];
+            p[5] = normal[index][0]; p[6] = normal[index][1]; p[7] = normal[index][2];
+        } else if (!normal.empty()) {
+            index = !normalIndex.empty()? normalIndex[face]: face;
+            p[5] = normal[index][0]; p[6] = normal[index][1]; p[7] = normal[index][2];
+        } else {
+            p[5] = faceNormal[0]; p[6] = faceNormal[1]; p[7] = faceNormal[2];
+        }
+
+        p[8] = v[0]; p[9] = v[1]; p[10] = v[2];
+
+        if (record) {
+            m.source.push_back(coordIndex[i]);
+            if (normal.empty()) m.face.push_back(GLuint(face));
+        }
+
+        GLuint n = GLuint(m.vertex.size() / AR_VRML_MESH_STRIDE - 1);
+        if (share) shared[coordIndex[i]] = n;
+        return n;
+    }
+
+    // Triangles of the primitive the tessellator has just ended.
+    void arVrmlShell::triangles()
+    {
+        size_t k;
+
+        switch (type) {
+          case GL_TRIANGLES:
+            for (k = 0; k + 2 < prim.size(); k += 3) {
+                m.index.push_back(prim[k]); m.index.push_back(prim[k+1]); m.index.push_back(prim[k+2]);
+            }
+            break;
+          case GL_TRIANGLE_FAN:
+            for (k = 1; k + 1 < prim.size(); ++k) {
+                m.index.push_back(prim[0]); m.index.push_back(prim[k]); m.index.push_back(prim[k+1]);
+            }
+            break;
+          case GL_TRIANGLE_STRIP:
+            for (k = 0; k + 2 < prim.size(); ++k) {
+                if (k & 1) {
+                    m.index.push_back(prim[k+1]); m.index.push_back(prim[k]); m.index.push_back(prim[k+2]);
+                } else {
+                    m.index.push_back(prim[k]); m.index.push_back(prim[k+1]); m.index.push_back(prim[k+2]);
+                }
+            }
+            break;
+          default:
+            break;
+        }
+        prim.clear();
+    }
+}
+
+extern "C" {
+    static void AR_VRML_GL_CALLBACK tessMeshBegin(GLenum type, void *pdata)
+    {
+        arVrmlShell *s = static_cast<arVrmlShell *>(pdata);
+        s->type = type;
+        s->prim.clear();
+    }
+
+    static void AR_VRML_GL_CALLBACK tessMeshVertex(void *vdata, void *pdata)
+    {
+        arVrmlShell *s = static_cast<arVrmlShell *>(pdata);
+        s->prim.push_back(s->corner(*static_cast<size_t *>(vdata)));
+    }
+
+    static void AR_VRML_GL_CALLBACK tessMeshEnd(void *pdata)
+    {
+        static_cast<arVrmlShell *>(pdata)->triangles();
+    }
+}
+
+// Texture coordinates generated from the two longest sides of the bounds of
+// the points; false when the bounds are flat.
+static bool texGenParams(const std::vector<vec3f> & coord, int axes[2], float params[4])
+{
+    float lo[3], hi[3], db;
+    size_t i;
+    int nb;
+
+    for (nb = 0; nb < 3; ++nb) lo[nb] = hi[nb] = coord.empty()? 0.0f: coord[0][nb];
+    for (i = 1; i < coord.size(); ++i) {
+        for (nb = 0; nb < 3; ++nb) {
+            if (coord[i][nb] < lo[nb]) lo[nb] = coord[i][nb];
+            if (coord[i][nb] > hi[nb]) hi[nb] = coord[i][nb];
+        }
+    }
+    axes[0] = 0;
+    axes[1] = 1;
+    params[0] = params[1] = params[2] = params[3] = 0.0f;
+    for (nb = 0; nb < 3; ++nb) {
+        db = hi[nb] - lo[nb];
+        if (db > params[1]) {
+            axes[1] = axes[0];
+            axes[0] = nb;
+            params[2] = params[0];
+            params[3] = params[1];
+            params[0] = lo[nb];
+            params[1] = db;
+        } else if (db > params[3]) {
+            axes[1] = nb;
+            params[2] = lo[nb];
+            params[3] = db;
+        }
+    }
+    if (params[1] == 0.0f || params[3] == 0.0f) return false;
+    params[1] = 1.0f / params[1];
+    params[3] = 1.0f / params[3];
+    return true;
+}
+
+// Tessellates the shell once into a mesh and draws it; the geometry node
+// keeps the returned object and draws it again with insert_reference().
+viewer::object_t
+arVrmlViewer::insert_shell(unsigned int mask,
+                           const std::vector<vec3f> & coord,
+                           const std::vector<int32> & coordIndex,
+                           const std::vector<openvrml::color> & color,
+                           const std::vector<int32> & colorIndex,
+                           const std::vector<vec3f> & normal,
+                           const std::vector<int32> & normalIndex,
+                           const std::vector<vec2f> & texCoord,
+                           const std::vector<int32> & texCoordIndex)
+{
+    if (this->select_mode || coordIndex.size() < 4) {
+        return gl::viewer::insert_shell(mask, coord, coordIndex, color, colorIndex,
+                                        normal, normalIndex, texCoord, texCoordIndex);
+    }
+
+    GLuint glid = glGenLists(1);
+    arVrmlMesh & m = meshes[object_t(glid)];
+
+    if (!tessellateShell(mask, coord, coordIndex, color, colorIndex,
+                         normal, normalIndex, texCoord, texCoordIndex, m)) {
+        meshes.erase(object_t(glid));
+        glDeleteLists(glid, 1);
+        return 0;
+    }
+    pickMesh(object_t(glid), m);
+    uploadMesh(m);
+    pickRecord(object_t(glid));
+    drawMesh(object_t(glid), m);
+
+    return object_t(glid);
+}
+
+// The triangles of the faces of a shell, in m.
+bool arVrmlViewer::tessellateShell(unsigned int mask,
+                                   const std::vector<vec3f> & coord,
+                                   const std::vector<int32> & coordIndex,
+                                   const std::vector<openvrml::color> & color,
+                                   const std::vector<int32> & colorIndex,
+                                   const std::vector<vec3f> & normal,
+                                   const std::vector<int32> & normalIndex,
+                                   const std::vector<vec2f> & texCoord,
+                                   const std::vector<int32> & texCoordIndex,
+                                   arVrmlMesh & m)
+{
+    // Generation of per vertex normals isn't implemented, as in gl::viewer.
+    if (normal.empty() && (mask & mask_normal_per_vertex)) {
+        mask &= ~mask_normal_per_vertex;
+    }
+
+    m.buffer[0] = m.buffer[1] = 0;
+    for (int l = 0; l < AR_VRML_LOD_LEVELS - 1; ++l) m.lod[l] = 0;
+    m.mask = mask;
+    m.color = !color.empty();
+    m.dynamic = false;
+    m.texGen = texCoord.empty();
+
+    arVrmlShell s(mask, coord, coordIndex, color, colorIndex,
+                  normal, normalIndex, texCoord, texCoordIndex, m);
+
+    if (texCoord.empty() && !texGenParams(coord, s.texAxes, s.texParams)) return false;
+
+    s.share = (texCoord.empty() || texCoordIndex.empty())
+           && (color.empty() || ((mask & mask_color_per_vertex) && colorIndex.empty()))
+           && (mask & mask_normal_per_vertex) && normalIndex.empty();
+
+    // The triangles of convex faces do not depend on the points, those of the
+    // tessellator may.
+    s.record = (mask & mask_convex) != 0;
+
+    std::vector<size_t>   corners;
+    std::vector<GLdouble> points;
+    size_t                first, k;
+
+    if (!(mask & mask_convex)) {
+        gluTessCallback(this->tesselator, GLU_TESS_BEGIN_DATA, reinterpret_cast<arVrmlTessCB>(tessMeshBegin));
+        gluTessCallback(this->tesselator, GLU_TESS_VERTEX_DATA, reinterpret_cast<arVrmlTessCB>(tessMeshVertex));
+        gluTessCallback(this->tesselator, GLU_TESS_END_DATA, reinterpret_cast<arVrmlTessCB>(tessMeshEnd));
+    }
+
+    for (first = 0; first < coordIndex.size(); ) {
+        // The corners of the face, up to its -1 or the end of the list.
+        corners.clear();
+        for (k = first; k < coordIndex.size() && coordIndex[k] >= 0; ++k) corners.push_back(k);
+
+        if (s.record && normal.empty()) {
+            for (size_t j = 0; j < 3; ++j) {
+                m.faceCorner.push_back(j < corners.size()? coordIndex[corners[j]]: 0);
+            }
+        }
+
+        if (corners.size() >= 3) {
+            vec3f n = (coord[coordIndex[corners[1]]] - coord[coordIndex[corners[2]]])
+                    * (coord[coordIndex[corners[1]]] - coord[coordIndex[corners[0]]]);
+            s.faceNormal = (mask & mask_ccw)? n: -n;
+
+            if (mask & mask_convex) {
+                GLuint c0 = s.corner(corners[0]);
+                GLuint c1 = s.corner(corners[1]);
+                for (size_t j = 2; j < corners.size(); ++j) {
+                    GLuint c2 = s.corner(corners[j]);
+                    m.index.push_back(c0); m.index.push_back(c1); m.index.push_back(c2);
+                    c1 = c2;
+                }
+            } else {
+                // The tessellator keeps the pointers until the polygon ends.
+                points.resize(corners.size() * 3);
+                gluTessBeginPolygon(this->tesselator, &s);
+                gluTessBeginContour(this->tesselator);
+                for (size_t j = 0; j < corners.size(); ++j) {
+                    const vec3f & v = coord[coordIndex[corners[j]]];
+                    points[j*3] = v[0]; points[j*3+1] = v[1]; points[j*3+2] = v[2];
+                    gluTessVertex(this->tesselator, &points[j*3], &corners[j]);
+                }
+                gluTessEndContour(this->tesselator);
+                gluTessEndPolygon(this->tesselator);
+            }
+        }
+        ++s.face;
+        first = k + 1;
+    }
+    m.count = GLsizei(m.index.size());
+
+    // Other geometry sets only the plain callbacks, which the data ones would hide.
+    if (!(mask & mask_convex)) {
+        gluTessCallback(this->tesselator, GLU_TESS_BEGIN_DATA, NULL);
+        gluTessCallback(this->tesselator, GLU_TESS_VERTEX_DATA, NULL);
+        gluTessCallback(this->tesselator, GLU_TESS_END_DATA, NULL);
+    }
+    simplifyMesh(m);
+    return true;
+}
+
+// The simpler levels of detail of a mesh of AR_VRML_LOD_MIN triangles or
+// more. Its vertices are clustered on a grid of cubes over its bounds,
+// AR_VRML_LOD_GRID of them along the longest side for the first level and
+// half as many for each next one; each triangle is drawn between the first
+// vertices of the clusters of its corners, and dropped when two of them are
+// in the same cluster. The levels share the vertices, only their indices are
+// added. A level that keeps more than AR_VRML_LOD_KEEP of the triangles of
+// the one before is not worth its indices, and ends the levels.
+#define  AR_VRML_LOD_MIN       256
+#define  AR_VRML_LOD_GRID      32
+#define  AR_VRML_LOD_KEEP      0.75
+
+void arVrmlViewer::simplifyMesh(arVrmlMesh & m)
+{
+    const size_t  stride = AR_VRML_MESH_STRIDE;
+    const size_t  n = m.vertex.size() / stride;
+    float         lo[3], hi[3], size = 0.0f;
+    size_t        i, k, kept, previous = size_t(m.count);
+    int           dim[3], level, grid;
+
+    if (m.count < AR_VRML_LOD_MIN * 3 || n == 0) return;
+
+    for (k = 0; k < 3; ++k) lo[k] = hi[k] = m.vertex[8 + k];
+    for (i = 1; i < n; ++i) {
+        const float *p = &m.vertex[i * stride + 8];
+        for (k = 0; k < 3; ++k) {
+            if (p[k] < lo[k]) lo[k] = p[k];
+            if (p[k] > hi[k]) hi[k] = p[k];
+        }
+    }
+    for (k = 0; k < 3; ++k) if (hi[k] - lo[k] > size) size = hi[k] - lo[k];
+    if (size <= 0.0f) return;
+
+    std::vector<int>          first;
+    std::vector<unsigned int> cluster(n);
+    for (level = 0, grid = AR_VRML_LOD_GRID; level < AR_VRML_LOD_LEVELS - 1; ++level, grid /= 2) {
+        const float cell = size / float(grid);
+        for (k = 0; k < 3; ++k) dim[k] = int((hi[k] - lo[k]) / cell) + 1;
+        first.assign(size_t(dim[0]) * dim[1] * dim[2], -1);
+        for (i = 0; i < n; ++i) {
+            const float *p = &m.vertex[i * stride + 8];
+            int c[3];
+            for (k = 0; k < 3; ++k) {
+                c[k] = int((p[k] - lo[k]) / cell);
+                if (c[k] >= dim[k]) c[k] = dim[k] - 1;
+            }
+            int &f = first[(size_t(c[2]) * dim[1] + c[1]) * dim[0] + c[0]];
+            if (f < 0) f = int(i);
+            cluster[i] = (unsigned int) f;
+        }
+
+        const size_t start = m.index.size();
+        for (i = 0; i + 2 < size_t(m.count); i += 3) {
+            const unsigned int a = cluster[m.index[i]];
+            const unsigned int b = cluster[m.index[i+1]];
+            const unsigned int c = cluster[m.index[i+2]];
+            if (a == b || b == c || a == c) continue;
+            m.index.push_back(a); m.index.push_back(b); m.index.push_back(c);
+        }
+        kept = m.index.size() - start;
+        if (kept == 0 || double(kept) > double(previous) * AR_VRML_LOD_KEEP) {
+            m.index.resize(start);
+            break;
+        }
+        m.lod[level] = int(kept);
+        previous = kept;
+    }
+}
+
+// Moves the arrays of a new mesh to buffer objects, when there are.
+void arVrmlViewer::uploadMesh(arVrmlMesh & m)
+{
+    m.bytes = m.vertex.size() * sizeof(float) + m.index.size() * sizeof(unsigned int);
+    if (m.count > 0 && bufferObjectsCheck() && !reuseBuffers(m)) {
+        genBuffers(2, m.buffer);
+        bindBuffer(GL_ARRAY_BUFFER, m.buffer[0]);
+        bufferData(GL_ARRAY_BUFFER, m.vertex.size() * sizeof(float), &m.vertex[0], GL_STATIC_DRAW);
+        bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.buffer[1]);
+        bufferData(GL_ELEMENT_ARRAY_BUFFER, m.index.size() * sizeof(unsigned int), &m.index[0], GL_STATIC_DRAW);
+        bindBuffer(GL_ARRAY_BUFFER, 0);
+        bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        std::vector<float>().swap(m.vertex);
+        std::vector<unsigned int>().swap(m.index);
+        std::vector<int>().swap(m.source);
+        std::vector<unsigned int>().swap(m.face);
+        std::vector<int>().swap(m.faceCorner);
+    }
+}
+
+// Two hashes of the fields of a geometry, FNV-1a and a multiplicative one,
+// as the key of its mesh in the cache. The vectors are hashed as their
+// bytes, their elements being arrays of floats or int32.
+class arVrmlHash {
+public:
+    arVrmlHash(char kind, unsigned int mask) { h[0] = 2166136261u; h[1] = 5381u; add(&kind, 1); add(&mask, sizeof(mask)); }
+
+    void add(const void *p, size_t n)
+    {
+        const unsigned char *b = static_cast<const unsigned char *>(p);
+        for (size_t i = 0; i < n; ++i) {
+            h[0] = (h[0] ^ b[i]) * 16777619u;
+            h[1] = h[1] * 33u + b[i];
+        }
+    }
+
+    template <typename T>
+    void add(const std::vector<T> & v)
+    {
+        unsigned int n = (unsigned int) v.size();
+        add(&n, sizeof(n));
+        if (n) add(&v[0], n * sizeof(T));
+    }
+
+    arVrmlMeshKey key() const { return arVrmlMeshKey(h[0], h[1]); }
+
+private:
+    unsigned int h[2];
+};
+
+// The cache of a scene is the file of the scene with a trailing m ("ball.wrlm"):
+// a header of "WRLM", the version and a byte order mark, then for each mesh
+// its key, mask, color flag, number of floats and of indices, the indices of
+// each simpler level of detail among them, and its arrays. It is only used on
+// machines of the byte order that wrote it.
+#define  AR_VRML_CACHE_VERSION   2
+#define  AR_VRML_CACHE_WORDS     (6 + AR_VRML_LOD_LEVELS - 1)
+#define  AR_VRML_CACHE_BOM       0x01020304u
+#define  AR_VRML_CACHE_MAX       (32L * 1024L * 1024L)
+
+static const char cacheMagic[4] = { 'W', 'R', 'L', 'M' };
+
+static bool cacheHeader(FILE *fp)
+{
+    char         magic[4];
+    unsigned int w[2];
+
+    return fread(magic, 1, 4, fp) == 4 && memcmp(magic, cacheMagic, 4) == 0
+        && fread(w, sizeof(w[0]), 2, fp) == 2
+        && w[0] == AR_VRML_CACHE_VERSION && w[1] == AR_VRML_CACHE_BOM;
+}
+
+// Reads the index of the cache the first time, then the mesh of key if it is
+// there.
+bool arVrmlViewer::cacheRead(const arVrmlMeshKey & key, arVrmlMesh & m)
+{
+    std::map<arVrmlMeshKey, long>::const_iterator it;
+    unsigned int w[AR_VRML_CACHE_WORDS];
+    unsigned int simpler;
+    int          l;
+
+    if (filename[0] == '\0') return false;
+    if (!cacheLoaded) {
+        cacheLoaded = true;
+        cacheIn = fopen((std::string(filename) + "m").c_str(), "rb");
+        if (cacheIn == NULL) return false;
+        cacheValid = cacheHeader(cacheIn);
+        while (cacheValid) {
+            long offset = ftell(cacheIn);
+            if (fread(w, sizeof(w[0]), AR_VRML_CACHE_WORDS, cacheIn) != AR_VRML_CACHE_WORDS) break;
+            if (fseek(cacheIn, long(w[4] + w[5]) * 4L, SEEK_CUR) != 0) break;
+            cacheIndex[arVrmlMeshKey(w[0], w[1])] = offset;
+        }
+    }
+
+    it = cacheIndex.find(key);
+    if (it == cacheIndex.end()) return false;
+    if (cacheIn == NULL) {
+        cacheIn = fopen((std::string(filename) + "m").c_str(), "rb");
+        if (cacheIn == NULL) return false;
+    }
+
+    if (fseek(cacheIn, it->second, SEEK_SET) != 0
+        || fread(w, sizeof(w[0]), AR_VRML_CACHE_WORDS, cacheIn) != AR_VRML_CACHE_WORDS || w[5] == 0
+        || arVrmlMeshKey(w[0], w[1]) != key) return false;
+    for (simpler = 0, l = 0; l < AR_VRML_LOD_LEVELS - 1; ++l) simpler += w[6 + l];
+    if (simpler >= w[5]) return false;
+    m.vertex.resize(w[4]);
+    m.index.resize(w[5]);
+    if ((w[4] && fread(&m.vertex[0], sizeof(float), w[4], cacheIn) != w[4])
+        || fread(&m.index[0], sizeof(unsigned int), w[5], cacheIn) != w[5]) {
+        m.vertex.clear();
+        m.index.clear();
+        return false;
+    }
+    for (size_t i = 0; i < m.index.size(); ++i) {
+        if (m.index[i] >= w[4] / AR_VRML_MESH_STRIDE) {
+            m.vertex.clear();
+            m.index.clear();
+            return false;
+        }
+    }
+
+    m.buffer[0] = m.buffer[1] = 0;
+    m.count = GLsizei(w[5] - simpler);
+    for (l = 0; l < AR_VRML_LOD_LEVELS - 1; ++l) m.lod[l] = int(w[6 + l]);
+    m.mask = w[2];
+    m.color = w[3] != 0;
+    m.dynamic = false;
+    m.texGen = false;
+    return true;
+}
+
+// Adds the mesh of key to the cache, during the first draw only.
+void arVrmlViewer::cacheWrite(const arVrmlMeshKey & key, const arVrmlMesh & m)
+{
+    unsigned int w[AR_VRML_CACHE_WORDS];
+    long         offset;
+
+    if (!cacheWriting || filename[0] == '\0' || m.count == 0) return;
+    if (cacheIndex.find(key) != cacheIndex.end()) return;
+
+    if (cacheOut == NULL) {
+        std::string path = std::string(filename) + "m";
+        if (cacheIn && !cacheValid) { fclose(cacheIn); cacheIn = NULL; }
+        cacheOut = fopen(path.c_str(), cacheValid? "ab": "wb");
+        if (cacheOut == NULL) {
+            cacheWriting = false;
+            return;
+        }
+        if (!cacheValid) {
+            w[0] = AR_VRML_CACHE_VERSION;
+            w[1] = AR_VRML_CACHE_BOM;
+            fwrite(cacheMagic, 1, 4, cacheOut);
+            fwrite(w, sizeof(w[0]), 2, cacheOut);
+            cacheValid = true;
+            cacheIndex.clear();
+        }
+    }
+
+    fseek(cacheOut, 0L, SEEK_END);
+    offset = ftell(cacheOut);
+    if (offset < 0 || offset > AR_VRML_CACHE_MAX) return;
+
+    w[0] = key.first;
+    w[1] = key.second;
+    w[2] = m.mask;
+    w[3] = m.color? 1: 0;
+    w[4] = (unsigned int) m.vertex.size();
+    w[5] = (unsigned int) m.index.size();
+    for (int l = 0; l < AR_VRML_LOD_LEVELS - 1; ++l) w[6 + l] = (unsigned int) m.lod[l];
+    if (fwrite(w, sizeof(w[0]), AR_VRML_CACHE_WORDS, cacheOut) != AR_VRML_CACHE_WORDS
+        || fwrite(&m.vertex[0], sizeof(float), w[4], cacheOut) != w[4]
+        || fwrite(&m.index[0], sizeof(unsigned int), w[5], cacheOut) != w[5]
+        || fflush(cacheOut) != 0) {
+        printf("Error: cannot write the mesh cache of %s\n", filename);
+        fclose(cacheOut);
+        cacheOut = NULL;
+        cacheWriting = false;
+        return;
+    }
+    cacheIndex[key] = offset;
+}
+
+void arVrmlViewer::cacheClose()
+{
+    if (cacheIn)  { fclose(cacheIn);  cacheIn = NULL; }
+    if (cacheOut) { fclose(cacheOut); cacheOut = NULL; }
+}
+
+// The normal of a grid point from the heights around it, as gl::viewer has.
+static vec3f elevationVertexNormal(int i, int j, int nx, int nz, float dx, float dz,
+                                   const std::vector<float> & h)
+{
+    const float *p = &h[j * nx + i];
+    vec3f        vx, vz;
+
+    if (i > 0 && i < nx - 1) { vx[0] = 2.0f * dx; vx[1] = p[1] - p[-1]; }
+    else if (i == 0)         { vx[0] = dx;        vx[1] = p[1] - p[0]; }
+    else                     { vx[0] = dx;        vx[1] = p[0] - p[-1]; }
+    vx[2] = 0.0f;
+
+    vz[0] = 0.0f;
+    if (j > 0 && j < nz - 1) { vz[1] = p[nx] - p[-nx]; vz[2] = 2.0f * dz; }
+    else if (j == 0)         { vz[1] = p[nx] - p[0];   vz[2] = dz; }
+    else                     { vz[1] = p[0] - p[-nx];  vz[2] = dz; }
+
+    return vz * vx;
+}
+
+// An ElevationGrid is drawn as the shell of its quads, from the cache when
+// it has the mesh.
+viewer::object_t
+arVrmlViewer::insert_elevation_grid(const unsigned int mask,
+                                    const std::vector<float> & height,
+                                    const int32 xDimension,
+                                    const int32 zDimension,
+                                    const float xSpacing,
+                                    const float zSpacing,
+                                    const std::vector<openvrml::color> & color,
+                                    const std::vector<vec3f> & normal,
+                                    const std::vector<vec2f> & texCoord)
+{
+    if (this->select_mode || xDimension < 2 || zDimension < 2
+        || height.size() < size_t(xDimension * zDimension)) {
+        return gl::viewer::insert_elevation_grid(mask, height, xDimension, zDimension,
+                                                 xSpacing, zSpacing, color, normal, texCoord);
+    }
+
+    arVrmlHash h('G', mask);
+    h.add(height);
+    h.add(&xDimension, sizeof(xDimension));
+    h.add(&zDimension, sizeof(zDimension));
+    h.add(&xSpacing, sizeof(xSpacing));
+    h.add(&zSpacing, sizeof(zSpacing));
+    h.add(color);
+    h.add(normal);
+    h.add(texCoord);
+
+    GLuint glid = glGenLists(1);
+    arVrmlMesh & m = meshes[object_t(glid)];
+
+    if (!cacheRead(h.key(), m)) {
+        const std::vector<int32> none;
+        std::vector<vec3f>  coord(xDimension * zDimension);
+        std::vector<vec2f>  tc;
+        std::vector<vec3f>  vn;
+        std::vector<int32>  coordIndex;
+        unsigned int        shellMask = mask | mask_convex;
+        int32               i, j;
+
+        for (j = 0; j < zDimension; ++j) {
+            for (i = 0; i < xDimension; ++i) {
+                coord[j * xDimension + i] = vec3f(xSpacing * i, height[j * xDimension + i], zSpacing * j);
+            }
+        }
+        for (j = 0; j < zDimension - 1; ++j) {
+            for (i = 0; i < xDimension - 1; ++i) {
+                coordIndex.push_back(j * xDimension + i);
+                coordIndex.push_back((j + 1) * xDimension + i);
+                coordIndex.push_back((j + 1) * xDimension + i + 1);
+                coordIndex.push_back(j * xDimension + i + 1);
+                coordIndex.push_back(-1);
+            }
+        }
+        if (texCoord.empty()) {
+            tc.resize(coord.size());
+            for (j = 0; j < zDimension; ++j) {
+                for (i = 0; i < xDimension; ++i) {
+                    tc[j * xDimension + i] = vec2f(float(i) / (xDimension - 1), float(j) / (zDimension - 1));
+                }
+            }
+        }
+        if (normal.empty() && (mask & mask_normal_per_vertex)) {
+            vn.resize(coord.size());
+            for (j = 0; j < zDimension; ++j) {
+                for (i = 0; i < xDimension; ++i) {
+                    vn[j * xDimension + i] = elevationVertexNormal(i, j, xDimension, zDimension,
+                                                                   xSpacing, zSpacing, height);
+                }
+            }
+        }
+
+        if (!tessellateShell(shellMask, coord, coordIndex, color, none,
+                             normal.empty()? vn: normal, none,
+                             texCoord.empty()? tc: texCoord, none, m)) {
+            meshes.erase(object_t(glid));
+            glDeleteLists(glid, 1);
+            return 0;
+        }
+        cacheWrite(h.key(), m);
+    }
+    pickMesh(object_t(glid), m);
+    uploadMesh(m);
+    pickRecord(object_t(glid));
+    drawMesh(object_t(glid), m);
+
+    return object_t(glid);
+}
+
+// An Extrusion is drawn as the shell of its sides and caps, from the cache
+// when it has the mesh. Convex only concerns the caps, the sides are quads.
+viewer::object_t
+arVrmlViewer::insert_extrusion(const unsigned int mask,
+                               const std::vector<vec3f> & spine,
+                               const std::vector<vec2f> & crossSection,
+                               const std::vector<openvrml::rotation> & orientation,
+                               const std::vector<vec2f> & scale)
+{
+    if (this->select_mode || crossSection.size() < 2 || spine.size() < 2) {
+        return gl::viewer::insert_extrusion(mask, spine, crossSection, orientation, scale);
+    }
+
+    arVrmlHash h('E', mask);
+    h.add(spine);
+    h.add(crossSection);
+    h.add(orientation);
+    h.add(scale);
+
+    GLuint glid = glGenLists(1);
+    arVrmlMesh & m = meshes[object_t(glid)];
+
+    if (!cacheRead(h.key(), m)) {
+        const std::vector<int32>           none;
+        const std::vector<openvrml::color> noColor;
+        const std::vector<vec3f>           noNormal;
+        const size_t        nc = crossSection.size();
+        const size_t        ns = spine.size();
+        std::vector<vec3f>  coord;
+        std::vector<vec2f>  tc;
+        std::vector<int32>  coordIndex, texCoordIndex;
+        size_t              i, j, last;
+
+        extrusion_points(orientation, scale, crossSection, spine, coord, tc);
+
+        for (i = 0; i < ns - 1; ++i) {
+            for (j = 0; j < nc - 1; ++j) {
+                coordIndex.push_back(int32(i * nc + j));
+                coordIndex.push_back(int32(i * nc + j + 1));
+                coordIndex.push_back(int32((i + 1) * nc + j + 1));
+                coordIndex.push_back(int32((i + 1) * nc + j));
+                coordIndex.push_back(-1);
+            }
+        }
+        texCoordIndex = coordIndex;
+
+        // The caps are the cross section, the first one reversed, textured
+        // over the bounds of the cross section.
+        if (mask & (mask_bottom | mask_top)) {
+            const size_t base = tc.size();
+            float lo[2], hi[2];
+
+            lo[0] = hi[0] = crossSection[0].x();
+            lo[1] = hi[1] = crossSection[0].y();
+            for (j = 1; j < nc; ++j) {
+                for (int k = 0; k < 2; ++k) {
+                    if (crossSection[j][k] < lo[k]) lo[k] = crossSection[j][k];
+                    if (crossSection[j][k] > hi[k]) hi[k] = crossSection[j][k];
+                }
+            }
+            for (j = 0; j < nc; ++j) {
+                tc.push_back(vec2f(hi[0] > lo[0]? (crossSection[j].x() - lo[0]) / (hi[0] - lo[0]): 0.0f,
+                                   hi[1] > lo[1]? (crossSection[j].y() - lo[1]) / (hi[1] - lo[1]): 0.0f));
+            }
+
+            last = (crossSection.front() == crossSection.back())? nc - 1: nc;
+            if (mask & mask_bottom) {
+                for (j = last; j > 0; --j) {
+                    coordIndex.push_back(int32(j - 1));
+                    texCoordIndex.push_back(int32(base + j - 1));
+                }
+                coordIndex.push_back(-1);
+                texCoordIndex.push_back(-1);
+            }
+            if (mask & mask_top) {
+                for (j = 0; j < last; ++j) {
+                    coordIndex.push_back(int32((ns - 1) * nc + j));
+                    texCoordIndex.push_back(int32(base + j));
+                }
+                coordIndex.push_back(-1);
+                texCoordIndex.push_back(-1);
+            }
+        }
+
+        if (coordIndex.size() < 4
+            || !tessellateShell(mask & (mask_ccw | mask_solid | mask_convex), coord, coordIndex,
+                                noColor, none, noNormal, none, tc, texCoordIndex, m)) {
+            meshes.erase(object_t(glid));
+            glDeleteLists(glid, 1);
+            return gl::viewer::insert_extrusion(mask, spine, crossSection, orientation, scale);
+        }
+        cacheWrite(h.key(), m);
+    }
+    pickMesh(object_t(glid), m);
+    uploadMesh(m);
+    pickRecord(object_t(glid));
+    drawMesh(object_t(glid), m);
+
+    return object_t(glid);
+}
+
+// Takes the retired buffers for m when they are the same size, uploading only
+// the range of vertices that changed. m then keeps its arrays, to find the
+// range again the next time.
+bool arVrmlViewer::reuseBuffers(arVrmlMesh & m)
+{
+    const size_t  stride = AR_VRML_MESH_STRIDE;
+    size_t        first, last;
+
+    if (!retired.buffer[0]) return false;
+    if (retired.count != m.count || retired.mask != m.mask || retired.color != m.color
+        || memcmp(retired.lod, m.lod, sizeof(m.lod)) != 0
+        || (retired.dynamic && retired.vertex.size() != m.vertex.size())) {
+        return false;
+    }
+
+    m.buffer[0] = retired.buffer[0];
+    m.buffer[1] = retired.buffer[1];
+    retired.buffer[0] = retired.buffer[1] = 0;
+
+    bindBuffer(GL_ARRAY_BUFFER, m.buffer[0]);
+    if (retired.dynamic) {
+        for (first = 0; first < m.vertex.size() && m.vertex[first] == retired.vertex[first]; ++first) ;
+        for (last = m.vertex.size(); last > first && m.vertex[last - 1] == retired.vertex[last - 1]; --last) ;
+        if (first < last) {
+            first -= first % stride;
+            last += (stride - last % stride) % stride;
+            bufferSubData(GL_ARRAY_BUFFER, first * sizeof(float), (last - first) * sizeof(float), &m.vertex[first]);
+        }
+    } else {
+        bufferData(GL_ARRAY_BUFFER, m.vertex.size() * sizeof(float), &m.vertex[0], GL_DYNAMIC_DRAW);
+    }
+    if (!retired.dynamic || retired.index != m.index) {
+        bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.buffer[1]);
+        bufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, m.index.size() * sizeof(unsigned int), &m.index[0]);
+        bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+    bindBuffer(GL_ARRAY_BUFFER, 0);
+
+    m.dynamic = true;
+    std::vector<float>().swap(retired.vertex);
+    std::vector<unsigned int>().swap(retired.index);
+    return true;
+}
+
+// Moves the vertices of a mesh that still has its arrays to the new points,
+// with its generated normals and texture coordinates, and uploads the range of
+// vertices that changed. Other meshes are built again by the node.
+bool arVrmlViewer::update_shell_coord(const object_t ref, const std::vector<vec3f> & coord)
+{
+    std::map<object_t, arVrmlMesh>::iterator it = meshes.find(ref);
+    const size_t        stride = AR_VRML_MESH_STRIDE;
+    std::vector<vec3f>  normals;
+    float               w[AR_VRML_MESH_STRIDE];
+    int                 texAxes[2];
+    float               texParams[4];
+    size_t              i, n, first, last;
+
+    if (it == meshes.end()) return false;
+    arVrmlMesh & m = it->second;
+
+    n = m.vertex.size() / stride;
+    if (n == 0 || m.source.size() != n) return false;
+    for (i = 0; i < n; ++i) {
+        if (m.source[i] < 0 || size_t(m.source[i]) >= coord.size()) return false;
+    }
+    for (i = 0; i < m.faceCorner.size(); ++i) {
+        if (m.faceCorner[i] < 0 || size_t(m.faceCorner[i]) >= coord.size()) return false;
+    }
+    if (m.texGen && !texGenParams(coord, texAxes, texParams)) return false;
+
+    normals.resize(m.faceCorner.size() / 3);
+    for (i = 0; i < normals.size(); ++i) {
+        const vec3f & c0 = coord[m.faceCorner[i*3]];
+        const vec3f & c1 = coord[m.faceCorner[i*3+1]];
+        const vec3f & c2 = coord[m.faceCorner[i*3+2]];
+        normals[i] = (c1 - c2) * (c1 - c0);
+        if (!(m.mask & mask_ccw)) normals[i] = -normals[i];
+    }
+
+    first = n;
+    last = 0;
+    for (i = 0; i < n; ++i) {
+        float *p = &m.vertex[i * stride];
+        const vec3f & v = coord[m.source[i]];
+
+        memcpy(w, p, sizeof(w));
+        if (m.texGen) {
+            w[0] = (v[texAxes[0]] - texParams[0]) * texParams[1];
+            w[1] = (v[texAxes[1]] - texParams[2]) * texParams[3];
+        }
+        if (!m.face.empty()) {
+            const vec3f & fn = normals[m.face[i]];
+            w[5] = fn[0]; w[6] = fn[1]; w[7] = fn[2];
+        }
+        w[8] = v[0]; w[9] = v[1]; w[10] = v[2];
+
+        if (memcmp(w, p, sizeof(w)) != 0) {
+            memcpy(p, w, sizeof(w));
+            if (i < first) first = i;
+            last = i + 1;
+        }
+    }
+
+    if (first < last && m.buffer[0]) {
+        bindBuffer(GL_ARRAY_BUFFER, m.buffer[0]);
+        bufferSubData(GL_ARRAY_BUFFER, first * stride * sizeof(float),
+                      (last - first) * stride * sizeof(float), &m.vertex[first * stride]);
+        bindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+    if (first < last) {
+        std::map<object_t, arVrmlPickTree>::iterator t = pickTrees.find(ref);
+        if (t != pickTrees.end()) {
+            t->second.stale = true;
+            std::map<int, arVrmlPickList>::iterator pl;
+            for (pl = picks.begin(); pl != picks.end(); ++pl) pl->second.topStale = true;
+        }
+    }
+    return true;
+}
+
+// The appearance calls of the shapes, followed to know what a recorded draw
+// needs set again.
+void arVrmlViewer::enable_lighting(const bool val)
+{
+    counts.states++;
+    look.lighting = val;
+    gl::viewer::enable_lighting(val);
+}
+
+void arVrmlViewer::set_color(const color & rgb, const float a)
+{
+    counts.states++;
+    look.material = false;
+    look.diffuse = rgb;
+    look.alpha = a;
+    gl::viewer::set_color(rgb, a);
+}
+
+void arVrmlViewer::set_material(const float ambientIntensity,
+                                const color & diffuseColor,
+                                const color & emissiveColor,
+                                const float shininess,
+                                const color & specularColor,
+                                const float transparency)
+{
+    counts.states++;
+    look.material = true;
+    look.ambient = ambientIntensity;
+    look.diffuse = diffuseColor;
+    look.emissive = emissiveColor;
+    look.shininess = shininess;
+    look.specular = specularColor;
+    look.transparency = transparency;
+    if (transparency != 0.0f) blended = true;
+    gl::viewer::set_material(ambientIntensity, diffuseColor, emissiveColor,
+                             shininess, specularColor, transparency);
+}
+
+void arVrmlViewer::set_material_mode(const size_t tex_components, const bool geometry_color)
+{
+    counts.states++;
+    look.texComponents = tex_components;
+    look.geometryColor = geometry_color;
+    if (tex_components == 2 || tex_components == 4) blended = true;
+    gl::viewer::set_material_mode(tex_components, geometry_color);
+}
+
+// The calls a shape makes for l, in the same order.
+void arVrmlViewer::setLook(const arVrmlLook & l)
+{
+    counts.states += 3;
+    if (l.material) {
+        gl::viewer::enable_lighting(l.lighting);
+        gl::viewer::set_material(l.ambient, l.diffuse, l.emissive,
+                                 l.shininess, l.specular, l.transparency);
+    } else {
+        gl::viewer::set_color(l.diffuse, l.alpha);
+        gl::viewer::enable_lighting(l.lighting);
+    }
+    gl::viewer::set_material_mode(l.texComponents, l.geometryColor);
+}
+
+// The values that tell two appearances apart, in the order they sort by.
+static void lookKey(const arVrmlLook & l, float key[17])
+{
+    key[0] = l.material;
+    key[1] = l.lighting;
+    key[2] = l.geometryColor;
+    key[3] = float(l.texComponents);
+    key[4] = l.ambient;
+    key[5] = l.shininess;
+    key[6] = l.transparency;
+    key[7] = l.alpha;
+    for (int i = 0; i < 3; ++i) {
+        key[8+i]  = l.diffuse[i];
+        key[11+i] = l.emissive[i];
+        key[14+i] = l.specular[i];
+    }
+}
+
+static int lookCompare(const arVrmlLook & a, const arVrmlLook & b)
+{
+    float ka[17], kb[17];
+
+    lookKey(a, ka);
+    lookKey(b, kb);
+    for (int i = 0; i < 17; ++i) {
+        if (ka[i] != kb[i]) return ka[i] < kb[i]? -1: 1;
+    }
+    return 0;
+}
+
+static bool drawLess(const arVrmlDrawItem & a, const arVrmlDrawItem & b)
+{
+    int c = lookCompare(a.look, b.look);
+
+    if (c != 0) return c < 0;
+    if (a.lights != b.lights) return a.lights < b.lights;
+    return a.mesh < b.mesh;
+}
+
+// Draws the recorded meshes, each appearance and set of lights set once for
+// all the meshes that have it, then puts back the state the traversal is in.
+void arVrmlViewer::flushDraws()
+{
+    std::vector<arVrmlDrawItem>::const_iterator d;
+    const arVrmlLook *last = 0;
+    unsigned int on = 0, lights;
+    bool was = recording;
+    int i;
+
+    if (drawList.empty()) return;
+    recording = false;
+
+    std::stable_sort(drawList.begin(), drawList.end(), drawLess);
+    for (i = 0; i < max_lights; ++i) {
+        if (light_info_[i].type != light_unused) on |= 1u << i;
+    }
+    lights = on;
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    for (d = drawList.begin(); d != drawList.end(); ++d) {
+        std::map<object_t, arVrmlMesh>::const_iterator it = meshes.find(d->mesh);
+        if (it == meshes.end()) continue;
+
+        if (!last || lookCompare(*last, d->look) != 0) {
+            setLook(d->look);
+            last = &d->look;
+        }
+        for (i = 0; i < max_lights; ++i) {
+            if (!((d->lights ^ lights) & (1u << i))) continue;
+            if (d->lights & (1u << i)) glEnable((GLenum) (GL_LIGHT0 + i));
+            else                       glDisable((GLenum) (GL_LIGHT0 + i));
+            counts.states++;
+        }
+        lights = d->lights;
+
+        glLoadMatrixf(d->modelview);
+        drawMesh(it->first, it->second);
+    }
+    glPopMatrix();
+
+    for (i = 0; i < max_lights; ++i) {
+        if (!((on ^ lights) & (1u << i))) continue;
+        if (on & (1u << i)) glEnable((GLenum) (GL_LIGHT0 + i));
+        else                glDisable((GLenum) (GL_LIGHT0 + i));
+        counts.states++;
+    }
+    if (last) setLook(look);
+
+    drawList.clear();
+    recording = was;
+}
+
+// The state insert_shell() of gl::viewer puts in its display lists, then
+// one draw of the triangles, or only its record while the scene is walked.
+void arVrmlViewer::drawMesh(const object_t ref, const arVrmlMesh & m)
+{
+    const float   *base = 0;
+    const GLsizei  stride = AR_VRML_MESH_STRIDE * sizeof(float);
+    GLsizei        first = 0, count = m.count;
+
+    if (m.count == 0) return;
+
+    if (recording && look.texComponents == 0
+        && (!look.material || look.transparency == 0.0f)
+        && this->mode() == draw_mode) {
+        drawList.push_back(arVrmlDrawItem());
+        arVrmlDrawItem & d = drawList.back();
+        memcpy(d.modelview, &modelview_matrix_stack_.current[0][0], sizeof(d.modelview));
+        d.look = look;
+        d.lights = 0;
+        for (int i = 0; i < max_lights; ++i) {
+            if (light_info_[i].type != light_unused) d.lights |= 1u << i;
+        }
+        d.mesh = ref;
+        return;
+    }
+
+    this->begin_geometry();
+
+    glFrontFace((m.mask & mask_ccw) ? GL_CCW : GL_CW);
+    counts.states++;
+    if (!(m.mask & mask_solid)) { glDisable(GL_CULL_FACE); counts.states++; }
+    if (m.color && !(m.mask & mask_color_per_vertex)) { glShadeModel(GL_FLAT); counts.states++; }
+
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    if (m.buffer[0]) {
+        bindBuffer(GL_ARRAY_BUFFER, m.buffer[0]);
+        bindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.buffer[1]);
+        counts.states += 2;
+    } else {
+        base = &m.vertex[0];
+    }
+    glTexCoordPointer(2, GL_FLOAT, stride, base);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    if (m.color) {
+        glColorPointer(3, GL_FLOAT, stride, base + 2);
+        glEnableClientState(GL_COLOR_ARRAY);
+    }
+    glNormalPointer(GL_FLOAT, stride, base + 5);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glVertexPointer(3, GL_FLOAT, stride, base + 8);
+    glEnableClientState(GL_VERTEX_ARRAY);
+
+    // The simplest level made up to that of the instance.
+    for (int l = 0; l < lod && m.lod[l] > 0; ++l) {
+        first += count;
+        count = m.lod[l];
+    }
+    glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT,
+                   m.buffer[0]? (const GLvoid *)(first * sizeof(unsigned int)): &m.index[first]);
+    counts.draws++;
+    counts.triangles += count / 3;
+
+    if (m.buffer[0]) {
+        bindBuffer(GL_ARRAY_BUFFER, 0);
+        bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        counts.states += 2;
+    }
+    glPopClientAttrib();
+
+    this->end_geometry();
+}
+
+// A mesh in buffer objects counts for GL, as do the textures; the arrays a
+// mesh keeps, without buffer objects or to be moved in place, for memory.
+void arVrmlViewer::memoryUsed(size_t & gpu, size_t & cpu) const
+{
+    std::map<object_t, arVrmlMesh>::const_iterator               it;
+    std::map<texture_object_t, size_t>::const_iterator           tex;
+    std::map<object_t, arVrmlPickTree>::const_iterator           tree;
+    std::map<int, arVrmlPickList>::const_iterator                pl;
+
+    gpu = cpu = 0;
+    for (it = meshes.begin(); it != meshes.end(); ++it) {
+        const arVrmlMesh & m = it->second;
+        if (m.buffer[0]) gpu += m.bytes;
+        cpu += m.vertex.capacity() * sizeof(float)
+             + m.index.capacity() * sizeof(unsigned int)
+             + m.source.capacity() * sizeof(int)
+             + m.face.capacity() * sizeof(unsigned int)
+             + m.faceCorner.capacity() * sizeof(int);
+    }
+    for (tex = textureBytes.begin(); tex != textureBytes.end(); ++tex) {
+        gpu += tex->second;
+    }
+    for (tree = pickTrees.begin(); tree != pickTrees.end(); ++tree) {
+        cpu += tree->second.tri.capacity() * sizeof(float)
+             + tree->second.node.capacity() * sizeof(arVrmlPickNode);
+    }
+    for (pl = picks.begin(); pl != picks.end(); ++pl) {
+        cpu += pl->second.top.capacity() * sizeof(arVrmlPickNode)
+             + pl->second.order.capacity() * sizeof(int)
+             + pl->second.box.capacity() * sizeof(float);
+    }
+}
+
+// The small textures that do not repeat, as those of the balls and status
+// models, are packed into the cells of one atlas shared by all the viewers,
+// in rows as they come. A texture of the atlas is known by a texture name of
+// its own that is never bound; binding it binds the atlas, with the tile
+// mapped onto [0, 1] by the texture matrix after the TextureTransform of the
+// shape, so the models keep their texture coordinates. The cells have a
+// border repeating the edge of the image, so that linear filtering does not
+// reach the next tile. Display lists record the pixels of a texture upload,
+// so a tile is uploaded by flushAtlas() once the scene has been walked: it
+// shows from the draw after the one that made it.
+#define  AR_VRML_ATLAS_SIZE    1024
+#define  AR_VRML_ATLAS_TILE    128     // the longest side of an image packed
+#define  AR_VRML_ATLAS_BORDER  1
+
+static GLuint                   atlasTexture = 0;
+static bool                     atlasMade = false;
+static bool                     atlasOn = true;
+static int                      atlasRowX = 0, atlasRowY = 0, atlasRowH = 0;
+static std::map<viewer::texture_object_t, arVrmlAtlasTile>  atlasTiles;
+static std::vector<arVrmlAtlasTile>                         atlasFree;
+static std::map<viewer::texture_object_t, std::vector<unsigned char> > atlasPending;
+
+void arVrmlViewer::setAtlas(bool flag)
+{
+    atlasOn = flag;
+}
+
+// A free cell of the size of a cell for w by h, or a new one; false when the
+// atlas is full.
+static bool atlasCell(int w, int h, arVrmlAtlasTile & t)
+{
+    const int cw = w + 2 * AR_VRML_ATLAS_BORDER, ch = h + 2 * AR_VRML_ATLAS_BORDER;
+
+    t.w = w;
+    t.h = h;
+    for (size_t i = 0; i < atlasFree.size(); ++i) {
+        if (atlasFree[i].w == w && atlasFree[i].h == h) {
+            t.x = atlasFree[i].x;
+            t.y = atlasFree[i].y;
+            atlasFree.erase(atlasFree.begin() + i);
+            return true;
+        }
+    }
+    if (atlasRowX + cw > AR_VRML_ATLAS_SIZE) {
+        atlasRowY += atlasRowH;
+        atlasRowX = atlasRowH = 0;
+    }
+    if (atlasRowY + ch > AR_VRML_ATLAS_SIZE) return false;
+    t.x = atlasRowX;
+    t.y = atlasRowY;
+    atlasRowX += cw;
+    if (ch > atlasRowH) atlasRowH = ch;
+    return true;
+}
+
+// The pixels of the cell of t, RGBA, its border included.
+static void atlasQueue(viewer::texture_object_t ref, const arVrmlAtlasTile & t,
+                       size_t nc, const unsigned char *pixels)
+{
+    const int cw = t.w + 2 * AR_VRML_ATLAS_BORDER, ch = t.h + 2 * AR_VRML_ATLAS_BORDER;
+    std::vector<unsigned char> & cell = atlasPending[ref];
+
+    cell.resize(size_t(cw) * ch * 4);
+    for (int j = 0; j < ch; ++j) {
+        const int sj = std::min(std::max(j - AR_VRML_ATLAS_BORDER, 0), t.h - 1);
+        for (int i = 0; i < cw; ++i) {
+            const int si = std::min(std::max(i - AR_VRML_ATLAS_BORDER, 0), t.w - 1);
+            const unsigned char *p = pixels + (size_t(sj) * t.w + si) * nc;
+            unsigned char *q = &cell[(size_t(j) * cw + i) * 4];
+            switch (nc) {
+            case 1: q[0] = q[1] = q[2] = p[0]; q[3] = 255; break;
+            case 2: q[0] = q[1] = q[2] = p[0]; q[3] = p[1]; break;
+            case 3: q[0] = p[0]; q[1] = p[1]; q[2] = p[2]; q[3] = 255; break;
+            default: q[0] = p[0]; q[1] = p[1]; q[2] = p[2]; q[3] = p[3]; break;
+            }
+        }
+    }
+}
+
+static void atlasRelease(viewer::texture_object_t ref)
+{
+    std::map<viewer::texture_object_t, arVrmlAtlasTile>::iterator it = atlasTiles.find(ref);
+    GLuint name = GLuint(ref);
+
+    if (it == atlasTiles.end()) return;
+    atlasFree.push_back(it->second);
+    atlasTiles.erase(it);
+    atlasPending.erase(ref);
+    glDeleteTextures(1, &name);
+}
+
+void arVrmlViewer::flushAtlas()
+{
+    std::map<viewer::texture_object_t, std::vector<unsigned char> >::iterator it;
+
+    if (atlasPending.empty()) return;
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    if (!atlasMade) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, AR_VRML_ATLAS_SIZE, AR_VRML_ATLAS_SIZE, 0,
+                     GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        atlasMade = true;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (it = atlasPending.begin(); it != atlasPending.end(); ++it) {
+        const arVrmlAtlasTile & t = atlasTiles[it->first];
+        glTexSubImage2D(GL_TEXTURE_2D, 0, t.x, t.y,
+                        t.w + 2 * AR_VRML_ATLAS_BORDER, t.h + 2 * AR_VRML_ATLAS_BORDER,
+                        GL_RGBA, GL_UNSIGNED_BYTE, &it->second[0]);
+        counts.states++;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    atlasPending.clear();
+}
+
+// The TextureTransform of the shape, as gl::viewer sets it, for the tiles.
+void arVrmlViewer::set_texture_transform(const vec2f & center, const float rotation,
+                                         const vec2f & scale, const vec2f & translation)
+{
+    texCenter = center;
+    texRotation = rotation;
+    texScale = scale;
+    texTranslation = translation;
+    gl::viewer::set_texture_transform(center, rotation, scale, translation);
+}
+
+void arVrmlViewer::bindTile(const arVrmlAtlasTile & t, const size_t nc)
+{
+    const float inv = 1.0f / AR_VRML_ATLAS_SIZE;
+
+    if (this->blend && (nc == 2 || nc == 4)) glEnable(GL_BLEND);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture);
+    glMatrixMode(GL_TEXTURE);
+    glLoadIdentity();
+    glTranslatef((t.x + AR_VRML_ATLAS_BORDER) * inv, (t.y + AR_VRML_ATLAS_BORDER) * inv, 0.0f);
+    glScalef(t.w * inv, t.h * inv, 1.0f);
+    glTranslatef(-texCenter.x(), -texCenter.y(), 0.0f);
+    glScalef(texScale.x(), texScale.y(), 1.0f);
+    if (texRotation != 0.0f) glRotatef(GLfloat(texRotation * 180.0 / pi), 0.0f, 0.0f, 1.0f);
+    glTranslatef(texCenter.x(), texCenter.y(), 0.0f);
+    glTranslatef(texTranslation.x(), texTranslation.y(), 0.0f);
+    glMatrixMode(GL_MODELVIEW);
+    counts.states += 2;
+}
+
+// Counts the bytes of a texture kept as a texture object: those of the image,
+// which is not scaled up, and a third more for its mipmaps.
+viewer::texture_object_t arVrmlViewer::insert_texture(const size_t w, const size_t h,
+                                                      const size_t nc,
+                                                      const bool repeat_s,
+                                                      const bool repeat_t,
+                                                      const unsigned char *pixels,
+                                                      const bool retainHint)
+{
+    if (atlasOn && retainHint && !repeat_s && !repeat_t && !this->select_mode
+        && w > 0 && h > 0 && nc >= 1 && nc <= 4
+        && w <= AR_VRML_ATLAS_TILE && h <= AR_VRML_ATLAS_TILE) {
+        arVrmlAtlasTile t;
+        GLuint name;
+
+        if (atlasTexture == 0) glGenTextures(1, &atlasTexture);
+        if (atlasCell(int(w), int(h), t)) {
+            glGenTextures(1, &name);
+            atlasTiles[texture_object_t(name)] = t;
+            atlasQueue(texture_object_t(name), t, nc, pixels);
+            textureBytes[texture_object_t(name)] = w * h * 4;
+            bindTile(t, nc);
+            return texture_object_t(name);
+        }
+    }
+
+    texture_object_t ref = gl::viewer::insert_texture(w, h, nc, repeat_s, repeat_t,
+                                                      pixels, retainHint);
+    if (ref) textureBytes[ref] = w * h * nc + w * h * nc / 3;
+    return ref;
+}
+
+// A frame of a movie goes through the next of two pixel buffers: the call
+// returns once the frame is copied, and the driver fills the texture from the
+// buffer without the frame waiting for the transfer.
+void arVrmlViewer::update_texture(const texture_object_t ref,
+                                  const size_t w, const size_t h, const size_t nc,
+                                  const unsigned char *pixels)
+{
+    static const GLenum fmt[] = { GL_LUMINANCE, GL_LUMINANCE_ALPHA, GL_RGB, GL_RGBA };
+    std::map<texture_object_t, arVrmlAtlasTile>::const_iterator tile = atlasTiles.find(ref);
+
+    if (tile != atlasTiles.end()) {
+        if (int(w) == tile->second.w && int(h) == tile->second.h) atlasQueue(ref, tile->second, nc, pixels);
+        return;
+    }
+    if (!ref || !pixelBuffersCheck()) {
+        gl::viewer::update_texture(ref, w, h, nc, pixels);
+        return;
+    }
+    if (!unpackBuffer[0]) genBuffers(2, unpackBuffer);
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuffer[unpackNext]);
+    bufferData(GL_PIXEL_UNPACK_BUFFER, ptrdiff_t(w * h * nc), pixels, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_2D, GLuint(ref));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, GLsizei(w), GLsizei(h),
+                    fmt[nc - 1], GL_UNSIGNED_BYTE, 0);
+    bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    unpackNext = 1 - unpackNext;
+}
+
+void arVrmlViewer::remove_texture_object(const texture_object_t ref)
+{
+    textureBytes.erase(ref);
+    if (atlasTiles.count(ref)) {
+        atlasRelease(ref);
+        return;
+    }
+    gl::viewer::remove_texture_object(ref);
+}
+
+void arVrmlViewer::insert_texture_reference(const texture_object_t ref, const size_t components)
+{
+    std::map<texture_object_t, arVrmlAtlasTile>::const_iterator tile = atlasTiles.find(ref);
+
+    if (tile != atlasTiles.end()) {
+        bindTile(tile->second, components);
+        return;
+    }
+    counts.states++;
+    gl::viewer::insert_texture_reference(ref, components);
+}
+
+viewer::object_t arVrmlViewer::insert_reference(const object_t existing_object)
+{
+    std::map<object_t, arVrmlMesh>::const_iterator it = meshes.find(existing_object);
+
+    pickRecord(existing_object);
+    if (it == meshes.end()) {
+        counts.draws++;
+        return gl::viewer::insert_reference(existing_object);
+    }
+    drawMesh(it->first, it->second);
+    return 0;
+}
+
+void arVrmlViewer::remove_object(const object_t ref)
+{
+    std::map<object_t, arVrmlMesh>::iterator it = meshes.find(ref);
+
+    if (it != meshes.end()) {
+        flushDraws();
+        if (it->second.buffer[0]) {
+            if (retired.buffer[0]) deleteBuffers(2, retired.buffer);
+            retired.buffer[0] = it->second.buffer[0];
+            retired.buffer[1] = it->second.buffer[1];
+            retired.count = it->second.count;
+            memcpy(retired.lod, it->second.lod, sizeof(retired.lod));
+            retired.mask = it->second.mask;
+            retired.color = it->second.color;
+            retired.dynamic = it->second.dynamic;
+            retired.vertex.swap(it->second.vertex);
+            retired.index.swap(it->second.index);
+        }
+        meshes.erase(it);
+    }
+    pickTrees.erase(ref);
+    gl::viewer::remove_object(ref);
+}
+
+// Picking without select mode. The geometry drawn under a sensitive node is
+// kept as triangles in a bounding volume hierarchy of its own, and each draw
+// lists where it put them; an actuator is tested against that list, each
+// hierarchy in the object coordinates of its draw.
+#define  AR_VRML_PICK_LEAF     4
+#define  AR_VRML_PICK_SLICES   16
+#define  AR_VRML_PICK_STACKS   8
+#define  AR_VRML_PICK_DEPTH    64
+#define  AR_VRML_PICK_REFITS   32
+#define  AR_VRML_PI            3.14159265358979323846
+
+void arVrmlViewer::set_sensitive(node * const object)
+{
+    if (object)                  pickStack.push_back(object);
+    else if (!pickStack.empty()) pickStack.pop_back();
+    gl::viewer::set_sensitive(object);
+}
+
+static void pickTriangle(std::vector<float> & tri, const vec3f & a, const vec3f & b, const vec3f & c)
+{
+    const vec3f *v[3] = { &a, &b, &c };
+
+    for (int i = 0; i < 3; ++i) {
+        tri.push_back((*v[i])[0]);
+        tri.push_back((*v[i])[1]);
+        tri.push_back((*v[i])[2]);
+    }
+}
+
+// The triangles of a mesh, from its arrays of vertices and indices.
+static void pickMeshTriangles(const arVrmlMesh & m, std::vector<float> & tri)
+{
+    tri.reserve(size_t(m.count) * 3);
+    for (size_t i = 0; i + 2 < size_t(m.count); i += 3) {
+        for (size_t j = 0; j < 3; ++j) {
+            const float *v = &m.vertex[m.index[i+j] * AR_VRML_MESH_STRIDE + 8];
+            tri.push_back(v[0]);
+            tri.push_back(v[1]);
+            tri.push_back(v[2]);
+        }
+    }
+}
+
+static void pickBox(std::vector<float> & tri, const vec3f & size)
+{
+    static const int face[6][4] = { {0, 1, 3, 2}, {4, 6, 7, 5}, {0, 4, 5, 1},
+                                    {2, 3, 7, 6}, {0, 2, 6, 4}, {1, 5, 7, 3} };
+    vec3f corner[8];
+
+    for (int i = 0; i < 8; ++i) {
+        corner[i] = vec3f((i & 4)? 0.5f * size[0]: -0.5f * size[0],
+                          (i & 2)? 0.5f * size[1]: -0.5f * size[1],
+                          (i & 1)? 0.5f * size[2]: -0.5f * size[2]);
+    }
+    for (int i = 0; i < 6; ++i) {
+        pickTriangle(tri, corner[face[i][0]], corner[face[i][1]], corner[face[i][2]]);
+        pickTriangle(tri, corner[face[i][0]], corner[face[i][2]], corner[face[i][3]]);
+    }
+}
+
+// The sides and caps of a cylinder or a cone along y, as gl::viewer draws
+// them; a cone has no top radius.
+static void pickRound(std::vector<float> & tri, float height, float bottomRadius,
+                      float topRadius, bool bottom, bool side, bool top)
+{
+    const float y0 = -0.5f * height, y1 = 0.5f * height;
+
+    for (int i = 0; i < AR_VRML_PICK_SLICES; ++i) {
+        const float a0 = float(2.0 * AR_VRML_PI * i / AR_VRML_PICK_SLICES);
+        const float a1 = float(2.0 * AR_VRML_PI * (i + 1) / AR_VRML_PICK_SLICES);
+        const vec3f b0(bottomRadius * float(sin(a0)), y0, bottomRadius * float(cos(a0)));
+        const vec3f b1(bottomRadius * float(sin(a1)), y0, bottomRadius * float(cos(a1)));
+        const vec3f t0(topRadius * float(sin(a0)), y1, topRadius * float(cos(a0)));
+        const vec3f t1(topRadius * float(sin(a1)), y1, topRadius * float(cos(a1)));
+
+        if (side) {
+            pickTriangle(tri, b0, b1, t1);
+            if (topRadius > 0.0f) pickTriangle(tri, b0, t1, t0);
+        }
+        if (bottom) pickTriangle(tri, vec3f(0.0f, y0, 0.0f), b1, b0);
+        if (top && topRadius > 0.0f) pickTriangle(tri, vec3f(0.0f, y1, 0.0f), t0, t1);
+    }
+}
+
+static void pickSphere(std::vector<float> & tri, float radius)
+{
+    vec3f p[AR_VRML_PICK_STACKS + 1][AR_VRML_PICK_SLICES + 1];
+
+    for (int j = 0; j <= AR_VRML_PICK_STACKS; ++j) {
+        const double phi = AR_VRML_PI * j / AR_VRML_PICK_STACKS - 0.5 * AR_VRML_PI;
+        for (int i = 0; i <= AR_VRML_PICK_SLICES; ++i) {
+            const double a = 2.0 * AR_VRML_PI * i / AR_VRML_PICK_SLICES;
+            p[j][i] = vec3f(float(radius * cos(phi) * sin(a)), float(radius * sin(phi)),
+                            float(radius * cos(phi) * cos(a)));
+        }
+    }
+    for (int j = 0; j < AR_VRML_PICK_STACKS; ++j) {
+        for (int i = 0; i < AR_VRML_PICK_SLICES; ++i) {
+            pickTriangle(tri, p[j][i], p[j][i+1], p[j+1][i+1]);
+            pickTriangle(tri, p[j][i], p[j+1][i+1], p[j+1][i]);
+        }
+    }
+}
+
+// Orders triangles by the centroid on an axis.
+struct arVrmlPickLess {
+    const float *centroid;
+    int          axis;
+
+    bool operator()(int a, int b) const { return centroid[a*3+axis] < centroid[b*3+axis]; }
+};
+
+// Bounds the triangles order[first, first + count) of node n, then splits
+// them at the median of their centroids on the longest axis of those, down
+// to leaves of a few triangles.
+static void pickSplit(std::vector<arVrmlPickNode> & node, std::vector<int> & order,
+                      const std::vector<float> & tri, const std::vector<float> & centroid,
+                      size_t n, int first, int count)
+{
+    float  clo[3], chi[3];
+    int    i, j, k, axis, child, half;
+
+    for (k = 0; k < 3; ++k) {
+        node[n].lo[k] = clo[k] = FLT_MAX;
+        node[n].hi[k] = chi[k] = -FLT_MAX;
+    }
+    for (i = first; i < first + count; ++i) {
+        const float *v = &tri[order[i] * 9];
+        for (j = 0; j < 9; ++j) {
+            if (v[j] < node[n].lo[j%3]) node[n].lo[j%3] = v[j];
+            if (v[j] > node[n].hi[j%3]) node[n].hi[j%3] = v[j];
+        }
+        for (k = 0; k < 3; ++k) {
+            if (centroid[order[i]*3+k] < clo[k]) clo[k] = centroid[order[i]*3+k];
+            if (centroid[order[i]*3+k] > chi[k]) chi[k] = centroid[order[i]*3+k];
+        }
+    }
+    if (count <= AR_VRML_PICK_LEAF) {
+        node[n].first = first;
+        node[n].count = count;
+        return;
+    }
+
+    axis = 0;
+    for (k = 1; k < 3; ++k) {
+        if (chi[k] - clo[k] > chi[axis] - clo[axis]) axis = k;
+    }
+    arVrmlPickLess less = { &centroid[0], axis };
+    half = count / 2;
+    std::nth_element(order.begin() + first, order.begin() + first + half,
+                     order.begin() + first + count, less);
+
+    child = int(node.size());
+    node.resize(node.size() + 2);
+    node[n].first = child;
+    node[n].count = 0;
+    pickSplit(node, order, tri, centroid, child, first, half);
+    pickSplit(node, order, tri, centroid, child + 1, first + half, count - half);
+}
+
+void arVrmlViewer::pickBuild(const object_t ref, std::vector<float> & tri)
+{
+    const int           n = int(tri.size() / 9);
+    std::vector<float>  centroid(n * 3);
+    std::vector<int>    order(n);
+    arVrmlPickTree    & t = pickTrees[ref];
+    int                 i, k;
+
+    t.stale = false;
+    t.tri.clear();
+    t.node.clear();
+    if (n == 0) return;
+
+    for (i = 0; i < n; ++i) {
+        order[i] = i;
+        for (k = 0; k < 3; ++k) {
+            centroid[i*3+k] = (tri[i*9+k] + tri[i*9+3+k] + tri[i*9+6+k]) / 3.0f;
+        }
+    }
+    t.node.resize(1);
+    pickSplit(t.node, order, tri, centroid, 0, 0, n);
+
+    t.tri.reserve(tri.size());
+    for (i = 0; i < n; ++i) {
+        t.tri.insert(t.tri.end(), tri.begin() + order[i] * 9, tri.begin() + order[i] * 9 + 9);
+    }
+}
+
+// The hierarchy of a mesh drawn under a sensitive node, made before
+// uploadMesh() lets go of its arrays.
+void arVrmlViewer::pickMesh(const object_t ref, const arVrmlMesh & m)
+{
+    std::vector<float> tri;
+
+    if (pickStack.empty()) return;
+    pickMeshTriangles(m, tri);
+    pickBuild(ref, tri);
+}
+
+// Lists a pickable geometry where the traversal draws it.
+void arVrmlViewer::pickRecord(const object_t ref)
+{
+    if (!pickList || pickStack.empty() || pickList->views.empty()) return;
+    if (pickTrees.find(ref) == pickTrees.end()) return;
+
+    pickList->items.push_back(arVrmlPickItem());
+    arVrmlPickItem & item = pickList->items.back();
+    item.modelview = modelview_matrix_stack_.current;
+    item.sensitive.reset(pickStack.back());
+    item.ref = ref;
+    item.view = int(pickList->views.size()) - 1;
+}
+
+// The hierarchy of a geometry, made again once the points of its mesh moved.
+const arVrmlPickTree * arVrmlViewer::pickTree(const object_t ref)
+{
+    std::map<object_t, arVrmlPickTree>::iterator t = pickTrees.find(ref);
+
+    if (t == pickTrees.end()) return NULL;
+    if (t->second.stale) {
+        std::map<object_t, arVrmlMesh>::const_iterator it = meshes.find(ref);
+        if (it != meshes.end() && !it->second.vertex.empty()) {
+            std::vector<float> tri;
+            pickMeshTriangles(it->second, tri);
+            pickBuild(ref, tri);
+        } else {
+            t->second.stale = false;
+        }
+    }
+    return &t->second;
+}
+
+// The hierarchy over the items of a pick list. A draw leaving as many items
+// as the last, as an animation does, moves their boxes but keeps the shape
+// of the hierarchy, so it is only refitted, from the leaves up as children
+// come after their parent; it is made again when the items change, and
+// every AR_VRML_PICK_REFITS refits, as the boxes of the refitted nodes grow.
+void arVrmlViewer::pickTop(arVrmlPickList & pl)
+{
+    const int  n = int(pl.items.size());
+    int        i, j, k;
+
+    if (!pl.topStale) return;
+    pl.topStale = false;
+
+    pl.box.resize(n * 6);
+    for (i = 0; i < n; ++i) {
+        float *lo = &pl.box[i * 6], *hi = lo + 3;
+        const arVrmlPickTree *t = pickTree(pl.items[i].ref);
+        for (k = 0; k < 3; ++k) {
+            lo[k] = FLT_MAX;
+            hi[k] = -FLT_MAX;
+        }
+        if (!t || t->node.empty()) continue;
+        for (j = 0; j < 8; ++j) {
+            const arVrmlPickNode & r = t->node[0];
+            const vec3f c = vec3f((j & 1)? r.hi[0]: r.lo[0],
+                                  (j & 2)? r.hi[1]: r.lo[1],
+                                  (j & 4)? r.hi[2]: r.lo[2]) * pl.items[i].modelview;
+            for (k = 0; k < 3; ++k) {
+                if (c[k] < lo[k]) lo[k] = c[k];
+                if (c[k] > hi[k]) hi[k] = c[k];
+            }
+        }
+    }
+
+    if (n > 0 && int(pl.order.size()) == n && pl.refits < AR_VRML_PICK_REFITS) {
+        pl.refits++;
+        for (i = int(pl.top.size()) - 1; i >= 0; --i) {
+            arVrmlPickNode & node = pl.top[i];
+            for (k = 0; k < 3; ++k) {
+                node.lo[k] = FLT_MAX;
+                node.hi[k] = -FLT_MAX;
+            }
+            for (j = 0; j < (node.count? node.count: 2); ++j) {
+                const float *lo = node.count? &pl.box[pl.order[node.first + j] * 6]: pl.top[node.first + j].lo;
+                const float *hi = node.count? lo + 3: pl.top[node.first + j].hi;
+                for (k = 0; k < 3; ++k) {
+                    if (lo[k] < node.lo[k]) node.lo[k] = lo[k];
+                    if (hi[k] > node.hi[k]) node.hi[k] = hi[k];
+                }
+            }
+        }
+        return;
+    }
+
+    // Each box as a triangle of its two corners, for pickSplit().
+    std::vector<float> tri(n * 9);
+    std::vector<float> centroid(n * 3);
+    pl.refits = 0;
+    pl.order.resize(n);
+    pl.top.clear();
+    if (n == 0) return;
+    for (i = 0; i < n; ++i) {
+        pl.order[i] = i;
+        for (k = 0; k < 3; ++k) {
+            tri[i*9+k] = tri[i*9+6+k] = pl.box[i*6+k];
+            tri[i*9+3+k] = pl.box[i*6+3+k];
+            centroid[i*3+k] = (pl.box[i*6+k] + pl.box[i*6+3+k]) * 0.5f;
+        }
+    }
+    pl.top.resize(1);
+    pickSplit(pl.top, pl.order, tri, centroid, 0, 0, n);
+}
+
+viewer::object_t arVrmlViewer::insert_box(const vec3f & size)
+{
+    const object_t ref = gl::viewer::insert_box(size);
+
+    if (ref && !pickStack.empty()) {
+        std::vector<float> tri;
+        pickBox(tri, size);
+        pickBuild(ref, tri);
+    }
+    pickRecord(ref);
+    return ref;
+}
+
+viewer::object_t arVrmlViewer::insert_cone(const float height, const float radius,
+                                           const bool bottom, const bool side)
+{
+    const object_t ref = gl::viewer::insert_cone(height, radius, bottom, side);
+
+    if (ref && !pickStack.empty()) {
+        std::vector<float> tri;
+        pickRound(tri, height, radius, 0.0f, bottom, side, false);
+        pickBuild(ref, tri);
+    }
+    pickRecord(ref);
+    return ref;
+}
+
+viewer::object_t arVrmlViewer::insert_cylinder(const float height, const float radius,
+                                               const bool bottom, const bool side,
+                                               const bool top)
+{
+    const object_t ref = gl::viewer::insert_cylinder(height, radius, bottom, side, top);
+
+    if (ref && !pickStack.empty()) {
+        std::vector<float> tri;
+        pickRound(tri, height, radius, radius, bottom, side, top);
+        pickBuild(ref, tri);
+    }
+    pickRecord(ref);
+    return ref;
+}
+
+viewer::object_t arVrmlViewer::insert_sphere(const float radius)
+{
+    const object_t ref = gl::viewer::insert_sphere(radius);
+
+    if (ref && !pickStack.empty()) {
+        std::vector<float> tri;
+        pickSphere(tri, radius);
+        pickBuild(ref, tri);
+    }
+    pickRecord(ref);
+    return ref;
+}
+
+// Whether a ray enters a box before best.
+static bool pickRayBox(const float lo[3], const float hi[3],
+                       const vec3f & o, const vec3f & d, float best)
+{
+    float t0 = 0.0f, t1 = best;
+
+    for (int i = 0; i < 3; ++i) {
+        if (d[i] == 0.0f) {
+            if (o[i] < lo[i] || o[i] > hi[i]) return false;
+            continue;
+        }
+        float a = (lo[i] - o[i]) / d[i];
+        float b = (hi[i] - o[i]) / d[i];
+        if (a > b) std::swap(a, b);
+        if (a > t0) t0 = a;
+        if (b < t1) t1 = b;
+        if (t0 > t1) return false;
+    }
+    return true;
+}
+
+// Where along a ray it crosses a triangle, from either side as the faces are
+// not culled for the pick, after Moller and Trumbore.
+static bool pickRayTriangle(const float *v, const vec3f & o, const vec3f & d, float & t)
+{
+    const vec3f a(v[0], v[1], v[2]);
+    const vec3f e1 = vec3f(v[3], v[4], v[5]) - a;
+    const vec3f e2 = vec3f(v[6], v[7], v[8]) - a;
+    const vec3f p = d * e2;
+    const float det = e1.dot(p);
+
+    if (det == 0.0f) return false;
+    const vec3f s = o - a;
+    const float u = s.dot(p) / det;
+    if (u < 0.0f || u > 1.0f) return false;
+    const vec3f q = s * e1;
+    const float w = d.dot(q) / det;
+    if (w < 0.0f || u + w > 1.0f) return false;
+    t = e2.dot(q) / det;
+    return t >= 0.0f;
+}
+
+static bool pickRayTree(const arVrmlPickTree & tree, const vec3f & o, const vec3f & d, float & best)
+{
+    int    stack[AR_VRML_PICK_DEPTH], top = 0;
+    bool   hit = false;
+    float  t;
+
+    stack[top++] = 0;
+    while (top > 0) {
+        const arVrmlPickNode & n = tree.node[stack[--top]];
+        if (!pickRayBox(n.lo, n.hi, o, d, best)) continue;
+        if (n.count == 0) {
+            stack[top++] = n.first;
+            stack[top++] = n.first + 1;
+            continue;
+        }
+        for (int i = n.first; i < n.first + n.count; ++i) {
+            if (pickRayTriangle(&tree.tri[i * 9], o, d, t) && t < best) {
+                best = t;
+                hit = true;
+            }
+        }
+    }
+    return hit;
+}
+
+// The point of a triangle nearest p, after Ericson.
+static vec3f pickNearest(const vec3f & p, const vec3f & a, const vec3f & b, const vec3f & c)
+{
+    const vec3f ab = b - a, ac = c - a;
+    const float d1 = ab.dot(p - a), d2 = ac.dot(p - a);
+    if (d1 <= 0.0f && d2 <= 0.0f) return a;
+
+    const float d3 = ab.dot(p - b), d4 = ac.dot(p - b);
+    if (d3 >= 0.0f && d4 <= d3) return b;
+
+    const float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+
+    const float d5 = ab.dot(p - c), d6 = ac.dot(p - c);
+    if (d6 >= 0.0f && d5 <= d6) return c;
+
+    const float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+
+    const float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+    return a + ab * (vb / (va + vb + vc)) + ac * (vc / (va + vb + vc));
+}
+
+// The nearest point of the triangles to p within best, both in eye
+// coordinates; the boxes are tested in object coordinates, against the ball
+// of best times scale, at least the largest stretch of the inverse transform.
+static bool pickPointTree(const arVrmlPickTree & tree, const mat4f & modelview,
+                          const vec3f & local, float scale, const vec3f & p,
+                          float & best, vec3f & nearest)
+{
+    int    stack[AR_VRML_PICK_DEPTH], top = 0;
+    bool   hit = false;
+
+    stack[top++] = 0;
+    while (top > 0) {
+        const arVrmlPickNode & n = tree.node[stack[--top]];
+        const float r = best * scale;
+        float d2 = 0.0f;
+
+        for (int k = 0; k < 3; ++k) {
+            if (local[k] < n.lo[k])      d2 += (n.lo[k] - local[k]) * (n.lo[k] - local[k]);
+            else if (local[k] > n.hi[k]) d2 += (local[k] - n.hi[k]) * (local[k] - n.hi[k]);
+        }
+        if (d2 > r * r) continue;
+        if (n.count == 0) {
+            stack[top++] = n.first;
+            stack[top++] = n.first + 1;
+            continue;
+        }
+        for (int i = n.first; i < n.first + n.count; ++i) {
+            vec3f t[3];
+            modelview.transform_points(reinterpret_cast<const vec3f *>(&tree.tri[i * 9]), 3, t);
+            const vec3f q = pickNearest(p, t[0], t[1], t[2]);
+            const float d = (q - p).length();
+            if (d < best) {
+                best = d;
+                nearest = q;
+                hit = true;
+            }
+        }
+    }
+    return hit;
+}
+
+bool arVrmlViewer::pickRay(const int tag, const vec3f & origin, const vec3f & direction,
+                           arVrmlPickHit & hit)
+{
+    std::map<int, arVrmlPickList>::iterator      pl = picks.find(tag);
+    int                                          stack[AR_VRML_PICK_DEPTH], top = 0;
+    float                                        best = FLT_MAX;
+    bool                                         found = false;
+
+    if (pl == picks.end() || direction.length() == 0.0f) return false;
+    pickTop(pl->second);
+    if (pl->second.top.empty()) return false;
+
+    // The parameter of the ray is the same in the coordinates of each object,
+    // and in the eye coordinates of the boxes of the items.
+    stack[top++] = 0;
+    while (top > 0) {
+        const arVrmlPickNode & n = pl->second.top[stack[--top]];
+        if (!pickRayBox(n.lo, n.hi, origin, direction, best)) continue;
+        if (n.count == 0) {
+            stack[top++] = n.first;
+            stack[top++] = n.first + 1;
+            continue;
+        }
+        for (int i = n.first; i < n.first + n.count; ++i) {
+            const arVrmlPickItem & it = pl->second.items[pl->second.order[i]];
+            const arVrmlPickTree *t = pickTree(it.ref);
+            if (!t || t->node.empty()) continue;
+
+            const mat4f inverse = it.modelview.inverse();
+            const vec3f o = origin * inverse;
+            const vec3f d = (origin + direction) * inverse - o;
+            if (pickRayTree(*t, o, d, best)) {
+                hit.sensitive = it.sensitive;
+                hit.view = it.view;
+                found = true;
+            }
+        }
+    }
+    if (!found) return false;
+
+    hit.point = origin + direction * best;
+    hit.distance = best * direction.length();
+    return true;
+}
+
+bool arVrmlViewer::pickPoint(const int tag, const vec3f & point, const float radius,
+                             arVrmlPickHit & hit)
+{
+    std::map<int, arVrmlPickList>::iterator      pl = picks.find(tag);
+    int                                          stack[AR_VRML_PICK_DEPTH], top = 0;
+    float                                        best = radius;
+    bool                                         found = false;
+
+    if (pl == picks.end() || !(radius > 0.0f)) return false;
+    pickTop(pl->second);
+    if (pl->second.top.empty()) return false;
+
+    stack[top++] = 0;
+    while (top > 0) {
+        const arVrmlPickNode & n = pl->second.top[stack[--top]];
+        float d2 = 0.0f;
+
+        for (int k = 0; k < 3; ++k) {
+            if (point[k] < n.lo[k])      d2 += (n.lo[k] - point[k]) * (n.lo[k] - point[k]);
+            else if (point[k] > n.hi[k]) d2 += (point[k] - n.hi[k]) * (point[k] - n.hi[k]);
+        }
+        if (d2 > best * best) continue;
+        if (n.count == 0) {
+            stack[top++] = n.first;
+            stack[top++] = n.first + 1;
+            continue;
+        }
+        for (int l = n.first; l < n.first + n.count; ++l) {
+            const arVrmlPickItem & it = pl->second.items[pl->second.order[l]];
+            const arVrmlPickTree *t = pickTree(it.ref);
+            if (!t || t->node.empty()) continue;
+
+            const mat4f inverse = it.modelview.inverse();
+            float scale = 0.0f;
+            for (int i = 0; i < 3; ++i) {
+                for (int j = 0; j < 3; ++j) scale += inverse[i][j] * inverse[i][j];
+            }
+            if (pickPointTree(*t, it.modelview, point * inverse, float(sqrt(scale)),
+                              point, best, hit.point)) {
+                hit.sensitive = it.sensitive;
+                hit.view = it.view;
+                found = true;
+            }
+        }
+    }
+    if (!found) return false;
+
+    hit.distance = best;
+    return true;
+}
+
+// A point in eye coordinates in those a sensor takes, of the viewpoint under
+// one of the transforms of the last draw.
+static void pickSensorPoint(const arVrmlPickList & pl, size_t view, const vec3f & eye, double p[3])
+{
+    vec3f v = eye;
+
+    if (!pl.views.empty()) v *= pl.views[view < pl.views.size()? view: pl.views.size() - 1];
+    p[0] = v[0];
+    p[1] = v[1];
+    p[2] = v[2];
+}
+
+// The transitions of checkSensitive(): pressed over a sensitive node the
+// actuator makes it active, and drags it until released; moved without it is
+// over one node at a time. As the mouse keeps the depth it pressed at, a ray
+// keeps the distance and a point the offset it grabbed the node with.
+bool arVrmlViewer::pointer(arVrmlPickList & pl, const arVrmlPickHit * hit,
+                           const vec3f & origin, const vec3f & direction,
+                           const bool ray, const bool press)
+{
+    const double    now = browser::current_time();
+    const node_ptr  selected = hit? hit->sensitive: node_ptr();
+    const bool      pressed = press && !pl.pressed;
+    double          p[3] = { 0.0, 0.0, 0.0 };
+
+    pl.pressed = press;
+
+    if (pl.active) {
+        const bool isOver = selected.get() == pl.active.get();
+        const vec3f eye = ray? origin + direction.normalize() * pl.grabDistance: origin + pl.grabOffset;
+
+        pickSensorPoint(pl, pl.activeView, eye, p);
+        if (press) {
+            this->browser.sensitive_event(pl.active.get(), now, isOver, true, p);
+        } else {
+            this->browser.sensitive_event(pl.active.get(), now, isOver, false, p);
+            pl.over = isOver? pl.active: node_ptr();
+            pl.active.reset();
+        }
+        return true;
+    }
+
+    if (hit) pickSensorPoint(pl, hit->view, hit->point, p);
+
+    if (pressed && selected) {
+        if (pl.over && pl.over.get() != selected.get()) {
+            this->browser.sensitive_event(pl.over.get(), now, false, false, p);
+        }
+        pl.over = selected;
+        pl.active = selected;
+        pl.activeView = hit->view;
+        pl.grabDistance = (hit->point - origin).length();
+        pl.grabOffset = hit->point - origin;
+        this->browser.sensitive_event(selected.get(), now, true, true, p);
+        return true;
+    }
+
+    if (pl.over && pl.over.get() != selected.get()) {
+        this->browser.sensitive_event(pl.over.get(), now, false, false, p);
+    }
+    pl.over = selected;
+    if (selected) this->browser.sensitive_event(selected.get(), now, true, false, p);
+    return selected;
+}
+
+bool arVrmlViewer::pointerRay(const int tag, const vec3f & origin, const vec3f & direction,
+                              const bool press)
+{
+    std::map<int, arVrmlPickList>::iterator pl = picks.find(tag);
+    arVrmlPickHit hit;
+
+    if (pl == picks.end()) return false;
+    const bool over = pickRay(tag, origin, direction, hit);
+    return pointer(pl->second, over? &hit: NULL, origin, direction, true, press);
+}
+
+bool arVrmlViewer::pointerPoint(const int tag, const vec3f & point, const float radius,
+                                const bool press)
+{
+    std::map<int, arVrmlPickList>::iterator pl = picks.find(tag);
+    arVrmlPickHit hit;
+
+    if (pl == picks.end()) return false;
+    const bool over = pickPoint(tag, point, radius, hit);
+    return pointer(pl->second, over? &hit: NULL, point, vec3f(), false, press);
+}
+
+void arVrmlViewer::pickForget(const int tag)
+{
+    picks.erase(tag);
 }
@@ -6,6 +6,135 @@
 #include <openvrml/browser.h>
 #include <openvrml/gl/viewer.h>
 #include <openvrml/bounding_volume.h>
+#include <openvrml/frustum.h>
+#include <map>
+#include <vector>
+#include <utility>
+#include <stdio.h>
+
+// The GL work of the draws of all the viewers, see arVrmlGetStats().
+struct arVrmlCounts {
+    long                        draws;          // glDrawElements() and glCallList()
+    long                        triangles;      // of the meshes drawn
+    long                        states;         // made outside the display lists
+};
+
+// The levels of detail of a mesh: its triangles, then as many as two
+// simpler sets of them, drawn as the scene is further from the camera.
+#define  AR_VRML_LOD_LEVELS    3
+
+// An IndexedFaceSet tessellated once into triangles of interleaved vertices,
+// (s t, r g b, nx ny nz, x y z), drawn from buffer objects when the GL has them.
+// The indices of the simpler levels of detail follow those of the triangles.
+struct arVrmlMesh {
+    std::vector<float>          vertex;
+    std::vector<unsigned int>   index;
+    unsigned int                buffer[2];      // vertices, indices
+    int                         count;
+    int                         lod[AR_VRML_LOD_LEVELS - 1];    // indices of each simpler level, 0 past the last
+    unsigned int                mask;
+    bool                        color;
+    bool                        dynamic;        // keeps vertex and index
+    bool                        texGen;
+    size_t                      bytes;          // of vertex and index as built
+    // For update_shell_coord(): the point of each vertex and, for generated
+    // normals, the face of each vertex and the first three points of each face.
+    std::vector<int>            source;
+    std::vector<unsigned int>   face;
+    std::vector<int>            faceCorner;
+};
+
+// The key of a mesh in the cache, two hashes of the fields it was made from.
+typedef std::pair<unsigned int, unsigned int> arVrmlMeshKey;
+
+// The appearance a shape sets before its geometry, kept as the arguments of
+// the calls that set it so that a recorded draw can set it again.
+struct arVrmlLook {
+    bool                        material;       // set_material(), else set_color()
+    bool                        lighting;
+    float                       ambient;
+    openvrml::color             diffuse;        // the color of set_color() too
+    openvrml::color             emissive;
+    float                       shininess;
+    openvrml::color             specular;
+    float                       transparency;
+    float                       alpha;
+    size_t                      texComponents;
+    bool                        geometryColor;
+};
+
+// A mesh the traversal has reached, drawn once it is over.
+struct arVrmlDrawItem {
+    float                       modelview[16];
+    arVrmlLook                  look;
+    unsigned int                lights;         // mask of the lights on
+    openvrml::viewer::object_t  mesh;
+};
+
+// A texture packed into the atlas of the small textures: its cell, the
+// border around the image included, and the size of the image.
+struct arVrmlAtlasTile {
+    int                         x, y;
+    int                         w, h;
+};
+
+// A node of the bounding volume hierarchy of a pickable geometry: the box of
+// its triangles, and the range of them of a leaf or the first of its two
+// children, next to each other, of an inner node.
+struct arVrmlPickNode {
+    float                       lo[3];
+    float                       hi[3];
+    int                         first;
+    int                         count;          // 0 for an inner node
+};
+
+// The triangles of a geometry drawn under a sensitive node, nine floats each
+// in the order of the leaves of its hierarchy, in object coordinates.
+struct arVrmlPickTree {
+    std::vector<float>          tri;
+    std::vector<arVrmlPickNode> node;
+    bool                        stale;          // the mesh moved since
+};
+
+// A pickable geometry drawn by the last draw of an instance, with the
+// sensitive node it was under and the transform of the draw it is from.
+struct arVrmlPickItem {
+    openvrml::mat4f             modelview;
+    openvrml::node_ptr          sensitive;
+    openvrml::viewer::object_t  ref;
+    int                         view;
+};
+
+// What the actuator is over: the sensitive node, the point in eye
+// coordinates and its distance along the ray or from the point.
+struct arVrmlPickHit {
+    openvrml::node_ptr          sensitive;
+    openvrml::vec3f             point;
+    float                       distance;
+    int                         view;
+};
+
+// The pickable geometry of the last draw of an instance, the eye to sensor
+// coordinates of each of its transforms, and the actuator the instance has.
+// The nodes are held, a world replaced in between leaves them to the list.
+// The items are bounded in turn by a hierarchy of their boxes in eye
+// coordinates, its leaves ranges of order, made again or refitted on the
+// first pick after a draw.
+struct arVrmlPickList {
+    std::vector<arVrmlPickItem>     items;
+    std::vector<openvrml::mat4f>    views;
+    std::vector<arVrmlPickNode>     top;
+    std::vector<int>                order;
+    std::vector<float>              box;            // lo and hi of each item
+    bool                            topStale;
+    int                             refits;         // since it was made
+    openvrml::node_ptr              over;
+    openvrml::node_ptr              active;
+    int                             activeView;
+    bool                            pressed;
+    float                           grabDistance;   // along the ray
+    openvrml::vec3f                 grabOffset;     // from the point
+};
 
 class arVrmlViewer : public openvrml::gl::viewer {
 
@@ -18,12 +147,153 @@ public:
     double           rotation[3];
     double           scale[3];
     bool             internal_light;
+    bool             cull;
+    int              pickTag;       // of the pick list the next draw makes
+    bool             blended;       // a draw has met a transparent material or texture
 
-    void timerUpdate();
+    bool timerUpdate();
     void redraw();
+    // Draws the scene once under each of the n column-major transforms.
+    void redrawInstanced(const double (*transforms)[16], int n);
     void setInternalLight( bool f );
+    void setCulling( bool f );
+    // Packs the small textures of the scenes loaded from now into the atlas.
+    static void setAtlas( bool f );
+    // Makes the next draw set up again all the GL state it depends on.
+    static void invalidateState();
+    // The bytes of the buffer objects and textures it holds in GL, and of
+    // the mesh arrays it keeps in memory.
+    void memoryUsed(size_t & gpu, size_t & cpu) const;
+    static arVrmlCounts counts;
+    // The distances from the camera to the origin of the scene, in the units
+    // of the modelview, past which each simpler level of detail is drawn; 0
+    // for never.
+    static double lodDistance[AR_VRML_LOD_LEVELS - 1];
+    // The draws leave GL_BLEND as they find it, see arVrmlSetBlendExternal().
+    static bool blendExternal;
+    // The nearest geometry of a sensitive node along a ray, or within radius
+    // of a point, of the last draw of tag, in its eye coordinates.
+    bool pickRay(int tag, const openvrml::vec3f & origin,
+                 const openvrml::vec3f & direction, arVrmlPickHit & hit);
+    bool pickPoint(int tag, const openvrml::vec3f & point, float radius,
+                   arVrmlPickHit & hit);
+    // Hands an actuator to the sensors as checkSensitive() of gl::viewer does
+    // the mouse, without drawing again in select mode. true while it is over
+    // a sensitive node or drags one.
+    bool pointerRay(int tag, const openvrml::vec3f & origin,
+                    const openvrml::vec3f & direction, bool press);
+    bool pointerPoint(int tag, const openvrml::vec3f & point, float radius,
+                      bool press);
+    void pickForget(int tag);
 
 protected:
+    // Eye coordinates from those of the rendering context, and the view
+    // volume of the projection redraw() was given, for the culling.
+    openvrml::mat4f  cull_modelview;
+    openvrml::mat4f  cull_matrix;
+    openvrml::frustum cull_frustum;
+
+    void cullUpdate(const float p[16]);
+
+    std::map<viewer::object_t, arVrmlMesh> meshes;
+    bool tessellateShell(unsigned int mask,
+                         const std::vector<openvrml::vec3f> & coord,
+                         const std::vector<openvrml::int32> & coordIndex,
+                         const std::vector<openvrml::color> & color,
+                         const std::vector<openvrml::int32> & colorIndex,
+                         const std::vector<openvrml::vec3f> & normal,
+                         const std::vector<openvrml::int32> & normalIndex,
+                         const std::vector<openvrml::vec2f> & texCoord,
+                         const std::vector<openvrml::int32> & texCoordIndex,
+                         arVrmlMesh & m);
+    void simplifyMesh(arVrmlMesh & m);
+    void uploadMesh(arVrmlMesh & m);
+    // The level of detail of the instance being drawn.
+    int              lod;
+    void drawMesh(viewer::object_t ref, const arVrmlMesh & m);
+
+    // The bytes of each texture object, for memoryUsed().
+    std::map<viewer::texture_object_t, size_t> textureBytes;
+
+    // The pixel buffers update_texture() fills the frames of movies from,
+    // in turn, 0 until the first.
+    unsigned int     unpackBuffer[2];
+    int              unpackNext;
+
+    // The meshes of Extrusions and ElevationGrids, kept from one run to the
+    // next in a file next to the scene; those of the first draw are added.
+    std::map<arVrmlMeshKey, long> cacheIndex;
+    bool             cacheLoaded;
+    bool             cacheValid;
+    bool             cacheWriting;
+    FILE            *cacheIn;
+    FILE            *cacheOut;
+    bool cacheRead(const arVrmlMeshKey & key, arVrmlMesh & m);
+    void cacheWrite(const arVrmlMeshKey & key, const arVrmlMesh & m);
+    void cacheClose();
+
+    // The hierarchies of the geometries drawn under a sensitive node, made
+    // while the traversal is under it, and the pick list being filled.
+    std::map<viewer::object_t, arVrmlPickTree>  pickTrees;
+    std::map<int, arVrmlPickList>               picks;
+    arVrmlPickList                             *pickList;
+    std::vector<openvrml::node *>               pickStack;
+    void pickBuild(viewer::object_t ref, std::vector<float> & tri);
+    void pickMesh(viewer::object_t ref, const arVrmlMesh & m);
+    void pickRecord(viewer::object_t ref);
+    const arVrmlPickTree * pickTree(viewer::object_t ref);
+    void pickTop(arVrmlPickList & pl);
+    bool pointer(arVrmlPickList & pl, const arVrmlPickHit * hit,
+                 const openvrml::vec3f & origin, const openvrml::vec3f & direction,
+                 bool ray, bool press);
+
+    // The buffers of the last mesh removed, taken over by the next one of
+    // the same size, as a morphing geometry is removed and inserted again.
+    arVrmlMesh       retired;
+    bool reuseBuffers(arVrmlMesh & m);
+
+    // While browser::render() walks the scene the meshes of opaque untextured
+    // shapes are only recorded, with their transform and appearance, then
+    // drawn by flushDraws() grouped by appearance and mesh.
+    bool                     recording;
+    arVrmlLook               look;
+    std::vector<arVrmlDrawItem>  drawList;
+    void setLook(const arVrmlLook & l);
+    void flushDraws();
+
+    virtual void enable_lighting(bool val);
+    virtual void set_color(const openvrml::color & rgb, float a = 1.0);
+    virtual void set_material(float ambientIntensity,
+                              const openvrml::color & diffuseColor,
+                              const openvrml::color & emissiveColor,
+                              float shininess,
+                              const openvrml::color & specularColor,
+                              float transparency);
+    virtual void set_material_mode(size_t tex_components, bool geometry_color);
+    virtual void set_texture_transform(const openvrml::vec2f & center,
+                                       float rotation,
+                                       const openvrml::vec2f & scale,
+                                       const openvrml::vec2f & translation);
+
+    // The TextureTransform of the shape, applied after the tile of the atlas.
+    openvrml::vec2f  texCenter;
+    float            texRotation;
+    openvrml::vec2f  texScale;
+    openvrml::vec2f  texTranslation;
+    void bindTile(const arVrmlAtlasTile & t, size_t nc);
+    void flushAtlas();
+    virtual void set_sensitive(openvrml::node * object);
+
+    virtual viewer::texture_object_t insert_texture(size_t w, size_t h, size_t nc,
+                                                    bool repeat_s, bool repeat_t,
+                                                    const unsigned char *pixels,
+                                                    bool retainHint = false);
+    virtual void update_texture(viewer::texture_object_t ref,
+                                size_t w, size_t h, size_t nc,
+                                const unsigned char *pixels);
+    virtual void remove_texture_object(viewer::texture_object_t ref);
+    virtual void insert_texture_reference(viewer::texture_object_t ref, size_t components);
+
     virtual void post_redraw();
     virtual void set_cursor(openvrml::gl::viewer::cursor_style c);
     virtual void swap_buffers();
@@ -66,6 +336,40 @@ protected:
                                                float radius);
     virtual openvrml::bounding_volume::intersection
       intersect_view_volume(const openvrml::bounding_volume & bvolume) const;
+
+    virtual viewer::object_t insert_shell(unsigned int mask,
+                                          const std::vector<openvrml::vec3f> & coord,
+                                          const std::vector<openvrml::int32> & coordIndex,
+                                          const std::vector<openvrml::color> & color,
+                                          const std::vector<openvrml::int32> & colorIndex,
+                                          const std::vector<openvrml::vec3f> & normal,
+                                          const std::vector<openvrml::int32> & normalIndex,
+                                          const std::vector<openvrml::vec2f> & texCoord,
+                                          const std::vector<openvrml::int32> & texCoordIndex);
+    virtual viewer::object_t insert_elevation_grid(unsigned int mask,
+                                                   const std::vector<float> & height,
+                                                   openvrml::int32 xDimension,
+                                                   openvrml::int32 zDimension,
+                                                   float xSpacing,
+                                                   float zSpacing,
+                                                   const std::vector<openvrml::color> & color,
+                                                   const std::vector<openvrml::vec3f> & normal,
+                                                   const std::vector<openvrml::vec2f> & texCoord);
+    virtual viewer::object_t insert_extrusion(unsigned int mask,
+                                              const std::vector<openvrml::vec3f> & spine,
+                                              const std::vector<openvrml::vec2f> & crossSection,
+                                              const std::vector<openvrml::rotation> & orientation,
+                                              const std::vector<openvrml::vec2f> & scale);
+    virtual viewer::object_t insert_box(const openvrml::vec3f & size);
+    virtual viewer::object_t insert_cone(float height, float radius,
+                                         bool bottom, bool side);
+    virtual viewer::object_t insert_cylinder(float height, float radius,
+                                             bool bottom, bool side, bool top);
+    virtual viewer::object_t insert_sphere(float radius);
+    virtual viewer::object_t insert_reference(viewer::object_t existing_object);
+    virtual void remove_object(viewer::object_t ref);
+    virtual bool update_shell_coord(viewer::object_t ref,
+                                    const std::vector<openvrml::vec3f> & coord);
 };
 
 #endif
@@ -1,5 +1,7 @@
 #include <AR/arvrml.h>
+#include <AR/ar.h>
 #include "arViewer.h"
+#include <openvrml/script.h>
 #include <iostream>
 #include <vector>
 #include <string>
@@ -10,35 +12,446 @@
 #endif
 #include <stdio.h>
 #include <string.h>
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  include <windows.h>
+#  include <process.h>
+#else
+#  include <pthread.h>
+#  include <unistd.h>
+#endif
 
 #define  AR_VRML_MAX   400
 
-static arVrmlViewer    *viewer[AR_VRML_MAX];
-static int              init = 1;
-static int              vrID = -1;
+/* States of a scene. A queued scene is parsed by the loader thread, and its
+ * viewer, the only part that touches GL, is made on the render thread. */
+#define  SCENE_FREE      0
+#define  SCENE_QUEUED    1
+#define  SCENE_PARSING   2
+#define  SCENE_PARSED    3
+#define  SCENE_READY     4
+#define  SCENE_FAILED    5
+#define  SCENE_ORPHAN    6      /* freed while the loader parses it */
+#define  SCENE_EVICTED   7      /* dropped for the memory budget */
+
+/* A scene is parsed once per url; the instances of every .dat file that
+ * names it share its browser, textures and display lists, and keep only
+ * their own placement. */
+typedef struct {
+    int              scene;
+    double           translation[3];
+    double           rotation[3];
+    double           scale[3];
+    int              active;
+} arVrmlInstance;
+
+static arVrmlViewer      *viewer[AR_VRML_MAX];
+static openvrml::browser *viewerBrowser[AR_VRML_MAX];
+static int                viewerRef[AR_VRML_MAX];
+static int                viewerState[AR_VRML_MAX];
+static int                viewerCull[AR_VRML_MAX];
+static int                viewerDrawn[AR_VRML_MAX];     /* since the last tick */
+static int                viewerRunning[AR_VRML_MAX];   /* changed by the last tick */
+static int                viewerActive[AR_VRML_MAX];    /* instances of arVrmlSetActive() */
+static int                viewerTick[AR_VRML_MAX];      /* of the last draw */
+static size_t             viewerSource[AR_VRML_MAX];    /* bytes of the scene file */
+static long               viewerMem[AR_VRML_MAX];       /* accounted with arMemAdd() */
+static int                viewerFirst[AR_VRML_MAX];     /* not drawn since it was made */
+static int                viewerWanted[AR_VRML_MAX];    /* prefetched since the last tick */
+static char               viewerUrl[AR_VRML_MAX][256];
+static arVrmlInstance     instance[AR_VRML_MAX];
+static int                init = 1;
+static int                vrID = -1;
+static int                internalLight = 1;
+static int                loaderRunning = 0;
+static int                tick = 0;
+static int                warmTick = -1;                /* of the last first draw of arVrmlPrefetch() */
+static size_t             budgetGpu = 0;                /* bytes, 0 for no limit */
+static size_t             budgetCpu = 0;
+static double             budgetScript = 0.002;         /* seconds */
+static ARVrmlLoadStats    loadStats;                    /* under the lock */
+
+#ifdef _WIN32
+static CRITICAL_SECTION   lock;
+#  define LOCK()       EnterCriticalSection( &lock )
+#  define UNLOCK()     LeaveCriticalSection( &lock )
+#  define NAP()        Sleep( 10 )
+#else
+static pthread_mutex_t    lock = PTHREAD_MUTEX_INITIALIZER;
+#  define LOCK()       pthread_mutex_lock( &lock )
+#  define UNLOCK()     pthread_mutex_unlock( &lock )
+#  define NAP()        usleep( 10000 )
+#endif
 
 static char *get_buff( char *buf, int n, FILE *fp );
+static int   load_instance( const char *file, int async );
+static int   get_scene( const char *url, int async );
+static int   scene_ready( int scene );
+static void  free_scene( int scene );
+static void  evict_scenes( void );
+static void  account_scene( int scene );
+static void  delete_scene( int scene );
+static size_t file_size( const char *url );
+static openvrml::browser *parse_scene( const char *url );
+static void  first_drawn( int scene, double t );
+static void  loader( void );
+static int   loader_start( void );
 
 
 int arVrmlLoadFile(const char *file)
 {
-  
+    return load_instance( file, 0 );
+}
+
+int arVrmlLoadFileAsync(const char *file)
+{
+    return load_instance( file, 1 );
+}
+
+int arVrmlLoadStatus( int id )
+{
+    if( init || id < 0 || id >= AR_VRML_MAX || instance[id].scene < 0 ) return -1;
+
+    return scene_ready( instance[id].scene );
+}
+
+int arVrmlFree( int id )
+{
+    if( init || id < 0 || id >= AR_VRML_MAX || instance[id].scene < 0 ) return -1;
+
+    arVrmlSetActive( id, 0 );
+    if( viewer[instance[id].scene] != NULL ) viewer[instance[id].scene]->pickForget( id );
+    free_scene( instance[id].scene );
+    instance[id].scene = -1;
+
+    if( vrID == id ) {
+        vrID = -1;
+    }
+
+    return 0;
+}
+
+/* Ticks the scenes drawn since the last call, those still animating and
+ * those held active. The others are paused; their TimeSensors work from the
+ * absolute time, so the first tick after they are drawn again catches up.
+ * Then the scripts are collected, and scenes evicted for the memory budget. */
+int arVrmlTimerUpdate()
+{
+     int     i;
+     AR_TRACE_SCOPE( "arVrmlTimerUpdate" );
+
+    // The frame in between is drawn by the application.
+    arVrmlViewer::invalidateState();
+
+    tick++;
+    for( i = 0; i < AR_VRML_MAX; i++ ) {
+        if( viewer[i] == NULL ) continue;
+        if( viewerWanted[i] ) {
+            viewerTick[i] = tick;
+            viewerWanted[i] = 0;
+        }
+        if( viewerDrawn[i] ) {
+            viewerTick[i] = tick;
+            account_scene( i );
+        }
+        if( !viewerDrawn[i] && !viewerRunning[i] && viewerActive[i] == 0 ) continue;
+        viewerRunning[i] = viewer[i]->timerUpdate()? 1: 0;
+        viewerDrawn[i] = 0;
+    }
+    AR_TRACE_BEGIN( "script gc" );
+    openvrml::script::collect_garbage( budgetScript );
+    AR_TRACE_END();
+    evict_scenes();
+    return 0;
+}
+
+int arVrmlSetMemoryBudget( int gpuKB, int cpuKB )
+{
+    if( gpuKB < 0 || cpuKB < 0 ) return -1;
+
+    budgetGpu = (size_t)gpuKB * 1024;
+    budgetCpu = (size_t)cpuKB * 1024;
+    return 0;
+}
+
+int arVrmlSetScriptBudget( double msec )
+{
+    if( msec < 0.0 ) return -1;
+
+    budgetScript = msec / 1000.0;
+    return 0;
+}
+
+int arVrmlSetScriptDeferred( int flag )
+{
+    openvrml::script::defer( flag != 0 );
+    return 0;
+}
+
+int arVrmlSetLOD( double nearDist, double farDist )
+{
+    if( nearDist < 0.0 || farDist < 0.0 ) return -1;
+    if( nearDist > 0.0 && farDist > 0.0 && farDist < nearDist ) return -1;
+
+    arVrmlViewer::lodDistance[0] = nearDist;
+    arVrmlViewer::lodDistance[1] = farDist;
+    return 0;
+}
+
+int arVrmlInvalidateState( void )
+{
+    arVrmlViewer::invalidateState();
+    return 0;
+}
+
+int arVrmlSetActive( int id, int flag )
+{
+    arVrmlInstance  *in;
+
+    if( init || id < 0 || id >= AR_VRML_MAX || instance[id].scene < 0 ) return -1;
+
+    in = &instance[id];
+    flag = flag? 1: 0;
+    if( in->active != flag ) {
+        viewerActive[in->scene] += flag? 1: -1;
+        in->active = flag;
+    }
+    return 0;
+}
+
+int arVrmlDraw( int id )
+{
+     arVrmlViewer   *v;
+     double          t;
+     int             ret;
+
+     if( init || id < 0 || id >= AR_VRML_MAX || instance[id].scene < 0 ) return -1;
+     if( (ret = scene_ready( instance[id].scene )) != AR_VRML_LOADED ) return ret;
+
+     AR_TRACE_SCOPE( "arVrmlDraw" );
+     v = viewer[instance[id].scene];
+     viewerDrawn[instance[id].scene] = 1;
+     memcpy( v->translation, instance[id].translation, sizeof(v->translation) );
+     memcpy( v->rotation,    instance[id].rotation,    sizeof(v->rotation) );
+     memcpy( v->scale,       instance[id].scale,       sizeof(v->scale) );
+     v->pickTag = id;
+     t = viewerFirst[instance[id].scene]? arUtilClock(): 0.0;
+     v->redraw();
+     if( viewerFirst[instance[id].scene] ) first_drawn( instance[id].scene, t );
+     return 0;
+}
+
+int arVrmlDrawInstanced( int id, const double transforms[][16], int n )
+{
+     arVrmlViewer   *v;
+     double          t;
+     int             ret;
+
+     if( init || id < 0 || id >= AR_VRML_MAX || instance[id].scene < 0 ) return -1;
+     if( (ret = scene_ready( instance[id].scene )) != AR_VRML_LOADED ) return ret;
+     if( n <= 0 ) return 0;
+
+     AR_TRACE_SCOPE( "arVrmlDrawInstanced" );
+     v = viewer[instance[id].scene];
+     viewerDrawn[instance[id].scene] = 1;
+     memcpy( v->translation, instance[id].translation, sizeof(v->translation) );
+     memcpy( v->rotation,    instance[id].rotation,    sizeof(v->rotation) );
+     memcpy( v->scale,       instance[id].scale,       sizeof(v->scale) );
+     v->pickTag = id;
+     t = viewerFirst[instance[id].scene]? arUtilClock(): 0.0;
+     v->redrawInstanced( transforms, n );
+     if( viewerFirst[instance[id].scene] ) first_drawn( instance[id].scene, t );
+     return 0;
+}
+
+/* The first draw is made under the matrices of the application, unculled
+ * and into a pick list of its own, so that neither the culling nor the
+ * pointers of the instance depend on where it was. */
+int arVrmlPrefetch( int id )
+{
+     arVrmlViewer   *v;
+     double          t;
+     int             scene, ret;
+
+     if( init || id < 0 || id >= AR_VRML_MAX || instance[id].scene < 0 ) return -1;
+     scene = instance[id].scene;
+     if( (ret = scene_ready( scene )) != AR_VRML_LOADED ) return ret;
+
+     viewerWanted[scene] = 1;
+     if( !viewerFirst[scene] ) return AR_VRML_LOADED;
+     if( warmTick == tick ) return AR_VRML_LOADING;
+     warmTick = tick;
+
+     AR_TRACE_SCOPE( "arVrmlPrefetch" );
+     v = viewer[scene];
+     memcpy( v->translation, instance[id].translation, sizeof(v->translation) );
+     memcpy( v->rotation,    instance[id].rotation,    sizeof(v->rotation) );
+     memcpy( v->scale,       instance[id].scale,       sizeof(v->scale) );
+     v->pickTag = -1;
+     v->setCulling( false );
+     glPushAttrib( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
+     glColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+     glDepthMask( GL_FALSE );
+     glStencilMask( 0 );
+     t = arUtilClock();
+     v->redraw();
+     first_drawn( scene, t );
+     glPopAttrib();
+     v->setCulling( viewerCull[scene]? true: false );
+     arVrmlViewer::invalidateState();
+     return AR_VRML_LOADED;
+}
+
+int arVrmlSetCulling( int id, int flag )
+{
+    int     scene;
+
+    if( init || id < 0 || id >= AR_VRML_MAX || instance[id].scene < 0 ) return -1;
+
+    scene = instance[id].scene;
+    viewerCull[scene] = flag;
+    if( viewer[scene] != NULL ) viewer[scene]->setCulling( flag? true: false );
+
+    return 0;
+}
+
+int arVrmlIsBlended( int id )
+{
+    arVrmlViewer   *v;
+
+    if( init || id < 0 || id >= AR_VRML_MAX || instance[id].scene < 0 ) return -1;
+    if( (v = viewer[instance[id].scene]) == NULL ) return 0;
+
+    return v->blended? 1: 0;
+}
+
+int arVrmlSetBlendExternal( int flag )
+{
+    arVrmlViewer::blendExternal = flag? true: false;
+    return 0;
+}
+
+int arVrmlSetTextureAtlas( int flag )
+{
+    arVrmlViewer::setAtlas( flag? true: false );
+    return 0;
+}
+
+/* A scene still loading or evicted has nothing drawn to be over. */
+int arVrmlPointerRay( int id, const double origin[3], const double direction[3], int press )
+{
+    arVrmlViewer   *v;
+
+    if( init || id < 0 || id >= AR_VRML_MAX || instance[id].scene < 0 ) return -1;
+    if( (v = viewer[instance[id].scene]) == NULL ) return 0;
+
+    return v->pointerRay( id, openvrml::vec3f( float(origin[0]), float(origin[1]), float(origin[2]) ),
+                          openvrml::vec3f( float(direction[0]), float(direction[1]), float(direction[2]) ),
+                          press? true: false )? 1: 0;
+}
+
+int arVrmlPointerTouch( int id, const double point[3], double radius, int press )
+{
+    arVrmlViewer   *v;
+
+    if( init || id < 0 || id >= AR_VRML_MAX || instance[id].scene < 0 || radius < 0.0 ) return -1;
+    if( (v = viewer[instance[id].scene]) == NULL ) return 0;
+
+    return v->pointerPoint( id, openvrml::vec3f( float(point[0]), float(point[1]), float(point[2]) ),
+                            float(radius), press? true: false )? 1: 0;
+}
+
+int arVrmlGetStats( ARVrmlStats *stats )
+{
+    if( stats == NULL ) return -1;
+
+    stats->draws     = arVrmlViewer::counts.draws;
+    stats->triangles = arVrmlViewer::counts.triangles;
+    stats->states    = arVrmlViewer::counts.states;
+    memset( &arVrmlViewer::counts, 0, sizeof(arVrmlViewer::counts) );
+    return 0;
+}
+
+int arVrmlGetLoadStats( ARVrmlLoadStats *stats )
+{
+    if( stats == NULL ) return -1;
+    if( init ) {
+        memset( stats, 0, sizeof(ARVrmlLoadStats) );
+        return 0;
+    }
+
+    LOCK();
+    *stats = loadStats;
+    memset( &loadStats, 0, sizeof(loadStats) );
+    UNLOCK();
+    return 0;
+}
+
+int arVrmlLiveScenes( void )
+{
+    int     i, n = 0;
+
+    if( init ) return 0;
+    LOCK();
+    for( i = 0; i < AR_VRML_MAX; i++ ) {
+        if( viewerBrowser[i] != NULL ) n++;
+    }
+    UNLOCK();
+    return n;
+}
+
+int arVrmlSetInternalLight( int flag )
+{
+   int     i;
+
+    internalLight = flag;
+    if( flag ) {
+        for( i = 0; i < AR_VRML_MAX; i++ ) {
+            if( viewer[i] == NULL ) continue;
+            viewer[i]->setInternalLight(true);
+        }
+    }
+    else {
+        for( i = 0; i < AR_VRML_MAX; i++ ) {
+            if( viewer[i] == NULL ) continue;
+            viewer[i]->setInternalLight(false);
+        }
+    }
+
+    return 0;
+}
+
+static int load_instance( const char *file, int async )
+{
     FILE             *fp;
-    openvrml::browser * myBrowser = 0;
+    arVrmlInstance   *in;
     char             buf[256], buf1[256];
     char             buf2[256];
     int              id;
     int              i;
 
     if( init ) {
-        for( i = 0; i < AR_VRML_MAX; i++ ) viewer[i] = NULL;
+#ifdef _WIN32
+        InitializeCriticalSection( &lock );
+#endif
+        for( i = 0; i < AR_VRML_MAX; i++ ) {
+            viewer[i] = NULL;
+            viewerBrowser[i] = NULL;
+            viewerRef[i] = 0;
+            viewerState[i] = SCENE_FREE;
+            instance[i].scene = -1;
+        }
         init = 0;
     }
     for( i = 0; i < AR_VRML_MAX; i++ ) {
-        if( viewer[i] == NULL ) break;
+        if( instance[i].scene < 0 ) break;
     }
     if( i == AR_VRML_MAX ) return -1;
     id = i;
+    in = &instance[id];
+    in->active = 0;
 
 
     if( (fp=fopen(file, "r")) == NULL ) return -1;
@@ -52,45 +465,32 @@ int arVrmlLoadFile(const char *file)
     buf2[i+1] = '\0';
     sprintf(buf, "%s%s", buf2, buf1);
 
-    myBrowser = new openvrml::browser(std::cout, std::cerr);
-    if( !myBrowser) {fclose(fp); return -1;}
-
-    std::vector<std::string> uri(1, buf);
-    std::vector<std::string> parameter; 
-    myBrowser->load_url(uri, parameter);
+    in->scene = get_scene( buf, async );
+    if( in->scene < 0 ) {fclose(fp); return -1;}
 
-    viewer[id] = new arVrmlViewer(*myBrowser);
-    if(!viewer[id]) 
-    {
-        delete myBrowser;
-        fclose(fp);
-        return -1;
-    }
-    strcpy( viewer[id]->filename, buf );
-    
     get_buff(buf, 256, fp);
-    if( sscanf(buf, "%lf %lf %lf", &viewer[id]->translation[0], 
-        &viewer[id]->translation[1], &viewer[id]->translation[2]) != 3 ) {
-        delete viewer[id];
-        viewer[id] = NULL;
+    if( sscanf(buf, "%lf %lf %lf", &in->translation[0],
+        &in->translation[1], &in->translation[2]) != 3 ) {
+        free_scene( in->scene );
+        in->scene = -1;
         fclose(fp);
         return -1;
     }
 
     get_buff(buf, 256, fp);
-    if( sscanf(buf, "%lf %lf %lf ", &viewer[id]->rotation[0],
-        &viewer[id]->rotation[1], &viewer[id]->rotation[2] ) != 3 ) {
-        delete viewer[id];
-        viewer[id] = NULL;
+    if( sscanf(buf, "%lf %lf %lf ", &in->rotation[0],
+        &in->rotation[1], &in->rotation[2] ) != 3 ) {
+        free_scene( in->scene );
+        in->scene = -1;
         fclose(fp);
         return -1;
     }
 
     get_buff(buf, 256, fp);
-    if( sscanf(buf, "%lf %lf %lf", &viewer[id]->scale[0], &viewer[id]->scale[1],
-               &viewer[id]->scale[2]) != 3 ) {
-        delete viewer[id];
-        viewer[id] = NULL;
+    if( sscanf(buf, "%lf %lf %lf", &in->scale[0], &in->scale[1],
+               &in->scale[2]) != 3 ) {
+        free_scene( in->scene );
+        in->scene = -1;
         fclose(fp);
         return -1;
     }
@@ -99,57 +499,318 @@ int arVrmlLoadFile(const char *file)
     return id;
 }
 
-int arVrmlFree( int id )
+/* The scene of the url, parsed only if no instance holds it yet: at once,
+ * or by the loader thread when async. A synchronous load of a scene that is
+ * still queued or parsing waits for it. */
+static int get_scene( const char *url, int async )
 {
-    if( viewer[id] == NULL ) return -1;
+    openvrml::browser  *b;
+    int                 i, id, state;
 
-    delete viewer[id];
-    viewer[id] = NULL;
+    LOCK();
+    id = -1;
+    for( i = 0; i < AR_VRML_MAX; i++ ) {
+        if( viewerState[i] == SCENE_FREE ) {
+            if( id < 0 ) id = i;
+        }
+        else if( viewerState[i] != SCENE_ORPHAN && strcmp(viewerUrl[i], url) == 0 ) {
+            viewerRef[i]++;
+            UNLOCK();
+            if( !async ) {
+                while( (state = scene_ready(i)) == AR_VRML_LOADING ) NAP();
+                if( state < 0 ) {free_scene(i); return -1;}
+            }
+            return i;
+        }
+    }
+    if( id < 0 || strlen(url) >= sizeof(viewerUrl[id]) ) {UNLOCK(); return -1;}
+    strcpy( viewerUrl[id], url );
+    viewerRef[id] = 1;
+    viewerCull[id] = 1;
+    viewerDrawn[id] = 0;
+    viewerRunning[id] = 1;      /* a first tick for the events of the load */
+    viewerActive[id] = 0;
+    viewerTick[id] = tick;
+    viewerState[id] = async? SCENE_QUEUED: SCENE_PARSING;
+    UNLOCK();
+    viewerSource[id] = file_size( url );
 
-    if( vrID == id ) {
-        vrID = -1;
+    if( async ) {
+        if( loader_start() < 0 ) {free_scene(id); return -1;}
+        return id;
     }
 
-    return 0;
+    b = parse_scene( url );
+    LOCK();
+    viewerBrowser[id] = b;
+    viewerState[id] = (b != NULL)? SCENE_PARSED: SCENE_FAILED;
+    UNLOCK();
+    if( scene_ready( id ) < 0 ) {free_scene(id); return -1;}
+
+    return id;
 }
 
-int arVrmlTimerUpdate()
+/* AR_VRML_LOADED once the viewer of the scene exists, making it on the
+ * render thread when the loader has parsed the scene. An evicted scene is
+ * queued to be parsed again, from its compiled copy when it has one. */
+static int scene_ready( int scene )
 {
-     int     i;
+    double  t;
+    int     state;
 
-    for( i = 0; i < AR_VRML_MAX; i++ ) {
-        if( viewer[i] == NULL ) continue;
-        viewer[i]->timerUpdate();
+    LOCK();
+    state = viewerState[scene];
+    UNLOCK();
+
+    switch( state ) {
+      case SCENE_READY:
+        return AR_VRML_LOADED;
+      case SCENE_QUEUED:
+      case SCENE_PARSING:
+        return AR_VRML_LOADING;
+      case SCENE_PARSED:
+        t = arUtilClock();
+        viewer[scene] = new arVrmlViewer(*viewerBrowser[scene]);
+        if( !viewer[scene] ) break;
+        strcpy( viewer[scene]->filename, viewerUrl[scene] );
+        viewer[scene]->setInternalLight( internalLight? true: false );
+        viewer[scene]->setCulling( viewerCull[scene]? true: false );
+        viewerTick[scene] = tick;
+        viewerFirst[scene] = 1;
+        t = arUtilClock() - t;
+        LOCK();
+        viewerState[scene] = SCENE_READY;
+        loadStats.build += t * 1000.0;
+        UNLOCK();
+        return AR_VRML_LOADED;
+      case SCENE_EVICTED:
+        LOCK();
+        viewerState[scene] = SCENE_QUEUED;
+        viewerRunning[scene] = 1;
+        UNLOCK();
+        if( loader_start() < 0 ) {
+            LOCK();
+            viewerState[scene] = SCENE_FAILED;
+            UNLOCK();
+            break;
+        }
+        return AR_VRML_LOADING;
+      default:
+        break;
     }
-    return 0;
+
+    return -1;
 }
 
-int arVrmlDraw( int id )
+/* Drops one instance of the scene, and the scene with its browser after the last. */
+static void free_scene( int scene )
 {
-     if( viewer[id] == NULL ) return -1;
-     viewer[id]->redraw();
-     return 0;
+    LOCK();
+    if( --viewerRef[scene] > 0 ) {UNLOCK(); return;}
+
+    if( viewerState[scene] == SCENE_PARSING ) {
+        viewerState[scene] = SCENE_ORPHAN;
+        UNLOCK();
+        return;
+    }
+    viewerState[scene] = SCENE_FREE;
+    UNLOCK();
+
+    delete_scene( scene );
 }
 
-int arVrmlSetInternalLight( int flag )
+/* Only a drawn scene makes new meshes and textures, so the memory of the
+ * others is not looked at again. As for the budget, the size of the scene
+ * file stands in for the memory of its browser. */
+static void account_scene( int scene )
 {
-   int     i;
+    size_t   gpu, cpu;
+    long     bytes;
 
-    if( flag ) {
+    viewer[scene]->memoryUsed( gpu, cpu );
+    bytes = (long)(gpu + cpu + viewerSource[scene]);
+    arMemAdd( AR_MEM_VRML, bytes - viewerMem[scene] );
+    viewerMem[scene] = bytes;
+}
+
+static void delete_scene( int scene )
+{
+    delete viewer[scene];
+    delete viewerBrowser[scene];
+    viewer[scene] = NULL;
+    viewerBrowser[scene] = NULL;
+    arMemAdd( AR_MEM_VRML, -viewerMem[scene] );
+    viewerMem[scene] = 0;
+}
+
+/* While the scenes hold more than the budget, drops the viewer and browser
+ * of the one drawn least recently, leaving its instances to reload it. Those
+ * drawn in the frame just ticked and those held active stay. The memory of a
+ * browser is not known; the size of its scene file stands in for it. */
+static void evict_scenes( void )
+{
+    size_t   gpu[AR_VRML_MAX], cpu[AR_VRML_MAX];
+    size_t   totalGpu, totalCpu;
+    int      i, lru;
+
+    if( budgetGpu == 0 && budgetCpu == 0 ) return;
+
+    totalGpu = totalCpu = 0;
+    for( i = 0; i < AR_VRML_MAX; i++ ) {
+        if( viewer[i] == NULL ) continue;
+        viewer[i]->memoryUsed( gpu[i], cpu[i] );
+        cpu[i] += viewerSource[i];
+        totalGpu += gpu[i];
+        totalCpu += cpu[i];
+    }
+
+    while( (budgetGpu != 0 && totalGpu > budgetGpu)
+        || (budgetCpu != 0 && totalCpu > budgetCpu) ) {
+        lru = -1;
         for( i = 0; i < AR_VRML_MAX; i++ ) {
-            if( viewer[i] == NULL ) continue;
-            viewer[i]->setInternalLight(true);
+            if( viewer[i] == NULL || viewerTick[i] == tick || viewerActive[i] > 0 ) continue;
+            if( lru < 0 || viewerTick[i] < viewerTick[lru] ) lru = i;
         }
+        if( lru < 0 ) return;
+
+        totalGpu -= gpu[lru];
+        totalCpu -= cpu[lru];
+        LOCK();
+        viewerState[lru] = SCENE_EVICTED;
+        UNLOCK();
+        delete_scene( lru );
+        viewerRunning[lru] = 0;
+        viewerDrawn[lru] = 0;
     }
-    else {
+}
+
+static size_t file_size( const char *url )
+{
+    FILE    *fp;
+    long     size;
+
+    if( (fp = fopen(url, "rb")) == NULL ) return 0;
+    size = (fseek(fp, 0, SEEK_END) == 0)? ftell(fp): 0;
+    fclose( fp );
+    return (size > 0)? (size_t)size: 0;
+}
+
+static openvrml::browser *parse_scene( const char *url )
+{
+    openvrml::browser * myBrowser = 0;
+    double              t = arUtilClock();
+
+    myBrowser = new openvrml::browser(std::cout, std::cerr);
+    if( !myBrowser) return NULL;
+
+    std::vector<std::string> uri(1, url);
+    std::vector<std::string> parameter;
+    myBrowser->load_url(uri, parameter);
+
+    t = arUtilClock() - t;
+    LOCK();
+    loadStats.scenes++;
+    loadStats.parse += t * 1000.0;
+    UNLOCK();
+
+    return myBrowser;
+}
+
+static void first_drawn( int scene, double t )
+{
+    t = arUtilClock() - t;
+    viewerFirst[scene] = 0;
+    LOCK();
+    loadStats.draw += t * 1000.0;
+    UNLOCK();
+}
+
+/* Parses the queued scenes one after another, the OpenVRML parser not being
+ * safe to run on several browsers at a time, and ends with the queue. */
+static void loader( void )
+{
+    openvrml::browser  *b;
+    char                url[256];
+    int                 i;
+
+    for(;;) {
+        LOCK();
         for( i = 0; i < AR_VRML_MAX; i++ ) {
-            if( viewer[i] == NULL ) continue;
-            viewer[i]->setInternalLight(false);
+            if( viewerState[i] == SCENE_QUEUED ) break;
+        }
+        if( i == AR_VRML_MAX ) {
+            loaderRunning = 0;
+            UNLOCK();
+            return;
+        }
+        viewerState[i] = SCENE_PARSING;
+        strcpy( url, viewerUrl[i] );
+        UNLOCK();
+
+        b = parse_scene( url );
+
+        LOCK();
+        if( viewerState[i] == SCENE_ORPHAN ) {
+            viewerState[i] = SCENE_FREE;
+            UNLOCK();
+            delete b;
+            continue;
         }
+        viewerBrowser[i] = b;
+        viewerState[i] = (b != NULL)? SCENE_PARSED: SCENE_FAILED;
+        UNLOCK();
     }
-  
+}
+
+#ifdef _WIN32
+static unsigned __stdcall loader_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_BACKGROUND, "vrml loader" );
+    loader();
+    arThreadRoleEnd();
     return 0;
 }
+#else
+static void *loader_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_BACKGROUND, "vrml loader" );
+    loader();
+    arThreadRoleEnd();
+    return NULL;
+}
+#endif
+
+static int loader_start( void )
+{
+#ifdef _WIN32
+    HANDLE    tid;
+#else
+    pthread_t tid;
+#endif
+
+    LOCK();
+    if( loaderRunning ) {UNLOCK(); return 0;}
+    loaderRunning = 1;
+    UNLOCK();
+
+#ifdef _WIN32
+    tid = (HANDLE)_beginthreadex( NULL, 0, loader_thread, NULL, 0, NULL );
+    if( tid != 0 ) {
+        CloseHandle( tid );
+        return 0;
+    }
+#else
+    if( pthread_create( &tid, NULL, loader_thread, NULL ) == 0 ) {
+        pthread_detach( tid );
+        return 0;
+    }
+#endif
+    printf("unable to start the VRML loader thread.\n");
+    LOCK();
+    loaderRunning = 0;
+    UNLOCK();
+    return -1;
+}
 
 static char *get_buff( char *buf, int n, FILE *fp )
 {
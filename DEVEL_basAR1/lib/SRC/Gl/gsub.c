@@ -17,6 +17,7 @@
 #include <AR/param.h>
 #include <AR/ar.h>
 #include <AR/gsub.h>
+#include <AR/gsub_lite.h>
 
 #ifndef GL_ABGR
 #  define GL_ABGR GL_ABGR_EXT
@@ -74,6 +75,10 @@ static int      gWinXsize, gWinYsize;
 static int      gImXsize, gImYsize;
 static int      win;
 static GLuint   glid[4];
+static GLuint   gStereoList = 0;
+static ARGL_FRAME_PACER_REF gPacer = NULL;
+static ARGL_CONTEXT_SETTINGS_REF gArglSettings     = NULL;
+static ARGL_CONTEXT_SETTINGS_REF gArglSettingsHalf = NULL;
 
 static void (*gMouseFunc)(int button, int state, int x, int y);
 static void (*gKeyFunc)(unsigned char key, int x, int y);
@@ -82,6 +87,8 @@ static void (*gMainFunc)(void);
 
 static void argInit2( int fullFlag );
 static void argInitLoop(void);
+static void argIdle(void);
+static double argTime(void);
 static void argInitStencil(void);
 static void argSetStencil( int flag );
 static void argConvGLcpara2( double cparam[3][4], int width, int height, double gnear, double gfar, double m[16] );
@@ -102,6 +109,7 @@ static void   argDispImageTex4( ARUint8 *image, int xwin, int ywin, int mode );
 static void   argDispHalfImageTex( ARUint8 *image, int xwin, int ywin, int mode );
 static void   argDispImageDrawPixels( ARUint8 *image, int xwin, int ywin );
 static void   argDispHalfImageDrawPixels( ARUint8 *image, int xwin, int ywin );
+static void   argDispImageLite( ARGL_CONTEXT_SETTINGS_REF settings, ARUint8 *image, int xsize, int ysize, int xwin, int ywin );
 
 void argInqSetting( int *hmdMode,
                     int *gMiniXnum2, int *gMiniYnum2,
@@ -185,6 +193,10 @@ static void argInit2( int fullFlag )
     gKeyFunc   = NULL;
     gMainFunc  = NULL;
 
+    /* Swap on the refresh, and let the pacer of argMainLoop time the frames. */
+    arglSwapIntervalSet( 1 );
+    gPacer = arglFramePacerCreate();
+
 
     glGenTextures(4, glid);
     glBindTexture( GL_TEXTURE_2D, glid[0] );
@@ -225,10 +237,36 @@ static void argInit2( int fullFlag )
     while( tex2Xsize < gImXsize/2 ) tex2Xsize *= 2;
     tex2Ysize = 1;
     while( tex2Ysize < gImYsize/2 ) tex2Ysize *= 2;
+
+    /* The images are streamed by gsub_lite, through pixel buffer objects
+       where the driver has them. The code below is kept as the fallback. */
+    if( (gArglSettings = arglSetupForCurrentContext()) != NULL ) {
+        arglPixelBufferObjectsSet( gArglSettings, 2 );
+        arglDistortionMeshPrepare( gArglSettings, &gCparam );
+    }
+    if( (gArglSettingsHalf = arglSetupForCurrentContext()) != NULL ) {
+        arglPixelBufferObjectsSet( gArglSettingsHalf, 2 );
+    }
 }
 
 void argCleanup( void )
 {
+    if( gPacer != NULL ) {
+        arglFramePacerDelete( gPacer );
+        gPacer = NULL;
+    }
+    if( gStereoList != 0 ) {
+        glDeleteLists( gStereoList, 1 );
+        gStereoList = 0;
+    }
+    if( gArglSettings != NULL ) {
+        arglCleanup( gArglSettings );
+        gArglSettings = NULL;
+    }
+    if( gArglSettingsHalf != NULL ) {
+        arglCleanup( gArglSettingsHalf );
+        gArglSettingsHalf = NULL;
+    }
 /*
     glutDestroyWindow( win );
 */
@@ -236,7 +274,11 @@ void argCleanup( void )
 
 void argSwapBuffers( void )
 {
+    double   drawn;
+
+    drawn = argTime();
     glutSwapBuffers();
+    arglFramePacerPresented( gPacer, drawn, argTime() );
 }
 
 void argMainLoop( void (*mouseFunc)(int button, int state, int x, int y),
@@ -272,7 +314,28 @@ static void argInitLoop(void)
     glutKeyboardFunc( gKeyFunc );
     glutMouseFunc( gMouseFunc );
     glutDisplayFunc( gMainFunc );
-    glutIdleFunc( gMainFunc );
+    glutIdleFunc( (gMainFunc != NULL)? argIdle: NULL );
+}
+
+/* Run the main function at the moment the pacer chooses, so that the
+   frame is done just before the refresh, with the newest video image. */
+static void argIdle(void)
+{
+    double   now, wait;
+
+    now  = argTime();
+    wait = arglFramePacerWait( gPacer, now );
+    if( wait > 0.0 ) {
+        if( wait > 0.002 ) arUtilSleep( 1 );
+        return;
+    }
+    arglFramePacerBegin( gPacer, now );
+    (*gMainFunc)();
+}
+
+static double argTime(void)
+{
+    return glutGet(GLUT_ELAPSED_TIME) / 1000.0;
 }
 
 void argDrawMode2D( void )
@@ -327,6 +390,34 @@ void argDraw3dRight( void )
     glLoadMatrixd( gl_rpara );
 }
 
+void argDraw3dStereo( void (*drawFunc)(void) )
+{
+    if( gl_hmd_flag == 0 || gl_hmd_para_flag == 0 ) {
+        argDraw3dCamera( 0, 0 );
+        argDrawMode3D();
+        (*drawFunc)();
+        return;
+    }
+
+    /* The scene is traversed once, into a list replayed for both eyes. */
+    if( gStereoList == 0 ) gStereoList = glGenLists(1);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glNewList( gStereoList, GL_COMPILE );
+    (*drawFunc)();
+    glEndList();
+
+    argDraw3dLeft();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glCallList( gStereoList );
+    argDraw3dRight();
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glCallList( gStereoList );
+    argSetStencil( 0 );
+}
+
 
 void argDraw3dCamera( int xwin, int ywin )
 {
@@ -362,7 +453,11 @@ void argConvGlpara( double para[3][4], double gl_para[16] )
 
 void argDispImage( ARUint8 *image, int xwin, int ywin )
 {
-    if( argDrawMode == AR_DRAW_BY_GL_DRAW_PIXELS ) {
+    if( gArglSettings != NULL ) {
+        arglTexmapModeSet( gArglSettings, argTexmapMode );
+        argDispImageLite( gArglSettings, image, gImXsize, gImYsize, xwin, ywin );
+    }
+    else if( argDrawMode == AR_DRAW_BY_GL_DRAW_PIXELS ) {
         argDispImageDrawPixels( image, xwin, ywin );
     }
     else {
@@ -394,6 +489,65 @@ void argDispImage( ARUint8 *image, int xwin, int ywin )
 }
 
 
+/* Textured quad of gsub_lite in the viewport of the window xwin, ywin.
+   AR_DRAW_BY_GL_DRAW_PIXELS keeps its look, the image without the
+   compensation of the lens distortion. */
+static void argDispImageLite( ARGL_CONTEXT_SETTINGS_REF settings, ARUint8 *image, int xsize, int ysize, int xwin, int ywin )
+{
+    ARParam    cparam;
+    GLint      viewport[4];
+    GLint      texEnvMode;
+    GLboolean  lighting, depthTest;
+    int        enable;
+
+    cparam = gCparam;
+    cparam.xsize = xsize;
+    cparam.ysize = ysize;
+
+    glGetIntegerv( GL_VIEWPORT, viewport );
+    if( xwin == 0 && ywin == 0 ) {
+        glViewport(0, gWinYsize-(int)(gZoom*gImYsize),
+                   (int)(gZoom*gImXsize), (int)(gZoom*gImYsize));
+    }
+    else if( xwin == 1 && ywin == 0 ) {
+        glViewport(gXsize, gWinYsize-(int)(gZoom*gImYsize),
+                   (int)(gZoom*gImXsize), (int)(gZoom*gImYsize));
+    }
+    else {
+        glViewport((xwin-1)*gMiniXsize, gWinYsize-gYsize-ywin*gMiniYsize,
+                    gMiniXsize, gMiniYsize);
+    }
+
+    glGetTexEnviv( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, &texEnvMode );
+    glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE );
+    lighting  = glIsEnabled( GL_LIGHTING );
+    depthTest = glIsEnabled( GL_DEPTH_TEST );
+    glDisable( GL_LIGHTING );
+    glDisable( GL_DEPTH_TEST );
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(0, xsize, 0, ysize, -1.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glLoadIdentity();
+
+    arglDistortionCompensationGet( settings, &enable );
+    if( enable != (argDrawMode != AR_DRAW_BY_GL_DRAW_PIXELS) ) {
+        arglDistortionCompensationSet( settings, !enable );
+    }
+    arglDispImageStateful( image, &cparam, 1.0, settings );
+
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopMatrix();
+    if( depthTest ) glEnable( GL_DEPTH_TEST );
+    if( lighting ) glEnable( GL_LIGHTING );
+    glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, texEnvMode );
+    glViewport( viewport[0], viewport[1], viewport[2], viewport[3] );
+}
+
 static void argDispImageDrawPixels( ARUint8 *image, int xwin, int ywin )
 {
     float    sx, sy;
@@ -1234,7 +1388,10 @@ static void argDispImageTex3( ARUint8 *wimage, int xwin, int ywin, int mode )
 
 void argDispHalfImage( ARUint8 *image, int xwin, int ywin )
 {
-    if( argDrawMode == AR_DRAW_BY_GL_DRAW_PIXELS ) {
+    if( gArglSettingsHalf != NULL && argDrawMode == AR_DRAW_BY_GL_DRAW_PIXELS ) {
+        argDispImageLite( gArglSettingsHalf, image, gImXsize/2, gImYsize/2, xwin, ywin );
+    }
+    else if( argDrawMode == AR_DRAW_BY_GL_DRAW_PIXELS ) {
         argDispHalfImageDrawPixels( image, xwin, ywin );
     }
     else {
@@ -1,7 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #if defined(_WIN32)
 #include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
 #endif
 #ifndef __APPLE__
 #  include <GL/glut.h>
@@ -21,6 +25,20 @@
 
 #define  CALIB_POS1_NUM     5
 #define  CALIB_POS2_NUM     2
+#define  CALIB_SOLVE_MIN    6       /* samples arParamGet() needs */
+
+/* The samples of the eye being calibrated are solved in a thread of their
+   own from CALIB_SOLVE_MIN on, again after each new one once the last solve
+   is done, so that the display keeps the video rate. The target is shown
+   where the newest solution puts it, and the last one is the result. */
+typedef struct {
+    double          pos3d[CALIB_POS1_NUM*CALIB_POS2_NUM][3];
+    double          pos2d[CALIB_POS1_NUM*CALIB_POS2_NUM][2];
+    int             num;
+    double          mat[3][4];
+    int             ok;
+    volatile int    done;
+} CalibSolve;
 
 static double   calib_pos[CALIB_POS1_NUM][2] = { { 160, 120 },
                                                  { 480, 120 },
@@ -38,6 +56,17 @@ static int      target_visible;
 static double   target_center[2] = { 0.0, 0.0 };
 static double   target_width     =  80.0;
 
+static CalibSolve solve;
+#ifdef _WIN32
+static HANDLE   solve_tid;
+#else
+static pthread_t solve_tid;
+#endif
+static int      solving;            /* solve_tid runs */
+static int      solve_pending;      /* samples came since it started */
+static double   preview_mat[3][4];
+static int      preview_num;        /* samples of preview_mat, 0 for none */
+
 static ARParam  hmd_param[2];
 static int      thresh;
 static int      arFittingModeBak;
@@ -52,6 +81,11 @@ static void     (*gCalibPostFunc)(ARParam *lpara, ARParam *rpara);
 static void argCalibMouseFunc(int button, int state, int x, int y);
 static void argCalibMainFunc(void);
 static int  argDrawAttention(double pos[2], int color);
+static void argDrawPreview(void);
+static void calib_solve_start( void );
+static void calib_solve_poll( void );
+static void calib_solve_wait( void );
+static void calib_exit( ARParam *lpara, ARParam *rpara );
 
 void argUtilCalibHMD( int targetId, int thresh2,
                       void (*postFunc)(ARParam *lpara, ARParam *rpara) )
@@ -71,6 +105,8 @@ void argUtilCalibHMD( int targetId, int thresh2,
     co2 = 0;
     left_right = 0;
     target_visible = 0;
+    preview_num = 0;
+    solve_pending = 0;
 
     glutKeyboardFunc( NULL );
     glutMouseFunc( argCalibMouseFunc );
@@ -80,6 +116,8 @@ void argUtilCalibHMD( int targetId, int thresh2,
 
 static void argCalibMouseFunc(int button, int state, int x, int y)
 {
+    int     num;
+
     if( button == GLUT_LEFT_BUTTON  && state == GLUT_DOWN ) {
         if( target_visible ) {
             calib_pos3d[co1][co2][0] = target_trans[0][3];
@@ -92,6 +130,7 @@ static void argCalibMouseFunc(int button, int state, int x, int y)
                 co1++;
                 co2 = 0;
             }
+            num = co1*CALIB_POS2_NUM + co2;
 
             if( co1 == CALIB_POS1_NUM ) {
                 hmd_param[left_right].xsize = AR_HMD_XSIZE;
@@ -100,48 +139,131 @@ static void argCalibMouseFunc(int button, int state, int x, int y)
                 hmd_param[left_right].dist_factor[1] = AR_HMD_YSIZE / 2.0;
                 hmd_param[left_right].dist_factor[2] = 0.0;
                 hmd_param[left_right].dist_factor[3] = 1.0;
-                if( arParamGet( (double (*)[3])calib_pos3d, (double (*)[2])calib_pos2d,
-                                 CALIB_POS1_NUM*CALIB_POS2_NUM, hmd_param[left_right].mat) < 0 ) {
-                    (*gCalibPostFunc)( NULL, NULL );
-                    arFittingMode = arFittingModeBak;
-                    glutKeyboardFunc( gKeyFunc );
-                    glutMouseFunc( gMouseFunc );
-                    glutIdleFunc( gMainFunc );
-                    glutDisplayFunc( gMainFunc );
+
+                /* All the samples, unless the thread has solved them already. */
+                calib_solve_wait();
+                if( preview_num == num ) {
+                    memcpy( hmd_param[left_right].mat, preview_mat, sizeof(preview_mat) );
+                }
+                else if( arParamGet( (double (*)[3])calib_pos3d, (double (*)[2])calib_pos2d,
+                                     num, hmd_param[left_right].mat) < 0 ) {
+                    calib_exit( NULL, NULL );
                     return;
                 }
 
                 co1 = 0;
                 co2 = 0;
+                preview_num = 0;
                 left_right++;
                 if( left_right == 2 ) {
                     argLoadHMDparam( &hmd_param[0], &hmd_param[1] );
-                    arFittingMode = arFittingModeBak;
-
-                    if( gCalibPostFunc != NULL ) {
-                        (*gCalibPostFunc)( &hmd_param[0], &hmd_param[1] );
-                    }
-                    glutKeyboardFunc( gKeyFunc );
-                    glutMouseFunc( gMouseFunc );
-                    glutIdleFunc( gMainFunc );
-                    glutDisplayFunc( gMainFunc );
+                    calib_exit( &hmd_param[0], &hmd_param[1] );
                     return;
                 }
             }
+            else if( num >= CALIB_SOLVE_MIN ) {
+                if( solving ) solve_pending = 1;
+                else          calib_solve_start();
+            }
         }
     }
 
     if( button == GLUT_RIGHT_BUTTON  && state == GLUT_DOWN ) {
-        (*gCalibPostFunc)( NULL, NULL );
-        arFittingMode = arFittingMode;
-        glutKeyboardFunc( gKeyFunc );
-        glutMouseFunc( gMouseFunc );
-        glutIdleFunc( gMainFunc );
-        glutDisplayFunc( gMainFunc );
+        calib_exit( NULL, NULL );
         return;
     }
 }
 
+/* Back to the application, with the parameters or NULL. */
+static void calib_exit( ARParam *lpara, ARParam *rpara )
+{
+    calib_solve_wait();
+    arFittingMode = arFittingModeBak;
+    if( gCalibPostFunc != NULL ) (*gCalibPostFunc)( lpara, rpara );
+    glutKeyboardFunc( gKeyFunc );
+    glutMouseFunc( gMouseFunc );
+    glutIdleFunc( gMainFunc );
+    glutDisplayFunc( gMainFunc );
+}
+
+static void calib_solve_run( void )
+{
+    solve.ok   = (arParamGet( solve.pos3d, solve.pos2d, solve.num, solve.mat ) >= 0);
+    solve.done = 1;
+}
+
+#ifdef _WIN32
+static unsigned __stdcall calib_solve_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_BACKGROUND, NULL );
+    calib_solve_run();
+    return 0;
+}
+#else
+static void *calib_solve_thread( void *arg )
+{
+    arThreadRole( AR_THREAD_BACKGROUND, NULL );
+    calib_solve_run();
+    return NULL;
+}
+#endif
+
+/* The solution of a solve that has been joined, if the samples are still
+   those of the eye being calibrated. */
+static void calib_solve_take( void )
+{
+    solving = 0;
+    if( solve.ok && solve.num <= co1*CALIB_POS2_NUM + co2 ) {
+        memcpy( preview_mat, solve.mat, sizeof(preview_mat) );
+        preview_num = solve.num;
+    }
+}
+
+/* A solve of the samples so far, on a copy of them. */
+static void calib_solve_start( void )
+{
+    solve.num = co1*CALIB_POS2_NUM + co2;
+    memcpy( solve.pos3d, calib_pos3d, solve.num*3*sizeof(double) );
+    memcpy( solve.pos2d, calib_pos2d, solve.num*2*sizeof(double) );
+    solve.done = 0;
+    solve_pending = 0;
+#ifdef _WIN32
+    solve_tid = (HANDLE)_beginthreadex( NULL, 0, calib_solve_thread, NULL, 0, NULL );
+    solving = (solve_tid != 0);
+#else
+    solving = (pthread_create( &solve_tid, NULL, calib_solve_thread, NULL ) == 0);
+#endif
+    if( !solving ) {
+        calib_solve_run();
+        calib_solve_take();
+    }
+}
+
+static void calib_solve_join( void )
+{
+#ifdef _WIN32
+    WaitForSingleObject( solve_tid, INFINITE );
+    CloseHandle( solve_tid );
+#else
+    pthread_join( solve_tid, NULL );
+#endif
+    calib_solve_take();
+}
+
+/* Takes a finished solve, and starts the next one if samples came. */
+static void calib_solve_poll( void )
+{
+    if( !solving || !solve.done ) return;
+    calib_solve_join();
+    if( solve_pending ) calib_solve_start();
+}
+
+static void calib_solve_wait( void )
+{
+    if( solving ) calib_solve_join();
+    solve_pending = 0;
+}
+
 static void argCalibMainFunc(void)
 {
     ARUint8         *dataPtr;
@@ -151,6 +273,8 @@ static void argCalibMainFunc(void)
     double          cfmax;
     double          err;
 
+    calib_solve_poll();
+
     /* grab a vide frame */
     if( (dataPtr = (ARUint8 *)arVideoGetImage()) == NULL ) {
         arUtilSleep(2);
@@ -161,12 +285,7 @@ static void argCalibMainFunc(void)
     /* detect the markers in the video frame */
     if( arDetectMarker(dataPtr, thresh,
                        &marker_info, &marker_num) < 0 ) {
-        (*gCalibPostFunc)( NULL, NULL );
-        arFittingMode = arFittingModeBak;
-        glutKeyboardFunc( gKeyFunc );
-        glutMouseFunc( gMouseFunc );
-        glutIdleFunc( gMainFunc );
-        glutDisplayFunc( gMainFunc );
+        calib_exit( NULL, NULL );
         return;
     }
     arVideoCapNext();
@@ -178,7 +297,7 @@ static void argCalibMainFunc(void)
        around the detected squares in the video image */
     if( arDebug && gMiniXnum >= 2 && gMiniYnum >= 1 ) {
         argDispImage( dataPtr, 1, 1 );
-        if( arImageProcMode == AR_IMAGE_PROC_IN_HALF )
+        if( arImageProcMode != AR_IMAGE_PROC_IN_FULL )
             argDispHalfImage( arImage, 2, 1 );
         else
             argDispImage( arImage, 2, 1);
@@ -222,6 +341,7 @@ static void argCalibMainFunc(void)
         if( left_right == 0 ) argDraw2dLeft();
          else                 argDraw2dRight();
         argDrawAttention( calib_pos[co1], co2 );
+        argDrawPreview();
         argDrawMode2D();
 
         if( arDebug && gMiniXnum >= 2 && gMiniYnum >= 1 ) {
@@ -235,6 +355,27 @@ static void argCalibMainFunc(void)
     argSwapBuffers();
 }
 
+/* A cross where the newest solution of the eye puts the target. */
+static void argDrawPreview( void )
+{
+    double   hx, hy, h;
+
+    if( preview_num == 0 ) return;
+    hx = preview_mat[0][0]*target_trans[0][3] + preview_mat[0][1]*target_trans[1][3]
+       + preview_mat[0][2]*target_trans[2][3] + preview_mat[0][3];
+    hy = preview_mat[1][0]*target_trans[0][3] + preview_mat[1][1]*target_trans[1][3]
+       + preview_mat[1][2]*target_trans[2][3] + preview_mat[1][3];
+    h  = preview_mat[2][0]*target_trans[0][3] + preview_mat[2][1]*target_trans[1][3]
+       + preview_mat[2][2]*target_trans[2][3] + preview_mat[2][3];
+    if( h <= 0.0 ) return;
+
+    glColor3f( 1.0, 1.0, 1.0 );
+    glLineWidth( 2.0 );
+    argLineSegHMD( hx/h-10, hy/h, hx/h+10, hy/h );
+    argLineSegHMD( hx/h, hy/h-10, hx/h, hy/h+10 );
+    glLineWidth( 1.0 );
+}
+
 static int  argDrawAttention( double pos[2], int color )
 {
     switch( color%7 ) {
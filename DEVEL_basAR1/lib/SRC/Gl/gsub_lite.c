@@ -48,7 +48,13 @@
 #include <AR/gsub_lite.h>
 
 #include <stdio.h>		// fprintf(), stderr
+#include <stdlib.h>		// calloc(), free(), exit()
+#include <stddef.h>		// ptrdiff_t
 #include <string.h>		// strchr(), strstr(), strlen()
+#include <math.h>		// sqrt()
+#ifdef AR_OPENGL_EGL
+#  include <EGL/egl.h>
+#endif
 #ifndef __APPLE__
 #  include <GL/glu.h>
 #  ifdef GL_VERSION_1_2
@@ -57,6 +63,10 @@
 #else
 #  include <OpenGL/glu.h>
 #  include <OpenGL/glext.h>
+#  include <OpenGL/OpenGL.h>	// CGLSetParameter()
+#  ifdef AR_INPUT_AVFOUNDATION
+#    include <OpenGL/CGLIOSurface.h>
+#  endif
 #endif
 
 // ============================================================================
@@ -116,26 +126,176 @@
 #  define GL_UNSIGNED_SHORT_8_8_MESA		0x85BA
 #  define GL_UNSIGNED_SHORT_8_8_REV_MESA	0x85BB
 #endif
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#  define GL_PIXEL_UNPACK_BUFFER			0x88EC
+#endif
+#ifndef GL_STREAM_DRAW
+#  define GL_STREAM_DRAW					0x88E0
+#endif
+#ifndef GL_ARRAY_BUFFER
+#  define GL_ARRAY_BUFFER					0x8892
+#endif
+#ifndef GL_PIXEL_PACK_BUFFER
+#  define GL_PIXEL_PACK_BUFFER				0x88EB
+#endif
+#ifndef GL_STREAM_READ
+#  define GL_STREAM_READ					0x88E1
+#endif
+#ifndef GL_READ_ONLY
+#  define GL_READ_ONLY						0x88B8
+#endif
+#ifndef GL_FRAMEBUFFER
+#  define GL_FRAMEBUFFER					0x8D40
+#  define GL_RENDERBUFFER					0x8D41
+#  define GL_COLOR_ATTACHMENT0				0x8CE0
+#  define GL_DEPTH_ATTACHMENT				0x8D00
+#  define GL_FRAMEBUFFER_COMPLETE			0x8CD5
+#endif
+#ifndef GL_DEPTH_COMPONENT24
+#  define GL_DEPTH_COMPONENT24				0x81A6
+#endif
+#ifndef GL_STATIC_DRAW
+#  define GL_STATIC_DRAW					0x88E4
+#endif
+
+// Grid of the distortion compensation, the same for all the drawing paths.
+#define ARGL_MESH_DIVISIONS		20
+#define ARGL_MESH_POINTS		((ARGL_MESH_DIVISIONS + 1) * (ARGL_MESH_DIVISIONS + 1))
+#define ARGL_MESH_INDICES		(ARGL_MESH_DIVISIONS * ARGL_MESH_DIVISIONS * 6)
+#define ARGL_MESH_CACHE			4		// Camera parameters kept at once, e.g. one per capture resolution.
+#define ARGL_SHARE_CONTEXTS		4		// Contexts drawing from the objects of one settings.
+#define ARGL_SHARE_PAIRS		16		// Contexts made to share with another, see arglSetupForCurrentContextShared().
+
+// Buffer object entry points (OpenGL 1.5), fetched at runtime as Windows only exports OpenGL 1.1.
+#ifndef APIENTRY
+#  define APIENTRY
+#endif
+typedef void (APIENTRY *ARGL_GL_GEN_BUFFERS)(GLsizei n, GLuint *buffers);
+typedef void (APIENTRY *ARGL_GL_DELETE_BUFFERS)(GLsizei n, const GLuint *buffers);
+typedef void (APIENTRY *ARGL_GL_BIND_BUFFER)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *ARGL_GL_BUFFER_DATA)(GLenum target, ptrdiff_t size, const GLvoid *data, GLenum usage);
+typedef GLvoid *(APIENTRY *ARGL_GL_MAP_BUFFER)(GLenum target, GLenum access);
+typedef GLboolean (APIENTRY *ARGL_GL_UNMAP_BUFFER)(GLenum target);
+
+// Framebuffer object entry points (OpenGL 3.0 or GL_EXT_framebuffer_object) of arglOffscreenCreate().
+typedef void (APIENTRY *ARGL_GL_GEN_FRAMEBUFFERS)(GLsizei n, GLuint *framebuffers);
+typedef void (APIENTRY *ARGL_GL_DELETE_FRAMEBUFFERS)(GLsizei n, const GLuint *framebuffers);
+typedef void (APIENTRY *ARGL_GL_BIND_FRAMEBUFFER)(GLenum target, GLuint framebuffer);
+typedef void (APIENTRY *ARGL_GL_FRAMEBUFFER_RENDERBUFFER)(GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer);
+typedef GLenum (APIENTRY *ARGL_GL_CHECK_FRAMEBUFFER_STATUS)(GLenum target);
+typedef void (APIENTRY *ARGL_GL_GEN_RENDERBUFFERS)(GLsizei n, GLuint *renderbuffers);
+typedef void (APIENTRY *ARGL_GL_DELETE_RENDERBUFFERS)(GLsizei n, const GLuint *renderbuffers);
+typedef void (APIENTRY *ARGL_GL_BIND_RENDERBUFFER)(GLenum target, GLuint renderbuffer);
+typedef void (APIENTRY *ARGL_GL_RENDERBUFFER_STORAGE)(GLenum target, GLenum internalformat, GLsizei width, GLsizei height);
+
+#if defined(_WIN32)
+typedef int (APIENTRY *ARGL_SWAP_INTERVAL)(int interval);	// wglSwapIntervalEXT().
+#elif !defined(__APPLE__)
+typedef int (*ARGL_SWAP_INTERVAL)(int interval);			// glXSwapIntervalSGI().
+#endif
+
+// Shader entry points (OpenGL 2.0) and multitexture (OpenGL 1.3), fetched the same way.
+#ifndef GL_FRAGMENT_SHADER
+#  define GL_FRAGMENT_SHADER				0x8B30
+#endif
+#ifndef GL_COMPILE_STATUS
+#  define GL_COMPILE_STATUS					0x8B81
+#  define GL_LINK_STATUS					0x8B82
+#endif
+#ifndef GL_TEXTURE0
+#  define GL_TEXTURE0						0x84C0
+#endif
+typedef GLuint (APIENTRY *ARGL_GL_CREATE_SHADER)(GLenum type);
+typedef void (APIENTRY *ARGL_GL_SHADER_SOURCE)(GLuint shader, GLsizei count, const char **string, const GLint *length);
+typedef void (APIENTRY *ARGL_GL_COMPILE_SHADER)(GLuint shader);
+typedef void (APIENTRY *ARGL_GL_DELETE_SHADER)(GLuint shader);
+typedef GLuint (APIENTRY *ARGL_GL_CREATE_PROGRAM)(void);
+typedef void (APIENTRY *ARGL_GL_ATTACH_SHADER)(GLuint program, GLuint shader);
+typedef void (APIENTRY *ARGL_GL_LINK_PROGRAM)(GLuint program);
+typedef void (APIENTRY *ARGL_GL_GET_IV)(GLuint object, GLenum pname, GLint *params);
+typedef void (APIENTRY *ARGL_GL_GET_INFO_LOG)(GLuint object, GLsizei bufSize, GLsizei *length, char *infoLog);
+typedef void (APIENTRY *ARGL_GL_DELETE_PROGRAM)(GLuint program);
+typedef void (APIENTRY *ARGL_GL_USE_PROGRAM)(GLuint program);
+typedef GLint (APIENTRY *ARGL_GL_GET_UNIFORM_LOCATION)(GLuint program, const char *name);
+typedef void (APIENTRY *ARGL_GL_UNIFORM_1I)(GLint location, GLint v0);
+typedef void (APIENTRY *ARGL_GL_UNIFORM_2F)(GLint location, GLfloat v0, GLfloat v1);
+typedef void (APIENTRY *ARGL_GL_ACTIVE_TEXTURE)(GLenum texture);
+
+typedef struct {
+	ARGL_GL_CREATE_SHADER			createShader;
+	ARGL_GL_SHADER_SOURCE			shaderSource;
+	ARGL_GL_COMPILE_SHADER			compileShader;
+	ARGL_GL_GET_IV					getShaderiv;
+	ARGL_GL_GET_INFO_LOG			getShaderInfoLog;
+	ARGL_GL_DELETE_SHADER			deleteShader;
+	ARGL_GL_CREATE_PROGRAM			createProgram;
+	ARGL_GL_ATTACH_SHADER			attachShader;
+	ARGL_GL_LINK_PROGRAM			linkProgram;
+	ARGL_GL_GET_IV					getProgramiv;
+	ARGL_GL_GET_INFO_LOG			getProgramInfoLog;
+	ARGL_GL_DELETE_PROGRAM			deleteProgram;
+	ARGL_GL_USE_PROGRAM				useProgram;
+	ARGL_GL_GET_UNIFORM_LOCATION	getUniformLocation;
+	ARGL_GL_UNIFORM_1I				uniform1i;
+	ARGL_GL_UNIFORM_2F				uniform2f;
+	ARGL_GL_ACTIVE_TEXTURE			activeTexture;
+} ARGL_SHADER_PROCS;
+
+// Layouts of the video image the fragment program converts from.
+#define ARGL_SHADER_RGB		0		// Any format the fixed pipeline takes, MONO included.
+#define ARGL_SHADER_YUYV	1		// AR_PIXEL_FORMAT_yuvs.
+#define ARGL_SHADER_UYVY	2		// AR_PIXEL_FORMAT_2vuy.
+#define ARGL_SHADER_NV12	3		// arglDispImageNV12().
+#define ARGL_SHADER_BAYER	4		// arglDispImageBayer().
+#define ARGL_SHADER_LAYOUTS	5
+
+// The distortion compensation of one camera parameter, see arglMeshBuild().
+typedef struct {
+	int		xsize;
+	int		ysize;
+	double	dist_factor[4];
+	GLfloat	mesh[ARGL_MESH_POINTS * 4];	// Ideal vertex x, y, then observed texel x, y, at zoom 1.
+	GLuint	meshBuffer;				// Vertex buffer object of mesh[], 0 if none.
+	GLuint	table;					// Distortion table of the fragment program, 0 until it draws this parameter.
+	unsigned long	used;			// When last drawn, the least recent is replaced.
+} ARGL_MESH;
+
+#if !defined(_WIN32) && !defined(__APPLE__)
+extern void (*glXGetProcAddressARB(const GLubyte *procName))(void);
+extern void *glXGetCurrentContext(void);
+#endif
+
+// A context drawing from the objects of the settings, see arglSetupForCurrentContextShared().
+typedef struct {
+	void	*context;
+	unsigned long	drawn;			// uploadSerial of the image it drew last.
+} ARGL_SHARE;
+
+#ifdef _WIN32
+// The contexts wglShareLists() was called for, once: the settings of several
+// cameras are all of the first context, and the second has objects after the first.
+static void *arglSharePair[ARGL_SHARE_PAIRS][2];
+static int arglSharePairNum = 0;
+#endif
 
 //#define ARGL_DEBUG
 
 struct _ARGL_CONTEXT_SETTINGS {
 	int		texturePow2CapabilitiesChecked;
 	GLuint	texturePow2;
-	GLuint	listPow2;
 	int		initedPow2;
 	int		textureRectangleCapabilitiesChecked;
 	GLuint	textureRectangle;
-	GLuint	listRectangle;
 	int		initedRectangle;
 	int		initPlease;		// Set to TRUE to request re-init of texture etc.
 	int		asInited_texmapScaleFactor;
-	float	asInited_zoom;
 	int		asInited_xsize;
 	int		asInited_ysize;
 	GLsizei	texturePow2SizeX;
 	GLsizei	texturePow2SizeY;
 	GLenum	texturePow2WrapMode;
+	long	texturePow2Bytes;		// Accounted with arMemAdd() while inited.
+	long	textureRectangleBytes;
 	int		disableDistortionCompensation;
 	GLenum	pixIntFormat;
 	GLenum	pixFormat;
@@ -144,9 +304,113 @@ struct _ARGL_CONTEXT_SETTINGS {
 	int	arglDrawMode;
 	int	arglTexmapMode;
 	int arglTexRectangle;	
+	int		pixelBufferObjects;		// Requested with arglPixelBufferObjectsSet(), 0 for none.
+	int		pixelBufferObjectsCapabilitiesChecked;
+	int		pixelBufferObjectsInited;	// Number of pbo[] generated.
+	GLuint	pbo[ARGL_PIXEL_BUFFER_OBJECTS_MAX];
+	int		pboNext;
+	ARGL_GL_GEN_BUFFERS		genBuffers;
+	ARGL_GL_DELETE_BUFFERS	deleteBuffers;
+	ARGL_GL_BIND_BUFFER		bindBuffer;
+	ARGL_GL_BUFFER_DATA		bufferData;
+	ARGL_MESH	mesh[ARGL_MESH_CACHE];
+	int		meshNum;				// Of mesh[] built.
+	unsigned long	meshClock;
+	GLushort	meshIndex[ARGL_MESH_INDICES];	// The same for every mesh.
+	int		meshBufferCapabilitiesChecked;
+	int		meshBuffers;			// The meshes are held in vertex buffer objects.
+	int		arglShader;				// Set with arglShaderSet().
+	AR_PIXEL_FORMAT	arPixelFormat;	// Of arglPixelFormatSet().
+	int		shaderCapabilitiesChecked;
+	ARGL_SHADER_PROCS	shader;
+	GLuint	shaderProgram[ARGL_SHADER_LAYOUTS];	// Compiled on first use, 0 before.
+	GLuint	shaderTexture[2];		// Image (luma for NV12), NV12 chroma; the distortion table is the mesh's.
+	int		initedShader;
+	int		asInitedShader_xsize;
+	int		asInitedShader_ysize;
+	int		asInitedShader_layout;
+#ifdef AR_INPUT_AVFOUNDATION
+	GLuint	textureIOSurface;
+	int		initedIOSurface;
+#endif
+	ARGL_SHARE	share[ARGL_SHARE_CONTEXTS];	// share[0] is the context it was set up for.
+	int		shareNum;
+	const ARUint8	*uploadImage;	// Last uploaded into the textures.
+	unsigned long	uploadSerial;	// Of the uploads, to tell a new frame in the same buffer.
+	int		uploadSkip;				// The image of this draw is in the textures already.
 };
 typedef struct _ARGL_CONTEXT_SETTINGS ARGL_CONTEXT_SETTINGS;
 
+#define ARGL_FRAME_PACER_PERIOD	(1.0 / 60.0)	// Until measured.
+#define ARGL_FRAME_PACER_MARGIN	0.002			// Slack left before the refresh.
+
+struct _ARGL_FRAME_PACER {
+	double	period;			// Refresh period of the display.
+	double	cost;			// Smoothed drawing time, from arglFramePacerBegin() to the swap.
+	double	begin;			// Of the frame being drawn, -1 if none.
+	double	presented;		// Of the last swap, -1 before the first.
+};
+
+struct _ARGL_OFFSCREEN {
+	int		width;
+	int		height;
+	GLuint	framebuffer;
+	GLuint	renderbuffer[2];		// Colour, depth.
+	GLuint	pbo[2];					// Of the readback, 0 if none.
+	int		pboNext;				// Next pbo[] read into.
+	int		pboMapped;				// pbo[] mapped by the last arglOffscreenRead(), -1 if none.
+	int		frames;					// Read into the pbo[] so far.
+	ARUint8	*image;					// Readback without pixel buffer objects.
+	long	glBytes;				// Of the renderbuffers and pbo[], accounted with arMemAdd().
+	ARGL_GL_GEN_FRAMEBUFFERS		genFramebuffers;
+	ARGL_GL_DELETE_FRAMEBUFFERS		deleteFramebuffers;
+	ARGL_GL_BIND_FRAMEBUFFER		bindFramebuffer;
+	ARGL_GL_FRAMEBUFFER_RENDERBUFFER	framebufferRenderbuffer;
+	ARGL_GL_CHECK_FRAMEBUFFER_STATUS	checkFramebufferStatus;
+	ARGL_GL_GEN_RENDERBUFFERS		genRenderbuffers;
+	ARGL_GL_DELETE_RENDERBUFFERS	deleteRenderbuffers;
+	ARGL_GL_BIND_RENDERBUFFER		bindRenderbuffer;
+	ARGL_GL_RENDERBUFFER_STORAGE	renderbufferStorage;
+	ARGL_GL_GEN_BUFFERS		genBuffers;
+	ARGL_GL_DELETE_BUFFERS	deleteBuffers;
+	ARGL_GL_BIND_BUFFER		bindBuffer;
+	ARGL_GL_BUFFER_DATA		bufferData;
+	ARGL_GL_MAP_BUFFER		mapBuffer;
+	ARGL_GL_UNMAP_BUFFER	unmapBuffer;
+#ifdef AR_OPENGL_EGL
+	EGLDisplay	eglDisplay;			// Of the context of our own, EGL_NO_DISPLAY if none.
+	EGLSurface	eglSurface;
+	EGLContext	eglContext;
+#endif
+};
+
+// Template matching, see arglMatch().
+#define ARGL_MATCH_LEN		(AR_PATT_SIZE_Y * AR_PATT_SIZE_X * 3)	// Samples of a pattern.
+#define ARGL_MATCH_TEXELS	(ARGL_MATCH_LEN / 2)					// Two samples of 16 bits per RGBA texel.
+
+struct _ARGL_MATCHER {
+	ARGL_SHADER_PROCS	shader;
+	GLuint	program;				// 0 if the GL cannot match.
+	GLuint	texture[2];				// Library, a row per pattern and direction; patterns of the frame, a row each.
+	GLint	textureMax;				// GL_MAX_TEXTURE_SIZE.
+	ARGL_OFFSCREEN_REF	offscreen;	// A pixel per pattern of the frame across and pattern of the library down.
+	int		serial;					// arGetPattSerial() of the library uploaded, -1 before.
+	int		num;					// Patterns in the library.
+	int		max;					// Room in id[], samples[], pow[] and the texture.
+	int		*id;					// Number of each pattern of the library.
+	ARInt16	(*samples)[4][ARGL_MATCH_LEN];	// The library, for the confidence of the best match.
+	double	(*pow)[4];
+	ARUint8	*upload;				// Rows of texels on their way to texture[].
+	ARUint8	*result;				// Read back from offscreen.
+};
+
+// GL state saved by arglDispImage*() around the drawing.
+typedef struct {
+	GLint		texEnvMode;
+	GLboolean	lighting;
+	GLboolean	depthTest;
+} ARGL_DISP_IMAGE_STATE;
+
 // ============================================================================
 //	Public globals.
 // ============================================================================
@@ -297,23 +561,238 @@ static int arglCleanupTexPow2(ARGL_CONTEXT_SETTINGS_REF contextSettings)
 	if (!contextSettings->initedPow2) return (FALSE);
 	
 	glDeleteTextures(1, &(contextSettings->texturePow2));
-	glDeleteLists(contextSettings->listPow2, 1);
+	arMemAdd(AR_MEM_GSUB, -contextSettings->texturePow2Bytes);
+	contextSettings->texturePow2Bytes = 0;
 	contextSettings->texturePow2CapabilitiesChecked = FALSE;
 	contextSettings->initedPow2 = FALSE;
 	return (TRUE);
 }
 
+#ifndef __APPLE__
+//
+// Fetch an OpenGL entry point, or its ARB extension alternate.
+// (On Mac OS X they are linked directly.)
+//
+static void *arglGLProcAddress(const char *name, const char *nameARB)
+{
+	void *proc;
+
+#if defined(_WIN32)
+	if (!(proc = (void *)wglGetProcAddress(name))) proc = (void *)wglGetProcAddress(nameARB);
+#elif defined(AR_OPENGL_EGL)
+	if (!(proc = (void *)eglGetProcAddress(name))) proc = (void *)eglGetProcAddress(nameARB);
+#else
+	if (!(proc = (void *)glXGetProcAddressARB((const GLubyte *)name))) proc = (void *)glXGetProcAddressARB((const GLubyte *)nameARB);
+#endif
+	return (proc);
+}
+#endif // !__APPLE__
+
+//
+// Fetch the buffer object entry points, shared by pixel and vertex buffer objects.
+//
+static int arglBufferObjectsProcs(ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+#ifdef __APPLE__
+	contextSettings->genBuffers = glGenBuffers;
+	contextSettings->deleteBuffers = glDeleteBuffers;
+	contextSettings->bindBuffer = glBindBuffer;
+	contextSettings->bufferData = (ARGL_GL_BUFFER_DATA)glBufferData;
+#else
+	contextSettings->genBuffers = (ARGL_GL_GEN_BUFFERS)arglGLProcAddress("glGenBuffers", "glGenBuffersARB");
+	contextSettings->deleteBuffers = (ARGL_GL_DELETE_BUFFERS)arglGLProcAddress("glDeleteBuffers", "glDeleteBuffersARB");
+	contextSettings->bindBuffer = (ARGL_GL_BIND_BUFFER)arglGLProcAddress("glBindBuffer", "glBindBufferARB");
+	contextSettings->bufferData = (ARGL_GL_BUFFER_DATA)arglGLProcAddress("glBufferData", "glBufferDataARB");
+#endif
+	return (contextSettings->genBuffers && contextSettings->deleteBuffers && contextSettings->bindBuffer && contextSettings->bufferData);
+}
+
+static int arglPixelBufferObjectsCapabilitiesCheck(ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	if (!arglGLCapabilityCheck(0x0210, (unsigned char *)"GL_ARB_pixel_buffer_object")) {
+		if (!arglGLCapabilityCheck(0, (unsigned char *)"GL_EXT_pixel_buffer_object")) { // Alternate name.
+			return (FALSE);
+		}
+	}
+	return (arglBufferObjectsProcs(contextSettings));
+}
+
+static void arglCleanupPixelBufferObjects(ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	if (!contextSettings->pixelBufferObjectsInited) return;
+	
+	contextSettings->deleteBuffers(contextSettings->pixelBufferObjectsInited, contextSettings->pbo);
+	contextSettings->pixelBufferObjectsInited = 0;
+}
+
+//
+// Upload the image into the bound texture. With pixel buffer objects, the image
+// is copied into the next buffer of the ring and the texture is filled from
+// there by the driver, asynchronously, so the call returns without waiting for
+// the transfer and the image may be given back to the video library at once.
+//
+static void arglTexSubImage(const GLenum target, const GLsizei width, const GLsizei height, const GLenum format, const GLenum type, const ARUint8 *image, const ptrdiff_t size, ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	if (contextSettings->uploadSkip) return;
+	if (contextSettings->pixelBufferObjects && !contextSettings->pixelBufferObjectsCapabilitiesChecked) {
+		contextSettings->pixelBufferObjectsCapabilitiesChecked = TRUE;
+		if (!arglPixelBufferObjectsCapabilitiesCheck(contextSettings)) {
+			printf("argl error: Your OpenGL implementation does not support pixel buffer objects.\n"); // Windows bug: when running multi-threaded, can't write to stderr!
+			contextSettings->pixelBufferObjects = 0;
+		}
+	}
+	if (contextSettings->pixelBufferObjects != contextSettings->pixelBufferObjectsInited) {
+		arglCleanupPixelBufferObjects(contextSettings);
+		if (contextSettings->pixelBufferObjects) {
+			contextSettings->genBuffers(contextSettings->pixelBufferObjects, contextSettings->pbo);
+			contextSettings->pixelBufferObjectsInited = contextSettings->pixelBufferObjects;
+			contextSettings->pboNext = 0;
+		}
+	}
+	
+	if (!contextSettings->pixelBufferObjectsInited) {
+		glTexSubImage2D(target, 0, 0, 0, width, height, format, type, image);
+		return;
+	}
+	
+	contextSettings->bindBuffer(GL_PIXEL_UNPACK_BUFFER, contextSettings->pbo[contextSettings->pboNext]);
+	// New storage for every frame, so that a transfer still reading the buffer is never waited for.
+	contextSettings->bufferData(GL_PIXEL_UNPACK_BUFFER, size, image, GL_STREAM_DRAW);
+	glTexSubImage2D(target, 0, 0, 0, width, height, format, type, (const GLvoid *)0);
+	contextSettings->bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	contextSettings->pboNext = (contextSettings->pboNext + 1) % contextSettings->pixelBufferObjectsInited;
+}
+
+//
+// The grid of the distortion compensation for cparam, computed unless it is one
+// of the grids already held. It does not depend on the zoom, the texture or the
+// texmap mode, so it is built once per camera parameter and kept, in a vertex
+// buffer object where the driver has them. Up to ARGL_MESH_CACHE of them are
+// kept, so that switching between capture resolutions builds nothing.
+//
+static ARGL_MESH *arglMeshBuild(const ARParam *cparam, ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	ARGL_MESH *mesh;
+	GLfloat	*m;
+	GLushort *n;
+	double	x, y;
+	float	px, py;
+	int		i, j, k;
+	
+	for (k = 0; k < contextSettings->meshNum; k++) {
+		mesh = &(contextSettings->mesh[k]);
+		if (cparam->xsize == mesh->xsize && cparam->ysize == mesh->ysize &&
+			memcmp(cparam->dist_factor, mesh->dist_factor, sizeof(mesh->dist_factor)) == 0) {
+			mesh->used = ++contextSettings->meshClock;
+			return (mesh);
+		}
+	}
+	
+	if (contextSettings->meshNum < ARGL_MESH_CACHE) {
+		mesh = &(contextSettings->mesh[contextSettings->meshNum++]);
+	} else {
+		mesh = &(contextSettings->mesh[0]);
+		for (k = 1; k < ARGL_MESH_CACHE; k++) {
+			if (contextSettings->mesh[k].used < mesh->used) mesh = &(contextSettings->mesh[k]);
+		}
+		// Its buffer object is refilled below, its table rebuilt when next drawn.
+		if (mesh->table) glDeleteTextures(1, &(mesh->table));
+		mesh->table = 0;
+	}
+	
+	m = mesh->mesh;
+	for (j = 0; j <= ARGL_MESH_DIVISIONS; j++) {
+		py = cparam->ysize * j / (float)ARGL_MESH_DIVISIONS;
+		for (i = 0; i <= ARGL_MESH_DIVISIONS; i++) {
+			px = cparam->xsize * i / (float)ARGL_MESH_DIVISIONS;
+			arParamObserv2Ideal(cparam->dist_factor, (double)px, (double)py, &x, &y);
+			*m++ = (float)x;
+			*m++ = cparam->ysize - (float)y;
+			*m++ = px;
+			*m++ = py;
+		}
+	}
+	
+	if (!contextSettings->meshBufferCapabilitiesChecked) {
+		contextSettings->meshBufferCapabilitiesChecked = TRUE;
+		n = contextSettings->meshIndex;
+		for (j = 0; j < ARGL_MESH_DIVISIONS; j++) {
+			for (i = 0; i < ARGL_MESH_DIVISIONS; i++) {
+				k = j * (ARGL_MESH_DIVISIONS + 1) + i;
+				*n++ = (GLushort)k; *n++ = (GLushort)(k + 1); *n++ = (GLushort)(k + ARGL_MESH_DIVISIONS + 2);
+				*n++ = (GLushort)k; *n++ = (GLushort)(k + ARGL_MESH_DIVISIONS + 2); *n++ = (GLushort)(k + ARGL_MESH_DIVISIONS + 1);
+			}
+		}
+		contextSettings->meshBuffers = arglGLCapabilityCheck(0x0150, (unsigned char *)"GL_ARB_vertex_buffer_object") && arglBufferObjectsProcs(contextSettings);
+	}
+	if (contextSettings->meshBuffers) {
+		if (!mesh->meshBuffer) contextSettings->genBuffers(1, &(mesh->meshBuffer));
+		contextSettings->bindBuffer(GL_ARRAY_BUFFER, mesh->meshBuffer);
+		contextSettings->bufferData(GL_ARRAY_BUFFER, sizeof(mesh->mesh), mesh->mesh, GL_STATIC_DRAW);
+		contextSettings->bindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	
+	mesh->xsize = cparam->xsize;
+	mesh->ysize = cparam->ysize;
+	memcpy(mesh->dist_factor, cparam->dist_factor, sizeof(mesh->dist_factor));
+	mesh->used = ++contextSettings->meshClock;
+	return (mesh);
+}
+
+//
+// Draw the bound texture of the image, with or without the distortion compensation.
+// Texel coordinates are in image pixels, scaled by texScaleX and texScaleY.
+//
+static void arglDispImageMesh(const GLenum target, const ARParam *cparam, const float zoom, const float texScaleX, const float texScaleY, ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	ARGL_MESH *mesh;
+	const char *base;
+	
+	glEnable(target);
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glScalef(texScaleX, texScaleY, 1.0f);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glScalef(zoom, zoom, 1.0f);
+	
+	if (contextSettings->disableDistortionCompensation) {
+		glBegin(GL_QUADS);
+		glTexCoord2f(0.0f, (float)cparam->ysize); glVertex2f(0.0f, 0.0f);
+		glTexCoord2f((float)cparam->xsize, (float)cparam->ysize); glVertex2f((float)cparam->xsize, 0.0f);
+		glTexCoord2f((float)cparam->xsize, 0.0f); glVertex2f((float)cparam->xsize, (float)cparam->ysize);
+		glTexCoord2f(0.0f, 0.0f); glVertex2f(0.0f, (float)cparam->ysize);
+		glEnd();
+	} else {
+		mesh = arglMeshBuild(cparam, contextSettings);
+		if (mesh->meshBuffer) {
+			contextSettings->bindBuffer(GL_ARRAY_BUFFER, mesh->meshBuffer);
+			base = (const char *)0;
+		} else {
+			base = (const char *)mesh->mesh;
+		}
+		glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glVertexPointer(2, GL_FLOAT, 4 * sizeof(GLfloat), base);
+		glTexCoordPointer(2, GL_FLOAT, 4 * sizeof(GLfloat), base + 2 * sizeof(GLfloat));
+		glDrawElements(GL_TRIANGLES, ARGL_MESH_INDICES, GL_UNSIGNED_SHORT, contextSettings->meshIndex);
+		glPopClientAttrib();
+		if (mesh->meshBuffer) contextSettings->bindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	
+	glPopMatrix();
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glDisable(target);
+}
+
 //
 // Blit an image to the screen using OpenGL power-of-two texturing.
 //
 static void arglDispImageTexPow2(ARUint8 *image, const ARParam *cparam, const float zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings, const int texmapScaleFactor)
 {
-    float	tsx, tsy, tex, tey;
-    float	px, py, qx, qy;
-    double	x1, x2, x3, x4, y1, y2, y3, y4;
-    float	xx1, xx2, xx3, xx4, yy1, yy2, yy3, yy4;
-    int		i, j;
-
     if(!contextSettings->initedPow2 || contextSettings->initPlease) {
 
 		contextSettings->initPlease = FALSE;
@@ -363,73 +842,12 @@ static void arglDispImageTexPow2(ARUint8 *image, const ARParam *cparam, const fl
 			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 		}
 		
-		// Set up the surface which we will texture upon.
-		contextSettings->listPow2 = glGenLists(1);
-		glNewList(contextSettings->listPow2, GL_COMPILE); // NB Texture not specified yet so don't execute.
-		glEnable(GL_TEXTURE_2D);
-		glMatrixMode(GL_TEXTURE);
-		glLoadIdentity();
-		glMatrixMode(GL_MODELVIEW);
-
-		if (contextSettings->disableDistortionCompensation) {
-			glBegin(GL_QUADS);
-			glTexCoord2f(0.0f, (float)cparam->ysize/(float)contextSettings->texturePow2SizeY);
-			glVertex2f(0.0f, 0.0f);
-			glTexCoord2f((float)cparam->xsize/(float)contextSettings->texturePow2SizeX, (float)cparam->ysize/(float)contextSettings->texturePow2SizeY);
-			glVertex2f((float)cparam->xsize * zoom, 0.0f);
-			glTexCoord2f((float)cparam->xsize/(float)contextSettings->texturePow2SizeX, 0.0f);
-			glVertex2f((float)cparam->xsize * zoom, (float)cparam->ysize * zoom);
-			glTexCoord2f(0.0f, 0.0f);
-			glVertex2f(0.0f, (float)cparam->ysize * zoom);
-			glEnd();
-		} else {
-			qy = 0.0f;
-			tey = 0.0f;
-			for(j = 1; j <= 20; j++) {	// Do 20 rows.
-				py = qy;
-				tsy = tey;
-				qy = cparam->ysize * j / 20.0f;
-				tey = qy / contextSettings->texturePow2SizeY;
-				
-				qx = 0.0f;
-				tex = 0.0f;
-				for(i = 1; i <= 20; i++) {	// Draw 20 columns.
-					px = qx;
-					tsx = tex;
-					qx = cparam->xsize * i / 20.0f;
-					tex = qx / contextSettings->texturePow2SizeX;
-					
-					arParamObserv2Ideal(cparam->dist_factor, (double)px, (double)py, &x1, &y1);
-					arParamObserv2Ideal(cparam->dist_factor, (double)qx, (double)py, &x2, &y2);
-					arParamObserv2Ideal(cparam->dist_factor, (double)qx, (double)qy, &x3, &y3);
-					arParamObserv2Ideal(cparam->dist_factor, (double)px, (double)qy, &x4, &y4);
-					
-					xx1 = (float)x1 * zoom;
-					yy1 = (cparam->ysize - (float)y1) * zoom;
-					xx2 = (float)x2 * zoom;
-					yy2 = (cparam->ysize - (float)y2) * zoom;
-					xx3 = (float)x3 * zoom;
-					yy3 = (cparam->ysize - (float)y3) * zoom;
-					xx4 = (float)x4 * zoom;
-					yy4 = (cparam->ysize - (float)y4) * zoom;
-					
-					glBegin(GL_QUADS);
-					glTexCoord2f(tsx, tsy); glVertex2f(xx1, yy1);
-					glTexCoord2f(tex, tsy); glVertex2f(xx2, yy2);
-					glTexCoord2f(tex, tey); glVertex2f(xx3, yy3);
-					glTexCoord2f(tsx, tey); glVertex2f(xx4, yy4);
-					glEnd();
-				} // columns.
-			} // rows.
-		}
-		glDisable(GL_TEXTURE_2D);
-        glEndList();
-
 		contextSettings->asInited_ysize = cparam->ysize;
 		contextSettings->asInited_xsize = cparam->xsize;
-		contextSettings->asInited_zoom = zoom;
         contextSettings->asInited_texmapScaleFactor = texmapScaleFactor;
 		contextSettings->initedPow2 = TRUE;
+		contextSettings->texturePow2Bytes = (long)contextSettings->texturePow2SizeX * (contextSettings->texturePow2SizeY/texmapScaleFactor) * contextSettings->pixSize;
+		arMemAdd(AR_MEM_GSUB, contextSettings->texturePow2Bytes);
 	}
 
     glBindTexture(GL_TEXTURE_2D, contextSettings->texturePow2);
@@ -448,8 +866,9 @@ static void arglDispImageTexPow2(ARUint8 *image, const ARParam *cparam, const fl
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, cparam->xsize*texmapScaleFactor);
 	}
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, cparam->xsize, cparam->ysize/texmapScaleFactor, contextSettings->pixFormat, contextSettings->pixType, image);
-	glCallList(contextSettings->listPow2);
+	arglTexSubImage(GL_TEXTURE_2D, cparam->xsize, cparam->ysize/texmapScaleFactor, contextSettings->pixFormat, contextSettings->pixType,
+					image, (ptrdiff_t)cparam->xsize * cparam->ysize * contextSettings->pixSize, contextSettings);
+	arglDispImageMesh(GL_TEXTURE_2D, cparam, zoom, 1.0f/(float)contextSettings->texturePow2SizeX, 1.0f/(float)contextSettings->texturePow2SizeY, contextSettings);
 	if (texmapScaleFactor == 2) {
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 	}
@@ -486,7 +905,8 @@ static int arglCleanupTexRectangle(ARGL_CONTEXT_SETTINGS_REF contextSettings)
 	if (!contextSettings->initedRectangle) return (FALSE);
 	
 	glDeleteTextures(1, &(contextSettings->textureRectangle));
-	glDeleteLists(contextSettings->listRectangle, 1);
+	arMemAdd(AR_MEM_GSUB, -contextSettings->textureRectangleBytes);
+	contextSettings->textureRectangleBytes = 0;
 	contextSettings->textureRectangleCapabilitiesChecked = FALSE;
 	contextSettings->initedRectangle = FALSE;
 	return (TRUE);
@@ -497,11 +917,6 @@ static int arglCleanupTexRectangle(ARGL_CONTEXT_SETTINGS_REF contextSettings)
 //
 static void arglDispImageTexRectangle(ARUint8 *image, const ARParam *cparam, const float zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings, const int texmapScaleFactor)
 {
-	float	px, py, py_prev;
-    double	x1, x2, y1, y2;
-    float	xx1, xx2, yy1, yy2;
-	int		i, j;
-	
     if(!contextSettings->initedRectangle || contextSettings->initPlease) {
 		
 		contextSettings->initPlease = FALSE;
@@ -557,54 +972,13 @@ static void arglDispImageTexRectangle(ARUint8 *image, const ARParam *cparam, con
 		if (texmapScaleFactor == 2) {
 			glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 		}
-		
-		// Set up the surface which we will texture upon.
-		contextSettings->listRectangle = glGenLists(1);
-		glNewList(contextSettings->listRectangle, GL_COMPILE);
-		glEnable(GL_TEXTURE_RECTANGLE);
-		glMatrixMode(GL_TEXTURE);
-		glLoadIdentity();
-		glMatrixMode(GL_MODELVIEW);
-		
-		if (contextSettings->disableDistortionCompensation) {
-			glBegin(GL_QUADS);
-			glTexCoord2f(0.0f, (float)(cparam->ysize/texmapScaleFactor)); glVertex2f(0.0f, 0.0f);
-			glTexCoord2f((float)(cparam->xsize), (float)(cparam->ysize/texmapScaleFactor)); glVertex2f(cparam->xsize * zoom, 0.0f);
-			glTexCoord2f((float)(cparam->xsize), 0.0f); glVertex2f(cparam->xsize * zoom, cparam->ysize * zoom);
-			glTexCoord2f(0.0f, 0.0f); glVertex2f(0.0f, cparam->ysize * zoom);
-			glEnd();
-		} else {
-			py_prev = 0.0f;
-			for(j = 1; j <= 20; j++) {	// Do 20 rows.
-				py = py_prev;
-				py_prev = cparam->ysize * j / 20.0f;
-				
-				glBegin(GL_QUAD_STRIP);
-				for(i = 0; i <= 20; i++) {	// Draw 21 pairs of vertices per row to make 20 columns.
-					px = cparam->xsize * i / 20.0f;
-					
-					arParamObserv2Ideal(cparam->dist_factor, (double)px, (double)py, &x1, &y1);
-					arParamObserv2Ideal(cparam->dist_factor, (double)px, (double)py_prev, &x2, &y2);
-					
-					xx1 = (float)x1 * zoom;
-					yy1 = (cparam->ysize - (float)y1) * zoom;
-					xx2 = (float)x2 * zoom;
-					yy2 = (cparam->ysize - (float)y2) * zoom;
-					
-					glTexCoord2f(px, py/texmapScaleFactor); glVertex2f(xx1, yy1);
-					glTexCoord2f(px, py_prev/texmapScaleFactor); glVertex2f(xx2, yy2);
-				}
-				glEnd();
-			}			
-		}
-		glDisable(GL_TEXTURE_RECTANGLE);
-		glEndList();
 
 		contextSettings->asInited_ysize = cparam->ysize;
 		contextSettings->asInited_xsize = cparam->xsize;
-		contextSettings->asInited_zoom = zoom;
         contextSettings->asInited_texmapScaleFactor = texmapScaleFactor;
         contextSettings->initedRectangle = TRUE;
+		contextSettings->textureRectangleBytes = (long)cparam->xsize * (cparam->ysize/texmapScaleFactor) * contextSettings->pixSize;
+		arMemAdd(AR_MEM_GSUB, contextSettings->textureRectangleBytes);
     }
 
     glBindTexture(GL_TEXTURE_RECTANGLE, contextSettings->textureRectangle);
@@ -624,14 +998,391 @@ static void arglDispImageTexRectangle(ARUint8 *image, const ARParam *cparam, con
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, cparam->xsize*texmapScaleFactor);
 	}
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	glTexSubImage2D(GL_TEXTURE_RECTANGLE, 0, 0, 0, cparam->xsize, cparam->ysize/texmapScaleFactor, contextSettings->pixFormat, contextSettings->pixType, image);
-	glCallList(contextSettings->listRectangle);
+	arglTexSubImage(GL_TEXTURE_RECTANGLE, cparam->xsize, cparam->ysize/texmapScaleFactor, contextSettings->pixFormat, contextSettings->pixType,
+					image, (ptrdiff_t)cparam->xsize * cparam->ysize * contextSettings->pixSize, contextSettings);
+	arglDispImageMesh(GL_TEXTURE_RECTANGLE, cparam, zoom, 1.0f, 1.0f/(float)texmapScaleFactor, contextSettings);
 	if (texmapScaleFactor == 2) {
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 	}
     glBindTexture(GL_TEXTURE_RECTANGLE, 0);	
 }
 
+//
+// Fragment program for the video image. gl_TexCoord[0] is the ideal (undistorted)
+// position of the fragment in image pixels, row 0 at the top. The distortion table
+// holds, for every ideal pixel, the observed position it was seen at: x and y, each
+// as 16 bits over [-size/2, 3*size/2), high byte first. YCbCr is converted by ITU-R
+// BT.601 with video range levels. Bayer frames are demosaiced as by the video
+// modules: each 2x2 tile takes its own R and B, and the G of the column; bayer
+// is the position of R in the tile. With thresh not negative, for arglBinarize(), the
+// output is white where the image is darker than thresh, as binarized by libAR: the
+// mean of R, G and B, or the luma of YCbCr, and black elsewhere.
+//
+static const char *arglShaderSource =
+	"uniform sampler2D image;\n"
+	"uniform sampler2D table;\n"
+	"uniform sampler2D chroma;\n"
+	"uniform vec2 size;\n"
+	"uniform vec2 bayer;\n"
+	"uniform int undistort;\n"
+	"uniform int thresh;\n"
+	"void main()\n"
+	"{\n"
+	"	vec2 p = gl_TexCoord[0].xy;\n"
+	"	if (undistort != 0) {\n"
+	"		vec4 e = texture2D(table, p / size);\n"
+	"		p = (vec2(e.r * 65280.0 + e.g * 255.0, e.b * 65280.0 + e.a * 255.0) / 32767.5 - 0.5) * size;\n"
+	"		if (p.x < 0.0 || p.y < 0.0 || p.x >= size.x || p.y >= size.y) discard;\n"
+	"	}\n"
+	"#if defined(ARGL_YUYV) || defined(ARGL_UYVY)\n"
+	"	float x0 = floor(p.x) - mod(floor(p.x), 2.0);\n"
+	"	vec4 t  = texture2D(image, p / size);\n"
+	"	vec4 t0 = texture2D(image, vec2(x0 + 0.5, p.y) / size);\n"
+	"	vec4 t1 = texture2D(image, vec2(x0 + 1.5, p.y) / size);\n"
+	"#  ifdef ARGL_YUYV\n"
+	"	vec3 yuv = vec3(t.r, t0.a, t1.a);\n"
+	"#  else\n"
+	"	vec3 yuv = vec3(t.a, t0.r, t1.r);\n"
+	"#  endif\n"
+	"#elif defined(ARGL_NV12)\n"
+	"	vec4 c = texture2D(chroma, p / size);\n"
+	"	vec3 yuv = vec3(texture2D(image, p / size).r, c.r, c.a);\n"
+	"#elif defined(ARGL_BAYER)\n"
+	"	vec2 q = mod(floor(p), 2.0);\n"
+	"	vec2 o = floor(p) - q + 0.5;\n"
+	"	vec2 g = vec2(q.x, (q.x == bayer.x) ? 1.0 - bayer.y : bayer.y);\n"
+	"#endif\n"
+	"#ifdef ARGL_RGB\n"
+	"	vec3 c = texture2D(image, p / size).rgb;\n"
+	"	float l = (c.r + c.g + c.b) / 3.0;\n"
+	"#elif defined(ARGL_BAYER)\n"
+	"	vec3 c = vec3(texture2D(image, (o + bayer) / size).r, texture2D(image, (o + g) / size).r,\n"
+	"				  texture2D(image, (o + 1.0 - bayer) / size).r);\n"
+	"	float l = (c.r + c.g + c.b) / 3.0;\n"
+	"#else\n"
+	"	float y = 1.1644 * (yuv.x - 0.0627);\n"
+	"	float u = yuv.y - 0.5;\n"
+	"	float v = yuv.z - 0.5;\n"
+	"	vec3 c = vec3(y + 1.5960 * v, y - 0.3918 * u - 0.8130 * v, y + 2.0172 * u);\n"
+	"	float l = yuv.x;\n"
+	"#endif\n"
+	"	if (thresh >= 0) gl_FragColor = vec4(vec3(l * 255.0 < float(thresh) ? 1.0 : 0.0), 1.0);\n"
+	"	else gl_FragColor = vec4(c, 1.0);\n"
+	"}\n";
+
+static int arglShaderCapabilitiesCheck(ARGL_SHADER_PROCS *sp)
+{
+	if (!arglGLCapabilityCheck(0x0200, NULL)) return (FALSE); // Fragment programs, multitexture and non power-of-two textures.
+#ifdef __APPLE__
+	sp->createShader = glCreateShader;
+	sp->shaderSource = (ARGL_GL_SHADER_SOURCE)glShaderSource;
+	sp->compileShader = glCompileShader;
+	sp->getShaderiv = glGetShaderiv;
+	sp->getShaderInfoLog = (ARGL_GL_GET_INFO_LOG)glGetShaderInfoLog;
+	sp->deleteShader = glDeleteShader;
+	sp->createProgram = glCreateProgram;
+	sp->attachShader = glAttachShader;
+	sp->linkProgram = glLinkProgram;
+	sp->getProgramiv = glGetProgramiv;
+	sp->getProgramInfoLog = (ARGL_GL_GET_INFO_LOG)glGetProgramInfoLog;
+	sp->deleteProgram = glDeleteProgram;
+	sp->useProgram = glUseProgram;
+	sp->getUniformLocation = (ARGL_GL_GET_UNIFORM_LOCATION)glGetUniformLocation;
+	sp->uniform1i = glUniform1i;
+	sp->uniform2f = glUniform2f;
+	sp->activeTexture = glActiveTexture;
+#else
+	sp->createShader = (ARGL_GL_CREATE_SHADER)arglGLProcAddress("glCreateShader", "glCreateShader");
+	sp->shaderSource = (ARGL_GL_SHADER_SOURCE)arglGLProcAddress("glShaderSource", "glShaderSource");
+	sp->compileShader = (ARGL_GL_COMPILE_SHADER)arglGLProcAddress("glCompileShader", "glCompileShader");
+	sp->getShaderiv = (ARGL_GL_GET_IV)arglGLProcAddress("glGetShaderiv", "glGetShaderiv");
+	sp->getShaderInfoLog = (ARGL_GL_GET_INFO_LOG)arglGLProcAddress("glGetShaderInfoLog", "glGetShaderInfoLog");
+	sp->deleteShader = (ARGL_GL_DELETE_SHADER)arglGLProcAddress("glDeleteShader", "glDeleteShader");
+	sp->createProgram = (ARGL_GL_CREATE_PROGRAM)arglGLProcAddress("glCreateProgram", "glCreateProgram");
+	sp->attachShader = (ARGL_GL_ATTACH_SHADER)arglGLProcAddress("glAttachShader", "glAttachShader");
+	sp->linkProgram = (ARGL_GL_LINK_PROGRAM)arglGLProcAddress("glLinkProgram", "glLinkProgram");
+	sp->getProgramiv = (ARGL_GL_GET_IV)arglGLProcAddress("glGetProgramiv", "glGetProgramiv");
+	sp->getProgramInfoLog = (ARGL_GL_GET_INFO_LOG)arglGLProcAddress("glGetProgramInfoLog", "glGetProgramInfoLog");
+	sp->deleteProgram = (ARGL_GL_DELETE_PROGRAM)arglGLProcAddress("glDeleteProgram", "glDeleteProgram");
+	sp->useProgram = (ARGL_GL_USE_PROGRAM)arglGLProcAddress("glUseProgram", "glUseProgram");
+	sp->getUniformLocation = (ARGL_GL_GET_UNIFORM_LOCATION)arglGLProcAddress("glGetUniformLocation", "glGetUniformLocation");
+	sp->uniform1i = (ARGL_GL_UNIFORM_1I)arglGLProcAddress("glUniform1i", "glUniform1i");
+	sp->uniform2f = (ARGL_GL_UNIFORM_2F)arglGLProcAddress("glUniform2f", "glUniform2f");
+	sp->activeTexture = (ARGL_GL_ACTIVE_TEXTURE)arglGLProcAddress("glActiveTexture", "glActiveTextureARB");
+#endif
+	return (sp->createShader && sp->shaderSource && sp->compileShader && sp->getShaderiv && sp->getShaderInfoLog &&
+			sp->deleteShader && sp->createProgram && sp->attachShader && sp->linkProgram && sp->getProgramiv &&
+			sp->getProgramInfoLog && sp->deleteProgram && sp->useProgram && sp->getUniformLocation &&
+			sp->uniform1i && sp->uniform2f && sp->activeTexture);
+}
+
+//
+// Compile and link the fragment program for one image layout. Returns 0 on error.
+//
+static GLuint arglShaderProgram(ARGL_CONTEXT_SETTINGS_REF contextSettings, const int layout)
+{
+	static const char *defines[ARGL_SHADER_LAYOUTS] = {
+		"#define ARGL_RGB\n", "#define ARGL_YUYV\n", "#define ARGL_UYVY\n", "#define ARGL_NV12\n", "#define ARGL_BAYER\n"
+	};
+	ARGL_SHADER_PROCS *sp = &(contextSettings->shader);
+	const char *source[2];
+	GLuint shader, program;
+	GLint status;
+	char log[512];
+
+	source[0] = defines[layout];
+	source[1] = arglShaderSource;
+	shader = sp->createShader(GL_FRAGMENT_SHADER);
+	sp->shaderSource(shader, 2, source, NULL);
+	sp->compileShader(shader);
+	sp->getShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		sp->getShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("argl error: fragment program did not compile: %s\n", log);
+		sp->deleteShader(shader);
+		return (0);
+	}
+	program = sp->createProgram();
+	sp->attachShader(program, shader);
+	sp->linkProgram(program);
+	sp->deleteShader(shader); // Goes with the program.
+	sp->getProgramiv(program, GL_LINK_STATUS, &status);
+	if (!status) {
+		sp->getProgramInfoLog(program, sizeof(log), NULL, log);
+		printf("argl error: fragment program did not link: %s\n", log);
+		sp->deleteProgram(program);
+		return (0);
+	}
+	sp->useProgram(program);
+	sp->uniform1i(sp->getUniformLocation(program, "image"), 0);
+	sp->uniform1i(sp->getUniformLocation(program, "table"), 1);
+	sp->uniform1i(sp->getUniformLocation(program, "chroma"), 2);
+	sp->useProgram(0);
+	return (program);
+}
+
+static void arglCleanupShader(ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	int i;
+
+	for (i = 0; i < ARGL_SHADER_LAYOUTS; i++) {
+		if (contextSettings->shaderProgram[i]) contextSettings->shader.deleteProgram(contextSettings->shaderProgram[i]);
+		contextSettings->shaderProgram[i] = 0;
+	}
+	if (contextSettings->initedShader) glDeleteTextures(2, contextSettings->shaderTexture);
+	contextSettings->initedShader = FALSE;
+}
+
+//
+// Fill the distortion table of the bound texture: the observed position of
+// every ideal pixel, see arglShaderSource.
+//
+static void arglShaderTable(const ARParam *cparam)
+{
+	ARUint8 *table, *p;
+	double ox, oy;
+	int i, j, x, y;
+
+	if (!(table = (ARUint8 *)malloc(cparam->xsize * cparam->ysize * 4))) {
+		printf("argl error: out of memory.\n");
+		return;
+	}
+	p = table;
+	for (j = 0; j < cparam->ysize; j++) {
+		for (i = 0; i < cparam->xsize; i++) {
+			arParamIdeal2Observ(cparam->dist_factor, (double)i + 0.5, (double)j + 0.5, &ox, &oy);
+			x = (int)((ox / cparam->xsize + 0.5) * 32767.5);
+			y = (int)((oy / cparam->ysize + 0.5) * 32767.5);
+			if (x < 0) x = 0; else if (x > 65535) x = 65535;
+			if (y < 0) y = 0; else if (y > 65535) y = 65535;
+			*p++ = (ARUint8)(x >> 8);
+			*p++ = (ARUint8)(x & 0xff);
+			*p++ = (ARUint8)(y >> 8);
+			*p++ = (ARUint8)(y & 0xff);
+		}
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, cparam->xsize, cparam->ysize, 0, GL_RGBA, GL_UNSIGNED_BYTE, table);
+	free(table);
+}
+
+static void arglShaderTextureSetup(GLuint texture)
+{
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+//
+// Draw an image with the fragment program: the raw planes are uploaded (through
+// the pixel buffer objects, if set) and the colour conversion and the distortion
+// compensation are done by the GPU. chroma is the CbCr plane of an NV12 image,
+// NULL otherwise. bayer is the position of R in the tiles of a Bayer frame, -1
+// otherwise. thresh is that of arglBinarize(), -1 to draw the image itself.
+// Returns FALSE if the GL cannot run the program.
+//
+static int arglDispImageShader(ARUint8 *image, ARUint8 *chroma, const int bayer, const ARParam *cparam, const float zoom, const int thresh, ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	ARGL_SHADER_PROCS *sp = &(contextSettings->shader);
+	GLenum intFormat, format, type;
+	ARGL_MESH *mesh;
+	GLuint program;
+	int layout;
+
+	if (!contextSettings->shaderCapabilitiesChecked) {
+		contextSettings->shaderCapabilitiesChecked = TRUE;
+		if (!arglShaderCapabilitiesCheck(sp)) {
+			printf("argl error: Your OpenGL implementation does not support OpenGL 2.0 fragment programs.\n"); // Windows bug: when running multi-threaded, can't write to stderr!
+			contextSettings->arglShader = FALSE;
+			return (FALSE);
+		}
+	} else if (!sp->useProgram) {
+		return (FALSE);
+	}
+
+	if (chroma) layout = ARGL_SHADER_NV12;
+	else if (bayer >= 0) layout = ARGL_SHADER_BAYER;
+	else if (contextSettings->arPixelFormat == AR_PIXEL_FORMAT_yuvs) layout = ARGL_SHADER_YUYV;
+	else if (contextSettings->arPixelFormat == AR_PIXEL_FORMAT_2vuy) layout = ARGL_SHADER_UYVY;
+	else layout = ARGL_SHADER_RGB;
+	if (layout == ARGL_SHADER_NV12 || layout == ARGL_SHADER_BAYER) {
+		intFormat = format = GL_LUMINANCE;
+		type = GL_UNSIGNED_BYTE;
+	} else if (layout != ARGL_SHADER_RGB) {
+		// Two bytes per pixel, Y in one, alternately Cb and Cr in the other.
+		intFormat = format = GL_LUMINANCE_ALPHA;
+		type = GL_UNSIGNED_BYTE;
+	} else {
+		intFormat = contextSettings->pixIntFormat;
+		format = contextSettings->pixFormat;
+		type = contextSettings->pixType;
+	}
+	if (!contextSettings->shaderProgram[layout]) {
+		if (!(contextSettings->shaderProgram[layout] = arglShaderProgram(contextSettings, layout))) {
+			contextSettings->arglShader = FALSE;
+			return (FALSE);
+		}
+	}
+	program = contextSettings->shaderProgram[layout];
+
+	if (!contextSettings->initedShader) {
+		glGenTextures(2, contextSettings->shaderTexture);
+		sp->activeTexture(GL_TEXTURE0 + 2);
+		arglShaderTextureSetup(contextSettings->shaderTexture[1]);
+		sp->activeTexture(GL_TEXTURE0);
+		arglShaderTextureSetup(contextSettings->shaderTexture[0]);
+		contextSettings->asInitedShader_layout = -1;
+		contextSettings->initedShader = TRUE;
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	
+	// The distortion table is kept with the mesh of cparam, built the first time it is drawn.
+	mesh = arglMeshBuild(cparam, contextSettings);
+	sp->activeTexture(GL_TEXTURE0 + 1);
+	if (!mesh->table) {
+		glGenTextures(1, &(mesh->table));
+		arglShaderTextureSetup(mesh->table);
+		arglShaderTable(cparam);
+	}
+
+	// (Re)allocate the textures when the image changes.
+	if (cparam->xsize != contextSettings->asInitedShader_xsize ||
+		cparam->ysize != contextSettings->asInitedShader_ysize ||
+		layout != contextSettings->asInitedShader_layout) {
+		if (layout == ARGL_SHADER_NV12) {
+			sp->activeTexture(GL_TEXTURE0 + 2);
+			glBindTexture(GL_TEXTURE_2D, contextSettings->shaderTexture[1]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE_ALPHA, cparam->xsize/2, cparam->ysize/2, 0, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE, NULL);
+		}
+		sp->activeTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, contextSettings->shaderTexture[0]);
+		glTexImage2D(GL_TEXTURE_2D, 0, intFormat, cparam->xsize, cparam->ysize, 0, format, type, NULL);
+		contextSettings->asInitedShader_xsize = cparam->xsize;
+		contextSettings->asInitedShader_ysize = cparam->ysize;
+		contextSettings->asInitedShader_layout = layout;
+	}
+
+	// Upload only; everything else is done per fragment.
+	sp->activeTexture(GL_TEXTURE0 + 1);
+	glBindTexture(GL_TEXTURE_2D, mesh->table);
+	if (layout == ARGL_SHADER_NV12) {
+		sp->activeTexture(GL_TEXTURE0 + 2);
+		glBindTexture(GL_TEXTURE_2D, contextSettings->shaderTexture[1]);
+		arglTexSubImage(GL_TEXTURE_2D, cparam->xsize/2, cparam->ysize/2, GL_LUMINANCE_ALPHA, GL_UNSIGNED_BYTE,
+						chroma, (ptrdiff_t)(cparam->xsize/2) * (cparam->ysize/2) * 2, contextSettings);
+	}
+	sp->activeTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, contextSettings->shaderTexture[0]);
+	arglTexSubImage(GL_TEXTURE_2D, cparam->xsize, cparam->ysize, format, type,
+					image, (ptrdiff_t)cparam->xsize * cparam->ysize * ((format == GL_LUMINANCE) ? 1 : contextSettings->pixSize), contextSettings);
+
+	sp->useProgram(program);
+	sp->uniform2f(sp->getUniformLocation(program, "size"), (GLfloat)cparam->xsize, (GLfloat)cparam->ysize);
+	if (layout == ARGL_SHADER_BAYER) sp->uniform2f(sp->getUniformLocation(program, "bayer"), (GLfloat)(bayer & 1), (GLfloat)(bayer >> 1));
+	// The binary image is of the observed image, as libAR labels it.
+	sp->uniform1i(sp->getUniformLocation(program, "undistort"), thresh < 0 && !contextSettings->disableDistortionCompensation);
+	sp->uniform1i(sp->getUniformLocation(program, "thresh"), thresh);
+	glMatrixMode(GL_TEXTURE);
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glBegin(GL_QUADS);
+	glTexCoord2f(0.0f, (float)cparam->ysize); glVertex2f(0.0f, 0.0f);
+	glTexCoord2f((float)cparam->xsize, (float)cparam->ysize); glVertex2f(cparam->xsize * zoom, 0.0f);
+	glTexCoord2f((float)cparam->xsize, 0.0f); glVertex2f(cparam->xsize * zoom, cparam->ysize * zoom);
+	glTexCoord2f(0.0f, 0.0f); glVertex2f(0.0f, cparam->ysize * zoom);
+	glEnd();
+	sp->useProgram(0);
+
+	sp->activeTexture(GL_TEXTURE0 + 2);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	sp->activeTexture(GL_TEXTURE0 + 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	sp->activeTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return (TRUE);
+}
+
+static void *arglCurrentContext(void)
+{
+#if defined(_WIN32)
+	return ((void *)wglGetCurrentContext());
+#elif defined(__APPLE__)
+	return ((void *)CGLGetCurrentContext());
+#else
+	return (glXGetCurrentContext());
+#endif
+}
+
+//
+// Whether the image to draw in the current context is in the textures already.
+// The settings shared by several contexts hold one set of textures; the first
+// context to draw a frame uploads it, the others draw what it uploaded. A
+// context that draws again before the others is given a new frame, even in the
+// same buffer, which a video library hands out again.
+//
+static void arglUploadCheck(const ARUint8 *image, ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	void *context;
+	int i;
+
+	contextSettings->uploadSkip = FALSE;
+	if (contextSettings->shareNum < 2) return;
+	context = arglCurrentContext();
+	for (i = 0; i < contextSettings->shareNum; i++) {
+		if (contextSettings->share[i].context == context) break;
+	}
+	if (i == contextSettings->shareNum) return;
+	if (contextSettings->share[i].drawn != contextSettings->uploadSerial && image == contextSettings->uploadImage) {
+		contextSettings->uploadSkip = TRUE;
+	} else {
+		contextSettings->uploadSerial++;
+		contextSettings->uploadImage = image;
+	}
+	contextSettings->share[i].drawn = contextSettings->uploadSerial;
+}
+
 #pragma mark -
 // ============================================================================
 //	Public functions.
@@ -641,7 +1392,8 @@ ARGL_CONTEXT_SETTINGS_REF arglSetupForCurrentContext(void)
 {
 	ARGL_CONTEXT_SETTINGS_REF contextSettings;
 	
-	contextSettings = (ARGL_CONTEXT_SETTINGS_REF)calloc(1, sizeof(ARGL_CONTEXT_SETTINGS));
+	if (!(contextSettings = (ARGL_CONTEXT_SETTINGS_REF)arMemAlloc(AR_MEM_GSUB, sizeof(ARGL_CONTEXT_SETTINGS)))) return (NULL);
+	memset(contextSettings, 0, sizeof(ARGL_CONTEXT_SETTINGS));
 	// Use default pixel format handed to us by <AR/config.h>.
 	if (!arglPixelFormatSet(contextSettings, AR_DEFAULT_PIXEL_FORMAT)) {
 		printf("Unknown default pixel format defined in config.h.\n"); // Windows bug: when running multi-threaded, can't write to stderr!
@@ -650,15 +1402,78 @@ ARGL_CONTEXT_SETTINGS_REF arglSetupForCurrentContext(void)
 	arglDrawModeSet(contextSettings, AR_DRAW_BY_TEXTURE_MAPPING);
 	arglTexmapModeSet(contextSettings, AR_DRAW_TEXTURE_FULL_IMAGE);
 	arglTexRectangleSet(contextSettings, TRUE);
+	contextSettings->share[0].context = arglCurrentContext();
+	contextSettings->shareNum = 1;
 
 	return (contextSettings);
 }
 
+ARGL_CONTEXT_SETTINGS_REF arglSetupForCurrentContextShared(ARGL_CONTEXT_SETTINGS_REF share)
+{
+	void *context = arglCurrentContext();
+	int i;
+#ifdef _WIN32
+	int j;
+#endif
+
+	if (!share || !context) return (NULL);
+	for (i = 0; i < share->shareNum; i++) {
+		if (share->share[i].context == context) return (share);
+	}
+	if (share->shareNum == ARGL_SHARE_CONTEXTS) {
+		printf("argl error: at most %d contexts share the objects of one context.\n", ARGL_SHARE_CONTEXTS);
+		return (NULL);
+	}
+#ifdef _WIN32
+	for (j = 0; j < arglSharePairNum; j++) {
+		if (arglSharePair[j][0] == share->share[0].context && arglSharePair[j][1] == context) break;
+	}
+	if (j == arglSharePairNum) {
+		// Before the context has objects of its own, which wglShareLists() refuses.
+		if (arglSharePairNum == ARGL_SHARE_PAIRS || !wglShareLists((HGLRC)share->share[0].context, (HGLRC)context)) {
+			printf("argl error: unable to share the objects of the first context.\n");
+			return (NULL);
+		}
+		arglSharePair[j][0] = share->share[0].context;
+		arglSharePair[j][1] = context;
+		arglSharePairNum++;
+	}
+#endif
+	share->share[share->shareNum].context = context;
+	share->share[share->shareNum].drawn = 0;
+	share->shareNum++;
+	return (share);
+}
+
 void arglCleanup(ARGL_CONTEXT_SETTINGS_REF contextSettings)
 {
+	void *context;
+	int i;
+
+	// The objects stay for the other contexts sharing them.
+	if (contextSettings->shareNum > 1) {
+		context = arglCurrentContext();
+		for (i = 0; i < contextSettings->shareNum - 1; i++) {
+			if (contextSettings->share[i].context == context) break;
+		}
+		contextSettings->share[i] = contextSettings->share[contextSettings->shareNum - 1];
+		contextSettings->shareNum--;
+		return;
+	}
 	arglCleanupTexRectangle(contextSettings);
 	arglCleanupTexPow2(contextSettings);
-	free(contextSettings);
+	arglCleanupPixelBufferObjects(contextSettings);
+	arglCleanupShader(contextSettings);
+#ifdef AR_INPUT_AVFOUNDATION
+	if (contextSettings->initedIOSurface) {
+		glDeleteTextures(1, &(contextSettings->textureIOSurface));
+	}
+#endif
+	for (i = 0; i < contextSettings->meshNum; i++) {
+		if (contextSettings->mesh[i].meshBuffer) contextSettings->deleteBuffers(1, &(contextSettings->mesh[i].meshBuffer));
+		if (contextSettings->mesh[i].table) glDeleteTextures(1, &(contextSettings->mesh[i].table));
+	}
+	arMemFree(contextSettings);
 }
 
 //
@@ -832,25 +1647,17 @@ void arglCameraViewRH(const double para[3][4], GLdouble m_modelview[16], const d
 	}
 }
 
-void arglDispImage(ARUint8 *image, const ARParam *cparam, const double zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings)
+//
+// Prepare an orthographic projection, set camera position for 2D drawing, and save GL state.
+//
+static void arglDispImageStateSave(const ARParam *cparam, ARGL_DISP_IMAGE_STATE *state)
 {
-	GLint texEnvModeSave;	
-	GLboolean lightingSave;
-	GLboolean depthTestSave;
-#ifdef ARGL_DEBUG
-	GLenum			err;
-	const GLubyte	*errs;
-#endif // ARGL_DEBUG
-
-	if (!image) return;
-
-	// Prepare an orthographic projection, set camera position for 2D drawing, and save GL state.
-	glGetTexEnviv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, &texEnvModeSave); // Save GL texture environment mode.
-	if (texEnvModeSave != GL_REPLACE) glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-	lightingSave = glIsEnabled(GL_LIGHTING);			// Save enabled state of lighting.
-	if (lightingSave == GL_TRUE) glDisable(GL_LIGHTING);
-	depthTestSave = glIsEnabled(GL_DEPTH_TEST);		// Save enabled state of depth test.
-	if (depthTestSave == GL_TRUE) glDisable(GL_DEPTH_TEST);
+	glGetTexEnviv(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, &state->texEnvMode); // Save GL texture environment mode.
+	if (state->texEnvMode != GL_REPLACE) glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+	state->lighting = glIsEnabled(GL_LIGHTING);			// Save enabled state of lighting.
+	if (state->lighting == GL_TRUE) glDisable(GL_LIGHTING);
+	state->depthTest = glIsEnabled(GL_DEPTH_TEST);		// Save enabled state of depth test.
+	if (state->depthTest == GL_TRUE) glDisable(GL_DEPTH_TEST);
 	glMatrixMode(GL_PROJECTION);
 	glPushMatrix();
 	glLoadIdentity();
@@ -858,39 +1665,61 @@ void arglDispImage(ARUint8 *image, const ARParam *cparam, const double zoom, ARG
 	glMatrixMode(GL_MODELVIEW);
 	glPushMatrix();
 	glLoadIdentity();		
-	
-	if (arDebug) { // Globals from ar.h: arDebug, arImage, arImageProcMode.
-		if (arImage) {
-			if (arImageProcMode == AR_IMAGE_PROC_IN_HALF) {
-				ARParam cparamScaled = *cparam;
-				cparamScaled.xsize /= 2;
-				cparamScaled.ysize /= 2;
-				arglDispImageStateful(arImage, &cparamScaled, zoom * 2.0, contextSettings);
-			} else {
-				arglDispImageStateful(arImage, cparam, zoom, contextSettings);
-			}
-		}
-	} else {
-		arglDispImageStateful(image, cparam, zoom, contextSettings);
-	}
+}
 
-	// Restore previous projection, camera position, and GL state.
-	glMatrixMode(GL_PROJECTION);
-	glPopMatrix();
-	glMatrixMode(GL_MODELVIEW);
-	glPopMatrix();
-	if (depthTestSave == GL_TRUE) glEnable(GL_DEPTH_TEST);			// Restore enabled state of depth test.
-	if (lightingSave == GL_TRUE) glEnable(GL_LIGHTING);			// Restore enabled state of lighting.
-	if (texEnvModeSave != GL_REPLACE) glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, texEnvModeSave); // Restore GL texture environment mode.
-	
-#ifdef ARGL_DEBUG
-	// Report any errors we generated.
+//
+// Restore previous projection, camera position, and GL state.
+//
+static void arglDispImageStateRestore(const ARGL_DISP_IMAGE_STATE *state)
+{
+#ifdef ARGL_DEBUG
+	GLenum			err;
+	const GLubyte	*errs;
+#endif // ARGL_DEBUG
+
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopMatrix();
+	if (state->depthTest == GL_TRUE) glEnable(GL_DEPTH_TEST);			// Restore enabled state of depth test.
+	if (state->lighting == GL_TRUE) glEnable(GL_LIGHTING);			// Restore enabled state of lighting.
+	if (state->texEnvMode != GL_REPLACE) glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, state->texEnvMode); // Restore GL texture environment mode.
+	
+#ifdef ARGL_DEBUG
+	// Report any errors we generated.
 	while ((err = glGetError()) != GL_NO_ERROR) {
 		errs = gluErrorString(err);	// fetch error code
 		fprintf(stderr, "GL error: %s (%i)\n", errs, (int)err);	// write err code and number to stderr
 	}
 #endif // ARGL_DEBUG
+}
+
+void arglDispImage(ARUint8 *image, const ARParam *cparam, const double zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	ARGL_DISP_IMAGE_STATE state;
+
+	if (!image) return;
+
+	AR_TRACE_BEGIN("arglDispImage");
+	arglDispImageStateSave(cparam, &state);
 	
+	if (arDebug) { // Globals from ar.h: arDebug, arImage, arImageProcMode.
+		if (arImage) {
+			if (arImageProcMode != AR_IMAGE_PROC_IN_FULL) {
+				ARParam cparamScaled = *cparam;
+				cparamScaled.xsize /= 2;
+				cparamScaled.ysize /= 2;
+				arglDispImageStateful(arImage, &cparamScaled, zoom * 2.0, contextSettings);
+			} else {
+				arglDispImageStateful(arImage, cparam, zoom, contextSettings);
+			}
+		}
+	} else {
+		arglDispImageStateful(image, cparam, zoom, contextSettings);
+	}
+
+	arglDispImageStateRestore(&state);
+	AR_TRACE_END();
 }
 
 void arglDispImageStateful(ARUint8 *image, const ARParam *cparam, const double zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings)
@@ -910,15 +1739,17 @@ void arglDispImageStateful(ARUint8 *image, const ARParam *cparam, const double z
 		glDrawPixels(cparam->xsize, cparam->ysize, contextSettings->pixFormat, contextSettings->pixType, image);
 	} else {
 		// Check whether any settings in globals/parameters have changed.
-		// N.B. We don't check cparam->dist_factor[], but this is unlikely to change!
+		// The zoom and cparam->dist_factor[] only change the mesh, see arglMeshBuild().
 		if ((texmapScaleFactor != contextSettings->asInited_texmapScaleFactor) ||
-			(zoomf != contextSettings->asInited_zoom) ||
 			(cparam->xsize != contextSettings->asInited_xsize) ||
 			(cparam->ysize != contextSettings->asInited_ysize)) {
 			contextSettings->initPlease = TRUE;
 		}
 		
-		if (contextSettings->arglTexRectangle) {
+		arglUploadCheck(image, contextSettings);
+		if (contextSettings->arglShader && arglDispImageShader(image, NULL, -1, cparam, zoomf, -1, contextSettings)) {
+			// Drawn by the fragment program.
+		} else if (contextSettings->arglTexRectangle) {
 			arglDispImageTexRectangle(image, cparam, zoomf, contextSettings, texmapScaleFactor);
 		} else {
 			arglDispImageTexPow2(image, cparam, zoomf, contextSettings, texmapScaleFactor);
@@ -926,11 +1757,96 @@ void arglDispImageStateful(ARUint8 *image, const ARParam *cparam, const double z
 	}	
 }
 
+void arglDispImageNV12(ARUint8 *luma, ARUint8 *chroma, const ARParam *cparam, const double zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	ARGL_DISP_IMAGE_STATE state;
+
+	if (!luma) return;
+
+	arglDispImageStateSave(cparam, &state);
+	arglUploadCheck(luma, contextSettings);
+	arglDispImageShader(luma, (chroma) ? chroma : luma + cparam->xsize * cparam->ysize, -1, cparam, (float)zoom, -1, contextSettings);
+	arglDispImageStateRestore(&state);
+}
+
+void arglDispImageBayer(ARUint8 *raw, const int red, const ARParam *cparam, const double zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	ARGL_DISP_IMAGE_STATE state;
+
+	if (!raw || red < 0 || red > 3) return;
+
+	arglDispImageStateSave(cparam, &state);
+	arglUploadCheck(raw, contextSettings);
+	arglDispImageShader(raw, NULL, red, cparam, (float)zoom, -1, contextSettings);
+	arglDispImageStateRestore(&state);
+}
+
+#ifdef AR_INPUT_AVFOUNDATION
+void arglDispImageIOSurface(IOSurfaceRef surface, const ARParam *cparam, const double zoom, ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	ARGL_DISP_IMAGE_STATE state;
+	GLenum intFormat, format, type;
+
+	if (!surface) return;
+
+	switch (IOSurfaceGetPixelFormat(surface)) {
+		case '420f':
+		case '420v':
+			// The luma plane only, the chroma would take a fragment program.
+			intFormat = GL_LUMINANCE;
+			format = GL_LUMINANCE;
+			type = GL_UNSIGNED_BYTE;
+			break;
+		case 'BGRA':
+			intFormat = GL_RGBA;
+			format = GL_BGRA;
+			type = GL_UNSIGNED_INT_8_8_8_8_REV;
+			break;
+		case '2vuy':
+			intFormat = GL_RGB;
+			format = GL_YCBCR_422_APPLE;
+#ifdef AR_BIG_ENDIAN
+			type = GL_UNSIGNED_SHORT_8_8_REV_APPLE;
+#else
+			type = GL_UNSIGNED_SHORT_8_8_APPLE;
+#endif
+			break;
+		default:
+			printf("argl error: IOSurface pixel format is not supported.\n");
+			return;
+	}
+
+	arglDispImageStateSave(cparam, &state);
+
+	if (!contextSettings->initedIOSurface) {
+		glGenTextures(1, &(contextSettings->textureIOSurface));
+		glBindTexture(GL_TEXTURE_RECTANGLE, contextSettings->textureIOSurface);
+		glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_RECTANGLE, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		contextSettings->initedIOSurface = TRUE;
+	}
+
+	// Bind the surface itself as the texture, nothing is uploaded.
+	glBindTexture(GL_TEXTURE_RECTANGLE, contextSettings->textureIOSurface);
+	if (CGLTexImageIOSurface2D(CGLGetCurrentContext(), GL_TEXTURE_RECTANGLE, intFormat,
+							   (GLsizei)IOSurfaceGetWidthOfPlane(surface, 0), (GLsizei)IOSurfaceGetHeightOfPlane(surface, 0),
+							   format, type, surface, 0) == kCGLNoError) {
+		arglDispImageMesh(GL_TEXTURE_RECTANGLE, cparam, (float)zoom, 1.0f, 1.0f, contextSettings);
+	} else {
+		printf("argl error: unable to bind the IOSurface as a texture.\n");
+	}
+	glBindTexture(GL_TEXTURE_RECTANGLE, 0);
+
+	arglDispImageStateRestore(&state);
+}
+#endif // AR_INPUT_AVFOUNDATION
+
 int arglDistortionCompensationSet(ARGL_CONTEXT_SETTINGS_REF contextSettings, int enable)
 {
 	if (!contextSettings) return (FALSE);
 	contextSettings->disableDistortionCompensation = !enable;
-	contextSettings->initPlease = TRUE;
 	return (TRUE);
 }
 
@@ -941,6 +1857,13 @@ int arglDistortionCompensationGet(ARGL_CONTEXT_SETTINGS_REF contextSettings, int
 	return (TRUE);
 }
 
+int arglDistortionMeshPrepare(ARGL_CONTEXT_SETTINGS_REF contextSettings, const ARParam *cparam)
+{
+	if (!contextSettings || !cparam) return (FALSE);
+	arglMeshBuild(cparam, contextSettings);
+	return (TRUE);
+}
+
 int arglPixelFormatSet(ARGL_CONTEXT_SETTINGS_REF contextSettings, AR_PIXEL_FORMAT format)
 {
 	if (!contextSettings) return (FALSE);
@@ -1025,6 +1948,12 @@ int arglPixelFormatSet(ARGL_CONTEXT_SETTINGS_REF contextSettings, AR_PIXEL_FORMA
 #else
 				contextSettings->pixType = GL_UNSIGNED_SHORT_8_8_MESA;
 #endif
+			} else if (arglGLCapabilityCheck(0x0200, NULL)) {
+				// Only the fragment program can draw it.
+				contextSettings->pixIntFormat = GL_LUMINANCE_ALPHA;
+				contextSettings->pixFormat = GL_LUMINANCE_ALPHA;
+				contextSettings->pixType = GL_UNSIGNED_BYTE;
+				contextSettings->arglShader = TRUE;
 			} else {
 				return (FALSE);
 			}
@@ -1047,6 +1976,12 @@ int arglPixelFormatSet(ARGL_CONTEXT_SETTINGS_REF contextSettings, AR_PIXEL_FORMA
 #else
 				contextSettings->pixType = GL_UNSIGNED_SHORT_8_8_REV_MESA;
 #endif
+			} else if (arglGLCapabilityCheck(0x0200, NULL)) {
+				// Only the fragment program can draw it.
+				contextSettings->pixIntFormat = GL_LUMINANCE_ALPHA;
+				contextSettings->pixFormat = GL_LUMINANCE_ALPHA;
+				contextSettings->pixType = GL_UNSIGNED_BYTE;
+				contextSettings->arglShader = TRUE;
 			} else {
 				return (FALSE);
 			}
@@ -1056,6 +1991,7 @@ int arglPixelFormatSet(ARGL_CONTEXT_SETTINGS_REF contextSettings, AR_PIXEL_FORMA
 			return (FALSE);
 			break;
 	}
+	contextSettings->arPixelFormat = format;
 	contextSettings->initPlease = TRUE;
 	return (TRUE);
 }
@@ -1106,6 +2042,10 @@ int arglPixelFormatGet(ARGL_CONTEXT_SETTINGS_REF contextSettings, AR_PIXEL_FORMA
 			*format = AR_PIXEL_FORMAT_MONO;
 			*size = 1;
 			break;
+		case GL_LUMINANCE_ALPHA: // 2vuy or yuvs for the fragment program.
+			*format = contextSettings->arPixelFormat;
+			*size = 2;
+			break;
 		default:
 			return (FALSE);
 			break;
@@ -1149,3 +2089,675 @@ int arglTexRectangleGet(ARGL_CONTEXT_SETTINGS_REF contextSettings)
 	return (contextSettings->arglTexRectangle);
 }
 
+void arglPixelBufferObjectsSet(ARGL_CONTEXT_SETTINGS_REF contextSettings, const int count)
+{
+	if (!contextSettings || count < 0 || count > ARGL_PIXEL_BUFFER_OBJECTS_MAX) return; // Sanity check.
+	contextSettings->pixelBufferObjects = count;
+}
+
+int arglPixelBufferObjectsGet(ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	if (!contextSettings) return (-1); // Sanity check.
+	return (contextSettings->pixelBufferObjects);
+}
+
+void arglShaderSet(ARGL_CONTEXT_SETTINGS_REF contextSettings, const int state)
+{
+	if (!contextSettings) return; // Sanity check.
+	contextSettings->arglShader = state;
+}
+
+int arglShaderGet(ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	if (!contextSettings) return (-1); // Sanity check.
+	return (contextSettings->arglShader);
+}
+
+int arglSwapIntervalSet(const int interval)
+{
+#ifdef __APPLE__
+	GLint i = interval;
+	
+	return (CGLSetParameter(CGLGetCurrentContext(), kCGLCPSwapInterval, &i) == kCGLNoError);
+#else
+	ARGL_SWAP_INTERVAL swapInterval;
+	
+#  ifdef _WIN32
+	swapInterval = (ARGL_SWAP_INTERVAL)wglGetProcAddress("wglSwapIntervalEXT");
+#  else
+	if (interval < 1) return (FALSE);
+	swapInterval = (ARGL_SWAP_INTERVAL)arglGLProcAddress("glXSwapIntervalSGI", "glXSwapIntervalSGI");
+#  endif
+	return (swapInterval && swapInterval(interval));
+#endif
+}
+
+ARGL_FRAME_PACER_REF arglFramePacerCreate(void)
+{
+	ARGL_FRAME_PACER_REF pacer;
+	
+	if (!(pacer = (ARGL_FRAME_PACER_REF)calloc(1, sizeof(struct _ARGL_FRAME_PACER)))) return (NULL);
+	pacer->period = ARGL_FRAME_PACER_PERIOD;
+	pacer->begin = -1.0;
+	pacer->presented = -1.0;
+	return (pacer);
+}
+
+void arglFramePacerDelete(ARGL_FRAME_PACER_REF pacer)
+{
+	free(pacer);
+}
+
+double arglFramePacerWait(ARGL_FRAME_PACER_REF pacer, const double now)
+{
+	double	next;
+	int		k;
+	
+	if (!pacer || pacer->presented < 0.0 || now < pacer->presented) return (0.0);
+	
+	// The first refresh that a frame begun now can be ready for.
+	k = (int)((now + pacer->cost + ARGL_FRAME_PACER_MARGIN - pacer->presented) / pacer->period) + 1;
+	next = pacer->presented + k * pacer->period;
+	next -= pacer->cost + ARGL_FRAME_PACER_MARGIN;
+	return ((next > now) ? next - now : 0.0);
+}
+
+void arglFramePacerBegin(ARGL_FRAME_PACER_REF pacer, const double now)
+{
+	if (!pacer) return;
+	pacer->begin = now;
+}
+
+void arglFramePacerPresented(ARGL_FRAME_PACER_REF pacer, const double drawn, const double presented)
+{
+	double	dt;
+	
+	if (!pacer) return;
+	
+	if (pacer->begin >= 0.0 && drawn >= pacer->begin) {
+		if (pacer->cost == 0.0) pacer->cost = drawn - pacer->begin;
+		else pacer->cost += (drawn - pacer->begin - pacer->cost) * 0.1;
+	}
+	pacer->begin = -1.0;
+	
+	// Swaps that missed a refresh are a multiple of the period apart, so only
+	// intervals near one period refine it. A shorter one means a faster display.
+	if (pacer->presented >= 0.0 && presented > pacer->presented) {
+		dt = presented - pacer->presented;
+		if (dt < pacer->period * 0.75) pacer->period = dt;
+		else if (dt < pacer->period * 1.5) pacer->period += (dt - pacer->period) * 0.1;
+	}
+	pacer->presented = presented;
+}
+
+double arglFramePacerPeriod(ARGL_FRAME_PACER_REF pacer)
+{
+	if (!pacer) return (ARGL_FRAME_PACER_PERIOD);
+	return (pacer->period);
+}
+
+#ifdef AR_OPENGL_EGL
+//
+// Make current an EGL context of our own, on a 1 x 1 pbuffer, as no window is needed.
+//
+static int arglOffscreenContext(ARGL_OFFSCREEN_REF offscreen)
+{
+	static const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	static const EGLint pbufferAttribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+	EGLConfig	config;
+	EGLint		n;
+	
+	if ((offscreen->eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY)) == EGL_NO_DISPLAY) return (FALSE);
+	if (!eglInitialize(offscreen->eglDisplay, NULL, NULL)) {
+		offscreen->eglDisplay = EGL_NO_DISPLAY;
+		return (FALSE);
+	}
+	if (!eglChooseConfig(offscreen->eglDisplay, configAttribs, &config, 1, &n) || n < 1 ||
+		(offscreen->eglSurface = eglCreatePbufferSurface(offscreen->eglDisplay, config, pbufferAttribs)) == EGL_NO_SURFACE) {
+		eglTerminate(offscreen->eglDisplay);
+		offscreen->eglDisplay = EGL_NO_DISPLAY;
+		return (FALSE);
+	}
+	eglBindAPI(EGL_OPENGL_API);
+	if ((offscreen->eglContext = eglCreateContext(offscreen->eglDisplay, config, EGL_NO_CONTEXT, NULL)) == EGL_NO_CONTEXT ||
+		!eglMakeCurrent(offscreen->eglDisplay, offscreen->eglSurface, offscreen->eglSurface, offscreen->eglContext)) {
+		if (offscreen->eglContext != EGL_NO_CONTEXT) eglDestroyContext(offscreen->eglDisplay, offscreen->eglContext);
+		eglDestroySurface(offscreen->eglDisplay, offscreen->eglSurface);
+		eglTerminate(offscreen->eglDisplay);
+		offscreen->eglDisplay = EGL_NO_DISPLAY;
+		return (FALSE);
+	}
+	return (TRUE);
+}
+#endif // AR_OPENGL_EGL
+
+static int arglOffscreenCapabilitiesCheck(ARGL_OFFSCREEN_REF offscreen)
+{
+	if (!arglGLCapabilityCheck(0x0300, (unsigned char *)"GL_ARB_framebuffer_object")) {
+		if (!arglGLCapabilityCheck(0, (unsigned char *)"GL_EXT_framebuffer_object")) { // Alternate name.
+			return (FALSE);
+		}
+	}
+#ifdef __APPLE__
+	offscreen->genFramebuffers = glGenFramebuffersEXT;
+	offscreen->deleteFramebuffers = glDeleteFramebuffersEXT;
+	offscreen->bindFramebuffer = glBindFramebufferEXT;
+	offscreen->framebufferRenderbuffer = glFramebufferRenderbufferEXT;
+	offscreen->checkFramebufferStatus = glCheckFramebufferStatusEXT;
+	offscreen->genRenderbuffers = glGenRenderbuffersEXT;
+	offscreen->deleteRenderbuffers = glDeleteRenderbuffersEXT;
+	offscreen->bindRenderbuffer = glBindRenderbufferEXT;
+	offscreen->renderbufferStorage = glRenderbufferStorageEXT;
+#else
+	offscreen->genFramebuffers = (ARGL_GL_GEN_FRAMEBUFFERS)arglGLProcAddress("glGenFramebuffers", "glGenFramebuffersEXT");
+	offscreen->deleteFramebuffers = (ARGL_GL_DELETE_FRAMEBUFFERS)arglGLProcAddress("glDeleteFramebuffers", "glDeleteFramebuffersEXT");
+	offscreen->bindFramebuffer = (ARGL_GL_BIND_FRAMEBUFFER)arglGLProcAddress("glBindFramebuffer", "glBindFramebufferEXT");
+	offscreen->framebufferRenderbuffer = (ARGL_GL_FRAMEBUFFER_RENDERBUFFER)arglGLProcAddress("glFramebufferRenderbuffer", "glFramebufferRenderbufferEXT");
+	offscreen->checkFramebufferStatus = (ARGL_GL_CHECK_FRAMEBUFFER_STATUS)arglGLProcAddress("glCheckFramebufferStatus", "glCheckFramebufferStatusEXT");
+	offscreen->genRenderbuffers = (ARGL_GL_GEN_RENDERBUFFERS)arglGLProcAddress("glGenRenderbuffers", "glGenRenderbuffersEXT");
+	offscreen->deleteRenderbuffers = (ARGL_GL_DELETE_RENDERBUFFERS)arglGLProcAddress("glDeleteRenderbuffers", "glDeleteRenderbuffersEXT");
+	offscreen->bindRenderbuffer = (ARGL_GL_BIND_RENDERBUFFER)arglGLProcAddress("glBindRenderbuffer", "glBindRenderbufferEXT");
+	offscreen->renderbufferStorage = (ARGL_GL_RENDERBUFFER_STORAGE)arglGLProcAddress("glRenderbufferStorage", "glRenderbufferStorageEXT");
+#endif
+	if (!offscreen->genFramebuffers || !offscreen->deleteFramebuffers || !offscreen->bindFramebuffer ||
+		!offscreen->framebufferRenderbuffer || !offscreen->checkFramebufferStatus || !offscreen->genRenderbuffers ||
+		!offscreen->deleteRenderbuffers || !offscreen->bindRenderbuffer || !offscreen->renderbufferStorage) {
+		return (FALSE);
+	}
+	
+	// Pixel buffer objects are optional, without them the readback waits.
+	if (arglGLCapabilityCheck(0x0210, (unsigned char *)"GL_ARB_pixel_buffer_object") ||
+		arglGLCapabilityCheck(0, (unsigned char *)"GL_EXT_pixel_buffer_object")) {
+#ifdef __APPLE__
+		offscreen->genBuffers = glGenBuffers;
+		offscreen->deleteBuffers = glDeleteBuffers;
+		offscreen->bindBuffer = glBindBuffer;
+		offscreen->bufferData = (ARGL_GL_BUFFER_DATA)glBufferData;
+		offscreen->mapBuffer = glMapBuffer;
+		offscreen->unmapBuffer = glUnmapBuffer;
+#else
+		offscreen->genBuffers = (ARGL_GL_GEN_BUFFERS)arglGLProcAddress("glGenBuffers", "glGenBuffersARB");
+		offscreen->deleteBuffers = (ARGL_GL_DELETE_BUFFERS)arglGLProcAddress("glDeleteBuffers", "glDeleteBuffersARB");
+		offscreen->bindBuffer = (ARGL_GL_BIND_BUFFER)arglGLProcAddress("glBindBuffer", "glBindBufferARB");
+		offscreen->bufferData = (ARGL_GL_BUFFER_DATA)arglGLProcAddress("glBufferData", "glBufferDataARB");
+		offscreen->mapBuffer = (ARGL_GL_MAP_BUFFER)arglGLProcAddress("glMapBuffer", "glMapBufferARB");
+		offscreen->unmapBuffer = (ARGL_GL_UNMAP_BUFFER)arglGLProcAddress("glUnmapBuffer", "glUnmapBufferARB");
+#endif
+	}
+	return (TRUE);
+}
+
+ARGL_OFFSCREEN_REF arglOffscreenCreate(const int width, const int height, const int ownContext)
+{
+	ARGL_OFFSCREEN_REF offscreen;
+	
+	if (width < 1 || height < 1) return (NULL);
+	if (!(offscreen = (ARGL_OFFSCREEN_REF)arMemAlloc(AR_MEM_GSUB, sizeof(struct _ARGL_OFFSCREEN)))) return (NULL);
+	memset(offscreen, 0, sizeof(struct _ARGL_OFFSCREEN));
+	offscreen->width = width;
+	offscreen->height = height;
+	offscreen->pboMapped = -1;
+#ifdef AR_OPENGL_EGL
+	offscreen->eglDisplay = EGL_NO_DISPLAY;
+	if (ownContext && !arglOffscreenContext(offscreen)) {
+		printf("argl error: unable to create an EGL context.\n");
+		arMemFree(offscreen);
+		return (NULL);
+	}
+#else
+	if (ownContext) {
+		printf("argl error: offscreen contexts need AR_OPENGL_EGL in config.h.\n");
+		arMemFree(offscreen);
+		return (NULL);
+	}
+#endif
+	
+	if (!arglOffscreenCapabilitiesCheck(offscreen)) {
+		printf("argl error: Your OpenGL implementation does not support framebuffer objects.\n");
+		arglOffscreenDelete(offscreen);
+		return (NULL);
+	}
+	offscreen->genRenderbuffers(2, offscreen->renderbuffer);
+	offscreen->bindRenderbuffer(GL_RENDERBUFFER, offscreen->renderbuffer[0]);
+	offscreen->renderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	offscreen->bindRenderbuffer(GL_RENDERBUFFER, offscreen->renderbuffer[1]);
+	offscreen->renderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	offscreen->bindRenderbuffer(GL_RENDERBUFFER, 0);
+	offscreen->genFramebuffers(1, &(offscreen->framebuffer));
+	offscreen->bindFramebuffer(GL_FRAMEBUFFER, offscreen->framebuffer);
+	offscreen->framebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, offscreen->renderbuffer[0]);
+	offscreen->framebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, offscreen->renderbuffer[1]);
+	if (offscreen->checkFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		printf("argl error: offscreen framebuffer of %dx%d is not complete.\n", width, height);
+		offscreen->bindFramebuffer(GL_FRAMEBUFFER, 0);
+		arglOffscreenDelete(offscreen);
+		return (NULL);
+	}
+	offscreen->bindFramebuffer(GL_FRAMEBUFFER, 0);
+	offscreen->glBytes = (long)width * height * 8;
+	
+	if (offscreen->genBuffers && offscreen->deleteBuffers && offscreen->bindBuffer &&
+		offscreen->bufferData && offscreen->mapBuffer && offscreen->unmapBuffer) {
+		offscreen->genBuffers(2, offscreen->pbo);
+		offscreen->bindBuffer(GL_PIXEL_PACK_BUFFER, offscreen->pbo[0]);
+		offscreen->bufferData(GL_PIXEL_PACK_BUFFER, (ptrdiff_t)width * height * 4, NULL, GL_STREAM_READ);
+		offscreen->bindBuffer(GL_PIXEL_PACK_BUFFER, offscreen->pbo[1]);
+		offscreen->bufferData(GL_PIXEL_PACK_BUFFER, (ptrdiff_t)width * height * 4, NULL, GL_STREAM_READ);
+		offscreen->bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		offscreen->glBytes += (long)width * height * 8;
+	} else {
+		arMallocTag(offscreen->image, ARUint8, width * height * 4, AR_MEM_GSUB);
+	}
+	arMemAdd(AR_MEM_GSUB, offscreen->glBytes);
+	return (offscreen);
+}
+
+void arglOffscreenDelete(ARGL_OFFSCREEN_REF offscreen)
+{
+	if (!offscreen) return;
+	
+	if (offscreen->pboMapped >= 0) {
+		offscreen->bindBuffer(GL_PIXEL_PACK_BUFFER, offscreen->pbo[offscreen->pboMapped]);
+		offscreen->unmapBuffer(GL_PIXEL_PACK_BUFFER);
+		offscreen->bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+	if (offscreen->pbo[0]) offscreen->deleteBuffers(2, offscreen->pbo);
+	if (offscreen->framebuffer) offscreen->deleteFramebuffers(1, &(offscreen->framebuffer));
+	if (offscreen->renderbuffer[0]) offscreen->deleteRenderbuffers(2, offscreen->renderbuffer);
+	arMemFree(offscreen->image);
+	arMemAdd(AR_MEM_GSUB, -offscreen->glBytes);
+#ifdef AR_OPENGL_EGL
+	if (offscreen->eglDisplay != EGL_NO_DISPLAY) {
+		eglMakeCurrent(offscreen->eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(offscreen->eglDisplay, offscreen->eglContext);
+		eglDestroySurface(offscreen->eglDisplay, offscreen->eglSurface);
+		eglTerminate(offscreen->eglDisplay);
+	}
+#endif
+	arMemFree(offscreen);
+}
+
+void arglOffscreenBind(ARGL_OFFSCREEN_REF offscreen)
+{
+	if (!offscreen) return;
+	offscreen->bindFramebuffer(GL_FRAMEBUFFER, offscreen->framebuffer);
+	glViewport(0, 0, offscreen->width, offscreen->height);
+}
+
+void arglOffscreenUnbind(ARGL_OFFSCREEN_REF offscreen)
+{
+	if (!offscreen) return;
+	offscreen->bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ARUint8 *arglOffscreenRead(ARGL_OFFSCREEN_REF offscreen)
+{
+	ARUint8	*image;
+	int		prev;
+	
+	if (!offscreen) return (NULL);
+	
+	offscreen->bindFramebuffer(GL_FRAMEBUFFER, offscreen->framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	if (!offscreen->pbo[0]) {
+		glReadPixels(0, 0, offscreen->width, offscreen->height, GL_BGRA, GL_UNSIGNED_BYTE, offscreen->image);
+		return (offscreen->image);
+	}
+	
+	// Give back the frame of the last call, and start the transfer of this one.
+	if (offscreen->pboMapped >= 0) {
+		offscreen->bindBuffer(GL_PIXEL_PACK_BUFFER, offscreen->pbo[offscreen->pboMapped]);
+		offscreen->unmapBuffer(GL_PIXEL_PACK_BUFFER);
+		offscreen->pboMapped = -1;
+	}
+	offscreen->bindBuffer(GL_PIXEL_PACK_BUFFER, offscreen->pbo[offscreen->pboNext]);
+	glReadPixels(0, 0, offscreen->width, offscreen->height, GL_BGRA, GL_UNSIGNED_BYTE, (GLvoid *)0);
+	prev = 1 - offscreen->pboNext;
+	offscreen->pboNext = prev;
+	if (offscreen->frames++ == 0) {
+		offscreen->bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		return (NULL);
+	}
+	
+	// The frame before, whose transfer has had a frame's time to complete.
+	offscreen->bindBuffer(GL_PIXEL_PACK_BUFFER, offscreen->pbo[prev]);
+	if ((image = (ARUint8 *)offscreen->mapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY)) != NULL) offscreen->pboMapped = prev;
+	offscreen->bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return (image);
+}
+
+int arglBinarize(ARUint8 *image, const ARParam *cparam, const int scale, const int thresh, ARUint8 *mask, ARGL_OFFSCREEN_REF offscreen, ARGL_CONTEXT_SETTINGS_REF contextSettings)
+{
+	int ok;
+	
+	if (!image || !cparam || !mask || !offscreen || !contextSettings || scale < 1 || thresh < 0) return (FALSE);
+	if (offscreen->width != cparam->xsize / scale || offscreen->height != cparam->ysize / scale) return (FALSE);
+	
+	arglOffscreenBind(offscreen);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	// Upside down, so that the first row read back is the top of the image.
+	glOrtho(0.0, (GLdouble)offscreen->width, (GLdouble)offscreen->height, 0.0, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	arglUploadCheck(image, contextSettings);
+	ok = arglDispImageShader(image, NULL, -1, cparam, 1.0f / scale, thresh, contextSettings);
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	
+	// One byte per pixel, waiting for the GPU: the mask is of this very frame.
+	if (ok) {
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, offscreen->width, offscreen->height, GL_RED, GL_UNSIGNED_BYTE, mask);
+	}
+	arglOffscreenUnbind(offscreen);
+	return (ok);
+}
+
+//
+// Fragment program of the template matching: for the pattern of the frame of its
+// column and the pattern of the library of its row, the cosine of the angle between
+// their samples in each of the four directions of the library pattern. The best of
+// the four goes out as 16 bits over [-1, 1] in red and green, high byte first, and
+// its direction in blue. Samples are 16 bits over [-1, 1], two per texel.
+//
+static const char *arglMatchSource =
+	"uniform sampler2D library;\n"
+	"uniform sampler2D patterns;\n"
+	"uniform vec2 librarySize;\n"
+	"uniform vec2 patternsSize;\n"
+	"vec2 samples(vec4 e)\n"
+	"{\n"
+	"	return vec2(e.r * 65280.0 + e.g * 255.0, e.b * 65280.0 + e.a * 255.0) / 32767.5 - 1.0;\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"	float c = (floor(gl_FragCoord.x) + 0.5) / patternsSize.y;\n"
+	"	float k = floor(gl_FragCoord.y) * 4.0 + 0.5;\n"
+	"	vec4 s = vec4(0.0);\n"
+	"	for (int i = 0; i < ARGL_MATCH_TEXELS; i++) {\n"
+	"		float x = (float(i) + 0.5) / librarySize.x;\n"
+	"		vec2 a = samples(texture2D(patterns, vec2(x, c)));\n"
+	"		s.x += dot(a, samples(texture2D(library, vec2(x, k / librarySize.y))));\n"
+	"		s.y += dot(a, samples(texture2D(library, vec2(x, (k + 1.0) / librarySize.y))));\n"
+	"		s.z += dot(a, samples(texture2D(library, vec2(x, (k + 2.0) / librarySize.y))));\n"
+	"		s.w += dot(a, samples(texture2D(library, vec2(x, (k + 3.0) / librarySize.y))));\n"
+	"	}\n"
+	"	float m = max(max(s.x, s.y), max(s.z, s.w));\n"
+	"	float d = (m == s.x) ? 0.0 : (m == s.y) ? 1.0 : (m == s.z) ? 2.0 : 3.0;\n"
+	"	float q = floor(clamp((m + 1.0) * 0.5, 0.0, 1.0) * 65535.0 + 0.5);\n"
+	"	gl_FragColor = vec4(floor(q / 256.0), mod(q, 256.0), d, 0.0) / 255.0;\n"
+	"}\n";
+
+// Write n samples, each a value over [-1, 1], as n / 2 RGBA texels.
+static void arglMatchEncode(const double *v, const int n, ARUint8 *texels)
+{
+	int i, q;
+
+	for (i = 0; i < n; i++) {
+		q = (int)((v[i] + 1.0) * 32767.5 + 0.5);
+		if (q < 0) q = 0; else if (q > 65535) q = 65535;
+		*texels++ = (ARUint8)(q >> 8);
+		*texels++ = (ARUint8)(q & 0xff);
+	}
+}
+
+// The samples of a pattern of the frame less their mean, as pattern_match() of
+// libAR makes them. Returns the length of the vector.
+static double arglMatchInput(ARUint8 *data, ARInt16 input[ARGL_MATCH_LEN])
+{
+	int i, sum, ave;
+	double pow;
+
+	sum = 0;
+	for (i = 0; i < ARGL_MATCH_LEN; i++) sum += data[i];
+	ave = (255 * ARGL_MATCH_LEN - sum) / ARGL_MATCH_LEN;
+	pow = 0.0;
+	for (i = 0; i < ARGL_MATCH_LEN; i++) {
+		input[i] = (ARInt16)((255 - ave) - data[i]);
+		pow += (double)input[i] * input[i];
+	}
+	return (sqrt(pow));
+}
+
+// Upload the active patterns of libAR, when they changed. Returns FALSE if they do not fit.
+static int arglMatchLibrary(ARGL_MATCHER_REF matcher)
+{
+	double v[ARGL_MATCH_LEN];
+	int serial, num, k, j, i;
+
+	serial = arGetPattSerial();
+	if (serial == matcher->serial) return (matcher->num > 0);
+
+	num = arGetPattActive(NULL, 0);
+	if (num * 4 > matcher->textureMax) {
+		printf("argl error: %d patterns are more than the GPU matcher holds.\n", num);
+		return (FALSE);
+	}
+	if (num > matcher->max) {
+		arMemFree(matcher->id);
+		arMemFree(matcher->samples);
+		arMemFree(matcher->pow);
+		arMemFree(matcher->upload);
+		arMemFree(matcher->result);
+		matcher->max = num;
+		matcher->id = (int *)arMemAlloc(AR_MEM_GSUB, num * sizeof(int));
+		matcher->samples = (ARInt16 (*)[4][ARGL_MATCH_LEN])arMemAlloc(AR_MEM_GSUB, num * sizeof(*matcher->samples));
+		matcher->pow = (double (*)[4])arMemAlloc(AR_MEM_GSUB, num * sizeof(*matcher->pow));
+		matcher->upload = (ARUint8 *)arMemAlloc(AR_MEM_GSUB, ((num * 4 > AR_SQUARE_MAX) ? num * 4 : AR_SQUARE_MAX) * ARGL_MATCH_TEXELS * 4);
+		matcher->result = (ARUint8 *)arMemAlloc(AR_MEM_GSUB, num * AR_SQUARE_MAX * 4);
+		if (!matcher->id || !matcher->samples || !matcher->pow || !matcher->upload || !matcher->result) {
+			printf("argl error: out of memory.\n");
+			matcher->max = matcher->num = 0;
+			return (FALSE);
+		}
+		arglOffscreenDelete(matcher->offscreen);
+		if (!(matcher->offscreen = arglOffscreenCreate(AR_SQUARE_MAX, num, FALSE))) {
+			matcher->max = matcher->num = 0;
+			return (FALSE);
+		}
+	}
+
+	num = arGetPattActive(matcher->id, num);
+	if (num > matcher->max) num = matcher->max;
+	for (k = 0; k < num; k++) {
+		if (arGetPattSamples(matcher->id[k], matcher->samples[k], matcher->pow[k]) < 0) {
+			// Freed since it was listed: never the best.
+			memset(matcher->samples[k], 0, sizeof(matcher->samples[k]));
+			for (j = 0; j < 4; j++) matcher->pow[k][j] = 0.0;
+		}
+		for (j = 0; j < 4; j++) {
+			for (i = 0; i < ARGL_MATCH_LEN; i++) {
+				v[i] = (matcher->pow[k][j] > 0.0) ? matcher->samples[k][j][i] / matcher->pow[k][j] : -1.0;
+			}
+			arglMatchEncode(v, ARGL_MATCH_LEN, &(matcher->upload[(k * 4 + j) * ARGL_MATCH_TEXELS * 4]));
+		}
+	}
+	matcher->num = num;
+	matcher->serial = serial;
+	if (num == 0) return (FALSE);
+
+	glBindTexture(GL_TEXTURE_2D, matcher->texture[0]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, ARGL_MATCH_TEXELS, num * 4, 0, GL_RGBA, GL_UNSIGNED_BYTE, matcher->upload);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return (TRUE);
+}
+
+ARGL_MATCHER_REF arglMatcherCreate(void)
+{
+	ARGL_MATCHER_REF matcher;
+	ARGL_SHADER_PROCS *sp;
+	const char *source[2];
+	char define[64], log[512];
+	GLuint shader;
+	GLint status;
+
+	if (!(matcher = (ARGL_MATCHER_REF)arMemAlloc(AR_MEM_GSUB, sizeof(struct _ARGL_MATCHER)))) return (NULL);
+	memset(matcher, 0, sizeof(struct _ARGL_MATCHER));
+	matcher->serial = -1;
+	sp = &(matcher->shader);
+	if (!arglShaderCapabilitiesCheck(sp)) {
+		printf("argl error: Your OpenGL implementation does not support OpenGL 2.0 fragment programs.\n");
+		return (matcher);
+	}
+
+	sprintf(define, "#define ARGL_MATCH_TEXELS %d\n", ARGL_MATCH_TEXELS);
+	source[0] = define;
+	source[1] = arglMatchSource;
+	shader = sp->createShader(GL_FRAGMENT_SHADER);
+	sp->shaderSource(shader, 2, source, NULL);
+	sp->compileShader(shader);
+	sp->getShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (!status) {
+		sp->getShaderInfoLog(shader, sizeof(log), NULL, log);
+		printf("argl error: matching program did not compile: %s\n", log);
+		sp->deleteShader(shader);
+		return (matcher);
+	}
+	matcher->program = sp->createProgram();
+	sp->attachShader(matcher->program, shader);
+	sp->linkProgram(matcher->program);
+	sp->deleteShader(shader);
+	sp->getProgramiv(matcher->program, GL_LINK_STATUS, &status);
+	if (!status) {
+		sp->getProgramInfoLog(matcher->program, sizeof(log), NULL, log);
+		printf("argl error: matching program did not link: %s\n", log);
+		sp->deleteProgram(matcher->program);
+		matcher->program = 0;
+		return (matcher);
+	}
+	sp->useProgram(matcher->program);
+	sp->uniform1i(sp->getUniformLocation(matcher->program, "library"), 0);
+	sp->uniform1i(sp->getUniformLocation(matcher->program, "patterns"), 1);
+	sp->useProgram(0);
+
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &(matcher->textureMax));
+	glGenTextures(2, matcher->texture);
+	arglShaderTextureSetup(matcher->texture[0]);
+	arglShaderTextureSetup(matcher->texture[1]);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, ARGL_MATCH_TEXELS, AR_SQUARE_MAX, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return (matcher);
+}
+
+void arglMatcherDelete(ARGL_MATCHER_REF matcher)
+{
+	if (!matcher) return;
+	if (matcher->program) {
+		matcher->shader.deleteProgram(matcher->program);
+		glDeleteTextures(2, matcher->texture);
+	}
+	arglOffscreenDelete(matcher->offscreen);
+	arMemFree(matcher->id);
+	arMemFree(matcher->samples);
+	arMemFree(matcher->pow);
+	arMemFree(matcher->upload);
+	arMemFree(matcher->result);
+	arMemFree(matcher);
+}
+
+int arglMatch(void *data, ARUint8 (*ext_pat)[AR_PATT_SIZE_Y][AR_PATT_SIZE_X][3], int num, int *code, int *dir, double *cf)
+{
+	ARGL_MATCHER_REF matcher = (ARGL_MATCHER_REF)data;
+	ARGL_SHADER_PROCS *sp;
+	ARInt16 input[AR_SQUARE_MAX][ARGL_MATCH_LEN];
+	double datapow[AR_SQUARE_MAX], v[ARGL_MATCH_LEN];
+	ARUint8 *r;
+	int best, q, c, k, i;
+	double sum;
+
+	if (!matcher || !matcher->program || num > AR_SQUARE_MAX) return (-1);
+	if (!arglMatchLibrary(matcher)) return (-1);
+	sp = &(matcher->shader);
+
+	// The patterns of the frame, normalised, in one upload.
+	for (c = 0; c < num; c++) {
+		datapow[c] = arglMatchInput((ARUint8 *)ext_pat[c], input[c]);
+		for (i = 0; i < ARGL_MATCH_LEN; i++) v[i] = (datapow[c] > 0.0) ? input[c][i] / datapow[c] : 0.0;
+		arglMatchEncode(v, ARGL_MATCH_LEN, &(matcher->upload[c * ARGL_MATCH_TEXELS * 4]));
+	}
+	sp->activeTexture(GL_TEXTURE0 + 1);
+	glBindTexture(GL_TEXTURE_2D, matcher->texture[1]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, ARGL_MATCH_TEXELS, num, GL_RGBA, GL_UNSIGNED_BYTE, matcher->upload);
+	sp->activeTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, matcher->texture[0]);
+
+	// A fragment per pair of patterns, over the whole of the viewport.
+	arglOffscreenBind(matcher->offscreen);
+	glViewport(0, 0, num, matcher->num);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	sp->useProgram(matcher->program);
+	sp->uniform2f(sp->getUniformLocation(matcher->program, "librarySize"), (GLfloat)ARGL_MATCH_TEXELS, (GLfloat)(matcher->num * 4));
+	sp->uniform2f(sp->getUniformLocation(matcher->program, "patternsSize"), (GLfloat)ARGL_MATCH_TEXELS, (GLfloat)AR_SQUARE_MAX);
+	glBegin(GL_QUADS);
+	glVertex2f(-1.0f, -1.0f);
+	glVertex2f( 1.0f, -1.0f);
+	glVertex2f( 1.0f,  1.0f);
+	glVertex2f(-1.0f,  1.0f);
+	glEnd();
+	sp->useProgram(0);
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	sp->activeTexture(GL_TEXTURE0 + 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	sp->activeTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, num, matcher->num, GL_RGBA, GL_UNSIGNED_BYTE, matcher->result);
+	arglOffscreenUnbind(matcher->offscreen);
+
+	// The best row of each column.
+	for (c = 0; c < num; c++) {
+		code[c] = -1;
+		dir[c] = -1;
+		cf[c] = 0.0;
+		if (datapow[c] == 0.0) {
+			code[c] = 0;
+			dir[c] = 0;
+			cf[c] = -1.0;
+			continue;
+		}
+		best = -1;
+		r = NULL;
+		for (k = 0; k < matcher->num; k++) {
+			q = (matcher->result[(k * num + c) * 4] << 8) | matcher->result[(k * num + c) * 4 + 1];
+			if (q > best) { best = q; r = &(matcher->result[(k * num + c) * 4]); }
+		}
+		k = (int)(r - matcher->result) / 4 / num;
+		if (r[2] > 3 || matcher->pow[k][r[2]] <= 0.0) continue;
+
+		// The confidence as libAR gives it, from the samples themselves.
+		sum = 0.0;
+		for (i = 0; i < ARGL_MATCH_LEN; i++) sum += (double)input[c][i] * matcher->samples[k][r[2]][i];
+		sum = sum / matcher->pow[k][r[2]] / datapow[c];
+		if (sum > 0.0) {
+			code[c] = matcher->id[k];
+			dir[c] = r[2];
+			cf[c] = sum;
+		}
+	}
+	return (0);
+}
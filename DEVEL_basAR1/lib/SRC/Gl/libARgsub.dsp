@@ -89,6 +89,10 @@ LIB32=link.exe -lib
 
 SOURCE=.\gsub.c
 # End Source File
+# Begin Source File
+
+SOURCE=.\gsub_lite.c
+# End Source File
 # End Group
 # Begin Group "Header Files"
 
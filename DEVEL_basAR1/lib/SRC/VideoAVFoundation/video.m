@@ -0,0 +1,674 @@
+/*
+ *	Video capture for Mac OS X with AVFoundation.
+ *
+ *	Replaces the QuickTime Sequence Grabber module (VideoMacOSX), which
+ *	is gone from current Mac OS X, when AR_INPUT_AVFOUNDATION is defined.
+ *	The capture session delivers CVPixelBuffers on a dispatch queue; the
+ *	delegate only swaps the newest one under a mutex, so no frame is
+ *	copied and none is written while it is in use. ar2VideoGetImage()
+ *	locks the buffer read-only and returns its first plane: the luma of
+ *	a 420f frame, which the marker detection reads in place, or the
+ *	pixels of a BGRA or 2vuy frame. Leased frames keep their buffer
+ *	locked until the last ar2VideoReleaseFrame(). The buffers are backed
+ *	by IOSurfaces, see arglDispImageIOSurface().
+ *
+ *	Frames are stamped with the monotonic clock when they reach the
+ *	delegate.
+ */
+/*
+ *
+ * This file is part of ARToolKit.
+ *
+ * ARToolKit is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * ARToolKit is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with ARToolKit; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+
+#import <AVFoundation/AVFoundation.h>
+#import <CoreMedia/CoreMedia.h>
+#import <CoreVideo/CoreVideo.h>
+#include <mach/mach_time.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <AR/config.h>
+#include <AR/ar.h>
+#include <AR/video.h>
+
+// A locked buffer: the one of the last ar2VideoGetImage(), or a leased one.
+typedef struct {
+	CVPixelBufferRef	buffer;
+	unsigned long		n;
+	long long			time;
+	int					refs;
+} AR2VideoFrameAVFT;
+
+struct _AR2VideoParamT {
+	AVCaptureSession			*session;
+	AVCaptureDeviceInput		*input;
+	AVCaptureVideoDataOutput	*output;
+	id							delegate;
+	dispatch_queue_t			queue;
+	int							width;
+	int							height;
+	OSType						pixelFormat;
+	int							stride;			// Of the first plane.
+	int							capturing;
+	int							debug;
+
+	// Newest buffer of the delegate, not handed out yet, and the references to the frames.
+	pthread_mutex_t				lock;
+	CVPixelBufferRef			pending;
+	unsigned long				sequence;
+	long long					pendingTime;
+
+	// Sequence number and arrival time of the last image, 0 before the first.
+	unsigned long				n;
+	long long					time;
+
+	AR2VideoFrameAVFT			frame[AR_VIDEO_AVF_FRAMES];
+	int							current;
+};
+
+static AR2VideoParamT *gVid = NULL;
+
+static long long	time_now(void);
+static int			pix_size(OSType pixelFormat);
+static void			give_back(AR2VideoParamT *vid, int i);
+
+// Keeps the newest buffer of the capture session, drops the one not taken yet.
+@interface ARVideoAVFDelegate : NSObject <AVCaptureVideoDataOutputSampleBufferDelegate>
+{
+	AR2VideoParamT *vid;
+}
+- (id)initWithVideo:(AR2VideoParamT *)v;
+@end
+
+@implementation ARVideoAVFDelegate
+
+- (id)initWithVideo:(AR2VideoParamT *)v
+{
+	if ((self = [super init])) vid = v;
+	return (self);
+}
+
+- (void)captureOutput:(AVCaptureOutput *)captureOutput didOutputSampleBuffer:(CMSampleBufferRef)sampleBuffer fromConnection:(AVCaptureConnection *)connection
+{
+	CVPixelBufferRef buffer;
+	CVPixelBufferRef old;
+
+	if (!(buffer = CMSampleBufferGetImageBuffer(sampleBuffer))) return;
+	CVPixelBufferRetain(buffer);
+
+	pthread_mutex_lock(&vid->lock);
+	old = vid->pending;
+	vid->pending = buffer;
+	vid->pendingTime = time_now();
+	vid->sequence++;
+	pthread_mutex_unlock(&vid->lock);
+
+	if (old) CVPixelBufferRelease(old);
+}
+
+@end
+
+#pragma mark -
+
+int arVideoDispOption(void)
+{
+	return (ar2VideoDispOption());
+}
+
+int arVideoOpen(char *config)
+{
+	if (gVid != NULL) {
+		printf("Device has been opened!!\n");
+		return (-1);
+	}
+	gVid = ar2VideoOpen(config);
+	if (gVid == NULL) return (-1);
+
+	return (0);
+}
+
+int arVideoClose(void)
+{
+	int result;
+
+	if (gVid == NULL) return (-1);
+
+	result = ar2VideoClose(gVid);
+	gVid = NULL;
+	return (result);
+}
+
+int arVideoInqSize(int *x, int *y)
+{
+	if (gVid == NULL) return (-1);
+
+	return (ar2VideoInqSize(gVid, x, y));
+}
+
+ARUint8 *arVideoGetImage(void)
+{
+	if (gVid == NULL) return (NULL);
+
+	return (ar2VideoGetImage(gVid));
+}
+
+int arVideoCapStart(void)
+{
+	if (gVid == NULL) return (-1);
+
+	return (ar2VideoCapStart(gVid));
+}
+
+int arVideoCapStop(void)
+{
+	if (gVid == NULL) return (-1);
+
+	return (ar2VideoCapStop(gVid));
+}
+
+int arVideoCapNext(void)
+{
+	if (gVid == NULL) return (-1);
+
+	return (ar2VideoCapNext(gVid));
+}
+
+int arVideoLeaseFrame(ARVideoFrame *frame)
+{
+	if (gVid == NULL) return (-1);
+
+	return (ar2VideoLeaseFrame(gVid, frame));
+}
+
+int arVideoRetainFrame(ARVideoFrame *frame)
+{
+	if (gVid == NULL) return (-1);
+
+	return (ar2VideoRetainFrame(gVid, frame));
+}
+
+int arVideoReleaseFrame(ARVideoFrame *frame)
+{
+	if (gVid == NULL) return (-1);
+
+	return (ar2VideoReleaseFrame(gVid, frame));
+}
+
+int arVideoInqFrameInfo(long long *time, unsigned long *n)
+{
+	if (gVid == NULL) return (-1);
+
+	return (ar2VideoInqFrameInfo(gVid, time, n));
+}
+
+long long arVideoTime(void)
+{
+	return (time_now());
+}
+
+#pragma mark -
+
+int ar2VideoDispOption(void)
+{
+	//     0         1         2         3         4         5         6         7
+	//     0123456789012345678901234567890123456789012345678901234567890123456789012
+	printf("ARVideo may be configured using one or more of the following options,\n");
+	printf("separated by a space:\n\n");
+	printf(" -device=n\n");
+	printf("    Use video input device n (default n=0).\n");
+	printf(" -width=w\n");
+	printf("    Capture at width w, scaled if the camera has no such format.\n");
+	printf(" -height=h\n");
+	printf("    Capture at height h, scaled if the camera has no such format.\n");
+	printf(" -pixelformat=cccc\n");
+	printf("    Return images with pixels in format cccc, one of 420f (the luma\n");
+	printf("    plane, AR_PIXEL_FORMAT_MONO, the default), BGRA or 2vuy.\n");
+	printf(" -debug\n");
+	printf("    Print the formats of the device.\n");
+	printf("\n");
+
+	return (0);
+}
+
+AR2VideoParamT *ar2VideoOpen(char *config_in)
+{
+	AR2VideoParamT		*vid;
+	NSAutoreleasePool	*pool;
+	NSArray				*devices;
+	AVCaptureDevice		*device;
+	AVCaptureDeviceFormat *format, *match;
+	NSDictionary		*settings;
+	NSError				*error = nil;
+	CMVideoDimensions	dim;
+	char				*config, *a, line[256];
+	int					deviceIndex = 0;
+	int					width = DEFAULT_VIDEO_WIDTH;
+	int					height = DEFAULT_VIDEO_HEIGHT;
+	int					i;
+
+	// If no config string is supplied, we should use the environment variable, otherwise set a sane default.
+	if (!config_in || !(config_in[0])) {
+		// None suppplied, lets see if the user supplied one from the shell.
+		char *envconf = getenv("ARTOOLKIT_CONFIG");
+		if (envconf && envconf[0]) {
+			config = envconf;
+			printf("Using config string from environment [%s].\n", envconf);
+		} else {
+			config = NULL;
+			printf("No video config string supplied, using defaults.\n");
+		}
+	} else {
+		config = config_in;
+		printf("Using supplied video config string [%s].\n", config_in);
+	}
+
+	arMalloc(vid, AR2VideoParamT, 1);
+	memset(vid, 0, sizeof(AR2VideoParamT));
+	vid->pixelFormat = kCVPixelFormatType_420YpCbCr8BiPlanarFullRange;
+	vid->current = -1;
+
+	a = config;
+	if (a != NULL) {
+		for (;;) {
+			while (*a == ' ' || *a == '\t') a++;
+			if (*a == '\0') break;
+			if (strncmp(a, "-device=", 8) == 0) {
+				sscanf(a, "%s", line);
+				if (sscanf(&line[8], "%d", &deviceIndex) == 0 || deviceIndex < 0) {
+					ar2VideoDispOption();
+					free(vid);
+					return (NULL);
+				}
+			} else if (strncmp(a, "-width=", 7) == 0) {
+				sscanf(a, "%s", line);
+				if (sscanf(&line[7], "%d", &width) == 0 || width <= 0) {
+					ar2VideoDispOption();
+					free(vid);
+					return (NULL);
+				}
+			} else if (strncmp(a, "-height=", 8) == 0) {
+				sscanf(a, "%s", line);
+				if (sscanf(&line[8], "%d", &height) == 0 || height <= 0) {
+					ar2VideoDispOption();
+					free(vid);
+					return (NULL);
+				}
+			} else if (strncmp(a, "-pixelformat=", 13) == 0) {
+				if (strncmp(&a[13], "420f", 4) == 0) vid->pixelFormat = kCVPixelFormatType_420YpCbCr8BiPlanarFullRange;
+				else if (strncmp(&a[13], "BGRA", 4) == 0) vid->pixelFormat = kCVPixelFormatType_32BGRA;
+				else if (strncmp(&a[13], "2vuy", 4) == 0) vid->pixelFormat = kCVPixelFormatType_422YpCbCr8;
+				else {
+					ar2VideoDispOption();
+					free(vid);
+					return (NULL);
+				}
+			} else if (strncmp(a, "-debug", 6) == 0) {
+				vid->debug = 1;
+			} else {
+				ar2VideoDispOption();
+				free(vid);
+				return (NULL);
+			}
+
+			while (*a != ' ' && *a != '\t' && *a != '\0') a++;
+		}
+	}
+
+	pool = [[NSAutoreleasePool alloc] init];
+
+	devices = [AVCaptureDevice devicesWithMediaType:AVMediaTypeVideo];
+	if (deviceIndex >= (int)[devices count]) {
+		printf("ar2VideoOpen(): no video input device %d.\n", deviceIndex);
+		[pool release];
+		free(vid);
+		return (NULL);
+	}
+	device = [devices objectAtIndex:deviceIndex];
+
+	// Capture at the native size if the camera has a format of it.
+	match = nil;
+	for (i = 0; i < (int)[[device formats] count]; i++) {
+		format = [[device formats] objectAtIndex:i];
+		dim = CMVideoFormatDescriptionGetDimensions([format formatDescription]);
+		if (vid->debug) printf("  format %d: %dx%d\n", i, dim.width, dim.height);
+		if (match == nil && dim.width == width && dim.height == height) match = format;
+	}
+	if (match != nil && [device lockForConfiguration:&error]) {
+		[device setActiveFormat:match];
+		[device unlockForConfiguration];
+	}
+
+	vid->input = [[AVCaptureDeviceInput alloc] initWithDevice:device error:&error];
+	if (vid->input == nil) {
+		printf("ar2VideoOpen(): unable to open video input device %d: %s.\n", deviceIndex, [[error localizedDescription] UTF8String]);
+		[pool release];
+		free(vid);
+		return (NULL);
+	}
+
+	// IOSurface backed buffers of the requested size, scaled by the output if need be.
+	settings = [NSDictionary dictionaryWithObjectsAndKeys:
+				[NSNumber numberWithUnsignedInt:vid->pixelFormat], (id)kCVPixelBufferPixelFormatTypeKey,
+				[NSNumber numberWithInt:width], (id)kCVPixelBufferWidthKey,
+				[NSNumber numberWithInt:height], (id)kCVPixelBufferHeightKey,
+				[NSDictionary dictionary], (id)kCVPixelBufferIOSurfacePropertiesKey,
+				[NSNumber numberWithBool:YES], (id)kCVPixelBufferOpenGLCompatibilityKey,
+				nil];
+	vid->output = [[AVCaptureVideoDataOutput alloc] init];
+	[vid->output setVideoSettings:settings];
+	[vid->output setAlwaysDiscardsLateVideoFrames:YES];
+	vid->delegate = [[ARVideoAVFDelegate alloc] initWithVideo:vid];
+	vid->queue = dispatch_queue_create("libARvideo", DISPATCH_QUEUE_SERIAL);
+	[vid->output setSampleBufferDelegate:vid->delegate queue:vid->queue];
+
+	vid->session = [[AVCaptureSession alloc] init];
+	if (![vid->session canAddInput:vid->input] || ![vid->session canAddOutput:vid->output]) {
+		printf("ar2VideoOpen(): unable to set up the capture session.\n");
+		[pool release];
+		ar2VideoClose(vid);
+		return (NULL);
+	}
+	[vid->session addInput:vid->input];
+	[vid->session addOutput:vid->output];
+	[pool release];
+
+	pthread_mutex_init(&vid->lock, NULL);
+	vid->width  = width;
+	vid->height = height;
+	vid->stride = width * pix_size(vid->pixelFormat);
+
+	if (vid->debug) {
+		printf("===== Video Device Info =====\n");
+		printf("   device      = %d%s\n", deviceIndex, (match == nil) ? ", scaled" : "");
+		printf("   size        = %dx%d\n", vid->width, vid->height);
+		printf("   pixelformat = %c%c%c%c\n", (char)(vid->pixelFormat >> 24), (char)(vid->pixelFormat >> 16), (char)(vid->pixelFormat >> 8), (char)vid->pixelFormat);
+	}
+
+	return (vid);
+}
+
+int ar2VideoClose(AR2VideoParamT *vid)
+{
+	int i;
+
+	if (vid == NULL) return (-1);
+	if (vid->capturing) ar2VideoCapStop(vid);
+
+	if (vid->output) [vid->output setSampleBufferDelegate:nil queue:NULL];
+	if (vid->queue) {
+		dispatch_sync(vid->queue, ^{});	// Let a delegate call still queued finish.
+		dispatch_release(vid->queue);
+	}
+	[vid->session release];
+	[vid->output release];
+	[vid->input release];
+	[vid->delegate release];
+
+	if (vid->width) {
+		for (i = 0; i < AR_VIDEO_AVF_FRAMES; i++) {
+			vid->frame[i].refs = 0;
+			give_back(vid, i);
+		}
+		if (vid->pending) CVPixelBufferRelease(vid->pending);
+		pthread_mutex_destroy(&vid->lock);
+	}
+	free(vid);
+
+	return (0);
+}
+
+int ar2VideoCapStart(AR2VideoParamT *vid)
+{
+	if (vid->capturing) {
+		printf("arVideoCapStart has already been called.\n");
+		return (-1);
+	}
+	[vid->session startRunning];
+	if (![vid->session isRunning]) {
+		printf("ar2VideoCapStart(): unable to start the capture session.\n");
+		return (-1);
+	}
+	vid->capturing = 1;
+
+	return (0);
+}
+
+int ar2VideoCapNext(AR2VideoParamT *vid)
+{
+	// Give the last frame back to the capture session.
+	pthread_mutex_lock(&vid->lock);
+	give_back(vid, vid->current);
+	vid->current = -1;
+	pthread_mutex_unlock(&vid->lock);
+
+	return (0);
+}
+
+int ar2VideoCapStop(AR2VideoParamT *vid)
+{
+	if (!vid->capturing) {
+		printf("arVideoCapStart has never been called.\n");
+		return (-1);
+	}
+	[vid->session stopRunning];
+	vid->capturing = 0;
+
+	pthread_mutex_lock(&vid->lock);
+	give_back(vid, vid->current);
+	vid->current = -1;
+	if (vid->pending) CVPixelBufferRelease(vid->pending);
+	vid->pending = NULL;
+	pthread_mutex_unlock(&vid->lock);
+
+	return (0);
+}
+
+ARUint8 *ar2VideoGetImage(AR2VideoParamT *vid)
+{
+	CVPixelBufferRef	buffer;
+	ARUint8				*image;
+	int					i;
+
+	pthread_mutex_lock(&vid->lock);
+	buffer = vid->pending;
+	vid->pending = NULL;
+	if (!buffer) {
+		pthread_mutex_unlock(&vid->lock);
+		return (NULL);
+	}
+
+	// The last frame is given back, unless it is leased.
+	give_back(vid, vid->current);
+	vid->current = -1;
+
+	for (i = 0; i < AR_VIDEO_AVF_FRAMES; i++) {
+		if (!vid->frame[i].buffer) break;
+	}
+	if (i == AR_VIDEO_AVF_FRAMES) {
+		pthread_mutex_unlock(&vid->lock);
+		printf("libARvideo: every frame is leased\n");
+		CVPixelBufferRelease(buffer);
+		return (NULL);
+	}
+	if (CVPixelBufferLockBaseAddress(buffer, kCVPixelBufferLock_ReadOnly) != kCVReturnSuccess) {
+		pthread_mutex_unlock(&vid->lock);
+		CVPixelBufferRelease(buffer);
+		return (NULL);
+	}
+	if (CVPixelBufferIsPlanar(buffer)) {
+		image = (ARUint8 *)CVPixelBufferGetBaseAddressOfPlane(buffer, 0);
+		vid->stride = (int)CVPixelBufferGetBytesPerRowOfPlane(buffer, 0);
+	} else {
+		image = (ARUint8 *)CVPixelBufferGetBaseAddress(buffer);
+		vid->stride = (int)CVPixelBufferGetBytesPerRow(buffer);
+	}
+	vid->frame[i].buffer = buffer;
+	vid->frame[i].n      = vid->sequence;
+	vid->frame[i].time   = vid->pendingTime;
+	vid->frame[i].refs   = 0;
+	vid->current = i;
+	vid->n    = vid->frame[i].n;
+	vid->time = vid->frame[i].time;
+	pthread_mutex_unlock(&vid->lock);
+
+	return (image);
+}
+
+int ar2VideoInqSize(AR2VideoParamT *vid, int *x, int *y)
+{
+	*x = vid->width;
+	*y = vid->height;
+
+	return (0);
+}
+
+int ar2VideoInqPixelFormat(AR2VideoParamT *vid, int *format, int *stride)
+{
+	int f;
+
+	switch (vid->pixelFormat) {
+		case kCVPixelFormatType_420YpCbCr8BiPlanarFullRange: f = AR_PIXEL_FORMAT_MONO; break;
+		case kCVPixelFormatType_32BGRA:                      f = AR_PIXEL_FORMAT_BGRA; break;
+		case kCVPixelFormatType_422YpCbCr8:                  f = AR_PIXEL_FORMAT_2vuy; break;
+		default: return (-1);
+	}
+	if (format) *format = f;
+	if (stride) *stride = vid->stride;
+
+	return (0);
+}
+
+CVPixelBufferRef ar2VideoInqPixelBuffer(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	CVPixelBufferRef buffer = NULL;
+	int i;
+
+	pthread_mutex_lock(&vid->lock);
+	i = (frame) ? frame->id : vid->current;
+	if (i >= 0 && i < AR_VIDEO_AVF_FRAMES && (!frame || vid->frame[i].n == frame->n)) {
+		buffer = vid->frame[i].buffer;
+	}
+	pthread_mutex_unlock(&vid->lock);
+
+	return (buffer);
+}
+
+int ar2VideoLeaseFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	AR2VideoFrameAVFT *f;
+
+	if (ar2VideoInqPixelFormat(vid, &frame->format, NULL) < 0) return (-1);
+
+	pthread_mutex_lock(&vid->lock);
+	if (vid->current < 0) {
+		pthread_mutex_unlock(&vid->lock);
+		return (-1);
+	}
+	f = &vid->frame[vid->current];
+	f->refs++;
+	if (CVPixelBufferIsPlanar(f->buffer)) {
+		frame->buff   = (ARUint8 *)CVPixelBufferGetBaseAddressOfPlane(f->buffer, 0);
+		frame->stride = (int)CVPixelBufferGetBytesPerRowOfPlane(f->buffer, 0);
+	} else {
+		frame->buff   = (ARUint8 *)CVPixelBufferGetBaseAddress(f->buffer);
+		frame->stride = (int)CVPixelBufferGetBytesPerRow(f->buffer);
+	}
+	frame->time   = f->time;
+	frame->xsize  = vid->width;
+	frame->ysize  = vid->height;
+	frame->n      = f->n;
+	frame->id     = vid->current;
+	pthread_mutex_unlock(&vid->lock);
+
+	return (0);
+}
+
+int ar2VideoRetainFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	int i = frame->id;
+
+	pthread_mutex_lock(&vid->lock);
+	if (i < 0 || i >= AR_VIDEO_AVF_FRAMES || vid->frame[i].refs == 0 || vid->frame[i].n != frame->n) {
+		pthread_mutex_unlock(&vid->lock);
+		return (-1);
+	}
+	vid->frame[i].refs++;
+	pthread_mutex_unlock(&vid->lock);
+
+	return (0);
+}
+
+int ar2VideoReleaseFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	int i = frame->id;
+
+	pthread_mutex_lock(&vid->lock);
+	if (i < 0 || i >= AR_VIDEO_AVF_FRAMES || vid->frame[i].refs == 0 || vid->frame[i].n != frame->n) {
+		pthread_mutex_unlock(&vid->lock);
+		return (-1);
+	}
+	vid->frame[i].refs--;
+	if (i != vid->current) give_back(vid, i);
+	pthread_mutex_unlock(&vid->lock);
+
+	return (0);
+}
+
+int ar2VideoInqFrameInfo(AR2VideoParamT *vid, long long *time, unsigned long *n)
+{
+	pthread_mutex_lock(&vid->lock);
+	if (vid->time == 0) {
+		pthread_mutex_unlock(&vid->lock);
+		return (-1);
+	}
+	if (time) *time = vid->time;
+	if (n) *n = vid->n;
+	pthread_mutex_unlock(&vid->lock);
+
+	return (0);
+}
+
+#pragma mark -
+
+// Microseconds on the monotonic clock of arVideoTime().
+static long long time_now(void)
+{
+	static mach_timebase_info_data_t tb;
+
+	if (tb.denom == 0) mach_timebase_info(&tb);
+	return ((long long)(mach_absolute_time() / 1000 * tb.numer / tb.denom));
+}
+
+static int pix_size(OSType pixelFormat)
+{
+	switch (pixelFormat) {
+		case kCVPixelFormatType_32BGRA:     return (4);
+		case kCVPixelFormatType_422YpCbCr8: return (2);
+		default:                            return (1);
+	}
+}
+
+// Unlocks and releases the buffer of frame i, unless it is leased. Called with the lock held.
+static void give_back(AR2VideoParamT *vid, int i)
+{
+	if (i < 0 || vid->frame[i].refs > 0 || !vid->frame[i].buffer) return;
+
+	CVPixelBufferUnlockBaseAddress(vid->frame[i].buffer, kCVPixelBufferLock_ReadOnly);
+	CVPixelBufferRelease(vid->frame[i].buffer);
+	vid->frame[i].buffer = NULL;
+}
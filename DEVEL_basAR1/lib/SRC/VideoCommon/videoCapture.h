@@ -0,0 +1,134 @@
+/*
+ * Capture thread for the video modules whose ar2VideoGetImage() blocks
+ * until the driver has a frame. The thread grabs every frame into one of
+ * three buffers and keeps the newest one ready, dropping the older ones,
+ * so that ar2VideoGetImage() only checks for a new frame.
+ *
+ * Included by the video.c of the module; every function is static.
+ */
+#ifndef AR_VIDEO_CAPTURE_H
+#define AR_VIDEO_CAPTURE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <AR/config.h>
+#include <AR/ar.h>
+
+/* grabs one frame of the driver, returns the image or NULL and its capture time */
+typedef ARUint8 *(*VideoCaptureGrabT)( void *vid, long long *time );
+/* gives the frame of the last grab back to the driver */
+typedef int (*VideoCaptureNextT)( void *vid );
+
+struct VideoCaptureThread {
+    pthread_t            thread;
+    pthread_mutex_t      mutex;
+    volatile int         run;
+    VideoCaptureGrabT    grab;
+    VideoCaptureNextT    next;
+    void                *vid;
+    int                  size;
+    /* written by the thread, newest complete frame, handed out */
+    ARUint8             *buff[3];
+    long long            time[3];
+    int                  write, ready, read;
+    int                  fresh;
+};
+
+static void *videoCaptureRun( void *arg )
+{
+    struct VideoCaptureThread *cap = (struct VideoCaptureThread *)arg;
+    ARUint8                   *image;
+    long long                  time;
+    int                        i;
+
+    arThreadRole( AR_THREAD_CAPTURE, "video capture" );
+    while( cap->run ) {
+        AR_TRACE_BEGIN( "grab" );
+        image = (*cap->grab)( cap->vid, &time );
+        AR_TRACE_END();
+        AR_TRACE_BEGIN( "copy" );
+        if( image != NULL ) {
+            memcpy( cap->buff[cap->write], image, cap->size );
+            cap->time[cap->write] = time;
+        }
+        (*cap->next)( cap->vid );
+        AR_TRACE_END();
+        if( image == NULL ) continue;
+
+        pthread_mutex_lock( &cap->mutex );
+        i = cap->ready;
+        cap->ready = cap->write;
+        cap->write = i;
+        cap->fresh = 1;
+        pthread_mutex_unlock( &cap->mutex );
+    }
+    arThreadRoleEnd();
+
+    return NULL;
+}
+
+/* starts grabbing frames of size bytes, NULL if the thread cannot start */
+static struct VideoCaptureThread *videoCaptureStart( void *vid, VideoCaptureGrabT grab, VideoCaptureNextT next, int size )
+{
+    struct VideoCaptureThread *cap;
+    int                        i;
+
+    arMalloc( cap, struct VideoCaptureThread, 1 );
+    memset( cap, 0, sizeof(struct VideoCaptureThread) );
+    for( i = 0; i < 3; i++ ) arMallocImage( cap->buff[i], ARUint8, size, AR_MEM_VIDEO );
+    cap->grab  = grab;
+    cap->next  = next;
+    cap->vid   = vid;
+    cap->size  = size;
+    cap->write = 0;
+    cap->ready = 1;
+    cap->read  = 2;
+    cap->run   = 1;
+    pthread_mutex_init( &cap->mutex, NULL );
+    if( pthread_create( &cap->thread, NULL, videoCaptureRun, cap ) != 0 ) {
+        printf("unable to start the capture thread.\n");
+        pthread_mutex_destroy( &cap->mutex );
+        for( i = 0; i < 3; i++ ) arImageFree( cap->buff[i] );
+        free( cap );
+        return NULL;
+    }
+
+    return cap;
+}
+
+/* waits for the frame in progress, the driver can be stopped afterwards */
+static void videoCaptureStop( struct VideoCaptureThread *cap )
+{
+    int     i;
+
+    if( cap == NULL ) return;
+    cap->run = 0;
+    pthread_join( cap->thread, NULL );
+    pthread_mutex_destroy( &cap->mutex );
+    for( i = 0; i < 3; i++ ) arImageFree( cap->buff[i] );
+    free( cap );
+}
+
+/* the newest frame if there is one since the last call, without waiting */
+static ARUint8 *videoCaptureImage( struct VideoCaptureThread *cap, long long *time )
+{
+    ARUint8  *image = NULL;
+    int       i;
+
+    pthread_mutex_lock( &cap->mutex );
+    if( cap->fresh ) {
+        i = cap->read;
+        cap->read  = cap->ready;
+        cap->ready = i;
+        cap->fresh = 0;
+        image = cap->buff[cap->read];
+        if( time != NULL ) *time = cap->time[cap->read];
+    }
+    pthread_mutex_unlock( &cap->mutex );
+
+    return image;
+}
+
+#endif
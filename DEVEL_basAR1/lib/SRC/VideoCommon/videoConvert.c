@@ -0,0 +1,379 @@
+/*
+ * Colour conversions shared by the video modules, replacing the per
+ * module ccvt and libdc1394 conversion loops.
+ *
+ * YUV to RGB is done in 16 bit fixed point, scaled by 64:
+ *   R = Y + 1.402 V,  G = Y - 0.344 U - 0.714 V,  B = Y + 1.772 U
+ * which fits a signed 16 bit lane, so that SSE2 and NEON compute eight
+ * pixels at a time exactly as the C code does one.
+ */
+#include <string.h>
+#include <AR/config.h>
+#include <AR/ar.h>
+#include "videoConvert.h"
+
+// SSE2 is in every x86-64 compiler; interleaving the 24 bit stores needs
+// the SSSE3 byte shuffles. NEON interleaves the stores itself.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define AR_CONV_SSE2
+#  include <emmintrin.h>
+#  if defined(__SSSE3__) || defined(__AVX__)
+#    define AR_CONV_SSSE3
+#    include <tmmintrin.h>
+#  endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define AR_CONV_NEON
+#  include <arm_neon.h>
+#endif
+
+#define CONV_VR     90
+#define CONV_UG     22
+#define CONV_VG     46
+#define CONV_UB    113
+
+static void conv_pixel( int y, int u, int v, ARUint8 *dst, int bgr )
+{
+    int     r, g, b;
+
+    y <<= 6;
+    u -= 128;
+    v -= 128;
+    r = (y + CONV_VR * v) >> 6;
+    g = (y - CONV_UG * u - CONV_VG * v) >> 6;
+    b = (y + CONV_UB * u) >> 6;
+    if( r < 0 ) r = 0; else if( r > 255 ) r = 255;
+    if( g < 0 ) g = 0; else if( g > 255 ) g = 255;
+    if( b < 0 ) b = 0; else if( b > 255 ) b = 255;
+    dst[bgr? 2: 0] = (ARUint8)r;
+    dst[1]         = (ARUint8)g;
+    dst[bgr? 0: 2] = (ARUint8)b;
+}
+
+#if defined(AR_CONV_SSE2)
+/* 16 pixels of three planes to 48 bytes of RGB */
+static void store_rgb24( __m128i r, __m128i g, __m128i b, ARUint8 *dst )
+{
+#if defined(AR_CONV_SSSE3)
+    const __m128i  r0 = _mm_setr_epi8( 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5 );
+    const __m128i  g0 = _mm_setr_epi8( -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1 );
+    const __m128i  b0 = _mm_setr_epi8( -1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1 );
+    const __m128i  r1 = _mm_setr_epi8( -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1 );
+    const __m128i  g1 = _mm_setr_epi8( 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10 );
+    const __m128i  b1 = _mm_setr_epi8( -1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1 );
+    const __m128i  r2 = _mm_setr_epi8( -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1 );
+    const __m128i  g2 = _mm_setr_epi8( -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1 );
+    const __m128i  b2 = _mm_setr_epi8( 10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15 );
+
+    _mm_storeu_si128( (__m128i *)(dst),      _mm_or_si128( _mm_or_si128( _mm_shuffle_epi8(r, r0), _mm_shuffle_epi8(g, g0) ), _mm_shuffle_epi8(b, b0) ) );
+    _mm_storeu_si128( (__m128i *)(dst + 16), _mm_or_si128( _mm_or_si128( _mm_shuffle_epi8(r, r1), _mm_shuffle_epi8(g, g1) ), _mm_shuffle_epi8(b, b1) ) );
+    _mm_storeu_si128( (__m128i *)(dst + 32), _mm_or_si128( _mm_or_si128( _mm_shuffle_epi8(r, r2), _mm_shuffle_epi8(g, g2) ), _mm_shuffle_epi8(b, b2) ) );
+#else
+    ARUint8  pr[16], pg[16], pb[16];
+    int      i;
+
+    _mm_storeu_si128( (__m128i *)pr, r );
+    _mm_storeu_si128( (__m128i *)pg, g );
+    _mm_storeu_si128( (__m128i *)pb, b );
+    for( i = 0; i < 16; i++ ) {
+        *dst++ = pr[i];
+        *dst++ = pg[i];
+        *dst++ = pb[i];
+    }
+#endif
+}
+
+/* one channel of eight pixels: (y*64 + c1*u + c2*v) >> 6, in 16 bit lanes */
+#define CONV_CH(y, t)   _mm_srai_epi16( _mm_add_epi16( y, t ), 6 )
+
+/* y, u, v: 16 bit lanes of per pixel values, for the pixels 0-7 and 8-15 */
+static void conv_rgb16( __m128i y0, __m128i u0, __m128i v0,
+                        __m128i y1, __m128i u1, __m128i v1, ARUint8 *dst, int bgr )
+{
+    const __m128i  c128 = _mm_set1_epi16( 128 );
+    const __m128i  vr = _mm_set1_epi16( CONV_VR );
+    const __m128i  ug = _mm_set1_epi16( CONV_UG );
+    const __m128i  vg = _mm_set1_epi16( CONV_VG );
+    const __m128i  ub = _mm_set1_epi16( CONV_UB );
+    __m128i        r, g, b;
+
+    y0 = _mm_slli_epi16( y0, 6 );
+    y1 = _mm_slli_epi16( y1, 6 );
+    u0 = _mm_sub_epi16( u0, c128 );
+    u1 = _mm_sub_epi16( u1, c128 );
+    v0 = _mm_sub_epi16( v0, c128 );
+    v1 = _mm_sub_epi16( v1, c128 );
+    r = _mm_packus_epi16( CONV_CH(y0, _mm_mullo_epi16(v0, vr)),
+                          CONV_CH(y1, _mm_mullo_epi16(v1, vr)) );
+    g = _mm_packus_epi16( CONV_CH(y0, _mm_sub_epi16(_mm_setzero_si128(), _mm_add_epi16(_mm_mullo_epi16(u0, ug), _mm_mullo_epi16(v0, vg)))),
+                          CONV_CH(y1, _mm_sub_epi16(_mm_setzero_si128(), _mm_add_epi16(_mm_mullo_epi16(u1, ug), _mm_mullo_epi16(v1, vg)))) );
+    b = _mm_packus_epi16( CONV_CH(y0, _mm_mullo_epi16(u0, ub)),
+                          CONV_CH(y1, _mm_mullo_epi16(u1, ub)) );
+    if( bgr ) store_rgb24( b, g, r, dst );
+     else     store_rgb24( r, g, b, dst );
+}
+#endif
+
+#if defined(AR_CONV_NEON)
+static uint8x8_t conv_ch_neon( int16x8_t t )
+{
+    return vqshrun_n_s16( t, 6 );
+}
+
+/* y, u, v: 16 per pixel values */
+static void conv_rgb16( uint8x16_t y, uint8x16_t u, uint8x16_t v, ARUint8 *dst, int bgr )
+{
+    const uint8x8_t  c128 = vdup_n_u8( 128 );
+    int16x8_t        yl, yh, ul, uh, vl, vh;
+    uint8x16x3_t     o;
+    uint8x16_t       r, g, b;
+
+    yl = vreinterpretq_s16_u16( vshll_n_u8(vget_low_u8(y), 6) );
+    yh = vreinterpretq_s16_u16( vshll_n_u8(vget_high_u8(y), 6) );
+    ul = vreinterpretq_s16_u16( vsubl_u8(vget_low_u8(u), c128) );
+    uh = vreinterpretq_s16_u16( vsubl_u8(vget_high_u8(u), c128) );
+    vl = vreinterpretq_s16_u16( vsubl_u8(vget_low_u8(v), c128) );
+    vh = vreinterpretq_s16_u16( vsubl_u8(vget_high_u8(v), c128) );
+    r = vcombine_u8( conv_ch_neon(vmlaq_n_s16(yl, vl, CONV_VR)),
+                     conv_ch_neon(vmlaq_n_s16(yh, vh, CONV_VR)) );
+    g = vcombine_u8( conv_ch_neon(vmlsq_n_s16(vmlsq_n_s16(yl, ul, CONV_UG), vl, CONV_VG)),
+                     conv_ch_neon(vmlsq_n_s16(vmlsq_n_s16(yh, uh, CONV_UG), vh, CONV_VG)) );
+    b = vcombine_u8( conv_ch_neon(vmlaq_n_s16(yl, ul, CONV_UB)),
+                     conv_ch_neon(vmlaq_n_s16(yh, uh, CONV_UB)) );
+    o.val[0] = bgr? b: r;
+    o.val[1] = g;
+    o.val[2] = bgr? r: b;
+    vst3q_u8( dst, o );
+}
+#endif
+
+void videoConvUYVYToRGB24( const ARUint8 *src, ARUint8 *dst, int pixels )
+{
+    int     i = 0;
+
+#if defined(AR_CONV_SSE2)
+    {
+        const __m128i  lo = _mm_set1_epi16( 0x00FF );
+        __m128i        a, b, uv;
+
+        for( ; i + 16 <= pixels; i += 16, src += 32, dst += 48 ) {
+            a  = _mm_loadu_si128( (const __m128i *)src );
+            b  = _mm_loadu_si128( (const __m128i *)(src + 16) );
+            /* U0 V0 U1 V1 ... in 16 bit lanes, each U and V for two pixels */
+            uv = _mm_and_si128( a, lo );
+            a  = _mm_srli_epi16( a, 8 );
+            {
+                __m128i  u0 = _mm_shufflehi_epi16( _mm_shufflelo_epi16(uv, _MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,2,0,0) );
+                __m128i  v0 = _mm_shufflehi_epi16( _mm_shufflelo_epi16(uv, _MM_SHUFFLE(3,3,1,1)), _MM_SHUFFLE(3,3,1,1) );
+                __m128i  u1, v1;
+
+                uv = _mm_and_si128( b, lo );
+                b  = _mm_srli_epi16( b, 8 );
+                u1 = _mm_shufflehi_epi16( _mm_shufflelo_epi16(uv, _MM_SHUFFLE(2,2,0,0)), _MM_SHUFFLE(2,2,0,0) );
+                v1 = _mm_shufflehi_epi16( _mm_shufflelo_epi16(uv, _MM_SHUFFLE(3,3,1,1)), _MM_SHUFFLE(3,3,1,1) );
+                conv_rgb16( a, u0, v0, b, u1, v1, dst, 0 );
+            }
+        }
+    }
+#elif defined(AR_CONV_NEON)
+    {
+        uint8x8x4_t   p;
+        uint8x16_t    y, u, v;
+
+        for( ; i + 16 <= pixels; i += 16, src += 32, dst += 48 ) {
+            p = vld4_u8( src );
+            y = vcombine_u8( vzip_u8(p.val[1], p.val[3]).val[0], vzip_u8(p.val[1], p.val[3]).val[1] );
+            u = vcombine_u8( vzip_u8(p.val[0], p.val[0]).val[0], vzip_u8(p.val[0], p.val[0]).val[1] );
+            v = vcombine_u8( vzip_u8(p.val[2], p.val[2]).val[0], vzip_u8(p.val[2], p.val[2]).val[1] );
+            conv_rgb16( y, u, v, dst, 0 );
+        }
+    }
+#endif
+    for( ; i + 2 <= pixels; i += 2, src += 4, dst += 6 ) {
+        conv_pixel( src[1], src[0], src[2], dst,     0 );
+        conv_pixel( src[3], src[0], src[2], dst + 3, 0 );
+    }
+}
+
+void videoConvYUV411ToRGB24( const ARUint8 *src, ARUint8 *dst, int pixels )
+{
+    int     i = 0;
+
+#if defined(AR_CONV_SSE2) || defined(AR_CONV_NEON)
+    {
+        ARUint8  y[16], u[16], v[16];
+        int      j;
+
+        /* gathered into planes, four pixels share U and V */
+        for( ; i + 16 <= pixels; i += 16, src += 24, dst += 48 ) {
+            for( j = 0; j < 16; j += 4 ) {
+                u[j] = u[j+1] = u[j+2] = u[j+3] = src[j/4*6];
+                v[j] = v[j+1] = v[j+2] = v[j+3] = src[j/4*6+3];
+                y[j]   = src[j/4*6+1];
+                y[j+1] = src[j/4*6+2];
+                y[j+2] = src[j/4*6+4];
+                y[j+3] = src[j/4*6+5];
+            }
+#if defined(AR_CONV_SSE2)
+            {
+                const __m128i  zero = _mm_setzero_si128();
+                __m128i        yy = _mm_loadu_si128( (const __m128i *)y );
+                __m128i        uu = _mm_loadu_si128( (const __m128i *)u );
+                __m128i        vv = _mm_loadu_si128( (const __m128i *)v );
+
+                conv_rgb16( _mm_unpacklo_epi8(yy, zero), _mm_unpacklo_epi8(uu, zero), _mm_unpacklo_epi8(vv, zero),
+                            _mm_unpackhi_epi8(yy, zero), _mm_unpackhi_epi8(uu, zero), _mm_unpackhi_epi8(vv, zero), dst, 0 );
+            }
+#else
+            conv_rgb16( vld1q_u8(y), vld1q_u8(u), vld1q_u8(v), dst, 0 );
+#endif
+        }
+    }
+#endif
+    for( ; i + 4 <= pixels; i += 4, src += 6, dst += 12 ) {
+        conv_pixel( src[1], src[0], src[3], dst,     0 );
+        conv_pixel( src[2], src[0], src[3], dst + 3, 0 );
+        conv_pixel( src[4], src[0], src[3], dst + 6, 0 );
+        conv_pixel( src[5], src[0], src[3], dst + 9, 0 );
+    }
+}
+
+void videoConvYUV420pToBGR24( const ARUint8 *srcy, const ARUint8 *srcu, const ARUint8 *srcv,
+                              ARUint8 *dst, int width, int height )
+{
+    const ARUint8  *py, *pu, *pv;
+    ARUint8        *pd;
+    int             i, j;
+
+    for( j = 0; j < height; j++ ) {
+        py = srcy + j * width;
+        pu = srcu + (j/2) * (width/2);
+        pv = srcv + (j/2) * (width/2);
+        pd = dst + j * width * 3;
+        i = 0;
+#if defined(AR_CONV_SSE2)
+        {
+            const __m128i  zero = _mm_setzero_si128();
+            __m128i        yy, uu, vv;
+
+            for( ; i + 16 <= width; i += 16, py += 16, pu += 8, pv += 8, pd += 48 ) {
+                yy = _mm_loadu_si128( (const __m128i *)py );
+                uu = _mm_unpacklo_epi8( _mm_loadl_epi64((const __m128i *)pu), zero );
+                vv = _mm_unpacklo_epi8( _mm_loadl_epi64((const __m128i *)pv), zero );
+                conv_rgb16( _mm_unpacklo_epi8(yy, zero), _mm_unpacklo_epi16(uu, uu), _mm_unpacklo_epi16(vv, vv),
+                            _mm_unpackhi_epi8(yy, zero), _mm_unpackhi_epi16(uu, uu), _mm_unpackhi_epi16(vv, vv), pd, 1 );
+            }
+        }
+#elif defined(AR_CONV_NEON)
+        {
+            uint8x8_t  uu, vv;
+
+            for( ; i + 16 <= width; i += 16, py += 16, pu += 8, pv += 8, pd += 48 ) {
+                uu = vld1_u8( pu );
+                vv = vld1_u8( pv );
+                conv_rgb16( vld1q_u8(py),
+                            vcombine_u8( vzip_u8(uu, uu).val[0], vzip_u8(uu, uu).val[1] ),
+                            vcombine_u8( vzip_u8(vv, vv).val[0], vzip_u8(vv, vv).val[1] ), pd, 1 );
+            }
+        }
+#endif
+        for( ; i + 2 <= width; i += 2, py += 2, pu++, pv++, pd += 6 ) {
+            conv_pixel( py[0], *pu, *pv, pd,     1 );
+            conv_pixel( py[1], *pu, *pv, pd + 3, 1 );
+        }
+    }
+}
+
+void videoConvBayerToRGB24( const ARUint8 *src, ARUint8 *dst, int width, int height,
+                            bayer_pattern_t pattern )
+{
+    const ARUint8  *a, *b;
+    const ARUint8  *pr, *pb, *pg0, *pg1;
+    ARUint8        *pd;
+    int             i, j, rx, bx, g0, g1;
+
+    /* rows a and b of a tile: which row holds R, B and the G of columns 0 and 1 */
+    switch( pattern ) {
+      case BAYER_PATTERN_GRBG: rx = 1; bx = 2; g0 = 0; g1 = 3; break;
+      case BAYER_PATTERN_BGGR: rx = 3; bx = 0; g0 = 2; g1 = 1; break;
+      case BAYER_PATTERN_RGGB: rx = 0; bx = 3; g0 = 2; g1 = 1; break;
+      case BAYER_PATTERN_GBRG: rx = 2; bx = 1; g0 = 0; g1 = 3; break;
+      default: return;
+    }
+
+    for( j = 0; j + 2 <= height; j += 2 ) {
+        a  = src + j * width;
+        b  = a + width;
+        /* position 0..3 = a[0], a[1], b[0], b[1] of the tile */
+        pr  = ((rx < 2)? a: b) + (rx & 1);
+        pb  = ((bx < 2)? a: b) + (bx & 1);
+        pg0 = ((g0 < 2)? a: b) + (g0 & 1);
+        pg1 = ((g1 < 2)? a: b) + (g1 & 1);
+        pd = dst + j * width * 3;
+        i = 0;
+#if defined(AR_CONV_SSE2)
+        {
+            const __m128i  lo = _mm_set1_epi16( 0x00FF );
+            __m128i        r, bb, g;
+
+            /* the sample of a tile is the low byte of a 16 bit lane, or the
+               high byte one byte before for the G of column 1 */
+            for( ; i + 16 <= width - 1; i += 16, pd += 48 ) {
+                r  = _mm_and_si128( _mm_loadu_si128((const __m128i *)(pr + i)), lo );
+                bb = _mm_and_si128( _mm_loadu_si128((const __m128i *)(pb + i)), lo );
+                g  = _mm_or_si128( _mm_and_si128( _mm_loadu_si128((const __m128i *)(pg0 + i)), lo ),
+                                   _mm_andnot_si128( lo, _mm_loadu_si128((const __m128i *)(pg1 + i - 1)) ) );
+                r  = _mm_or_si128( r, _mm_slli_epi16(r, 8) );
+                bb = _mm_or_si128( bb, _mm_slli_epi16(bb, 8) );
+                store_rgb24( r, g, bb, pd );
+            }
+        }
+#elif defined(AR_CONV_NEON)
+        {
+            uint8x16x2_t  t;
+            uint8x16x3_t  o;
+            uint8x16_t    r, bb;
+
+            for( ; i + 32 <= width - 1; i += 32, pd += 96 ) {
+                r  = vld2q_u8( pr + i ).val[0];
+                bb = vld2q_u8( pb + i ).val[0];
+                t.val[0] = vld2q_u8( pg0 + i ).val[0];
+                t.val[1] = vld2q_u8( pg1 + i - 1 ).val[1];
+                o.val[0] = vzipq_u8( r, r ).val[0];
+                o.val[1] = vzipq_u8( t.val[0], t.val[1] ).val[0];
+                o.val[2] = vzipq_u8( bb, bb ).val[0];
+                vst3q_u8( pd, o );
+                o.val[0] = vzipq_u8( r, r ).val[1];
+                o.val[1] = vzipq_u8( t.val[0], t.val[1] ).val[1];
+                o.val[2] = vzipq_u8( bb, bb ).val[1];
+                vst3q_u8( pd + 48, o );
+            }
+        }
+#endif
+        for( ; i + 2 <= width; i += 2, pd += 6 ) {
+            pd[0] = pd[3] = pr[i];
+            pd[2] = pd[5] = pb[i];
+            pd[1] = pg0[i];
+            pd[4] = pg1[i];
+        }
+        /* both rows of a tile are the same */
+        memcpy( dst + (j + 1) * width * 3, dst + j * width * 3, width * 3 );
+    }
+}
+
+void videoConvBayerToLuma( const ARUint8 *src, ARUint8 *dst, int width, int height )
+{
+    const ARUint8  *a, *b;
+    ARUint8        *pd;
+    int             i, j;
+
+    for( j = 0; j + 2 <= height; j += 2 ) {
+        a  = src + j * width;
+        b  = a + width;
+        pd = dst + j * width;
+        for( i = 0; i + 2 <= width; i += 2 ) {
+            pd[i] = pd[i+1] = (ARUint8)((a[i] + a[i+1] + b[i] + b[i+1] + 2) >> 2);
+        }
+        /* both rows of a tile are the same */
+        memcpy( pd + width, pd, width );
+    }
+}
@@ -0,0 +1,47 @@
+/*
+ * Colour conversions of the video modules, into the 24 bit formats of
+ * ARToolKit. One integer YUV to RGB conversion is shared by every YUV
+ * format, so that the vectorized paths (SSE2, with SSSE3 for the 24 bit
+ * stores, or NEON) give the same pixels as the plain C one.
+ *
+ * The sizes are in pixels and assumed even.
+ */
+#ifndef AR_VIDEO_CONVERT_H
+#define AR_VIDEO_CONVERT_H
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <AR/config.h>
+#include <AR/ar.h>
+
+typedef enum
+{
+  BAYER_PATTERN_BGGR,
+  BAYER_PATTERN_GRBG,
+  BAYER_PATTERN_RGGB,
+  BAYER_PATTERN_GBRG
+} bayer_pattern_t;
+
+/* 4:2:2 U Y0 V Y1 to RGB */
+void videoConvUYVYToRGB24( const ARUint8 *src, ARUint8 *dst, int pixels );
+
+/* 4:1:1 U Y0 Y1 V Y2 Y3 to RGB */
+void videoConvYUV411ToRGB24( const ARUint8 *src, ARUint8 *dst, int pixels );
+
+/* 4:2:0 planar to BGR */
+void videoConvYUV420pToBGR24( const ARUint8 *srcy, const ARUint8 *srcu, const ARUint8 *srcv,
+                              ARUint8 *dst, int width, int height );
+
+/* Bayer tiles to RGB, every 2x2 tile taking its own R, B and the G of its column */
+void videoConvBayerToRGB24( const ARUint8 *src, ARUint8 *dst, int width, int height,
+                            bayer_pattern_t pattern );
+
+/* Bayer tiles to a luma plane of the same size, every pixel of a 2x2 tile
+   taking (R + G + G + B) / 4: the same whatever the pattern */
+void videoConvBayerToLuma( const ARUint8 *src, ARUint8 *dst, int width, int height );
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,198 @@
+/*
+ * Groups of video devices captured together, for the video modules with
+ * frame leases. Every device of a group is grabbed by its own thread,
+ * which keeps the last AR_VIDEO_GROUP_HISTORY frames leased. A frame set
+ * takes the newest frame of the slowest device and, of every other
+ * device, the frame nearest to it in time.
+ *
+ * Cameras with a hardware trigger (1394 -trigger) give frames of the same
+ * exposure, the nearest timestamp pairs them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <AR/config.h>
+#include <AR/ar.h>
+#include <AR/video.h>
+
+typedef struct {
+    AR2VideoGroupT      *group;
+    AR2VideoParamT      *vid;
+    pthread_t            thread;
+    ARVideoFrame         hist[AR_VIDEO_GROUP_HISTORY];
+    int                  hist_num;
+    int                  hist_next;
+} AR2VideoGroupDeviceT;
+
+struct _AR2VideoGroupT {
+    pthread_mutex_t      mutex;
+    volatile int         run;
+    int                  num;
+    long long            time;          /* of the last frame set */
+    AR2VideoGroupDeviceT dev[AR_VIDEO_GROUP_MAX];
+};
+
+static void *ar2VideoGroupRun( void *arg );
+static void  ar2VideoGroupStop( AR2VideoGroupT *group, int num );
+
+AR2VideoGroupT *ar2VideoOpenGroup( char *config[], int num )
+{
+    AR2VideoGroupT  *group;
+    int              i;
+
+    if( num < 1 || num > AR_VIDEO_GROUP_MAX ) {
+        printf("video group of %d devices (1 <-> %d).\n", num, AR_VIDEO_GROUP_MAX);
+        return NULL;
+    }
+
+    arMalloc( group, AR2VideoGroupT, 1 );
+    memset( group, 0, sizeof(AR2VideoGroupT) );
+    pthread_mutex_init( &group->mutex, NULL );
+    group->num = num;
+    group->run = 1;
+
+    for( i = 0; i < num; i++ ) {
+        group->dev[i].group = group;
+        group->dev[i].vid   = ar2VideoOpen( config[i] );
+        if( group->dev[i].vid == NULL ) {
+            printf("unable to open video device %d of the group.\n", i);
+            break;
+        }
+        if( ar2VideoCapStart( group->dev[i].vid ) < 0 ) {
+            printf("unable to start video device %d of the group.\n", i);
+            ar2VideoClose( group->dev[i].vid );
+            break;
+        }
+        if( pthread_create( &group->dev[i].thread, NULL, ar2VideoGroupRun, &group->dev[i] ) != 0 ) {
+            printf("unable to start the capture thread of video device %d.\n", i);
+            ar2VideoCapStop( group->dev[i].vid );
+            ar2VideoClose( group->dev[i].vid );
+            break;
+        }
+    }
+    if( i < num ) {
+        ar2VideoGroupStop( group, i );
+        return NULL;
+    }
+
+    return group;
+}
+
+int ar2VideoCloseGroup( AR2VideoGroupT *group )
+{
+    if( group == NULL ) return -1;
+    ar2VideoGroupStop( group, group->num );
+
+    return 0;
+}
+
+AR2VideoParamT *ar2VideoGroupDevice( AR2VideoGroupT *group, int i )
+{
+    if( group == NULL || i < 0 || i >= group->num ) return NULL;
+
+    return group->dev[i].vid;
+}
+
+int ar2VideoGetGroupFrames( AR2VideoGroupT *group, ARVideoFrame frame[], long long *skew )
+{
+    AR2VideoGroupDeviceT  *dev;
+    long long              t, d, dmin, tmin, tmax;
+    int                    i, j, k;
+
+    pthread_mutex_lock( &group->mutex );
+
+    t = 0;
+    for( i = 0; i < group->num; i++ ) {
+        dev = &group->dev[i];
+        if( dev->hist_num == 0 ) break;
+        j = (dev->hist_next + AR_VIDEO_GROUP_HISTORY - 1) % AR_VIDEO_GROUP_HISTORY;
+        if( i == 0 || dev->hist[j].time < t ) t = dev->hist[j].time;
+    }
+    if( i < group->num || t <= group->time ) {
+        pthread_mutex_unlock( &group->mutex );
+        return -1;
+    }
+    group->time = t;
+
+    tmin = tmax = t;
+    for( i = 0; i < group->num; i++ ) {
+        dev = &group->dev[i];
+        k = 0;
+        dmin = -1;
+        for( j = 0; j < dev->hist_num; j++ ) {
+            d = dev->hist[j].time - t;
+            if( d < 0 ) d = -d;
+            if( dmin < 0 || d < dmin ) { dmin = d; k = j; }
+        }
+        frame[i] = dev->hist[k];
+        ar2VideoRetainFrame( dev->vid, &frame[i] );
+        if( frame[i].time < tmin ) tmin = frame[i].time;
+        if( frame[i].time > tmax ) tmax = frame[i].time;
+    }
+
+    pthread_mutex_unlock( &group->mutex );
+
+    if( skew != NULL ) *skew = tmax - tmin;
+
+    return 0;
+}
+
+int ar2VideoReleaseGroupFrames( AR2VideoGroupT *group, ARVideoFrame frame[] )
+{
+    int     i;
+
+    for( i = 0; i < group->num; i++ ) {
+        ar2VideoReleaseFrame( group->dev[i].vid, &frame[i] );
+    }
+
+    return 0;
+}
+
+static void *ar2VideoGroupRun( void *arg )
+{
+    AR2VideoGroupDeviceT  *dev   = (AR2VideoGroupDeviceT *)arg;
+    AR2VideoGroupT        *group = dev->group;
+    ARVideoFrame           frame, old;
+    int                    full;
+
+    arThreadRole( AR_THREAD_CAPTURE, "video group" );
+    while( group->run ) {
+        if( ar2VideoGetImage( dev->vid ) == NULL ) {
+            usleep( 1000 );
+            continue;
+        }
+        if( ar2VideoLeaseFrame( dev->vid, &frame ) == 0 ) {
+            pthread_mutex_lock( &group->mutex );
+            full = (dev->hist_num == AR_VIDEO_GROUP_HISTORY);
+            old  = dev->hist[dev->hist_next];
+            dev->hist[dev->hist_next] = frame;
+            dev->hist_next = (dev->hist_next + 1) % AR_VIDEO_GROUP_HISTORY;
+            if( !full ) dev->hist_num++;
+            pthread_mutex_unlock( &group->mutex );
+            if( full ) ar2VideoReleaseFrame( dev->vid, &old );
+        }
+        ar2VideoCapNext( dev->vid );
+    }
+    arThreadRoleEnd();
+
+    return NULL;
+}
+
+static void ar2VideoGroupStop( AR2VideoGroupT *group, int num )
+{
+    AR2VideoGroupDeviceT  *dev;
+    int                    i, j;
+
+    group->run = 0;
+    for( i = 0; i < num; i++ ) {
+        dev = &group->dev[i];
+        pthread_join( dev->thread, NULL );
+        for( j = 0; j < dev->hist_num; j++ ) ar2VideoReleaseFrame( dev->vid, &dev->hist[j] );
+        ar2VideoCapStop( dev->vid );
+        ar2VideoClose( dev->vid );
+    }
+    pthread_mutex_destroy( &group->mutex );
+    free( group );
+}
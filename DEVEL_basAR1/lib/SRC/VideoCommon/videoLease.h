@@ -0,0 +1,193 @@
+/*
+ * Frame leases for the video modules that hand out a buffer which is
+ * reused on the next ar2VideoCapNext(). A lease copies the image of the
+ * last ar2VideoGetImage() once per frame into a reference counted slot,
+ * later leases of the same frame share the copy. The pool also keeps
+ * the capture time and the sequence number of the last image.
+ *
+ * Included by the video.c of the module; every function is static.
+ */
+#ifndef AR_VIDEO_LEASE_H
+#define AR_VIDEO_LEASE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#ifdef __APPLE__
+#  include <mach/mach_time.h>
+#else
+#  include <time.h>
+#endif
+#include <AR/config.h>
+#include <AR/ar.h>
+#include <AR/video.h>
+
+/* microseconds on the monotonic clock of arVideoTime() */
+static long long videoTimeMonotonic( void )
+{
+#ifdef __APPLE__
+    static mach_timebase_info_data_t  tb;
+
+    if( tb.denom == 0 ) mach_timebase_info( &tb );
+    return (long long)(mach_absolute_time() / 1000 * tb.numer / tb.denom);
+#else
+    struct timespec  ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+typedef struct {
+    ARUint8             *buff;
+    int                  size;
+    int                  refs;
+    unsigned long        n;
+    long long            time;
+} VideoLeaseSlotT;
+
+struct VideoLeasePool {
+    pthread_mutex_t      mutex;
+    ARUint8             *image;         /* of the last ar2VideoGetImage(), or NULL */
+    unsigned long        n;
+    long long            time;
+    VideoLeaseSlotT      slot[AR_VIDEO_LEASE_MAX];
+};
+
+static struct VideoLeasePool *videoLeaseCreate( void )
+{
+    struct VideoLeasePool *pool;
+
+    arMalloc( pool, struct VideoLeasePool, 1 );
+    memset( pool, 0, sizeof(struct VideoLeasePool) );
+    pthread_mutex_init( &pool->mutex, NULL );
+
+    return pool;
+}
+
+static void videoLeaseDelete( struct VideoLeasePool *pool )
+{
+    int     i;
+
+    if( pool == NULL ) return;
+    for( i = 0; i < AR_VIDEO_LEASE_MAX; i++ ) arImageFree( pool->slot[i].buff );
+    pthread_mutex_destroy( &pool->mutex );
+    free( pool );
+}
+
+/* called with the image of ar2VideoGetImage() and its capture time (0 for
+   now), and with NULL on ar2VideoCapNext() */
+static void videoLeaseImage( struct VideoLeasePool *pool, ARUint8 *image, long long time )
+{
+    pthread_mutex_lock( &pool->mutex );
+    pool->image = image;
+    if( image != NULL ) {
+        pool->n++;
+        pool->time = (time != 0)? time: videoTimeMonotonic();
+    }
+    pthread_mutex_unlock( &pool->mutex );
+}
+
+static int videoLeaseInqFrameInfo( struct VideoLeasePool *pool, long long *time, unsigned long *n )
+{
+    pthread_mutex_lock( &pool->mutex );
+    if( pool->n == 0 ) {
+        pthread_mutex_unlock( &pool->mutex );
+        return -1;
+    }
+    if( time != NULL ) *time = pool->time;
+    if( n != NULL ) *n = pool->n;
+    pthread_mutex_unlock( &pool->mutex );
+
+    return 0;
+}
+
+static int videoLeaseFrame( struct VideoLeasePool *pool, ARVideoFrame *frame,
+                            int xsize, int ysize, int stride )
+{
+    VideoLeaseSlotT *s;
+    int              size = stride * ysize;
+    int              i;
+
+    pthread_mutex_lock( &pool->mutex );
+    if( pool->image == NULL ) {
+        pthread_mutex_unlock( &pool->mutex );
+        return -1;
+    }
+
+    /* the frame may already have been copied */
+    for( i = 0; i < AR_VIDEO_LEASE_MAX; i++ ) {
+        if( pool->slot[i].refs > 0 && pool->slot[i].n == pool->n ) break;
+    }
+    if( i == AR_VIDEO_LEASE_MAX ) {
+        for( i = 0; i < AR_VIDEO_LEASE_MAX; i++ ) {
+            if( pool->slot[i].refs == 0 ) break;
+        }
+        if( i == AR_VIDEO_LEASE_MAX ) {
+            pthread_mutex_unlock( &pool->mutex );
+            printf("every frame lease is in use.\n");
+            return -1;
+        }
+        s = &pool->slot[i];
+        if( s->size < size ) {
+            arImageFree( s->buff );
+            s->size = 0;
+            if( (s->buff = (ARUint8 *)arImageAlloc( AR_MEM_VIDEO, size )) == NULL ) {
+                pthread_mutex_unlock( &pool->mutex );
+                printf("malloc error !!\n");
+                return -1;
+            }
+            s->size = size;
+        }
+        memcpy( s->buff, pool->image, size );
+        s->n    = pool->n;
+        s->time = pool->time;
+    }
+    s = &pool->slot[i];
+    s->refs++;
+
+    frame->buff   = s->buff;
+    frame->time   = s->time;
+    frame->format = AR_DEFAULT_PIXEL_FORMAT;
+    frame->stride = stride;
+    frame->xsize  = xsize;
+    frame->ysize  = ysize;
+    frame->n      = s->n;
+    frame->id     = i;
+    pthread_mutex_unlock( &pool->mutex );
+
+    return 0;
+}
+
+static int videoLeaseRetain( struct VideoLeasePool *pool, ARVideoFrame *frame )
+{
+    int     i = frame->id;
+
+    pthread_mutex_lock( &pool->mutex );
+    if( i < 0 || i >= AR_VIDEO_LEASE_MAX || pool->slot[i].refs == 0 || pool->slot[i].n != frame->n ) {
+        pthread_mutex_unlock( &pool->mutex );
+        return -1;
+    }
+    pool->slot[i].refs++;
+    pthread_mutex_unlock( &pool->mutex );
+
+    return 0;
+}
+
+static int videoLeaseRelease( struct VideoLeasePool *pool, ARVideoFrame *frame )
+{
+    int     i = frame->id;
+
+    pthread_mutex_lock( &pool->mutex );
+    if( i < 0 || i >= AR_VIDEO_LEASE_MAX || pool->slot[i].refs == 0 || pool->slot[i].n != frame->n ) {
+        pthread_mutex_unlock( &pool->mutex );
+        return -1;
+    }
+    pool->slot[i].refs--;
+    pthread_mutex_unlock( &pool->mutex );
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * Recorder of video frames, from any video module, into the files played
+ * back by the file video module (AR_INPUT_FILE). See videoRecord.h for
+ * the layout.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <AR/config.h>
+#include <AR/ar.h>
+#include <AR/video.h>
+#include "videoRecord.h"
+
+struct _AR2VideoRecordT {
+    FILE                *fp;
+    VideoRecordHeaderT   header;
+    VideoRecordIndexT   *index;
+    int                  index_max;
+    ARUint8             *code;          /* compressed frame */
+    long long            offset;
+};
+
+#define  DELTA(i)   ((i) < stride? img[i]: (ARUint8)(img[i] - img[(i)-stride]))
+
+int videoRecordEncode( const ARUint8 *img, int stride, int ysize, ARUint8 *dst )
+{
+    int     size = stride * ysize;
+    int     i, j, k;
+    ARUint8 *p = dst;
+
+    i = 0;
+    while( i < size ) {
+        /* a run of at least 3 equal bytes */
+        for( j = i + 1; j < size && j - i < 129 && DELTA(j) == DELTA(i); j++ );
+        if( j - i >= 3 ) {
+            *p++ = (ARUint8)(j - i + 126);
+            *p++ = DELTA(i);
+            i = j;
+            continue;
+        }
+        /* literals up to the next run */
+        for( j = i; j < size && j - i < 128; j++ ) {
+            if( j + 2 < size && DELTA(j) == DELTA(j+1) && DELTA(j) == DELTA(j+2) ) break;
+        }
+        *p++ = (ARUint8)(j - i - 1);
+        for( k = i; k < j; k++ ) *p++ = DELTA(k);
+        i = j;
+    }
+
+    return (int)(p - dst);
+}
+
+int videoRecordDecode( const ARUint8 *src, int size, ARUint8 *img, int stride, int ysize )
+{
+    const ARUint8 *end = src + size;
+    int            isize = stride * ysize;
+    int            i, n;
+
+    i = 0;
+    while( src < end ) {
+        if( *src < 128 ) {
+            n = *src++ + 1;
+            if( i + n > isize || src + n > end ) return -1;
+            memcpy( &img[i], src, n );
+            src += n;
+        }
+        else {
+            n = *src++ - 126;
+            if( i + n > isize || src >= end ) return -1;
+            memset( &img[i], *src++, n );
+        }
+        i += n;
+    }
+    if( i != isize ) return -1;
+
+    for( i = stride; i < isize; i++ ) img[i] += img[i-stride];
+
+    return 0;
+}
+
+AR2VideoRecordT *ar2VideoRecordOpen( char *filename, int xsize, int ysize, int format, int stride, int compress )
+{
+    AR2VideoRecordT  *rec;
+
+    arMalloc( rec, AR2VideoRecordT, 1 );
+    memset( rec, 0, sizeof(AR2VideoRecordT) );
+    if( (rec->fp = fopen(filename, "wb")) == NULL ) {
+        printf("unable to open the video record %s.\n", filename);
+        free( rec );
+        return NULL;
+    }
+    memcpy( rec->header.magic, VIDEO_RECORD_MAGIC, 4 );
+    rec->header.version  = VIDEO_RECORD_VERSION;
+    rec->header.xsize    = xsize;
+    rec->header.ysize    = ysize;
+    rec->header.format   = format;
+    rec->header.stride   = stride;
+    rec->header.compress = compress? VIDEO_RECORD_RLE: VIDEO_RECORD_RAW;
+    if( compress ) {
+        arMallocTag( rec->code, ARUint8, VIDEO_RECORD_RLE_MAX(stride * ysize), AR_MEM_VIDEO );
+    }
+    if( fwrite( &rec->header, sizeof(VideoRecordHeaderT), 1, rec->fp ) != 1 ) {
+        printf("unable to write the video record %s.\n", filename);
+        fclose( rec->fp );
+        arMemFree( rec->code );
+        free( rec );
+        return NULL;
+    }
+    rec->offset = sizeof(VideoRecordHeaderT);
+
+    return rec;
+}
+
+int ar2VideoRecordFrame( AR2VideoRecordT *rec, ARUint8 *image, long long time )
+{
+    VideoRecordFrameT   f;
+    ARUint8            *data;
+
+    if( rec->header.frames == rec->index_max ) {
+        rec->index_max += 256;
+        rec->index = (VideoRecordIndexT *)arMemRealloc( AR_MEM_VIDEO, rec->index, rec->index_max * sizeof(VideoRecordIndexT) );
+        if( rec->index == NULL ) {
+            printf("malloc error !!\n");
+            exit(1);
+        }
+    }
+
+    if( rec->header.compress == VIDEO_RECORD_RLE ) {
+        f.size = videoRecordEncode( image, rec->header.stride, rec->header.ysize, rec->code );
+        data   = rec->code;
+    }
+    else {
+        f.size = rec->header.stride * rec->header.ysize;
+        data   = image;
+    }
+    f.time = (time != 0)? time: arVideoTime();
+    f.pad  = 0;
+    if( fwrite( &f, sizeof(VideoRecordFrameT), 1, rec->fp ) != 1
+     || fwrite( data, f.size, 1, rec->fp ) != 1 ) {
+        printf("unable to write the video record.\n");
+        return -1;
+    }
+
+    rec->index[rec->header.frames].time   = f.time;
+    rec->index[rec->header.frames].offset = rec->offset + sizeof(VideoRecordFrameT);
+    rec->index[rec->header.frames].size   = f.size;
+    rec->index[rec->header.frames].pad    = 0;
+    rec->header.frames++;
+    rec->offset += sizeof(VideoRecordFrameT) + f.size;
+
+    return 0;
+}
+
+int ar2VideoRecordClose( AR2VideoRecordT *rec )
+{
+    int     ret = 0;
+
+    if( rec == NULL ) return -1;
+
+    rec->header.index = rec->offset;
+    if( (rec->header.frames > 0
+         && fwrite( rec->index, sizeof(VideoRecordIndexT), rec->header.frames, rec->fp ) != (size_t)rec->header.frames)
+     || fseek( rec->fp, 0, SEEK_SET ) != 0
+     || fwrite( &rec->header, sizeof(VideoRecordHeaderT), 1, rec->fp ) != 1 ) {
+        printf("unable to write the index of the video record.\n");
+        ret = -1;
+    }
+    if( fclose( rec->fp ) != 0 ) ret = -1;
+    arMemFree( rec->index );
+    arMemFree( rec->code );
+    free( rec );
+
+    return ret;
+}
@@ -0,0 +1,71 @@
+/*
+ * Layout of the video recordings of ar2VideoRecordOpen(), played back by
+ * the file video module (AR_INPUT_FILE). Every field is in the byte order
+ * of the recording machine.
+ *
+ *   VideoRecordHeaderT
+ *   VideoRecordFrameT, data       one per frame
+ *   ...
+ *   VideoRecordIndexT             one per frame, at header.index
+ *
+ * The index is written by ar2VideoRecordClose(); a recording without it
+ * is indexed again from its frame records.
+ *
+ * A compressed frame (VIDEO_RECORD_RLE) codes every byte as its
+ * difference to the byte one row above, run-length coded: a control
+ * byte c < 128 is followed by c+1 literal bytes, a control byte c >= 128
+ * by one byte repeated c-126 times.
+ */
+#ifndef AR_VIDEO_RECORD_H
+#define AR_VIDEO_RECORD_H
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#include <AR/config.h>
+#include <AR/ar.h>
+
+#define   VIDEO_RECORD_MAGIC      "ARVR"
+#define   VIDEO_RECORD_VERSION    1
+
+#define   VIDEO_RECORD_RAW        0
+#define   VIDEO_RECORD_RLE        1
+
+typedef struct {
+    char            magic[4];
+    ARInt32         version;
+    ARInt32         xsize;
+    ARInt32         ysize;
+    ARInt32         format;         /* AR_PIXEL_FORMAT_* */
+    ARInt32         stride;
+    ARInt32         compress;       /* VIDEO_RECORD_* */
+    ARInt32         frames;
+    long long       index;          /* offset of the index, 0 before the close */
+} VideoRecordHeaderT;
+
+typedef struct {
+    long long       time;           /* capture time in microseconds */
+    ARInt32         size;           /* bytes of the data that follow */
+    ARInt32         pad;
+} VideoRecordFrameT;
+
+typedef struct {
+    long long       time;
+    long long       offset;         /* of the data */
+    ARInt32         size;
+    ARInt32         pad;
+} VideoRecordIndexT;
+
+/* the largest size of a compressed image of size bytes */
+#define   VIDEO_RECORD_RLE_MAX(size)   ((size) + (size) / 128 + 1)
+
+/* compress img of ysize rows into dst, returns the size of the data */
+int videoRecordEncode( const ARUint8 *img, int stride, int ysize, ARUint8 *dst );
+
+/* decompress size bytes of src into img, -1 if the data do not fit */
+int videoRecordDecode( const ARUint8 *src, int size, ARUint8 *img, int stride, int ysize );
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
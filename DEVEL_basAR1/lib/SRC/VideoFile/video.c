@@ -0,0 +1,482 @@
+/*
+ *   Video playback of the recordings of ar2VideoRecordOpen()
+ *
+ *   The recording is memory mapped and played in order, every
+ *   frame once between ar2VideoCapStart() and ar2VideoCapStop(),
+ *   so that a benchmark sees the same frames on every run.
+ *   ar2VideoGetImage() waits until the frame is due: at its
+ *   recorded time, at -rate=N frames per second, or not at all
+ *   with -rate=0. Uncompressed frames are handed out in place.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <AR/config.h>
+#include <AR/ar.h>
+#include <AR/video.h>
+#include "../VideoCommon/videoRecord.h"
+#include "../VideoCommon/videoLease.h"
+
+static AR2VideoParamT   *gVid = NULL;
+
+static int       read_index( AR2VideoParamT *vid );
+static long long due_time( AR2VideoParamT *vid, int i );
+
+int arVideoDispOption( void )
+{
+    return  ar2VideoDispOption();
+}
+
+int arVideoOpen( char *config )
+{
+    if( gVid != NULL ) {
+        printf("Device has been opened!!\n");
+        return -1;
+    }
+    gVid = ar2VideoOpen( config );
+    if( gVid == NULL ) return -1;
+
+    return 0;
+}
+
+int arVideoClose( void )
+{
+    int result;
+
+    if( gVid == NULL ) return -1;
+
+    result = ar2VideoClose(gVid);
+    gVid = NULL;
+    return (result);
+}
+
+int arVideoInqSize( int *x, int *y )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoInqSize( gVid, x, y );
+}
+
+ARUint8 *arVideoGetImage( void )
+{
+    if( gVid == NULL ) return NULL;
+
+    return ar2VideoGetImage( gVid );
+}
+
+int arVideoCapStart( void )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoCapStart( gVid );
+}
+
+int arVideoCapStop( void )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoCapStop( gVid );
+}
+
+int arVideoCapNext( void )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoCapNext( gVid );
+}
+
+int arVideoLeaseFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoLeaseFrame( gVid, frame );
+}
+
+int arVideoRetainFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoRetainFrame( gVid, frame );
+}
+
+int arVideoReleaseFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoReleaseFrame( gVid, frame );
+}
+
+int arVideoInqFrameInfo( long long *time, unsigned long *n )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoInqFrameInfo( gVid, time, n );
+}
+
+long long arVideoTime( void )
+{
+    return videoTimeMonotonic();
+}
+
+/*-------------------------------------------*/
+
+int ar2VideoDispOption( void )
+{
+    printf("ARVideo may be configured using one or more of the following options,\n");
+    printf("separated by a space:\n\n");
+    printf(" -file=filepath\n");
+    printf("    specifies the recording of ar2VideoRecordOpen() to play.\n");
+    printf(" -rate=N\n");
+    printf("    plays N frames per second, 0: as fast as they are asked for.\n");
+    printf("    (default: at the recorded times)\n");
+    printf(" -loop\n");
+    printf("    starts again after the last frame.\n");
+    printf("\n");
+
+    return 0;
+}
+
+AR2VideoParamT *ar2VideoOpen( char *config_in )
+{
+    AR2VideoParamT      *vid;
+    VideoRecordHeaderT  *header;
+    struct stat          st;
+    char                *config, *a, line[256];
+
+    /* If no config string is supplied, we should use the environment variable, otherwise set a sane default */
+    if (!config_in || !(config_in[0])) {
+        /* None suppplied, lets see if the user supplied one from the shell */
+        char *envconf = getenv ("ARTOOLKIT_CONFIG");
+        if (envconf && envconf[0]) {
+            config = envconf;
+            printf ("Using config string from environment [%s].\n", envconf);
+        } else {
+            config = NULL;
+            printf ("No video config string supplied, using defaults.\n");
+        }
+    } else {
+        config = config_in;
+        printf ("Using supplied video config string [%s].\n", config_in);
+    }
+
+    arMalloc( vid, AR2VideoParamT, 1 );
+    memset( vid, 0, sizeof(AR2VideoParamT) );
+    strcpy( vid->file, DEFAULT_VIDEO_FILE );
+    vid->rate  = AR_VIDEO_FILE_RATE_RECORDED;
+    vid->loop  = 0;
+    vid->debug = 0;
+    vid->fd    = -1;
+
+    a = config;
+    if( a != NULL) {
+        for(;;) {
+            while( *a == ' ' || *a == '\t' ) a++;
+            if( *a == '\0' ) break;
+            if( strncmp( a, "-file=", 6 ) == 0 ) {
+                sscanf( a, "%s", line );
+                if( sscanf( &line[6], "%s", vid->file ) == 0 ) {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-rate=", 6 ) == 0 ) {
+                sscanf( a, "%s", line );
+                if( sscanf( &line[6], "%lf", &vid->rate ) == 0 || vid->rate < 0.0 ) {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-loop", 5 ) == 0 ) {
+                vid->loop = 1;
+            }
+            else if( strncmp( a, "-debug", 6 ) == 0 ) {
+                vid->debug = 1;
+            }
+            else {
+                ar2VideoDispOption();
+                free( vid );
+                return 0;
+            }
+
+            while( *a != ' ' && *a != '\t' && *a != '\0') a++;
+        }
+    }
+
+    vid->fd = open( vid->file, O_RDONLY );
+    if( vid->fd < 0 || fstat( vid->fd, &st ) < 0 ) {
+        printf("video recording (%s) open failed\n", vid->file);
+        if( vid->fd >= 0 ) close( vid->fd );
+        free( vid );
+        return 0;
+    }
+    vid->length = st.st_size;
+    if( vid->length < sizeof(VideoRecordHeaderT)
+     || (vid->map = (ARUint8 *)mmap(NULL, vid->length, PROT_READ, MAP_PRIVATE, vid->fd, 0)) == MAP_FAILED ) {
+        printf("error: mapping %s\n", vid->file);
+        close( vid->fd );
+        free( vid );
+        return 0;
+    }
+
+    header = (VideoRecordHeaderT *)vid->map;
+    if( memcmp( header->magic, VIDEO_RECORD_MAGIC, 4 ) != 0 || header->version != VIDEO_RECORD_VERSION ) {
+        printf("error: %s is no video recording\n", vid->file);
+        ar2VideoClose( vid );
+        return 0;
+    }
+    vid->xsize    = header->xsize;
+    vid->ysize    = header->ysize;
+    vid->format   = header->format;
+    vid->stride   = header->stride;
+    vid->compress = header->compress;
+    if( read_index( vid ) < 0 ) {
+        printf("error: %s has no frames\n", vid->file);
+        ar2VideoClose( vid );
+        return 0;
+    }
+    if( vid->compress == VIDEO_RECORD_RLE ) {
+        arMalloc( vid->image, ARUint8, vid->stride * vid->ysize );
+    }
+    vid->lease = videoLeaseCreate();
+
+    if( vid->debug ) {
+        printf("===== Video Recording Info =====\n");
+        printf("   size   = %dx%d\n", vid->xsize, vid->ysize);
+        printf("   format = %d, stride = %d\n", vid->format, vid->stride);
+        printf("   frames = %d%s\n", vid->frames, (vid->compress == VIDEO_RECORD_RLE)? ", compressed": "");
+    }
+    if( vid->format != AR_DEFAULT_PIXEL_FORMAT ) {
+        printf("the frames of %s are in the pixel format %d, see ar2VideoInqPixelFormat().\n",
+               vid->file, vid->format);
+    }
+
+    return vid;
+}
+
+int ar2VideoClose( AR2VideoParamT *vid )
+{
+    if( vid->capturing ) {
+        ar2VideoCapStop( vid );
+    }
+    if( vid->map != NULL ) munmap( vid->map, vid->length );
+    if( vid->fd >= 0 ) close( vid->fd );
+    free( vid->index );
+    free( vid->image );
+    videoLeaseDelete( vid->lease );
+    free( vid );
+
+    return 0;
+}
+
+int ar2VideoCapStart( AR2VideoParamT *vid )
+{
+    if( vid->capturing ) {
+        printf("arVideoCapStart has already been called.\n");
+        return -1;
+    }
+    vid->capturing = 1;
+    vid->next      = 0;
+    vid->pending   = 0;
+    vid->start     = videoTimeMonotonic();
+
+    return 0;
+}
+
+int ar2VideoCapNext( AR2VideoParamT *vid )
+{
+    if( !vid->capturing ) {
+        printf("arVideoCapStart has never been called.\n");
+        return -1;
+    }
+    videoLeaseImage( vid->lease, NULL, 0 );
+    vid->pending = 0;
+
+    return 0;
+}
+
+int ar2VideoCapStop( AR2VideoParamT *vid )
+{
+    if( !vid->capturing ) {
+        printf("arVideoCapStart has never been called.\n");
+        return -1;
+    }
+    videoLeaseImage( vid->lease, NULL, 0 );
+    vid->capturing = 0;
+
+    return 0;
+}
+
+ARUint8 *ar2VideoGetImage( AR2VideoParamT *vid )
+{
+    VideoRecordIndexT  *idx;
+    ARUint8            *buf;
+    long long           due, now;
+    struct timespec     ts;
+
+    if( !vid->capturing ) {
+        printf("arVideoCapStart has never been called.\n");
+        return NULL;
+    }
+
+    /* the frame stays until ar2VideoCapNext() */
+    if( vid->pending ) {
+        vid->next--;
+    }
+    else if( vid->next == vid->frames ) {
+        if( !vid->loop ) return NULL;
+        vid->start = due_time( vid, vid->frames );
+        vid->next  = 0;
+    }
+    idx = (VideoRecordIndexT *)vid->index + vid->next;
+
+    now = videoTimeMonotonic();
+    if( vid->rate == AR_VIDEO_FILE_RATE_FASTEST ) {
+        due = now;
+    }
+    else {
+        due = due_time( vid, vid->next );
+        if( due > now ) {
+            ts.tv_sec  = (due - now) / 1000000;
+            ts.tv_nsec = (due - now) % 1000000 * 1000;
+            nanosleep( &ts, NULL );
+        }
+    }
+
+    if( vid->compress == VIDEO_RECORD_RLE ) {
+        if( !vid->pending ) {
+            AR_TRACE_BEGIN( "videoRecordDecode" );
+            if( videoRecordDecode( vid->map + idx->offset, idx->size, vid->image, vid->stride, vid->ysize ) < 0 ) {
+                AR_TRACE_END();
+                printf("error: damaged frame %d of %s\n", vid->next, vid->file);
+                vid->next++;
+                return NULL;
+            }
+            AR_TRACE_END();
+        }
+        buf = vid->image;
+    }
+    else {
+        buf = vid->map + idx->offset;
+    }
+    vid->next++;
+
+    if( !vid->pending ) {
+        vid->time    = due;
+        vid->pending = 1;
+        videoLeaseImage( vid->lease, buf, due );
+    }
+
+    return buf;
+}
+
+int ar2VideoInqSize( AR2VideoParamT *vid, int *x, int *y )
+{
+    *x = vid->xsize;
+    *y = vid->ysize;
+
+    return 0;
+}
+
+int ar2VideoInqPixelFormat( AR2VideoParamT *vid, int *format, int *stride )
+{
+    if( format != NULL ) *format = vid->format;
+    if( stride != NULL ) *stride = vid->stride;
+
+    return 0;
+}
+
+int ar2VideoLeaseFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    if( videoLeaseFrame( vid->lease, frame, vid->xsize, vid->ysize, vid->stride ) < 0 ) return -1;
+    frame->format = vid->format;
+
+    return 0;
+}
+
+int ar2VideoRetainFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    return videoLeaseRetain( vid->lease, frame );
+}
+
+int ar2VideoReleaseFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    return videoLeaseRelease( vid->lease, frame );
+}
+
+int ar2VideoInqFrameInfo( AR2VideoParamT *vid, long long *time, unsigned long *n )
+{
+    return videoLeaseInqFrameInfo( vid->lease, time, n );
+}
+
+/*-------------------------------------------*/
+
+/* the index at the end, or rebuilt from the frame records if the recorder was not closed */
+static int read_index( AR2VideoParamT *vid )
+{
+    VideoRecordHeaderT  *header = (VideoRecordHeaderT *)vid->map;
+    VideoRecordFrameT   *f;
+    VideoRecordIndexT   *index;
+    size_t               offset;
+    int                  max;
+
+    if( header->index > 0 && header->frames > 0
+     && (size_t)header->index + header->frames * sizeof(VideoRecordIndexT) <= vid->length ) {
+        vid->frames = header->frames;
+        arMalloc( index, VideoRecordIndexT, vid->frames );
+        memcpy( index, vid->map + header->index, vid->frames * sizeof(VideoRecordIndexT) );
+        vid->index = index;
+        return 0;
+    }
+
+    printf("%s has no index, reading the frames.\n", vid->file);
+    max    = 256;
+    arMalloc( index, VideoRecordIndexT, max );
+    offset = sizeof(VideoRecordHeaderT);
+    vid->frames = 0;
+    while( offset + sizeof(VideoRecordFrameT) <= vid->length ) {
+        f = (VideoRecordFrameT *)(vid->map + offset);
+        if( f->size <= 0 || offset + sizeof(VideoRecordFrameT) + f->size > vid->length ) break;
+        if( vid->frames == max ) {
+            max += 256;
+            index = (VideoRecordIndexT *)realloc( index, max * sizeof(VideoRecordIndexT) );
+            if( index == NULL ) {
+                printf("malloc error !!\n");
+                exit(1);
+            }
+        }
+        index[vid->frames].time   = f->time;
+        index[vid->frames].offset = offset + sizeof(VideoRecordFrameT);
+        index[vid->frames].size   = f->size;
+        index[vid->frames].pad    = 0;
+        vid->frames++;
+        offset += sizeof(VideoRecordFrameT) + f->size;
+    }
+    vid->index = index;
+
+    return (vid->frames > 0)? 0: -1;
+}
+
+/* playback time of frame i, frame vid->frames being the start of the next loop */
+static long long due_time( AR2VideoParamT *vid, int i )
+{
+    VideoRecordIndexT  *index = (VideoRecordIndexT *)vid->index;
+    long long           span;
+
+    if( vid->rate > 0.0 ) {
+        return vid->start + (long long)(i * 1000000.0 / vid->rate);
+    }
+    if( i < vid->frames ) {
+        return vid->start + (index[i].time - index[0].time);
+    }
+    span = index[vid->frames-1].time - index[0].time;
+
+    return vid->start + span + ((vid->frames > 1)? span / (vid->frames - 1): 33333);
+}
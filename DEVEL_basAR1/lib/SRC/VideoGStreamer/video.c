@@ -1,13 +1,21 @@
 /*
  * Video capture module utilising the GStreamer pipeline for AR Toolkit
- * 
+ *
  * (c) Copyrights 2003-2006 Hartmut Seichter
- * 
+ *
  * licensed under the terms of the GPL v2.0
  *
+ * Ported to GStreamer 1.x. The pipeline ends in an appsink named
+ * "artoolkit"; each frame is kept as the GstSample of the streaming
+ * thread and mapped read-only, never copied. The streaming thread only
+ * swaps the pending sample under a mutex, so a frame handed out by
+ * ar2VideoGetImage() is never written while it is in use. A frame
+ * leased with ar2VideoLeaseFrame() stays mapped until its last
+ * ar2VideoReleaseFrame(). Frames are stamped with the monotonic clock
+ * when they reach the appsink, as the PTS is on the pipeline clock.
  */
 
-/* include AR Toolkit*/ 
+/* include AR Toolkit*/
 #include <AR/config.h>
 #include <AR/ar.h>
 #include <AR/video.h>
@@ -17,108 +25,59 @@
 
 /* include GStreamer itself */
 #include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+#include <gst/video/video.h>
 
-/* using memcpy */
+#include <stdio.h>
 #include <string.h>
 
+/* seconds to wait for the first frame to learn its caps */
+#define PREROLL_TIMEOUT     5
+
+
+/* A mapped frame: the one of the last ar2VideoGetImage(), or a leased one. */
+typedef struct {
+	GstSample       *sample;
+	GstVideoFrame   frame;
+	unsigned long   n;
+	gint64          time;
+	int             refs;
+} VideoFrameT;
 
 struct _AR2VideoParamT {
 
 	/* GStreamer pipeline */
 	GstElement *pipeline;
-	
-	/* GStreamer identity needed for probing */
-	GstElement *probe;
-	
-	/* size of the image */
+
+	/* the appsink the frames are taken from */
+	GstElement *sink;
+
+	/* size and format of the image */
 	int	width, height;
+	GstVideoInfo info;
 
-	/* the actual video buffer */
-    ARUint8             *videoBuffer;
-    
-};
+	/* newest sample of the streaming thread, not handed out yet,
+	   and the references to the frames */
+	GMutex lock;
+	GstSample *pending;
+	unsigned long sequence;
+	gint64 pending_time;
 
+	/* sequence number and arrival time of the last image, 0 before the first */
+	unsigned long n;
+	gint64 time;
 
-static AR2VideoParamT *gVid = 0;
+	VideoFrameT frame[AR_VIDEO_GST_FRAMES];
+	int current;
+};
 
-static gboolean
-cb_have_data (GstPad    *pad,
-	      GstBuffer *buffer,
-	      gpointer   u_data)
-{
- 	const GstCaps *caps;
-	GstStructure *str;
-	
-	gint width,height;
-	gdouble rate;
-	
-	AR2VideoParamT *vid = (AR2VideoParamT*)u_data;
-	
-
-	/* only do initialy for the buffer */
-	if (vid->videoBuffer == 0) 
-	{ 
-	
-		/* 
-		 * Get the capabilities of the frame, we need that in order
-		 * to extract information about the frame 
-		 */
-		caps=gst_pad_get_negotiated_caps(pad);
-		str=gst_caps_get_structure(caps,0);
-
-		/* Get some data about the frame */
-		gst_structure_get_int(str,"width",&width);
-		gst_structure_get_int(str,"height",&height);
-		gst_structure_get_double(str,"framerate",&rate);
-		
-		g_print("libARvideo: GStreamer negotiated %dx%d\n",width,height);
-	
-		vid->width = width;
-		vid->height = height;
-		
-		/* allocate the buffer */
-		vid->videoBuffer = malloc(buffer->size);
-		
-		return TRUE;
-		
-	}
-	else 
-	{
-		/* copy the video buffer */
-		memcpy(vid->videoBuffer, buffer->data, buffer->size);
-	}	
-	
-	return TRUE;
-}
 
-void 
-testing_pad(GstPad *pad)
-{		
-	const GstCaps *caps;
-	GstStructure *str;
-	
-	gint width,height;
-	gdouble rate;
-
-	caps=gst_pad_get_negotiated_caps(pad);
-
-	if (caps) {
-		str=gst_caps_get_structure(caps,0);
-
-		/* Get some data about the frame */
-		gst_structure_get_int(str,"width",&width);
-		gst_structure_get_int(str,"height",&height);
-		gst_structure_get_double(str,"framerate",&rate);
-		
-		g_print("libARvideo: GStreamer negotiated %dx%d\n",width,height);
-	} else {
-		return;
-#if 0		
-		g_print("Nothing yet!");	
-#endif
+static AR2VideoParamT *gVid = 0;
 
-	}
-}
+static GstFlowReturn cb_new_sample( GstAppSink *appsink, gpointer u_data );
+static int  set_caps( AR2VideoParamT *vid, GstSample *sample );
+static void release_frame( AR2VideoParamT *vid, int i );
+static void give_back( AR2VideoParamT *vid, int i );
 
 
 int
@@ -129,65 +88,128 @@ arVideoOpen( char *config ) {
     }
     gVid = ar2VideoOpen( config );
     if( gVid == NULL ) return -1;
+
+    return 0;
 }
 
-int 
+int
 arVideoClose( void )
 {
-	return ar2VideoClose(gVid);
+	int result;
+
+	if( gVid == NULL ) return -1;
+
+	result = ar2VideoClose(gVid);
+	gVid = NULL;
+	return result;
 }
 
 int
 arVideoDispOption( void )
 {
-   return 0;
+   return ar2VideoDispOption();
 }
 
 int
 arVideoInqSize( int *x, int *y ) {
-	
-	ar2VideoInqSize(gVid,x,y);
 
-	return 0;
+	if( gVid == NULL ) return -1;
+
+	return ar2VideoInqSize(gVid,x,y);
 }
 
 ARUint8
 *arVideoGetImage( void )
 {
+   if( gVid == NULL ) return NULL;
+
    return ar2VideoGetImage(gVid);  // address of your image data
 }
 
-int 
+int
 arVideoCapStart( void ) {
 
-	ar2VideoCapStart(gVid);
-	return 0;
+	if( gVid == NULL ) return -1;
+
+	return ar2VideoCapStart(gVid);
 }
 
-int 
+int
 arVideoCapStop( void )
 {
-	ar2VideoCapStop(gVid);
-	return 0;
+	if( gVid == NULL ) return -1;
+
+	return ar2VideoCapStop(gVid);
 }
 
 int arVideoCapNext( void )
 {
-	ar2VideoCapNext(gVid);
-	return 0;
+	if( gVid == NULL ) return -1;
+
+	return ar2VideoCapNext(gVid);
+}
+
+int arVideoLeaseFrame( ARVideoFrame *frame )
+{
+	if( gVid == NULL ) return -1;
+
+	return ar2VideoLeaseFrame(gVid, frame);
+}
+
+int arVideoRetainFrame( ARVideoFrame *frame )
+{
+	if( gVid == NULL ) return -1;
+
+	return ar2VideoRetainFrame(gVid, frame);
+}
+
+int arVideoReleaseFrame( ARVideoFrame *frame )
+{
+	if( gVid == NULL ) return -1;
+
+	return ar2VideoReleaseFrame(gVid, frame);
+}
+
+int arVideoInqFrameInfo( long long *time, unsigned long *n )
+{
+	if( gVid == NULL ) return -1;
+
+	return ar2VideoInqFrameInfo(gVid, time, n);
+}
+
+long long arVideoTime( void )
+{
+	/* CLOCK_MONOTONIC in microseconds */
+	return (long long)g_get_monotonic_time();
 }
 
 /*---------------------------------------------------------------------------*/
 
-AR2VideoParamT* 
+int
+ar2VideoDispOption( void )
+{
+	printf("ARVideo is configured with a GStreamer pipeline description\n");
+	printf("ending in an appsink named artoolkit, for example:\n\n");
+	printf(" v4l2src ! videoconvert ! video/x-raw,format=BGR ! appsink name=artoolkit\n\n");
+	printf("The frames are handed out in place in one of the formats\n");
+	printf("RGB, BGR, RGBA, BGRA, ABGR, ARGB, GRAY8, UYVY, YUY2, NV12 or I420\n");
+	printf("(luma plane), see ar2VideoInqPixelFormat().\n\n");
+	printf("MJPEG and H.264 cameras are decoded best by a hardware decoder giving\n");
+	printf("NV12, whose luma plane goes to the detection without a conversion:\n\n");
+	printf(" v4l2src ! image/jpeg ! vaapijpegdec ! appsink name=artoolkit\n");
+	printf(" rtspsrc location=... ! rtph264depay ! h264parse ! nvh264dec ! appsink name=artoolkit\n");
+	printf("\n");
+
+	return 0;
+}
+
+AR2VideoParamT*
 ar2VideoOpen(char *config_in ) {
 
 	AR2VideoParamT *vid = 0;
 	GError *error = 0;
-	int i;
-	GstPad *pad, *peerpad;
-	GstXML *xml;
-	GstStateChangeReturn _ret;
+	GstAppSinkCallbacks callbacks;
+	GstSample *sample;
 	char *config;
 
 	/* If no config string is supplied, we should use the environment variable, otherwise set a sane default */
@@ -196,193 +218,366 @@ ar2VideoOpen(char *config_in ) {
 		char *envconf = getenv ("ARTOOLKIT_CONFIG");
 		if (envconf && envconf[0]) {
 			config = envconf;
-			g_printf ("Using config string from environment [%s].\n", envconf);
+			g_print ("Using config string from environment [%s].\n", envconf);
 		} else {
-			config = NULL;
-			g_printf ("No video config string supplied, using defaults.\n");
+			ar2VideoDispOption();
+			return 0;
 		}
 	} else {
 		config = config_in;
-		g_printf ("Using supplied video config string [%s].\n", config_in);
+		g_print ("Using supplied video config string [%s].\n", config_in);
 	}
 
 	/* initialise GStreamer */
-	gst_init(0,0);	
-	
+	gst_init(0,0);
+
 	/* init ART structure */
     arMalloc( vid, AR2VideoParamT, 1 );
+	memset( vid, 0, sizeof(AR2VideoParamT) );
+	g_mutex_init( &vid->lock );
+	vid->current = -1;
 
-	/* initialise buffer */
-	vid->videoBuffer = 0;
-	
 	/* report the current version and features */
 	g_print ("libARvideo: %s\n", gst_version_string());
 
-#if 0	
-	xml = gst_xml_new();
-	
-	/* first check if config contains an xml file */
-	if (gst_xml_parse_file(xml,config,NULL)) 
-	{
-		/* parse the pipe definition */
-		
-	} else 
-	{
-		vid->pipeline = gst_xml_get_element(xml,"pipeline");
-	}
-	
-#endif
-
 	vid->pipeline = gst_parse_launch (config, &error);
-	
-	if (!vid->pipeline) {
+	if (error) {
 		g_print ("Parse error: %s\n", error->message);
+		g_error_free (error);
+		if (vid->pipeline) gst_object_unref (vid->pipeline);
+		g_mutex_clear( &vid->lock );
+		free( vid );
 		return 0;
 	};
 
 	/* get the video sink */
-	vid->probe = gst_bin_get_by_name(GST_BIN(vid->pipeline), "artoolkit");
-
-	if (!vid->probe) {
-		g_print("Pipeline has no element named 'artoolkit'!\n");
-		return 0;	
+	vid->sink = gst_bin_get_by_name(GST_BIN(vid->pipeline), "artoolkit");
+	if (!vid->sink || !GST_IS_APP_SINK(vid->sink)) {
+		g_print("Pipeline has no appsink named 'artoolkit'!\n");
+		if (vid->sink) gst_object_unref (vid->sink);
+		gst_object_unref (vid->pipeline);
+		g_mutex_clear( &vid->lock );
+		free( vid );
+		return 0;
 	};
-		
-	/* get the pad from the probe (the source pad seems to be more flexible) */	
-	pad = gst_element_get_pad (vid->probe, "src");
-
-		
-	/* install the probe callback for capturing */
-	gst_pad_add_buffer_probe (pad, G_CALLBACK (cb_have_data), vid);	
-	
-	
-
-#if 0
-	/* request ready state */
-	gst_element_set_state (vid->pipeline, GST_STATE_READY);
-	
-	/* check if stream is ready */
-	if (gst_element_get_state (vid->pipeline, NULL, NULL, -1) == GST_STATE_CHANGE_FAILURE) {
-    	g_error ("libARvideo: failed to put GStreamer into READY state!\n");
-    } else {
-    	g_print ("libARvideo: GStreamer pipeline is READY!\n");
-    }
-#endif
 
-	/* Needed to fill the information for ARVidInfo */
-	gst_element_set_state (vid->pipeline, GST_STATE_PAUSED);
+	/* only the newest frame is of interest */
+	gst_app_sink_set_max_buffers (GST_APP_SINK(vid->sink), 1);
+	gst_app_sink_set_drop (GST_APP_SINK(vid->sink), TRUE);
+	g_object_set (G_OBJECT(vid->sink), "sync", FALSE, NULL);
+
+	/* Run until the first frame, needed to fill the information for ARVidInfo */
+	gst_element_set_state (vid->pipeline, GST_STATE_PLAYING);
+	sample = gst_app_sink_try_pull_sample (GST_APP_SINK(vid->sink), PREROLL_TIMEOUT * GST_SECOND);
+	if (!sample || set_caps( vid, sample ) < 0) {
+		g_print ("libARvideo: no video frame from the GStreamer pipeline!\n");
+		if (sample) gst_sample_unref (sample);
+		gst_element_set_state (vid->pipeline, GST_STATE_NULL);
+		gst_object_unref (vid->sink);
+		gst_object_unref (vid->pipeline);
+		g_mutex_clear( &vid->lock );
+		free( vid );
+		return 0;
+	}
+	vid->pending = sample;
+	vid->pending_time = g_get_monotonic_time();
+	g_print("libARvideo: GStreamer negotiated %dx%d\n", vid->width, vid->height);
 
-	peerpad = gst_pad_get_peer(pad);
-	
-	testing_pad(peerpad);
-
-	/* dismiss the pad */
-	gst_object_unref (pad);
-	
-	/* wait until it's up and running or failed */
-	if (gst_element_get_state (vid->pipeline, NULL, NULL, -1) == GST_STATE_CHANGE_FAILURE) {
-    	g_error ("libARvideo: failed to put GStreamer into PAUSE state!\n");
-    } else {
-    	g_print ("libARvideo: GStreamer pipeline is PAUSED!\n");
-    }
+	/* from now on the frames are taken in the streaming thread */
+	memset( &callbacks, 0, sizeof(callbacks) );
+	callbacks.new_sample = cb_new_sample;
+	gst_app_sink_set_callbacks (GST_APP_SINK(vid->sink), &callbacks, vid, NULL);
+
+	gst_element_set_state (vid->pipeline, GST_STATE_PAUSED);
 
-	/* now preroll for V4L v2 interfaces */
-	if ((strstr(config, "v4l2src") != 0) ||
-		(strstr(config, "dv1394src") != 0))
-	{
-		/* set playing state of the pipeline */
-		gst_element_set_state (vid->pipeline, GST_STATE_PLAYING);
-		
-		/* wait until it's up and running or failed */
-		if (gst_element_get_state (vid->pipeline, NULL, NULL, -1) == GST_STATE_CHANGE_FAILURE) {
-	    	g_error ("libARvideo: failed to put GStreamer into PLAYING state!\n");
-	    } else {
-	    	g_print ("libARvideo: GStreamer pipeline is PLAYING!\n");
-	    }
-		
-		/* set playing state of the pipeline */
-		gst_element_set_state (vid->pipeline, GST_STATE_PAUSED);
-		
-		/* wait until it's up and running or failed */
-		if (gst_element_get_state (vid->pipeline, NULL, NULL, -1) == GST_STATE_CHANGE_FAILURE) {
-	    	g_error ("libARvideo: failed to put GStreamer into PAUSED state!\n");
-	    } else {
-	    	g_print ("libARvideo: GStreamer pipeline is PAUSED!\n");
-	    }
-	}
-		
-#if 0
-	/* write the bin to stdout */
-	gst_xml_write_file (GST_ELEMENT (vid->pipeline), stdout);
-#endif
-	
 	/* return the video handle */
 	return vid;
 };
 
 
-int 
+int
 ar2VideoClose(AR2VideoParamT *vid) {
 
+	int i;
+
 	/* stop the pipeline */
 	gst_element_set_state (vid->pipeline, GST_STATE_NULL);
-	
+
+	for (i = 0; i < AR_VIDEO_GST_FRAMES; i++) release_frame( vid, i );
+	if (vid->pending) gst_sample_unref (vid->pending);
+
 	/* free the pipeline handle */
+	gst_object_unref (GST_OBJECT (vid->sink));
 	gst_object_unref (GST_OBJECT (vid->pipeline));
+	g_mutex_clear( &vid->lock );
+	free( vid );
 
 	return 0;
 }
 
 
-ARUint8* 
+ARUint8*
 ar2VideoGetImage(AR2VideoParamT *vid) {
-	/* just return the bare video buffer */
-	return vid->videoBuffer;
+
+	GstSample *sample;
+	unsigned long n;
+	gint64 time;
+	int i;
+
+	g_mutex_lock( &vid->lock );
+	sample = vid->pending;
+	n = vid->sequence;
+	time = vid->pending_time;
+	vid->pending = 0;
+	if (!sample) {
+		g_mutex_unlock( &vid->lock );
+		return NULL;
+	}
+
+	/* the last frame is given back, unless it is leased */
+	give_back( vid, vid->current );
+	vid->current = -1;
+
+	for (i = 0; i < AR_VIDEO_GST_FRAMES; i++) {
+		if (!vid->frame[i].sample) break;
+	}
+	if (i == AR_VIDEO_GST_FRAMES) {
+		g_mutex_unlock( &vid->lock );
+		printf("libARvideo: every frame is leased\n");
+		gst_sample_unref (sample);
+		return NULL;
+	}
+	if (!gst_video_frame_map( &vid->frame[i].frame, &vid->info,
+	                          gst_sample_get_buffer( sample ), GST_MAP_READ )) {
+		g_mutex_unlock( &vid->lock );
+		gst_sample_unref (sample);
+		return NULL;
+	}
+	vid->frame[i].sample = sample;
+	vid->frame[i].n      = n;
+	vid->frame[i].time   = time;
+	vid->frame[i].refs   = 0;
+	vid->current = i;
+	vid->n    = n;
+	vid->time = time;
+	g_mutex_unlock( &vid->lock );
+
+	return (ARUint8 *)GST_VIDEO_FRAME_PLANE_DATA( &vid->frame[i].frame, 0 );
 }
 
-int 
-ar2VideoCapStart(AR2VideoParamT *vid) 
+int
+ar2VideoCapStart(AR2VideoParamT *vid)
 {
 	GstStateChangeReturn _ret;
 
 	/* set playing state of the pipeline */
 	_ret = gst_element_set_state (vid->pipeline, GST_STATE_PLAYING);
 
-	if (_ret == GST_STATE_CHANGE_ASYNC) 
+	if (_ret == GST_STATE_CHANGE_ASYNC)
 	{
 
 		/* wait until it's up and running or failed */
-		if (gst_element_get_state (vid->pipeline, 
-				NULL, NULL, GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_FAILURE) 
+		if (gst_element_get_state (vid->pipeline,
+				NULL, NULL, GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_FAILURE)
 		{
-    		g_error ("libARvideo: failed to put GStreamer into PLAYING state!\n");    	
-    		return 0;
-  
+    		g_print ("libARvideo: failed to put GStreamer into PLAYING state!\n");
+    		return -1;
+
         } else {
 			g_print ("libARvideo: GStreamer pipeline is PLAYING!\n");
-		} 
+		}
 	}
-	return 1; 
+	else if (_ret == GST_STATE_CHANGE_FAILURE) {
+		g_print ("libARvideo: failed to put GStreamer into PLAYING state!\n");
+		return -1;
+	}
+	return 0;
 }
 
-int 
+int
 ar2VideoCapStop(AR2VideoParamT *vid) {
 	/* stop pipeline */
-	return gst_element_set_state (vid->pipeline, GST_STATE_NULL);
+	if (gst_element_set_state (vid->pipeline, GST_STATE_NULL) == GST_STATE_CHANGE_FAILURE) return -1;
+	return 0;
 }
 
-int 
+int
 ar2VideoCapNext(AR2VideoParamT *vid)
 {
-	/* gstreamer should */
-	return TRUE;
+	/* give the last frame back to GStreamer */
+	g_mutex_lock( &vid->lock );
+	give_back( vid, vid->current );
+	vid->current = -1;
+	g_mutex_unlock( &vid->lock );
+
+	return 0;
 }
 
 int
-ar2VideoInqSize(AR2VideoParamT *vid, int *x, int *y ) 
+ar2VideoInqSize(AR2VideoParamT *vid, int *x, int *y )
 {
 
    *x = vid->width; // width of your static image
    *y = vid->height; // height of your static image
 
+   return 0;
+}
+
+int
+ar2VideoInqPixelFormat(AR2VideoParamT *vid, int *format, int *stride)
+{
+	int f;
+
+	switch (GST_VIDEO_INFO_FORMAT( &vid->info )) {
+		case GST_VIDEO_FORMAT_RGB:   f = AR_PIXEL_FORMAT_RGB;  break;
+		case GST_VIDEO_FORMAT_BGR:   f = AR_PIXEL_FORMAT_BGR;  break;
+		case GST_VIDEO_FORMAT_RGBA:  f = AR_PIXEL_FORMAT_RGBA; break;
+		case GST_VIDEO_FORMAT_BGRA:  f = AR_PIXEL_FORMAT_BGRA; break;
+		case GST_VIDEO_FORMAT_ABGR:  f = AR_PIXEL_FORMAT_ABGR; break;
+		case GST_VIDEO_FORMAT_ARGB:  f = AR_PIXEL_FORMAT_ARGB; break;
+		case GST_VIDEO_FORMAT_GRAY8: f = AR_PIXEL_FORMAT_MONO; break;
+		case GST_VIDEO_FORMAT_NV12:  f = AR_PIXEL_FORMAT_MONO; break;
+		case GST_VIDEO_FORMAT_I420:  f = AR_PIXEL_FORMAT_MONO; break;
+		case GST_VIDEO_FORMAT_UYVY:  f = AR_PIXEL_FORMAT_2vuy; break;
+		case GST_VIDEO_FORMAT_YUY2:  f = AR_PIXEL_FORMAT_yuvs; break;
+		default: return -1;
+	}
+	if (format) *format = f;
+	if (stride) *stride = GST_VIDEO_INFO_PLANE_STRIDE( &vid->info, 0 );
+
+	return 0;
+}
+
+int
+ar2VideoLeaseFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	VideoFrameT *f;
+
+	if (ar2VideoInqPixelFormat( vid, &frame->format, &frame->stride ) < 0) return -1;
+
+	g_mutex_lock( &vid->lock );
+	if (vid->current < 0) {
+		g_mutex_unlock( &vid->lock );
+		return -1;
+	}
+	f = &vid->frame[vid->current];
+	f->refs++;
+	frame->buff   = (ARUint8 *)GST_VIDEO_FRAME_PLANE_DATA( &f->frame, 0 );
+	frame->stride = GST_VIDEO_FRAME_PLANE_STRIDE( &f->frame, 0 );
+	frame->time   = (long long)f->time;
+	frame->xsize  = vid->width;
+	frame->ysize  = vid->height;
+	frame->n      = f->n;
+	frame->id     = vid->current;
+	g_mutex_unlock( &vid->lock );
+
+	return 0;
+}
+
+int
+ar2VideoRetainFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	int i = frame->id;
+
+	g_mutex_lock( &vid->lock );
+	if (i < 0 || i >= AR_VIDEO_GST_FRAMES || vid->frame[i].refs == 0 || vid->frame[i].n != frame->n) {
+		g_mutex_unlock( &vid->lock );
+		return -1;
+	}
+	vid->frame[i].refs++;
+	g_mutex_unlock( &vid->lock );
+
+	return 0;
+}
+
+int
+ar2VideoReleaseFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	int i = frame->id;
+
+	g_mutex_lock( &vid->lock );
+	if (i < 0 || i >= AR_VIDEO_GST_FRAMES || vid->frame[i].refs == 0 || vid->frame[i].n != frame->n) {
+		g_mutex_unlock( &vid->lock );
+		return -1;
+	}
+	vid->frame[i].refs--;
+	if (i != vid->current) give_back( vid, i );
+	g_mutex_unlock( &vid->lock );
+
+	return 0;
+}
+
+int
+ar2VideoInqFrameInfo(AR2VideoParamT *vid, long long *time, unsigned long *n)
+{
+	g_mutex_lock( &vid->lock );
+	if (vid->time == 0) {
+		g_mutex_unlock( &vid->lock );
+		return -1;
+	}
+	if (time) *time = (long long)vid->time;
+	if (n) *n = vid->n;
+	g_mutex_unlock( &vid->lock );
+
+	return 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+/* streaming thread: keep the newest sample, drop the one not taken yet */
+static GstFlowReturn
+cb_new_sample (GstAppSink *appsink, gpointer u_data)
+{
+	AR2VideoParamT *vid = (AR2VideoParamT*)u_data;
+	GstSample *sample, *old;
+
+	sample = gst_app_sink_pull_sample (appsink);
+	if (!sample) return GST_FLOW_OK;
+
+	g_mutex_lock( &vid->lock );
+	old = vid->pending;
+	vid->pending = sample;
+	vid->pending_time = g_get_monotonic_time();
+	vid->sequence++;
+	g_mutex_unlock( &vid->lock );
+
+	if (old) gst_sample_unref (old);
+
+	return GST_FLOW_OK;
+}
+
+static int
+set_caps (AR2VideoParamT *vid, GstSample *sample)
+{
+	GstCaps *caps;
+
+	caps = gst_sample_get_caps (sample);
+	if (!caps || !gst_video_info_from_caps (&vid->info, caps)) return -1;
+
+	vid->width  = GST_VIDEO_INFO_WIDTH( &vid->info );
+	vid->height = GST_VIDEO_INFO_HEIGHT( &vid->info );
+
+	return 0;
+}
+
+/* unmaps a frame once nothing holds it, vid->lock held */
+static void
+give_back (AR2VideoParamT *vid, int i)
+{
+	if (i < 0 || vid->frame[i].refs) return;
+
+	release_frame( vid, i );
+}
+
+static void
+release_frame (AR2VideoParamT *vid, int i)
+{
+	VideoFrameT *f = &vid->frame[i];
+
+	if (!f->sample) return;
+
+	gst_video_frame_unmap( &f->frame );
+	gst_sample_unref (f->sample);
+	f->sample = 0;
+	f->refs = 0;
 }
@@ -80,6 +80,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <sys/time.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
@@ -173,7 +174,9 @@
 
 
 /* Here are some extra definitions to support Point Grey DragonFly cameras */
-#include "conversions.h"
+#include "../VideoCommon/videoConvert.h"
+#include "../VideoCommon/videoLease.h"
+#include "../VideoCommon/videoCapture.h"
 int ar2Video_dragonfly = -1;
 
 
@@ -181,6 +184,11 @@ int ar2Video_dragonfly = -1;
 
 static AR2VideoParamT   *gVid = NULL;
 
+static ARUint8 *ar2VideoGetImage1394( AR2VideoParamT *vid );
+static long long ar2VideoFillTime( AR2VideoParamT *vid );
+static ARUint8 *ar2VideoGrab1394( void *vid, long long *time );
+static int ar2VideoCapNext1394( void *vid );
+
 int arVideoDispOption( void )
 {
     return  ar2VideoDispOption();
@@ -245,6 +253,39 @@ int arVideoCapNext( void )
     return ar2VideoCapNext( gVid );
 }
 
+int arVideoLeaseFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoLeaseFrame( gVid, frame );
+}
+
+int arVideoRetainFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoRetainFrame( gVid, frame );
+}
+
+int arVideoReleaseFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoReleaseFrame( gVid, frame );
+}
+
+int arVideoInqFrameInfo( long long *time, unsigned long *n )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoInqFrameInfo( gVid, time, n );
+}
+
+long long arVideoTime( void )
+{
+    return videoTimeMonotonic();
+}
+
 /*-------------------------------------------*/
 
 
@@ -274,6 +315,13 @@ int ar2VideoDispOption( void )
     printf("    (1.875, 3.75, 7.5, 15, 30, 60)\n");
     printf(" -[name]=N  where name is brightness, iris, shutter, gain, saturation, gamma, sharpness\n");
     printf("    (value must be a legal value for this parameter - use coriander to find what they are\n");
+    printf(" -trigger\n");
+    printf("    starts every frame on the external trigger, for the cameras of a video group.\n");
+    printf(" -thread\n");
+    printf("    captures in a thread, arVideoGetImage() returns the newest frame without waiting.\n");
+    printf(" -decode=[rgb|luma]\n");
+    printf("    Bayer frames of DragonFly cameras are made RGB, or each 2x2 tile binned into\n");
+    printf("    a luma plane for the detection, see ar2VideoInqPixelFormat() and ar2VideoInqBayer().\n");
     printf("\n");
     printf(" Note that if no config string is supplied, you can override it with the environment variable ARTOOLKIT_CONFIG\n");
     printf("\n");
@@ -308,7 +356,13 @@ AR2VideoParamT *ar2VideoOpen( char *config_in )
     vid->format       = FORMAT_VGA_NONCOMPRESSED;
     vid->dma_buf_num  = 16;
     vid->debug        = 0;
+    vid->thread       = 0;
+    vid->trigger      = 0;
     vid->status       = 0;
+    vid->decode       = AR_VIDEO_1394_DECODE_RGB;
+    vid->capture      = NULL;
+    vid->raw          = NULL;
+    vid->bayer_red    = -1;
     
 	/* If no config string is supplied, we should use the environment variable, otherwise set a sane default */
 	if (!config_in || !(config_in[0])) {
@@ -410,6 +464,21 @@ AR2VideoParamT *ar2VideoOpen( char *config_in )
             else if( strncmp( a, "-debug", 6 ) == 0 ) {
                 vid->debug = 1;
             }
+            else if( strncmp( a, "-thread", 7 ) == 0 ) {
+                vid->thread = 1;
+            }
+            else if( strncmp( a, "-trigger", 8 ) == 0 ) {
+                vid->trigger = 1;
+            }
+            else if( strncmp( a, "-decode=", 8 ) == 0 ) {
+                if( strncmp( &a[8], "rgb", 3 ) == 0 )       vid->decode = AR_VIDEO_1394_DECODE_RGB;
+                else if( strncmp( &a[8], "luma", 4 ) == 0 ) vid->decode = AR_VIDEO_1394_DECODE_LUMA;
+                else {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
 	    else if( strncmp( a, "-adjust", 7 ) == 0 ) {
 	      /* Do nothing - this is for V4L compatibility */
 	    }
@@ -605,8 +674,14 @@ AR2VideoParamT *ar2VideoOpen( char *config_in )
     if( dc1394_set_trigger_mode(arV1394.handle, vid->node, TRIGGER_MODE_0) != DC1394_SUCCESS ) {
         fprintf( stderr, "unable to set camera trigger mode (ignored)\n");
     }
+    if( vid->trigger ) {
+        if( dc1394_set_trigger_on_off(arV1394.handle, vid->node, DC1394_TRUE) != DC1394_SUCCESS ) {
+            fprintf( stderr, "unable to turn the camera trigger on (ignored)\n");
+        }
+    }
     
     arMalloc( vid->image, ARUint8, (vid->camera.frame_width * vid->camera.frame_height * AR_PIX_SIZE_DEFAULT) );
+    vid->lease = videoLeaseCreate();
     
     return vid;
 }
@@ -621,6 +696,7 @@ int ar2VideoClose( AR2VideoParamT *vid )
     dc1394_dma_release_camera(arV1394.handle, &(vid->camera));
 #endif
     free( vid->image );
+    videoLeaseDelete( vid->lease );
     free( vid );
     
     raw1394_destroy_handle(arV1394.handle);
@@ -684,6 +760,11 @@ int ar2VideoCapStart( AR2VideoParamT *vid )
 
     vid->status = 1;
 
+    if( vid->thread ) {
+        vid->capture = videoCaptureStart( vid, ar2VideoGrab1394, ar2VideoCapNext1394,
+                                          vid->camera.frame_width * vid->camera.frame_height * AR_PIX_SIZE_DEFAULT );
+    }
+
     return 0;
 }
 
@@ -693,7 +774,23 @@ int ar2VideoCapNext( AR2VideoParamT *vid )
         fprintf(stderr, "arVideoCapStart has never been called.\n");
         return -1;
     }
+
+    videoLeaseImage( vid->lease, NULL, 0 );
+    if( vid->capture != NULL ) return 0;
     if(vid->status == 2) vid->status = 1;
+    vid->raw = NULL;
+
+    dc1394_dma_done_with_buffer( &(vid->camera) );
+
+    return 0;
+}
+
+static int ar2VideoCapNext1394( void *v )
+{
+    AR2VideoParamT *vid = (AR2VideoParamT *)v;
+
+    if(vid->status != 2) return -1;
+    vid->status = 1;
 
     dc1394_dma_done_with_buffer( &(vid->camera) );
 
@@ -702,6 +799,9 @@ int ar2VideoCapNext( AR2VideoParamT *vid )
 
 int ar2VideoCapStop( AR2VideoParamT *vid )
 {
+    videoCaptureStop( vid->capture );
+    vid->capture = NULL;
+
     if(vid->status == 2){
         if( dc1394_dma_single_capture( &(vid->camera) ) != DC1394_SUCCESS ) {
             fprintf( stderr, "unable to capture a frame\n");
@@ -731,13 +831,111 @@ int ar2VideoInqSize(AR2VideoParamT *vid, int *x,int *y)
     return 0;
 }
 
+int ar2VideoInqPixelFormat( AR2VideoParamT *vid, int *format, int *stride )
+{
+    if( vid->int_mode == MODE_640x480_MONO && vid->decode == AR_VIDEO_1394_DECODE_LUMA ) {
+        if( format != NULL ) *format = AR_PIXEL_FORMAT_MONO;
+        if( stride != NULL ) *stride = vid->camera.frame_width;
+    }
+    else {
+        if( format != NULL ) *format = AR_DEFAULT_PIXEL_FORMAT;
+        if( stride != NULL ) *stride = vid->camera.frame_width * AR_PIX_SIZE_DEFAULT;
+    }
+
+    return 0;
+}
+
+int ar2VideoInqBayer( AR2VideoParamT *vid, ARUint8 **raw, int *red )
+{
+    if( vid->raw == NULL ) return -1;
+    if( raw != NULL ) *raw = vid->raw;
+    if( red != NULL ) *red = vid->bayer_red;
+
+    return 0;
+}
+
+int ar2VideoSetControl( AR2VideoParamT *vid, int control, double value )
+{
+    dc1394_feature_info   *f;
+    unsigned int           feature, v;
+
+    switch( control ) {
+        // The shutter is the exposure time; FEATURE_EXPOSURE is the level
+        // the automatic shutter and gain aim for.
+        case AR_VIDEO_CONTROL_EXPOSURE: feature = FEATURE_SHUTTER; break;
+        case AR_VIDEO_CONTROL_GAIN:     feature = FEATURE_GAIN;    break;
+        default: return -1;
+    }
+    f = &(vid->features.feature[feature - FEATURE_MIN]);
+    if( !f->available ) return -1;
+
+    if( value < 0.0 ) {
+        if( !f->auto_capable ) return -1;
+        return (dc1394_auto_on_off(arV1394.handle, vid->node, feature, 1) == DC1394_SUCCESS)? 0: -1;
+    }
+    if( f->auto_capable ) dc1394_auto_on_off(arV1394.handle, vid->node, feature, 0);
+    v = f->min + (unsigned int)(value * (f->max - f->min) + 0.5);
+
+    return (dc1394_set_feature_value(arV1394.handle, vid->node, feature, v) == DC1394_SUCCESS)? 0: -1;
+}
+
+int ar2VideoLeaseFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    int     x, y, stride;
+
+    ar2VideoInqSize( vid, &x, &y );
+    ar2VideoInqPixelFormat( vid, NULL, &stride );
+    if( videoLeaseFrame( vid->lease, frame, x, y, stride ) < 0 ) return -1;
+    ar2VideoInqPixelFormat( vid, &frame->format, NULL );
+
+    return 0;
+}
+
+int ar2VideoRetainFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    return videoLeaseRetain( vid->lease, frame );
+}
+
+int ar2VideoReleaseFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    return videoLeaseRelease( vid->lease, frame );
+}
+
+int ar2VideoInqFrameInfo( AR2VideoParamT *vid, long long *time, unsigned long *n )
+{
+    return videoLeaseInqFrameInfo( vid->lease, time, n );
+}
+
 ARUint8 *ar2VideoGetImage( AR2VideoParamT *vid )
 {
-    register ARUint8 *buf, *buf2;
-    register int i, j;
-    register int U, V, R, G, B, V2, U5, UV;
-    register int Y0, Y1, Y2, Y3;
-    register ARUint8 r, g, b;
+    ARUint8   *buf;
+    long long  time = 0;
+
+    if( vid->capture != NULL ) {
+        buf = videoCaptureImage( vid->capture, &time );
+    }
+    else {
+        buf = ar2VideoGetImage1394( vid );
+        if( buf != NULL ) time = ar2VideoFillTime( vid );
+    }
+    if( buf != NULL ) videoLeaseImage( vid->lease, buf, time );
+
+    return buf;
+}
+
+static ARUint8 *ar2VideoGrab1394( void *v, long long *time )
+{
+    AR2VideoParamT *vid = (AR2VideoParamT *)v;
+    ARUint8        *buf;
+
+    buf = ar2VideoGetImage1394( vid );
+    if( buf != NULL ) *time = ar2VideoFillTime( vid );
+
+    return buf;
+}
+
+static ARUint8 *ar2VideoGetImage1394( AR2VideoParamT *vid )
+{
 
     if(vid->status == 0){
         fprintf(stderr, "arVideoCapStart has never been called.\n");
@@ -814,10 +1012,26 @@ ARUint8 *ar2VideoGetImage( AR2VideoParamT *vid )
 	    /* Store the previous Bayer pattern value */
 	    prev_pattern = pattern;
 	    
-	    /* Do the Bayer image conversion now */
+	    /* The detection only needs the luma, which is binned straight from the DMA buffer;
+	       the buffer itself stays valid for ar2VideoInqBayer() until ar2VideoCapNext() */
 	    unsigned char *dest  = vid->image;
 	    unsigned char *src = (ARUint8 *)vid->camera.capture_buffer;
-	    BayerNearestNeighbor( src, 
+	    if (vid->decode == AR_VIDEO_1394_DECODE_LUMA)
+	      {
+		videoConvBayerToLuma( src, dest, vid->camera.frame_width, vid->camera.frame_height );
+		switch( pattern )
+		  {
+		  case BAYER_PATTERN_RGGB: vid->bayer_red = 0; break;
+		  case BAYER_PATTERN_GRBG: vid->bayer_red = 1; break;
+		  case BAYER_PATTERN_GBRG: vid->bayer_red = 2; break;
+		  case BAYER_PATTERN_BGGR: vid->bayer_red = 3; break;
+		  }
+		if (!vid->thread) vid->raw = src;
+		return (vid->image);
+	      }
+
+	    /* Do the Bayer image conversion now */
+	    videoConvBayerToRGB24( src, 
 			    dest,
 			    vid->camera.frame_width,
 			    vid->camera.frame_height,
@@ -829,120 +1043,13 @@ ARUint8 *ar2VideoGetImage( AR2VideoParamT *vid )
 	  
 	  
         case MODE_640x480_YUV411:
-          buf  = vid->image;
-          buf2 = (ARUint8 *)vid->camera.capture_buffer;
-          for( i = vid->camera.frame_height * vid->camera.frame_width / 4; i; i--) {
-              U   = ((ARUint8)*buf2++ - 128) * 0.354;
-              U5  = 5*U;
-              Y0  = (ARUint8)*buf2++;
-              Y1  = (ARUint8)*buf2++;
-              V   = ((ARUint8)*buf2++ - 128) * 0.707;
-              V2  = 2*V;
-              Y2  = (ARUint8)*buf2++;
-              Y3  = (ARUint8)*buf2++;
-              UV  = - U - V;
-
-              // Original equations
-              // R = Y           + 1.402 V
-              // G = Y - 0.344 U - 0.714 V
-              // B = Y + 1.772 U
-              R = Y0 + V2;
-              if ((R >> 8) > 0) R = 255; else if (R < 0) R = 0;
-
-              G = Y0 + UV;
-              if ((G >> 8) > 0) G = 255; else if (G < 0) G = 0;
-
-              B = Y0 + U5;
-              if ((B >> 8) > 0) B = 255; else if (B < 0) B = 0;
-     
-              *buf++ = (ARUint8)R;
-              *buf++ = (ARUint8)G;
-              *buf++ = (ARUint8)B;
-
-              //---
-              R = Y1 + V2;
-              if ((R >> 8) > 0) R = 255; else if (R < 0) R = 0;
-
-              G = Y1 + UV;
-              if ((G >> 8) > 0) G = 255; else if (G < 0) G = 0;
-
-              B = Y1 + U5;
-              if ((B >> 8) > 0) B = 255; else if (B < 0) B = 0;
-     
-              *buf++ = (ARUint8)R;
-              *buf++ = (ARUint8)G;
-              *buf++ = (ARUint8)B;
-
-              //---
-              R = Y2 + V2;
-              if ((R >> 8) > 0) R = 255; else if (R < 0) R = 0;
-
-              G = Y2 + UV;
-              if ((G >> 8) > 0) G = 255; else if (G < 0) G = 0;
-
-              B = Y2 + U5;
-              if ((B >> 8) > 0) B = 255; else if (B < 0) B = 0;
-     
-              *buf++ = (ARUint8)R;
-              *buf++ = (ARUint8)G;
-              *buf++ = (ARUint8)B;
-
-              //---
-              R = Y3 + V2;
-              if ((R >> 8) > 0) R = 255; else if (R < 0) R = 0;
-
-              G = Y3 + UV;
-              if ((G >> 8) > 0) G = 255; else if (G < 0) G = 0;
-
-              B = Y3 + U5;
-              if ((B >> 8) > 0) B = 255; else if (B < 0) B = 0;
-     
-              *buf++ = (ARUint8)R;
-              *buf++ = (ARUint8)G;
-              *buf++ = (ARUint8)B;
-          }
+          videoConvYUV411ToRGB24( (ARUint8 *)vid->camera.capture_buffer, vid->image,
+                                  vid->camera.frame_width * vid->camera.frame_height );
           return vid->image;
 
         case MODE_320x240_YUV422:
-          buf  = vid->image;
-          buf2 = (ARUint8 *)vid->camera.capture_buffer;
-          for( i = vid->camera.frame_height * vid->camera.frame_width / 2; i; i-- ) {
-              U   = ((ARUint8)*buf2++ - 128) * 0.354;
-              U5  = 5*U;
-              Y0  = (ARUint8)*buf2++;
-              V   = ((ARUint8)*buf2++ - 128) * 0.707;
-              V2  = 2*V;
-              Y1  = (ARUint8)*buf2++;
-              UV  = - U - V;
-
-              //---
-              R = Y0 + V2;
-              if ((R >> 8) > 0) R = 255; else if (R < 0) R = 0;
-
-              G = Y0 + UV;
-              if ((G >> 8) > 0) G = 255; else if (G < 0) G = 0;
-
-              B = Y0 + U5;
-              if ((B >> 8) > 0) B = 255; else if (B < 0) B = 0;
-      
-              *buf++ = (ARUint8)R;
-              *buf++ = (ARUint8)G;
-              *buf++ = (ARUint8)B;
-
-              //---
-              R = Y1 + V2;
-              if ((R >> 8) > 0) R = 255; else if (R < 0) R = 0;
-
-              G = Y1 + UV;
-              if ((G >> 8) > 0) G = 255; else if (G < 0) G = 0;
-
-              B = Y1 + U5;
-              if ((B >> 8) > 0) B = 255; else if (B < 0) B = 0;
-      
-              *buf++ = (ARUint8)R;
-              *buf++ = (ARUint8)G;
-              *buf++ = (ARUint8)B;
-          }
+          videoConvUYVYToRGB24( (ARUint8 *)vid->camera.capture_buffer, vid->image,
+                                vid->camera.frame_width * vid->camera.frame_height );
           return vid->image;
     }
 
@@ -952,6 +1059,16 @@ ARUint8 *ar2VideoGetImage( AR2VideoParamT *vid )
 
 
 
+/* the DMA fill time is on the wall clock, move it to the one of arVideoTime() */
+static long long ar2VideoFillTime( AR2VideoParamT *vid )
+{
+    struct timeval  now;
+
+    gettimeofday( &now, NULL );
+    return videoTimeMonotonic() - ((long long)(now.tv_sec - vid->camera.filltime.tv_sec) * 1000000
+                                   + (now.tv_usec - vid->camera.filltime.tv_usec));
+}
+
 static int ar2Video1394Init( int debug, int *card, int *node )
 {
     int     i;
@@ -6,6 +6,7 @@
 #include <AR/config.h>
 #include <AR/ar.h>
 #include <AR/video.h>
+#include "../VideoCommon/videoLease.h"
 
 #define VIDEO_MODE_PAL             0
 #define VIDEO_MODE_NTSC            1
@@ -28,11 +29,11 @@ static AR2VideoParamT   *gVid = NULL;
 static void ar2VideoCapture(AR2VideoParamT *vid);
 static int ar2VideoRawISOHandler(raw1394handle_t handle, int channel, size_t length, quadlet_t *data);
 static int ar2VideoBusResetHandler(raw1394handle_t handle, unsigned int generation);
-static int ar2VideoBufferInit(AR2VideoBufferT *buffer, int size);
+static int ar2VideoBufferInit(AR2VideoBufferT *buffer, int size, int image_size);
 static int ar2VideoBufferClose(AR2VideoBufferT *buffer);
-static int ar2VideoBufferRead(AR2VideoBufferT *buffer, ARUint8 *dest, int size, int flag);
-static int ar2VideoBufferWrite(AR2VideoBufferT *buffer, ARUint8 *src, int size, int flag);
-static ARUint8 *ar2VideoBufferReadDV(AR2VideoParamT *vid);
+static int ar2VideoBufferWrite(AR2VideoParamT *vid, ARUint8 *src, int size, int flag);
+static int ar2VideoBufferDecodeDV(AR2VideoParamT *vid);
+static ARUint8 *ar2VideoBufferReadDV(AR2VideoParamT *vid, long long *time);
 
 int arVideoDispOption( void )
 {
@@ -97,6 +98,39 @@ int arVideoCapNext( void )
     return ar2VideoCapNext( gVid );
 }
 
+int arVideoLeaseFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoLeaseFrame( gVid, frame );
+}
+
+int arVideoRetainFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoRetainFrame( gVid, frame );
+}
+
+int arVideoReleaseFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoReleaseFrame( gVid, frame );
+}
+
+int arVideoInqFrameInfo( long long *time, unsigned long *n )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoInqFrameInfo( gVid, time, n );
+}
+
+long long arVideoTime( void )
+{
+    return videoTimeMonotonic();
+}
+
 /*-------------------------------------------*/
 
 int ar2VideoDispOption( void )
@@ -208,9 +242,9 @@ AR2VideoParamT *ar2VideoOpen( char *config_in )
 
     arMalloc( vid->buffer, AR2VideoBufferT, 1 );
     vid->buffer->init = 0;
-    ar2VideoBufferInit( vid->buffer, ARV_BUF_FRAME_DATA );
+    ar2VideoBufferInit( vid->buffer, ARV_BUF_FRAME_DATA, 720*576*4 ); // Make the images big enough for PAL BGRA.
 
-    arMalloc( vid->image, ARUint8, 720*576*4 ); // Make buffer big enough for PAL BGRA images.
+    vid->lease = videoLeaseCreate();
 
     return vid;
 }
@@ -236,6 +270,8 @@ int ar2VideoCapStop( AR2VideoParamT *vid )
 
 int ar2VideoCapNext( AR2VideoParamT *vid )
 {
+    videoLeaseImage( vid->lease, NULL, 0 );
+
     return 0;
 }
 
@@ -248,7 +284,7 @@ int ar2VideoClose( AR2VideoParamT *vid )
 
     ar2VideoBufferClose(vid->buffer);
     free( vid->buffer );
-    free( vid->image );
+    videoLeaseDelete( vid->lease );
 
     raw1394_stop_fcp_listen(vid->handle);
     raw1394_destroy_handle(vid->handle);
@@ -262,6 +298,7 @@ int ar2VideoClose( AR2VideoParamT *vid )
   
 static void ar2VideoCapture(AR2VideoParamT *vid)
 { 
+    arThreadRole( AR_THREAD_CAPTURE, "ieee1394 capture" );
     raw1394_set_userdata(vid->handle, vid);
     raw1394_set_bus_reset_handler(vid->handle, ar2VideoBusResetHandler);
     raw1394_set_iso_handler(vid->handle, 63, ar2VideoRawISOHandler);
@@ -280,6 +317,7 @@ static void ar2VideoCapture(AR2VideoParamT *vid)
         else if( vid->status == 2 ) usleep(10);
         else break;
     }
+    arThreadRoleEnd();
 
     return;
 }
@@ -301,23 +339,23 @@ static int ar2VideoRawISOHandler(raw1394handle_t handle, int channel, size_t len
         if (packet[12] == 0x1f && packet[13] == 0x07) {
             if(vid->packet_num == 0) {
                 vid->packet_num++;
-                len = ar2VideoBufferWrite(vid->buffer, (ARUint8 *)(data+3), ARV_PACKET_DATA_SIZE, 0);
+                len = ar2VideoBufferWrite(vid, (ARUint8 *)(data+3), ARV_PACKET_DATA_SIZE, 0);
             }
             else {
                 vid->packet_num = 0;
                 vid->packet_num++;
-                len = ar2VideoBufferWrite(vid->buffer, (ARUint8 *)(data+3), ARV_PACKET_DATA_SIZE, 2);
+                len = ar2VideoBufferWrite(vid, (ARUint8 *)(data+3), ARV_PACKET_DATA_SIZE, 2);
             }
         }
         else {
             vid->packet_num++;
             if( (vid->mode == VIDEO_MODE_NTSC && vid->packet_num == ARV_PACKET_NUM_NTSC)
              || (vid->mode == VIDEO_MODE_PAL  && vid->packet_num == ARV_PACKET_NUM_PAL) ) {
-                len = ar2VideoBufferWrite(vid->buffer, (ARUint8 *)(data+3), ARV_PACKET_DATA_SIZE, 1);
+                len = ar2VideoBufferWrite(vid, (ARUint8 *)(data+3), ARV_PACKET_DATA_SIZE, 1);
                 vid->packet_num = 0;
             }
             else {
-                len = ar2VideoBufferWrite(vid->buffer, (ARUint8 *)(data+3), ARV_PACKET_DATA_SIZE, 0);
+                len = ar2VideoBufferWrite(vid, (ARUint8 *)(data+3), ARV_PACKET_DATA_SIZE, 0);
             }
         }
     }
@@ -340,63 +378,53 @@ static int ar2VideoBusResetHandler(raw1394handle_t handle, unsigned int generati
 
 ARUint8 *ar2VideoGetImage( AR2VideoParamT *vid )
 {
-    return ar2VideoBufferReadDV( vid );
+    ARUint8   *buf;
+    long long  time;
+
+    buf = ar2VideoBufferReadDV( vid, &time );
+    if( buf != NULL ) videoLeaseImage( vid->lease, buf, time );
+
+    return buf;
 }
 
-static ARUint8 *ar2VideoBufferReadDV(AR2VideoParamT *vid)
+int ar2VideoLeaseFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
 {
-    static int     f = 1;
-    ARUint8       *tmp;
-    int            read_size;
-    int            pitches[3];
-    unsigned char *pixels[3];
+    int     x, y;
 
-    if( vid->buffer->init == 0 ) return NULL;
+    ar2VideoInqSize( vid, &x, &y );
 
-    pthread_mutex_lock(&(vid->buffer->mutex));
-    tmp = vid->buffer->buff_wait;
-    vid->buffer->buff_wait = vid->buffer->buff_out;
-    vid->buffer->buff_out = tmp;
+    return videoLeaseFrame( vid->lease, frame, x, y, x * AR_PIX_SIZE_DEFAULT );
+}
 
-    vid->buffer->fill_size_out = vid->buffer->fill_size_wait;
-    vid->buffer->read_size = 0;
-    vid->buffer->fill_size_wait = 0;
-    pthread_mutex_unlock(&(vid->buffer->mutex));
- 
-    if( vid->mode == VIDEO_MODE_NTSC ) {
-        if( vid->buffer->fill_size_out != ARV_NTSC_FRAME_SIZE ) return NULL;
-    }
-    else if( vid->mode == VIDEO_MODE_PAL ) {
-        if( vid->buffer->fill_size_out != ARV_PAL_FRAME_SIZE ) return NULL;
-    }
-    if( f ) {
-        dv_parse_header(vid->dv_decoder, vid->image);
-        if( vid->mode == VIDEO_MODE_NTSC ) {
-            if( vid->dv_decoder->width != 720 || vid->dv_decoder->height != 480 ) {
-                printf("Image format is not correct.\n");
-                return NULL;
-            }
-        }
-        else if( vid->mode == VIDEO_MODE_PAL ) {
-            if( vid->dv_decoder->width != 720 || vid->dv_decoder->height != 576 ) {
-                printf("Image format is not correct.\n");
-                return NULL;
-            }
-        }
-        f = 0;
-    }
+int ar2VideoRetainFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    return videoLeaseRetain( vid->lease, frame );
+}
 
-    pitches[0] = 720*AR_PIX_SIZE_DEFAULT;
-    pixels[0] =  vid->image;
-#if (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_RGB)
-    dv_decode_full_frame(vid->dv_decoder, vid->buffer->buff_out, e_dv_color_rgb, pixels, pitches );
-#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_BGRA)
-    dv_decode_full_frame(vid->dv_decoder, vid->buffer->buff_out, e_dv_color_bgr0, pixels, pitches );
-#else
-#  error Unsupported pixel format defined in <AR/config.h>.
-#endif
+int ar2VideoReleaseFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    return videoLeaseRelease( vid->lease, frame );
+}
+
+int ar2VideoInqFrameInfo( AR2VideoParamT *vid, long long *time, unsigned long *n )
+{
+    return videoLeaseInqFrameInfo( vid->lease, time, n );
+}
+
+/* the newest decoded frame if there is one since the last call, without a lock */
+static ARUint8 *ar2VideoBufferReadDV(AR2VideoParamT *vid, long long *time)
+{
+    AR2VideoBufferT *buffer = vid->buffer;
+    int              i;
 
-    return vid->image;
+    if( buffer->init == 0 ) return NULL;
+    if( (__atomic_load_n(&(buffer->ready), __ATOMIC_ACQUIRE) & AR_VIDEO_DV_FRESH) == 0 ) return NULL;
+
+    i = __atomic_exchange_n(&(buffer->ready), buffer->read, __ATOMIC_ACQ_REL);
+    buffer->read = i & ~AR_VIDEO_DV_FRESH;
+    *time = buffer->time[buffer->read];
+
+    return buffer->image[buffer->read];
 }
 
 int ar2VideoInqSize(AR2VideoParamT *vid, int *x,int *y)
@@ -414,96 +442,113 @@ int ar2VideoInqSize(AR2VideoParamT *vid, int *x,int *y)
     return 0;
 }
 
-static int ar2VideoBufferInit(AR2VideoBufferT *buffer, int size)
+static int ar2VideoBufferInit(AR2VideoBufferT *buffer, int size, int image_size)
 {
+    int     i;
+
     if( buffer->init ) return -1;
 
     buffer->size = size;
 
-    arMalloc( buffer->buff_in,   ARUint8, size );
-    arMalloc( buffer->buff_wait, ARUint8, size );
-    arMalloc( buffer->buff_out,  ARUint8, size );
-    buffer->fill_size_in   = 0;
-    buffer->fill_size_wait = 0;
-    buffer->fill_size_out  = 0;
-    buffer->read_size      = 0;
-
-    pthread_mutex_init(&(buffer->mutex), NULL);
+    arMalloc( buffer->dv, ARUint8, size );
+    for( i = 0; i < 3; i++ ) {
+        arMalloc( buffer->image[i], ARUint8, image_size );
+        buffer->time[i] = 0;
+    }
+    buffer->fill_size = 0;
+    buffer->write     = 0;
+    buffer->ready     = 1;
+    buffer->read      = 2;
+    buffer->parsed    = 0;
 
     buffer->init = 1;
 
     return 0;
 }
 
+/* called after the capture thread has been joined */
 static int ar2VideoBufferClose(AR2VideoBufferT *buffer)
 {
+    int     i;
+
     if( buffer->init == 0 ) return -1;
 
-    pthread_mutex_lock(&(buffer->mutex));
-    free( buffer->buff_in   );
-    free( buffer->buff_wait );
-    free( buffer->buff_out  );
-    pthread_mutex_unlock(&(buffer->mutex));
-    pthread_mutex_destroy(&(buffer->mutex));
+    free( buffer->dv );
+    for( i = 0; i < 3; i++ ) free( buffer->image[i] );
 
     buffer->init = 0;
 
     return 0;
 }
 
-static int ar2VideoBufferRead(AR2VideoBufferT *buffer, ARUint8 *dest, int size, int flag)
+/* capture thread: collects the packets of a DV frame, a complete one (flag 1) is decoded */
+static int ar2VideoBufferWrite(AR2VideoParamT *vid, ARUint8 *src, int size, int flag)
 {
-    ARUint8   *tmp;
-    int        read_size;
+    AR2VideoBufferT *buffer = vid->buffer;
+    int              write_size;
 
     if( buffer->init == 0 ) return -1;
 
-    if( flag ) {
-        pthread_mutex_lock(&(buffer->mutex));
-        tmp = buffer->buff_wait;
-        buffer->buff_wait = buffer->buff_out;
-        buffer->buff_out = tmp;
+    if( flag == 2 ) {
+        buffer->fill_size = 0;
+    }
+
+    if( buffer->size - buffer->fill_size > size ) write_size = size;
+     else                                         write_size = buffer->size - buffer->fill_size;
+    memcpy(buffer->dv + buffer->fill_size, src, write_size);
+    buffer->fill_size += write_size;
 
-        buffer->fill_size_out = buffer->fill_size_wait;
-        buffer->read_size = 0;
-        buffer->fill_size_wait = 0;
-        pthread_mutex_unlock(&(buffer->mutex));
+    if( flag == 1 ) {
+        ar2VideoBufferDecodeDV( vid );
+        buffer->fill_size = 0;
     }
- 
-    if( buffer->fill_size_out - buffer->read_size >= size ) read_size = size;
-     else                                                   read_size = buffer->fill_size_out - buffer->read_size;
-    memcpy(dest, buffer->buff_out + buffer->read_size, read_size);
-    buffer->read_size += read_size;
 
-    return read_size;
+    return write_size;
 }
 
-static int ar2VideoBufferWrite(AR2VideoBufferT *buffer, ARUint8 *src, int size, int flag)
+/* capture thread: decodes the received frame and makes it the ready one */
+static int ar2VideoBufferDecodeDV(AR2VideoParamT *vid)
 {
-    ARUint8   *tmp;
-    int        write_size;
-
-    if( buffer->init == 0 ) return -1;
+    AR2VideoBufferT *buffer = vid->buffer;
+    int              pitches[3];
+    unsigned char   *pixels[3];
 
-    if( flag == 2 ) {
-        buffer->fill_size_in = 0;
+    if( vid->mode == VIDEO_MODE_NTSC ) {
+        if( buffer->fill_size != ARV_NTSC_FRAME_SIZE ) return -1;
+    }
+    else if( vid->mode == VIDEO_MODE_PAL ) {
+        if( buffer->fill_size != ARV_PAL_FRAME_SIZE ) return -1;
+    }
+    if( !buffer->parsed ) {
+        dv_parse_header(vid->dv_decoder, buffer->dv);
+        if( vid->mode == VIDEO_MODE_NTSC ) {
+            if( vid->dv_decoder->width != 720 || vid->dv_decoder->height != 480 ) {
+                printf("Image format is not correct.\n");
+                return -1;
+            }
+        }
+        else if( vid->mode == VIDEO_MODE_PAL ) {
+            if( vid->dv_decoder->width != 720 || vid->dv_decoder->height != 576 ) {
+                printf("Image format is not correct.\n");
+                return -1;
+            }
+        }
+        buffer->parsed = 1;
     }
 
-    if( buffer->size - buffer->fill_size_in > size ) write_size = size;
-     else                                            write_size = buffer->size - buffer->fill_size_in;
-    memcpy(buffer->buff_in + buffer->fill_size_in, src, write_size);
-    buffer->fill_size_in += write_size;
+    pitches[0] = 720*AR_PIX_SIZE_DEFAULT;
+    pixels[0] =  buffer->image[buffer->write];
+#if (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_RGB)
+    dv_decode_full_frame(vid->dv_decoder, buffer->dv, e_dv_color_rgb, pixels, pitches );
+#elif (AR_DEFAULT_PIXEL_FORMAT == AR_PIXEL_FORMAT_BGRA)
+    dv_decode_full_frame(vid->dv_decoder, buffer->dv, e_dv_color_bgr0, pixels, pitches );
+#else
+#  error Unsupported pixel format defined in <AR/config.h>.
+#endif
+    buffer->time[buffer->write] = videoTimeMonotonic();
 
-    if( flag == 1 ) {
-        pthread_mutex_lock(&(buffer->mutex));
-        tmp = buffer->buff_wait;
-        buffer->buff_wait = buffer->buff_in;
-        buffer->buff_in = tmp;
-
-        buffer->fill_size_wait = buffer->fill_size_in;
-        buffer->fill_size_in = 0;
-        pthread_mutex_unlock(&(buffer->mutex));
-    }
+    buffer->write = __atomic_exchange_n(&(buffer->ready), buffer->write | AR_VIDEO_DV_FRESH, __ATOMIC_ACQ_REL)
+                  & ~AR_VIDEO_DV_FRESH;
 
-    return write_size;
+    return 0;
 }
@@ -31,7 +31,9 @@
 #include <AR/config.h>
 #include <AR/ar.h>
 #include <AR/video.h>
-#include "ccvt.h"
+#include "../VideoCommon/videoConvert.h"
+#include "../VideoCommon/videoLease.h"
+#include "../VideoCommon/videoCapture.h"
 #ifdef USE_EYETOY
 #include "jpegtorgb.h" 
 #endif
@@ -40,6 +42,10 @@
 
 static AR2VideoParamT   *gVid = NULL;
 
+static ARUint8 *ar2VideoGetImageV4L( AR2VideoParamT *vid );
+static ARUint8 *ar2VideoGrabV4L( void *vid, long long *time );
+static int ar2VideoCapNextV4L( void *vid );
+
 int arVideoDispOption( void )
 {
     return  ar2VideoDispOption();
@@ -103,6 +109,39 @@ int arVideoCapNext( void )
     return ar2VideoCapNext( gVid );
 }
 
+int arVideoLeaseFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoLeaseFrame( gVid, frame );
+}
+
+int arVideoRetainFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoRetainFrame( gVid, frame );
+}
+
+int arVideoReleaseFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoReleaseFrame( gVid, frame );
+}
+
+int arVideoInqFrameInfo( long long *time, unsigned long *n )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoInqFrameInfo( gVid, time, n );
+}
+
+long long arVideoTime( void )
+{
+    return videoTimeMonotonic();
+}
+
 /*-------------------------------------------*/
 
 int ar2VideoDispOption( void )
@@ -138,6 +177,8 @@ int ar2VideoDispOption( void )
     printf("OPTION CONTROLS:\n");
     printf(" -mode=[PAL|NTSC|SECAM]\n");
     printf("    specifies TV signal mode (for tv/capture card).\n");
+    printf(" -thread\n");
+    printf("    captures in a thread, arVideoGetImage() returns the newest frame without waiting.\n");
     printf("\n");
 
     return 0;
@@ -187,6 +228,8 @@ AR2VideoParamT *ar2VideoOpen( char *config_in )
     vid->whiteness  = -1.;
     vid->mode       = DEFAULT_VIDEO_MODE;
     vid->debug      = 0;
+    vid->thread     = 0;
+    vid->capture    = NULL;
     vid->videoBuffer=NULL;
 
 	a = config;
@@ -302,6 +345,9 @@ AR2VideoParamT *ar2VideoOpen( char *config_in )
             else if( strncmp( a, "-debug", 6 ) == 0 ) {
                 vid->debug = 1;
             }
+            else if( strncmp( a, "-thread", 7 ) == 0 ) {
+                vid->thread = 1;
+            }
             else {
                 ar2VideoDispOption();
                 free( vid );
@@ -448,7 +494,7 @@ AR2VideoParamT *ar2VideoOpen( char *config_in )
         return 0;
     }
     if (vid->palette==VIDEO_PALETTE_YUV420P)
-        arMalloc( vid->videoBuffer, ARUint8, vid->width*vid->height*3 );
+        arMallocImage( vid->videoBuffer, ARUint8, vid->width*vid->height*3, AR_MEM_VIDEO );
 
     if( vid->debug ) { 
         if(ioctl(vid->fd, VIDIOCGPICT, &vp)) {
@@ -504,6 +550,7 @@ AR2VideoParamT *ar2VideoOpen( char *config_in )
 #ifdef USE_EYETOY
     JPEGToRGBInit(vid->width,vid->height);
 #endif
+    vid->lease = videoLeaseCreate();
     return vid;
 }
 
@@ -514,7 +561,8 @@ int ar2VideoClose( AR2VideoParamT *vid )
     }
     close(vid->fd);
     if(vid->videoBuffer!=NULL)
-        free(vid->videoBuffer);
+        arImageFree(vid->videoBuffer);
+    videoLeaseDelete( vid->lease );
     free( vid );
 
     return 0;
@@ -538,6 +586,11 @@ int ar2VideoCapStart( AR2VideoParamT *vid )
         return -1;
     }
 
+    if( vid->thread ) {
+        vid->capture = videoCaptureStart( vid, ar2VideoGrabV4L, ar2VideoCapNextV4L,
+                                          vid->width * vid->height * AR_PIX_SIZE_DEFAULT );
+    }
+
     return 0;
 }
 
@@ -548,6 +601,16 @@ int ar2VideoCapNext( AR2VideoParamT *vid )
         return -1;
     }
 
+    videoLeaseImage( vid->lease, NULL, 0 );
+    if( vid->capture != NULL ) return 0;
+
+    return ar2VideoCapNextV4L( vid );
+}
+
+static int ar2VideoCapNextV4L( void *v )
+{
+    AR2VideoParamT *vid = (AR2VideoParamT *)v;
+
     vid->vmm.frame = 1 - vid->vmm.frame;
     ioctl(vid->fd, VIDIOCMCAPTURE, &vid->vmm);
 
@@ -560,6 +623,8 @@ int ar2VideoCapStop( AR2VideoParamT *vid )
         printf("arVideoCapStart has never been called.\n");
         return -1;
     }
+    videoCaptureStop( vid->capture );
+    vid->capture = NULL;
     if(ioctl(vid->fd, VIDIOCSYNC, &vid->video_cont_num) < 0){
         printf("error: videosync\n");
         return -1;
@@ -571,6 +636,28 @@ int ar2VideoCapStop( AR2VideoParamT *vid )
 
 
 ARUint8 *ar2VideoGetImage( AR2VideoParamT *vid )
+{
+    ARUint8   *buf;
+    long long  time = 0;
+
+    if( vid->capture != NULL ) buf = videoCaptureImage( vid->capture, &time );
+     else                      buf = ar2VideoGetImageV4L( vid );
+    if( buf != NULL ) videoLeaseImage( vid->lease, buf, time );
+
+    return buf;
+}
+
+static ARUint8 *ar2VideoGrabV4L( void *vid, long long *time )
+{
+    ARUint8   *buf;
+
+    buf = ar2VideoGetImageV4L( (AR2VideoParamT *)vid );
+    *time = videoTimeMonotonic();
+
+    return buf;
+}
+
+static ARUint8 *ar2VideoGetImageV4L( AR2VideoParamT *vid )
 {
     ARUint8 *buf;
 
@@ -593,9 +680,9 @@ ARUint8 *ar2VideoGetImage( AR2VideoParamT *vid )
     if(vid->palette == VIDEO_PALETTE_YUV420P)
     {
 
-        ccvt_420p_bgr24(vid->width, vid->height, buf, buf+(vid->width*vid->height),
+        videoConvYUV420pToBGR24(buf, buf+(vid->width*vid->height),
 	 	        buf+(vid->width*vid->height)+(vid->width*vid->height)/4,
-		        vid->videoBuffer);
+		        vid->videoBuffer, vid->width, vid->height);
         return vid->videoBuffer;
     }
 #ifdef USE_EYETOY
@@ -613,3 +700,27 @@ int ar2VideoInqSize(AR2VideoParamT *vid, int *x,int *y)
 
     return 0;
 }
+
+int ar2VideoLeaseFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    int     x, y;
+
+    ar2VideoInqSize( vid, &x, &y );
+
+    return videoLeaseFrame( vid->lease, frame, x, y, x * AR_PIX_SIZE_DEFAULT );
+}
+
+int ar2VideoRetainFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    return videoLeaseRetain( vid->lease, frame );
+}
+
+int ar2VideoReleaseFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    return videoLeaseRelease( vid->lease, frame );
+}
+
+int ar2VideoInqFrameInfo( AR2VideoParamT *vid, long long *time, unsigned long *n )
+{
+    return videoLeaseInqFrameInfo( vid->lease, time, n );
+}
@@ -0,0 +1,905 @@
+/*
+ *   Video capture subrutine for Linux/Video4Linux2 devices
+ *
+ *   The frames are streamed into a ring of driver buffers
+ *   (VIDIOC_QBUF/VIDIOC_DQBUF). The buffers are memory mapped,
+ *   and with -io=dmabuf also exported as DMABUF descriptors for
+ *   the GPU. YUYV, UYVY, NV12, GREY, RGB24 and BGR24 frames are
+ *   handed out in place; MJPEG frames are decoded with libjpeg
+ *   (the SIMD decoder of libjpeg-turbo where installed) into an
+ *   image of their buffer, with -decode=luma only the Y plane.
+ *
+ *   A dequeued buffer stays out of the ring until the next
+ *   ar2VideoCapNext() or ar2VideoGetImage(), or, once leased with
+ *   ar2VideoLeaseFrame(), until its last ar2VideoReleaseFrame().
+ */
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <pthread.h>
+#include <time.h>
+#include <linux/types.h>
+#include <linux/videodev2.h>
+#include <jpeglib.h>
+#include <AR/config.h>
+#include <AR/ar.h>
+#include <AR/video.h>
+
+typedef struct {
+    struct jpeg_error_mgr   pub;
+    jmp_buf                 jump;
+} JpegError;
+
+static AR2VideoParamT   *gVid = NULL;
+
+static int  xioctl( int fd, unsigned long request, void *arg );
+static int  set_control( AR2VideoParamT *vid, unsigned int id, double value );
+static int  set_value( AR2VideoParamT *vid, unsigned int id, int value );
+static int  queue_buffer( AR2VideoParamT *vid, int index );
+static int  give_back( AR2VideoParamT *vid, int index );
+static void free_buffers( AR2VideoParamT *vid );
+static int  decode_mjpeg( AR2VideoParamT *vid, ARUint8 *data, int size, ARUint8 *image );
+static void jpeg_error_exit( j_common_ptr cinfo );
+
+int arVideoDispOption( void )
+{
+    return  ar2VideoDispOption();
+}
+
+int arVideoOpen( char *config )
+{
+    if( gVid != NULL ) {
+        printf("Device has been opened!!\n");
+        return -1;
+    }
+    gVid = ar2VideoOpen( config );
+    if( gVid == NULL ) return -1;
+
+    return 0;
+}
+
+int arVideoClose( void )
+{
+    int result;
+
+    if( gVid == NULL ) return -1;
+
+    result = ar2VideoClose(gVid);
+    gVid = NULL;
+    return (result);
+}
+
+int arVideoInqSize( int *x, int *y )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoInqSize( gVid, x, y );
+}
+
+ARUint8 *arVideoGetImage( void )
+{
+    if( gVid == NULL ) return NULL;
+
+    return ar2VideoGetImage( gVid );
+}
+
+int arVideoCapStart( void )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoCapStart( gVid );
+}
+
+int arVideoCapStop( void )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoCapStop( gVid );
+}
+
+int arVideoCapNext( void )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoCapNext( gVid );
+}
+
+int arVideoLeaseFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoLeaseFrame( gVid, frame );
+}
+
+int arVideoRetainFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoRetainFrame( gVid, frame );
+}
+
+int arVideoReleaseFrame( ARVideoFrame *frame )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoReleaseFrame( gVid, frame );
+}
+
+int arVideoInqFrameInfo( long long *time, unsigned long *n )
+{
+    if( gVid == NULL ) return -1;
+
+    return ar2VideoInqFrameInfo( gVid, time, n );
+}
+
+long long arVideoTime( void )
+{
+    struct timespec  ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*-------------------------------------------*/
+
+int ar2VideoDispOption( void )
+{
+    printf("ARVideo may be configured using one or more of the following options,\n");
+    printf("separated by a space:\n\n");
+    printf("DEVICE CONTROLS:\n");
+    printf(" -dev=filepath\n");
+    printf("    specifies device file.\n");
+    printf(" -channel=N\n");
+    printf("    specifies source channel.\n");
+    printf(" -width=N\n");
+    printf("    specifies expected width of image.\n");
+    printf(" -height=N\n");
+    printf("    specifies expected height of image.\n");
+    printf(" -format=[YUYV|UYVY|NV12|GREY|RGB24|BGR24|MJPEG]\n");
+    printf("    specifies the pixel format of the camera.\n");
+    printf(" -decode=[rgb|luma]\n");
+    printf("    rgb: MJPEG frames decoded to RGB, luma: only their Y plane (MONO).\n");
+    printf(" -io=[mmap|dmabuf]\n");
+    printf("    mmap: memory mapped buffers, dmabuf: also exported as DMABUF.\n");
+    printf(" -buffers=N\n");
+    printf("    specifies the number of buffers of the capture ring (2 <-> %d).\n", AR_VIDEO_V4L2_BUFFERS_MAX);
+    printf("IMAGE CONTROLS (WARNING: every options are not supported by all camera !!):\n");
+    printf(" -brightness=N\n");
+    printf("    specifies brightness. (0.0 <-> 1.0)\n");
+    printf(" -contrast=N\n");
+    printf("    specifies contrast. (0.0 <-> 1.0)\n");
+    printf(" -saturation=N\n");
+    printf("    specifies saturation (color). (0.0 <-> 1.0) (for color camera only)\n");
+    printf(" -hue=N\n");
+    printf("    specifies hue. (0.0 <-> 1.0) (for color camera only)\n");
+    printf("\n");
+
+    return 0;
+}
+
+AR2VideoParamT *ar2VideoOpen( char *config_in )
+{
+    AR2VideoParamT              *vid;
+    struct v4l2_capability      cap;
+    struct v4l2_format          fmt;
+    struct v4l2_requestbuffers  req;
+    struct v4l2_buffer          buf;
+    struct v4l2_exportbuffer    exp;
+    char                        *config, *a, line[256];
+    unsigned int                caps;
+    int                         i;
+
+    /* If no config string is supplied, we should use the environment variable, otherwise set a sane default */
+    if (!config_in || !(config_in[0])) {
+        /* None suppplied, lets see if the user supplied one from the shell */
+        char *envconf = getenv ("ARTOOLKIT_CONFIG");
+        if (envconf && envconf[0]) {
+            config = envconf;
+            printf ("Using config string from environment [%s].\n", envconf);
+        } else {
+            config = NULL;
+            printf ("No video config string supplied, using defaults.\n");
+        }
+    } else {
+        config = config_in;
+        printf ("Using supplied video config string [%s].\n", config_in);
+    }
+
+    arMalloc( vid, AR2VideoParamT, 1 );
+    memset( vid, 0, sizeof(AR2VideoParamT) );
+    strcpy( vid->dev, DEFAULT_VIDEO_DEVICE );
+    vid->channel    = -1;
+    vid->width      = DEFAULT_VIDEO_WIDTH;
+    vid->height     = DEFAULT_VIDEO_HEIGHT;
+    vid->format     = V4L2_PIX_FMT_YUYV;
+    vid->io         = AR_VIDEO_V4L2_IO_MMAP;
+    vid->decode     = AR_VIDEO_V4L2_DECODE_RGB;
+    vid->buffer_num = DEFAULT_VIDEO_BUFFERS;
+    vid->contrast   = -1.;
+    vid->brightness = -1.;
+    vid->saturation = -1.;
+    vid->hue        = -1.;
+    vid->debug      = 0;
+    vid->fd         = -1;
+    vid->current    = -1;
+    for( i = 0; i < AR_VIDEO_V4L2_BUFFERS_MAX; i++ ) vid->buffer[i].dmabuf_fd = -1;
+    pthread_mutex_init( &vid->mutex, NULL );
+
+    a = config;
+    if( a != NULL) {
+        for(;;) {
+            while( *a == ' ' || *a == '\t' ) a++;
+            if( *a == '\0' ) break;
+            if( strncmp( a, "-dev=", 5 ) == 0 ) {
+                sscanf( a, "%s", line );
+                if( sscanf( &line[5], "%s", vid->dev ) == 0 ) {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-channel=", 9 ) == 0 ) {
+                sscanf( a, "%s", line );
+                if( sscanf( &line[9], "%d", &vid->channel ) == 0 ) {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-width=", 7 ) == 0 ) {
+                sscanf( a, "%s", line );
+                if( sscanf( &line[7], "%d", &vid->width ) == 0 ) {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-height=", 8 ) == 0 ) {
+                sscanf( a, "%s", line );
+                if( sscanf( &line[8], "%d", &vid->height ) == 0 ) {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-format=", 8 ) == 0 ) {
+                if(      strncmp( &a[8], "YUYV", 4 ) == 0 )  vid->format = V4L2_PIX_FMT_YUYV;
+                else if( strncmp( &a[8], "UYVY", 4 ) == 0 )  vid->format = V4L2_PIX_FMT_UYVY;
+                else if( strncmp( &a[8], "NV12", 4 ) == 0 )  vid->format = V4L2_PIX_FMT_NV12;
+                else if( strncmp( &a[8], "GREY", 4 ) == 0 )  vid->format = V4L2_PIX_FMT_GREY;
+                else if( strncmp( &a[8], "RGB24", 5 ) == 0 ) vid->format = V4L2_PIX_FMT_RGB24;
+                else if( strncmp( &a[8], "BGR24", 5 ) == 0 ) vid->format = V4L2_PIX_FMT_BGR24;
+                else if( strncmp( &a[8], "MJPEG", 5 ) == 0 ) vid->format = V4L2_PIX_FMT_MJPEG;
+                else {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-decode=", 8 ) == 0 ) {
+                if(      strncmp( &a[8], "rgb", 3 ) == 0 )  vid->decode = AR_VIDEO_V4L2_DECODE_RGB;
+                else if( strncmp( &a[8], "luma", 4 ) == 0 ) vid->decode = AR_VIDEO_V4L2_DECODE_LUMA;
+                else {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-io=", 4 ) == 0 ) {
+                if(      strncmp( &a[4], "mmap", 4 ) == 0 )   vid->io = AR_VIDEO_V4L2_IO_MMAP;
+                else if( strncmp( &a[4], "dmabuf", 6 ) == 0 ) vid->io = AR_VIDEO_V4L2_IO_DMABUF;
+                else {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-buffers=", 9 ) == 0 ) {
+                sscanf( a, "%s", line );
+                if( sscanf( &line[9], "%d", &vid->buffer_num ) == 0
+                 || vid->buffer_num < 2 || vid->buffer_num > AR_VIDEO_V4L2_BUFFERS_MAX ) {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-contrast=", 10 ) == 0 ) {
+                sscanf( a, "%s", line );
+                if( sscanf( &line[10], "%lf", &vid->contrast ) == 0 ) {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-brightness=", 12 ) == 0 ) {
+                sscanf( a, "%s", line );
+                if( sscanf( &line[12], "%lf", &vid->brightness ) == 0 ) {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-saturation=", 12 ) == 0 ) {
+                sscanf( a, "%s", line );
+                if( sscanf( &line[12], "%lf", &vid->saturation ) == 0 ) {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-hue=", 5 ) == 0 ) {
+                sscanf( a, "%s", line );
+                if( sscanf( &line[5], "%lf", &vid->hue ) == 0 ) {
+                    ar2VideoDispOption();
+                    free( vid );
+                    return 0;
+                }
+            }
+            else if( strncmp( a, "-debug", 6 ) == 0 ) {
+                vid->debug = 1;
+            }
+            else {
+                ar2VideoDispOption();
+                free( vid );
+                return 0;
+            }
+
+            while( *a != ' ' && *a != '\t' && *a != '\0') a++;
+        }
+    }
+
+    /* Non blocking, so that ar2VideoGetImage() returns NULL when no frame is ready. */
+    vid->fd = open(vid->dev, O_RDWR | O_NONBLOCK);
+    if(vid->fd < 0){
+        printf("video device (%s) open failed\n",vid->dev);
+        free( vid );
+        return 0;
+    }
+
+    if(xioctl(vid->fd, VIDIOC_QUERYCAP, &cap) < 0){
+        printf("error: %s is no V4L2 device\n", vid->dev);
+        close( vid->fd );
+        free( vid );
+        return 0;
+    }
+    caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS)? cap.device_caps: cap.capabilities;
+    if( !(caps & V4L2_CAP_VIDEO_CAPTURE) || !(caps & V4L2_CAP_STREAMING) ) {
+        printf("error: %s does not support streaming capture\n", vid->dev);
+        close( vid->fd );
+        free( vid );
+        return 0;
+    }
+
+    if( vid->debug ) {
+        printf("=== debug info ===\n");
+        printf("  cap.driver   =   %s\n", cap.driver);
+        printf("  cap.card     =   %s\n", cap.card);
+        printf("  cap.bus_info =   %s\n", cap.bus_info);
+    }
+
+    if( vid->channel >= 0 && xioctl(vid->fd, VIDIOC_S_INPUT, &vid->channel) < 0 ) {
+        printf("error: selecting channel %d\n", vid->channel);
+        close( vid->fd );
+        free( vid );
+        return 0;
+    }
+
+    /* set the format, the driver may adjust the size */
+    memset( &fmt, 0, sizeof(fmt) );
+    fmt.type                = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    fmt.fmt.pix.width       = vid->width;
+    fmt.fmt.pix.height      = vid->height;
+    fmt.fmt.pix.pixelformat = vid->format;
+    fmt.fmt.pix.field       = V4L2_FIELD_NONE;
+    if( xioctl(vid->fd, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != vid->format ) {
+        printf("error: setting configuration !! bad pixel format..\n TIPS:try other pixel format with -format=\n");
+        close( vid->fd );
+        free( vid );
+        return 0;
+    }
+    if( (int)fmt.fmt.pix.width != vid->width || (int)fmt.fmt.pix.height != vid->height ) {
+        printf("arVideoOpen: width/height adjusted to (%d, %d)\n", fmt.fmt.pix.width, fmt.fmt.pix.height);
+    }
+    vid->width  = fmt.fmt.pix.width;
+    vid->height = fmt.fmt.pix.height;
+    vid->stride = fmt.fmt.pix.bytesperline;
+
+    if( vid->debug ) {
+        printf("=== debug info ===\n");
+        printf("  width        =   %d\n", vid->width);
+        printf("  height       =   %d\n", vid->height);
+        printf("  bytesperline =   %d\n", vid->stride);
+        printf("  sizeimage    =   %d\n", fmt.fmt.pix.sizeimage);
+    }
+
+    /* set video picture */
+    if ((vid->brightness+1.)>0.001) set_control( vid, V4L2_CID_BRIGHTNESS, vid->brightness );
+    if ((vid->contrast+1.)>0.001)   set_control( vid, V4L2_CID_CONTRAST,   vid->contrast );
+    if ((vid->saturation+1.)>0.001) set_control( vid, V4L2_CID_SATURATION, vid->saturation );
+    if ((vid->hue+1.)>0.001)        set_control( vid, V4L2_CID_HUE,        vid->hue );
+
+    /* allocate the capture ring */
+    memset( &req, 0, sizeof(req) );
+    req.count  = vid->buffer_num;
+    req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    req.memory = V4L2_MEMORY_MMAP;
+    if( xioctl(vid->fd, VIDIOC_REQBUFS, &req) < 0 ) {
+        printf("error: requesting %d buffers\n", vid->buffer_num);
+        close( vid->fd );
+        free( vid );
+        return 0;
+    }
+    if( req.count < 2 ) {
+        printf("this device can not be supported by libARvideo.\n");
+        printf("(buffers < 2)\n");
+        close( vid->fd );
+        free( vid );
+        return 0;
+    }
+    if( req.count > AR_VIDEO_V4L2_BUFFERS_MAX ) req.count = AR_VIDEO_V4L2_BUFFERS_MAX;
+    vid->buffer_num = req.count;
+
+    for( i = 0; i < vid->buffer_num; i++ ) {
+        memset( &buf, 0, sizeof(buf) );
+        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        buf.index  = i;
+        if( xioctl(vid->fd, VIDIOC_QUERYBUF, &buf) < 0 ) {
+            printf("error: querying buffer %d\n", i);
+            free_buffers( vid );
+            free( vid );
+            return 0;
+        }
+        vid->buffer[i].length = buf.length;
+        vid->buffer[i].start  = (ARUint8 *)mmap(NULL, buf.length, PROT_READ|PROT_WRITE,
+                                                MAP_SHARED, vid->fd, buf.m.offset);
+        if( vid->buffer[i].start == MAP_FAILED ) {
+            printf("error: mmap\n");
+            vid->buffer[i].start = NULL;
+            free_buffers( vid );
+            free( vid );
+            return 0;
+        }
+
+        if( vid->io == AR_VIDEO_V4L2_IO_DMABUF ) {
+            memset( &exp, 0, sizeof(exp) );
+            exp.type  = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+            exp.index = i;
+            exp.flags = O_RDONLY | O_CLOEXEC;
+            if( xioctl(vid->fd, VIDIOC_EXPBUF, &exp) < 0 ) {
+                printf("error: exporting buffer %d as DMABUF\n", i);
+                free_buffers( vid );
+                free( vid );
+                return 0;
+            }
+            vid->buffer[i].dmabuf_fd = exp.fd;
+        }
+    }
+
+    if( vid->debug ) {
+        printf("===== Image Buffer Info =====\n");
+        printf("   buffers =  %d\n", vid->buffer_num);
+        printf("   size    =  %d[bytes]\n", (int)vid->buffer[0].length);
+    }
+
+    if( vid->format == V4L2_PIX_FMT_MJPEG ) {
+        for( i = 0; i < vid->buffer_num; i++ ) {
+            arMalloc( vid->buffer[i].decoded, ARUint8, vid->width*vid->height*3 );
+        }
+    }
+
+    return vid;
+}
+
+int ar2VideoClose( AR2VideoParamT *vid )
+{
+    if( vid->capturing ) {
+        ar2VideoCapStop( vid );
+    }
+    free_buffers( vid );
+    pthread_mutex_destroy( &vid->mutex );
+    free( vid );
+
+    return 0;
+}
+
+int ar2VideoCapStart( AR2VideoParamT *vid )
+{
+    enum v4l2_buf_type  type;
+    int                 i;
+
+    if( vid->capturing ) {
+        printf("arVideoCapStart has already been called.\n");
+        return -1;
+    }
+
+    pthread_mutex_lock( &vid->mutex );
+    for( i = 0; i < vid->buffer_num; i++ ) {
+        if( vid->buffer[i].refs ) continue;
+        if( queue_buffer( vid, i ) < 0 ) {
+            pthread_mutex_unlock( &vid->mutex );
+            return -1;
+        }
+    }
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if( xioctl(vid->fd, VIDIOC_STREAMON, &type) < 0 ) {
+        printf("error: streamon\n");
+        pthread_mutex_unlock( &vid->mutex );
+        return -1;
+    }
+    vid->current   = -1;
+    vid->capturing = 1;
+    pthread_mutex_unlock( &vid->mutex );
+
+    return 0;
+}
+
+int ar2VideoCapNext( AR2VideoParamT *vid )
+{
+    int     i;
+
+    if( !vid->capturing ) {
+        printf("arVideoCapStart has never been called.\n");
+        return -1;
+    }
+
+    pthread_mutex_lock( &vid->mutex );
+    i = give_back( vid, vid->current );
+    vid->current = -1;
+    pthread_mutex_unlock( &vid->mutex );
+
+    return i;
+}
+
+int ar2VideoCapStop( AR2VideoParamT *vid )
+{
+    enum v4l2_buf_type  type;
+
+    if( !vid->capturing ) {
+        printf("arVideoCapStart has never been called.\n");
+        return -1;
+    }
+
+    /* STREAMOFF takes every buffer back from the driver; the leased ones stay mapped. */
+    pthread_mutex_lock( &vid->mutex );
+    type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    if( xioctl(vid->fd, VIDIOC_STREAMOFF, &type) < 0 ) {
+        printf("error: streamoff\n");
+        pthread_mutex_unlock( &vid->mutex );
+        return -1;
+    }
+    vid->current   = -1;
+    vid->capturing = 0;
+    pthread_mutex_unlock( &vid->mutex );
+
+    return 0;
+}
+
+ARUint8 *ar2VideoGetImage( AR2VideoParamT *vid )
+{
+    struct v4l2_buffer  buf;
+    int                 index, size;
+
+    if( !vid->capturing ) {
+        printf("arVideoCapStart has never been called.\n");
+        return NULL;
+    }
+
+    /* Drain the ring and keep the newest frame, giving the older ones back. */
+    pthread_mutex_lock( &vid->mutex );
+    index = -1;
+    size  = 0;
+    for(;;) {
+        memset( &buf, 0, sizeof(buf) );
+        buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if( xioctl(vid->fd, VIDIOC_DQBUF, &buf) < 0 ) {
+            if( errno == EAGAIN ) break;
+            printf("error: dqbuf\n");
+            pthread_mutex_unlock( &vid->mutex );
+            return NULL;
+        }
+        if( buf.flags & V4L2_BUF_FLAG_ERROR ) {
+            queue_buffer( vid, buf.index );
+            continue;
+        }
+        if( index >= 0 ) queue_buffer( vid, index );
+        index = buf.index;
+        size  = buf.bytesused;
+        vid->buffer[index].n    = buf.sequence;
+        /* the driver stamps on CLOCK_MONOTONIC, older ones on the wall clock */
+        if( (buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC ) {
+            vid->buffer[index].time = (long long)buf.timestamp.tv_sec * 1000000 + buf.timestamp.tv_usec;
+        }
+        else {
+            vid->buffer[index].time = arVideoTime();
+        }
+    }
+    if( index < 0 ) {
+        pthread_mutex_unlock( &vid->mutex );
+        return NULL;
+    }
+
+    give_back( vid, vid->current );
+    vid->current = index;
+    vid->n       = vid->buffer[index].n;
+    vid->time    = vid->buffer[index].time;
+    pthread_mutex_unlock( &vid->mutex );
+
+    if( vid->format == V4L2_PIX_FMT_MJPEG ) {
+        if( decode_mjpeg( vid, vid->buffer[index].start, size, vid->buffer[index].decoded ) < 0 ) return NULL;
+        return vid->buffer[index].decoded;
+    }
+
+    return vid->buffer[index].start;
+}
+
+int ar2VideoInqSize(AR2VideoParamT *vid, int *x,int *y)
+{
+    *x = vid->width;
+    *y = vid->height;
+
+    return 0;
+}
+
+int ar2VideoInqPixelFormat( AR2VideoParamT *vid, int *format, int *stride )
+{
+    int     f, s;
+
+    s = vid->stride;
+    switch( vid->format ) {
+        case V4L2_PIX_FMT_YUYV:  f = AR_PIXEL_FORMAT_yuvs; break;
+        case V4L2_PIX_FMT_UYVY:  f = AR_PIXEL_FORMAT_2vuy; break;
+        case V4L2_PIX_FMT_NV12:  f = AR_PIXEL_FORMAT_MONO; break;
+        case V4L2_PIX_FMT_GREY:  f = AR_PIXEL_FORMAT_MONO; break;
+        case V4L2_PIX_FMT_RGB24: f = AR_PIXEL_FORMAT_RGB;  break;
+        case V4L2_PIX_FMT_BGR24: f = AR_PIXEL_FORMAT_BGR;  break;
+        case V4L2_PIX_FMT_MJPEG:
+            if( vid->decode == AR_VIDEO_V4L2_DECODE_LUMA ) { f = AR_PIXEL_FORMAT_MONO; s = vid->width; }
+             else                                          { f = AR_PIXEL_FORMAT_RGB;  s = vid->width*3; }
+            break;
+        default: return -1;
+    }
+    if( format != NULL ) *format = f;
+    if( stride != NULL ) *stride = s;
+
+    return 0;
+}
+
+int ar2VideoSetControl( AR2VideoParamT *vid, int control, double value )
+{
+    if( vid == NULL ) return -1;
+
+    switch( control ) {
+        case AR_VIDEO_CONTROL_EXPOSURE:
+            // UVC webcams have aperture priority as their automatic mode.
+            if( value < 0.0 ) {
+                if( set_value( vid, V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_APERTURE_PRIORITY ) == 0 ) return 0;
+                return set_value( vid, V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_AUTO );
+            }
+            set_value( vid, V4L2_CID_EXPOSURE_AUTO, V4L2_EXPOSURE_MANUAL );
+            return set_control( vid, V4L2_CID_EXPOSURE_ABSOLUTE, value );
+        case AR_VIDEO_CONTROL_GAIN:
+            if( value < 0.0 ) return set_value( vid, V4L2_CID_AUTOGAIN, 1 );
+            set_value( vid, V4L2_CID_AUTOGAIN, 0 );
+            return set_control( vid, V4L2_CID_GAIN, value );
+    }
+
+    return -1;
+}
+
+int ar2VideoLeaseFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    AR2VideoBufferV4L2T *b;
+
+    pthread_mutex_lock( &vid->mutex );
+    if( vid->current < 0 ) {
+        pthread_mutex_unlock( &vid->mutex );
+        return -1;
+    }
+    b = &vid->buffer[vid->current];
+    b->refs++;
+    frame->buff  = (b->decoded != NULL)? b->decoded: b->start;
+    frame->time  = b->time;
+    frame->xsize = vid->width;
+    frame->ysize = vid->height;
+    frame->n     = b->n;
+    frame->id    = vid->current;
+    pthread_mutex_unlock( &vid->mutex );
+    ar2VideoInqPixelFormat( vid, &frame->format, &frame->stride );
+
+    return 0;
+}
+
+int ar2VideoRetainFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    int     i = frame->id;
+
+    pthread_mutex_lock( &vid->mutex );
+    if( i < 0 || i >= vid->buffer_num || vid->buffer[i].refs == 0 || vid->buffer[i].n != frame->n ) {
+        pthread_mutex_unlock( &vid->mutex );
+        return -1;
+    }
+    vid->buffer[i].refs++;
+    pthread_mutex_unlock( &vid->mutex );
+
+    return 0;
+}
+
+int ar2VideoReleaseFrame( AR2VideoParamT *vid, ARVideoFrame *frame )
+{
+    int     i = frame->id;
+    int     ret = 0;
+
+    pthread_mutex_lock( &vid->mutex );
+    if( i < 0 || i >= vid->buffer_num || vid->buffer[i].refs == 0 || vid->buffer[i].n != frame->n ) {
+        pthread_mutex_unlock( &vid->mutex );
+        return -1;
+    }
+    vid->buffer[i].refs--;
+    if( i != vid->current ) ret = give_back( vid, i );
+    pthread_mutex_unlock( &vid->mutex );
+
+    return ret;
+}
+
+int ar2VideoInqFrameInfo( AR2VideoParamT *vid, long long *time, unsigned long *n )
+{
+    pthread_mutex_lock( &vid->mutex );
+    if( vid->time == 0 ) {
+        pthread_mutex_unlock( &vid->mutex );
+        return -1;
+    }
+    if( time != NULL ) *time = vid->time;
+    if( n != NULL ) *n = vid->n;
+    pthread_mutex_unlock( &vid->mutex );
+
+    return 0;
+}
+
+/*-------------------------------------------*/
+
+static int xioctl( int fd, unsigned long request, void *arg )
+{
+    int     r;
+
+    do {
+        r = ioctl( fd, request, arg );
+    } while( r < 0 && errno == EINTR );
+
+    return r;
+}
+
+/* Sets a control from a value in 0.0 <-> 1.0 of its range. */
+static int set_control( AR2VideoParamT *vid, unsigned int id, double value )
+{
+    struct v4l2_queryctrl   query;
+
+    memset( &query, 0, sizeof(query) );
+    query.id = id;
+    if( xioctl(vid->fd, VIDIOC_QUERYCTRL, &query) < 0
+     || (query.flags & V4L2_CTRL_FLAG_DISABLED) ) {
+        if( vid->debug ) printf("control 0x%08x is not supported\n", id);
+        return -1;
+    }
+
+    if( set_value( vid, id, query.minimum + (int)(value * (query.maximum - query.minimum) + 0.5) ) < 0 ) {
+        printf("error: setting control 0x%08x\n", id);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Sets a control, or a menu control, to a value of its own. */
+static int set_value( AR2VideoParamT *vid, unsigned int id, int value )
+{
+    struct v4l2_control     ctrl;
+
+    ctrl.id    = id;
+    ctrl.value = value;
+    if( xioctl(vid->fd, VIDIOC_S_CTRL, &ctrl) < 0 ) return -1;
+
+    return 0;
+}
+
+/* Queues a dequeued buffer again once nothing holds it, vid->mutex held. */
+static int give_back( AR2VideoParamT *vid, int index )
+{
+    if( index < 0 || vid->buffer[index].refs || !vid->capturing ) return 0;
+
+    return queue_buffer( vid, index );
+}
+
+static int queue_buffer( AR2VideoParamT *vid, int index )
+{
+    struct v4l2_buffer  buf;
+
+    memset( &buf, 0, sizeof(buf) );
+    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    buf.index  = index;
+    if( xioctl(vid->fd, VIDIOC_QBUF, &buf) < 0 ) {
+        printf("error: qbuf %d\n", index);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void free_buffers( AR2VideoParamT *vid )
+{
+    int     i;
+
+    for( i = 0; i < AR_VIDEO_V4L2_BUFFERS_MAX; i++ ) {
+        if( vid->buffer[i].dmabuf_fd >= 0 ) close( vid->buffer[i].dmabuf_fd );
+        if( vid->buffer[i].start != NULL ) munmap( vid->buffer[i].start, vid->buffer[i].length );
+        free( vid->buffer[i].decoded );
+        vid->buffer[i].dmabuf_fd = -1;
+        vid->buffer[i].start     = NULL;
+        vid->buffer[i].decoded   = NULL;
+    }
+    if( vid->fd >= 0 ) close( vid->fd );
+    vid->fd = -1;
+}
+
+static int decode_mjpeg( AR2VideoParamT *vid, ARUint8 *data, int size, ARUint8 *image )
+{
+    struct jpeg_decompress_struct   cinfo;
+    JpegError                       jerr;
+    JSAMPROW                        row[4];
+    int                             pix, i, m, n;
+
+    cinfo.err = jpeg_std_error( &jerr.pub );
+    jerr.pub.error_exit = jpeg_error_exit;
+    if( setjmp( jerr.jump ) ) {
+        /* A damaged frame is dropped. */
+        jpeg_destroy_decompress( &cinfo );
+        return -1;
+    }
+    jpeg_create_decompress( &cinfo );
+    jpeg_mem_src( &cinfo, data, size );
+    jpeg_read_header( &cinfo, TRUE );
+    /* the luma plane skips the chroma, and upsampling is by replication */
+    if( vid->decode == AR_VIDEO_V4L2_DECODE_LUMA ) {
+        cinfo.out_color_space = JCS_GRAYSCALE;
+        pix = 1;
+    }
+    else {
+        cinfo.out_color_space = JCS_RGB;
+        pix = 3;
+    }
+    cinfo.dct_method          = JDCT_IFAST;
+    cinfo.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress( &cinfo );
+    if( (int)cinfo.output_width != vid->width || (int)cinfo.output_height != vid->height ) {
+        jpeg_destroy_decompress( &cinfo );
+        return -1;
+    }
+    n = (cinfo.rec_outbuf_height < 4)? cinfo.rec_outbuf_height: 4;
+    while( cinfo.output_scanline < cinfo.output_height ) {
+        m = cinfo.output_height - cinfo.output_scanline;
+        if( m > n ) m = n;
+        for( i = 0; i < m; i++ ) {
+            row[i] = image + (cinfo.output_scanline + i) * vid->width * pix;
+        }
+        jpeg_read_scanlines( &cinfo, row, m );
+    }
+    jpeg_finish_decompress( &cinfo );
+    jpeg_destroy_decompress( &cinfo );
+
+    return 0;
+}
+
+static void jpeg_error_exit( j_common_ptr cinfo )
+{
+    longjmp( ((JpegError *)cinfo->err)->jump, 1 );
+}
@@ -90,6 +90,7 @@
 #include <AR/ar.h>
 #include <AR/video.h>
 #include "videoInternal.h"
+#include "../VideoCommon/videoLease.h"
 
 // ============================================================================
 //	Private definitions
@@ -174,6 +175,8 @@ struct _AR2VideoParamT {
 	Fixed					frameRate;		// DH (seeSaw).
 	long					bytesPerSecond; // DH (seeSaw).
 	ImageDescriptionHandle  vdImageDesc;	// DH (seeSaw).
+	struct VideoLeasePool  *lease;			// Copies of leased frames.
+	long long				frameTime;		// Capture time of the frame ready (arVideoTime() clock).
 };
 typedef struct _AR2VideoParamT *AR2VideoParamTRef;
 
@@ -926,6 +929,39 @@ int arVideoCapNext(void)
     return (ar2VideoCapNext(gVid)); 
 }
 
+int arVideoLeaseFrame(ARVideoFrame *frame)
+{
+    if (gVid == NULL) return (-1);
+
+    return (ar2VideoLeaseFrame(gVid, frame));
+}
+
+int arVideoRetainFrame(ARVideoFrame *frame)
+{
+    if (gVid == NULL) return (-1);
+
+    return (ar2VideoRetainFrame(gVid, frame));
+}
+
+int arVideoReleaseFrame(ARVideoFrame *frame)
+{
+    if (gVid == NULL) return (-1);
+
+    return (ar2VideoReleaseFrame(gVid, frame));
+}
+
+int arVideoInqFrameInfo(long long *time, unsigned long *n)
+{
+    if (gVid == NULL) return (-1);
+
+    return (ar2VideoInqFrameInfo(gVid, time, n));
+}
+
+long long arVideoTime(void)
+{
+    return (videoTimeMonotonic());
+}
+
 #pragma mark -
 static int ar2VideoInternalLock(pthread_mutex_t *mutex)
 {
@@ -1002,7 +1038,7 @@ static void *ar2VideoInternalThread(void *arg)
 	ComponentResult		err;
 	int					isUpdated = 0;
 
-	
+	arThreadRole(AR_THREAD_CAPTURE, NULL);
 #ifndef AR_VIDEO_SUPPORT_OLD_QUICKTIME
 	// Signal to QuickTime that this is a separate thread.
 	if ((err_o = EnterMoviesOnThread(0)) != noErr) {
@@ -1131,6 +1167,7 @@ static void *ar2VideoInternalThread(void *arg)
 			}
 			
 			// Mark status to indicate we have a frame available.
+			vid->frameTime = videoTimeMonotonic();
 			vid->status |= AR_VIDEO_STATUS_BIT_READY;			
 		}
 #ifndef AR_VIDEO_DEBUG_FIX_DUAL_PROCESSOR_RACE		
@@ -1634,6 +1671,8 @@ AR2VideoParamT *ar2VideoOpen(char *config_in)
 	if (err_i != 0) { // Clean up component on failure to init per-vid pthread variables.
 		goto out6;
 	}
+	
+	vid->lease = videoLeaseCreate();
 
 	goto out;
 	
@@ -1727,6 +1766,8 @@ int ar2VideoClose(AR2VideoParamT *vid)
 	
 	vdgReleaseAndDealloc(vid->pVdg);
 	
+	videoLeaseDelete(vid->lease);
+	
 #ifdef AR_VIDEO_SUPPORT_OLD_QUICKTIME
 	// Release our hold on the QuickTime toolbox.
 	if (weLocked) {
@@ -1814,6 +1855,7 @@ int ar2VideoCapStart(AR2VideoParamT *vid)
 
 int ar2VideoCapNext(AR2VideoParamT *vid)
 {
+	videoLeaseImage(vid->lease, NULL, 0);
 	return (0);
 }
 
@@ -1939,6 +1981,9 @@ ARUint8 *ar2VideoGetImage(AR2VideoParamT *vid)
 
 		vid->status &= ~AR_VIDEO_STATUS_BIT_READY; // Clear ready bit.
 		
+		// Leases copy this frame until the next ar2VideoCapNext().
+		videoLeaseImage(vid->lease, pix, vid->frameTime);
+		
 		if (!ar2VideoInternalUnlock(&(vid->bufMutex))) {
 			fprintf(stderr, "ar2VideoGetImage(): Unable to unlock mutex.\n");
 			return (NULL);
@@ -1947,3 +1992,23 @@ ARUint8 *ar2VideoGetImage(AR2VideoParamT *vid)
 	
 	return (pix);
 }
+
+int ar2VideoLeaseFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	return (videoLeaseFrame(vid->lease, frame, vid->width, vid->height, (int)vid->rowBytes));
+}
+
+int ar2VideoRetainFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	return (videoLeaseRetain(vid->lease, frame));
+}
+
+int ar2VideoReleaseFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	return (videoLeaseRelease(vid->lease, frame));
+}
+
+int ar2VideoInqFrameInfo(AR2VideoParamT *vid, long long *time, unsigned long *n)
+{
+	return (videoLeaseInqFrameInfo(vid->lease, time, n));
+}
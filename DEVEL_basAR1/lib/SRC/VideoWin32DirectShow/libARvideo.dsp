@@ -96,6 +96,10 @@ LINK32=xilink6.exe
 # PROP Default_Filter ""
 # Begin Source File
 
+SOURCE=..\VideoCommon\videoRecord.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\videoWin32DirectShow.cpp
 # End Source File
 # End Group
@@ -44,14 +44,27 @@
 #include <AR/video.h>
 #include <stdlib.h>
 #include "comutil.h"
+#include <dshow.h>
 
 // -----------------------------------------------------------------------------------------------------------------
 
+// A buffer handed over from ar2VideoGetImage() to ar2VideoLeaseFrame().
+typedef struct {
+	MemoryBufferHandle  handle;
+	unsigned char		*buff;
+	long long			time;
+	int					refs;
+} AR2VideoLeaseT;
+
 struct _AR2VideoParamT {
 	DSVL_VideoSource	*graphManager;
 	MemoryBufferHandle  g_Handle;
 	bool				bufferCheckedOut;
 	__int64				g_Timestamp; // deprecated, use (g_Handle.t) instead.
+	unsigned char		*pixelBuffer; // of g_Handle.
+	long long			time;		  // arVideoTime() when g_Handle was checked out, 0 before.
+	CRITICAL_SECTION	leaseLock;
+	AR2VideoLeaseT		lease[AR_VIDEO_LEASE_MAX];
 	//bool flip_horizontal = false; // deprecated.
 	//bool flip_vertical = false;   // deprecated.
 };
@@ -65,8 +78,8 @@ static const bool		FLIPPED_defined =  true;		// deprecated
 #else
 static const bool		FLIPPED_defined =  false;		// deprecated
 #endif
-const long				frame_timeout_ms = 0L;	// set to INFINITE if arVideoGetImage()
-														// is called from a separate worker thread
+const long				frame_timeout_ms = 100L;	// arVideoGetImage() is called from a separate
+														// capture thread; bounded so that it can be stopped
 
 // -----------------------------------------------------------------------------------------------------------------
 
@@ -133,6 +146,58 @@ int arVideoCapNext(void)
     return (ar2VideoCapNext(gVid)); 
 }
 
+int arVideoInqPixelFormat(int *format, int *stride)
+{
+    if (gVid == NULL) return (-1);
+
+    return (ar2VideoInqPixelFormat(gVid, format, stride));
+}
+
+int arVideoSetControl(int control, double value)
+{
+    if (gVid == NULL) return (-1);
+
+    return (ar2VideoSetControl(gVid, control, value));
+}
+
+int arVideoLeaseFrame(ARVideoFrame *frame)
+{
+    if (gVid == NULL) return (-1);
+
+    return (ar2VideoLeaseFrame(gVid, frame));
+}
+
+int arVideoRetainFrame(ARVideoFrame *frame)
+{
+    if (gVid == NULL) return (-1);
+
+    return (ar2VideoRetainFrame(gVid, frame));
+}
+
+int arVideoReleaseFrame(ARVideoFrame *frame)
+{
+    if (gVid == NULL) return (-1);
+
+    return (ar2VideoReleaseFrame(gVid, frame));
+}
+
+int arVideoInqFrameInfo(long long *time, unsigned long *n)
+{
+    if (gVid == NULL) return (-1);
+
+    return (ar2VideoInqFrameInfo(gVid, time, n));
+}
+
+long long arVideoTime(void)
+{
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER now;
+
+	if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return ((now.QuadPart / freq.QuadPart) * 1000000 + (now.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart);
+}
+
 // -----------------------------------------------------------------------------------------------------------------
 
 int ar2VideoDispOption(void)
@@ -150,6 +215,7 @@ AR2VideoParamT *ar2VideoOpen(char *config)
 	// Allocate the parameters structure and fill it in.
 	arMalloc(vid, AR2VideoParamT, 1);
 	memset(vid, 0, sizeof(AR2VideoParamT));
+	InitializeCriticalSection(&(vid->leaseLock));
 
 	CoInitialize(NULL);
 	
@@ -163,7 +229,8 @@ AR2VideoParamT *ar2VideoOpen(char *config)
 			if (FAILED(vid->graphManager->BuildGraphFromXMLFile(config))) return(NULL);
 		}
 	}
-	if (FAILED(vid->graphManager->EnableMemoryBuffer())) return(NULL);
+	// One client for ar2VideoGetImage(), the others for ar2VideoLockBuffer() and leases.
+	if (FAILED(vid->graphManager->EnableMemoryBuffer(AR_VIDEO_DSVL_CLIENTS))) return(NULL);
 
 	return (vid);
 }
@@ -172,6 +239,7 @@ AR2VideoParamT *ar2VideoOpen(char *config)
 int ar2VideoClose(AR2VideoParamT *vid)
 {
 	int _ret = -1;
+	int i;
 
 	if (vid == NULL) return (_ret);
 
@@ -179,6 +247,9 @@ int ar2VideoClose(AR2VideoParamT *vid)
 	
 		if (vid->bufferCheckedOut) 
 			vid->graphManager->CheckinMemoryBuffer(vid->g_Handle, true);
+		for (i = 0; i < AR_VIDEO_LEASE_MAX; i++) {
+			if (vid->lease[i].refs) vid->graphManager->CheckinMemoryBuffer(vid->lease[i].handle, true);
+		}
 
 		vid->graphManager->Stop();
 		delete vid->graphManager;
@@ -187,6 +258,7 @@ int ar2VideoClose(AR2VideoParamT *vid)
 		_ret = 0;
 	}
 
+	DeleteCriticalSection(&(vid->leaseLock));
 	free(vid);
 
 	// do not assume free NULL's the pointer
@@ -210,10 +282,14 @@ unsigned char *ar2VideoGetImage(AR2VideoParamT *vid)
 		if (FAILED(vid->graphManager->CheckinMemoryBuffer(vid->g_Handle))) return (NULL);
 		vid->bufferCheckedOut = false;
 	}
+	AR_TRACE_BEGIN("WaitForNextSample");
 	wait_result = vid->graphManager->WaitForNextSample(frame_timeout_ms);
+	AR_TRACE_END();
 	if (wait_result == WAIT_OBJECT_0) {
 		if (FAILED(vid->graphManager->CheckoutMemoryBuffer(&(vid->g_Handle), &pixelBuffer, NULL, NULL, NULL, &(vid->g_Timestamp)))) return(NULL);
 		vid->bufferCheckedOut = true;
+		vid->pixelBuffer = pixelBuffer;
+		vid->time = arVideoTime(); // the sample time g_Handle.t is on the graph clock.
 		return (pixelBuffer);
 	}
 
@@ -235,7 +311,7 @@ int ar2VideoCapStop(AR2VideoParamT *vid)
 	if (vid->graphManager == NULL) return (-1);
 
 	if (vid->bufferCheckedOut) {
-		if (FAILED(vid->graphManager->CheckinMemoryBuffer(vid->g_Handle, true))) return (-1);
+		if (FAILED(vid->graphManager->CheckinMemoryBuffer(vid->g_Handle))) return (-1);
 		vid->bufferCheckedOut = false;
 	}
 
@@ -252,8 +328,10 @@ int ar2VideoCapNext(AR2VideoParamT *vid)
 	if (vid == NULL) return (-1);
 	if (vid->graphManager == NULL) return (-1);
 
+	// Only the checkout of ar2VideoGetImage() is given back; a frame locked
+	// by another thread, or leased, stays checked out until its own release.
 	if (vid->bufferCheckedOut) {
-		if (FAILED(vid->graphManager->CheckinMemoryBuffer(vid->g_Handle, true))) return (-1);
+		if (FAILED(vid->graphManager->CheckinMemoryBuffer(vid->g_Handle))) return (-1);
 		vid->bufferCheckedOut = false;
 	}
 	return (0);
@@ -305,6 +383,154 @@ int ar2VideoInqFreq(AR2VideoParamT *vid, float *fps)
     return (0);
 }
 
+// With <AUTO/> in the XML config, DSVL takes the camera's YUY2 or NV12 as
+// it comes, so detection reads the luma without a colour conversion.
+int ar2VideoInqPixelFormat(AR2VideoParamT *vid, int *format, int *stride)
+{
+	long frame_width;
+	PIXELFORMAT pixel_format;
+	int f, s;
+
+	if (vid == NULL) return (-1);
+	if (vid->graphManager == NULL) return (-1);
+
+	if (FAILED(vid->graphManager->GetCurrentMediaFormat(&frame_width, NULL, NULL, &pixel_format))) return (-1);
+	switch (pixel_format) {
+		case PIXELFORMAT_YUY2:  f = AR_PIXEL_FORMAT_yuvs; s = (int)frame_width * 2; break;
+		case PIXELFORMAT_UYVY:  f = AR_PIXEL_FORMAT_2vuy; s = (int)frame_width * 2; break;
+		case PIXELFORMAT_NV12:  f = AR_PIXEL_FORMAT_MONO; s = (int)frame_width;     break; // the luma plane
+		case PIXELFORMAT_RGB24: f = AR_PIXEL_FORMAT_BGR;  s = (int)frame_width * 3; break;
+		case PIXELFORMAT_RGB32: f = AR_PIXEL_FORMAT_BGRA; s = (int)frame_width * 4; break;
+		default: return (-1);
+	}
+	if (format != NULL) *format = f;
+	if (stride != NULL) *stride = s;
+
+	return (0);
+}
+
+// Exposure through IAMCameraControl, gain through IAMVideoProcAmp, the
+// interfaces 0 and 1 of DSVL.
+int ar2VideoSetControl(AR2VideoParamT *vid, int control, double value)
+{
+	int itf;
+	long prop;
+	HRESULT hr;
+
+	if (vid == NULL) return (-1);
+	if (vid->graphManager == NULL) return (-1);
+
+	switch (control) {
+		case AR_VIDEO_CONTROL_EXPOSURE: itf = 0; prop = CameraControl_Exposure; break;
+		case AR_VIDEO_CONTROL_GAIN:     itf = 1; prop = VideoProcAmp_Gain;      break;
+		default: return (-1);
+	}
+	if (value < 0.0) hr = vid->graphManager->SetCameraParameterToDefault(itf, prop, true);
+	else hr = vid->graphManager->SetCameraParameterN(itf, prop, value);
+
+	return (FAILED(hr) ? -1 : 0);
+}
+
+// The first lease of a frame takes the buffer checked out by ar2VideoGetImage()
+// over, so that ar2VideoCapNext() leaves it alone; later leases share it.
+int ar2VideoLeaseFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	long frame_width, frame_height;
+	int i;
+	
+	if (vid == NULL) return (-1);
+	if (vid->graphManager == NULL) return (-1);
+	
+	if (FAILED(vid->graphManager->GetCurrentMediaFormat(&frame_width, &frame_height, NULL, NULL))) return (-1);
+
+	EnterCriticalSection(&(vid->leaseLock));
+	for (i = 0; i < AR_VIDEO_LEASE_MAX; i++) {
+		if (vid->lease[i].refs && vid->lease[i].handle.n == vid->g_Handle.n) break;
+	}
+	if (i == AR_VIDEO_LEASE_MAX) {
+		if (!vid->bufferCheckedOut) {
+			LeaveCriticalSection(&(vid->leaseLock));
+			return (-1);
+		}
+		for (i = 0; i < AR_VIDEO_LEASE_MAX; i++) {
+			if (!vid->lease[i].refs) break;
+		}
+		if (i == AR_VIDEO_LEASE_MAX) {
+			LeaveCriticalSection(&(vid->leaseLock));
+			printf("every frame lease is in use.\n");
+			return (-1);
+		}
+		vid->lease[i].handle = vid->g_Handle;
+		vid->lease[i].buff = vid->pixelBuffer;
+		vid->lease[i].time = vid->time;
+		vid->bufferCheckedOut = false;
+	}
+	vid->lease[i].refs++;
+	
+	frame->buff = vid->lease[i].buff;
+	frame->time = vid->lease[i].time;
+	if (ar2VideoInqPixelFormat(vid, &frame->format, &frame->stride) < 0) {
+		frame->format = AR_DEFAULT_PIXEL_FORMAT;
+		frame->stride = (int)frame_width * AR_PIX_SIZE_DEFAULT;
+	}
+	frame->xsize = (int)frame_width;
+	frame->ysize = (int)frame_height;
+	frame->n = vid->lease[i].handle.n;
+	frame->id = i;
+	LeaveCriticalSection(&(vid->leaseLock));
+	
+	return (0);
+}
+
+int ar2VideoRetainFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	int i = frame->id;
+	
+	if (vid == NULL) return (-1);
+	
+	EnterCriticalSection(&(vid->leaseLock));
+	if (i < 0 || i >= AR_VIDEO_LEASE_MAX || !vid->lease[i].refs || vid->lease[i].handle.n != frame->n) {
+		LeaveCriticalSection(&(vid->leaseLock));
+		return (-1);
+	}
+	vid->lease[i].refs++;
+	LeaveCriticalSection(&(vid->leaseLock));
+	
+	return (0);
+}
+
+int ar2VideoReleaseFrame(AR2VideoParamT *vid, ARVideoFrame *frame)
+{
+	int i = frame->id;
+	int _ret = 0;
+	
+	if (vid == NULL) return (-1);
+	if (vid->graphManager == NULL) return (-1);
+	
+	EnterCriticalSection(&(vid->leaseLock));
+	if (i < 0 || i >= AR_VIDEO_LEASE_MAX || !vid->lease[i].refs || vid->lease[i].handle.n != frame->n) {
+		LeaveCriticalSection(&(vid->leaseLock));
+		return (-1);
+	}
+	if (--vid->lease[i].refs == 0) {
+		if (FAILED(vid->graphManager->CheckinMemoryBuffer(vid->lease[i].handle))) _ret = -1;
+	}
+	LeaveCriticalSection(&(vid->leaseLock));
+	
+	return (_ret);
+}
+
+int ar2VideoInqFrameInfo(AR2VideoParamT *vid, long long *time, unsigned long *n)
+{
+	if (vid == NULL) return (-1);
+	if (vid->time == 0) return (-1);
+	
+	if (time) *time = vid->time;
+	if (n) *n = vid->g_Handle.n;
+	
+	return (0);
+}
+
 unsigned char *ar2VideoLockBuffer(AR2VideoParamT *vid, MemoryBufferHandle* pHandle)
 {
 	unsigned char *pixelBuffer;
@@ -312,8 +538,9 @@ unsigned char *ar2VideoLockBuffer(AR2VideoParamT *vid, MemoryBufferHandle* pHand
 	if (vid == NULL) return (NULL);
 	if (vid->graphManager == NULL) return (NULL);
 	
+	// A checkout of its own, independent of the one of ar2VideoGetImage(),
+	// so that e.g. a render thread can hold a frame while the next is detected.
 	if (FAILED(vid->graphManager->CheckoutMemoryBuffer(pHandle, &pixelBuffer))) return (NULL);
-	vid->bufferCheckedOut = true;
 	
 	return (pixelBuffer);
 }
@@ -324,7 +551,6 @@ int ar2VideoUnlockBuffer(AR2VideoParamT *vid, MemoryBufferHandle Handle)
 	if (vid->graphManager == NULL) return(-1);
 	
 	if (FAILED(vid->graphManager->CheckinMemoryBuffer(Handle))) return(-1);
-	vid->bufferCheckedOut = false;
 
 	return (0);
 }